@@ -0,0 +1,215 @@
+// This program compares the results of a run of the benchmarks with a
+// baseline, and fails if any benchmark regressed.
+//
+// Both files are the JSON output of Google Benchmark, i.e. what
+// `benchmarks --benchmark_out_format=json --benchmark_out=<file>` writes.  If
+// the benchmarks were repeated, the median of the repetitions is compared;
+// otherwise the single run is.
+//
+// A benchmark regressed if its CPU time per iteration exceeds the baseline's
+// by more than the tolerance, a percentage, or if its "allocations" counter
+// exceeds the baseline's by more than half an allocation.  Allocations are
+// deterministic, so they get no tolerance beyond rounding.  Benchmarks that
+// are only in one of the files are reported, but are not regressions.
+//
+// The program prints a table of the comparison and exits with status zero if
+// nothing regressed, one if something did, or two if the input is invalid.
+//
+// Usage:
+//
+//     compare_benchmarks [--tolerance=PERCENT] BASELINE RESULTS
+
+#include <datadog/json.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// `Measurement` is what's compared for one benchmark.
+struct Measurement {
+  double cpu_nanoseconds = 0;
+  std::optional<double> allocations;
+};
+
+using Measurements = std::map<std::string, Measurement>;
+
+// Return the number of nanoseconds in the specified Google Benchmark
+// `time_unit`, or return zero if the unit is unknown.
+double nanoseconds_per(std::string_view time_unit) {
+  if (time_unit == "ns") {
+    return 1;
+  }
+  if (time_unit == "us") {
+    return 1e3;
+  }
+  if (time_unit == "ms") {
+    return 1e6;
+  }
+  if (time_unit == "s") {
+    return 1e9;
+  }
+  return 0;
+}
+
+// Replace the non-finite numbers in the specified Google Benchmark `output`
+// with nulls.  Google Benchmark writes "NaN" and "Infinity", which aren't
+// JSON, for example as the coefficient of variation of a counter that's
+// always zero.
+void replace_non_finite(std::string& output) {
+  for (const std::string_view literal : {"-Infinity", "Infinity", "NaN"}) {
+    const std::string value = std::string(": ") + std::string(literal);
+    for (auto i = output.find(value); i != std::string::npos;
+         i = output.find(value, i)) {
+      output.replace(i + 2, literal.size(), "null");
+    }
+  }
+}
+
+// Read the benchmark results in the JSON file at the specified `path` into the
+// specified `measurements`.  Return zero on success, or print a diagnostic and
+// return a nonzero value if an error occurs.
+int read_measurements(Measurements& measurements, const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Unable to open " << path << '\n';
+    return 1;
+  }
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  std::string output = contents.str();
+  replace_non_finite(output);
+  const auto json = nlohmann::json::parse(output, nullptr, false);
+  if (json.is_discarded() || !json.contains("benchmarks") ||
+      !json["benchmarks"].is_array()) {
+    std::cerr << path << " is not the JSON output of Google Benchmark.\n";
+    return 1;
+  }
+
+  // Medians, if present, take precedence over individual repetitions.
+  std::map<std::string, bool> is_median;
+  for (const auto& benchmark : json["benchmarks"]) {
+    const std::string name = benchmark.value("run_name", "");
+    const std::string run_type = benchmark.value("run_type", "iteration");
+    const bool median = run_type == "aggregate" &&
+                        benchmark.value("aggregate_name", "") == "median";
+    if (name.empty() || (run_type != "iteration" && !median) ||
+        benchmark.contains("error_occurred")) {
+      continue;
+    }
+    const auto found = is_median.find(name);
+    if (found != is_median.end() && (found->second || !median)) {
+      continue;
+    }
+
+    const double scale = nanoseconds_per(benchmark.value("time_unit", "ns"));
+    if (scale == 0 || !benchmark.contains("cpu_time") ||
+        !benchmark["cpu_time"].is_number()) {
+      std::cerr << path << ": " << name << " has an invalid time.\n";
+      return 1;
+    }
+    Measurement& measurement = measurements[name];
+    measurement.cpu_nanoseconds = benchmark["cpu_time"].get<double>() * scale;
+    if (benchmark.contains("allocations") &&
+        benchmark["allocations"].is_number()) {
+      measurement.allocations = benchmark["allocations"].get<double>();
+    }
+    is_median[name] = median;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  double tolerance_percent = 10;
+  const char* paths[2] = {nullptr, nullptr};
+  int num_paths = 0;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view argument = argv[i];
+    const std::string_view prefix = "--tolerance=";
+    if (argument.substr(0, prefix.size()) == prefix) {
+      const std::string value(argument.substr(prefix.size()));
+      char* end = nullptr;
+      tolerance_percent = std::strtod(value.c_str(), &end);
+      if (value.empty() || *end != '\0' || tolerance_percent < 0) {
+        std::cerr << "Invalid argument: " << argument << '\n';
+        return 2;
+      }
+    } else if (num_paths < 2) {
+      paths[num_paths++] = argv[i];
+    } else {
+      num_paths = 3;
+    }
+  }
+  if (num_paths != 2) {
+    std::cerr << "usage: " << argv[0]
+              << " [--tolerance=PERCENT] BASELINE RESULTS\n";
+    return 2;
+  }
+
+  Measurements baseline;
+  Measurements results;
+  if (read_measurements(baseline, paths[0]) ||
+      read_measurements(results, paths[1])) {
+    return 2;
+  }
+
+  std::printf("%-50s %12s %12s %9s %13s  %s\n", "Benchmark", "Baseline ns",
+              "Current ns", "Change", "Allocations", "Status");
+  int regressions = 0;
+  for (const auto& [name, current] : results) {
+    const auto found = baseline.find(name);
+    if (found == baseline.end()) {
+      std::printf("%-50s %12s %12.1f %9s %13s  new\n", name.c_str(), "-",
+                  current.cpu_nanoseconds, "-", "-");
+      continue;
+    }
+    const Measurement& before = found->second;
+    const double change_percent =
+        before.cpu_nanoseconds == 0
+            ? 0
+            : 100 * (current.cpu_nanoseconds - before.cpu_nanoseconds) /
+                  before.cpu_nanoseconds;
+    const bool slower = change_percent > tolerance_percent;
+    const bool allocates_more =
+        before.allocations && current.allocations &&
+        *current.allocations > *before.allocations + 0.5;
+
+    char allocations[32] = "-";
+    if (before.allocations && current.allocations) {
+      std::snprintf(allocations, sizeof allocations, "%.0f -> %.0f",
+                    *before.allocations, *current.allocations);
+    }
+    const char* status = slower && allocates_more ? "SLOWER, MORE ALLOCATIONS"
+                         : slower                 ? "SLOWER"
+                         : allocates_more         ? "MORE ALLOCATIONS"
+                                                  : "ok";
+    std::printf("%-50s %12.1f %12.1f %+8.1f%% %13s  %s\n", name.c_str(),
+                before.cpu_nanoseconds, current.cpu_nanoseconds,
+                change_percent, allocations, status);
+    regressions += slower || allocates_more;
+  }
+  for (const auto& [name, before] : baseline) {
+    if (!results.count(name)) {
+      std::printf("%-50s %12.1f %12s %9s %13s  missing\n", name.c_str(),
+                  before.cpu_nanoseconds, "-", "-", "-");
+    }
+  }
+
+  if (regressions) {
+    std::printf("\n%d benchmark(s) regressed beyond the tolerance of %g%%.\n",
+                regressions, tolerance_percent);
+    return 1;
+  }
+  std::printf("\nNo benchmark regressed beyond the tolerance of %g%%.\n",
+              tolerance_percent);
+  return 0;
+}
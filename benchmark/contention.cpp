@@ -0,0 +1,307 @@
+// These benchmarks measure how the tracer scales with the number of threads
+// that use it at once, from 1 to 128.  They cover:
+//
+// - creating and finishing traces on many threads, all sent to one
+//   `DatadogAgent`,
+// - creating and finishing children of one root span, and so of one
+//   `TraceSegment`, on many threads,
+// - `TraceSampler::decide` on many threads, with and without its limiter
+//   deciding, and
+// - matching `SpanSampler` rules and deciding with their limiters on many
+//   threads.
+//
+// Each benchmark reports its throughput as "items_per_second" for each number
+// of threads, which together are its throughput curve.  Perfect scaling is a
+// throughput proportional to the number of threads, up to the number of cores.
+// Each benchmark also reports, per operation:
+//
+// - "voluntary_switches", the context switches made by threads that blocked,
+//   e.g. waiting for a contended lock,
+// - "involuntary_switches", the context switches made by threads that the
+//   kernel preempted, e.g. because there are more threads than cores,
+// - "off_cpu_ns", the time that the threads spent not running, which, when
+//   there are no more threads than cores, is mostly time spent waiting for
+//   locks, and
+// - "allocations", the heap allocations per operation.
+//
+// The context switches and the time off CPU are measured using
+// `getrusage(RUSAGE_THREAD)`, and so are reported only on Linux.
+//
+// The benchmarks are in their own program, rather than in `benchmarks`, so
+// that the quick single-threaded suite and its baseline aren't slowed down by
+// runs of 128 threads.  Compare the results of runs before and after a change
+// to locking with the `--benchmark_out` option and `compare_benchmarks`, or
+// just by reading the curves.
+
+#include <benchmark/benchmark.h>
+#include <datadog/clock.h>
+#include <datadog/http_client.h>
+#include <datadog/json.hpp>
+#include <datadog/null_collector.h>
+#include <datadog/span.h>
+#include <datadog/span_data.h>
+#include <datadog/span_sampler.h>
+#include <datadog/span_sampler_config.h>
+#include <datadog/trace_sampler.h>
+#include <datadog/trace_sampler_config.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "fixtures.h"
+#include "mocks/loggers.h"
+
+namespace {
+
+// `ContentionProbe` measures the context switches of, and the time not spent
+// running by, the current thread while it exists.
+class ContentionProbe {
+  std::chrono::steady_clock::time_point start_;
+#ifdef RUSAGE_THREAD
+  rusage usage_;
+#endif
+
+ public:
+  ContentionProbe() : start_(std::chrono::steady_clock::now()) {
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage_);
+#endif
+  }
+
+  // Add the measurements since this object was created to the counters of
+  // the specified `state`, per iteration.  Google Benchmark sums each counter
+  // over the threads before dividing by all of their iterations.
+  void report(benchmark::State& state) const {
+#ifdef RUSAGE_THREAD
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    const auto cpu = [](const rusage& usage) {
+      return std::chrono::seconds(usage.ru_utime.tv_sec) +
+             std::chrono::microseconds(usage.ru_utime.tv_usec) +
+             std::chrono::seconds(usage.ru_stime.tv_sec) +
+             std::chrono::microseconds(usage.ru_stime.tv_usec);
+    };
+    const auto off_cpu = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        elapsed - (cpu(usage) - cpu(usage_)));
+    const auto per_iteration = [](double value) {
+      return benchmark::Counter(value, benchmark::Counter::kAvgIterations);
+    };
+    state.counters["voluntary_switches"] =
+        per_iteration(double(usage.ru_nvcsw - usage_.ru_nvcsw));
+    state.counters["involuntary_switches"] =
+        per_iteration(double(usage.ru_nivcsw - usage_.ru_nivcsw));
+    state.counters["off_cpu_ns"] =
+        per_iteration(std::max(double(off_cpu.count()), 0.0));
+#else
+    (void)state;
+#endif
+  }
+};
+
+// Start measuring with the specified `probe`, unless it's started already.
+// The threads of a benchmark start their iterations together, and so the probe
+// starts in the first iteration, so as not to measure the wait for the others.
+void start(std::optional<ContentionProbe>& probe) {
+  if (!probe) {
+    probe.emplace();
+  }
+}
+
+// `DiscardingHTTPClient` accepts requests and discards them, without ever
+// responding, so that a `DatadogAgent` can flush without a network.
+class DiscardingHTTPClient : public HTTPClient {
+ public:
+  using HTTPClient::post;
+
+  Expected<void> post(const URL&, HeadersSetter, std::string, ResponseHandler,
+                      ErrorHandler) override {
+    return {};
+  }
+
+  Expected<void> get(const URL&, HeadersSetter, ResponseHandler,
+                     ErrorHandler) override {
+    return {};
+  }
+
+  void drain(std::chrono::steady_clock::time_point) override {}
+
+  nlohmann::json config_json() const override {
+    return nlohmann::json::object({{"type", "DiscardingHTTPClient"}});
+  }
+};
+
+template <typename Finalized>
+Finalized require(Expected<Finalized> result) {
+  if (!result) {
+    std::cerr << "Unable to configure the benchmark: " << result.error()
+              << '\n';
+    std::exit(1);
+  }
+  return std::move(*result);
+}
+
+SpanData make_span() {
+  SpanData span;
+  span.service = "benchmark";
+  span.name = "http.request";
+  span.resource = "GET /api/v1/users/:id";
+  span.trace_id = TraceID{4942614562549416309ULL};
+  span.tags.emplace("http.method", "GET");
+  return span;
+}
+
+// Run the benchmarks at 1, 2, 4, ..., 128 threads, measuring real time, since
+// CPU time doesn't include time spent waiting.
+void threads(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ThreadRange(1, 128)->UseRealTime();
+}
+
+// The state shared by the threads of a benchmark is created by the first
+// thread before the threads start their iterations, and destroyed by it after
+// they finish.
+
+std::optional<Tracer> shared_tracer;
+
+void BM_ConcurrentTracesToDatadogAgent(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    TracerConfig config;
+    config.defaults.service = "benchmark";
+    config.logger = std::make_shared<NullLogger>();
+    config.agent.http_client = std::make_shared<DiscardingHTTPClient>();
+    config.agent.flush_interval_milliseconds = 100;
+    config.agent.shutdown_timeout_milliseconds = 0;
+    // The limit only bounds the memory of a run whose flushes fall behind.
+    config.agent.max_buffered_spans = 1000000;
+    shared_tracer.emplace(require(finalize_config(config)));
+  }
+  const AllocationCounter allocations;
+  std::optional<ContentionProbe> probe;
+  for (auto _ : state) {
+    start(probe);
+    auto root = shared_tracer->create_span();
+    auto child = root.create_child();
+    child.set_tag("http.method", "GET");
+  }
+  report_allocations(state, allocations);
+  probe->report(state);
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    shared_tracer.reset();
+  }
+}
+BENCHMARK(BM_ConcurrentTracesToDatadogAgent)->Apply(threads);
+
+std::optional<Span> shared_root;
+
+void BM_ConcurrentChildrenOfOneSegment(benchmark::State& state) {
+  if (state.thread_index() == 0) {
+    // Partial flushing bounds the size of the segment, whose root span stays
+    // open for the whole run.
+    TracerConfig config;
+    config.defaults.service = "benchmark";
+    config.logger = std::make_shared<NullLogger>();
+    config.collector = std::make_shared<NullCollector>();
+    config.partial_flush_enabled = true;
+    config.partial_flush_min_spans = 1000;
+    shared_tracer.emplace(require(finalize_config(config)));
+    shared_root.emplace(shared_tracer->create_span());
+  }
+  const AllocationCounter allocations;
+  std::optional<ContentionProbe> probe;
+  for (auto _ : state) {
+    start(probe);
+    auto child = shared_root->create_child();
+    benchmark::DoNotOptimize(child);
+  }
+  report_allocations(state, allocations);
+  probe->report(state);
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    shared_root.reset();
+    shared_tracer.reset();
+  }
+}
+BENCHMARK(BM_ConcurrentChildrenOfOneSegment)->Apply(threads);
+
+std::optional<TraceSampler> shared_trace_sampler;
+
+void BM_ConcurrentTraceSamplerDecide(benchmark::State& state) {
+  // If `state.range(0)` is zero, then the limiter allows everything.
+  // Otherwise, it allows 100 traces per second, and so it decides most
+  // traces.
+  if (state.thread_index() == 0) {
+    TraceSamplerConfig config;
+    TraceSamplerConfig::Rule rule;
+    rule.service = "bench*";
+    config.rules.push_back(rule);
+    config.max_per_second = state.range(0) ? 100 : 1e9;
+    shared_trace_sampler.emplace(require(finalize_config(config)),
+                                 default_clock);
+  }
+  const SpanData span = make_span();
+  const AllocationCounter allocations;
+  std::optional<ContentionProbe> probe;
+  for (auto _ : state) {
+    start(probe);
+    benchmark::DoNotOptimize(shared_trace_sampler->decide(span));
+  }
+  report_allocations(state, allocations);
+  probe->report(state);
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    shared_trace_sampler.reset();
+  }
+}
+BENCHMARK(BM_ConcurrentTraceSamplerDecide)->Arg(0)->Arg(1)->Apply(threads);
+
+std::optional<SpanSampler> shared_span_sampler;
+
+void BM_ConcurrentSpanSamplerDecide(benchmark::State& state) {
+  // The span matches the last of `state.range(0)` rules, whose limiter allows
+  // 100 spans per second.
+  if (state.thread_index() == 0) {
+    SpanSamplerConfig config;
+    for (int i = 1; i < state.range(0); ++i) {
+      SpanSamplerConfig::Rule rule;
+      rule.name = "other.operation." + std::to_string(i);
+      config.rules.push_back(rule);
+    }
+    SpanSamplerConfig::Rule rule;
+    rule.service = "bench*";
+    rule.max_per_second = 100;
+    config.rules.push_back(rule);
+    NullLogger logger;
+    shared_span_sampler.emplace(require(finalize_config(config, logger)),
+                                default_clock);
+  }
+  const SpanData span = make_span();
+  const AllocationCounter allocations;
+  std::optional<ContentionProbe> probe;
+  for (auto _ : state) {
+    start(probe);
+    const auto rule = shared_span_sampler->match(span);
+    benchmark::DoNotOptimize(rule->decide(span));
+  }
+  report_allocations(state, allocations);
+  probe->report(state);
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    shared_span_sampler.reset();
+  }
+}
+BENCHMARK(BM_ConcurrentSpanSamplerDecide)->Arg(1)->Arg(10)->Apply(threads);
+
+}  // namespace
@@ -0,0 +1,35 @@
+#include "fixtures.h"
+
+#include <datadog/null_collector.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/loggers.h"
+
+FinalizedTracerConfig make_tracer_config(bool report_traces) {
+  TracerConfig config;
+  config.defaults.service = "benchmark";
+  config.defaults.environment = "dev";
+  config.defaults.version = "1.0";
+  config.collector = std::make_shared<NullCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.event_scheduler = std::make_shared<MockEventScheduler>();
+  config.report_traces = report_traces;
+
+  auto finalized = finalize_config(config);
+  if (!finalized) {
+    std::cerr << "Unable to configure the tracer: " << finalized.error()
+              << '\n';
+    std::exit(1);
+  }
+  return std::move(*finalized);
+}
+
+void report_allocations(benchmark::State& state,
+                        const AllocationCounter& allocations) {
+  state.counters["allocations"] = benchmark::Counter(
+      double(allocations.count()), benchmark::Counter::kAvgIterations);
+}
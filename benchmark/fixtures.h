@@ -0,0 +1,27 @@
+#pragma once
+
+// This file provides fixtures shared by the benchmarks: a function that returns
+// the configuration of a tracer that discards its traces, and a function that
+// reports the heap allocations made by a benchmark's iterations.
+//
+// The mocks in `test/mocks/` and the `AllocationCounter` in `test/` serve as
+// the other fixtures.
+
+#include <benchmark/benchmark.h>
+#include <datadog/tracer_config.h>
+
+#include "allocation_counter.h"
+
+using namespace datadog::tracing;
+
+// Return the configuration of a tracer that reports its traces to a
+// `NullCollector` and doesn't log.  `NullCollector` discards the trace chunks
+// that it receives, so that the memory used by a benchmark doesn't grow with
+// its iterations.  If the specified `report_traces` is false, then the tracer
+// is disabled, and creates only no-op spans.
+FinalizedTracerConfig make_tracer_config(bool report_traces = true);
+
+// Set the "allocations" counter of the specified `state` to the number of
+// allocations counted by the specified `allocations` per iteration.
+void report_allocations(benchmark::State& state,
+                        const AllocationCounter& allocations);
@@ -0,0 +1,44 @@
+// These benchmarks cover `glob_match` and `GlobPattern`, which sampling rules
+// use to match spans.
+
+#include <benchmark/benchmark.h>
+#include <datadog/glob.h>
+
+#include <string_view>
+
+using namespace datadog::tracing;
+
+namespace {
+
+void BM_GlobMatch(benchmark::State& state, std::string_view pattern,
+                  std::string_view subject) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(glob_match(pattern, subject));
+  }
+}
+BENCHMARK_CAPTURE(BM_GlobMatch, exact, "http.request", "http.request");
+BENCHMARK_CAPTURE(BM_GlobMatch, prefix, "http.*", "http.request");
+BENCHMARK_CAPTURE(BM_GlobMatch, substring, "*users*",
+                  "GET /api/v1/users/:id");
+BENCHMARK_CAPTURE(BM_GlobMatch, general, "GET /api/v?/*/:id",
+                  "GET /api/v1/users/:id");
+BENCHMARK_CAPTURE(BM_GlobMatch, mismatch, "*a*a*a*a*b",
+                  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+
+void BM_GlobPatternMatch(benchmark::State& state, std::string_view pattern,
+                         std::string_view subject) {
+  const GlobPattern compiled{pattern};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(compiled.match(subject));
+  }
+}
+BENCHMARK_CAPTURE(BM_GlobPatternMatch, exact, "http.request", "http.request");
+BENCHMARK_CAPTURE(BM_GlobPatternMatch, prefix, "http.*", "http.request");
+BENCHMARK_CAPTURE(BM_GlobPatternMatch, substring, "*users*",
+                  "GET /api/v1/users/:id");
+BENCHMARK_CAPTURE(BM_GlobPatternMatch, general, "GET /api/v?/*/:id",
+                  "GET /api/v1/users/:id");
+BENCHMARK_CAPTURE(BM_GlobPatternMatch, mismatch, "*a*a*a*a*b",
+                  "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+
+}  // namespace
@@ -0,0 +1,91 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr std::size_t bits = LatencyHistogram::sub_bucket_bits;
+
+// Return the index of the most significant set bit of the specified nonzero
+// `value`.
+std::size_t highest_bit(std::uint64_t value) {
+  std::size_t index = 0;
+  while (value >>= 1) {
+    ++index;
+  }
+  return index;
+}
+
+// Values less than `sub_buckets` have a bucket each.  A larger value is
+// shifted right by an `exponent` that puts it within [`sub_buckets / 2`,
+// `sub_buckets`), and the result selects one of the `sub_buckets / 2` buckets
+// for that `exponent`.
+std::size_t index_of(std::uint64_t value) {
+  if (value < LatencyHistogram::sub_buckets) {
+    return std::size_t(value);
+  }
+  const std::size_t exponent = highest_bit(value) - bits + 1;
+  return (exponent << (bits - 1)) + std::size_t(value >> exponent);
+}
+
+// Return the largest value whose index is the specified `index`.
+std::uint64_t upper_bound_of(std::size_t index) {
+  if (index < LatencyHistogram::sub_buckets) {
+    return index;
+  }
+  const std::size_t exponent = (index >> (bits - 1)) - 1;
+  const std::uint64_t mantissa = index - (exponent << (bits - 1));
+  return ((mantissa + 1) << exponent) - 1;
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram()
+    : counts_(index_of(UINT64_MAX) + 1), count_(0), total_(0), max_(0) {}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration) {
+  const std::uint64_t value = std::max<std::int64_t>(duration.count(), 0);
+  ++counts_[index_of(value)];
+  ++count_;
+  total_ += value;
+  max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (std::size_t i = 0; i < counts_.size(); ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  total_ += other.total_;
+  max_ = std::max(max_, other.max_);
+}
+
+std::uint64_t LatencyHistogram::count() const { return count_; }
+
+std::chrono::nanoseconds LatencyHistogram::mean() const {
+  if (count_ == 0) {
+    return std::chrono::nanoseconds::zero();
+  }
+  return std::chrono::nanoseconds(total_ / count_);
+}
+
+std::chrono::nanoseconds LatencyHistogram::max() const {
+  return std::chrono::nanoseconds(max_);
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double percent) const {
+  if (count_ == 0) {
+    return std::chrono::nanoseconds::zero();
+  }
+  const auto rank = std::max<std::uint64_t>(
+      1, std::uint64_t(std::ceil(percent / 100 * double(count_))));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < counts_.size(); ++i) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return std::chrono::nanoseconds(std::min(upper_bound_of(i), max_));
+    }
+  }
+  return max();
+}
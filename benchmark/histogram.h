@@ -0,0 +1,42 @@
+#pragma once
+
+// This component provides a class, `LatencyHistogram`, that records durations
+// for the load generator (see `load_generator.cpp`) and reports their
+// percentiles.
+//
+// Durations are recorded in nanoseconds into logarithmic buckets, each of
+// which is divided into `sub_buckets` linear sub-buckets.  Recording a
+// duration takes constant time and doesn't allocate memory, and a reported
+// percentile is within one part in `sub_buckets / 2` of the recorded value.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LatencyHistogram {
+ public:
+  static constexpr std::size_t sub_bucket_bits = 7;
+  static constexpr std::size_t sub_buckets = std::size_t(1) << sub_bucket_bits;
+
+ private:
+  std::vector<std::uint64_t> counts_;
+  std::uint64_t count_;
+  std::uint64_t total_;
+  std::uint64_t max_;
+
+ public:
+  LatencyHistogram();
+
+  void record(std::chrono::nanoseconds duration);
+  // Add the durations recorded by the specified `other` to this histogram.
+  void merge(const LatencyHistogram& other);
+
+  std::uint64_t count() const;
+  std::chrono::nanoseconds mean() const;
+  std::chrono::nanoseconds max() const;
+  // Return the smallest duration that is at least as long as the specified
+  // `percent` of the recorded durations, or return zero if none have been
+  // recorded.
+  std::chrono::nanoseconds percentile(double percent) const;
+};
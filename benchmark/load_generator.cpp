@@ -0,0 +1,410 @@
+// This program measures the throughput and latency of the tracer under load.
+//
+// A number of threads create traces as fast as they can (or at a specified
+// rate) for a specified duration.  The traces are sent by the tracer's
+// default `DatadogAgent` and `Curl` to a `MockAgent` running in this process.
+// Then the program reports:
+//
+// - spans and traces created per second,
+// - payload bytes received by the mock agent per second,
+// - how many trace chunks were received, reported dropped by the tracer, or
+//   not accounted for,
+// - the duration of each flush, i.e. each invocation of the `DatadogAgent`'s
+//   scheduled event, and
+// - the latency of each tracer operation: creating a root span, creating a
+//   child span, setting a tag, and finishing (destroying) a child span and a
+//   root span.
+//
+// The traces have the shape of those produced by `example/hasher.cpp` for a
+// directory of files: a root span, with a child span for each directory, each
+// of which has a child span for each file.
+//
+// Usage:
+//
+//     load_generator [--threads=N] [--seconds=N] [--directories=N]
+//                    [--files=N] [--traces-per-second=N]
+//                    [--flush-interval-milliseconds=N]
+
+#include <datadog/event_scheduler.h>
+#include <datadog/json.hpp>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/threaded_event_scheduler.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "histogram.h"
+#include "mock_agent.h"
+
+namespace dd = datadog::tracing;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  int threads = 4;
+  double seconds = 10;
+  int directories = 3;
+  int files = 5;
+  // Zero means as fast as possible.
+  double traces_per_second = 0;
+  int flush_interval_milliseconds = 2000;
+};
+
+// Parse the specified command line arguments into the specified `options`.
+// Return zero on success, or print a diagnostic and return a nonzero value if
+// an error occurs.
+int parse_options(Options& options, int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view argument = argv[i];
+    const auto equals = argument.find('=');
+    const std::string_view name = argument.substr(0, equals);
+    const std::string value(equals == std::string_view::npos
+                                ? std::string_view()
+                                : argument.substr(equals + 1));
+    char* end = nullptr;
+    const double number = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || number < 0) {
+      std::cerr << "Invalid argument: " << argument << '\n';
+      return 1;
+    }
+
+    if (name == "--threads") {
+      options.threads = int(number);
+    } else if (name == "--seconds") {
+      options.seconds = number;
+    } else if (name == "--directories") {
+      options.directories = int(number);
+    } else if (name == "--files") {
+      options.files = int(number);
+    } else if (name == "--traces-per-second") {
+      options.traces_per_second = number;
+    } else if (name == "--flush-interval-milliseconds") {
+      options.flush_interval_milliseconds = int(number);
+    } else {
+      std::cerr << "Unknown option: " << name << '\n';
+      return 1;
+    }
+  }
+
+  if (options.threads < 1) {
+    std::cerr << "At least one thread is required.\n";
+    return 1;
+  }
+  return 0;
+}
+
+// `TimedEventScheduler` is an `EventScheduler` that records how long each
+// invocation of each event's callback takes, and otherwise defers to another
+// `EventScheduler`.  The `DatadogAgent` flushes in its scheduled event.
+class TimedEventScheduler : public dd::EventScheduler {
+  struct Durations {
+    std::mutex mutex;
+    LatencyHistogram histogram;
+  };
+
+  std::shared_ptr<dd::EventScheduler> scheduler_;
+  std::shared_ptr<Durations> durations_;
+
+  std::function<void()> timed(std::function<void()> callback) const {
+    return [durations = durations_, callback = std::move(callback)]() {
+      const auto before = Clock::now();
+      callback();
+      const auto elapsed = Clock::now() - before;
+      std::lock_guard<std::mutex> lock(durations->mutex);
+      durations->histogram.record(elapsed);
+    };
+  }
+
+ public:
+  explicit TimedEventScheduler(std::shared_ptr<dd::EventScheduler> scheduler)
+      : scheduler_(std::move(scheduler)),
+        durations_(std::make_shared<Durations>()) {}
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override {
+    return scheduler_->schedule_recurring_event(interval,
+                                                timed(std::move(callback)));
+  }
+
+  RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override {
+    return scheduler_->schedule_wakeable_recurring_event(
+        interval, timed(std::move(callback)));
+  }
+
+  nlohmann::json config_json() const override {
+    return nlohmann::json::object({{"type", "TimedEventScheduler"},
+                                   {"config", scheduler_->config_json()}});
+  }
+
+  LatencyHistogram durations() const {
+    std::lock_guard<std::mutex> lock(durations_->mutex);
+    return durations_->histogram;
+  }
+};
+
+// `Measurements` are the results of one thread of the load, and also of all of
+// them when merged.
+struct Measurements {
+  std::uint64_t traces = 0;
+  std::uint64_t spans = 0;
+  LatencyHistogram create_span;
+  LatencyHistogram create_child;
+  LatencyHistogram set_tag;
+  LatencyHistogram finish_child;
+  LatencyHistogram finish_root;
+
+  void merge(const Measurements& other) {
+    traces += other.traces;
+    spans += other.spans;
+    create_span.merge(other.create_span);
+    create_child.merge(other.create_child);
+    set_tag.merge(other.set_tag);
+    finish_child.merge(other.finish_child);
+    finish_root.merge(other.finish_root);
+  }
+};
+
+// `Workload` produces traces having the shape of those of `example/hasher.cpp`
+// and records the latency of each tracer operation involved.  The tag values
+// are prepared in advance, so that only the tracer's work is measured.
+class Workload {
+  struct File {
+    std::string path;
+    std::string name;
+  };
+  struct Directory {
+    std::string path;
+    std::string name;
+    std::vector<File> files;
+  };
+
+  std::vector<Directory> directories_;
+  std::string file_size_;
+  std::string children_;
+  std::string digest_;
+
+ public:
+  Workload(int directories, int files)
+      : file_size_("4096"),
+        children_(std::to_string(files)),
+        digest_(64, 'a') {
+    for (int d = 0; d < directories; ++d) {
+      Directory& directory = directories_.emplace_back();
+      directory.name = "directory" + std::to_string(d);
+      directory.path = "/srv/data/" + directory.name;
+      for (int f = 0; f < files; ++f) {
+        File& file = directory.files.emplace_back();
+        file.name = "file" + std::to_string(f) + ".txt";
+        file.path = directory.path + "/" + file.name;
+      }
+    }
+  }
+
+  void run(dd::Tracer& tracer, Measurements& measurements) const {
+    const auto set_tag = [&](dd::Span& span, std::string_view name,
+                             std::string_view value) {
+      const auto before = Clock::now();
+      span.set_tag(name, value);
+      measurements.set_tag.record(Clock::now() - before);
+    };
+    const auto create_child = [&](const dd::Span& parent,
+                                  const dd::SpanConfig& config) {
+      const auto before = Clock::now();
+      std::optional<dd::Span> child{parent.create_child(config)};
+      measurements.create_child.record(Clock::now() - before);
+      ++measurements.spans;
+      return child;
+    };
+    const auto finish_child = [&](std::optional<dd::Span>& child) {
+      const auto before = Clock::now();
+      child.reset();
+      measurements.finish_child.record(Clock::now() - before);
+    };
+
+    dd::SpanConfig root_config;
+    root_config.name = "sha256.request";
+    dd::SpanConfig directory_config;
+    directory_config.name = "sha256.directory";
+    dd::SpanConfig file_config;
+    file_config.name = "sha256.file";
+
+    auto before = Clock::now();
+    std::optional<dd::Span> root{tracer.create_span(root_config)};
+    measurements.create_span.record(Clock::now() - before);
+    ++measurements.spans;
+    set_tag(*root, "path", "/srv/data");
+
+    for (const Directory& directory : directories_) {
+      auto directory_span = create_child(*root, directory_config);
+      set_tag(*directory_span, "path", directory.path);
+      set_tag(*directory_span, "file_name", directory.name);
+      set_tag(*directory_span, "directory_name", directory.name);
+      for (const File& file : directory.files) {
+        auto file_span = create_child(*directory_span, file_config);
+        set_tag(*file_span, "path", file.path);
+        set_tag(*file_span, "file_name", file.name);
+        set_tag(*file_span, "file_size_bytes", file_size_);
+        set_tag(*file_span, "sha256_hex", digest_);
+        finish_child(file_span);
+      }
+      set_tag(*directory_span, "number_of_children_included", children_);
+      set_tag(*directory_span, "sha256_hex", digest_);
+      finish_child(directory_span);
+    }
+    set_tag(*root, "sha256_hex", digest_);
+
+    before = Clock::now();
+    root.reset();
+    measurements.finish_root.record(Clock::now() - before);
+    ++measurements.traces;
+  }
+};
+
+void print_latencies(std::string_view name, const LatencyHistogram& histogram) {
+  const auto ns = [](std::chrono::nanoseconds duration) {
+    return static_cast<long long>(duration.count());
+  };
+  std::printf("  %-14.*s %12llu %10lld %10lld %10lld %10lld %10lld %12lld\n",
+              int(name.size()), name.data(),
+              static_cast<unsigned long long>(histogram.count()),
+              ns(histogram.mean()), ns(histogram.percentile(50)),
+              ns(histogram.percentile(90)), ns(histogram.percentile(99)),
+              ns(histogram.percentile(99.9)), ns(histogram.max()));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (const int rc = parse_options(options, argc, argv)) {
+    return rc;
+  }
+
+  MockAgent agent;
+  if (const int error = agent.start()) {
+    std::cerr << "Unable to start the mock agent: " << std::strerror(error)
+              << '\n';
+    return 1;
+  }
+
+  const auto scheduler = std::make_shared<TimedEventScheduler>(
+      std::make_shared<dd::ThreadedEventScheduler>());
+  dd::TracerConfig config;
+  config.defaults.service = "load-generator";
+  config.log_on_startup = false;
+  config.agent.url = "http://127.0.0.1:" + std::to_string(agent.port());
+  config.agent.event_scheduler = scheduler;
+  config.agent.flush_interval_milliseconds =
+      options.flush_interval_milliseconds;
+  auto finalized = dd::finalize_config(config);
+  if (!finalized) {
+    std::cerr << "Unable to configure the tracer: " << finalized.error()
+              << '\n';
+    return 1;
+  }
+  dd::Tracer tracer{*finalized};
+
+  const Workload workload{options.directories, options.files};
+  const auto duration = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.seconds));
+  std::optional<Clock::duration> pace;
+  if (options.traces_per_second > 0) {
+    pace = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.threads /
+                                      options.traces_per_second));
+  }
+
+  std::vector<Measurements> measurements(options.threads);
+  std::vector<std::thread> threads;
+  const auto start = Clock::now();
+  for (auto& thread_measurements : measurements) {
+    threads.emplace_back([&, results = &thread_measurements]() {
+      auto next = start;
+      for (auto now = start; now - start < duration; now = Clock::now()) {
+        if (pace) {
+          std::this_thread::sleep_until(next);
+          next += *pace;
+        }
+        workload.run(tracer, *results);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  // Send what remains buffered, so that every trace is accounted for.
+  const auto before_flush = Clock::now();
+  const auto flushed = tracer.flush(before_flush + std::chrono::seconds(30));
+  const std::chrono::duration<double, std::milli> final_flush =
+      Clock::now() - before_flush;
+  if (auto* error = flushed.if_error()) {
+    std::cerr << "Unable to flush: " << *error << '\n';
+  }
+
+  Measurements total;
+  for (const auto& thread_measurements : measurements) {
+    total.merge(thread_measurements);
+  }
+  const MockAgent::Statistics received = agent.statistics();
+  const std::uint64_t accounted = received.traces + received.dropped_traces;
+  const double seconds = elapsed.count();
+
+  std::printf("threads: %d\n", options.threads);
+  std::printf("spans per trace: %d\n",
+              1 + options.directories * (1 + options.files));
+  std::printf("duration: %.3f s\n", seconds);
+  std::printf("traces: %llu (%.0f/s)\n",
+              static_cast<unsigned long long>(total.traces),
+              double(total.traces) / seconds);
+  std::printf("spans: %llu (%.0f/s)\n",
+              static_cast<unsigned long long>(total.spans),
+              double(total.spans) / seconds);
+  std::printf("agent requests: %llu\n",
+              static_cast<unsigned long long>(received.requests));
+  std::printf("payload bytes: %llu (%.0f/s)\n",
+              static_cast<unsigned long long>(received.payload_bytes),
+              double(received.payload_bytes) / seconds);
+  std::printf("trace chunks received: %llu\n",
+              static_cast<unsigned long long>(received.traces));
+  std::printf("trace chunks dropped (reported by the tracer): %llu\n",
+              static_cast<unsigned long long>(received.dropped_traces));
+  std::printf("spans dropped (reported by the tracer): %llu\n",
+              static_cast<unsigned long long>(received.dropped_spans));
+  std::printf("trace chunks unaccounted for: %lld\n",
+              static_cast<long long>(total.traces) -
+                  static_cast<long long>(accounted));
+  std::printf("final flush: %.3f ms\n", final_flush.count());
+
+  std::printf("\nlatency (ns):\n");
+  std::printf("  %-14s %12s %10s %10s %10s %10s %10s %12s\n", "operation",
+              "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+  print_latencies("create_span", total.create_span);
+  print_latencies("create_child", total.create_child);
+  print_latencies("set_tag", total.set_tag);
+  print_latencies("finish_child", total.finish_child);
+  print_latencies("finish_root", total.finish_root);
+  print_latencies("flush", scheduler->durations());
+}
@@ -0,0 +1,183 @@
+// This program reports how much memory the tracer retains per span and per
+// trace chunk, so that memory limits can be sized from measurements rather
+// than from guesses.
+//
+// For each of several numbers of tags per span, it measures the heap memory
+// retained by:
+//
+// - an open span, i.e. a child span not yet finished, whose `Span` object is
+//   not included (see `sizeof(Span)` instead),
+// - a finished span whose trace segment is still open, and so hasn't yet been
+//   sent to the collector, and
+// - a trace chunk of one span that a `DatadogAgent` has buffered, but not yet
+//   flushed.
+//
+// Half of each span's tags have short values, which `std::string` stores
+// inline, and half have 32-byte values, which it allocates, as a URL or a
+// host name would be.
+//
+// The memory is counted by `AllocationCounter` (see `allocation_counter.h`)
+// as the bytes that the allocator granted, plus `allocation_header_bytes` of
+// bookkeeping per allocation.  The difference between that and the bytes
+// requested is the allocator's overhead.  Span data is allocated from arena
+// blocks (see `span_arena.h`), whose cost is spread over the spans measured.
+// The program also prints the sizes of the tracer's main objects.
+//
+// Usage:
+//
+//     memory_footprint [--spans=N]
+
+#include <datadog/null_collector.h>
+#include <datadog/span.h>
+#include <datadog/span_data.h>
+#include <datadog/trace_segment.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+
+namespace dd = datadog::tracing;
+
+namespace {
+
+// `Footprint` is the memory retained per object, measured over many objects.
+struct Footprint {
+  double bytes = 0;
+  double allocations = 0;
+};
+
+// Return the memory retained since the specified `counter` was created,
+// divided among the specified `count` objects.
+Footprint footprint(const AllocationCounter& counter, std::size_t count) {
+  const auto allocations = counter.live_allocations();
+  const auto bytes = counter.live_bytes() +
+                     allocations * std::int64_t(allocation_header_bytes);
+  return Footprint{double(bytes) / double(count),
+                   double(allocations) / double(count)};
+}
+
+dd::Tracer make_tracer(std::shared_ptr<dd::Collector> collector) {
+  dd::TracerConfig config;
+  config.defaults.service = "memory_footprint";
+  config.logger = std::make_shared<NullLogger>();
+  config.collector = std::move(collector);
+  auto finalized = dd::finalize_config(config);
+  if (!finalized) {
+    std::cerr << "Unable to configure the tracer: " << finalized.error()
+              << '\n';
+    std::exit(1);
+  }
+  return dd::Tracer{*finalized};
+}
+
+// Set the specified `count` tags on the specified `span`.
+void set_tags(dd::Span& span, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    span.set_tag("tag." + std::to_string(i),
+                 i % 2 ? std::string(32, 'v') : std::string("value"));
+  }
+}
+
+Footprint measure_open_spans(std::size_t spans, std::size_t tags) {
+  auto tracer = make_tracer(std::make_shared<dd::NullCollector>());
+  auto root = tracer.create_span();
+  std::vector<dd::Span> children;
+  children.reserve(spans);
+  const AllocationCounter counter;
+  for (std::size_t i = 0; i < spans; ++i) {
+    set_tags(children.emplace_back(root.create_child()), tags);
+  }
+  return footprint(counter, spans);
+}
+
+Footprint measure_finished_spans(std::size_t spans, std::size_t tags) {
+  auto tracer = make_tracer(std::make_shared<dd::NullCollector>());
+  auto root = tracer.create_span();
+  const AllocationCounter counter;
+  for (std::size_t i = 0; i < spans; ++i) {
+    auto child = root.create_child();
+    set_tags(child, tags);
+  }
+  return footprint(counter, spans);
+}
+
+Footprint measure_queued_chunks(std::size_t chunks, std::size_t tags) {
+  // The `DatadogAgent` doesn't flush on its own, since its event scheduler
+  // never runs its events.
+  dd::TracerConfig config;
+  config.defaults.service = "memory_footprint";
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  config.agent.event_scheduler = std::make_shared<MockEventScheduler>();
+  config.agent.shutdown_timeout_milliseconds = 0;
+  auto finalized = dd::finalize_config(config);
+  if (!finalized) {
+    std::cerr << "Unable to configure the tracer: " << finalized.error()
+              << '\n';
+    std::exit(1);
+  }
+  dd::Tracer tracer{*finalized};
+  const AllocationCounter counter;
+  for (std::size_t i = 0; i < chunks; ++i) {
+    auto root = tracer.create_span();
+    set_tags(root, tags);
+  }
+  return footprint(counter, chunks);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t spans = 10000;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view argument = argv[i];
+    const std::string_view prefix = "--spans=";
+    if (argument.substr(0, prefix.size()) != prefix ||
+        std::atoll(argv[i] + prefix.size()) <= 0) {
+      std::cerr << "usage: " << argv[0] << " [--spans=N]\n";
+      return 1;
+    }
+    spans = std::size_t(std::atoll(argv[i] + prefix.size()));
+  }
+  if (!allocation_bytes_supported()) {
+    std::cerr << "Heap bytes can't be counted on this platform.\n";
+    return 1;
+  }
+
+  std::printf("sizeof(Span)          %6zu bytes\n", sizeof(dd::Span));
+  std::printf("sizeof(SpanData)      %6zu bytes\n", sizeof(dd::SpanData));
+  std::printf("sizeof(TraceSegment)  %6zu bytes\n", sizeof(dd::TraceSegment));
+  std::printf("allocator header      %6zu bytes per allocation\n",
+              allocation_header_bytes);
+  std::printf("\nHeap bytes (allocations) retained per object, over %zu:\n\n",
+              spans);
+  std::printf("%6s  %20s  %20s  %20s\n", "tags", "open span",
+              "finished span", "queued trace chunk");
+  for (const std::size_t tags : {0, 4, 16, 64}) {
+    const Footprint open = measure_open_spans(spans, tags);
+    const Footprint finished = measure_finished_spans(spans, tags);
+    const Footprint queued = measure_queued_chunks(spans, tags);
+    std::printf("%6zu", tags);
+    for (const Footprint& each : {open, finished, queued}) {
+      char cell[32];
+      std::snprintf(cell, sizeof cell, "%.0f (%.1f)", each.bytes,
+                    each.allocations);
+      std::printf("  %20s", cell);
+    }
+    std::printf("\n");
+  }
+}
@@ -0,0 +1,203 @@
+#include "mock_agent.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <string_view>
+
+namespace {
+
+const std::string_view response =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 39\r\n"
+    "\r\n"
+    "{\"rate_by_service\":{\"service:,env:\":1}}";
+
+bool send_all(int connection, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t sent =
+        ::send(connection, data.data(), data.size(), MSG_NOSIGNAL);
+    if (sent <= 0) {
+      return false;
+    }
+    data.remove_prefix(std::size_t(sent));
+  }
+  return true;
+}
+
+// Return the value of the header having the specified `name` in the specified
+// `head`, which contains a request line followed by header lines, or return an
+// empty string if there is no such header.  Header names are compared without
+// regard to case.
+std::string_view header(std::string_view head, std::string_view name) {
+  std::size_t begin = head.find("\r\n");
+  while (begin != std::string_view::npos && begin + 2 < head.size()) {
+    begin += 2;
+    const std::size_t end = std::min(head.find("\r\n", begin), head.size());
+    const std::string_view line = head.substr(begin, end - begin);
+    const std::size_t colon = line.find(':');
+    if (colon == name.size() &&
+        std::equal(name.begin(), name.end(), line.begin(),
+                   [](char left, char right) {
+                     return std::tolower(static_cast<unsigned char>(left)) ==
+                            std::tolower(static_cast<unsigned char>(right));
+                   })) {
+      std::string_view value = line.substr(colon + 1);
+      while (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+      }
+      return value;
+    }
+    begin = end;
+  }
+  return {};
+}
+
+std::uint64_t to_integer(std::string_view text) {
+  std::uint64_t result = 0;
+  for (const char digit : text) {
+    if (digit < '0' || digit > '9') {
+      break;
+    }
+    result = result * 10 + std::uint64_t(digit - '0');
+  }
+  return result;
+}
+
+}  // namespace
+
+MockAgent::MockAgent() : listener_(-1), port_(0), stopping_(false) {}
+
+MockAgent::~MockAgent() {
+  stopping_ = true;
+  if (listener_ != -1) {
+    // Shutting down a socket wakes any thread blocked on it.
+    ::shutdown(listener_, SHUT_RDWR);
+    acceptor_.join();
+    ::close(listener_);
+  }
+  std::vector<std::thread> handlers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const int connection : connections_) {
+      ::shutdown(connection, SHUT_RDWR);
+    }
+    handlers.swap(handlers_);
+  }
+  for (auto& handler : handlers) {
+    handler.join();
+  }
+}
+
+int MockAgent::start() {
+  listener_ = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listener_ == -1) {
+    return errno;
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+  socklen_t length = sizeof address;
+  if (::bind(listener_, reinterpret_cast<sockaddr*>(&address), length) ||
+      ::listen(listener_, SOMAXCONN) ||
+      ::getsockname(listener_, reinterpret_cast<sockaddr*>(&address),
+                    &length)) {
+    const int error = errno;
+    ::close(listener_);
+    listener_ = -1;
+    return error;
+  }
+  port_ = ntohs(address.sin_port);
+  acceptor_ = std::thread([this]() { accept_connections(); });
+  return 0;
+}
+
+int MockAgent::port() const { return port_; }
+
+MockAgent::Statistics MockAgent::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void MockAgent::accept_connections() {
+  while (!stopping_) {
+    const int connection = ::accept(listener_, nullptr, nullptr);
+    if (connection == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    connections_.push_back(connection);
+    handlers_.emplace_back([this, connection]() { serve(connection); });
+  }
+}
+
+void MockAgent::serve(int connection) {
+  std::string buffer;
+  char chunk[64 * 1024];
+  // Append to `buffer` what's next received, and return whether anything was.
+  const auto receive = [&]() {
+    const ssize_t received = ::recv(connection, chunk, sizeof chunk, 0);
+    if (received <= 0) {
+      return false;
+    }
+    buffer.append(chunk, std::size_t(received));
+    return true;
+  };
+
+  // Read a request and respond to it.  Return whether the connection is
+  // still usable.
+  const auto serve_request = [&]() {
+    std::size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (!receive()) {
+        return false;
+      }
+    }
+    const std::string head = buffer.substr(0, head_end);
+    buffer.erase(0, head_end + 4);
+
+    if (header(head, "Expect") == "100-continue" &&
+        !send_all(connection, "HTTP/1.1 100 Continue\r\n\r\n")) {
+      return false;
+    }
+    const std::uint64_t body_size = to_integer(header(head, "Content-Length"));
+    while (buffer.size() < body_size) {
+      if (!receive()) {
+        return false;
+      }
+    }
+    buffer.erase(0, std::size_t(body_size));
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++statistics_.requests;
+      statistics_.payload_bytes += body_size;
+      statistics_.traces += to_integer(header(head, "X-Datadog-Trace-Count"));
+      statistics_.dropped_traces +=
+          to_integer(header(head, "Datadog-Client-Dropped-P0-Traces"));
+      statistics_.dropped_spans +=
+          to_integer(header(head, "Datadog-Client-Dropped-P0-Spans"));
+    }
+
+    return send_all(connection, response);
+  };
+
+  while (serve_request()) {
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  connections_.erase(
+      std::find(connections_.begin(), connections_.end(), connection));
+  ::close(connection);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// This component provides a class, `MockAgent`, that stands in for the Datadog
+// Agent in the load generator (see `load_generator.cpp`).
+//
+// `MockAgent` is a minimal HTTP/1.1 server listening on an ephemeral port of
+// the loopback interface.  It reads each request in full, responds to it with
+// status 200 and a sampling rate of 100% for all services, and tallies what
+// the tracer sent.  Connections are kept alive, and each is served by its own
+// thread.
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MockAgent {
+ public:
+  struct Statistics {
+    std::uint64_t requests = 0;
+    // `payload_bytes` is the total size of the request bodies.
+    std::uint64_t payload_bytes = 0;
+    // `traces` is the sum of the requests' "X-Datadog-Trace-Count" headers, and
+    // `dropped_traces` and `dropped_spans` are the sums of their
+    // "Datadog-Client-Dropped-P0-*" headers.
+    std::uint64_t traces = 0;
+    std::uint64_t dropped_traces = 0;
+    std::uint64_t dropped_spans = 0;
+  };
+
+ private:
+  int listener_;
+  int port_;
+  std::atomic<bool> stopping_;
+  std::thread acceptor_;
+  mutable std::mutex mutex_;
+  std::vector<int> connections_;
+  std::vector<std::thread> handlers_;
+  Statistics statistics_;
+
+  void accept_connections();
+  void serve(int connection);
+
+ public:
+  MockAgent();
+  ~MockAgent();
+
+  MockAgent(const MockAgent&) = delete;
+  MockAgent& operator=(const MockAgent&) = delete;
+
+  // Begin listening for connections.  Return zero on success, or return the
+  // `errno` of the failed operation.
+  int start();
+
+  // Return the port on which this object is listening.
+  int port() const;
+
+  Statistics statistics() const;
+};
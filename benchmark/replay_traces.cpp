@@ -0,0 +1,335 @@
+// This program measures the tracer's handling of recorded traces: encoding,
+// sampling, and sending them to the Datadog Agent.
+//
+// The traces are read from a recording made by `RecordingCollector` (see
+// `recording_collector.h`), so that the measurements reflect the trace shapes
+// and tag cardinality of a real workload rather than those of a synthetic one.
+// The program then reports:
+//
+// - the time taken to encode each trace chunk with `msgpack_encode`, and the
+//   size of the encoding,
+// - the time taken by `TraceSampler::decide` for each chunk's root span and
+//   by `SpanSampler::match` for each span, using the sampling rules of
+//   `DD_TRACE_SAMPLING_RULES`, `DD_SPAN_SAMPLING_RULES`, and
+//   `DD_SPAN_SAMPLING_RULES_FILE`, if any, and
+// - the time taken by `DatadogAgent::send` for each chunk, the duration of
+//   the final flush, and what a `MockAgent` in this process received.
+//
+// The chunks are sent to the `DatadogAgent` at the pace at which they were
+// recorded, according to the start times of their spans, divided by
+// `--speedup`.  A speedup of zero sends them as fast as possible.  Encoding
+// and sampling are measured as fast as possible.  Each measurement goes
+// through the recording `--repeat` times.
+//
+// Usage:
+//
+//     replay_traces --recording=PATH [--speedup=N] [--repeat=N]
+//                   [--flush-interval-milliseconds=N]
+
+#include <datadog/cerr_logger.h>
+#include <datadog/clock.h>
+#include <datadog/datadog_agent.h>
+#include <datadog/datadog_agent_config.h>
+#include <datadog/metrics.h>
+#include <datadog/msgpack.h>
+#include <datadog/recording_collector.h>
+#include <datadog/span_data.h>
+#include <datadog/span_defaults.h>
+#include <datadog/span_sampler.h>
+#include <datadog/span_sampler_config.h>
+#include <datadog/trace_sampler.h>
+#include <datadog/trace_sampler_config.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "histogram.h"
+#include "mock_agent.h"
+
+namespace dd = datadog::tracing;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string recording;
+  double speedup = 1;
+  int repeat = 1;
+  int flush_interval_milliseconds = 2000;
+};
+
+// Parse the specified command line arguments into the specified `options`.
+// Return zero on success, or print a diagnostic and return a nonzero value if
+// an error occurs.
+int parse_options(Options& options, int argc, char* argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view argument = argv[i];
+    const auto equals = argument.find('=');
+    const std::string_view name = argument.substr(0, equals);
+    const std::string value(equals == std::string_view::npos
+                                ? std::string_view()
+                                : argument.substr(equals + 1));
+    if (name == "--recording") {
+      options.recording = value;
+      continue;
+    }
+
+    char* end = nullptr;
+    const double number = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || number < 0) {
+      std::cerr << "Invalid argument: " << argument << '\n';
+      return 1;
+    }
+
+    if (name == "--speedup") {
+      options.speedup = number;
+    } else if (name == "--repeat") {
+      options.repeat = int(number);
+    } else if (name == "--flush-interval-milliseconds") {
+      options.flush_interval_milliseconds = int(number);
+    } else {
+      std::cerr << "Unknown option: " << name << '\n';
+      return 1;
+    }
+  }
+
+  if (options.recording.empty()) {
+    std::cerr << "A recording is required: --recording=PATH\n";
+    return 1;
+  }
+  return 0;
+}
+
+template <typename Value>
+Value require(dd::Expected<Value> result, std::string_view what) {
+  if (!result) {
+    std::cerr << "Unable to " << what << ": " << result.error() << '\n';
+    std::exit(1);
+  }
+  return std::move(*result);
+}
+
+// Return a copy of the specified `spans`.
+std::vector<std::unique_ptr<dd::SpanData>> copy(
+    const std::vector<std::unique_ptr<dd::SpanData>>& spans) {
+  std::vector<std::unique_ptr<dd::SpanData>> result;
+  result.reserve(spans.size());
+  for (const auto& span : spans) {
+    result.push_back(std::make_unique<dd::SpanData>(*span));
+  }
+  return result;
+}
+
+// Return the root span of the specified `spans`, i.e. the span whose parent
+// isn't among them.  Return the first span if there is no such span.
+const dd::SpanData& root_of(
+    const std::vector<std::unique_ptr<dd::SpanData>>& spans) {
+  for (const auto& span : spans) {
+    if (std::none_of(spans.begin(), spans.end(), [&](const auto& other) {
+          return other->span_id == span->parent_id;
+        })) {
+      return *span;
+    }
+  }
+  return *spans.front();
+}
+
+// Return the earliest start time of the specified `spans`.
+std::chrono::system_clock::time_point start_of(
+    const std::vector<std::unique_ptr<dd::SpanData>>& spans) {
+  auto result = std::chrono::system_clock::time_point::max();
+  for (const auto& span : spans) {
+    result = std::min(result, span->start.wall);
+  }
+  return result;
+}
+
+void print_latencies(std::string_view name, const LatencyHistogram& histogram) {
+  const auto ns = [](std::chrono::nanoseconds duration) {
+    return static_cast<long long>(duration.count());
+  };
+  std::printf("  %-14.*s %12llu %10lld %10lld %10lld %10lld %10lld %12lld\n",
+              int(name.size()), name.data(),
+              static_cast<unsigned long long>(histogram.count()),
+              ns(histogram.mean()), ns(histogram.percentile(50)),
+              ns(histogram.percentile(90)), ns(histogram.percentile(99)),
+              ns(histogram.percentile(99.9)), ns(histogram.max()));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Options options;
+  if (const int rc = parse_options(options, argc, argv)) {
+    return rc;
+  }
+
+  auto chunks =
+      require(dd::read_trace_recording(options.recording), "read recording");
+  chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
+                              [](const auto& chunk) {
+                                return chunk.spans.empty();
+                              }),
+               chunks.end());
+  if (chunks.empty()) {
+    std::cerr << "The recording contains no spans.\n";
+    return 1;
+  }
+  std::uint64_t spans = 0;
+  for (const auto& chunk : chunks) {
+    spans += chunk.spans.size();
+  }
+
+  // Encoding
+  LatencyHistogram encode;
+  std::uint64_t encoded_bytes = 0;
+  std::string buffer;
+  for (int i = 0; i < options.repeat; ++i) {
+    for (const auto& chunk : chunks) {
+      buffer.clear();
+      const auto before = Clock::now();
+      auto result = dd::msgpack::pack_array(
+          buffer, chunk.spans, [&](auto& destination, const auto& span) {
+            return dd::msgpack_encode(destination, *span);
+          });
+      encode.record(Clock::now() - before);
+      if (auto* error = result.if_error()) {
+        std::cerr << "Unable to encode a trace chunk: " << *error << '\n';
+        return 1;
+      }
+      encoded_bytes += buffer.size();
+    }
+  }
+
+  // Sampling
+  const auto logger = std::make_shared<dd::CerrLogger>();
+  const auto trace_sampler = std::make_shared<dd::TraceSampler>(
+      require(dd::finalize_config(dd::TraceSamplerConfig{}),
+              "configure the trace sampler"),
+      dd::default_clock);
+  const auto span_sampler = std::make_shared<dd::SpanSampler>(
+      require(dd::finalize_config(dd::SpanSamplerConfig{}, *logger),
+              "configure the span sampler"),
+      dd::default_clock);
+  LatencyHistogram decide;
+  LatencyHistogram match;
+  std::uint64_t kept = 0;
+  std::uint64_t matched = 0;
+  for (int i = 0; i < options.repeat; ++i) {
+    for (const auto& chunk : chunks) {
+      auto before = Clock::now();
+      const auto decision = trace_sampler->decide(root_of(chunk.spans));
+      decide.record(Clock::now() - before);
+      kept += decision.priority > 0;
+      for (const auto& span : chunk.spans) {
+        before = Clock::now();
+        const bool found = bool(span_sampler->match(*span));
+        match.record(Clock::now() - before);
+        matched += found;
+      }
+    }
+  }
+
+  // Sending
+  MockAgent mock_agent;
+  if (const int error = mock_agent.start()) {
+    std::cerr << "Unable to start the mock agent: " << std::strerror(error)
+              << '\n';
+    return 1;
+  }
+  dd::DatadogAgentConfig agent_config;
+  agent_config.url = "http://127.0.0.1:" + std::to_string(mock_agent.port());
+  agent_config.flush_interval_milliseconds =
+      options.flush_interval_milliseconds;
+  LatencyHistogram send;
+  std::chrono::duration<double> elapsed;
+  std::chrono::duration<double, std::milli> final_flush;
+  {
+    dd::DatadogAgent agent{
+        require(dd::finalize_config(agent_config, logger), "configure agent"),
+        dd::default_clock, logger, dd::SpanDefaults{},
+        std::make_shared<dd::Metrics>()};
+    const auto recorded_start = start_of(chunks.front().spans);
+    const auto start = Clock::now();
+    for (int i = 0; i < options.repeat; ++i) {
+      const auto pass_start = Clock::now();
+      for (const auto& chunk : chunks) {
+        if (options.speedup > 0) {
+          const std::chrono::duration<double> offset =
+              start_of(chunk.spans) - recorded_start;
+          std::this_thread::sleep_until(
+              pass_start + std::chrono::duration_cast<Clock::duration>(
+                               offset / options.speedup));
+        }
+        auto spans_copy = copy(chunk.spans);
+        const auto before = Clock::now();
+        auto result =
+            chunk.origin.empty()
+                ? agent.send(std::move(spans_copy), trace_sampler)
+                : agent.send_with_origin(std::move(spans_copy), trace_sampler,
+                                         chunk.origin);
+        send.record(Clock::now() - before);
+        if (auto* error = result.if_error()) {
+          std::cerr << "Unable to send a trace chunk: " << *error << '\n';
+        }
+      }
+    }
+    elapsed = Clock::now() - start;
+
+    const auto before_flush = Clock::now();
+    const auto flushed = agent.flush(before_flush + std::chrono::seconds(30));
+    final_flush = Clock::now() - before_flush;
+    if (auto* error = flushed.if_error()) {
+      std::cerr << "Unable to flush: " << *error << '\n';
+    }
+  }
+  const MockAgent::Statistics received = mock_agent.statistics();
+
+  const std::uint64_t total_chunks = chunks.size() * options.repeat;
+  const std::uint64_t total_spans = spans * options.repeat;
+  std::printf("trace chunks in recording: %llu\n",
+              static_cast<unsigned long long>(chunks.size()));
+  std::printf("spans in recording: %llu\n",
+              static_cast<unsigned long long>(spans));
+  std::printf("repeat: %d\n", options.repeat);
+  std::printf("encoded bytes per chunk: %.1f\n",
+              double(encoded_bytes) / double(total_chunks));
+  std::printf("encoded bytes per span: %.1f\n",
+              double(encoded_bytes) / double(total_spans));
+  std::printf("traces kept by the trace sampler: %llu of %llu\n",
+              static_cast<unsigned long long>(kept),
+              static_cast<unsigned long long>(total_chunks));
+  std::printf("spans matched by the span sampler: %llu of %llu\n",
+              static_cast<unsigned long long>(matched),
+              static_cast<unsigned long long>(total_spans));
+  std::printf("send duration: %.3f s (speedup %g)\n", elapsed.count(),
+              options.speedup);
+  std::printf("final flush: %.3f ms\n", final_flush.count());
+  std::printf("agent requests: %llu\n",
+              static_cast<unsigned long long>(received.requests));
+  std::printf("payload bytes: %llu\n",
+              static_cast<unsigned long long>(received.payload_bytes));
+  std::printf("trace chunks received: %llu\n",
+              static_cast<unsigned long long>(received.traces));
+
+  std::printf("\nlatency (ns):\n");
+  std::printf("  %-14s %12s %10s %10s %10s %10s %10s %12s\n", "operation",
+              "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+  print_latencies("encode_chunk", encode);
+  print_latencies("decide", decide);
+  print_latencies("match", match);
+  print_latencies("send", send);
+}
@@ -0,0 +1,94 @@
+// These benchmarks cover `TraceSampler::decide` and `SpanSampler::match`.
+
+#include <benchmark/benchmark.h>
+#include <datadog/clock.h>
+#include <datadog/span_data.h>
+#include <datadog/span_sampler.h>
+#include <datadog/span_sampler_config.h>
+#include <datadog/trace_sampler.h>
+#include <datadog/trace_sampler_config.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "fixtures.h"
+#include "mocks/loggers.h"
+
+namespace {
+
+SpanData make_span() {
+  SpanData span;
+  span.service = "benchmark";
+  span.name = "http.request";
+  span.resource = "GET /api/v1/users/:id";
+  span.trace_id = TraceID{4942614562549416309ULL};
+  span.tags.emplace("http.method", "GET");
+  return span;
+}
+
+template <typename Finalized>
+Finalized require(Expected<Finalized> result) {
+  if (!result) {
+    std::cerr << "Unable to configure the sampler: " << result.error() << '\n';
+    std::exit(1);
+  }
+  return std::move(*result);
+}
+
+void BM_TraceSamplerDecide(benchmark::State& state) {
+  // `state.range(0)` is the number of rules, which the span matches only the
+  // last of.
+  TraceSamplerConfig config;
+  for (int i = 1; i < state.range(0); ++i) {
+    TraceSamplerConfig::Rule rule;
+    rule.service = "other-service-" + std::to_string(i);
+    config.rules.push_back(rule);
+  }
+  if (state.range(0) > 0) {
+    TraceSamplerConfig::Rule rule;
+    rule.service = "bench*";
+    rule.name = "http.*";
+    config.rules.push_back(rule);
+  }
+  // Don't let the limiter decide.
+  config.max_per_second = 1e9;
+  TraceSampler sampler{require(finalize_config(config)), default_clock};
+
+  SpanData span = make_span();
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sampler.decide(span));
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_TraceSamplerDecide)->Arg(0)->Arg(1)->Arg(10);
+
+void BM_SpanSamplerMatch(benchmark::State& state) {
+  // `state.range(0)` is the number of rules, which the span matches only the
+  // last of.
+  SpanSamplerConfig config;
+  for (int i = 1; i < state.range(0); ++i) {
+    SpanSamplerConfig::Rule rule;
+    rule.name = "other.operation." + std::to_string(i);
+    config.rules.push_back(rule);
+  }
+  SpanSamplerConfig::Rule rule;
+  rule.service = "bench*";
+  rule.resource = "GET /api/*";
+  rule.tags.emplace("http.method", "GET");
+  config.rules.push_back(rule);
+  NullLogger logger;
+  SpanSampler sampler{require(finalize_config(config, logger)), default_clock};
+
+  SpanData span = make_span();
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sampler.match(span));
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_SpanSamplerMatch)->Arg(1)->Arg(10);
+
+}  // namespace
@@ -0,0 +1,50 @@
+// These benchmarks cover the MessagePack encoding of `SpanData`, as performed
+// when a trace chunk is sent to the Datadog Agent.
+
+#include <benchmark/benchmark.h>
+#include <datadog/span_data.h>
+
+#include <chrono>
+#include <string>
+
+#include "fixtures.h"
+
+namespace {
+
+SpanData make_span() {
+  SpanData span;
+  span.service = "benchmark";
+  span.service_type = "web";
+  span.name = "http.request";
+  span.resource = "GET /api/v1/users/:id";
+  span.trace_id = TraceID{4942614562549416309ULL};
+  span.span_id = 6756151711809114196ULL;
+  span.parent_id = 1539413398231362906ULL;
+  span.duration = std::chrono::microseconds(1234);
+  span.tags.emplace("env", "dev");
+  span.tags.emplace("version", "1.0");
+  span.tags.emplace("http.method", "GET");
+  span.tags.emplace("http.url", "https://example.com/api/v1/users/42");
+  span.tags.emplace("http.status_code", "200");
+  span.tags.emplace("_dd.p.dm", "-0");
+  span.numeric_tags.emplace("_sampling_priority_v1", 1);
+  span.numeric_tags.emplace("_dd.agent_psr", 1);
+  return span;
+}
+
+void BM_MsgpackEncodeSpanData(benchmark::State& state) {
+  const SpanData span = make_span();
+  std::string buffer;
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    buffer.clear();
+    auto result = msgpack_encode(buffer, span);
+    benchmark::DoNotOptimize(result);
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  report_allocations(state, allocations);
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_MsgpackEncodeSpanData);
+
+}  // namespace
@@ -0,0 +1,55 @@
+// These benchmarks cover `decode_tags` and `encode_tags`, which parse and
+// produce the "x-datadog-tags" header.
+
+#include <benchmark/benchmark.h>
+#include <datadog/flat_map.h>
+#include <datadog/tag_propagation.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "fixtures.h"
+
+namespace {
+
+const std::string_view header =
+    "_dd.p.dm=-4,_dd.p.tid=640cfd8d00000000,_dd.p.usr=YmVuY2htYXJr";
+
+void BM_DecodeTags(benchmark::State& state) {
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto tags = decode_tags(header);
+    benchmark::DoNotOptimize(tags);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_DecodeTags);
+
+void BM_DecodeTagsVisit(benchmark::State& state) {
+  std::size_t total = 0;
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto result = decode_tags(
+        header, [&](std::string_view key, std::string_view value) {
+          total += key.size() + value.size();
+        });
+    benchmark::DoNotOptimize(result);
+  }
+  report_allocations(state, allocations);
+  benchmark::DoNotOptimize(total);
+}
+BENCHMARK(BM_DecodeTagsVisit);
+
+void BM_EncodeTags(benchmark::State& state) {
+  const auto tags = decode_tags(header);
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto encoded = encode_tags(*tags);
+    benchmark::DoNotOptimize(encoded);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_EncodeTags);
+
+}  // namespace
@@ -0,0 +1,181 @@
+// These benchmarks cover the creation of spans by `Tracer` and `Span`, the
+// setting of tags, and the extraction and injection of trace context.
+//
+// Each span created by a benchmark is finished within the benchmark, and so
+// the cost of finishing the span (and, for a root span, of making a sampling
+// decision and sending the trace chunk to a `NullCollector`) is included.
+
+#include <benchmark/benchmark.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/tracer.h>
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "fixtures.h"
+#include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
+
+namespace {
+
+void BM_TracerCreateSpan(benchmark::State& state) {
+  Tracer tracer{make_tracer_config()};
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto span = tracer.create_span();
+    benchmark::DoNotOptimize(span);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_TracerCreateSpan);
+
+void BM_TracerCreateSpanWithConfig(benchmark::State& state) {
+  Tracer tracer{make_tracer_config()};
+  SpanConfig config;
+  config.name = "http.request";
+  config.resource = "GET /api/v1/users";
+  config.tags.emplace("http.method", "GET");
+  config.tags.emplace("http.url", "https://example.com/api/v1/users");
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto span = tracer.create_span(config);
+    benchmark::DoNotOptimize(span);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_TracerCreateSpanWithConfig);
+
+// Create root spans with twenty default tags, as if from `DD_TAGS`.
+void BM_TracerCreateSpanWithDefaultTags(benchmark::State& state) {
+  auto config = make_tracer_config();
+  for (int i = 0; i < 20; ++i) {
+    config.defaults.tags.insert_or_assign("tag" + std::to_string(i),
+                                          "value" + std::to_string(i));
+  }
+  Tracer tracer{config};
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto span = tracer.create_span();
+    benchmark::DoNotOptimize(span);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_TracerCreateSpanWithDefaultTags);
+
+void BM_SpanCreateChild(benchmark::State& state) {
+  // A trace segment keeps its spans until the whole segment is finished, so
+  // the root span is replaced periodically to bound the segment's size.
+  const std::size_t children_per_root = 1000;
+  Tracer tracer{make_tracer_config()};
+  std::optional<Span> root = tracer.create_span();
+  std::size_t children = 0;
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto child = root->create_child();
+    benchmark::DoNotOptimize(child);
+    if (++children == children_per_root) {
+      state.PauseTiming();
+      root.reset();
+      root = tracer.create_span();
+      children = 0;
+      state.ResumeTiming();
+    }
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_SpanCreateChild);
+
+// Create children from a `SpanConfig`, or from a `SpanConfigView`, built in
+// each iteration, as an instrumented RPC client would.
+template <typename Config>
+void BM_SpanCreateChildWithConfig(benchmark::State& state) {
+  const std::size_t children_per_root = 1000;
+  Tracer tracer{make_tracer_config()};
+  std::optional<Span> root = tracer.create_span();
+  std::size_t children = 0;
+  const std::string method = "/users.UserService/GetUserProfile";
+  const std::string peer = "users-backend.internal.example.com";
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    Config config;
+    config.name = "grpc.client";
+    config.resource = method;
+    config.tags.emplace("rpc.method", method);
+    config.tags.emplace("peer.hostname", peer);
+    auto child = root->create_child(config);
+    benchmark::DoNotOptimize(child);
+    if (++children == children_per_root) {
+      state.PauseTiming();
+      root.reset();
+      root = tracer.create_span();
+      children = 0;
+      state.ResumeTiming();
+    }
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK_TEMPLATE(BM_SpanCreateChildWithConfig, SpanConfig);
+BENCHMARK_TEMPLATE(BM_SpanCreateChildWithConfig, SpanConfigView);
+
+void BM_SpanSetTag(benchmark::State& state) {
+  Tracer tracer{make_tracer_config()};
+  auto span = tracer.create_span();
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    span.set_tag("http.route", "/api/v1/users/:id");
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_SpanSetTag);
+
+void BM_TracerExtractSpan(benchmark::State& state) {
+  Tracer tracer{make_tracer_config()};
+  const std::unordered_map<std::string, std::string> headers{
+      {"x-datadog-trace-id", "4942614562549416309"},
+      {"x-datadog-parent-id", "6756151711809114196"},
+      {"x-datadog-sampling-priority", "1"},
+      {"x-datadog-origin", "synthetics"},
+      {"x-datadog-tags", "_dd.p.dm=-4,_dd.p.tid=640cfd8d00000000"},
+  };
+  const MockDictReader reader{headers};
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto span = tracer.extract_span(reader);
+    benchmark::DoNotOptimize(span);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_TracerExtractSpan);
+
+void BM_SpanInject(benchmark::State& state) {
+  Tracer tracer{make_tracer_config()};
+  auto span = tracer.create_span();
+  MockDictWriter writer;
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    span.inject(writer);
+  }
+  report_allocations(state, allocations);
+  benchmark::DoNotOptimize(writer.items);
+}
+BENCHMARK(BM_SpanInject);
+
+// A disabled tracer creates no-op spans.  This is the cost of tracing for a
+// service that has the tracer compiled in but turned off.
+void BM_DisabledTracerCreateSpan(benchmark::State& state) {
+  Tracer tracer{make_tracer_config(false)};
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+    child.set_tag("http.method", "GET");
+    benchmark::DoNotOptimize(child);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_DisabledTracerCreateSpan);
+
+}  // namespace
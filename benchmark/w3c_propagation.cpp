@@ -0,0 +1,41 @@
+// These benchmarks cover `parse_traceparent` and `format_traceparent`, which
+// handle the W3C "traceparent" header on every inbound and outbound request.
+
+#include <benchmark/benchmark.h>
+#include <datadog/trace_id.h>
+#include <datadog/w3c_propagation.h>
+
+#include <cstdint>
+#include <string_view>
+
+#include "fixtures.h"
+
+namespace {
+
+const std::string_view traceparent =
+    "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+
+void BM_ParseTraceparent(benchmark::State& state) {
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto result = parse_traceparent(traceparent);
+    benchmark::DoNotOptimize(result);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_ParseTraceparent);
+
+void BM_FormatTraceparent(benchmark::State& state) {
+  const TraceID trace_id{0xa3ce929d0e0e4736, 0x4bf92f3577b34da6};
+  const std::uint64_t parent_id = 0x00f067aa0ba902b7;
+  TraceParentBuffer buffer;
+  const AllocationCounter allocations;
+  for (auto _ : state) {
+    auto result = format_traceparent(buffer, trace_id, parent_id, true);
+    benchmark::DoNotOptimize(result);
+  }
+  report_allocations(state, allocations);
+}
+BENCHMARK(BM_FormatTraceparent);
+
+}  // namespace
@@ -0,0 +1,81 @@
+#include "active_span.h"
+
+#include <atomic>
+#include <cassert>
+
+#include "span.h"
+#include "trace_segment.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `top` is the most recently created `ActiveSpan` of the calling thread that
+// still exists, or null if there is none.
+thread_local const ActiveSpan* top = nullptr;
+
+// `IDSlot` contains the IDs of the calling thread's active span.  A
+// `span_id` of zero means that there is no active span.  `span_id` is written
+// last and read first, so that a signal handler that interrupts an update
+// sees no span rather than a mixture of two spans' IDs.  Since the handler
+// runs on the thread that it interrupts, signal fences suffice to order the
+// stores.
+struct IDSlot {
+  std::atomic<std::uint64_t> trace_id_high{0};
+  std::atomic<std::uint64_t> trace_id_low{0};
+  std::atomic<std::uint64_t> span_id{0};
+  std::atomic<std::uint64_t> local_root_span_id{0};
+};
+
+thread_local IDSlot slot;
+
+void store_ids(const Span* span) {
+  constexpr auto relaxed = std::memory_order_relaxed;
+  slot.span_id.store(0, relaxed);
+  if (!span) {
+    return;
+  }
+  std::atomic_signal_fence(std::memory_order_release);
+  const TraceID trace_id = span->trace_id();
+  slot.trace_id_high.store(trace_id.high, relaxed);
+  slot.trace_id_low.store(trace_id.low, relaxed);
+  slot.local_root_span_id.store(span->trace_segment().local_root_id(),
+                                relaxed);
+  std::atomic_signal_fence(std::memory_order_release);
+  slot.span_id.store(span->id(), relaxed);
+}
+
+}  // namespace
+
+ActiveSpan::ActiveSpan(Span& span) : ActiveSpan(&span) {}
+
+ActiveSpan::ActiveSpan(Span* span) : span_(span), previous_(top) {
+  top = this;
+  store_ids(span_);
+}
+
+ActiveSpan::~ActiveSpan() {
+  assert(top == this);
+  top = previous_;
+  store_ids(active_span());
+}
+
+Span* active_span() { return top ? top->span_ : nullptr; }
+
+std::optional<ActiveSpanIDs> active_span_ids() {
+  constexpr auto relaxed = std::memory_order_relaxed;
+  const std::uint64_t span_id = slot.span_id.load(relaxed);
+  if (span_id == 0) {
+    return std::nullopt;
+  }
+  std::atomic_signal_fence(std::memory_order_acquire);
+  ActiveSpanIDs result;
+  result.trace_id.high = slot.trace_id_high.load(relaxed);
+  result.trace_id.low = slot.trace_id_low.load(relaxed);
+  result.span_id = span_id;
+  result.local_root_span_id = slot.local_root_span_id.load(relaxed);
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,132 @@
+#pragma once
+
+// This component provides a class, `ActiveSpan`, that makes a `Span` the
+// active span of the calling thread for as long as the `ActiveSpan` exists,
+// and a function, `active_span`, that returns the calling thread's active
+// span.
+//
+// Each thread has a stack of active spans.  Constructing an `ActiveSpan`
+// pushes its span onto the stack, and destroying the `ActiveSpan` pops it, so
+// that the span active before is active again.  The stack is linked through
+// the `ActiveSpan` objects themselves, and so activating a span costs a
+// couple of pointer writes and does not allocate memory.
+//
+// An `ActiveSpan` must be destroyed on the thread that created it, in the
+// reverse order of creation, which is the case for local variables.  While
+// it's active, the span must not be moved or destroyed.
+//
+// If `TracerConfig::active_span_as_parent` is `true`, then
+// `Tracer::create_span` creates a child of the calling thread's active span,
+// if there is one, instead of the root of a new trace.  Either way,
+// `active_span` can be used to correlate logs or profiles with the current
+// trace, e.g. by reading the active span's `trace_id` and `id`.
+//
+// Work that resumes later, possibly on another thread, such as a completion
+// handler posted to an executor or a coroutine's continuation, can carry the
+// active span with it.  `bind_active_span` wraps a handler so that, whenever
+// it is invoked, the span that was active when it was wrapped is active for
+// the duration of the call.  The wrapper holds only a `Span*` in addition to
+// the handler, and so invoking it costs the same as an `ActiveSpan`.  The span
+// must remain in place until the handler has finished, which is the case for
+// a span that lives in a coroutine frame or in a connection's state.
+//
+// For example:
+//
+//     auto span = tracer.create_span();
+//     ActiveSpan scope{span};
+//     // Creates a child of `span`, if so configured.
+//     auto child = tracer.create_span();
+//     log(active_span()->trace_id(), active_span()->id());
+//     // `span` is active while the handler runs.
+//     post(executor, bind_active_span([]() { do_work(); }));
+//
+// A sampling profiler's signal handler can't call `active_span`, since the
+// span's properties aren't safe to read from a signal handler.  Instead,
+// `ActiveSpan` copies the IDs of the span that it activates, and of the span
+// that it restores, into a per-thread slot, and `active_span_ids` reads the
+// slot.  `active_span_ids` is async-signal-safe: the slot is written with
+// relaxed atomic stores, ordered by signal fences, so that a signal handler
+// that interrupts the calling thread sees either the old IDs or the new IDs,
+// or no span.  Updating the slot costs five relaxed stores per activation.
+//
+// The slot is a `thread_local` variable, and so in a shared library that's
+// loaded by `dlopen`, the first access on a thread might allocate its storage.
+// Calling `active_span_ids` once on each thread, outside of a signal handler,
+// e.g. when the profiler registers the thread, avoids that.
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+class Span;
+
+class ActiveSpan {
+  Span* span_;
+  const ActiveSpan* previous_;
+
+  friend Span* active_span();
+
+ public:
+  // Make the specified `span` the active span of the calling thread.
+  explicit ActiveSpan(Span& span);
+  // Make the specified `span` the active span of the calling thread, or make
+  // no span active if `span` is null.
+  explicit ActiveSpan(Span* span);
+  ActiveSpan(const ActiveSpan&) = delete;
+  ActiveSpan& operator=(const ActiveSpan&) = delete;
+
+  // Restore the calling thread's previously active span, if any.
+  ~ActiveSpan();
+};
+
+// Return the active span of the calling thread, or return null if there is
+// none.
+Span* active_span();
+
+// `ActiveSpanIDs` identifies an active span, its trace, and the local root
+// span of its trace segment, which identifies e.g. the request being served.
+struct ActiveSpanIDs {
+  TraceID trace_id;
+  std::uint64_t span_id;
+  std::uint64_t local_root_span_id;
+};
+
+// Return the IDs of the active span of the calling thread, or return nothing
+// if there is none.  This function is async-signal-safe.
+std::optional<ActiveSpanIDs> active_span_ids();
+
+// `ActiveSpanHandler` is the callable returned by `bind_active_span`.
+template <typename Handler>
+class ActiveSpanHandler {
+  Span* span_;
+  Handler handler_;
+
+ public:
+  ActiveSpanHandler(Span* span, Handler handler)
+      : span_(span), handler_(std::move(handler)) {}
+
+  // Invoke the handler with the specified `args`, with the span bound to this
+  // object active.
+  template <typename... Args>
+  decltype(auto) operator()(Args&&... args) {
+    const ActiveSpan scope{span_};
+    return handler_(std::forward<Args>(args)...);
+  }
+};
+
+// Return a callable that invokes the specified `handler` with the calling
+// thread's current active span, or with no span, active.
+template <typename Handler>
+ActiveSpanHandler<std::decay_t<Handler>> bind_active_span(Handler&& handler) {
+  return ActiveSpanHandler<std::decay_t<Handler>>(
+      active_span(), std::forward<Handler>(handler));
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,198 @@
+#include "adaptive_sampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "sampling_util.h"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `smoothing` is the weight of the previous measurement of a group's traffic,
+// or of the spans per trace, when a new measurement is taken.
+constexpr double smoothing = 0.5;
+
+// A group whose smoothed traffic falls below `min_traces_per_second` is no
+// longer tracked.
+constexpr double min_traces_per_second = 0.01;
+
+double smooth(double previous, double measured) {
+  return smoothing * previous + (1 - smoothing) * measured;
+}
+
+}  // namespace
+
+AdaptiveSampler::Group::Group(const Key& key, Rate rate)
+    : service(std::get<0>(key)),
+      resource(std::get<1>(key)),
+      error(std::get<2>(key)),
+      decision{rate, max_id_from_rate(rate)} {}
+
+std::size_t AdaptiveSampler::Rates::hash(std::string_view service,
+                                         std::string_view resource,
+                                         bool error) {
+  const std::hash<std::string_view> hash;
+  const std::size_t result = hash(service);
+  return (result ^ (hash(resource) + 0x9e3779b9 + (result << 6) +
+                    (result >> 2))) +
+         std::size_t(error);
+}
+
+const AdaptiveSampler::Group* AdaptiveSampler::Rates::find(
+    std::string_view service, std::string_view resource, bool error) const {
+  const auto [begin, end] = groups.equal_range(hash(service, resource, error));
+  for (auto iter = begin; iter != end; ++iter) {
+    const Group& group = iter->second;
+    if (group.error == error && group.service == service &&
+        group.resource == resource) {
+      return &group;
+    }
+  }
+  return nullptr;
+}
+
+AdaptiveSampler::AdaptiveSampler(const Clock& clock,
+                                 double target_spans_per_second)
+    : clock_(clock),
+      target_spans_per_second_(target_spans_per_second),
+      rates_(std::make_shared<const Rates>()),
+      spans_(0),
+      spans_per_trace_(0),
+      previous_adapt_(clock_()) {}
+
+AdaptiveSampler::Decision AdaptiveSampler::decide(const SpanData& span) {
+  const auto rates =
+      std::atomic_load_explicit(&rates_, std::memory_order_acquire);
+  const Group* group = rates->find(span.service, span.resource, span.error);
+  if (!group && rates->full) {
+    group = rates->find("", "", span.error);
+  }
+  if (group) {
+    group->traces.fetch_add(1, std::memory_order_relaxed);
+    return group->decision;
+  }
+
+  Key key{span.service, span.resource, span.error};
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (traces_per_second_.size() + new_groups_.size() >= max_groups &&
+      !new_groups_.count(key)) {
+    key = Key{"", "", span.error};
+  }
+  ++new_groups_[std::move(key)];
+  return Decision{Rate::one(), max_id_from_rate(Rate::one())};
+}
+
+void AdaptiveSampler::count_spans(std::size_t count) {
+  spans_.fetch_add(count, std::memory_order_relaxed);
+}
+
+void AdaptiveSampler::adapt() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto now = clock_();
+  const double seconds =
+      std::chrono::duration<double>(now - previous_adapt_).count();
+  if (!(seconds > 0)) {
+    return;
+  }
+  previous_adapt_ = now;
+
+  // Gather the traces counted since the previous call.  A trace counted in a
+  // snapshot that is concurrently being replaced might be missed.
+  std::map<Key, std::uint64_t> counts = std::move(new_groups_);
+  new_groups_.clear();
+  const auto previous =
+      std::atomic_load_explicit(&rates_, std::memory_order_relaxed);
+  std::uint64_t total_traces = 0;
+  for (const auto& entry : previous->groups) {
+    const Group& group = entry.second;
+    const auto traces = group.traces.exchange(0, std::memory_order_relaxed);
+    counts[Key{group.service, group.resource, group.error}] += traces;
+  }
+  for (const auto& entry : counts) {
+    total_traces += entry.second;
+  }
+  const auto spans = spans_.exchange(0, std::memory_order_relaxed);
+  if (total_traces && spans) {
+    const double measured = double(spans) / total_traces;
+    spans_per_trace_ = spans_per_trace_ ? smooth(spans_per_trace_, measured)
+                                        : measured;
+  }
+
+  // Update each group's traffic, and forget the groups that have gone quiet.
+  for (const auto& [key, traces] : counts) {
+    const double measured = traces / seconds;
+    const auto [iter, inserted] = traces_per_second_.emplace(key, measured);
+    if (!inserted) {
+      iter->second = smooth(iter->second, measured);
+    }
+  }
+  for (auto iter = traces_per_second_.begin();
+       iter != traces_per_second_.end();) {
+    if (!counts.count(iter->first)) {
+      iter->second = smooth(iter->second, 0);
+    }
+    if (iter->second < min_traces_per_second) {
+      iter = traces_per_second_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  // Divide the budget, in traces per second, by water filling from the
+  // quietest group to the busiest.
+  std::vector<std::pair<double, const Key*>> traffic;
+  traffic.reserve(traces_per_second_.size());
+  for (const auto& [key, traces_per_second] : traces_per_second_) {
+    traffic.emplace_back(traces_per_second, &key);
+  }
+  std::sort(traffic.begin(), traffic.end());
+  double budget = target_spans_per_second_ / std::max(spans_per_trace_, 1.0);
+
+  auto rates = std::make_shared<Rates>();
+  rates->groups.reserve(traffic.size() + 2);
+  for (std::size_t i = 0; i < traffic.size(); ++i) {
+    const auto& [traces_per_second, key] = traffic[i];
+    const double share = budget / (traffic.size() - i);
+    double rate = 1.0;
+    if (traces_per_second > share) {
+      rate = share / traces_per_second;
+      budget -= share;
+    } else {
+      budget -= traces_per_second;
+    }
+    const auto& [service, resource, error] = *key;
+    rates->groups.emplace(
+        std::piecewise_construct,
+        std::forward_as_tuple(Rates::hash(service, resource, error)),
+        std::forward_as_tuple(*key, *Rate::from(std::clamp(rate, 0.0, 1.0))));
+  }
+  // Leave room for the two groups that the others share once full.
+  if (traces_per_second_.size() + 2 >= max_groups) {
+    rates->full = true;
+    for (const bool error : {false, true}) {
+      if (!rates->find("", "", error)) {
+        const Key key{"", "", error};
+        rates->groups.emplace(
+            std::piecewise_construct,
+            std::forward_as_tuple(Rates::hash("", "", error)),
+            std::forward_as_tuple(key, Rate::one()));
+      }
+    }
+  }
+
+  std::shared_ptr<const Rates> snapshot = std::move(rates);
+  std::atomic_store_explicit(&rates_, std::move(snapshot),
+                             std::memory_order_release);
+}
+
+double AdaptiveSampler::target_spans_per_second() const {
+  return target_spans_per_second_;
+}
+
+}  // namespace tracing
+}  // namespace datadog
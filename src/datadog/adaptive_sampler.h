@@ -0,0 +1,126 @@
+#pragma once
+
+// This component provides a class, `AdaptiveSampler`, that chooses trace
+// sample rates so that the traces kept add up to a target number of spans per
+// second.
+//
+// `AdaptiveSampler` is used by `TraceSampler` when
+// `TraceSamplerConfig::target_spans_per_second` is configured.  See
+// `trace_sampler.h`.
+//
+// Traces are grouped by the service, resource, and error status of their root
+// span.  `decide` counts each trace in its group and returns the group's
+// current rate.  `adapt`, which `Tracer` calls periodically on an event
+// scheduler, measures each group's traces per second since the previous call,
+// smooths the measurements, and then recomputes the rates.
+//
+// The target is converted into traces per second using the average number of
+// spans per trace, which is measured from the spans reported to
+// `count_spans`.  That budget is then divided among the groups by "water
+// filling": groups whose traffic is less than an equal share of the remaining
+// budget are kept entirely, and the rest of the budget is divided equally
+// among the busier groups.  So, rare endpoints, and traces whose root span
+// has an error (which are grouped apart from those without), are favored over
+// busy endpoints during spikes.
+//
+// A group not seen before is kept entirely until the next `adapt`.  At most
+// `max_groups` groups are tracked.  Beyond that, the traces of groups not
+// already tracked share one group per error status, as if their service and
+// resource were empty.
+//
+// `decide` does not lock, except to count a group not seen before.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+#include "clock.h"
+#include "rate.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+class AdaptiveSampler {
+ public:
+  // `Decision` is a sample rate and the sampling threshold derived from it
+  // (see `max_id_from_rate`).
+  struct Decision {
+    Rate rate;
+    std::uint64_t max_id;
+  };
+
+  static constexpr std::size_t max_groups = 1000;
+
+ private:
+  // `Key` is the service, resource, and error status of a group.
+  using Key = std::tuple<std::string, std::string, bool>;
+
+  // `Group` is a group's entry in a `Rates` snapshot.  `traces` is the number
+  // of traces counted since the snapshot was made.
+  struct Group {
+    std::string service;
+    std::string resource;
+    bool error;
+    Decision decision;
+    mutable std::atomic<std::uint64_t> traces{0};
+
+    Group(const Key&, Rate);
+  };
+
+  // `Rates` is an immutable snapshot of the groups' rates, keyed by a hash of
+  // the group (see `hash`).  If `full`, then the traces of groups not in
+  // `groups` are counted in the group having an empty service and resource,
+  // which is then always present.
+  struct Rates {
+    std::unordered_multimap<std::size_t, Group> groups;
+    bool full = false;
+
+    static std::size_t hash(std::string_view service, std::string_view resource,
+                            bool error);
+    // Return the group of the specified `service`, `resource`, and `error`, or
+    // return null if there is none.
+    const Group* find(std::string_view service, std::string_view resource,
+                      bool error) const;
+  };
+
+  Clock clock_;
+  double target_spans_per_second_;
+  // `rates_` is read and replaced using the atomic `shared_ptr` functions.
+  std::shared_ptr<const Rates> rates_;
+  // `spans_` is the number of spans counted since the previous `adapt`.
+  std::atomic<std::uint64_t> spans_;
+
+  // `mutex_` protects the members below.
+  std::mutex mutex_;
+  // `new_groups_` counts the traces of groups not in `rates_`.
+  std::map<Key, std::uint64_t> new_groups_;
+  // `traces_per_second_` is the smoothed traffic of each tracked group.
+  std::map<Key, double> traces_per_second_;
+  double spans_per_trace_;
+  TimePoint previous_adapt_;
+
+ public:
+  AdaptiveSampler(const Clock& clock, double target_spans_per_second);
+
+  // Count the trace whose root is the specified `span`, and return the rate
+  // at which to keep it.
+  Decision decide(const SpanData& span);
+  // Count the specified number of finished spans.
+  void count_spans(std::size_t count);
+  // Recompute the rates from the traffic counted since the previous call.
+  void adapt();
+
+  double target_spans_per_second() const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
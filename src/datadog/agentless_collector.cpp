@@ -0,0 +1,402 @@
+#include "agentless_collector.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "dict_writer.h"
+#include "error_stack.h"
+#include "gzip.h"
+#include "json.hpp"
+#include "logger.h"
+#include "protobuf.h"
+#include "span_data.h"
+#include "tags.h"
+#include "version.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// These are the field numbers of the Datadog Agent's protobuf messages, as
+// defined in the "pkg/proto/datadog/trace" directory of the Agent's
+// repository.
+namespace agent_payload {
+constexpr std::uint32_t host_name = 1;
+constexpr std::uint32_t env = 2;
+constexpr std::uint32_t tracer_payloads = 5;
+}  // namespace agent_payload
+
+namespace tracer_payload {
+constexpr std::uint32_t language_name = 2;
+constexpr std::uint32_t language_version = 3;
+constexpr std::uint32_t tracer_version = 4;
+constexpr std::uint32_t chunks = 6;
+constexpr std::uint32_t env = 8;
+constexpr std::uint32_t hostname = 9;
+constexpr std::uint32_t app_version = 10;
+}  // namespace tracer_payload
+
+namespace trace_chunk {
+constexpr std::uint32_t priority = 1;
+constexpr std::uint32_t origin = 2;
+constexpr std::uint32_t spans = 3;
+constexpr std::uint32_t dropped_trace = 5;
+}  // namespace trace_chunk
+
+namespace span {
+constexpr std::uint32_t service = 1;
+constexpr std::uint32_t name = 2;
+constexpr std::uint32_t resource = 3;
+constexpr std::uint32_t trace_id = 4;
+constexpr std::uint32_t span_id = 5;
+constexpr std::uint32_t parent_id = 6;
+constexpr std::uint32_t start = 7;
+constexpr std::uint32_t duration = 8;
+constexpr std::uint32_t error = 9;
+constexpr std::uint32_t meta = 10;
+constexpr std::uint32_t metrics = 11;
+constexpr std::uint32_t type = 12;
+}  // namespace span
+
+std::int64_t nanoseconds(Duration duration) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+      .count();
+}
+
+// Append to the specified `destination` the specified `data` as a protobuf
+// "Span" message in the "spans" field of a "TraceChunk", where the trace has
+// the specified `origin`.
+void encode_span(std::string& destination, const SpanData& data,
+                 std::string_view origin) {
+  namespace pb = protobuf;
+  const auto begin = pb::begin_message(destination, trace_chunk::spans);
+  pb::pack_string(destination, span::service, data.service);
+  pb::pack_string(destination, span::name, data.name);
+  pb::pack_string(destination, span::resource, data.resource);
+  pb::pack_uint64(destination, span::trace_id, data.trace_id.low);
+  pb::pack_uint64(destination, span::span_id, data.span_id);
+  pb::pack_uint64(destination, span::parent_id, data.parent_id);
+  pb::pack_int64(destination, span::start,
+                 nanoseconds(data.start.wall.time_since_epoch()));
+  pb::pack_int64(destination, span::duration, nanoseconds(data.duration));
+  pb::pack_int32(destination, span::error, std::int32_t(data.error));
+  if (!origin.empty()) {
+    pb::pack_map_entry(destination, span::meta, tags::internal::origin,
+                       origin);
+  }
+  for (const auto& [key, value] : data.tags) {
+    pb::pack_map_entry(destination, span::meta, key, value);
+  }
+  for (const auto& [key, value] : data.numeric_tags) {
+    pb::pack_map_entry(destination, span::metrics, key, value);
+  }
+  for (std::size_t i = 0; i < data.mark_count; ++i) {
+    pb::pack_map_entry(destination, span::metrics, data.marks[i].name,
+                       double(nanoseconds(data.marks[i].offset)));
+  }
+  pb::pack_string(destination, span::type, data.service_type);
+  pb::end_message(destination, begin);
+}
+
+// Return the value of the tag having the specified `name` on the specified
+// `data`, or an empty string if there isn't one.
+std::string tag_value(const SpanData& data, const std::string& name) {
+  const auto found = data.tags.find(name);
+  return found == data.tags.end() ? std::string() : found->second;
+}
+
+bool same_tracer(const AgentlessCollector::EncodedTraceChunk& left,
+                 const AgentlessCollector::EncodedTraceChunk& right) {
+  return left.environment == right.environment &&
+         left.version == right.version && left.hostname == right.hostname;
+}
+
+// Return how many bytes the specified `chunk` adds to a payload, including
+// its field's tag and length, and the enclosing "TracerPayload" fields.
+std::size_t payload_size(
+    const AgentlessCollector::EncodedTraceChunk& chunk) {
+  constexpr std::size_t overhead = 16;
+  return chunk.body.size() + overhead;
+}
+
+}  // namespace
+
+AgentlessCollector::AgentlessCollector(
+    const FinalizedAgentlessCollectorConfig& config,
+    const std::shared_ptr<Logger>& logger)
+    : logger_(logger),
+      http_client_(config.http_client),
+      event_scheduler_(config.event_scheduler),
+      api_key_(config.api_key),
+      url_(config.url),
+      flush_interval_(config.flush_interval),
+      max_payload_bytes_(config.max_payload_bytes),
+      compression_(config.compression),
+      compression_level_(config.compression_level),
+      in_flight_(std::make_shared<InFlightRequests>()),
+      buffered_bytes_(0) {
+  cancel_flush_ = event_scheduler_->schedule_recurring_event(
+      flush_interval_, [this]() { flush(); });
+}
+
+AgentlessCollector::~AgentlessCollector() {
+  cancel_flush_();
+  flush();
+  http_client_->drain(std::chrono::steady_clock::now() + flush_interval_);
+}
+
+Expected<void> AgentlessCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& /*response_handler*/) {
+  return buffer(std::move(spans), "");
+}
+
+Expected<void> AgentlessCollector::send_with_origin(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& /*response_handler*/,
+    std::string_view origin) {
+  return buffer(std::move(spans), origin);
+}
+
+Expected<void> AgentlessCollector::buffer(
+    std::vector<std::unique_ptr<SpanData>>&& spans, std::string_view origin) {
+  if (spans.empty()) {
+    return {};
+  }
+
+  // The sampling priority is on the local root span, which is first.
+  std::int32_t priority = 0;
+  {
+    const auto& numeric_tags = spans.front()->numeric_tags;
+    const auto found = numeric_tags.find(tags::internal::sampling_priority);
+    if (found != numeric_tags.end()) {
+      priority = std::int32_t(found->second);
+    }
+  }
+  EncodedTraceChunk chunk;
+  const SpanData& root = *spans.front();
+  chunk.environment = tag_value(root, tags::environment);
+  chunk.version = tag_value(root, tags::version);
+  chunk.hostname = tag_value(root, tags::internal::hostname);
+
+  const bool dropped = priority <= 0 && root.numeric_tags.contains(
+                                            tags::internal::sampling_priority);
+  if (dropped) {
+    // Of a dropped trace, only the spans kept by span sampling are sent.
+    spans.erase(std::remove_if(spans.begin(), spans.end(),
+                               [](const std::unique_ptr<SpanData>& span) {
+                                 return !span->numeric_tags.contains(
+                                     tags::internal::span_sampling_mechanism);
+                               }),
+                spans.end());
+    if (spans.empty()) {
+      return {};
+    }
+  }
+
+  symbolize_error_stacks(spans);
+  std::string& body = chunk.body;
+  protobuf::pack_int32(body, trace_chunk::priority, priority);
+  if (!origin.empty()) {
+    protobuf::pack_string(body, trace_chunk::origin, origin);
+  }
+  for (const auto& span : spans) {
+    encode_span(body, *span, origin);
+  }
+  if (dropped) {
+    protobuf::pack_bool(body, trace_chunk::dropped_trace, true);
+  }
+
+  // If the chunk doesn't fit in the payload being buffered, then send the
+  // payload now rather than at the end of the flush interval.
+  const std::size_t size = payload_size(chunk);
+  std::vector<EncodedTraceChunk> full;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!chunks_.empty() && buffered_bytes_ + size > max_payload_bytes_) {
+      full.swap(chunks_);
+      buffered_bytes_ = 0;
+    }
+    buffered_bytes_ += size;
+    chunks_.push_back(std::move(chunk));
+  }
+  if (!full.empty()) {
+    post(full);
+  }
+  return {};
+}
+
+void AgentlessCollector::flush() {
+  std::vector<EncodedTraceChunk> chunks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunks.swap(chunks_);
+    buffered_bytes_ = 0;
+  }
+
+  // Split the chunks into requests of at most `max_payload_bytes_`, except
+  // that a chunk larger than that is sent by itself.
+  std::vector<EncodedTraceChunk> batch;
+  std::size_t batch_bytes = 0;
+  for (auto& chunk : chunks) {
+    const std::size_t size = payload_size(chunk);
+    if (!batch.empty() && batch_bytes + size > max_payload_bytes_) {
+      post(batch);
+      batch.clear();
+      batch_bytes = 0;
+    }
+    batch_bytes += size;
+    batch.push_back(std::move(chunk));
+  }
+  if (!batch.empty()) {
+    post(batch);
+  }
+}
+
+Expected<void> AgentlessCollector::flush(
+    std::chrono::steady_clock::time_point deadline) {
+  flush();
+  http_client_->drain(deadline);
+
+  std::lock_guard<std::mutex> lock(in_flight_->mutex);
+  if (in_flight_->count != 0) {
+    std::string message;
+    message += "Flush timed out with ";
+    message += std::to_string(in_flight_->count);
+    message += " request(s) to the Datadog intake still in flight.";
+    return Error{Error::FLUSH_TIMEOUT, std::move(message)};
+  }
+  return std::nullopt;
+}
+
+void AgentlessCollector::post(const std::vector<EncodedTraceChunk>& chunks) {
+  std::string body;
+  encode_payload(body, chunks);
+  bool compressed = false;
+  if (compression_ == PayloadCompression::GZIP) {
+    std::string gzipped;
+    auto result = gzip_compress(gzipped, body, compression_level_);
+    if (auto* error = result.if_error()) {
+      // Send the payload uncompressed instead.
+      logger_->log_error(*error);
+    } else {
+      body = std::move(gzipped);
+      compressed = true;
+    }
+  }
+
+  auto set_request_headers = [this, compressed](DictWriter& headers) {
+    headers.set("Content-Type", "application/x-protobuf");
+    if (compressed) {
+      headers.set("Content-Encoding", "gzip");
+    }
+    headers.set("DD-Api-Key", api_key_);
+    headers.set("X-Datadog-Reported-Languages", "cpp");
+    headers.set("Datadog-Meta-Lang", "cpp");
+    headers.set("Datadog-Meta-Lang-Version", std::to_string(__cplusplus));
+    headers.set("Datadog-Meta-Tracer-Version", tracer_version);
+  };
+
+  const auto end_request = [](InFlightRequests& in_flight) {
+    std::lock_guard<std::mutex> lock(in_flight.mutex);
+    --in_flight.count;
+  };
+
+  auto on_response = [logger = logger_, in_flight = in_flight_, end_request](
+                         int response_status,
+                         const DictReader& /*response_headers*/,
+                         std::string response_body) {
+    if (response_status < 200 || response_status >= 300) {
+      logger->log_error([&](auto& stream) {
+        stream << "Unexpected response status " << response_status
+               << " from the Datadog intake with body (starts on next "
+                  "line):\n"
+               << response_body;
+      });
+    }
+    end_request(*in_flight);
+  };
+
+  auto on_error = [logger = logger_, in_flight = in_flight_,
+                   end_request](Error error) {
+    logger->log_error(error.with_prefix(
+        "Error occurred during HTTP request to the Datadog intake: "));
+    end_request(*in_flight);
+  };
+
+  {
+    std::lock_guard<std::mutex> lock(in_flight_->mutex);
+    ++in_flight_->count;
+  }
+  auto post_result =
+      http_client_->post(url_, std::move(set_request_headers), std::move(body),
+                         std::move(on_response), std::move(on_error));
+  if (auto* error = post_result.if_error()) {
+    logger_->log_error(*error);
+    end_request(*in_flight_);
+  }
+}
+
+void AgentlessCollector::encode_payload(
+    std::string& destination, const std::vector<EncodedTraceChunk>& chunks) {
+  namespace pb = protobuf;
+  if (chunks.empty()) {
+    return;
+  }
+  pb::pack_string(destination, agent_payload::host_name,
+                  chunks.front().hostname);
+  pb::pack_string(destination, agent_payload::env,
+                  chunks.front().environment);
+
+  // Consecutive chunks of the same tracer share a "TracerPayload".
+  auto begin = chunks.begin();
+  while (begin != chunks.end()) {
+    const auto end =
+        std::find_if(begin, chunks.end(), [&](const EncodedTraceChunk& chunk) {
+          return !same_tracer(chunk, *begin);
+        });
+    const auto payload =
+        pb::begin_message(destination, agent_payload::tracer_payloads);
+    pb::pack_string(destination, tracer_payload::language_name, "cpp");
+    pb::pack_string(destination, tracer_payload::language_version,
+                    std::to_string(__cplusplus));
+    pb::pack_string(destination, tracer_payload::tracer_version,
+                    tracer_version);
+    for (auto chunk = begin; chunk != end; ++chunk) {
+      const auto encoded =
+          pb::begin_message(destination, tracer_payload::chunks);
+      destination += chunk->body;
+      pb::end_message(destination, encoded);
+    }
+    pb::pack_string(destination, tracer_payload::env, begin->environment);
+    pb::pack_string(destination, tracer_payload::hostname, begin->hostname);
+    pb::pack_string(destination, tracer_payload::app_version, begin->version);
+    pb::end_message(destination, payload);
+    begin = end;
+  }
+}
+
+nlohmann::json AgentlessCollector::config_json() const {
+  const auto flush_interval_milliseconds =
+      std::chrono::duration_cast<std::chrono::milliseconds>(flush_interval_)
+          .count();
+
+  // The API key is a secret, and so is not included.
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::AgentlessCollector"},
+    {"config", nlohmann::json::object({
+      {"url", (url_.scheme + "://" + url_.authority + url_.path)},
+      {"flush_interval_milliseconds", flush_interval_milliseconds},
+      {"max_payload_bytes", max_payload_bytes_},
+      {"compression",
+       compression_ == PayloadCompression::GZIP ? "gzip" : "none"},
+      {"http_client", http_client_->config_json()},
+      {"event_scheduler", event_scheduler_->config_json()},
+    })},
+  });
+  // clang-format on
+}
+
+}  // namespace tracing
+}  // namespace datadog
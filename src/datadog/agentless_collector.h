@@ -0,0 +1,121 @@
+#pragma once
+
+// This component provides a `class`, `AgentlessCollector`, that implements the
+// `Collector` interface in terms of HTTPS requests sent directly to the
+// Datadog intake, without a Datadog Agent.
+//
+// `AgentlessCollector` is configured by `AgentlessCollectorConfig`.  See
+// `agentless_collector_config.h`.  To use it, create one and give it to the
+// tracer as its `TracerConfig::collector`.
+//
+// Each trace chunk is encoded, as it's sent to the collector, in the protobuf
+// format that the Datadog Agent uses to forward traces to the intake (see
+// `protobuf.h`).  The encoded chunks are buffered, and sent every flush
+// interval, in requests of at most `max_payload_bytes` before compression.
+// Once the buffered chunks reach `max_payload_bytes`, they are sent without
+// waiting for the flush interval.  Requests are authenticated by the API key,
+// and are gzip compressed unless configured otherwise.
+//
+// The intake accepts only traces that are kept, and so of a trace chunk that
+// is dropped by sampling, only the spans kept by span sampling are sent.
+//
+// The default `Curl` HTTP client supports HTTPS only if the library was built
+// with the `DD_TRACE_ENABLE_AGENTLESS` CMake option, which builds the bundled
+// libcurl with TLS and HTTP/2 support.  Concurrent requests to the intake are
+// then multiplexed over one connection (see `CurlConfig::http2`).
+//
+// Unlike a Datadog Agent, the intake doesn't compute trace metrics, obfuscate
+// resources, or adjust sampling rates, and failed requests are not retried.
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "agentless_collector_config.h"
+#include "collector.h"
+#include "event_scheduler.h"
+#include "http_client.h"
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+
+class AgentlessCollector : public Collector {
+ public:
+  // `EncodedTraceChunk` is a trace chunk encoded as a protobuf "TraceChunk"
+  // message, along with the properties of its tracer that the enclosing
+  // "TracerPayload" message has.
+  struct EncodedTraceChunk {
+    std::string environment;
+    std::string version;
+    std::string hostname;
+    std::string body;
+  };
+
+  // `InFlightRequests` is shared with the HTTP client's callbacks, which can
+  // outlive the collector.
+  struct InFlightRequests {
+    std::mutex mutex;
+    std::size_t count = 0;
+  };
+
+ private:
+  std::shared_ptr<Logger> logger_;
+  std::shared_ptr<HTTPClient> http_client_;
+  std::shared_ptr<EventScheduler> event_scheduler_;
+  std::string api_key_;
+  HTTPClient::URL url_;
+  std::chrono::steady_clock::duration flush_interval_;
+  std::size_t max_payload_bytes_;
+  PayloadCompression compression_;
+  int compression_level_;
+  std::shared_ptr<InFlightRequests> in_flight_;
+  EventScheduler::Cancel cancel_flush_;
+
+  // `mutex_` protects the members below it.
+  std::mutex mutex_;
+  std::vector<EncodedTraceChunk> chunks_;
+  std::size_t buffered_bytes_;
+
+  // Send the buffered trace chunks.
+  void flush();
+  // Send the specified `chunks` in one request.
+  void post(const std::vector<EncodedTraceChunk>& chunks);
+  // Encode the specified `spans` of a trace having the specified `origin`,
+  // and buffer them.  Return an error if they can't be sent.
+  Expected<void> buffer(std::vector<std::unique_ptr<SpanData>>&& spans,
+                        std::string_view origin);
+
+ public:
+  AgentlessCollector(const FinalizedAgentlessCollectorConfig& config,
+                     const std::shared_ptr<Logger>& logger);
+  // Send the buffered trace chunks, and wait for the requests until the
+  // flush interval elapses.
+  ~AgentlessCollector();
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+
+  Expected<void> send_with_origin(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::string_view origin) override;
+
+  Expected<void> flush(std::chrono::steady_clock::time_point deadline) override;
+
+  nlohmann::json config_json() const override;
+
+  // Append to the specified `destination` a protobuf "AgentPayload" message
+  // containing the specified `chunks`.
+  static void encode_payload(std::string& destination,
+                             const std::vector<EncodedTraceChunk>& chunks);
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,109 @@
+#include "agentless_collector_config.h"
+
+#include "default_http_client.h"
+#include "environment.h"
+#include "gzip.h"
+#include "threaded_event_scheduler.h"
+
+namespace datadog {
+namespace tracing {
+
+Expected<FinalizedAgentlessCollectorConfig> finalize_config(
+    const AgentlessCollectorConfig& config,
+    const std::shared_ptr<Logger>& logger) {
+  FinalizedAgentlessCollectorConfig result;
+
+  if (auto api_key_env = lookup(environment::DD_API_KEY)) {
+    result.api_key = std::string(*api_key_env);
+  } else if (config.api_key) {
+    result.api_key = *config.api_key;
+  }
+  if (result.api_key.empty()) {
+    return Error{Error::AGENTLESS_MISSING_API_KEY,
+                 "AgentlessCollector: An API key is required.  Set "
+                 "DD_API_KEY or AgentlessCollectorConfig::api_key."};
+  }
+
+  std::string configured_url;
+  if (config.url) {
+    configured_url = *config.url;
+  } else {
+    configured_url = "https://trace.agent.";
+    if (auto site_env = lookup(environment::DD_SITE)) {
+      configured_url += *site_env;
+    } else {
+      configured_url += config.site;
+    }
+  }
+  auto url = DatadogAgentConfig::parse(configured_url);
+  if (auto* error = url.if_error()) {
+    return error->with_prefix("AgentlessCollector: ");
+  }
+  result.url = std::move(*url);
+  while (!result.url.path.empty() && result.url.path.back() == '/') {
+    result.url.path.pop_back();
+  }
+  result.url.path += "/api/v0.2/traces";
+
+  if (config.flush_interval_milliseconds <= 0) {
+    return Error{Error::AGENTLESS_INVALID_FLUSH_INTERVAL,
+                 "AgentlessCollector: Flush interval must be a positive "
+                 "number of milliseconds."};
+  }
+  result.flush_interval =
+      std::chrono::milliseconds(config.flush_interval_milliseconds);
+
+  if (config.max_payload_bytes == 0) {
+    return Error{Error::AGENTLESS_INVALID_MAX_PAYLOAD_BYTES,
+                 "AgentlessCollector: Maximum payload size must be positive."};
+  }
+  result.max_payload_bytes = config.max_payload_bytes;
+
+  if (config.compression == PayloadCompression::GZIP) {
+    if (!gzip_supported()) {
+      return Error{Error::GZIP_UNSUPPORTED,
+                   "AgentlessCollector: gzip compression was configured, but "
+                   "this library was built without zlib."};
+    }
+    if (config.compression_level < 1 || config.compression_level > 9) {
+      std::string message;
+      message +=
+          "AgentlessCollector: Compression level must be between 1 and 9, but ";
+      message += std::to_string(config.compression_level);
+      message += " was configured.";
+      return Error{Error::AGENTLESS_INVALID_COMPRESSION_LEVEL,
+                   std::move(message)};
+    }
+  }
+  result.compression = config.compression;
+  result.compression_level = config.compression_level;
+
+  result.http_client = config.http_client;
+  if (!result.http_client) {
+    result.http_client = default_http_client(logger);
+    // As with `DatadogAgentConfig`, there's a default only if this library
+    // was built with libcurl.
+    if (!result.http_client) {
+      return Error{Error::AGENTLESS_NULL_HTTP_CLIENT,
+                   "AgentlessCollector: HTTP client cannot be null."};
+    }
+    if (result.url.scheme == "https" &&
+        !default_http_client_supports_https()) {
+      return Error{Error::AGENTLESS_HTTPS_UNSUPPORTED,
+                   "AgentlessCollector: The default HTTP client doesn't "
+                   "support HTTPS, since this library was built without "
+                   "DD_TRACE_ENABLE_AGENTLESS.  Specify an http_client that "
+                   "supports HTTPS."};
+    }
+  }
+
+  result.event_scheduler = config.event_scheduler;
+  if (!result.event_scheduler) {
+    result.event_scheduler = std::make_shared<ThreadedEventScheduler>();
+  }
+
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,91 @@
+#pragma once
+
+// This component provides facilities for configuring an `AgentlessCollector`.
+//
+// `struct AgentlessCollectorConfig` contains fields that are used to configure
+// `AgentlessCollector`.  The configuration must first be finalized before it
+// can be used by `AgentlessCollector`.  The function `finalize_config`
+// produces either an error or a `FinalizedAgentlessCollectorConfig`.
+//
+// Unlike `DatadogAgentConfig`, `AgentlessCollectorConfig` is not part of
+// `TracerConfig`.  Create an `AgentlessCollector` and give it to the tracer as
+// its `TracerConfig::collector`.  See `agentless_collector.h`.
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "datadog_agent_config.h"
+#include "expected.h"
+#include "http_client.h"
+
+namespace datadog {
+namespace tracing {
+
+class EventScheduler;
+class Logger;
+
+struct AgentlessCollectorConfig {
+  // The `HTTPClient` used to submit traces to the Datadog intake.  If this
+  // library was built with libcurl (the default), then `http_client` is
+  // optional: a `Curl` instance will be used if `http_client` is left null.
+  // The intake requires HTTPS, and so the `HTTPClient` must support it.  The
+  // `Curl` instance supports it only if the library was built with the
+  // `DD_TRACE_ENABLE_AGENTLESS` CMake option.
+  std::shared_ptr<HTTPClient> http_client;
+  // The `EventScheduler` used to periodically submit batches of traces.  If
+  // `event_scheduler` is null, then a `ThreadedEventScheduler` instance will
+  // be used instead.
+  std::shared_ptr<EventScheduler> event_scheduler;
+  // The Datadog API key with which requests are authenticated.  Overridden by
+  // the `DD_API_KEY` environment variable.  Required.
+  std::optional<std::string> api_key;
+  // The Datadog site to which traces are sent, e.g. "datadoghq.eu".  The
+  // intake is at "https://trace.agent.<site>".  Overridden by the `DD_SITE`
+  // environment variable.
+  std::string site = "datadoghq.com";
+  // The URL of the intake, if not that of `site`, e.g. of a proxy.  The
+  // traces endpoint, "/api/v0.2/traces", is appended to it.
+  std::optional<std::string> url;
+  // How often, in milliseconds, to send batches of traces to the intake.
+  int flush_interval_milliseconds = 2000;
+  // The most uncompressed bytes that one request contains.  Once the buffered
+  // traces would exceed it, they are sent without waiting for the flush
+  // interval.  The default is the intake's limit.  A trace chunk that alone
+  // exceeds `max_payload_bytes` is sent in a request of its own.
+  std::size_t max_payload_bytes = 3200000;
+  // How to compress request bodies, and the compression level, which is
+  // between 1 (fastest) and 9 (smallest).
+  PayloadCompression compression = PayloadCompression::GZIP;
+  int compression_level = 6;
+};
+
+class FinalizedAgentlessCollectorConfig {
+  friend Expected<FinalizedAgentlessCollectorConfig> finalize_config(
+      const AgentlessCollectorConfig& config,
+      const std::shared_ptr<Logger>& logger);
+
+  FinalizedAgentlessCollectorConfig() = default;
+
+ public:
+  std::shared_ptr<HTTPClient> http_client;
+  std::shared_ptr<EventScheduler> event_scheduler;
+  std::string api_key;
+  HTTPClient::URL url;
+  std::chrono::steady_clock::duration flush_interval;
+  std::size_t max_payload_bytes;
+  PayloadCompression compression;
+  int compression_level;
+};
+
+// Return a `FinalizedAgentlessCollectorConfig` from the specified `config` and
+// from any relevant environment variables, or return an error.  The default
+// HTTP client, if needed, logs to the specified `logger`.
+Expected<FinalizedAgentlessCollectorConfig> finalize_config(
+    const AgentlessCollectorConfig& config,
+    const std::shared_ptr<Logger>& logger);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,214 @@
+#include "async_logger.h"
+
+#include <functional>
+#include <sstream>
+#include <typeinfo>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Return the smallest power of two that is not less than the specified
+// `value`, or one if `value` is zero.
+std::size_t round_up_to_power_of_two(std::size_t value) {
+  std::size_t result = 1;
+  while (result < value) {
+    result *= 2;
+  }
+  return result;
+}
+
+// Invoke the specified `write` with a stream, and return what it wrote,
+// followed by a note if the specified `suppressed` isn't zero.
+std::string format(const Logger::LogFunc& write, std::uint64_t suppressed) {
+  thread_local std::ostringstream stream;
+  stream.clear();
+  // Copy an empty string in, don't move it.
+  // We want `stream` to keep its storage.
+  const std::string empty;
+  stream.str(empty);
+
+  write(stream);
+  if (suppressed) {
+    stream << " [" << suppressed << " similar message"
+           << (suppressed == 1 ? " was" : "s were") << " suppressed]";
+  }
+  return stream.str();
+}
+
+}  // namespace
+
+AsyncLogger::Site::Site(const Clock& clock, int burst, double per_second)
+    : limiter(clock, burst, per_second), suppressed(0) {}
+
+AsyncLogger::AsyncLogger(std::shared_ptr<Logger> logger, int burst,
+                         double per_second, std::size_t capacity,
+                         const Clock& clock)
+    : logger_(std::move(logger)),
+      mask_(round_up_to_power_of_two(capacity) - 1),
+      tail_(0),
+      head_(0),
+      dropped_(0),
+      shutting_down_(false) {
+  sites_.reserve(num_sites);
+  for (std::size_t i = 0; i < num_sites; ++i) {
+    sites_.push_back(std::make_unique<Site>(clock, burst, per_second));
+  }
+  messages_.reset(new Message[mask_ + 1]);
+  for (std::size_t i = 0; i <= mask_; ++i) {
+    messages_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  writer_ = std::thread([this]() { run(); });
+  ForkHandlers handlers;
+  handlers.before_fork = [this]() { stop_writer(); };
+  handlers.after_fork_in_parent = [this]() { start_writer(); };
+  handlers.after_fork_in_child = [this]() { start_writer(); };
+  unregister_fork_handlers_ = register_fork_handlers(std::move(handlers));
+}
+
+AsyncLogger::~AsyncLogger() {
+  unregister_fork_handlers_();
+  stop_writer();
+}
+
+void AsyncLogger::log_error(const LogFunc& write) {
+  std::uint64_t suppressed;
+  if (allow(write.target_type().hash_code(), suppressed)) {
+    push(Message::ERROR_TEXT, Error::OTHER, format(write, suppressed));
+  }
+}
+
+void AsyncLogger::log_startup(const LogFunc& write) {
+  push(Message::STARTUP, Error::OTHER, format(write, 0));
+}
+
+void AsyncLogger::log_error(const Error& error) {
+  std::uint64_t suppressed;
+  if (allow(std::size_t(error.code), suppressed)) {
+    push(Message::ERROR_VALUE, error.code,
+         format([&](std::ostream& log) { log << error.message; },
+                suppressed));
+  }
+}
+
+void AsyncLogger::log_error(std::string_view message) {
+  std::uint64_t suppressed;
+  if (allow(std::hash<std::string_view>{}(message), suppressed)) {
+    push(Message::ERROR_TEXT, Error::OTHER,
+         format([&](std::ostream& log) { log << message; }, suppressed));
+  }
+}
+
+bool AsyncLogger::allow(std::size_t key, std::uint64_t& suppressed) {
+  Site& site = *sites_[key % num_sites];
+  if (!site.limiter.allow().allowed) {
+    site.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+void AsyncLogger::push(Message::Kind kind, Error::Code code,
+                       std::string text) {
+  std::size_t position = tail_.load(std::memory_order_relaxed);
+  Message* message;
+  for (;;) {
+    message = &messages_[position & mask_];
+    const std::size_t sequence =
+        message->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      // The slot is free.  Claim it.
+      if (tail_.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < position) {
+      // The slot still holds the message from one lap ago: the buffer is
+      // full.
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = tail_.load(std::memory_order_relaxed);
+    }
+  }
+
+  message->kind = kind;
+  message->code = code;
+  message->text = std::move(text);
+  message->sequence.store(position + 1, std::memory_order_release);
+
+  // Lock the mutex so that the notification can't fall between the writing
+  // thread's check of `ready` and its wait.
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  message_or_shutdown_.notify_one();
+}
+
+bool AsyncLogger::ready() const {
+  return messages_[head_ & mask_].sequence.load(std::memory_order_acquire) ==
+         head_ + 1;
+}
+
+void AsyncLogger::run() {
+  for (;;) {
+    bool shutting_down;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      message_or_shutdown_.wait(
+          lock, [this]() { return shutting_down_ || ready(); });
+      shutting_down = shutting_down_;
+    }
+    write_messages();
+    if (shutting_down) {
+      return;
+    }
+  }
+}
+
+void AsyncLogger::write_messages() {
+  while (ready()) {
+    Message& message = messages_[head_ & mask_];
+    const auto write = [&](std::ostream& log) { log << message.text; };
+    switch (message.kind) {
+      case Message::ERROR_TEXT:
+        logger_->log_error(write);
+        break;
+      case Message::ERROR_VALUE:
+        logger_->log_error(Error{message.code, std::move(message.text)});
+        break;
+      case Message::STARTUP:
+        logger_->log_startup(write);
+    }
+    message.text.clear();
+    message.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+  }
+
+  if (const std::uint64_t dropped =
+          dropped_.exchange(0, std::memory_order_relaxed)) {
+    logger_->log_error([dropped](std::ostream& log) {
+      log << "AsyncLogger discarded " << dropped << " message"
+          << (dropped == 1 ? "" : "s") << " because its buffer was full.";
+    });
+  }
+}
+
+void AsyncLogger::stop_writer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+  }
+  message_or_shutdown_.notify_one();
+  writer_.join();
+}
+
+void AsyncLogger::start_writer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  shutting_down_ = false;
+  writer_ = std::thread([this]() { run(); });
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,140 @@
+#pragma once
+
+// This component provides a class, `AsyncLogger`, that implements the `Logger`
+// interface from `logger.h` by decorating another `Logger`.  `AsyncLogger`
+// keeps logging off of the threads that call it:
+//
+// - Error messages are rate limited per message site.  A site is identified
+//   by the type of the callback passed to `log_error`, which is distinct for
+//   each lambda expression in the program, by the code of an `Error`, or by
+//   the text of a `std::string_view` message.  Each site has its own token
+//   bucket `Limiter`, allowing `burst` messages at once and `per_second`
+//   messages per second thereafter.  A message that isn't allowed is counted
+//   and discarded without invoking its callback, so a flood of errors costs
+//   little more than a clock reading each.  The next message allowed from the
+//   site notes how many were suppressed.
+// - Allowed messages are formatted on the calling thread, since the callback
+//   may refer to the caller's stack, and are then pushed onto a bounded ring
+//   buffer without locking.  If the buffer is full, the message is discarded
+//   and counted.
+// - A dedicated thread takes messages from the buffer and passes them to the
+//   decorated `Logger`, which thus is only ever called from that thread.
+//   When messages were discarded because the buffer was full, the thread
+//   logs how many.
+//
+// Startup messages are not rate limited.  The thread writes the remaining
+// messages before `AsyncLogger` is destroyed.  As with
+// `ThreadedEventScheduler`, the thread is stopped before `fork` and started
+// again afterward (see `fork_handlers.h`).
+//
+//     auto logger = std::make_shared<AsyncLogger>(
+//         std::make_shared<CerrLogger>());
+//     tracer_config.logger = logger;
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "clock.h"
+#include "error.h"
+#include "fork_handlers.h"
+#include "limiter.h"
+#include "logger.h"
+
+namespace datadog {
+namespace tracing {
+
+class AsyncLogger : public Logger {
+ public:
+  // The rate limits and buffer size used unless otherwise specified.
+  static constexpr int default_burst = 10;
+  static constexpr double default_per_second = 1.0;
+  static constexpr std::size_t default_capacity = 1024;
+
+ private:
+  // `Site` is the rate limit of the messages from one message site.  Sites
+  // are hashed into a fixed number of `Site`s, so sites that collide share a
+  // limit.
+  struct Site {
+    Limiter limiter;
+    std::atomic<std::uint64_t> suppressed;
+
+    Site(const Clock& clock, int burst, double per_second);
+  };
+
+  // `Message` is an element of the ring buffer.  `sequence` indicates
+  // whether the slot is free to be written, or ready to be read, as in
+  // Dmitry Vyukov's bounded queue.
+  struct Message {
+    enum Kind { ERROR_TEXT, ERROR_VALUE, STARTUP };
+
+    std::atomic<std::size_t> sequence;
+    Kind kind;
+    Error::Code code;
+    std::string text;
+  };
+
+  static constexpr std::size_t num_sites = 64;
+
+  std::shared_ptr<Logger> logger_;
+  std::vector<std::unique_ptr<Site>> sites_;
+  std::unique_ptr<Message[]> messages_;
+  std::size_t mask_;
+  // Producers claim slots by incrementing `tail_`.  Only the writing thread
+  // uses `head_`.
+  std::atomic<std::size_t> tail_;
+  std::size_t head_;
+  std::atomic<std::uint64_t> dropped_;
+
+  std::mutex mutex_;
+  std::condition_variable message_or_shutdown_;
+  bool shutting_down_;
+  std::thread writer_;
+  UnregisterForkHandlers unregister_fork_handlers_;
+
+  // Return whether a message from the site having the specified `key` is
+  // allowed, and if so, store in the specified `suppressed` the number of
+  // messages from the site that were discarded since the last one allowed.
+  bool allow(std::size_t key, std::uint64_t& suppressed);
+  // Push a message having the specified attributes onto the ring buffer, or
+  // count it as dropped if the buffer is full.
+  void push(Message::Kind kind, Error::Code code, std::string text);
+  // Return whether a message is ready to be read from the ring buffer.
+  bool ready() const;
+
+  void run();
+  // Pass the messages in the ring buffer to `logger_`.
+  void write_messages();
+  // Stop the writing thread, or start it again, around `fork`.
+  void stop_writer();
+  void start_writer();
+
+ public:
+  // Create an `AsyncLogger` that passes messages to the specified `logger`.
+  // Allow, from each message site, the specified `burst` of error messages,
+  // and then the specified `per_second` error messages per second.  Buffer at
+  // most the specified `capacity` messages, rounded up to a power of two.
+  // Use the specified `clock` for rate limiting.
+  explicit AsyncLogger(std::shared_ptr<Logger> logger,
+                       int burst = default_burst,
+                       double per_second = default_per_second,
+                       std::size_t capacity = default_capacity,
+                       const Clock& clock = default_clock);
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+  ~AsyncLogger();
+
+  void log_error(const LogFunc&) override;
+  void log_startup(const LogFunc&) override;
+  void log_error(const Error&) override;
+  void log_error(std::string_view) override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -1,12 +1,72 @@
 #include "clock.h"
 
+#ifdef __linux__
+#include <time.h>
+#endif
+
 namespace datadog {
 namespace tracing {
+namespace {
+
+#if defined(__linux__) && defined(CLOCK_REALTIME_COARSE) && \
+    defined(CLOCK_MONOTONIC_COARSE)
+std::chrono::nanoseconds since_epoch(clockid_t clock) {
+  timespec time;
+  clock_gettime(clock, &time);
+  return std::chrono::seconds(time.tv_sec) +
+         std::chrono::nanoseconds(time.tv_nsec);
+}
+
+TimePoint coarse_now() {
+  // `std::chrono::steady_clock` is `CLOCK_MONOTONIC`, whose epoch
+  // `CLOCK_MONOTONIC_COARSE` shares.
+  return TimePoint{
+      std::chrono::system_clock::time_point(
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              since_epoch(CLOCK_REALTIME_COARSE))),
+      std::chrono::steady_clock::time_point(
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              since_epoch(CLOCK_MONOTONIC_COARSE)))};
+}
+#else
+TimePoint coarse_now() {
+  return TimePoint{std::chrono::system_clock::now(),
+                   std::chrono::steady_clock::now()};
+}
+#endif
+
+}  // namespace
 
 const Clock default_clock = []() {
   return TimePoint{std::chrono::system_clock::now(),
                    std::chrono::steady_clock::now()};
 };
 
+const Clock coarse_clock = []() { return coarse_now(); };
+
+Clock make_anchored_clock() {
+  const TimePoint anchor = default_clock();
+  return [anchor]() {
+    const auto tick = std::chrono::steady_clock::now();
+    return TimePoint{
+        anchor.wall +
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                tick - anchor.tick),
+        tick};
+  };
+}
+
+Clock make_clock(ClockSource source) {
+  switch (source) {
+    case ClockSource::COARSE:
+      return coarse_clock;
+    case ClockSource::ANCHORED:
+      return make_anchored_clock();
+    case ClockSource::DEFAULT:
+      break;
+  }
+  return default_clock;
+}
+
 }  // namespace tracing
 }  // namespace datadog
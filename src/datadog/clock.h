@@ -18,6 +18,19 @@
 // `Clock` is an alias for `std::function<TimePoint()>`, and the default
 // `Clock`, `default_clock`, gives a `TimePoint` using the
 // `std::chrono::system_clock` and `std::chrono::steady_clock`.
+//
+// There are cheaper alternatives to `default_clock`, selected by
+// `ClockSource`:
+//
+// - `coarse_clock` reads the kernel's coarse clocks, `CLOCK_REALTIME_COARSE`
+//   and `CLOCK_MONOTONIC_COARSE`, where they are available.  They are not
+//   refined between scheduler ticks, and so are cheaper to read but only as
+//   precise as the tick, typically one to four milliseconds.  Where the coarse
+//   clocks are not available, `coarse_clock` is `default_clock`.
+// - `make_anchored_clock` returns a `Clock` that reads the system clock once,
+//   when it is created, and afterward reads only the steady clock.  The wall
+//   time is the creation time plus the steady time elapsed since, and so
+//   doesn't follow adjustments made to the system clock afterward.
 
 #include <chrono>
 #include <functional>
@@ -51,6 +64,14 @@ inline TimePoint& operator+=(TimePoint& self, Duration offset) {
 using Clock = std::function<TimePoint()>;
 
 extern const Clock default_clock;
+extern const Clock coarse_clock;
+
+Clock make_anchored_clock();
+
+enum class ClockSource { DEFAULT, COARSE, ANCHORED };
+
+// Return a `Clock` of the specified `source`.
+Clock make_clock(ClockSource source);
 
 }  // namespace tracing
 }  // namespace datadog
@@ -1 +1,40 @@
 #include "collector.h"
+
+#include <string>
+#include <utility>
+
+#include "span_data.h"
+#include "span_sampler.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+
+Expected<void> Collector::send_with_origin(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::string_view origin) {
+  for (const auto& span_ptr : spans) {
+    span_ptr->tags.insert_or_assign(tags::internal::origin,
+                                    std::string(origin));
+  }
+  return send(std::move(spans), response_handler);
+}
+
+Expected<void> Collector::send_unsampled(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::optional<std::string_view> origin,
+    const std::shared_ptr<SpanSampler>& span_sampler,
+    std::optional<int> /*sampling_mechanism*/) {
+  if (span_sampler) {
+    span_sampler->sample(spans);
+  }
+  if (origin) {
+    return send_with_origin(std::move(spans), response_handler, *origin);
+  }
+  return send(std::move(spans), response_handler);
+}
+
+}  // namespace tracing
+}  // namespace datadog
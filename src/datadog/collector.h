@@ -9,9 +9,29 @@
 // As a result of `send`ing spans to a `Collector`, the `TraceSampler` might be
 // adjusted to increase or decrease the rate at which traces are kept.  See the
 // `response_handler` parameter to `Collector::send`.
+//
+// A `Collector` might buffer spans before delivering them.  `flush` delivers
+// the buffered spans on demand.
+//
+// If the trace has an origin (see `TraceSegment::origin`), then the spans are
+// sent by `send_with_origin` instead, and carry no "_dd.origin" tag of their
+// own.  By default, `send_with_origin` tags each span with the origin and then
+// calls `send`.  A collector that serializes spans, such as `DatadogAgent`,
+// instead adds the origin once per span as it encodes them, so that the
+// origin isn't copied into each span's tags.
+//
+// If the trace is dropped, then the spans are sent by `send_unsampled`, along
+// with the mechanism of the trace's sampling decision and, if span sampling
+// is deferred (see `TracerConfig::defer_span_sampling`), the `SpanSampler`
+// that is yet to be applied to them.  By default, `send_unsampled` applies the
+// span sampler immediately.  A collector that buffers spans, such as
+// `DatadogAgent`, instead applies it when it flushes, so that the thread that
+// finished the trace doesn't.
 
+#include <chrono>
 #include <memory>
 #include <optional>
+#include <string_view>
 #include <vector>
 
 #include "expected.h"
@@ -21,6 +41,7 @@ namespace datadog {
 namespace tracing {
 
 struct SpanData;
+class SpanSampler;
 class TraceSampler;
 
 class Collector {
@@ -33,6 +54,42 @@ class Collector {
       std::vector<std::unique_ptr<SpanData>>&& spans,
       const std::shared_ptr<TraceSampler>& response_handler) = 0;
 
+  // Submit ownership of the specified `spans` to the collector, as with
+  // `send`, where the spans are of a trace having the specified `origin`.
+  // The default implementation sets the "_dd.origin" tag of each span to
+  // `origin`, and then calls `send`.
+  virtual Expected<void> send_with_origin(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::string_view origin);
+
+  // Submit ownership of the specified `spans` of a dropped trace to the
+  // collector, as with `send_with_origin` if the specified `origin` has a
+  // value and as with `send` otherwise.  The trace was dropped by the
+  // optionally specified `sampling_mechanism` (see `sampling_mechanism.h`).
+  // If the specified `span_sampler` is not null, then span sampling is yet to
+  // happen, and the collector applies `span_sampler` to the spans (see
+  // `SpanSampler::sample`) before delivering them.  The default
+  // implementation applies `span_sampler` immediately, and then calls
+  // `send_with_origin` or `send`.
+  virtual Expected<void> send_unsampled(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::optional<std::string_view> origin,
+      const std::shared_ptr<SpanSampler>& span_sampler,
+      std::optional<int> sampling_mechanism);
+
+  // Deliver the spans that have been `send`ed but not yet delivered, and wait
+  // until the delivery completes or until the specified `deadline`, whichever
+  // is first.  Return an error with code `Error::FLUSH_TIMEOUT` if the
+  // deadline passed first, or an error with some other code if a failure
+  // occurs.  The default implementation does nothing, which is appropriate
+  // for collectors that don't buffer.
+  virtual Expected<void> flush(
+      std::chrono::steady_clock::time_point /*deadline*/) {
+    return {};
+  }
+
   // Return a JSON representation of this object's configuration. The JSON
   // representation is an object with the following properties:
   //
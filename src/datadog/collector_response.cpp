@@ -1,5 +1,7 @@
 #include "collector_response.h"
 
+#include "parse_util.h"
+
 namespace datadog {
 namespace tracing {
 
@@ -13,6 +15,22 @@ std::string CollectorResponse::key(std::string_view service,
   return result;
 }
 
+std::optional<std::pair<std::string_view, std::string_view>>
+CollectorResponse::parse_key(std::string_view key) {
+  const std::string_view service_prefix = "service:";
+  const std::string_view env_separator = ",env:";
+  if (!starts_with(key, service_prefix)) {
+    return std::nullopt;
+  }
+  key.remove_prefix(service_prefix.size());
+  const auto separator = key.rfind(env_separator);
+  if (separator == std::string_view::npos) {
+    return std::nullopt;
+  }
+  return std::make_pair(key.substr(0, separator),
+                        key.substr(separator + env_separator.size()));
+}
+
 const std::string CollectorResponse::key_of_default_rate =
     CollectorResponse::key("", "");
 
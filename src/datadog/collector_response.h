@@ -12,10 +12,19 @@
 //
 // See `TraceSampler::handle_collector_response` in `trace_sampler.h` for more
 // information.
+//
+// A `CollectorResponse` may have a nonzero `version`, which identifies its
+// contents: two responses with the same nonzero `version` have the same
+// `sample_rate_by_key`.  `DatadogAgent` gives each distinct response that it
+// parses a new version, so that `TraceSampler` can skip rebuilding its rates
+// when the Agent repeats itself, as it usually does.
 
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
 
 #include "rate.h"
 
@@ -25,8 +34,14 @@ namespace tracing {
 struct CollectorResponse {
   static std::string key(std::string_view service,
                          std::string_view environment);
+  // Return the service and environment of the specified `key`, or return
+  // `std::nullopt` if `key` is not of the form produced by `key()`.  The
+  // returned views refer to `key`.
+  static std::optional<std::pair<std::string_view, std::string_view>>
+  parse_key(std::string_view key);
   static const std::string key_of_default_rate;
   std::unordered_map<std::string, Rate> sample_rate_by_key;
+  std::uint64_t version = 0;
 };
 
 }  // namespace tracing
@@ -0,0 +1,385 @@
+#include "compact_spans.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "gzip.h"
+#include "protobuf.h"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Spans are compacted by the thread that finishes them, so blocks are
+// compressed at the fastest level.  The spans of a trace are repetitive
+// enough that it does nearly as well as the others.
+const int compression_level = 1;
+
+std::uint64_t zigzag(std::int64_t value) {
+  return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value) {
+  return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+}
+
+// Each string added to the pool costs about this many bytes in addition to
+// its characters, for its `std::string` and its entry in the pool's index.
+const std::size_t pooled_string_overhead = 64;
+
+std::uint64_t address(const void* pointer) {
+  return std::uint64_t(reinterpret_cast<std::uintptr_t>(pointer));
+}
+
+// `Writer` encodes spans into a block, which it refers to but does not own,
+// adding short strings to a pool, which it also refers to.  The block's string
+// table refers to the spans, which must outlive the `Writer`.
+class Writer {
+  std::string& output_;
+  StringTable& pool_;
+  std::unordered_map<std::string_view, std::uint64_t> strings_;
+  std::size_t pooled_bytes_ = 0;
+
+ public:
+  Writer(std::string& output, StringTable& pool)
+      : output_(output), pool_(pool) {}
+
+  // Return the approximate number of bytes of memory added to the pool.
+  std::size_t pooled_bytes() const { return pooled_bytes_; }
+
+  void varint(std::uint64_t value) { protobuf::pack_varint(output_, value); }
+
+  void signed_varint(std::int64_t value) { varint(zigzag(value)); }
+
+  void float64(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    for (int i = 0; i < 8; ++i) {
+      output_ += char(bits >> (8 * i));
+    }
+  }
+
+  // Add the specified `value` to the pool, and return its index there.
+  std::uint32_t pool(std::string_view value) {
+    const std::size_t pool_size = pool_.size();
+    const std::uint32_t index = pool_.index(value);
+    if (pool_.size() != pool_size) {
+      pooled_bytes_ += value.size() + pooled_string_overhead;
+    }
+    return index;
+  }
+
+  // Encode the specified `value`.  A short `value` is pooled if the specified
+  // `repeated` is true, or once it's repeated within the block, so that
+  // strings that occur only once, such as IDs, don't occupy the pool.
+  void string(std::string_view value, bool repeated = false) {
+    const bool short_value =
+        value.size() <= CompactSpans::max_pooled_string_size;
+    if (short_value) {
+      if (const auto index = pool_.find(value)) {
+        varint(std::uint64_t(*index) * 3);
+        return;
+      }
+      if (repeated) {
+        varint(std::uint64_t(pool(value)) * 3);
+        return;
+      }
+    }
+    const auto [found, inserted] = strings_.emplace(value, strings_.size());
+    if (!inserted) {
+      varint(found->second * 3 + 1);
+      if (short_value) {
+        pool(value);
+      }
+      return;
+    }
+    varint(value.size() * 3 + 2);
+    output_.append(value);
+  }
+
+  void span(const SpanData& span) {
+    // Services, types, operation names, and tag names have few distinct values.
+    string(span.service, true);
+    string(span.service_type, true);
+    string(span.name, true);
+    string(span.resource);
+    varint(span.trace_id.high);
+    varint(span.trace_id.low);
+    varint(span.span_id);
+    varint(span.parent_id);
+    signed_varint(span.start.wall.time_since_epoch().count());
+    signed_varint(span.start.tick.time_since_epoch().count());
+    signed_varint(span.duration.count());
+    output_ += char(span.error);
+
+    varint(span.tags.size());
+    for (const auto& [key, value] : span.tags) {
+      string(key, true);
+      string(value);
+    }
+    varint(span.numeric_tags.size());
+    for (const auto& [key, value] : span.numeric_tags) {
+      string(key, true);
+      float64(value);
+    }
+    varint(span.mark_count);
+    for (std::size_t i = 0; i < span.mark_count; ++i) {
+      const SpanMark& mark = span.marks[i];
+      varint(address(mark.name.data()));
+      varint(mark.name.size());
+      signed_varint(mark.offset.count());
+    }
+    varint(span.error_stack_addresses.size());
+    for (const void* return_address : span.error_stack_addresses) {
+      varint(address(return_address));
+    }
+  }
+};
+
+// `Reader` decodes a block, which it refers to but does not own, using the
+// pool to which the block's `Writer` added strings.  Each function returns
+// `false` if the block ends too soon or is otherwise malformed.  The block's
+// string table refers to the block as well.
+class Reader {
+  std::string_view input_;
+  const StringTable& pool_;
+  std::vector<std::string_view> strings_;
+
+ public:
+  Reader(std::string_view input, const StringTable& pool)
+      : input_(input), pool_(pool) {}
+
+  bool varint(std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (input_.empty()) {
+        return false;
+      }
+      const auto byte = std::uint8_t(input_.front());
+      input_.remove_prefix(1);
+      value |= std::uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename Integer>
+  bool signed_varint(Integer& value) {
+    std::uint64_t encoded;
+    if (!varint(encoded)) {
+      return false;
+    }
+    value = Integer(unzigzag(encoded));
+    return true;
+  }
+
+  bool byte(bool& value) {
+    if (input_.empty()) {
+      return false;
+    }
+    value = input_.front() != 0;
+    input_.remove_prefix(1);
+    return true;
+  }
+
+  bool float64(double& value) {
+    if (input_.size() < 8) {
+      return false;
+    }
+    std::uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+      bits |= std::uint64_t(std::uint8_t(input_[i])) << (8 * i);
+    }
+    input_.remove_prefix(8);
+    std::memcpy(&value, &bits, sizeof value);
+    return true;
+  }
+
+  bool string(std::string_view& value) {
+    std::uint64_t encoded;
+    if (!varint(encoded)) {
+      return false;
+    }
+    if (encoded % 3 == 0) {
+      if (encoded / 3 >= pool_.size()) {
+        return false;
+      }
+      value = pool_[std::uint32_t(encoded / 3)];
+      return true;
+    }
+    if (encoded % 3 == 1) {
+      if (encoded / 3 >= strings_.size()) {
+        return false;
+      }
+      value = strings_[encoded / 3];
+      return true;
+    }
+    const std::uint64_t size = encoded / 3;
+    if (size > input_.size()) {
+      return false;
+    }
+    value = input_.substr(0, size);
+    input_.remove_prefix(size);
+    strings_.push_back(value);
+    return true;
+  }
+
+  bool string(std::string& value) {
+    std::string_view view;
+    if (!string(view)) {
+      return false;
+    }
+    value.assign(view);
+    return true;
+  }
+
+  bool span(SpanData& span) {
+    using SystemDuration = std::chrono::system_clock::duration;
+    SystemDuration::rep wall;
+    Duration::rep tick;
+    Duration::rep duration;
+    std::uint64_t count;
+    if (!string(span.service) || !string(span.service_type) ||
+        !string(span.name) || !string(span.resource) ||
+        !varint(span.trace_id.high) || !varint(span.trace_id.low) ||
+        !varint(span.span_id) || !varint(span.parent_id) ||
+        !signed_varint(wall) || !signed_varint(tick) ||
+        !signed_varint(duration) || !byte(span.error) || !varint(count)) {
+      return false;
+    }
+    span.start.wall =
+        std::chrono::system_clock::time_point(SystemDuration(wall));
+    span.start.tick = std::chrono::steady_clock::time_point(Duration(tick));
+    span.duration = Duration(duration);
+
+    span.tags.reserve(count);
+    for (; count != 0; --count) {
+      std::string_view key;
+      std::string_view value;
+      if (!string(key) || !string(value)) {
+        return false;
+      }
+      span.tags.insert_or_assign(key, std::string(value));
+    }
+    if (!varint(count)) {
+      return false;
+    }
+    span.numeric_tags.reserve(count);
+    for (; count != 0; --count) {
+      std::string_view key;
+      double value;
+      if (!string(key) || !float64(value)) {
+        return false;
+      }
+      span.numeric_tags.insert_or_assign(key, value);
+    }
+    if (!varint(count) || count > SpanData::max_marks) {
+      return false;
+    }
+    span.mark_count = std::uint8_t(count);
+    for (std::size_t i = 0; i < span.mark_count; ++i) {
+      std::uint64_t name;
+      std::uint64_t size;
+      Duration::rep offset;
+      if (!varint(name) || !varint(size) || !signed_varint(offset)) {
+        return false;
+      }
+      span.marks[i].name = std::string_view(
+          reinterpret_cast<const char*>(std::uintptr_t(name)), size);
+      span.marks[i].offset = Duration(offset);
+    }
+    if (!varint(count)) {
+      return false;
+    }
+    span.error_stack_addresses.reserve(count);
+    for (; count != 0; --count) {
+      std::uint64_t return_address;
+      if (!varint(return_address)) {
+        return false;
+      }
+      span.error_stack_addresses.push_back(
+          reinterpret_cast<const void*>(std::uintptr_t(return_address)));
+    }
+    return true;
+  }
+};
+
+}  // namespace
+
+void CompactSpans::add(const std::vector<std::unique_ptr<SpanData>>& spans,
+                       bool compress) {
+  if (spans.empty()) {
+    return;
+  }
+  Block& block = blocks_.emplace_back();
+  if (!strings_) {
+    strings_.emplace();
+  }
+  Writer writer{block.data, *strings_};
+  for (const auto& span : spans) {
+    writer.span(*span);
+  }
+  block.num_spans = spans.size();
+  block.decoded_size = block.data.size();
+  block.compressed = false;
+  if (compress) {
+    std::string compressed;
+    if (gzip_compress(compressed, block.data, compression_level) &&
+        compressed.size() < block.data.size()) {
+      block.data = std::move(compressed);
+      block.compressed = true;
+    }
+  }
+  block.data.shrink_to_fit();
+  num_spans_ += block.num_spans;
+  num_bytes_ += sizeof(Block) + block.data.capacity() + writer.pooled_bytes();
+}
+
+Expected<void> CompactSpans::take(
+    std::vector<std::unique_ptr<SpanData>>& spans) {
+  std::vector<Block> blocks = std::move(blocks_);
+  blocks_.clear();
+  // The pool is released once the blocks are decoded.
+  const std::optional<StringTable> strings = std::move(strings_);
+  strings_.reset();
+  spans.reserve(spans.size() + num_spans_);
+  num_spans_ = 0;
+  num_bytes_ = 0;
+
+  Expected<void> result;
+  std::string decompressed;
+  for (const Block& block : blocks) {
+    std::string_view data = block.data;
+    if (block.compressed) {
+      decompressed.clear();
+      auto decompress_result =
+          gzip_decompress(decompressed, data, block.decoded_size);
+      if (decompress_result.if_error()) {
+        result = std::move(decompress_result);
+        continue;
+      }
+      data = decompressed;
+    }
+    Reader reader{data, *strings};
+    for (std::size_t i = 0; i < block.num_spans; ++i) {
+      auto span = std::make_unique<SpanData>();
+      if (!reader.span(*span)) {
+        result = Error{Error::COMPACT_SPANS_DECODING_FAILURE,
+                       "Unable to decode a block of compacted spans."};
+        break;
+      }
+      spans.push_back(std::move(span));
+    }
+  }
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,113 @@
+#pragma once
+
+// This component provides a class, `CompactSpans`, that holds finished spans
+// in a compact binary encoding, rather than as `SpanData` objects.
+//
+// A long-lived trace segment, such as that of a websocket session or of a
+// batch job, retains its finished spans until its last span finishes, unless
+// partial flushing is configured.  As `SpanData`, each finished span
+// occupies its object, its strings, and its tag tables, for as long as the
+// segment lives.  If so configured (see
+// `TracerConfig::compact_finished_spans`), `TraceSegment` instead moves its
+// finished spans into a `CompactSpans` in batches, and decodes them back into
+// `SpanData` just before it sends them to the collector.  The spans are then
+// finalized, sampled, and encoded as usual.
+//
+// Format
+// ------
+// Each batch of spans is encoded as a separate block, so that adding spans
+// doesn't re-encode earlier ones.  A block is optionally gzip compressed (see
+// `gzip.h`).
+//
+// Integers are written as base 128 varints, and signed integers are first
+// "zigzag" encoded, as in Protocol Buffers.  Numbers having a fractional part
+// are the eight bytes of their IEEE 754 representation, least significant
+// byte first.
+//
+// Strings no longer than `max_pooled_string_size` are kept in a string pool
+// (see `string_table.h`) that all of the blocks share, and which is released
+// when the spans are taken.  Service names, operation names, tag names, and
+// most tag values are short and repeated across the spans of a trace, and so
+// they're stored once per trace segment, however many blocks refer to them.
+// Service names, span types, operation names, and tag names are pooled when
+// they first occur.  Other short strings are pooled once they're repeated
+// within a block, so that distinct values, such as IDs, don't occupy the
+// pool.  Longer strings, such as SQL statements, are more often distinct, and
+// so are written into the blocks, where compression applies to them.
+//
+// A string is an integer `n`.  If `n % 3` is zero, then the string is entry
+// `n / 3` of the pool.  If it's one, then the string is entry `(n - 1) / 3` of
+// the block's string table.  Otherwise, the `(n - 2) / 3` bytes of the string
+// follow, and the string is appended to the block's table.
+//
+// A span is its service, type, name, and resource (strings); the high and
+// low halves of its trace ID, its span ID, and its parent ID; its start time
+// as system clock and steady clock ticks since their epochs, and its duration
+// in steady clock ticks (signed); whether it's an error (one byte); the
+// number of its string tags, followed by the name and value of each; the
+// number of its numeric tags, followed by the name and value of each; the
+// number of its marks, followed by the address and length of each mark's
+// name and its offset in steady clock ticks; and the number of its error
+// stack addresses, followed by each address.
+//
+// A mark's name and an error stack's addresses refer to memory that outlives
+// the span (see `span_data.h`), and so are encoded as addresses.  An encoding
+// is therefore meaningful only within the process that made it.
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "expected.h"
+#include "string_table.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+class CompactSpans {
+  struct Block {
+    std::string data;
+    std::size_t num_spans;
+    // `decoded_size` is the size of `data` before compression, if
+    // `compressed`.
+    std::size_t decoded_size;
+    bool compressed;
+  };
+
+  std::vector<Block> blocks_;
+  // `strings_` is the string pool.  It's created by the first `add`, so that a
+  // trace segment whose spans are never compacted doesn't allocate it.
+  std::optional<StringTable> strings_;
+  std::size_t num_spans_ = 0;
+  std::size_t num_bytes_ = 0;
+
+ public:
+  // Strings at most this long are pooled.
+  static constexpr std::size_t max_pooled_string_size = 64;
+
+  // Encode the specified `spans` as a block appended to this object.  If the
+  // specified `compress` is true, then gzip compress the block, unless
+  // compression fails or doesn't make the block smaller.
+  void add(const std::vector<std::unique_ptr<SpanData>>& spans, bool compress);
+
+  // Return whether this object contains no spans.
+  bool empty() const { return num_spans_ == 0; }
+  // Return the number of spans that this object contains.
+  std::size_t size() const { return num_spans_; }
+  // Return the approximate number of bytes of memory occupied by the encoded
+  // spans, including the string pool.
+  std::size_t bytes() const { return num_bytes_; }
+
+  // Append to the specified `spans` the spans that this object contains,
+  // decoded, in the order in which they were added, and leave this object
+  // empty.  Return an error if a block can't be decoded, in which case the
+  // spans of that block that weren't decoded are lost.
+  Expected<void> take(std::vector<std::unique_ptr<SpanData>>& spans);
+};
+
+}  // namespace tracing
+}  // namespace datadog
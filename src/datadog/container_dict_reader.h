@@ -0,0 +1,82 @@
+#pragma once
+
+// This component provides a class template, `ContainerDictReader<Container>`,
+// that is a `DictReader` over a container of HTTP header fields, such as those
+// of a request in an HTTP framework.
+//
+// `Container` is any range of key/value pairs whose keys convert to
+// `std::string_view`, e.g. `std::map<std::string, std::string>`,
+// `std::unordered_multimap<std::string, std::string>`, or
+// `std::vector<std::pair<std::string_view, std::string_view>>`.  Containers
+// that map each name to a list of values, e.g.
+// `std::map<std::string, std::vector<std::string>>`, are supported as well,
+// in which case the first value of each name is used.
+//
+// Keys are compared without regard to case, as HTTP header names are.  Since
+// the container might be keyed by a name of a different case than that
+// looked up, `lookup` is a linear scan, and so `prefer_visit` returns `true`:
+// `Tracer::extract_span` indexes the headers in one pass (see
+// `indexed_dict_reader.h`).
+//
+// A `ContainerDictReader` refers to, but does not own, its container, which
+// must outlive it.
+
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+#include "dict_reader.h"
+#include "parse_util.h"
+
+namespace datadog {
+namespace tracing {
+
+template <typename Container>
+class ContainerDictReader : public DictReader {
+  const Container* headers_;
+
+  // Return the value of the specified `value` to use as the value of its
+  // header, or return `std::nullopt` if `value` is an empty list of values.
+  template <typename Value>
+  static std::optional<std::string_view> view(const Value& value) {
+    if constexpr (std::is_convertible_v<const Value&, std::string_view>) {
+      return std::string_view(value);
+    } else {
+      if (std::begin(value) == std::end(value)) {
+        return std::nullopt;
+      }
+      return std::string_view(*std::begin(value));
+    }
+  }
+
+ public:
+  explicit ContainerDictReader(const Container& headers)
+      : headers_(&headers) {}
+
+  std::optional<std::string_view> lookup(std::string_view key) const override {
+    for (const auto& [name, value] : *headers_) {
+      if (equals_ignoring_case(name, key)) {
+        if (auto found = view(value)) {
+          return found;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  void visit(
+      const std::function<void(std::string_view key, std::string_view value)>&
+          visitor) const override {
+    for (const auto& [name, value] : *headers_) {
+      if (auto found = view(value)) {
+        visitor(name, *found);
+      }
+    }
+  }
+
+  bool prefer_visit() const override { return true; }
+};
+
+}  // namespace tracing
+}  // namespace datadog
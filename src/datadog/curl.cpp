@@ -1,31 +1,45 @@
 #include "curl.h"
 
 #include <curl/curl.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <iterator>
-#include <list>
+#include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "dict_reader.h"
 #include "dict_writer.h"
+#include "event_loop.h"
+#include "event_scheduler.h"
+#include "fork_handlers.h"
 #include "http_client.h"
 #include "json.hpp"
 #include "logger.h"
+#include "mpsc_queue.h"
 #include "parse_util.h"
 
 namespace datadog {
 namespace tracing {
 
+using BodyChain = HTTPClient::BodyChain;
 using ErrorHandler = HTTPClient::ErrorHandler;
 using HeadersSetter = HTTPClient::HeadersSetter;
 using ResponseHandler = HTTPClient::ResponseHandler;
@@ -34,21 +48,83 @@ using URL = HTTPClient::URL;
 class CurlImpl {
   std::mutex mutex_;
   std::shared_ptr<Logger> logger_;
+  const CurlConfig config_;
+  // `http2_` is whether `config_.http2` is requested and libcurl supports it.
+  bool http2_;
   CURLM *multi_handle_;
   std::unordered_set<CURL *> request_handles_;
-  std::list<CURL *> new_handles_;
+  // `new_handles_` are the requests from `send` that are yet to be added to
+  // the multi handle.  `send` pushes them without locking `mutex_`.
+  // `num_pending_requests_` counts the requests sent and not yet finished,
+  // which `drain` waits for.  `wake_pending_` is whether the thread that
+  // drives libcurl has been woken for `new_handles_` and hasn't added them
+  // yet, so that many concurrent `send`s wake it once.
+  MPSCQueue<CURL *> new_handles_;
+  std::atomic<std::size_t> num_pending_requests_;
+  std::atomic<bool> wake_pending_;
+  // `idle_handles_` are reset easy handles of finished requests, kept to be
+  // reused by later requests.
+  std::vector<CURL *> idle_handles_;
+  // Statistics reported by `config_json`.
+  std::atomic<std::uint64_t> num_requests_;
+  std::atomic<std::uint64_t> num_reused_connections_;
+  std::atomic<std::uint64_t> num_reused_handles_;
   bool shutting_down_;
+  // `forking_` is true while `event_loop_` is stopped for a `fork`.
+  bool forking_;
+  UnregisterForkHandlers unregister_fork_handlers_;
   int num_active_handles_;
   std::condition_variable no_requests_;
+  // If `loop_` is null, then `event_loop_` is the thread that drives libcurl.
+  // Otherwise, libcurl is driven by `loop_`'s callbacks, which hold weak
+  // references to `alive_` so that they do nothing once this object is
+  // destroyed.  Either way, libcurl is driven by its socket and timer
+  // callbacks.  `sockets_` maps each socket that libcurl is interested in to
+  // its `EventLoop::Interest` flags.  With `loop_`, `timer_` is the timer for
+  // libcurl's timeout, if `has_timer_`.  Without, `timer_deadline_` is when
+  // libcurl's timeout expires, if it has one, and writing to `wake_pipe_`
+  // wakes `event_loop_`, which otherwise sleeps until a socket is ready or
+  // the timeout expires.
   std::thread event_loop_;
+  std::shared_ptr<EventLoop> loop_;
+  std::shared_ptr<CurlImpl *> alive_;
+  std::unordered_map<curl_socket_t, int> sockets_;
+  std::uint64_t timer_;
+  bool has_timer_;
+  std::optional<std::chrono::steady_clock::time_point> timer_deadline_;
+  int wake_pipe_[2];
+  // `events_` are the recurring events of `curl_event_scheduler`, keyed by
+  // ID, which `event_loop_` invokes after acting on libcurl's sockets and
+  // timeout.  They are guarded by `events_mutex_` rather than by `mutex_`, so
+  // that they can be scheduled and cancelled from within a response handler.
+  // If `mutex_` is also locked, then it's locked first.  `running_event_` is
+  // the ID of the event whose callback is being invoked, or zero.
+  struct Event {
+    const void *owner;
+    std::shared_ptr<const std::function<void()>> callback;
+    std::function<std::chrono::steady_clock::duration()> next_interval;
+    std::chrono::steady_clock::time_point next;
+  };
+  std::mutex events_mutex_;
+  std::map<std::uint64_t, Event> events_;
+  std::uint64_t next_event_id_;
+  std::uint64_t running_event_;
+  std::condition_variable event_done_;
 
   struct Request {
     curl_slist *request_headers = nullptr;
-    std::string request_body;
+    // `request_body` is read by `on_send_body` from the buffer at
+    // `body_buffer`, starting at `body_offset` within that buffer.
+    BodyChain request_body;
+    std::size_t body_buffer = 0;
+    std::size_t body_offset = 0;
     ResponseHandler on_response;
     ErrorHandler on_error;
     char error_buffer[CURL_ERROR_SIZE] = "";
-    std::unordered_map<std::string, std::string> response_headers_lower;
+    // `response_headers` are the response's header lines, as received.  They
+    // are parsed only if the response handler looks at them, which most
+    // don't.
+    std::string response_headers;
     std::string response_body;
 
     ~Request();
@@ -64,13 +140,14 @@ class CurlImpl {
     void set(std::string_view key, std::string_view value) override;
   };
 
+  // `HeaderReader` looks up headers in the raw header lines of a response.
+  // Each `lookup` scans the lines, and names are matched without regard to
+  // case.  `visit` passes the names as they were received.
   class HeaderReader : public DictReader {
-    std::unordered_map<std::string, std::string> *response_headers_lower_;
-    mutable std::string buffer_;
+    const std::string *response_headers_;
 
    public:
-    explicit HeaderReader(
-        std::unordered_map<std::string, std::string> *response_headers_lower);
+    explicit HeaderReader(const std::string *response_headers);
     std::optional<std::string_view> lookup(std::string_view key) const override;
     void visit(
         const std::function<void(std::string_view key, std::string_view value)>
@@ -78,7 +155,56 @@ class CurlImpl {
   };
 
   void run();
+  // Create `multi_handle_` and configure it, or log an error and leave it
+  // null if that fails.
+  void init_multi_handle();
+  // Start `event_loop_` running `run`, or log an error and mark this object
+  // as not working if that fails.  `mutex_` must be locked.
+  void start_event_loop();
+  // Stop `event_loop_` before `fork`, and start it again after `fork`.
+  void before_fork();
+  void after_fork_in_parent();
+  void after_fork_in_child();
+  // Add `new_handles_` to the multi handle.  `mutex_` must be locked.
+  void add_new_handles();
+  // Open `wake_pipe_`, or log an error and return `false` if that fails.
+  bool open_wake_pipe();
+  void close_wake_pipe();
+  // Wake `event_loop_` by writing to `wake_pipe_`.
+  void wake_event_loop();
+  // Wake whatever adds `new_handles_` to the multi handle, unless it has
+  // already been woken and hasn't yet added them.
+  void wake_for_new_handles();
+  // Handle the messages of finished requests.  `mutex_` must be locked.
+  void handle_messages();
   void handle_message(const CURLMsg &);
+  // Return when the earliest of `events_` is due, if there are any.
+  // `events_mutex_` must not be locked.
+  std::optional<std::chrono::steady_clock::time_point> next_event_deadline();
+  // Invoke the callbacks of the `events_` that are due.  Neither `mutex_` nor
+  // `events_mutex_` may be locked.
+  void run_due_events();
+  // Wait until the event having the specified `id` isn't running, unless it's
+  // running on the calling thread.  `lock` must hold `events_mutex_`.
+  void wait_for_event(std::unique_lock<std::mutex> &lock, std::uint64_t id);
+  // Clean up the requests, the handles, and libcurl.  `mutex_` must be
+  // locked.
+  void shut_down();
+  // Let libcurl act on the specified `socket`, or on its timeout if `socket`
+  // is `CURL_SOCKET_TIMEOUT`, given the specified `CURL_CSELECT_*` flags, and
+  // then handle the finished requests.  `perform` requires that `mutex_` is
+  // locked, and `socket_action` locks it.
+  void perform(curl_socket_t socket, int flags);
+  void socket_action(curl_socket_t socket, int flags);
+  // Wait on libcurl's sockets until there are no more requests, or until the
+  // specified `deadline`.  This is `drain` when there is a `loop_`.
+  void drain_sockets(std::chrono::steady_clock::time_point deadline);
+  // Return an easy handle for a new request, reusing an idle one if there is
+  // one.  Return null if a handle could not be created.
+  CURL *acquire_handle();
+  // Reset the specified finished `handle` and keep it for reuse, or clean it
+  // up if enough handles are already kept.  `mutex_` must be locked.
+  void release_handle(CURL *handle);
   CURLcode log_on_error(CURLcode result);
   CURLMcode log_on_error(CURLMcode result);
 
@@ -86,19 +212,50 @@ class CurlImpl {
                                     void *user_data);
   static std::size_t on_read_body(char *data, std::size_t, std::size_t length,
                                   void *user_data);
+  static std::size_t on_send_body(char *buffer, std::size_t size,
+                                   std::size_t count, void *user_data);
+  static int on_seek_body(void *user_data, curl_off_t offset, int origin);
+  static int on_socket(CURL *, curl_socket_t socket, int what, void *user_data,
+                       void *socket_data);
+  static int on_timer(CURLM *, long timeout_milliseconds, void *user_data);
   static bool is_non_whitespace(unsigned char);
-  static char to_lower(unsigned char);
   static std::string_view trim(std::string_view);
 
  public:
-  explicit CurlImpl(const std::shared_ptr<Logger> &logger);
+  CurlImpl(const std::shared_ptr<Logger> &logger,
+           const std::shared_ptr<EventLoop> &loop, const CurlConfig &config);
   ~CurlImpl();
 
-  Expected<void> post(const URL &url, HeadersSetter set_headers,
-                      std::string body, ResponseHandler on_response,
-                      ErrorHandler on_error);
+  // Send a POST request having the specified `body`, or a GET request if
+  // `body` is null.
+  Expected<void> send(const URL &url, HeadersSetter set_headers,
+                      std::optional<BodyChain> body,
+                      ResponseHandler on_response, ErrorHandler on_error);
 
   void drain(std::chrono::steady_clock::time_point deadline);
+
+  // Return whether this object has a thread of its own, on which it can
+  // invoke scheduled events.
+  bool has_thread() const;
+
+  // Invoke the specified `callback` on `event_loop_`, first after the
+  // specified `first_delay` and then after each duration returned by the
+  // specified `next_interval`.  Return the ID of the event.  The event is
+  // associated with the specified `owner`, which `cancel_events` refers to.
+  std::uint64_t schedule_event(
+      const void *owner, std::chrono::steady_clock::duration first_delay,
+      std::function<std::chrono::steady_clock::duration()> next_interval,
+      std::function<void()> callback);
+  // Invoke the callback of the event having the specified `id` as soon as
+  // possible, if it's still scheduled.
+  void wake_event(std::uint64_t id);
+  // Cancel the event having the specified `id`, or all events associated
+  // with the specified `owner`, and wait for its callback to return if it's
+  // running on another thread.
+  void cancel_event(std::uint64_t id);
+  void cancel_events(const void *owner);
+
+  nlohmann::json config_json() const;
 };
 
 namespace {
@@ -109,35 +266,191 @@ void throw_on_error(CURLcode result) {
   }
 }
 
+bool equal_ignoring_case(std::string_view left, std::string_view right) {
+  return left.size() == right.size() &&
+         std::equal(left.begin(), left.end(), right.begin(),
+                    [](unsigned char a, unsigned char b) {
+                      return std::tolower(a) == std::tolower(b);
+                    });
+}
+
+// Return the `poll` events for the specified `EventLoop::Interest` flags.
+short poll_events(int interest) {
+  return short(((interest & EventLoop::READ) ? POLLIN : 0) |
+               ((interest & EventLoop::WRITE) ? POLLOUT : 0));
+}
+
+// Return the `CURL_CSELECT_*` flags for the specified `poll` result events.
+int select_flags(short revents) {
+  return ((revents & POLLIN) ? CURL_CSELECT_IN : 0) |
+         ((revents & POLLOUT) ? CURL_CSELECT_OUT : 0) |
+         ((revents & (POLLERR | POLLHUP)) ? CURL_CSELECT_ERR : 0);
+}
+
+// Invoke the specified `visitor` with the name and value of each of the
+// specified header `lines`, e.g. "  Foo-Bar  :   thingy, thing   \r\n" is
+// {"Foo-Bar", "thingy, thing"}, until `visitor` returns `false`.
+template <typename Visitor>
+void for_each_header(std::string_view lines, Visitor &&visitor) {
+  while (!lines.empty()) {
+    auto line_end = lines.find('\n');
+    if (line_end == std::string_view::npos) {
+      line_end = lines.size() - 1;
+    }
+    const auto line = lines.substr(0, line_end + 1);
+    lines.remove_prefix(line.size());
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    if (!visitor(strip(line.substr(0, colon)), strip(line.substr(colon + 1)))) {
+      return;
+    }
+  }
+}
+
+// `CurlEventScheduler` is the `EventScheduler` returned by
+// `curl_event_scheduler`.  Its events are kept by the `CurlImpl`, and so its
+// cancel and wake functions hold a weak reference to the `Curl` rather than
+// to this object.  Destroying this object cancels the events that remain.
+class CurlEventScheduler : public EventScheduler {
+  std::shared_ptr<Curl> curl_;
+  CurlImpl *impl_;
+
+ public:
+  CurlEventScheduler(const std::shared_ptr<Curl> &curl, CurlImpl *impl)
+      : curl_(curl), impl_(impl) {}
+
+  ~CurlEventScheduler() { impl_->cancel_events(this); }
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override {
+    return schedule_wakeable_recurring_event(interval, std::move(callback))
+        .cancel;
+  }
+
+  RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override {
+    return schedule_jittered_recurring_event(
+        interval, interval, std::chrono::steady_clock::duration::zero(),
+        std::move(callback));
+  }
+
+  RecurringEvent schedule_jittered_recurring_event(
+      std::chrono::steady_clock::duration first_delay,
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter,
+      std::function<void()> callback) override {
+    const auto id = impl_->schedule_event(
+        this, first_delay,
+        [interval, jitter]() { return jittered(interval, jitter); },
+        std::move(callback));
+    const std::weak_ptr<Curl> weak_curl = curl_;
+    auto cancel = [weak_curl, impl = impl_, id]() {
+      if (const auto curl = weak_curl.lock()) {
+        impl->cancel_event(id);
+      }
+    };
+    auto wake = [weak_curl, impl = impl_, id]() {
+      if (const auto curl = weak_curl.lock()) {
+        impl->wake_event(id);
+      }
+    };
+    return RecurringEvent{std::move(cancel), std::move(wake)};
+  }
+
+  nlohmann::json config_json() const override {
+    return nlohmann::json::object(
+        {{"type", "datadog::tracing::CurlEventScheduler"},
+         {"config", nlohmann::json::object({{"curl", curl_->config_json()}})}});
+  }
+};
+
 }  // namespace
 
-Curl::Curl(const std::shared_ptr<Logger> &logger)
-    : impl_(new CurlImpl{logger}) {}
+Curl::Curl(const std::shared_ptr<Logger> &logger, const CurlConfig &config)
+    : impl_(new CurlImpl{logger, nullptr, config}) {}
+
+Curl::Curl(const std::shared_ptr<Logger> &logger,
+           const std::shared_ptr<EventLoop> &loop, const CurlConfig &config)
+    : impl_(new CurlImpl{logger, loop, config}) {}
 
 Curl::~Curl() { delete impl_; }
 
 Expected<void> Curl::post(const URL &url, HeadersSetter set_headers,
                           std::string body, ResponseHandler on_response,
                           ErrorHandler on_error) {
-  return impl_->post(url, set_headers, body, on_response, on_error);
+  BodyChain chain;
+  chain.push_back(std::make_shared<const std::string>(std::move(body)));
+  return impl_->send(url, std::move(set_headers), std::move(chain),
+                     std::move(on_response), std::move(on_error));
+}
+
+Expected<void> Curl::post(const URL &url, HeadersSetter set_headers,
+                          BodyChain body, ResponseHandler on_response,
+                          ErrorHandler on_error) {
+  return impl_->send(url, std::move(set_headers), std::move(body),
+                     std::move(on_response), std::move(on_error));
+}
+
+Expected<void> Curl::get(const URL &url, HeadersSetter set_headers,
+                         ResponseHandler on_response, ErrorHandler on_error) {
+  return impl_->send(url, std::move(set_headers), std::nullopt,
+                     std::move(on_response), std::move(on_error));
 }
 
 void Curl::drain(std::chrono::steady_clock::time_point deadline) {
   impl_->drain(deadline);
 }
 
-nlohmann::json Curl::config_json() const {
-  return nlohmann::json::object({{"type", "datadog::tracing::Curl"}});
+nlohmann::json Curl::config_json() const { return impl_->config_json(); }
+
+std::shared_ptr<EventScheduler> curl_event_scheduler(
+    const std::shared_ptr<Curl> &curl) {
+  if (!curl || !curl->impl_->has_thread()) {
+    return nullptr;
+  }
+  return std::make_shared<CurlEventScheduler>(curl, curl->impl_);
 }
 
-CurlImpl::CurlImpl(const std::shared_ptr<Logger> &logger)
-    : logger_(logger), shutting_down_(false), num_active_handles_(0) {
+CurlImpl::CurlImpl(const std::shared_ptr<Logger> &logger,
+                   const std::shared_ptr<EventLoop> &loop,
+                   const CurlConfig &config)
+    : logger_(logger),
+      config_(config),
+      http2_(false),
+      num_pending_requests_(0),
+      wake_pending_(false),
+      num_requests_(0),
+      num_reused_connections_(0),
+      num_reused_handles_(0),
+      shutting_down_(false),
+      forking_(false),
+      num_active_handles_(0),
+      loop_(loop),
+      timer_(0),
+      has_timer_(false),
+      wake_pipe_{-1, -1},
+      next_event_id_(1),
+      running_event_(0) {
   curl_global_init(CURL_GLOBAL_ALL);
-  multi_handle_ = curl_multi_init();
+  http2_ = config_.http2 &&
+           (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2);
+  init_multi_handle();
   if (multi_handle_ == nullptr) {
-    logger_->log_error(Error{
-        Error::CURL_HTTP_CLIENT_SETUP_FAILED,
-        "Unable to initialize a curl multi-handle for sending requests."});
+    return;
+  }
+
+  if (loop_) {
+    alive_ = std::make_shared<CurlImpl *>(this);
+    return;
+  }
+
+  if (!open_wake_pipe()) {
+    (void)curl_multi_cleanup(multi_handle_);
+    curl_global_cleanup();
+    multi_handle_ = nullptr;
     return;
   }
 
@@ -151,28 +464,54 @@ CurlImpl::CurlImpl(const std::shared_ptr<Logger> &logger)
     // start, do it here.
     (void)curl_multi_cleanup(multi_handle_);
     curl_global_cleanup();
+    close_wake_pipe();
 
     // Mark this object as not working.
     multi_handle_ = nullptr;
+    return;
   }
+
+  unregister_fork_handlers_ = register_fork_handlers(
+      ForkHandlers{[this]() { before_fork(); },
+                   [this]() { after_fork_in_parent(); },
+                   [this]() { after_fork_in_child(); }});
 }
 
 CurlImpl::~CurlImpl() {
+  if (unregister_fork_handlers_) {
+    unregister_fork_handlers_();
+  }
   if (multi_handle_ == nullptr) {
     // We're not running; nothing to shut down.
     return;
   }
 
+  if (loop_) {
+    alive_.reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    shut_down();
+    for (const auto &[socket, interest] : sockets_) {
+      (void)interest;
+      loop_->watch_socket(socket, 0, nullptr);
+    }
+    if (has_timer_) {
+      loop_->cancel_timer(timer_);
+    }
+    return;
+  }
+
   {
     std::lock_guard<std::mutex> lock(mutex_);
     shutting_down_ = true;
   }
-  log_on_error(curl_multi_wakeup(multi_handle_));
+  wake_event_loop();
   event_loop_.join();
+  close_wake_pipe();
 }
 
-Expected<void> CurlImpl::post(const HTTPClient::URL &url,
-                              HeadersSetter set_headers, std::string body,
+Expected<void> CurlImpl::send(const HTTPClient::URL &url,
+                              HeadersSetter set_headers,
+                              std::optional<BodyChain> body,
                               ResponseHandler on_response,
                               ErrorHandler on_error) try {
   if (multi_handle_ == nullptr) {
@@ -183,12 +522,14 @@ Expected<void> CurlImpl::post(const HTTPClient::URL &url,
 
   auto request = std::make_unique<Request>();
 
-  request->request_body = std::move(body);
+  if (body) {
+    request->request_body = std::move(*body);
+  }
   request->on_response = std::move(on_response);
   request->on_error = std::move(on_error);
 
   std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> handle{
-      curl_easy_init(), &curl_easy_cleanup};
+      acquire_handle(), &curl_easy_cleanup};
 
   if (!handle) {
     return Error{Error::CURL_REQUEST_SETUP_FAILED,
@@ -201,11 +542,38 @@ Expected<void> CurlImpl::post(const HTTPClient::URL &url,
       curl_easy_setopt(handle.get(), CURLOPT_PRIVATE, request.get()));
   throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_ERRORBUFFER,
                                   request->error_buffer));
-  throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_POST, 1));
-  throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_POSTFIELDSIZE,
-                                  request->request_body.size()));
-  throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_POSTFIELDS,
-                                  request->request_body.data()));
+  if (!body) {
+    throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_HTTPGET, 1L));
+  } else {
+    curl_off_t body_size = 0;
+    for (const auto &buffer : request->request_body) {
+      body_size += curl_off_t(buffer->size());
+    }
+    throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_POST, 1L));
+    throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_POSTFIELDSIZE_LARGE,
+                                    body_size));
+    throw_on_error(
+        curl_easy_setopt(handle.get(), CURLOPT_READFUNCTION, &on_send_body));
+    throw_on_error(
+        curl_easy_setopt(handle.get(), CURLOPT_READDATA, request.get()));
+    // libcurl rewinds the body if it has to send the request again, such as
+    // when a reused connection turns out to have been closed.
+    throw_on_error(
+        curl_easy_setopt(handle.get(), CURLOPT_SEEKFUNCTION, &on_seek_body));
+    throw_on_error(
+        curl_easy_setopt(handle.get(), CURLOPT_SEEKDATA, request.get()));
+  }
+  // HTTP/2 is negotiated only over TLS, and so requests to the Datadog Agent
+  // over plain HTTP still use HTTP/1.1.
+  throw_on_error(curl_easy_setopt(
+      handle.get(), CURLOPT_HTTP_VERSION,
+      http2_ ? long(CURL_HTTP_VERSION_2TLS) : long(CURL_HTTP_VERSION_1_1)));
+  throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_TCP_KEEPALIVE, 1L));
+  throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_TCP_KEEPIDLE,
+                                  long(config_.tcp_keepalive_idle.count())));
+  throw_on_error(
+      curl_easy_setopt(handle.get(), CURLOPT_TCP_KEEPINTVL,
+                       long(config_.tcp_keepalive_interval.count())));
   throw_on_error(
       curl_easy_setopt(handle.get(), CURLOPT_HEADERFUNCTION, &on_read_header));
   throw_on_error(
@@ -236,28 +604,51 @@ Expected<void> CurlImpl::post(const HTTPClient::URL &url,
   throw_on_error(curl_easy_setopt(handle.get(), CURLOPT_HTTPHEADER,
                                   request->request_headers));
 
-  std::list<CURL *> node;
-  node.push_back(handle.get());
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    new_handles_.splice(new_handles_.end(), node);
-
-    headers.release();
-    handle.release();
-    request.release();
-  }
-  log_on_error(curl_multi_wakeup(multi_handle_));
+  // The request is counted before it's pushed, so that `drain` can't miss it.
+  ++num_pending_requests_;
+  new_handles_.push(handle.get());
+  headers.release();
+  handle.release();
+  request.release();
+  wake_for_new_handles();
 
   return std::nullopt;
 } catch (CURLcode error) {
   return Error{Error::CURL_REQUEST_SETUP_FAILED, curl_easy_strerror(error)};
 }
 
+CURL *CurlImpl::acquire_handle() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_handles_.empty()) {
+      CURL *const handle = idle_handles_.back();
+      idle_handles_.pop_back();
+      ++num_reused_handles_;
+      return handle;
+    }
+  }
+  return curl_easy_init();
+}
+
+void CurlImpl::release_handle(CURL *handle) {
+  if (idle_handles_.size() >= config_.max_idle_handles) {
+    curl_easy_cleanup(handle);
+    return;
+  }
+  // `curl_easy_reset` clears the options set for the finished request, but
+  // keeps the handle's DNS and TLS session caches.
+  curl_easy_reset(handle);
+  idle_handles_.push_back(handle);
+}
+
 void CurlImpl::drain(std::chrono::steady_clock::time_point deadline) {
+  if (loop_) {
+    drain_sockets(deadline);
+    return;
+  }
   std::unique_lock<std::mutex> lock(mutex_);
-  no_requests_.wait_until(lock, deadline, [this]() {
-    return num_active_handles_ == 0 && new_handles_.empty();
-  });
+  no_requests_.wait_until(lock, deadline,
+                          [this]() { return num_pending_requests_ == 0; });
 }
 
 std::size_t CurlImpl::on_read_header(char *data, std::size_t,
@@ -284,22 +675,55 @@ std::size_t CurlImpl::on_read_header(char *data, std::size_t,
     return length;
   }
 
-  const auto key = strip(range(begin, colon));
-  const auto value = strip(range(colon + 1, end));
+  // The line is kept as is, and parsed only if it's looked up.  Appending
+  // to one string allocates rarely, rather than once or twice per header.
+  request->response_headers.append(begin, length);
+  return length;
+}
 
-  std::string key_lower;
-  key_lower.reserve(key.size());
-  std::transform(key.begin(), key.end(), std::back_inserter(key_lower),
-                 &to_lower);
+std::size_t CurlImpl::on_send_body(char *buffer, std::size_t size,
+                                    std::size_t count, void *user_data) {
+  auto &request = *static_cast<Request *>(user_data);
+  const std::size_t capacity = size * count;
+  std::size_t written = 0;
+  while (written < capacity &&
+         request.body_buffer < request.request_body.size()) {
+    const std::string &source = *request.request_body[request.body_buffer];
+    const std::size_t length =
+        std::min(capacity - written, source.size() - request.body_offset);
+    std::copy_n(source.data() + request.body_offset, length, buffer + written);
+    written += length;
+    request.body_offset += length;
+    if (request.body_offset == source.size()) {
+      ++request.body_buffer;
+      request.body_offset = 0;
+    }
+  }
+  return written;
+}
 
-  request->response_headers_lower.emplace(std::move(key_lower), value);
-  return length;
+int CurlImpl::on_seek_body(void *user_data, curl_off_t offset, int origin) {
+  auto &request = *static_cast<Request *>(user_data);
+  if (origin != SEEK_SET || offset < 0) {
+    return CURL_SEEKFUNC_CANTSEEK;
+  }
+  request.body_buffer = 0;
+  request.body_offset = 0;
+  auto remaining = std::size_t(offset);
+  while (request.body_buffer < request.request_body.size() &&
+         remaining >= request.request_body[request.body_buffer]->size()) {
+    remaining -= request.request_body[request.body_buffer]->size();
+    ++request.body_buffer;
+  }
+  if (request.body_buffer == request.request_body.size() && remaining != 0) {
+    return CURL_SEEKFUNC_FAIL;
+  }
+  request.body_offset = remaining;
+  return CURL_SEEKFUNC_OK;
 }
 
 bool CurlImpl::is_non_whitespace(unsigned char ch) { return !std::isspace(ch); }
 
-char CurlImpl::to_lower(unsigned char ch) { return std::tolower(ch); }
-
 std::size_t CurlImpl::on_read_body(char *data, std::size_t, std::size_t length,
                                    void *user_data) {
   const auto request = static_cast<Request *>(user_data);
@@ -323,42 +747,364 @@ CURLMcode CurlImpl::log_on_error(CURLMcode result) {
   return result;
 }
 
+void CurlImpl::init_multi_handle() {
+  multi_handle_ = curl_multi_init();
+  if (multi_handle_ == nullptr) {
+    logger_->log_error(Error{
+        Error::CURL_HTTP_CLIENT_SETUP_FAILED,
+        "Unable to initialize a curl multi-handle for sending requests."});
+    return;
+  }
+
+  log_on_error(curl_multi_setopt(multi_handle_, CURLMOPT_MAXCONNECTS,
+                                 config_.max_connections));
+  log_on_error(curl_multi_setopt(multi_handle_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                                 config_.max_host_connections));
+  log_on_error(
+      curl_multi_setopt(multi_handle_, CURLMOPT_PIPELINING,
+                        http2_ ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING));
+  log_on_error(
+      curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETFUNCTION, &on_socket));
+  log_on_error(curl_multi_setopt(multi_handle_, CURLMOPT_SOCKETDATA, this));
+  log_on_error(
+      curl_multi_setopt(multi_handle_, CURLMOPT_TIMERFUNCTION, &on_timer));
+  log_on_error(curl_multi_setopt(multi_handle_, CURLMOPT_TIMERDATA, this));
+}
+
+bool CurlImpl::open_wake_pipe() {
+  if (::pipe(wake_pipe_) != 0) {
+    logger_->log_error(
+        Error{Error::CURL_HTTP_CLIENT_SETUP_FAILED,
+              "Unable to create a pipe for waking the libcurl event loop."});
+    wake_pipe_[0] = wake_pipe_[1] = -1;
+    return false;
+  }
+  for (const int descriptor : wake_pipe_) {
+    ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+    ::fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+  }
+  return true;
+}
+
+void CurlImpl::close_wake_pipe() {
+  for (int &descriptor : wake_pipe_) {
+    if (descriptor != -1) {
+      ::close(descriptor);
+      descriptor = -1;
+    }
+  }
+}
+
+void CurlImpl::wake_event_loop() {
+  const char byte = 0;
+  // If the pipe is full, then the loop is already due to wake.
+  if (::write(wake_pipe_[1], &byte, 1) < 0) {
+    return;
+  }
+}
+
+void CurlImpl::wake_for_new_handles() {
+  if (wake_pending_.exchange(true)) {
+    return;
+  }
+  if (loop_) {
+    loop_->post([alive = std::weak_ptr<CurlImpl *>(alive_)]() {
+      if (const auto impl = alive.lock()) {
+        std::lock_guard<std::mutex> lock((*impl)->mutex_);
+        (*impl)->add_new_handles();
+      }
+    });
+  } else {
+    wake_event_loop();
+  }
+}
+
+void CurlImpl::start_event_loop() {
+  forking_ = false;
+  try {
+    event_loop_ = std::thread([this]() { run(); });
+  } catch (const std::system_error &error) {
+    logger_->log_error(
+        Error{Error::CURL_HTTP_CLIENT_SETUP_FAILED, error.what()});
+    // Mark this object as not working.  The multi handle is abandoned rather
+    // than cleaned up, as in `after_fork_in_child`.
+    multi_handle_ = nullptr;
+  }
+}
+
+void CurlImpl::before_fork() {
+  if (multi_handle_ == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    forking_ = true;
+  }
+  wake_event_loop();
+  event_loop_.join();
+}
+
+void CurlImpl::after_fork_in_parent() {
+  if (multi_handle_ == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  start_event_loop();
+}
+
+void CurlImpl::after_fork_in_child() {
+  if (multi_handle_ == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  // The requests in flight, and the connections in the multi handle's cache,
+  // are shared with the parent.  Closing them could send data on the
+  // parent's behalf (e.g. a TLS close notification), so the multi handle and
+  // the easy handles in flight are abandoned instead.  Their responses belong
+  // to the parent, and so their handlers aren't called.
+  const auto delete_request = [this](CURL *handle) {
+    char *user_data;
+    if (log_on_error(curl_easy_getinfo(handle, CURLINFO_PRIVATE,
+                                       &user_data)) == CURLE_OK) {
+      delete reinterpret_cast<Request *>(user_data);
+    }
+  };
+  for (CURL *const handle : request_handles_) {
+    delete_request(handle);
+  }
+  request_handles_.clear();
+  // Requests that haven't started are the parent's too, and they don't have
+  // connections yet.
+  new_handles_.drain([&](CURL *handle) {
+    delete_request(handle);
+    curl_easy_cleanup(handle);
+  });
+  num_pending_requests_ = 0;
+  wake_pending_ = false;
+  num_active_handles_ = 0;
+  sockets_.clear();
+  timer_deadline_.reset();
+  // The pipe is shared with the parent, whose loop it would wake.
+  close_wake_pipe();
+  if (!open_wake_pipe()) {
+    multi_handle_ = nullptr;
+    return;
+  }
+
+  init_multi_handle();
+  if (multi_handle_ == nullptr) {
+    return;
+  }
+  start_event_loop();
+}
+
 void CurlImpl::run() {
-  int num_messages_remaining;
-  CURLMsg *message;
+  auto placed = place_current_thread(config_.thread_placement, "dd-trace-curl");
+  if (auto *error = placed.if_error()) {
+    logger_->log_error(*error);
+  }
+
   std::unique_lock<std::mutex> lock(mutex_);
+  std::vector<pollfd> descriptors;
 
   for (;;) {
-    log_on_error(curl_multi_perform(multi_handle_, &num_active_handles_));
-    if (num_active_handles_ == 0) {
-      no_requests_.notify_all();
+    // New requests might have been added while we were sleeping.
+    add_new_handles();
+
+    if (shutting_down_) {
+      break;
+    }
+    if (forking_) {
+      // Leave everything as it is, for the thread that replaces this one.
+      return;
+    }
+
+    // Sleep until one of libcurl's sockets is ready, libcurl's timeout
+    // expires, or we're woken.  While there are no requests, libcurl has
+    // neither, and so we sleep until woken.
+    descriptors.clear();
+    descriptors.push_back(pollfd{wake_pipe_[0], POLLIN, 0});
+    for (const auto &[socket, interest] : sockets_) {
+      descriptors.push_back(pollfd{socket, poll_events(interest), 0});
     }
+    int timeout = -1;
+    auto deadline = next_event_deadline();
+    if (timer_deadline_ && (!deadline || *timer_deadline_ < *deadline)) {
+      deadline = timer_deadline_;
+    }
+    if (deadline) {
+      const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+          *deadline - std::chrono::steady_clock::now());
+      timeout = int(std::clamp<std::chrono::milliseconds::rep>(
+          remaining.count(), 0, std::numeric_limits<int>::max()));
+    }
+    lock.unlock();
+    const int num_ready = ::poll(descriptors.data(), descriptors.size(),
+                                 timeout);
+    lock.lock();
 
-    // If a request is done or errored out, curl will enqueue a "message" for
-    // us to handle.  Handle any pending messages.
-    while ((message =
-                curl_multi_info_read(multi_handle_, &num_messages_remaining))) {
-      handle_message(*message);
+    if (num_ready > 0) {
+      if (descriptors.front().revents & POLLIN) {
+        char buffer[64];
+        while (::read(wake_pipe_[0], buffer, sizeof buffer) > 0) {
+        }
+      }
+      for (auto descriptor = descriptors.begin() + 1;
+           descriptor != descriptors.end(); ++descriptor) {
+        if (const int flags = select_flags(descriptor->revents)) {
+          perform(descriptor->fd, flags);
+        }
+      }
+    }
+    if (timer_deadline_ &&
+        *timer_deadline_ <= std::chrono::steady_clock::now()) {
+      // libcurl might set another timeout as it acts on this one.
+      timer_deadline_.reset();
+      perform(CURL_SOCKET_TIMEOUT, 0);
     }
 
-    const int max_wait_milliseconds = 10 * 1000;
+    // The callbacks may send requests, which `send` queues without `mutex_`.
     lock.unlock();
-    log_on_error(curl_multi_poll(multi_handle_, nullptr, 0,
-                                 max_wait_milliseconds, nullptr));
+    run_due_events();
     lock.lock();
+  }
 
-    // New requests might have been added while we were sleeping.
-    for (; !new_handles_.empty(); new_handles_.pop_front()) {
-      CURL *const handle = new_handles_.front();
-      log_on_error(curl_multi_add_handle(multi_handle_, handle));
-      request_handles_.insert(handle);
+  shut_down();
+}
+
+std::optional<std::chrono::steady_clock::time_point>
+CurlImpl::next_event_deadline() {
+  std::lock_guard<std::mutex> lock(events_mutex_);
+  std::optional<std::chrono::steady_clock::time_point> result;
+  for (const auto &[id, event] : events_) {
+    (void)id;
+    if (!result || event.next < *result) {
+      result = event.next;
     }
+  }
+  return result;
+}
 
-    if (shutting_down_) {
-      break;
+void CurlImpl::run_due_events() {
+  std::unique_lock<std::mutex> lock(events_mutex_);
+  const auto now = std::chrono::steady_clock::now();
+  // An event isn't invoked twice in one turn, even if its callback wakes it.
+  std::vector<std::uint64_t> due;
+  for (const auto &[id, event] : events_) {
+    if (event.next <= now) {
+      due.push_back(id);
+    }
+  }
+
+  for (const std::uint64_t id : due) {
+    const auto found = events_.find(id);
+    if (found == events_.end()) {
+      // An earlier callback cancelled it.
+      continue;
+    }
+    Event &event = found->second;
+    // After a stall, e.g. a long callback, the event is invoked once rather
+    // than once for each interval missed.
+    const auto interval = event.next_interval();
+    event.next += interval;
+    if (event.next <= now) {
+      event.next = now + interval;
     }
+    const auto callback = event.callback;
+    running_event_ = id;
+    lock.unlock();
+    (*callback)();
+    lock.lock();
+    running_event_ = 0;
+    event_done_.notify_all();
   }
+}
+
+bool CurlImpl::has_thread() const { return multi_handle_ && !loop_; }
 
+std::uint64_t CurlImpl::schedule_event(
+    const void *owner, std::chrono::steady_clock::duration first_delay,
+    std::function<std::chrono::steady_clock::duration()> next_interval,
+    std::function<void()> callback) {
+  std::uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(events_mutex_);
+    id = next_event_id_++;
+    events_.emplace(
+        id, Event{owner,
+                  std::make_shared<const std::function<void()>>(
+                      std::move(callback)),
+                  std::move(next_interval),
+                  std::chrono::steady_clock::now() + first_delay});
+  }
+  // `event_loop_` might be sleeping past the new event's deadline.
+  wake_event_loop();
+  return id;
+}
+
+void CurlImpl::wake_event(std::uint64_t id) {
+  {
+    std::lock_guard<std::mutex> lock(events_mutex_);
+    const auto found = events_.find(id);
+    if (found == events_.end()) {
+      return;
+    }
+    found->second.next = std::chrono::steady_clock::now();
+  }
+  wake_event_loop();
+}
+
+void CurlImpl::wait_for_event(std::unique_lock<std::mutex> &lock,
+                              std::uint64_t id) {
+  if (std::this_thread::get_id() == event_loop_.get_id()) {
+    // The event is cancelling itself, or a response handler is cancelling
+    // it.  Either way, it isn't running on another thread.
+    return;
+  }
+  event_done_.wait(lock, [&]() { return running_event_ != id; });
+}
+
+void CurlImpl::cancel_event(std::uint64_t id) {
+  std::unique_lock<std::mutex> lock(events_mutex_);
+  events_.erase(id);
+  wait_for_event(lock, id);
+}
+
+void CurlImpl::cancel_events(const void *owner) {
+  std::unique_lock<std::mutex> lock(events_mutex_);
+  std::vector<std::uint64_t> ids;
+  for (const auto &[id, event] : events_) {
+    if (event.owner == owner) {
+      ids.push_back(id);
+    }
+  }
+  for (const std::uint64_t id : ids) {
+    events_.erase(id);
+    wait_for_event(lock, id);
+  }
+}
+
+void CurlImpl::add_new_handles() {
+  // A `send` after this point wakes us again.
+  wake_pending_ = false;
+  new_handles_.drain([this](CURL *handle) {
+    // libcurl starts the request from its timer callback.
+    log_on_error(curl_multi_add_handle(multi_handle_, handle));
+    request_handles_.insert(handle);
+  });
+}
+
+void CurlImpl::handle_messages() {
+  // If a request is done or errored out, curl will enqueue a "message" for us
+  // to handle.  Handle any pending messages.
+  int num_messages_remaining;
+  while (CURLMsg *message =
+             curl_multi_info_read(multi_handle_, &num_messages_remaining)) {
+    handle_message(*message);
+  }
+}
+
+void CurlImpl::shut_down() {
   // We're shutting down.  Clean up any remaining request handles.
   for (const auto &handle : request_handles_) {
     char *user_data;
@@ -368,13 +1114,139 @@ void CurlImpl::run() {
     }
 
     log_on_error(curl_multi_remove_handle(multi_handle_, handle));
+    curl_easy_cleanup(handle);
   }
 
   request_handles_.clear();
+  for (CURL *const handle : idle_handles_) {
+    curl_easy_cleanup(handle);
+  }
+  idle_handles_.clear();
   log_on_error(curl_multi_cleanup(multi_handle_));
   curl_global_cleanup();
 }
 
+void CurlImpl::perform(curl_socket_t socket, int flags) {
+  log_on_error(curl_multi_socket_action(multi_handle_, socket, flags,
+                                        &num_active_handles_));
+  handle_messages();
+}
+
+void CurlImpl::socket_action(curl_socket_t socket, int flags) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  perform(socket, flags);
+}
+
+void CurlImpl::drain_sockets(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  add_new_handles();
+  std::vector<pollfd> descriptors;
+  while (!request_handles_.empty()) {
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      return;
+    }
+    long timeout;
+    if (log_on_error(curl_multi_timeout(multi_handle_, &timeout)) !=
+            CURLM_OK ||
+        timeout < 0) {
+      timeout = 1000;
+    }
+    timeout = std::min<long>(
+        timeout,
+        std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count());
+
+    descriptors.clear();
+    for (const auto &[socket, interest] : sockets_) {
+      descriptors.push_back(pollfd{socket, poll_events(interest), 0});
+    }
+    lock.unlock();
+    const int num_ready = ::poll(descriptors.data(), descriptors.size(),
+                                 int(timeout));
+    if (num_ready <= 0) {
+      socket_action(CURL_SOCKET_TIMEOUT, 0);
+    } else {
+      for (const pollfd &descriptor : descriptors) {
+        if (const int flags = select_flags(descriptor.revents)) {
+          socket_action(descriptor.fd, flags);
+        }
+      }
+    }
+    lock.lock();
+  }
+}
+
+int CurlImpl::on_socket(CURL *, curl_socket_t socket, int what,
+                        void *user_data, void *) {
+  auto &self = *static_cast<CurlImpl *>(user_data);
+  if (what == CURL_POLL_REMOVE) {
+    self.sockets_.erase(socket);
+    if (self.loop_) {
+      self.loop_->watch_socket(socket, 0, nullptr);
+    }
+    return 0;
+  }
+
+  const int interest =
+      ((what == CURL_POLL_IN || what == CURL_POLL_INOUT) ? EventLoop::READ
+                                                         : 0) |
+      ((what == CURL_POLL_OUT || what == CURL_POLL_INOUT) ? EventLoop::WRITE
+                                                          : 0);
+  self.sockets_[socket] = interest;
+  if (!self.loop_) {
+    // `event_loop_` polls `sockets_` the next time it sleeps.
+    return 0;
+  }
+  self.loop_->watch_socket(
+      socket, interest,
+      [alive = std::weak_ptr<CurlImpl *>(self.alive_), socket](int events) {
+        const auto impl = alive.lock();
+        if (!impl) {
+          return;
+        }
+        const int flags =
+            ((events & EventLoop::READ) ? CURL_CSELECT_IN : 0) |
+            ((events & EventLoop::WRITE) ? CURL_CSELECT_OUT : 0) |
+            ((events & EventLoop::FAILURE) ? CURL_CSELECT_ERR : 0);
+        (*impl)->socket_action(socket, flags);
+      });
+  return 0;
+}
+
+int CurlImpl::on_timer(CURLM *, long timeout_milliseconds, void *user_data) {
+  auto &self = *static_cast<CurlImpl *>(user_data);
+  if (!self.loop_) {
+    // `event_loop_` sleeps until the deadline, at the latest.
+    if (timeout_milliseconds < 0) {
+      self.timer_deadline_.reset();
+    } else {
+      self.timer_deadline_ = std::chrono::steady_clock::now() +
+                             std::chrono::milliseconds(timeout_milliseconds);
+    }
+    return 0;
+  }
+  if (self.has_timer_) {
+    self.loop_->cancel_timer(self.timer_);
+    self.has_timer_ = false;
+  }
+  if (timeout_milliseconds < 0 || !self.alive_) {
+    return 0;
+  }
+
+  // libcurl must not be called back from within this callback, and so even a
+  // zero timeout is handled by the loop.
+  self.timer_ = self.loop_->start_timer(
+      std::chrono::milliseconds(timeout_milliseconds),
+      [alive = std::weak_ptr<CurlImpl *>(self.alive_)]() {
+        if (const auto impl = alive.lock()) {
+          (*impl)->has_timer_ = false;
+          (*impl)->socket_action(CURL_SOCKET_TIMEOUT, 0);
+        }
+      });
+  self.has_timer_ = true;
+  return 0;
+}
+
 void CurlImpl::handle_message(const CURLMsg &message) {
   if (message.msg != CURLMSG_DONE) {
     return;
@@ -400,20 +1272,54 @@ void CurlImpl::handle_message(const CURLMsg &message) {
     request.on_error(
         Error{Error::CURL_REQUEST_FAILURE, std::move(error_message)});
   } else {
+    // A transfer that didn't need a new connection reused a cached one.
+    long num_connects;
+    if (curl_easy_getinfo(request_handle, CURLINFO_NUM_CONNECTS,
+                          &num_connects) == CURLE_OK &&
+        num_connects == 0) {
+      ++num_reused_connections_;
+    }
     long status;
     if (log_on_error(curl_easy_getinfo(request_handle, CURLINFO_RESPONSE_CODE,
                                        &status)) != CURLE_OK) {
       status = -1;
     }
-    HeaderReader reader(&request.response_headers_lower);
+    HeaderReader reader(&request.response_headers);
     request.on_response(static_cast<int>(status), reader,
                         std::move(request.response_body));
   }
 
+  ++num_requests_;
   log_on_error(curl_multi_remove_handle(multi_handle_, request_handle));
-  curl_easy_cleanup(request_handle);
   request_handles_.erase(request_handle);
+  release_handle(request_handle);
   delete &request;
+  if (--num_pending_requests_ == 0) {
+    no_requests_.notify_all();
+  }
+}
+
+nlohmann::json CurlImpl::config_json() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::Curl"},
+    {"config", nlohmann::json::object({
+      {"max_connections", config_.max_connections},
+      {"max_host_connections", config_.max_host_connections},
+      {"max_idle_handles", config_.max_idle_handles},
+      {"http2", http2_},
+      {"tcp_keepalive_idle_seconds", config_.tcp_keepalive_idle.count()},
+      {"tcp_keepalive_interval_seconds",
+       config_.tcp_keepalive_interval.count()},
+      {"event_loop", bool(loop_)},
+    })},
+    {"stats", nlohmann::json::object({
+      {"requests", num_requests_.load()},
+      {"reused_connections", num_reused_connections_.load()},
+      {"reused_handles", num_reused_handles_.load()},
+    })},
+  });
+  // clang-format on
 }
 
 CurlImpl::Request::~Request() { curl_slist_free_all(request_headers); }
@@ -435,29 +1341,32 @@ void CurlImpl::HeaderWriter::set(std::string_view key, std::string_view value) {
   list_ = curl_slist_append(list_, buffer_.c_str());
 }
 
-CurlImpl::HeaderReader::HeaderReader(
-    std::unordered_map<std::string, std::string> *response_headers_lower)
-    : response_headers_lower_(response_headers_lower) {}
+CurlImpl::HeaderReader::HeaderReader(const std::string *response_headers)
+    : response_headers_(response_headers) {}
 
 std::optional<std::string_view> CurlImpl::HeaderReader::lookup(
     std::string_view key) const {
-  buffer_.clear();
-  std::transform(key.begin(), key.end(), std::back_inserter(buffer_),
-                 &to_lower);
-
-  const auto found = response_headers_lower_->find(buffer_);
-  if (found == response_headers_lower_->end()) {
-    return std::nullopt;
-  }
-  return found->second;
+  std::optional<std::string_view> result;
+  for_each_header(*response_headers_,
+                  [&](std::string_view name, std::string_view value) {
+                    if (!equal_ignoring_case(name, key)) {
+                      return true;
+                    }
+                    // As when a header is repeated, the first one wins.
+                    result = value;
+                    return false;
+                  });
+  return result;
 }
 
 void CurlImpl::HeaderReader::visit(
     const std::function<void(std::string_view key, std::string_view value)>
         &visitor) const {
-  for (const auto &[key, value] : *response_headers_lower_) {
-    visitor(key, value);
-  }
+  for_each_header(*response_headers_,
+                  [&](std::string_view name, std::string_view value) {
+                    visitor(name, value);
+                    return true;
+                  });
 }
 
 }  // namespace tracing
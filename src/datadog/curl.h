@@ -1,8 +1,53 @@
 #pragma once
 
 // This component provides a `class`, `Curl`, that implements the `HTTPClient`
-// interface in terms of [libcurl][1].  `class Curl` manages a thread that is
-// used as the event loop for libcurl.
+// interface in terms of [libcurl][1].  By default, `class Curl` manages a
+// thread that is used as the event loop for libcurl.  The thread is driven by
+// libcurl's socket and timer callbacks: it sleeps until one of libcurl's
+// sockets is ready, libcurl's timeout expires, or a request is sent, and so
+// it doesn't wake at all while there are no requests.  Requests are handed to
+// the thread without locking, and the thread is woken once for any number of
+// them.
+//
+// Alternatively, `Curl` can be constructed with an application-owned
+// `EventLoop` (see `event_loop.h`), in which case it has no thread.  Instead,
+// it registers libcurl's sockets and timeouts with the loop, and drives
+// libcurl using `curl_multi_socket_action` from the loop's callbacks.  In that
+// mode, `post` and `get` may be called from any thread, but `Curl` must be
+// destroyed, and `drain` called, on the loop's thread.  `drain` then waits on
+// libcurl's sockets itself until the requests are done or the deadline
+// passes.
+//
+// `Curl` keeps the connections that libcurl opens to the collector alive
+// between requests: the multi handle's connection cache holds up to
+// `CurlConfig::max_connections` idle connections, TCP keepalive probes keep
+// them from being silently dropped, and finished easy handles are reset and
+// reused for later requests rather than recreated.  `config_json` reports how
+// often connections and handles were reused.
+//
+// A request body given as a `BodyChain` is streamed to libcurl from its
+// buffers by a read callback, and so is never concatenated.
+//
+// When `Curl` manages its own thread, the thread is named "dd-trace-curl", and
+// it can be kept to some CPUs, and its priority lowered, by
+// `CurlConfig::thread_placement` (see `thread_placement.h`).
+//
+// When `Curl` manages its own thread, it stops the thread before `fork` and
+// starts it again afterward (see `fork_handlers.h`).  In the child, the
+// requests in flight and the open connections belong to the parent, and so
+// the child abandons them, discards the requests not yet started, and begins
+// again with a new multi handle.  `fork` must not be called from within a
+// response or error handler.  When `Curl` uses an `EventLoop`, handling
+// `fork` is the application's business.
+//
+// A `Curl` that has its own thread can also run the tracer's recurring events:
+// `curl_event_scheduler` returns an `EventScheduler` whose events are invoked
+// on that thread, between its turns of libcurl.  A tracer that uses it for
+// `DatadogAgentConfig::event_scheduler` then has one background thread rather
+// than two, and a flush encodes and sends its request on the thread that
+// performs it, without handing it to another thread.  An event's callback
+// delays the requests in flight while it runs, as a long response handler
+// would.  See `DatadogAgentConfig::single_background_thread`.
 //
 // If this library was built in a mode that does not include libcurl, then this
 // file and its implementation, `curl.cpp`, will not be included.
@@ -10,23 +55,61 @@
 // [1]: https://curl.se/libcurl/
 
 #include <chrono>
+#include <cstddef>
 #include <memory>
 #include <string>
 
 #include "http_client.h"
 #include "json_fwd.hpp"
+#include "thread_placement.h"
 
 namespace datadog {
 namespace tracing {
 
 class CurlImpl;
+class EventLoop;
+class EventScheduler;
 class Logger;
 
+struct CurlConfig {
+  // `max_connections` is the size of the connection cache, i.e. the maximum
+  // number of idle connections kept open for reuse.
+  long max_connections = 8;
+  // `max_host_connections` is the maximum number of simultaneous connections
+  // to a single host.  Requests beyond the limit wait for a connection.  Zero
+  // means no limit.
+  long max_host_connections = 4;
+  // `max_idle_handles` is the maximum number of finished easy handles kept for
+  // reuse by later requests.
+  std::size_t max_idle_handles = 4;
+  // `tcp_keepalive_idle` is how long a connection is idle before TCP keepalive
+  // probes are sent, and `tcp_keepalive_interval` is the time between probes.
+  std::chrono::seconds tcp_keepalive_idle = std::chrono::seconds(60);
+  std::chrono::seconds tcp_keepalive_interval = std::chrono::seconds(60);
+  // `http2` is whether HTTPS requests use HTTP/2, if the server supports it,
+  // and concurrent requests to the same host are multiplexed over one
+  // connection rather than each taking a connection of its own.  It has no
+  // effect if libcurl was built without HTTP/2 support.  Requests over plain
+  // HTTP, such as to the Datadog Agent, use HTTP/1.1 regardless.
+  bool http2 = true;
+  // `thread_placement` is applied to the thread that drives libcurl, if
+  // `Curl` has one.  If it can't be applied, then the error is logged and the
+  // thread runs anyway.
+  ThreadPlacement thread_placement;
+};
+
 class Curl : public HTTPClient {
   CurlImpl* impl_;
 
+  friend std::shared_ptr<EventScheduler> curl_event_scheduler(
+      const std::shared_ptr<Curl>&);
+
  public:
-  explicit Curl(const std::shared_ptr<Logger>& logger);
+  explicit Curl(const std::shared_ptr<Logger>& logger,
+                const CurlConfig& config = CurlConfig{});
+  Curl(const std::shared_ptr<Logger>& logger,
+       const std::shared_ptr<EventLoop>& loop,
+       const CurlConfig& config = CurlConfig{});
   ~Curl();
 
   Curl(const Curl&) = delete;
@@ -34,11 +117,25 @@ class Curl : public HTTPClient {
   Expected<void> post(const URL& url, HeadersSetter set_headers,
                       std::string body, ResponseHandler on_response,
                       ErrorHandler on_error) override;
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      BodyChain body, ResponseHandler on_response,
+                      ErrorHandler on_error) override;
+  Expected<void> get(const URL& url, HeadersSetter set_headers,
+                     ResponseHandler on_response,
+                     ErrorHandler on_error) override;
 
   void drain(std::chrono::steady_clock::time_point deadline) override;
 
   nlohmann::json config_json() const override;
 };
 
+// Return an `EventScheduler` whose events are invoked on the thread of the
+// specified `curl`, or return null if `curl` has no thread, i.e. if it uses an
+// `EventLoop` or failed to start.  The scheduler keeps `curl` alive.  An
+// event may be cancelled from within its own callback, and cancelling it from
+// another thread waits for its callback to return, if it's running.
+std::shared_ptr<EventScheduler> curl_event_scheduler(
+    const std::shared_ptr<Curl>& curl);
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,44 @@
+#include "cycle_counter.h"
+
+#include <thread>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Return the number of nanoseconds per cycle of the cycle counter.
+double measure_nanoseconds_per_cycle() {
+#if DD_TRACE_CYCLE_COUNTER_IS_TSC
+  const auto start_time = std::chrono::steady_clock::now();
+  const std::uint64_t start_cycles = read_cycle_counter();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  const auto end_time = std::chrono::steady_clock::now();
+  const std::uint64_t end_cycles = read_cycle_counter();
+  const double nanoseconds = double(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end_time -
+                                                           start_time)
+          .count());
+  const std::uint64_t cycles = end_cycles - start_cycles;
+  return cycles == 0 ? 1.0 : nanoseconds / double(cycles);
+#else
+  // The cycle counter is the steady clock in nanoseconds.
+  return 1.0;
+#endif
+}
+
+double nanoseconds_per_cycle() {
+  static const double rate = measure_nanoseconds_per_cycle();
+  return rate;
+}
+
+}  // namespace
+
+void calibrate_cycle_counter() { (void)nanoseconds_per_cycle(); }
+
+std::chrono::nanoseconds cycles_to_duration(std::uint64_t cycles) {
+  return std::chrono::nanoseconds(
+      std::int64_t(double(cycles) * nanoseconds_per_cycle()));
+}
+
+}  // namespace tracing
+}  // namespace datadog
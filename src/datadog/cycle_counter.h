@@ -0,0 +1,49 @@
+#pragma once
+
+// This component provides functions for timing short intervals cheaply.
+// `read_cycle_counter` returns the processor's timestamp counter where the
+// library is built for x86-64 with GCC or Clang, and otherwise returns the
+// steady clock in nanoseconds.  `cycles_to_duration` converts the difference
+// of two counts to a duration.
+//
+// The timestamp counter's rate is measured against the steady clock the first
+// time that `cycles_to_duration` is called, which takes a couple of
+// milliseconds.  Call `calibrate_cycle_counter` beforehand to do that at a
+// convenient time.  The counter is assumed to be invariant, i.e. to advance at
+// a constant rate that's the same on every core, as it is on processors made
+// in the last fifteen years or so.
+//
+// These are used to measure the tracer's own overhead.  See
+// `TracerConfig::overhead_profiling_enabled`.
+
+#include <chrono>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <x86intrin.h>
+#define DD_TRACE_CYCLE_COUNTER_IS_TSC 1
+#else
+#define DD_TRACE_CYCLE_COUNTER_IS_TSC 0
+#endif
+
+namespace datadog {
+namespace tracing {
+
+inline std::uint64_t read_cycle_counter() {
+#if DD_TRACE_CYCLE_COUNTER_IS_TSC
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// Measure the rate of the cycle counter, if it hasn't been already.
+void calibrate_cycle_counter();
+
+// Return the duration of the specified number of `cycles`.
+std::chrono::nanoseconds cycles_to_duration(std::uint64_t cycles);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -1,19 +1,38 @@
 #include "datadog_agent.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <typeinfo>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <variant>
 
 #include "collector_response.h"
 #include "datadog_agent_config.h"
 #include "dict_writer.h"
+#include "error_stack.h"
+#include "gzip.h"
 #include "json.hpp"
 #include "logger.h"
 #include "msgpack.h"
+#include "otlp.h"
+#include "shared_memory_ring.h"
 #include "span_data.h"
+#include "span_defaults.h"
+#include "span_sampler.h"
+#include "string_table.h"
+#include "tags.h"
+#include "thread_placement.h"
 #include "trace_sampler.h"
 #include "version.h"
 
@@ -21,248 +40,2442 @@ namespace datadog {
 namespace tracing {
 namespace {
 
-const std::string_view traces_api_path = "/v0.4/traces";
+// A flush is encoded in parallel only if each task would have at least this
+// many trace chunks.
+constexpr std::size_t min_chunks_per_encoder_task = 16;
 
-HTTPClient::URL traces_endpoint(const HTTPClient::URL& agent_url) {
+std::string_view traces_api_path(TraceAPIVersion version) {
+  switch (version) {
+    case TraceAPIVersion::V0_5:
+      return "/v0.5/traces";
+    case TraceAPIVersion::OTLP:
+      return "/v1/traces";
+    case TraceAPIVersion::V0_4:
+    default:
+      return "/v0.4/traces";
+  }
+}
+
+std::string_view to_string(TraceAPIVersion version) {
+  switch (version) {
+    case TraceAPIVersion::V0_5:
+      return "v0.5";
+    case TraceAPIVersion::OTLP:
+      return "otlp";
+    case TraceAPIVersion::V0_4:
+    default:
+      return "v0.4";
+  }
+}
+
+std::string_view to_string(BufferOverflowPolicy policy) {
+  switch (policy) {
+    case BufferOverflowPolicy::DROP_OLDEST:
+      return "drop_oldest";
+    case BufferOverflowPolicy::DROP_BY_PRIORITY:
+      return "drop_by_priority";
+    case BufferOverflowPolicy::DROP_NEWEST:
+    default:
+      return "drop_newest";
+  }
+}
+
+std::string_view to_string(PayloadCompression compression) {
+  switch (compression) {
+    case PayloadCompression::GZIP:
+      return "gzip";
+    case PayloadCompression::NONE:
+    default:
+      return "none";
+  }
+}
+
+std::string_view to_string(AgentLoadBalancing load_balancing) {
+  switch (load_balancing) {
+    case AgentLoadBalancing::LEAST_OUTSTANDING_REQUESTS:
+      return "least_outstanding_requests";
+    case AgentLoadBalancing::ROUND_ROBIN:
+    default:
+      return "round_robin";
+  }
+}
+
+HTTPClient::URL traces_endpoint(const HTTPClient::URL& agent_url,
+                                TraceAPIVersion version) {
   auto traces_url = agent_url;
-  traces_url.path += traces_api_path;
+  traces_url.path += traces_api_path(version);
   return traces_url;
 }
 
-Expected<void> msgpack_encode(
-    std::string& destination,
-    const std::vector<std::unique_ptr<SpanData>>& spans) {
-  return msgpack::pack_array(destination, spans,
-                             [](auto& destination, const auto& span_ptr) {
-                               assert(span_ptr);
-                               return msgpack_encode(destination, *span_ptr);
-                             });
+// Return the DogStatsD tags of the health metrics of a tracer having the
+// specified `defaults`.  Characters that delimit DogStatsD tags are replaced.
+std::string health_metrics_tags(const SpanDefaults& defaults) {
+  std::string tags;
+  const auto append = [&](std::string_view name, std::string_view value) {
+    if (value.empty()) {
+      return;
+    }
+    if (!tags.empty()) {
+      tags += ',';
+    }
+    tags += name;
+    tags += ':';
+    for (const char ch : value) {
+      tags += (ch == ',' || ch == '|' || ch == '#' || ch == '\n') ? '_' : ch;
+    }
+  };
+  append("service", defaults.service);
+  append("env", defaults.environment);
+  append("version", defaults.version);
+  append("lang", "cpp");
+  append("tracer_version", tracer_version);
+  return tags;
+}
+
+// Return what the specified `current` histogram or distribution counted since
+// the specified `previous` snapshot of it.
+template <typename Histogram>
+Histogram since(const Histogram& current, const Histogram& previous) {
+  Histogram result;
+  result.count = current.count - previous.count;
+  result.sum = current.sum - previous.sum;
+  for (std::size_t i = 0; i < result.buckets.size(); ++i) {
+    result.buckets[i] = current.buckets[i] - previous.buckets[i];
+  }
+  return result;
+}
+
+// Write to the specified `stream` the mean and the 99th percentile of the
+// specified `histogram`, in microseconds, labeled with the specified `name`.
+void summarize(std::ostream& stream, std::string_view name,
+               const MetricsSnapshot::Histogram& histogram) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  stream << ' ' << name << " mean "
+         << duration_cast<microseconds>(histogram.mean()).count() << "us p99 "
+         << duration_cast<microseconds>(histogram.percentile(0.99)).count()
+         << "us;";
+}
+
+HTTPClient::URL stats_endpoint(const HTTPClient::URL& agent_url) {
+  auto stats_url = agent_url;
+  stats_url.path += "/v0.6/stats";
+  return stats_url;
 }
 
 Expected<void> msgpack_encode(
     std::string& destination,
-    const std::vector<DatadogAgent::TraceChunk>& trace_chunks) {
-  return msgpack::pack_array(destination, trace_chunks,
-                             [](auto& destination, const auto& chunk) {
-                               return msgpack_encode(destination, chunk.spans);
-                             });
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    const EncodedSpanDefaults& defaults, std::string_view origin) {
+  return msgpack::pack_array(
+      destination, spans, [&](auto& destination, const auto& span_ptr) {
+        assert(span_ptr);
+        return msgpack_encode(destination, *span_ptr, defaults, origin);
+      });
 }
 
-std::variant<CollectorResponse, std::string> parse_agent_traces_response(
-    std::string_view body) try {
-  nlohmann::json response = nlohmann::json::parse(body);
+void otlp_encode(std::string& destination,
+                 const std::vector<std::unique_ptr<SpanData>>& spans,
+                 const OtlpResource& resource, std::string_view origin) {
+  for (const auto& span_ptr : spans) {
+    assert(span_ptr);
+    otlp_encode(destination, *span_ptr, resource, origin);
+  }
+}
 
-  std::string_view type = response.type_name();
-  if (type != "object") {
-    std::string message;
-    message +=
-        "Parsing the Datadog Agent's response to traces we sent it failed.  "
-        "The response is expected to be a JSON object, but instead it's a JSON "
-        "value with type \"";
-    message += type;
-    message += '\"';
-    message += "\nError occurred for response body (begins on next line):\n";
-    message += body;
-    return message;
+// Return whether the specified `spans` are a trace chunk whose sampling
+// priority is `AUTO_DROP` or `USER_DROP`.
+bool dropped_by_sampling(const std::vector<std::unique_ptr<SpanData>>& spans) {
+  // The sampling priority is on the local root span, which is first.
+  if (spans.empty()) {
+    return false;
+  }
+  const auto& numeric_tags = spans.front()->numeric_tags;
+  const auto found = numeric_tags.find(tags::internal::sampling_priority);
+  return found != numeric_tags.end() && found->second <= 0;
+}
+
+// Return the footprint of a trace chunk having the specified `spans` and the
+// specified encoded size in `bytes`.
+TraceChunkFootprint footprint(
+    const std::vector<std::unique_ptr<SpanData>>& spans, std::size_t bytes) {
+  TraceChunkFootprint result;
+  result.spans = spans.size();
+  result.bytes = bytes;
+  result.dropped_by_sampling = dropped_by_sampling(spans);
+  return result;
+}
+
+// Return whether a request to which the Datadog Agent responded with the
+// specified `status` may be retried.
+bool is_retryable(int status) {
+  return status == 408 || status == 429 || status >= 500;
+}
+
+// Return a callback that sets the headers of the specified `request` of
+// traces, including the specified numbers of `dropped_traces` and
+// `dropped_spans` that the client dropped, if either is not zero.  An `OTLP`
+// request has only the headers that describe its body.
+HTTPClient::HeadersSetter traces_request_headers(
+    const DatadogAgent::Request& request, std::size_t dropped_traces,
+    std::size_t dropped_spans) {
+  return [trace_count = request.trace_count, compressed = request.compressed,
+          dropped_traces, dropped_spans,
+          computed_stats = request.computed_stats,
+          otlp = request.api_version == TraceAPIVersion::OTLP](
+             DictWriter& headers) {
+    headers.set("Content-Type",
+                otlp ? "application/x-protobuf" : "application/msgpack");
+    if (compressed) {
+      headers.set("Content-Encoding", "gzip");
+    }
+    if (otlp) {
+      return;
+    }
+    headers.set("Datadog-Meta-Lang", "cpp");
+    headers.set("Datadog-Meta-Lang-Version", std::to_string(__cplusplus));
+    headers.set("Datadog-Meta-Tracer-Version", tracer_version);
+    headers.set("X-Datadog-Trace-Count", std::to_string(trace_count));
+    if (computed_stats) {
+      headers.set("Datadog-Client-Computed-Stats", "yes");
+    }
+    if (dropped_traces != 0 || dropped_spans != 0) {
+      headers.set("Datadog-Client-Dropped-P0-Traces",
+                  std::to_string(dropped_traces));
+      headers.set("Datadog-Client-Dropped-P0-Spans",
+                  std::to_string(dropped_spans));
+    }
+  };
+}
+
+// Add the specified `request` to the specified `failed` requests.
+void add_failed(DatadogAgent::FailedRequests& failed,
+                DatadogAgent::Request&& request) {
+  std::lock_guard<std::mutex> lock(failed.mutex);
+  failed.requests.push_back(std::move(request));
+}
+
+// Fulfill the specified `in_flight` requests' `idle` promise, if there is one.
+// `in_flight.mutex` must be locked.
+void notify_idle(DatadogAgent::InFlightRequests& in_flight) {
+  if (in_flight.idle) {
+    in_flight.idle->set_value();
+    in_flight.idle.reset();
+  }
+}
+
+void begin_request(DatadogAgent::InFlightRequests& in_flight) {
+  std::lock_guard<std::mutex> lock(in_flight.mutex);
+  ++in_flight.count;
+}
+
+void end_request(DatadogAgent::InFlightRequests& in_flight) {
+  std::lock_guard<std::mutex> lock(in_flight.mutex);
+  if (--in_flight.count == 0) {
+    notify_idle(in_flight);
+  }
+}
+
+// `AgentResponseParser` is a SAX handler that parses the Datadog Agent's
+// response to traces directly into a `CollectorResponse`, without building a
+// JSON document.  If the response is invalid, then it stops the parse and
+// sets `error`.
+class AgentResponseParser : public nlohmann::json_sax<nlohmann::json> {
+  static constexpr std::string_view sample_rates_property = "rate_by_service";
+
+  std::string_view body_;
+  // `depth_` is the number of objects and arrays that are open.
+  std::size_t depth_ = 0;
+  // `rates_next_` is true if the next value is that of
+  // `sample_rates_property`, and `in_rates_` is true while that object is
+  // open, during which `rate_key_` is the key of the next rate.
+  bool rates_next_ = false;
+  bool in_rates_ = false;
+  std::string rate_key_;
+
+ public:
+  CollectorResponse response;
+  std::optional<std::string> error;
+
+  explicit AgentResponseParser(std::string_view body) : body_(body) {}
+
+  bool null() override { return on_value("null", nullptr); }
+  bool boolean(bool) override { return on_value("boolean", nullptr); }
+  bool number_integer(number_integer_t value) override {
+    const double number = double(value);
+    return on_value("number", &number);
+  }
+  bool number_unsigned(number_unsigned_t value) override {
+    const double number = double(value);
+    return on_value("number", &number);
+  }
+  bool number_float(number_float_t value, const string_t&) override {
+    const double number = value;
+    return on_value("number", &number);
+  }
+  bool string(string_t&) override { return on_value("string", nullptr); }
+  bool binary(binary_t&) override { return on_value("binary", nullptr); }
+
+  bool start_object(std::size_t) override {
+    const bool rates = rates_next_;
+    if (!on_value("object", nullptr)) {
+      return false;
+    }
+    ++depth_;
+    if (rates) {
+      // If the property appears more than once, then the last one counts.
+      in_rates_ = true;
+      response.sample_rate_by_key.clear();
+    }
+    return true;
+  }
+
+  bool end_object() override {
+    if (in_rates_ && depth_ == 2) {
+      in_rates_ = false;
+    }
+    --depth_;
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    if (!on_value("array", nullptr)) {
+      return false;
+    }
+    ++depth_;
+    return true;
   }
 
-  const std::string_view sample_rates_property = "rate_by_service";
-  const auto found = response.find(sample_rates_property);
-  if (found == response.end()) {
-    return CollectorResponse{};
+  bool end_array() override {
+    --depth_;
+    return true;
   }
-  const auto& rates_json = found.value();
-  type = rates_json.type_name();
-  if (type != "object") {
+
+  bool key(string_t& key) override {
+    if (depth_ == 1) {
+      rates_next_ = key == sample_rates_property;
+    } else if (in_rates_ && depth_ == 2) {
+      rate_key_ = std::move(key);
+    }
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&,
+                   const nlohmann::detail::exception& exception) override {
     std::string message;
     message +=
-        "Parsing the Datadog Agent's response to traces we sent it failed.  "
-        "The \"";
-    message += sample_rates_property;
-    message +=
-        "\" property of the response is expected to be a JSON object, but "
-        "instead it's a JSON value with type \"";
-    message += type;
-    message += '\"';
-    message += "\nError occurred for response body (begins on next line):\n";
-    message += body;
-    return message;
+        "Parsing the Datadog Agent's response to traces we sent it failed with "
+        "a JSON error: ";
+    message += exception.what();
+    return fail(std::move(message));
   }
 
-  std::unordered_map<std::string, Rate> sample_rates;
-  for (const auto& [key, value] : rates_json.items()) {
-    type = value.type_name();
-    if (type != "number") {
+ private:
+  // Handle a value of the specified JSON `type`, whose value is `*number` if
+  // it's a number.  Return whether to continue parsing.
+  bool on_value(std::string_view type, const double* number) {
+    if (depth_ == 0) {
+      if (type == "object") {
+        return true;
+      }
+      std::string message;
+      message +=
+          "Parsing the Datadog Agent's response to traces we sent it failed.  "
+          "The response is expected to be a JSON object, but instead it's a "
+          "JSON value with type \"";
+      message += type;
+      message += '\"';
+      return fail(std::move(message));
+    }
+
+    if (rates_next_) {
+      rates_next_ = false;
+      if (type == "object") {
+        return true;
+      }
+      std::string message;
+      message +=
+          "Parsing the Datadog Agent's response to traces we sent it failed.  "
+          "The \"";
+      message += sample_rates_property;
+      message +=
+          "\" property of the response is expected to be a JSON object, but "
+          "instead it's a JSON value with type \"";
+      message += type;
+      message += '\"';
+      return fail(std::move(message));
+    }
+
+    if (!in_rates_ || depth_ != 2) {
+      return true;
+    }
+    if (number == nullptr) {
       std::string message;
       message +=
           "Datadog Agent response to traces included an invalid sample rate "
           "for the key \"";
-      message += key;
+      message += rate_key_;
       message += "\". Rate should be a number, but it's a \"";
       message += type;
       message += "\" instead.";
-      message += "\nError occurred for response body (begins on next line):\n";
-      message += body;
-      return message;
+      return fail(std::move(message));
     }
-    auto maybe_rate = Rate::from(value);
-    if (auto* error = maybe_rate.if_error()) {
+    auto maybe_rate = Rate::from(*number);
+    if (auto* rate_error = maybe_rate.if_error()) {
       std::string message;
       message +=
           "Datadog Agent response trace traces included an invalid sample rate "
           "for the key \"";
-      message += key;
+      message += rate_key_;
       message += "\": ";
-      message += error->message;
-      message += "\nError occurred for response body (begins on next line):\n";
-      message += body;
-      return message;
+      message += rate_error->message;
+      return fail(std::move(message));
+    }
+    response.sample_rate_by_key.insert_or_assign(std::move(rate_key_),
+                                                 *maybe_rate);
+    rate_key_.clear();
+    return true;
+  }
+
+  bool fail(std::string message) {
+    message += "\nError occurred for response body (begins on next line):\n";
+    message += body_;
+    error = std::move(message);
+    return false;
+  }
+};
+
+std::variant<CollectorResponse, std::string> parse_agent_traces_response(
+    std::string_view body) {
+  AgentResponseParser parser{body};
+  if (nlohmann::json::sax_parse(body.begin(), body.end(), &parser)) {
+    return std::move(parser.response);
+  }
+  if (parser.error) {
+    return std::move(*parser.error);
+  }
+  return std::string(
+      "Parsing the Datadog Agent's response to traces we sent it failed.");
+}
+
+// Return the features parsed from the specified `body` of the Datadog Agent's
+// response to "/info", or return an error message if parsing fails.
+std::variant<DatadogAgent::AgentFeatures, std::string> parse_agent_info(
+    std::string_view body) {
+  const auto info = nlohmann::json::parse(body, nullptr, false);
+  if (info.is_discarded() || !info.is_object()) {
+    return std::string(
+        "Parsing the Datadog Agent's response to \"/info\" failed.");
+  }
+  DatadogAgent::AgentFeatures features;
+  const auto endpoints = info.find("endpoints");
+  if (endpoints != info.end() && endpoints->is_array()) {
+    for (const auto& endpoint : *endpoints) {
+      if (!endpoint.is_string()) {
+        continue;
+      }
+      const auto& path = endpoint.get_ref<const std::string&>();
+      if (path == traces_api_path(TraceAPIVersion::V0_5)) {
+        features.v05_traces = true;
+      } else if (path == "/v0.6/stats") {
+        features.stats = true;
+      }
+    }
+  }
+  const auto drop = info.find("client_drop_p0s");
+  features.client_drop_p0s =
+      drop != info.end() && drop->is_boolean() && drop->get<bool>();
+  return features;
+}
+
+// Return a new version for a `CollectorResponse`.  Each distinct response
+// gets a new version, so that a `TraceSampler` can tell that it has already
+// handled a response's rates.
+std::uint64_t next_response_version() {
+  static std::atomic<std::uint64_t> next_version{1};
+  return next_version.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Return the response parsed from the specified `body`.  If `body` is the
+// same as the body most recently parsed using the specified `cache`, then
+// return the cached response instead of parsing again.  Return an error
+// message if parsing fails.
+std::variant<std::shared_ptr<const CollectorResponse>, std::string>
+parse_agent_traces_response(DatadogAgent::ResponseCache& cache,
+                            std::string_view body) {
+  const std::size_t hash = std::hash<std::string_view>{}(body);
+  {
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.response && cache.hash == hash && cache.body == body) {
+      return cache.response;
+    }
+  }
+
+  auto result = parse_agent_traces_response(body);
+  if (auto* error_message = std::get_if<std::string>(&result)) {
+    return std::move(*error_message);
+  }
+  auto response = std::make_shared<CollectorResponse>(
+      std::move(std::get<CollectorResponse>(result)));
+  response->version = next_response_version();
+
+  std::lock_guard<std::mutex> lock(cache.mutex);
+  cache.hash = hash;
+  cache.body = body;
+  cache.response = response;
+  return response;
+}
+
+// Return the Datadog Agent at the specified `url` followed by the specified
+// `replica_urls`, as endpoints among which to distribute requests.
+std::shared_ptr<DatadogAgent::AgentEndpoints> make_endpoints(
+    const HTTPClient::URL& url,
+    const std::vector<HTTPClient::URL>& replica_urls) {
+  auto result = std::make_shared<DatadogAgent::AgentEndpoints>();
+  result->endpoints.push_back(std::make_unique<DatadogAgent::AgentEndpoint>());
+  result->endpoints.back()->url = url;
+  for (const auto& replica_url : replica_urls) {
+    result->endpoints.push_back(
+        std::make_unique<DatadogAgent::AgentEndpoint>());
+    result->endpoints.back()->url = replica_url;
+  }
+  return result;
+}
+
+// Record the specified `response` as the most recent of the specified
+// `endpoint`, and return the most recent responses of the specified
+// `endpoints` merged: each key's rate is the average of the rates that the
+// endpoints gave it.  If there's only one endpoint, then return `response`.
+std::shared_ptr<const CollectorResponse> merge_response(
+    DatadogAgent::AgentEndpoints& endpoints,
+    DatadogAgent::AgentEndpoint& endpoint,
+    std::shared_ptr<const CollectorResponse> response) {
+  if (endpoints.endpoints.size() == 1) {
+    return response;
+  }
+  {
+    std::lock_guard<std::mutex> lock(endpoint.mutex);
+    endpoint.response = std::move(response);
+  }
+
+  std::vector<std::shared_ptr<const CollectorResponse>> responses;
+  std::vector<std::uint64_t> versions;
+  for (const auto& each : endpoints.endpoints) {
+    std::lock_guard<std::mutex> lock(each->mutex);
+    if (each->response) {
+      responses.push_back(each->response);
+      versions.push_back(each->response->version);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(endpoints.mutex);
+  if (endpoints.merged && endpoints.merged_versions == versions) {
+    // The Agents repeated themselves, and so the merge is the same.
+    return endpoints.merged;
+  }
+  std::unordered_map<std::string, std::pair<double, int>> sums;
+  for (const auto& each : responses) {
+    for (const auto& [key, rate] : each->sample_rate_by_key) {
+      auto& [sum, count] = sums[key];
+      sum += rate.value();
+      ++count;
     }
-    sample_rates.emplace(key, *maybe_rate);
   }
-  return CollectorResponse{std::move(sample_rates)};
-} catch (const nlohmann::json::exception& error) {
-  std::string message;
-  message +=
-      "Parsing the Datadog Agent's response to traces we sent it failed with a "
-      "JSON error: ";
-  message += error.what();
-  message += "\nError occurred for response body (begins on next line):\n";
-  message += body;
-  return message;
+  auto merged = std::make_shared<CollectorResponse>();
+  for (const auto& [key, sum_and_count] : sums) {
+    const auto& [sum, count] = sum_and_count;
+    // The average of valid rates is a valid rate.
+    merged->sample_rate_by_key.emplace(key, *Rate::from(sum / count));
+  }
+  merged->version = next_response_version();
+  endpoints.merged = merged;
+  endpoints.merged_versions = std::move(versions);
+  return merged;
+}
+
+// Record that the specified `endpoint` responded without distress.
+void record_success(DatadogAgent::AgentEndpoint& endpoint) {
+  std::lock_guard<std::mutex> lock(endpoint.mutex);
+  endpoint.consecutive_failures = 0;
+}
+
+// Record that the specified `endpoint` failed a request as of the specified
+// `now`, and skip it for the specified `backoff`, doubled for each previous
+// consecutive failure, but for no more than the specified `max_backoff`.
+void record_failure(DatadogAgent::AgentEndpoint& endpoint,
+                    std::chrono::steady_clock::time_point now,
+                    std::chrono::steady_clock::duration backoff,
+                    std::chrono::steady_clock::duration max_backoff) {
+  std::lock_guard<std::mutex> lock(endpoint.mutex);
+  for (int i = 0; i < endpoint.consecutive_failures && backoff < max_backoff;
+       ++i) {
+    backoff *= 2;
+  }
+  ++endpoint.consecutive_failures;
+  endpoint.unhealthy_until = now + std::min(backoff, max_backoff);
 }
 
 }  // namespace
 
 DatadogAgent::DatadogAgent(const FinalizedDatadogAgentConfig& config,
                            const Clock& clock,
-                           const std::shared_ptr<Logger>& logger)
+                           const std::shared_ptr<Logger>& logger,
+                           const SpanDefaults& defaults,
+                           const std::shared_ptr<Metrics>& metrics)
     : clock_(clock),
       logger_(logger),
-      traces_endpoint_(traces_endpoint(config.url)),
+      retry_bytes_(0),
+      encoded_defaults_(defaults),
+      otlp_resource_(defaults),
+      incoming_trace_chunks_(config.max_buffered_spans,
+                             config.max_buffered_bytes,
+                             config.buffer_overflow_policy, &retry_bytes_,
+                             config.buffer_shards),
+      encode_on_send_(config.encode_on_send),
+      incoming_encoded_chunks_(config.max_buffered_spans,
+                               config.max_buffered_bytes,
+                               config.buffer_overflow_policy, &retry_bytes_,
+                               config.buffer_shards),
+      max_buffered_spans_(config.max_buffered_spans),
+      max_buffered_bytes_(config.max_buffered_bytes),
+      buffer_overflow_policy_(config.buffer_overflow_policy),
+      tail_sampler_(config.tail_sampling_enabled
+                        ? std::make_unique<TailSampler>(
+                              config.tail_sampling_window,
+                              config.tail_sampling_max_bytes,
+                              config.tail_sampling_min_duration,
+                              config.tail_sampling_min_spans, metrics)
+                        : nullptr),
+      dropped_traces_(0),
+      dropped_spans_(0),
+      encoded_bytes_per_span_(0),
+      api_version_(config.api_version),
+      max_payload_bytes_(config.max_payload_bytes),
+      compression_(config.compression),
+      compression_level_(config.compression_level),
+      max_retry_attempts_(config.max_retry_attempts),
+      retry_backoff_(config.retry_backoff),
+      max_retry_backoff_(config.max_retry_backoff),
+      failed_requests_(std::make_shared<FailedRequests>()),
+      in_flight_requests_(std::make_shared<InFlightRequests>()),
+      response_counts_(std::make_shared<ResponseCounts>()),
+      retry_jitter_(std::random_device{}()),
+      shared_memory_ring_(config.shared_memory_ring),
+      agent_url_(config.url),
+      endpoints_(make_endpoints(config.url, config.replica_urls)),
+      load_balancing_(config.load_balancing),
+      next_endpoint_(0),
+      stats_(config.stats_computation_enabled ||
+                     (config.agent_discovery_enabled && !config.encode_on_send)
+                 ? std::make_unique<StatsConcentrator>(defaults)
+                 : nullptr),
+      computes_stats_(config.stats_computation_enabled),
+      normalizer_(config.normalize_resources
+                      ? std::make_unique<ResourceNormalizer>(
+                            config.resource_cache_entries)
+                      : nullptr),
+      span_normalizer_(config.normalize_spans
+                           ? std::make_unique<SpanNormalizer>()
+                           : nullptr),
+      encoder_pool_(config.encoder_threads != 0 && !config.encode_on_send &&
+                            (config.api_version != TraceAPIVersion::V0_5 ||
+                             config.agent_discovery_enabled)
+                        ? std::make_unique<WorkerPool>(config.encoder_threads)
+                        : nullptr),
+      stats_endpoint_(stats_endpoint(config.url)),
       http_client_(config.http_client),
       event_scheduler_(config.event_scheduler),
-      cancel_scheduled_flush_(event_scheduler_->schedule_recurring_event(
-          config.flush_interval, [this]() { flush(); })),
-      flush_interval_(config.flush_interval) {
+      flush_interval_(config.flush_interval),
+      randomize_flush_phase_(config.randomize_flush_phase),
+      flush_jitter_(config.flush_jitter),
+      max_flush_backoff_(
+          config.max_flush_interval
+              ? std::size_t(*config.max_flush_interval / config.flush_interval)
+              : 1),
+      flush_backoff_(1),
+      skipped_flushes_(0),
+      flush_threshold_spans_(config.flush_threshold_spans),
+      flush_threshold_bytes_(config.flush_threshold_bytes),
+      early_flush_pending_(config.early_first_flush &&
+                           config.api_version != TraceAPIVersion::OTLP),
+      flush_requested_(false),
+      shutdown_timeout_(config.shutdown_timeout),
+      forking_(false),
+      metrics_(metrics) {
   assert(logger_);
+  assert(metrics_);
+  for (const auto& processor : config.span_processors) {
+    span_processors_.push_back({processor, processor->tags_read()});
+  }
+  // The Agent is asked about its features before the first flush.
+  if (config.agent_discovery_enabled && !config.encode_on_send) {
+    discovered_ = std::make_shared<DiscoveredFeatures>();
+    info_endpoint_ = config.url;
+    info_endpoint_.path += "/info";
+    discover();
+    cancel_discovery_ = event_scheduler_->schedule_recurring_event(
+        config.agent_discovery_interval, [this]() { discover(); });
+  }
+  // The first flush is after a random fraction of the flush interval, if so
+  // configured, so that processes started together don't flush together.
+  auto first_flush = config.flush_interval;
+  if (config.randomize_flush_phase) {
+    std::minstd_rand generator{std::random_device{}()};
+    std::uniform_int_distribution<std::chrono::steady_clock::rep> phase(
+        1, first_flush.count());
+    first_flush = std::chrono::steady_clock::duration(phase(generator));
+  }
+  auto event = event_scheduler_->schedule_jittered_recurring_event(
+      first_flush, config.flush_interval, config.flush_jitter,
+      [this]() { scheduled_flush(); });
+  cancel_scheduled_flush_ = std::move(event.cancel);
+  wake_scheduled_flush_ = std::move(event.wake);
+
+  if (config.health_metrics_enabled || config.runtime_metrics_enabled) {
+    auto dogstatsd = connect_dogstatsd(config.dogstatsd_url);
+    if (auto* error = dogstatsd.if_error()) {
+      logger_->log_error(error->with_prefix(
+          config.health_metrics_enabled ? "Health metrics are disabled: "
+                                        : "Runtime metrics are disabled: "));
+    } else {
+      dogstatsd_ = std::move(*dogstatsd);
+      health_metrics_tags_ = health_metrics_tags(defaults);
+    }
+  }
+  if (dogstatsd_ && config.health_metrics_enabled) {
+    cancel_health_metrics_ = event_scheduler_->schedule_recurring_event(
+        config.health_metrics_interval, [this]() { send_health_metrics(); });
+  }
+  if (dogstatsd_ && config.runtime_metrics_enabled) {
+    runtime_metrics_ = std::make_unique<RuntimeMetrics>();
+    cancel_runtime_metrics_ = event_scheduler_->schedule_recurring_event(
+        config.runtime_metrics_interval, [this]() { send_runtime_metrics(); });
+  }
+  if (config.flush_summary_enabled) {
+    cancel_flush_summary_ = event_scheduler_->schedule_recurring_event(
+        config.flush_summary_interval, [this]() { log_flush_summary(); });
+  }
+
+  for (const auto& mirror_url : config.mirror_urls) {
+    Mirror mirror;
+    mirror.url = mirror_url;
+    mirror.failed_requests = std::make_shared<FailedRequests>();
+    mirrors_.push_back(std::move(mirror));
+  }
+
+  if (config.spool_directory) {
+    auto spool =
+        open_disk_spool(*config.spool_directory, config.spool_max_bytes);
+    if (auto* error = spool.if_error()) {
+      logger_->log_error(error->with_prefix("Disk spooling is disabled: "));
+    } else {
+      spool_ = std::move(*spool);
+    }
+  }
+
+  ForkHandlers handlers;
+  handlers.before_fork = [this]() { forking_.store(true); };
+  handlers.after_fork_in_parent = [this]() { forking_.store(false); };
+  handlers.after_fork_in_child = [this]() { discard_after_fork(); };
+  unregister_fork_handlers_ = register_fork_handlers(std::move(handlers));
 }
 
 DatadogAgent::~DatadogAgent() {
-  const auto deadline = clock_().tick + std::chrono::seconds(2);
+  unregister_fork_handlers_();
+  if (!shutdown_) {
+    shutdown(clock_().tick + shutdown_timeout_);
+  } else {
+    // Send what arrived since `shutdown`.
+    flush(true);
+  }
+  http_client_->drain(shutdown_deadline_);
+  if (cancel_shutdown_deadline_) {
+    cancel_shutdown_deadline_();
+  }
+}
+
+std::shared_future<void> DatadogAgent::shutdown(
+    std::chrono::steady_clock::time_point deadline) {
+  if (shutdown_) {
+    return *shutdown_;
+  }
   cancel_scheduled_flush_();
-  flush();
-  http_client_->drain(deadline);
+  if (cancel_health_metrics_) {
+    cancel_health_metrics_();
+  }
+  if (cancel_runtime_metrics_) {
+    cancel_runtime_metrics_();
+  }
+  if (cancel_flush_summary_) {
+    cancel_flush_summary_();
+  }
+  if (cancel_discovery_) {
+    cancel_discovery_();
+  }
+  shutdown_deadline_ = deadline;
+  std::promise<void> idle;
+  shutdown_ = idle.get_future().share();
+  {
+    std::lock_guard<std::mutex> lock(in_flight_requests_->mutex);
+    in_flight_requests_->idle = std::move(idle);
+  }
+
+  flush(true);
+  if (cancel_health_metrics_) {
+    send_health_metrics();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(in_flight_requests_->mutex);
+    if (in_flight_requests_->count == 0) {
+      notify_idle(*in_flight_requests_);
+    }
+  }
+  const auto now = clock_().tick;
+  if (deadline <= now) {
+    std::lock_guard<std::mutex> lock(in_flight_requests_->mutex);
+    notify_idle(*in_flight_requests_);
+  } else {
+    cancel_shutdown_deadline_ = event_scheduler_->schedule_recurring_event(
+        deadline - now, [in_flight = in_flight_requests_]() {
+          std::lock_guard<std::mutex> lock(in_flight->mutex);
+          notify_idle(*in_flight);
+        });
+  }
+  return *shutdown_;
 }
 
 Expected<void> DatadogAgent::send(
     std::vector<std::unique_ptr<SpanData>>&& spans,
     const std::shared_ptr<TraceSampler>& response_handler) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  incoming_trace_chunks_.push_back(
-      TraceChunk{std::move(spans), response_handler});
+  return send_with_origin(std::move(spans), response_handler, "");
+}
+
+Expected<void> DatadogAgent::send_unsampled(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::optional<std::string_view> origin,
+    const std::shared_ptr<SpanSampler>& span_sampler,
+    std::optional<int> sampling_mechanism) {
+  if (tail_sampler_) {
+    sample_tail(TailSampler::Chunk{std::move(spans), response_handler,
+                                   std::string(origin.value_or("")),
+                                   span_sampler, sampling_mechanism});
+    return std::nullopt;
+  }
+  return accept_unsampled(std::move(spans), response_handler, origin,
+                          span_sampler);
+}
+
+Expected<void> DatadogAgent::send_with_origin(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::string_view origin) {
+  if (tail_sampler_) {
+    sample_tail(TailSampler::Chunk{std::move(spans), response_handler,
+                                   std::string(origin), nullptr,
+                                   std::nullopt});
+    return std::nullopt;
+  }
+  return accept(std::move(spans), response_handler, origin);
+}
+
+void DatadogAgent::sample_tail(TailSampler::Chunk&& chunk) {
+  std::vector<TailSampler::Chunk> released;
+  tail_sampler_->add(std::move(chunk), clock_().tick, released);
+  accept_released(std::move(released));
+}
+
+void DatadogAgent::accept_released(
+    std::vector<TailSampler::Chunk>&& released) {
+  for (auto& chunk : released) {
+    Expected<void> result;
+    if (chunk.span_sampler) {
+      result = accept_unsampled(std::move(chunk.spans), chunk.response_handler,
+                                chunk.origin, chunk.span_sampler);
+    } else {
+      result = accept(std::move(chunk.spans), chunk.response_handler,
+                      chunk.origin);
+    }
+    if (auto* error = result.if_error()) {
+      logger_->log_error(
+          error->with_prefix("Error sending spans held for tail sampling: "));
+    }
+  }
+}
+
+Expected<void> DatadogAgent::accept_unsampled(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::optional<std::string_view> origin,
+    const std::shared_ptr<SpanSampler>& span_sampler) {
+  if (!span_sampler) {
+    return accept(std::move(spans), response_handler, origin.value_or(""));
+  }
+  if (computes_stats_.load(std::memory_order_relaxed) || encode_on_send_) {
+    span_sampler->sample(spans);
+    return accept(std::move(spans), response_handler, origin.value_or(""));
+  }
+  enqueue(std::move(spans), response_handler, origin.value_or(""),
+          span_sampler, false);
+  return std::nullopt;
+}
+
+void DatadogAgent::enqueue(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::string_view origin, const std::shared_ptr<SpanSampler>& span_sampler,
+    bool computed_stats) {
+  const auto estimated_bytes = std::size_t(
+      spans.size() * encoded_bytes_per_span_.load(std::memory_order_relaxed));
+  auto chunk_footprint = footprint(spans, estimated_bytes);
+  metrics_->add(Metrics::TRACE_CHUNKS_ENQUEUED);
+  count_dropped(incoming_trace_chunks_.push(
+      TraceChunk{std::move(spans), response_handler, chunk_footprint,
+                 std::string(origin), span_sampler, computed_stats},
+      buffer_shard()));
+  wake_flush_if_full(incoming_trace_chunks_.spans(),
+                     incoming_trace_chunks_.bytes());
+}
+
+Expected<void> DatadogAgent::accept(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::string_view origin) {
+  // Agent discovery might switch statistics on or off meanwhile, and so the
+  // trace chunk records whether its statistics were computed.
+  const bool computes_stats = computes_stats_.load(std::memory_order_relaxed);
+  if (normalizes() && (computes_stats || encode_on_send_)) {
+    normalize(spans);
+  }
+  if (computes_stats) {
+    // Statistics include all spans, even those that are then dropped.
+    stats_->add(spans, origin);
+    if (drop_unsampled(spans)) {
+      return std::nullopt;
+    }
+  }
+
+  if (!encode_on_send_) {
+    enqueue(std::move(spans), response_handler, origin, nullptr,
+            computes_stats);
+    return std::nullopt;
+  }
+
+  // The spans are destroyed when `chunk_spans` goes out of scope, after they
+  // are encoded.
+  const auto chunk_spans = std::move(spans);
+  symbolize_error_stacks(chunk_spans);
+  Expected<void> result;
+
+  if (api_version_ == TraceAPIVersion::V0_5) {
+    // The string table is shared by all of the trace chunks in the payload, so
+    // encode while holding the lock.
+    // Since trace chunks can't be removed from the table once they're encoded,
+    // only the newest trace chunk can be dropped.
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& encoded = incoming_encoded_;
+    const DroppedTraceChunks dropped{1, chunk_spans.size()};
+    if (max_buffered_spans_ &&
+        encoded.span_count + chunk_spans.size() > *max_buffered_spans_) {
+      count_dropped(dropped);
+      return std::nullopt;
+    }
+    const auto size_before = encoded.traces.size();
+    result = msgpack::pack_array(
+        encoded.traces, chunk_spans,
+        [&](auto& destination, const auto& span_ptr) {
+          assert(span_ptr);
+          return msgpack_encode_v05(destination, *span_ptr, encoded.strings,
+                                    origin);
+        });
+    if (!result) {
+      encoded.traces.resize(size_before);
+      return result;
+    }
+    if (max_buffered_bytes_ &&
+        encoded.traces.size() + retry_bytes_.load(std::memory_order_relaxed) >
+            *max_buffered_bytes_) {
+      encoded.traces.resize(size_before);
+      count_dropped(dropped);
+      return std::nullopt;
+    }
+    metrics_->add(Metrics::TRACE_CHUNKS_ENQUEUED);
+    ++encoded.count;
+    encoded.span_count += chunk_spans.size();
+    encoded.dropped_by_sampling += dropped_by_sampling(chunk_spans);
+    encoded.response_handlers.insert(response_handler);
+    wake_flush_if_full(encoded.span_count, encoded.traces.size());
+    return std::nullopt;
+  }
+
+  // In the "v0.4" and OTLP formats, each trace chunk is encoded
+  // independently.
+  std::string trace;
+  if (api_version_ == TraceAPIVersion::OTLP) {
+    otlp_encode(trace, chunk_spans, otlp_resource_, origin);
+  } else {
+    result = msgpack_encode(trace, chunk_spans, encoded_defaults_, origin);
+    if (!result) {
+      return result;
+    }
+  }
+  auto chunk_footprint = footprint(chunk_spans, trace.size());
+  metrics_->add(Metrics::TRACE_CHUNKS_ENQUEUED);
+  count_dropped(incoming_encoded_chunks_.push(
+      EncodedTraceChunk{std::move(trace), response_handler, chunk_footprint},
+      buffer_shard()));
+  wake_flush_if_full(incoming_encoded_chunks_.spans(),
+                     incoming_encoded_chunks_.bytes());
   return std::nullopt;
 }
 
 nlohmann::json DatadogAgent::config_json() const {
-  const auto& url = traces_endpoint_;  // brevity
+  const auto url = traces_endpoint(agent_url_, api_version_);  // brevity
   const auto flush_interval_milliseconds =
       std::chrono::duration_cast<std::chrono::milliseconds>(flush_interval_)
           .count();
+  const auto flush_jitter_milliseconds =
+      std::chrono::duration_cast<std::chrono::milliseconds>(flush_jitter_)
+          .count();
+  const auto shutdown_timeout_milliseconds =
+      std::chrono::duration_cast<std::chrono::milliseconds>(shutdown_timeout_)
+          .count();
 
   // clang-format off
-  return nlohmann::json::object({
+  auto result = nlohmann::json::object({
     {"type", "datadog::tracing::DatadogAgent"},
     {"config", nlohmann::json::object({
       {"url", (url.scheme + "://" + url.authority + url.path)},
       {"flush_interval_milliseconds", flush_interval_milliseconds},
+      {"randomize_flush_phase", randomize_flush_phase_},
+      {"flush_jitter_milliseconds", flush_jitter_milliseconds},
+      {"api_version", to_string(api_version_)},
+      {"max_payload_bytes", max_payload_bytes_},
+      {"compression", to_string(compression_)},
+      {"max_retry_attempts", max_retry_attempts_},
+      {"stats_computation_enabled", computes_stats_.load()},
+      {"agent_discovery_enabled", bool(discovered_)},
+      {"normalize_resources", bool(normalizer_)},
+      {"normalize_spans", bool(span_normalizer_)},
+      {"encoder_threads", encoder_pool_ ? encoder_pool_->size() : 0},
+      {"health_metrics_enabled", bool(cancel_health_metrics_)},
+      {"runtime_metrics_enabled", bool(runtime_metrics_)},
+      {"flush_summary_enabled", bool(cancel_flush_summary_)},
+      {"spooling_enabled", bool(spool_)},
+      {"buffer_overflow_policy", to_string(buffer_overflow_policy_)},
+      {"buffer_shards", incoming_trace_chunks_.shards()},
+      {"shutdown_timeout_milliseconds", shutdown_timeout_milliseconds},
       {"http_client", http_client_->config_json()},
       {"event_scheduler", event_scheduler_->config_json()},
     })},
   });
   // clang-format on
+  if (max_buffered_spans_) {
+    result["config"]["max_buffered_spans"] = *max_buffered_spans_;
+  }
+  if (max_buffered_bytes_) {
+    result["config"]["max_buffered_bytes"] = *max_buffered_bytes_;
+  }
+  if (shared_memory_ring_) {
+    result["config"]["shared_memory_ring"] = nlohmann::json::object({
+        {"max_processes", shared_memory_ring_->max_processes()},
+        {"buffer_bytes", shared_memory_ring_->buffer_bytes()},
+    });
+  }
+  if (!mirrors_.empty()) {
+    auto& mirror_urls = result["config"]["mirror_urls"];
+    mirror_urls = nlohmann::json::array();
+    for (const Mirror& mirror : mirrors_) {
+      const auto mirror_url = traces_endpoint(mirror.url, api_version_);
+      mirror_urls.push_back(mirror_url.scheme + "://" + mirror_url.authority +
+                            mirror_url.path);
+    }
+  }
+  if (endpoints_->endpoints.size() > 1) {
+    auto& replica_urls = result["config"]["replica_urls"];
+    replica_urls = nlohmann::json::array();
+    for (std::size_t i = 1; i < endpoints_->endpoints.size(); ++i) {
+      const auto replica_url =
+          traces_endpoint(endpoints_->endpoints[i]->url, api_version_);
+      replica_urls.push_back(replica_url.scheme + "://" +
+                             replica_url.authority + replica_url.path);
+    }
+    result["config"]["load_balancing"] = to_string(load_balancing_);
+  }
+  if (flush_threshold_spans_) {
+    result["config"]["flush_threshold_spans"] = *flush_threshold_spans_;
+  }
+  if (flush_threshold_bytes_) {
+    result["config"]["flush_threshold_bytes"] = *flush_threshold_bytes_;
+  }
+  if (tail_sampler_) {
+    result["config"]["tail_sampling"] = tail_sampler_->config_json();
+  }
+  if (!span_processors_.empty()) {
+    auto& processors = result["config"]["span_processors"];
+    processors = nlohmann::json::array();
+    for (const auto& configured : span_processors_) {
+      processors.push_back(configured.processor->config_json());
+    }
+  }
+  if (max_flush_backoff_ > 1) {
+    result["config"]["max_flush_interval_milliseconds"] =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            flush_interval_ * max_flush_backoff_)
+            .count();
+  }
+  return result;
 }
 
-void DatadogAgent::flush() {
-  outgoing_trace_chunks_.clear();
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    using std::swap;
-    swap(incoming_trace_chunks_, outgoing_trace_chunks_);
-  }
+const std::shared_ptr<Metrics>& DatadogAgent::metrics() const {
+  return metrics_;
+}
 
-  if (outgoing_trace_chunks_.empty()) {
-    return;
+Expected<void> DatadogAgent::flush(
+    std::chrono::steady_clock::time_point deadline) {
+  flush(true);
+  http_client_->drain(deadline);
+
+  std::lock_guard<std::mutex> lock(in_flight_requests_->mutex);
+  if (in_flight_requests_->count != 0) {
+    std::string message;
+    message += "Flush timed out with ";
+    message += std::to_string(in_flight_requests_->count);
+    message += " request(s) to the Datadog Agent still in flight.";
+    return Error{Error::FLUSH_TIMEOUT, std::move(message)};
   }
+  return std::nullopt;
+}
 
-  std::string body;
-  auto encode_result = msgpack_encode(body, outgoing_trace_chunks_);
-  if (auto* error = encode_result.if_error()) {
-    logger_->log_error(*error);
+void DatadogAgent::flush(bool all_stats) {
+  std::lock_guard<std::mutex> lock(flush_mutex_);
+  if (forking_.load()) {
     return;
   }
+  const auto start = clock_().tick;
+  send_buffered(all_stats);
+  metrics_->record(Metrics::FLUSH_DURATION, clock_().tick - start);
+  update_buffer_gauges();
+}
 
-  // One HTTP request to the Agent could possibly involve trace chunks from
-  // multiple tracers, and thus multiple trace samplers might need to have
-  // their rates updated. Unlikely, but possible.
-  std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+void DatadogAgent::scheduled_flush() {
+  if (max_flush_backoff_ > 1) {
+    std::unique_lock<std::mutex> lock(flush_mutex_);
+    // The interval doubles after distress, and halves after success.
+    auto& counts = *response_counts_;
+    if (counts.distressed.exchange(0, std::memory_order_relaxed) != 0) {
+      counts.succeeded.store(0, std::memory_order_relaxed);
+      flush_backoff_ = std::min(flush_backoff_ * 2, max_flush_backoff_);
+    } else if (counts.succeeded.exchange(0, std::memory_order_relaxed) != 0) {
+      flush_backoff_ = std::max(flush_backoff_ / 2, std::size_t(1));
+    }
+    // A flush that was woken by a flush threshold, or that would fill a
+    // request, happens regardless, so that the buffers don't grow while the
+    // interval is lengthened.
+    if (++skipped_flushes_ < flush_backoff_ &&
+        !flush_requested_.load(std::memory_order_relaxed) &&
+        buffered_bytes() < max_payload_bytes_) {
+      return;
+    }
+    skipped_flushes_ = 0;
+  }
+  flush();
+}
+
+void DatadogAgent::send_buffered(bool all_stats) {
+  // The trace chunks whose tail sampling window has elapsed, or all of them
+  // if the flush is explicit, are buffered as though they were just sent.
+  if (tail_sampler_) {
+    std::vector<TailSampler::Chunk> released;
+    tail_sampler_->release(clock_().tick, all_stats, released);
+    accept_released(std::move(released));
+  }
+  // Chunks sent from now on are not included in this flush, and so might need
+  // to wake the next one.
+  flush_requested_.store(false, std::memory_order_relaxed);
+  if (discovered_) {
+    apply_discovered_features();
+  }
+  retry_failed_requests();
+  if (stats_) {
+    // If statistics are no longer computed, then send what remains of them.
+    flush_stats(all_stats || !computes_stats_.load(std::memory_order_relaxed));
+  }
+  if (shared_memory_ring_) {
+    flush_shared_memory_ring();
+  }
+  if (encode_on_send_) {
+    flush_encoded();
+    return;
+  }
+
+  const auto swap_start = clock_().tick;
+  outgoing_trace_chunks_ = incoming_trace_chunks_.take();
+  metrics_->record(Metrics::FLUSH_SWAP_DURATION, clock_().tick - swap_start);
+
+  if (outgoing_trace_chunks_.empty()) {
+    return;
+  }
+  // Span sampling of dropped traces was deferred until now (see
+  // `send_unsampled`).
   for (auto& chunk : outgoing_trace_chunks_) {
-    response_handlers.insert(std::move(chunk.response_handler));
+    if (chunk.span_sampler) {
+      chunk.span_sampler->sample(chunk.spans);
+      chunk.span_sampler.reset();
+    }
+  }
+  if (!span_processors_.empty()) {
+    process_spans();
+    if (outgoing_trace_chunks_.empty()) {
+      return;
+    }
   }
 
-  // This is the callback for setting request headers.
-  // It's invoked synchronously (before `post` returns).
-  auto set_request_headers = [this](DictWriter& headers) {
+  std::size_t span_count = 0;
+  for (const auto& chunk : outgoing_trace_chunks_) {
+    span_count += chunk.spans.size();
+  }
+
+  // Large flushes are divided into tasks of consecutive trace chunks, several
+  // per encoder thread, whose payloads are then sent in order.
+  const auto encode_start = clock_().tick;
+  double bytes_per_span_estimate = encoded_bytes_per_span_;
+  const std::size_t chunk_count = outgoing_trace_chunks_.size();
+  std::size_t tasks = 1;
+  if (encoder_pool_ && api_version_ != TraceAPIVersion::V0_5) {
+    tasks = std::min(chunk_count / min_chunks_per_encoder_task,
+                     4 * (encoder_pool_->size() + 1));
+  }
+  std::vector<EncodedTraceChunks> payloads;
+  if (tasks <= 1) {
+    auto result =
+        encode_chunks(0, chunk_count, bytes_per_span_estimate, payloads);
+    if (auto* error = result.if_error()) {
+      logger_->log_error(*error);
+      return;
+    }
+  } else {
+    std::vector<std::vector<EncodedTraceChunks>> task_payloads(tasks);
+    std::vector<Expected<void>> task_results(tasks);
+    encoder_pool_->run(tasks, [&](std::size_t task) {
+      task_results[task] =
+          encode_chunks(chunk_count * task / tasks,
+                        chunk_count * (task + 1) / tasks,
+                        bytes_per_span_estimate, task_payloads[task]);
+    });
+    for (std::size_t task = 0; task < tasks; ++task) {
+      if (auto* error = task_results[task].if_error()) {
+        logger_->log_error(*error);
+        return;
+      }
+      for (auto& payload : task_payloads[task]) {
+        payloads.push_back(std::move(payload));
+      }
+    }
+  }
+  metrics_->record(Metrics::FLUSH_ENCODE_DURATION,
+                   clock_().tick - encode_start);
+
+  // One HTTP request to the Agent could possibly involve trace chunks from
+  // multiple tracers, and thus multiple trace samplers might need to have
+  // their rates updated. Unlikely, but possible.  Each sampler is given the
+  // response to only one of the requests.  Consecutive payloads are combined
+  // into one request while they fit within the limit, which happens only
+  // when tasks end with small payloads.  The chunks' string tables make
+  // "v0.5" payloads impossible to combine, and a request's trace chunks must
+  // agree on whether their statistics were computed.
+  std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+  std::size_t encoded_bytes = 0;
+  std::vector<EncodedTraceChunks> request;
+  std::size_t request_bytes = 0;
+  for (auto& payload : payloads) {
+    if (!request.empty() &&
+        (api_version_ == TraceAPIVersion::V0_5 ||
+         request_bytes + payload.traces.size() > max_payload_bytes_ ||
+         payload.computed_stats != request.front().computed_stats)) {
+      post(std::move(request));
+      request.clear();
+      request_bytes = 0;
+    }
+    std::unordered_set<std::shared_ptr<TraceSampler>> handlers;
+    for (const auto& handler : payload.response_handlers) {
+      if (response_handlers.insert(handler).second) {
+        handlers.insert(handler);
+      }
+    }
+    payload.response_handlers = std::move(handlers);
+    encoded_bytes += payload.traces.size();
+    request_bytes += payload.traces.size();
+    request.push_back(std::move(payload));
+  }
+  if (!request.empty()) {
+    post(std::move(request));
+  }
+
+  if (span_count != 0) {
+    const double bytes_per_span = double(encoded_bytes) / span_count;
+    if (bytes_per_span_estimate == 0) {
+      bytes_per_span_estimate = bytes_per_span;
+    } else {
+      bytes_per_span_estimate =
+          0.75 * bytes_per_span_estimate + 0.25 * bytes_per_span;
+    }
+    encoded_bytes_per_span_ = bytes_per_span_estimate;
+  }
+}
+
+Expected<void> DatadogAgent::encode_chunks(
+    std::size_t begin, std::size_t end, double bytes_per_span,
+    std::vector<EncodedTraceChunks>& payloads) {
+  // Reserve enough of each payload for its estimated size, plus some room for
+  // error, so that encoding typically allocates only once.
+  std::size_t span_count = 0;
+  for (std::size_t i = begin; i < end; ++i) {
+    span_count += outgoing_trace_chunks_[i].spans.size();
+  }
+  std::size_t remaining_estimate =
+      std::size_t(span_count * bytes_per_span * 1.25);
+  const auto reserve = [&](EncodedTraceChunks& payload) {
+    payload.traces.reserve(std::min(remaining_estimate, max_payload_bytes_));
+  };
+
+  EncodedTraceChunks payload;
+  reserve(payload);
+  for (std::size_t i = begin; i < end; ++i) {
+    auto& chunk = outgoing_trace_chunks_[i];
+    if (payload.count != 0 && chunk.computed_stats != payload.computed_stats) {
+      payloads.push_back(std::move(payload));
+      payload = EncodedTraceChunks{};
+      reserve(payload);
+    }
+    payload.api_version = api_version_;
+    payload.computed_stats = chunk.computed_stats;
+    if (normalizes() && !chunk.computed_stats) {
+      normalize(chunk.spans);
+    }
+    symbolize_error_stacks(chunk.spans);
+    Expected<void> result;
+    if (api_version_ == TraceAPIVersion::V0_5) {
+      result = msgpack::pack_array(
+          payload.traces, chunk.spans,
+          [&](auto& destination, const auto& span_ptr) {
+            assert(span_ptr);
+            return msgpack_encode_v05(destination, *span_ptr, payload.strings,
+                                      chunk.origin);
+          });
+    } else if (api_version_ == TraceAPIVersion::OTLP) {
+      otlp_encode(payload.traces, chunk.spans, otlp_resource_, chunk.origin);
+    } else {
+      result = msgpack_encode(payload.traces, chunk.spans, encoded_defaults_,
+                              chunk.origin);
+    }
+    if (auto* error = result.if_error()) {
+      return std::move(*error);
+    }
+    ++payload.count;
+    payload.span_count += chunk.spans.size();
+    payload.dropped_by_sampling += chunk.footprint.dropped_by_sampling;
+    payload.response_handlers.insert(std::move(chunk.response_handler));
+
+    // Payloads are split between trace chunks, once they reach the limit.
+    if (payload.traces.size() >= max_payload_bytes_) {
+      remaining_estimate -= std::min(remaining_estimate, payload.traces.size());
+      payloads.push_back(std::move(payload));
+      payload = EncodedTraceChunks{};
+      reserve(payload);
+    }
+  }
+  if (payload.count != 0) {
+    payloads.push_back(std::move(payload));
+  }
+  return std::nullopt;
+}
+
+void DatadogAgent::discard_after_fork() {
+  std::lock_guard<std::mutex> lock(flush_mutex_);
+  (void)incoming_trace_chunks_.take();
+  (void)incoming_encoded_chunks_.take();
+  {
+    std::lock_guard<std::mutex> encoded_lock(mutex_);
+    incoming_encoded_ = EncodedTraceChunks{};
+  }
+  outgoing_trace_chunks_.clear();
+  if (tail_sampler_) {
+    tail_sampler_->clear();
+  }
+  retries_.clear();
+  metrics_->decrease(Metrics::PAYLOAD_BYTES, retry_bytes_.exchange(0));
+  for (Mirror& mirror : mirrors_) {
+    mirror.retries.clear();
+    mirror.retry_bytes = 0;
+    mirror.failed_requests = std::make_shared<FailedRequests>();
+  }
+  // The parent's segment files are shared with the child, and so the child
+  // must not write to them.  The parent drains the shared memory ring.
+  spool_.reset();
+  shared_memory_ring_.reset();
+  dropped_traces_ = 0;
+  dropped_spans_ = 0;
+  if (stats_) {
+    std::string discarded;
+    (void)stats_->flush(discarded, clock_().wall, true);
+  }
+  // The parent's requests might still complete in the child, depending on the
+  // HTTP client, and so their handlers keep the old shared state.
+  failed_requests_ = std::make_shared<FailedRequests>();
+  in_flight_requests_ = std::make_shared<InFlightRequests>();
+  response_counts_ = std::make_shared<ResponseCounts>();
+  std::vector<HTTPClient::URL> replica_urls;
+  for (std::size_t i = 1; i < endpoints_->endpoints.size(); ++i) {
+    replica_urls.push_back(endpoints_->endpoints[i]->url);
+  }
+  endpoints_ = make_endpoints(agent_url_, replica_urls);
+  forking_.store(false);
+}
+
+void DatadogAgent::flush_shared_memory_ring() {
+  // The trace chunks are already encoded in the "v0.4" format, and so they're
+  // copied into payloads as they're read.
+  const bool computed_stats = computes_stats_.load(std::memory_order_relaxed);
+  EncodedTraceChunks payload;
+  payload.computed_stats = computed_stats;
+  const auto dropped = shared_memory_ring_->drain(
+      [&](std::string_view chunk, std::size_t span_count) {
+        if (payload.count != 0 &&
+            payload.traces.size() + chunk.size() > max_payload_bytes_) {
+          post(std::move(payload));
+          payload = EncodedTraceChunks{};
+          payload.computed_stats = computed_stats;
+        }
+        payload.traces += chunk;
+        ++payload.count;
+        payload.span_count += span_count;
+      });
+  count_dropped(dropped);
+  if (payload.count != 0) {
+    post(std::move(payload));
+  }
+}
+
+void DatadogAgent::flush_encoded() {
+  const auto swap_start = clock_().tick;
+  if (api_version_ != TraceAPIVersion::V0_5) {
+    std::vector<EncodedTraceChunk> chunks = incoming_encoded_chunks_.take();
+    metrics_->record(Metrics::FLUSH_SWAP_DURATION, clock_().tick - swap_start);
+    std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+    EncodedTraceChunks payload;
+    payload.api_version = api_version_;
+    payload.computed_stats = computes_stats_.load();
+    for (auto& chunk : chunks) {
+      if (payload.count != 0 &&
+          payload.traces.size() + chunk.trace.size() > max_payload_bytes_) {
+        post(std::move(payload));
+        payload = EncodedTraceChunks{};
+        payload.api_version = api_version_;
+        payload.computed_stats = computes_stats_.load();
+      }
+      payload.traces += chunk.trace;
+      ++payload.count;
+      payload.span_count += chunk.footprint.spans;
+      payload.dropped_by_sampling += chunk.footprint.dropped_by_sampling;
+      if (response_handlers.insert(chunk.response_handler).second) {
+        payload.response_handlers.insert(std::move(chunk.response_handler));
+      }
+    }
+    if (payload.count != 0) {
+      post(std::move(payload));
+    }
+    return;
+  }
+
+  // The trace chunks share a string table, and so can't be split into
+  // multiple payloads.  Swap in a fresh buffer, reserved to the size of the
+  // previous one.
+  EncodedTraceChunks outgoing;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (incoming_encoded_.count == 0) {
+      return;
+    }
+    outgoing.traces.reserve(incoming_encoded_.traces.size());
+    using std::swap;
+    swap(incoming_encoded_, outgoing);
+  }
+  metrics_->record(Metrics::FLUSH_SWAP_DURATION, clock_().tick - swap_start);
+  outgoing.api_version = TraceAPIVersion::V0_5;
+  outgoing.computed_stats = computes_stats_.load();
+  post(std::move(outgoing));
+}
+
+void DatadogAgent::post(EncodedTraceChunks&& payload) {
+  std::vector<EncodedTraceChunks> parts;
+  parts.push_back(std::move(payload));
+  post(std::move(parts));
+}
+
+void DatadogAgent::post(std::vector<EncodedTraceChunks>&& parts) {
+  // The body is the header, which is followed by the already encoded traces.
+  // They're sent as separate buffers, so that the traces aren't copied.
+  const auto build_start = clock_().tick;
+  std::size_t count = 0;
+  std::size_t span_count = 0;
+  std::size_t dropped_by_sampling = 0;
+  std::size_t traces_size = 0;
+  for (const auto& part : parts) {
+    count += part.count;
+    span_count += part.span_count;
+    dropped_by_sampling += part.dropped_by_sampling;
+    traces_size += part.traces.size();
+  }
+  const auto api_version = parts.front().api_version;
+  std::string header;
+  if (api_version == TraceAPIVersion::OTLP) {
+    otlp_encode_header(header, otlp_resource_, traces_size);
+  } else {
+    if (api_version == TraceAPIVersion::V0_5) {
+      msgpack::pack_array(header, 2);
+      auto result = parts.front().strings.msgpack_encode(header);
+      if (auto* error = result.if_error()) {
+        logger_->log_error(*error);
+        return;
+      }
+    }
+    msgpack::pack_array(header, count);
+  }
+  metrics_->add(Metrics::BYTES_ENCODED, header.size() + traces_size);
+
+  Request request;
+  request.api_version = api_version;
+  request.computed_stats = parts.front().computed_stats;
+  // If compression fails, send the body uncompressed.
+  if (compression_ == PayloadCompression::GZIP) {
+    std::string compressed;
+    header.reserve(header.size() + traces_size);
+    for (const auto& part : parts) {
+      header += part.traces;
+    }
+    auto result = gzip_compress(compressed, header, compression_level_);
+    if (auto* error = result.if_error()) {
+      logger_->log_error(*error);
+      request.body_size = header.size();
+      request.body.push_back(
+          std::make_shared<const std::string>(std::move(header)));
+    } else {
+      request.compressed = true;
+      request.body_size = compressed.size();
+      request.body.push_back(
+          std::make_shared<const std::string>(std::move(compressed)));
+    }
+  } else {
+    request.body_size = header.size() + traces_size;
+    request.body.push_back(
+        std::make_shared<const std::string>(std::move(header)));
+    for (auto& part : parts) {
+      request.body.push_back(
+          std::make_shared<const std::string>(std::move(part.traces)));
+    }
+  }
+  request.trace_count = count;
+  request.span_count = span_count;
+  request.dropped_by_sampling = dropped_by_sampling == count;
+  for (auto& part : parts) {
+    request.response_handlers.merge(part.response_handlers);
+  }
+  metrics_->record(Metrics::REQUEST_BYTES, request.body_size);
+  metrics_->record(Metrics::REQUEST_TRACE_CHUNKS, count);
+  if (!mirrors_.empty()) {
+    post_to_mirrors(request);
+  }
+  post(std::move(request), build_start);
+}
+
+void DatadogAgent::retry_failed_requests() {
+  std::vector<Request> failed;
+  {
+    std::lock_guard<std::mutex> lock(failed_requests_->mutex);
+    failed.swap(failed_requests_->requests);
+  }
+
+  const auto now = clock_().tick;
+  for (Mirror& mirror : mirrors_) {
+    retry_failed_requests(mirror, now);
+  }
+
+  for (auto& request : failed) {
+    // Requests are retained after their last attempt only to be spooled.
+    if (request.attempts > max_retry_attempts_) {
+      if (spool_) {
+        spool(std::move(request));
+      }
+      continue;
+    }
+    request.retry_at = retry_time(request.attempts, now);
+    retry_bytes_.fetch_add(request.body_size, std::memory_order_relaxed);
+    metrics_->increase(Metrics::PAYLOAD_BYTES, request.body_size);
+    retries_.push_back(std::move(request));
+  }
+
+  // Drop or spool the oldest retries until they fit within the byte limit,
+  // which they share with the buffered trace chunks.  Requests containing
+  // only traces dropped by sampling go first.
+  std::size_t limit = max_payload_bytes_;
+  if (max_buffered_bytes_) {
+    const auto buffered = buffered_bytes();
+    limit = *max_buffered_bytes_ - std::min(buffered, *max_buffered_bytes_);
+  }
+  for (const bool only_dropped_by_sampling : {true, false}) {
+    for (auto iter = retries_.begin();
+         iter != retries_.end() &&
+         retry_bytes_.load(std::memory_order_relaxed) > limit;) {
+      if (only_dropped_by_sampling && !iter->dropped_by_sampling) {
+        ++iter;
+        continue;
+      }
+      retry_bytes_.fetch_sub(iter->body_size, std::memory_order_relaxed);
+      metrics_->decrease(Metrics::PAYLOAD_BYTES, iter->body_size);
+      Request oldest = std::move(*iter);
+      iter = retries_.erase(iter);
+      if (spool_) {
+        spool(std::move(oldest));
+      } else {
+        count_dropped(
+            DroppedTraceChunks{oldest.trace_count, oldest.span_count});
+      }
+    }
+  }
+
+  // Retry the requests whose backoff has elapsed, those containing traces
+  // kept by sampling first.
+  for (const bool only_kept : {true, false}) {
+    for (auto iter = retries_.begin(); iter != retries_.end();) {
+      if (iter->retry_at > now || (only_kept && iter->dropped_by_sampling)) {
+        ++iter;
+        continue;
+      }
+      retry_bytes_.fetch_sub(iter->body_size, std::memory_order_relaxed);
+      metrics_->decrease(Metrics::PAYLOAD_BYTES, iter->body_size);
+      Request request = std::move(*iter);
+      iter = retries_.erase(iter);
+      post(std::move(request));
+    }
+  }
+
+  // The Datadog Agent is presumed healthy once no requests are failing.
+  if (spool_ && failed.empty() && retries_.empty()) {
+    replay_spooled();
+  }
+}
+
+void DatadogAgent::retry_failed_requests(
+    Mirror& mirror, std::chrono::steady_clock::time_point now) {
+  std::vector<Request> failed;
+  {
+    std::lock_guard<std::mutex> lock(mirror.failed_requests->mutex);
+    failed.swap(mirror.failed_requests->requests);
+  }
+  for (auto& request : failed) {
+    request.retry_at = retry_time(request.attempts, now);
+    mirror.retry_bytes += request.body_size;
+    mirror.retries.push_back(std::move(request));
+  }
+
+  // A mirror's retries don't count against the buffer's byte limit, since
+  // they're not the only copy of their traces, but they're limited to
+  // `max_payload_bytes_`.  Requests containing only traces dropped by
+  // sampling are dropped first.
+  for (const bool only_dropped_by_sampling : {true, false}) {
+    for (auto iter = mirror.retries.begin();
+         iter != mirror.retries.end() &&
+         mirror.retry_bytes > max_payload_bytes_;) {
+      if (only_dropped_by_sampling && !iter->dropped_by_sampling) {
+        ++iter;
+        continue;
+      }
+      mirror.retry_bytes -= iter->body_size;
+      iter = mirror.retries.erase(iter);
+      metrics_->add(Metrics::MIRROR_REQUESTS_DROPPED);
+    }
+  }
+
+  for (auto iter = mirror.retries.begin(); iter != mirror.retries.end();) {
+    if (iter->retry_at > now) {
+      ++iter;
+      continue;
+    }
+    mirror.retry_bytes -= iter->body_size;
+    Request request = std::move(*iter);
+    iter = mirror.retries.erase(iter);
+    post(mirror, std::move(request));
+  }
+}
+
+std::chrono::steady_clock::time_point DatadogAgent::retry_time(
+    int attempts, std::chrono::steady_clock::time_point now) {
+  // The backoff doubles with each attempt, and then is randomly shortened by
+  // up to half.
+  std::uniform_real_distribution<double> jitter(0.5, 1.0);
+  auto backoff = retry_backoff_;
+  for (int i = 1; i < attempts && backoff < max_retry_backoff_; ++i) {
+    backoff *= 2;
+  }
+  backoff = std::min(backoff, max_retry_backoff_);
+  return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   backoff * jitter(retry_jitter_));
+}
+
+void DatadogAgent::spool(Request&& request) {
+  DroppedTraceChunks dropped;
+  if (spool_->append(request.body, request.body_size, request.compressed,
+                     request.api_version, request.computed_stats,
+                     request.trace_count, request.span_count, dropped)) {
+    metrics_->add(Metrics::REQUESTS_SPOOLED);
+  } else {
+    dropped.traces += request.trace_count;
+    dropped.spans += request.span_count;
+  }
+  count_dropped(dropped);
+}
+
+void DatadogAgent::replay_spooled() {
+  std::size_t bytes = 0;
+  while (bytes < max_payload_bytes_) {
+    auto spooled = spool_->take();
+    if (!spooled) {
+      return;
+    }
+    Request request;
+    request.body_size = spooled->body.size();
+    request.compressed = spooled->compressed;
+    request.api_version = spooled->api_version;
+    request.computed_stats = spooled->computed_stats;
+    request.trace_count = spooled->trace_count;
+    request.span_count = spooled->span_count;
+    request.body.push_back(
+        std::make_shared<const std::string>(std::move(spooled->body)));
+    bytes += request.body_size;
+    metrics_->add(Metrics::REQUESTS_REPLAYED);
+    post(std::move(request));
+  }
+}
+
+std::size_t DatadogAgent::buffered_bytes() {
+  std::size_t bytes =
+      incoming_trace_chunks_.bytes() + incoming_encoded_chunks_.bytes();
+  if (encode_on_send_ && api_version_ == TraceAPIVersion::V0_5) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes += incoming_encoded_.traces.size();
+  }
+  return bytes;
+}
+
+std::size_t DatadogAgent::buffer_shard() const {
+  return incoming_trace_chunks_.shards() > 1 ? current_numa_node() : 0;
+}
+
+void DatadogAgent::wake_flush_if_full(std::size_t spans, std::size_t bytes) {
+  metrics_->set(Metrics::BUFFERED_SPANS, spans);
+  metrics_->set(Metrics::BUFFERED_BYTES, bytes);
+  if (!wake_scheduled_flush_) {
+    return;
+  }
+  const bool full =
+      (flush_threshold_spans_ && spans >= *flush_threshold_spans_) ||
+      (flush_threshold_bytes_ && bytes >= *flush_threshold_bytes_);
+  // The first trace chunk wakes the first flush, if so configured, so that
+  // the Agent's sample rates arrive without waiting a whole interval.
+  const bool first =
+      spans != 0 && early_flush_pending_.load(std::memory_order_relaxed) &&
+      early_flush_pending_.exchange(false, std::memory_order_relaxed);
+  if (!(full || first) ||
+      flush_requested_.exchange(true, std::memory_order_relaxed)) {
+    return;
+  }
+  wake_scheduled_flush_();
+}
+
+void DatadogAgent::update_buffer_gauges() {
+  std::size_t spans =
+      incoming_trace_chunks_.spans() + incoming_encoded_chunks_.spans();
+  if (encode_on_send_ && api_version_ == TraceAPIVersion::V0_5) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans += incoming_encoded_.span_count;
+  }
+  metrics_->set(Metrics::BUFFERED_SPANS, spans);
+  metrics_->set(Metrics::BUFFERED_BYTES, buffered_bytes());
+}
+
+void DatadogAgent::send_health_metrics() {
+  const MetricsSnapshot current = metrics_->snapshot();
+  const MetricsSnapshot& previous = reported_metrics_;
+  const auto& tags = health_metrics_tags_;
+  // Counters are sent as their increase since the previous report, and only
+  // if they increased.
+  const auto count = [&](std::string_view name, std::uint64_t now,
+                         std::uint64_t before) {
+    if (now > before) {
+      dogstatsd_->count(name, now - before, tags);
+    }
+  };
+  count("datadog.tracer.spans.created", current.spans_created,
+        previous.spans_created);
+  count("datadog.tracer.spans.finished", current.spans_finished,
+        previous.spans_finished);
+  count("datadog.tracer.spans.dropped", current.spans_dropped,
+        previous.spans_dropped);
+  count("datadog.tracer.spans.filtered", current.spans_filtered,
+        previous.spans_filtered);
+  count("datadog.tracer.spans.collapsed", current.spans_collapsed,
+        previous.spans_collapsed);
+  count("datadog.tracer.spans.compacted", current.spans_compacted,
+        previous.spans_compacted);
+  count("datadog.tracer.trace_chunks.finished", current.trace_chunks_finished,
+        previous.trace_chunks_finished);
+  count("datadog.tracer.trace_chunks.enqueued", current.trace_chunks_enqueued,
+        previous.trace_chunks_enqueued);
+  count("datadog.tracer.trace_chunks.dropped", current.trace_chunks_dropped,
+        previous.trace_chunks_dropped);
+  count("datadog.tracer.bytes_encoded", current.bytes_encoded,
+        previous.bytes_encoded);
+  count("datadog.tracer.http.requests", current.http_requests,
+        previous.http_requests);
+  count("datadog.tracer.http.errors", current.http_errors,
+        previous.http_errors);
+  count("datadog.tracer.flushes", current.flush_duration.count,
+        previous.flush_duration.count);
+  count("datadog.tracer.memory_budget.partial_flushes",
+        current.memory_budget_partial_flushes,
+        previous.memory_budget_partial_flushes);
+  count("datadog.tracer.memory_budget.trace_chunks_dropped",
+        current.memory_budget_trace_chunks_dropped,
+        previous.memory_budget_trace_chunks_dropped);
+  count("datadog.tracer.memory_budget.tags_stripped",
+        current.memory_budget_tags_stripped,
+        previous.memory_budget_tags_stripped);
+  count("datadog.tracer.quota.trace_chunks_dropped",
+        current.quota_trace_chunks_dropped,
+        previous.quota_trace_chunks_dropped);
+  count("datadog.tracer.quota.spans_dropped", current.quota_spans_dropped,
+        previous.quota_spans_dropped);
+  count("datadog.tracer.spool.requests_spooled", current.requests_spooled,
+        previous.requests_spooled);
+  count("datadog.tracer.spool.requests_replayed", current.requests_replayed,
+        previous.requests_replayed);
+  count("datadog.tracer.mirror.requests_dropped",
+        current.mirror_requests_dropped, previous.mirror_requests_dropped);
+  count("datadog.tracer.tail_sampling.traces_kept",
+        current.tail_sampling_traces_kept, previous.tail_sampling_traces_kept);
+  count("datadog.tracer.tail_sampling.overflows",
+        current.tail_sampling_overflows, previous.tail_sampling_overflows);
+  dogstatsd_->gauge("datadog.tracer.buffer.spans", current.buffered_spans,
+                    tags);
+  dogstatsd_->gauge("datadog.tracer.buffer.bytes", current.buffered_bytes,
+                    tags);
+  dogstatsd_->gauge("datadog.tracer.memory.bytes", current.memory_bytes(),
+                    tags);
+  // The flush duration is sent as the mean of the interval's flushes.
+  const auto flushes =
+      current.flush_duration.count - previous.flush_duration.count;
+  if (flushes != 0) {
+    const auto total = current.flush_duration.sum - previous.flush_duration.sum;
+    dogstatsd_->gauge(
+        "datadog.tracer.flush.duration_us",
+        std::chrono::duration_cast<std::chrono::microseconds>(total).count() /
+            flushes,
+        tags);
+  }
+  dogstatsd_->flush();
+  reported_metrics_ = current;
+}
+
+void DatadogAgent::send_runtime_metrics() {
+  const auto current = runtime_metrics_->sample();
+  if (!current) {
+    return;
+  }
+  const auto& tags = health_metrics_tags_;
+  // CPU time is sent as its increase since the previous sample, and so isn't
+  // sent for the first sample, nor for the first sample in the child after
+  // `fork`, whose CPU time starts over.
+  const auto count = [&](std::string_view name, std::uint64_t now,
+                         std::uint64_t before) {
+    if (now >= before) {
+      dogstatsd_->count(name, now - before, tags);
+    }
+  };
+  if (const auto& previous = reported_runtime_metrics_) {
+    count("runtime.cpp.cpu.time.user_us", current->cpu_user_microseconds,
+          previous->cpu_user_microseconds);
+    count("runtime.cpp.cpu.time.sys_us", current->cpu_system_microseconds,
+          previous->cpu_system_microseconds);
+  }
+  dogstatsd_->gauge("runtime.cpp.mem.rss", current->resident_bytes, tags);
+  dogstatsd_->gauge("runtime.cpp.thread_count", current->threads, tags);
+  if (current->heap_allocated_bytes) {
+    dogstatsd_->gauge("runtime.cpp.mem.heap_allocated",
+                      *current->heap_allocated_bytes, tags);
+  }
+  if (current->heap_reserved_bytes) {
+    dogstatsd_->gauge("runtime.cpp.mem.heap_reserved",
+                      *current->heap_reserved_bytes, tags);
+  }
+  dogstatsd_->flush();
+  reported_runtime_metrics_ = current;
+}
+
+void DatadogAgent::log_flush_summary() {
+  const MetricsSnapshot current = metrics_->snapshot();
+  const MetricsSnapshot& previous = summarized_metrics_;
+  const auto flushes = since(current.flush_duration, previous.flush_duration);
+  if (flushes.count == 0) {
+    return;
+  }
+  const auto bytes = since(current.request_bytes, previous.request_bytes);
+  const auto chunks =
+      since(current.request_trace_chunks, previous.request_trace_chunks);
+  logger_->log_startup([&](std::ostream& stream) {
+    stream << "DATADOG TRACER FLUSHES - " << flushes.count << " flush(es):";
+    summarize(stream, "total", flushes);
+    summarize(stream, "swap",
+              since(current.flush_swap_duration, previous.flush_swap_duration));
+    summarize(stream, "encode", since(current.flush_encode_duration,
+                                      previous.flush_encode_duration));
+    stream << ' ' << bytes.count << " request(s):";
+    summarize(stream, "build", since(current.request_build_duration,
+                                     previous.request_build_duration));
+    summarize(stream, "round trip",
+              since(current.request_round_trip_duration,
+                    previous.request_round_trip_duration));
+    summarize(stream, "response", since(current.response_parse_duration,
+                                        previous.response_parse_duration));
+    stream << " bytes mean " << bytes.mean() << " p99 "
+           << bytes.percentile(0.99) << "; trace chunks mean " << chunks.mean()
+           << " p99 " << chunks.percentile(0.99);
+  });
+  summarized_metrics_ = current;
+}
+
+void DatadogAgent::discover() {
+  {
+    std::lock_guard<std::mutex> lock(discovered_->mutex);
+    if (discovered_->in_flight) {
+      return;
+    }
+    discovered_->in_flight = true;
+  }
+
+  auto set_request_headers = [](DictWriter& headers) {
+    headers.set("Datadog-Meta-Lang", "cpp");
+    headers.set("Datadog-Meta-Tracer-Version", tracer_version);
+  };
+
+  // The callbacks might outlive this object, and so they share
+  // `discovered_` rather than refer to it.
+  auto on_response = [discovered = discovered_, logger = logger_](
+                         int response_status,
+                         const DictReader& /*response_headers*/,
+                         std::string response_body) {
+    std::optional<AgentFeatures> features;
+    std::optional<std::string> error_message;
+    // An Agent too old to have "/info" responds with 404, and then the
+    // configured features are used.
+    if (response_status < 200 || response_status >= 300) {
+      if (response_status != 404) {
+        error_message =
+            "Unexpected response status " + std::to_string(response_status) +
+            " to agent discovery with body (starts on next line):\n" +
+            response_body;
+      }
+    } else {
+      auto result = parse_agent_info(response_body);
+      if (auto* message = std::get_if<std::string>(&result)) {
+        error_message = std::move(*message);
+      } else {
+        features = std::get<AgentFeatures>(result);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(discovered->mutex);
+      discovered->in_flight = false;
+      if (features) {
+        discovered->pending = features;
+      }
+    }
+    if (error_message) {
+      logger->log_error(*error_message);
+    }
+  };
+
+  auto on_error = [discovered = discovered_, logger = logger_](Error error) {
+    {
+      std::lock_guard<std::mutex> lock(discovered->mutex);
+      discovered->in_flight = false;
+    }
+    logger->log_error(error.with_prefix(
+        "Error occurred during HTTP request for agent discovery: "));
+  };
+
+  auto get_result =
+      http_client_->get(info_endpoint_, std::move(set_request_headers),
+                        std::move(on_response), std::move(on_error));
+  if (auto* error = get_result.if_error()) {
+    if (error->code == Error::HTTP_CLIENT_GET_UNSUPPORTED) {
+      // Leave `in_flight` set, so that discovery isn't attempted again.
+      logger_->log_error(error->with_prefix("Agent discovery is disabled: "));
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(discovered_->mutex);
+      discovered_->in_flight = false;
+    }
+    logger_->log_error(*error);
+  }
+}
+
+void DatadogAgent::apply_discovered_features() {
+  std::optional<AgentFeatures> features;
+  {
+    std::lock_guard<std::mutex> lock(discovered_->mutex);
+    features = std::exchange(discovered_->pending, std::nullopt);
+  }
+  if (!features) {
+    return;
+  }
+  api_version_ =
+      features->v05_traces ? TraceAPIVersion::V0_5 : TraceAPIVersion::V0_4;
+  // Statistics computed by the tracer are useful only if the trace chunks
+  // dropped by sampling can then be dropped, rather than sent.
+  computes_stats_.store(features->stats && features->client_drop_p0s,
+                        std::memory_order_relaxed);
+}
+
+void DatadogAgent::count_dropped(const DroppedTraceChunks& dropped) {
+  if (dropped.traces == 0 && dropped.spans == 0) {
+    return;
+  }
+  metrics_->add(Metrics::TRACE_CHUNKS_DROPPED, dropped.traces);
+  metrics_->add(Metrics::SPANS_DROPPED, dropped.spans);
+  dropped_traces_.fetch_add(dropped.traces, std::memory_order_relaxed);
+  dropped_spans_.fetch_add(dropped.spans, std::memory_order_relaxed);
+}
+
+void DatadogAgent::process_spans() {
+  std::vector<SpanProcessor::Chunk> chunks;
+  chunks.reserve(outgoing_trace_chunks_.size());
+  for (const auto& configured : span_processors_) {
+    const auto& tags = configured.tags_read;
+    const auto reads = [&](const std::unique_ptr<SpanData>& span) {
+      return std::any_of(tags.begin(), tags.end(), [&](const auto& tag) {
+        return span->tags.contains(tag) || span->numeric_tags.contains(tag);
+      });
+    };
+    chunks.clear();
+    for (TraceChunk& chunk : outgoing_trace_chunks_) {
+      if (chunk.spans.empty() ||
+          (!tags.empty() &&
+           std::none_of(chunk.spans.begin(), chunk.spans.end(), reads))) {
+        continue;
+      }
+      chunks.push_back(SpanProcessor::Chunk{chunk.spans, chunk.origin});
+    }
+    if (chunks.empty()) {
+      continue;
+    }
+    configured.processor->process(chunks);
+    // Spans that the processor reset are removed before the next processor.
+    for (const SpanProcessor::Chunk& chunk : chunks) {
+      auto& spans = chunk.spans;
+      spans.erase(std::remove(spans.begin(), spans.end(), nullptr),
+                  spans.end());
+    }
+  }
+
+  const auto is_empty = [](const TraceChunk& chunk) {
+    return chunk.spans.empty();
+  };
+  outgoing_trace_chunks_.erase(
+      std::remove_if(outgoing_trace_chunks_.begin(),
+                     outgoing_trace_chunks_.end(), is_empty),
+      outgoing_trace_chunks_.end());
+}
+
+bool DatadogAgent::normalizes() const {
+  return normalizer_ || span_normalizer_;
+}
+
+void DatadogAgent::normalize(std::vector<std::unique_ptr<SpanData>>& spans) {
+  for (const auto& span : spans) {
+    // Resource names are normalized after they're made valid UTF-8.
+    if (span_normalizer_) {
+      span_normalizer_->normalize(*span);
+    }
+    if (normalizer_) {
+      normalizer_->normalize(*span);
+    }
+  }
+}
+
+bool DatadogAgent::drop_unsampled(
+    std::vector<std::unique_ptr<SpanData>>& spans) {
+  if (!dropped_by_sampling(spans)) {
+    return false;
+  }
+
+  const auto size_before = spans.size();
+  spans.erase(std::remove_if(spans.begin(), spans.end(),
+                             [](const std::unique_ptr<SpanData>& span) {
+                               return !span->numeric_tags.contains(
+                                   tags::internal::span_sampling_mechanism);
+                             }),
+              spans.end());
+  // Only a trace chunk dropped entirely counts as a dropped trace.
+  count_dropped(DroppedTraceChunks{std::size_t(spans.empty()),
+                                   size_before - spans.size()});
+  return spans.empty();
+}
+
+void DatadogAgent::flush_stats(bool all) {
+  std::string body;
+  auto flushed = stats_->flush(body, clock_().wall, all);
+  if (auto* error = flushed.if_error()) {
+    logger_->log_error(*error);
+    return;
+  }
+  if (*flushed == 0) {
+    return;
+  }
+
+  auto set_request_headers = [](DictWriter& headers) {
     headers.set("Content-Type", "application/msgpack");
     headers.set("Datadog-Meta-Lang", "cpp");
     headers.set("Datadog-Meta-Lang-Version", std::to_string(__cplusplus));
     headers.set("Datadog-Meta-Tracer-Version", tracer_version);
-    headers.set("X-Datadog-Trace-Count",
-                std::to_string(outgoing_trace_chunks_.size()));
   };
 
+  // Statistics are not retried.  The next payload contains only later time
+  // buckets.
+  auto on_response = [logger = logger_, in_flight = in_flight_requests_,
+                      metrics = metrics_](
+                         int response_status,
+                         const DictReader& /*response_headers*/,
+                         std::string response_body) {
+    if (response_status < 200 || response_status >= 300) {
+      metrics->add(Metrics::HTTP_ERRORS);
+      logger->log_error([&](auto& stream) {
+        stream << "Unexpected response status " << response_status
+               << " to stats with body (starts on next line):\n"
+               << response_body;
+      });
+    }
+    end_request(*in_flight);
+  };
+
+  auto on_error = [logger = logger_, in_flight = in_flight_requests_,
+                   metrics = metrics_](Error error) {
+    metrics->add(Metrics::HTTP_ERRORS);
+    logger->log_error(
+        error.with_prefix("Error occurred during HTTP request for stats: "));
+    end_request(*in_flight);
+  };
+
+  begin_request(*in_flight_requests_);
+  metrics_->add(Metrics::HTTP_REQUESTS);
+  auto post_result = http_client_->post(
+      stats_endpoint_, std::move(set_request_headers), std::move(body),
+      std::move(on_response), std::move(on_error));
+  if (auto* error = post_result.if_error()) {
+    metrics_->add(Metrics::HTTP_ERRORS);
+    logger_->log_error(*error);
+    end_request(*in_flight_requests_);
+  }
+}
+
+void DatadogAgent::post(
+    Request request,
+    std::optional<std::chrono::steady_clock::time_point> build_start) {
+  if (!build_start) {
+    build_start = clock_().tick;
+  }
+  ++request.attempts;
+  const auto api_version = request.api_version;
+
+  // Trace chunks dropped from the buffer are reported the same way as trace
+  // chunks dropped by the client for sampling.
+  const auto dropped_traces =
+      dropped_traces_.exchange(0, std::memory_order_relaxed);
+  const auto dropped_spans =
+      dropped_spans_.exchange(0, std::memory_order_relaxed);
+
+  // This is the callback for setting request headers.
+  // It's invoked synchronously (before `post` returns).
+  auto set_request_headers =
+      traces_request_headers(request, dropped_traces, dropped_spans);
+
+  // The body counts as memory held by the tracer until the request completes.
+  const std::size_t body_size = request.body_size;
+
+  // If the request may be retried or spooled, then the HTTP client shares the
+  // body's buffers with the request, which the callbacks retain.
+  HTTPClient::BodyChain body;
+  std::shared_ptr<Request> retained;
+  std::unordered_set<std::shared_ptr<TraceSampler>> samplers;
+  if (request.attempts <= max_retry_attempts_ || spool_) {
+    body = request.body;
+    samplers = request.response_handlers;
+    retained = std::make_shared<Request>(std::move(request));
+  } else {
+    body = std::move(request.body);
+    samplers = std::move(request.response_handlers);
+  }
+
+  // The chosen Agent is skipped for a while if it fails the request.  The
+  // callbacks share `endpoints_`, which keeps `endpoint` alive.
+  AgentEndpoint& endpoint = choose_endpoint();
+  auto mark_unhealthy = [endpoints = endpoints_, &endpoint, clock = clock_,
+                         backoff = retry_backoff_,
+                         max_backoff = max_retry_backoff_]() {
+    record_failure(endpoint, clock().tick, backoff, max_backoff);
+  };
+
+  // The round trip is timed from before the HTTP client is given the
+  // request, since the client might invoke a callback before `post` returns.
+  const auto sent = clock_().tick;
+
   // This is the callback for the HTTP response.  It's invoked
   // asynchronously.
-  auto on_response = [samplers = std::move(response_handlers),
-                      logger = logger_](int response_status,
-                                        const DictReader& /*response_headers*/,
-                                        std::string response_body) {
+  auto on_response = [samplers = std::move(samplers), logger = logger_,
+                      retained, failed = failed_requests_,
+                      in_flight = in_flight_requests_,
+                      endpoints = endpoints_, &endpoint, mark_unhealthy,
+                      counts = response_counts_, metrics = metrics_,
+                      body_size, clock = clock_, sent,
+                      api_version](int response_status,
+                                   const DictReader& /*response_headers*/,
+                                   std::string response_body) {
+    const auto received = clock().tick;
+    metrics->record(Metrics::REQUEST_ROUND_TRIP_DURATION, received - sent);
+    metrics->decrease(Metrics::PAYLOAD_BYTES, body_size);
+    endpoint.outstanding.fetch_sub(1, std::memory_order_relaxed);
     if (response_status < 200 || response_status >= 300) {
+      metrics->add(Metrics::HTTP_ERRORS);
+      if (response_status == 429 || response_status == 503) {
+        counts->distressed.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (response_status == 429 || response_status >= 500) {
+        mark_unhealthy();
+      }
       logger->log_error([&](auto& stream) {
         stream << "Unexpected response status " << response_status
                << " with body (starts on next line):\n"
                << response_body;
       });
+      if (retained && is_retryable(response_status)) {
+        add_failed(*failed, std::move(*retained));
+      }
+      end_request(*in_flight);
       return;
     }
 
-    auto result = parse_agent_traces_response(response_body);
+    counts->succeeded.fetch_add(1, std::memory_order_relaxed);
+    record_success(endpoint);
+    // An OTLP response contains no sampling rates.
+    if (api_version == TraceAPIVersion::OTLP) {
+      end_request(*in_flight);
+      return;
+    }
+    auto result =
+        parse_agent_traces_response(endpoint.responses, response_body);
     if (const auto* error_message = std::get_if<std::string>(&result)) {
       logger->log_error(*error_message);
+      end_request(*in_flight);
       return;
     }
-    const auto& response = std::get<CollectorResponse>(result);
+    const auto response = merge_response(
+        *endpoints, endpoint,
+        std::move(std::get<std::shared_ptr<const CollectorResponse>>(result)));
     for (const auto& sampler : samplers) {
       if (sampler) {
-        sampler->handle_collector_response(response);
+        sampler->handle_collector_response(*response);
       }
     }
+    metrics->record(Metrics::RESPONSE_PARSE_DURATION,
+                    clock().tick - received);
+    end_request(*in_flight);
   };
 
   // This is the callback for if something goes wrong sending the
   // request or retrieving the response.  It's invoked
   // asynchronously.
-  auto on_error = [logger = logger_](Error error) {
+  auto on_error = [logger = logger_, retained, failed = failed_requests_,
+                   in_flight = in_flight_requests_, &endpoint, mark_unhealthy,
+                   counts = response_counts_, metrics = metrics_, body_size,
+                   clock = clock_, sent](Error error) {
+    metrics->record(Metrics::REQUEST_ROUND_TRIP_DURATION,
+                    clock().tick - sent);
+    metrics->decrease(Metrics::PAYLOAD_BYTES, body_size);
+    metrics->add(Metrics::HTTP_ERRORS);
+    endpoint.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    mark_unhealthy();
+    counts->distressed.fetch_add(1, std::memory_order_relaxed);
     logger->log_error(
         error.with_prefix("Error occurred during HTTP request: "));
+    if (retained) {
+      add_failed(*failed, std::move(*retained));
+    }
+    end_request(*in_flight);
+  };
+
+  begin_request(*in_flight_requests_);
+  endpoint.outstanding.fetch_add(1, std::memory_order_relaxed);
+  metrics_->add(Metrics::HTTP_REQUESTS);
+  metrics_->increase(Metrics::PAYLOAD_BYTES, body_size);
+  auto post_result = http_client_->post(
+      traces_endpoint(endpoint.url, api_version),
+      std::move(set_request_headers), std::move(body), std::move(on_response),
+      std::move(on_error));
+  metrics_->record(Metrics::REQUEST_BUILD_DURATION,
+                   clock_().tick - *build_start);
+  if (auto* error = post_result.if_error()) {
+    metrics_->decrease(Metrics::PAYLOAD_BYTES, body_size);
+    metrics_->add(Metrics::HTTP_ERRORS);
+    endpoint.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    mark_unhealthy();
+    logger_->log_error(*error);
+    end_request(*in_flight_requests_);
+  }
+}
+
+DatadogAgent::AgentEndpoint& DatadogAgent::choose_endpoint() {
+  const auto& endpoints = endpoints_->endpoints;
+  const std::size_t count = endpoints.size();
+  if (count == 1) {
+    return *endpoints.front();
+  }
+
+  // Prefer the Agents that aren't being skipped, unless all of them are.
+  const auto now = clock_().tick;
+  std::vector<bool> healthy(count);
+  bool any_healthy = false;
+  for (std::size_t i = 0; i < count; ++i) {
+    std::lock_guard<std::mutex> lock(endpoints[i]->mutex);
+    healthy[i] = endpoints[i]->unhealthy_until <= now;
+    any_healthy = any_healthy || healthy[i];
+  }
+
+  // Consider the Agents in turn, starting with `next_endpoint_`, so that ties
+  // are broken in round robin order.
+  std::optional<std::size_t> chosen;
+  for (std::size_t offset = 0; offset < count; ++offset) {
+    const std::size_t i = (next_endpoint_ + offset) % count;
+    if (any_healthy && !healthy[i]) {
+      continue;
+    }
+    if (!chosen) {
+      chosen = i;
+      if (load_balancing_ == AgentLoadBalancing::ROUND_ROBIN) {
+        break;
+      }
+    } else if (endpoints[i]->outstanding.load(std::memory_order_relaxed) <
+               endpoints[*chosen]->outstanding.load(
+                   std::memory_order_relaxed)) {
+      chosen = i;
+    }
+  }
+  next_endpoint_ = (*chosen + 1) % count;
+  return *endpoints[*chosen];
+}
+
+void DatadogAgent::post_to_mirrors(const Request& request) {
+  for (Mirror& mirror : mirrors_) {
+    // The copy shares the request's body, but not its response handlers.
+    Request copy;
+    copy.body = request.body;
+    copy.body_size = request.body_size;
+    copy.compressed = request.compressed;
+    copy.trace_count = request.trace_count;
+    copy.span_count = request.span_count;
+    copy.api_version = request.api_version;
+    copy.computed_stats = request.computed_stats;
+    copy.dropped_by_sampling = request.dropped_by_sampling;
+    post(mirror, std::move(copy));
+  }
+}
+
+void DatadogAgent::post(Mirror& mirror, Request request) {
+  ++request.attempts;
+  // The counts of trace chunks dropped by the client are reported only to the
+  // primary Datadog Agent.
+  auto set_request_headers = traces_request_headers(request, 0, 0);
+  const auto url = traces_endpoint(mirror.url, request.api_version);
+
+  HTTPClient::BodyChain body;
+  std::shared_ptr<Request> retained;
+  if (request.attempts <= max_retry_attempts_) {
+    body = request.body;
+    retained = std::make_shared<Request>(std::move(request));
+  } else {
+    body = std::move(request.body);
+  }
+
+  // A mirror's responses don't affect sampling.
+  auto on_response = [logger = logger_, retained,
+                      failed = mirror.failed_requests,
+                      in_flight = in_flight_requests_, metrics = metrics_](
+                         int response_status,
+                         const DictReader& /*response_headers*/,
+                         std::string response_body) {
+    if (response_status < 200 || response_status >= 300) {
+      metrics->add(Metrics::HTTP_ERRORS);
+      logger->log_error([&](auto& stream) {
+        stream << "Unexpected response status " << response_status
+               << " from mirror with body (starts on next line):\n"
+               << response_body;
+      });
+      if (retained && is_retryable(response_status)) {
+        add_failed(*failed, std::move(*retained));
+      } else {
+        metrics->add(Metrics::MIRROR_REQUESTS_DROPPED);
+      }
+    }
+    end_request(*in_flight);
+  };
+
+  auto on_error = [logger = logger_, retained, failed = mirror.failed_requests,
+                   in_flight = in_flight_requests_,
+                   metrics = metrics_](Error error) {
+    metrics->add(Metrics::HTTP_ERRORS);
+    logger->log_error(
+        error.with_prefix("Error occurred during HTTP request to mirror: "));
+    if (retained) {
+      add_failed(*failed, std::move(*retained));
+    } else {
+      metrics->add(Metrics::MIRROR_REQUESTS_DROPPED);
+    }
+    end_request(*in_flight);
   };
 
+  begin_request(*in_flight_requests_);
+  metrics_->add(Metrics::HTTP_REQUESTS);
   auto post_result = http_client_->post(
-      traces_endpoint_, std::move(set_request_headers), std::move(body),
+      url, std::move(set_request_headers), std::move(body),
       std::move(on_response), std::move(on_error));
   if (auto* error = post_result.if_error()) {
+    metrics_->add(Metrics::HTTP_ERRORS);
+    metrics_->add(Metrics::MIRROR_REQUESTS_DROPPED);
     logger_->log_error(*error);
+    end_request(*in_flight_requests_);
+  }
+}
+
+Expected<std::shared_ptr<DatadogAgent>> make_shared_datadog_agent(
+    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
+    const SpanDefaults& defaults, const Clock& clock) {
+  auto finalized = finalize_config(config, logger);
+  if (auto* error = finalized.if_error()) {
+    return std::move(*error);
   }
+  return std::make_shared<DatadogAgent>(*finalized, clock, logger, defaults,
+                                        std::make_shared<Metrics>());
 }
 
 }  // namespace tracing
@@ -4,23 +4,112 @@
 // `Collector` interface in terms of periodic HTTP requests to a Datadog Agent.
 //
 // `DatadogAgent` is configured by `DatadogAgentConfig`.  See
-// `datadog_agent_config.h`.
+// `datadog_agent_config.h`.  With `TraceAPIVersion::OTLP`, it instead sends
+// its traces in the OpenTelemetry protocol, with the same buffering, limits,
+// and retries (see `otlp.h`).
+//
+// Usually each `Tracer` creates its own `DatadogAgent`, and with it its own
+// HTTP client and event scheduler.  A process that has many tracers, such as
+// one per tenant, can instead create one `DatadogAgent` using
+// `make_shared_datadog_agent` and give it to each tracer as its
+// `TracerConfig::collector`.  The tracers' trace chunks are then buffered
+// together and sent in combined payloads by a single HTTP client and event
+// scheduler, and the Agent's response to each payload is given to the sampler
+// of every tracer whose chunks the payload contained.
+//
+// When a `DatadogAgent` is destroyed, it sends its buffered trace chunks and
+// statistics, and waits for those requests for at most
+// `DatadogAgentConfig::shutdown_timeout_milliseconds`.  To shut down without
+// blocking, call `shutdown`, which returns a future instead of waiting.
+//
+// Trace chunks that are kept by sampling are sent before those that are
+// dropped by sampling (and sent only for the Agent's statistics), so that
+// they're the likeliest to be sent when the Agent is overloaded, or before
+// the shutdown deadline.  Likewise, failed requests that contain only dropped
+// traces are the first to be dropped and the last to be retried.
+//
+// `DatadogAgent` counts its buffered, dropped, and sent trace chunks, and its
+// requests, in a `Metrics` (see `metrics.h`) that it shares with the tracer
+// that created it, or with every tracer given it as `TracerConfig::collector`.
+// If configured, it sends those metrics to DogStatsD periodically, as well as
+// the process's runtime metrics (see `runtime_metrics.h`).
+//
+// If configured, requests that `DatadogAgent` would drop during an outage of
+// the Datadog Agent, because they exhausted their retries or exceeded the
+// byte limit of retries, are kept in a `DiskSpool` (see `disk_spool.h`)
+// instead, and are sent again once retries stop failing.
+//
+// If configured, every request of traces is also sent to other Datadog Agents,
+// "mirrors" (see `DatadogAgentConfig::mirror_urls`).  The request body is
+// encoded once and its buffers are shared by the destinations.  Each mirror
+// retries its own failed requests within its own byte limit, and its
+// responses are otherwise ignored.
+//
+// If configured, requests of traces are instead distributed among several
+// Datadog Agents, "replicas" (see `DatadogAgentConfig::replica_urls`), each
+// request going to one of them.  An Agent that fails is skipped for a while,
+// and the sampling rates that the Agents respond with are averaged.
+//
+// If configured, the trace chunks that sampling dropped are held by a
+// `TailSampler` (see `tail_sampler.h`) before they're buffered, so that traces
+// that turn out to be slow, large, or erroneous are kept after all.
+//
+// If configured, `DatadogAgent` asks the Datadog Agent which features it
+// supports, and switches to the most efficient trace format and to computing
+// statistics when the Agent supports them (see
+// `DatadogAgentConfig::agent_discovery_enabled`).  Each request records the
+// format and statistics mode of the trace chunks that it contains, so that a
+// switch doesn't affect trace chunks already buffered or awaiting retry.
+//
+// After `fork`, the child process discards the trace chunks, statistics, and
+// retries that it inherited, since the parent sends them.  The child doesn't
+// use the parent's spool, nor drain the parent's shared memory ring.  The HTTP
+// client and event scheduler handle `fork` themselves (see
+// `fork_handlers.h`).
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_set>
 #include <vector>
 
 #include "clock.h"
 #include "collector.h"
+#include "datadog_agent_config.h"
+#include "disk_spool.h"
+#include "dogstatsd.h"
+#include "encoded_span_defaults.h"
 #include "event_scheduler.h"
+#include "fork_handlers.h"
 #include "http_client.h"
+#include "metrics.h"
+#include "otlp.h"
+#include "resource_normalizer.h"
+#include "runtime_metrics.h"
+#include "span_normalizer.h"
+#include "span_processor.h"
+#include "stats_concentrator.h"
+#include "string_table.h"
+#include "tail_sampler.h"
+#include "trace_chunk_buffer.h"
+#include "worker_pool.h"
 
 namespace datadog {
 namespace tracing {
 
-class FinalizedDatadogAgentConfig;
+struct CollectorResponse;
 class Logger;
 struct SpanData;
+class SpanSampler;
+struct SpanDefaults;
 class TraceSampler;
 
 class DatadogAgent : public Collector {
@@ -28,35 +117,537 @@ class DatadogAgent : public Collector {
   struct TraceChunk {
     std::vector<std::unique_ptr<SpanData>> spans;
     std::shared_ptr<TraceSampler> response_handler;
+    TraceChunkFootprint footprint;
+    // `origin` is the origin of the trace, which is encoded in each span
+    // (see `Collector::send_with_origin`), or is empty if there is none.
+    std::string origin;
+    // `span_sampler` is the span sampler yet to be applied to `spans` (see
+    // `Collector::send_unsampled`), or is null if there is none.
+    std::shared_ptr<SpanSampler> span_sampler;
+    // `computed_stats` is whether the statistics of `spans` were computed by
+    // `stats_`, in which case their resource names are already normalized.
+    bool computed_stats = false;
+  };
+
+  // `EncodedTraceChunk` is a trace chunk that `send` encoded in the "v0.4"
+  // format as it arrived.  It's used instead of `TraceChunk` when
+  // `encode_on_send` is configured.
+  struct EncodedTraceChunk {
+    std::string trace;
+    std::shared_ptr<TraceSampler> response_handler;
+    TraceChunkFootprint footprint;
+  };
+
+  // `EncodedTraceChunks` are the encoded trace chunks of one request to the
+  // Datadog Agent.  They're also where `send` encodes trace chunks in the
+  // "v0.5" format as they arrive, when `encode_on_send` is configured.  Unlike
+  // in the "v0.4" format, the chunks within a payload are not independent of
+  // each other, because they share a string table.
+  struct EncodedTraceChunks {
+    // `traces` contains the encoding of each of `count` trace chunks, in the
+    // format of `api_version`, without the header of the array (or, if the
+    // format is `OTLP`, of the message) that contains them.
+    std::string traces;
+    std::size_t count = 0;
+    std::size_t span_count = 0;
+    // `dropped_by_sampling` is how many of the `count` trace chunks were
+    // dropped by sampling, and are sent only for the Agent's statistics.
+    std::size_t dropped_by_sampling = 0;
+    // `strings` contains the strings referred to by `traces` when the API
+    // version is "v0.5".
+    StringTable strings;
+    std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+    // `api_version` is the format of `traces`, and `computed_stats` is whether
+    // the statistics of the trace chunks were computed by `stats_`.
+    TraceAPIVersion api_version = TraceAPIVersion::V0_4;
+    bool computed_stats = false;
+  };
+
+  // `Request` is a request body sent to the Datadog Agent, retained so that it
+  // can be sent again if sending it fails.  The buffers of `body` are shared
+  // with the HTTP client rather than copied, and `body_size` is their total
+  // size.
+  struct Request {
+    HTTPClient::BodyChain body;
+    std::size_t body_size = 0;
+    bool compressed = false;
+    std::size_t trace_count = 0;
+    std::size_t span_count = 0;
+    TraceAPIVersion api_version = TraceAPIVersion::V0_4;
+    bool computed_stats = false;
+    // `dropped_by_sampling` is whether every trace in the request was dropped
+    // by sampling.  Such requests are the first to be dropped, and the last
+    // to be retried, when requests are failing.
+    bool dropped_by_sampling = false;
+    std::unordered_set<std::shared_ptr<TraceSampler>> response_handlers;
+    // `attempts` is the number of times that the request has been sent.
+    int attempts = 0;
+    std::chrono::steady_clock::time_point retry_at;
+  };
+
+  // `FailedRequests` are requests that failed and that have not yet been
+  // scheduled for retry by `flush`.  They're added to by the HTTP response
+  // callbacks, which might outlive the `DatadogAgent`, and so `FailedRequests`
+  // is shared with them.
+  struct FailedRequests {
+    std::mutex mutex;
+    std::vector<Request> requests;
+  };
+
+  // `InFlightRequests` counts the requests to the Datadog Agent that have been
+  // sent but haven't completed.  Like `FailedRequests`, it's shared with the
+  // HTTP response callbacks.  Once `shutdown` is called, `idle` is fulfilled
+  // when `count` reaches zero, or when the shutdown deadline passes.
+  struct InFlightRequests {
+    std::mutex mutex;
+    std::size_t count = 0;
+    std::optional<std::promise<void>> idle;
+  };
+
+  // `AgentFeatures` are the relevant features that the Datadog Agent says, in
+  // its response to "/info", that it supports.
+  struct AgentFeatures {
+    bool v05_traces = false;
+    bool stats = false;
+    bool client_drop_p0s = false;
+  };
+
+  // `DiscoveredFeatures` is the Datadog Agent's most recent answer to "/info",
+  // until `flush` applies it.  Like `FailedRequests`, it's shared with the HTTP
+  // response callbacks.  `in_flight` prevents the requests from overlapping.
+  struct DiscoveredFeatures {
+    std::mutex mutex;
+    std::optional<AgentFeatures> pending;
+    bool in_flight = false;
+  };
+
+  // `ResponseCache` is the Datadog Agent's most recently parsed response to
+  // traces, whose `body` has the specified `hash`.  The Agent usually sends
+  // the same response every time, and so the HTTP response callbacks, with
+  // which it's shared, parse a response only if it differs from `body`.
+  struct ResponseCache {
+    std::mutex mutex;
+    std::size_t hash = 0;
+    std::string body;
+    std::shared_ptr<const CollectorResponse> response;
+  };
+
+  // `Mirror` is another Datadog Agent to which each request of traces is also
+  // sent.  Its `failed_requests` are shared with the HTTP response callbacks,
+  // like `FailedRequests`.  `retries`, oldest first, and their total size
+  // `retry_bytes` are accessed only by `flush`.
+  struct Mirror {
+    HTTPClient::URL url;
+    std::shared_ptr<FailedRequests> failed_requests;
+    std::deque<Request> retries;
+    std::size_t retry_bytes = 0;
+  };
+
+  // `AgentEndpoint` is a Datadog Agent to which requests of traces are sent:
+  // the one at `DatadogAgentConfig::url`, or a replica.  Like
+  // `FailedRequests`, it's shared with the HTTP response callbacks.
+  // `outstanding` is the number of its requests awaiting a response.  `mutex`
+  // protects the members below it.  The Agent is skipped until
+  // `unhealthy_until`, which is pushed back by each of its
+  // `consecutive_failures`.  `response` is its most recent response.
+  struct AgentEndpoint {
+    HTTPClient::URL url;
+    std::atomic<std::size_t> outstanding{0};
+    ResponseCache responses;
+    std::mutex mutex;
+    int consecutive_failures = 0;
+    std::chrono::steady_clock::time_point unhealthy_until;
+    std::shared_ptr<const CollectorResponse> response;
+  };
+
+  // `AgentEndpoints` are the Datadog Agents among which requests of traces
+  // are distributed, the one at `DatadogAgentConfig::url` first.  If there's
+  // more than one, then their responses are merged.  `mutex` protects
+  // `merged`, which is the merge of the responses whose versions are
+  // `merged_versions`.
+  struct AgentEndpoints {
+    std::vector<std::unique_ptr<AgentEndpoint>> endpoints;
+    std::mutex mutex;
+    std::vector<std::uint64_t> merged_versions;
+    std::shared_ptr<const CollectorResponse> merged;
+  };
+
+  // `ResponseCounts` counts the requests to the Datadog Agent that met
+  // distress (status 429 or 503, or no response), and those that succeeded,
+  // since the scheduled flush last looked.  Like `FailedRequests`, it's shared
+  // with the HTTP response callbacks.
+  struct ResponseCounts {
+    std::atomic<std::size_t> distressed{0};
+    std::atomic<std::size_t> succeeded{0};
   };
 
  private:
+  // `mutex_` protects `incoming_encoded_`.  The other mutable state is either
+  // lock-free or accessed only by `flush`.  `flush_mutex_` serializes `flush`,
+  // which is called by the event scheduler and by the public `flush`.
   std::mutex mutex_;
+  std::mutex flush_mutex_;
   Clock clock_;
   std::shared_ptr<Logger> logger_;
-  // `incoming_trace_chunks_` are what `send` appends to.
-  std::vector<TraceChunk> incoming_trace_chunks_;
+  // `retry_bytes_` is the total size of the requests in `retries_`, which
+  // counts against the buffer's byte limit.
+  std::atomic<std::size_t> retry_bytes_;
+  // `encoded_defaults_` contains pre-encoded fragments of the tracer's
+  // `SpanDefaults`, used when encoding spans in `flush`.
+  EncodedSpanDefaults encoded_defaults_;
+  // `otlp_resource_` is the encoded resource of the tracer's `SpanDefaults`,
+  // written once per request when the API version is `OTLP`.
+  OtlpResource otlp_resource_;
+  // `incoming_trace_chunks_` are what `send` appends to.  It and
+  // `incoming_encoded_chunks_` have a shard per NUMA node, if so configured.
+  TraceChunkBuffer<TraceChunk> incoming_trace_chunks_;
   // `outgoing_trace_chunks_` are what `flush` consumes from.
   std::vector<TraceChunk> outgoing_trace_chunks_;
-  HTTPClient::URL traces_endpoint_;
+  // If `encode_on_send_`, then `send` encodes into `incoming_encoded_chunks_`
+  // or `incoming_encoded_` (depending on the API version) instead of appending
+  // to `incoming_trace_chunks_`.
+  bool encode_on_send_;
+  TraceChunkBuffer<EncodedTraceChunk> incoming_encoded_chunks_;
+  EncodedTraceChunks incoming_encoded_;
+  // `max_buffered_spans_` and `max_buffered_bytes_` limit `incoming_encoded_`.
+  // The other incoming buffers enforce the limits themselves.
+  std::optional<std::size_t> max_buffered_spans_;
+  std::optional<std::size_t> max_buffered_bytes_;
+  BufferOverflowPolicy buffer_overflow_policy_;
+  // `tail_sampler_` is null unless tail-based sampling is enabled.  The trace
+  // chunks that it releases go where `send` would otherwise have put them.
+  std::unique_ptr<TailSampler> tail_sampler_;
+  // `dropped_traces_` and `dropped_spans_` count the trace chunks dropped to
+  // stay within the buffer limits since the previous request to the Agent.
+  std::atomic<std::size_t> dropped_traces_;
+  std::atomic<std::size_t> dropped_spans_;
+  // `encoded_bytes_per_span_` is a moving average of the encoded size of a
+  // span, used to reserve the request body in `flush`, and to estimate the
+  // size of incoming trace chunks in `send`.  It's zero until the first flush.
+  // It's modified only by `flush`.
+  std::atomic<double> encoded_bytes_per_span_;
+  // `api_version_` is the format in which `flush` encodes trace chunks.  It's
+  // modified only by `flush`, when it applies `discovered_`, and only if
+  // `encode_on_send_` is false.
+  TraceAPIVersion api_version_;
+  std::size_t max_payload_bytes_;
+  PayloadCompression compression_;
+  int compression_level_;
+  int max_retry_attempts_;
+  std::chrono::steady_clock::duration retry_backoff_;
+  std::chrono::steady_clock::duration max_retry_backoff_;
+  std::shared_ptr<FailedRequests> failed_requests_;
+  std::shared_ptr<InFlightRequests> in_flight_requests_;
+  std::shared_ptr<ResponseCounts> response_counts_;
+  // `retries_` are the requests awaiting retry, oldest first.  `retries_` and
+  // `retry_jitter_` are accessed only by `flush`.
+  std::deque<Request> retries_;
+  std::mt19937 retry_jitter_;
+  // `spool_` is null unless spooling is configured and the spool could be
+  // created.  It's accessed only by `flush`.
+  std::unique_ptr<DiskSpool> spool_;
+  // `shared_memory_ring_` is null unless configured.  `flush` sends the trace
+  // chunks that other processes wrote to it.
+  std::shared_ptr<SharedMemoryRing> shared_memory_ring_;
+  HTTPClient::URL agent_url_;
+  // `endpoints_` contains the Agent at `agent_url_` and its replicas, if any.
+  // `next_endpoint_` is the index of the one whose turn it is to receive a
+  // request.  It's accessed only by `flush`.
+  std::shared_ptr<AgentEndpoints> endpoints_;
+  AgentLoadBalancing load_balancing_;
+  std::size_t next_endpoint_;
+  // `mirrors_` are accessed only by `flush`, apart from their
+  // `failed_requests`.
+  std::vector<Mirror> mirrors_;
+  // `stats_` is null unless stats computation is enabled, or might be enabled
+  // by agent discovery.  `computes_stats_` is whether it's in use.
+  std::unique_ptr<StatsConcentrator> stats_;
+  std::atomic<bool> computes_stats_;
+  // `normalizer_` is null unless resource normalization is enabled, and
+  // `span_normalizer_` is null unless span normalization is enabled.
+  std::unique_ptr<ResourceNormalizer> normalizer_;
+  std::unique_ptr<SpanNormalizer> span_normalizer_;
+  // `span_processors_` are applied in order by `process_spans`, each with the
+  // tags that it declared when this object was created.
+  struct ConfiguredSpanProcessor {
+    std::shared_ptr<SpanProcessor> processor;
+    std::vector<std::string> tags_read;
+  };
+  std::vector<ConfiguredSpanProcessor> span_processors_;
+  // `encoder_pool_` is null unless encoder threads are configured and apply.
+  std::unique_ptr<WorkerPool> encoder_pool_;
+  HTTPClient::URL stats_endpoint_;
+  // `discovered_` is null unless agent discovery is enabled.  The scheduled
+  // event cancelled by `cancel_discovery_` calls `discover`.
+  std::shared_ptr<DiscoveredFeatures> discovered_;
+  HTTPClient::URL info_endpoint_;
+  EventScheduler::Cancel cancel_discovery_;
   std::shared_ptr<HTTPClient> http_client_;
   std::shared_ptr<EventScheduler> event_scheduler_;
-  EventScheduler::Cancel cancel_scheduled_flush_;
   std::chrono::steady_clock::duration flush_interval_;
+  bool randomize_flush_phase_;
+  std::chrono::steady_clock::duration flush_jitter_;
+  // If the flush interval is adaptive, then the scheduled flush sends only
+  // every `flush_backoff_` intervals, and has skipped `skipped_flushes_` since
+  // it last sent.  `flush_backoff_` is at most `max_flush_backoff_`, which is
+  // one if the flush interval isn't adaptive.  These are accessed only by
+  // `scheduled_flush`.
+  std::size_t max_flush_backoff_;
+  std::size_t flush_backoff_;
+  std::size_t skipped_flushes_;
+  // `send` wakes the scheduled flush early when the buffered trace chunks
+  // reach `flush_threshold_spans_` or `flush_threshold_bytes_`, or, while
+  // `early_flush_pending_` is true, when the first trace chunk arrives.
+  // `flush_requested_` is true between waking the flush and the flush, so that
+  // the flush is woken only once.
+  std::optional<std::size_t> flush_threshold_spans_;
+  std::optional<std::size_t> flush_threshold_bytes_;
+  std::atomic<bool> early_flush_pending_;
+  std::atomic<bool> flush_requested_;
+  EventScheduler::Cancel cancel_scheduled_flush_;
+  EventScheduler::Wake wake_scheduled_flush_;
+  // `shutdown_` is the result of `shutdown`, once it's been called.  While
+  // shutting down, `flush` sends kept trace chunks first.  The scheduled
+  // event cancelled by `cancel_shutdown_deadline_` fulfills the future at
+  // `shutdown_deadline_`.
+  std::chrono::steady_clock::duration shutdown_timeout_;
+  std::optional<std::shared_future<void>> shutdown_;
+  std::chrono::steady_clock::time_point shutdown_deadline_;
+  EventScheduler::Cancel cancel_shutdown_deadline_;
+  // `forking_` is true from before `fork` until the child has discarded what
+  // it inherited, and `flush` does nothing meanwhile.  The child's event
+  // scheduler might be restarted before that.
+  std::atomic<bool> forking_;
+  UnregisterForkHandlers unregister_fork_handlers_;
+  std::shared_ptr<Metrics> metrics_;
+  // `dogstatsd_` is null unless health or runtime metrics are enabled.  The
+  // scheduled event cancelled by `cancel_health_metrics_` sends the health
+  // metrics to it, with the tags `health_metrics_tags_`.  `reported_metrics_`
+  // is the snapshot whose counters were most recently sent.
+  std::unique_ptr<DogStatsD> dogstatsd_;
+  std::string health_metrics_tags_;
+  MetricsSnapshot reported_metrics_;
+  EventScheduler::Cancel cancel_health_metrics_;
+  // `runtime_metrics_` is null unless runtime metrics are enabled.  The
+  // scheduled event cancelled by `cancel_runtime_metrics_` samples it and
+  // sends the sample to `dogstatsd_`, also with the tags
+  // `health_metrics_tags_`.  CPU time is sent as the increase since
+  // `reported_runtime_metrics_`.
+  std::unique_ptr<RuntimeMetrics> runtime_metrics_;
+  std::optional<RuntimeMetricsSample> reported_runtime_metrics_;
+  EventScheduler::Cancel cancel_runtime_metrics_;
+  // The scheduled event cancelled by `cancel_flush_summary_` logs a summary of
+  // the flushes since `summarized_metrics_`, if flush summaries are enabled.
+  MetricsSnapshot summarized_metrics_;
+  EventScheduler::Cancel cancel_flush_summary_;
 
-  void flush();
+  // Send the buffered trace chunks, the statistics of completed time buckets
+  // or of all time buckets if `all_stats` is true, and the requests due for
+  // retry.
+  void flush(bool all_stats = false);
+  // `flush`, unless the flush interval is lengthened by the Datadog Agent's
+  // distress.  This is what the event scheduler calls.
+  void scheduled_flush();
+  // Send the buffered trace chunks, statistics, and retries.  This is the
+  // part of `flush` that `metrics_` times.
+  void send_buffered(bool all_stats);
+  // Discard the buffered trace chunks, statistics, and retries, and release
+  // `flush`.  This is done in the child process after `fork`.
+  void discard_after_fork();
+  // Record the specified numbers of buffered `spans` and buffered `bytes` in
+  // `metrics_`, and wake the scheduled flush if they reach either flush
+  // threshold.
+  void wake_flush_if_full(std::size_t spans, std::size_t bytes);
+  // Return the shard of the incoming buffers to which the calling thread
+  // sends trace chunks: that of its NUMA node, if the buffers are sharded.
+  std::size_t buffer_shard() const;
+  // Update the buffer gauges of `metrics_` after a flush.
+  void update_buffer_gauges();
+  // Send `metrics_` to `dogstatsd_`.
+  void send_health_metrics();
+  // Send a sample of `runtime_metrics_` to `dogstatsd_`.
+  void send_runtime_metrics();
+  // Log the timings of the stages of the flushes since the previous summary.
+  void log_flush_summary();
+  // Ask the Datadog Agent which features it supports, unless the previous
+  // request is still in flight.  The answer is stored in `discovered_`.
+  void discover();
+  // Switch the trace format and statistics mode to those of the features in
+  // `discovered_`, if an answer has arrived since the previous flush.
+  void apply_discovered_features();
+  // Add the specified `dropped` trace chunks to the counts that will be
+  // reported to the Datadog Agent.
+  void count_dropped(const DroppedTraceChunks& dropped);
+  // If the specified `spans` were dropped by sampling, then remove those that
+  // weren't kept by span sampling, and count them as dropped.  Return whether
+  // no spans remain.  This is done only if stats are computed by `stats_`.
+  bool drop_unsampled(std::vector<std::unique_ptr<SpanData>>& spans);
+  // Give `outgoing_trace_chunks_` to each of `span_processors_`, and then
+  // remove the spans that they reset and the chunks left without spans.
+  void process_spans();
+  // Return whether `normalize` would modify spans, i.e. whether
+  // `normalizer_` or `span_normalizer_` is not null.
+  bool normalizes() const;
+  // Normalize the specified `spans` using `span_normalizer_` and then
+  // `normalizer_`, whichever are not null.
+  void normalize(std::vector<std::unique_ptr<SpanData>>& spans);
+  // Send the statistics computed by `stats_` to the Datadog Agent.  Send only
+  // the time buckets that have elapsed, unless `all` is true.
+  void flush_stats(bool all);
+  // Send the trace chunks written to `shared_memory_ring_`, which must not be
+  // null.
+  void flush_shared_memory_ring();
+  // Append to the specified `payloads` the encoding of the trace chunks of
+  // `outgoing_trace_chunks_` in the specified range from `begin` to `end`,
+  // starting another payload whenever one reaches `max_payload_bytes_`.
+  // Reserve each payload using the specified estimated `bytes_per_span`.
+  // This is done by the encoder threads, for different ranges concurrently.
+  Expected<void> encode_chunks(std::size_t begin, std::size_t end,
+                               double bytes_per_span,
+                               std::vector<EncodedTraceChunks>& payloads);
+  // Send the trace chunks that `send` encoded.  This is what `flush` does when
+  // `encode_on_send_` is true.
+  void flush_encoded();
+  // Schedule the retry of requests that have failed since the previous flush,
+  // and send the retries whose backoff has elapsed.
+  void retry_failed_requests();
+  // Add the specified `request` to `spool_`, which must not be null, and count
+  // the trace chunks that it drops to make room as dropped.
+  void spool(Request&& request);
+  // Send spooled requests, up to `max_payload_bytes_` of them.
+  void replay_spooled();
+  // Return the number of bytes, other than requests awaiting retry, that count
+  // against the buffer's byte limit.
+  std::size_t buffered_bytes();
+  // Send a request containing the specified `payload` to the Datadog Agent.
+  void post(EncodedTraceChunks&& payload);
+  // Send a request containing the concatenation of the specified `parts` to
+  // the Datadog Agent.  The parts are sent as separate buffers, rather than
+  // copied.  The parts must have the same API version and statistics mode.
+  // If the API version is "v0.5", then there must be only one part.
+  void post(std::vector<EncodedTraceChunks>&& parts);
+  // Send the specified `request` to the Datadog Agent, or to one of its
+  // replicas, chosen by `choose_endpoint`.  Pass the Agent's response, merged
+  // with those of the replicas, to the request's response handlers.  If the
+  // request fails and may be retried or spooled, add it to
+  // `failed_requests_`.  The request's building began at the optionally
+  // specified `build_start`, or else begins now, for `metrics_`.
+  void post(Request request,
+            std::optional<std::chrono::steady_clock::time_point> build_start =
+                std::nullopt);
+  // Return the Agent among `endpoints_` to which to send the next request of
+  // traces, per `load_balancing_`, preferring those that aren't being
+  // skipped after failures.
+  AgentEndpoint& choose_endpoint();
+  // Send a copy of the specified `request`, sharing its body, to each of
+  // `mirrors_`.
+  void post_to_mirrors(const Request& request);
+  // Send the specified `request` to the specified `mirror`.  If the request
+  // fails and may be retried, add it to the mirror's `failed_requests`.
+  void post(Mirror& mirror, Request request);
+  // Schedule the retry of the requests to the specified `mirror` that have
+  // failed since the previous flush, drop the oldest retries that exceed
+  // `max_payload_bytes_`, and send the retries whose backoff has elapsed as
+  // of the specified `now`.
+  void retry_failed_requests(Mirror& mirror,
+                             std::chrono::steady_clock::time_point now);
+  // Return when to retry a request that has been sent the specified
+  // `attempts` times and that failed as of the specified `now`.
+  std::chrono::steady_clock::time_point retry_time(
+      int attempts, std::chrono::steady_clock::time_point now);
+  // Append the specified `spans` to `incoming_trace_chunks_` as a trace chunk
+  // having the specified `response_handler`, `origin`, `span_sampler`, and
+  // `computed_stats`.
+  void enqueue(std::vector<std::unique_ptr<SpanData>>&& spans,
+               const std::shared_ptr<TraceSampler>& response_handler,
+               std::string_view origin,
+               const std::shared_ptr<SpanSampler>& span_sampler,
+               bool computed_stats);
+  // Buffer, or encode, the specified `spans` having the specified
+  // `response_handler` and `origin`, as `send_with_origin` does when there's
+  // no `tail_sampler_`.  `accept_unsampled` is the same for `send_unsampled`.
+  Expected<void> accept(std::vector<std::unique_ptr<SpanData>>&& spans,
+                        const std::shared_ptr<TraceSampler>& response_handler,
+                        std::string_view origin);
+  Expected<void> accept_unsampled(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::optional<std::string_view> origin,
+      const std::shared_ptr<SpanSampler>& span_sampler);
+  // Give the specified `chunk` to `tail_sampler_`, which must not be null,
+  // and `accept` the trace chunks that it releases.
+  void sample_tail(TailSampler::Chunk&& chunk);
+  // `accept` the specified `released` trace chunks, logging any errors.
+  void accept_released(std::vector<TailSampler::Chunk>&& released);
 
  public:
-  DatadogAgent(const FinalizedDatadogAgentConfig&, const Clock& clock,
-               const std::shared_ptr<Logger>&);
+  // Create a `DatadogAgent` configured by the specified `config` that counts
+  // its operation in the specified `metrics`.
+  DatadogAgent(const FinalizedDatadogAgentConfig& config, const Clock& clock,
+               const std::shared_ptr<Logger>&, const SpanDefaults& defaults,
+               const std::shared_ptr<Metrics>& metrics);
   ~DatadogAgent();
 
+  // Stop flushing periodically, and send the buffered trace chunks and
+  // statistics to the Datadog Agent, kept trace chunks first.  Return a
+  // future that becomes ready when those requests have completed, or when the
+  // specified `deadline` has passed, whichever is first.  Trace chunks sent
+  // after `shutdown` are sent only by the destructor.  If `shutdown` is called
+  // more than once, then return the result of the first call.  `shutdown`
+  // must not be called concurrently with itself.
+  std::shared_future<void> shutdown(
+      std::chrono::steady_clock::time_point deadline);
+
+  // Send the buffered trace chunks and statistics to the Datadog Agent now,
+  // and wait for the requests that are in flight to complete, or for the
+  // specified `deadline` to pass, whichever is first.  Return an error with
+  // code `Error::FLUSH_TIMEOUT` if the deadline passed first.  The waiting is
+  // done by the HTTP client's `drain`, on the calling thread.  Requests that
+  // fail are retried by a later flush, as usual.
+  Expected<void> flush(
+      std::chrono::steady_clock::time_point deadline) override;
+
   Expected<void> send(
       std::vector<std::unique_ptr<SpanData>>&& spans,
       const std::shared_ptr<TraceSampler>& response_handler) override;
+  // Send the specified `spans` as with `send`, encoding the specified
+  // `origin` in each span without adding it to the spans' tags.
+  Expected<void> send_with_origin(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::string_view origin) override;
+  // Send the specified `spans` as with `send_with_origin`, and apply the
+  // specified `span_sampler`, if any, to them when they are flushed.  If
+  // statistics are computed or chunks are encoded as they arrive, then the
+  // span sampler is applied immediately instead, since both need the spans'
+  // final tags.  If tail sampling is enabled, then the spans are first given
+  // to the `TailSampler`, along with the specified `sampling_mechanism`.
+  Expected<void> send_unsampled(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::optional<std::string_view> origin,
+      const std::shared_ptr<SpanSampler>& span_sampler,
+      std::optional<int> sampling_mechanism) override;
 
   nlohmann::json config_json() const override;
+
+  // Return the metrics that this `DatadogAgent` counts its operation in.  A
+  // `Tracer` given this `DatadogAgent` as its collector counts its spans in
+  // them too.
+  const std::shared_ptr<Metrics>& metrics() const;
 };
 
+// Return a `DatadogAgent` configured by the specified `config` that can be
+// shared by multiple tracers, or return an error if `config` is invalid.  Log
+// using the specified `logger`, and read time from the specified `clock`.  The
+// specified `defaults` are the span properties that are pre-encoded for
+// efficiency; spans having other properties are encoded as usual.  If stats
+// computation is enabled, then the stats payloads are labelled with the
+// service, environment, and version of `defaults`, and so tracers that share
+// the `DatadogAgent` should then have the same environment and version.
+Expected<std::shared_ptr<DatadogAgent>> make_shared_datadog_agent(
+    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
+    const SpanDefaults& defaults, const Clock& clock = default_clock);
+
 }  // namespace tracing
 }  // namespace datadog
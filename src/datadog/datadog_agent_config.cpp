@@ -3,13 +3,49 @@
 #include <algorithm>
 #include <cstddef>
 
+#ifndef _MSC_VER
+#include <sys/stat.h>
+#endif
+
 #include "default_http_client.h"
 #include "environment.h"
+#include "gzip.h"
 #include "parse_util.h"
 #include "threaded_event_scheduler.h"
 
 namespace datadog {
 namespace tracing {
+namespace {
+
+// Return whether there is a Unix domain socket at the specified `path`.
+bool is_unix_socket(const std::string& path) {
+#ifdef _MSC_VER
+  (void)path;
+  return false;
+#else
+  struct stat status;
+  return !path.empty() && ::stat(path.c_str(), &status) == 0 &&
+         S_ISSOCK(status.st_mode);
+#endif
+}
+
+// Return the nonempty items of the specified comma-separated `input`.
+std::vector<std::string> parse_url_list(std::string_view input) {
+  std::vector<std::string> urls;
+  std::string_view rest = input;
+  while (!rest.empty()) {
+    const auto comma = rest.find(',');
+    const auto item = strip(rest.substr(0, comma));
+    if (!item.empty()) {
+      urls.emplace_back(item);
+    }
+    rest = comma == std::string_view::npos ? std::string_view{}
+                                           : rest.substr(comma + 1);
+  }
+  return urls;
+}
+
+}  // namespace
 
 Expected<HTTPClient::URL> DatadogAgentConfig::parse(std::string_view input) {
   const std::string_view separator = "://";
@@ -83,27 +119,146 @@ Expected<HTTPClient::URL> DatadogAgentConfig::parse(std::string_view input) {
       std::string(range(after_authority, authority_and_path.end()))};
 }
 
-Expected<FinalizedDatadogAgentConfig> finalize_config(
-    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger) {
-  FinalizedDatadogAgentConfig result;
+Expected<HTTPClient::URL> DatadogAgentConfig::parse_dogstatsd(
+    std::string_view input) {
+  const auto invalid = [&](std::string_view reason) {
+    std::string message;
+    message += "Invalid DogStatsD URL \"";
+    message += input;
+    message += "\": ";
+    message += reason;
+    return Error{Error::DATADOG_AGENT_INVALID_DOGSTATSD_URL,
+                 std::move(message)};
+  };
+
+  const std::string_view separator = "://";
+  const auto found = input.find(separator);
+  if (found == std::string_view::npos) {
+    return invalid("missing the \"://\" separator.");
+  }
+  const std::string_view scheme = input.substr(0, found);
+  const std::string_view rest = input.substr(found + separator.size());
+
+  if (scheme == "unix") {
+    if (rest.empty() || rest[0] != '/') {
+      return invalid("the socket path must be absolute.");
+    }
+    return HTTPClient::URL{std::string(scheme), std::string(rest), ""};
+  }
+  if (scheme != "udp") {
+    return invalid("the scheme must be either \"udp\" or \"unix\".");
+  }
+
+  // The authority is "<host>" or "<host>:<port>", where the host might be a
+  // bracketed IPv6 address.
+  std::string_view host = rest;
+  std::string_view port = "8125";
+  const auto colon = rest.rfind(':');
+  if (colon != std::string_view::npos &&
+      rest.find(']', colon) == std::string_view::npos) {
+    host = rest.substr(0, colon);
+    port = rest.substr(colon + 1);
+  }
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  if (host.empty()) {
+    return invalid("the host is missing.");
+  }
+  auto port_number = parse_uint64(port, 10);
+  if (!port_number || *port_number == 0 || *port_number > 65535) {
+    return invalid("the port must be a number between 1 and 65535.");
+  }
+  std::string authority{host};
+  authority += ':';
+  authority += std::to_string(*port_number);
+  return HTTPClient::URL{std::string(scheme), std::move(authority), ""};
+}
 
+Expected<void> create_deferred_components(
+    FinalizedDatadogAgentConfig& config,
+    const std::shared_ptr<Logger>& logger) {
   if (!config.http_client) {
-    result.http_client = default_http_client(logger);
+    config.http_client =
+        default_http_client(logger, config.background_threads);
     // `default_http_client` might return a `Curl` instance depending on how
     // this library was built.  If it returns `nullptr`, then there's no
     // built-in default, and so the user must provide a value.
-    if (!result.http_client) {
+    if (!config.http_client) {
       return Error{Error::DATADOG_AGENT_NULL_HTTP_CLIENT,
                    "DatadogAgent: HTTP client cannot be null."};
     }
-  } else {
-    result.http_client = config.http_client;
   }
 
+  if (!config.event_scheduler && config.single_background_thread) {
+    config.event_scheduler =
+        default_http_client_event_scheduler(config.http_client);
+  }
   if (!config.event_scheduler) {
-    result.event_scheduler = std::make_shared<ThreadedEventScheduler>();
-  } else {
-    result.event_scheduler = config.event_scheduler;
+    config.event_scheduler = std::make_shared<ThreadedEventScheduler>(
+        config.background_threads, logger);
+  }
+
+  return std::nullopt;
+}
+
+Expected<FinalizedDatadogAgentConfig> finalize_config(
+    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
+    bool defer_components) {
+  FinalizedDatadogAgentConfig result;
+
+  result.http_client = config.http_client;
+  result.event_scheduler = config.event_scheduler;
+
+  result.background_threads.cpus = config.background_thread_cpus;
+  if (auto cpus_env = lookup(environment::DD_TRACE_BACKGROUND_THREAD_CPUS)) {
+    auto cpus = parse_cpu_list(*cpus_env);
+    if (auto* error = cpus.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += environment::name(environment::DD_TRACE_BACKGROUND_THREAD_CPUS);
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    result.background_threads.cpus = std::move(*cpus);
+  }
+  for (const int cpu : result.background_threads.cpus) {
+    if (cpu < 0) {
+      return Error{Error::INVALID_THREAD_PLACEMENT,
+                   "DatadogAgent: Background thread CPU indices must not be "
+                   "negative."};
+    }
+  }
+  result.background_threads.nice = config.background_thread_nice;
+  if (auto nice_env = lookup(environment::DD_TRACE_BACKGROUND_THREAD_NICE)) {
+    auto nice = parse_int(*nice_env, 10);
+    if (auto* error = nice.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += environment::name(environment::DD_TRACE_BACKGROUND_THREAD_NICE);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    result.background_threads.nice = *nice;
+  }
+  if (result.background_threads.nice &&
+      (*result.background_threads.nice < -20 ||
+       *result.background_threads.nice > 19)) {
+    return Error{Error::INVALID_THREAD_PLACEMENT,
+                 "DatadogAgent: Background thread nice value must be between "
+                 "-20 and 19."};
+  }
+  result.single_background_thread = config.single_background_thread;
+  if (auto single_env =
+          lookup(environment::DD_TRACE_SINGLE_BACKGROUND_THREAD)) {
+    result.single_background_thread = !falsy(*single_env);
+  }
+
+  if (!defer_components) {
+    auto created = create_deferred_components(result, logger);
+    if (auto* error = created.if_error()) {
+      return std::move(*error);
+    }
   }
 
   if (config.flush_interval_milliseconds <= 0) {
@@ -114,18 +269,317 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
   result.flush_interval =
       std::chrono::milliseconds(config.flush_interval_milliseconds);
 
+  if (config.flush_jitter_milliseconds < 0 ||
+      config.flush_jitter_milliseconds >= config.flush_interval_milliseconds) {
+    return Error{Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL,
+                 "DatadogAgent: Flush jitter must be a nonnegative number of "
+                 "milliseconds less than the flush interval."};
+  }
+  result.randomize_flush_phase = config.randomize_flush_phase;
+  result.early_first_flush = config.early_first_flush;
+  result.flush_jitter =
+      std::chrono::milliseconds(config.flush_jitter_milliseconds);
+
+  if (config.adaptive_flush_interval) {
+    if (config.max_flush_interval_milliseconds <
+        config.flush_interval_milliseconds) {
+      return Error{Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL,
+                   "DatadogAgent: Maximum flush interval must be at least the "
+                   "flush interval."};
+    }
+    result.max_flush_interval =
+        std::chrono::milliseconds(config.max_flush_interval_milliseconds);
+  }
+
+  if (config.flush_threshold_spans == std::size_t(0) ||
+      config.flush_threshold_bytes == std::size_t(0)) {
+    return Error{Error::DATADOG_AGENT_INVALID_FLUSH_THRESHOLD,
+                 "DatadogAgent: Flush thresholds must be positive, if "
+                 "specified."};
+  }
+  result.flush_threshold_spans = config.flush_threshold_spans;
+  result.flush_threshold_bytes = config.flush_threshold_bytes;
+
+  if (config.max_payload_bytes == 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_MAX_PAYLOAD_BYTES,
+                 "DatadogAgent: Maximum payload size must be positive."};
+  }
+  result.max_payload_bytes = config.max_payload_bytes;
+
+  if (config.compression == PayloadCompression::GZIP) {
+    if (!gzip_supported()) {
+      return Error{Error::GZIP_UNSUPPORTED,
+                   "DatadogAgent: gzip compression was configured, but this "
+                   "library was built without zlib."};
+    }
+    if (config.compression_level < 1 || config.compression_level > 9) {
+      std::string message;
+      message +=
+          "DatadogAgent: Compression level must be between 1 and 9, but ";
+      message += std::to_string(config.compression_level);
+      message += " was configured.";
+      return Error{Error::DATADOG_AGENT_INVALID_COMPRESSION_LEVEL,
+                   std::move(message)};
+    }
+  }
+  result.compression = config.compression;
+  result.compression_level = config.compression_level;
+
+  if (config.max_retry_attempts < 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_RETRY,
+                 "DatadogAgent: Maximum retry attempts must not be negative."};
+  }
+  if (config.retry_backoff_milliseconds <= 0 ||
+      config.max_retry_backoff_milliseconds <
+          config.retry_backoff_milliseconds) {
+    return Error{Error::DATADOG_AGENT_INVALID_RETRY,
+                 "DatadogAgent: Retry backoff must be a positive number of "
+                 "milliseconds, and must not exceed the maximum retry "
+                 "backoff."};
+  }
+  result.max_retry_attempts = config.max_retry_attempts;
+  result.retry_backoff =
+      std::chrono::milliseconds(config.retry_backoff_milliseconds);
+  result.max_retry_backoff =
+      std::chrono::milliseconds(config.max_retry_backoff_milliseconds);
+
+  if (config.shutdown_timeout_milliseconds < 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_SHUTDOWN_TIMEOUT,
+                 "DatadogAgent: Shutdown timeout must not be a negative number "
+                 "of milliseconds."};
+  }
+  result.shutdown_timeout =
+      std::chrono::milliseconds(config.shutdown_timeout_milliseconds);
+
+  result.encode_on_send = config.encode_on_send;
+  result.encoder_threads = config.encoder_threads;
+
+  if (config.max_buffered_spans == std::size_t(0) ||
+      config.max_buffered_bytes == std::size_t(0)) {
+    return Error{Error::DATADOG_AGENT_INVALID_BUFFER_LIMIT,
+                 "DatadogAgent: Buffer limits must be positive, if specified."};
+  }
+  result.max_buffered_spans = config.max_buffered_spans;
+  result.max_buffered_bytes = config.max_buffered_bytes;
+  result.buffer_overflow_policy = config.buffer_overflow_policy;
+  result.buffer_shards =
+      config.shard_buffer_by_numa_node ? numa_node_count() : 1;
+
+  result.tail_sampling_enabled = config.tail_sampling_enabled;
+  if (auto tail_env = lookup(environment::DD_TRACE_TAIL_SAMPLING_ENABLED)) {
+    result.tail_sampling_enabled = !falsy(*tail_env);
+  }
+  if (config.tail_sampling_window_milliseconds <= 0 ||
+      config.tail_sampling_max_bytes == 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_TAIL_SAMPLING,
+                 "DatadogAgent: Tail sampling window and memory limit must be "
+                 "positive."};
+  }
+  if ((config.tail_sampling_min_duration_milliseconds &&
+       *config.tail_sampling_min_duration_milliseconds < 0) ||
+      config.tail_sampling_min_spans == std::size_t(0)) {
+    return Error{Error::DATADOG_AGENT_INVALID_TAIL_SAMPLING,
+                 "DatadogAgent: Tail sampling minimum duration must not be "
+                 "negative, and minimum span count must be positive, if "
+                 "specified."};
+  }
+  result.tail_sampling_window =
+      std::chrono::milliseconds(config.tail_sampling_window_milliseconds);
+  result.tail_sampling_max_bytes = config.tail_sampling_max_bytes;
+  if (config.tail_sampling_min_duration_milliseconds) {
+    result.tail_sampling_min_duration = std::chrono::milliseconds(
+        *config.tail_sampling_min_duration_milliseconds);
+  }
+  result.tail_sampling_min_spans = config.tail_sampling_min_spans;
+
+  result.normalize_resources = config.normalize_resources;
+  result.resource_cache_entries = config.resource_cache_entries;
+  result.normalize_spans = config.normalize_spans;
+
+  if (!config.span_processors.empty() && config.encode_on_send) {
+    return Error{Error::DATADOG_AGENT_INVALID_SPAN_PROCESSORS,
+                 "DatadogAgent: Span processors are incompatible with "
+                 "encode_on_send, whose trace chunks are encoded as they are "
+                 "sent."};
+  }
+  for (const auto& processor : config.span_processors) {
+    if (!processor) {
+      return Error{Error::DATADOG_AGENT_INVALID_SPAN_PROCESSORS,
+                   "DatadogAgent: Span processors must not be null."};
+    }
+  }
+  result.span_processors = config.span_processors;
+
+  if (config.spool_directory) {
+    if (config.spool_directory->empty()) {
+      return Error{Error::DATADOG_AGENT_INVALID_SPOOL,
+                   "DatadogAgent: Spool directory must not be empty, if "
+                   "specified."};
+    }
+    if (config.spool_max_bytes < 64 * 1024) {
+      return Error{Error::DATADOG_AGENT_INVALID_SPOOL,
+                   "DatadogAgent: Spool size must be at least 64 KiB."};
+    }
+  }
+  result.spool_directory = config.spool_directory;
+  result.spool_max_bytes = config.spool_max_bytes;
+
+  result.stats_computation_enabled = config.stats_computation_enabled;
+  if (auto stats_env =
+          lookup(environment::DD_TRACE_STATS_COMPUTATION_ENABLED)) {
+    result.stats_computation_enabled = !falsy(*stats_env);
+  }
+
+  result.health_metrics_enabled = config.health_metrics_enabled;
+  if (auto health_env = lookup(environment::DD_TRACE_HEALTH_METRICS_ENABLED)) {
+    result.health_metrics_enabled = !falsy(*health_env);
+  }
+  if (result.health_metrics_enabled &&
+      config.health_metrics_interval_milliseconds <= 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_HEALTH_METRICS_INTERVAL,
+                 "DatadogAgent: Health metrics interval must be a positive "
+                 "number of milliseconds."};
+  }
+  result.runtime_metrics_enabled = config.runtime_metrics_enabled;
+  if (auto runtime_env = lookup(environment::DD_RUNTIME_METRICS_ENABLED)) {
+    result.runtime_metrics_enabled = !falsy(*runtime_env);
+  }
+  if (result.runtime_metrics_enabled &&
+      config.runtime_metrics_interval_milliseconds <= 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_RUNTIME_METRICS_INTERVAL,
+                 "DatadogAgent: Runtime metrics interval must be a positive "
+                 "number of milliseconds."};
+  }
+  result.flush_summary_enabled = config.flush_summary_enabled;
+  if (auto debug_env = lookup(environment::DD_TRACE_DEBUG)) {
+    result.flush_summary_enabled = !falsy(*debug_env);
+  }
+  if (result.flush_summary_enabled &&
+      config.flush_summary_interval_milliseconds <= 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_FLUSH_SUMMARY_INTERVAL,
+                 "DatadogAgent: Flush summary interval must be a positive "
+                 "number of milliseconds."};
+  }
+  result.flush_summary_interval =
+      std::chrono::milliseconds(config.flush_summary_interval_milliseconds);
+  // The DogStatsD configuration is validated only if it's used, since other
+  // DogStatsD clients in the process might share `DD_DOGSTATSD_URL`.
+  if (result.health_metrics_enabled || result.runtime_metrics_enabled) {
+    const auto env_agent_host = lookup(environment::DD_AGENT_HOST);
+    const auto env_host = lookup(environment::DD_DOGSTATSD_HOST);
+    const auto env_port = lookup(environment::DD_DOGSTATSD_PORT);
+    std::string configured;
+    if (auto url_env = lookup(environment::DD_DOGSTATSD_URL)) {
+      configured = *url_env;
+    } else if (env_host || env_port) {
+      configured += "udp://";
+      configured += env_host.value_or(env_agent_host.value_or("localhost"));
+      configured += ':';
+      configured += env_port.value_or("8125");
+    } else if (config.dogstatsd_url) {
+      configured = *config.dogstatsd_url;
+    } else if (is_unix_socket(config.dogstatsd_socket_path)) {
+      configured += "unix://";
+      configured += config.dogstatsd_socket_path;
+    } else {
+      configured += "udp://";
+      configured += env_agent_host.value_or("localhost");
+      configured += ":8125";
+    }
+    auto dogstatsd_url = config.parse_dogstatsd(configured);
+    if (auto* error = dogstatsd_url.if_error()) {
+      return std::move(*error);
+    }
+    result.dogstatsd_url = std::move(*dogstatsd_url);
+  }
+  result.health_metrics_interval =
+      std::chrono::milliseconds(config.health_metrics_interval_milliseconds);
+  result.runtime_metrics_interval =
+      std::chrono::milliseconds(config.runtime_metrics_interval_milliseconds);
+
+  result.agent_discovery_enabled = config.agent_discovery_enabled;
+  if (auto discovery_env =
+          lookup(environment::DD_TRACE_AGENT_DISCOVERY_ENABLED)) {
+    result.agent_discovery_enabled = !falsy(*discovery_env);
+  }
+  if (result.agent_discovery_enabled &&
+      config.agent_discovery_interval_milliseconds <= 0) {
+    return Error{Error::DATADOG_AGENT_INVALID_DISCOVERY_INTERVAL,
+                 "DatadogAgent: Agent discovery interval must be a positive "
+                 "number of milliseconds."};
+  }
+  result.agent_discovery_interval = std::chrono::milliseconds(
+      config.agent_discovery_interval_milliseconds);
+
+  result.remote_configuration_enabled = config.remote_configuration_enabled;
+  if (auto remote_env = lookup(environment::DD_REMOTE_CONFIGURATION_ENABLED)) {
+    result.remote_configuration_enabled = !falsy(*remote_env);
+  }
+  if (result.remote_configuration_enabled &&
+      config.remote_configuration_poll_interval_milliseconds <= 0) {
+    return Error{
+        Error::DATADOG_AGENT_INVALID_REMOTE_CONFIGURATION_POLL_INTERVAL,
+        "DatadogAgent: Remote configuration poll interval must be a positive "
+        "number of milliseconds."};
+  }
+  result.remote_configuration_poll_interval = std::chrono::milliseconds(
+      config.remote_configuration_poll_interval_milliseconds);
+
+  result.api_version = config.api_version;
+  if (auto api_version_env = lookup(environment::DD_TRACE_API_VERSION)) {
+    if (*api_version_env == "v0.4") {
+      result.api_version = TraceAPIVersion::V0_4;
+    } else if (*api_version_env == "v0.5") {
+      result.api_version = TraceAPIVersion::V0_5;
+    } else if (*api_version_env == "otlp") {
+      result.api_version = TraceAPIVersion::OTLP;
+    } else {
+      std::string message;
+      message += "Unsupported Datadog Agent API version \"";
+      message += *api_version_env;
+      message += "\" in environment variable ";
+      message += environment::name(environment::DD_TRACE_API_VERSION);
+      message += ".  The following are supported: v0.4 v0.5 otlp";
+      return Error{Error::DATADOG_AGENT_INVALID_API_VERSION,
+                   std::move(message)};
+    }
+  }
+  if (result.api_version == TraceAPIVersion::OTLP &&
+      (result.stats_computation_enabled || result.agent_discovery_enabled)) {
+    return Error{Error::DATADOG_AGENT_INVALID_API_VERSION,
+                 "DatadogAgent: API version otlp is incompatible with stats "
+                 "computation and with agent discovery, which require a "
+                 "Datadog Agent."};
+  }
+
+  // The workers encode their trace chunks in the "v0.4" format.
+  if (config.shared_memory_ring &&
+      result.api_version != TraceAPIVersion::V0_4) {
+    return Error{Error::DATADOG_AGENT_INVALID_SHARED_MEMORY_RING,
+                 "DatadogAgent: A shared memory ring requires API version "
+                 "v0.4."};
+  }
+  result.shared_memory_ring = config.shared_memory_ring;
+
   auto env_host = lookup(environment::DD_AGENT_HOST);
   auto env_port = lookup(environment::DD_TRACE_AGENT_PORT);
 
-  std::string configured_url = config.url;
+  std::string configured_url;
   if (auto url_env = lookup(environment::DD_TRACE_AGENT_URL)) {
     configured_url = *url_env;
   } else if (env_host || env_port) {
-    configured_url.clear();
     configured_url += "http://";
     configured_url += env_host.value_or("localhost");
     configured_url += ':';
     configured_url += env_port.value_or("8126");
+  } else if (config.url) {
+    configured_url = *config.url;
+  } else if (is_unix_socket(config.unix_socket_path)) {
+    // A Unix domain socket avoids the loopback TCP stack.
+    configured_url += "unix://";
+    configured_url += config.unix_socket_path;
+  } else {
+    configured_url = "http://localhost:8126";
   }
 
   auto url = config.parse(configured_url);
@@ -134,6 +588,50 @@ Expected<FinalizedDatadogAgentConfig> finalize_config(
   }
   result.url = *url;
 
+  std::vector<std::string> mirror_urls = config.mirror_urls;
+  if (auto mirrors_env = lookup(environment::DD_TRACE_AGENT_MIRROR_URLS)) {
+    mirror_urls = parse_url_list(*mirrors_env);
+  }
+  for (const auto& mirror_url : mirror_urls) {
+    auto mirror = config.parse(mirror_url);
+    if (auto* error = mirror.if_error()) {
+      return error->with_prefix("DatadogAgent: Invalid mirror URL: ");
+    }
+    result.mirror_urls.push_back(std::move(*mirror));
+  }
+
+  std::vector<std::string> replica_urls = config.replica_urls;
+  if (auto replicas_env = lookup(environment::DD_TRACE_AGENT_REPLICA_URLS)) {
+    replica_urls = parse_url_list(*replicas_env);
+  }
+  for (const auto& replica_url : replica_urls) {
+    auto replica = config.parse(replica_url);
+    if (auto* error = replica.if_error()) {
+      return error->with_prefix("DatadogAgent: Invalid replica URL: ");
+    }
+    result.replica_urls.push_back(std::move(*replica));
+  }
+
+  result.load_balancing = config.load_balancing;
+  if (auto balancing_env = lookup(environment::DD_TRACE_AGENT_LOAD_BALANCING)) {
+    if (*balancing_env == "round_robin") {
+      result.load_balancing = AgentLoadBalancing::ROUND_ROBIN;
+    } else if (*balancing_env == "least_outstanding_requests") {
+      result.load_balancing = AgentLoadBalancing::LEAST_OUTSTANDING_REQUESTS;
+    } else {
+      std::string message;
+      message += "Unsupported load balancing \"";
+      message += *balancing_env;
+      message += "\" in environment variable ";
+      message += environment::name(environment::DD_TRACE_AGENT_LOAD_BALANCING);
+      message +=
+          ".  The following are supported: round_robin "
+          "least_outstanding_requests";
+      return Error{Error::DATADOG_AGENT_INVALID_LOAD_BALANCING,
+                   std::move(message)};
+    }
+  }
+
   return result;
 }
 
@@ -12,19 +12,55 @@
 // See `tracer_config.h`.
 
 #include <chrono>
+#include <cstddef>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
 #include "expected.h"
 #include "http_client.h"
+#include "thread_placement.h"
 
 namespace datadog {
 namespace tracing {
 
 class EventScheduler;
 class Logger;
+class SharedMemoryRing;
+class SpanProcessor;
+
+// `TraceAPIVersion` is the version of the Datadog Agent's traces endpoint to
+// which traces are sent.  `V0_4` sends each span as a map containing all of
+// its strings.  `V0_5` sends a table of the distinct strings in a payload, and
+// then sends each span as an array that refers to strings by their index in
+// the table.  `OTLP` isn't the Datadog Agent's: it sends each batch as an
+// OpenTelemetry "ExportTraceServiceRequest" in protobuf to "/v1/traces", such
+// as of an OpenTelemetry Collector or of the Datadog Agent's OTLP receiver,
+// whose URL is then the `DatadogAgent`'s (see `otlp.h`).
+enum class TraceAPIVersion { V0_4, V0_5, OTLP };
+
+// `BufferOverflowPolicy` is which trace chunks a `DatadogAgent` drops when
+// buffering another trace chunk would exceed its configured limits.
+// `DROP_NEWEST` drops the trace chunk being buffered.  `DROP_OLDEST` drops the
+// trace chunks that have been buffered the longest.  `DROP_BY_PRIORITY` drops
+// trace chunks whose sampling priority is `AUTO_DROP` or `USER_DROP`, oldest
+// first, before dropping the oldest of the remaining trace chunks.
+enum class BufferOverflowPolicy { DROP_NEWEST, DROP_OLDEST, DROP_BY_PRIORITY };
+
+// `PayloadCompression` is how a `DatadogAgent` compresses the bodies of its
+// requests to the Datadog Agent.  `GZIP` requires that this library was built
+// with zlib (the default when building with CMake).
+enum class PayloadCompression { NONE, GZIP };
+
+// `AgentLoadBalancing` is how a `DatadogAgent` that has replica Datadog Agents
+// chooses the Agent to which it sends each request of traces.  `ROUND_ROBIN`
+// takes the Agents in turn.  `LEAST_OUTSTANDING_REQUESTS` chooses the Agent
+// having the fewest requests awaiting a response, taking the Agents in turn
+// among those having the same number.
+enum class AgentLoadBalancing { ROUND_ROBIN, LEAST_OUTSTANDING_REQUESTS };
 
 struct DatadogAgentConfig {
   // The `HTTPClient` used to submit traces to the Datadog Agent.  If this
@@ -37,6 +73,28 @@ struct DatadogAgentConfig {
   // Datadog Agent.  If `event_scheduler` is null, then a
   // `ThreadedEventScheduler` instance will be used instead.
   std::shared_ptr<EventScheduler> event_scheduler = nullptr;
+  // The CPUs on which the threads of the default `http_client` and
+  // `event_scheduler` may run, and the nice value of those threads, between
+  // -20 and 19 (see `thread_placement.h`).  The `event_scheduler`'s thread is
+  // the one that encodes and sends trace chunks.  By default, the threads may
+  // run on any CPU, at the process's priority.  Overridden by the
+  // `DD_TRACE_BACKGROUND_THREAD_CPUS` environment variable, a list such as
+  // "2,3,8-11", and by the `DD_TRACE_BACKGROUND_THREAD_NICE` environment
+  // variable.  They have no effect on an `http_client` or `event_scheduler`
+  // that is specified.
+  std::vector<int> background_thread_cpus;
+  std::optional<int> background_thread_nice;
+  // Whether the default `event_scheduler` invokes its events on the thread of
+  // the `http_client`, rather than on a thread of its own, so that the tracer
+  // has one background thread that schedules flushes, encodes the traces, and
+  // performs the requests.  This requires that `event_scheduler` is not
+  // specified and that the `http_client` is the default `Curl` instance (see
+  // `curl_event_scheduler` in `curl.h`); otherwise, a
+  // `ThreadedEventScheduler` is used as usual.  A slow flush then delays the
+  // requests in flight, and a slow response handler delays the flush.
+  // Overridden by the `DD_TRACE_SINGLE_BACKGROUND_THREAD` environment
+  // variable.
+  bool single_background_thread = false;
   // A URL at which the Datadog Agent can be contacted.
   // The following formats are supported:
   //
@@ -45,29 +103,364 @@ struct DatadogAgentConfig {
   // - http+unix://<path to socket>
   // - unix://<path to socket>
   //
-  // The port defaults to 8126 if it is not specified.
-  std::string url = "http://localhost:8126";
+  // The port defaults to 8126 if it is not specified.  Overridden by the
+  // `DD_TRACE_AGENT_URL`, `DD_AGENT_HOST`, and `DD_TRACE_AGENT_PORT`
+  // environment variables.  If none of them, nor `url`, is specified, then the
+  // Agent's Unix domain socket at `unix_socket_path` is used if it exists.
+  // Otherwise, the URL is "http://localhost:8126".
+  std::optional<std::string> url;
+  // Where the Datadog Agent listens on a Unix domain socket by default.  If
+  // this is empty, then no socket is looked for.
+  std::string unix_socket_path = "/var/run/datadog/apm.socket";
+  // Other Datadog Agents to which every request of traces is also sent, e.g.
+  // while migrating from one Agent to another.  Each has the same form as
+  // `url`.  The traces are encoded once, and the destinations share the
+  // request body rather than copying it.  Each mirror has its own retries,
+  // which are limited to `max_payload_bytes` in total, so that a mirror that
+  // is down neither delays nor drops the requests to the others.  Mirrors
+  // receive only requests of traces, and their responses don't set sampling
+  // rates.  Overridden by the `DD_TRACE_AGENT_MIRROR_URLS` environment
+  // variable, a comma-separated list of URLs.
+  std::vector<std::string> mirror_urls;
+  // Other Datadog Agents among which, together with `url`, requests of traces
+  // are distributed, e.g. several replicas of the Agent on a dense host, or a
+  // node-local and a cluster-level Agent.  Each has the same form as `url`.
+  // Each request is sent to one Agent, chosen per `load_balancing`.  An Agent
+  // that fails a request, or that responds with status 429 or 5xx, is skipped
+  // for `retry_backoff_milliseconds`, doubling with each consecutive failure
+  // up to `max_retry_backoff_milliseconds`, and its failed requests are
+  // retried on the others.  If every Agent is being skipped, then they're all
+  // used.  Each Agent's most recent sampling rates are averaged, so that a
+  // trace's sampling doesn't depend on which Agent responded last.
+  // Statistics, agent discovery, and remote configuration use `url` alone.
+  // Overridden by the `DD_TRACE_AGENT_REPLICA_URLS` environment variable, a
+  // comma-separated list of URLs.
+  std::vector<std::string> replica_urls;
+  // How requests of traces are distributed among `url` and `replica_urls`.
+  // Overridden by the `DD_TRACE_AGENT_LOAD_BALANCING` environment variable,
+  // either "round_robin" or "least_outstanding_requests".
+  AgentLoadBalancing load_balancing = AgentLoadBalancing::ROUND_ROBIN;
   // How often, in milliseconds, to send batches of traces to the Datadog Agent.
   int flush_interval_milliseconds = 2000;
+  // Whether to send the first batch after a random fraction of the flush
+  // interval, rather than after the whole interval, and by how many
+  // milliseconds, at most, to randomly lengthen or shorten each interval
+  // thereafter.  Processes that are started together, e.g. by an
+  // orchestrator, then send their batches at different times, rather than in
+  // bursts.  `flush_jitter_milliseconds` must be less than
+  // `flush_interval_milliseconds`.  Both require an `event_scheduler` that
+  // supports jitter, such as the default `ThreadedEventScheduler`.
+  bool randomize_flush_phase = false;
+  int flush_jitter_milliseconds = 0;
+  // Whether the first trace chunk to arrive wakes the first flush, rather
+  // than waiting for the rest of the flush interval.  Until the Datadog Agent
+  // first responds, the trace sampler has no Agent rates, and so keeps every
+  // trace, which is costly when many processes start at once.  Only the first
+  // flush is early; the flush interval applies thereafter.  Has no effect if
+  // `api_version` is `OTLP`, whose responses have no rates.
+  bool early_first_flush = false;
+  // Whether to lengthen the flush interval while the Datadog Agent is in
+  // distress, i.e. while it responds with status 429 or 503, or can't be
+  // reached.  The interval doubles after each flush interval in which a
+  // request met distress, up to `max_flush_interval_milliseconds`, and halves
+  // after each in which requests succeeded without distress, down to
+  // `flush_interval_milliseconds`.  Meanwhile the buffered trace chunks are
+  // sent in fewer, larger requests.  They remain limited by
+  // `max_buffered_spans` and `max_buffered_bytes`, and they're sent early if
+  // they reach a flush threshold or `max_payload_bytes`.
+  bool adaptive_flush_interval = false;
+  int max_flush_interval_milliseconds = 30000;
+  // The number of buffered spans, and the estimated number of buffered encoded
+  // bytes, at which to send a batch of traces before the end of the flush
+  // interval.  The early flush happens on the `event_scheduler`'s thread, not
+  // on the thread that finished the trace, and so requires an
+  // `event_scheduler` that supports waking recurring events, such as the
+  // default `ThreadedEventScheduler`.  Both thresholds are optional; by
+  // default, traces are sent only at the flush interval.
+  std::optional<std::size_t> flush_threshold_spans;
+  std::optional<std::size_t> flush_threshold_bytes;
+  // The size, in encoded bytes, at which a batch of traces is split into
+  // another request to the Datadog Agent.  Requests are split between trace
+  // chunks, and so a request can exceed `max_payload_bytes` by at most one
+  // trace chunk.  The requests of a batch are sent concurrently.  If
+  // `encode_on_send` is true and `api_version` is `V0_5`, then the trace chunks
+  // share a string table, and so a batch is always sent as one request.
+  std::size_t max_payload_bytes = 10 * 1024 * 1024;
+  // How to compress request bodies, and the compression level, which is
+  // between 1 (fastest) and 9 (smallest).  Compression happens when traces are
+  // flushed, and so doesn't delay the threads that finish traces.
+  // `max_payload_bytes` applies to the uncompressed size.
+  PayloadCompression compression = PayloadCompression::NONE;
+  int compression_level = 6;
+  // How many times to retry a request to the Datadog Agent that failed,
+  // either because the request could not be completed or because the Agent
+  // responded with a retryable status (408, 429, or 5xx).  Zero disables
+  // retries.  A retry is sent by the first flush after its backoff elapses.
+  // The backoff starts at `retry_backoff_milliseconds` and doubles with each
+  // attempt, up to `max_retry_backoff_milliseconds`.  Each backoff is randomly
+  // shortened by up to half, so that many tracers don't retry in unison when
+  // an Agent restarts.  Requests awaiting retry count against
+  // `max_buffered_bytes` or, if it's not set, are limited to
+  // `max_payload_bytes` in total.
+  int max_retry_attempts = 3;
+  int retry_backoff_milliseconds = 1000;
+  int max_retry_backoff_milliseconds = 30000;
+  // How long, in milliseconds, the `DatadogAgent`'s destructor waits for the
+  // requests that it sends when shutting down, unless `DatadogAgent::shutdown`
+  // was called with a deadline already.  Zero means don't wait.
+  int shutdown_timeout_milliseconds = 2000;
+  // Which version of the Datadog Agent's traces endpoint to use.  Overridden
+  // by the `DD_TRACE_API_VERSION` environment variable, which is "v0.4",
+  // "v0.5", or "otlp".  Responses to `OTLP` requests don't contain sampling
+  // rates, and `OTLP` is incompatible with `stats_computation_enabled` and
+  // with `agent_discovery_enabled`, which require a Datadog Agent.
+  TraceAPIVersion api_version = TraceAPIVersion::V0_4;
+  // Whether to encode each trace chunk as soon as it is sent to the
+  // `DatadogAgent`, rather than all at once when traces are flushed.  Encoding
+  // on send frees each trace's span data before `Collector::send` returns, and
+  // spreads the cost of encoding over the threads that finish traces.
+  bool encode_on_send = false;
+  // The number of threads, in addition to the flush's own, that encode the
+  // trace chunks of large flushes in parallel (see `worker_pool.h`).  Each
+  // thread encodes groups of consecutive trace chunks into buffers of its
+  // own, which are then sent without being copied.  Zero, the default,
+  // encodes on the flush's thread alone.  Parallel encoding applies only if
+  // `api_version` is `V0_4` or `OTLP` and `encode_on_send` is false.
+  std::size_t encoder_threads = 0;
+  // The maximum number of spans, and the maximum estimated number of encoded
+  // bytes, to buffer between flushes.  If either limit would be exceeded,
+  // then trace chunks are dropped according to `buffer_overflow_policy`, and
+  // the number dropped is reported to the Datadog Agent with the next batch of
+  // traces.  The limits are optional; by default, buffering is unbounded.
+  //
+  // Unless `encode_on_send` is true, the encoded size of a trace chunk is
+  // estimated from the average encoded size of previously flushed spans.  If
+  // `encode_on_send` is true and `api_version` is `V0_5`, then the buffered
+  // trace chunks share a string table, and so only the newest trace chunk can
+  // be dropped, regardless of `buffer_overflow_policy`.
+  std::optional<std::size_t> max_buffered_spans;
+  std::optional<std::size_t> max_buffered_bytes;
+  BufferOverflowPolicy buffer_overflow_policy =
+      BufferOverflowPolicy::DROP_NEWEST;
+  // Whether to divide the buffer of trace chunks into a shard per NUMA node of
+  // the host, so that threads on different nodes that finish traces at the
+  // same time don't contend for the same cache lines.  Each thread sends to
+  // the shard of the node on which it's running, and each flush takes from
+  // every shard.  The buffer limits apply to all of the shards together.  On
+  // hosts having one NUMA node, and on platforms other than Linux, there is
+  // one shard regardless (see `thread_placement.h`).
+  bool shard_buffer_by_numa_node = false;
+  // Whether to decide whether to keep the traces that sampling dropped once
+  // they have finished, from what happened in them (see `tail_sampler.h`).
+  // Trace chunks whose sampling priority is `AUTO_DROP` or `USER_DROP` are
+  // held for `tail_sampling_window_milliseconds` from the arrival of their
+  // trace's first chunk.  A trace is kept if, within the window, any of its
+  // spans has an error, its spans span at least
+  // `tail_sampling_min_duration_milliseconds`, or it has at least
+  // `tail_sampling_min_spans` spans; either criterion can be disabled by
+  // leaving it unset.  The held chunks are limited to an estimated
+  // `tail_sampling_max_bytes` of memory, beyond which the trace sampler's
+  // decision stands.  Held chunks are not yet buffered for sending, and so
+  // dropped traces, as well as the kept traces that wait for their first
+  // interesting chunk, are sent a window later than otherwise, unless they're
+  // flushed explicitly.  Dropped traces are otherwise handled as usual, e.g.
+  // they're encoded only if the Datadog Agent needs them for its statistics.
+  // Overridden by the `DD_TRACE_TAIL_SAMPLING_ENABLED` environment variable.
+  bool tail_sampling_enabled = false;
+  int tail_sampling_window_milliseconds = 10000;
+  std::size_t tail_sampling_max_bytes = 16 * 1024 * 1024;
+  std::optional<int> tail_sampling_min_duration_milliseconds = 1000;
+  std::optional<std::size_t> tail_sampling_min_spans;
+  // Whether to normalize the resource names of SQL and HTTP spans before they
+  // are sent to the Datadog Agent, by obfuscating literals in SQL queries and
+  // templating identifiers in URL paths (see `resource_normalizer.h`).  This
+  // shrinks payloads and keeps resource names from varying with parameters.
+  // Normalization happens when traces are flushed, unless `encode_on_send` or
+  // `stats_computation_enabled` is true, in which case it happens in `send`,
+  // so that the encoded spans and the statistics use the normalized names.
+  // At most `resource_cache_entries` normalized names are cached, replacing
+  // the least recently used.  Zero disables the cache.
+  bool normalize_resources = false;
+  std::size_t resource_cache_entries = 1024;
+  // Whether to make spans acceptable to the Datadog Agent before they are
+  // encoded, by making their strings valid UTF-8 and normalizing their
+  // service and operation names as the Agent would (see
+  // `span_normalizer.h`).  Spans whose tags might contain arbitrary bytes
+  // would otherwise cause the Agent to reject the payloads that contain them.
+  // This happens along with resource normalization, as described above.
+  bool normalize_spans = false;
+  // The processors that modify or drop the spans of each flush, in order,
+  // before they are normalized and encoded (see `span_processor.h`).  They
+  // run on the thread that flushes, instead of on the threads that finish
+  // spans.  They must not be null.  Span processors are incompatible with
+  // `encode_on_send`, since its buffered trace chunks are already encoded.
+  std::vector<std::shared_ptr<SpanProcessor>> span_processors;
+  // A directory in which to spool the requests to the Datadog Agent that
+  // would otherwise be dropped, during an outage of the Agent: requests that
+  // exhausted their retries, and the oldest requests awaiting retry when they
+  // exceed their byte limit.  The spool is a ring of memory-mapped segment
+  // files totalling `spool_max_bytes` (see `disk_spool.h`).  When it's full,
+  // the oldest spooled requests are dropped.  Spooled requests are sent again,
+  // at most `max_payload_bytes` per flush, by flushes that have no failed
+  // requests to retry.  The Agent's responses to them are not given to the
+  // samplers.  By default, or if the spool can't be created, requests are
+  // dropped instead.  Spooling is not supported on Windows.
+  std::optional<std::string> spool_directory;
+  std::size_t spool_max_bytes = 64 * 1024 * 1024;
+  // A ring to which the worker processes of a multi-process server write
+  // their trace chunks (see `shared_memory_ring.h`), which the `DatadogAgent`
+  // drains at each flush, sending the chunks along with its own.  Only one
+  // `DatadogAgent` in the server may drain the ring, and it must use
+  // `api_version` `V0_4`.  The ring's buffers must be large enough for a
+  // flush interval's worth of each worker's trace chunks.
+  std::shared_ptr<SharedMemoryRing> shared_memory_ring;
+  // Whether to compute APM statistics in the tracer, rather than in the
+  // Datadog Agent.  If true, then statistics are sent to the Agent's stats
+  // endpoint, and trace chunks whose sampling priority is `AUTO_DROP` or
+  // `USER_DROP` are dropped before they are encoded, except for spans kept by
+  // span sampling.  This requires a Datadog Agent that supports the "v0.6"
+  // stats endpoint.  Overridden by the `DD_TRACE_STATS_COMPUTATION_ENABLED`
+  // environment variable.
+  bool stats_computation_enabled = false;
+  // Whether to send the tracer's health metrics (see `metrics.h`) to
+  // DogStatsD, every `health_metrics_interval_milliseconds`, from the
+  // `event_scheduler`.  Counters are sent as the increase since the previous
+  // interval.  Overridden by the `DD_TRACE_HEALTH_METRICS_ENABLED` environment
+  // variable.
+  bool health_metrics_enabled = false;
+  int health_metrics_interval_milliseconds = 10000;
+  // Whether to send the process's runtime metrics (CPU time, resident memory,
+  // thread count, and heap usage; see `runtime_metrics.h`) to DogStatsD,
+  // every `runtime_metrics_interval_milliseconds`, from the `event_scheduler`.
+  // They have the same tags as the health metrics, including the service,
+  // environment, and version.  Overridden by the `DD_RUNTIME_METRICS_ENABLED`
+  // environment variable.
+  bool runtime_metrics_enabled = false;
+  int runtime_metrics_interval_milliseconds = 10000;
+  // Whether to log a summary of the stages of the flushes (see
+  // `MetricsSnapshot::flush_swap_duration`) every
+  // `flush_summary_interval_milliseconds`, from the `event_scheduler`, if
+  // there were any flushes since the previous summary.  The summary is logged
+  // by `Logger::log_startup`.  Overridden by the `DD_TRACE_DEBUG` environment
+  // variable.
+  bool flush_summary_enabled = false;
+  int flush_summary_interval_milliseconds = 60000;
+  // Where DogStatsD listens for health and runtime metrics, either
+  // "udp://<host>:<port>" or "unix://<path to datagram socket>".  The port
+  // defaults to 8125 if it is not specified.  Overridden by the
+  // `DD_DOGSTATSD_URL`, `DD_DOGSTATSD_HOST`, and `DD_DOGSTATSD_PORT`
+  // environment variables.  If none of them, nor `dogstatsd_url`, is
+  // specified, then the Agent's DogStatsD socket at `dogstatsd_socket_path` is
+  // used if it exists.  Otherwise, the host is that of `DD_AGENT_HOST`, or
+  // "localhost".  These are used only if `health_metrics_enabled` or
+  // `runtime_metrics_enabled` is true.
+  std::optional<std::string> dogstatsd_url;
+  std::string dogstatsd_socket_path = "/var/run/datadog/dsd.socket";
+  // Whether to ask the Datadog Agent which features it supports, using its
+  // "/info" endpoint, when the `DatadogAgent` is created and every
+  // `agent_discovery_interval_milliseconds` thereafter, from the
+  // `event_scheduler`.  The answer, once it arrives, replaces `api_version`
+  // and `stats_computation_enabled` as of the next flush: the "v0.5" format is
+  // used if the Agent supports it, and statistics are computed, and trace
+  // chunks dropped by sampling are dropped, if the Agent supports both.  If the
+  // Agent doesn't answer, as older Agents don't, then the configured values
+  // are used.  `compression` is unaffected, since the Agent doesn't say
+  // whether it supports compression.  Neither is a `DatadogAgent` that has
+  // `encode_on_send`, since its buffered trace chunks are already encoded.
+  // Overridden by the `DD_TRACE_AGENT_DISCOVERY_ENABLED` environment variable.
+  bool agent_discovery_enabled = false;
+  int agent_discovery_interval_milliseconds = 60000;
+  // Whether to poll the Datadog Agent's remote configuration endpoint, every
+  // `remote_configuration_poll_interval_milliseconds`, from the
+  // `event_scheduler`, and apply the sample rate, rate limit, and tracing kill
+  // switch that it delivers (see `remote_config.h`).  Overridden by the
+  // `DD_REMOTE_CONFIGURATION_ENABLED` environment variable.
+  bool remote_configuration_enabled = false;
+  int remote_configuration_poll_interval_milliseconds = 5000;
 
   static Expected<HTTPClient::URL> parse(std::string_view);
+  // Parse the specified DogStatsD URL.  See `dogstatsd_url`.
+  static Expected<HTTPClient::URL> parse_dogstatsd(std::string_view);
 };
 
 class FinalizedDatadogAgentConfig {
   friend Expected<FinalizedDatadogAgentConfig> finalize_config(
-      const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger);
+      const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
+      bool defer_components);
 
   FinalizedDatadogAgentConfig() = default;
 
  public:
   std::shared_ptr<HTTPClient> http_client;
   std::shared_ptr<EventScheduler> event_scheduler;
+  ThreadPlacement background_threads;
+  bool single_background_thread;
   HTTPClient::URL url;
+  std::vector<HTTPClient::URL> mirror_urls;
+  std::vector<HTTPClient::URL> replica_urls;
+  AgentLoadBalancing load_balancing;
   std::chrono::steady_clock::duration flush_interval;
+  bool randomize_flush_phase;
+  std::chrono::steady_clock::duration flush_jitter;
+  bool early_first_flush;
+  std::optional<std::chrono::steady_clock::duration> max_flush_interval;
+  std::optional<std::size_t> flush_threshold_spans;
+  std::optional<std::size_t> flush_threshold_bytes;
+  std::size_t max_payload_bytes;
+  PayloadCompression compression;
+  int compression_level;
+  int max_retry_attempts;
+  std::chrono::steady_clock::duration retry_backoff;
+  std::chrono::steady_clock::duration max_retry_backoff;
+  std::chrono::steady_clock::duration shutdown_timeout;
+  TraceAPIVersion api_version;
+  bool encode_on_send;
+  std::size_t encoder_threads;
+  std::optional<std::size_t> max_buffered_spans;
+  std::optional<std::size_t> max_buffered_bytes;
+  BufferOverflowPolicy buffer_overflow_policy;
+  std::size_t buffer_shards;
+  bool tail_sampling_enabled;
+  std::chrono::steady_clock::duration tail_sampling_window;
+  std::size_t tail_sampling_max_bytes;
+  std::optional<std::chrono::nanoseconds> tail_sampling_min_duration;
+  std::optional<std::size_t> tail_sampling_min_spans;
+  bool normalize_resources;
+  std::size_t resource_cache_entries;
+  bool normalize_spans;
+  std::vector<std::shared_ptr<SpanProcessor>> span_processors;
+  std::optional<std::string> spool_directory;
+  std::size_t spool_max_bytes;
+  std::shared_ptr<SharedMemoryRing> shared_memory_ring;
+  bool stats_computation_enabled;
+  bool health_metrics_enabled;
+  std::chrono::steady_clock::duration health_metrics_interval;
+  bool runtime_metrics_enabled;
+  std::chrono::steady_clock::duration runtime_metrics_interval;
+  bool flush_summary_enabled;
+  std::chrono::steady_clock::duration flush_summary_interval;
+  HTTPClient::URL dogstatsd_url;
+  bool agent_discovery_enabled;
+  std::chrono::steady_clock::duration agent_discovery_interval;
+  bool remote_configuration_enabled;
+  std::chrono::steady_clock::duration remote_configuration_poll_interval;
 };
 
+// Return a `FinalizedDatadogAgentConfig` from the specified `config` and from
+// any relevant environment variables, or return an error.  If the optionally
+// specified `defer_components` is `true`, then leave the `http_client` and
+// `event_scheduler` that `config` doesn't specify null instead of creating
+// the defaults, whose threads would start.  `create_deferred_components`
+// creates them later.
 Expected<FinalizedDatadogAgentConfig> finalize_config(
-    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger);
+    const DatadogAgentConfig& config, const std::shared_ptr<Logger>& logger,
+    bool defer_components = false);
+
+// Create the default `http_client` and `event_scheduler` of the specified
+// `config`, if they are null, using the specified `logger`.  Return an error
+// if this library was built without a default HTTP client.
+Expected<void> create_deferred_components(
+    FinalizedDatadogAgentConfig& config, const std::shared_ptr<Logger>& logger);
 
 }  // namespace tracing
 }  // namespace datadog
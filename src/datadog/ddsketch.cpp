@@ -0,0 +1,242 @@
+#include "ddsketch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Protobuf fields are prefixed by a key that includes their wire type.
+namespace wire {
+constexpr int FIXED64 = 1;
+constexpr int LENGTH_DELIMITED = 2;
+constexpr int VARINT = 0;
+}  // namespace wire
+
+// The following append protobuf wire format primitives to a `std::string`.
+
+void push_varint(std::string& destination, std::uint64_t value) {
+  while (value >= 0x80) {
+    destination.push_back(char((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  destination.push_back(char(value));
+}
+
+// Append the key of the field having the specified `number` and wire `type`.
+void push_key(std::string& destination, int number, int type) {
+  push_varint(destination, std::uint64_t(number) << 3 | type);
+}
+
+// Append the specified `value` as a little endian 64-bit floating point number.
+void push_fixed64(std::string& destination, double value) {
+  std::uint64_t bits;
+  static_assert(sizeof bits == sizeof value);
+  std::memcpy(&bits, &value, sizeof bits);
+  for (int i = 0; i < 8; ++i) {
+    destination.push_back(char((bits >> (8 * i)) & 0xFF));
+  }
+}
+
+// Append a length delimited field having the specified `number` and the
+// specified encoded `body`.
+void push_message(std::string& destination, int number,
+                  const std::string& body) {
+  push_key(destination, number, wire::LENGTH_DELIMITED);
+  push_varint(destination, body.size());
+  destination += body;
+}
+
+// The coefficients of the cubic polynomial that approximates `log2(1 + s)`
+// for `s` in `[0, 1)`.  They're those of the Datadog sketch libraries, so
+// that the Datadog Agent maps indices to values as this sketch does.
+constexpr double A = 6.0 / 35.0;
+constexpr double B = -3.0 / 5.0;
+constexpr double C = 10.0 / 7.0;
+
+// Return an approximation of the base 2 logarithm of the specified `value`,
+// which must be a positive normal number: the exponent of `value` plus the
+// polynomial of its significand.
+double approximate_log2(double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  const int exponent = int((bits >> 52) & 0x7FF) - 1023;
+  // Replace the exponent with zero, leaving the significand in `[1, 2)`.
+  bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+  double significand;
+  std::memcpy(&significand, &bits, sizeof significand);
+  const double s = significand - 1;
+  return ((A * s + B) * s + C) * s + exponent;
+}
+
+// Return the inverse of `approximate_log2` at the specified `log2`, which
+// solves the polynomial using Cardano's formula.
+double approximate_exp2(double log2) {
+  const double exponent = std::floor(log2);
+  const double d0 = B * B - 3 * A * C;
+  const double d1 =
+      2 * B * B * B - 9 * A * B * C - 27 * A * A * (log2 - exponent);
+  const double p = std::cbrt((d1 - std::sqrt(d1 * d1 - 4 * d0 * d0 * d0)) / 2);
+  const double significand = -(B + p + d0 / p) / (3 * A) + 1;
+  return std::ldexp(significand, int(exponent));
+}
+
+}  // namespace
+
+DDSketch::DDSketch(double relative_accuracy, int max_bins)
+    // The polynomial's slope relative to that of `log2` is at least
+    // `C * ln(2)`, and so the bins are narrowed by that factor.
+    : gamma_(std::pow((1 + relative_accuracy) / (1 - relative_accuracy),
+                      C * std::log(2.0))),
+      multiplier_(1 / std::log2(gamma_)),
+      offset_(0),
+      max_bins_(max_bins),
+      zero_count_(0) {
+  assert(relative_accuracy > 0 && relative_accuracy < 1);
+  assert(max_bins > 0);
+}
+
+int DDSketch::index(double value) const {
+  const double index = approximate_log2(value) * multiplier_;
+  // This is `std::floor`, but cheaper.
+  const int truncated = int(index);
+  return index < truncated ? truncated - 1 : truncated;
+}
+
+void DDSketch::add(double value) {
+  if (!std::isfinite(value)) {
+    return;
+  }
+  // Subnormal values, which are too small to be durations, don't have the
+  // exponent that `approximate_log2` requires.
+  if (value < std::numeric_limits<double>::min()) {
+    ++zero_count_;
+    return;
+  }
+  add_to_bin(index(value), 1);
+}
+
+void DDSketch::add_to_bin(int index, std::uint32_t count) {
+  if (bins_.empty()) {
+    offset_ = index;
+    bins_.push_back(count);
+    return;
+  }
+
+  const int high = std::max(index, offset_ + int(bins_.size()) - 1);
+  const int low = std::max(std::min(index, offset_), high - max_bins_ + 1);
+  if (low < offset_) {
+    bins_.insert(bins_.begin(), offset_ - low, 0);
+  } else if (low > offset_) {
+    // Collapse the bins below `low` into the bin at `low`.
+    const auto collapsed =
+        bins_.begin() + std::min(std::size_t(low - offset_), bins_.size());
+    const std::uint32_t sum =
+        std::accumulate(bins_.begin(), collapsed, std::uint32_t(0));
+    bins_.erase(bins_.begin(), collapsed);
+    if (bins_.empty()) {
+      bins_.push_back(0);
+    }
+    bins_.front() += sum;
+  }
+  offset_ = low;
+  if (high - low >= int(bins_.size())) {
+    bins_.resize(high - low + 1, 0);
+  }
+  bins_[std::max(index, low) - low] += count;
+}
+
+void DDSketch::merge(const DDSketch& other) {
+  assert(other.gamma_ == gamma_);
+  zero_count_ += other.zero_count_;
+  for (std::size_t i = 0; i < other.bins_.size(); ++i) {
+    if (other.bins_[i] != 0) {
+      add_to_bin(other.offset_ + int(i), other.bins_[i]);
+    }
+  }
+}
+
+bool DDSketch::empty() const { return bins_.empty() && zero_count_ == 0; }
+
+std::uint64_t DDSketch::count() const {
+  return std::accumulate(bins_.begin(), bins_.end(), zero_count_);
+}
+
+double DDSketch::quantile(double quantile) const {
+  const std::uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  const double rank = quantile * double(total - 1);
+  double seen = double(zero_count_);
+  if (rank < seen) {
+    return 0;
+  }
+  std::size_t i = 0;
+  for (; i + 1 < bins_.size(); ++i) {
+    seen += bins_[i];
+    if (rank < seen) {
+      break;
+    }
+  }
+  // The value is the bin's lower bound, scaled to be within the relative
+  // accuracy of every value in the bin.
+  const double relative_accuracy =
+      1 - 2 / (1 + std::exp(std::log2(gamma_) / C));
+  return approximate_exp2((offset_ + int(i)) / multiplier_) *
+         (1 + relative_accuracy);
+}
+
+void DDSketch::protobuf_encode(std::string& destination) const {
+  // message IndexMapping {
+  //   double gamma = 1;
+  //   double indexOffset = 2;
+  //   Interpolation interpolation = 3;
+  // }
+  // The index offset is zero, which is the default, and so is omitted.  The
+  // interpolation is `CUBIC`.
+  std::string mapping;
+  push_key(mapping, 1, wire::FIXED64);
+  push_fixed64(mapping, gamma_);
+  push_key(mapping, 3, wire::VARINT);
+  push_varint(mapping, 3);
+  push_message(destination, 1, mapping);
+
+  // message Store {
+  //   map<sint32, double> binCounts = 1;
+  //   repeated double contiguousBinCounts = 2 [packed = true];
+  //   sint32 contiguousBinIndexOffset = 3;
+  // }
+  if (!bins_.empty()) {
+    std::string store;
+    push_key(store, 2, wire::LENGTH_DELIMITED);
+    push_varint(store, bins_.size() * 8);
+    for (const std::uint32_t count : bins_) {
+      push_fixed64(store, double(count));
+    }
+    if (offset_ != 0) {
+      // `sint32` is "zigzag" encoded.
+      const auto zigzag =
+          (std::uint32_t(offset_) << 1) ^ -std::uint32_t(offset_ < 0);
+      push_key(store, 3, wire::VARINT);
+      push_varint(store, zigzag);
+    }
+    // This is `positiveValues`.  Negative values are counted as zero, and so
+    // `negativeValues` (field 3) is always empty.
+    push_message(destination, 2, store);
+  }
+
+  if (zero_count_ != 0) {
+    push_key(destination, 4, wire::FIXED64);
+    push_fixed64(destination, double(zero_count_));
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,86 @@
+#pragma once
+
+// This component provides a class, `DDSketch`, that summarizes a distribution
+// of non-negative values with bounded relative error.  See [the paper][1].
+//
+// `StatsConcentrator` uses `DDSketch` for the distribution of span durations
+// that it reports to the Datadog Agent.  See `stats_concentrator.h`.
+//
+// Each value is counted in a bin whose bounds grow geometrically, so that any
+// quantile read from the sketch is within `relative_accuracy` of the true
+// quantile.  The bins are stored contiguously, between the smallest and the
+// largest bin that have a value, as 32-bit counts.  There are at most
+// `max_bins` of them: beyond that, the lowest bins are collapsed into one, so
+// that the accuracy of the highest quantiles, which matter most for
+// latencies, is kept.
+//
+// A value's bin is the logarithm of the value, scaled.  Rather than calling
+// `std::log`, the logarithm is approximated from the binary representation of
+// the value: its exponent, plus a cubic polynomial of its significand.  The
+// bins are made slightly narrower to make up for the approximation.  This is
+// the "cubically interpolated" index mapping of the Datadog sketch libraries,
+// which the Datadog Agent decodes like the exact one.
+//
+// Sketches having the same `relative_accuracy` can be merged.
+//
+// `DDSketch` is encoded as the [protobuf message][2] that the Datadog Agent
+// expects.  Only encoding is provided.
+//
+// [1]: https://arxiv.org/abs/1908.10693
+// [2]: https://github.com/DataDog/sketches-go/blob/master/ddsketch/pb/ddsketch.proto
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+class DDSketch {
+  // `gamma_` is the ratio of the upper bound to the lower bound of each bin,
+  // and `multiplier_` is `1 / log2(gamma_)`.
+  double gamma_;
+  double multiplier_;
+  // `bins_[i]` is the count of values whose index is `offset_ + i`.
+  std::vector<std::uint32_t> bins_;
+  int offset_;
+  int max_bins_;
+  std::uint64_t zero_count_;
+
+  // Return the index of the bin of the specified positive `value`.
+  int index(double value) const;
+  // Add the specified `count` to the bin having the specified `index`,
+  // collapsing the lowest bins if there would be more than `max_bins_`.
+  void add_to_bin(int index, std::uint32_t count);
+
+ public:
+  // Create an empty sketch whose quantiles are within the specified
+  // `relative_accuracy`, which must be between zero and one (exclusive), and
+  // that has at most the specified `max_bins` bins, which must be positive.
+  explicit DDSketch(double relative_accuracy = 0.01, int max_bins = 2048);
+
+  // Count the specified `value`.  Negative values are counted as zero.
+  void add(double value);
+
+  // Add the counts of the specified `other` sketch to this sketch.  The
+  // sketches must have the same relative accuracy.
+  void merge(const DDSketch& other);
+
+  // Return whether no values have been counted.
+  bool empty() const;
+
+  // Return the number of values counted.
+  std::uint64_t count() const;
+
+  // Return an approximation of the specified `quantile`, which is between
+  // zero and one (inclusive), of the counted values.  Return zero if no
+  // values have been counted.
+  double quantile(double quantile) const;
+
+  // Append to the specified `destination` the protobuf encoding of this
+  // sketch.
+  void protobuf_encode(std::string& destination) const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -2,21 +2,44 @@
 
 // This component defines a function, `default_http_client`, that returns either
 // a `Curl` instance or `nullptr` depending on whether libcurl was included in
-// the build.
+// the build.  The `Curl` instance's thread has the specified
+// `ThreadPlacement` (see `thread_placement.h`).
 //
 // `default_http_client` is implemented in either `default_http_client_curl.cpp`
-// or `default_http_client_null.cpp`.
+// or `default_http_client_null.cpp`.  A build without libcurl for Linux can
+// instead use `default_http_client_io_uring.cpp`, which returns an
+// `IoUringHTTPClient` (see `io_uring_http_client.h`).
+//
+// It also defines a function, `default_http_client_event_scheduler`, that
+// returns an `EventScheduler` whose events are invoked on the thread of the
+// specified client, if the client was returned by `default_http_client` and
+// supports that, or returns `nullptr` otherwise.  Only `Curl` supports it (see
+// `curl_event_scheduler` in `curl.h`).
+//
+// Finally, `default_http_client_supports_https` returns whether the client
+// returned by `default_http_client` can send HTTPS requests, as the
+// `AgentlessCollector` does.  The `Curl` client can if the bundled libcurl was
+// built with TLS, which CMake's `DD_TRACE_ENABLE_AGENTLESS` option enables.
 
 #include <memory>
 
+#include "thread_placement.h"
+
 namespace datadog {
 namespace tracing {
 
+class EventScheduler;
 class HTTPClient;
 class Logger;
 
 std::shared_ptr<HTTPClient> default_http_client(
-    const std::shared_ptr<Logger>& logger);
+    const std::shared_ptr<Logger>& logger,
+    const ThreadPlacement& placement = ThreadPlacement{});
+
+std::shared_ptr<EventScheduler> default_http_client_event_scheduler(
+    const std::shared_ptr<HTTPClient>& client);
+
+bool default_http_client_supports_https();
 
 }  // namespace tracing
 }  // namespace datadog
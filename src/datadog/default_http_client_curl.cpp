@@ -1,3 +1,5 @@
+#include <curl/curl.h>
+
 #include "curl.h"
 #include "default_http_client.h"
 
@@ -12,8 +14,19 @@ namespace datadog {
 namespace tracing {
 
 std::shared_ptr<HTTPClient> default_http_client(
-    const std::shared_ptr<Logger>& logger) {
-  return std::make_shared<Curl>(logger);
+    const std::shared_ptr<Logger>& logger, const ThreadPlacement& placement) {
+  CurlConfig config;
+  config.thread_placement = placement;
+  return std::make_shared<Curl>(logger, config);
+}
+
+std::shared_ptr<EventScheduler> default_http_client_event_scheduler(
+    const std::shared_ptr<HTTPClient>& client) {
+  return curl_event_scheduler(std::dynamic_pointer_cast<Curl>(client));
+}
+
+bool default_http_client_supports_https() {
+  return curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_SSL;
 }
 
 }  // namespace tracing
@@ -0,0 +1,27 @@
+#include "default_http_client.h"
+#include "io_uring_http_client.h"
+
+// This file can be included in the build, instead of
+// `default_http_client_curl.cpp` or `default_http_client_null.cpp`, to send to
+// the Datadog Agent without libcurl on Linux.  It provides an implementation
+// of `default_http_client` that returns an `IoUringHTTPClient` instance.
+
+namespace datadog {
+namespace tracing {
+
+std::shared_ptr<HTTPClient> default_http_client(
+    const std::shared_ptr<Logger>& logger, const ThreadPlacement& placement) {
+  IoUringHTTPClientConfig config;
+  config.thread_placement = placement;
+  return std::make_shared<IoUringHTTPClient>(logger, config);
+}
+
+std::shared_ptr<EventScheduler> default_http_client_event_scheduler(
+    const std::shared_ptr<HTTPClient>&) {
+  return nullptr;
+}
+
+bool default_http_client_supports_https() { return false; }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -9,10 +9,17 @@
 namespace datadog {
 namespace tracing {
 
-std::shared_ptr<HTTPClient> default_http_client(
-    const std::shared_ptr<Logger>&) {
+std::shared_ptr<HTTPClient> default_http_client(const std::shared_ptr<Logger>&,
+                                                const ThreadPlacement&) {
   return nullptr;
 }
 
+std::shared_ptr<EventScheduler> default_http_client_event_scheduler(
+    const std::shared_ptr<HTTPClient>&) {
+  return nullptr;
+}
+
+bool default_http_client_supports_https() { return false; }
+
 }  // namespace tracing
 }  // namespace datadog
@@ -3,6 +3,11 @@
 // This component provides an interface, `DictReader`, that represents a
 // read-only key/value mapping of strings.  It's used when extracting trace
 // context from externalized formats: HTTP headers, gRPC metadata, etc.
+//
+// `ContainerDictReader` (see `container_dict_reader.h`) adapts common
+// containers of header fields to this interface, and `IndexedDictReader` (see
+// `indexed_dict_reader.h`) indexes the trace context headers of another
+// `DictReader`.
 
 #include <functional>
 #include <optional>
@@ -24,6 +29,15 @@ class DictReader {
   virtual void visit(
       const std::function<void(std::string_view key, std::string_view value)>&
           visitor) const = 0;
+
+  // Return whether `Tracer::extract_span` should read the trace context from
+  // this object in a single call to `visit`, rather than by calling `lookup`
+  // once for each header of each extraction style.  This is worthwhile for
+  // implementations where `lookup` is a linear scan.  If an implementation
+  // returns `true`, then the views that it passes to the visitor must remain
+  // valid for as long as this object, and header names are matched without
+  // regard to case.  The default implementation returns `false`.
+  virtual bool prefer_visit() const { return false; }
 };
 
 }  // namespace tracing
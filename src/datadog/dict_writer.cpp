@@ -1 +1,13 @@
 #include "dict_writer.h"
+
+namespace datadog {
+namespace tracing {
+
+void DictWriter::set_all(const Entry* entries, std::size_t count) {
+  for (std::size_t i = 0; i < count; ++i) {
+    set(entries[i].key, entries[i].value);
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -7,7 +7,14 @@
 // Note that while the data structure modeled is a mapping, duplicate keys are
 // permitted to result from repeated invocations of `DictWriter::set` with the
 // same key.
+//
+// `DictWriter::set_all` sets several key/value pairs in one call.
+// `Span::inject` uses it, so that an implementation backed by a container that
+// can take a batch of entries at once (e.g. nghttp2 header lists or gRPC
+// metadata) can override it.  The default implementation calls `set` for each
+// entry.
 
+#include <cstddef>
 #include <string_view>
 
 namespace datadog {
@@ -21,6 +28,16 @@ class DictWriter {
   // implementation may, but is not required to, overwrite any previous value at
   // `key`.
   virtual void set(std::string_view key, std::string_view value) = 0;
+
+  struct Entry {
+    std::string_view key;
+    std::string_view value;
+  };
+
+  // Associate each of the specified `count` entries beginning at the
+  // specified `entries` as if by `set`, in order.  The referenced strings are
+  // valid only for the duration of the call.
+  virtual void set_all(const Entry* entries, std::size_t count);
 };
 
 }  // namespace tracing
@@ -0,0 +1,221 @@
+#include "disk_spool.h"
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include "error.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Each body in a segment is preceded by a `RecordHeader`, and padded so that
+// the next header is aligned.
+struct RecordHeader {
+  std::uint64_t body_size;
+  std::uint64_t trace_count;
+  std::uint64_t span_count;
+  std::uint64_t compressed;
+  std::uint64_t api_version;
+  std::uint64_t computed_stats;
+};
+
+std::size_t record_size(std::size_t body_size) {
+  const std::size_t align = alignof(RecordHeader);
+  return sizeof(RecordHeader) + (body_size + align - 1) / align * align;
+}
+
+#ifndef _MSC_VER
+Error spool_error(std::string_view what, const std::string& directory,
+                  int error) {
+  std::string message;
+  message += "Unable to ";
+  message += what;
+  message += " in the spool directory ";
+  message += directory;
+  message += ": ";
+  message += std::strerror(error);
+  return Error{Error::DISK_SPOOL_ERROR, std::move(message)};
+}
+
+// Return a shared mapping of a new file of the specified `size` in the
+// specified `directory`, or return an error.  The file is removed from the
+// directory once it's mapped.
+Expected<char*> map_segment(const std::string& directory, std::size_t size) {
+  std::string path = directory;
+  if (!path.empty() && path.back() != '/') {
+    path += '/';
+  }
+  path += "dd-trace-spool-XXXXXX";
+  const int fd = ::mkstemp(path.data());
+  if (fd < 0) {
+    return spool_error("create a segment file", directory, errno);
+  }
+  ::unlink(path.c_str());
+  if (::ftruncate(fd, off_t(size)) != 0) {
+    const int error = errno;
+    ::close(fd);
+    return spool_error("size a segment file", directory, error);
+  }
+  void* data =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return spool_error("map a segment file", directory, error);
+  }
+  return static_cast<char*>(data);
+}
+#endif
+
+}  // namespace
+
+DiskSpool::DiskSpool(std::size_t segment_size)
+    : segment_size_(segment_size),
+      segments_(num_segments),
+      oldest_(0),
+      used_(0),
+      bytes_(0),
+      count_(0) {}
+
+DiskSpool::~DiskSpool() {
+#ifndef _MSC_VER
+  for (const Segment& segment : segments_) {
+    if (segment.data) {
+      ::munmap(segment.data, segment_size_);
+    }
+  }
+#endif
+}
+
+void DiskSpool::reset(Segment& segment) {
+  segment.read = 0;
+  segment.write = 0;
+  segment.contents = DroppedTraceChunks{};
+}
+
+bool DiskSpool::append(const HTTPClient::BodyChain& body,
+                       std::size_t body_size, bool compressed,
+                       TraceAPIVersion api_version, bool computed_stats,
+                       std::size_t trace_count, std::size_t span_count,
+                       DroppedTraceChunks& dropped) {
+  const std::size_t size = record_size(body_size);
+  if (size > segment_size_) {
+    return false;
+  }
+
+  if (used_ == 0) {
+    used_ = 1;
+  } else if (segments_[(oldest_ + used_ - 1) % num_segments].write + size >
+             segment_size_) {
+    if (used_ == num_segments) {
+      // Drop the oldest segment's remaining requests to reuse it.
+      Segment& oldest = segments_[oldest_];
+      dropped.traces += oldest.contents.traces;
+      dropped.spans += oldest.contents.spans;
+      for (std::size_t offset = oldest.read; offset < oldest.write;) {
+        RecordHeader header;
+        std::memcpy(&header, oldest.data + offset, sizeof header);
+        bytes_ -= header.body_size;
+        --count_;
+        offset += record_size(header.body_size);
+      }
+      reset(oldest);
+      oldest_ = (oldest_ + 1) % num_segments;
+      --used_;
+    }
+    ++used_;
+  }
+
+  Segment& newest = segments_[(oldest_ + used_ - 1) % num_segments];
+  const RecordHeader header{body_size, trace_count, span_count, compressed,
+                            std::uint64_t(api_version), computed_stats};
+  char* destination = newest.data + newest.write;
+  std::memcpy(destination, &header, sizeof header);
+  destination += sizeof header;
+  for (const auto& buffer : body) {
+    std::memcpy(destination, buffer->data(), buffer->size());
+    destination += buffer->size();
+  }
+  newest.write += size;
+  newest.contents.traces += trace_count;
+  newest.contents.spans += span_count;
+  bytes_ += body_size;
+  ++count_;
+  return true;
+}
+
+std::optional<DiskSpool::SpooledRequest> DiskSpool::take() {
+  if (count_ == 0) {
+    return std::nullopt;
+  }
+  Segment& oldest = segments_[oldest_];
+  RecordHeader header;
+  std::memcpy(&header, oldest.data + oldest.read, sizeof header);
+  SpooledRequest request;
+  request.body.assign(oldest.data + oldest.read + sizeof header,
+                      header.body_size);
+  request.compressed = header.compressed != 0;
+  request.api_version = TraceAPIVersion(header.api_version);
+  request.computed_stats = header.computed_stats != 0;
+  request.trace_count = header.trace_count;
+  request.span_count = header.span_count;
+
+  oldest.read += record_size(header.body_size);
+  oldest.contents.traces -= header.trace_count;
+  oldest.contents.spans -= header.span_count;
+  bytes_ -= header.body_size;
+  --count_;
+  if (oldest.read == oldest.write) {
+    reset(oldest);
+    if (used_ > 1) {
+      oldest_ = (oldest_ + 1) % num_segments;
+    }
+    --used_;
+  }
+  return request;
+}
+
+std::size_t DiskSpool::size() const { return count_; }
+
+std::size_t DiskSpool::bytes() const { return bytes_; }
+
+Expected<std::unique_ptr<DiskSpool>> open_disk_spool(
+    const std::string& directory, std::size_t max_bytes) {
+#ifdef _MSC_VER
+  (void)directory;
+  (void)max_bytes;
+  return Error{Error::DISK_SPOOL_ERROR,
+               "Disk spooling is not supported on Windows."};
+#else
+  // Segments are a whole number of pages.
+  const auto page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+  const std::size_t segment_size =
+      max_bytes / DiskSpool::num_segments / page_size * page_size;
+  if (segment_size == 0) {
+    return Error{Error::DISK_SPOOL_ERROR,
+                 "The disk spool is too small for its segments."};
+  }
+  std::unique_ptr<DiskSpool> spool(new DiskSpool(segment_size));
+  for (auto& segment : spool->segments_) {
+    auto data = map_segment(directory, segment_size);
+    if (auto* error = data.if_error()) {
+      return std::move(*error);
+    }
+    segment.data = *data;
+  }
+  return spool;
+#endif
+}
+
+}  // namespace tracing
+}  // namespace datadog
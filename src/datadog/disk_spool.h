@@ -0,0 +1,114 @@
+#pragma once
+
+// This component provides a class, `DiskSpool`, that holds request bodies
+// for the Datadog Agent in memory-mapped files, rather than on the heap, while
+// the Agent can't accept them.
+//
+// The spool is a ring of equally sized segment files.  Each `append` copies
+// a body into the newest segment, after the bodies already there, and so
+// writes are sequential.  When the newest segment is full, the next one in
+// the ring becomes the newest, and if it holds bodies that haven't been
+// taken yet, then they are dropped, oldest first, which caps the spool's size.
+// `take` removes the oldest body.
+//
+// Nothing is flushed to disk explicitly: the operating system writes the
+// segments' pages back when it needs the memory, and not before.  The
+// segment files are removed from the directory as soon as they're mapped,
+// and so the spool doesn't outlive its process, and processes sharing a
+// directory don't interfere with each other.
+//
+// `DiskSpool` is used by `DatadogAgent` to keep the requests that it would
+// otherwise drop during an outage of the Agent.  See
+// `DatadogAgentConfig::spool_directory`.  It's not thread-safe, and it's not
+// supported on Windows.
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "datadog_agent_config.h"
+#include "expected.h"
+#include "http_client.h"
+#include "trace_chunk_buffer.h"
+
+namespace datadog {
+namespace tracing {
+
+class DiskSpool {
+ public:
+  // `SpooledRequest` is a request body taken from the spool, together with
+  // what the `DatadogAgent` needs to send it again.
+  struct SpooledRequest {
+    std::string body;
+    bool compressed = false;
+    TraceAPIVersion api_version = TraceAPIVersion::V0_4;
+    bool computed_stats = false;
+    std::size_t trace_count = 0;
+    std::size_t span_count = 0;
+  };
+
+  static constexpr std::size_t num_segments = 4;
+
+ private:
+  struct Segment {
+    char* data = nullptr;
+    // `read` is the offset of the oldest body not yet taken, and `write` is
+    // where the next body is appended.
+    std::size_t read = 0;
+    std::size_t write = 0;
+    DroppedTraceChunks contents;
+  };
+
+  std::size_t segment_size_;
+  std::vector<Segment> segments_;
+  // The segments in use are the `used_` segments that start at `oldest_`, in
+  // ring order.
+  std::size_t oldest_;
+  std::size_t used_;
+  std::size_t bytes_;
+  std::size_t count_;
+
+  explicit DiskSpool(std::size_t segment_size);
+
+  friend Expected<std::unique_ptr<DiskSpool>> open_disk_spool(
+      const std::string& directory, std::size_t max_bytes);
+
+  // Forget the contents of the specified `segment`.
+  static void reset(Segment& segment);
+
+ public:
+  DiskSpool(const DiskSpool&) = delete;
+  DiskSpool& operator=(const DiskSpool&) = delete;
+  ~DiskSpool();
+
+  // Append the request having the specified `body`, which has the specified
+  // total `body_size`, and the specified `compressed` flag, `api_version`,
+  // `computed_stats` flag, `trace_count`, and `span_count`.  Add the trace
+  // chunks of the requests dropped to make room for it to the specified
+  // `dropped`.  Return false, and append nothing, if the request is larger
+  // than a segment.
+  bool append(const HTTPClient::BodyChain& body, std::size_t body_size,
+              bool compressed, TraceAPIVersion api_version,
+              bool computed_stats, std::size_t trace_count,
+              std::size_t span_count, DroppedTraceChunks& dropped);
+
+  // Remove and return the oldest request, or return null if the spool is
+  // empty.
+  std::optional<SpooledRequest> take();
+
+  // Return the number of requests in the spool, and the total size of their
+  // bodies.
+  std::size_t size() const;
+  std::size_t bytes() const;
+};
+
+// Return a `DiskSpool` whose segment files are created in the specified
+// `directory`, and whose segments total the specified `max_bytes`, or return
+// an error if the segment files can't be created and mapped.
+Expected<std::unique_ptr<DiskSpool>> open_disk_spool(
+    const std::string& directory, std::size_t max_bytes);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,206 @@
+#include "dogstatsd.h"
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <tuple>
+#include <utility>
+
+#include "error.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+#ifndef _MSC_VER
+Error socket_error(std::string_view what, const HTTPClient::URL& url,
+                   std::string_view reason) {
+  std::string message;
+  message += "Unable to ";
+  message += what;
+  message += " for DogStatsD at ";
+  message += url.scheme;
+  message += "://";
+  message += url.authority;
+  message += ": ";
+  message += reason;
+  return Error{Error::DOGSTATSD_SOCKET_ERROR, std::move(message)};
+}
+
+// Return a socket connected to the Unix domain datagram socket at the
+// specified `url`, or return an error.
+Expected<int> connect_unix(const HTTPClient::URL& url) {
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof address);
+  address.sun_family = AF_UNIX;
+  if (url.authority.size() >= sizeof address.sun_path) {
+    return socket_error("connect", url, "The socket path is too long.");
+  }
+  std::memcpy(address.sun_path, url.authority.data(), url.authority.size());
+
+  const int fd = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return socket_error("create a socket", url, std::strerror(errno));
+  }
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                sizeof address) != 0) {
+    const int error = errno;
+    ::close(fd);
+    return socket_error("connect", url, std::strerror(error));
+  }
+  return fd;
+}
+
+// Return a UDP socket connected to the first address of the host and port in
+// the specified `url`, or return an error.
+Expected<int> connect_udp(const HTTPClient::URL& url) {
+  // `authority` is "<host>:<port>", as produced by `parse_dogstatsd`.
+  const auto colon = url.authority.rfind(':');
+  const std::string host = url.authority.substr(0, colon);
+  const std::string port = url.authority.substr(colon + 1);
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* addresses = nullptr;
+  if (const int rc =
+          ::getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses)) {
+    return socket_error("resolve the address", url, ::gai_strerror(rc));
+  }
+
+  Expected<int> result =
+      socket_error("connect", url, "The host has no addresses.");
+  for (const addrinfo* address = addresses; address;
+       address = address->ai_next) {
+    const int fd = ::socket(address->ai_family, address->ai_socktype,
+                            address->ai_protocol);
+    if (fd < 0) {
+      result = socket_error("create a socket", url, std::strerror(errno));
+      continue;
+    }
+    if (::connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+      result = socket_error("connect", url, std::strerror(errno));
+      ::close(fd);
+      continue;
+    }
+    result = fd;
+    break;
+  }
+  ::freeaddrinfo(addresses);
+  return result;
+}
+#endif
+
+}  // namespace
+
+DogStatsD::DogStatsD(int socket) : socket_(socket), dropped_datagrams_(0) {}
+
+DogStatsD::~DogStatsD() {
+#ifndef _MSC_VER
+  ::close(socket_);
+#endif
+}
+
+void DogStatsD::count(std::string_view name, std::uint64_t value,
+                      std::string_view tags) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Look up the metric without allocating a key, since it usually exists.
+  const auto found =
+      metrics_.find(std::make_tuple(name, std::string_view("c"), tags));
+  if (found != metrics_.end()) {
+    found->second += value;
+    return;
+  }
+  metrics_.emplace(Key{std::string(name), "c", std::string(tags)}, value);
+}
+
+void DogStatsD::gauge(std::string_view name, std::uint64_t value,
+                      std::string_view tags) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto found =
+      metrics_.find(std::make_tuple(name, std::string_view("g"), tags));
+  if (found != metrics_.end()) {
+    found->second = value;
+    return;
+  }
+  metrics_.emplace(Key{std::string(name), "g", std::string(tags)}, value);
+}
+
+void DogStatsD::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string datagram;
+  std::string line;
+  for (const auto& [key, value] : metrics_) {
+    const auto& [name, type, tags] = key;
+    line.clear();
+    line += name;
+    line += ':';
+    line += std::to_string(value);
+    line += '|';
+    line += type;
+    if (!tags.empty()) {
+      line += "|#";
+      line += tags;
+    }
+    // Lines are separated by newlines within a datagram.
+    if (!datagram.empty() &&
+        datagram.size() + 1 + line.size() > max_datagram_size) {
+      send(datagram);
+      datagram.clear();
+    }
+    if (!datagram.empty()) {
+      datagram += '\n';
+    }
+    datagram += line;
+  }
+  if (!datagram.empty()) {
+    send(datagram);
+  }
+  metrics_.clear();
+}
+
+void DogStatsD::send(const std::string& datagram) {
+#ifdef _MSC_VER
+  (void)datagram;
+#else
+  // Metrics are best effort, and so failures, such as there being no
+  // DogStatsD server listening or its buffer being full, are only counted.
+  if (::send(socket_, datagram.data(), datagram.size(), MSG_DONTWAIT) < 0) {
+    ++dropped_datagrams_;
+  }
+#endif
+}
+
+std::size_t DogStatsD::dropped_datagrams() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return dropped_datagrams_;
+}
+
+Expected<std::unique_ptr<DogStatsD>> connect_dogstatsd(
+    const HTTPClient::URL& url) {
+#ifdef _MSC_VER
+  (void)url;
+  return Error{Error::DOGSTATSD_SOCKET_ERROR,
+               "DogStatsD is not supported on Windows."};
+#else
+  auto fd = url.scheme == "unix" ? connect_unix(url) : connect_udp(url);
+  if (auto* error = fd.if_error()) {
+    return std::move(*error);
+  }
+  // Sending must not block the event scheduler.
+  ::fcntl(*fd, F_SETFL, ::fcntl(*fd, F_GETFL) | O_NONBLOCK);
+  ::fcntl(*fd, F_SETFD, FD_CLOEXEC);
+  return std::unique_ptr<DogStatsD>(new DogStatsD(*fd));
+#endif
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,87 @@
+#pragma once
+
+// This component provides a class, `DogStatsD`, that sends metrics to a
+// DogStatsD server, such as the one in the Datadog Agent, over UDP or a Unix
+// domain datagram socket.
+//
+// Metrics are aggregated in the client: `count` adds to the count having the
+// same name and tags, and `gauge` replaces the gauge having the same name and
+// tags.  Nothing is sent until `flush`, which sends each aggregated metric as
+// one line of the DogStatsD protocol, packing the lines into as few datagrams
+// as fit within `max_datagram_size`.  Updating a metric is thus cheap enough
+// for frequent events, and `flush` is meant to be called periodically, from
+// an `EventScheduler`.
+//
+// Sending never blocks: a datagram that can't be sent immediately is dropped,
+// as is usual for DogStatsD clients.  `dropped_datagrams` counts them.
+//
+// `DogStatsD` is used by `DatadogAgent` to send the tracer's health metrics.
+// See `DatadogAgentConfig::health_metrics_enabled`.  It's not supported on
+// Windows.
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "expected.h"
+#include "http_client.h"
+
+namespace datadog {
+namespace tracing {
+
+class DogStatsD {
+  // `Key` is the name, the type ("c" or "g"), and the tags of a metric.
+  using Key = std::tuple<std::string, std::string_view, std::string>;
+
+  int socket_;
+  // `mutex_` protects `metrics_` and `dropped_datagrams_`.
+  mutable std::mutex mutex_;
+  std::map<Key, std::uint64_t, std::less<>> metrics_;
+  std::size_t dropped_datagrams_;
+
+  explicit DogStatsD(int socket);
+
+  friend Expected<std::unique_ptr<DogStatsD>> connect_dogstatsd(
+      const HTTPClient::URL& url);
+
+  // Send the specified `datagram`, or count it as dropped.  `mutex_` must be
+  // locked.
+  void send(const std::string& datagram);
+
+ public:
+  // A datagram of this size fits within the usual Ethernet MTU.
+  static constexpr std::size_t max_datagram_size = 1432;
+
+  DogStatsD(const DogStatsD&) = delete;
+  DogStatsD& operator=(const DogStatsD&) = delete;
+  ~DogStatsD();
+
+  // Add the specified `value` to the count having the specified `name` and
+  // comma-separated `tags`, which may be empty.
+  void count(std::string_view name, std::uint64_t value,
+             std::string_view tags);
+  // Set the gauge having the specified `name` and comma-separated `tags`,
+  // which may be empty, to the specified `value`.
+  void gauge(std::string_view name, std::uint64_t value,
+             std::string_view tags);
+
+  // Send the aggregated metrics, and then forget them.
+  void flush();
+
+  // Return the number of datagrams that `flush` couldn't send.
+  std::size_t dropped_datagrams() const;
+};
+
+// Return a `DogStatsD` that sends to the specified `url`, which is the result
+// of `DatadogAgentConfig::parse_dogstatsd`, or return an error if the socket
+// can't be created.
+Expected<std::unique_ptr<DogStatsD>> connect_dogstatsd(
+    const HTTPClient::URL& url);
+
+}  // namespace tracing
+}  // namespace datadog
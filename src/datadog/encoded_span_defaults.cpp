@@ -0,0 +1,49 @@
+#include "encoded_span_defaults.h"
+
+#include "msgpack.h"
+#include "span_defaults.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+EncodedSpanDefaults::Fragment make_fragment(std::string_view key,
+                                            std::string_view value) {
+  EncodedSpanDefaults::Fragment fragment;
+  fragment.value = value;
+  if (!msgpack::pack_string(fragment.encoded, key) ||
+      !msgpack::pack_string(fragment.encoded, value)) {
+    // The value is too large to encode.  Leave the fragment empty, so that
+    // `EncodedSpanDefaults::pack` handles the error.
+    fragment = EncodedSpanDefaults::Fragment{};
+  }
+  return fragment;
+}
+
+}  // namespace
+
+EncodedSpanDefaults::EncodedSpanDefaults(const SpanDefaults& defaults)
+    : service_(make_fragment("service", defaults.service)),
+      service_type_(make_fragment("type", defaults.service_type)),
+      environment_(make_fragment(tags::environment, defaults.environment)),
+      version_(make_fragment(tags::version, defaults.version)) {}
+
+Expected<void> EncodedSpanDefaults::pack(std::string& destination,
+                                         const Fragment& fragment,
+                                         std::string_view key,
+                                         std::string_view value) {
+  if (!fragment.encoded.empty() && value == fragment.value) {
+    destination += fragment.encoded;
+    return std::nullopt;
+  }
+
+  auto result = msgpack::pack_string(destination, key);
+  if (!result) {
+    return result;
+  }
+  return msgpack::pack_string(destination, value);
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,62 @@
+#pragma once
+
+// This component provides a class, `EncodedSpanDefaults`, that holds
+// pre-encoded MessagePack fragments for the span properties that are usually
+// the same for every span produced by a tracer: the service name, the service
+// type, and the "env" and "version" tags.
+//
+// `DatadogAgent` builds an `EncodedSpanDefaults` once, from the tracer's
+// `SpanDefaults`, and passes it to `msgpack_encode` (see `span_data.h`).  When
+// a span's value is the same as the default, the encoder appends the
+// pre-encoded fragment instead of encoding the value again.  A span whose value
+// differs from the default is encoded as usual, so an `EncodedSpanDefaults` can
+// be used with spans from any tracer.
+
+#include <string>
+#include <string_view>
+
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanDefaults;
+
+class EncodedSpanDefaults {
+ public:
+  // A `Fragment` is the MessagePack encoding of a key followed by a string
+  // value.
+  struct Fragment {
+    std::string value;
+    std::string encoded;
+  };
+
+ private:
+  Fragment service_;
+  Fragment service_type_;
+  Fragment environment_;
+  Fragment version_;
+
+ public:
+  // Create an `EncodedSpanDefaults` that matches no values.
+  EncodedSpanDefaults() = default;
+  explicit EncodedSpanDefaults(const SpanDefaults& defaults);
+
+  // The fragments for the "service" and "type" fields of a span, and for the
+  // "env" and "version" entries of a span's "meta" map.
+  const Fragment& service() const { return service_; }
+  const Fragment& service_type() const { return service_type_; }
+  const Fragment& environment() const { return environment_; }
+  const Fragment& version() const { return version_; }
+
+  // Append to the specified `destination` the MessagePack encoding of the
+  // specified `key` followed by the specified `value`.  If `value` is the same
+  // as the value of the specified `fragment`, then append the fragment's
+  // encoding instead.  Return an error if `key` or `value` cannot be encoded.
+  static Expected<void> pack(std::string& destination,
+                             const Fragment& fragment, std::string_view key,
+                             std::string_view value);
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -25,25 +25,61 @@ namespace environment {
 
 // To enforce correspondence between `enum Variable` and `variable_names`, the
 // preprocessor is used so that the DD_* symbols are listed exactly once.
-#define LIST_ENVIRONMENT_VARIABLES(MACRO)     \
-  MACRO(DD_AGENT_HOST)                        \
-  MACRO(DD_ENV)                               \
-  MACRO(DD_PROPAGATION_STYLE_EXTRACT)         \
-  MACRO(DD_PROPAGATION_STYLE_INJECT)          \
-  MACRO(DD_SERVICE)                           \
-  MACRO(DD_SPAN_SAMPLING_RULES)               \
-  MACRO(DD_SPAN_SAMPLING_RULES_FILE)          \
-  MACRO(DD_TAGS)                              \
-  MACRO(DD_TRACE_AGENT_PORT)                  \
-  MACRO(DD_TRACE_AGENT_URL)                   \
-  MACRO(DD_TRACE_DEBUG)                       \
-  MACRO(DD_TRACE_ENABLED)                     \
-  MACRO(DD_TRACE_RATE_LIMIT)                  \
-  MACRO(DD_TRACE_REPORT_HOSTNAME)             \
-  MACRO(DD_TRACE_SAMPLE_RATE)                 \
-  MACRO(DD_TRACE_SAMPLING_RULES)              \
-  MACRO(DD_TRACE_STARTUP_LOGS)                \
-  MACRO(DD_TRACE_TAGS_PROPAGATION_MAX_LENGTH) \
+#define LIST_ENVIRONMENT_VARIABLES(MACRO)            \
+  MACRO(DD_AGENT_HOST)                               \
+  MACRO(DD_API_KEY)                                  \
+  MACRO(DD_DOGSTATSD_HOST)                           \
+  MACRO(DD_DOGSTATSD_PORT)                           \
+  MACRO(DD_DOGSTATSD_URL)                            \
+  MACRO(DD_ENV)                                      \
+  MACRO(DD_PROPAGATION_STYLE_EXTRACT)                \
+  MACRO(DD_PROPAGATION_STYLE_INJECT)                 \
+  MACRO(DD_REMOTE_CONFIGURATION_ENABLED)             \
+  MACRO(DD_RUNTIME_METRICS_ENABLED)                  \
+  MACRO(DD_SERVICE)                                  \
+  MACRO(DD_SITE)                                     \
+  MACRO(DD_SPAN_SAMPLING_RULES)                      \
+  MACRO(DD_SPAN_SAMPLING_RULES_FILE)                 \
+  MACRO(DD_TAGS)                                     \
+  MACRO(DD_TRACE_ACTIVE_SPAN_AS_PARENT)              \
+  MACRO(DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED) \
+  MACRO(DD_TRACE_AGENT_DISCOVERY_ENABLED)            \
+  MACRO(DD_TRACE_AGENT_LOAD_BALANCING)               \
+  MACRO(DD_TRACE_AGENT_MIRROR_URLS)                  \
+  MACRO(DD_TRACE_AGENT_PORT)                         \
+  MACRO(DD_TRACE_AGENT_REPLICA_URLS)                 \
+  MACRO(DD_TRACE_AGENT_URL)                          \
+  MACRO(DD_TRACE_API_VERSION)                        \
+  MACRO(DD_TRACE_BACKGROUND_THREAD_CPUS)             \
+  MACRO(DD_TRACE_BACKGROUND_THREAD_NICE)             \
+  MACRO(DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD)  \
+  MACRO(DD_TRACE_COMPACT_FINISHED_SPANS)             \
+  MACRO(DD_TRACE_COMPRESS_COMPACTED_SPANS)           \
+  MACRO(DD_TRACE_DEBUG)                              \
+  MACRO(DD_TRACE_DEFER_SPAN_SAMPLING)                \
+  MACRO(DD_TRACE_DELEGATE_SAMPLING)                  \
+  MACRO(DD_TRACE_ENABLED)                            \
+  MACRO(DD_TRACE_HEALTH_METRICS_ENABLED)             \
+  MACRO(DD_TRACE_LAZY_STARTUP)                       \
+  MACRO(DD_TRACE_MAX_MEMORY_BYTES)                   \
+  MACRO(DD_TRACE_MAX_SPANS_PER_TRACE)                \
+  MACRO(DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS)     \
+  MACRO(DD_TRACE_OVERHEAD_PROFILING_ENABLED)         \
+  MACRO(DD_TRACE_PARTIAL_FLUSH_ENABLED)              \
+  MACRO(DD_TRACE_PARTIAL_FLUSH_MIN_SPANS)            \
+  MACRO(DD_TRACE_RATE_LIMIT)                         \
+  MACRO(DD_TRACE_REPORT_HOSTNAME)                    \
+  MACRO(DD_TRACE_SAMPLER_RATES_FILE)                 \
+  MACRO(DD_TRACE_SAMPLE_RATE)                        \
+  MACRO(DD_TRACE_SAMPLING_DECISION_AT_ROOT)          \
+  MACRO(DD_TRACE_SAMPLING_RULES)                     \
+  MACRO(DD_TRACE_SINGLE_BACKGROUND_THREAD)           \
+  MACRO(DD_TRACE_SPAN_QUOTAS)                        \
+  MACRO(DD_TRACE_STARTUP_LOGS)                       \
+  MACRO(DD_TRACE_STATS_COMPUTATION_ENABLED)          \
+  MACRO(DD_TRACE_TAGS_PROPAGATION_MAX_LENGTH)        \
+  MACRO(DD_TRACE_TAIL_SAMPLING_ENABLED)              \
+  MACRO(DD_TRACE_TARGET_SPANS_PER_SECOND)            \
   MACRO(DD_VERSION)
 
 #define WITH_COMMA(ARG) ARG,
@@ -66,6 +66,60 @@ struct Error {
     INVALID_DOUBLE = 42,
     MISSING_TRACE_ID = 43,
     ENVOY_HTTP_CLIENT_FAILURE = 44,
+    DATADOG_AGENT_INVALID_API_VERSION = 45,
+    DATADOG_AGENT_INVALID_BUFFER_LIMIT = 46,
+    DATADOG_AGENT_INVALID_FLUSH_THRESHOLD = 47,
+    DATADOG_AGENT_INVALID_MAX_PAYLOAD_BYTES = 48,
+    DATADOG_AGENT_INVALID_COMPRESSION_LEVEL = 49,
+    GZIP_UNSUPPORTED = 50,
+    GZIP_FAILURE = 51,
+    DATADOG_AGENT_INVALID_RETRY = 52,
+    INVALID_PARTIAL_FLUSH_MIN_SPANS = 53,
+    DATADOG_AGENT_INVALID_SHUTDOWN_TIMEOUT = 54,
+    FLUSH_TIMEOUT = 55,
+    DATADOG_AGENT_INVALID_DOGSTATSD_URL = 56,
+    DATADOG_AGENT_INVALID_HEALTH_METRICS_INTERVAL = 57,
+    DOGSTATSD_SOCKET_ERROR = 58,
+    INVALID_OVERHEAD_LOG_INTERVAL = 59,
+    INVALID_MAX_MEMORY_BYTES = 60,
+    INVALID_SPAN_LIMITS = 61,
+    MALFORMED_TRACEPARENT = 62,
+    MALFORMED_B3_HEADER = 63,
+    DATADOG_AGENT_INVALID_SPOOL = 64,
+    DISK_SPOOL_ERROR = 65,
+    SHARED_MEMORY_RING_ERROR = 66,
+    DATADOG_AGENT_INVALID_SHARED_MEMORY_RING = 67,
+    TARGET_SPANS_PER_SECOND_OUT_OF_RANGE = 68,
+    INVALID_COLLAPSE_REPEATED_SPANS_THRESHOLD = 69,
+    INVALID_SPAN_SAMPLING_RULES_FILE_POLL_INTERVAL = 70,
+    DATADOG_AGENT_INVALID_REMOTE_CONFIGURATION_POLL_INTERVAL = 71,
+    REMOTE_CONFIGURATION_INVALID_RESPONSE = 72,
+    DATADOG_AGENT_INVALID_DISCOVERY_INTERVAL = 73,
+    HTTP_CLIENT_GET_UNSUPPORTED = 74,
+    AGENTLESS_MISSING_API_KEY = 75,
+    AGENTLESS_INVALID_FLUSH_INTERVAL = 76,
+    AGENTLESS_INVALID_MAX_PAYLOAD_BYTES = 77,
+    AGENTLESS_INVALID_COMPRESSION_LEVEL = 78,
+    AGENTLESS_NULL_HTTP_CLIENT = 79,
+    TRACE_RECORDING_ERROR = 80,
+    DATADOG_AGENT_INVALID_RUNTIME_METRICS_INTERVAL = 81,
+    INVALID_MAX_SPANS_PER_TRACE = 82,
+    INVALID_THREAD_PLACEMENT = 83,
+    THREAD_PLACEMENT_FAILED = 84,
+    INVALID_SPAN_QUOTAS = 85,
+    INVALID_SAMPLING_DELEGATION_RESPONSE = 86,
+    INVALID_COMPACT_FINISHED_SPANS = 87,
+    COMPACT_SPANS_DECODING_FAILURE = 88,
+    DATADOG_AGENT_INVALID_LOAD_BALANCING = 89,
+    DATADOG_AGENT_INVALID_TAIL_SAMPLING = 90,
+    DATADOG_AGENT_INVALID_FLUSH_SUMMARY_INTERVAL = 91,
+    IO_URING_HTTP_CLIENT_SETUP_FAILED = 92,
+    IO_URING_HTTP_CLIENT_NOT_RUNNING = 93,
+    IO_URING_REQUEST_SETUP_FAILED = 94,
+    IO_URING_REQUEST_FAILURE = 95,
+    INVALID_SAMPLER_RATES_FILE_MAX_AGE = 96,
+    DATADOG_AGENT_INVALID_SPAN_PROCESSORS = 97,
+    AGENTLESS_HTTPS_UNSUPPORTED = 98,
   };
 
   Code code;
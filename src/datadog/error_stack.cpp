@@ -0,0 +1,143 @@
+#include "error_stack.h"
+
+#if __has_include(<execinfo.h>) && __has_include(<dlfcn.h>)
+#define DD_TRACE_CAPTURES_STACKS
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "span_data.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The cache of symbolized frames stops growing at this many entries, after
+// which frames not already in it are symbolized each time.
+constexpr std::size_t max_cached_frames = 1 << 16;
+
+std::string hex(std::uintptr_t value) {
+  char buffer[2 + 2 * sizeof value + 1];
+  std::snprintf(buffer, sizeof buffer, "0x%llx",
+                static_cast<unsigned long long>(value));
+  return buffer;
+}
+
+// Return a description of the frame having the specified return `address`.
+std::string symbolize_frame(const void* address) {
+  const auto numeric = reinterpret_cast<std::uintptr_t>(address);
+#ifdef DD_TRACE_CAPTURES_STACKS
+  Dl_info info;
+  if (::dladdr(address, &info) == 0) {
+    return hex(numeric);
+  }
+
+  std::string result;
+  if (info.dli_sname) {
+    int status = 0;
+    char* const demangled =
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    result = status == 0 ? demangled : info.dli_sname;
+    std::free(demangled);
+    result += '+';
+    result += hex(numeric - reinterpret_cast<std::uintptr_t>(info.dli_saddr));
+  } else {
+    result = hex(numeric);
+  }
+
+  if (info.dli_fname && *info.dli_fname) {
+    std::string_view module = info.dli_fname;
+    module = module.substr(module.find_last_of('/') + 1);
+    result += " in ";
+    result += module;
+  }
+  return result;
+#else
+  return hex(numeric);
+#endif
+}
+
+class FrameCache {
+  std::mutex mutex_;
+  std::unordered_map<const void*, std::string> frames_;
+
+ public:
+  void append(std::string& destination, const void* address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = frames_.find(address);
+    if (found == frames_.end()) {
+      std::string frame = symbolize_frame(address);
+      if (frames_.size() >= max_cached_frames) {
+        destination += frame;
+        return;
+      }
+      found = frames_.emplace(address, std::move(frame)).first;
+    }
+    destination += found->second;
+  }
+};
+
+FrameCache& frame_cache() {
+  // The cache is never destroyed, so that spans flushed during static
+  // destruction can still be symbolized.
+  static FrameCache* const cache = new FrameCache;
+  return *cache;
+}
+
+}  // namespace
+
+std::vector<const void*> capture_stack(std::size_t skip) {
+  std::vector<const void*> result;
+#ifdef DD_TRACE_CAPTURES_STACKS
+  // The extra frame is that of `capture_stack`.
+  ++skip;
+  std::vector<void*> frames(skip + max_captured_frames);
+  const int captured = ::backtrace(frames.data(), int(frames.size()));
+  if (captured > 0 && std::size_t(captured) > skip) {
+    result.assign(frames.begin() + skip, frames.begin() + captured);
+  }
+#else
+  (void)skip;
+#endif
+  return result;
+}
+
+std::string symbolize_stack(const std::vector<const void*>& addresses) {
+  std::string result;
+  auto& cache = frame_cache();
+  for (const void* address : addresses) {
+    if (!result.empty()) {
+      result += '\n';
+    }
+    cache.append(result, address);
+  }
+  return result;
+}
+
+void symbolize_error_stacks(
+    const std::vector<std::unique_ptr<SpanData>>& spans) {
+  for (const auto& span : spans) {
+    if (span->error_stack_addresses.empty()) {
+      continue;
+    }
+    if (!span->tags.contains(tags::error_stack)) {
+      span->tags.insert_or_assign(tags::error_stack,
+                                  symbolize_stack(span->error_stack_addresses));
+    }
+    span->error_stack_addresses.clear();
+    span->error_stack_addresses.shrink_to_fit();
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
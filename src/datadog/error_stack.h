@@ -0,0 +1,57 @@
+#pragma once
+
+// This component provides functions that capture the call stack of the
+// calling thread as raw return addresses, and that later describe those
+// addresses as text.
+//
+// Formatting a symbolized backtrace takes milliseconds: each address is looked
+// up among the loaded modules' symbols, and each symbol is demangled.
+// `Span::capture_error_stack` instead records only the return addresses, which
+// takes microseconds, and the span's "error.stack" tag is made from them when
+// the span is about to be encoded, typically by the thread that flushes trace
+// chunks, and only if the span is sent at all.  See `symbolize_error_stacks`.
+//
+// Symbols are looked up once per address per process, and then cached.  Only
+// exported symbols can be found, so the functions of an executable are named
+// only if it's linked with e.g. `-rdynamic`.  Other frames are described by
+// their addresses.
+//
+// Capture is supported where `<execinfo.h>` and `<dlfcn.h>` are available,
+// e.g. on Linux with glibc and on macOS.  Elsewhere, nothing is captured.
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+// The maximum number of frames captured by `capture_stack`.  A symbolized
+// frame is usually less than 200 bytes, so that a symbolized stack fits within
+// the default `SpanLimits::max_tag_value_bytes`.
+constexpr std::size_t max_captured_frames = 64;
+
+// Return the return addresses of the calling thread's call stack, innermost
+// first, omitting the specified `skip` innermost frames in addition to the
+// frame of `capture_stack` itself.  Return at most `max_captured_frames`
+// addresses, or none if capture is not supported on this platform.
+std::vector<const void*> capture_stack(std::size_t skip = 0);
+
+// Return a description of the call stack having the specified return
+// `addresses`, one frame per line, innermost first.  Each frame is described by
+// its function's demangled name and the offset of the address within it, or by
+// its address if the function is unknown, followed by the name of the module
+// that contains it, if known.
+std::string symbolize_stack(const std::vector<const void*>& addresses);
+
+// For each of the specified `spans` that has captured error stack addresses
+// and no "error.stack" tag, set the tag to the symbolized stack.  Clear the
+// captured addresses of each span.
+void symbolize_error_stacks(
+    const std::vector<std::unique_ptr<SpanData>>& spans);
+
+}  // namespace tracing
+}  // namespace datadog
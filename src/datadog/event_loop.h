@@ -0,0 +1,62 @@
+#pragma once
+
+// This component provides an interface, `EventLoop`, through which the tracer
+// registers sockets and timers with an event loop owned by the application,
+// such as a libuv loop, an asio `io_context`, or an epoll based worker loop.
+//
+// An application that already runs an event loop can use `EventLoopScheduler`
+// (see `event_loop_scheduler.h`) and the event loop mode of `Curl` (see
+// `curl.h`) instead of `ThreadedEventScheduler` and threaded `Curl`, so that
+// the tracer runs entirely on the application's loop without any threads of
+// its own.
+//
+// Except for `post`, the member functions of `EventLoop` are called only from
+// the loop's thread, and they must not invoke the callbacks given to them
+// before returning.  Callbacks are invoked on the loop's thread.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace datadog {
+namespace tracing {
+
+class EventLoop {
+ public:
+  // `Socket` is a socket's file descriptor.
+  using Socket = int;
+  // `SocketCallback` is invoked with the `Interest` flags of the events that
+  // are ready on a watched socket.  `FAILURE` is set if an error or hangup
+  // occurred on the socket.
+  using SocketCallback = std::function<void(int events)>;
+  using TimerID = std::uint64_t;
+
+  // `Interest` flags are combined into the `interest` argument of
+  // `watch_socket`, and into the `events` argument of `SocketCallback`.
+  enum Interest : int { READ = 1, WRITE = 2, FAILURE = 4 };
+
+  // Invoke the specified `callback` whenever the specified `socket` is ready
+  // for any of the `Interest` flags in the specified `interest`, until
+  // `watch_socket` is next called for `socket`.  If `interest` is zero, then
+  // stop watching `socket`, and ignore `callback`.
+  virtual void watch_socket(Socket socket, int interest,
+                            SocketCallback callback) = 0;
+
+  // Invoke the specified `callback` once, after the specified `delay` has
+  // elapsed.  Return an ID that can be passed to `cancel_timer`.
+  virtual TimerID start_timer(std::chrono::steady_clock::duration delay,
+                              std::function<void()> callback) = 0;
+
+  // Prevent the callback of the timer having the specified `id` from being
+  // invoked, if it hasn't been already.
+  virtual void cancel_timer(TimerID id) = 0;
+
+  // Invoke the specified `callback` on the loop's thread as soon as possible.
+  // Unlike the other member functions, `post` may be called from any thread.
+  virtual void post(std::function<void()> callback) = 0;
+
+  virtual ~EventLoop() = default;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,131 @@
+#include "event_loop_scheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+
+// `Event` is a recurring event.  Its pending timer's callback refers to it,
+// so a scheduled event is kept alive by the event loop until it's cancelled.
+struct EventLoopScheduler::Event : public std::enable_shared_from_this<Event> {
+  EventLoop* loop;
+  std::function<void()> callback;
+  std::chrono::steady_clock::duration interval;
+  std::chrono::steady_clock::duration jitter;
+  EventLoop::TimerID timer = 0;
+  bool cancelled = false;
+
+  Event(EventLoop* loop, std::function<void()> callback,
+        std::chrono::steady_clock::duration interval,
+        std::chrono::steady_clock::duration jitter)
+      : loop(loop),
+        callback(std::move(callback)),
+        interval(interval),
+        jitter(jitter) {}
+
+  // Start the timer for the invocation after the specified `delay`.
+  void arm(std::chrono::steady_clock::duration delay) {
+    timer = loop->start_timer(delay,
+                              [self = shared_from_this()]() { self->run(); });
+  }
+
+  // Invoke the callback, having first started the timer for the next
+  // invocation, so that the callback may cancel the event.
+  void run() {
+    if (cancelled) {
+      return;
+    }
+    arm(jittered(interval, jitter));
+    callback();
+  }
+
+  void cancel() {
+    if (cancelled) {
+      return;
+    }
+    cancelled = true;
+    loop->cancel_timer(timer);
+  }
+};
+
+EventLoopScheduler::EventLoopScheduler(const std::shared_ptr<EventLoop>& loop)
+    : loop_(loop) {}
+
+EventLoopScheduler::~EventLoopScheduler() {
+  for (const auto& weak_event : events_) {
+    if (const auto event = weak_event.lock()) {
+      event->cancel();
+    }
+  }
+}
+
+EventScheduler::Cancel EventLoopScheduler::schedule_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  return schedule_wakeable_recurring_event(interval, std::move(callback))
+      .cancel;
+}
+
+EventScheduler::RecurringEvent
+EventLoopScheduler::schedule_wakeable_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  return schedule_jittered_recurring_event(
+      interval, interval, std::chrono::steady_clock::duration::zero(),
+      std::move(callback));
+}
+
+EventScheduler::RecurringEvent
+EventLoopScheduler::schedule_jittered_recurring_event(
+    std::chrono::steady_clock::duration first_delay,
+    std::chrono::steady_clock::duration interval,
+    std::chrono::steady_clock::duration jitter,
+    std::function<void()> callback) {
+  auto event = std::make_shared<Event>(loop_.get(), std::move(callback),
+                                       interval, jitter);
+  event->arm(first_delay);
+
+  events_.erase(std::remove_if(events_.begin(), events_.end(),
+                               [](const auto& weak) { return weak.expired(); }),
+                events_.end());
+  events_.push_back(event);
+
+  // This is the wake function.  It may be invoked from any thread, and so it
+  // posts the invocation to the loop.  It holds a weak reference to `event` so
+  // that it doesn't keep a cancelled event alive.
+  std::weak_ptr<Event> weak_event = event;
+  auto wake = [loop = loop_, weak_event = std::move(weak_event)]() {
+    loop->post([weak_event]() {
+      const auto event = weak_event.lock();
+      if (!event || event->cancelled) {
+        return;
+      }
+      // Supersede the invocation that was scheduled for the end of the
+      // interval.
+      event->loop->cancel_timer(event->timer);
+      event->run();
+    });
+  };
+
+  // This is the cancellation function.
+  auto cancel = [event = std::move(event)]() mutable {
+    if (!event) {
+      return;
+    }
+    event->cancel();
+    event.reset();
+  };
+
+  return RecurringEvent{std::move(cancel), std::move(wake)};
+}
+
+nlohmann::json EventLoopScheduler::config_json() const {
+  return nlohmann::json::object(
+      {{"type", "datadog::tracing::EventLoopScheduler"}});
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,54 @@
+#pragma once
+
+// This component provides a `class`, `EventLoopScheduler`, that implements the
+// `EventScheduler` interface in terms of the timers of an application-owned
+// `EventLoop`.  See `event_loop.h`.
+//
+// Unlike `ThreadedEventScheduler`, `EventLoopScheduler` has no thread: events'
+// callbacks are invoked on the event loop's thread.  Events must be scheduled
+// and cancelled on the loop's thread, but they may be woken from any thread,
+// which posts the invocation to the loop.
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "event_loop.h"
+#include "event_scheduler.h"
+
+namespace datadog {
+namespace tracing {
+
+class EventLoopScheduler : public EventScheduler {
+  struct Event;
+
+  std::shared_ptr<EventLoop> loop_;
+  // `events_` are the events scheduled so far, which are cancelled when this
+  // object is destroyed.
+  std::vector<std::weak_ptr<Event>> events_;
+
+ public:
+  explicit EventLoopScheduler(const std::shared_ptr<EventLoop>& loop);
+  ~EventLoopScheduler();
+
+  EventLoopScheduler(const EventLoopScheduler&) = delete;
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override;
+
+  RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override;
+
+  RecurringEvent schedule_jittered_recurring_event(
+      std::chrono::steady_clock::duration first_delay,
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter,
+      std::function<void()> callback) override;
+
+  nlohmann::json config_json() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -1 +1,39 @@
 #include "event_scheduler.h"
+
+#include <random>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+
+EventScheduler::RecurringEvent
+EventScheduler::schedule_wakeable_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  return RecurringEvent{schedule_recurring_event(interval, std::move(callback)),
+                        nullptr};
+}
+
+EventScheduler::RecurringEvent
+EventScheduler::schedule_jittered_recurring_event(
+    std::chrono::steady_clock::duration /*first_delay*/,
+    std::chrono::steady_clock::duration interval,
+    std::chrono::steady_clock::duration /*jitter*/,
+    std::function<void()> callback) {
+  return schedule_wakeable_recurring_event(interval, std::move(callback));
+}
+
+std::chrono::steady_clock::duration EventScheduler::jittered(
+    std::chrono::steady_clock::duration interval,
+    std::chrono::steady_clock::duration jitter) {
+  if (jitter <= jitter.zero()) {
+    return interval;
+  }
+  thread_local std::minstd_rand generator{std::random_device{}()};
+  std::uniform_int_distribution<std::chrono::steady_clock::rep> offset(
+      -jitter.count(), jitter.count());
+  return interval + std::chrono::steady_clock::duration(offset(generator));
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -4,7 +4,11 @@
 // specified function-like object to be invoked at regular intervals.
 //
 // `DatadogAgent` uses an `EventScheduler` to periodically send batches of
-// traces to the Datadog Agent.
+// traces to the Datadog Agent.  If the `EventScheduler` supports waking a
+// recurring event, then `DatadogAgent` also uses it to send a batch early when
+// enough traces have accumulated.  If the `EventScheduler` supports jitter,
+// then `DatadogAgent` can also spread its flushes in time (see
+// `DatadogAgentConfig::randomize_flush_phase`).
 //
 // The default implementation is `ThreadedEventScheduler`.  See
 // `threaded_event_scheduler.h`.
@@ -21,6 +25,18 @@ namespace tracing {
 class EventScheduler {
  public:
   using Cancel = std::function<void()>;
+  using Wake = std::function<void()>;
+
+  // `RecurringEvent` is the result of `schedule_wakeable_recurring_event`.
+  // `cancel` prevents subsequent invocations of the event's callback.  `wake`,
+  // if not null, causes the callback to be invoked as soon as possible, rather
+  // than at the end of the current interval; subsequent invocations are then
+  // spaced by the interval from that invocation.  `wake` may be invoked from
+  // any thread.
+  struct RecurringEvent {
+    Cancel cancel;
+    Wake wake;
+  };
 
   // Invoke the specified `callback` repeatedly, with the specified `interval`
   // elapsing between invocations.  The first invocation is after an initial
@@ -30,6 +46,27 @@ class EventScheduler {
       std::chrono::steady_clock::duration interval,
       std::function<void()> callback) = 0;
 
+  // Invoke the specified `callback` as described for
+  // `schedule_recurring_event`, and additionally allow it to be woken early.
+  // The default implementation doesn't support waking, and returns a null
+  // `wake`.
+  virtual RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback);
+
+  // Invoke the specified `callback` as described for
+  // `schedule_wakeable_recurring_event`, except that the first invocation is
+  // after the specified `first_delay` rather than after `interval`, and each
+  // interval thereafter is lengthened or shortened by a random duration of at
+  // most the specified `jitter`, which must be less than `interval`.  This
+  // keeps processes that started together from invoking their callbacks in
+  // unison.  The default implementation ignores `first_delay` and `jitter`.
+  virtual RecurringEvent schedule_jittered_recurring_event(
+      std::chrono::steady_clock::duration first_delay,
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter,
+      std::function<void()> callback);
+
   // Return a JSON representation of this object's configuration. The JSON
   // representation is an object with the following properties:
   //
@@ -40,6 +77,13 @@ class EventScheduler {
   virtual nlohmann::json config_json() const = 0;
 
   virtual ~EventScheduler() = default;
+
+ protected:
+  // Return the specified `interval` lengthened or shortened by a random
+  // duration of at most the specified `jitter`.
+  static std::chrono::steady_clock::duration jittered(
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter);
 };
 
 }  // namespace tracing
@@ -4,6 +4,10 @@
 // instance of `T` or an instance of `Error`.  `Expected<void>` is either
 // `std::nullopt` or an instance of `Error`.
 //
+// The error type is an optional second template parameter, which is `Error`
+// by default.  Parsers on hot paths return `Expected<T, LazyError>`, whose
+// error isn't formatted until it's needed (see `lazy_error.h`).
+//
 // `Expected` is inspired by, but incompatible with, C++23's `std::expected`.
 //
 // Example Usage
@@ -45,9 +49,9 @@
 namespace datadog {
 namespace tracing {
 
-template <typename Value>
+template <typename Value, typename ErrorType = Error>
 class Expected {
-  std::variant<Value, Error> data_;
+  std::variant<Value, ErrorType> data_;
 
  public:
   Expected() = default;
@@ -84,112 +88,114 @@ class Expected {
 
   // Return a reference to the `Error` held by this object.  If this object is
   // not an `Error`, throw a `std::bad_variant_access`.
-  Error& error() &;
-  const Error& error() const&;
-  Error&& error() &&;
-  const Error&& error() const&&;
+  ErrorType& error() &;
+  const ErrorType& error() const&;
+  ErrorType&& error() &&;
+  const ErrorType&& error() const&&;
 
   // Return a pointer to the `Error` value held by this object, or return
   // `nullptr` if this object is not an `Error`.
-  Error* if_error() &;
-  const Error* if_error() const&;
+  ErrorType* if_error() &;
+  const ErrorType* if_error() const&;
   // Don't use `if_error` on an rvalue (temporary).
-  Error* if_error() && = delete;
-  const Error* if_error() const&& = delete;
+  ErrorType* if_error() && = delete;
+  const ErrorType* if_error() const&& = delete;
 };
 
-template <typename Value>
+template <typename Value, typename ErrorType>
 template <typename Other>
-Expected<Value>::Expected(Other&& other) : data_(std::forward<Other>(other)) {}
+Expected<Value, ErrorType>::Expected(Other&& other)
+    : data_(std::forward<Other>(other)) {}
 
-template <typename Value>
+template <typename Value, typename ErrorType>
 template <typename Other>
-Expected<Value>& Expected<Value>::operator=(Other&& other) {
+Expected<Value, ErrorType>& Expected<Value, ErrorType>::operator=(
+    Other&& other) {
   data_ = std::forward<Other>(other);
   return *this;
 }
 
-template <typename Value>
-bool Expected<Value>::has_value() const noexcept {
+template <typename Value, typename ErrorType>
+bool Expected<Value, ErrorType>::has_value() const noexcept {
   return std::holds_alternative<Value>(data_);
 }
-template <typename Value>
-Expected<Value>::operator bool() const noexcept {
+template <typename Value, typename ErrorType>
+Expected<Value, ErrorType>::operator bool() const noexcept {
   return has_value();
 }
 
-template <typename Value>
-Value& Expected<Value>::value() & {
+template <typename Value, typename ErrorType>
+Value& Expected<Value, ErrorType>::value() & {
   return std::get<0>(data_);
 }
-template <typename Value>
-const Value& Expected<Value>::value() const& {
+template <typename Value, typename ErrorType>
+const Value& Expected<Value, ErrorType>::value() const& {
   return std::get<0>(data_);
 }
-template <typename Value>
-Value&& Expected<Value>::value() && {
+template <typename Value, typename ErrorType>
+Value&& Expected<Value, ErrorType>::value() && {
   return std::move(std::get<0>(data_));
 }
-template <typename Value>
-const Value&& Expected<Value>::value() const&& {
+template <typename Value, typename ErrorType>
+const Value&& Expected<Value, ErrorType>::value() const&& {
   return std::move(std::get<0>(data_));
 }
 
-template <typename Value>
-Value& Expected<Value>::operator*() & {
+template <typename Value, typename ErrorType>
+Value& Expected<Value, ErrorType>::operator*() & {
   return value();
 }
-template <typename Value>
-const Value& Expected<Value>::operator*() const& {
+template <typename Value, typename ErrorType>
+const Value& Expected<Value, ErrorType>::operator*() const& {
   return value();
 }
-template <typename Value>
-Value&& Expected<Value>::operator*() && {
+template <typename Value, typename ErrorType>
+Value&& Expected<Value, ErrorType>::operator*() && {
   return std::move(value());
 }
-template <typename Value>
-const Value&& Expected<Value>::operator*() const&& {
+template <typename Value, typename ErrorType>
+const Value&& Expected<Value, ErrorType>::operator*() const&& {
   return std::move(value());
 }
 
-template <typename Value>
-Value* Expected<Value>::operator->() {
+template <typename Value, typename ErrorType>
+Value* Expected<Value, ErrorType>::operator->() {
   return &value();
 }
-template <typename Value>
-const Value* Expected<Value>::operator->() const {
+template <typename Value, typename ErrorType>
+const Value* Expected<Value, ErrorType>::operator->() const {
   return &value();
 }
 
-template <typename Value>
-Error& Expected<Value>::error() & {
+template <typename Value, typename ErrorType>
+ErrorType& Expected<Value, ErrorType>::error() & {
   return std::get<1>(data_);
 }
-template <typename Value>
-const Error& Expected<Value>::error() const& {
+template <typename Value, typename ErrorType>
+const ErrorType& Expected<Value, ErrorType>::error() const& {
   return std::get<1>(data_);
 }
-template <typename Value>
-Error&& Expected<Value>::error() && {
+template <typename Value, typename ErrorType>
+ErrorType&& Expected<Value, ErrorType>::error() && {
   return std::move(std::get<1>(data_));
 }
-template <typename Value>
-const Error&& Expected<Value>::error() const&& {
+template <typename Value, typename ErrorType>
+const ErrorType&& Expected<Value, ErrorType>::error() const&& {
   return std::move(std::get<1>(data_));
 }
 
-template <typename Value>
-Error* Expected<Value>::if_error() & {
+template <typename Value, typename ErrorType>
+ErrorType* Expected<Value, ErrorType>::if_error() & {
   return std::get_if<1>(&data_);
 }
-template <typename Value>
-const Error* Expected<Value>::if_error() const& {
+template <typename Value, typename ErrorType>
+const ErrorType* Expected<Value, ErrorType>::if_error() const& {
   return std::get_if<1>(&data_);
 }
 
-template <>
-class Expected<void> {
-  std::optional<Error> data_;
+template <typename ErrorType>
+class Expected<void, ErrorType> {
+  std::optional<ErrorType> data_;
 
  public:
   Expected() = default;
@@ -209,41 +215,68 @@ class Expected<void> {
   bool has_value() const;
   explicit operator bool() const;
 
-  Error& error() &;
-  const Error& error() const&;
-  Error&& error() &&;
-  const Error&& error() const&&;
+  ErrorType& error() &;
+  const ErrorType& error() const&;
+  ErrorType&& error() &&;
+  const ErrorType&& error() const&&;
 
-  Error* if_error() &;
-  const Error* if_error() const&;
+  ErrorType* if_error() &;
+  const ErrorType* if_error() const&;
   // Don't use `if_error` on an rvalue (temporary).
-  Error* if_error() && = delete;
-  const Error* if_error() const&& = delete;
+  ErrorType* if_error() && = delete;
+  const ErrorType* if_error() const&& = delete;
 };
 
+template <typename ErrorType>
 template <typename Other>
-Expected<void>::Expected(Other&& other) : data_(std::forward<Other>(other)) {}
+Expected<void, ErrorType>::Expected(Other&& other)
+    : data_(std::forward<Other>(other)) {}
 
+template <typename ErrorType>
 template <typename Other>
-Expected<void>& Expected<void>::operator=(Other&& other) {
+Expected<void, ErrorType>& Expected<void, ErrorType>::operator=(
+    Other&& other) {
   data_ = std::forward<Other>(other);
   return *this;
 }
 
-inline void Expected<void>::swap(Expected& other) { data_.swap(other.data_); }
+template <typename ErrorType>
+void Expected<void, ErrorType>::swap(Expected& other) {
+  data_.swap(other.data_);
+}
 
-inline bool Expected<void>::has_value() const { return !data_.has_value(); }
-inline Expected<void>::operator bool() const { return has_value(); }
+template <typename ErrorType>
+bool Expected<void, ErrorType>::has_value() const {
+  return !data_.has_value();
+}
+template <typename ErrorType>
+Expected<void, ErrorType>::operator bool() const {
+  return has_value();
+}
 
-inline Error& Expected<void>::error() & { return *data_; }
-inline const Error& Expected<void>::error() const& { return *data_; }
-inline Error&& Expected<void>::error() && { return std::move(*data_); }
-inline const Error&& Expected<void>::error() const&& {
+template <typename ErrorType>
+ErrorType& Expected<void, ErrorType>::error() & {
+  return *data_;
+}
+template <typename ErrorType>
+const ErrorType& Expected<void, ErrorType>::error() const& {
+  return *data_;
+}
+template <typename ErrorType>
+ErrorType&& Expected<void, ErrorType>::error() && {
+  return std::move(*data_);
+}
+template <typename ErrorType>
+const ErrorType&& Expected<void, ErrorType>::error() const&& {
   return std::move(*data_);
 }
 
-inline Error* Expected<void>::if_error() & { return data_ ? &*data_ : nullptr; }
-inline const Error* Expected<void>::if_error() const& {
+template <typename ErrorType>
+ErrorType* Expected<void, ErrorType>::if_error() & {
+  return data_ ? &*data_ : nullptr;
+}
+template <typename ErrorType>
+const ErrorType* Expected<void, ErrorType>::if_error() const& {
   return data_ ? &*data_ : nullptr;
 }
 
@@ -0,0 +1,553 @@
+#pragma once
+
+// This component provides a class template, `FlatMap<Value>`, that is an
+// associative container mapping `TagKey` keys to `Value`s.
+//
+// `FlatMap` is used for span tags (see `SpanData`, `SpanConfig`, and
+// `SpanDefaults`) and trace tags (see `TraceSegment`).  A typical span has
+// fewer than sixteen tags, and for that size a contiguous array searched
+// linearly is faster than a node-based hash table.
+//
+// The first `inline_capacity` elements of a `FlatMap` are stored within the
+// `FlatMap` object itself.  Only if the map grows beyond that is storage
+// allocated.  Once the map contains more than `index_threshold` elements, a
+// hashed index is maintained alongside the elements so that lookups remain
+// constant time.
+//
+// Elements are `std::pair<TagKey, Value>`, as with `std::unordered_map`,
+// and are iterated in insertion order, except that erasing an element moves
+// the last element into the erased element's position.  Insertion and erasure
+// invalidate iterators.
+//
+// Keys are `TagKey` rather than `std::string`, so that well-known tag names are
+// not copied into every span.  See `tag_key.h`.
+//
+// The subset of the `std::unordered_map` interface used by this library is
+// provided, except that lookups accept a `std::string_view`.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "tag_key.h"
+
+namespace datadog {
+namespace tracing {
+
+template <typename Value, std::size_t inline_capacity = 8>
+class FlatMap {
+ public:
+  using key_type = TagKey;
+  using mapped_type = Value;
+  using value_type = std::pair<TagKey, Value>;
+  using size_type = std::size_t;
+  using iterator = value_type*;
+  using const_iterator = const value_type*;
+
+  // Maps larger than this maintain a hashed index.
+  static constexpr size_type index_threshold = 16;
+
+ private:
+  value_type* data_;
+  size_type size_;
+  size_type capacity_;
+  // `index_` is an open-addressing hash table of `index_capacity_` slots.  Each
+  // slot is either zero (empty) or one plus the offset of an element in
+  // `data_`.  `index_` is null when `size_ <= index_threshold`.
+  std::unique_ptr<std::uint32_t[]> index_;
+  size_type index_capacity_;
+  alignas(value_type) unsigned char inline_[inline_capacity *
+                                            sizeof(value_type)];
+
+  value_type* inline_data() { return reinterpret_cast<value_type*>(inline_); }
+  bool is_inline() const {
+    return data_ == reinterpret_cast<const value_type*>(inline_);
+  }
+
+  static size_type hash(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+  }
+
+  size_type offset_of(std::string_view key) const;
+  void index_insert(size_type offset);
+  void rebuild_index();
+  // Return uninitialized storage for the specified `capacity` elements.
+  static value_type* allocate(size_type capacity);
+  // Move the elements to the specified `new_data`, which has the specified
+  // `new_capacity`, and free the old storage.
+  void relocate(value_type* new_data, size_type new_capacity);
+  void grow(size_type min_capacity);
+  template <typename Key, typename... Args>
+  value_type& append(Key&& key, Args&&... args);
+  // Copy the elements of the specified `other` into this empty map, and copy
+  // its index rather than rebuilding it.
+  void copy_from(const FlatMap& other);
+  void destroy();
+
+ public:
+  FlatMap();
+  FlatMap(std::initializer_list<value_type>);
+  template <typename InputIterator>
+  FlatMap(InputIterator begin, InputIterator end);
+  FlatMap(const FlatMap&);
+  FlatMap(FlatMap&&) noexcept(std::is_nothrow_move_constructible_v<Value>);
+  FlatMap& operator=(const FlatMap&);
+  FlatMap& operator=(FlatMap&&) noexcept(
+      std::is_nothrow_move_constructible_v<Value>);
+  FlatMap& operator=(std::initializer_list<value_type>);
+  ~FlatMap();
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  size_type size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  void clear();
+  // Ensure that at least the specified `capacity` elements can be stored
+  // without further allocation.
+  void reserve(size_type capacity);
+
+  iterator find(std::string_view key);
+  const_iterator find(std::string_view key) const;
+  size_type count(std::string_view key) const;
+  bool contains(std::string_view key) const;
+  // Return a reference to the value at the specified `key`.  Throw
+  // `std::out_of_range` if there is no such element.
+  Value& at(std::string_view key);
+  const Value& at(std::string_view key) const;
+  // Return a reference to the value at the specified `key`, inserting a
+  // value-initialized `Value` first if there is no such element.
+  Value& operator[](std::string_view key);
+
+  // Insert an element at the specified `key` having a `Value` constructed from
+  // the specified `args`, unless there is already an element at `key`.
+  // Return an iterator to the element at `key` and whether an insertion was
+  // performed.
+  template <typename Key, typename... Args>
+  std::pair<iterator, bool> emplace(Key&& key, Args&&... args);
+  template <typename Key, typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+  // Assign the specified `value` to the element at the specified `key`,
+  // inserting the element if necessary.  Return an iterator to the element at
+  // `key` and whether an insertion was performed.
+  template <typename Key, typename Other>
+  std::pair<iterator, bool> insert_or_assign(Key&& key, Other&& value);
+  // Insert each element of the range `[begin, end)` whose key is not already
+  // present.
+  template <typename InputIterator>
+  void insert(InputIterator begin, InputIterator end);
+
+  // Erase the element at the specified `key`, if any.  Return the number of
+  // elements erased (zero or one).
+  size_type erase(std::string_view key);
+  // Erase the element at the specified `position` and return an iterator to
+  // the element that took its place.
+  iterator erase(const_iterator position);
+};
+
+// Return whether the specified maps contain the same elements, regardless of
+// order.
+template <typename Value, std::size_t left_capacity, std::size_t right_capacity>
+bool operator==(const FlatMap<Value, left_capacity>& left,
+                const FlatMap<Value, right_capacity>& right) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  return std::all_of(left.begin(), left.end(), [&](const auto& entry) {
+    const auto found = right.find(entry.first);
+    return found != right.end() && found->second == entry.second;
+  });
+}
+
+template <typename Value, std::size_t left_capacity, std::size_t right_capacity>
+bool operator!=(const FlatMap<Value, left_capacity>& left,
+                const FlatMap<Value, right_capacity>& right) {
+  return !(left == right);
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>::FlatMap()
+    : data_(inline_data()),
+      size_(0),
+      capacity_(inline_capacity),
+      index_capacity_(0) {}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>::FlatMap(
+    std::initializer_list<value_type> items)
+    : FlatMap(items.begin(), items.end()) {}
+
+template <typename Value, std::size_t inline_capacity>
+template <typename InputIterator>
+FlatMap<Value, inline_capacity>::FlatMap(InputIterator begin,
+                                         InputIterator end)
+    : FlatMap() {
+  // Among duplicate keys, the last one wins, as with `insert_or_assign`.
+  for (; begin != end; ++begin) {
+    insert_or_assign(begin->first, begin->second);
+  }
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>::FlatMap(const FlatMap& other) : FlatMap() {
+  copy_from(other);
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>::FlatMap(FlatMap&& other) noexcept(
+    std::is_nothrow_move_constructible_v<Value>)
+    : FlatMap() {
+  *this = std::move(other);
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>& FlatMap<Value, inline_capacity>::operator=(
+    const FlatMap& other) {
+  if (this != &other) {
+    clear();
+    copy_from(other);
+  }
+  return *this;
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>& FlatMap<Value, inline_capacity>::operator=(
+    FlatMap&& other) noexcept(std::is_nothrow_move_constructible_v<Value>) {
+  if (this == &other) {
+    return *this;
+  }
+
+  destroy();
+  if (other.is_inline()) {
+    // Move the elements one by one.
+    data_ = inline_data();
+    capacity_ = inline_capacity;
+    for (size_type i = 0; i < other.size_; ++i) {
+      new (data_ + i) value_type(std::move(other.data_[i]));
+      other.data_[i].~value_type();
+    }
+    size_ = other.size_;
+  } else {
+    // Steal the allocation.
+    data_ = other.data_;
+    capacity_ = other.capacity_;
+    size_ = other.size_;
+    other.data_ = other.inline_data();
+    other.capacity_ = inline_capacity;
+  }
+  index_ = std::move(other.index_);
+  index_capacity_ = other.index_capacity_;
+  other.size_ = 0;
+  other.index_capacity_ = 0;
+  return *this;
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>& FlatMap<Value, inline_capacity>::operator=(
+    std::initializer_list<value_type> items) {
+  clear();
+  for (const auto& entry : items) {
+    insert_or_assign(entry.first, entry.second);
+  }
+  return *this;
+}
+
+template <typename Value, std::size_t inline_capacity>
+FlatMap<Value, inline_capacity>::~FlatMap() {
+  destroy();
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::copy_from(const FlatMap& other) {
+  reserve(other.size_);
+  for (const auto& entry : other) {
+    new (data_ + size_) value_type(entry);
+    ++size_;
+  }
+  if (other.index_) {
+    // The elements are at the same offsets as in `other`, so its index is
+    // valid for this map as well.
+    index_.reset(new std::uint32_t[other.index_capacity_]);
+    index_capacity_ = other.index_capacity_;
+    std::copy(other.index_.get(), other.index_.get() + index_capacity_,
+              index_.get());
+  }
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::destroy() {
+  for (size_type i = 0; i < size_; ++i) {
+    data_[i].~value_type();
+  }
+  if (!is_inline()) {
+    ::operator delete(data_);
+    data_ = inline_data();
+    capacity_ = inline_capacity;
+  }
+  size_ = 0;
+  index_.reset();
+  index_capacity_ = 0;
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::clear() {
+  // Keep any allocated storage for reuse.
+  for (size_type i = 0; i < size_; ++i) {
+    data_[i].~value_type();
+  }
+  size_ = 0;
+  index_.reset();
+  index_capacity_ = 0;
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::reserve(size_type capacity) {
+  if (capacity > capacity_) {
+    grow(capacity);
+  }
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::value_type*
+FlatMap<Value, inline_capacity>::allocate(size_type capacity) {
+  return static_cast<value_type*>(
+      ::operator new(capacity * sizeof(value_type)));
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::grow(size_type min_capacity) {
+  const size_type new_capacity = std::max(min_capacity, capacity_ * 2);
+  relocate(allocate(new_capacity), new_capacity);
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::relocate(value_type* new_data,
+                                               size_type new_capacity) {
+  for (size_type i = 0; i < size_; ++i) {
+    new (new_data + i) value_type(std::move(data_[i]));
+    data_[i].~value_type();
+  }
+  if (!is_inline()) {
+    ::operator delete(data_);
+  }
+  data_ = new_data;
+  capacity_ = new_capacity;
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::size_type
+FlatMap<Value, inline_capacity>::offset_of(std::string_view key) const {
+  if (!index_) {
+    for (size_type i = 0; i < size_; ++i) {
+      if (data_[i].first == key) {
+        return i;
+      }
+    }
+    return size_;
+  }
+
+  const size_type mask = index_capacity_ - 1;
+  for (size_type slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+    const std::uint32_t entry = index_[slot];
+    if (entry == 0) {
+      return size_;
+    }
+    if (data_[entry - 1].first == key) {
+      return entry - 1;
+    }
+  }
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::index_insert(size_type offset) {
+  const size_type mask = index_capacity_ - 1;
+  size_type slot = hash(data_[offset].first.view()) & mask;
+  while (index_[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  index_[slot] = std::uint32_t(offset + 1);
+}
+
+template <typename Value, std::size_t inline_capacity>
+void FlatMap<Value, inline_capacity>::rebuild_index() {
+  if (size_ <= index_threshold) {
+    index_.reset();
+    index_capacity_ = 0;
+    return;
+  }
+
+  // Keep the load factor at or below one half.
+  size_type capacity = 2 * index_threshold;
+  while (capacity < 2 * size_) {
+    capacity *= 2;
+  }
+  if (capacity != index_capacity_ || !index_) {
+    index_.reset(new std::uint32_t[capacity]);
+    index_capacity_ = capacity;
+  }
+  std::fill(index_.get(), index_.get() + index_capacity_, 0);
+  for (size_type i = 0; i < size_; ++i) {
+    index_insert(i);
+  }
+}
+
+template <typename Value, std::size_t inline_capacity>
+template <typename Key, typename... Args>
+typename FlatMap<Value, inline_capacity>::value_type&
+FlatMap<Value, inline_capacity>::append(Key&& key, Args&&... args) {
+  const auto construct = [&](value_type* where) {
+    new (where) value_type(std::piecewise_construct,
+                           std::forward_as_tuple(std::forward<Key>(key)),
+                           std::forward_as_tuple(std::forward<Args>(args)...));
+  };
+  if (size_ < capacity_) {
+    construct(data_ + size_);
+  } else {
+    // `key` or `args` might refer to an element, and so the new element is
+    // constructed before the others are moved, as `std::vector` does.
+    const size_type new_capacity = std::max(size_ + 1, capacity_ * 2);
+    value_type* const new_data = allocate(new_capacity);
+    try {
+      construct(new_data + size_);
+    } catch (...) {
+      ::operator delete(new_data);
+      throw;
+    }
+    relocate(new_data, new_capacity);
+  }
+  ++size_;
+  if (size_ > index_threshold) {
+    if (!index_ || 2 * size_ > index_capacity_) {
+      rebuild_index();
+    } else {
+      index_insert(size_ - 1);
+    }
+  }
+  return data_[size_ - 1];
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::iterator
+FlatMap<Value, inline_capacity>::find(std::string_view key) {
+  return data_ + offset_of(key);
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::const_iterator
+FlatMap<Value, inline_capacity>::find(std::string_view key) const {
+  return data_ + offset_of(key);
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::size_type
+FlatMap<Value, inline_capacity>::count(std::string_view key) const {
+  return offset_of(key) != size_;
+}
+
+template <typename Value, std::size_t inline_capacity>
+bool FlatMap<Value, inline_capacity>::contains(std::string_view key) const {
+  return offset_of(key) != size_;
+}
+
+template <typename Value, std::size_t inline_capacity>
+Value& FlatMap<Value, inline_capacity>::at(std::string_view key) {
+  const size_type offset = offset_of(key);
+  if (offset == size_) {
+    throw std::out_of_range("FlatMap::at");
+  }
+  return data_[offset].second;
+}
+
+template <typename Value, std::size_t inline_capacity>
+const Value& FlatMap<Value, inline_capacity>::at(std::string_view key) const {
+  const size_type offset = offset_of(key);
+  if (offset == size_) {
+    throw std::out_of_range("FlatMap::at");
+  }
+  return data_[offset].second;
+}
+
+template <typename Value, std::size_t inline_capacity>
+Value& FlatMap<Value, inline_capacity>::operator[](std::string_view key) {
+  return try_emplace(key).first->second;
+}
+
+template <typename Value, std::size_t inline_capacity>
+template <typename Key, typename... Args>
+std::pair<typename FlatMap<Value, inline_capacity>::iterator, bool>
+FlatMap<Value, inline_capacity>::emplace(Key&& key, Args&&... args) {
+  return try_emplace(std::forward<Key>(key), std::forward<Args>(args)...);
+}
+
+template <typename Value, std::size_t inline_capacity>
+template <typename Key, typename... Args>
+std::pair<typename FlatMap<Value, inline_capacity>::iterator, bool>
+FlatMap<Value, inline_capacity>::try_emplace(Key&& key, Args&&... args) {
+  const size_type offset = offset_of(key);
+  if (offset != size_) {
+    return {data_ + offset, false};
+  }
+  return {&append(std::forward<Key>(key), std::forward<Args>(args)...), true};
+}
+
+template <typename Value, std::size_t inline_capacity>
+template <typename Key, typename Other>
+std::pair<typename FlatMap<Value, inline_capacity>::iterator, bool>
+FlatMap<Value, inline_capacity>::insert_or_assign(Key&& key, Other&& value) {
+  const size_type offset = offset_of(key);
+  if (offset != size_) {
+    data_[offset].second = std::forward<Other>(value);
+    return {data_ + offset, false};
+  }
+  return {&append(std::forward<Key>(key), std::forward<Other>(value)), true};
+}
+
+template <typename Value, std::size_t inline_capacity>
+template <typename InputIterator>
+void FlatMap<Value, inline_capacity>::insert(InputIterator begin,
+                                             InputIterator end) {
+  for (; begin != end; ++begin) {
+    try_emplace(begin->first, begin->second);
+  }
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::size_type
+FlatMap<Value, inline_capacity>::erase(std::string_view key) {
+  const size_type offset = offset_of(key);
+  if (offset == size_) {
+    return 0;
+  }
+  erase(data_ + offset);
+  return 1;
+}
+
+template <typename Value, std::size_t inline_capacity>
+typename FlatMap<Value, inline_capacity>::iterator
+FlatMap<Value, inline_capacity>::erase(const_iterator position) {
+  const size_type offset = position - data_;
+  if (offset != size_ - 1) {
+    data_[offset] = std::move(data_[size_ - 1]);
+  }
+  data_[size_ - 1].~value_type();
+  --size_;
+  if (index_) {
+    // Erasure is rare compared to lookup and insertion, so just start over.
+    rebuild_index();
+  }
+  return data_ + offset;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,94 @@
+#include "fork_handlers.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `Registry` is the process's registered handlers, by registration order.
+// `mutex` is locked from before `fork` until after it, so that the handlers
+// aren't modified while they're being invoked.
+struct Registry {
+  std::mutex mutex;
+  std::map<std::uint64_t, ForkHandlers> handlers;
+  std::uint64_t next_id = 1;
+};
+
+// The registry is never destroyed, so that threads that outlive static
+// destruction may still unregister their handlers.
+Registry& global_registry() {
+  static Registry* const instance = new Registry;
+  return *instance;
+}
+
+#ifndef _MSC_VER
+extern "C" void before_fork() {
+  Registry& registry = global_registry();
+  registry.mutex.lock();
+  for (auto iter = registry.handlers.rbegin(); iter != registry.handlers.rend();
+       ++iter) {
+    if (iter->second.before_fork) {
+      iter->second.before_fork();
+    }
+  }
+}
+
+extern "C" void after_fork_in_parent() {
+  Registry& registry = global_registry();
+  for (auto& [id, handlers] : registry.handlers) {
+    (void)id;
+    if (handlers.after_fork_in_parent) {
+      handlers.after_fork_in_parent();
+    }
+  }
+  registry.mutex.unlock();
+}
+
+extern "C" void after_fork_in_child() {
+  // The thread that locked `mutex` before `fork` is the thread that's running
+  // in the child, and so it may unlock `mutex` here.
+  Registry& registry = global_registry();
+  for (auto& [id, handlers] : registry.handlers) {
+    (void)id;
+    if (handlers.after_fork_in_child) {
+      handlers.after_fork_in_child();
+    }
+  }
+  registry.mutex.unlock();
+}
+#endif
+
+}  // namespace
+
+UnregisterForkHandlers register_fork_handlers(ForkHandlers handlers) {
+#ifndef _MSC_VER
+  // https://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_atfork.html
+  static const int registered = pthread_atfork(
+      &before_fork, &after_fork_in_parent, &after_fork_in_child);
+  (void)registered;
+#endif
+
+  Registry& registry = global_registry();
+  std::uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    id = registry.next_id++;
+    registry.handlers.emplace(id, std::move(handlers));
+  }
+
+  return [&registry, id]() {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.handlers.erase(id);
+  };
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,44 @@
+#pragma once
+
+// This component provides a function, `register_fork_handlers`, that arranges
+// for callbacks to be invoked around each call to `fork`.
+//
+// Only the thread that calls `fork` exists in the child process.  Objects that
+// own threads, such as `ThreadedEventScheduler` and `Curl`, use
+// `register_fork_handlers` to stop their threads before `fork`, and to start
+// them again afterward in both the parent and the child.  That way, a server
+// that creates its tracer before forking its worker processes, such as nginx
+// or a prefork server, keeps tracing in its workers.
+//
+// The handlers are registered with `pthread_atfork` once per process.  Before
+// `fork`, the `before_fork` handlers are invoked in the reverse order of their
+// registration.  After `fork`, the `after_fork_in_parent` handlers or the
+// `after_fork_in_child` handlers are invoked in the order of their
+// registration.  Registering and unregistering are blocked while `fork` is in
+// progress.  A handler must not register or unregister handlers.
+//
+// On Windows, which doesn't have `fork`, the handlers are never invoked.
+
+#include <functional>
+
+namespace datadog {
+namespace tracing {
+
+struct ForkHandlers {
+  // Each of these may be null.
+  std::function<void()> before_fork;
+  std::function<void()> after_fork_in_parent;
+  std::function<void()> after_fork_in_child;
+};
+
+// Invoking an `UnregisterForkHandlers` prevents subsequent invocations of the
+// handlers that it refers to.  If a `fork` is in progress, it first waits for
+// the `fork` to complete.
+using UnregisterForkHandlers = std::function<void()>;
+
+// Invoke the specified `handlers` around each subsequent call to `fork`, until
+// the returned function is invoked.
+UnregisterForkHandlers register_fork_handlers(ForkHandlers handlers);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -1,7 +1,11 @@
 #include "glob.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 
+#include "parse_util.h"
+
 namespace datadog {
 namespace tracing {
 
@@ -55,5 +59,86 @@ bool glob_match(std::string_view pattern, std::string_view subject) {
   return true;
 }
 
+GlobPattern::GlobPattern(std::string_view pattern) {
+  if (pattern.find('?') != std::string_view::npos) {
+    kind_ = Kind::GENERAL;
+    prefix_ = std::string(pattern);
+    return;
+  }
+
+  const auto first_star = pattern.find('*');
+  if (first_star == std::string_view::npos) {
+    kind_ = Kind::EXACT;
+    prefix_ = std::string(pattern);
+    return;
+  }
+
+  const auto last_star = pattern.rfind('*');
+  prefix_ = std::string(pattern.substr(0, first_star));
+  suffix_ = std::string(pattern.substr(last_star + 1));
+  // Split the part between the first and last stars on the stars within it.
+  // Consecutive stars produce empty literals, which are skipped.
+  std::string_view rest = pattern.substr(first_star, last_star - first_star);
+  while (!rest.empty()) {
+    rest.remove_prefix(1);  // the star
+    const auto star = std::min(rest.find('*'), rest.size());
+    if (star != 0) {
+      middle_.emplace_back(rest.substr(0, star));
+    }
+    rest.remove_prefix(star);
+  }
+
+  if (!middle_.empty()) {
+    kind_ = prefix_.empty() && suffix_.empty() && middle_.size() == 1
+                ? Kind::CONTAINS
+                : Kind::SEGMENTS;
+  } else if (prefix_.empty() && suffix_.empty()) {
+    kind_ = Kind::ANY;
+  } else if (suffix_.empty()) {
+    kind_ = Kind::PREFIX;
+  } else if (prefix_.empty()) {
+    kind_ = Kind::SUFFIX;
+  } else {
+    kind_ = Kind::SEGMENTS;
+  }
+}
+
+bool GlobPattern::match(std::string_view subject) const {
+  switch (kind_) {
+    case Kind::ANY:
+      return true;
+    case Kind::EXACT:
+      return subject == prefix_;
+    case Kind::PREFIX:
+      return starts_with(subject, prefix_);
+    case Kind::SUFFIX:
+      return ends_with(subject, suffix_);
+    case Kind::CONTAINS:
+      return subject.find(middle_.front()) != std::string_view::npos;
+    case Kind::GENERAL:
+      return glob_match(prefix_, subject);
+    case Kind::SEGMENTS:
+      break;
+  }
+
+  // The prefix and suffix are anchored, and must not overlap.  Each middle
+  // literal then can be matched at its leftmost occurrence after the previous
+  // one, since the stars around it absorb whatever is skipped.
+  if (subject.size() < prefix_.size() + suffix_.size() ||
+      !starts_with(subject, prefix_) || !ends_with(subject, suffix_)) {
+    return false;
+  }
+  subject.remove_prefix(prefix_.size());
+  subject.remove_suffix(suffix_.size());
+  for (const auto& literal : middle_) {
+    const auto found = subject.find(literal);
+    if (found == std::string_view::npos) {
+      return false;
+    }
+    subject.remove_prefix(found + literal.size());
+  }
+  return true;
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -10,8 +10,19 @@
 //
 // The patterns are here called "glob patterns," though they are different from
 // the patterns used in Unix shells.
+//
+// This component also provides a class, `GlobPattern`, that is a glob pattern
+// compiled for repeated matching.  Sampling rules match a pattern against many
+// spans, and most patterns are of a simple form: a literal, a prefix ("foo*"),
+// a suffix ("*foo"), or a substring ("*foo*").  `GlobPattern` recognizes those
+// forms when it's constructed, and then matches them with a single comparison
+// or search.  Other patterns without "?" are matched by searching for each of
+// their literal segments in turn, which doesn't backtrack.  Only patterns that
+// contain "?" fall back to `glob_match`.
 
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace datadog {
 namespace tracing {
@@ -21,5 +32,27 @@ namespace tracing {
 // glob `pattern`.
 bool glob_match(std::string_view pattern, std::string_view subject);
 
+class GlobPattern {
+  enum class Kind { ANY, EXACT, PREFIX, SUFFIX, CONTAINS, SEGMENTS, GENERAL };
+
+  Kind kind_;
+  // For `GENERAL`, `prefix_` is the whole pattern.  For `EXACT`, it's the
+  // literal.  Otherwise, `prefix_` is the literal before the first "*", and
+  // `suffix_` is the literal after the last "*".  `middle_` are the nonempty
+  // literals between stars.
+  std::string prefix_;
+  std::string suffix_;
+  std::vector<std::string> middle_;
+
+ public:
+  // Compile the specified glob `pattern`.
+  explicit GlobPattern(std::string_view pattern);
+
+  // Return whether the specified `subject` matches this pattern.  This is
+  // equivalent to `glob_match(pattern, subject)`, where `pattern` is the
+  // pattern from which this object was compiled.
+  bool match(std::string_view subject) const;
+};
+
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,42 @@
+#pragma once
+
+// This component defines functions, `gzip_supported`, `gzip_compress`, and
+// `gzip_decompress`, that compress and decompress data in the gzip format, if
+// zlib was included in the build.
+//
+// `DatadogAgent` uses `gzip_compress` to compress request bodies when it is
+// configured to do so.  See `DatadogAgentConfig::compression`.  `CompactSpans`
+// uses both to compress the finished spans of long-lived trace segments.  See
+// `TracerConfig::compress_compacted_spans`.
+//
+// The functions are implemented in either `gzip_zlib.cpp` or `gzip_null.cpp`.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+// Return whether `gzip_compress` is able to compress data, i.e. whether zlib
+// was included in the build.
+bool gzip_supported();
+
+// Append to the specified `destination` the gzip compressed form of the
+// specified `source`, using the specified compression `level`, which is
+// between 1 (fastest) and 9 (smallest).  Return an error if compression fails
+// or if zlib was not included in the build.
+Expected<void> gzip_compress(std::string& destination, std::string_view source,
+                             int level);
+
+// Append to the specified `destination` the decompressed form of the specified
+// gzip compressed `source`, which is expected to be the specified `size`
+// bytes.  Return an error if `source` is not a gzip stream that decompresses
+// to `size` bytes, or if zlib was not included in the build.
+Expected<void> gzip_decompress(std::string& destination,
+                               std::string_view source, std::size_t size);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,28 @@
+#include "gzip.h"
+
+// This file is included in the build when zlib is not included in the build.
+// It provides implementations of `gzip_supported`, `gzip_compress`, and
+// `gzip_decompress` that indicate that compression is not available, which
+// means that a user configuring a tracer must not enable
+// `DatadogAgentConfig::compression` or
+// `TracerConfig::compress_compacted_spans`.
+
+namespace datadog {
+namespace tracing {
+
+bool gzip_supported() { return false; }
+
+Expected<void> gzip_compress(std::string&, std::string_view, int) {
+  return Error{Error::GZIP_UNSUPPORTED,
+               "gzip compression is not available, because this library was "
+               "built without zlib."};
+}
+
+Expected<void> gzip_decompress(std::string&, std::string_view, std::size_t) {
+  return Error{Error::GZIP_UNSUPPORTED,
+               "gzip decompression is not available, because this library "
+               "was built without zlib."};
+}
+
+}  // namespace tracing
+}  // namespace datadog
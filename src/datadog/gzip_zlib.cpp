@@ -0,0 +1,127 @@
+#include <zlib.h>
+
+#include <limits>
+#include <string>
+
+#include "gzip.h"
+
+// This file is included in the build when zlib is included in the build.
+// It provides implementations of `gzip_supported`, `gzip_compress`, and
+// `gzip_decompress` in terms of zlib's `deflate` and `inflate`.
+//
+// If zlib is not included in the build, then `gzip_null.cpp` will be built
+// instead.
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `window_bits` selects the largest window (15), plus 16 to produce a gzip
+// header and trailer rather than a zlib wrapper.
+const int window_bits = 15 + 16;
+const int memory_level = 8;
+
+Error zlib_error(const char* operation, int status, const z_stream& stream) {
+  std::string message;
+  message += "zlib ";
+  message += operation;
+  message += " failed with status ";
+  message += std::to_string(status);
+  if (stream.msg) {
+    message += ": ";
+    message += stream.msg;
+  }
+  return Error{Error::GZIP_FAILURE, std::move(message)};
+}
+
+}  // namespace
+
+bool gzip_supported() { return true; }
+
+Expected<void> gzip_compress(std::string& destination, std::string_view source,
+                             int level) {
+  // Leave room for the compressed form to be larger than the input.
+  const std::size_t max_size = std::numeric_limits<uInt>::max() / 2;
+  if (source.size() > max_size) {
+    std::string message;
+    message += "Unable to gzip compress ";
+    message += std::to_string(source.size());
+    message += " bytes, which exceeds the maximum of ";
+    message += std::to_string(max_size);
+    return Error{Error::GZIP_FAILURE, std::move(message)};
+  }
+
+  z_stream stream{};
+  int status = deflateInit2(&stream, level, Z_DEFLATED, window_bits,
+                            memory_level, Z_DEFAULT_STRATEGY);
+  if (status != Z_OK) {
+    return zlib_error("deflateInit2", status, stream);
+  }
+
+  // `deflateBound` is large enough to compress `source` in a single call.
+  const auto bound = deflateBound(&stream, uLong(source.size()));
+  const auto size_before = destination.size();
+  destination.resize(size_before + bound);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(source.data()));
+  stream.avail_in = uInt(source.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&destination[size_before]);
+  stream.avail_out = uInt(bound);
+
+  status = deflate(&stream, Z_FINISH);
+  if (status != Z_STREAM_END) {
+    destination.resize(size_before);
+    Error error = zlib_error("deflate", status, stream);
+    deflateEnd(&stream);
+    return error;
+  }
+  destination.resize(size_before + stream.total_out);
+  deflateEnd(&stream);
+  return std::nullopt;
+}
+
+Expected<void> gzip_decompress(std::string& destination,
+                               std::string_view source, std::size_t size) {
+  const std::size_t max_size = std::numeric_limits<uInt>::max();
+  if (source.size() > max_size || size >= max_size) {
+    std::string message;
+    message += "Unable to gzip decompress ";
+    message += std::to_string(source.size());
+    message += " bytes into ";
+    message += std::to_string(size);
+    message += " bytes, which exceeds the maximum of ";
+    message += std::to_string(max_size);
+    return Error{Error::GZIP_FAILURE, std::move(message)};
+  }
+
+  z_stream stream{};
+  int status = inflateInit2(&stream, window_bits);
+  if (status != Z_OK) {
+    return zlib_error("inflateInit2", status, stream);
+  }
+
+  // The decompressed size is known, so `source` is decompressed in a single
+  // call.  One more byte of room reveals a stream longer than expected.
+  const auto size_before = destination.size();
+  destination.resize(size_before + size + 1);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(source.data()));
+  stream.avail_in = uInt(source.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&destination[size_before]);
+  stream.avail_out = uInt(size + 1);
+
+  status = inflate(&stream, Z_FINISH);
+  if (status != Z_STREAM_END || stream.total_out != size) {
+    destination.resize(size_before);
+    Error error = status == Z_STREAM_END
+                      ? Error{Error::GZIP_FAILURE,
+                              "gzip stream decompressed to an unexpected size"}
+                      : zlib_error("inflate", status, stream);
+    inflateEnd(&stream);
+    return error;
+  }
+  destination.resize(size_before + size);
+  inflateEnd(&stream);
+  return std::nullopt;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -1 +1,31 @@
 #include "http_client.h"
+
+#include <cstddef>
+
+namespace datadog {
+namespace tracing {
+
+Expected<void> HTTPClient::post(const URL& url, HeadersSetter set_headers,
+                                BodyChain body, ResponseHandler on_response,
+                                ErrorHandler on_error) {
+  std::string concatenated;
+  std::size_t size = 0;
+  for (const auto& buffer : body) {
+    size += buffer->size();
+  }
+  concatenated.reserve(size);
+  for (const auto& buffer : body) {
+    concatenated += *buffer;
+  }
+  return post(url, std::move(set_headers), std::move(concatenated),
+              std::move(on_response), std::move(on_error));
+}
+
+Expected<void> HTTPClient::get(const URL&, HeadersSetter, ResponseHandler,
+                               ErrorHandler) {
+  return Error{Error::HTTP_CLIENT_GET_UNSUPPORTED,
+               "This HTTP client doesn't support GET requests."};
+}
+
+}  // namespace tracing
+}  // namespace datadog
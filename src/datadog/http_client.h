@@ -6,11 +6,16 @@
 // `HTTPClient` is used by `DatadogAgent` to send traces to the Datadog Agent.
 //
 // If this library was built with support for libcurl, then `Curl` implements
-// `HTTPClient` in terms of libcurl.  See `curl.h`.
+// `HTTPClient` in terms of libcurl.  See `curl.h`.  On Linux,
+// `IoUringHTTPClient` implements it without libcurl, using io_uring.  See
+// `io_uring_http_client.h`.
 
 #include <chrono>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <string>
+#include <vector>
 
 #include "error.h"
 #include "expected.h"
@@ -36,6 +41,11 @@ class HTTPClient {
   // `ErrorHandler` is for errors encountered by `HTTPClient`, not for
   // error-indicating HTTP responses.
   using ErrorHandler = std::function<void(Error)>;
+  // `BodyChain` is a request body that is the concatenation of a sequence of
+  // buffers.  The buffers are immutable and shared, so that the caller can
+  // retain them, e.g. to send the request again, without either the caller or
+  // the client copying them.
+  using BodyChain = std::vector<std::shared_ptr<const std::string>>;
 
   // Send a POST request to the specified `url`.  Set request headers by calling
   // the specified `set_headers` callback.  Include the specified `body` at the
@@ -48,6 +58,23 @@ class HTTPClient {
                               std::string body, ResponseHandler on_response,
                               ErrorHandler on_error) = 0;
 
+  // Send a POST request as above, except that the body is the concatenation
+  // of the specified `body` buffers.  The default implementation concatenates
+  // the buffers and calls the other overload of `post`.  A client that can
+  // send the buffers without concatenating them, such as `Curl`, overrides
+  // this.
+  virtual Expected<void> post(const URL& url, HeadersSetter set_headers,
+                              BodyChain body, ResponseHandler on_response,
+                              ErrorHandler on_error);
+
+  // Send a GET request to the specified `url`, as with `post` but without a
+  // body.  The default implementation returns an error, so that clients
+  // written before `get` existed still work with the parts of this library
+  // that don't need it.
+  virtual Expected<void> get(const URL& url, HeadersSetter set_headers,
+                             ResponseHandler on_response,
+                             ErrorHandler on_error);
+
   // Wait until there are no more outstanding requests, or until the specified
   // `deadline`.
   virtual void drain(std::chrono::steady_clock::time_point deadline) = 0;
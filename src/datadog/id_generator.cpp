@@ -1,7 +1,6 @@
 #include "id_generator.h"
 
 #include <cstddef>
-#include <limits>
 #include <random>
 
 #ifndef _MSC_VER
@@ -16,14 +15,57 @@ namespace {
 extern "C" void on_fork();
 #endif
 
+// `SplitMix64` is the generator recommended for seeding `Xoshiro256`.  See
+// https://prng.di.unimi.it/splitmix64.c
+class SplitMix64 {
+  std::uint64_t state_;
+
+ public:
+  explicit SplitMix64(std::uint64_t seed) : state_(seed) {}
+
+  std::uint64_t operator()() {
+    std::uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+};
+
+// `Xoshiro256` is the xoshiro256** generator, which has 32 bytes of state and
+// is much cheaper to seed and to advance than `std::mt19937_64`.  See
+// https://prng.di.unimi.it/xoshiro256starstar.c
+class Xoshiro256 {
+  std::uint64_t state_[4];
+
+  static std::uint64_t rotl(std::uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+ public:
+  void seed(std::uint64_t seed) {
+    // The state must not be all zeros, which `SplitMix64` can't produce from
+    // any seed.
+    SplitMix64 seeder{seed};
+    for (auto& word : state_) {
+      word = seeder();
+    }
+  }
+
+  std::uint64_t operator()() {
+    const std::uint64_t result = rotl(state_[1] * 5, 7) * 9;
+    const std::uint64_t t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = rotl(state_[3], 45);
+    return result;
+  }
+};
+
 class DefaultIDGenerator {
-  std::mt19937_64 generator_;
-  // The distribution used is for a _signed_ integer, and the default minimum
-  // value is zero.
-  // This means that we generate IDs with non-negative values that will always
-  // fit into an `int64_t`, which is a polite thing to do when you work with
-  // people who write Java.
-  std::uniform_int_distribution<std::int64_t> distribution_;
+  Xoshiro256 generator_;
 
  public:
   DefaultIDGenerator() {
@@ -34,18 +76,28 @@ class DefaultIDGenerator {
 // A subsequent call to `exec` would remedy this, but nginx in particular does
 // not call `exec` after forking its worker processes.
 // So, we use `pthread_atfork` to re-seed `generator_` in the child process
-// after `fork`.
+// after `fork`.  Only the thread that called `fork` exists in the child, so
+// the handler re-seeds that thread's generator.  The handler is registered
+// once per process, rather than once per thread, so that short-lived threads
+// don't accumulate handlers.
 // Windows does not have `fork`, and so this is not relevant there.
 #ifndef _MSC_VER
     // https://pubs.opengroup.org/onlinepubs/9699919799/functions/pthread_atfork.html
-    (void)pthread_atfork(/*before fork*/ nullptr, /*in parent*/ nullptr,
-                         /*in child*/ &on_fork);
+    static const int registered =
+        pthread_atfork(/*before fork*/ nullptr, /*in parent*/ nullptr,
+                       /*in child*/ &on_fork);
+    (void)registered;
 #endif
   }
 
-  std::uint64_t operator()() { return distribution_(generator_); }
+  // Return a non-negative value that will always fit into an `int64_t`, which
+  // is a polite thing to do when you work with people who write Java.
+  std::uint64_t operator()() { return generator_() >> 1; }
 
-  void seed_with_random() { generator_.seed(std::random_device{}()); }
+  void seed_with_random() {
+    std::random_device device;
+    generator_.seed((std::uint64_t(device()) << 32) ^ device());
+  }
 };
 
 thread_local DefaultIDGenerator thread_local_generator;
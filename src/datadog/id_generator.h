@@ -7,7 +7,8 @@
 //
 // `default_id_generator` is an `IDGenerator` that produces a thread-local
 // pseudo-random sequence of uniformly distributed 63-bit unsigned integers. The
-// sequence is randomly seeded one per thread and anytime the process forks.
+// sequence is generated by xoshiro256**, which is cheap to seed, and is
+// randomly seeded once per thread and anytime the process forks.
 // The IDs are 63-bit (instead of 64-bit) to ease compatibility with peer
 // runtimes that don't have a native 64-bit unsigned numeric type.
 
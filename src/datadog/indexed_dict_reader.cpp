@@ -0,0 +1,101 @@
+#include "indexed_dict_reader.h"
+
+#include <cctype>
+
+#include "parse_util.h"
+
+namespace datadog {
+namespace tracing {
+
+const std::string_view IndexedDictReader::names[NUM_HEADERS] = {
+    "x-datadog-trace-id",
+    "x-datadog-parent-id",
+    "x-datadog-sampling-priority",
+    "x-datadog-origin",
+    "x-datadog-tags",
+    "x-datadog-delegate-trace-sampling",
+    "x-b3-traceid",
+    "x-b3-spanid",
+    "x-b3-sampled",
+    "b3",
+    "traceparent",
+    "tracestate"};
+
+IndexedDictReader::IndexedDictReader(const DictReader& reader) {
+  reader.visit([this](std::string_view key, std::string_view value) {
+    const Header header = classify(key);
+    if (header != NUM_HEADERS && !values_[header]) {
+      values_[header] = value;
+    }
+  });
+}
+
+// The header names are distinguished by their lengths, except for the two B3
+// headers of length 12, which differ in their sixth character, and the two
+// headers of length 11, which differ in their first.  So, the length and at
+// most one character select the only possible match, which is then compared.
+IndexedDictReader::Header IndexedDictReader::classify(std::string_view name) {
+  Header candidate;
+  switch (name.size()) {
+    case 2:
+      candidate = B3_SINGLE;
+      break;
+    case 10:
+      candidate = W3C_TRACESTATE;
+      break;
+    case 11:
+      candidate = std::tolower(static_cast<unsigned char>(name[0])) == 't'
+                      ? W3C_TRACEPARENT
+                      : B3_SPAN_ID;
+      break;
+    case 12:
+      candidate = std::tolower(static_cast<unsigned char>(name[5])) == 't'
+                      ? B3_TRACE_ID
+                      : B3_SAMPLED;
+      break;
+    case 14:
+      candidate = DATADOG_TAGS;
+      break;
+    case 16:
+      candidate = DATADOG_ORIGIN;
+      break;
+    case 18:
+      candidate = DATADOG_TRACE_ID;
+      break;
+    case 19:
+      candidate = DATADOG_PARENT_ID;
+      break;
+    case 27:
+      candidate = DATADOG_SAMPLING_PRIORITY;
+      break;
+    case 33:
+      candidate = DATADOG_DELEGATE_TRACE_SAMPLING;
+      break;
+    default:
+      return NUM_HEADERS;
+  }
+  return equals_ignoring_case(name, names[candidate]) ? candidate
+                                                      : NUM_HEADERS;
+}
+
+std::optional<std::string_view> IndexedDictReader::lookup(
+    std::string_view key) const {
+  const Header header = classify(key);
+  if (header == NUM_HEADERS) {
+    return std::nullopt;
+  }
+  return values_[header];
+}
+
+void IndexedDictReader::visit(
+    const std::function<void(std::string_view key, std::string_view value)>&
+        visitor) const {
+  for (int i = 0; i < NUM_HEADERS; ++i) {
+    if (values_[i]) {
+      visitor(names[i], *values_[i]);
+    }
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,76 @@
+#pragma once
+
+// This component provides a `class`, `IndexedDictReader`, that is a
+// `DictReader` decorator.  An `IndexedDictReader` reads the trace context
+// headers of another `DictReader` in a single call to `DictReader::visit`,
+// and then looks them up in a fixed table without consulting the other reader
+// again.
+//
+// `Tracer::extract_span` looks up each header of each configured extraction
+// style.  If `lookup` is a linear scan of the request's headers, as it is for
+// most HTTP frameworks, then each of those lookups rescans the headers.
+// Wrapping the reader in an `IndexedDictReader` replaces those scans with one
+// pass over the headers.
+//
+// `Tracer::extract_span` does this itself for readers whose `prefer_visit`
+// returns `true` (see `dict_reader.h`).  An application can instead construct
+// an `IndexedDictReader` once per request and use it for every extraction
+// from that request.
+//
+// A header name is matched without regard to case.  Where a header occurs
+// more than once, the first occurrence wins, as with `lookup`.  Only the trace
+// context headers are indexed; `lookup` of any other key returns
+// `std::nullopt`.
+
+#include <optional>
+#include <string_view>
+
+#include "dict_reader.h"
+
+namespace datadog {
+namespace tracing {
+
+class IndexedDictReader : public DictReader {
+ public:
+  enum Header {
+    DATADOG_TRACE_ID,
+    DATADOG_PARENT_ID,
+    DATADOG_SAMPLING_PRIORITY,
+    DATADOG_ORIGIN,
+    DATADOG_TAGS,
+    DATADOG_DELEGATE_TRACE_SAMPLING,
+    B3_TRACE_ID,
+    B3_SPAN_ID,
+    B3_SAMPLED,
+    B3_SINGLE,
+    W3C_TRACEPARENT,
+    W3C_TRACESTATE,
+    NUM_HEADERS
+  };
+
+  // The name of each `Header`, in lower case, indexed by `Header`.
+  static const std::string_view names[NUM_HEADERS];
+
+ private:
+  std::optional<std::string_view> values_[NUM_HEADERS];
+
+ public:
+  // Index the trace context headers of the specified `reader`.  The views
+  // that `reader` passes to its visitor must remain valid for as long as this
+  // object.
+  explicit IndexedDictReader(const DictReader& reader);
+
+  // Return the `Header` whose name is the specified `name`, ignoring case, or
+  // return `NUM_HEADERS` if `name` is not a trace context header.
+  static Header classify(std::string_view name);
+
+  std::optional<std::string_view> lookup(std::string_view key) const override;
+
+  // Invoke the specified `visitor` once for each trace context header found.
+  void visit(
+      const std::function<void(std::string_view key, std::string_view value)>&
+          visitor) const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
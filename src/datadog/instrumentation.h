@@ -0,0 +1,161 @@
+#pragma once
+
+// This component provides macros for instrumenting code with spans, so that
+// tracing can be removed from a build without removing the instrumentation
+// from the source.  For example:
+//
+//     void handle(Tracer& tracer, const Request& request, Response& response) {
+//       DD_TRACE_EXTRACT_SPAN(span, tracer, RequestReader{request});
+//       DD_TRACE_SET_TAG(span, "http.url", request.url());
+//       {
+//         DD_TRACE_CHILD_SPAN(query, span, SpanConfig{...});
+//         DD_TRACE_SET_TAG(query, "db.rows", std::to_string(run_query()));
+//       }
+//       ResponseWriter writer{response};
+//       DD_TRACE_INJECT(span, writer);
+//     }
+//
+// Each macro that creates a span declares a local variable of type
+// `InstrumentedSpan` having the specified name:
+//
+// - `DD_TRACE_SPAN(span, tracer[, config])` creates the root of a new trace,
+//   as `Tracer::create_span` does.
+// - `DD_TRACE_CHILD_SPAN(span, parent[, config])` creates a child of the
+//   `InstrumentedSpan` `parent`, as `Span::create_child` does.
+// - `DD_TRACE_EXTRACT_SPAN(span, tracer, reader[, config])` extracts a span
+//   from the `DictReader` `reader`, or creates the root of a new trace, as
+//   `Tracer::extract_or_create_span` does.  If extraction fails, then the
+//   span is empty, and the macros below do nothing with it.
+//
+// The other macros act on an `InstrumentedSpan`:
+//
+// - `DD_TRACE_SET_TAG(span, name, value)` calls `Span::set_tag`.
+// - `DD_TRACE_INJECT(span, writer)` calls `Span::inject` with the `DictWriter`
+//   `writer`.
+//
+// If `DD_TRACE_COMPILE_OUT` is defined, which it is for users of the library
+// when the library is built with the CMake option `DD_TRACE_COMPILE_OUT` or
+// with the Bazel flag `--define=dd_trace_compile_out=1`, then each span is an
+// empty object, and each macro that acts on a span expands to nothing.  The
+// macros' other arguments are not evaluated, so that the computation of a tag
+// value costs nothing either, but they still count as used, so that a tracer
+// or a header reader that's used only for tracing doesn't cause warnings.
+
+#ifndef DD_TRACE_COMPILE_OUT
+
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "expected.h"
+#include "span.h"
+#include "tracer.h"
+
+namespace datadog {
+namespace tracing {
+
+// `InstrumentedSpan` is a `Span`, or nothing if the span could not be
+// extracted.
+class InstrumentedSpan {
+  std::optional<Span> span_;
+
+ public:
+  InstrumentedSpan() = default;
+  explicit InstrumentedSpan(Span&& span) : span_(std::move(span)) {}
+  explicit InstrumentedSpan(Expected<Span>&& span) {
+    if (span) {
+      span_.emplace(std::move(*span));
+    }
+  }
+
+  // These are the implementations of the macros below.  `Config` is either
+  // empty, or is `SpanConfig` or `SpanConfigView`.
+  template <typename... Config>
+  static InstrumentedSpan create(Tracer& tracer, const Config&... config) {
+    return InstrumentedSpan{tracer.create_span(config...)};
+  }
+
+  template <typename... Config>
+  static InstrumentedSpan create_child(const InstrumentedSpan& parent,
+                                       const Config&... config) {
+    if (!parent.span_) {
+      return InstrumentedSpan{};
+    }
+    return InstrumentedSpan{parent.span_->create_child(config...)};
+  }
+
+  template <typename... Config>
+  static InstrumentedSpan extract(Tracer& tracer, const DictReader& reader,
+                                  const Config&... config) {
+    return InstrumentedSpan{tracer.extract_or_create_span(reader, config...)};
+  }
+
+  // Return the span, or return null if there isn't one.
+  Span* get() { return span_ ? &*span_ : nullptr; }
+  const Span* get() const { return span_ ? &*span_ : nullptr; }
+
+  template <typename Value>
+  void set_tag(std::string_view name, Value&& value) {
+    if (span_) {
+      span_->set_tag(name, std::forward<Value>(value));
+    }
+  }
+
+  void inject(DictWriter& writer) const {
+    if (span_) {
+      span_->inject(writer);
+    }
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
+
+#define DD_TRACE_SPAN(span, ...)              \
+  ::datadog::tracing::InstrumentedSpan span = \
+      ::datadog::tracing::InstrumentedSpan::create(__VA_ARGS__)
+#define DD_TRACE_CHILD_SPAN(span, ...)        \
+  ::datadog::tracing::InstrumentedSpan span = \
+      ::datadog::tracing::InstrumentedSpan::create_child(__VA_ARGS__)
+#define DD_TRACE_EXTRACT_SPAN(span, ...)      \
+  ::datadog::tracing::InstrumentedSpan span = \
+      ::datadog::tracing::InstrumentedSpan::extract(__VA_ARGS__)
+#define DD_TRACE_SET_TAG(span, name, value) (span).set_tag((name), (value))
+#define DD_TRACE_INJECT(span, writer) (span).inject(writer)
+
+#else  // DD_TRACE_COMPILE_OUT
+
+#include <cstddef>
+
+namespace datadog {
+namespace tracing {
+// The compiled-out `InstrumentedSpan` is in its own namespace so that it
+// doesn't conflict with the other if both are linked into a program.
+inline namespace compiled_out {
+
+class InstrumentedSpan {
+ public:
+  constexpr explicit InstrumentedSpan(std::size_t) {}
+};
+
+// `unevaluated` is named only within `sizeof`, so that the arguments of the
+// macros count as used without being evaluated.
+template <typename... Args>
+char unevaluated(const Args&...);
+
+}  // namespace compiled_out
+}  // namespace tracing
+}  // namespace datadog
+
+#define DD_TRACE_SPAN(span, ...)                              \
+  [[maybe_unused]] ::datadog::tracing::InstrumentedSpan span { \
+    sizeof(::datadog::tracing::unevaluated(__VA_ARGS__))      \
+  }
+#define DD_TRACE_CHILD_SPAN(span, ...) DD_TRACE_SPAN(span, __VA_ARGS__)
+#define DD_TRACE_EXTRACT_SPAN(span, ...) DD_TRACE_SPAN(span, __VA_ARGS__)
+#define DD_TRACE_SET_TAG(span, name, value) \
+  static_cast<void>(sizeof(::datadog::tracing::unevaluated(span, name, value)))
+#define DD_TRACE_INJECT(span, writer) \
+  static_cast<void>(sizeof(::datadog::tracing::unevaluated(span, writer)))
+
+#endif  // DD_TRACE_COMPILE_OUT
@@ -0,0 +1,1483 @@
+#include "io_uring_http_client.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+// The implementation needs the io_uring definitions of Linux 6.1 or later,
+// which include zero-copy sends.  Whether the running kernel supports them is
+// determined when the ring is created.
+#ifdef IORING_CQE_F_NOTIF
+#define DD_TRACE_HAS_IO_URING
+#endif
+
+#ifdef DD_TRACE_HAS_IO_URING
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "container_dict_reader.h"
+#include "dict_writer.h"
+#include "fork_handlers.h"
+#include "json.hpp"
+#include "logger.h"
+#include "mpsc_queue.h"
+#include "parse_util.h"
+
+namespace datadog {
+namespace tracing {
+
+using BodyChain = HTTPClient::BodyChain;
+using ErrorHandler = HTTPClient::ErrorHandler;
+using HeadersSetter = HTTPClient::HeadersSetter;
+using ResponseHandler = HTTPClient::ResponseHandler;
+using URL = HTTPClient::URL;
+
+namespace {
+
+nlohmann::json to_json(const IoUringHTTPClientConfig& config) {
+  // clang-format off
+  return nlohmann::json::object({
+    {"max_connections", config.max_connections},
+    {"receive_buffer_size", config.receive_buffer_size},
+    {"request_timeout_milliseconds", config.request_timeout.count()},
+    {"zero_copy", config.zero_copy},
+    {"zero_copy_min_bytes", config.zero_copy_min_bytes},
+  });
+  // clang-format on
+}
+
+Error not_running() {
+  return Error{Error::IO_URING_HTTP_CLIENT_NOT_RUNNING,
+               "Unable to send request via io_uring because the HTTP client "
+               "failed to start."};
+}
+
+}  // namespace
+
+#ifndef DD_TRACE_HAS_IO_URING
+
+class IoUringHTTPClientImpl {
+  const IoUringHTTPClientConfig config_;
+
+ public:
+  IoUringHTTPClientImpl(const std::shared_ptr<Logger>& logger,
+                        const IoUringHTTPClientConfig& config)
+      : config_(config) {
+    logger->log_error(Error{Error::IO_URING_HTTP_CLIENT_SETUP_FAILED,
+                            "io_uring is not supported on this platform."});
+  }
+
+  Expected<void> send(const URL&, HeadersSetter, std::optional<BodyChain>,
+                      ResponseHandler, ErrorHandler) {
+    return not_running();
+  }
+
+  void drain(std::chrono::steady_clock::time_point) {}
+
+  nlohmann::json config_json() const {
+    return nlohmann::json::object({
+        {"type", "datadog::tracing::IoUringHTTPClient"},
+        {"config", to_json(config_)},
+        {"running", false},
+    });
+  }
+};
+
+#else
+
+namespace {
+
+Error errno_error(Error::Code code, std::string_view what, int number) {
+  std::string message{what};
+  message += ": ";
+  message += std::strerror(number);
+  return Error{code, std::move(message)};
+}
+
+// `Ring` is an io_uring: a queue of operations submitted to the kernel, and a
+// queue of their completions, both in memory shared with the kernel.  It's
+// used by one thread at a time.
+class Ring {
+  int fd_ = -1;
+  io_uring_params params_;
+  void* sq_map_ = MAP_FAILED;
+  std::size_t sq_map_size_ = 0;
+  void* cq_map_ = MAP_FAILED;
+  std::size_t cq_map_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  std::size_t sqes_size_ = 0;
+  unsigned* sq_head_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+  // `tail_` is the submission queue's tail, including the entries prepared
+  // but not yet submitted, whose count is `tail_ - submitted_`.
+  unsigned tail_ = 0;
+  unsigned submitted_ = 0;
+  std::vector<bool> supported_;
+
+ public:
+  Ring() = default;
+  Ring(const Ring&) = delete;
+  ~Ring() { close(); }
+
+  // Create a ring having at least the specified `entries`, or return an error.
+  Expected<void> open(unsigned entries);
+  void close();
+
+  // Return whether the kernel supports the specified `IORING_OP_*` opcode.
+  bool supports(unsigned opcode) const {
+    return opcode < supported_.size() && supported_[opcode];
+  }
+
+  // Register the specified `count` `buffers` for use by
+  // `IORING_OP_READ_FIXED`, or return an error.
+  Expected<void> register_buffers(const iovec* buffers, unsigned count);
+
+  // Return a cleared submission queue entry to fill in.  The entry is
+  // submitted by the next `enter`.  If the queue is full, then submit it
+  // first.  Return null if the queue is still full.
+  io_uring_sqe* prepare();
+
+  // Submit the prepared entries, and then wait until there's at least one
+  // completion, or until the specified `deadline`, if any.  Return zero or a
+  // negated `errno` value, such as `-ETIME` if the deadline passed.
+  int enter(std::optional<std::chrono::steady_clock::time_point> deadline);
+
+  // Invoke the specified `visit` with each completion queue entry, removing
+  // the entry from the queue.
+  template <typename Visit>
+  void reap(Visit&& visit) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const io_uring_cqe entry = cqes_[head & cq_mask_];
+      ++head;
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      visit(entry);
+    }
+  }
+
+ private:
+  // Submit the prepared entries, and wait for the specified
+  // `min_complete` completions, as `io_uring_enter` does.
+  int enter(unsigned min_complete, const __kernel_timespec* timeout);
+};
+
+Expected<void> Ring::open(unsigned entries) {
+  std::memset(&params_, 0, sizeof params_);
+  params_.flags = IORING_SETUP_CLAMP;
+  const long fd = ::syscall(__NR_io_uring_setup, entries, &params_);
+  if (fd < 0) {
+    return errno_error(Error::IO_URING_HTTP_CLIENT_SETUP_FAILED,
+                       "Unable to create an io_uring", errno);
+  }
+  fd_ = int(fd);
+  if (!(params_.features & IORING_FEAT_EXT_ARG)) {
+    close();
+    return Error{Error::IO_URING_HTTP_CLIENT_SETUP_FAILED,
+                 "The io_uring HTTP client requires Linux 5.11 or later."};
+  }
+
+  sq_map_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+  cq_map_size_ =
+      params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+  const bool single_map = params_.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_map) {
+    sq_map_size_ = cq_map_size_ = std::max(sq_map_size_, cq_map_size_);
+  }
+  sq_map_ = ::mmap(nullptr, sq_map_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+  if (sq_map_ != MAP_FAILED) {
+    cq_map_ = single_map ? sq_map_
+                         : ::mmap(nullptr, cq_map_size_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_,
+                                  IORING_OFF_CQ_RING);
+  }
+  sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = MAP_FAILED;
+  if (cq_map_ != MAP_FAILED) {
+    sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+  }
+  if (sqes == MAP_FAILED) {
+    const int number = errno;
+    close();
+    return errno_error(Error::IO_URING_HTTP_CLIENT_SETUP_FAILED,
+                       "Unable to map an io_uring", number);
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  char* const sq = static_cast<char*>(sq_map_);
+  char* const cq = static_cast<char*>(cq_map_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+  // Each slot of the submission queue refers to the entry of the same index.
+  unsigned* const array =
+      reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+  for (unsigned i = 0; i < params_.sq_entries; ++i) {
+    array[i] = i;
+  }
+  tail_ = submitted_ = *sq_tail_;
+
+  // `io_uring_probe` is followed by an array of `io_uring_probe_op`, one per
+  // opcode.
+  const unsigned num_ops = 256;
+  std::vector<std::uint64_t> probe_storage(
+      (sizeof(io_uring_probe) + num_ops * sizeof(io_uring_probe_op)) /
+      sizeof(std::uint64_t));
+  auto* const probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+  supported_.assign(num_ops, false);
+  if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe,
+                num_ops) == 0) {
+    for (unsigned i = 0; i < probe->ops_len && i < num_ops; ++i) {
+      if (probe->ops[i].flags & IO_URING_OP_SUPPORTED) {
+        supported_[probe->ops[i].op] = true;
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+void Ring::close() {
+  if (sqes_ != nullptr) {
+    ::munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_map_ != MAP_FAILED && cq_map_ != sq_map_) {
+    ::munmap(cq_map_, cq_map_size_);
+  }
+  cq_map_ = MAP_FAILED;
+  if (sq_map_ != MAP_FAILED) {
+    ::munmap(sq_map_, sq_map_size_);
+    sq_map_ = MAP_FAILED;
+  }
+  if (fd_ != -1) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  supported_.clear();
+}
+
+Expected<void> Ring::register_buffers(const iovec* buffers, unsigned count) {
+  if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS, buffers,
+                count) != 0) {
+    return errno_error(Error::IO_URING_HTTP_CLIENT_SETUP_FAILED,
+                       "Unable to register io_uring buffers", errno);
+  }
+  return std::nullopt;
+}
+
+io_uring_sqe* Ring::prepare() {
+  if (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) ==
+      params_.sq_entries) {
+    enter(0, nullptr);
+    if (tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) ==
+        params_.sq_entries) {
+      return nullptr;
+    }
+  }
+  io_uring_sqe* const entry = &sqes_[tail_ & sq_mask_];
+  std::memset(entry, 0, sizeof *entry);
+  ++tail_;
+  return entry;
+}
+
+int Ring::enter(
+    std::optional<std::chrono::steady_clock::time_point> deadline) {
+  if (!deadline) {
+    return enter(1, nullptr);
+  }
+  const auto remaining = std::max(
+      std::chrono::steady_clock::duration::zero(),
+      *deadline - std::chrono::steady_clock::now());
+  const auto seconds =
+      std::chrono::duration_cast<std::chrono::seconds>(remaining);
+  __kernel_timespec timeout;
+  timeout.tv_sec = seconds.count();
+  timeout.tv_nsec =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(remaining - seconds)
+          .count();
+  return enter(1, &timeout);
+}
+
+int Ring::enter(unsigned min_complete, const __kernel_timespec* timeout) {
+  __atomic_store_n(sq_tail_, tail_, __ATOMIC_RELEASE);
+  unsigned flags = 0;
+  io_uring_getevents_arg argument;
+  std::memset(&argument, 0, sizeof argument);
+  if (min_complete) {
+    flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    argument.sigmask_sz = _NSIG / 8;
+    argument.ts = std::uint64_t(reinterpret_cast<std::uintptr_t>(timeout));
+  }
+  const long result =
+      ::syscall(__NR_io_uring_enter, fd_, tail_ - submitted_, min_complete,
+                flags, min_complete ? &argument : nullptr,
+                min_complete ? sizeof argument : 0);
+  if (result < 0) {
+    return -errno;
+  }
+  submitted_ += unsigned(result);
+  return 0;
+}
+
+// `HeaderWriter` appends header fields to the header of a request.
+class HeaderWriter : public DictWriter {
+  std::string* header_;
+
+ public:
+  explicit HeaderWriter(std::string* header) : header_(header) {}
+
+  void set(std::string_view key, std::string_view value) override {
+    *header_ += key;
+    *header_ += ": ";
+    *header_ += value;
+    *header_ += "\r\n";
+  }
+};
+
+using Headers = std::vector<std::pair<std::string_view, std::string_view>>;
+
+// `Response` is a parsed HTTP response.  Its `headers` refer to the received
+// data from which it was parsed.
+struct Response {
+  int status = 0;
+  Headers headers;
+  std::string body;
+  // `keep_alive` is whether the connection can be used for another request.
+  bool keep_alive = true;
+};
+
+enum class Parse { INCOMPLETE, COMPLETE, INVALID };
+
+// Append to the specified `body` the chunks of the specified chunked-encoded
+// `data`.  Return whether `data` is all of the chunks and the trailer.
+Parse decode_chunked(std::string_view data, std::string& body) {
+  for (;;) {
+    auto line_end = data.find("\r\n");
+    if (line_end == std::string_view::npos) {
+      return Parse::INCOMPLETE;
+    }
+    // Chunk extensions, after a semicolon, are ignored.
+    const auto line = data.substr(0, line_end);
+    const auto size = parse_uint64(strip(line.substr(0, line.find(';'))), 16);
+    if (!size) {
+      return Parse::INVALID;
+    }
+    data.remove_prefix(line_end + 2);
+    if (*size == 0) {
+      // The trailer, if any, ends with an empty line.
+      while ((line_end = data.find("\r\n")) != 0) {
+        if (line_end == std::string_view::npos) {
+          return Parse::INCOMPLETE;
+        }
+        data.remove_prefix(line_end + 2);
+      }
+      return Parse::COMPLETE;
+    }
+    if (data.size() < *size + 2) {
+      return Parse::INCOMPLETE;
+    }
+    if (data.substr(*size, 2) != "\r\n") {
+      return Parse::INVALID;
+    }
+    body.append(data.data(), *size);
+    data.remove_prefix(*size + 2);
+  }
+}
+
+// Parse the specified `data` into the specified `response`.  `data` is all
+// that's been received of the response so far, and `closed` is whether the
+// server has since closed the connection.
+Parse parse_response(std::string_view data, bool closed, Response& response) {
+  const auto header_end = data.find("\r\n\r\n");
+  if (header_end == std::string_view::npos) {
+    return closed ? Parse::INVALID : Parse::INCOMPLETE;
+  }
+  std::string_view lines = data.substr(0, header_end + 2);
+
+  // e.g. "HTTP/1.1 200 OK"
+  const auto status_end = lines.find("\r\n");
+  const auto status_line = lines.substr(0, status_end);
+  lines.remove_prefix(status_end + 2);
+  const auto space = status_line.find(' ');
+  if (status_line.substr(0, 5) != "HTTP/" || space == std::string_view::npos) {
+    return Parse::INVALID;
+  }
+  const auto status = parse_int(status_line.substr(space + 1, 3), 10);
+  if (!status) {
+    return Parse::INVALID;
+  }
+  response.status = *status;
+  response.keep_alive = status_line.substr(0, space) != "HTTP/1.0";
+
+  std::optional<std::uint64_t> content_length;
+  bool chunked = false;
+  response.headers.clear();
+  while (!lines.empty()) {
+    const auto line_end = lines.find("\r\n");
+    const auto line = lines.substr(0, line_end);
+    lines.remove_prefix(line_end + 2);
+    const auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    const auto name = strip(line.substr(0, colon));
+    const auto value = strip(line.substr(colon + 1));
+    response.headers.emplace_back(name, value);
+    if (equals_ignoring_case(name, "Content-Length")) {
+      auto length = parse_uint64(value, 10);
+      if (!length) {
+        return Parse::INVALID;
+      }
+      content_length = *length;
+    } else if (equals_ignoring_case(name, "Transfer-Encoding")) {
+      chunked = equals_ignoring_case(value, "chunked");
+    } else if (equals_ignoring_case(name, "Connection")) {
+      if (equals_ignoring_case(value, "close")) {
+        response.keep_alive = false;
+      } else if (equals_ignoring_case(value, "keep-alive")) {
+        response.keep_alive = true;
+      }
+    }
+  }
+
+  const auto body = data.substr(header_end + 4);
+  response.body.clear();
+  if (response.status == 204 || response.status == 304) {
+    content_length = 0;
+  }
+  if (chunked) {
+    const Parse result = decode_chunked(body, response.body);
+    if (result == Parse::INCOMPLETE && closed) {
+      return Parse::INVALID;
+    }
+    return result;
+  }
+  if (content_length) {
+    if (body.size() < *content_length) {
+      return closed ? Parse::INVALID : Parse::INCOMPLETE;
+    }
+    response.body.assign(body.data(), *content_length);
+    // Anything after the body isn't a response to any request.
+    response.keep_alive = response.keep_alive && !closed &&
+                          body.size() == *content_length;
+    return Parse::COMPLETE;
+  }
+  // The body is everything until the server closes the connection.
+  if (!closed) {
+    return Parse::INCOMPLETE;
+  }
+  response.body.assign(body.data(), body.size());
+  response.keep_alive = false;
+  return Parse::COMPLETE;
+}
+
+}  // namespace
+
+class IoUringHTTPClientImpl {
+  // Each operation's `user_data` is the index of its connection shifted left
+  // by `operation_bits`, plus the kind of operation.
+  enum Operation : std::uint64_t { WAKE, CONNECT, SEND, RECEIVE, CANCEL };
+  static constexpr int operation_bits = 8;
+
+  struct Request {
+    // `endpoint` is the server's "host:port", or the path of its Unix domain
+    // socket if `unix_socket`.
+    std::string endpoint;
+    bool unix_socket = false;
+    // `buffers` are the request's header followed by its body.  `size` is
+    // their total size.
+    BodyChain buffers;
+    std::size_t size = 0;
+    std::size_t body_size = 0;
+    ResponseHandler on_response;
+    ErrorHandler on_error;
+    // `retried` is whether the request was sent again after a reused
+    // connection turned out to have been closed.
+    bool retried = false;
+  };
+
+  struct Connection {
+    enum State { CLOSED, CONNECTING, SENDING, RECEIVING, IDLE };
+    State state = CLOSED;
+    int fd = -1;
+    std::string endpoint;
+    bool tcp = false;
+    // `request` is the request being sent or answered, and `reused` is
+    // whether this connection had answered another request before it.
+    std::unique_ptr<Request> request;
+    bool reused = false;
+    // `timed_out` is whether `request` has passed its `deadline`, and so its
+    // operation has been canceled.
+    bool timed_out = false;
+    std::chrono::steady_clock::time_point deadline;
+    sockaddr_storage address;
+    socklen_t address_size = 0;
+    std::vector<iovec> iovecs;
+    msghdr message;
+    // `payloads` are the buffers of the sends that the kernel might still
+    // read, oldest first.  A zero-copy send's buffers are released when the
+    // kernel's notification arrives, which can be after the response.
+    std::deque<BodyChain> payloads;
+    // `num_operations` is the number of this connection's operations whose
+    // completions are yet to arrive, including zero-copy notifications.
+    std::size_t num_operations = 0;
+    // `buffer` is this connection's registered receive buffer, and
+    // `response` is what's been received of the response to `request`.
+    char* buffer = nullptr;
+    std::string response;
+
+    // Return whether nothing refers to this connection, so that it can be
+    // opened again.
+    bool is_free() const {
+      return state == CLOSED && num_operations == 0 && payloads.empty();
+    }
+    bool is_busy() const {
+      return state == CONNECTING || state == SENDING || state == RECEIVING;
+    }
+  };
+
+  std::shared_ptr<Logger> logger_;
+  const IoUringHTTPClientConfig config_;
+  // The following are used only by `thread_`, or by whichever thread has
+  // stopped it.
+  Ring ring_;
+  bool zero_copy_;
+  bool registered_buffers_;
+  std::uint64_t wake_value_;
+  std::unique_ptr<char[]> buffers_;
+  std::vector<Connection> connections_;
+  std::deque<std::unique_ptr<Request>> waiting_;
+  // `num_operations_` is the number of operations whose completions are yet
+  // to arrive.
+  std::size_t num_operations_;
+  // `new_requests_` are the requests from `send` that `thread_` is yet to
+  // take.  `wake_pending_` is whether `thread_` has been woken for them and
+  // hasn't yet taken them, so that many concurrent `send`s wake it once.
+  // `num_pending_requests_` counts the requests sent and not yet finished,
+  // which `drain` waits for.
+  MPSCQueue<std::unique_ptr<Request>> new_requests_;
+  std::atomic<bool> wake_pending_;
+  std::atomic<std::size_t> num_pending_requests_;
+  int wake_fd_;
+  std::atomic<bool> running_;
+  // Statistics reported by `config_json`.
+  std::atomic<std::uint64_t> num_requests_;
+  std::atomic<std::uint64_t> num_connections_;
+  std::atomic<std::uint64_t> num_reused_connections_;
+  std::atomic<std::uint64_t> num_zero_copy_sends_;
+  std::mutex mutex_;
+  std::condition_variable no_requests_;
+  bool shutting_down_;
+  // `forking_` is true while `thread_` is stopped for a `fork`.
+  bool forking_;
+  std::thread thread_;
+  UnregisterForkHandlers unregister_fork_handlers_;
+
+  // Create the ring and the eventfd, and prepare to read the eventfd, or
+  // return an error.
+  Expected<void> open();
+  // Close the connections and the ring, and delete the requests without
+  // calling their handlers.
+  void close();
+  // Start `thread_` running `run`, or log an error and mark this object as not
+  // running if that fails.
+  void start_thread();
+  void run();
+  // Cancel the operations in flight, wait for them to finish, and then
+  // `close`.
+  void shut_down();
+  void before_fork();
+  void after_fork_in_parent();
+  void after_fork_in_child();
+  void wake();
+
+  // Prepare an operation of the specified `kind` for the specified
+  // connection `index`, and return its submission queue entry, or return
+  // null if the queue is full.
+  io_uring_sqe* prepare(std::size_t index, Operation kind);
+  void prepare_wake();
+  void handle(const io_uring_cqe&);
+  // Send the waiting requests on free or idle connections, until there are
+  // none left.
+  void dispatch();
+  void start(std::size_t index, std::unique_ptr<Request> request,
+             bool reused);
+  Expected<void> open_connection(std::size_t index);
+  void send_request(std::size_t index);
+  void receive_response(std::size_t index);
+  void on_connect(std::size_t index, int result);
+  void on_send(std::size_t index, const io_uring_cqe&);
+  void on_receive(std::size_t index, int result);
+  // Cancel the operations of requests past their deadlines.  Return the
+  // earliest deadline of the others, if any.
+  std::optional<std::chrono::steady_clock::time_point> expire();
+  // Close the specified connection, and send its request again on another
+  // connection if it was reused and received nothing.  Otherwise, fail the
+  // request with the specified `error`.
+  void retry_or_fail(std::size_t index, Error error);
+  void fail(std::size_t index, Error error);
+  void fail(std::unique_ptr<Request> request, Error error);
+  void close_connection(Connection&);
+  // Count a finished request, and notify `drain` if it was the last.
+  void finished();
+  Error timeout_error(const Connection&) const;
+
+ public:
+  IoUringHTTPClientImpl(const std::shared_ptr<Logger>& logger,
+                        const IoUringHTTPClientConfig& config);
+  ~IoUringHTTPClientImpl();
+
+  // Send a POST request having the specified `body`, or a GET request if
+  // `body` is null.
+  Expected<void> send(const URL& url, HeadersSetter set_headers,
+                      std::optional<BodyChain> body,
+                      ResponseHandler on_response, ErrorHandler on_error);
+
+  void drain(std::chrono::steady_clock::time_point deadline);
+
+  nlohmann::json config_json() const;
+};
+
+IoUringHTTPClientImpl::IoUringHTTPClientImpl(
+    const std::shared_ptr<Logger>& logger,
+    const IoUringHTTPClientConfig& config)
+    : logger_(logger),
+      config_(config),
+      zero_copy_(false),
+      registered_buffers_(false),
+      wake_value_(0),
+      num_operations_(0),
+      wake_pending_(false),
+      num_pending_requests_(0),
+      wake_fd_(-1),
+      running_(false),
+      num_requests_(0),
+      num_connections_(0),
+      num_reused_connections_(0),
+      num_zero_copy_sends_(0),
+      shutting_down_(false),
+      forking_(false) {
+  auto opened = open();
+  if (auto* error = opened.if_error()) {
+    logger_->log_error(*error);
+    close();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    start_thread();
+  }
+  if (!running_) {
+    close();
+    return;
+  }
+  unregister_fork_handlers_ = register_fork_handlers(
+      ForkHandlers{[this]() { before_fork(); },
+                   [this]() { after_fork_in_parent(); },
+                   [this]() { after_fork_in_child(); }});
+}
+
+IoUringHTTPClientImpl::~IoUringHTTPClientImpl() {
+  if (unregister_fork_handlers_) {
+    unregister_fork_handlers_();
+  }
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutting_down_ = true;
+    }
+    wake();
+    thread_.join();
+  }
+  if (wake_fd_ != -1) {
+    ::close(wake_fd_);
+  }
+}
+
+Expected<void> IoUringHTTPClientImpl::open() {
+  const std::size_t num_connections =
+      std::max<std::size_t>(config_.max_connections, 1);
+  // Each connection has at most one operation and one cancellation
+  // submitted at a time, besides the read of the eventfd, and so the
+  // submission queue never fills.
+  auto opened = ring_.open(unsigned(num_connections * 2 + 8));
+  if (auto* error = opened.if_error()) {
+    return std::move(*error);
+  }
+  zero_copy_ = config_.zero_copy && ring_.supports(IORING_OP_SENDMSG_ZC);
+
+  const std::size_t buffer_size =
+      std::max<std::size_t>(config_.receive_buffer_size, 1);
+  buffers_.reset(new char[num_connections * buffer_size]);
+  connections_.clear();
+  connections_.resize(num_connections);
+  std::vector<iovec> buffers;
+  for (std::size_t i = 0; i < num_connections; ++i) {
+    connections_[i].buffer = buffers_.get() + i * buffer_size;
+    buffers.push_back(iovec{connections_[i].buffer, buffer_size});
+  }
+  // Registration can fail if the buffers would exceed the limit on locked
+  // memory, in which case the connections use plain reads instead.
+  const auto registered =
+      ring_.register_buffers(buffers.data(), unsigned(buffers.size()));
+  registered_buffers_ = !registered.if_error();
+
+  wake_fd_ = ::eventfd(0, EFD_CLOEXEC);
+  if (wake_fd_ == -1) {
+    return errno_error(Error::IO_URING_HTTP_CLIENT_SETUP_FAILED,
+                       "Unable to create an eventfd", errno);
+  }
+  prepare_wake();
+  return std::nullopt;
+}
+
+void IoUringHTTPClientImpl::close() {
+  for (Connection& connection : connections_) {
+    if (connection.fd != -1) {
+      ::close(connection.fd);
+    }
+  }
+  connections_.clear();
+  waiting_.clear();
+  new_requests_.drain([](std::unique_ptr<Request>) {});
+  num_operations_ = 0;
+  ring_.close();
+  buffers_.reset();
+}
+
+void IoUringHTTPClientImpl::start_thread() {
+  forking_ = false;
+  try {
+    thread_ = std::thread([this]() { run(); });
+    running_ = true;
+  } catch (const std::system_error& error) {
+    logger_->log_error(
+        Error{Error::IO_URING_HTTP_CLIENT_SETUP_FAILED, error.what()});
+    running_ = false;
+  }
+}
+
+void IoUringHTTPClientImpl::wake() {
+  const std::uint64_t one = 1;
+  // If the counter is about to overflow, then the thread is already due to
+  // wake.
+  if (::write(wake_fd_, &one, sizeof one) < 0) {
+    return;
+  }
+}
+
+Expected<void> IoUringHTTPClientImpl::send(const URL& url,
+                                           HeadersSetter set_headers,
+                                           std::optional<BodyChain> body,
+                                           ResponseHandler on_response,
+                                           ErrorHandler on_error) {
+  if (!running_) {
+    return not_running();
+  }
+
+  auto request = std::make_unique<Request>();
+  if (url.scheme == "unix" || url.scheme == "http+unix") {
+    request->unix_socket = true;
+  } else if (url.scheme != "http") {
+    return Error{Error::IO_URING_REQUEST_SETUP_FAILED,
+                 "The io_uring HTTP client doesn't support the URL scheme \"" +
+                     url.scheme + "\"."};
+  }
+  request->endpoint = url.authority;
+
+  std::string header;
+  header += body ? "POST " : "GET ";
+  header += url.path.empty() ? "/" : url.path;
+  header += " HTTP/1.1\r\nHost: ";
+  // The authority of a Unix domain socket URL is the socket's path.
+  header += request->unix_socket ? "localhost" : url.authority;
+  header += "\r\n";
+  if (body) {
+    for (const auto& buffer : *body) {
+      request->body_size += buffer->size();
+    }
+    header += "Content-Length: ";
+    header += std::to_string(request->body_size);
+    header += "\r\n";
+  }
+  HeaderWriter writer{&header};
+  set_headers(writer);
+  header += "\r\n";
+
+  request->size = header.size() + request->body_size;
+  request->buffers.reserve(1 + (body ? body->size() : 0));
+  request->buffers.push_back(
+      std::make_shared<const std::string>(std::move(header)));
+  if (body) {
+    std::move(body->begin(), body->end(),
+              std::back_inserter(request->buffers));
+  }
+  request->on_response = std::move(on_response);
+  request->on_error = std::move(on_error);
+
+  // The request is counted before it's pushed, so that `drain` can't miss it.
+  ++num_pending_requests_;
+  new_requests_.push(std::move(request));
+  if (!wake_pending_.exchange(true)) {
+    wake();
+  }
+  return std::nullopt;
+}
+
+void IoUringHTTPClientImpl::drain(
+    std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  no_requests_.wait_until(lock, deadline,
+                          [this]() { return num_pending_requests_ == 0; });
+}
+
+void IoUringHTTPClientImpl::run() {
+  auto placed =
+      place_current_thread(config_.thread_placement, "dd-trace-uring");
+  if (auto* error = placed.if_error()) {
+    logger_->log_error(*error);
+  }
+
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+  for (;;) {
+    // Submit everything prepared since the last time, and then sleep until
+    // something completes, a request's deadline passes, or we're woken.
+    const int result = ring_.enter(deadline);
+    if (result < 0 && result != -ETIME && result != -EINTR &&
+        result != -EAGAIN && result != -EBUSY) {
+      logger_->log_error(errno_error(Error::IO_URING_REQUEST_FAILURE,
+                                     "io_uring_enter failed", -result));
+      running_ = false;
+      break;
+    }
+    ring_.reap([this](const io_uring_cqe& entry) { handle(entry); });
+    dispatch();
+    deadline = expire();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_) {
+      break;
+    }
+    if (forking_) {
+      // Leave everything as it is, for the thread that replaces this one.
+      return;
+    }
+  }
+
+  shut_down();
+}
+
+void IoUringHTTPClientImpl::shut_down() {
+  for (std::size_t i = 0; i < connections_.size(); ++i) {
+    Connection& connection = connections_[i];
+    if (!connection.is_busy()) {
+      continue;
+    }
+    const Operation kind = connection.state == Connection::CONNECTING ? CONNECT
+                           : connection.state == Connection::SENDING  ? SEND
+                                                                      : RECEIVE;
+    if (io_uring_sqe* entry = prepare(i, CANCEL)) {
+      entry->opcode = IORING_OP_ASYNC_CANCEL;
+      entry->addr = (i << operation_bits) | kind;
+    }
+    ::shutdown(connection.fd, SHUT_RDWR);
+  }
+  if (io_uring_sqe* entry = prepare(0, CANCEL)) {
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->addr = WAKE;
+  }
+
+  // The kernel might still be using the buffers of the operations in flight,
+  // so wait for them before freeing the buffers.
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (num_operations_ != 0 && std::chrono::steady_clock::now() < deadline) {
+    const int result = ring_.enter(deadline);
+    if (result < 0 && result != -ETIME && result != -EINTR) {
+      break;
+    }
+    ring_.reap([this](const io_uring_cqe& entry) {
+      if (!(entry.flags & IORING_CQE_F_MORE)) {
+        --num_operations_;
+      }
+    });
+  }
+  close();
+}
+
+void IoUringHTTPClientImpl::before_fork() {
+  if (!running_) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    forking_ = true;
+  }
+  wake();
+  thread_.join();
+}
+
+void IoUringHTTPClientImpl::after_fork_in_parent() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!forking_) {
+    return;
+  }
+  start_thread();
+}
+
+void IoUringHTTPClientImpl::after_fork_in_child() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!forking_) {
+    return;
+  }
+  // The ring, the connections, and the requests in flight are shared with
+  // the parent, whose responses they'll receive, and so the child closes its
+  // references to them without calling the requests' handlers.  Requests
+  // that haven't been sent are the parent's too.
+  close();
+  num_pending_requests_ = 0;
+  wake_pending_ = false;
+  // The eventfd is shared with the parent, whose thread it would wake.
+  ::close(wake_fd_);
+  wake_fd_ = -1;
+  auto opened = open();
+  if (auto* error = opened.if_error()) {
+    logger_->log_error(*error);
+    close();
+    forking_ = false;
+    running_ = false;
+    return;
+  }
+  start_thread();
+}
+
+io_uring_sqe* IoUringHTTPClientImpl::prepare(std::size_t index,
+                                             Operation kind) {
+  io_uring_sqe* const entry = ring_.prepare();
+  if (entry == nullptr) {
+    logger_->log_error(Error{Error::IO_URING_REQUEST_FAILURE,
+                             "The io_uring submission queue is full."});
+    return nullptr;
+  }
+  entry->user_data = (std::uint64_t(index) << operation_bits) | kind;
+  ++num_operations_;
+  if (kind != WAKE) {
+    ++connections_[index].num_operations;
+  }
+  return entry;
+}
+
+void IoUringHTTPClientImpl::prepare_wake() {
+  if (io_uring_sqe* entry = prepare(0, WAKE)) {
+    entry->opcode = IORING_OP_READ;
+    entry->fd = wake_fd_;
+    entry->addr = reinterpret_cast<std::uintptr_t>(&wake_value_);
+    entry->len = sizeof wake_value_;
+  }
+}
+
+void IoUringHTTPClientImpl::handle(const io_uring_cqe& entry) {
+  const std::size_t index = std::size_t(entry.user_data >> operation_bits);
+  const auto kind =
+      Operation(entry.user_data & ((std::uint64_t(1) << operation_bits) - 1));
+  // An operation that completes in several parts, such as a zero-copy send
+  // and its notification, flags each part but the last.
+  if (!(entry.flags & IORING_CQE_F_MORE)) {
+    --num_operations_;
+    if (kind != WAKE) {
+      --connections_[index].num_operations;
+    }
+  }
+
+  switch (kind) {
+    case WAKE:
+      prepare_wake();
+      // A `send` after this point wakes us again.
+      wake_pending_ = false;
+      new_requests_.drain([this](std::unique_ptr<Request> request) {
+        waiting_.push_back(std::move(request));
+      });
+      break;
+    case CONNECT:
+      on_connect(index, entry.res);
+      break;
+    case SEND:
+      on_send(index, entry);
+      break;
+    case RECEIVE:
+      on_receive(index, entry.res);
+      break;
+    case CANCEL:
+      break;
+  }
+}
+
+void IoUringHTTPClientImpl::dispatch() {
+  while (!waiting_.empty()) {
+    const std::string& endpoint = waiting_.front()->endpoint;
+    std::optional<std::size_t> chosen;
+    bool reused = false;
+    for (std::size_t i = 0; i < connections_.size(); ++i) {
+      const Connection& connection = connections_[i];
+      if (connection.state == Connection::IDLE &&
+          connection.endpoint == endpoint) {
+        chosen = i;
+        reused = true;
+        break;
+      }
+      if (!chosen && connection.is_free()) {
+        chosen = i;
+      }
+    }
+    if (!chosen) {
+      // Make room by closing a connection kept for another server.
+      for (Connection& connection : connections_) {
+        if (connection.state == Connection::IDLE) {
+          close_connection(connection);
+          if (connection.is_free()) {
+            chosen = &connection - connections_.data();
+            break;
+          }
+        }
+      }
+    }
+    if (!chosen) {
+      // The request waits for a connection to finish.
+      return;
+    }
+    auto request = std::move(waiting_.front());
+    waiting_.pop_front();
+    start(*chosen, std::move(request), reused);
+  }
+}
+
+void IoUringHTTPClientImpl::start(std::size_t index,
+                                  std::unique_ptr<Request> request,
+                                  bool reused) {
+  Connection& connection = connections_[index];
+  connection.request = std::move(request);
+  connection.reused = reused;
+  connection.timed_out = false;
+  connection.deadline =
+      std::chrono::steady_clock::now() + config_.request_timeout;
+  connection.response.clear();
+  if (reused) {
+    ++num_reused_connections_;
+    send_request(index);
+    return;
+  }
+  auto opened = open_connection(index);
+  if (auto* error = opened.if_error()) {
+    auto request = std::move(connection.request);
+    close_connection(connection);
+    fail(std::move(request), std::move(*error));
+  }
+}
+
+Expected<void> IoUringHTTPClientImpl::open_connection(std::size_t index) {
+  Connection& connection = connections_[index];
+  const Request& request = *connection.request;
+  connection.endpoint = request.endpoint;
+  connection.tcp = !request.unix_socket;
+  std::memset(&connection.address, 0, sizeof connection.address);
+
+  if (request.unix_socket) {
+    auto& address = reinterpret_cast<sockaddr_un&>(connection.address);
+    if (request.endpoint.size() >= sizeof address.sun_path) {
+      return Error{Error::IO_URING_REQUEST_FAILURE,
+                   "Unix domain socket path is too long: " + request.endpoint};
+    }
+    address.sun_family = AF_UNIX;
+    request.endpoint.copy(address.sun_path, request.endpoint.size());
+    connection.address_size = sizeof address;
+  } else {
+    // e.g. "localhost:8126" or "[::1]:8126".  The name is resolved by this
+    // thread, which blocks while it's resolved.  Since connections are kept
+    // alive, that's rare.
+    std::string host = request.endpoint;
+    std::string port = "80";
+    const auto colon = host.rfind(':');
+    if (colon != std::string::npos &&
+        host.find(']', colon) == std::string::npos) {
+      port = host.substr(colon + 1);
+      host.resize(colon);
+    }
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+      host = host.substr(1, host.size() - 2);
+    }
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    const int rc =
+        ::getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if (rc != 0 || addresses == nullptr) {
+      return Error{Error::IO_URING_REQUEST_FAILURE,
+                   "Unable to resolve " + request.endpoint + ": " +
+                       ::gai_strerror(rc)};
+    }
+    std::memcpy(&connection.address, addresses->ai_addr,
+                addresses->ai_addrlen);
+    connection.address_size = addresses->ai_addrlen;
+    ::freeaddrinfo(addresses);
+  }
+
+  connection.fd = ::socket(connection.address.ss_family,
+                           SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (connection.fd == -1) {
+    return errno_error(Error::IO_URING_REQUEST_FAILURE,
+                       "Unable to create a socket", errno);
+  }
+  if (connection.tcp) {
+    // Requests are sent whole, and so there's nothing for Nagle's algorithm
+    // to coalesce.
+    const int one = 1;
+    ::setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  }
+  io_uring_sqe* const entry = prepare(index, CONNECT);
+  if (entry == nullptr) {
+    return Error{Error::IO_URING_REQUEST_FAILURE,
+                 "The io_uring submission queue is full."};
+  }
+  entry->opcode = IORING_OP_CONNECT;
+  entry->fd = connection.fd;
+  entry->addr = reinterpret_cast<std::uintptr_t>(&connection.address);
+  entry->off = connection.address_size;
+  connection.state = Connection::CONNECTING;
+  ++num_connections_;
+  return std::nullopt;
+}
+
+void IoUringHTTPClientImpl::send_request(std::size_t index) {
+  Connection& connection = connections_[index];
+  const Request& request = *connection.request;
+  // The iovecs refer to the buffers kept in `payloads`.
+  connection.payloads.push_back(request.buffers);
+  connection.iovecs.clear();
+  for (const auto& buffer : request.buffers) {
+    if (!buffer->empty()) {
+      connection.iovecs.push_back(
+          iovec{const_cast<char*>(buffer->data()), buffer->size()});
+    }
+  }
+  std::memset(&connection.message, 0, sizeof connection.message);
+  connection.message.msg_iov = connection.iovecs.data();
+  connection.message.msg_iovlen = connection.iovecs.size();
+
+  io_uring_sqe* const entry = prepare(index, SEND);
+  if (entry == nullptr) {
+    connection.payloads.pop_back();
+    fail(index, Error{Error::IO_URING_REQUEST_FAILURE,
+                      "The io_uring submission queue is full."});
+    return;
+  }
+  const bool zero_copy = zero_copy_ && connection.tcp &&
+                         request.body_size >= config_.zero_copy_min_bytes;
+  entry->opcode = zero_copy ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+  entry->fd = connection.fd;
+  entry->addr = reinterpret_cast<std::uintptr_t>(&connection.message);
+  entry->len = 1;
+  // `MSG_WAITALL` has the kernel finish a partial send before completing.
+  entry->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+  if (zero_copy) {
+    ++num_zero_copy_sends_;
+  }
+  connection.state = Connection::SENDING;
+}
+
+void IoUringHTTPClientImpl::receive_response(std::size_t index) {
+  Connection& connection = connections_[index];
+  io_uring_sqe* const entry = prepare(index, RECEIVE);
+  if (entry == nullptr) {
+    fail(index, Error{Error::IO_URING_REQUEST_FAILURE,
+                      "The io_uring submission queue is full."});
+    return;
+  }
+  entry->opcode = registered_buffers_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  entry->fd = connection.fd;
+  entry->addr = reinterpret_cast<std::uintptr_t>(connection.buffer);
+  entry->len =
+      unsigned(std::max<std::size_t>(config_.receive_buffer_size, 1));
+  entry->buf_index = std::uint16_t(index);
+  connection.state = Connection::RECEIVING;
+}
+
+void IoUringHTTPClientImpl::on_connect(std::size_t index, int result) {
+  Connection& connection = connections_[index];
+  if (connection.timed_out) {
+    fail(index, timeout_error(connection));
+  } else if (result < 0) {
+    fail(index, errno_error(Error::IO_URING_REQUEST_FAILURE,
+                            "Unable to connect to " + connection.endpoint,
+                            -result));
+  } else {
+    send_request(index);
+  }
+}
+
+void IoUringHTTPClientImpl::on_send(std::size_t index,
+                                    const io_uring_cqe& entry) {
+  Connection& connection = connections_[index];
+  if (entry.flags & IORING_CQE_F_NOTIF) {
+    // The kernel is done with the oldest zero-copy send's buffers.
+    connection.payloads.pop_front();
+    return;
+  }
+  if (!(entry.flags & IORING_CQE_F_MORE)) {
+    // No notification follows, and so the kernel is done with the buffers.
+    connection.payloads.pop_front();
+  }
+
+  if (connection.timed_out) {
+    fail(index, timeout_error(connection));
+  } else if (entry.res < 0) {
+    retry_or_fail(index,
+                  errno_error(Error::IO_URING_REQUEST_FAILURE,
+                              "Unable to send to " + connection.endpoint,
+                              -entry.res));
+  } else if (std::size_t(entry.res) != connection.request->size) {
+    fail(index, Error{Error::IO_URING_REQUEST_FAILURE,
+                      "Only part of the request was sent to " +
+                          connection.endpoint + "."});
+  } else {
+    receive_response(index);
+  }
+}
+
+void IoUringHTTPClientImpl::on_receive(std::size_t index, int result) {
+  Connection& connection = connections_[index];
+  if (connection.timed_out) {
+    fail(index, timeout_error(connection));
+    return;
+  }
+  if (result < 0) {
+    retry_or_fail(index,
+                  errno_error(Error::IO_URING_REQUEST_FAILURE,
+                              "Unable to receive from " + connection.endpoint,
+                              -result));
+    return;
+  }
+  connection.response.append(connection.buffer, std::size_t(result));
+
+  // Each read parses the response from the beginning.  Responses from the
+  // Datadog Agent fit in one read.
+  Response response;
+  const bool closed = result == 0;
+  switch (parse_response(connection.response, closed, response)) {
+    case Parse::INCOMPLETE:
+      receive_response(index);
+      return;
+    case Parse::INVALID:
+      if (connection.response.empty()) {
+        retry_or_fail(index,
+                      Error{Error::IO_URING_REQUEST_FAILURE,
+                            connection.endpoint +
+                                " closed the connection without responding."});
+      } else {
+        fail(index, Error{Error::IO_URING_REQUEST_FAILURE,
+                          "Received an invalid HTTP response from " +
+                              connection.endpoint + "."});
+      }
+      return;
+    case Parse::COMPLETE:
+      break;
+  }
+
+  auto request = std::move(connection.request);
+  const ContainerDictReader<Headers> headers{response.headers};
+  request->on_response(response.status, headers, std::move(response.body));
+  if (response.keep_alive) {
+    connection.state = Connection::IDLE;
+    connection.response.clear();
+  } else {
+    close_connection(connection);
+  }
+  finished();
+}
+
+std::optional<std::chrono::steady_clock::time_point>
+IoUringHTTPClientImpl::expire() {
+  const auto now = std::chrono::steady_clock::now();
+  std::optional<std::chrono::steady_clock::time_point> earliest;
+  for (std::size_t i = 0; i < connections_.size(); ++i) {
+    Connection& connection = connections_[i];
+    if (!connection.is_busy() || connection.timed_out) {
+      continue;
+    }
+    if (connection.deadline > now) {
+      if (!earliest || connection.deadline < *earliest) {
+        earliest = connection.deadline;
+      }
+      continue;
+    }
+    // The canceled operation completes with an error, or, if it was too late
+    // to cancel, as usual.  Either way, the request then fails.
+    connection.timed_out = true;
+    const Operation kind = connection.state == Connection::CONNECTING ? CONNECT
+                           : connection.state == Connection::SENDING  ? SEND
+                                                                      : RECEIVE;
+    if (io_uring_sqe* entry = prepare(i, CANCEL)) {
+      entry->opcode = IORING_OP_ASYNC_CANCEL;
+      entry->addr = (std::uint64_t(i) << operation_bits) | kind;
+    }
+    if (kind != CONNECT) {
+      ::shutdown(connection.fd, SHUT_RDWR);
+    }
+  }
+  return earliest;
+}
+
+void IoUringHTTPClientImpl::retry_or_fail(std::size_t index, Error error) {
+  Connection& connection = connections_[index];
+  if (!connection.reused || !connection.response.empty() ||
+      connection.request->retried) {
+    fail(index, std::move(error));
+    return;
+  }
+  // The server closed the connection while it was idle.
+  auto request = std::move(connection.request);
+  close_connection(connection);
+  request->retried = true;
+  waiting_.push_front(std::move(request));
+}
+
+void IoUringHTTPClientImpl::fail(std::size_t index, Error error) {
+  Connection& connection = connections_[index];
+  auto request = std::move(connection.request);
+  close_connection(connection);
+  fail(std::move(request), std::move(error));
+}
+
+void IoUringHTTPClientImpl::fail(std::unique_ptr<Request> request,
+                                 Error error) {
+  request->on_error(std::move(error));
+  finished();
+}
+
+void IoUringHTTPClientImpl::close_connection(Connection& connection) {
+  if (connection.fd != -1) {
+    ::close(connection.fd);
+    connection.fd = -1;
+  }
+  connection.state = Connection::CLOSED;
+  connection.endpoint.clear();
+  connection.response.clear();
+}
+
+void IoUringHTTPClientImpl::finished() {
+  ++num_requests_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--num_pending_requests_ == 0) {
+    no_requests_.notify_all();
+  }
+}
+
+Error IoUringHTTPClientImpl::timeout_error(const Connection& connection) const {
+  return Error{Error::IO_URING_REQUEST_FAILURE,
+               "Request to " + connection.endpoint + " timed out after " +
+                   std::to_string(config_.request_timeout.count()) +
+                   " milliseconds."};
+}
+
+nlohmann::json IoUringHTTPClientImpl::config_json() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::IoUringHTTPClient"},
+    {"config", to_json(config_)},
+    {"running", running_.load()},
+    {"stats", nlohmann::json::object({
+      {"requests", num_requests_.load()},
+      {"connections", num_connections_.load()},
+      {"reused_connections", num_reused_connections_.load()},
+      {"zero_copy_sends", num_zero_copy_sends_.load()},
+    })},
+  });
+  // clang-format on
+}
+
+#endif  // DD_TRACE_HAS_IO_URING
+
+IoUringHTTPClient::IoUringHTTPClient(const std::shared_ptr<Logger>& logger,
+                                     const IoUringHTTPClientConfig& config)
+    : impl_(new IoUringHTTPClientImpl{logger, config}) {}
+
+IoUringHTTPClient::~IoUringHTTPClient() { delete impl_; }
+
+Expected<void> IoUringHTTPClient::post(const URL& url,
+                                       HeadersSetter set_headers,
+                                       std::string body,
+                                       ResponseHandler on_response,
+                                       ErrorHandler on_error) {
+  BodyChain chain;
+  chain.push_back(std::make_shared<const std::string>(std::move(body)));
+  return impl_->send(url, std::move(set_headers), std::move(chain),
+                     std::move(on_response), std::move(on_error));
+}
+
+Expected<void> IoUringHTTPClient::post(const URL& url,
+                                       HeadersSetter set_headers,
+                                       BodyChain body,
+                                       ResponseHandler on_response,
+                                       ErrorHandler on_error) {
+  return impl_->send(url, std::move(set_headers), std::move(body),
+                     std::move(on_response), std::move(on_error));
+}
+
+Expected<void> IoUringHTTPClient::get(const URL& url,
+                                      HeadersSetter set_headers,
+                                      ResponseHandler on_response,
+                                      ErrorHandler on_error) {
+  return impl_->send(url, std::move(set_headers), std::nullopt,
+                     std::move(on_response), std::move(on_error));
+}
+
+void IoUringHTTPClient::drain(std::chrono::steady_clock::time_point deadline) {
+  impl_->drain(deadline);
+}
+
+nlohmann::json IoUringHTTPClient::config_json() const {
+  return impl_->config_json();
+}
+
+}  // namespace tracing
+}  // namespace datadog
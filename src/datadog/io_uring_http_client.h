@@ -0,0 +1,112 @@
+#pragma once
+
+// This component provides a class, `IoUringHTTPClient`, that implements the
+// `HTTPClient` interface on Linux using [io_uring][1], without libcurl.
+//
+// `IoUringHTTPClient` is meant for sending to the Datadog Agent, and so it
+// speaks just enough HTTP/1.1 for that: plain HTTP over TCP ("http" URLs) or
+// over a Unix domain socket ("unix" and "http+unix" URLs), requests whose
+// bodies have a `Content-Length`, and responses framed by `Content-Length`, by
+// chunked transfer encoding, or by the end of the connection.  It supports
+// neither TLS, proxies, nor redirects.  A request to an "https" URL is an
+// error.
+//
+// `IoUringHTTPClient` manages a thread, named "dd-trace-uring", that owns an
+// io_uring.  `post` and `get` hand their requests to the thread without
+// locking, and wake it by writing to an eventfd that the ring is reading.  The
+// thread prepares the operations of all of the requests that it finds, and
+// submits them together in the same `io_uring_enter` call in which it waits
+// for completions, and so many concurrent requests cost one system call.
+//
+// Connections are kept alive between requests.  At most
+// `IoUringHTTPClientConfig::max_connections` are open at once, and a request
+// waits while all of them are busy.  Each connection has a receive buffer that
+// is registered with the ring, so that the kernel needn't map it for each
+// read.  If a reused connection turns out to have been closed by the server
+// before it responded, then the request is sent again on a new connection,
+// once.
+//
+// A request is sent by one `sendmsg` whose iovecs are the request's header and
+// each of the buffers of its body, and so the body is never concatenated.  A
+// body of at least `IoUringHTTPClientConfig::zero_copy_min_bytes` sent over
+// TCP is sent with zero copies (`IORING_OP_SENDMSG_ZC`), if the kernel
+// supports it: the network stack transmits from the body's own pages, and the
+// body is released once the kernel notifies that it's done with them.
+// Smaller bodies are cheaper to copy than to pin.
+//
+// Like `Curl`, `IoUringHTTPClient` stops its thread before `fork` and starts it
+// again afterward (see `fork_handlers.h`).  In the child, the ring, the
+// connections and the requests in flight belong to the parent, and so the
+// child abandons them, discards the requests not yet sent, and begins again
+// with a new ring.  `fork` must not be called from within a response or error
+// handler.
+//
+// io_uring requires Linux 5.11 or later, and zero-copy sends Linux 6.1 or
+// later.  If the ring can't be created, e.g. because the kernel is too old or
+// io_uring is forbidden by a seccomp policy, then the error is logged and
+// every request fails with an error.  The same is true on other platforms.
+//
+// [1]: https://kernel.dk/io_uring.pdf
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "http_client.h"
+#include "json_fwd.hpp"
+#include "thread_placement.h"
+
+namespace datadog {
+namespace tracing {
+
+class IoUringHTTPClientImpl;
+class Logger;
+
+struct IoUringHTTPClientConfig {
+  // `max_connections` is the maximum number of connections open at once.
+  // Each is kept alive for later requests to the same server.
+  std::size_t max_connections = 4;
+  // `receive_buffer_size` is the size of each connection's registered
+  // receive buffer.  A larger response is received in several reads.
+  std::size_t receive_buffer_size = 16 * 1024;
+  // `request_timeout` is how long a request may take, from when it's sent,
+  // including connecting, until its response has been received.
+  std::chrono::milliseconds request_timeout = std::chrono::seconds(10);
+  // `zero_copy` is whether request bodies of at least `zero_copy_min_bytes`
+  // are sent over TCP with zero copies, if the kernel supports it.
+  bool zero_copy = true;
+  std::size_t zero_copy_min_bytes = 16 * 1024;
+  // `thread_placement` is applied to the thread that drives the ring.  If it
+  // can't be applied, then the error is logged and the thread runs anyway.
+  ThreadPlacement thread_placement;
+};
+
+class IoUringHTTPClient : public HTTPClient {
+  IoUringHTTPClientImpl* impl_;
+
+ public:
+  explicit IoUringHTTPClient(
+      const std::shared_ptr<Logger>& logger,
+      const IoUringHTTPClientConfig& config = IoUringHTTPClientConfig{});
+  ~IoUringHTTPClient();
+
+  IoUringHTTPClient(const IoUringHTTPClient&) = delete;
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
+                      ErrorHandler on_error) override;
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      BodyChain body, ResponseHandler on_response,
+                      ErrorHandler on_error) override;
+  Expected<void> get(const URL& url, HeadersSetter set_headers,
+                     ResponseHandler on_response,
+                     ErrorHandler on_error) override;
+
+  void drain(std::chrono::steady_clock::time_point deadline) override;
+
+  nlohmann::json config_json() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
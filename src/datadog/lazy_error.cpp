@@ -0,0 +1,65 @@
+#include "lazy_error.h"
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The suffix of a part that was truncated.
+constexpr std::string_view ellipsis = "...";
+
+// Invoke the specified `append` with each of the specified `parts`, each
+// truncated to `LazyError::max_part_size` bytes.
+template <typename Parts, typename Append>
+void for_each_truncated(const Parts& parts, std::size_t size, Append&& append) {
+  for (std::size_t i = 0; i < size; ++i) {
+    const std::string_view part = parts[i];
+    if (part.size() <= LazyError::max_part_size) {
+      append(part);
+    } else {
+      append(part.substr(0, LazyError::max_part_size));
+      append(ellipsis);
+    }
+  }
+}
+
+}  // namespace
+
+LazyError::LazyError(Error::Code code,
+                     std::initializer_list<std::string_view> parts)
+    : code(code), size_(std::min(parts.size(), max_parts)) {
+  std::copy_n(parts.begin(), size_, parts_.begin());
+}
+
+LazyError LazyError::with_context(
+    std::initializer_list<std::string_view> parts) const {
+  LazyError result{code, parts};
+  const std::size_t kept = std::min(size_, max_parts - result.size_);
+  std::copy_n(parts_.begin(), kept, result.parts_.begin() + result.size_);
+  result.size_ += kept;
+  return result;
+}
+
+Error LazyError::to_error() const {
+  std::size_t size = 0;
+  for_each_truncated(parts_, size_,
+                     [&](std::string_view part) { size += part.size(); });
+  std::string message;
+  message.reserve(size);
+  for_each_truncated(parts_, size_,
+                     [&](std::string_view part) { message += part; });
+  return Error{code, std::move(message)};
+}
+
+std::ostream& operator<<(std::ostream& stream, const LazyError& error) {
+  stream << "[error code " << int(error.code) << "] ";
+  for_each_truncated(error.parts_, error.size_,
+                     [&](std::string_view part) { stream << part; });
+  return stream;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,64 @@
+#pragma once
+
+// This component provides a class, `LazyError`, that is an `Error` whose
+// message hasn't been formatted yet.
+//
+// Parsing the trace context of a request fails whenever a client sends a
+// malformed header, which at the edge of a network might be often, and on
+// purpose.  An `Error` allocates its message, and so a failure that is then
+// only checked, or logged to a logger that discards it, would cost as much as
+// formatting the message, which includes the malformed input.
+//
+// A `LazyError` instead has the code of the error and up to `max_parts`
+// pieces of its message, as `std::string_view`s that refer to string literals
+// or to the input being parsed.  Creating, copying, and adding context to a
+// `LazyError` don't allocate.  The message is formatted only when the
+// `LazyError` is written to a stream, e.g. in a `Logger` callback, or is
+// converted to an `Error` by `to_error`, e.g. to be returned to the user.
+// Each piece is truncated to `max_part_size` bytes when formatted, and so the
+// size of a message is bounded however large the input.
+//
+// Since the pieces aren't owned, a `LazyError` must not outlive the strings to
+// which they refer.  Use `to_error` to keep the error any longer.
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <iosfwd>
+#include <string_view>
+
+#include "error.h"
+
+namespace datadog {
+namespace tracing {
+
+class LazyError {
+ public:
+  static constexpr std::size_t max_parts = 12;
+  static constexpr std::size_t max_part_size = 128;
+
+  Error::Code code;
+
+ private:
+  std::array<std::string_view, max_parts> parts_;
+  std::size_t size_;
+
+ public:
+  // Create an error having the specified `code` and the message that is the
+  // concatenation of the specified `parts`.  Parts beyond `max_parts` are
+  // ignored.
+  LazyError(Error::Code code, std::initializer_list<std::string_view> parts);
+
+  // Return a copy of this error whose message is preceded by the specified
+  // `parts`.  The parts of this error that would exceed `max_parts` are
+  // ignored.
+  LazyError with_context(std::initializer_list<std::string_view> parts) const;
+
+  // Return this error with its message formatted.
+  Error to_error() const;
+
+  friend std::ostream& operator<<(std::ostream&, const LazyError&);
+};
+
+}  // namespace tracing
+}  // namespace datadog
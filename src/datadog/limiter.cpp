@@ -1,100 +1,160 @@
 #include "limiter.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <iostream>
-#include <numeric>
+#include <limits>
 
 namespace datadog {
 namespace tracing {
+namespace {
 
-Limiter::Limiter(const Clock& clock, int max_tokens, double refresh_rate,
-                 int tokens_per_refresh)
+// Each element of `Limiter::periods_` packs the second that it describes
+// (modulo 2^24), the number of requests allowed in that second, and the
+// number of requests made in that second.  The counts saturate at 2^20 - 1,
+// after which the second's rate no longer changes.
+constexpr int count_bits = 20;
+constexpr std::uint64_t count_mask = (std::uint64_t(1) << count_bits) - 1;
+constexpr std::uint64_t tag_mask = (std::uint64_t(1) << 24) - 1;
+
+struct Period {
+  std::uint64_t tag;
+  std::uint64_t allowed;
+  std::uint64_t requested;
+
+  static Period decode(std::uint64_t word) {
+    return Period{word >> (2 * count_bits), (word >> count_bits) & count_mask,
+                  word & count_mask};
+  }
+
+  std::uint64_t encode() const {
+    return (tag << (2 * count_bits)) | (allowed << count_bits) | requested;
+  }
+
+  double rate() const {
+    return requested == 0 ? 1.0 : double(allowed) / double(requested);
+  }
+};
+
+std::int64_t nanoseconds(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+// The bucket's capacity, in nanoseconds, is at most this, so that adding
+// twice the capacity to a time point can't overflow.  A request's cost is at
+// most the capacity, and the theoretical arrival time is at most the capacity
+// after the current time.
+constexpr std::int64_t max_capacity = std::int64_t(1) << 61;
+
+// Return the number of nanoseconds that it takes to replenish one token at
+// the specified `refresh_rate` tokens per second, in a bucket of the
+// specified `max_tokens` tokens.  The result is bounded so that the bucket's
+// capacity doesn't exceed `max_capacity`, which also applies to rates that
+// aren't positive.
+std::int64_t token_interval(double refresh_rate, int max_tokens) {
+  const std::int64_t max_interval = max_capacity / std::max(max_tokens, 1);
+  const double interval = 1e9 / refresh_rate;
+  if (!(refresh_rate > 0) || !(interval < double(max_interval))) {
+    return max_interval;
+  }
+  return std::int64_t(interval);
+}
+
+// Return the number of tokens that a bucket replenished at the specified
+// `allowed_per_second` tokens per second holds.
+int bucket_size(double allowed_per_second) {
+  if (!(allowed_per_second > 0)) {
+    return 0;
+  }
+  if (!(allowed_per_second < double(std::numeric_limits<int>::max()))) {
+    return std::numeric_limits<int>::max();
+  }
+  return int(std::ceil(allowed_per_second));
+}
+
+}  // namespace
+
+Limiter::Limiter(const Clock& clock, int max_tokens, double refresh_rate)
     : clock_(clock),
-      num_tokens_(max_tokens),
-      max_tokens_(max_tokens),
-      tokens_per_refresh_(tokens_per_refresh),
-      previous_rates_(9, 1.0) {
-  // calculate refresh interval: (1/rate) * tokens per refresh as nanoseconds
-  refresh_interval_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                          std::chrono::duration_cast<std::chrono::nanoseconds>(
-                              std::chrono::seconds(1)) /
-                          refresh_rate) *
-                      tokens_per_refresh_;
-
-  auto now = clock_().tick;
-  next_refresh_ = now + refresh_interval_;
-  current_period_ = std::chrono::time_point_cast<std::chrono::seconds>(now);
-  previous_rates_sum_ =
-      std::accumulate(previous_rates_.begin(), previous_rates_.end(), 0.0);
+      token_interval_(token_interval(refresh_rate, max_tokens)),
+      capacity_(token_interval_ * std::max(max_tokens, 0)),
+      theoretical_arrival_(nanoseconds(clock_().tick)) {
+  for (auto& period : periods_) {
+    period.store(0, std::memory_order_relaxed);
+  }
 }
 
 Limiter::Limiter(const Clock& clock, double allowed_per_second)
-    : Limiter(clock, int(std::ceil(allowed_per_second)), allowed_per_second,
-              1) {}
+    : Limiter(clock, bucket_size(allowed_per_second), allowed_per_second) {}
 
 Limiter::Result Limiter::allow() { return allow(1); }
 
 Limiter::Result Limiter::allow(int tokens_requested) {
-  auto now = clock_().tick;
-
-  // update effective rate calculations
-  auto intervals = std::chrono::duration_cast<std::chrono::seconds>(
-                       std::chrono::time_point_cast<std::chrono::seconds>(now) -
-                       current_period_)
-                       .count();
-  if (intervals > 0) {
-    if (std::size_t(intervals) >= previous_rates_.size()) {
-      std::fill(previous_rates_.begin() + 1, previous_rates_.end(), 1.0);
-    } else {
-      std::move_backward(previous_rates_.begin(),
-                         previous_rates_.end() - intervals,
-                         previous_rates_.end());
-      if (num_requested_ > 0) {
-        previous_rates_[intervals - 1] =
-            double(num_allowed_) / double(num_requested_);
-      } else {
-        previous_rates_[intervals - 1] = 1.0;
-      }
-      if (intervals - 2 > 0) {
-        std::fill(previous_rates_.begin(),
-                  previous_rates_.begin() + intervals - 2, 1.0);
-      }
-    }
-    previous_rates_sum_ =
-        std::accumulate(previous_rates_.begin(), previous_rates_.end(), 0.0);
-    num_allowed_ = 0;
-    num_requested_ = 0;
-    current_period_ = now;
+  const auto now_tick = clock_().tick;
+  const std::int64_t now = nanoseconds(now_tick);
+  const auto second = std::chrono::duration_cast<std::chrono::seconds>(
+                          now_tick.time_since_epoch())
+                          .count();
+
+  // More tokens than the bucket holds are never allowed, and their cost
+  // might not be representable.
+  if (token_interval_ != 0 && tokens_requested > capacity_ / token_interval_) {
+    return {false, record(second, false)};
   }
+  const std::int64_t cost = token_interval_ * tokens_requested;
 
-  num_requested_++;
-  // refill "tokens"
-  if (now >= next_refresh_) {
-    auto intervals =
-        (now - next_refresh_).count() / refresh_interval_.count() + 1;
-    if (intervals > 0) {
-      next_refresh_ += refresh_interval_ * intervals;
-      num_tokens_ += intervals * tokens_per_refresh_;
-      if (num_tokens_ > max_tokens_) {
-        num_tokens_ = max_tokens_;
-      }
+  // The bucket's state is only this one word, so no other memory needs to be
+  // ordered with it.
+  bool allowed;
+  std::int64_t arrival = theoretical_arrival_.load(std::memory_order_relaxed);
+  for (;;) {
+    const std::int64_t advanced = std::max(arrival, now) + cost;
+    allowed = advanced - now <= capacity_;
+    if (!allowed ||
+        theoretical_arrival_.compare_exchange_weak(
+            arrival, advanced, std::memory_order_relaxed)) {
+      break;
     }
   }
-  // determine if allowed or not
-  bool allowed = false;
-  if (num_tokens_ >= tokens_requested) {
-    allowed = true;
-    num_allowed_++;
-    num_tokens_ -= tokens_requested;
+
+  return {allowed, record(second, allowed)};
+}
+
+Rate Limiter::record(std::int64_t second, bool allowed) {
+  const auto tag_of = [](std::int64_t second) {
+    return std::uint64_t(second) & tag_mask;
+  };
+  const auto slot_of = [](std::int64_t second) {
+    return std::size_t(std::uint64_t(second) % num_periods);
+  };
+
+  auto& slot = periods_[slot_of(second)];
+  Period current;
+  std::uint64_t word = slot.load(std::memory_order_relaxed);
+  do {
+    current = Period::decode(word);
+    if (current.tag != tag_of(second)) {
+      // The slot describes a second that's out of the window.  Start over.
+      current = Period{tag_of(second), 0, 0};
+    }
+    if (current.requested < count_mask) {
+      ++current.requested;
+      current.allowed += allowed;
+    }
+  } while (!slot.compare_exchange_weak(word, current.encode(),
+                                       std::memory_order_relaxed));
+
+  double sum = current.rate();
+  for (std::int64_t i = 1; i < std::int64_t(num_periods); ++i) {
+    const Period previous = Period::decode(
+        periods_[slot_of(second - i)].load(std::memory_order_relaxed));
+    sum += previous.tag == tag_of(second - i) ? previous.rate() : 1.0;
   }
 
   // `effective_rate` is guaranteed to be between 0.0 and 1.0.
-  double effective_rate =
-      (previous_rates_sum_ + double(num_allowed_) / double(num_requested_)) /
-      (previous_rates_.size() + 1);
-
-  return {allowed, *Rate::from(effective_rate)};
+  return *Rate::from(sum / num_periods);
 }
 
 }  // namespace tracing
@@ -6,9 +6,29 @@
 // `Limiter` is used by the `TraceSampler` and the `SpanSampler` to enforce
 // their respective `max_per_second` configuration parameters.
 //
+// `Limiter` is thread-safe, and does not lock.  The bucket is represented as
+// a single atomic "theoretical arrival time," as in the [generic cell rate
+// algorithm][2]: each allowed request advances the time by the request's
+// share of the refresh interval, and a request is allowed if the advanced time
+// is no further in the future than the bucket's capacity.  This is equivalent
+// to a bucket that refills continuously, one token every `1 / refresh_rate`
+// seconds, rather than in batches.
+//
+// A `refresh_rate` that isn't positive, including NaN, or that's so small
+// that a full bucket would take more than 2^61 nanoseconds (about 73 years)
+// to refill, is treated as the rate that refills a full bucket in that time.
+//
+// `Limiter` also reports its effective rate: the average, over the current
+// second and the previous nine, of the fraction of requests allowed in each
+// second.  A second without requests counts as 1.0.  Each second's counts are
+// kept in a single atomic word in a ring of ten.
+//
 // [1]: https://en.wikipedia.org/wiki/Token_bucket
+// [2]: https://en.wikipedia.org/wiki/Generic_cell_rate_algorithm
 
-#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 
 #include "clock.h"
 #include "rate.h"
@@ -23,26 +43,36 @@ class Limiter {
     Rate effective_rate;
   };
 
-  Limiter(const Clock& clock, int max_tokens, double refresh_rate,
-          int tokens_per_refresh);
+  // Create a limiter whose bucket holds the specified `max_tokens`, and is
+  // initially full, and that refills at the specified `refresh_rate` tokens
+  // per second.
+  Limiter(const Clock& clock, int max_tokens, double refresh_rate);
+  // Create a limiter that allows the specified `allowed_per_second` requests
+  // per second, in a bucket that holds a second's worth.
   Limiter(const Clock& clock, double allowed_per_second);
+  Limiter(const Limiter&) = delete;
 
   Result allow();
   Result allow(int tokens);
 
  private:
+  static constexpr std::size_t num_periods = 10;
+
   Clock clock_;
-  int num_tokens_;
-  int max_tokens_;
-  std::chrono::steady_clock::duration refresh_interval_;
-  int tokens_per_refresh_;
-  std::chrono::steady_clock::time_point next_refresh_;
-  // effective rate fields
-  std::vector<double> previous_rates_;
-  double previous_rates_sum_;
-  std::chrono::steady_clock::time_point current_period_;
-  int num_allowed_ = 0;
-  int num_requested_ = 0;
+  // The time it takes to refill one token, in nanoseconds.
+  std::int64_t token_interval_;
+  // The time it takes to refill a full bucket, in nanoseconds.
+  std::int64_t capacity_;
+  // The time, in nanoseconds since the steady clock's epoch, at which the
+  // bucket will be full if no more requests are allowed.
+  std::atomic<std::int64_t> theoretical_arrival_;
+  // `periods_[s % num_periods]` contains the counts for second `s`.  See
+  // `limiter.cpp`.
+  std::atomic<std::uint64_t> periods_[num_periods];
+
+  // Count a request in the specified `second`, and whether it was `allowed`.
+  // Return the effective rate.
+  Rate record(std::int64_t second, bool allowed);
 };
 
 }  // namespace tracing
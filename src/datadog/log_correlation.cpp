@@ -0,0 +1,100 @@
+#include "log_correlation.h"
+
+#include <charconv>
+#include <cstring>
+#include <string_view>
+
+#include "active_span.h"
+#include "span.h"
+#include "span_defaults.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr std::string_view trace_id_key = "dd.trace_id=";
+constexpr std::string_view span_id_key = " dd.span_id=";
+
+// A trace ID is at most 32 hexadecimal digits, and a span ID is at most 20
+// decimal digits.
+constexpr std::size_t max_ids_size =
+    trace_id_key.size() + 32 + span_id_key.size() + 20;
+
+char* append(char* position, std::string_view text) {
+  std::memcpy(position, text.data(), text.size());
+  return position + text.size();
+}
+
+// Write the fields of the specified `trace_id` and `span_id` to the specified
+// `position`, which has room for at least `max_ids_size` characters, and
+// return the end of what was written.
+char* append_ids(char* position, TraceID trace_id, std::uint64_t span_id) {
+  position = append(position, trace_id_key);
+  if (trace_id.high == 0) {
+    position = std::to_chars(position, position + 20, trace_id.low).ptr;
+  } else {
+    write_hex16(position, trace_id.high);
+    write_hex16(position + 16, trace_id.low);
+    position += 32;
+  }
+  position = append(position, span_id_key);
+  return std::to_chars(position, position + 20, span_id).ptr;
+}
+
+}  // namespace
+
+LogCorrelation::LogCorrelation(const SpanDefaults& defaults) {
+  service_fields_ += "dd.service=";
+  service_fields_ += defaults.service;
+  if (!defaults.environment.empty()) {
+    service_fields_ += " dd.env=";
+    service_fields_ += defaults.environment;
+  }
+  if (!defaults.version.empty()) {
+    service_fields_ += " dd.version=";
+    service_fields_ += defaults.version;
+  }
+}
+
+std::size_t LogCorrelation::max_size() const {
+  return max_ids_size + 1 + service_fields_.size();
+}
+
+std::size_t LogCorrelation::format(char* buffer, std::size_t size,
+                                   TraceID trace_id,
+                                   std::uint64_t span_id) const {
+  char ids[max_ids_size];
+  // If the buffer has room for the longest IDs, then format them in place.
+  // Otherwise, format them aside and see whether they fit.
+  char* const ids_begin = size >= max_size() ? buffer : ids;
+  const char* const ids_end = append_ids(ids_begin, trace_id, span_id);
+  const std::size_t ids_size = ids_end - ids_begin;
+  if (size < ids_size + 1 + service_fields_.size()) {
+    return 0;
+  }
+  if (ids_begin != buffer) {
+    std::memcpy(buffer, ids, ids_size);
+  }
+  char* position = buffer + ids_size;
+  *position++ = ' ';
+  return append(position, service_fields_) - buffer;
+}
+
+std::size_t LogCorrelation::format(char* buffer, std::size_t size,
+                                   const Span& span) const {
+  return format(buffer, size, span.trace_id(), span.id());
+}
+
+std::size_t LogCorrelation::format_active(char* buffer,
+                                          std::size_t size) const {
+  if (const auto ids = active_span_ids()) {
+    return format(buffer, size, ids->trace_id, ids->span_id);
+  }
+  if (size < service_fields_.size()) {
+    return 0;
+  }
+  return append(buffer, service_fields_) - buffer;
+}
+
+}  // namespace tracing
+}  // namespace datadog
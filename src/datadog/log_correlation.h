@@ -0,0 +1,71 @@
+#pragma once
+
+// This component provides a class, `LogCorrelation`, that formats the fields
+// that correlate a log record with a span, into a buffer provided by the
+// caller.  The fields are space-separated `key=value` pairs:
+//
+//     dd.trace_id=... dd.span_id=... dd.service=... dd.env=... dd.version=...
+//
+// The trace ID is formatted in decimal if it's a 64-bit trace ID, and
+// otherwise as 32 hexadecimal digits.  The span ID is formatted in decimal.
+// "dd.env" and "dd.version" are omitted if the tracer has no environment or
+// version.
+//
+// The service, environment, and version are those of the tracer, and so
+// their fields are formatted once, when the `LogCorrelation` is constructed.
+// Formatting a log record's fields then copies them after the two IDs, which
+// are formatted in place.  Formatting takes no locks and allocates no memory,
+// and so it's suitable for each line of high-volume logging.
+// `Tracer::log_correlation` returns the tracer's `LogCorrelation`.
+//
+// For example:
+//
+//     char buffer[256];
+//     const std::size_t size =
+//         tracer.log_correlation().format(buffer, sizeof buffer, span);
+//     log(std::string_view(buffer, size), message);
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+class Span;
+struct SpanDefaults;
+
+class LogCorrelation {
+  // `service_fields_` is "dd.service=... dd.env=... dd.version=...".
+  std::string service_fields_;
+
+ public:
+  // Create a `LogCorrelation` that formats the service, environment, and
+  // version of the specified `defaults`.
+  explicit LogCorrelation(const SpanDefaults& defaults);
+
+  // Return the maximum number of characters written by `format`.  A buffer of
+  // that size is always large enough.
+  std::size_t max_size() const;
+
+  // Write the fields that correlate a log record with the span having the
+  // specified `trace_id` and `span_id` to the specified `buffer`, which has
+  // the specified `size`.  Return the number of characters written, or
+  // return zero and write nothing if `size` is too small.  The result is not
+  // null-terminated.
+  std::size_t format(char* buffer, std::size_t size, TraceID trace_id,
+                     std::uint64_t span_id) const;
+  // Write the fields that correlate a log record with the specified `span` to
+  // the specified `buffer`, which has the specified `size`, as above.
+  std::size_t format(char* buffer, std::size_t size, const Span& span) const;
+  // Write the fields that correlate a log record with the calling thread's
+  // active span (see `active_span.h`) to the specified `buffer`, which has the
+  // specified `size`, as above.  If there is no active span, then write only
+  // the service, environment, and version.
+  std::size_t format_active(char* buffer, std::size_t size) const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,234 @@
+#include "metrics.h"
+
+#include <algorithm>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr std::size_t num_buckets = MetricsSnapshot::Histogram::num_buckets;
+
+// Return the index of the bucket for the specified `value`, which is in
+// nanoseconds for a histogram.  See `MetricsSnapshot::Histogram`.
+std::size_t bucket_of(std::uint64_t value) {
+  std::size_t bucket = 0;
+  while (value > 0 && bucket + 1 < num_buckets) {
+    value >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+// Return the upper bound of the bucket, among the specified `buckets` that
+// together count the specified nonzero `count`, that contains the specified
+// `quantile`.
+std::uint64_t percentile_bound(
+    const std::array<std::uint64_t, num_buckets>& buckets, std::uint64_t count,
+    double quantile) {
+  // `rank` is the number of values at or below the percentile.
+  const auto rank = std::max<std::uint64_t>(1, std::uint64_t(quantile * count));
+  std::uint64_t seen = 0;
+  std::size_t bucket = 0;
+  while (bucket + 1 < num_buckets) {
+    seen += buckets[bucket];
+    if (seen >= rank) {
+      break;
+    }
+    ++bucket;
+  }
+  // The upper bound of bucket `i` is 2^i.
+  return std::uint64_t(1) << bucket;
+}
+
+// `next_shard` assigns shards to threads round-robin.  A thread's shard is
+// the same for every `Metrics` object.
+std::atomic<std::size_t> next_shard{0};
+
+std::size_t this_thread_shard() {
+  thread_local const std::size_t shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed) % Metrics::num_shards;
+  return shard;
+}
+
+}  // namespace
+
+std::chrono::nanoseconds MetricsSnapshot::Histogram::mean() const {
+  if (count == 0) {
+    return std::chrono::nanoseconds::zero();
+  }
+  return sum / std::int64_t(count);
+}
+
+std::chrono::nanoseconds MetricsSnapshot::Histogram::percentile(
+    double quantile) const {
+  if (count == 0) {
+    return std::chrono::nanoseconds::zero();
+  }
+  return std::chrono::nanoseconds(percentile_bound(buckets, count, quantile));
+}
+
+std::uint64_t MetricsSnapshot::Distribution::mean() const {
+  if (count == 0) {
+    return 0;
+  }
+  return sum / count;
+}
+
+std::uint64_t MetricsSnapshot::Distribution::percentile(double quantile) const {
+  if (count == 0) {
+    return 0;
+  }
+  return percentile_bound(buckets, count, quantile);
+}
+
+Metrics::Metrics() : shards_(new Shard[num_shards]) {
+  for (std::size_t i = 0; i < num_shards; ++i) {
+    Shard& shard = shards_[i];
+    for (auto& counter : shard.counters) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+    const auto clear = [](ShardHistogram& histogram) {
+      histogram.count.store(0, std::memory_order_relaxed);
+      histogram.sum.store(0, std::memory_order_relaxed);
+      for (auto& bucket : histogram.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+    };
+    for (auto& histogram : shard.histograms) {
+      clear(histogram);
+    }
+    for (auto& distribution : shard.distributions) {
+      clear(distribution);
+    }
+  }
+  for (auto& gauge : gauges_) {
+    gauge.store(0, std::memory_order_relaxed);
+  }
+}
+
+Metrics::Shard& Metrics::shard() { return shards_[this_thread_shard()]; }
+
+void Metrics::add(Counter counter, std::uint64_t amount) {
+  shard().counters[counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Metrics::set(Gauge gauge, std::uint64_t value) {
+  gauges_[gauge].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::increase(Gauge gauge, std::uint64_t amount) {
+  gauges_[gauge].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void Metrics::decrease(Gauge gauge, std::uint64_t amount) {
+  gauges_[gauge].fetch_sub(amount, std::memory_order_relaxed);
+}
+
+std::uint64_t Metrics::memory_bytes() const {
+  return gauges_[TRACE_SEGMENT_BYTES].load(std::memory_order_relaxed) +
+         gauges_[BUFFERED_BYTES].load(std::memory_order_relaxed) +
+         gauges_[PAYLOAD_BYTES].load(std::memory_order_relaxed) +
+         gauges_[TAIL_SAMPLING_BYTES].load(std::memory_order_relaxed);
+}
+
+void Metrics::count(ShardHistogram& histogram, std::uint64_t value) {
+  histogram.count.fetch_add(1, std::memory_order_relaxed);
+  histogram.sum.fetch_add(value, std::memory_order_relaxed);
+  histogram.buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::record(Histogram histogram,
+                     std::chrono::steady_clock::duration duration) {
+  if (duration < duration.zero()) {
+    duration = duration.zero();
+  }
+  count(shard().histograms[histogram],
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+void Metrics::record(Distribution distribution, std::uint64_t size) {
+  count(shard().distributions[distribution], size);
+}
+
+MetricsSnapshot Metrics::snapshot() const {
+  std::uint64_t counters[NUM_COUNTERS] = {};
+  MetricsSnapshot::Histogram histograms[NUM_HISTOGRAMS];
+  MetricsSnapshot::Distribution distributions[NUM_DISTRIBUTIONS];
+  for (std::size_t i = 0; i < num_shards; ++i) {
+    const Shard& shard = shards_[i];
+    for (std::size_t c = 0; c < NUM_COUNTERS; ++c) {
+      counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+    }
+    for (std::size_t h = 0; h < NUM_HISTOGRAMS; ++h) {
+      const ShardHistogram& from = shard.histograms[h];
+      MetricsSnapshot::Histogram& to = histograms[h];
+      to.count += from.count.load(std::memory_order_relaxed);
+      to.sum +=
+          std::chrono::nanoseconds(from.sum.load(std::memory_order_relaxed));
+      for (std::size_t b = 0; b < num_buckets; ++b) {
+        to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+      }
+    }
+    for (std::size_t d = 0; d < NUM_DISTRIBUTIONS; ++d) {
+      const ShardHistogram& from = shard.distributions[d];
+      MetricsSnapshot::Distribution& to = distributions[d];
+      to.count += from.count.load(std::memory_order_relaxed);
+      to.sum += from.sum.load(std::memory_order_relaxed);
+      for (std::size_t b = 0; b < num_buckets; ++b) {
+        to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  MetricsSnapshot result;
+  result.spans_created = counters[SPANS_CREATED];
+  result.spans_finished = counters[SPANS_FINISHED];
+  result.trace_chunks_finished = counters[TRACE_CHUNKS_FINISHED];
+  result.spans_filtered = counters[SPANS_FILTERED];
+  result.spans_collapsed = counters[SPANS_COLLAPSED];
+  result.spans_compacted = counters[SPANS_COMPACTED];
+  result.trace_chunks_enqueued = counters[TRACE_CHUNKS_ENQUEUED];
+  result.trace_chunks_dropped = counters[TRACE_CHUNKS_DROPPED];
+  result.spans_dropped = counters[SPANS_DROPPED];
+  result.bytes_encoded = counters[BYTES_ENCODED];
+  result.http_requests = counters[HTTP_REQUESTS];
+  result.http_errors = counters[HTTP_ERRORS];
+  result.buffered_spans =
+      gauges_[BUFFERED_SPANS].load(std::memory_order_relaxed);
+  result.buffered_bytes =
+      gauges_[BUFFERED_BYTES].load(std::memory_order_relaxed);
+  result.trace_segment_bytes =
+      gauges_[TRACE_SEGMENT_BYTES].load(std::memory_order_relaxed);
+  result.payload_bytes =
+      gauges_[PAYLOAD_BYTES].load(std::memory_order_relaxed);
+  result.tail_sampling_bytes =
+      gauges_[TAIL_SAMPLING_BYTES].load(std::memory_order_relaxed);
+  result.memory_budget_partial_flushes =
+      counters[MEMORY_BUDGET_PARTIAL_FLUSHES];
+  result.memory_budget_trace_chunks_dropped =
+      counters[MEMORY_BUDGET_TRACE_CHUNKS_DROPPED];
+  result.memory_budget_tags_stripped = counters[MEMORY_BUDGET_TAGS_STRIPPED];
+  result.quota_trace_chunks_dropped = counters[QUOTA_TRACE_CHUNKS_DROPPED];
+  result.quota_spans_dropped = counters[QUOTA_SPANS_DROPPED];
+  result.requests_spooled = counters[REQUESTS_SPOOLED];
+  result.requests_replayed = counters[REQUESTS_REPLAYED];
+  result.mirror_requests_dropped = counters[MIRROR_REQUESTS_DROPPED];
+  result.tail_sampling_traces_kept = counters[TAIL_SAMPLING_TRACES_KEPT];
+  result.tail_sampling_overflows = counters[TAIL_SAMPLING_OVERFLOWS];
+  result.flush_duration = histograms[FLUSH_DURATION];
+  result.flush_swap_duration = histograms[FLUSH_SWAP_DURATION];
+  result.flush_encode_duration = histograms[FLUSH_ENCODE_DURATION];
+  result.request_build_duration = histograms[REQUEST_BUILD_DURATION];
+  result.request_round_trip_duration = histograms[REQUEST_ROUND_TRIP_DURATION];
+  result.response_parse_duration = histograms[RESPONSE_PARSE_DURATION];
+  result.request_bytes = distributions[REQUEST_BYTES];
+  result.request_trace_chunks = distributions[REQUEST_TRACE_CHUNKS];
+  result.create_span_duration = histograms[CREATE_SPAN_DURATION];
+  result.extract_span_duration = histograms[EXTRACT_SPAN_DURATION];
+  result.inject_duration = histograms[INJECT_DURATION];
+  result.finish_span_duration = histograms[FINISH_SPAN_DURATION];
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
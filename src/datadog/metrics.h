@@ -0,0 +1,331 @@
+#pragma once
+
+// This component provides a class, `Metrics`, that counts events in the
+// operation of the tracer itself, and a struct, `MetricsSnapshot`, that is a
+// copy of those counts at a point in time.  These are the tracer's "health
+// metrics."
+//
+// `Metrics` is updated on the tracer's hot paths, from any thread.  Its
+// counters and histograms are sharded: each thread updates the shard assigned
+// to it the first time that it updates any `Metrics`, and so threads seldom
+// contend for a cache line.  Taking a snapshot sums the shards.  Gauges are
+// not sharded: each gauge either has a single writer at a time, or is an
+// amount of memory that is increased and decreased atomically.
+//
+// `Tracer::metrics` returns a snapshot of a tracer's metrics, which include
+// those of the tracer's `DatadogAgent`, if the tracer created one.  The
+// `DatadogAgent` can also send the metrics to DogStatsD periodically.  See
+// `DatadogAgentConfig::health_metrics_enabled`.
+//
+// If `TracerConfig::overhead_profiling_enabled` is true, then the tracer also
+// times its own operations, using `OverheadTimer`, so that its overhead can be
+// measured in production.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "cycle_counter.h"
+
+namespace datadog {
+namespace tracing {
+
+struct MetricsSnapshot {
+  // `Histogram` counts durations in buckets whose bounds are powers of two
+  // nanoseconds.  `buckets[0]` counts durations shorter than a nanosecond,
+  // and `buckets[i]`, for `i` greater than zero, counts durations at least
+  // 2^(i-1) nanoseconds and shorter than 2^i nanoseconds.  The last bucket,
+  // which starts at about nine minutes, also counts all longer durations.
+  struct Histogram {
+    static constexpr std::size_t num_buckets = 40;
+
+    std::uint64_t count = 0;
+    std::chrono::nanoseconds sum = std::chrono::nanoseconds::zero();
+    std::array<std::uint64_t, num_buckets> buckets = {};
+
+    // Return the mean duration, or zero if `count` is zero.
+    std::chrono::nanoseconds mean() const;
+    // Return the upper bound of the bucket that contains the specified
+    // `quantile`, which is between zero and one, of the durations.  Return
+    // zero if `count` is zero.
+    std::chrono::nanoseconds percentile(double quantile) const;
+  };
+
+  // `Distribution` counts sizes, e.g. of payloads, in buckets like those of
+  // `Histogram`: `buckets[0]` counts zeros, and `buckets[i]`, for `i` greater
+  // than zero, counts sizes at least 2^(i-1) and less than 2^i.
+  struct Distribution {
+    static constexpr std::size_t num_buckets = Histogram::num_buckets;
+
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;
+    std::array<std::uint64_t, num_buckets> buckets = {};
+
+    // Return the mean size, or zero if `count` is zero.
+    std::uint64_t mean() const;
+    // Return the upper bound of the bucket that contains the specified
+    // `quantile`, which is between zero and one, of the sizes.  Return zero
+    // if `count` is zero.
+    std::uint64_t percentile(double quantile) const;
+  };
+
+  // Counts of spans registered with and finished by their trace segments, and
+  // of the trace chunks that the segments gave to the collector.
+  std::uint64_t spans_created = 0;
+  std::uint64_t spans_finished = 0;
+  std::uint64_t trace_chunks_finished = 0;
+  // `spans_filtered` counts the spans that trace segments left out of their
+  // trace chunks for being shorter than
+  // `TracerConfig::min_span_duration_microseconds`.
+  std::uint64_t spans_filtered = 0;
+  // `spans_collapsed` counts the spans that trace segments merged into a
+  // sibling (see `TracerConfig::collapse_repeated_spans_threshold`).
+  std::uint64_t spans_collapsed = 0;
+  // `spans_compacted` counts the finished spans that trace segments encoded
+  // compactly until they were sent (see
+  // `TracerConfig::compact_finished_spans`).
+  std::uint64_t spans_compacted = 0;
+
+  // The remaining metrics are those of the `DatadogAgent`.
+  //
+  // `trace_chunks_enqueued` counts the trace chunks that the `DatadogAgent`
+  // gave to its buffer.  `trace_chunks_dropped` and `spans_dropped` count
+  // those that it didn't send, whether because of buffer limits or retry
+  // limits, and also those dropped by sampling when stats computation is
+  // enabled, which aren't buffered.
+  std::uint64_t trace_chunks_enqueued = 0;
+  std::uint64_t trace_chunks_dropped = 0;
+  std::uint64_t spans_dropped = 0;
+  // `bytes_encoded` is the total size of the encoded trace payloads, before any
+  // compression.
+  std::uint64_t bytes_encoded = 0;
+  // `http_requests` counts the requests sent to the Datadog Agent, including
+  // retries and statistics.  `http_errors` counts those that failed or that
+  // received a response status other than 2xx.
+  std::uint64_t http_requests = 0;
+  std::uint64_t http_errors = 0;
+  // The number of spans and the estimated number of encoded bytes buffered by
+  // the `DatadogAgent`, as of the most recent trace chunk or flush.
+  std::uint64_t buffered_spans = 0;
+  std::uint64_t buffered_bytes = 0;
+  // The duration of each of the `DatadogAgent`'s flushes.
+  Histogram flush_duration;
+  // The stages of the flushes, so that a slow flush can be attributed:
+  // taking the buffered trace chunks (`flush_swap_duration`), and encoding
+  // them (`flush_encode_duration`), which happens when they're sent instead,
+  // if `DatadogAgentConfig::encode_on_send` is true.  Each flush then sends
+  // one or more requests to the Datadog Agent, whose stages are: building
+  // the request, including its compression and the HTTP client's preparation
+  // of it (`request_build_duration`), the round trip from when the request is
+  // given to the HTTP client until the client invokes a callback
+  // (`request_round_trip_duration`), which therefore overlaps the client's
+  // preparation, and parsing a successful response and giving it to the
+  // samplers (`response_parse_duration`).  Retried requests are included.
+  // Each request's body size, after any compression, is counted in
+  // `request_bytes`, and its trace chunks in `request_trace_chunks`.
+  Histogram flush_swap_duration;
+  Histogram flush_encode_duration;
+  Histogram request_build_duration;
+  Histogram request_round_trip_duration;
+  Histogram response_parse_duration;
+  Distribution request_bytes;
+  Distribution request_trace_chunks;
+
+  // The approximate bytes of memory held by the tracer's buffered trace data:
+  // the finished spans of trace segments that are still open
+  // (`trace_segment_bytes`), the trace chunks buffered by the `DatadogAgent`
+  // (`buffered_bytes`), the encoded payloads that the `DatadogAgent` has not
+  // yet sent successfully, i.e. requests in flight or awaiting retry
+  // (`payload_bytes`), and the trace chunks held for tail-based sampling
+  // (`tail_sampling_bytes`).  Trace segments count their spans only if
+  // `TracerConfig::max_memory_bytes` is set.
+  std::uint64_t trace_segment_bytes = 0;
+  std::uint64_t payload_bytes = 0;
+  std::uint64_t tail_sampling_bytes = 0;
+  // What the trace segments did to stay within
+  // `TracerConfig::max_memory_bytes`: the trace chunks that they sent early,
+  // those that they dropped because sampling dropped them, and the large tags
+  // that they removed.
+  std::uint64_t memory_budget_partial_flushes = 0;
+  std::uint64_t memory_budget_trace_chunks_dropped = 0;
+  std::uint64_t memory_budget_tags_stripped = 0;
+  // The trace chunks, and their spans, that the trace segments dropped
+  // because they exceeded `TracerConfig::span_quotas`.
+  std::uint64_t quota_trace_chunks_dropped = 0;
+  std::uint64_t quota_spans_dropped = 0;
+  // The requests that the `DatadogAgent` spooled to disk instead of dropping
+  // them, and those that it sent again from the spool.  See
+  // `DatadogAgentConfig::spool_directory`.
+  std::uint64_t requests_spooled = 0;
+  std::uint64_t requests_replayed = 0;
+  // The requests to mirrors of the Datadog Agent that were abandoned, because
+  // they failed and couldn't be retried.  See
+  // `DatadogAgentConfig::mirror_urls`.
+  std::uint64_t mirror_requests_dropped = 0;
+  // The traces that tail-based sampling kept although the head-based sampler
+  // dropped them, and the trace chunks for which tail-based sampling fell
+  // back to the head-based decision because its memory was full.  See
+  // `DatadogAgentConfig::tail_sampling_enabled`.
+  std::uint64_t tail_sampling_traces_kept = 0;
+  std::uint64_t tail_sampling_overflows = 0;
+
+  // The durations of the tracer's operations, if overhead profiling is
+  // enabled: `Tracer::create_span`, `Tracer::extract_span`, `Span::inject`,
+  // and the finishing of a span, which includes sending its trace chunk to
+  // the collector, if it's the last to finish.
+  Histogram create_span_duration;
+  Histogram extract_span_duration;
+  Histogram inject_duration;
+  Histogram finish_span_duration;
+
+  // Return the total of `trace_segment_bytes`, `buffered_bytes`,
+  // `payload_bytes`, and `tail_sampling_bytes`.
+  std::uint64_t memory_bytes() const {
+    return trace_segment_bytes + buffered_bytes + payload_bytes +
+           tail_sampling_bytes;
+  }
+};
+
+class Metrics {
+ public:
+  enum Counter {
+    SPANS_CREATED,
+    SPANS_FINISHED,
+    TRACE_CHUNKS_FINISHED,
+    SPANS_FILTERED,
+    SPANS_COLLAPSED,
+    SPANS_COMPACTED,
+    TRACE_CHUNKS_ENQUEUED,
+    TRACE_CHUNKS_DROPPED,
+    SPANS_DROPPED,
+    BYTES_ENCODED,
+    HTTP_REQUESTS,
+    HTTP_ERRORS,
+    MEMORY_BUDGET_PARTIAL_FLUSHES,
+    MEMORY_BUDGET_TRACE_CHUNKS_DROPPED,
+    MEMORY_BUDGET_TAGS_STRIPPED,
+    QUOTA_TRACE_CHUNKS_DROPPED,
+    QUOTA_SPANS_DROPPED,
+    REQUESTS_SPOOLED,
+    REQUESTS_REPLAYED,
+    MIRROR_REQUESTS_DROPPED,
+    TAIL_SAMPLING_TRACES_KEPT,
+    TAIL_SAMPLING_OVERFLOWS,
+    NUM_COUNTERS
+  };
+
+  enum Gauge {
+    BUFFERED_SPANS,
+    BUFFERED_BYTES,
+    TRACE_SEGMENT_BYTES,
+    PAYLOAD_BYTES,
+    TAIL_SAMPLING_BYTES,
+    NUM_GAUGES
+  };
+
+  enum Histogram {
+    FLUSH_DURATION,
+    FLUSH_SWAP_DURATION,
+    FLUSH_ENCODE_DURATION,
+    REQUEST_BUILD_DURATION,
+    REQUEST_ROUND_TRIP_DURATION,
+    RESPONSE_PARSE_DURATION,
+    CREATE_SPAN_DURATION,
+    EXTRACT_SPAN_DURATION,
+    INJECT_DURATION,
+    FINISH_SPAN_DURATION,
+    NUM_HISTOGRAMS
+  };
+
+  enum Distribution {
+    REQUEST_BYTES,
+    REQUEST_TRACE_CHUNKS,
+    NUM_DISTRIBUTIONS
+  };
+
+  static constexpr std::size_t num_shards = 16;
+
+ private:
+  static constexpr std::size_t num_buckets =
+      MetricsSnapshot::Histogram::num_buckets;
+
+  // `ShardHistogram` is a shard's part of a histogram, whose `sum` is in
+  // nanoseconds, or of a distribution.
+  struct ShardHistogram {
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> buckets[num_buckets];
+  };
+
+  // Each shard occupies its own cache lines.
+  struct alignas(64) Shard {
+    std::atomic<std::uint64_t> counters[NUM_COUNTERS];
+    ShardHistogram histograms[NUM_HISTOGRAMS];
+    ShardHistogram distributions[NUM_DISTRIBUTIONS];
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<std::uint64_t> gauges_[NUM_GAUGES];
+
+  // Return the shard assigned to the calling thread.
+  Shard& shard();
+  // Count the specified `value` in the specified `histogram`.
+  static void count(ShardHistogram& histogram, std::uint64_t value);
+
+ public:
+  Metrics();
+
+  Metrics(const Metrics&) = delete;
+  Metrics& operator=(const Metrics&) = delete;
+
+  // Add the specified `amount` to the specified `counter`.
+  void add(Counter counter, std::uint64_t amount = 1);
+  // Set the specified `gauge` to the specified `value`.
+  void set(Gauge gauge, std::uint64_t value);
+  // Add the specified `amount` to, or subtract it from, the specified
+  // `gauge`.
+  void increase(Gauge gauge, std::uint64_t amount);
+  void decrease(Gauge gauge, std::uint64_t amount);
+  // Return the current total of the gauges that count memory, as in
+  // `MetricsSnapshot::memory_bytes`, without taking a snapshot.
+  std::uint64_t memory_bytes() const;
+  // Count the specified `duration` in the specified `histogram`.
+  void record(Histogram histogram,
+              std::chrono::steady_clock::duration duration);
+  // Count the specified `size` in the specified `distribution`.
+  void record(Distribution distribution, std::uint64_t size);
+
+  MetricsSnapshot snapshot() const;
+};
+
+// `OverheadTimer` records the time from its construction until its
+// destruction in a histogram of a `Metrics`, measured using the cycle counter
+// (see `cycle_counter.h`).  If it's given a null `Metrics`, then it does
+// nothing.
+class OverheadTimer {
+  Metrics* metrics_;
+  Metrics::Histogram histogram_;
+  std::uint64_t start_;
+
+ public:
+  OverheadTimer(Metrics* metrics, Metrics::Histogram histogram)
+      : metrics_(metrics),
+        histogram_(histogram),
+        start_(metrics ? read_cycle_counter() : 0) {}
+
+  OverheadTimer(const OverheadTimer&) = delete;
+  OverheadTimer& operator=(const OverheadTimer&) = delete;
+
+  ~OverheadTimer() {
+    if (metrics_) {
+      metrics_->record(histogram_,
+                       cycles_to_duration(read_cycle_counter() - start_));
+    }
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
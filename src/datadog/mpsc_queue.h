@@ -0,0 +1,88 @@
+#pragma once
+
+// This component provides a class template, `MPSCQueue<Value>`, that is a
+// lock-free queue having any number of producers and a single consumer.
+//
+// `DatadogAgent` uses `MPSCQueue` for the trace chunks that it receives via
+// `Collector::send`, so that threads finishing traces never block each other.
+//
+// Producers call `push`, which never blocks.  The consumer calls `drain`,
+// which removes all of the values pushed so far and visits them in the order
+// in which they were pushed.  Only one thread at a time may call `drain`.
+//
+// The queue is a singly linked list used as a stack: `push` links its value
+// onto the head of the list using compare-and-swap, and `drain` detaches the
+// entire list with a single exchange, and then reverses it.  Since the
+// consumer never removes individual nodes, the list is not subject to the ABA
+// problem.
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+
+template <typename Value>
+class MPSCQueue {
+  struct Node {
+    Value value;
+    Node* next;
+  };
+
+  std::atomic<Node*> head_;
+
+  static void destroy(Node* node) {
+    while (node) {
+      Node* const next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+
+ public:
+  MPSCQueue() : head_(nullptr) {}
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+  ~MPSCQueue() { destroy(head_.load(std::memory_order_acquire)); }
+
+  // Add the specified `value` to the back of the queue.
+  void push(Value value) {
+    Node* const node =
+        new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+    while (!head_.compare_exchange_weak(node->next, node,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+  }
+
+  // Remove all values from the queue and invoke the specified `visit` with
+  // each, as an rvalue, in the order in which they were pushed.  Return the
+  // number of values removed.
+  template <typename Visit>
+  std::size_t drain(Visit&& visit) {
+    Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+
+    // The list is newest-first.  Reverse it.
+    Node* reversed = nullptr;
+    std::size_t count = 0;
+    while (node) {
+      Node* const next = node->next;
+      node->next = reversed;
+      reversed = node;
+      node = next;
+      ++count;
+    }
+
+    while (reversed) {
+      Node* const next = reversed->next;
+      visit(std::move(reversed->value));
+      delete reversed;
+      reversed = next;
+    }
+    return count;
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -1,8 +1,7 @@
 #include "msgpack.h"
 
-#include <cassert>
 #include <limits>
-#include <type_traits>
+#include <string>
 
 #include "error.h"
 
@@ -10,15 +9,6 @@ namespace datadog {
 namespace tracing {
 namespace msgpack {
 namespace {
-// MessagePack values are prefixed by a byte naming their type.
-namespace types {
-constexpr auto ARRAY32 = std::byte(0xDD);
-constexpr auto DOUBLE = std::byte(0xCB);
-constexpr auto INT64 = std::byte(0xD3);
-constexpr auto MAP32 = std::byte(0xDF);
-constexpr auto STR32 = std::byte(0xDB);
-constexpr auto UINT64 = std::byte(0xCF);
-}  // namespace types
 
 std::string make_overflow_message(std::string_view type, std::size_t actual,
                                   std::size_t max) {
@@ -33,98 +23,97 @@ std::string make_overflow_message(std::string_view type, std::size_t actual,
   return message;
 }
 
-template <typename Integer>
-void push_number_big_endian(std::string& buffer, Integer integer) {
-  // Assume two's complement.
-  const std::make_unsigned_t<Integer> value = integer;
-
-  // The loop below is more likely to unroll if we don't call any functions
-  // within it.
-  char buf[sizeof value];
-
-  // The most significant byte of `value` goes to the front of `buf`, and the
-  // least significant byte of `value` goes
-  // to the back of `buf`, and so on in between.
-  // On a big endian architecture, this is just a complicated way to copy
-  // `value`. On a little endian architecture, which is much more common, this
-  // effectively copies the bytes of `value` backwards.
-  const int size = sizeof value;
-  for (int i = 0; i < size; ++i) {
-    const char byte = (value >> (8 * ((size - 1) - i))) & 0xFF;
-    buf[i] = byte;
-  }
-
-  buffer.append(buf, sizeof buf);
+// Append to the specified `buffer` what the specified `pack` writes, given at
+// most `max_size` bytes.
+template <std::size_t max_size, typename Pack>
+void append(std::string& buffer, Pack&& pack) {
+  char encoded[max_size];
+  buffer.append(encoded, pack(encoded) - encoded);
 }
 
 }  // namespace
 
+Expected<void> check_size(std::string_view type, std::size_t size) {
+  const auto max = std::numeric_limits<std::uint32_t>::max();
+  if (size > max) {
+    return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
+                 make_overflow_message(type, size, max)};
+  }
+  return {};
+}
+
 void pack_integer(std::string& buffer, std::int64_t value) {
-  buffer.push_back(static_cast<char>(types::INT64));
-  push_number_big_endian(buffer, static_cast<std::int64_t>(value));
+  append<unchecked::max_integer_size>(
+      buffer, [&](char* out) { return unchecked::pack_integer(out, value); });
 }
 
 void pack_integer(std::string& buffer, std::uint64_t value) {
-  buffer.push_back(static_cast<char>(types::UINT64));
-  push_number_big_endian(buffer, static_cast<std::uint64_t>(value));
+  append<unchecked::max_integer_size>(
+      buffer, [&](char* out) { return unchecked::pack_integer(out, value); });
 }
 
 void pack_double(std::string& buffer, double value) {
-  buffer.push_back(static_cast<char>(types::DOUBLE));
-
-  // The following is lifted from the "msgpack-c" project.
-  // See "pack_double" in
-  // <https://github.com/msgpack/msgpack-c/blob/cpp_master/include/msgpack/v1/pack.hpp>
-
-  union {
-    double as_double;
-    uint64_t as_integer;
-  } memory;
-  memory.as_double = value;
-
-#if defined(TARGET_OS_IPHONE)
-  // ok
-#elif defined(__arm__) && !(__ARM_EABI__)  // arm-oabi
-  // https://github.com/msgpack/msgpack-perl/pull/1
-  memory.as_integer =
-      (memory.as_integer & 0xFFFFFFFFUL) << 32UL | (memory.as_integer >> 32UL);
-#endif
-
-  push_number_big_endian(buffer, memory.as_integer);
+  append<unchecked::max_double_size>(
+      buffer, [&](char* out) { return unchecked::pack_double(out, value); });
+}
+
+void pack_bool(std::string& buffer, bool value) {
+  buffer.push_back(static_cast<char>(value ? types::TRUE : types::FALSE));
 }
 
 Expected<void> pack_string(std::string& buffer, std::string_view value) {
-  const auto size = value.size();
-  const auto max = std::numeric_limits<std::uint32_t>::max();
-  if (size > max) {
-    return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
-                 make_overflow_message("string", size, max)};
+  auto result = check_size("string", value.size());
+  if (!result) {
+    return result;
+  }
+  append<unchecked::max_header_size>(buffer, [&](char* out) {
+    return unchecked::pack_header(out, value.size(), types::FIXSTR, 31,
+                                  types::STR8, types::STR16, types::STR32);
+  });
+  buffer.append(value.begin(), value.end());
+  return {};
+}
+
+Expected<void> pack_binary(std::string& buffer, std::string_view value) {
+  auto result = check_size("binary", value.size());
+  if (!result) {
+    return result;
   }
-  buffer.push_back(static_cast<char>(types::STR32));
-  push_number_big_endian(buffer, static_cast<std::uint32_t>(size));
+  // "bin" has no "fix" form, and so doesn't use `unchecked::pack_header`.
+  append<unchecked::max_header_size>(buffer, [&](char* out) {
+    const auto size = value.size();
+    if (size <= std::numeric_limits<std::uint8_t>::max()) {
+      out = unchecked::pack_type(out, types::BIN8);
+      return unchecked::pack_big_endian(out, static_cast<std::uint8_t>(size));
+    }
+    if (size <= std::numeric_limits<std::uint16_t>::max()) {
+      out = unchecked::pack_type(out, types::BIN16);
+      return unchecked::pack_big_endian(out, static_cast<std::uint16_t>(size));
+    }
+    out = unchecked::pack_type(out, types::BIN32);
+    return unchecked::pack_big_endian(out, static_cast<std::uint32_t>(size));
+  });
   buffer.append(value.begin(), value.end());
   return {};
 }
 
 Expected<void> pack_array(std::string& buffer, size_t size) {
-  const auto max = std::numeric_limits<std::uint32_t>::max();
-  if (size > max) {
-    return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
-                 make_overflow_message("array", size, max)};
+  auto result = check_size("array", size);
+  if (!result) {
+    return result;
   }
-  buffer.push_back(static_cast<char>(types::ARRAY32));
-  push_number_big_endian(buffer, static_cast<std::uint32_t>(size));
+  append<unchecked::max_header_size>(
+      buffer, [&](char* out) { return unchecked::pack_array(out, size); });
   return {};
 }
 
 Expected<void> pack_map(std::string& buffer, size_t size) {
-  const auto max = std::numeric_limits<std::uint32_t>::max();
-  if (size > max) {
-    return Error{Error::MESSAGEPACK_ENCODE_FAILURE,
-                 make_overflow_message("map", size, max)};
+  auto result = check_size("map", size);
+  if (!result) {
+    return result;
   }
-  buffer.push_back(static_cast<char>(types::MAP32));
-  push_number_big_endian(buffer, static_cast<std::uint32_t>(size));
+  append<unchecked::max_header_size>(
+      buffer, [&](char* out) { return unchecked::pack_map(out, size); });
   return {};
 }
 
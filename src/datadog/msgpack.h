@@ -9,12 +9,31 @@
 // Only encoding is provided, and only for the types required by `SpanData` and
 // `DatadogAgent`.
 //
+// Integers, strings, arrays, and maps are encoded using the smallest form that
+// can represent the value (e.g. "fixint" for small integers and "fixstr" for
+// short strings).
+//
+// The functions in `namespace msgpack::unchecked` are an alternative for
+// encoders that write many values at once.  Rather than appending to a
+// `std::string`, each writes through a pointer into a buffer that the caller
+// has already sized, and returns a pointer to just past what it wrote.  They
+// check nothing: the caller first checks the sizes of its strings, maps, and
+// arrays with `check_size`, and reserves room for the encoding using the
+// `max_*_size` constants.  `msgpack_encode(SpanData)` uses them so that a span
+// is checked once, before it's encoded, rather than after each value.
+//
 // [1]: https://msgpack.org/index.html
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <cstdlib>
+#endif
+#include <limits>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <utility>
 
 #include "expected.h"
@@ -23,14 +42,25 @@ namespace datadog {
 namespace tracing {
 namespace msgpack {
 
+// Return an error if a string, map, or array of the specified `size` exceeds
+// the protocol maximum.  `type` names the kind of value in the error message,
+// e.g. "string".
+Expected<void> check_size(std::string_view type, std::size_t size);
+
 void pack_integer(std::string& buffer, std::int64_t value);
 void pack_integer(std::string& buffer, std::uint64_t value);
 void pack_integer(std::string& buffer, std::int32_t value);
 
 void pack_double(std::string& buffer, double value);
 
+void pack_bool(std::string& buffer, bool value);
+
 Expected<void> pack_string(std::string& buffer, std::string_view value);
 
+// Append to the specified `buffer` the specified `value` as a MessagePack
+// "bin" (byte array), rather than as a string.
+Expected<void> pack_binary(std::string& buffer, std::string_view value);
+
 Expected<void> pack_array(std::string& buffer, std::size_t size);
 
 // Append to the specified `buffer` a MessagePack encoded array having the
@@ -159,6 +189,227 @@ inline void pack_integer(std::string& buffer, std::int32_t value) {
   pack_integer(buffer, std::int64_t(value));
 }
 
+// MessagePack values are prefixed by a byte naming their type.
+namespace types {
+constexpr auto ARRAY16 = std::byte(0xDC);
+constexpr auto ARRAY32 = std::byte(0xDD);
+constexpr auto BIN8 = std::byte(0xC4);
+constexpr auto BIN16 = std::byte(0xC5);
+constexpr auto BIN32 = std::byte(0xC6);
+constexpr auto DOUBLE = std::byte(0xCB);
+constexpr auto FALSE = std::byte(0xC2);
+constexpr auto FIXARRAY = std::byte(0x90);
+constexpr auto FIXMAP = std::byte(0x80);
+constexpr auto FIXSTR = std::byte(0xA0);
+constexpr auto INT8 = std::byte(0xD0);
+constexpr auto INT16 = std::byte(0xD1);
+constexpr auto INT32 = std::byte(0xD2);
+constexpr auto INT64 = std::byte(0xD3);
+constexpr auto MAP16 = std::byte(0xDE);
+constexpr auto MAP32 = std::byte(0xDF);
+constexpr auto STR8 = std::byte(0xD9);
+constexpr auto STR16 = std::byte(0xDA);
+constexpr auto STR32 = std::byte(0xDB);
+constexpr auto TRUE = std::byte(0xC3);
+constexpr auto UINT8 = std::byte(0xCC);
+constexpr auto UINT16 = std::byte(0xCD);
+constexpr auto UINT32 = std::byte(0xCE);
+constexpr auto UINT64 = std::byte(0xCF);
+}  // namespace types
+
+namespace unchecked {
+
+// The largest encodings of a number, and of the header of a string, map, or
+// array.
+constexpr std::size_t max_integer_size = 9;
+constexpr std::size_t max_double_size = 9;
+constexpr std::size_t max_header_size = 5;
+
+// `FixStr` is the encoding of a string literal, computed at compile time,
+// e.g. `constexpr auto key = msgpack::unchecked::FixStr("service")`.  Only
+// strings of fewer than 32 characters have the "fixstr" form.
+template <std::size_t Size>
+struct FixStr {
+  // The type byte takes the place of the literal's null terminator.
+  char bytes[Size] = {};
+
+  constexpr explicit FixStr(const char (&value)[Size]) {
+    static_assert(Size - 1 < 32, "A fixstr has fewer than 32 characters.");
+    bytes[0] = static_cast<char>(types::FIXSTR | std::byte(Size - 1));
+    for (std::size_t i = 0; i + 1 < Size; ++i) {
+      bytes[i + 1] = value[i];
+    }
+  }
+
+  static constexpr std::size_t size() { return Size; }
+};
+
+inline char* pack_raw(char* out, std::string_view encoded) {
+  std::memcpy(out, encoded.data(), encoded.size());
+  return out + encoded.size();
+}
+
+template <std::size_t Size>
+char* pack_raw(char* out, const FixStr<Size>& encoded) {
+  std::memcpy(out, encoded.bytes, Size);
+  return out + Size;
+}
+
+// Return the specified `value` with the order of its bytes reversed.  Each
+// overload compiles to a single instruction.
+inline std::uint8_t byte_swap(std::uint8_t value) { return value; }
+
+inline std::uint16_t byte_swap(std::uint16_t value) {
+#ifdef _MSC_VER
+  return _byteswap_ushort(value);
+#else
+  return __builtin_bswap16(value);
+#endif
+}
+
+inline std::uint32_t byte_swap(std::uint32_t value) {
+#ifdef _MSC_VER
+  return _byteswap_ulong(value);
+#else
+  return __builtin_bswap32(value);
+#endif
+}
+
+inline std::uint64_t byte_swap(std::uint64_t value) {
+#ifdef _MSC_VER
+  return _byteswap_uint64(value);
+#else
+  return __builtin_bswap64(value);
+#endif
+}
+
+template <typename Integer>
+char* pack_big_endian(char* out, Integer integer) {
+  // Assume two's complement.
+  std::make_unsigned_t<Integer> value = integer;
+  // The most significant byte of `value` goes first.  On a little endian
+  // platform, the bytes of `value` are swapped in a register and then stored
+  // at once, rather than stored one at a time.  Compilers that don't define
+  // `__BYTE_ORDER__`, such as MSVC, target only little endian platforms.
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  value = byte_swap(value);
+#endif
+  std::memcpy(out, &value, sizeof value);
+  return out + sizeof value;
+}
+
+inline char* pack_type(char* out, std::byte type) {
+  *out = static_cast<char>(type);
+  return out + 1;
+}
+
+inline char* pack_integer(char* out, std::uint64_t value) {
+  if (value <= 0x7F) {
+    // positive fixint: the value is the type byte
+    return pack_big_endian(out, static_cast<std::uint8_t>(value));
+  }
+  if (value <= std::numeric_limits<std::uint8_t>::max()) {
+    out = pack_type(out, types::UINT8);
+    return pack_big_endian(out, static_cast<std::uint8_t>(value));
+  }
+  if (value <= std::numeric_limits<std::uint16_t>::max()) {
+    out = pack_type(out, types::UINT16);
+    return pack_big_endian(out, static_cast<std::uint16_t>(value));
+  }
+  if (value <= std::numeric_limits<std::uint32_t>::max()) {
+    out = pack_type(out, types::UINT32);
+    return pack_big_endian(out, static_cast<std::uint32_t>(value));
+  }
+  out = pack_type(out, types::UINT64);
+  return pack_big_endian(out, value);
+}
+
+inline char* pack_integer(char* out, std::int64_t value) {
+  if (value >= 0) {
+    // Non-negative integers use the unsigned forms, which have a larger range.
+    return pack_integer(out, static_cast<std::uint64_t>(value));
+  }
+  if (value >= -32) {
+    // negative fixint: the value is the type byte
+    return pack_big_endian(out, static_cast<std::int8_t>(value));
+  }
+  if (value >= std::numeric_limits<std::int8_t>::min()) {
+    out = pack_type(out, types::INT8);
+    return pack_big_endian(out, static_cast<std::int8_t>(value));
+  }
+  if (value >= std::numeric_limits<std::int16_t>::min()) {
+    out = pack_type(out, types::INT16);
+    return pack_big_endian(out, static_cast<std::int16_t>(value));
+  }
+  if (value >= std::numeric_limits<std::int32_t>::min()) {
+    out = pack_type(out, types::INT32);
+    return pack_big_endian(out, static_cast<std::int32_t>(value));
+  }
+  out = pack_type(out, types::INT64);
+  return pack_big_endian(out, value);
+}
+
+inline char* pack_integer(char* out, std::int32_t value) {
+  return pack_integer(out, std::int64_t(value));
+}
+
+inline char* pack_double(char* out, double value) {
+  out = pack_type(out, types::DOUBLE);
+  std::uint64_t bits;
+  static_assert(sizeof bits == sizeof value);
+  std::memcpy(&bits, &value, sizeof bits);
+#if defined(TARGET_OS_IPHONE)
+  // ok
+#elif defined(__arm__) && !(__ARM_EABI__)  // arm-oabi
+  // https://github.com/msgpack/msgpack-perl/pull/1
+  bits = (bits & 0xFFFFFFFFUL) << 32UL | (bits >> 32UL);
+#endif
+  return pack_big_endian(out, bits);
+}
+
+// Write the header of a collection (map or array) or string having the
+// specified `size`, using the smallest form that fits.  `fix` is the type
+// byte of the form whose size is encoded in the type byte itself, and
+// `fix_max` is the largest size that that form can express.  `type8`,
+// `type16`, and `type32` are the type bytes of the forms whose sizes follow
+// the type byte in 8, 16, or 32 bits.  Some kinds of value have no 8-bit
+// form, in which case `type8` is the same as `type16`.
+inline char* pack_header(char* out, std::size_t size, std::byte fix,
+                         std::size_t fix_max, std::byte type8,
+                         std::byte type16, std::byte type32) {
+  if (size <= fix_max) {
+    return pack_type(out, fix | std::byte(size));
+  }
+  if (type8 != type16 && size <= std::numeric_limits<std::uint8_t>::max()) {
+    out = pack_type(out, type8);
+    return pack_big_endian(out, static_cast<std::uint8_t>(size));
+  }
+  if (size <= std::numeric_limits<std::uint16_t>::max()) {
+    out = pack_type(out, type16);
+    return pack_big_endian(out, static_cast<std::uint16_t>(size));
+  }
+  out = pack_type(out, type32);
+  return pack_big_endian(out, static_cast<std::uint32_t>(size));
+}
+
+inline char* pack_string(char* out, std::string_view value) {
+  out = pack_header(out, value.size(), types::FIXSTR, 31, types::STR8,
+                    types::STR16, types::STR32);
+  return pack_raw(out, value);
+}
+
+inline char* pack_array(char* out, std::size_t size) {
+  return pack_header(out, size, types::FIXARRAY, 15, types::ARRAY16,
+                     types::ARRAY16, types::ARRAY32);
+}
+
+inline char* pack_map(char* out, std::size_t size) {
+  return pack_header(out, size, types::FIXMAP, 15, types::MAP16, types::MAP16,
+                     types::MAP32);
+}
+
+}  // namespace unchecked
+
 }  // namespace msgpack
 }  // namespace tracing
 }  // namespace datadog
@@ -0,0 +1,247 @@
+#include "otlp.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+
+#include "protobuf.h"
+#include "span_data.h"
+#include "span_defaults.h"
+#include "tags.h"
+#include "version.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// These are the field numbers of the OTLP messages that are encoded, from
+// "opentelemetry/proto/trace/v1/trace.proto" and its dependencies.
+namespace fields {
+
+constexpr std::uint32_t request_resource_spans = 1;
+constexpr std::uint32_t resource_spans_resource = 1;
+constexpr std::uint32_t resource_spans_scope_spans = 2;
+constexpr std::uint32_t resource_attributes = 1;
+constexpr std::uint32_t scope_spans_scope = 1;
+constexpr std::uint32_t scope_spans_spans = 2;
+constexpr std::uint32_t scope_name = 1;
+constexpr std::uint32_t scope_version = 2;
+
+constexpr std::uint32_t span_trace_id = 1;
+constexpr std::uint32_t span_span_id = 2;
+constexpr std::uint32_t span_parent_span_id = 4;
+constexpr std::uint32_t span_name = 5;
+constexpr std::uint32_t span_kind = 6;
+constexpr std::uint32_t span_start_time = 7;
+constexpr std::uint32_t span_end_time = 8;
+constexpr std::uint32_t span_attributes = 9;
+constexpr std::uint32_t span_status = 15;
+constexpr std::uint32_t status_message = 2;
+constexpr std::uint32_t status_code = 3;
+
+constexpr std::uint32_t key_value_key = 1;
+constexpr std::uint32_t key_value_value = 2;
+constexpr std::uint32_t any_value_string = 1;
+constexpr std::uint32_t any_value_double = 4;
+
+}  // namespace fields
+
+// The "Status.StatusCode" of a span that has an error.
+constexpr std::uint64_t status_code_error = 2;
+
+// The name of the instrumentation scope of every span.
+constexpr std::string_view scope_name = "datadog";
+
+// Append to the specified `destination` an attribute, i.e. a "KeyValue"
+// message in the specified `field`, having the specified `key` and string
+// `value`.  Its size is computed first, and so nothing is moved.
+void pack_attribute(std::string& destination, std::uint32_t field,
+                    std::string_view key, std::string_view value) {
+  const auto any_value_size =
+      protobuf::message_size(fields::any_value_string, value.size());
+  protobuf::pack_message_header(
+      destination, field,
+      protobuf::message_size(fields::key_value_key, key.size()) +
+          protobuf::message_size(fields::key_value_value, any_value_size));
+  protobuf::pack_string(destination, fields::key_value_key, key);
+  protobuf::pack_message_header(destination, fields::key_value_value,
+                                any_value_size);
+  protobuf::pack_string(destination, fields::any_value_string, value);
+}
+
+void pack_attribute(std::string& destination, std::uint32_t field,
+                    std::string_view key, double value) {
+  // A double is a one-byte tag followed by eight bytes.
+  const std::size_t any_value_size = 1 + sizeof value;
+  protobuf::pack_message_header(
+      destination, field,
+      protobuf::message_size(fields::key_value_key, key.size()) +
+          protobuf::message_size(fields::key_value_value, any_value_size));
+  protobuf::pack_string(destination, fields::key_value_key, key);
+  protobuf::pack_message_header(destination, fields::key_value_value,
+                                any_value_size);
+  protobuf::pack_double(destination, fields::any_value_double, value);
+}
+
+// Append to the specified `destination` the specified `id` as a "bytes" field
+// having the specified `field` number.  OTLP IDs are big-endian.
+void pack_id(std::string& destination, std::uint32_t field,
+             std::uint64_t high, std::uint64_t low, std::size_t size) {
+  char encoded[16];
+  for (std::size_t i = 0; i < 8; ++i) {
+    encoded[7 - i] = char((high >> (8 * i)) & 0xFF);
+    encoded[15 - i] = char((low >> (8 * i)) & 0xFF);
+  }
+  protobuf::pack_string(destination, field,
+                        std::string_view(encoded + 16 - size, size));
+}
+
+// Return the OTLP "SpanKind" corresponding to the specified value of the
+// "span.kind" tag, or zero ("SPAN_KIND_UNSPECIFIED") if there's none.
+std::uint64_t span_kind(std::string_view kind) {
+  constexpr std::string_view kinds[] = {"internal", "server", "client",
+                                        "producer", "consumer"};
+  for (std::size_t i = 0; i < std::size(kinds); ++i) {
+    if (kind == kinds[i]) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+std::uint64_t nanoseconds_since_epoch(
+    std::chrono::system_clock::time_point time) {
+  return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           time.time_since_epoch())
+                           .count());
+}
+
+}  // namespace
+
+OtlpResource::OtlpResource(const SpanDefaults& defaults)
+    : service_(defaults.service),
+      environment_(defaults.environment),
+      version_(defaults.version) {
+  pack_attribute(encoded_, fields::resource_attributes, "service.name",
+                 service_);
+  if (!environment_.empty()) {
+    pack_attribute(encoded_, fields::resource_attributes,
+                   "deployment.environment", environment_);
+  }
+  if (!version_.empty()) {
+    pack_attribute(encoded_, fields::resource_attributes, "service.version",
+                   version_);
+  }
+  pack_attribute(encoded_, fields::resource_attributes,
+                 "telemetry.sdk.language", "cpp");
+  pack_attribute(encoded_, fields::resource_attributes, "telemetry.sdk.name",
+                 "datadog");
+  pack_attribute(encoded_, fields::resource_attributes,
+                 "telemetry.sdk.version", tracer_version);
+}
+
+void otlp_encode(std::string& destination, const SpanData& span,
+                 const OtlpResource& resource, std::string_view origin) {
+  const auto begin =
+      protobuf::begin_message(destination, fields::scope_spans_spans);
+  pack_id(destination, fields::span_trace_id, span.trace_id.high,
+          span.trace_id.low, 16);
+  pack_id(destination, fields::span_span_id, 0, span.span_id, 8);
+  if (span.parent_id != 0) {
+    pack_id(destination, fields::span_parent_span_id, 0, span.parent_id, 8);
+  }
+  protobuf::pack_string(destination, fields::span_name, span.name);
+  const auto kind = span.tags.find("span.kind");
+  if (kind != span.tags.end()) {
+    if (const auto value = span_kind(kind->second)) {
+      protobuf::pack_uint64(destination, fields::span_kind, value);
+    }
+  }
+  protobuf::pack_fixed64(destination, fields::span_start_time,
+                         nanoseconds_since_epoch(span.start.wall));
+  protobuf::pack_fixed64(
+      destination, fields::span_end_time,
+      nanoseconds_since_epoch(
+          span.start.wall +
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              span.duration)));
+
+  pack_attribute(destination, fields::span_attributes, "operation.name",
+                 span.name);
+  pack_attribute(destination, fields::span_attributes, "resource.name",
+                 span.resource);
+  if (!span.service_type.empty()) {
+    pack_attribute(destination, fields::span_attributes, "span.type",
+                   span.service_type);
+  }
+  if (span.service != resource.service()) {
+    pack_attribute(destination, fields::span_attributes, "service.name",
+                   span.service);
+  }
+  if (!origin.empty() && !span.tags.contains(tags::internal::origin)) {
+    pack_attribute(destination, fields::span_attributes,
+                   tags::internal::origin, origin);
+  }
+  for (const auto& [key, value] : span.tags) {
+    if ((key == tags::environment && value == resource.environment()) ||
+        (key == tags::version && value == resource.version())) {
+      continue;
+    }
+    pack_attribute(destination, fields::span_attributes, key, value);
+  }
+  for (const auto& [key, value] : span.numeric_tags) {
+    pack_attribute(destination, fields::span_attributes, key, value);
+  }
+  for (std::size_t i = 0; i < span.mark_count; ++i) {
+    pack_attribute(
+        destination, fields::span_attributes, span.marks[i].name,
+        double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   span.marks[i].offset)
+                   .count()));
+  }
+
+  if (span.error) {
+    const auto status =
+        protobuf::begin_message(destination, fields::span_status);
+    const auto message = span.tags.find(tags::error_message);
+    if (message != span.tags.end()) {
+      protobuf::pack_string(destination, fields::status_message,
+                            message->second);
+    }
+    protobuf::pack_uint64(destination, fields::status_code,
+                          status_code_error);
+    protobuf::end_message(destination, status);
+  }
+  protobuf::end_message(destination, begin);
+}
+
+void otlp_encode_header(std::string& destination, const OtlpResource& resource,
+                        std::size_t spans_size) {
+  const std::string_view version = tracer_version;
+  const auto scope_size =
+      protobuf::message_size(fields::scope_name, scope_name.size()) +
+      protobuf::message_size(fields::scope_version, version.size());
+  const auto scope_spans_size =
+      protobuf::message_size(fields::scope_spans_scope, scope_size) +
+      spans_size;
+  const auto resource_spans_size =
+      protobuf::message_size(fields::resource_spans_resource,
+                             resource.encoded().size()) +
+      protobuf::message_size(fields::resource_spans_scope_spans,
+                             scope_spans_size);
+
+  protobuf::pack_message_header(destination, fields::request_resource_spans,
+                                resource_spans_size);
+  protobuf::pack_message_header(destination, fields::resource_spans_resource,
+                                resource.encoded().size());
+  destination += resource.encoded();
+  protobuf::pack_message_header(
+      destination, fields::resource_spans_scope_spans, scope_spans_size);
+  protobuf::pack_message_header(destination, fields::scope_spans_scope,
+                                scope_size);
+  protobuf::pack_string(destination, fields::scope_name, scope_name);
+  protobuf::pack_string(destination, fields::scope_version, version);
+}
+
+}  // namespace tracing
+}  // namespace datadog
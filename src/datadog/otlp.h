@@ -0,0 +1,82 @@
+#pragma once
+
+// This component provides encoding routines for sending traces in the
+// [OpenTelemetry protocol][1] (OTLP), as protobuf over HTTP.  `DatadogAgent`
+// uses them when its `TraceAPIVersion` is `OTLP` (see
+// `datadog_agent_config.h`).
+//
+// A request is an "ExportTraceServiceRequest" message having one
+// "ResourceSpans", which has one "ScopeSpans", which has all of the spans of
+// the request.  The resource's attributes come from the tracer's
+// `SpanDefaults`, and so they're encoded once, when an `OtlpResource` is
+// created, and are then written once per request.
+//
+// Since the spans of a "ScopeSpans" are a repeated field, the encodings of
+// spans can be concatenated.  Each trace chunk is encoded independently by
+// `otlp_encode`, just as in the Datadog Agent's "v0.4" format, and so trace
+// chunks can be buffered already encoded, encoded in parallel, and combined
+// into requests without being encoded again.  `otlp_encode_header` then
+// writes what precedes the spans of a request, which depends only on the
+// resource and on the total size of the spans.
+//
+// A span's properties that have no OpenTelemetry equivalent are sent as
+// attributes of the span, named as the Datadog Agent's OTLP receiver expects:
+// "operation.name", "resource.name", and "span.type".  The span's tags are
+// attributes having string values, and its numeric tags and marks are
+// attributes having double values.  Tags whose values are those of the
+// resource, i.e. the service, "env", and "version", aren't repeated on each
+// span.
+//
+// The encoding uses `protobuf.h`, and so it allocates only when the
+// destination buffer grows.
+//
+// [1]: https://opentelemetry.io/docs/specs/otlp/
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+struct SpanDefaults;
+
+class OtlpResource {
+  std::string service_;
+  std::string environment_;
+  std::string version_;
+  // `encoded_` is the "Resource" message, without its tag and length.
+  std::string encoded_;
+
+ public:
+  // Create an `OtlpResource` having the "service.name",
+  // "deployment.environment", and "service.version" attributes of the
+  // specified `defaults`, and the "telemetry.sdk.*" attributes of this
+  // library.
+  explicit OtlpResource(const SpanDefaults& defaults);
+
+  const std::string& service() const { return service_; }
+  const std::string& environment() const { return environment_; }
+  const std::string& version() const { return version_; }
+  const std::string& encoded() const { return encoded_; }
+};
+
+// Append to the specified `destination` the OTLP encoding of the specified
+// `span` as an element of the "spans" field of a "ScopeSpans" message.
+// Attributes that are the same as the specified `resource`'s are omitted.  If
+// the optionally specified `origin` is not empty, and the span has no
+// "_dd.origin" tag, then encode the span as if it had that tag with the value
+// `origin`.
+void otlp_encode(std::string& destination, const SpanData& span,
+                 const OtlpResource& resource, std::string_view origin = {});
+
+// Append to the specified `destination` the beginning of an
+// "ExportTraceServiceRequest" message having the specified `resource`, up to
+// where its spans begin.  The spans, which were encoded by `otlp_encode`, must
+// then be appended, and must total the specified `spans_size` bytes.
+void otlp_encode_header(std::string& destination, const OtlpResource& resource,
+                        std::size_t spans_size);
+
+}  // namespace tracing
+}  // namespace datadog
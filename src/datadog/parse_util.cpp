@@ -5,40 +5,92 @@
 #include <cctype>
 #include <charconv>
 #include <iterator>
+#include <limits>
 #include <sstream>
 #include <string>
 
 #include "error.h"
+#include "trace_id.h"
 
 namespace datadog {
 namespace tracing {
 namespace {
 
+constexpr std::uint64_t lanes_of(unsigned char byte) {
+  return 0x0101010101010101ULL * byte;
+}
+
+// Return whether each of the specified `lanes` is a decimal digit.
+bool all_decimal(std::uint64_t lanes) {
+  // A digit's high nibble is 3, and stays 3 when 6 is added to the digit.
+  return ((lanes & lanes_of(0xF0)) |
+          (((lanes + lanes_of(0x06)) & lanes_of(0xF0)) >> 4)) ==
+         lanes_of(0x33);
+}
+
+// Return the value of the eight decimal digits in the specified `lanes`.
+std::uint64_t decimal_value(std::uint64_t lanes) {
+  // Combine adjacent digits into pairs, then pairs into quads, and then
+  // quads into the result, in three multiplications.
+  lanes = ((lanes & lanes_of(0x0F)) * (1 + (10 << 8))) >> 8;
+  lanes = ((lanes & 0x00FF00FF00FF00FFULL) * (1 + (100ULL << 16))) >> 16;
+  return ((lanes & 0x0000FFFF0000FFFFULL) * (1 + (10000ULL << 32))) >> 32;
+}
+
+// Store into the specified `value` the decimal integer that is the specified
+// `input`, eight digits at a time, and return true.  Return false if `input`
+// is empty, contains anything other than digits, or is out of range, in
+// which case the caller reports the error.
+bool parse_decimal(std::string_view input, std::uint64_t& value) {
+  // The largest 64-bit integer has 20 digits.
+  constexpr std::size_t max_digits =
+      std::numeric_limits<std::uint64_t>::digits10 + 1;
+  if (input.empty() || input.size() > max_digits) {
+    return false;
+  }
+  const char* digits = input.data();
+  const char* const end = digits + input.size();
+  value = 0;
+  // Take the leading digits that don't fill a group of eight one at a time.
+  for (; (end - digits) % 8 != 0; ++digits) {
+    const unsigned digit = static_cast<unsigned char>(*digits) - unsigned('0');
+    if (digit > 9) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  constexpr std::uint64_t group = 100000000;
+  constexpr std::uint64_t max = std::numeric_limits<std::uint64_t>::max();
+  for (; digits != end; digits += 8) {
+    const std::uint64_t lanes = load_lanes(digits);
+    if (!all_decimal(lanes)) {
+      return false;
+    }
+    const std::uint64_t digits_value = decimal_value(lanes);
+    if (value > (max - digits_value) / group) {
+      return false;
+    }
+    value = value * group + digits_value;
+  }
+  return true;
+}
+
 template <typename Integer>
-Expected<Integer> parse_integer(std::string_view input, int base,
-                                std::string_view kind) {
+Expected<Integer, LazyError> parse_integer(std::string_view input, int base,
+                                           std::string_view kind) {
   Integer value;
   input = strip(input);
   const auto status = std::from_chars(input.begin(), input.end(), value, base);
   if (status.ec == std::errc::invalid_argument) {
-    std::string message;
-    message += "Is not a valid integer: \"";
-    message += input;
-    message += '\"';
-    return Error{Error::INVALID_INTEGER, std::move(message)};
+    return LazyError{Error::INVALID_INTEGER,
+                     {"Is not a valid integer: \"", input, "\""}};
   } else if (status.ptr != input.end()) {
-    std::string message;
-    message += "Integer has trailing characters in: \"";
-    message += input;
-    message += '\"';
-    return Error{Error::INVALID_INTEGER, std::move(message)};
+    return LazyError{Error::INVALID_INTEGER,
+                     {"Integer has trailing characters in: \"", input, "\""}};
   } else if (status.ec == std::errc::result_out_of_range) {
-    std::string message;
-    message += "Integer is not within the range of ";
-    message += kind;
-    message += ": ";
-    message += input;
-    return Error{Error::OUT_OF_RANGE_INTEGER, std::move(message)};
+    return LazyError{
+        Error::OUT_OF_RANGE_INTEGER,
+        {"Integer is not within the range of ", kind, ": ", input}};
   }
   return value;
 }
@@ -61,11 +113,25 @@ std::string_view strip(std::string_view input) {
   return std::string_view{begin, std::size_t(end - begin)};
 }
 
-Expected<std::uint64_t> parse_uint64(std::string_view input, int base) {
+Expected<std::uint64_t, LazyError> parse_uint64(std::string_view input,
+                                                int base) {
+  // IDs are parsed from every request, and so the common forms have a fast
+  // path.  Anything else, including errors, takes the general path.
+  std::uint64_t value;
+  if (base == 10 && parse_decimal(input, value)) {
+    return value;
+  }
+  if (base == 16 && !input.empty() && input.size() <= 16) {
+    int invalid = 0;
+    value = read_hex(input, invalid);
+    if (!invalid) {
+      return value;
+    }
+  }
   return parse_integer<std::uint64_t>(input, base, "64-bit unsigned");
 }
 
-Expected<int> parse_int(std::string_view input, int base) {
+Expected<int, LazyError> parse_int(std::string_view input, int base) {
   return parse_integer<int>(input, base, "int");
 }
 
@@ -109,5 +175,24 @@ bool starts_with(std::string_view subject, std::string_view prefix) {
          prefix.end();
 }
 
+bool ends_with(std::string_view subject, std::string_view suffix) {
+  return suffix.size() <= subject.size() &&
+         subject.substr(subject.size() - suffix.size()) == suffix;
+}
+
+bool equals_ignoring_case(std::string_view left, std::string_view right) {
+  return std::equal(left.begin(), left.end(), right.begin(), right.end(),
+                    [](unsigned char left, unsigned char right) {
+                      return std::tolower(left) == std::tolower(right);
+                    });
+}
+
+bool falsy(std::string_view text) {
+  std::string lower{text};
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char ch) { return std::tolower(ch); });
+  return lower == "0" || lower == "false" || lower == "no";
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -4,9 +4,11 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <string_view>
 
 #include "expected.h"
+#include "lazy_error.h"
 
 namespace datadog {
 namespace tracing {
@@ -16,16 +18,44 @@ inline std::string_view range(const char* begin, const char* end) {
   return std::string_view{begin, std::size_t(end - begin)};
 }
 
+// Return the eight characters beginning at the specified `input` as an
+// integer whose least significant byte is `input[0]`, whatever the byte order
+// of the platform.  This is how several characters are examined at once, as
+// the lanes of one integer.  Compilers that don't define `__BYTE_ORDER__`,
+// such as MSVC, target only little endian platforms.
+inline std::uint64_t load_lanes(const char* input) {
+  std::uint64_t lanes;
+  std::memcpy(&lanes, input, sizeof lanes);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  lanes = __builtin_bswap64(lanes);
+#endif
+  return lanes;
+}
+
+// Write the specified `lanes` to the eight characters beginning at the
+// specified `output`, least significant byte first.  This is the inverse of
+// `load_lanes`.
+inline void store_lanes(char* output, std::uint64_t lanes) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  lanes = __builtin_bswap64(lanes);
+#endif
+  std::memcpy(output, &lanes, sizeof lanes);
+}
+
 // Remove leading and trailing whitespace (as determined by `std::isspace`) from
 // the specified `input`.
 std::string_view strip(std::string_view input);
 
 // Return a non-negative integer parsed from the specified `input` with respect
-// to the specified `base`, or return an `Error` if no such integer can be
+// to the specified `base`, or return an error if no such integer can be
 // parsed. It is an error unless all of `input` is consumed by the parse.
-// Leading and trailing whitespace are not ignored.
-Expected<std::uint64_t> parse_uint64(std::string_view input, int base);
-Expected<int> parse_int(std::string_view input, int base);
+// Leading and trailing whitespace are not ignored.  Integers are parsed from
+// untrusted headers, and so the error is a `LazyError`, which refers to
+// `input` rather than copying it.  Use `LazyError::to_error` to keep the error
+// beyond the lifetime of `input`.
+Expected<std::uint64_t, LazyError> parse_uint64(std::string_view input,
+                                                int base);
+Expected<int, LazyError> parse_int(std::string_view input, int base);
 
 // Return a floating point number parsed from the specified `input`, or return
 // an `Error` if not such number can be parsed. It is an error unless all of
@@ -36,5 +66,16 @@ Expected<double> parse_double(std::string_view input);
 // Return whether the specified `prefix` is a prefix of the specified `subject`.
 bool starts_with(std::string_view subject, std::string_view prefix);
 
+// Return whether the specified `suffix` is a suffix of the specified `subject`.
+bool ends_with(std::string_view subject, std::string_view suffix);
+
+// Return whether the specified `left` and `right` are equal, ignoring the case
+// of ASCII letters.
+bool equals_ignoring_case(std::string_view left, std::string_view right);
+
+// Return whether the specified `text` is "0", "false", or "no", ignoring case.
+// This is how environment variables turn off boolean settings.
+bool falsy(std::string_view text);
+
 }  // namespace tracing
 }  // namespace datadog
@@ -16,6 +16,12 @@ nlohmann::json to_json(const PropagationStyles& styles) {
   if (styles.b3) {
     selected_names.emplace_back("B3");
   }
+  if (styles.b3_single) {
+    selected_names.emplace_back("b3single");
+  }
+  if (styles.w3c) {
+    selected_names.emplace_back("tracecontext");
+  }
   return selected_names;
 }
 
@@ -13,6 +13,13 @@ namespace tracing {
 struct PropagationStyles {
   bool datadog = true;
   bool b3 = false;
+  // The B3 style in a single "b3" header, named "b3single".  When extracting,
+  // it's used only if the Datadog and B3 styles found no trace ID.
+  bool b3_single = false;
+  // The W3C Trace Context style, named "tracecontext".  See
+  // `w3c_propagation.h`.  When extracting, it's used only if the other styles
+  // found no trace ID.
+  bool w3c = false;
 };
 
 nlohmann::json to_json(const PropagationStyles&);
@@ -0,0 +1,136 @@
+#include "protobuf.h"
+
+#include <cstring>
+
+namespace datadog {
+namespace tracing {
+namespace protobuf {
+namespace {
+
+enum WireType : std::uint32_t { VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2 };
+
+constexpr std::size_t max_varint_size = 10;
+
+// Write the specified `value` as a varint to the specified `out`, and return a
+// pointer to just past what was written.
+char* write_varint(char* out, std::uint64_t value) {
+  while (value >= 0x80) {
+    *out++ = char((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  *out++ = char(value);
+  return out;
+}
+
+std::uint64_t tag(std::uint32_t field, WireType type) {
+  return (std::uint64_t(field) << 3) | type;
+}
+
+void pack_tag(std::string& buffer, std::uint32_t field, WireType type) {
+  pack_varint(buffer, tag(field, type));
+}
+
+std::size_t varint_size(std::uint64_t value) {
+  std::size_t size = 1;
+  while (value >= 0x80) {
+    ++size;
+    value >>= 7;
+  }
+  return size;
+}
+
+}  // namespace
+
+void pack_varint(std::string& buffer, std::uint64_t value) {
+  char encoded[max_varint_size];
+  buffer.append(encoded, write_varint(encoded, value) - encoded);
+}
+
+void pack_uint64(std::string& buffer, std::uint32_t field,
+                 std::uint64_t value) {
+  pack_tag(buffer, field, VARINT);
+  pack_varint(buffer, value);
+}
+
+void pack_int64(std::string& buffer, std::uint32_t field, std::int64_t value) {
+  // Negative values of the "int64" type are encoded as their two's
+  // complement, which takes ten bytes.
+  pack_uint64(buffer, field, std::uint64_t(value));
+}
+
+void pack_int32(std::string& buffer, std::uint32_t field, std::int32_t value) {
+  // As with "int64," a negative "int32" is sign-extended to 64 bits.
+  pack_uint64(buffer, field, std::uint64_t(std::int64_t(value)));
+}
+
+void pack_bool(std::string& buffer, std::uint32_t field, bool value) {
+  pack_uint64(buffer, field, value);
+}
+
+void pack_double(std::string& buffer, std::uint32_t field, double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  pack_fixed64(buffer, field, bits);
+}
+
+void pack_fixed64(std::string& buffer, std::uint32_t field,
+                  std::uint64_t value) {
+  pack_tag(buffer, field, FIXED64);
+  // The value is little-endian regardless of the host.
+  char encoded[sizeof value];
+  for (char& byte : encoded) {
+    byte = char(value & 0xFF);
+    value >>= 8;
+  }
+  buffer.append(encoded, sizeof encoded);
+}
+
+void pack_string(std::string& buffer, std::uint32_t field,
+                 std::string_view value) {
+  pack_tag(buffer, field, LENGTH_DELIMITED);
+  pack_varint(buffer, value.size());
+  buffer.append(value.data(), value.size());
+}
+
+std::size_t begin_message(std::string& buffer, std::uint32_t field) {
+  pack_tag(buffer, field, LENGTH_DELIMITED);
+  return buffer.size();
+}
+
+void end_message(std::string& buffer, std::size_t offset) {
+  char encoded[max_varint_size];
+  const char* const end = write_varint(encoded, buffer.size() - offset);
+  buffer.insert(offset, encoded, end - encoded);
+}
+
+void pack_message_header(std::string& buffer, std::uint32_t field,
+                         std::size_t size) {
+  pack_tag(buffer, field, LENGTH_DELIMITED);
+  pack_varint(buffer, size);
+}
+
+std::size_t message_size(std::uint32_t field, std::size_t size) {
+  return varint_size(tag(field, LENGTH_DELIMITED)) + varint_size(size) + size;
+}
+
+void pack_map_entry(std::string& buffer, std::uint32_t field,
+                    std::string_view key, std::string_view value) {
+  // A map entry is an embedded message whose key is field 1 and whose value is
+  // field 2.
+  const auto entry = begin_message(buffer, field);
+  pack_string(buffer, 1, key);
+  pack_string(buffer, 2, value);
+  end_message(buffer, entry);
+}
+
+void pack_map_entry(std::string& buffer, std::uint32_t field,
+                    std::string_view key, double value) {
+  const auto entry = begin_message(buffer, field);
+  pack_string(buffer, 1, key);
+  pack_double(buffer, 2, value);
+  end_message(buffer, entry);
+}
+
+}  // namespace protobuf
+}  // namespace tracing
+}  // namespace datadog
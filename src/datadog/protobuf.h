@@ -0,0 +1,81 @@
+#pragma once
+
+// This component provides encoding routines for [Protocol Buffers][1].
+//
+// Each function is in `namespace protobuf` and appends a field, i.e. a tag
+// followed by a value, to a `std::string`.  For example,
+// `protobuf::pack_string(destination, 2, "foo")` appends field number 2 having
+// the string value "foo".
+//
+// Only encoding is provided, and only for the wire types required by
+// `AgentlessCollector`, which sends traces to the Datadog intake in the
+// protobuf format of the Datadog Agent's "AgentPayload" message, and by the
+// OpenTelemetry encoding of `DatadogAgent` (see `otlp.h`).
+//
+// An embedded message is length-prefixed, but its length isn't known until
+// it's encoded.  `begin_message` returns where the message begins, and
+// `end_message` inserts the length there once the message has been appended.
+// The insertion moves only the embedded message, and so nesting costs one move
+// of each message's encoding per level.
+//
+// When the length of an embedded message is known before it's encoded,
+// `pack_message_header` appends the tag and the length instead, and nothing is
+// moved.
+//
+// [1]: https://protobuf.dev/programming-guides/encoding/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace datadog {
+namespace tracing {
+namespace protobuf {
+
+// Append to the specified `buffer` the specified `value` as a base 128
+// varint.
+void pack_varint(std::string& buffer, std::uint64_t value);
+
+void pack_uint64(std::string& buffer, std::uint32_t field,
+                 std::uint64_t value);
+void pack_int64(std::string& buffer, std::uint32_t field, std::int64_t value);
+void pack_int32(std::string& buffer, std::uint32_t field, std::int32_t value);
+void pack_bool(std::string& buffer, std::uint32_t field, bool value);
+void pack_double(std::string& buffer, std::uint32_t field, double value);
+void pack_fixed64(std::string& buffer, std::uint32_t field,
+                  std::uint64_t value);
+void pack_string(std::string& buffer, std::uint32_t field,
+                 std::string_view value);
+
+// Append to the specified `buffer` the tag of an embedded message having the
+// specified `field` number, and return the offset at which the message
+// begins.  Pass the result to `end_message` after appending the message.
+std::size_t begin_message(std::string& buffer, std::uint32_t field);
+
+// Insert into the specified `buffer` the length of the embedded message that
+// begins at the specified `offset`, as returned by `begin_message`, and that
+// extends to the end of `buffer`.
+void end_message(std::string& buffer, std::size_t offset);
+
+// Append to the specified `buffer` the tag and the length of an embedded
+// message having the specified `field` number and the specified `size` in
+// bytes.  The caller then appends exactly `size` bytes of the message.
+void pack_message_header(std::string& buffer, std::uint32_t field,
+                         std::size_t size);
+
+// Return the number of bytes occupied by an embedded message having the
+// specified `field` number and the specified `size`, including its tag and
+// length.
+std::size_t message_size(std::uint32_t field, std::size_t size);
+
+// Append to the specified `buffer` an entry of the map having the specified
+// `field` number, where the entry has the specified `key` and `value`.
+void pack_map_entry(std::string& buffer, std::uint32_t field,
+                    std::string_view key, std::string_view value);
+void pack_map_entry(std::string& buffer, std::uint32_t field,
+                    std::string_view key, double value);
+
+}  // namespace protobuf
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,412 @@
+#include "recording_collector.h"
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#include "json.hpp"
+#include "protobuf.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr std::string_view magic = "DDTRACE1";
+
+Error recording_error(std::string_view what, const std::string& path,
+                      int error) {
+  std::string message;
+  message += "Unable to ";
+  message += what;
+  message += " the trace recording ";
+  message += path;
+  if (error != 0) {
+    message += ": ";
+    message += std::strerror(error);
+  }
+  return Error{Error::TRACE_RECORDING_ERROR, std::move(message)};
+}
+
+std::uint64_t zigzag(std::int64_t value) {
+  return (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63);
+}
+
+std::int64_t unzigzag(std::uint64_t value) {
+  return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+}
+
+std::int64_t nanoseconds(std::chrono::nanoseconds duration) {
+  return duration.count();
+}
+
+void pack_double(std::string& buffer, double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  for (int i = 0; i < 8; ++i) {
+    buffer += char(bits >> (8 * i));
+  }
+}
+
+// Return a string of the same length as the specified `value`, derived from a
+// hash of `value`.
+std::string anonymized(std::string_view value) {
+  constexpr std::string_view alphabet = "abcdefghijklmnopqrstuvwxyz0123456789";
+  // FNV-1a, and then SplitMix64 to produce each character.
+  std::uint64_t state = 14695981039346656037ULL;
+  for (const char ch : value) {
+    state = (state ^ std::uint8_t(ch)) * 1099511628211ULL;
+  }
+  std::string result(value.size(), ' ');
+  for (char& ch : result) {
+    std::uint64_t mixed = (state += 0x9e3779b97f4a7c15ULL);
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+    mixed ^= mixed >> 31;
+    ch = alphabet[mixed % alphabet.size()];
+  }
+  return result;
+}
+
+// `Reader` decodes a recording, which it refers to but does not own.  Each
+// function returns `false` if the recording ends too soon.  The string table
+// refers to the recording as well.
+class Reader {
+  std::string_view input_;
+  std::vector<std::string_view> strings_;
+
+ public:
+  explicit Reader(std::string_view input) : input_(input) {}
+
+  bool done() const { return input_.empty(); }
+
+  bool varint(std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (input_.empty()) {
+        return false;
+      }
+      const auto byte = std::uint8_t(input_.front());
+      input_.remove_prefix(1);
+      value |= std::uint64_t(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool signed_varint(std::int64_t& value) {
+    std::uint64_t encoded;
+    if (!varint(encoded)) {
+      return false;
+    }
+    value = unzigzag(encoded);
+    return true;
+  }
+
+  bool byte(bool& value) {
+    if (input_.empty()) {
+      return false;
+    }
+    value = input_.front() != 0;
+    input_.remove_prefix(1);
+    return true;
+  }
+
+  bool float64(double& value) {
+    if (input_.size() < 8) {
+      return false;
+    }
+    std::uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+      bits |= std::uint64_t(std::uint8_t(input_[i])) << (8 * i);
+    }
+    input_.remove_prefix(8);
+    std::memcpy(&value, &bits, sizeof value);
+    return true;
+  }
+
+  // Set the specified `value` to the next string.  Return `false` if the
+  // recording ends too soon or refers to a string that it doesn't contain.
+  bool string(std::string_view& value) {
+    std::uint64_t encoded;
+    if (!varint(encoded)) {
+      return false;
+    }
+    if (encoded % 2 == 0) {
+      if (encoded / 2 >= strings_.size()) {
+        return false;
+      }
+      value = strings_[encoded / 2];
+      return true;
+    }
+    const std::uint64_t size = encoded / 2;
+    if (size > input_.size()) {
+      return false;
+    }
+    value = input_.substr(0, size);
+    input_.remove_prefix(size);
+    if (strings_.size() < max_recorded_strings) {
+      strings_.push_back(value);
+    }
+    return true;
+  }
+
+  bool string(std::string& value) {
+    std::string_view view;
+    if (!string(view)) {
+      return false;
+    }
+    value.assign(view);
+    return true;
+  }
+
+  bool span(SpanData& span) {
+    std::uint64_t count;
+    std::int64_t start;
+    std::int64_t duration;
+    if (!string(span.service) || !string(span.service_type) ||
+        !string(span.name) || !string(span.resource) ||
+        !varint(span.trace_id.high) || !varint(span.trace_id.low) ||
+        !varint(span.span_id) || !varint(span.parent_id) ||
+        !signed_varint(start) || !signed_varint(duration) ||
+        !byte(span.error) || !varint(count)) {
+      return false;
+    }
+    // The steady clock time is arbitrary, and so is the same as the wall time.
+    const auto since_epoch = std::chrono::nanoseconds(start);
+    span.start.wall = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            since_epoch));
+    span.start.tick = std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<Duration>(since_epoch));
+    span.duration = std::chrono::duration_cast<Duration>(
+        std::chrono::nanoseconds(duration));
+
+    for (; count != 0; --count) {
+      std::string_view key;
+      std::string value;
+      if (!string(key) || !string(value)) {
+        return false;
+      }
+      span.tags.insert_or_assign(key, std::move(value));
+    }
+    if (!varint(count)) {
+      return false;
+    }
+    for (; count != 0; --count) {
+      std::string_view key;
+      double value;
+      if (!string(key) || !float64(value)) {
+        return false;
+      }
+      span.numeric_tags.insert_or_assign(key, value);
+    }
+    return true;
+  }
+
+  bool chunk(RecordedTraceChunk& chunk) {
+    std::uint64_t count;
+    if (!string(chunk.origin) || !varint(count)) {
+      return false;
+    }
+    for (; count != 0; --count) {
+      auto span = std::make_unique<SpanData>();
+      if (!this->span(*span)) {
+        return false;
+      }
+      chunk.spans.push_back(std::move(span));
+    }
+    return true;
+  }
+};
+
+}  // namespace
+
+RecordingCollector::RecordingCollector(std::shared_ptr<Collector> collector,
+                                       std::string path, bool anonymize,
+                                       std::FILE* file)
+    : collector_(std::move(collector)),
+      path_(std::move(path)),
+      anonymize_(anonymize),
+      file_(file) {
+  assert(collector_);
+  assert(file_);
+}
+
+Expected<std::shared_ptr<RecordingCollector>> RecordingCollector::open(
+    std::shared_ptr<Collector> collector, const std::string& path,
+    bool anonymize) {
+  std::FILE* file = std::fopen(path.c_str(), "wb");
+  if (!file) {
+    return recording_error("create", path, errno);
+  }
+  if (std::fwrite(magic.data(), 1, magic.size(), file) != magic.size()) {
+    const int error = errno;
+    std::fclose(file);
+    return recording_error("write to", path, error);
+  }
+  return std::shared_ptr<RecordingCollector>(
+      new RecordingCollector(std::move(collector), path, anonymize, file));
+}
+
+RecordingCollector::~RecordingCollector() { std::fclose(file_); }
+
+void RecordingCollector::pack_string(std::string_view value) {
+  const auto found = strings_.find(value);
+  if (found != strings_.end()) {
+    protobuf::pack_varint(buffer_, found->second * 2);
+    return;
+  }
+  protobuf::pack_varint(buffer_, value.size() * 2 + 1);
+  buffer_.append(value);
+  if (strings_.size() < max_recorded_strings) {
+    const std::string& stored = string_storage_.emplace_back(value);
+    strings_.emplace(stored, strings_.size());
+  }
+}
+
+Expected<void> RecordingCollector::record(
+    const std::vector<std::unique_ptr<SpanData>>& spans,
+    std::string_view origin) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  buffer_.clear();
+  pack_string(origin);
+  protobuf::pack_varint(buffer_, spans.size());
+  for (const auto& span : spans) {
+    pack_string(span->service);
+    pack_string(span->service_type);
+    pack_string(span->name);
+    pack_string(anonymize_ ? anonymized(span->resource) : span->resource);
+    protobuf::pack_varint(buffer_, span->trace_id.high);
+    protobuf::pack_varint(buffer_, span->trace_id.low);
+    protobuf::pack_varint(buffer_, span->span_id);
+    protobuf::pack_varint(buffer_, span->parent_id);
+    protobuf::pack_varint(
+        buffer_, zigzag(nanoseconds(span->start.wall.time_since_epoch())));
+    protobuf::pack_varint(buffer_, zigzag(nanoseconds(span->duration)));
+    buffer_ += char(span->error);
+
+    protobuf::pack_varint(buffer_, span->tags.size());
+    for (const auto& [key, value] : span->tags) {
+      pack_string(key);
+      if (anonymize_ && std::string_view(key).substr(0, 4) != "_dd.") {
+        pack_string(anonymized(value));
+      } else {
+        pack_string(value);
+      }
+    }
+    protobuf::pack_varint(buffer_,
+                          span->numeric_tags.size() + span->mark_count);
+    for (const auto& [key, value] : span->numeric_tags) {
+      pack_string(key);
+      pack_double(buffer_, value);
+    }
+    for (std::size_t i = 0; i < span->mark_count; ++i) {
+      pack_string(span->marks[i].name);
+      pack_double(buffer_, double(nanoseconds(span->marks[i].offset)));
+    }
+  }
+
+  if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) !=
+      buffer_.size()) {
+    return recording_error("write to", path_, errno);
+  }
+  return {};
+}
+
+Expected<void> RecordingCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler) {
+  auto result = record(spans, {});
+  if (!result) {
+    return result;
+  }
+  return collector_->send(std::move(spans), response_handler);
+}
+
+Expected<void> RecordingCollector::send_with_origin(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::string_view origin) {
+  auto result = record(spans, origin);
+  if (!result) {
+    return result;
+  }
+  return collector_->send_with_origin(std::move(spans), response_handler,
+                                      origin);
+}
+
+Expected<void> RecordingCollector::send_unsampled(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler,
+    std::optional<std::string_view> origin,
+    const std::shared_ptr<SpanSampler>& span_sampler,
+    std::optional<int> sampling_mechanism) {
+  auto result = record(spans, origin.value_or(""));
+  if (!result) {
+    return result;
+  }
+  return collector_->send_unsampled(std::move(spans), response_handler, origin,
+                                    span_sampler, sampling_mechanism);
+}
+
+Expected<void> RecordingCollector::flush(
+    std::chrono::steady_clock::time_point deadline) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::fflush(file_) != 0) {
+      return recording_error("write to", path_, errno);
+    }
+  }
+  return collector_->flush(deadline);
+}
+
+nlohmann::json RecordingCollector::config_json() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::RecordingCollector"},
+    {"config", nlohmann::json::object({
+      {"path", path_},
+      {"anonymize", anonymize_},
+      {"collector", collector_->config_json()},
+    })},
+  });
+  // clang-format on
+}
+
+Expected<std::vector<RecordedTraceChunk>> read_trace_recording(
+    const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return recording_error("open", path, errno);
+  }
+  const std::string contents{std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>()};
+  if (file.bad()) {
+    return recording_error("read", path, 0);
+  }
+  if (contents.compare(0, magic.size(), magic) != 0) {
+    return recording_error("recognize", path, 0);
+  }
+
+  std::vector<RecordedTraceChunk> chunks;
+  Reader reader{std::string_view(contents).substr(magic.size())};
+  while (!reader.done()) {
+    RecordedTraceChunk chunk;
+    if (!reader.chunk(chunk)) {
+      // The rest of the recording is incomplete or malformed.
+      break;
+    }
+    chunks.push_back(std::move(chunk));
+  }
+  return chunks;
+}
+
+}  // namespace tracing
+}  // namespace datadog
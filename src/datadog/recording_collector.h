@@ -0,0 +1,140 @@
+#pragma once
+
+// This component provides a class, `RecordingCollector`, that implements the
+// `Collector` interface by appending each trace chunk that it receives to a
+// file, and then passing the chunk on to another `Collector`.  It also
+// provides a function, `read_trace_recording`, that reads the trace chunks
+// back from such a file.
+//
+// A recording captures the trace shapes and tag cardinality of a real
+// workload, so that the encoding, sampling, and flushing of traces can be
+// measured against it (see `benchmark/replay_traces.cpp`).  To record, wrap
+// the collector that the tracer would otherwise use, e.g. a `DatadogAgent`,
+// and give the wrapper to the tracer as `TracerConfig::collector`.
+//
+// If `anonymize` is true, then the recording doesn't contain resource names
+// or tag values, other than the values of tags whose names begin with "_dd.".
+// Each such string is replaced by a string of the same length derived from a
+// hash of the original, so that equal strings remain equal.  The recording
+// then has the sizes and cardinality of the workload, but not its content.
+//
+// Format
+// ------
+// A recording begins with the eight bytes "DDTRACE1", followed by the chunks.
+//
+// Integers are written as base 128 varints, and signed integers are first
+// "zigzag" encoded, as in Protocol Buffers.  Numbers having a fractional part
+// are the eight bytes of their IEEE 754 representation, least significant
+// byte first.
+//
+// A string is an integer `n`.  If `n` is even, then the string is entry
+// `n / 2` of the recording's string table.  Otherwise, the `(n - 1) / 2`
+// bytes of the string follow, and the string is appended to the table if the
+// table has fewer than `max_recorded_strings` entries.  Service names, tag
+// names, and most tag values are repeated across spans, and so are written
+// once.
+//
+// A chunk is its origin (a string, empty if none) and its number of spans,
+// followed by the spans.  A span is its service, type, name, and resource
+// (strings); the high and low halves of its trace ID, its span ID, and its
+// parent ID; its start time in nanoseconds since the epoch and its duration
+// in nanoseconds (signed); whether it's an error (one byte); the number of
+// its string tags, followed by the name and value of each; and the number of
+// its numeric tags, followed by the name and value of each.  The span's marks
+// (see `SpanMark`) are recorded as numeric tags, as they are encoded.
+//
+// Chunks are written as they are received.  `read_trace_recording` ignores an
+// incomplete chunk at the end of the file, so that a recording that was cut
+// short, e.g. by a crash, is still usable.
+//
+// Chunks of dropped traces whose span sampling is deferred (see
+// `Collector::send_unsampled`) are recorded before span sampling, and so
+// include all of their spans.
+
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "collector.h"
+#include "expected.h"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+// The maximum number of entries in a recording's string table.
+constexpr std::size_t max_recorded_strings = 1 << 16;
+
+class RecordingCollector : public Collector {
+  std::shared_ptr<Collector> collector_;
+  std::string path_;
+  bool anonymize_;
+  std::mutex mutex_;
+  std::FILE* file_;
+  // `strings_` maps each entry of the string table, stored in
+  // `string_storage_`, to its index.
+  std::deque<std::string> string_storage_;
+  std::unordered_map<std::string_view, std::size_t> strings_;
+  std::string buffer_;
+
+  RecordingCollector(std::shared_ptr<Collector> collector, std::string path,
+                     bool anonymize, std::FILE* file);
+
+  // Append the specified `spans` of a chunk having the specified `origin` to
+  // the recording.
+  Expected<void> record(const std::vector<std::unique_ptr<SpanData>>& spans,
+                        std::string_view origin);
+  void pack_string(std::string_view value);
+
+ public:
+  // Return a collector that records to a new file at the specified `path`,
+  // replacing any file there, and then passes each chunk to the specified
+  // `collector`.  If the specified `anonymize` is true, then replace resource
+  // names and tag values as described above.  Return an error if the file
+  // can't be created.
+  static Expected<std::shared_ptr<RecordingCollector>> open(
+      std::shared_ptr<Collector> collector, const std::string& path,
+      bool anonymize = false);
+
+  RecordingCollector(const RecordingCollector&) = delete;
+  RecordingCollector& operator=(const RecordingCollector&) = delete;
+  ~RecordingCollector() override;
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+  Expected<void> send_with_origin(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::string_view origin) override;
+  Expected<void> send_unsampled(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::optional<std::string_view> origin,
+      const std::shared_ptr<SpanSampler>& span_sampler,
+      std::optional<int> sampling_mechanism) override;
+  Expected<void> flush(std::chrono::steady_clock::time_point deadline) override;
+
+  nlohmann::json config_json() const override;
+};
+
+// `RecordedTraceChunk` is a trace chunk read from a recording.
+struct RecordedTraceChunk {
+  std::vector<std::unique_ptr<SpanData>> spans;
+  std::string origin;
+};
+
+// Return the trace chunks recorded in the file at the specified `path`, or
+// return an error if the file can't be read or is not a recording.
+Expected<std::vector<RecordedTraceChunk>> read_trace_recording(
+    const std::string& path);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,428 @@
+#include "remote_config.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+
+#include "dict_writer.h"
+#include "id_generator.h"
+#include "json.hpp"
+#include "logger.h"
+#include "rate.h"
+#include "trace_id.h"
+#include "trace_sampler.h"
+#include "version.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr std::string_view product = "APM_TRACING";
+
+Error invalid_response(std::string_view detail) {
+  std::string message;
+  message += "Invalid remote configuration response from the Datadog Agent: ";
+  message += detail;
+  return Error{Error::REMOTE_CONFIGURATION_INVALID_RESPONSE,
+               std::move(message)};
+}
+
+// Return the bytes encoded by the specified base64 `input`, or return null
+// if `input` is not valid base64.
+std::optional<std::string> decode_base64(std::string_view input) {
+  static const auto values = []() {
+    std::array<signed char, 256> result;
+    result.fill(-1);
+    const std::string_view alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (std::size_t i = 0; i < alphabet.size(); ++i) {
+      result[static_cast<unsigned char>(alphabet[i])] = static_cast<char>(i);
+    }
+    return result;
+  }();
+
+  while (!input.empty() && input.back() == '=') {
+    input.remove_suffix(1);
+  }
+  std::string result;
+  result.reserve(input.size() * 3 / 4);
+  std::uint32_t bits = 0;
+  int bit_count = 0;
+  for (const char ch : input) {
+    const int value = values[static_cast<unsigned char>(ch)];
+    if (value < 0) {
+      return std::nullopt;
+    }
+    bits = (bits << 6) | std::uint32_t(value);
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      result += static_cast<char>((bits >> bit_count) & 0xFF);
+    }
+  }
+  return result;
+}
+
+// Return the configuration ID within the specified target file `path`, which
+// has the form "<source>/<org>/<product>/<id>/<name>", or return an empty
+// string if `path` has another form.
+std::string config_id(std::string_view path) {
+  for (int i = 0; i < 3; ++i) {
+    const auto slash = path.find('/');
+    if (slash == std::string_view::npos) {
+      return "";
+    }
+    path.remove_prefix(slash + 1);
+  }
+  return std::string(path.substr(0, path.find('/')));
+}
+
+// Return whether the specified `rule` matches every span.
+bool is_catch_all(const FinalizedTraceSamplerConfig::Rule& rule) {
+  return rule.service == "*" && rule.name == "*" && rule.resource == "*" &&
+         rule.tags.empty();
+}
+
+}  // namespace
+
+bool RemoteConfigClient::Overrides::operator==(const Overrides& other) const {
+  return sample_rate == other.sample_rate && rate_limit == other.rate_limit &&
+         tracing_enabled == other.tracing_enabled;
+}
+
+RemoteConfigClient::RemoteConfigClient(
+    const std::shared_ptr<Logger>& logger,
+    const std::shared_ptr<HTTPClient>& http_client,
+    const HTTPClient::URL& agent_url,
+    const std::shared_ptr<TraceSampler>& trace_sampler,
+    const FinalizedTraceSamplerConfig& base, std::string service,
+    std::string environment, std::string app_version)
+    : logger_(logger),
+      http_client_(http_client),
+      trace_sampler_(trace_sampler),
+      endpoint_(agent_url),
+      client_id_(TraceID(default_id_generator(), default_id_generator())
+                     .hex_padded()),
+      service_(std::move(service)),
+      environment_(std::move(environment)),
+      app_version_(std::move(app_version)),
+      base_(base),
+      targets_version_(0),
+      request_in_flight_(false),
+      tracing_enabled_(true) {
+  endpoint_.path += "/v0.7/config";
+}
+
+RemoteConfigClient::~RemoteConfigClient() {
+  if (cancel_poll_) {
+    cancel_poll_();
+  }
+}
+
+void RemoteConfigClient::start(EventScheduler& scheduler,
+                               std::chrono::steady_clock::duration interval) {
+  cancel_poll_ = scheduler.schedule_recurring_event(interval, [this]() {
+    // The event is cancelled before this object is destroyed.
+    poll();
+  });
+}
+
+void RemoteConfigClient::update_base(const FinalizedTraceSamplerConfig& base) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  base_ = base;
+  auto result = apply();
+  if (auto* error = result.if_error()) {
+    logger_->log_error(*error);
+  }
+}
+
+void RemoteConfigClient::poll() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (request_in_flight_) {
+      return;
+    }
+    request_in_flight_ = true;
+  }
+
+  const auto set_headers = [](DictWriter& headers) {
+    headers.set("Content-Type", "application/json");
+  };
+  // A response can arrive after this object is destroyed.
+  std::weak_ptr<RemoteConfigClient> weak_self = weak_from_this();
+  const auto done = [weak_self]() {
+    if (auto self = weak_self.lock()) {
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      self->request_in_flight_ = false;
+    }
+  };
+  const auto on_response = [weak_self, done](int status, const DictReader&,
+                                             std::string body) {
+    done();
+    auto self = weak_self.lock();
+    if (!self) {
+      return;
+    }
+    if (status == 404) {
+      // The Agent doesn't have remote configuration enabled.
+      return;
+    }
+    if (status < 200 || status >= 300) {
+      std::string message;
+      message += "Unexpected response status ";
+      message += std::to_string(status);
+      message += " from the Datadog Agent's remote configuration endpoint.";
+      self->logger_->log_error(message);
+      return;
+    }
+    auto result = self->handle_response(body);
+    if (auto* error = result.if_error()) {
+      self->logger_->log_error(*error);
+    }
+  };
+  const auto on_error = [weak_self, done](Error error) {
+    done();
+    if (auto self = weak_self.lock()) {
+      self->logger_->log_error(error.with_prefix(
+          "Error requesting remote configuration from the Datadog Agent: "));
+    }
+  };
+
+  auto result = http_client_->post(endpoint_, set_headers, request_body(),
+                                   on_response, on_error);
+  if (auto* error = result.if_error()) {
+    done();
+    logger_->log_error(*error);
+  }
+}
+
+std::string RemoteConfigClient::request_body() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto config_states = nlohmann::json::array();
+  auto cached_target_files = nlohmann::json::array();
+  for (const auto& [path, file] : files_) {
+    auto config_state = nlohmann::json::object({
+        {"id", file.id},
+        {"version", file.version},
+        {"product", product},
+        // 2 is "acknowledged," and 3 is "error."
+        {"apply_state", file.error.empty() ? 2 : 3},
+    });
+    if (!file.error.empty()) {
+      config_state["apply_error"] = file.error;
+    }
+    config_states.push_back(std::move(config_state));
+    cached_target_files.push_back(nlohmann::json::object({
+        {"path", path},
+        {"length", file.length},
+        {"hashes", nlohmann::json::array({nlohmann::json::object(
+                       {{"algorithm", "sha256"}, {"hash", file.sha256}})})},
+    }));
+  }
+
+  auto state = nlohmann::json::object({
+      {"root_version", 1},
+      {"targets_version", targets_version_},
+      {"config_states", std::move(config_states)},
+      {"has_error", false},
+  });
+  if (!backend_state_.empty()) {
+    state["backend_client_state"] = backend_state_;
+  }
+  // clang-format off
+  const auto client_tracer = nlohmann::json::object({
+      {"runtime_id", client_id_},
+      {"language", "cpp"},
+      {"tracer_version", tracer_version},
+      {"service", service_},
+      {"env", environment_},
+      {"app_version", app_version_},
+  });
+  // clang-format on
+  const auto client = nlohmann::json::object({
+      {"id", client_id_},
+      {"products", nlohmann::json::array({product})},
+      {"is_tracer", true},
+      {"client_tracer", client_tracer},
+      {"state", std::move(state)},
+  });
+  return nlohmann::json::object({
+                                    {"client", client},
+                                    {"cached_target_files",
+                                     std::move(cached_target_files)},
+                                })
+      .dump();
+}
+
+Expected<void> RemoteConfigClient::handle_response(std::string_view body) {
+  const auto response = nlohmann::json::parse(body, nullptr, false);
+  if (response.is_discarded() || !response.is_object()) {
+    return invalid_response("The response is not a JSON object.");
+  }
+  const auto targets_encoded = response.find("targets");
+  if (targets_encoded == response.end()) {
+    // Nothing has changed since the previous request.
+    return std::nullopt;
+  }
+  if (!targets_encoded->is_string()) {
+    return invalid_response("\"targets\" is not a string.");
+  }
+  const auto targets_json = decode_base64(targets_encoded->get<std::string>());
+  if (!targets_json) {
+    return invalid_response("\"targets\" is not base64.");
+  }
+  const auto targets = nlohmann::json::parse(*targets_json, nullptr, false);
+  if (targets.is_discarded() || !targets.is_object() ||
+      !targets.contains("signed") || !targets["signed"].is_object()) {
+    return invalid_response("\"targets\" lacks signed metadata.");
+  }
+  const auto& signed_targets = targets["signed"];
+  const auto target_metadata =
+      signed_targets.value("targets", nlohmann::json::object());
+
+  // Decode the delivered files, keyed by path.
+  std::map<std::string, std::string> delivered;
+  for (const auto& target_file :
+       response.value("target_files", nlohmann::json::array())) {
+    if (!target_file.is_object() || !target_file["path"].is_string() ||
+        !target_file["raw"].is_string()) {
+      return invalid_response("A target file lacks a path or content.");
+    }
+    auto raw = decode_base64(target_file["raw"].get<std::string>());
+    if (!raw) {
+      return invalid_response("A target file's content is not base64.");
+    }
+    delivered.emplace(target_file["path"].get<std::string>(), std::move(*raw));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // The configuration files in effect are those listed in "client_configs".
+  // A file that is not delivered must be one that the client already holds.
+  std::map<std::string, TargetFile> files;
+  for (const auto& path_json :
+       response.value("client_configs", nlohmann::json::array())) {
+    if (!path_json.is_string()) {
+      return invalid_response("\"client_configs\" contains a non-string.");
+    }
+    const auto path = path_json.get<std::string>();
+    if (path.find(std::string("/") + std::string(product) + "/") ==
+        std::string::npos) {
+      continue;
+    }
+    const auto metadata = target_metadata.find(path);
+    if (metadata == target_metadata.end() || !metadata->is_object()) {
+      return invalid_response("A configuration file lacks signed metadata.");
+    }
+    TargetFile file;
+    file.id = config_id(path);
+    file.length = metadata->value("length", std::uint64_t(0));
+    const auto hashes = metadata->value("hashes", nlohmann::json::object());
+    file.sha256 = hashes.value("sha256", "");
+    const auto custom = metadata->value("custom", nlohmann::json::object());
+    file.version = custom.value("v", std::uint64_t(0));
+
+    if (auto found = delivered.find(path); found != delivered.end()) {
+      file.raw = std::move(found->second);
+    } else if (auto held = files_.find(path);
+               held != files_.end() && held->second.sha256 == file.sha256) {
+      file.raw = std::move(held->second.raw);
+    } else {
+      return invalid_response("A configuration file was not delivered.");
+    }
+    files.emplace(path, std::move(file));
+  }
+
+  files_ = std::move(files);
+  targets_version_ = signed_targets.value("version", std::uint64_t(0));
+  const auto custom = signed_targets.value("custom", nlohmann::json::object());
+  backend_state_ = custom.value("opaque_backend_state", "");
+
+  auto overrides = collect_overrides();
+  if (overrides == overrides_) {
+    return std::nullopt;
+  }
+  auto previous = std::move(overrides_);
+  overrides_ = std::move(overrides);
+  auto result = apply();
+  if (result.if_error()) {
+    overrides_ = std::move(previous);
+    for (auto& entry : files_) {
+      entry.second.error = result.error().message;
+    }
+  }
+  return result;
+}
+
+RemoteConfigClient::Overrides RemoteConfigClient::collect_overrides() {
+  // `mutex_` must already be locked.
+  Overrides result;
+  for (auto& [path, file] : files_) {
+    (void)path;
+    file.error.clear();
+    const auto config = nlohmann::json::parse(file.raw, nullptr, false);
+    if (config.is_discarded() || !config.is_object()) {
+      file.error = "The configuration is not a JSON object.";
+      continue;
+    }
+    const auto target = config.value("service_target", nlohmann::json());
+    if (target.is_object() &&
+        (target.value("service", service_) != service_ ||
+         target.value("env", environment_) != environment_)) {
+      continue;
+    }
+    const auto lib_config = config.value("lib_config", nlohmann::json());
+    if (!lib_config.is_object()) {
+      continue;
+    }
+    // The first file to set a property wins.
+    const auto sample_rate = lib_config.find("tracing_sampling_rate");
+    if (!result.sample_rate && sample_rate != lib_config.end() &&
+        sample_rate->is_number()) {
+      result.sample_rate = sample_rate->get<double>();
+    }
+    const auto rate_limit = lib_config.find("tracing_rate_limit");
+    if (!result.rate_limit && rate_limit != lib_config.end() &&
+        rate_limit->is_number()) {
+      result.rate_limit = rate_limit->get<double>();
+    }
+    const auto enabled = lib_config.find("tracing_enabled");
+    if (!result.tracing_enabled && enabled != lib_config.end() &&
+        enabled->is_boolean()) {
+      result.tracing_enabled = enabled->get<bool>();
+    }
+  }
+  return result;
+}
+
+Expected<void> RemoteConfigClient::apply() {
+  // `mutex_` must already be locked.
+  FinalizedTraceSamplerConfig config = base_;
+  if (overrides_.sample_rate) {
+    auto rate = Rate::from(*overrides_.sample_rate);
+    if (auto* error = rate.if_error()) {
+      return error->with_prefix("Invalid remote tracing_sampling_rate: ");
+    }
+    config.rules.erase(
+        std::remove_if(config.rules.begin(), config.rules.end(), is_catch_all),
+        config.rules.end());
+    FinalizedTraceSamplerConfig::Rule catch_all;
+    catch_all.sample_rate = *rate;
+    config.rules.push_back(std::move(catch_all));
+  }
+  if (overrides_.rate_limit) {
+    if (!(*overrides_.rate_limit > 0)) {
+      return Error{Error::REMOTE_CONFIGURATION_INVALID_RESPONSE,
+                   "Invalid remote tracing_rate_limit: It must be greater "
+                   "than zero."};
+    }
+    config.max_per_second = *overrides_.rate_limit;
+  }
+  trace_sampler_->update(config);
+  tracing_enabled_.store(overrides_.tracing_enabled.value_or(true),
+                         std::memory_order_relaxed);
+  return std::nullopt;
+}
+
+}  // namespace tracing
+}  // namespace datadog
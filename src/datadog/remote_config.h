@@ -0,0 +1,154 @@
+#pragma once
+
+// This component provides a class, `RemoteConfigClient`, that polls the
+// Datadog Agent's remote configuration endpoint, "/v0.7/config", and applies
+// the tracing configuration that it receives to a running tracer.
+//
+// The client subscribes to the "APM_TRACING" product.  Of each configuration
+// file, it uses the following properties of the "lib_config" object:
+//
+// - "tracing_sampling_rate" is the global sample rate, which replaces any
+//   catch-all trace sampling rule (see `TraceSamplerConfig::sample_rate`).
+// - "tracing_rate_limit" is the maximum number of traces per second kept by
+//   the sampling rules (see `TraceSamplerConfig::max_per_second`).
+// - "tracing_enabled", if `false`, is a kill switch: the tracer creates and
+//   extracts only no-op spans (see `span.h`) until it's re-enabled.
+//
+// A configuration file that has a "service_target" applies only if its
+// "service" and "env" match the tracer's defaults.  A property that no
+// applicable configuration file sets, including a property of a
+// configuration file that is removed, reverts to the tracer's own setting.
+//
+// The requests are conditional: each one includes the version of the
+// configuration that the client last received, the Agent's opaque state, and
+// the path, size, and hash of each configuration file that the client holds.
+// While nothing changes, the Agent responds with an empty object, and so
+// polling costs a small request and response every poll interval, and does
+// nothing else.  Configuration files are delivered in full only when they
+// change.
+//
+// The signed metadata in the Agent's responses is trusted as is: the client
+// doesn't verify the TUF signatures, since the Agent does.
+//
+// Requests are sent using the `HTTPClient` of the `DatadogAgent`, from its
+// `EventScheduler`.  See `DatadogAgentConfig::remote_configuration_enabled`.
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "event_scheduler.h"
+#include "http_client.h"
+#include "trace_sampler_config.h"
+
+namespace datadog {
+namespace tracing {
+
+class Logger;
+class TraceSampler;
+
+class RemoteConfigClient
+    : public std::enable_shared_from_this<RemoteConfigClient> {
+ public:
+  // `Overrides` are the settings of the applicable configuration files.
+  struct Overrides {
+    std::optional<double> sample_rate;
+    std::optional<double> rate_limit;
+    std::optional<bool> tracing_enabled;
+
+    bool operator==(const Overrides&) const;
+  };
+
+ private:
+  // `TargetFile` is a configuration file held by the client, and the
+  // metadata that the client reports back to the Agent.
+  struct TargetFile {
+    std::string raw;
+    std::uint64_t length = 0;
+    std::string sha256;
+    std::uint64_t version = 0;
+    std::string id;
+    // `error` describes why the file could not be applied, if it couldn't.
+    std::string error;
+  };
+
+  std::shared_ptr<Logger> logger_;
+  std::shared_ptr<HTTPClient> http_client_;
+  std::shared_ptr<TraceSampler> trace_sampler_;
+  HTTPClient::URL endpoint_;
+  std::string client_id_;
+  std::string service_;
+  std::string environment_;
+  std::string app_version_;
+
+  // `mutex_` protects the members below it.
+  std::mutex mutex_;
+  FinalizedTraceSamplerConfig base_;
+  std::uint64_t targets_version_;
+  std::string backend_state_;
+  std::map<std::string, TargetFile> files_;
+  Overrides overrides_;
+  // `request_in_flight_` prevents polls from overlapping.
+  bool request_in_flight_;
+  EventScheduler::Cancel cancel_poll_;
+
+  std::atomic<bool> tracing_enabled_;
+
+  // Update `trace_sampler_` and `tracing_enabled_` to reflect `base_` and
+  // `overrides_`.  Return an error if the overrides are invalid, in which
+  // case they're not applied.  `mutex_` must be locked.
+  Expected<void> apply();
+  // Return the applicable settings of `files_`, noting in each file any
+  // error parsing it.  `mutex_` must be locked.
+  Overrides collect_overrides();
+
+ public:
+  // Create a client that applies remote configuration to the specified
+  // `trace_sampler`, whose configuration is the specified `base`, for a
+  // tracer having the specified `service`, `environment`, and `app_version`.
+  // Requests are sent using the specified `http_client` to the Datadog Agent
+  // at the specified `agent_url`.  Errors are logged to the specified
+  // `logger`.  The client doesn't poll until `start`.
+  RemoteConfigClient(const std::shared_ptr<Logger>& logger,
+                     const std::shared_ptr<HTTPClient>& http_client,
+                     const HTTPClient::URL& agent_url,
+                     const std::shared_ptr<TraceSampler>& trace_sampler,
+                     const FinalizedTraceSamplerConfig& base,
+                     std::string service, std::string environment,
+                     std::string app_version);
+  // Stop polling.  A response that arrives afterward is ignored.
+  ~RemoteConfigClient();
+
+  // Poll the Datadog Agent every specified `interval` using the specified
+  // `scheduler`.  The client must be owned by a `std::shared_ptr`, and
+  // `scheduler` must outlive the client, whose destructor cancels the poll.
+  void start(EventScheduler& scheduler,
+             std::chrono::steady_clock::duration interval);
+
+  // Return whether the remote configuration allows tracing.
+  bool tracing_enabled() const {
+    return tracing_enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Replace the configuration to which the remote overrides are applied, as
+  // when the tracer's sampling is updated (see `Tracer::update_sampling`), and
+  // apply them again.
+  void update_base(const FinalizedTraceSamplerConfig& base);
+
+  // Send a request to the Datadog Agent, unless one is already in flight.
+  void poll();
+
+  // Return the body of the next request.
+  std::string request_body();
+  // Update the client's state and the tracer's configuration from the
+  // specified response `body`.  Return an error if the response is invalid.
+  Expected<void> handle_response(std::string_view body);
+};
+
+}  // namespace tracing
+}  // namespace datadog
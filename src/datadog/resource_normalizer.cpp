@@ -0,0 +1,206 @@
+#include "resource_normalizer.h"
+
+#include <cctype>
+#include <iterator>
+#include <utility>
+
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+bool is_space(char ch) { return std::isspace(static_cast<unsigned char>(ch)); }
+
+bool is_digit(char ch) { return std::isdigit(static_cast<unsigned char>(ch)); }
+
+bool is_hex_digit(char ch) {
+  return std::isxdigit(static_cast<unsigned char>(ch));
+}
+
+bool is_identifier(char ch) {
+  return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_' ||
+         ch == '$';
+}
+
+// Append a "?" to the specified obfuscated SQL `result`, unless `result` ends
+// with a "?" followed by a comma, in which case remove the comma instead, so
+// that a list of literals becomes one "?".
+void append_placeholder(std::string& result) {
+  const auto end = result.find_last_not_of(' ');
+  if (end != std::string::npos && end != 0 && result[end] == ',') {
+    const auto previous = result.find_last_not_of(' ', end - 1);
+    if (previous != std::string::npos && result[previous] == '?') {
+      result.resize(previous + 1);
+      return;
+    }
+  }
+  result += '?';
+}
+
+// Return whether the specified URL path `segment` looks like an identifier,
+// rather than like part of a route.
+bool is_parameter(std::string_view segment) {
+  bool has_digit = false;
+  bool is_hex = true;
+  for (const char ch : segment) {
+    has_digit = has_digit || is_digit(ch);
+    is_hex = is_hex && (is_hex_digit(ch) || ch == '-');
+  }
+  return has_digit && (is_hex || segment.size() > 16);
+}
+
+}  // namespace
+
+std::string obfuscate_sql(std::string_view query) {
+  std::string result;
+  result.reserve(query.size());
+  bool pending_space = false;
+  std::size_t i = 0;
+  while (i < query.size()) {
+    const char ch = query[i];
+    const char next = i + 1 < query.size() ? query[i + 1] : '\0';
+    if (is_space(ch)) {
+      pending_space = !result.empty();
+      ++i;
+      continue;
+    }
+    if (ch == '-' && next == '-') {
+      i = query.find('\n', i);
+      i = i == std::string_view::npos ? query.size() : i;
+      pending_space = !result.empty();
+      continue;
+    }
+    if (ch == '/' && next == '*') {
+      i = query.find("*/", i + 2);
+      i = i == std::string_view::npos ? query.size() : i + 2;
+      pending_space = !result.empty();
+      continue;
+    }
+    if (pending_space) {
+      result += ' ';
+      pending_space = false;
+    }
+
+    if (ch == '\'') {
+      // A string literal, in which a quote is escaped either by another quote
+      // or by a backslash.
+      for (++i; i < query.size(); ++i) {
+        if (query[i] == '\\') {
+          ++i;
+        } else if (query[i] == '\'') {
+          if (i + 1 < query.size() && query[i + 1] == '\'') {
+            ++i;
+          } else {
+            ++i;
+            break;
+          }
+        }
+      }
+      append_placeholder(result);
+      continue;
+    }
+    if (ch == '"' || ch == '`') {
+      // A quoted identifier.
+      auto end = query.find(ch, i + 1);
+      end = end == std::string_view::npos ? query.size() : end + 1;
+      result.append(query.substr(i, end - i));
+      i = end;
+      continue;
+    }
+    if (is_digit(ch) && (result.empty() || !is_identifier(result.back()))) {
+      // A numeric literal, including hexadecimal and floating point literals.
+      while (i < query.size() && (is_identifier(query[i]) || query[i] == '.')) {
+        ++i;
+      }
+      append_placeholder(result);
+      continue;
+    }
+    result += ch;
+    ++i;
+  }
+  return result;
+}
+
+std::string template_url_path(std::string_view resource) {
+  const auto slash = resource.find('/');
+  if (slash == std::string_view::npos) {
+    return std::string(resource);
+  }
+  auto end = resource.find_first_of("?#", slash);
+  end = end == std::string_view::npos ? resource.size() : end;
+
+  std::string result(resource.substr(0, slash));
+  result.reserve(end);
+  std::size_t i = slash;
+  while (i < end) {
+    // `resource[i]` is a "/".
+    result += '/';
+    ++i;
+    auto next = resource.find('/', i);
+    next = next == std::string_view::npos || next > end ? end : next;
+    const auto segment = resource.substr(i, next - i);
+    if (is_parameter(segment)) {
+      result += '?';
+    } else {
+      result.append(segment);
+    }
+    i = next;
+  }
+  return result;
+}
+
+ResourceNormalizer::ResourceNormalizer(std::size_t max_entries)
+    : max_entries_(max_entries) {}
+
+void ResourceNormalizer::normalize(SpanData& span) {
+  std::string (*normalizer)(std::string_view);
+  char kind;
+  if (span.service_type == "sql" || span.service_type == "db") {
+    normalizer = &obfuscate_sql;
+    kind = 's';
+  } else if ((span.service_type == "web" || span.service_type == "http") &&
+             span.resource.find('/') != std::string::npos) {
+    normalizer = &template_url_path;
+    kind = 'u';
+  } else {
+    return;
+  }
+
+  if (max_entries_ == 0) {
+    span.resource = normalizer(span.resource);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  key_.assign(1, kind);
+  key_ += span.resource;
+  const auto found = index_.find(key_);
+  if (found != index_.end()) {
+    entries_.splice(entries_.begin(), entries_, found->second);
+    span.resource = found->second->normalized;
+    return;
+  }
+
+  std::string normalized = normalizer(span.resource);
+  if (entries_.size() < max_entries_) {
+    entries_.emplace_front(Entry{key_, normalized});
+  } else {
+    // Reuse the least recently used entry.
+    const auto oldest = std::prev(entries_.end());
+    index_.erase(oldest->key);
+    entries_.splice(entries_.begin(), entries_, oldest);
+    oldest->key = key_;
+    oldest->normalized = normalized;
+  }
+  index_.emplace(entries_.front().key, entries_.begin());
+  span.resource = std::move(normalized);
+}
+
+std::size_t ResourceNormalizer::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,82 @@
+#pragma once
+
+// This component provides a class, `ResourceNormalizer`, that replaces the
+// resource names of spans with normalized forms before the spans are sent to
+// the Datadog Agent, so that resource names that differ only in their
+// parameters are sent, and aggregated, as one.
+//
+// - The resource name of a span whose type is "sql" or "db" is obfuscated by
+//   `obfuscate_sql`: string and numeric literals become "?", comments are
+//   removed, and runs of whitespace become one space.
+// - The resource name of a span whose type is "web" or "http", if it contains
+//   a path, such as "GET /users/42", is templated by `template_url_path`:
+//   path segments that look like identifiers become "?", and the query string
+//   is removed.
+//
+// Other resource names are not modified.
+//
+// Since applications repeat the same few queries and routes, normalized
+// resource names are kept in a least recently used cache keyed by the span
+// type and the raw resource name.  A `ResourceNormalizer` may be used from
+// multiple threads, though `DatadogAgent` usually uses it only when flushing.
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+// Return the specified SQL `query` with its string and numeric literals
+// replaced by "?", its comments removed, and its whitespace collapsed.  A list
+// of literals, such as the values in "IN (1, 2, 3)", becomes a single "?".
+// Quoted identifiers, such as "table" or `table`, are kept.
+std::string obfuscate_sql(std::string_view query);
+
+// Return the specified `resource` with the path segments that contain digits
+// and are hexadecimal (like "42" or a UUID) or longer than 16 characters
+// replaced by "?", and with its query string and fragment removed.  The path
+// begins at the first "/", and anything before it, such as an HTTP method, is
+// kept.
+std::string template_url_path(std::string_view resource);
+
+class ResourceNormalizer {
+ public:
+  static constexpr std::size_t default_max_entries = 1024;
+
+ private:
+  struct Entry {
+    std::string key;
+    std::string normalized;
+  };
+
+  std::mutex mutex_;
+  std::size_t max_entries_;
+  // `entries_` are ordered from most to least recently used.  The keys of
+  // `index_` refer to the keys of `entries_`.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+  // `key_` is where lookup keys are built, so that its storage is reused.
+  std::string key_;
+
+ public:
+  // Create a `ResourceNormalizer` that caches at most the specified
+  // `max_entries` normalized resource names.  If `max_entries` is zero, then
+  // nothing is cached.
+  explicit ResourceNormalizer(std::size_t max_entries = default_max_entries);
+
+  // Replace the resource name of the specified `span` with its normalized
+  // form, if its type has one.
+  void normalize(SpanData& span);
+
+  // Return the number of cached resource names.
+  std::size_t size();
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,62 @@
+#include "rule_match_cache.h"
+
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+
+std::size_t RuleMatchCache::hash(const SpanData& span) {
+  const std::hash<std::string_view> hash;
+  std::size_t result = hash(span.service);
+  const auto combine = [&](std::size_t value) {
+    result ^= value + 0x9e3779b9 + (result << 6) + (result >> 2);
+  };
+  combine(hash(span.name));
+  combine(hash(span.resource));
+  return result;
+}
+
+RuleMatchCache::RuleMatchCache(std::size_t max_entries)
+    : max_entries_(max_entries) {}
+
+std::optional<std::size_t> RuleMatchCache::lookup(const SpanData& span) const {
+  const auto key = hash(span);
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  const auto found = entries_.find(key);
+  if (found == entries_.end()) {
+    return std::nullopt;
+  }
+  const Entry& entry = found->second;
+  if (entry.service != span.service || entry.name != span.name ||
+      entry.resource != span.resource) {
+    // hash collision
+    return std::nullopt;
+  }
+  return entry.rule;
+}
+
+void RuleMatchCache::insert(const SpanData& span, std::size_t rule) {
+  const auto key = hash(span);
+  Entry entry{span.service, span.name, span.resource, rule};
+  std::lock_guard<std::shared_mutex> lock(mutex_);
+  if (entries_.size() >= max_entries_ && !entries_.count(key)) {
+    entries_.clear();
+  }
+  // Among colliding keys, the most recent wins.
+  entries_.insert_or_assign(key, std::move(entry));
+}
+
+void RuleMatchCache::clear() {
+  std::lock_guard<std::shared_mutex> lock(mutex_);
+  entries_.clear();
+}
+
+std::size_t RuleMatchCache::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return entries_.size();
+}
+
+}  // namespace tracing
+}  // namespace datadog
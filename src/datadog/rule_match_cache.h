@@ -0,0 +1,107 @@
+#pragma once
+
+// This component provides a class, `RuleMatchCache`, that remembers which
+// sampling rule first matches spans having a given service, operation name,
+// and resource name.
+//
+// `TraceSampler` and `SpanSampler` match spans against their rules in order.
+// The distinct combinations of service, name, and resource that an
+// application produces are usually few and stable, so each sampler consults a
+// `RuleMatchCache` before scanning its rules.
+//
+// The cache considers only the service, name, and resource patterns of rules.
+// The cached rule is the first rule whose service, name, and resource patterns
+// match.  If that rule also has tag patterns, then its tag patterns are checked
+// against the span, and if they don't match, the remaining rules are scanned as
+// before.  So, rules having tag patterns don't benefit from the cache, but
+// don't prevent the rules before them from benefiting.
+//
+// A sampler's rules don't change after the sampler is constructed.  A sampler
+// whose rules change must `clear` its cache.
+//
+// The cache contains at most a fixed number of entries.  When it is full, it
+// is cleared before the next insertion.  Lookups take a shared lock, so
+// concurrent lookups don't block each other.
+
+#include <cstddef>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "span_data.h"
+#include "span_matcher.h"
+
+namespace datadog {
+namespace tracing {
+
+class RuleMatchCache {
+  struct Entry {
+    std::string service;
+    std::string name;
+    std::string resource;
+    std::size_t rule;
+  };
+
+  mutable std::shared_mutex mutex_;
+  // `entries_` is keyed by a hash of the service, name, and resource, so that
+  // a lookup needn't build a key.  Each entry is verified against the span.
+  std::unordered_map<std::size_t, Entry> entries_;
+  std::size_t max_entries_;
+
+  static std::size_t hash(const SpanData&);
+
+ public:
+  static constexpr std::size_t default_max_entries = 1024;
+
+  explicit RuleMatchCache(std::size_t max_entries = default_max_entries);
+
+  // Return the index of the first rule whose service, name, and resource
+  // patterns match the specified `span`, if it's cached.  An index equal to the
+  // number of rules means that no rule matches.
+  std::optional<std::size_t> lookup(const SpanData& span) const;
+  // Remember that the specified `rule` is the first whose service, name, and
+  // resource patterns match the specified `span`.
+  void insert(const SpanData& span, std::size_t rule);
+  // Remove all entries.
+  void clear();
+  // Return the number of entries.
+  std::size_t size() const;
+
+  // Return the index of the first of the specified `count` matchers that
+  // matches the specified `span`, where `matcher_at(i)` returns the `i`th
+  // matcher as a `const CompiledSpanMatcher&`.  Return `count` if none matches.
+  // Use and update the cache.
+  template <typename MatcherAt>
+  std::size_t find(const SpanData& span, std::size_t count,
+                   MatcherAt&& matcher_at);
+};
+
+template <typename MatcherAt>
+std::size_t RuleMatchCache::find(const SpanData& span, std::size_t count,
+                                 MatcherAt&& matcher_at) {
+  std::size_t i;
+  if (const auto cached = lookup(span)) {
+    i = *cached;
+  } else {
+    i = 0;
+    while (i < count && !matcher_at(i).match_names(span)) {
+      ++i;
+    }
+    insert(span, i);
+  }
+
+  if (i == count || matcher_at(i).match_tags(span)) {
+    return i;
+  }
+  for (++i; i < count; ++i) {
+    if (matcher_at(i).match(span)) {
+      return i;
+    }
+  }
+  return count;
+}
+
+}  // namespace tracing
+}  // namespace datadog
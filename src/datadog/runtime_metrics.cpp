@@ -0,0 +1,135 @@
+#include "runtime_metrics.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+#ifdef __linux__
+// These are the one-based positions of the fields of "/proc/self/stat" that
+// are sampled.  See proc(5).
+constexpr int stat_utime = 14;
+constexpr int stat_stime = 15;
+constexpr int stat_num_threads = 20;
+constexpr int stat_rss = 24;
+#endif
+
+}  // namespace
+
+RuntimeMetrics::RuntimeMetrics()
+    : file_(-1), pid_(0), ticks_per_second_(0), page_size_(0) {
+#ifdef __linux__
+  ticks_per_second_ = ::sysconf(_SC_CLK_TCK);
+  page_size_ = ::sysconf(_SC_PAGESIZE);
+#endif
+}
+
+RuntimeMetrics::~RuntimeMetrics() {
+#ifdef __linux__
+  if (file_ != -1) {
+    ::close(file_);
+  }
+#endif
+}
+
+std::optional<RuntimeMetricsSample> RuntimeMetrics::sample() {
+#ifdef __linux__
+  if (ticks_per_second_ <= 0 || page_size_ <= 0) {
+    return std::nullopt;
+  }
+  const long pid = ::getpid();
+  if (pid != pid_) {
+    if (file_ != -1) {
+      ::close(file_);
+    }
+    file_ = ::open("/proc/self/stat", O_RDONLY | O_CLOEXEC);
+    pid_ = pid;
+  }
+  if (file_ == -1) {
+    return std::nullopt;
+  }
+  const ssize_t size = ::pread(file_, buffer_, sizeof buffer_, 0);
+  if (size <= 0) {
+    return std::nullopt;
+  }
+
+  // The second field is the executable's name in parentheses, which might
+  // contain spaces and parentheses, and so the third field follows the last
+  // closing parenthesis.
+  const char* const end = buffer_ + size;
+  const char* position = end;
+  while (position != buffer_ && position[-1] != ')') {
+    --position;
+  }
+  if (position == buffer_) {
+    return std::nullopt;
+  }
+
+  RuntimeMetricsSample result;
+  std::uint64_t utime = 0;
+  std::uint64_t stime = 0;
+  std::uint64_t rss = 0;
+  int field = 2;
+  while (field < stat_rss) {
+    while (position != end && *position == ' ') {
+      ++position;
+    }
+    if (position == end) {
+      return std::nullopt;
+    }
+    ++field;
+    const char* const field_end = std::find(position, end, ' ');
+    std::uint64_t* destination = nullptr;
+    switch (field) {
+      case stat_utime:
+        destination = &utime;
+        break;
+      case stat_stime:
+        destination = &stime;
+        break;
+      case stat_num_threads:
+        destination = &result.threads;
+        break;
+      case stat_rss:
+        destination = &rss;
+        break;
+    }
+    if (destination) {
+      const auto parsed = std::from_chars(position, field_end, *destination);
+      if (parsed.ec != std::errc() || parsed.ptr != field_end) {
+        return std::nullopt;
+      }
+    }
+    position = field_end;
+  }
+
+  const auto microseconds = [&](std::uint64_t ticks) {
+    return ticks * 1000000 / std::uint64_t(ticks_per_second_);
+  };
+  result.cpu_user_microseconds = microseconds(utime);
+  result.cpu_system_microseconds = microseconds(stime);
+  result.resident_bytes = rss * std::uint64_t(page_size_);
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  const struct mallinfo2 heap = ::mallinfo2();
+  result.heap_allocated_bytes = heap.uordblks + heap.hblkhd;
+  result.heap_reserved_bytes = heap.arena + heap.hblkhd;
+#endif
+  return result;
+#else
+  return std::nullopt;
+#endif
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,60 @@
+#pragma once
+
+// This component provides a class, `RuntimeMetrics`, that samples the
+// resource usage of the current process: its CPU time, its resident memory,
+// its number of threads, and the usage of its heap.
+//
+// `DatadogAgent` sends the samples to DogStatsD periodically, so that they can
+// be correlated with the process's traces.  See
+// `DatadogAgentConfig::runtime_metrics_enabled`.
+//
+// The CPU time, resident memory, and number of threads are read from
+// "/proc/self/stat".  The file is opened once, and each sample rereads it
+// with one `pread` into a buffer within the `RuntimeMetrics`, and parses it in
+// place, so that sampling allocates no memory.  The file is reopened in the
+// child after `fork`, since the inherited descriptor refers to the parent.
+//
+// The heap usage is that reported by glibc's `mallinfo2`, and is omitted from
+// samples where that isn't available.  Where "/proc" isn't available, e.g.
+// other than on Linux, `sample` returns nothing.
+
+#include <cstdint>
+#include <optional>
+
+namespace datadog {
+namespace tracing {
+
+struct RuntimeMetricsSample {
+  // The process's CPU time, in microseconds, in user mode and in kernel mode.
+  std::uint64_t cpu_user_microseconds = 0;
+  std::uint64_t cpu_system_microseconds = 0;
+  std::uint64_t resident_bytes = 0;
+  std::uint64_t threads = 0;
+  // The bytes of heap memory allocated by the program, and the bytes that
+  // the allocator obtained from the system, including those allocated.
+  std::optional<std::uint64_t> heap_allocated_bytes;
+  std::optional<std::uint64_t> heap_reserved_bytes;
+};
+
+class RuntimeMetrics {
+  // `file_` is the descriptor of "/proc/self/stat" as opened by the process
+  // `pid_`, or -1 if it's not open.
+  int file_;
+  long pid_;
+  long ticks_per_second_;
+  long page_size_;
+  char buffer_[1024];
+
+ public:
+  RuntimeMetrics();
+  RuntimeMetrics(const RuntimeMetrics&) = delete;
+  RuntimeMetrics& operator=(const RuntimeMetrics&) = delete;
+  ~RuntimeMetrics();
+
+  // Return the current resource usage of the process, or return nothing if
+  // it can't be read.
+  std::optional<RuntimeMetricsSample> sample();
+};
+
+}  // namespace tracing
+}  // namespace datadog
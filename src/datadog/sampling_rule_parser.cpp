@@ -0,0 +1,195 @@
+#include "sampling_rule_parser.h"
+
+#include <string>
+#include <utility>
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `RuleHandler` receives the events of a JSON parser and builds rules from
+// them.  Any event that doesn't belong in an array of rules returns `false`,
+// which stops the parser.
+class RuleHandler : public nlohmann::json::json_sax_t {
+  enum class State {
+    START,     // expecting the array of rules
+    RULES,     // in the array, expecting a rule or the end
+    RULE,      // in a rule, expecting a property name or the end
+    PROPERTY,  // expecting the value of `property_`
+    TAGS,      // in "tags", expecting a tag name or the end
+    TAG,       // expecting the pattern of the tag named `tag_name_`
+    DONE       // after the array of rules
+  };
+
+  enum class Property {
+    SERVICE,
+    NAME,
+    RESOURCE,
+    TAGS,
+    SAMPLE_RATE,
+    MAX_PER_SECOND
+  };
+
+  bool allow_max_per_second_;
+  State state_ = State::START;
+  Property property_ = Property::SERVICE;
+  std::string tag_name_;
+  std::vector<ParsedSamplingRule> rules_;
+
+  bool number(double value) {
+    if (state_ != State::PROPERTY) {
+      return false;
+    }
+    ParsedSamplingRule& rule = rules_.back();
+    if (property_ == Property::SAMPLE_RATE) {
+      rule.sample_rate = value;
+    } else if (property_ == Property::MAX_PER_SECOND) {
+      rule.max_per_second = value;
+    } else {
+      return false;
+    }
+    state_ = State::RULE;
+    return true;
+  }
+
+ public:
+  explicit RuleHandler(bool allow_max_per_second)
+      : allow_max_per_second_(allow_max_per_second) {}
+
+  std::vector<ParsedSamplingRule>& rules() { return rules_; }
+
+  bool null() override { return false; }
+  bool boolean(bool) override { return false; }
+  bool binary(binary_t&) override { return false; }
+
+  bool number_integer(number_integer_t value) override {
+    return number(double(value));
+  }
+  bool number_unsigned(number_unsigned_t value) override {
+    return number(double(value));
+  }
+  bool number_float(number_float_t value, const string_t&) override {
+    return number(value);
+  }
+
+  bool string(string_t& value) override {
+    if (state_ == State::TAG) {
+      // As in a JSON document, a repeated name replaces the earlier value.
+      rules_.back().matcher.tags[std::move(tag_name_)] = std::move(value);
+      tag_name_.clear();
+      state_ = State::TAGS;
+      return true;
+    }
+    if (state_ != State::PROPERTY) {
+      return false;
+    }
+    SpanMatcher& matcher = rules_.back().matcher;
+    switch (property_) {
+      case Property::SERVICE:
+        matcher.service = std::move(value);
+        break;
+      case Property::NAME:
+        matcher.name = std::move(value);
+        break;
+      case Property::RESOURCE:
+        matcher.resource = std::move(value);
+        break;
+      default:
+        return false;
+    }
+    state_ = State::RULE;
+    return true;
+  }
+
+  bool start_object(std::size_t) override {
+    if (state_ == State::RULES) {
+      rules_.emplace_back();
+      state_ = State::RULE;
+      return true;
+    }
+    if (state_ == State::PROPERTY && property_ == Property::TAGS) {
+      // As in a JSON document, a repeated "tags" replaces the earlier value.
+      rules_.back().matcher.tags.clear();
+      state_ = State::TAGS;
+      return true;
+    }
+    return false;
+  }
+
+  bool key(string_t& name) override {
+    if (state_ == State::TAGS) {
+      tag_name_ = std::move(name);
+      state_ = State::TAG;
+      return true;
+    }
+    if (state_ != State::RULE) {
+      return false;
+    }
+    if (name == "service") {
+      property_ = Property::SERVICE;
+    } else if (name == "name") {
+      property_ = Property::NAME;
+    } else if (name == "resource") {
+      property_ = Property::RESOURCE;
+    } else if (name == "tags") {
+      property_ = Property::TAGS;
+    } else if (name == "sample_rate") {
+      property_ = Property::SAMPLE_RATE;
+    } else if (name == "max_per_second" && allow_max_per_second_) {
+      property_ = Property::MAX_PER_SECOND;
+    } else {
+      return false;
+    }
+    state_ = State::PROPERTY;
+    return true;
+  }
+
+  bool end_object() override {
+    if (state_ == State::TAGS) {
+      state_ = State::RULE;
+      return true;
+    }
+    if (state_ == State::RULE) {
+      state_ = State::RULES;
+      return true;
+    }
+    return false;
+  }
+
+  bool start_array(std::size_t) override {
+    if (state_ != State::START) {
+      return false;
+    }
+    state_ = State::RULES;
+    return true;
+  }
+
+  bool end_array() override {
+    if (state_ != State::RULES) {
+      return false;
+    }
+    state_ = State::DONE;
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string&,
+                   const nlohmann::json::exception&) override {
+    return false;
+  }
+};
+
+}  // namespace
+
+std::optional<std::vector<ParsedSamplingRule>> parse_sampling_rules(
+    std::string_view text, bool allow_max_per_second) {
+  RuleHandler handler{allow_max_per_second};
+  if (!nlohmann::json::sax_parse(text.begin(), text.end(), &handler)) {
+    return std::nullopt;
+  }
+  return std::move(handler.rules());
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,44 @@
+#pragma once
+
+// This component provides a function, `parse_sampling_rules`, that parses a
+// JSON array of trace or span sampling rules in one pass, without building a
+// JSON document.
+//
+// Sampling rules are configured as JSON, e.g. in `DD_TRACE_SAMPLING_RULES`,
+// `DD_SPAN_SAMPLING_RULES`, or the file named by
+// `DD_SPAN_SAMPLING_RULES_FILE`.  Generated configurations can contain
+// hundreds of rules.  `parse_sampling_rules` consumes the parser's events
+// directly into `SpanMatcher`s, validating each property as it goes.
+//
+// `parse_sampling_rules` does not describe what is wrong with invalid rules.
+// It returns `std::nullopt` instead, and then the caller parses the rules
+// again, as a JSON document, to produce a detailed error.  Invalid rules are
+// rare, and so the cost of describing them is paid only when they occur.
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "span_matcher.h"
+
+namespace datadog {
+namespace tracing {
+
+struct ParsedSamplingRule {
+  SpanMatcher matcher;
+  std::optional<double> sample_rate;
+  std::optional<double> max_per_second;
+};
+
+// Return the rules in the specified JSON `text`, which must be an array of
+// objects whose properties are any of "service", "name", "resource", "tags",
+// and "sample_rate", and "max_per_second" if the specified
+// `allow_max_per_second` is true.  Return `std::nullopt` if `text` is not
+// such an array, or if any property has the wrong type.  This function
+// accepts exactly the rules that `SpanMatcher::from_json` and the finalization
+// of `TraceSamplerConfig` or `SpanSamplerConfig` accept.
+std::optional<std::vector<ParsedSamplingRule>> parse_sampling_rules(
+    std::string_view text, bool allow_max_per_second);
+
+}  // namespace tracing
+}  // namespace datadog
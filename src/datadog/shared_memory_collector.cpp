@@ -0,0 +1,64 @@
+#include "shared_memory_collector.h"
+
+#include <cassert>
+#include <string>
+#include <utility>
+
+#include "error_stack.h"
+#include "json.hpp"
+#include "msgpack.h"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+
+SharedMemoryCollector::SharedMemoryCollector(
+    const std::shared_ptr<SharedMemoryRing>& ring,
+    const SpanDefaults& defaults)
+    : ring_(ring), encoded_defaults_(defaults) {
+  assert(ring_);
+}
+
+Expected<void> SharedMemoryCollector::send(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& response_handler) {
+  return send_with_origin(std::move(spans), response_handler, {});
+}
+
+Expected<void> SharedMemoryCollector::send_with_origin(
+    std::vector<std::unique_ptr<SpanData>>&& spans,
+    const std::shared_ptr<TraceSampler>& /*response_handler*/,
+    std::string_view origin) {
+  // The spans are destroyed when `chunk_spans` goes out of scope, after they
+  // are encoded.
+  const auto chunk_spans = std::move(spans);
+  symbolize_error_stacks(chunk_spans);
+  std::string encoded;
+  auto result = msgpack::pack_array(
+      encoded, chunk_spans, [&](auto& destination, const auto& span_ptr) {
+        assert(span_ptr);
+        return msgpack_encode(destination, *span_ptr, encoded_defaults_,
+                              origin);
+      });
+  if (!result) {
+    return result;
+  }
+  // A trace chunk that doesn't fit is counted as dropped by the ring.
+  ring_->write(encoded, chunk_spans.size());
+  return std::nullopt;
+}
+
+nlohmann::json SharedMemoryCollector::config_json() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::SharedMemoryCollector"},
+    {"config", nlohmann::json::object({
+      {"max_processes", ring_->max_processes()},
+      {"buffer_bytes", ring_->buffer_bytes()},
+    })},
+  });
+  // clang-format on
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,53 @@
+#pragma once
+
+// This component provides a class, `SharedMemoryCollector`, that implements
+// the `Collector` interface by encoding each trace chunk in the Datadog
+// Agent's "v0.4" format and writing it to a `SharedMemoryRing` (see
+// `shared_memory_ring.h`).
+//
+// A multi-process server gives each of its worker processes' tracers a
+// `SharedMemoryCollector` as their `TracerConfig::collector`, and gives the
+// ring to one `DatadogAgent`, via `DatadogAgentConfig::shared_memory_ring`,
+// which sends the workers' trace chunks in combined payloads.  The workers
+// then have no HTTP client or flush thread of their own.
+//
+// Since the Datadog Agent's responses go to the draining process, the
+// workers' trace samplers don't receive the Agent's sampling rates, and use
+// their configured and default rates instead.
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "collector.h"
+#include "encoded_span_defaults.h"
+#include "shared_memory_ring.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanDefaults;
+
+class SharedMemoryCollector : public Collector {
+  std::shared_ptr<SharedMemoryRing> ring_;
+  EncodedSpanDefaults encoded_defaults_;
+
+ public:
+  // Create a collector that writes to the specified `ring`, pre-encoding the
+  // specified `defaults`, which are those of the tracer.
+  SharedMemoryCollector(const std::shared_ptr<SharedMemoryRing>& ring,
+                        const SpanDefaults& defaults);
+
+  Expected<void> send(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler) override;
+  Expected<void> send_with_origin(
+      std::vector<std::unique_ptr<SpanData>>&& spans,
+      const std::shared_ptr<TraceSampler>& response_handler,
+      std::string_view origin) override;
+
+  nlohmann::json config_json() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
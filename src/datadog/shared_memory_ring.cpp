@@ -0,0 +1,235 @@
+#include "shared_memory_ring.h"
+
+#ifndef _MSC_VER
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "error.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Each trace chunk in a buffer is preceded by a `RecordHeader`, and padded so
+// that the next header is aligned.  A header whose `size` is `wrap` marks the
+// end of the buffer's bytes: the next record is at the start of the buffer.
+struct RecordHeader {
+  std::uint32_t size;
+  std::uint32_t span_count;
+};
+
+constexpr std::uint32_t wrap = std::numeric_limits<std::uint32_t>::max();
+
+std::size_t record_size(std::size_t chunk_size) {
+  const std::size_t align = sizeof(RecordHeader);
+  return sizeof(RecordHeader) + (chunk_size + align - 1) / align * align;
+}
+
+#ifndef _MSC_VER
+// Return whether the process having the specified `pid` has exited.
+bool has_exited(std::int64_t pid) {
+  return ::kill(pid_t(pid), 0) != 0 && errno == ESRCH;
+}
+#endif
+
+}  // namespace
+
+SharedMemoryRing::SharedMemoryRing(char* memory, std::size_t mapped_bytes,
+                                   std::size_t max_processes,
+                                   std::size_t buffer_bytes)
+    : memory_(memory),
+      mapped_bytes_(mapped_bytes),
+      max_processes_(max_processes),
+      buffer_bytes_(buffer_bytes),
+      attached_(nullptr) {
+  ForkHandlers handlers;
+  handlers.before_fork = [this]() { mutex_.lock(); };
+  handlers.after_fork_in_parent = [this]() { mutex_.unlock(); };
+  handlers.after_fork_in_child = [this]() {
+    // The child claims a buffer of its own.
+    attached_ = nullptr;
+    mutex_.unlock();
+  };
+  unregister_fork_handlers_ = register_fork_handlers(std::move(handlers));
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  unregister_fork_handlers_();
+#ifndef _MSC_VER
+  ::munmap(memory_, mapped_bytes_);
+#endif
+}
+
+SharedMemoryRing::Buffer& SharedMemoryRing::buffer(std::size_t index) const {
+  return *reinterpret_cast<Buffer*>(memory_ +
+                                    index * (sizeof(Buffer) + buffer_bytes_));
+}
+
+char* SharedMemoryRing::bytes(Buffer& buffer) const {
+  return reinterpret_cast<char*>(&buffer) + sizeof(Buffer);
+}
+
+SharedMemoryRing::Buffer* SharedMemoryRing::attach() {
+#ifdef _MSC_VER
+  return nullptr;
+#else
+  const std::int64_t pid = ::getpid();
+  for (std::size_t i = 0; i < max_processes_; ++i) {
+    std::int64_t unclaimed = 0;
+    if (buffer(i).owner.compare_exchange_strong(unclaimed, pid,
+                                                std::memory_order_acq_rel)) {
+      return &buffer(i);
+    }
+  }
+  return nullptr;
+#endif
+}
+
+bool SharedMemoryRing::write(std::string_view chunk, std::size_t span_count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!attached_) {
+    attached_ = attach();
+    if (!attached_) {
+      return false;
+    }
+  }
+  Buffer& buffer = *attached_;
+  // Only this process writes to `buffer`, and so `write` is what it last
+  // stored.
+  const std::uint64_t write = buffer.write.load(std::memory_order_relaxed);
+  const std::uint64_t read = buffer.read.load(std::memory_order_acquire);
+  std::size_t offset = write % buffer_bytes_;
+  const std::size_t size = record_size(chunk.size());
+  const std::size_t padding =
+      offset + size > buffer_bytes_ ? buffer_bytes_ - offset : 0;
+  if (chunk.size() >= wrap ||
+      padding + size > buffer_bytes_ - (write - read)) {
+    buffer.dropped_traces.fetch_add(1, std::memory_order_relaxed);
+    buffer.dropped_spans.fetch_add(span_count, std::memory_order_relaxed);
+    return false;
+  }
+
+  char* const data = bytes(buffer);
+  if (padding != 0) {
+    const RecordHeader end{wrap, 0};
+    std::memcpy(data + offset, &end, sizeof end);
+    offset = 0;
+  }
+  const RecordHeader header{std::uint32_t(chunk.size()),
+                            std::uint32_t(span_count)};
+  std::memcpy(data + offset, &header, sizeof header);
+  std::memcpy(data + offset + sizeof header, chunk.data(), chunk.size());
+  // Publish the record only once it's complete.
+  buffer.write.store(write + padding + size, std::memory_order_release);
+  return true;
+}
+
+DroppedTraceChunks SharedMemoryRing::drain(
+    const std::function<void(std::string_view chunk, std::size_t span_count)>&
+        on_chunk) {
+  DroppedTraceChunks dropped;
+#ifdef _MSC_VER
+  (void)on_chunk;
+#else
+  const std::int64_t self = ::getpid();
+  for (std::size_t i = 0; i < max_processes_; ++i) {
+    Buffer& buffer = this->buffer(i);
+    const std::int64_t owner = buffer.owner.load(std::memory_order_acquire);
+    if (owner == 0) {
+      continue;
+    }
+    // If the owner has exited, then nothing more will be written, and so the
+    // buffer can be reclaimed once it's read.
+    const bool exited = owner != self && has_exited(owner);
+
+    const char* const data = bytes(buffer);
+    std::uint64_t read = buffer.read.load(std::memory_order_relaxed);
+    const std::uint64_t write = buffer.write.load(std::memory_order_acquire);
+    while (read < write) {
+      const std::size_t offset = read % buffer_bytes_;
+      RecordHeader header;
+      std::memcpy(&header, data + offset, sizeof header);
+      if (header.size == wrap) {
+        read += buffer_bytes_ - offset;
+        continue;
+      }
+      on_chunk(std::string_view(data + offset + sizeof header, header.size),
+               header.span_count);
+      read += record_size(header.size);
+    }
+    buffer.read.store(read, std::memory_order_release);
+    dropped.traces +=
+        buffer.dropped_traces.exchange(0, std::memory_order_relaxed);
+    dropped.spans +=
+        buffer.dropped_spans.exchange(0, std::memory_order_relaxed);
+
+    if (exited) {
+      buffer.owner.store(0, std::memory_order_release);
+    }
+  }
+#endif
+  return dropped;
+}
+
+std::size_t SharedMemoryRing::max_processes() const { return max_processes_; }
+
+std::size_t SharedMemoryRing::buffer_bytes() const { return buffer_bytes_; }
+
+Expected<std::shared_ptr<SharedMemoryRing>> make_shared_memory_ring(
+    std::size_t max_processes, std::size_t buffer_bytes) {
+#ifdef _MSC_VER
+  (void)max_processes;
+  (void)buffer_bytes;
+  return Error{Error::SHARED_MEMORY_RING_ERROR,
+               "Shared memory rings are not supported on Windows."};
+#else
+  if (max_processes == 0 || buffer_bytes < 4096) {
+    return Error{Error::SHARED_MEMORY_RING_ERROR,
+                 "A shared memory ring must have at least one process and "
+                 "at least 4096 bytes per process."};
+  }
+  // Each buffer's size is a multiple of the cache line, so that the next
+  // buffer is aligned.
+  buffer_bytes = (buffer_bytes + 63) / 64 * 64;
+  using Buffer = SharedMemoryRing::Buffer;
+  const std::size_t mapped_bytes =
+      max_processes * (sizeof(Buffer) + buffer_bytes);
+  void* memory = ::mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    std::string message;
+    message += "Unable to map a shared memory ring of ";
+    message += std::to_string(mapped_bytes);
+    message += " bytes: ";
+    message += std::strerror(errno);
+    return Error{Error::SHARED_MEMORY_RING_ERROR, std::move(message)};
+  }
+
+  static_assert(std::atomic<std::uint64_t>::is_always_lock_free &&
+                    std::atomic<std::int64_t>::is_always_lock_free,
+                "Shared memory requires address-free atomics.");
+  std::shared_ptr<SharedMemoryRing> ring(new SharedMemoryRing(
+      static_cast<char*>(memory), mapped_bytes, max_processes, buffer_bytes));
+  for (std::size_t i = 0; i < max_processes; ++i) {
+    Buffer* buffer = new (&ring->buffer(i)) Buffer;
+    buffer->write.store(0);
+    buffer->read.store(0);
+    buffer->dropped_traces.store(0);
+    buffer->dropped_spans.store(0);
+    buffer->owner.store(0);
+  }
+  return ring;
+#endif
+}
+
+}  // namespace tracing
+}  // namespace datadog
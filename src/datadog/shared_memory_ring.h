@@ -0,0 +1,108 @@
+#pragma once
+
+// This component provides a class, `SharedMemoryRing`, through which the
+// worker processes of a multi-process server, such as nginx or php-fpm, hand
+// encoded trace chunks to a single process that sends them to the Datadog
+// Agent.
+//
+// The ring is created with `make_shared_memory_ring` by the server's master
+// process, before it forks its workers, in memory that's shared with every
+// process forked afterward.  Each worker writes into a ring buffer of its own,
+// which it claims, lock-free, the first time that it writes.  The process
+// that sends the trace chunks, usually the master, calls `drain`
+// periodically, which reads every worker's buffer.  Since each buffer has one
+// writer and one reader, neither blocks the other, and a worker that dies,
+// even in the middle of a write, can't obstruct the others.  The buffers of
+// workers that have exited are reclaimed by `drain` for their successors.
+//
+// Within a process, the threads that write to the process's buffer are
+// serialized by a mutex.  A trace chunk that doesn't fit in the buffer is
+// dropped, and the dropped trace chunks are counted in the buffer, for the
+// draining process to report.
+//
+// Workers write to the ring with `SharedMemoryCollector` (see
+// `shared_memory_collector.h`), and a `DatadogAgent` drains it when it's
+// configured with `DatadogAgentConfig::shared_memory_ring`.  The ring is not
+// supported on Windows.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+#include "expected.h"
+#include "fork_handlers.h"
+#include "trace_chunk_buffer.h"
+
+namespace datadog {
+namespace tracing {
+
+class SharedMemoryRing {
+  // `Buffer` is the shared state of one process's ring buffer.  It's followed
+  // in memory by the buffer's bytes.  `write` and `read` are the total number
+  // of bytes ever written to and read from the buffer.  `owner` is the process
+  // ID of the process that writes to the buffer, or zero if the buffer is
+  // unclaimed.
+  struct Buffer {
+    alignas(64) std::atomic<std::uint64_t> write;
+    alignas(64) std::atomic<std::uint64_t> read;
+    std::atomic<std::uint64_t> dropped_traces;
+    std::atomic<std::uint64_t> dropped_spans;
+    alignas(64) std::atomic<std::int64_t> owner;
+  };
+
+  char* memory_;
+  std::size_t mapped_bytes_;
+  std::size_t max_processes_;
+  std::size_t buffer_bytes_;
+  // `mutex_` serializes writes by this process, and protects `attached_`,
+  // which is this process's buffer, or null if it hasn't claimed one.
+  std::mutex mutex_;
+  Buffer* attached_;
+  UnregisterForkHandlers unregister_fork_handlers_;
+
+  SharedMemoryRing(char* memory, std::size_t mapped_bytes,
+                   std::size_t max_processes, std::size_t buffer_bytes);
+
+  friend Expected<std::shared_ptr<SharedMemoryRing>> make_shared_memory_ring(
+      std::size_t max_processes, std::size_t buffer_bytes);
+
+  Buffer& buffer(std::size_t index) const;
+  char* bytes(Buffer& buffer) const;
+  // Claim an unclaimed buffer for this process, and return it, or return null
+  // if every buffer is claimed.  `mutex_` must be locked.
+  Buffer* attach();
+
+ public:
+  SharedMemoryRing(const SharedMemoryRing&) = delete;
+  SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+  ~SharedMemoryRing();
+
+  // Append the specified encoded trace `chunk`, which has the specified
+  // `span_count`, to this process's buffer.  Return whether it fit.  If it
+  // didn't, then count it as dropped.
+  bool write(std::string_view chunk, std::size_t span_count);
+
+  // Invoke the specified `on_chunk` with each trace chunk written since the
+  // previous `drain`, and with its span count, and return the trace chunks
+  // dropped meanwhile.  `drain` must be called by only one process, and not
+  // concurrently with itself.
+  DroppedTraceChunks drain(
+      const std::function<void(std::string_view chunk, std::size_t span_count)>&
+          on_chunk);
+
+  std::size_t max_processes() const;
+  std::size_t buffer_bytes() const;
+};
+
+// Return a `SharedMemoryRing` that has a buffer of the specified
+// `buffer_bytes` for each of at most the specified `max_processes`, or return
+// an error if the shared memory can't be mapped or the sizes are invalid.
+Expected<std::shared_ptr<SharedMemoryRing>> make_shared_memory_ring(
+    std::size_t max_processes, std::size_t buffer_bytes);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -4,65 +4,186 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
 
 #include "dict_writer.h"
+#include "error_stack.h"
 #include "span_config.h"
 #include "span_data.h"
+#include "span_limits.h"
+#include "span_prototype.h"
 #include "tags.h"
 #include "trace_segment.h"
 
 namespace datadog {
 namespace tracing {
+namespace {
 
-Span::Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment,
-           const IDGenerator& generate_span_id, const Clock& clock)
-    : trace_segment_(trace_segment),
-      data_(data),
-      generate_span_id_(generate_span_id),
-      clock_(clock) {
+// Return the `SpanData` shared by all no-op spans.  It's never modified.
+const SpanData& noop_span_data() {
+  static const SpanData* const data = new SpanData;
+  return *data;
+}
+
+}  // namespace
+
+Span::Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment)
+    : trace_segment_(trace_segment), data_(data) {
   assert(trace_segment_);
   assert(data_);
-  assert(generate_span_id_);
-  assert(clock_);
+}
+
+Span Span::noop(TraceSegment& segment) {
+  // The aliasing constructor, given an empty owner, makes a `shared_ptr`
+  // without a control block, so copying and destroying it is free.
+  const std::shared_ptr<TraceSegment> unowned(std::shared_ptr<void>(),
+                                              &segment);
+  return Span(const_cast<SpanData*>(&noop_span_data()), unowned);
+}
+
+bool Span::is_noop() const {
+  return data_ == &noop_span_data() || trace_segment_->is_overflow_span(data_);
+}
+
+Span Span::overflow_child() const {
+  return Span(trace_segment_->overflow_span(*data_), trace_segment_);
 }
 
 Span::~Span() {
-  if (!trace_segment_) {
-    // We were moved from.
+  if (!trace_segment_ || is_noop()) {
+    // We were moved from, or there's nothing to finish.
     return;
   }
 
   if (end_time_) {
     data_->duration = *end_time_ - data_->start.tick;
   } else {
-    const auto now = clock_();
+    const auto now = trace_segment_->clock()();
     data_->duration = now - data_->start;
   }
 
-  trace_segment_->span_finished();
+  trace_segment_->span_finished(*data_);
 }
 
 Span Span::create_child(const SpanConfig& config) const {
-  auto span_data = std::make_unique<SpanData>();
-  span_data->apply_config(trace_segment_->defaults(), config, clock_);
+  return create_child_from(config);
+}
+
+Span Span::create_child(const SpanConfigView& config) const {
+  return create_child_from(config);
+}
+
+template <typename Config>
+Span Span::create_child_from(const Config& config) const {
+  if (data_ == &noop_span_data()) {
+    return noop(*trace_segment_);
+  }
+  if (trace_segment_->admit_spans(1) == 0) {
+    return overflow_child();
+  }
+  auto span_data = trace_segment_->allocate_span_data();
+  span_data->apply_config(trace_segment_->prototype(), config,
+                          trace_segment_->clock(),
+                          trace_segment_->lightweight());
   span_data->trace_id = data_->trace_id;
   span_data->parent_id = data_->span_id;
-  span_data->span_id = generate_span_id_();
+  span_data->span_id = trace_segment_->generator()();
 
   const auto span_data_ptr = span_data.get();
   trace_segment_->register_span(std::move(span_data));
-  return Span(span_data_ptr, trace_segment_, generate_span_id_, clock_);
+  return Span(span_data_ptr, trace_segment_);
+}
+
+Span Span::create_child() const {
+  if (is_noop()) {
+    // Skip constructing a `SpanConfig`.
+    return create_child_from(SpanConfigView{});
+  }
+  return create_child(SpanConfig{});
+}
+
+std::vector<Span> Span::create_children(std::size_t count,
+                                        const SpanConfig& config) const {
+  return create_children_from(count, config);
+}
+
+std::vector<Span> Span::create_children(std::size_t count,
+                                        const SpanConfigView& config) const {
+  return create_children_from(count, config);
 }
 
-Span Span::create_child() const { return create_child(SpanConfig{}); }
+std::vector<Span> Span::create_children(std::size_t count) const {
+  if (is_noop()) {
+    // Skip constructing a `SpanConfig`.
+    return create_children_from(count, SpanConfigView{});
+  }
+  return create_children_from(count, SpanConfig{});
+}
+
+template <typename Config>
+std::vector<Span> Span::create_children_from(std::size_t count,
+                                             const Config& config) const {
+  std::vector<Span> children;
+  children.reserve(count);
+  if (data_ == &noop_span_data()) {
+    for (std::size_t i = 0; i < count; ++i) {
+      children.push_back(noop(*trace_segment_));
+    }
+    return children;
+  }
+  const std::size_t admitted = trace_segment_->admit_spans(count);
+  if (admitted != 0) {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    trace_segment_->allocate_span_data(admitted, spans);
+    // Configure the first child, and then copy it into the others.
+    SpanData& first = *spans.front();
+    first.apply_config(trace_segment_->prototype(), config,
+                       trace_segment_->clock(), trace_segment_->lightweight());
+    first.trace_id = data_->trace_id;
+    first.parent_id = data_->span_id;
+    const IDGenerator& generator = trace_segment_->generator();
+    for (auto& span_data : spans) {
+      if (span_data.get() != &first) {
+        *span_data = first;
+      }
+      span_data->span_id = generator();
+      children.push_back(Span(span_data.get(), trace_segment_));
+    }
+    trace_segment_->register_spans(spans);
+  }
+  // Children beyond the segment's maximum number of spans are overflow spans.
+  while (children.size() != count) {
+    children.push_back(overflow_child());
+  }
+  return children;
+}
 
 void Span::inject(DictWriter& writer) const {
+  // Overflow spans propagate the trace.
+  if (data_ == &noop_span_data()) {
+    return;
+  }
   trace_segment_->inject(writer, *data_);
 }
 
+Expected<void> Span::read_sampling_delegation_response(
+    const DictReader& reader) {
+  if (data_ == &noop_span_data()) {
+    return std::nullopt;
+  }
+  return trace_segment_->read_sampling_delegation_response(reader);
+}
+
+void Span::write_sampling_delegation_response(DictWriter& writer) {
+  if (data_ == &noop_span_data()) {
+    return;
+  }
+  trace_segment_->write_sampling_delegation_response(writer);
+}
+
 std::uint64_t Span::id() const { return data_->span_id; }
 
-std::uint64_t Span::trace_id() const { return data_->trace_id; }
+TraceID Span::trace_id() const { return data_->trace_id; }
 
 std::optional<std::uint64_t> Span::parent_id() const {
   if (data_->parent_id == 0) {
@@ -80,66 +201,177 @@ std::optional<std::string_view> Span::lookup_tag(std::string_view name) const {
     return std::nullopt;
   }
 
-  const auto found = data_->tags.find(std::string(name));
+  const auto found = data_->tags.find(name);
   if (found == data_->tags.end()) {
     return std::nullopt;
   }
   return found->second;
 }
 
+bool Span::accepts_tag(std::string_view name) const {
+  if (is_noop() || tags::is_internal(name)) {
+    return false;
+  }
+  if (trace_segment_->lightweight() && name != tags::environment &&
+      name != tags::version && name != tags::http_status_code) {
+    return false;
+  }
+  return trace_segment_->prototype().projection.accepts(name);
+}
+
 void Span::set_tag(std::string_view name, std::string_view value) {
-  if (!tags::is_internal(name)) {
-    data_->tags.insert_or_assign(std::string(name), std::string(value));
+  if (accepts_tag(name)) {
+    limits().set_tag(*data_, name, value);
+  }
+}
+
+void Span::set_tag(std::string_view name, std::string&& value) {
+  if (accepts_tag(name)) {
+    limits().set_tag(*data_, name, std::move(value));
+  }
+}
+
+void Span::set_tags(
+    std::initializer_list<std::pair<std::string_view, std::string_view>>
+        tags) {
+  if (is_noop()) {
+    return;
+  }
+  data_->tags.reserve(data_->tags.size() + tags.size());
+  const SpanLimits& span_limits = limits();
+  for (const auto& [name, value] : tags) {
+    if (accepts_tag(name)) {
+      span_limits.set_tag(*data_, name, value);
+    }
+  }
+}
+
+void Span::set_metric(std::string_view name, double value) {
+  if (is_noop() || trace_segment_->lightweight() || tags::is_internal(name) ||
+      !trace_segment_->prototype().projection.accepts(name)) {
+    return;
   }
+  limits().set_metric(*data_, name, value);
+}
+
+void Span::mark(std::string_view name) {
+  if (is_noop()) {
+    return;
+  }
+  mark(name, trace_segment_->clock()().tick);
+}
+
+void Span::mark(std::string_view name,
+                std::chrono::steady_clock::time_point time) {
+  if (is_noop() || trace_segment_->lightweight() || tags::is_internal(name) ||
+      data_->mark_count == SpanData::max_marks) {
+    return;
+  }
+  data_->marks[data_->mark_count++] = SpanMark{name, time - data_->start.tick};
 }
 
 void Span::remove_tag(std::string_view name) {
+  if (is_noop()) {
+    return;
+  }
   if (!tags::is_internal(name)) {
-    data_->tags.erase(std::string(name));
+    data_->tags.erase(name);
   }
 }
 
 void Span::set_service_name(std::string_view service) {
+  if (is_noop()) {
+    return;
+  }
   data_->service = service;
 }
 
 void Span::set_service_type(std::string_view type) {
+  if (is_noop()) {
+    return;
+  }
   data_->service_type = type;
 }
 
 void Span::set_resource_name(std::string_view resource) {
-  data_->resource = resource;
+  if (is_noop()) {
+    return;
+  }
+  data_->resource = limits().resource(resource);
 }
 
 void Span::set_error(bool is_error) {
+  if (is_noop()) {
+    return;
+  }
   data_->error = is_error;
   if (!is_error) {
-    data_->tags.erase("error.msg");
-    data_->tags.erase("error.type");
+    data_->tags.erase(tags::error_message);
+    data_->tags.erase(tags::error_type);
   }
 }
 
 void Span::set_error_message(std::string_view message) {
+  if (is_noop()) {
+    return;
+  }
   data_->error = true;
-  data_->tags.insert_or_assign("error.msg", std::string(message));
+  if (trace_segment_->lightweight()) {
+    return;
+  }
+  limits().set_tag(*data_, tags::error_message, message);
 }
 
 void Span::set_error_type(std::string_view type) {
+  if (is_noop()) {
+    return;
+  }
   data_->error = true;
-  data_->tags.insert_or_assign("error.type", std::string(type));
+  if (trace_segment_->lightweight()) {
+    return;
+  }
+  limits().set_tag(*data_, tags::error_type, type);
 }
 
 void Span::set_error_stack(std::string_view type) {
+  if (is_noop()) {
+    return;
+  }
+  data_->error = true;
+  if (trace_segment_->lightweight()) {
+    return;
+  }
+  data_->error_stack_addresses.clear();
+  limits().set_tag(*data_, tags::error_stack, type);
+}
+
+void Span::capture_error_stack() {
+  if (is_noop()) {
+    return;
+  }
   data_->error = true;
-  data_->tags.insert_or_assign("error.stack", std::string(type));
+  if (trace_segment_->lightweight()) {
+    return;
+  }
+  // The skipped frame is that of `capture_error_stack`.
+  data_->error_stack_addresses = capture_stack(1);
 }
 
-void Span::set_name(std::string_view value) { data_->name = value; }
+void Span::set_name(std::string_view value) {
+  if (is_noop()) {
+    return;
+  }
+  data_->name = value;
+}
 
 void Span::set_end_time(std::chrono::steady_clock::time_point end_time) {
   end_time_ = end_time;
 }
 
+const SpanLimits& Span::limits() const {
+  return trace_segment_->prototype().limits;
+}
+
 TraceSegment& Span::trace_segment() { return *trace_segment_; }
 
 const TraceSegment& Span::trace_segment() const { return *trace_segment_; }
@@ -39,41 +39,73 @@
 //
 // A `Span` is finished when it is destroyed.  The end time can be overridden
 // via the `set_end_time` member function prior to the span's destruction.
+//
+// A `Tracer` that is disabled (see `TracerConfig::report_traces`) creates
+// no-op spans.  A no-op span refers to a sentinel `SpanData` and a sentinel
+// `TraceSegment` that are shared by all no-op spans and never destroyed.  A
+// no-op span ignores mutations, injects nothing, has zero IDs and no tags,
+// and its children are no-op spans.  Creating, using, and destroying a no-op
+// span neither allocates memory nor touches a reference count.
 
 #include <chrono>
 #include <functional>
+#include <initializer_list>
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include "clock.h"
 #include "error.h"
+#include "expected.h"
 #include "id_generator.h"
+#include "trace_id.h"
 
 namespace datadog {
 namespace tracing {
 
+class DictReader;
 class DictWriter;
 struct SpanConfig;
+struct SpanConfigView;
 struct SpanData;
+struct SpanLimits;
 class TraceSegment;
 
 class Span {
   std::shared_ptr<TraceSegment> trace_segment_;
   SpanData* data_;
-  IDGenerator generate_span_id_;
-  Clock clock_;
   std::optional<std::chrono::steady_clock::time_point> end_time_;
 
+  friend class Tracer;
+
+  // Return a no-op span whose trace segment is the specified `segment`, which
+  // must never be destroyed.
+  static Span noop(TraceSegment& segment);
+  // Return whether this span is a no-op span or an overflow span (see
+  // `trace_segment.h`), neither of which records anything.
+  bool is_noop() const;
+  // Return an overflow span in this span's trace segment.
+  Span overflow_child() const;
+  // Return whether a tag having the specified `name` may be set on this span.
+  bool accepts_tag(std::string_view name) const;
+  // Return the limits on the size of this span's properties.
+  const SpanLimits& limits() const;
+  // `Config` is either `SpanConfig` or `SpanConfigView`.
+  template <typename Config>
+  Span create_child_from(const Config& config) const;
+  template <typename Config>
+  std::vector<Span> create_children_from(std::size_t count,
+                                         const Config& config) const;
+
  public:
   // Create a span whose properties are stored in the specified `data` and that
-  // is associated with the specified `trace_segment`.  Optionally specify
-  // `generate_span_id` to generate IDs of child spans, and a `clock` to
-  // determine start and end times.  If `generate_span_id` and `clock` are not
-  // specified`, then `default_id_generator` and `default_clock` are used
-  // instead respectively.
-  Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment,
-       const IDGenerator& generate_span_id, const Clock& clock);
+  // is associated with the specified `trace_segment`.  The span uses the
+  // segment's ID generator to generate the IDs of child spans, and the
+  // segment's clock to determine start and end times.
+  Span(SpanData* data, const std::shared_ptr<TraceSegment>& trace_segment);
   Span(const Span&) = delete;
   Span(Span&&) = default;
   Span& operator=(Span&&) = default;
@@ -88,14 +120,28 @@ class Span {
   // specified, then the child span's properties are determined by the
   // `SpanDefaults` that were used to configure the `Tracer` to which this span
   // is related.  The child span's start time is the current time unless
-  // overridden in `config`.
+  // overridden in `config`.  A `SpanConfigView` need only outlive the call
+  // (see `span_config.h`).
   Span create_child(const SpanConfig& config) const;
+  Span create_child(const SpanConfigView& config) const;
   Span create_child() const;
 
+  // Return the specified `count` spans that are children of this span, as if
+  // by calling `create_child` with the optionally specified `config` `count`
+  // times, except that the children share one start time.  This is cheaper
+  // than creating the children one at a time: their properties are computed
+  // once, their storage is allocated at once, and they're registered with
+  // the trace segment at once.
+  std::vector<Span> create_children(std::size_t count,
+                                    const SpanConfig& config) const;
+  std::vector<Span> create_children(std::size_t count,
+                                    const SpanConfigView& config) const;
+  std::vector<Span> create_children(std::size_t count) const;
+
   // Return this span's ID (span ID).
   std::uint64_t id() const;
   // Return the ID of the trace of which this span is a part.
-  std::uint64_t trace_id() const;
+  TraceID trace_id() const;
   // Return the ID of this span's parent span, or return null if this span has
   // no parent.
   std::optional<std::uint64_t> parent_id() const;
@@ -108,12 +154,44 @@ class Span {
   // Return the value of the tag having the specified `name`, or return null if
   // there is no such tag.
   std::optional<std::string_view> lookup_tag(std::string_view name) const;
+
+  // The following setters honor the tracer's `SpanLimits`: tag names and
+  // values, and the resource name, are truncated to their limits, and a new
+  // tag is discarded if the span already has the maximum number of tags.  A
+  // tag whose name the limits don't allow is discarded.  See `span_limits.h`.
+
   // Overwrite the tag having the specified `name` so that it has the specified
   // `value`, or create a new tag.
   void set_tag(std::string_view name, std::string_view value);
+  // Overwrite or create the tag having the specified `name`, moving the
+  // specified `value` into the span rather than copying it.
+  void set_tag(std::string_view name, std::string&& value);
+  void set_tag(std::string_view name, const char* value) {
+    set_tag(name, std::string_view(value));
+  }
+  // Overwrite or create each of the specified `tags`, as if by `set_tag`,
+  // growing the span's storage for tags at most once.
+  void set_tags(
+      std::initializer_list<std::pair<std::string_view, std::string_view>>
+          tags);
+  // Overwrite the numeric tag (metric) having the specified `name` so that it
+  // has the specified `value`, or create a new metric.  Unlike a tag whose
+  // value is a number formatted as a string, a metric is sent as a number.
+  void set_metric(std::string_view name, double value);
   // Delete the tag having the specified `name` if it exists.
   void remove_tag(std::string_view name);
 
+  // Record a timing mark having the specified `name` at the current time, or
+  // at the optionally specified `time`, e.g. the end of a phase of the
+  // operation that this span represents.  A mark is much cheaper than a child
+  // span: it's stored within this span, and is sent as a metric whose value
+  // is the mark's offset from this span's start time, in nanoseconds.  The
+  // `name` is not copied, and so must outlive the span, e.g. be a string
+  // literal.  At most `SpanData::max_marks` marks are kept, and marks beyond
+  // that are ignored.  A mark shouldn't share its name with a metric.
+  void mark(std::string_view name);
+  void mark(std::string_view name, std::chrono::steady_clock::time_point time);
+
   // Set the name of the service associated with this span, e.g.
   // "ingress-nginx-useast1".
   void set_service_name(std::string_view);
@@ -137,6 +215,13 @@ class Span {
   // Associate a call stack with the error that occurred during the extent of
   // this span.  This also has the effect of calling `set_error(true)`.
   void set_error_stack(std::string_view);
+  // Capture the call stack of the calling thread as the call stack associated
+  // with the error that occurred during the extent of this span.  Only return
+  // addresses are captured, which is much cheaper than formatting a stack.  The
+  // addresses are symbolized when the span is about to be sent, unless
+  // `set_error_stack` is called meanwhile.  See `error_stack.h`.  This also
+  // has the effect of calling `set_error(true)`.
+  void capture_error_stack();
   // Set end time of this span.  Doing so will override the default behavior of
   // using the current time in the destructor.
   void set_end_time(std::chrono::steady_clock::time_point);
@@ -145,6 +230,16 @@ class Span {
   // for purposes of trace propagation.
   void inject(DictWriter& writer) const;
 
+  // Adopt the sampling decision of the service that handled a request into
+  // which this span's trace context was injected, if the specified `reader`,
+  // the response's headers, contains one.  Return an error if the decision is
+  // malformed.  See `TracerConfig::delegate_trace_sampling`.
+  Expected<void> read_sampling_delegation_response(const DictReader& reader);
+  // If this span's trace was extracted from a request that asks for the
+  // sampling decision, write the decision into the specified `writer`, the
+  // headers of the response.  Call this before sending the response.
+  void write_sampling_delegation_response(DictWriter& writer);
+
   // Return a reference to this span's trace segment.  The trace segment has
   // member functions that effect the trace as a whole, such as
   // `TraceSegment::override_sampling_priority`.
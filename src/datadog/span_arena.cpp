@@ -0,0 +1,286 @@
+#include "span_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Each allocation is preceded by a `Header`.  The header is padded so that the
+// memory following it is suitably aligned for any type.
+struct alignas(std::max_align_t) Header {
+  // `block` is null for allocations made directly from the global heap.
+  SpanArena::Block* block;
+};
+
+constexpr std::size_t round_up(std::size_t size) {
+  const std::size_t alignment = alignof(std::max_align_t);
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// Most trace segments contain only a few spans, so the first block is small.
+// Each subsequent block is twice as large as the previous, up to a maximum.
+constexpr std::size_t min_block_capacity = 2 * 1024;
+constexpr std::size_t max_block_capacity = 64 * 1024;
+// Block capacities are powers of two, so there is one free list for each.
+constexpr std::size_t num_block_sizes = 6;
+static_assert(min_block_capacity << (num_block_sizes - 1) ==
+              max_block_capacity);
+// At most this many bytes of free blocks of each capacity are kept for reuse
+// in the process-wide free lists, and at most this many more in each thread's
+// free lists, though a thread may always keep one block of each capacity.
+constexpr std::size_t max_free_bytes_per_size = 256 * 1024;
+constexpr std::size_t max_thread_free_bytes_per_size = 32 * 1024;
+
+}  // namespace
+
+struct alignas(std::max_align_t) SpanArena::Block {
+  // One reference for each live allocation, plus one for the arena while the
+  // arena is still allocating from this block.
+  std::atomic<std::size_t> references{1};
+  std::size_t used = 0;
+  std::size_t capacity;
+  // `next` links the block into a free list once it's released.
+  Block* next = nullptr;
+  // `resource` is the resource from which the block was allocated, or null
+  // if it was allocated from the global heap.
+  std::pmr::memory_resource* resource;
+  // The block's storage immediately follows the `Block` object.
+
+  Block(std::size_t capacity, std::pmr::memory_resource* resource)
+      : capacity(capacity), resource(resource) {}
+
+  unsigned char* storage() {
+    return reinterpret_cast<unsigned char*>(this + 1);
+  }
+};
+
+namespace {
+
+// Return the index of the free list of blocks having the specified
+// `capacity`.
+std::size_t size_index(std::size_t capacity) {
+  std::size_t index = 0;
+  while ((min_block_capacity << index) < capacity) {
+    ++index;
+  }
+  return index;
+}
+
+// `ReturnedBlocks` is a stack of released blocks of one capacity.  Any thread
+// may push a block onto the stack, but blocks are only ever removed all at
+// once, by `take`.  So, unlike a general lock-free stack, it isn't subject to
+// the ABA problem.
+class ReturnedBlocks {
+  std::atomic<SpanArena::Block*> head_{nullptr};
+  std::atomic<std::size_t> count_{0};
+
+ public:
+  // Push the specified `block`, unless the stack is full, in which case
+  // return false.
+  bool push(SpanArena::Block* block, std::size_t max_count) {
+    if (count_.fetch_add(1, std::memory_order_relaxed) >= max_count) {
+      count_.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+    block->next = head_.load(std::memory_order_relaxed);
+    while (!head_.compare_exchange_weak(block->next, block,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed)) {
+    }
+    return true;
+  }
+
+  // Remove and return all of the blocks, linked by `Block::next`.
+  SpanArena::Block* take() {
+    SpanArena::Block* blocks =
+        head_.exchange(nullptr, std::memory_order_acquire);
+    std::size_t count = 0;
+    for (auto* block = blocks; block; block = block->next) {
+      ++count;
+    }
+    count_.fetch_sub(count, std::memory_order_relaxed);
+    return blocks;
+  }
+};
+
+// Blocks are usually released by the thread that encodes spans, e.g. in
+// `DatadogAgent::flush`, and are needed again by the threads that create
+// spans.  Released blocks are pushed onto a process-wide `ReturnedBlocks`.  A
+// thread that needs a block takes one from its own free list, and if that's
+// empty, moves a batch of the returned blocks of the same capacity to its
+// list (see `take_returned`).
+ReturnedBlocks returned_blocks[num_block_sizes];
+
+// Return the specified released `block` for reuse, or delete it if enough
+// blocks of its capacity are already kept.  A block allocated from a memory
+// resource is returned to the resource.
+void recycle(SpanArena::Block* block) {
+  if (std::pmr::memory_resource* const resource = block->resource) {
+    const std::size_t size = sizeof(SpanArena::Block) + block->capacity;
+    block->~Block();
+    resource->deallocate(block, size, alignof(SpanArena::Block));
+    return;
+  }
+  const std::size_t max_count = max_free_bytes_per_size / block->capacity;
+  if (!returned_blocks[size_index(block->capacity)].push(block, max_count)) {
+    block->~Block();
+    ::operator delete(block);
+  }
+}
+
+// `FreeBlocks` is a thread's free lists.  When the thread exits, its blocks
+// are returned for use by other threads, or deleted.
+struct FreeBlocks {
+  SpanArena::Block* heads[num_block_sizes] = {};
+
+  ~FreeBlocks() {
+    for (std::size_t i = 0; i < num_block_sizes; ++i) {
+      for (auto* block = std::exchange(heads[i], nullptr); block;) {
+        auto* const next = block->next;
+        recycle(block);
+        block = next;
+      }
+    }
+  }
+};
+
+thread_local FreeBlocks free_blocks;
+
+// Remove and return a list, linked by `Block::next`, of at most
+// `max_thread_free_bytes_per_size` of the returned blocks having the
+// specified `capacity`, but at least one block if any were returned.  The
+// other returned blocks are returned again, or deleted if they no longer fit.
+SpanArena::Block* take_returned(std::size_t capacity) {
+  SpanArena::Block* const blocks =
+      returned_blocks[size_index(capacity)].take();
+  const std::size_t max_count =
+      std::max<std::size_t>(1, max_thread_free_bytes_per_size / capacity);
+  SpanArena::Block* last = blocks;
+  for (std::size_t count = 1; last && count < max_count; ++count) {
+    last = last->next;
+  }
+  if (last) {
+    for (auto* block = std::exchange(last->next, nullptr); block;) {
+      auto* const next = block->next;
+      recycle(block);
+      block = next;
+    }
+  }
+  return blocks;
+}
+
+SpanArena::Block* new_block(std::size_t capacity,
+                            std::pmr::memory_resource* resource) {
+  if (resource) {
+    void* memory = resource->allocate(sizeof(SpanArena::Block) + capacity,
+                                      alignof(SpanArena::Block));
+    return new (memory) SpanArena::Block(capacity, resource);
+  }
+
+  const std::size_t index = size_index(capacity);
+  SpanArena::Block*& head = free_blocks.heads[index];
+  if (!head) {
+    head = take_returned(capacity);
+  }
+  if (SpanArena::Block* const block = head) {
+    head = block->next;
+    block->next = nullptr;
+    block->used = 0;
+    block->references.store(1, std::memory_order_relaxed);
+    return block;
+  }
+
+  void* memory = ::operator new(sizeof(SpanArena::Block) + capacity);
+  return new (memory) SpanArena::Block(capacity, nullptr);
+}
+
+void release(SpanArena::Block* block) {
+  if (block &&
+      block->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    recycle(block);
+  }
+}
+
+}  // namespace
+
+SpanArena::SpanArena(std::pmr::memory_resource* resource)
+    : current_(nullptr), resource_(resource) {}
+
+SpanArena::SpanArena(SpanArena&& other)
+    : current_(std::exchange(other.current_, nullptr)),
+      resource_(other.resource_) {}
+
+SpanArena& SpanArena::operator=(SpanArena&& other) {
+  if (this != &other) {
+    release(current_);
+    current_ = std::exchange(other.current_, nullptr);
+    resource_ = other.resource_;
+  }
+  return *this;
+}
+
+SpanArena::~SpanArena() { release(current_); }
+
+void* SpanArena::allocate(std::size_t size) {
+  const std::size_t needed = sizeof(Header) + round_up(size);
+  if (needed > max_block_capacity) {
+    if (!resource_) {
+      return allocate_unpooled(size);
+    }
+    // The block's one reference is the allocation's.
+    Block* const block = new_block(needed, resource_);
+    block->used = needed;
+    auto* header = reinterpret_cast<Header*>(block->storage());
+    header->block = block;
+    return header + 1;
+  }
+
+  if (!current_ || current_->capacity - current_->used < needed) {
+    std::size_t capacity = min_block_capacity;
+    if (current_) {
+      capacity = std::min(current_->capacity * 2, max_block_capacity);
+    }
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    Block* const block = new_block(capacity, resource_);
+    release(current_);
+    current_ = block;
+  }
+
+  auto* header =
+      reinterpret_cast<Header*>(current_->storage() + current_->used);
+  current_->used += needed;
+  current_->references.fetch_add(1, std::memory_order_relaxed);
+  header->block = current_;
+  return header + 1;
+}
+
+void* SpanArena::allocate_unpooled(std::size_t size) {
+  auto* header =
+      static_cast<Header*>(::operator new(sizeof(Header) + round_up(size)));
+  header->block = nullptr;
+  return header + 1;
+}
+
+void SpanArena::deallocate(void* pointer) {
+  if (!pointer) {
+    return;
+  }
+
+  auto* header = static_cast<Header*>(pointer) - 1;
+  if (header->block) {
+    release(header->block);
+  } else {
+    ::operator delete(header);
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,83 @@
+#pragma once
+
+// This component provides a class, `SpanArena`, that is a monotonic allocator
+// from which a `TraceSegment` allocates the `SpanData` objects of its spans.
+//
+// `SpanArena` is not used directly.  It is an implementation detail of
+// `TraceSegment` and `SpanData`.
+//
+// Memory is carved from fixed-size blocks.  Each allocation is prefixed by a
+// small header that refers to the block from which the allocation was made, so
+// that an allocation can be freed (see `SpanArena::deallocate`) without a
+// reference to the arena.  Freeing an allocation does not make its memory
+// available for reuse.  Instead, each block counts its live allocations, and
+// the whole block is released in one step once its last allocation is freed
+// and the arena no longer allocates from it.
+//
+// This way, the `SpanData` objects of a trace segment can be handed to a
+// `Collector` as `std::unique_ptr<SpanData>`, and the memory of the entire
+// trace segment is released after the collector has encoded and destroyed the
+// spans (e.g. in `DatadogAgent::flush`).
+//
+// Released blocks are kept for reuse.  The thread that releases a block,
+// usually the one encoding spans, pushes it onto a process-wide list without
+// locking.  A thread that needs a block takes one from its own free list,
+// refilling the list from the process-wide one when it's empty.  So, in steady
+// state, creating a trace segment's spans needs no new arena blocks from the
+// heap.  The process-wide list keeps up to 256 KiB of blocks of each
+// capacity, and a thread takes up to 32 KiB of them (or one block, if a block
+// is larger) at a time, leaving the rest for other threads.  So the memory
+// kept for reuse is bounded by 256 KiB, plus 64 KiB for each thread that
+// allocates spans, for each of the six block capacities.
+//
+// An arena may instead allocate its blocks from a `std::pmr::memory_resource`
+// (see `TracerConfig::memory_resource`), and then so are allocations too large
+// for a block, each in a block of its own.  Such blocks are returned to their
+// resource when they're released, rather than kept for reuse, since pooling
+// is then up to the resource.
+//
+// `SpanArena` is not thread-safe.  `TraceSegment` serializes access to its
+// arena.  `SpanArena::deallocate`, however, may be called from any thread.
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace datadog {
+namespace tracing {
+
+class SpanArena {
+ public:
+  struct Block;
+
+ private:
+  Block* current_;
+  std::pmr::memory_resource* resource_;
+
+ public:
+  // Create an arena that allocates its blocks from the optionally specified
+  // `resource`, or, if it's null, from the global heap.  The resource must
+  // outlive the memory allocated from the arena.
+  explicit SpanArena(std::pmr::memory_resource* resource = nullptr);
+  SpanArena(SpanArena&&);
+  SpanArena& operator=(SpanArena&&);
+  SpanArena(const SpanArena&) = delete;
+  ~SpanArena();
+
+  // Return a pointer to at least the specified `size` bytes of memory, suitably
+  // aligned for any type.  The memory was allocated from this arena, unless
+  // `size` is too large for an arena block, in which case the memory was
+  // allocated from the arena's resource, if any, or else from the global heap.
+  // Either way, the memory must be freed using `deallocate`.
+  void* allocate(std::size_t size);
+
+  // Return a pointer to at least the specified `size` bytes of memory,
+  // allocated from the global heap, that may be freed using `deallocate`.
+  static void* allocate_unpooled(std::size_t size);
+
+  // Free the memory at the specified `pointer`, which must have been returned
+  // by `allocate` or by `allocate_unpooled`.
+  static void deallocate(void* pointer);
+};
+
+}  // namespace tracing
+}  // namespace datadog
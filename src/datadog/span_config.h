@@ -12,13 +12,31 @@
 // two types have different purposes. `SpanDefaults` are the properties used
 // when no corresponding property is specified in a `SpanConfig` argument.
 // See `SpanData::apply_config`.
+//
+// This component also provides `SpanConfigView`, which is like `SpanConfig`
+// except that it refers to strings owned by the caller instead of copying
+// them.  The same member functions accept a `SpanConfigView`, which need
+// only outlive the call.  The span's properties are then copied directly
+// from the caller's strings into the span, so that creating a span from a
+// `SpanConfigView` whose tag names are short or well-known does not allocate
+// memory beyond what the span itself requires.
+//
+//     SpanConfigView config;
+//     config.name = "rpc.call";
+//     config.resource = method_name;  // e.g. a `std::string_view`
+//     auto span = parent.create_child(config);
+//
+// `single_threaded` applies only to a span that begins a trace segment, i.e.
+// one created or extracted by `Tracer`.  It is ignored by `Span::create_child`,
+// whose span belongs to its parent's segment.
 
 #include <optional>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <variant>
 
 #include "clock.h"
+#include "flat_map.h"
 
 namespace datadog {
 namespace tracing {
@@ -31,7 +49,24 @@ struct SpanConfig {
   std::optional<std::string> name;
   std::optional<std::string> resource;
   std::optional<TimePoint> start;
-  std::unordered_map<std::string, std::string> tags;
+  FlatMap<std::string> tags;
+  // Whether the spans of the new trace segment are used only on the thread
+  // that creates them, in which case the segment doesn't lock its mutexes.
+  // See `trace_segment.h`.
+  bool single_threaded = false;
+};
+
+struct SpanConfigView {
+  std::optional<std::string_view> service;
+  std::optional<std::string_view> service_type;
+  std::optional<std::string_view> version;
+  std::optional<std::string_view> environment;
+  std::optional<std::string_view> name;
+  std::optional<std::string_view> resource;
+  std::optional<TimePoint> start;
+  FlatMap<std::string_view> tags;
+  // See `SpanConfig::single_threaded`.
+  bool single_threaded = false;
 };
 
 }  // namespace tracing
@@ -1,12 +1,19 @@
 #include "span_data.h"
 
 #include <cstddef>
+#include <optional>
+#include <string>
 #include <string_view>
 
+#include "encoded_span_defaults.h"
 #include "error.h"
 #include "msgpack.h"
+#include "span_arena.h"
 #include "span_config.h"
 #include "span_defaults.h"
+#include "span_limits.h"
+#include "span_prototype.h"
+#include "string_table.h"
 #include "tags.h"
 
 namespace datadog {
@@ -14,8 +21,7 @@ namespace tracing {
 namespace {
 
 std::optional<std::string_view> lookup(
-    const std::string& key,
-    const std::unordered_map<std::string, std::string>& map) {
+    const std::string& key, const FlatMap<std::string>& map) {
   const auto found = map.find(key);
   if (found != map.end()) {
     return found->second;
@@ -23,6 +29,179 @@ std::optional<std::string_view> lookup(
   return std::nullopt;
 }
 
+// Return whether the specified `origin` is to be encoded as a tag of the
+// specified `span`, i.e. whether it's not empty and `span` doesn't have an
+// origin tag of its own.
+bool has_implied_origin(const SpanData& span, std::string_view origin) {
+  return !origin.empty() && !span.tags.contains(tags::internal::origin);
+}
+
+// `keys` contains the MessagePack encodings of the names of the fields of a
+// span.  They are the same for every span.
+namespace keys {
+using msgpack::unchecked::FixStr;
+constexpr FixStr service("service");
+constexpr FixStr name("name");
+constexpr FixStr resource("resource");
+constexpr FixStr trace_id("trace_id");
+constexpr FixStr span_id("span_id");
+constexpr FixStr parent_id("parent_id");
+constexpr FixStr start("start");
+constexpr FixStr duration("duration");
+constexpr FixStr error("error");
+constexpr FixStr meta("meta");
+constexpr FixStr metrics("metrics");
+constexpr FixStr type("type");
+
+// The most bytes that the keys, integers, and headers of a span can take,
+// excluding those of its "meta" and "metrics" entries, and excluding the
+// characters of its strings.
+constexpr std::size_t fixed_size_bound =
+    msgpack::unchecked::max_header_size * 7 +
+    msgpack::unchecked::max_integer_size * 6 + service.size() + name.size() +
+    resource.size() + trace_id.size() + span_id.size() + parent_id.size() +
+    start.size() + duration.size() + error.size() + meta.size() +
+    metrics.size() + type.size();
+}  // namespace keys
+
+// Return the most bytes that `msgpack_encode` can write for the specified
+// `span`, whose "meta" includes the specified `origin` if `add_origin` is
+// true, or return an error if any string or map of the span is too large to
+// MessagePack encode.
+Expected<std::size_t> encoded_size_bound(const SpanData& span,
+                                         std::string_view origin,
+                                         bool add_origin) {
+  constexpr std::size_t header = msgpack::unchecked::max_header_size;
+  std::size_t bound = keys::fixed_size_bound;
+  Expected<void> result;
+  const auto add_string = [&](std::string_view value) {
+    result = msgpack::check_size("string", value.size());
+    bound += header + value.size();
+    return bool(result);
+  };
+
+  if (!add_string(span.service) || !add_string(span.name) ||
+      !add_string(span.resource) || !add_string(span.service_type)) {
+    return *result.if_error();
+  }
+  result = msgpack::check_size("map", span.tags.size() + add_origin);
+  if (!result) {
+    return *result.if_error();
+  }
+  if (add_origin && (!add_string(tags::internal::origin) ||
+                     !add_string(origin))) {
+    return *result.if_error();
+  }
+  for (const auto& [key, value] : span.tags) {
+    if (!add_string(key) || !add_string(value)) {
+      return *result.if_error();
+    }
+  }
+  result =
+      msgpack::check_size("map", span.numeric_tags.size() + span.mark_count);
+  if (!result) {
+    return *result.if_error();
+  }
+  for (const auto& entry : span.numeric_tags) {
+    if (!add_string(entry.first)) {
+      return *result.if_error();
+    }
+    bound += msgpack::unchecked::max_double_size;
+  }
+  for (std::size_t i = 0; i < span.mark_count; ++i) {
+    if (!add_string(span.marks[i].name)) {
+      return *result.if_error();
+    }
+    bound += msgpack::unchecked::max_double_size;
+  }
+  return bound;
+}
+
+char* pack_key(char* out, std::string_view key) {
+  return msgpack::unchecked::pack_string(out, key);
+}
+
+template <std::size_t Size>
+char* pack_key(char* out, const msgpack::unchecked::FixStr<Size>& key) {
+  return msgpack::unchecked::pack_raw(out, key);
+}
+
+// Write the specified `key` followed by the specified `value`, or, if
+// `value` is the value of the specified `fragment`, write the fragment's
+// encoding instead.  This is the unchecked counterpart of
+// `EncodedSpanDefaults::pack`.
+template <typename Key>
+char* pack_defaulted(char* out, const EncodedSpanDefaults::Fragment& fragment,
+                     const Key& key, std::string_view value) {
+  if (!fragment.encoded.empty() && value == fragment.value) {
+    return msgpack::unchecked::pack_raw(out, fragment.encoded);
+  }
+  out = pack_key(out, key);
+  return msgpack::unchecked::pack_string(out, value);
+}
+
+// Return the specified `offset` in nanoseconds.
+double nanoseconds(Duration offset) {
+  return double(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(offset).count());
+}
+
+// Return the specified `value` if it's set, or otherwise the specified
+// `fallback`.
+template <typename String>
+std::string_view value_or(const std::optional<String>& value,
+                          const std::string& fallback) {
+  if (value) {
+    return *value;
+  }
+  return fallback;
+}
+
+// Modify the specified `span` as described by `SpanData::apply_config`.
+// `Config` is either `SpanConfig` or `SpanConfigView`.
+template <typename Config>
+void apply(SpanData& span, const SpanPrototype& prototype,
+           const Config& config, const Clock& clock, bool lightweight) {
+  const SpanDefaults& defaults = prototype.defaults;
+  span.service = value_or(config.service, defaults.service);
+  span.name = value_or(config.name, defaults.name);
+
+  if (!lightweight && !config.environment && !config.version) {
+    // The prototype's tags already include the environment and version.
+    span.tags = prototype.tags;
+  } else {
+    if (!lightweight) {
+      span.tags = defaults.tags;
+    }
+    const std::string_view environment =
+        value_or(config.environment, defaults.environment);
+    if (!environment.empty()) {
+      span.tags.insert_or_assign(tags::environment, std::string(environment));
+    }
+    const std::string_view version =
+        value_or(config.version, defaults.version);
+    if (!version.empty()) {
+      span.tags.insert_or_assign(tags::version, std::string(version));
+    }
+  }
+  if (!lightweight) {
+    for (const auto& [key, value] : config.tags) {
+      if (!tags::is_internal(key) && prototype.projection.accepts(key)) {
+        prototype.limits.set_tag(span, key, value);
+      }
+    }
+  }
+
+  span.resource =
+      prototype.limits.resource(value_or(config.resource, span.name));
+  span.service_type = value_or(config.service_type, defaults.service_type);
+  if (config.start) {
+    span.start = *config.start;
+  } else {
+    span.start = clock();
+  }
+}
+
 }  // namespace
 
 std::optional<std::string_view> SpanData::environment() const {
@@ -33,95 +212,185 @@ std::optional<std::string_view> SpanData::version() const {
   return lookup(tags::version, tags);
 }
 
-void SpanData::apply_config(const SpanDefaults& defaults,
-                            const SpanConfig& config, const Clock& clock) {
-  service = config.service.value_or(defaults.service);
-  name = config.name.value_or(defaults.name);
+void SpanData::apply_config(const SpanPrototype& prototype,
+                            const SpanConfig& config, const Clock& clock,
+                            bool lightweight) {
+  apply(*this, prototype, config, clock, lightweight);
+}
+
+void SpanData::apply_config(const SpanPrototype& prototype,
+                            const SpanConfigView& config, const Clock& clock,
+                            bool lightweight) {
+  apply(*this, prototype, config, clock, lightweight);
+}
+
+void* SpanData::operator new(std::size_t size) {
+  return SpanArena::allocate_unpooled(size);
+}
+
+void* SpanData::operator new(std::size_t size, SpanArena& arena) {
+  return arena.allocate(size);
+}
+
+void SpanData::operator delete(void* pointer) {
+  SpanArena::deallocate(pointer);
+}
+
+void SpanData::operator delete(void* pointer, SpanArena&) {
+  SpanArena::deallocate(pointer);
+}
 
-  tags = defaults.tags;
-  std::string environment = config.environment.value_or(defaults.environment);
-  if (!environment.empty()) {
-    tags.insert_or_assign(tags::environment, environment);
+std::size_t approximate_size(const SpanData& span) {
+  // Short strings fit within their objects, but the estimate doesn't bother
+  // to tell.  Neither does it count the tables' unused capacity.
+  std::size_t size = sizeof(SpanData) + span.service.size() +
+                     span.service_type.size() + span.name.size() +
+                     span.resource.size() +
+                     span.error_stack_addresses.size() * sizeof(const void*);
+  for (const auto& entry : span.tags) {
+    size += sizeof(entry) + entry.first.size() + entry.second.size();
   }
-  std::string version = config.version.value_or(defaults.version);
-  if (!version.empty()) {
-    tags.insert_or_assign(tags::version, version);
+  for (const auto& entry : span.numeric_tags) {
+    size += sizeof(entry) + entry.first.size();
   }
-  for (const auto& [key, value] : config.tags) {
-    if (!tags::is_internal(key)) {
-      tags.insert_or_assign(key, value);
+  return size;
+}
+
+Expected<void> msgpack_encode(std::string& destination, const SpanData& span) {
+  static const EncodedSpanDefaults no_defaults;
+  return msgpack_encode(destination, span, no_defaults);
+}
+
+Expected<void> msgpack_encode(std::string& destination, const SpanData& span,
+                              const EncodedSpanDefaults& defaults,
+                              std::string_view origin) {
+  namespace unchecked = msgpack::unchecked;
+  // Check the span once, and then encode it without checking each value.
+  const bool add_origin = has_implied_origin(span, origin);
+  auto bound = encoded_size_bound(span, origin, add_origin);
+  if (auto* error = bound.if_error()) {
+    return *error;
+  }
+  const std::size_t old_size = destination.size();
+  destination.resize(old_size + *bound);
+  char* const begin = destination.data() + old_size;
+  char* out = begin;
+
+  out = unchecked::pack_map(out, 12);
+  out = pack_defaulted(out, defaults.service(), keys::service, span.service);
+  out = unchecked::pack_raw(out, keys::name);
+  out = unchecked::pack_string(out, span.name);
+  out = unchecked::pack_raw(out, keys::resource);
+  out = unchecked::pack_string(out, span.resource);
+  out = unchecked::pack_raw(out, keys::trace_id);
+  out = unchecked::pack_integer(out, span.trace_id.low);
+  out = unchecked::pack_raw(out, keys::span_id);
+  out = unchecked::pack_integer(out, span.span_id);
+  out = unchecked::pack_raw(out, keys::parent_id);
+  out = unchecked::pack_integer(out, span.parent_id);
+  out = unchecked::pack_raw(out, keys::start);
+  out = unchecked::pack_integer(
+      out, std::int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            span.start.wall.time_since_epoch())
+                            .count()));
+  out = unchecked::pack_raw(out, keys::duration);
+  out = unchecked::pack_integer(
+      out, std::int64_t(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   span.duration)
+                   .count()));
+  out = unchecked::pack_raw(out, keys::error);
+  out = unchecked::pack_integer(out, std::int32_t(span.error));
+
+  out = unchecked::pack_raw(out, keys::meta);
+  out = unchecked::pack_map(out, span.tags.size() + add_origin);
+  if (add_origin) {
+    out = unchecked::pack_string(out, tags::internal::origin);
+    out = unchecked::pack_string(out, origin);
+  }
+  for (const auto& [key, value] : span.tags) {
+    if (key == tags::environment) {
+      out = pack_defaulted(out, defaults.environment(), key, value);
+    } else if (key == tags::version) {
+      out = pack_defaulted(out, defaults.version(), key, value);
+    } else {
+      out = unchecked::pack_string(out, key);
+      out = unchecked::pack_string(out, value);
     }
   }
 
-  resource = config.resource.value_or(name);
-  service_type = config.service_type.value_or(defaults.service_type);
-  if (config.start) {
-    start = *config.start;
-  } else {
-    start = clock();
+  out = unchecked::pack_raw(out, keys::metrics);
+  out = unchecked::pack_map(out, span.numeric_tags.size() + span.mark_count);
+  for (const auto& [key, value] : span.numeric_tags) {
+    out = unchecked::pack_string(out, key);
+    out = unchecked::pack_double(out, value);
+  }
+  for (std::size_t i = 0; i < span.mark_count; ++i) {
+    out = unchecked::pack_string(out, span.marks[i].name);
+    out = unchecked::pack_double(out, nanoseconds(span.marks[i].offset));
   }
+
+  out = pack_defaulted(out, defaults.service_type(), keys::type,
+                       span.service_type);
+  destination.resize(old_size + (out - begin));
+  return std::nullopt;
 }
 
-Expected<void> msgpack_encode(std::string& destination, const SpanData& span) {
-  // clang-format off
-  msgpack::pack_map(
+Expected<void> msgpack_encode_v05(std::string& destination,
+                                  const SpanData& span, StringTable& strings,
+                                  std::string_view origin) {
+  const auto pack_index = [&](std::string_view value) {
+    msgpack::pack_integer(destination, std::uint64_t(strings.index(value)));
+  };
+
+  // In the v0.5 format, a span is an array of its fields, in this order.
+  msgpack::pack_array(destination, 12);
+  pack_index(span.service);
+  pack_index(span.name);
+  pack_index(span.resource);
+  msgpack::pack_integer(destination, span.trace_id.low);
+  msgpack::pack_integer(destination, span.span_id);
+  msgpack::pack_integer(destination, span.parent_id);
+  msgpack::pack_integer(destination,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            span.start.wall.time_since_epoch())
+                            .count());
+  msgpack::pack_integer(
       destination,
-      "service", [&](auto& destination) {
-         return msgpack::pack_string(destination, span.service);
-       },
-      "name", [&](auto& destination) {
-         return msgpack::pack_string(destination, span.name);
-       },
-      "resource", [&](auto& destination) {
-         return msgpack::pack_string(destination, span.resource);
-       },
-      "trace_id", [&](auto& destination) {
-         msgpack::pack_integer(destination, span.trace_id);
-         return Expected<void>{};
-       },
-      "span_id", [&](auto& destination) {
-         msgpack::pack_integer(destination, span.span_id);
-         return Expected<void>{};
-       },
-      "parent_id", [&](auto& destination) {
-         msgpack::pack_integer(destination, span.parent_id);
-         return Expected<void>{};
-       },
-      "start", [&](auto& destination) {
-         msgpack::pack_integer(
-             destination, std::chrono::duration_cast<std::chrono::nanoseconds>(
-                              span.start.wall.time_since_epoch())
-                              .count());
-         return Expected<void>{};
-       },
-      "duration", [&](auto& destination) {
-         msgpack::pack_integer(
-             destination,
-             std::chrono::duration_cast<std::chrono::nanoseconds>(span.duration)
-                 .count());
-        return Expected<void>{};
-       },
-      "error", [&](auto& destination) {
-         msgpack::pack_integer(destination, std::int32_t(span.error));
-         return Expected<void>{};
-       },
-      "meta", [&](auto& destination) {
-         return msgpack::pack_map(destination, span.tags,
-                           [](std::string& destination, const auto& value) {
-                             return msgpack::pack_string(destination, value);
-                           });
-       }, "metrics",
-       [&](auto& destination) {
-         return msgpack::pack_map(destination, span.numeric_tags,
-                           [](std::string& destination, const auto& value) {
-                             msgpack::pack_double(destination, value);
-                             return Expected<void>{};
-                           });
-       }, "type", [&](auto& destination) {
-         return msgpack::pack_string(destination, span.service_type);
-       });
-  // clang-format on
+      std::chrono::duration_cast<std::chrono::nanoseconds>(span.duration)
+          .count());
+  msgpack::pack_integer(destination, std::int32_t(span.error));
+
+  const bool add_origin = has_implied_origin(span, origin);
+  Expected<void> result =
+      msgpack::pack_map(destination, span.tags.size() + add_origin);
+  if (!result) {
+    return result;
+  }
+  if (add_origin) {
+    pack_index(tags::internal::origin);
+    pack_index(origin);
+  }
+  for (const auto& [key, value] : span.tags) {
+    pack_index(key);
+    pack_index(value);
+  }
+
+  result = msgpack::pack_map(destination,
+                             span.numeric_tags.size() + span.mark_count);
+  if (!result) {
+    return result;
+  }
+  for (const auto& [key, value] : span.numeric_tags) {
+    pack_index(key);
+    msgpack::pack_double(destination, value);
+  }
+  for (std::size_t i = 0; i < span.mark_count; ++i) {
+    pack_index(span.marks[i].name);
+    msgpack::pack_double(destination, nanoseconds(span.marks[i].offset));
+  }
 
+  pack_index(span.service_type);
   return std::nullopt;
 }
 
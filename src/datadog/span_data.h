@@ -3,50 +3,116 @@
 // This component provides a `struct`, `SpanData`, that contains all data fields
 // relevant to `Span`. `SpanData` is what is consumed by `Collector`.
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
-#include <unordered_map>
+#include <vector>
 
 #include "clock.h"
 #include "expected.h"
+#include "flat_map.h"
+#include "trace_id.h"
 
 namespace datadog {
 namespace tracing {
 
+class EncodedSpanDefaults;
+class SpanArena;
+class StringTable;
 struct SpanConfig;
-struct SpanDefaults;
+struct SpanConfigView;
+struct SpanPrototype;
+
+// `SpanMark` is a named point in time within a span (see `Span::mark`).
+// `name` is not owned, and refers to a string that outlives the span, such as
+// a string literal.  `offset` is the time since the start of the span.
+struct SpanMark {
+  std::string_view name;
+  Duration offset;
+};
 
 struct SpanData {
   std::string service;
   std::string service_type;
   std::string name;
   std::string resource;
-  std::uint64_t trace_id = 0;
+  TraceID trace_id;
   std::uint64_t span_id = 0;
   std::uint64_t parent_id = 0;
   TimePoint start;
   Duration duration = Duration::zero();
   bool error = false;
-  std::unordered_map<std::string, std::string> tags;
-  std::unordered_map<std::string, double> numeric_tags;
+  FlatMap<std::string> tags;
+  FlatMap<double> numeric_tags;
+  // `marks` contains `mark_count` timing marks, in the order in which they
+  // were made.  A mark is encoded as an entry of "metrics" whose value is the
+  // mark's offset in nanoseconds.
+  static constexpr std::size_t max_marks = 8;
+  std::array<SpanMark, max_marks> marks;
+  std::uint8_t mark_count = 0;
+  // `error_stack_addresses` are the return addresses of a call stack captured
+  // by `Span::capture_error_stack`.  They become the "error.stack" tag when
+  // the span is about to be encoded.  See `error_stack.h`.
+  std::vector<const void*> error_stack_addresses;
+  // `next_registration` links the span into its `TraceSegment`'s list of
+  // newly registered spans.  It's otherwise null.
+  SpanData* next_registration = nullptr;
 
   std::optional<std::string_view> environment() const;
   std::optional<std::string_view> version() const;
 
   // Modify the properties of this object to honor the specified `config` and
-  // `defaults`.  The properties of `config`, if set, override the properties of
-  // `defaults`. Use the specified `clock` to provide a start none of none is
-  // specified in `config`.
-  void apply_config(const SpanDefaults& defaults, const SpanConfig& config,
-                    const Clock& clock);
+  // the defaults of the specified `prototype`.  The properties of `config`, if
+  // set, override the defaults.  Use the specified `clock` to provide a start
+  // none of none is specified in `config`.  If the optionally specified
+  // `lightweight` is true, then omit the tags other than the environment and
+  // version (see `trace_segment.h`).
+  void apply_config(const SpanPrototype& prototype, const SpanConfig& config,
+                    const Clock& clock, bool lightweight = false);
+  void apply_config(const SpanPrototype& prototype,
+                    const SpanConfigView& config, const Clock& clock,
+                    bool lightweight = false);
+
+  // `SpanData` objects are usually allocated from the `SpanArena` of their
+  // `TraceSegment`, e.g. `new (arena) SpanData`.  Objects allocated without an
+  // arena come from the global heap.  Either way, `delete` does the right
+  // thing.  See `span_arena.h`.
+  static void* operator new(std::size_t size);
+  static void* operator new(std::size_t size, SpanArena& arena);
+  static void operator delete(void* pointer);
+  static void operator delete(void* pointer, SpanArena& arena);
 };
 
 // Append to the specified `destination` the MessagePack representation of the
 // specified `span`.
+// Return an estimate of the number of bytes of memory occupied by the
+// specified `span`, including its strings and tags.
+std::size_t approximate_size(const SpanData& span);
+
 Expected<void> msgpack_encode(std::string& destination, const SpanData& span);
 
+// Append to the specified `destination` the MessagePack representation of the
+// specified `span`, copying pre-encoded fragments from the specified `defaults`
+// where the span's values match them.  See `encoded_span_defaults.h`.  If the
+// optionally specified `origin` is not empty, and the span has no
+// "_dd.origin" tag, then encode the span as if it had that tag with the value
+// `origin`.
+Expected<void> msgpack_encode(std::string& destination, const SpanData& span,
+                              const EncodedSpanDefaults& defaults,
+                              std::string_view origin = {});
+
+// Append to the specified `destination` the MessagePack representation of the
+// specified `span` in the Datadog Agent's "v0.5" format, where each string is
+// replaced by its index in the specified `strings`.  Strings not already in
+// `strings` are added to it.  See `string_table.h`.  The optionally specified
+// `origin` is as for `msgpack_encode`.
+Expected<void> msgpack_encode_v05(std::string& destination,
+                                  const SpanData& span, StringTable& strings,
+                                  std::string_view origin = {});
+
 }  // namespace tracing
 }  // namespace datadog
@@ -21,8 +21,13 @@ nlohmann::json to_json(const SpanDefaults& defaults) {
   TO_JSON(environment);
   TO_JSON(version);
   TO_JSON(name);
-  TO_JSON(tags);
 #undef TO_JSON
+  if (!defaults.tags.empty()) {
+    auto& tags = result["tags"] = nlohmann::json::object();
+    for (const auto& [key, value] : defaults.tags) {
+      tags[std::string(key)] = value;
+    }
+  }
   return result;
 }
 
@@ -5,8 +5,8 @@
 // `SpanDefaults` are specified as the `defaults` property of `TracerConfig`.
 
 #include <string>
-#include <unordered_map>
 
+#include "flat_map.h"
 #include "json_fwd.hpp"
 
 namespace datadog {
@@ -18,7 +18,7 @@ struct SpanDefaults {
   std::string environment = "";
   std::string version = "";
   std::string name = "";
-  std::unordered_map<std::string, std::string> tags;
+  FlatMap<std::string> tags;
 };
 
 nlohmann::json to_json(const SpanDefaults&);
@@ -0,0 +1,93 @@
+#include "span_limits.h"
+
+#include <utility>
+
+#include "json.hpp"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+std::string_view truncate(std::string_view text,
+                          const std::optional<std::size_t>& max_bytes) {
+  if (!max_bytes) {
+    return text;
+  }
+  return truncate_utf8(text, *max_bytes);
+}
+
+// Return whether the specified `span` may have another tag, whose name is
+// the specified `name`, within the specified `max_tags`.
+bool has_room(const SpanData& span, std::string_view name,
+              const std::optional<std::size_t>& max_tags) {
+  return !max_tags ||
+         span.tags.size() + span.numeric_tags.size() < *max_tags ||
+         span.tags.contains(name) || span.numeric_tags.contains(name);
+}
+
+}  // namespace
+
+std::string_view SpanLimits::resource(std::string_view resource) const {
+  return truncate(resource, max_resource_bytes);
+}
+
+void SpanLimits::set_tag(SpanData& span, std::string_view name,
+                         std::string_view value) const {
+  name = truncate(name, max_tag_name_bytes);
+  if (has_room(span, name, max_tags)) {
+    span.tags.insert_or_assign(
+        name, std::string(truncate(value, max_tag_value_bytes)));
+  }
+}
+
+void SpanLimits::set_tag(SpanData& span, std::string_view name,
+                         std::string&& value) const {
+  name = truncate(name, max_tag_name_bytes);
+  if (has_room(span, name, max_tags)) {
+    value.resize(truncate(value, max_tag_value_bytes).size());
+    span.tags.insert_or_assign(name, std::move(value));
+  }
+}
+
+void SpanLimits::set_metric(SpanData& span, std::string_view name,
+                            double value) const {
+  name = truncate(name, max_tag_name_bytes);
+  if (has_room(span, name, max_tags)) {
+    span.numeric_tags.insert_or_assign(name, value);
+  }
+}
+
+std::string_view truncate_utf8(std::string_view text, std::size_t max_bytes) {
+  if (text.size() <= max_bytes) {
+    return text;
+  }
+  // Back up over continuation bytes (10xxxxxx), so that the cut falls before
+  // the first byte of a character.
+  std::size_t size = max_bytes;
+  while (size > 0 && (static_cast<unsigned char>(text[size]) & 0xC0) == 0x80) {
+    --size;
+  }
+  return text.substr(0, size);
+}
+
+nlohmann::json to_json(const SpanLimits& limits) {
+  auto result = nlohmann::json::object({});
+#define TO_JSON(FIELD) \
+  if (limits.FIELD) result[#FIELD] = *limits.FIELD
+  TO_JSON(max_resource_bytes);
+  TO_JSON(max_tag_name_bytes);
+  TO_JSON(max_tag_value_bytes);
+  TO_JSON(max_tags);
+#undef TO_JSON
+  if (!limits.allowed_tags.empty()) {
+    result["allowed_tags"] = limits.allowed_tags;
+  }
+  if (!limits.denied_tags.empty()) {
+    result["denied_tags"] = limits.denied_tags;
+  }
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,81 @@
+#pragma once
+
+// This component provides a `struct`, `SpanLimits`, that bounds the size of
+// what a span stores: its resource name, the names and values of its tags,
+// and its number of tags.  `SpanLimits` are specified as the `span_limits`
+// property of `TracerConfig`.
+//
+// The limits are enforced as a span's properties are set, e.g. by
+// `Span::set_tag`, so that the excess bytes of an oversized value (a long SQL
+// statement or error stack, say) are never copied into the span.  Strings are
+// truncated at a UTF-8 character boundary.  A tag beyond `max_tags` is
+// discarded, but an existing tag can always be overwritten.
+//
+// The default limits are those that the Datadog Agent applies anyway, so by
+// default nothing that the Agent would keep is lost.
+//
+// `SpanLimits` also specifies which tags spans may have at all, by the glob
+// patterns of their names (see `tag_projection.h`).  By default, any tag is
+// allowed.
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_fwd.hpp"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+struct SpanLimits {
+  // The maximum size, in bytes, of a span's resource name, of the name of
+  // each of its tags, and of the value of each of its string tags, and the
+  // maximum number of tags, string or numeric, that may be set on a span.
+  // Unset limits are unlimited.  The tags that a span receives from its
+  // `SpanDefaults` are neither truncated nor discarded, but they count toward
+  // `max_tags`.
+  std::optional<std::size_t> max_resource_bytes = 5000;
+  std::optional<std::size_t> max_tag_name_bytes = 200;
+  std::optional<std::size_t> max_tag_value_bytes = 25000;
+  std::optional<std::size_t> max_tags;
+
+  // The glob patterns of the names of the tags that may be set on a span, and
+  // of those that may not.  If `allowed_tags` is not empty, then a tag whose
+  // name matches none of its patterns is discarded.  A tag whose name matches
+  // any of the `denied_tags` patterns is discarded.  The projection applies to
+  // the tags set by `Span::set_tag`, `Span::set_tags`, and `Span::set_metric`,
+  // and to those in a span's `SpanConfig`, but not to the tags that a span
+  // receives from its `SpanDefaults` or that the tracer sets itself, such as
+  // the error tags.
+  std::vector<std::string> allowed_tags;
+  std::vector<std::string> denied_tags;
+
+  // Return the specified `resource` truncated to `max_resource_bytes`.
+  std::string_view resource(std::string_view resource) const;
+
+  // Set the string tag having the specified `name` and `value` on the
+  // specified `span`, truncating the name and the value, unless the tag is
+  // new and `span` already has `max_tags` tags.
+  void set_tag(SpanData& span, std::string_view name,
+               std::string_view value) const;
+  void set_tag(SpanData& span, std::string_view name,
+               std::string&& value) const;
+  // Set the numeric tag having the specified `name` and `value` on the
+  // specified `span`, truncating the name, unless the tag is new and `span`
+  // already has `max_tags` tags.
+  void set_metric(SpanData& span, std::string_view name, double value) const;
+};
+
+// Return the longest prefix of the specified `text` that is no longer than
+// the specified `max_bytes` and that doesn't end within a UTF-8 multi-byte
+// sequence.
+std::string_view truncate_utf8(std::string_view text, std::size_t max_bytes);
+
+nlohmann::json to_json(const SpanLimits&);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -38,6 +38,33 @@ bool SpanMatcher::match(const SpanData& span) const {
          });
 }
 
+CompiledSpanMatcher::CompiledSpanMatcher(const SpanMatcher& matcher)
+    : service_(matcher.service),
+      name_(matcher.name),
+      resource_(matcher.resource) {
+  tags_.reserve(matcher.tags.size());
+  for (const auto& [name, pattern] : matcher.tags) {
+    tags_.emplace_back(name, GlobPattern(pattern));
+  }
+}
+
+bool CompiledSpanMatcher::match(const SpanData& span) const {
+  return match_names(span) && match_tags(span);
+}
+
+bool CompiledSpanMatcher::match_names(const SpanData& span) const {
+  return service_.match(span.service) && name_.match(span.name) &&
+         resource_.match(span.resource);
+}
+
+bool CompiledSpanMatcher::match_tags(const SpanData& span) const {
+  return std::all_of(tags_.begin(), tags_.end(), [&](const auto& entry) {
+    const auto& [name, pattern] = entry;
+    auto found = span.tags.find(name);
+    return found != span.tags.end() && pattern.match(found->second);
+  });
+}
+
 Expected<SpanMatcher> SpanMatcher::from_json(const nlohmann::json& json) {
   SpanMatcher result;
 
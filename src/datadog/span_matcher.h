@@ -8,11 +8,20 @@
 // span matches the pattern.
 //
 // `SpanMatcher` is composed of glob patterns. See `glob.h`.
+//
+// This component also provides a class, `CompiledSpanMatcher`, that is a
+// `SpanMatcher` whose glob patterns are compiled (see `GlobPattern`).
+// `TraceSampler` and `SpanSampler` compile their rules when they are
+// constructed, so that matching a span against a rule doesn't reinterpret the
+// rule's patterns.
 
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "expected.h"
+#include "glob.h"
 #include "json_fwd.hpp"
 
 namespace datadog {
@@ -34,5 +43,24 @@ struct SpanMatcher {
   static Expected<SpanMatcher> from_json(const nlohmann::json&);
 };
 
+class CompiledSpanMatcher {
+  GlobPattern service_;
+  GlobPattern name_;
+  GlobPattern resource_;
+  std::vector<std::pair<std::string, GlobPattern>> tags_;
+
+ public:
+  explicit CompiledSpanMatcher(const SpanMatcher&);
+
+  // Return whether the specified span matches the `SpanMatcher` from which
+  // this object was compiled.  This is equivalent to `SpanMatcher::match`.
+  bool match(const SpanData&) const;
+  // Return whether the specified span's service, name, and resource match.
+  bool match_names(const SpanData&) const;
+  // Return whether the specified span's tags match.  This is true if there
+  // are no tag patterns.
+  bool match_tags(const SpanData&) const;
+};
+
 }  // namespace tracing
 }  // namespace datadog
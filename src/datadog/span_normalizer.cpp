@@ -0,0 +1,260 @@
+#include "span_normalizer.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "parse_util.h"
+#include "span_data.h"
+#include "span_limits.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr std::size_t max_name_bytes = 100;
+constexpr std::string_view replacement_character = "\xEF\xBF\xBD";
+
+bool is_ascii_letter(unsigned char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+bool is_ascii_digit(unsigned char ch) { return ch >= '0' && ch <= '9'; }
+
+bool is_continuation(unsigned char ch) { return (ch & 0xC0) == 0x80; }
+
+// Return the length of the valid UTF-8 sequence that begins at the specified
+// `begin`, which is before the specified `end`, or return zero if there is
+// no valid sequence there.
+std::size_t sequence_length(const unsigned char* begin,
+                            const unsigned char* end) {
+  const unsigned char lead = *begin;
+  if (lead < 0x80) {
+    return 1;
+  }
+  // The range of the second byte, which is narrower than that of other
+  // continuation bytes for some lead bytes, so as to exclude overlong
+  // encodings, surrogates, and code points beyond U+10FFFF.
+  unsigned char low = 0x80;
+  unsigned char high = 0xBF;
+  std::size_t length;
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    length = 2;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length = 3;
+    if (lead == 0xE0) {
+      low = 0xA0;
+    } else if (lead == 0xED) {
+      high = 0x9F;
+    }
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length = 4;
+    if (lead == 0xF0) {
+      low = 0x90;
+    } else if (lead == 0xF4) {
+      high = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+
+  if (std::size_t(end - begin) < length || begin[1] < low ||
+      begin[1] > high) {
+    return 0;
+  }
+  for (std::size_t i = 2; i < length; ++i) {
+    if (!is_continuation(begin[i])) {
+      return 0;
+    }
+  }
+  return length;
+}
+
+// Return the number of bytes at the beginning of the specified `text` that
+// are ASCII.  Eight bytes are examined at a time.
+std::size_t ascii_prefix(std::string_view text) {
+  constexpr std::uint64_t high_bits = 0x8080808080808080ULL;
+  std::size_t i = 0;
+  while (i + 8 <= text.size() &&
+         (load_lanes(text.data() + i) & high_bits) == 0) {
+    i += 8;
+  }
+  while (i < text.size() && static_cast<unsigned char>(text[i]) < 0x80) {
+    ++i;
+  }
+  return i;
+}
+
+// Return the specified `text` truncated to `max_name_bytes` and without
+// trailing underscores, or the specified `fallback` if nothing remains.
+std::string finish_name(std::string&& text, std::string_view fallback) {
+  text.resize(truncate_utf8(text, max_name_bytes).size());
+  while (!text.empty() && text.back() == '_') {
+    text.pop_back();
+  }
+  if (text.empty()) {
+    return std::string(fallback);
+  }
+  return std::move(text);
+}
+
+// Make the specified `value` valid UTF-8.
+void make_valid(std::string& value) {
+  if (!is_valid_utf8(value)) {
+    value = to_valid_utf8(value);
+  }
+}
+
+// Make the keys of the specified `tags` valid UTF-8.  A map whose keys are
+// all valid, as is nearly always so, is not modified.
+template <typename Map>
+void make_keys_valid(Map& tags) {
+  std::vector<std::string> invalid;
+  for (const auto& entry : tags) {
+    if (!is_valid_utf8(entry.first)) {
+      invalid.emplace_back(entry.first.view());
+    }
+  }
+  for (const std::string& key : invalid) {
+    auto value = std::move(tags.find(key)->second);
+    tags.erase(key);
+    tags.insert_or_assign(to_valid_utf8(key), std::move(value));
+  }
+}
+
+}  // namespace
+
+bool is_valid_utf8(std::string_view text) {
+  auto begin = reinterpret_cast<const unsigned char*>(text.data());
+  const auto end = begin + text.size();
+  begin += ascii_prefix(text);
+  while (begin != end) {
+    const std::size_t length = sequence_length(begin, end);
+    if (length == 0) {
+      return false;
+    }
+    begin += length;
+    // Skip any ASCII that follows, eight bytes at a time.
+    begin += ascii_prefix(
+        std::string_view(reinterpret_cast<const char*>(begin), end - begin));
+  }
+  return true;
+}
+
+std::string to_valid_utf8(std::string_view text) {
+  std::string result;
+  result.reserve(text.size());
+  auto begin = reinterpret_cast<const unsigned char*>(text.data());
+  const auto end = begin + text.size();
+  bool in_invalid_run = false;
+  while (begin != end) {
+    const std::size_t length = sequence_length(begin, end);
+    if (length == 0) {
+      if (!in_invalid_run) {
+        result += replacement_character;
+        in_invalid_run = true;
+      }
+      ++begin;
+      continue;
+    }
+    in_invalid_run = false;
+    result.append(reinterpret_cast<const char*>(begin), length);
+    begin += length;
+  }
+  return result;
+}
+
+std::string normalize_service(std::string_view name) {
+  std::string valid;
+  if (!is_valid_utf8(name)) {
+    valid = to_valid_utf8(name);
+    name = valid;
+  }
+
+  std::string result;
+  result.reserve(name.size());
+  for (const char raw : name) {
+    const auto ch = static_cast<unsigned char>(raw);
+    if (is_ascii_letter(ch) || ch >= 0x80) {
+      result += (ch >= 'A' && ch <= 'Z') ? char(ch - 'A' + 'a') : raw;
+    } else if (result.empty()) {
+      // Leading characters other than letters are removed.
+    } else if (is_ascii_digit(ch) || ch == '-' || ch == ':' || ch == '.' ||
+               ch == '/') {
+      result += raw;
+    } else if (result.back() != '_') {
+      result += '_';
+    }
+  }
+  return finish_name(std::move(result), "unnamed-service");
+}
+
+std::string normalize_operation_name(std::string_view name) {
+  std::string result;
+  result.reserve(name.size());
+  for (const char raw : name) {
+    const auto ch = static_cast<unsigned char>(raw);
+    if (is_ascii_letter(ch)) {
+      result += raw;
+    } else if (result.empty()) {
+      // Leading characters other than letters are removed.
+    } else if (is_ascii_digit(ch)) {
+      result += raw;
+    } else if (ch == '.') {
+      if (result.back() == '_') {
+        result.back() = '.';
+      } else {
+        result += '.';
+      }
+    } else if (result.back() != '_') {
+      result += '_';
+    }
+  }
+  return finish_name(std::move(result), "unnamed_operation");
+}
+
+SpanNormalizer::SpanNormalizer(std::size_t max_entries)
+    : max_entries_(max_entries) {}
+
+void SpanNormalizer::normalize_cached(
+    std::string& value, Cache& cache,
+    std::string (*normalize)(std::string_view)) {
+  if (max_entries_ == 0) {
+    value = normalize(value);
+    return;
+  }
+
+  auto found = cache.find(value);
+  if (found == cache.end()) {
+    if (cache.size() >= max_entries_) {
+      cache.clear();
+    }
+    found = cache.emplace(value, normalize(value)).first;
+  }
+  if (found->second != value) {
+    value = found->second;
+  }
+}
+
+void SpanNormalizer::normalize(SpanData& span) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    normalize_cached(span.service, services_, &normalize_service);
+    normalize_cached(span.name, names_, &normalize_operation_name);
+  }
+
+  make_valid(span.resource);
+  if (span.resource.empty()) {
+    span.resource = span.name;
+  }
+  make_valid(span.service_type);
+
+  for (auto& entry : span.tags) {
+    make_valid(entry.second);
+  }
+  make_keys_valid(span.tags);
+  make_keys_valid(span.numeric_tags);
+}
+
+}  // namespace tracing
+}  // namespace datadog
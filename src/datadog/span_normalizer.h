@@ -0,0 +1,88 @@
+#pragma once
+
+// This component provides a class, `SpanNormalizer`, that makes spans
+// acceptable to the Datadog Agent as they are, before they are encoded, so
+// that the Agent need not repair them and doesn't reject them.
+//
+// - Every string of a span (its service, name, resource, and type, and the
+//   names and values of its tags) is made valid UTF-8.  Invalid bytes would
+//   otherwise cause the Agent to reject the whole payload.  Each run of
+//   invalid bytes is replaced by U+FFFD, the replacement character.
+// - The service name is normalized by `normalize_service` and the operation
+//   name by `normalize_operation_name`, as the Agent would.
+// - An empty resource name is replaced by the operation name.
+//
+// Validating a string first checks it eight bytes at a time for bytes outside
+// of ASCII.  Strings that are ASCII, as most are, are not examined further.
+//
+// Applications use few distinct service and operation names, and so those are
+// normalized once and then kept in a cache, keyed by the raw name.  The cache
+// holds at most `max_entries` names, and is emptied when full.  A
+// `SpanNormalizer` may be used from multiple threads, though `DatadogAgent`
+// usually uses it only when flushing.
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+// Return whether the specified `text` is valid UTF-8.  Overlong encodings,
+// surrogates, and code points beyond U+10FFFF are not valid.
+bool is_valid_utf8(std::string_view text);
+
+// Return the specified `text` with each maximal run of bytes that isn't valid
+// UTF-8 replaced by U+FFFD.
+std::string to_valid_utf8(std::string_view text);
+
+// Return the specified service `name` normalized as the Datadog Agent
+// normalizes service names: ASCII letters are made lower case; characters
+// other than letters, digits, and any of "_-:./" become "_", with no two
+// in a row; leading characters other than letters, and trailing "_", are
+// removed; and the result is truncated to 100 bytes.  Characters outside of
+// ASCII are kept.  An empty result becomes "unnamed-service".
+std::string normalize_service(std::string_view name);
+
+// Return the specified operation `name` normalized as the Datadog Agent
+// normalizes operation names: characters other than letters, digits, and "."
+// become "_", with no two in a row, and "_" followed by "." becomes ".";
+// leading characters other than letters, and trailing "_", are removed; and
+// the result is truncated to 100 bytes.  An empty result becomes
+// "unnamed_operation".
+std::string normalize_operation_name(std::string_view name);
+
+class SpanNormalizer {
+ public:
+  static constexpr std::size_t default_max_entries = 1024;
+
+ private:
+  using Cache = std::unordered_map<std::string, std::string>;
+
+  std::mutex mutex_;
+  std::size_t max_entries_;
+  // `services_` and `names_` map raw names to their normalized forms.
+  Cache services_;
+  Cache names_;
+
+  // Replace the specified `value` with its normalized form, as computed by the
+  // specified `normalize` and cached in the specified `cache`.
+  void normalize_cached(std::string& value, Cache& cache,
+                        std::string (*normalize)(std::string_view));
+
+ public:
+  // Create a `SpanNormalizer` that caches at most the specified `max_entries`
+  // normalized service names and as many operation names.  If `max_entries`
+  // is zero, then nothing is cached.
+  explicit SpanNormalizer(std::size_t max_entries = default_max_entries);
+
+  // Modify the specified `span` as described above.
+  void normalize(SpanData& span);
+};
+
+}  // namespace tracing
+}  // namespace datadog
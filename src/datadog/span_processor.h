@@ -0,0 +1,73 @@
+#pragma once
+
+// This component provides an interface, `SpanProcessor`, through which an
+// application can modify finished spans before they are sent, such as to add
+// metadata about the host or to remove tags that contain personal data.
+//
+// `DatadogAgent` gives the trace chunks of each flush to its span processors
+// (see `DatadogAgentConfig::span_processors`) on the thread that flushes,
+// after span sampling and before the chunks are encoded.  The threads that
+// finish spans therefore do none of the processors' work.  Each processor
+// receives all of the flush's trace chunks in one call to `process`, in the
+// order in which the processors were configured.
+//
+// A processor may modify the spans of a chunk, and may drop spans by removing
+// them from the chunk or by resetting them.  A chunk left without spans is not
+// sent.  If statistics are computed by the tracer (see
+// `DatadogAgentConfig::stats_computation_enabled`), then they were computed
+// before the spans were processed, and so they include the dropped spans and
+// the spans' original names.
+//
+// A processor may declare the tags that it reads, with `tags_read`.  It then
+// receives only the chunks having a span with one of those tags, so that
+// chunks that a processor would ignore are not visited.  A processor that
+// declares no tags receives every chunk.
+//
+// A `SpanProcessor` is invoked by one thread at a time.
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_fwd.hpp"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+
+class SpanProcessor {
+ public:
+  // `Chunk` is a trace chunk given to `process`.  `spans` may be modified in
+  // place.  `origin` is the origin of the trace, which is encoded in each
+  // span, or is empty if there is none.
+  struct Chunk {
+    std::vector<std::unique_ptr<SpanData>>& spans;
+    std::string_view origin;
+  };
+
+  // Modify or drop the spans of the specified `chunks`.  `chunks` is never
+  // empty, and the spans of a chunk are never empty.
+  virtual void process(const std::vector<Chunk>& chunks) = 0;
+
+  // Return the names of the tags, string or numeric, that this processor
+  // reads.  If any are returned, then `process` is given only the chunks
+  // having a span with at least one of them.  By default, none are returned.
+  // `DatadogAgent` calls this once, when it's created.
+  virtual std::vector<std::string> tags_read() const { return {}; }
+
+  // Return a JSON representation of this object's configuration.  The JSON
+  // representation is an object with the following properties:
+  //
+  // - "type" is the unmangled, qualified name of the most-derived class, e.g.
+  //   "myapp::PIIScrubber".
+  // - "config" is an object containing this object's configuration.  "config"
+  //   may be omitted if the derived class has no configuration.
+  virtual nlohmann::json config_json() const = 0;
+
+  virtual ~SpanProcessor() {}
+};
+
+}  // namespace tracing
+}  // namespace datadog
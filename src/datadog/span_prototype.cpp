@@ -0,0 +1,23 @@
+#include "span_prototype.h"
+
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+
+SpanPrototype::SpanPrototype(const SpanDefaults& defaults,
+                             const SpanLimits& limits)
+    : defaults(defaults),
+      tags(defaults.tags),
+      limits(limits),
+      projection(limits.allowed_tags, limits.denied_tags) {
+  if (!defaults.environment.empty()) {
+    tags.insert_or_assign(tags::environment, defaults.environment);
+  }
+  if (!defaults.version.empty()) {
+    tags.insert_or_assign(tags::version, defaults.version);
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,38 @@
+#pragma once
+
+// This component provides a `struct`, `SpanPrototype`, that is a tracer's
+// `SpanDefaults` together with the tags that a span has if its `SpanConfig`
+// overrides neither the environment nor the version: the default tags, and
+// the "env" and "version" tags.  It also holds the tracer's `SpanLimits`,
+// which the spans apply as their properties are set, and the `TagProjection`
+// compiled from them.
+//
+// `Tracer` builds a `SpanPrototype` once, and shares it with its
+// `TraceSegment`s.  `SpanData::apply_config` then copies the prototype's
+// `tags` into most spans, rather than merging the default tags with the
+// environment and version for each span.  Copying a `FlatMap` copies its
+// index, if it has one, so even a large set of default tags (e.g. from
+// `DD_TAGS`) is copied without being hashed again.
+
+#include <string>
+
+#include "flat_map.h"
+#include "span_defaults.h"
+#include "span_limits.h"
+#include "tag_projection.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanPrototype {
+  SpanDefaults defaults;
+  FlatMap<std::string> tags;
+  SpanLimits limits;
+  TagProjection projection;
+
+  explicit SpanPrototype(const SpanDefaults& defaults,
+                         const SpanLimits& limits = SpanLimits{});
+};
+
+}  // namespace tracing
+}  // namespace datadog
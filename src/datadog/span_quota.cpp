@@ -0,0 +1,127 @@
+#include "span_quota.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "json.hpp"
+#include "limiter.h"
+#include "span_data.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+Error invalid(std::string_view input, std::string_view reason) {
+  std::string message;
+  message += "Invalid span quotas ";
+  message += input;
+  message += ": ";
+  message += reason;
+  return Error{Error::INVALID_SPAN_QUOTAS, std::move(message)};
+}
+
+}  // namespace
+
+nlohmann::json to_json(const SpanQuotaConfig& quota) {
+  auto result = nlohmann::json::object({
+      {"service", quota.service},
+      {"max_spans_per_second", quota.max_spans_per_second},
+  });
+  if (quota.resource) {
+    result["resource"] = *quota.resource;
+  }
+  return result;
+}
+
+Expected<std::vector<SpanQuotaConfig>> parse_span_quotas(
+    std::string_view input) {
+  nlohmann::json json;
+  try {
+    json = nlohmann::json::parse(input);
+  } catch (const nlohmann::json::parse_error& error) {
+    return invalid(input, error.what());
+  }
+  if (!json.is_array()) {
+    return invalid(input, "expected an array of objects.");
+  }
+
+  std::vector<SpanQuotaConfig> result;
+  for (const auto& json_quota : json) {
+    if (!json_quota.is_object()) {
+      return invalid(input, "expected an array of objects.");
+    }
+    SpanQuotaConfig& quota = result.emplace_back();
+    for (const auto& [key, value] : json_quota.items()) {
+      if (key == "service" && value.is_string()) {
+        quota.service = value.get<std::string>();
+      } else if (key == "resource" && value.is_string()) {
+        quota.resource = value.get<std::string>();
+      } else if (key == "max_spans_per_second" && value.is_number()) {
+        quota.max_spans_per_second = value.get<double>();
+      } else {
+        std::string reason;
+        reason += "unexpected property \"";
+        reason += key;
+        reason += "\" having value ";
+        reason += value.dump();
+        reason += '.';
+        return invalid(input, reason);
+      }
+    }
+  }
+  return result;
+}
+
+SpanQuotas::SpanQuotas(const std::vector<SpanQuotaConfig>& config,
+                       const Clock& clock)
+    : config_(config) {
+  for (const SpanQuotaConfig& quota_config : config) {
+    auto& quotas = quotas_[quota_config.service];
+    Quota quota;
+    quota.resource = quota_config.resource;
+    quota.limiter =
+        std::make_unique<Limiter>(clock, quota_config.max_spans_per_second);
+    quota.max_tokens =
+        std::max(1, int(std::ceil(quota_config.max_spans_per_second)));
+    quotas.push_back(std::move(quota));
+  }
+  // Resource quotas come before service quotas, so that a chunk denied by its
+  // resource's quota doesn't consume its service's.
+  for (auto& [service, quotas] : quotas_) {
+    (void)service;
+    std::stable_partition(quotas.begin(), quotas.end(), [](const Quota& quota) {
+      return quota.resource.has_value();
+    });
+  }
+}
+
+SpanQuotas::~SpanQuotas() = default;
+
+bool SpanQuotas::allow(const SpanData& chunk_root, std::size_t num_spans) {
+  const auto found = quotas_.find(chunk_root.service);
+  if (found == quotas_.end()) {
+    return true;
+  }
+  for (Quota& quota : found->second) {
+    if (quota.resource && *quota.resource != chunk_root.resource) {
+      continue;
+    }
+    const int tokens = int(std::min(num_spans, std::size_t(quota.max_tokens)));
+    if (!quota.limiter->allow(tokens).allowed) {
+      return false;
+    }
+  }
+  return true;
+}
+
+nlohmann::json SpanQuotas::config_json() const {
+  auto result = nlohmann::json::array();
+  for (const SpanQuotaConfig& quota : config_) {
+    result.push_back(to_json(quota));
+  }
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,86 @@
+#pragma once
+
+// This component provides a `class`, `SpanQuotas`, that limits the rate at
+// which each service, and optionally each of a service's resources, sends
+// spans to the collector.  See `TracerConfig::span_quotas`.
+//
+// Sampling decides which traces are kept according to their priority, which
+// an upstream service might have decided.  Quotas instead cap the spans that
+// this tracer sends on behalf of each service, whatever their priority, so
+// that one noisy service sharing the tracer and the Datadog Agent can't crowd
+// out the others.
+//
+// A quota applies to each trace chunk as a whole, so that no span is sent
+// without its parent.  A trace segment consults the quotas just before it
+// gives a trace chunk to the collector.  The chunk is counted, one token per
+// span, against each quota that matches its first span's service and
+// resource in turn, the resource's quota first, and is dropped as soon as one
+// of them has too few tokens left.  Each quota is a `Limiter` (see
+// `limiter.h`), whose bucket holds a second's worth of spans.  A chunk larger
+// than that is admitted only when the bucket is full, and then empties it.
+//
+// `SpanQuotas` is immutable once constructed, apart from its limiters, which
+// don't lock, and so enforcing quotas doesn't lock.
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "clock.h"
+#include "expected.h"
+#include "json_fwd.hpp"
+
+namespace datadog {
+namespace tracing {
+
+class Limiter;
+struct SpanData;
+
+struct SpanQuotaConfig {
+  // The service whose trace chunks are limited.
+  std::string service;
+  // If set, only trace chunks having this resource are limited, separately
+  // from the service's other resources.
+  std::optional<std::string> resource;
+  // The maximum average number of spans per second.  It must be positive.
+  double max_spans_per_second = 0;
+};
+
+nlohmann::json to_json(const SpanQuotaConfig&);
+
+// Return the span quotas described by the specified `input`, which is a JSON
+// array of objects having the properties "service", "resource" (optional),
+// and "max_spans_per_second", or return an error.
+Expected<std::vector<SpanQuotaConfig>> parse_span_quotas(
+    std::string_view input);
+
+class SpanQuotas {
+  struct Quota {
+    std::optional<std::string> resource;
+    std::unique_ptr<Limiter> limiter;
+    int max_tokens;
+  };
+
+  std::vector<SpanQuotaConfig> config_;
+  // `quotas_` maps each service to its quotas: first those of particular
+  // resources, if any, and then that of the whole service, if any.
+  std::unordered_map<std::string, std::vector<Quota>> quotas_;
+
+ public:
+  SpanQuotas(const std::vector<SpanQuotaConfig>& config, const Clock& clock);
+  ~SpanQuotas();
+
+  // Return whether a trace chunk whose first span is the specified
+  // `chunk_root`, and that has the specified `num_spans` spans, is within
+  // the quotas that match it.  If so, count the spans against those quotas.
+  bool allow(const SpanData& chunk_root, std::size_t num_spans);
+
+  nlohmann::json config_json() const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
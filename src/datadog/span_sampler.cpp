@@ -5,20 +5,22 @@
 #include "sampling_priority.h"
 #include "sampling_util.h"
 #include "span_data.h"
+#include "tags.h"
 
 namespace datadog {
 namespace tracing {
 
-SpanSampler::SynchronizedLimiter::SynchronizedLimiter(const Clock& clock,
-                                                      double max_per_second)
-    : limiter(clock, max_per_second) {}
-
 SpanSampler::Rule::Rule(const FinalizedSpanSamplerConfig::Rule& rule,
                         const Clock& clock)
     : FinalizedSpanSamplerConfig::Rule(rule),
-      limiter_(max_per_second ? std::make_unique<SynchronizedLimiter>(
-                                    clock, *max_per_second)
-                              : nullptr) {}
+      matcher_(rule),
+      limiter_(max_per_second
+                   ? std::make_unique<Limiter>(clock, *max_per_second)
+                   : nullptr) {}
+
+const CompiledSpanMatcher& SpanSampler::Rule::matcher() const {
+  return matcher_;
+}
 
 SamplingDecision SpanSampler::Rule::decide(const SpanData& span) {
   SamplingDecision decision;
@@ -38,8 +40,7 @@ SamplingDecision SpanSampler::Rule::decide(const SpanData& span) {
     return decision;
   }
 
-  std::lock_guard<std::mutex> lock(limiter_->mutex);
-  const auto result = limiter_->limiter.allow();
+  const auto result = limiter_->allow();
   if (result.allowed) {
     decision.priority = int(SamplingPriority::USER_KEEP);
   } else {
@@ -50,25 +51,71 @@ SamplingDecision SpanSampler::Rule::decide(const SpanData& span) {
   return decision;
 }
 
-SpanSampler::SpanSampler(const FinalizedSpanSamplerConfig& config,
-                         const Clock& clock) {
+std::shared_ptr<SpanSampler::RuleSet> SpanSampler::make_rule_set(
+    const FinalizedSpanSamplerConfig& config, const Clock& clock) {
+  auto rule_set = std::make_shared<RuleSet>();
   for (const auto& rule : config.rules) {
-    rules_.push_back(Rule{rule, clock});
+    rule_set->rules.push_back(Rule{rule, clock});
   }
+  return rule_set;
 }
 
-SpanSampler::Rule* SpanSampler::match(const SpanData& span) {
-  const auto found = std::find_if(rules_.begin(), rules_.end(),
-                                  [&](Rule& rule) { return rule.match(span); });
-  if (found != rules_.end()) {
-    return &*found;
+SpanSampler::SpanSampler(const FinalizedSpanSamplerConfig& config,
+                         const Clock& clock)
+    : rule_set_(make_rule_set(config, clock)), clock_(clock) {}
+
+std::shared_ptr<SpanSampler::Rule> SpanSampler::match(const SpanData& span) {
+  auto rule_set =
+      std::atomic_load_explicit(&rule_set_, std::memory_order_acquire);
+  auto& rules = rule_set->rules;
+  const std::size_t found = rule_set->match_cache.find(
+      span, rules.size(), [&](std::size_t i) -> const CompiledSpanMatcher& {
+        return rules[i].matcher();
+      });
+  if (found != rules.size()) {
+    // The rule shares ownership of its rule set.
+    return std::shared_ptr<Rule>(std::move(rule_set), &rules[found]);
   }
   return nullptr;
 }
 
+bool SpanSampler::has_rules() const {
+  return !std::atomic_load_explicit(&rule_set_, std::memory_order_acquire)
+              ->rules.empty();
+}
+
+void SpanSampler::update(const FinalizedSpanSamplerConfig& config) {
+  std::atomic_store_explicit(&rule_set_, make_rule_set(config, clock_),
+                             std::memory_order_release);
+}
+
+void SpanSampler::sample(const std::vector<std::unique_ptr<SpanData>>& spans) {
+  for (const auto& span_ptr : spans) {
+    SpanData& span = *span_ptr;
+    const auto rule = match(span);
+    if (!rule) {
+      continue;
+    }
+    const SamplingDecision decision = rule->decide(span);
+    if (decision.priority <= 0) {
+      continue;
+    }
+    span.numeric_tags[tags::internal::span_sampling_mechanism] =
+        *decision.mechanism;
+    span.numeric_tags[tags::internal::span_sampling_rule_rate] =
+        *decision.configured_rate;
+    if (decision.limiter_max_per_second) {
+      span.numeric_tags[tags::internal::span_sampling_limit] =
+          *decision.limiter_max_per_second;
+    }
+  }
+}
+
 nlohmann::json SpanSampler::config_json() const {
+  const auto rule_set =
+      std::atomic_load_explicit(&rule_set_, std::memory_order_acquire);
   std::vector<nlohmann::json> rules;
-  for (const auto& rule : rules_) {
+  for (const auto& rule : rule_set->rules) {
     rules.push_back(to_json(rule));
   }
 
@@ -17,48 +17,69 @@
 //
 // See `span_matcher.h` for a description of how spans are matched by span
 // sampling rules.
+//
+// `update` replaces the rules while the sampler is in use, e.g. via
+// `Tracer::update_sampling`.  A rule returned by `match` remains valid for as
+// long as the caller holds it, even if the rules are replaced meanwhile.
 
 #include <memory>
-#include <mutex>
+#include <vector>
 
 #include "clock.h"
 #include "json_fwd.hpp"
 #include "limiter.h"
+#include "rule_match_cache.h"
 #include "sampling_decision.h"
 #include "span_sampler_config.h"
+#include "span_matcher.h"
 
 namespace datadog {
 namespace tracing {
 
 class SpanSampler {
  public:
-  struct SynchronizedLimiter {
-    std::mutex mutex;
-    Limiter limiter;
-
-    SynchronizedLimiter(const Clock&, double max_per_second);
-  };
-
   class Rule : public FinalizedSpanSamplerConfig::Rule {
-    std::unique_ptr<SynchronizedLimiter> limiter_;
+    CompiledSpanMatcher matcher_;
+    std::unique_ptr<Limiter> limiter_;
 
    public:
     explicit Rule(const FinalizedSpanSamplerConfig::Rule&, const Clock&);
 
+    // Return this rule's compiled span matcher.
+    const CompiledSpanMatcher& matcher() const;
+
     // Return a sampling decision for the specified span.
     SamplingDecision decide(const SpanData&);
   };
 
  private:
-  std::vector<Rule> rules_;
+  // `RuleSet` is the part of the configuration that `update` replaces.
+  struct RuleSet {
+    std::vector<Rule> rules;
+    RuleMatchCache match_cache;
+  };
+  // `rule_set_` is read and replaced using the atomic `shared_ptr` functions.
+  std::shared_ptr<RuleSet> rule_set_;
+  Clock clock_;
+
+  static std::shared_ptr<RuleSet> make_rule_set(
+      const FinalizedSpanSamplerConfig& config, const Clock& clock);
 
  public:
   explicit SpanSampler(const FinalizedSpanSamplerConfig& config,
                        const Clock& clock);
 
-  // Return a pointer to the first `Rule` that the specified span matches, or
-  // return null if there is no match.
-  Rule* match(const SpanData&);
+  // Return the first `Rule` that the specified span matches, or return null
+  // if there is no match.
+  std::shared_ptr<Rule> match(const SpanData&);
+  // Return whether any rules are configured.  If not, then no span matches.
+  bool has_rules() const;
+  // Replace this sampler's rules with those of the specified `config`.
+  void update(const FinalizedSpanSamplerConfig& config);
+  // Apply span sampling to the specified `spans` of a dropped trace: tag each
+  // span that a matching rule keeps with the rule's sampling mechanism, rate,
+  // and limit.
+  void sample(const std::vector<std::unique_ptr<SpanData>>& spans);
 
   nlohmann::json config_json() const;
 };
@@ -1,5 +1,12 @@
 #include "span_sampler_config.h"
 
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <cmath>
 #include <fstream>
 #include <sstream>
@@ -9,6 +16,7 @@
 #include "expected.h"
 #include "json.hpp"
 #include "logger.h"
+#include "sampling_rule_parser.h"
 
 namespace datadog {
 namespace tracing {
@@ -19,6 +27,21 @@ namespace {
 Expected<std::vector<SpanSamplerConfig::Rule>> parse_rules(
     std::string_view rules_raw, std::string_view env_var) {
   std::vector<SpanSamplerConfig::Rule> rules;
+  if (auto parsed = parse_sampling_rules(rules_raw, true)) {
+    rules.reserve(parsed->size());
+    for (ParsedSamplingRule &parsed_rule : *parsed) {
+      SpanSamplerConfig::Rule &rule = rules.emplace_back();
+      static_cast<SpanMatcher &>(rule) = std::move(parsed_rule.matcher);
+      if (parsed_rule.sample_rate) {
+        rule.sample_rate = *parsed_rule.sample_rate;
+      }
+      rule.max_per_second = parsed_rule.max_per_second;
+    }
+    return rules;
+  }
+
+  // The rules are invalid, or at least unusual.  Parse them as a JSON
+  // document, so that any error can be described.
   nlohmann::json json_rules;
 
   try {
@@ -129,6 +152,78 @@ Expected<std::vector<SpanSamplerConfig::Rule>> parse_rules(
   return rules;
 }
 
+// `RulesFile` is the contents of a span sampling rules file.  Where possible,
+// the file is mapped into memory rather than copied.
+class RulesFile {
+  std::string_view contents_;
+  std::string buffer_;
+#ifndef _MSC_VER
+  void *mapping_ = nullptr;
+  std::size_t mapping_size_ = 0;
+#endif
+
+  // Read the file at the specified `path` into `buffer_`.  Return whether the
+  // file was read.
+  bool copy(const std::string &path) {
+    std::ifstream file(path);
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    if (!file) {
+      return false;
+    }
+    buffer_ = std::move(stream).str();
+    contents_ = buffer_;
+    return true;
+  }
+
+ public:
+  RulesFile() = default;
+  RulesFile(const RulesFile &) = delete;
+  RulesFile &operator=(const RulesFile &) = delete;
+
+  ~RulesFile() {
+#ifndef _MSC_VER
+    if (mapping_) {
+      ::munmap(mapping_, mapping_size_);
+    }
+#endif
+  }
+
+  // Load the file at the specified `path`.  Return the name of the operation
+  // that failed, i.e. "open" or "read", or return null on success.
+  const char *load(const std::string &path) {
+#ifndef _MSC_VER
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return "open";
+    }
+    struct stat status;
+    if (::fstat(fd, &status) == 0 && S_ISREG(status.st_mode) &&
+        status.st_size > 0) {
+      const auto size = std::size_t(status.st_size);
+      void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        ::close(fd);
+        mapping_ = data;
+        mapping_size_ = size;
+        contents_ = std::string_view(static_cast<const char *>(data), size);
+        return nullptr;
+      }
+    }
+    // Empty files, files that aren't regular (such as pipes), and files that
+    // can't be mapped are read instead.
+    ::close(fd);
+#else
+    if (!std::ifstream(path)) {
+      return "open";
+    }
+#endif
+    return copy(path) ? nullptr : "read";
+  }
+
+  std::string_view contents() const { return contents_; }
+};
+
 }  // namespace
 
 SpanSamplerConfig::Rule::Rule(const SpanMatcher &base) : SpanMatcher(base) {}
@@ -179,19 +274,13 @@ Expected<FinalizedSpanSamplerConfig> finalize_config(
         return Error{Error::SPAN_SAMPLING_RULES_FILE_IO, std::move(message)};
       };
 
-      std::ifstream file(span_rules_file);
-      if (!file) {
-        return file_error("open");
-      }
-
-      std::ostringstream rules_stream;
-      rules_stream << file.rdbuf();
-      if (!file) {
-        return file_error("read");
+      RulesFile file;
+      if (const char *operation = file.load(span_rules_file)) {
+        return file_error(operation);
       }
 
       auto maybe_rules = parse_rules(
-          rules_stream.str(), name(environment::DD_SPAN_SAMPLING_RULES_FILE));
+          file.contents(), name(environment::DD_SPAN_SAMPLING_RULES_FILE));
       if (auto *error = maybe_rules.if_error()) {
         std::string prefix;
         prefix += "With ";
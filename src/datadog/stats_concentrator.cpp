@@ -0,0 +1,296 @@
+#include "stats_concentrator.h"
+
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+#include "msgpack.h"
+#include "parse_util.h"
+#include "span_data.h"
+#include "span_defaults.h"
+#include "tags.h"
+#include "version.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+std::uint64_t nanoseconds(std::chrono::system_clock::time_point time) {
+  const auto count = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         time.time_since_epoch())
+                         .count();
+  return std::uint64_t(std::max<decltype(count)>(count, 0));
+}
+
+std::uint64_t nanoseconds(Duration duration) {
+  const auto count =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  return std::uint64_t(std::max<decltype(count)>(count, 0));
+}
+
+// Return the HTTP status code in the specified `span`'s tags, or return zero
+// if there isn't one.
+std::uint32_t http_status_code(const SpanData& span) {
+  const auto found = span.tags.find(tags::http_status_code);
+  if (found == span.tags.end()) {
+    return 0;
+  }
+  const auto status = parse_uint64(found->second, 10);
+  if (!status || *status > 999) {
+    return 0;
+  }
+  return std::uint32_t(*status);
+}
+
+// Return whether the specified `span` is from a synthetic test, according to
+// its origin tag, or, if it has none, the specified `origin`.
+bool is_synthetics(const SpanData& span, std::string_view origin) {
+  const auto found = span.tags.find(tags::internal::origin);
+  if (found != span.tags.end()) {
+    origin = found->second;
+  }
+  return starts_with(origin, "synthetics");
+}
+
+bool is_measured(const SpanData& span) {
+  const auto found = span.numeric_tags.find(tags::internal::measured);
+  return found != span.numeric_tags.end() && found->second == 1;
+}
+
+Expected<void> msgpack_encode(std::string& destination,
+                              const StatsConcentrator::Key& key,
+                              const StatsConcentrator::Aggregate& aggregate) {
+  std::string ok_summary;
+  aggregate.ok_durations.protobuf_encode(ok_summary);
+  std::string error_summary;
+  aggregate.error_durations.protobuf_encode(error_summary);
+
+  // clang-format off
+  return msgpack::pack_map(
+      destination,
+      "Service", [&](auto& destination) {
+        return msgpack::pack_string(destination, key.service);
+      },
+      "Name", [&](auto& destination) {
+        return msgpack::pack_string(destination, key.name);
+      },
+      "Resource", [&](auto& destination) {
+        return msgpack::pack_string(destination, key.resource);
+      },
+      "HTTPStatusCode", [&](auto& destination) {
+        msgpack::pack_integer(destination,
+                              std::uint64_t(key.http_status_code));
+        return Expected<void>{};
+      },
+      "Type", [&](auto& destination) {
+        return msgpack::pack_string(destination, key.type);
+      },
+      "Synthetics", [&](auto& destination) {
+        msgpack::pack_bool(destination, key.synthetics);
+        return Expected<void>{};
+      },
+      "Hits", [&](auto& destination) {
+        msgpack::pack_integer(destination, aggregate.hits);
+        return Expected<void>{};
+      },
+      "TopLevelHits", [&](auto& destination) {
+        msgpack::pack_integer(destination, aggregate.top_level_hits);
+        return Expected<void>{};
+      },
+      "Errors", [&](auto& destination) {
+        msgpack::pack_integer(destination, aggregate.errors);
+        return Expected<void>{};
+      },
+      "Duration", [&](auto& destination) {
+        msgpack::pack_integer(destination, aggregate.duration);
+        return Expected<void>{};
+      },
+      "OkSummary", [&](auto& destination) {
+        return msgpack::pack_binary(destination, ok_summary);
+      },
+      "ErrorSummary", [&](auto& destination) {
+        return msgpack::pack_binary(destination, error_summary);
+      });
+  // clang-format on
+}
+
+}  // namespace
+
+bool StatsConcentrator::Key::operator==(const Key& other) const {
+  return service == other.service && name == other.name &&
+         resource == other.resource && type == other.type &&
+         http_status_code == other.http_status_code &&
+         synthetics == other.synthetics;
+}
+
+std::size_t StatsConcentrator::KeyHash::operator()(const Key& key) const {
+  const std::hash<std::string_view> hash;
+  std::size_t result = hash(key.service);
+  const auto combine = [&](std::size_t value) {
+    result ^= value + 0x9e3779b9 + (result << 6) + (result >> 2);
+  };
+  combine(hash(key.name));
+  combine(hash(key.resource));
+  combine(hash(key.type));
+  combine(key.http_status_code);
+  combine(key.synthetics);
+  return result;
+}
+
+StatsConcentrator::StatsConcentrator(const SpanDefaults& defaults,
+                                     std::chrono::nanoseconds bucket_duration)
+    : service_(defaults.service),
+      environment_(defaults.environment),
+      version_(defaults.version),
+      bucket_duration_(bucket_duration),
+      oldest_start_(0),
+      sequence_(0) {}
+
+void StatsConcentrator::add(const std::vector<std::unique_ptr<SpanData>>& spans,
+                            std::string_view origin) {
+  // A span is top level if its parent is not in the trace chunk, or if its
+  // parent has a different service.  A trace chunk that's part of a partially
+  // flushed trace segment instead marks the spans whose parents are not in the
+  // chunk.  See `TraceSegment::mark_top_level`.
+  std::unordered_map<std::uint64_t, const std::string*> services;
+  if (spans.size() > 1) {
+    services.reserve(spans.size());
+    for (const auto& span_ptr : spans) {
+      services.emplace(span_ptr->span_id, &span_ptr->service);
+    }
+  }
+
+  // Build the keys before taking the lock, since doing so allocates.
+  struct Hit {
+    std::uint64_t end;
+    Key key;
+    std::uint64_t duration;
+    bool error;
+    bool top_level;
+  };
+  std::vector<Hit> hits;
+  for (const auto& span_ptr : spans) {
+    const SpanData& span = *span_ptr;
+    bool top_level = true;
+    if (const auto marked = span.numeric_tags.find(tags::internal::top_level);
+        marked != span.numeric_tags.end()) {
+      top_level = marked->second == 1;
+    } else if (span.parent_id != 0) {
+      const auto found = services.find(span.parent_id);
+      top_level = found == services.end() || *found->second != span.service;
+    }
+    if (!top_level && !is_measured(span)) {
+      continue;
+    }
+    const auto duration = nanoseconds(span.duration);
+    hits.push_back(Hit{nanoseconds(span.start.wall) + duration,
+                       Key{span.service, span.name, span.resource,
+                           span.service_type, http_status_code(span),
+                           is_synthetics(span, origin)},
+                       duration, span.error, top_level});
+  }
+  if (hits.empty()) {
+    return;
+  }
+
+  const auto bucket_nanoseconds = std::uint64_t(bucket_duration_.count());
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& hit : hits) {
+    const auto start =
+        std::max(hit.end - hit.end % bucket_nanoseconds, oldest_start_);
+    Aggregate& aggregate = buckets_[start][std::move(hit.key)];
+    ++aggregate.hits;
+    aggregate.top_level_hits += hit.top_level;
+    aggregate.duration += hit.duration;
+    if (hit.error) {
+      ++aggregate.errors;
+      aggregate.error_durations.add(double(hit.duration));
+    } else {
+      aggregate.ok_durations.add(double(hit.duration));
+    }
+  }
+}
+
+Expected<std::size_t> StatsConcentrator::flush(
+    std::string& destination, std::chrono::system_clock::time_point now,
+    bool all) {
+  const auto bucket_nanoseconds = std::uint64_t(bucket_duration_.count());
+  const auto now_nanoseconds = nanoseconds(now);
+  std::map<std::uint64_t, Bucket> flushed;
+  std::uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The bucket that contains `now` hasn't ended, and spans that end before
+    // it are counted in it from now on.
+    const auto current = now_nanoseconds - now_nanoseconds % bucket_nanoseconds;
+    auto end = all ? buckets_.end() : buckets_.lower_bound(current);
+    if (!all) {
+      oldest_start_ = std::max(oldest_start_, current);
+    }
+    if (end == buckets_.begin()) {
+      return std::size_t(0);
+    }
+    while (buckets_.begin() != end) {
+      flushed.insert(buckets_.extract(buckets_.begin()));
+    }
+    sequence = ++sequence_;
+  }
+
+  // clang-format off
+  auto result = msgpack::pack_map(
+      destination,
+      "Env", [&](auto& destination) {
+        return msgpack::pack_string(destination, environment_);
+      },
+      "Version", [&](auto& destination) {
+        return msgpack::pack_string(destination, version_);
+      },
+      "Service", [&](auto& destination) {
+        return msgpack::pack_string(destination, service_);
+      },
+      "Lang", [&](auto& destination) {
+        return msgpack::pack_string(destination, "cpp");
+      },
+      "TracerVersion", [&](auto& destination) {
+        return msgpack::pack_string(destination, tracer_version);
+      },
+      "Sequence", [&](auto& destination) {
+        msgpack::pack_integer(destination, sequence);
+        return Expected<void>{};
+      },
+      "Stats", [&](auto& destination) {
+        return msgpack::pack_array(destination, flushed,
+                                   [&](auto& destination, const auto& entry) {
+          const auto& [start, bucket] = entry;
+          return msgpack::pack_map(
+              destination,
+              "Start", [&](auto& destination) {
+                msgpack::pack_integer(destination, start);
+                return Expected<void>{};
+              },
+              "Duration", [&](auto& destination) {
+                msgpack::pack_integer(destination, bucket_nanoseconds);
+                return Expected<void>{};
+              },
+              "Stats", [&](auto& destination) {
+                Expected<void> result = msgpack::pack_array(destination,
+                                                            bucket.size());
+                for (const auto& [key, aggregate] : bucket) {
+                  if (result) {
+                    result = msgpack_encode(destination, key, aggregate);
+                  }
+                }
+                return result;
+              });
+        });
+      });
+  // clang-format on
+  if (auto* error = result.if_error()) {
+    return std::move(*error);
+  }
+  return flushed.size();
+}
+
+}  // namespace tracing
+}  // namespace datadog
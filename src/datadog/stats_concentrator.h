@@ -0,0 +1,119 @@
+#pragma once
+
+// This component provides a class, `StatsConcentrator`, that computes APM
+// statistics ("trace metrics") from finished spans, so that the Datadog Agent
+// doesn't need to receive every trace in order to compute them.
+//
+// When stats computation is enabled, `DatadogAgent` adds every trace chunk to
+// a `StatsConcentrator` before deciding whether to send the chunk, and then
+// drops the chunks whose sampling priority is `AUTO_DROP` or `USER_DROP`.
+// The statistics are sent to the Agent's "/v0.6/stats" endpoint.  See
+// `datadog_agent.h`.
+//
+// Statistics are computed for spans that are either "top level" (the local
+// root, or a span whose parent has a different service) or measured (having
+// the "_dd.measured" numeric tag).  If a span has the "_dd.top_level" numeric
+// tag, then that tag determines whether the span is top level.  Spans are
+// aggregated by their service, name, resource, HTTP status code, type, and
+// whether they are from a synthetics test.  Each aggregate counts hits, top
+// level hits, and errors, and sums durations.  It also contains a `DDSketch`
+// of the durations of successful spans, and another of the durations of
+// errored spans.
+//
+// Aggregates are kept in time buckets according to the spans' end times.
+// `flush` encodes the buckets that have elapsed.  A span that ends in a bucket
+// that has already been flushed, such as a span of a long trace, is counted in
+// the oldest bucket that hasn't yet been flushed.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ddsketch.h"
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+struct SpanData;
+struct SpanDefaults;
+
+class StatsConcentrator {
+ public:
+  // `Key` is what spans are aggregated by.
+  struct Key {
+    std::string service;
+    std::string name;
+    std::string resource;
+    std::string type;
+    std::uint32_t http_status_code = 0;
+    bool synthetics = false;
+
+    bool operator==(const Key&) const;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key&) const;
+  };
+
+  struct Aggregate {
+    std::uint64_t hits = 0;
+    std::uint64_t top_level_hits = 0;
+    std::uint64_t errors = 0;
+    // `duration` is the sum of the spans' durations, in nanoseconds.
+    std::uint64_t duration = 0;
+    DDSketch ok_durations;
+    DDSketch error_durations;
+  };
+
+ private:
+  using Bucket = std::unordered_map<Key, Aggregate, KeyHash>;
+
+  std::string service_;
+  std::string environment_;
+  std::string version_;
+  std::chrono::nanoseconds bucket_duration_;
+  // `mutex_` protects the members below.
+  std::mutex mutex_;
+  // `buckets_` are indexed by their start times, in nanoseconds since the
+  // Unix epoch.
+  std::map<std::uint64_t, Bucket> buckets_;
+  // `oldest_start_` is the start time of the oldest bucket that hasn't been
+  // flushed.
+  std::uint64_t oldest_start_;
+  // `sequence_` is the number of payloads flushed so far.
+  std::uint64_t sequence_;
+
+ public:
+  // Create a concentrator whose buckets have the specified `bucket_duration`,
+  // and whose payloads describe the service, environment, and version in the
+  // specified `defaults`.
+  explicit StatsConcentrator(
+      const SpanDefaults& defaults,
+      std::chrono::nanoseconds bucket_duration = std::chrono::seconds(10));
+
+  // Aggregate the specified `spans`, which are a trace chunk.  If the
+  // optionally specified `origin` is not empty, then it's the origin of spans
+  // that don't have an origin tag (see `Collector::send_with_origin`).
+  void add(const std::vector<std::unique_ptr<SpanData>>& spans,
+           std::string_view origin = {});
+
+  // Remove the buckets that ended at or before the specified `now`, and
+  // append a MessagePack encoded stats payload containing them to the
+  // specified `destination`.  If `all` is true, then remove all of the
+  // buckets.  If there are no buckets to remove, then append nothing.  Return
+  // the number of buckets removed, or return an error if encoding fails.
+  Expected<std::size_t> flush(std::string& destination,
+                              std::chrono::system_clock::time_point now,
+                              bool all = false);
+};
+
+}  // namespace tracing
+}  // namespace datadog
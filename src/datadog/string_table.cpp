@@ -0,0 +1,39 @@
+#include "string_table.h"
+
+#include "msgpack.h"
+
+namespace datadog {
+namespace tracing {
+
+StringTable::StringTable() { index(""); }
+
+std::uint32_t StringTable::index(std::string_view value) {
+  const auto found = indices_.find(value);
+  if (found != indices_.end()) {
+    return found->second;
+  }
+
+  const auto index = std::uint32_t(strings_.size());
+  const std::string& copy = strings_.emplace_back(value);
+  indices_.emplace(copy, index);
+  return index;
+}
+
+std::optional<std::uint32_t> StringTable::find(std::string_view value) const {
+  const auto found = indices_.find(value);
+  if (found == indices_.end()) {
+    return std::nullopt;
+  }
+  return found->second;
+}
+
+Expected<void> StringTable::msgpack_encode(std::string& destination) const {
+  return msgpack::pack_array(
+      destination, strings_,
+      [](std::string& destination, const std::string& value) {
+        return msgpack::pack_string(destination, value);
+      });
+}
+
+}  // namespace tracing
+}  // namespace datadog
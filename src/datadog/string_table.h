@@ -0,0 +1,67 @@
+#pragma once
+
+// This component provides a class, `StringTable`, that assigns an index to
+// each distinct string in a Datadog Agent "v0.5" traces payload.
+//
+// In the v0.5 format, spans refer to strings by their index in a table that is
+// sent at the beginning of the payload.  Each distinct string is sent only
+// once, no matter how many spans use it.  See `msgpack_encode_v05` in
+// `span_data.h`, and `DatadogAgent::flush`.
+//
+// `StringTable` keeps a copy of each distinct string, so that a table can
+// outlive the spans whose strings it contains.  This allows spans to be encoded
+// as they arrive, while the table accumulates until the payload is sent.
+//
+// `CompactSpans` also uses a `StringTable`, as the pool of the short strings
+// that the compacted spans of a trace segment share.  See `compact_spans.h`.
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+class StringTable {
+  // `strings_` is a `deque` so that the views in `indices_`, which refer to the
+  // elements of `strings_`, remain valid as elements are added.
+  std::deque<std::string> strings_;
+  std::unordered_map<std::string_view, std::uint32_t> indices_;
+
+ public:
+  // Create a table containing only the empty string, which the Datadog Agent
+  // requires to be at index zero.
+  StringTable();
+  StringTable(const StringTable&) = delete;
+  StringTable(StringTable&&) = default;
+  StringTable& operator=(const StringTable&) = delete;
+  StringTable& operator=(StringTable&&) = default;
+
+  // Return the index of the specified `value`, adding `value` to this table if
+  // it is not already present.
+  std::uint32_t index(std::string_view value);
+  // Return the index of the specified `value`, or return null if `value` is
+  // not in this table.
+  std::optional<std::uint32_t> find(std::string_view value) const;
+
+  // Return the number of strings in this table.
+  std::size_t size() const { return strings_.size(); }
+
+  // Return the string at the specified `index`, which must be less than
+  // `size()`.
+  const std::string& operator[](std::uint32_t index) const {
+    return strings_[index];
+  }
+
+  // Append to the specified `destination` a MessagePack array of the strings
+  // in this table, in order of index.
+  Expected<void> msgpack_encode(std::string& destination) const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,141 @@
+#include "tag_key.h"
+
+#include <cstring>
+#include <ostream>
+#include <unordered_set>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// The table of well-known tag names.  The names are string literals, so that
+// interned keys may be created at any time, even during static initialization.
+// `test/tag_key.cpp` verifies that every tag name in `tags.h` is here.
+const std::unordered_set<std::string_view>& interned_names() {
+  static const std::unordered_set<std::string_view> names{
+      // tags.h
+      "env",
+      "service.name",
+      "span.type",
+      "operation",
+      "resource.name",
+      "manual.keep",
+      "manual.drop",
+      "version",
+      "error.msg",
+      "error.type",
+      "error.stack",
+      "_dd.propagation_error",
+      "_dd.p.dm",
+      "_dd.origin",
+      "_dd.hostname",
+      "_sampling_priority_v1",
+      "_dd.rule_psr",
+      "_dd.limit_psr",
+      "_dd.agent_psr",
+      "_dd.span_sampling.mechanism",
+      "_dd.span_sampling.rule_rate",
+      "_dd.span_sampling.max_per_second",
+      // commonly set by integrations
+      "component",
+      "span.kind",
+      "http.method",
+      "http.status_code",
+      "http.url",
+      "http.useragent",
+      "http.client_ip",
+      "peer.hostname",
+      "peer.service",
+      "db.type",
+      "db.instance",
+      "db.statement",
+      "db.user",
+  };
+  return names;
+}
+
+}  // namespace
+
+TagKey::TagKey(std::string_view name) : size_(std::uint32_t(name.size())) {
+  const std::string_view interned = find_interned(name);
+  if (interned.data()) {
+    interned_ = interned.data();
+    kind_ = Kind::INTERNED;
+  } else if (name.size() <= inline_capacity) {
+    std::memcpy(inline_, name.data(), name.size());
+    kind_ = Kind::INLINE;
+  } else {
+    heap_ = new char[name.size()];
+    std::memcpy(heap_, name.data(), name.size());
+    kind_ = Kind::HEAP;
+  }
+}
+
+TagKey::TagKey(const std::string& name) : TagKey(std::string_view(name)) {}
+
+TagKey::TagKey(const char* name) : TagKey(std::string_view(name)) {}
+
+TagKey::TagKey(const TagKey& other) : size_(other.size_), kind_(other.kind_) {
+  if (kind_ == Kind::HEAP) {
+    heap_ = new char[size_];
+    std::memcpy(heap_, other.heap_, size_);
+  } else {
+    std::memcpy(inline_, other.inline_, inline_capacity);
+  }
+}
+
+TagKey::TagKey(TagKey&& other) noexcept
+    : size_(other.size_), kind_(other.kind_) {
+  // The union is copied regardless of kind.  If `other` is a heap key, then
+  // this key now owns the allocation and `other` becomes empty.
+  std::memcpy(inline_, other.inline_, inline_capacity);
+  if (other.kind_ == Kind::HEAP) {
+    other.kind_ = Kind::INLINE;
+    other.size_ = 0;
+  }
+}
+
+TagKey& TagKey::operator=(const TagKey& other) {
+  if (this != &other) {
+    *this = TagKey(other);
+  }
+  return *this;
+}
+
+TagKey& TagKey::operator=(TagKey&& other) noexcept {
+  if (this != &other) {
+    if (kind_ == Kind::HEAP) {
+      delete[] heap_;
+    }
+    size_ = other.size_;
+    kind_ = other.kind_;
+    std::memcpy(inline_, other.inline_, inline_capacity);
+    if (other.kind_ == Kind::HEAP) {
+      other.kind_ = Kind::INLINE;
+      other.size_ = 0;
+    }
+  }
+  return *this;
+}
+
+TagKey::~TagKey() {
+  if (kind_ == Kind::HEAP) {
+    delete[] heap_;
+  }
+}
+
+std::string_view TagKey::find_interned(std::string_view name) {
+  const auto& names = interned_names();
+  const auto found = names.find(name);
+  if (found == names.end()) {
+    return std::string_view();
+  }
+  return *found;
+}
+
+std::ostream& operator<<(std::ostream& stream, const TagKey& key) {
+  return stream << key.view();
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,113 @@
+#pragma once
+
+// This component provides a class, `TagKey`, that is the key type of the
+// associative container `FlatMap`, and so is the type of span tag names in
+// `SpanData`.
+//
+// A `TagKey` is smaller than a `std::string` and never allocates memory for
+// tag names that are well-known.  There are three kinds of `TagKey`:
+//
+// - An interned key refers to static storage in a process-wide table of
+//   well-known tag names.  The table contains every tag name in `tags.h`, as
+//   well as some commonly used tag names, such as "http.status_code".
+// - An inline key stores a short name within the `TagKey` object itself.
+// - A heap key owns a copy of a long name allocated from the global heap.
+//
+// The kind of a key is chosen when the key is constructed, and is otherwise an
+// implementation detail.  `TagKey` converts implicitly to `std::string_view`.
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace datadog {
+namespace tracing {
+
+class TagKey {
+ public:
+  // Names at most this long are stored inline, unless they're interned.
+  static constexpr std::size_t inline_capacity = 16;
+
+ private:
+  enum class Kind : std::uint8_t { INTERNED, INLINE, HEAP };
+
+  union {
+    const char* interned_;
+    char* heap_;
+    char inline_[inline_capacity];
+  };
+  std::uint32_t size_;
+  Kind kind_;
+
+ public:
+  // Create a key having the specified `name`.
+  TagKey(std::string_view name);
+  TagKey(const std::string& name);
+  TagKey(const char* name);
+  TagKey(const TagKey&);
+  TagKey(TagKey&&) noexcept;
+  TagKey& operator=(const TagKey&);
+  TagKey& operator=(TagKey&&) noexcept;
+  ~TagKey();
+
+  const char* data() const {
+    return kind_ == Kind::INLINE ? inline_
+                                 : (kind_ == Kind::HEAP ? heap_ : interned_);
+  }
+  std::size_t size() const { return size_; }
+  std::string_view view() const { return std::string_view(data(), size_); }
+  operator std::string_view() const { return view(); }
+
+  // Return whether this key refers to the process-wide table of well-known
+  // tag names.
+  bool interned() const { return kind_ == Kind::INTERNED; }
+
+  // Return a view of the entry in the process-wide table of well-known tag
+  // names that is equal to the specified `name`, or return an empty view if
+  // `name` is not well-known.
+  static std::string_view find_interned(std::string_view name);
+
+  // `TagKey` compares equal to anything that converts to `std::string_view`,
+  // including other `TagKey`s.  The comparison operators are found only by
+  // argument-dependent lookup, so that they do not interfere with comparisons
+  // between other string types.
+  template <typename String,
+            typename = std::enable_if_t<
+                std::is_convertible_v<const String&, std::string_view>>>
+  friend bool operator==(const TagKey& left, const String& right) {
+    const std::string_view other = right;
+    return left.size() == other.size() &&
+           (left.data() == other.data() || left.view() == other);
+  }
+
+  template <typename String,
+            typename = std::enable_if_t<
+                !std::is_same_v<String, TagKey> &&
+                std::is_convertible_v<const String&, std::string_view>>>
+  friend bool operator==(const String& left, const TagKey& right) {
+    return right == left;
+  }
+
+  template <typename String,
+            typename = std::enable_if_t<
+                std::is_convertible_v<const String&, std::string_view>>>
+  friend bool operator!=(const TagKey& left, const String& right) {
+    return !(left == right);
+  }
+
+  template <typename String,
+            typename = std::enable_if_t<
+                !std::is_same_v<String, TagKey> &&
+                std::is_convertible_v<const String&, std::string_view>>>
+  friend bool operator!=(const String& left, const TagKey& right) {
+    return !(right == left);
+  }
+};
+
+std::ostream& operator<<(std::ostream&, const TagKey&);
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,72 @@
+#include "tag_projection.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+std::vector<GlobPattern> compile(const std::vector<std::string>& patterns) {
+  std::vector<GlobPattern> result;
+  result.reserve(patterns.size());
+  for (const auto& pattern : patterns) {
+    result.emplace_back(pattern);
+  }
+  return result;
+}
+
+bool any_match(const std::vector<GlobPattern>& patterns,
+               std::string_view name) {
+  return std::any_of(
+      patterns.begin(), patterns.end(),
+      [&](const GlobPattern& pattern) { return pattern.match(name); });
+}
+
+}  // namespace
+
+TagProjection::TagProjection(const std::vector<std::string>& allowed,
+                             const std::vector<std::string>& denied,
+                             std::size_t max_entries)
+    : allowed_(compile(allowed)),
+      denied_(compile(denied)),
+      max_entries_(max_entries) {}
+
+bool TagProjection::match(std::string_view name) const {
+  return (allowed_.empty() || any_match(allowed_, name)) &&
+         !any_match(denied_, name);
+}
+
+bool TagProjection::accepts(std::string_view name) const {
+  if (accepts_all()) {
+    return true;
+  }
+
+  const auto key = std::hash<std::string_view>{}(name);
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto found = entries_.find(key);
+    if (found != entries_.end() && found->second.name == name) {
+      return found->second.accepted;
+    }
+  }
+
+  const bool accepted = match(name);
+  Entry entry{std::string(name), accepted};
+  std::lock_guard<std::shared_mutex> lock(mutex_);
+  if (entries_.size() >= max_entries_ && !entries_.count(key)) {
+    entries_.clear();
+  }
+  // Among colliding names, the most recent wins.
+  entries_.insert_or_assign(key, std::move(entry));
+  return accepted;
+}
+
+bool TagProjection::accepts_all() const {
+  return allowed_.empty() && denied_.empty();
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,66 @@
+#pragma once
+
+// This component provides a class, `TagProjection`, that decides which tags
+// spans may have, given the glob patterns (see `glob.h`) of the tag names that
+// are allowed and of those that are denied.  The patterns are specified as
+// `SpanLimits::allowed_tags` and `SpanLimits::denied_tags`.
+//
+// Instrumentation often sets tags that are never queried in Datadog, e.g. every
+// request header.  A denied tag is rejected by `Span::set_tag` before its value
+// is copied into the span, and so it costs neither memory nor encoding.
+//
+// An application sets tags having few distinct names, so `TagProjection`
+// remembers whether each name that it has seen is accepted, and a name is
+// matched against the patterns only the first time it's seen.  The cache
+// contains at most a fixed number of names.  When it is full, it is cleared
+// before the next insertion.  Lookups take a shared lock, so concurrent
+// lookups don't block each other.
+
+#include <cstddef>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "glob.h"
+
+namespace datadog {
+namespace tracing {
+
+class TagProjection {
+  struct Entry {
+    std::string name;
+    bool accepted;
+  };
+
+  std::vector<GlobPattern> allowed_;
+  std::vector<GlobPattern> denied_;
+  mutable std::shared_mutex mutex_;
+  // `entries_` is keyed by a hash of the tag name, so that a lookup needn't
+  // build a key.  Each entry is verified against the name.
+  mutable std::unordered_map<std::size_t, Entry> entries_;
+  std::size_t max_entries_;
+
+  // Return whether the specified tag `name` matches the patterns.
+  bool match(std::string_view name) const;
+
+ public:
+  static constexpr std::size_t default_max_entries = 1024;
+
+  // Create a `TagProjection` that accepts the tags whose names match any of
+  // the specified `allowed` patterns, or any tags if `allowed` is empty, and
+  // that match none of the specified `denied` patterns.  Remember whether at
+  // most the optionally specified `max_entries` names are accepted.
+  TagProjection(const std::vector<std::string>& allowed,
+                const std::vector<std::string>& denied,
+                std::size_t max_entries = default_max_entries);
+
+  // Return whether a span may have a tag having the specified `name`.
+  bool accepts(std::string_view name) const;
+  // Return whether this object accepts every tag.
+  bool accepts_all() const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
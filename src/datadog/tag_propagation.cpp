@@ -21,7 +21,7 @@ namespace tracing {
 //
 // That is, comma-separated "<key>=<value>" pairs.
 //
-// See `tag_propagation_test.cpp` for examples.
+// See `test/tag_propagation.cpp` for examples.
 //
 // [1]: https://en.wikipedia.org/wiki/Extended_Backus%E2%80%93Naur_form
 // [2]:
@@ -29,25 +29,52 @@ namespace tracing {
 
 namespace {
 
-// Insert into the specified `destination` a tag decoded from the specified
-// `entry`.  Return an `Error` if an error occurs.
-Expected<void> decode_tag(
-    std::unordered_map<std::string, std::string>& destination,
-    std::string_view entry) {
-  const auto separator = std::find(entry.begin(), entry.end(), '=');
-  if (separator == entry.end()) {
-    std::string message;
-    message += "invalid key=value pair for encoded tag: missing \"=\" in: ";
-    message += entry;
-    return Error{Error::MALFORMED_TRACE_TAGS, std::move(message)};
-  }
+// Return the offset of the first occurrence of the specified `delimiter` in
+// the specified `text`, or return `text.size()` if there is none.  This uses
+// `std::string_view::find`, which is `memchr` on common standard libraries,
+// and `memchr` is vectorized.
+std::size_t find(std::string_view text, char delimiter) {
+  return std::min(text.find(delimiter), text.size());
+}
 
-  const std::string_view key = range(entry.begin(), separator);
-  const std::string_view value = range(separator + 1, entry.end());
-  // Among duplicate keys, most recent value wins.
-  destination.insert_or_assign(std::string(key), std::string(value));
+// Return an error describing the specified `entry`, which is missing "=".
+LazyError missing_separator(std::string_view header_value,
+                            std::string_view entry) {
+  return LazyError{
+      Error::MALFORMED_TRACE_TAGS,
+      {"Error decoding trace tags \"", header_value, "\": ",
+       "invalid key=value pair for encoded tag: missing \"=\" in: ", entry}};
+}
 
-  return std::nullopt;
+// Invoke the specified `visit` with the key and value of each comma-separated
+// entry in the specified `header_value`, and return true, unless an entry is
+// missing "=", in which case stop and return false.  If the specified
+// `malformed` is not null, then on failure assign the offending entry to it.
+template <typename Visit>
+bool for_each_tag(std::string_view header_value, Visit&& visit,
+                  std::string_view* malformed = nullptr) {
+  if (header_value.empty()) {
+    // An empty string means no tags.
+    return true;
+  }
+
+  std::string_view rest = header_value;
+  for (;;) {
+    const std::size_t comma = find(rest, ',');
+    const std::string_view entry = rest.substr(0, comma);
+    const std::size_t separator = find(entry, '=');
+    if (separator == entry.size()) {
+      if (malformed) {
+        *malformed = entry;
+      }
+      return false;
+    }
+    visit(entry.substr(0, separator), entry.substr(separator + 1));
+    if (comma == rest.size()) {
+      return true;
+    }
+    rest.remove_prefix(comma + 1);
+  }
 }
 
 void append_tag(std::string& serialized_tags, std::string_view tag_key,
@@ -59,36 +86,37 @@ void append_tag(std::string& serialized_tags, std::string_view tag_key,
 
 }  // namespace
 
-Expected<std::unordered_map<std::string, std::string>> decode_tags(
+Expected<FlatMap<std::string>, LazyError> decode_tags(
     std::string_view header_value) {
-  std::unordered_map<std::string, std::string> tags;
-
-  auto iter = header_value.begin();
-  const auto end = header_value.end();
-  if (iter == end) {
-    // An empty string means no tags.
-    return tags;
+  FlatMap<std::string> tags;
+  auto result = decode_tags(
+      header_value, [&](std::string_view key, std::string_view value) {
+        // Among duplicate keys, most recent value wins.
+        tags.insert_or_assign(key, std::string(value));
+      });
+  if (auto* error = result.if_error()) {
+    return std::move(*error);
   }
-
-  decltype(iter) next;
-  do {
-    next = std::find(iter, end, ',');
-    auto result = decode_tag(tags, range(iter, next));
-    if (auto* error = result.if_error()) {
-      std::string prefix;
-      prefix += "Error decoding trace tags \"";
-      prefix += header_value;
-      prefix += "\": ";
-      return error->with_prefix(prefix);
-    }
-    iter = next + 1;
-  } while (next != end);
-
   return tags;
 }
 
-std::string encode_tags(
-    const std::unordered_map<std::string, std::string>& trace_tags) {
+Expected<void, LazyError> decode_tags(
+    std::string_view header_value,
+    const std::function<void(std::string_view key, std::string_view value)>&
+        visit) {
+  // Validate the whole header before visiting any of it, so that a malformed
+  // header yields no tags.
+  std::string_view malformed;
+  if (!for_each_tag(
+          header_value, [](std::string_view, std::string_view) {},
+          &malformed)) {
+    return missing_separator(header_value, malformed);
+  }
+  for_each_tag(header_value, visit);
+  return std::nullopt;
+}
+
+std::string encode_tags(const FlatMap<std::string>& trace_tags) {
   std::string result;
   auto iter = trace_tags.begin();
   if (iter == trace_tags.end()) {
@@ -104,5 +132,13 @@ std::string encode_tags(
   return result;
 }
 
+std::size_t encoded_tags_size(const FlatMap<std::string>& trace_tags) {
+  std::size_t size = 0;
+  for (const auto& [key, value] : trace_tags) {
+    size += encoded_tag_size(key, value);
+  }
+  return size == 0 ? 0 : size - 1;
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -11,24 +11,52 @@
 // This component provides serialization and deserialization routines for the
 // "x-datadog-tags" header format.
 
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 
 #include "expected.h"
+#include "flat_map.h"
+#include "lazy_error.h"
 
 namespace datadog {
 namespace tracing {
 
 // Return a name->value mapping of tags parsed from the specified
-// `header_value`, or return an `Error` if an error occurs.
-Expected<std::unordered_map<std::string, std::string>> decode_tags(
+// `header_value`, or return an error if an error occurs.  The error refers to
+// `header_value` (see `lazy_error.h`).
+Expected<FlatMap<std::string>, LazyError> decode_tags(
     std::string_view header_value);
 
+// Invoke the specified `visit` with the key and value of each tag parsed from
+// the specified `header_value`, in order, or return an error if an error
+// occurs.  The key and value, and the error, are views into `header_value`.
+// If an error occurs, then `visit` is not invoked.  Keys might be repeated, in
+// which case the last occurrence should win.  This function does not allocate
+// memory, even if an error occurs.
+Expected<void, LazyError> decode_tags(
+    std::string_view header_value,
+    const std::function<void(std::string_view key, std::string_view value)>&
+        visit);
+
 // Serialize the specified `trace_tags` into the propagation format and return
 // the resulting string.
-std::string encode_tags(
-    const std::unordered_map<std::string, std::string>& trace_tags);
+std::string encode_tags(const FlatMap<std::string>& trace_tags);
+
+// Return the number of bytes that the tag having the specified `key` and
+// `value` contributes to the result of `encode_tags`, counting one separating
+// comma.  The length of the encoding of some tags is the sum of their
+// `encoded_tag_size`s, less one for the comma that the first tag doesn't
+// have, or is zero if there are no tags.
+inline std::size_t encoded_tag_size(std::string_view key,
+                                    std::string_view value) {
+  return key.size() + 1 + value.size() + 1;
+}
+
+// Return the length of the string that `encode_tags` would return for the
+// specified `trace_tags`, without building the string.
+std::size_t encoded_tags_size(const FlatMap<std::string>& trace_tags);
 
 }  // namespace tracing
 }  // namespace datadog
@@ -14,11 +14,25 @@ const std::string resource_name = "resource.name";
 const std::string manual_keep = "manual.keep";
 const std::string manual_drop = "manual.drop";
 const std::string version = "version";
+const std::string error_message = "error.msg";
+const std::string error_type = "error.type";
+const std::string error_stack = "error.stack";
+const std::string http_status_code = "http.status_code";
+const std::string filtered_span_count = "filtered_spans.count";
+const std::string filtered_span_duration = "filtered_spans.duration";
+const std::string collapsed_span_count = "collapsed_spans.count";
+const std::string collapsed_span_error_count = "collapsed_spans.error_count";
+const std::string collapsed_span_min_duration = "collapsed_spans.min_duration";
+const std::string collapsed_span_max_duration = "collapsed_spans.max_duration";
+const std::string collapsed_span_total_duration =
+    "collapsed_spans.total_duration";
+const std::string overflow_span_count = "overflow_spans.count";
 
 namespace internal {
 
 const std::string propagation_error = "_dd.propagation_error";
 const std::string decision_maker = "_dd.p.dm";
+const std::string trace_id_high = "_dd.p.tid";
 const std::string origin = "_dd.origin";
 const std::string hostname = "_dd.hostname";
 const std::string sampling_priority = "_sampling_priority_v1";
@@ -28,6 +42,8 @@ const std::string agent_sample_rate = "_dd.agent_psr";
 const std::string span_sampling_mechanism = "_dd.span_sampling.mechanism";
 const std::string span_sampling_rule_rate = "_dd.span_sampling.rule_rate";
 const std::string span_sampling_limit = "_dd.span_sampling.max_per_second";
+const std::string measured = "_dd.measured";
+const std::string top_level = "_dd.top_level";
 
 }  // namespace internal
 
@@ -18,10 +18,23 @@ extern const std::string resource_name;
 extern const std::string manual_keep;
 extern const std::string manual_drop;
 extern const std::string version;
+extern const std::string error_message;
+extern const std::string error_type;
+extern const std::string error_stack;
+extern const std::string http_status_code;
+extern const std::string filtered_span_count;
+extern const std::string filtered_span_duration;
+extern const std::string collapsed_span_count;
+extern const std::string collapsed_span_error_count;
+extern const std::string collapsed_span_min_duration;
+extern const std::string collapsed_span_max_duration;
+extern const std::string collapsed_span_total_duration;
+extern const std::string overflow_span_count;
 
 namespace internal {
 extern const std::string propagation_error;
 extern const std::string decision_maker;
+extern const std::string trace_id_high;
 extern const std::string origin;
 extern const std::string hostname;
 extern const std::string sampling_priority;
@@ -31,6 +44,8 @@ extern const std::string agent_sample_rate;
 extern const std::string span_sampling_mechanism;
 extern const std::string span_sampling_rule_rate;
 extern const std::string span_sampling_limit;
+extern const std::string measured;
+extern const std::string top_level;
 }  // namespace internal
 
 // Return whether the specified `tag_name` is reserved for use internal to this
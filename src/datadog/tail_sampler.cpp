@@ -0,0 +1,222 @@
+#include "tail_sampler.h"
+
+#include <string>
+#include <utility>
+
+#include "json.hpp"
+#include "metrics.h"
+#include "sampling_mechanism.h"
+#include "sampling_priority.h"
+#include "span_data.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Each held trace costs this many bytes in addition to its chunks, for its
+// entry in the hash table and in the queue of expirations.
+constexpr std::size_t trace_overhead = 256;
+
+// Return the sampling priority of the trace chunk having the specified
+// `spans`, if it has one.  The sampling priority is on the chunk's first span.
+std::optional<double> sampling_priority(
+    const std::vector<std::unique_ptr<SpanData>>& spans) {
+  if (spans.empty()) {
+    return std::nullopt;
+  }
+  const auto& numeric_tags = spans.front()->numeric_tags;
+  const auto found = numeric_tags.find(tags::internal::sampling_priority);
+  if (found == numeric_tags.end()) {
+    return std::nullopt;
+  }
+  return found->second;
+}
+
+// Change the sampling priority of the specified `chunk`, which was dropped, to
+// the corresponding priority that keeps it, and tag the chunk with the
+// decision maker, as `TraceSegment` does for a trace that sampling kept.
+void keep(TailSampler::Chunk& chunk) {
+  SpanData& first = *chunk.spans.front();
+  double& priority = first.numeric_tags[tags::internal::sampling_priority];
+  priority = priority < 0 ? int(SamplingPriority::USER_KEEP)
+                          : int(SamplingPriority::AUTO_KEEP);
+  first.tags.insert_or_assign(
+      tags::internal::decision_maker,
+      "-" + std::to_string(chunk.sampling_mechanism.value_or(
+                int(SamplingMechanism::DEFAULT))));
+  chunk.span_sampler.reset();
+}
+
+}  // namespace
+
+TailSampler::TailSampler(std::chrono::steady_clock::duration window,
+                         std::size_t max_bytes,
+                         std::optional<std::chrono::nanoseconds> min_duration,
+                         std::optional<std::size_t> min_spans,
+                         const std::shared_ptr<Metrics>& metrics)
+    : window_(window),
+      max_bytes_(max_bytes),
+      min_duration_(min_duration),
+      min_spans_(min_spans),
+      metrics_(metrics),
+      bytes_(0) {}
+
+TailSampler::~TailSampler() { clear(); }
+
+bool TailSampler::is_interesting(const Trace& trace) const {
+  return trace.error ||
+         (min_duration_ && trace.begin &&
+          trace.end - *trace.begin >= *min_duration_) ||
+         (min_spans_ && trace.span_count >= *min_spans_);
+}
+
+void TailSampler::hold(std::size_t amount) {
+  bytes_ += amount;
+  metrics_->increase(Metrics::TAIL_SAMPLING_BYTES, amount);
+}
+
+void TailSampler::unhold(std::size_t amount) {
+  bytes_ -= amount;
+  metrics_->decrease(Metrics::TAIL_SAMPLING_BYTES, amount);
+}
+
+void TailSampler::expire(std::chrono::steady_clock::time_point now, bool all,
+                         std::vector<Chunk>& released) {
+  while (!expirations_.empty() &&
+         (all || expirations_.front().first <= now)) {
+    const auto found = traces_.find(expirations_.front().second);
+    expirations_.pop_front();
+    if (found == traces_.end()) {
+      continue;
+    }
+    Trace& trace = found->second;
+    for (auto& chunk : trace.chunks) {
+      released.push_back(std::move(chunk));
+    }
+    unhold(trace.bytes + trace_overhead);
+    traces_.erase(found);
+  }
+}
+
+void TailSampler::add(Chunk&& chunk, std::chrono::steady_clock::time_point now,
+                      std::vector<Chunk>& released) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  expire(now, false, released);
+
+  // Only traces that the head-based sampler dropped are reconsidered.  The
+  // user's decisions are final.
+  const auto priority = sampling_priority(chunk.spans);
+  if (!priority || *priority > 0 ||
+      chunk.sampling_mechanism == int(SamplingMechanism::MANUAL)) {
+    released.push_back(std::move(chunk));
+    return;
+  }
+
+  std::size_t chunk_bytes = 0;
+  for (const auto& span_ptr : chunk.spans) {
+    chunk_bytes += approximate_size(*span_ptr);
+  }
+
+  // A trace that isn't held yet is observed apart from the others until it's
+  // known whether there's room for it.
+  const TraceID trace_id = chunk.spans.front()->trace_id;
+  auto found = traces_.find(trace_id);
+  Trace untracked;
+  Trace* trace = found == traces_.end() ? &untracked : &found->second;
+  for (const auto& span_ptr : chunk.spans) {
+    const SpanData& span = *span_ptr;
+    trace->error = trace->error || span.error;
+    const auto end = span.start.wall + span.duration;
+    if (!trace->begin || span.start.wall < *trace->begin) {
+      trace->begin = span.start.wall;
+    }
+    if (end > trace->end) {
+      trace->end = end;
+    }
+  }
+  trace->span_count += chunk.spans.size();
+
+  if (trace->decision == Decision::PENDING) {
+    const std::size_t overhead = trace == &untracked ? trace_overhead : 0;
+    if (is_interesting(*trace)) {
+      trace->decision = Decision::KEEP;
+      metrics_->add(Metrics::TAIL_SAMPLING_TRACES_KEPT);
+    } else if (bytes_ + overhead + chunk_bytes > max_bytes_) {
+      // The head-based decision stands for the whole trace.
+      trace->decision = Decision::HEAD;
+      metrics_->add(Metrics::TAIL_SAMPLING_OVERFLOWS);
+    }
+    // A decided trace is remembered for the rest of its window, if there's
+    // room, so that its later chunks are decided alike.
+    if (trace == &untracked && (trace->decision == Decision::PENDING ||
+                                bytes_ + trace_overhead <= max_bytes_)) {
+      found = traces_.emplace(trace_id, std::move(untracked)).first;
+      trace = &found->second;
+      expirations_.emplace_back(now + window_, trace_id);
+      hold(trace_overhead);
+    }
+  }
+
+  switch (trace->decision) {
+    case Decision::PENDING:
+      trace->chunks.push_back(std::move(chunk));
+      trace->bytes += chunk_bytes;
+      hold(chunk_bytes);
+      return;
+    case Decision::KEEP:
+      for (auto& held : trace->chunks) {
+        keep(held);
+        released.push_back(std::move(held));
+      }
+      keep(chunk);
+      break;
+    case Decision::HEAD:
+      for (auto& held : trace->chunks) {
+        released.push_back(std::move(held));
+      }
+      break;
+  }
+  released.push_back(std::move(chunk));
+  trace->chunks.clear();
+  unhold(trace->bytes);
+  trace->bytes = 0;
+}
+
+void TailSampler::release(std::chrono::steady_clock::time_point now, bool all,
+                          std::vector<Chunk>& released) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  expire(now, all, released);
+}
+
+void TailSampler::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  traces_.clear();
+  expirations_.clear();
+  unhold(bytes_);
+}
+
+std::size_t TailSampler::bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+nlohmann::json TailSampler::config_json() const {
+  auto result = nlohmann::json::object({
+      {"window_milliseconds",
+       std::chrono::duration_cast<std::chrono::milliseconds>(window_).count()},
+      {"max_bytes", max_bytes_},
+  });
+  if (min_duration_) {
+    result["min_duration_milliseconds"] =
+        std::chrono::duration_cast<std::chrono::milliseconds>(*min_duration_)
+            .count();
+  }
+  if (min_spans_) {
+    result["min_spans"] = *min_spans_;
+  }
+  return result;
+}
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,164 @@
+#pragma once
+
+// This component provides a class, `TailSampler`, that decides whether to keep
+// a trace after the trace has finished, from what happened in it, rather than
+// before it started.
+//
+// `TraceSampler` decides at the start of a trace, and so it drops slow traces,
+// traces having errors, and large traces at the same rate as the others.
+// `DatadogAgent` can instead give each trace chunk that sampling dropped, with
+// sampling priority `AUTO_DROP` or `USER_DROP`, to a `TailSampler` (see
+// `DatadogAgentConfig::tail_sampling_enabled`).  The `TailSampler` holds the
+// trace's chunks for a window of time that starts when the trace's first
+// chunk arrives.  If, within the window, any span of the trace has an error,
+// the trace's spans span at least a minimum duration, or the trace has at
+// least a minimum number of spans, then the trace is kept: its held chunks,
+// and those that arrive later in the window, are released with sampling
+// priority `AUTO_KEEP` or `USER_KEEP`, respectively, and with the
+// decision-maker trace tag ("_dd.p.dm") of the mechanism that dropped the
+// trace, as though that mechanism had kept it.  When the window elapses, the
+// chunks of a trace that was not kept are released as they arrived, i.e.
+// dropped.
+//
+// Chunks that sampling kept are released immediately, as are the chunks of a
+// trace that the user dropped explicitly, i.e. whose sampling mechanism is
+// `SamplingMechanism::MANUAL`.  A trace's sampling decision might already
+// have been propagated to other services, which don't learn that the trace
+// was kept.
+//
+// The memory held by a `TailSampler` is limited.  A chunk that would exceed
+// the limit, unless it shows that its trace is to be kept, is released
+// immediately, as are the held chunks of its trace, and the trace's
+// head-based sampling decision then stands for the rest of the window.
+//
+// `TailSampler` is safe to use from multiple threads.  It doesn't send
+// released chunks anywhere; instead, its member functions append them to a
+// vector, in which chunks of the same trace are in the order in which they
+// were added.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "clock.h"
+#include "json_fwd.hpp"
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+class Metrics;
+struct SpanData;
+class SpanSampler;
+class TraceSampler;
+
+class TailSampler {
+ public:
+  // `Chunk` is a trace chunk as given to `Collector::send_with_origin` or to
+  // `Collector::send_unsampled`.  `span_sampler` is null unless span sampling
+  // is yet to be applied to the chunk.  A chunk that the `TailSampler` keeps
+  // has no `span_sampler`, since its whole trace is kept.
+  // `sampling_mechanism` is the mechanism of the trace's sampling decision,
+  // if known (see `sampling_mechanism.h`).
+  struct Chunk {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    std::shared_ptr<TraceSampler> response_handler;
+    std::string origin;
+    std::shared_ptr<SpanSampler> span_sampler;
+    std::optional<int> sampling_mechanism;
+  };
+
+ private:
+  enum class Decision { PENDING, KEEP, HEAD };
+
+  // `Trace` is what the `TailSampler` knows of a trace whose window has not
+  // yet elapsed.  `bytes` is the estimated memory of `chunks`.
+  struct Trace {
+    Decision decision = Decision::PENDING;
+    std::vector<Chunk> chunks;
+    std::size_t bytes = 0;
+    bool error = false;
+    std::size_t span_count = 0;
+    std::optional<std::chrono::system_clock::time_point> begin;
+    std::chrono::system_clock::time_point end;
+  };
+
+  struct TraceIDHash {
+    std::size_t operator()(TraceID id) const {
+      return std::hash<std::uint64_t>{}(id.low ^ (id.high * 31));
+    }
+  };
+
+  std::chrono::steady_clock::duration window_;
+  std::size_t max_bytes_;
+  std::optional<std::chrono::nanoseconds> min_duration_;
+  std::optional<std::size_t> min_spans_;
+  std::shared_ptr<Metrics> metrics_;
+  // `mutex_` protects the members below it.  `expirations_` contains each
+  // trace in `traces_` and the end of its window, in the order in which the
+  // traces arrived, which is also the order in which their windows end.
+  // `bytes_` is the estimated memory of `traces_`.
+  std::mutex mutex_;
+  std::unordered_map<TraceID, Trace, TraceIDHash> traces_;
+  std::deque<std::pair<std::chrono::steady_clock::time_point, TraceID>>
+      expirations_;
+  std::size_t bytes_;
+
+  // Return whether the specified `trace` is to be kept.
+  bool is_interesting(const Trace& trace) const;
+  // Account for the memory of the specified `amount` of bytes, which are
+  // added to or subtracted from `bytes_`.  The caller must hold `mutex_`.
+  void hold(std::size_t amount);
+  void unhold(std::size_t amount);
+  // Append to the specified `released` the chunks of the traces whose
+  // windows have elapsed as of the specified `now`, or of all traces if the
+  // specified `all` is true.  The caller must hold `mutex_`.
+  void expire(std::chrono::steady_clock::time_point now, bool all,
+              std::vector<Chunk>& released);
+
+ public:
+  // Create a `TailSampler` that holds traces for the specified `window` and
+  // at most the specified `max_bytes` of them, and that keeps traces having
+  // an error, lasting at least the optionally specified `min_duration`, or
+  // having at least the optionally specified `min_spans`.  Count what it does
+  // in the specified `metrics`.
+  TailSampler(std::chrono::steady_clock::duration window,
+              std::size_t max_bytes,
+              std::optional<std::chrono::nanoseconds> min_duration,
+              std::optional<std::size_t> min_spans,
+              const std::shared_ptr<Metrics>& metrics);
+  ~TailSampler();
+
+  // Add the specified `chunk`, which arrived at the specified `now`.  Append
+  // to the specified `released` the chunks that are no longer held, which
+  // might include `chunk`.
+  void add(Chunk&& chunk, std::chrono::steady_clock::time_point now,
+           std::vector<Chunk>& released);
+
+  // Append to the specified `released` the chunks of the traces whose windows
+  // have elapsed as of the specified `now`, or, if the specified `all` is
+  // true, the chunks of all traces, as though their windows had elapsed.
+  void release(std::chrono::steady_clock::time_point now, bool all,
+               std::vector<Chunk>& released);
+
+  // Forget every held chunk without releasing it.
+  void clear();
+
+  // Return the estimated number of bytes of memory held.
+  std::size_t bytes();
+
+  // Return a JSON representation of this object's configuration.
+  nlohmann::json config_json() const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,163 @@
+#include "thread_placement.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "parse_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Linux limits thread names to 15 characters, and macOS to 63.
+constexpr std::size_t max_name_size = 15;
+
+// This is `CPU_SETSIZE` with glibc.
+constexpr int max_cpus = 1024;
+
+Error placement_failed(std::string_view what, int error_number) {
+  std::string message;
+  message += "Unable to ";
+  message += what;
+  message += " of a background thread: ";
+  message += std::strerror(error_number);
+  return Error{Error::THREAD_PLACEMENT_FAILED, std::move(message)};
+}
+
+void name_current_thread(std::string_view name) {
+  char buffer[max_name_size + 1];
+  const std::size_t size = std::min(name.size(), max_name_size);
+  std::memcpy(buffer, name.data(), size);
+  buffer[size] = '\0';
+#if defined(__linux__)
+  (void)pthread_setname_np(pthread_self(), buffer);
+#elif defined(__APPLE__)
+  (void)pthread_setname_np(buffer);
+#else
+  (void)buffer;
+#endif
+}
+
+}  // namespace
+
+Expected<void> place_current_thread(const ThreadPlacement& placement,
+                                    std::string_view name) {
+  name_current_thread(name);
+
+#ifdef __linux__
+  if (!placement.cpus.empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (const int cpu : placement.cpus) {
+      if (cpu >= 0 && cpu < max_cpus && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    if (const int rc =
+            pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus)) {
+      return placement_failed("set the CPU affinity", rc);
+    }
+  }
+  if (placement.nice) {
+    // On Linux, the nice value is a property of each thread, and `setpriority`
+    // with a thread ID sets it for that thread alone.
+    const auto thread_id = static_cast<id_t>(::syscall(SYS_gettid));
+    if (::setpriority(PRIO_PROCESS, thread_id, *placement.nice) != 0) {
+      return placement_failed("set the priority", errno);
+    }
+  }
+#else
+  if (!placement.cpus.empty() || placement.nice) {
+    return Error{Error::THREAD_PLACEMENT_FAILED,
+                 "CPU affinity and priority of background threads are "
+                 "supported only on Linux."};
+  }
+#endif
+
+  return std::nullopt;
+}
+
+Expected<std::vector<int>> parse_cpu_list(std::string_view input) {
+  const auto invalid = [&](std::string_view reason) {
+    std::string message;
+    message += "Invalid CPU list \"";
+    message += input;
+    message += "\": ";
+    message += reason;
+    return Error{Error::INVALID_THREAD_PLACEMENT, std::move(message)};
+  };
+
+  std::vector<int> cpus;
+  std::string_view rest = input;
+  while (!rest.empty() || cpus.empty()) {
+    const auto comma = rest.find(',');
+    const std::string_view item = strip(rest.substr(0, comma));
+    rest = comma == std::string_view::npos ? std::string_view{}
+                                           : rest.substr(comma + 1);
+    const auto dash = item.find('-');
+    auto first = parse_int(item.substr(0, dash), 10);
+    auto last = dash == std::string_view::npos
+                    ? first
+                    : parse_int(item.substr(dash + 1), 10);
+    if (!first || !last || *first < 0 || *last < *first) {
+      return invalid(
+          "expected comma-separated CPU indices or ranges such as \"8-11\".");
+    }
+    if (*last >= max_cpus) {
+      return invalid("CPU indices must be less than 1024.");
+    }
+    for (int cpu = *first; cpu <= *last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    if (comma != std::string_view::npos && rest.empty()) {
+      return invalid("the list ends with a comma.");
+    }
+  }
+  return cpus;
+}
+
+std::size_t numa_node_count() {
+#ifdef __linux__
+  // The nodes are listed in the same format as CPUs, e.g. "0-1".
+  std::ifstream file{"/sys/devices/system/node/possible"};
+  const std::string nodes{std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>()};
+  auto indices = parse_cpu_list(strip(nodes));
+  if (!indices) {
+    return 1;
+  }
+  return std::size_t(*std::max_element(indices->begin(), indices->end())) + 1;
+#else
+  return 1;
+#endif
+}
+
+std::size_t current_numa_node() {
+#ifdef __linux__
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return 0;
+  }
+  return node;
+#else
+  return 0;
+#endif
+}
+
+}  // namespace tracing
+}  // namespace datadog
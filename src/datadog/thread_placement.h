@@ -0,0 +1,67 @@
+#pragma once
+
+// This component provides a `struct`, `ThreadPlacement`, that describes where
+// and how a background thread of the tracer runs, and a function,
+// `place_current_thread`, that a background thread calls as it starts, to
+// apply a `ThreadPlacement` to itself and to name itself.
+//
+// The event loop thread of `Curl` and the dispatching thread of
+// `ThreadedEventScheduler`, on which `DatadogAgent` encodes and sends trace
+// chunks, are such threads.  An application that reserves some CPUs for
+// latency-critical work can keep those threads off of them, and can lower
+// their scheduling priority so that bursts of encoding yield to its own
+// threads.  See `DatadogAgentConfig::background_thread_cpus`.
+//
+// CPU affinity and per-thread priority are supported on Linux.  Elsewhere,
+// requesting them is an error, but naming the thread is still done where
+// supported, e.g. on macOS.  A thread's name is at most 15 characters, and is
+// visible in e.g. `top -H` and debuggers.
+//
+// This component also provides functions that describe the NUMA nodes of the
+// host, so that `DatadogAgent` can keep the trace chunks sent by threads on
+// one node apart from those sent by threads on another.  See
+// `DatadogAgentConfig::shard_buffer_by_numa_node`.
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+struct ThreadPlacement {
+  // `cpus`, if not empty, are the zero-based indices of the CPUs on which the
+  // thread may run.  Indices of 1024 or more are ignored.
+  std::vector<int> cpus;
+  // `nice`, if set, is the nice value of the thread, between -20 (the highest
+  // priority) and 19 (the lowest).  Raising the priority above the default of
+  // zero requires privileges.
+  std::optional<int> nice;
+};
+
+// Apply the specified `placement` to the calling thread, and name the calling
+// thread the specified `name`.  Return an error if the placement could not be
+// applied.  Failing to name the thread is not an error.
+Expected<void> place_current_thread(const ThreadPlacement& placement,
+                                    std::string_view name);
+
+// Return the CPU indices listed in the specified `input`, which is a
+// comma-separated list of indices and inclusive ranges of indices, e.g.
+// "2,3,8-11", or return an error if `input` is not such a list.
+Expected<std::vector<int>> parse_cpu_list(std::string_view input);
+
+// Return the number of NUMA nodes that the host might have, which is one if
+// it can't be determined or if the platform isn't Linux.
+std::size_t numa_node_count();
+
+// Return the index of the NUMA node of the CPU on which the calling thread is
+// running, or zero if it can't be determined or if the platform isn't Linux.
+// The thread may have moved to another node by the time this function
+// returns.
+std::size_t current_numa_node();
+
+}  // namespace tracing
+}  // namespace datadog
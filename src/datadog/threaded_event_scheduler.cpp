@@ -1,16 +1,23 @@
 #include "threaded_event_scheduler.h"
 
 #include <thread>
+#include <utility>
 
 #include "json.hpp"
+#include "logger.h"
 
 namespace datadog {
 namespace tracing {
 
 ThreadedEventScheduler::EventConfig::EventConfig(
     std::function<void()> callback,
-    std::chrono::steady_clock::duration interval)
-    : callback(callback), interval(interval), cancelled(false) {}
+    std::chrono::steady_clock::duration interval,
+    std::chrono::steady_clock::duration jitter)
+    : callback(callback),
+      interval(interval),
+      jitter(jitter),
+      cancelled(false),
+      generation(0) {}
 
 bool ThreadedEventScheduler::GreaterThan::operator()(
     const ScheduledRun& left, const ScheduledRun& right) const {
@@ -18,11 +25,28 @@ bool ThreadedEventScheduler::GreaterThan::operator()(
 }
 
 ThreadedEventScheduler::ThreadedEventScheduler()
-    : running_current_(false),
+    : ThreadedEventScheduler(ThreadPlacement{}, nullptr) {}
+
+ThreadedEventScheduler::ThreadedEventScheduler(
+    const ThreadPlacement& placement, const std::shared_ptr<Logger>& logger)
+    : placement_(placement),
+      logger_(logger),
+      running_current_(false),
       shutting_down_(false),
-      dispatcher_([this]() { run(); }) {}
+      dispatcher_([this]() { run(); }) {
+  ForkHandlers handlers;
+  handlers.before_fork = [this]() { stop_dispatcher(); };
+  handlers.after_fork_in_parent = [this]() { start_dispatcher(); };
+  handlers.after_fork_in_child = [this]() { start_dispatcher(); };
+  unregister_fork_handlers_ = register_fork_handlers(std::move(handlers));
+}
 
 ThreadedEventScheduler::~ThreadedEventScheduler() {
+  unregister_fork_handlers_();
+  stop_dispatcher();
+}
+
+void ThreadedEventScheduler::stop_dispatcher() {
   {
     std::lock_guard guard(mutex_);
     shutting_down_ = true;
@@ -31,20 +55,69 @@ ThreadedEventScheduler::~ThreadedEventScheduler() {
   dispatcher_.join();
 }
 
+void ThreadedEventScheduler::start_dispatcher() {
+  // The scheduled runs remain in `upcoming_`, and so the new thread resumes
+  // where the old one stopped.
+  std::lock_guard<std::mutex> guard(mutex_);
+  shutting_down_ = false;
+  dispatcher_ = std::thread([this]() { run(); });
+}
+
 EventScheduler::Cancel ThreadedEventScheduler::schedule_recurring_event(
     std::chrono::steady_clock::duration interval,
     std::function<void()> callback) {
+  return schedule_wakeable_recurring_event(interval, std::move(callback))
+      .cancel;
+}
+
+EventScheduler::RecurringEvent
+ThreadedEventScheduler::schedule_wakeable_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  return schedule_jittered_recurring_event(
+      interval, interval, std::chrono::steady_clock::duration::zero(),
+      std::move(callback));
+}
+
+EventScheduler::RecurringEvent
+ThreadedEventScheduler::schedule_jittered_recurring_event(
+    std::chrono::steady_clock::duration first_delay,
+    std::chrono::steady_clock::duration interval,
+    std::chrono::steady_clock::duration jitter,
+    std::function<void()> callback) {
   const auto now = std::chrono::steady_clock::now();
-  auto config = std::make_shared<EventConfig>(std::move(callback), interval);
+  auto config =
+      std::make_shared<EventConfig>(std::move(callback), interval, jitter);
 
   {
     std::lock_guard<std::mutex> guard(mutex_);
-    upcoming_.push(ScheduledRun{now + interval, config});
+    upcoming_.push(
+        ScheduledRun{now + first_delay, config, config->generation});
     schedule_or_shutdown_.notify_one();
   }
 
-  // Return a cancellation function.
-  return [this, config = std::move(config)]() mutable {
+  // This is the wake function.  It holds a weak reference to `config` so that
+  // it doesn't keep a cancelled event alive.
+  std::weak_ptr<EventConfig> weak_config = config;
+  auto wake = [this, weak_config = std::move(weak_config)]() {
+    const auto config = weak_config.lock();
+    if (!config) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (config->cancelled) {
+      return;
+    }
+    // Supersede the run that was scheduled for the end of the interval.
+    ++config->generation;
+    upcoming_.push(ScheduledRun{std::chrono::steady_clock::now(), config,
+                                config->generation});
+    schedule_or_shutdown_.notify_one();
+  };
+
+  // This is the cancellation function.
+  auto cancel = [this, config = std::move(config)]() mutable {
     if (!config) {
       return;
     }
@@ -56,6 +129,8 @@ EventScheduler::Cancel ThreadedEventScheduler::schedule_recurring_event(
     });
     config.reset();
   };
+
+  return RecurringEvent{std::move(cancel), std::move(wake)};
 }
 
 nlohmann::json ThreadedEventScheduler::config_json() const {
@@ -64,6 +139,11 @@ nlohmann::json ThreadedEventScheduler::config_json() const {
 }
 
 void ThreadedEventScheduler::run() {
+  auto placed = place_current_thread(placement_, "dd-trace-sched");
+  if (auto* error = placed.if_error(); error && logger_) {
+    logger_->log_error(*error);
+  }
+
   std::unique_lock<std::mutex> lock(mutex_);
 
   for (;;) {
@@ -75,14 +155,17 @@ void ThreadedEventScheduler::run() {
 
     current_ = upcoming_.top();
 
-    if (current_.config->cancelled) {
+    if (current_.config->cancelled ||
+        current_.generation != current_.config->generation) {
       upcoming_.pop();
       continue;
     }
 
     const bool changed =
         schedule_or_shutdown_.wait_until(lock, current_.when, [this]() {
-          return shutting_down_ || upcoming_.top().config != current_.config;
+          return shutting_down_ ||
+                 upcoming_.top().config != current_.config ||
+                 upcoming_.top().generation != current_.generation;
         });
 
     if (shutting_down_) {
@@ -100,8 +183,10 @@ void ThreadedEventScheduler::run() {
       continue;
     }
 
-    upcoming_.push(ScheduledRun{current_.when + current_.config->interval,
-                                current_.config});
+    const auto interval =
+        jittered(current_.config->interval, current_.config->jitter);
+    upcoming_.push(ScheduledRun{current_.when + interval, current_.config,
+                                current_.generation});
     running_current_ = true;
     lock.unlock();
     current_.config->callback();
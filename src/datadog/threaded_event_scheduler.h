@@ -4,9 +4,20 @@
 // the `EventScheduler` interface in terms of a dedicated event dispatching
 // thread. It is the default implementation used if
 // `DatadogAgent::event_scheduler` is not specified.
+//
+// The dispatching thread is stopped before `fork` and started again after it,
+// in both the parent and the child, so the scheduled events keep being
+// invoked in a forked child.  `fork` must not be called from within an
+// event's callback.
+//
+// The dispatching thread is named "dd-trace-sched".  It can be kept to some
+// CPUs, and its priority lowered, by a `ThreadPlacement` (see
+// `thread_placement.h`).  If the placement can't be applied, then the error is
+// logged and the thread runs anyway.
 
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -15,29 +26,41 @@
 #include <vector>
 
 #include "event_scheduler.h"
+#include "fork_handlers.h"
+#include "thread_placement.h"
 
 namespace datadog {
 namespace tracing {
 
+class Logger;
+
 class ThreadedEventScheduler : public EventScheduler {
   struct EventConfig {
     std::function<void()> callback;
     std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::duration jitter;
     bool cancelled;
+    // `generation` is incremented each time the event is woken.  Runs
+    // scheduled for an earlier generation are skipped.
+    std::uint64_t generation;
 
     EventConfig(std::function<void()> callback,
-                std::chrono::steady_clock::duration interval);
+                std::chrono::steady_clock::duration interval,
+                std::chrono::steady_clock::duration jitter);
   };
 
   struct ScheduledRun {
     std::chrono::steady_clock::time_point when;
     std::shared_ptr<const EventConfig> config;
+    std::uint64_t generation;
   };
 
   struct GreaterThan {
     bool operator()(const ScheduledRun&, const ScheduledRun&) const;
   };
 
+  ThreadPlacement placement_;
+  std::shared_ptr<Logger> logger_;
   std::mutex mutex_;
   ScheduledRun current_;
   std::condition_variable schedule_or_shutdown_;
@@ -47,16 +70,34 @@ class ThreadedEventScheduler : public EventScheduler {
       upcoming_;
   bool shutting_down_;
   std::thread dispatcher_;
+  UnregisterForkHandlers unregister_fork_handlers_;
 
   void run();
+  // Stop the dispatching thread, or start it again, around `fork`.
+  void stop_dispatcher();
+  void start_dispatcher();
 
  public:
   ThreadedEventScheduler();
+  // Create a scheduler whose dispatching thread has the specified `placement`,
+  // and that logs failures to apply it to the specified `logger`.
+  ThreadedEventScheduler(const ThreadPlacement& placement,
+                         const std::shared_ptr<Logger>& logger);
   ~ThreadedEventScheduler();
 
   Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
                                   std::function<void()> callback) override;
 
+  RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override;
+
+  RecurringEvent schedule_jittered_recurring_event(
+      std::chrono::steady_clock::duration first_delay,
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter,
+      std::function<void()> callback) override;
+
   nlohmann::json config_json() const override;
 };
 
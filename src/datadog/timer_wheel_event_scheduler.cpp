@@ -0,0 +1,348 @@
+#include "timer_wheel_event_scheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// Return the index of the lowest set bit of the specified nonzero `bits`.
+std::size_t lowest_bit(std::uint64_t bits) {
+  std::size_t index = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    ++index;
+  }
+  return index;
+}
+
+}  // namespace
+
+TimerWheelEventScheduler::TimerWheelEventScheduler(
+    std::chrono::steady_clock::duration resolution)
+    : resolution_(std::max(resolution, std::chrono::steady_clock::duration(1))),
+      start_(std::chrono::steady_clock::now()),
+      next_id_(1),
+      wheel_(),
+      occupied_(),
+      now_(0),
+      running_(0),
+      shutting_down_(false),
+      dispatcher_([this]() { run(); }) {
+  ForkHandlers handlers;
+  handlers.before_fork = [this]() { stop_dispatcher(); };
+  handlers.after_fork_in_parent = [this]() { start_dispatcher(); };
+  handlers.after_fork_in_child = [this]() { start_dispatcher(); };
+  unregister_fork_handlers_ = register_fork_handlers(std::move(handlers));
+}
+
+TimerWheelEventScheduler::~TimerWheelEventScheduler() {
+  unregister_fork_handlers_();
+  stop_dispatcher();
+}
+
+void TimerWheelEventScheduler::stop_dispatcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutting_down_ = true;
+    schedule_or_shutdown_.notify_one();
+  }
+  dispatcher_.join();
+}
+
+void TimerWheelEventScheduler::start_dispatcher() {
+  // The wheel is unchanged, and so the new thread resumes where the old one
+  // stopped.
+  std::lock_guard<std::mutex> lock(mutex_);
+  shutting_down_ = false;
+  dispatcher_ = std::thread([this]() { run(); });
+}
+
+EventScheduler::Cancel TimerWheelEventScheduler::schedule_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  return schedule_wakeable_recurring_event(interval, std::move(callback))
+      .cancel;
+}
+
+EventScheduler::RecurringEvent
+TimerWheelEventScheduler::schedule_wakeable_recurring_event(
+    std::chrono::steady_clock::duration interval,
+    std::function<void()> callback) {
+  return schedule_jittered_recurring_event(
+      interval, interval, std::chrono::steady_clock::duration::zero(),
+      std::move(callback));
+}
+
+EventScheduler::RecurringEvent
+TimerWheelEventScheduler::schedule_jittered_recurring_event(
+    std::chrono::steady_clock::duration first_delay,
+    std::chrono::steady_clock::duration interval,
+    std::chrono::steady_clock::duration jitter,
+    std::function<void()> callback) {
+  auto event = std::make_unique<Event>();
+  event->callback = std::move(callback);
+  event->interval = interval;
+  event->jitter = jitter;
+  event->when = std::chrono::steady_clock::now() + first_delay;
+
+  std::uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = next_id_++;
+    event->id = id;
+    schedule(*event);
+    events_.emplace(id, std::move(event));
+  }
+
+  return RecurringEvent{[this, id]() { cancel(id); },
+                        [this, id]() { wake(id); }};
+}
+
+nlohmann::json TimerWheelEventScheduler::config_json() const {
+  // clang-format off
+  return nlohmann::json::object({
+    {"type", "datadog::tracing::TimerWheelEventScheduler"},
+    {"config", nlohmann::json::object({
+      {"resolution_nanoseconds",
+       std::chrono::duration_cast<std::chrono::nanoseconds>(resolution_)
+           .count()},
+    })},
+  });
+  // clang-format on
+}
+
+TimerWheelEventScheduler::Tick TimerWheelEventScheduler::tick_of(
+    std::chrono::steady_clock::time_point time) const {
+  if (time <= start_) {
+    return 0;
+  }
+  // Round up, so that no event is invoked early.
+  const auto elapsed = (time - start_).count();
+  const auto resolution = resolution_.count();
+  return Tick((elapsed + resolution - 1) / resolution);
+}
+
+std::optional<TimerWheelEventScheduler::Tick>
+TimerWheelEventScheduler::next_tick() const {
+  // The occupied slots of each level are after `now_`'s slot at that level.
+  // An occupied slot at level zero is due at its tick, and an occupied slot at
+  // a higher level must be cascaded when `now_` reaches its first tick.
+  std::optional<Tick> result;
+  for (std::size_t level = 0; level < levels; ++level) {
+    const std::size_t shift = slot_bits * level;
+    const std::size_t digit = (now_ >> shift) & (slots - 1);
+    const std::uint64_t later =
+        occupied_[level] & ~((std::uint64_t(2) << digit) - 1);
+    if (later == 0) {
+      continue;
+    }
+    const Tick base = (now_ >> (shift + slot_bits)) << (shift + slot_bits);
+    const Tick tick = base | (Tick(lowest_bit(later)) << shift);
+    if (!result || tick < *result) {
+      result = tick;
+    }
+  }
+  return result;
+}
+
+void TimerWheelEventScheduler::link(Event& event) {
+  // An event is placed at the level of the most significant digit in which
+  // its expiry differs from `now_`.  Expiries beyond the wheel's range are
+  // placed in the wheel's last slot, and placed again when it's cascaded.
+  const Tick range = (Tick(1) << (slot_bits * levels)) - 1;
+  const Tick placed = std::min(event.expiry, now_ + range);
+  std::size_t level = 0;
+  while (level + 1 < levels &&
+         ((placed ^ now_) >> (slot_bits * (level + 1))) != 0) {
+    ++level;
+  }
+  const std::size_t shift = slot_bits * level;
+  const std::size_t slot = (placed >> shift) & (slots - 1);
+
+  Event*& head = wheel_[level][slot];
+  event.prev = nullptr;
+  event.next = head;
+  if (head) {
+    head->prev = &event;
+  }
+  head = &event;
+  event.level = level;
+  event.slot = slot;
+  event.linked = true;
+  occupied_[level] |= std::uint64_t(1) << slot;
+
+  if (!sleeping_until_) {
+    // The dispatcher is awake, and will see the event.
+    return;
+  }
+  const Tick due =
+      level == 0 ? placed
+                 : ((now_ >> (shift + slot_bits)) << (shift + slot_bits)) |
+                       (Tick(slot) << shift);
+  if (due < *sleeping_until_) {
+    schedule_or_shutdown_.notify_one();
+  }
+}
+
+void TimerWheelEventScheduler::unlink(Event& event) {
+  if (!event.linked) {
+    return;
+  }
+  if (event.prev) {
+    event.prev->next = event.next;
+  } else {
+    wheel_[event.level][event.slot] = event.next;
+  }
+  if (event.next) {
+    event.next->prev = event.prev;
+  }
+  if (!wheel_[event.level][event.slot]) {
+    occupied_[event.level] &= ~(std::uint64_t(1) << event.slot);
+  }
+  event.prev = event.next = nullptr;
+  event.linked = false;
+}
+
+void TimerWheelEventScheduler::cascade() {
+  // Higher levels first, because cascading a slot can move events into the
+  // slot below it that `now_` has also entered.
+  for (std::size_t level = levels - 1; level > 0; --level) {
+    const std::size_t shift = slot_bits * level;
+    if ((now_ & ((Tick(1) << shift) - 1)) != 0) {
+      continue;
+    }
+    const std::size_t slot = (now_ >> shift) & (slots - 1);
+    Event* event = wheel_[level][slot];
+    wheel_[level][slot] = nullptr;
+    occupied_[level] &= ~(std::uint64_t(1) << slot);
+    while (event) {
+      Event* const next = event->next;
+      event->linked = false;
+      link(*event);
+      event = next;
+    }
+  }
+}
+
+void TimerWheelEventScheduler::schedule(Event& event) {
+  event.expiry = std::max(tick_of(event.when), now_ + 1);
+  link(event);
+}
+
+void TimerWheelEventScheduler::cancel(std::uint64_t id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto found = events_.find(id);
+  if (found == events_.end()) {
+    return;
+  }
+  Event& event = *found->second;
+  event.cancelled = true;
+  unlink(event);
+  if (running_ == id) {
+    // The dispatcher removes the event once its callback returns.  Unless
+    // this is the callback cancelling its own event, wait for that.
+    if (std::this_thread::get_id() != dispatcher_.get_id()) {
+      running_done_.wait(lock, [this, id]() { return running_ != id; });
+    }
+    return;
+  }
+  events_.erase(found);
+}
+
+void TimerWheelEventScheduler::wake(std::uint64_t id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto found = events_.find(id);
+  if (found == events_.end() || found->second->cancelled) {
+    return;
+  }
+  // Supersede the invocation that was scheduled for the end of the interval.
+  Event& event = *found->second;
+  unlink(event);
+  event.when = std::chrono::steady_clock::now();
+  schedule(event);
+}
+
+void TimerWheelEventScheduler::run() {
+  std::vector<std::uint64_t> due;
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  for (;;) {
+    if (shutting_down_) {
+      return;
+    }
+
+    const Tick current = Tick(
+        (std::chrono::steady_clock::now() - start_).count() /
+        resolution_.count());
+    for (auto next = next_tick(); next && *next <= current;
+         next = next_tick()) {
+      now_ = *next;
+      cascade();
+
+      // Take the events due at `now_` out of the wheel before invoking any of
+      // them, since their callbacks might schedule or cancel events.
+      const std::size_t slot = now_ & (slots - 1);
+      due.clear();
+      for (Event* event = wheel_[0][slot]; event;) {
+        Event* const next_event = event->next;
+        event->linked = false;
+        if (event->expiry > now_) {
+          // The event was beyond the wheel's range when it was placed.
+          link(*event);
+        } else {
+          due.push_back(event->id);
+        }
+        event = next_event;
+      }
+      wheel_[0][slot] = nullptr;
+      occupied_[0] &= ~(std::uint64_t(1) << slot);
+
+      for (const std::uint64_t id : due) {
+        const auto found = events_.find(id);
+        if (found == events_.end() || found->second->cancelled) {
+          continue;
+        }
+        Event& event = *found->second;
+        event.when += jittered(event.interval, event.jitter);
+        schedule(event);
+        running_ = id;
+        lock.unlock();
+        event.callback();
+        lock.lock();
+        running_ = 0;
+        if (event.cancelled) {
+          events_.erase(id);
+        }
+        running_done_.notify_all();
+        if (shutting_down_) {
+          return;
+        }
+      }
+    }
+    now_ = std::max(now_, current);
+
+    // Sleep for at most an hour, so that the wait's deadline doesn't overflow
+    // for distant events.
+    const auto next = next_tick();
+    if (next) {
+      const Tick max_sleep = std::max<Tick>(
+          1, Tick(std::chrono::hours(1) / resolution_));
+      sleeping_until_ = std::min(*next, now_ + max_sleep);
+      schedule_or_shutdown_.wait_until(lock,
+                                       start_ + resolution_ * *sleeping_until_);
+    } else {
+      sleeping_until_ = std::numeric_limits<Tick>::max();
+      schedule_or_shutdown_.wait(lock);
+    }
+    sleeping_until_.reset();
+  }
+}
+
+}  // namespace tracing
+}  // namespace datadog
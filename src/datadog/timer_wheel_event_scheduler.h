@@ -0,0 +1,137 @@
+#pragma once
+
+// This component provides a `class`, `TimerWheelEventScheduler`, that
+// implements the `EventScheduler` interface using a hierarchical timer wheel
+// driven by a dedicated thread.
+//
+// Time is divided into ticks of a configurable `resolution`.  An event's next
+// invocation is rounded up to a tick, and so events whose invocations fall
+// within the same tick are invoked together, in one wakeup of the thread.
+// The thread sleeps until the next tick that has work to do, rather than
+// waking every tick.
+//
+// The wheel has `levels` levels of `slots` slots each.  A slot at level zero
+// holds the events due in one tick, and a slot at level `L` holds the events
+// due within `slots` to the power of `L` ticks, which are redistributed
+// ("cascaded") to lower levels as their time approaches.  Each slot is an
+// intrusive list, so scheduling, rescheduling, and cancelling an event take
+// constant time.
+//
+// Unlike `ThreadedEventScheduler`, `TimerWheelEventScheduler` doesn't
+// guarantee an order among events due in the same tick.  Like
+// `ThreadedEventScheduler`, it stops its thread before `fork` and starts it
+// again after, in both the parent and the child.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+#include "event_scheduler.h"
+#include "fork_handlers.h"
+
+namespace datadog {
+namespace tracing {
+
+class TimerWheelEventScheduler : public EventScheduler {
+ public:
+  static constexpr std::size_t levels = 6;
+  static constexpr std::size_t slot_bits = 6;
+  static constexpr std::size_t slots = std::size_t(1) << slot_bits;
+
+ private:
+  using Tick = std::uint64_t;
+
+  struct Event {
+    std::uint64_t id = 0;
+    std::function<void()> callback;
+    std::chrono::steady_clock::duration interval;
+    std::chrono::steady_clock::duration jitter;
+    // `when` is the time of the next invocation, and `expiry` is its tick.
+    std::chrono::steady_clock::time_point when;
+    Tick expiry = 0;
+    // `prev` and `next` link the event into the slot at `level` and `slot`,
+    // if `linked`.
+    Event* prev = nullptr;
+    Event* next = nullptr;
+    std::size_t level = 0;
+    std::size_t slot = 0;
+    bool linked = false;
+    bool cancelled = false;
+  };
+
+  const std::chrono::steady_clock::duration resolution_;
+  const std::chrono::steady_clock::time_point start_;
+  std::mutex mutex_;
+  // `events_` owns the scheduled events, by ID.
+  std::unordered_map<std::uint64_t, std::unique_ptr<Event>> events_;
+  std::uint64_t next_id_;
+  // `wheel_` contains the head of each slot's list, and `occupied_` has a bit
+  // set for each slot whose list is not empty.
+  Event* wheel_[levels][slots];
+  std::uint64_t occupied_[levels];
+  // `now_` is the most recent tick processed.  `sleeping_until_` is the tick
+  // that the dispatcher is waiting for, if any.
+  Tick now_;
+  std::optional<Tick> sleeping_until_;
+  // `running_` is the ID of the event whose callback is being invoked, or
+  // zero.
+  std::uint64_t running_;
+  std::condition_variable schedule_or_shutdown_;
+  std::condition_variable running_done_;
+  bool shutting_down_;
+  std::thread dispatcher_;
+  UnregisterForkHandlers unregister_fork_handlers_;
+
+  void run();
+  // Stop the dispatching thread, or start it again, around `fork`.
+  void stop_dispatcher();
+  void start_dispatcher();
+  Tick tick_of(std::chrono::steady_clock::time_point) const;
+  // Return the earliest tick after `now_` at which there is an event to
+  // invoke or a slot to cascade, or return null if there are no events.
+  std::optional<Tick> next_tick() const;
+  // Put the specified `event` into the slot for its `expiry`.  Notify the
+  // dispatcher if it is then due before the dispatcher would otherwise wake.
+  void link(Event& event);
+  void unlink(Event& event);
+  // Redistribute the events of the slots that `now_` has entered.
+  void cascade();
+  // Schedule the specified `event`'s next invocation at its `when`.
+  void schedule(Event& event);
+  void cancel(std::uint64_t id);
+  void wake(std::uint64_t id);
+
+ public:
+  // Create a scheduler whose ticks have the specified `resolution`.
+  explicit TimerWheelEventScheduler(
+      std::chrono::steady_clock::duration resolution =
+          std::chrono::milliseconds(10));
+  ~TimerWheelEventScheduler();
+
+  TimerWheelEventScheduler(const TimerWheelEventScheduler&) = delete;
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override;
+
+  RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override;
+
+  RecurringEvent schedule_jittered_recurring_event(
+      std::chrono::steady_clock::duration first_delay,
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter,
+      std::function<void()> callback) override;
+
+  nlohmann::json config_json() const override;
+};
+
+}  // namespace tracing
+}  // namespace datadog
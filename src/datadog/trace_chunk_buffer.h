@@ -0,0 +1,239 @@
+#pragma once
+
+// This component provides a class template, `TraceChunkBuffer<Chunk>`, that
+// holds trace chunks until they are flushed, subject to optional limits on the
+// number of spans and the number of bytes that it contains.
+//
+// `DatadogAgent` uses `TraceChunkBuffer` for the trace chunks that it receives
+// via `Collector::send`, so that a slow or unavailable Datadog Agent does not
+// cause the tracer to buffer without bound.
+//
+// Producers call `push`, and the consumer calls `take`, which returns the
+// chunks that sampling kept before the chunks that sampling dropped, so that
+// a consumer that cannot send everything sends the most valuable first.
+// While the buffer is within its limits, `push` appends to a lock-free
+// `MPSCQueue`.  When a push would exceed a limit, the buffer drops trace
+// chunks according to its `BufferOverflowPolicy` (see
+// `datadog_agent_config.h`).  Dropping the newest chunk is lock-free.  The
+// other policies must remove chunks that were pushed earlier, and so they
+// lock out `take` while they do so.
+//
+// `Chunk` is required to have a data member `footprint` of type
+// `TraceChunkFootprint`, which describes how much the chunk counts against the
+// buffer's limits.
+//
+// The byte limit can be shared with memory held elsewhere, such as requests
+// awaiting retry.  Those bytes are counted by an atomic specified at
+// construction.
+//
+// The buffer can be divided into shards, each having its own queue and
+// counters on cache lines of their own, and `push` can be told which shard to
+// use.  `DatadogAgent` uses a shard per NUMA node, so that threads on
+// different nodes don't contend for the same cache lines when they push.  The
+// limits apply to the buffer as a whole.  Chunks pushed to the same shard are
+// taken in the order in which they were pushed, but chunks pushed to
+// different shards are not ordered with respect to each other.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "datadog_agent_config.h"
+#include "mpsc_queue.h"
+
+namespace datadog {
+namespace tracing {
+
+struct TraceChunkFootprint {
+  std::size_t spans = 0;
+  std::size_t bytes = 0;
+  // Whether the trace chunk's sampling priority is `AUTO_DROP` or `USER_DROP`.
+  bool dropped_by_sampling = false;
+};
+
+// `DroppedTraceChunks` is the number of trace chunks, and the spans within
+// them, that a `TraceChunkBuffer` dropped to stay within its limits.
+struct DroppedTraceChunks {
+  std::size_t traces = 0;
+  std::size_t spans = 0;
+};
+
+template <typename Chunk>
+class TraceChunkBuffer {
+  std::optional<std::size_t> max_spans_;
+  std::optional<std::size_t> max_bytes_;
+  BufferOverflowPolicy policy_;
+  // `shared_bytes_`, if not null, counts bytes held outside of the buffer that
+  // count against `max_bytes_`.
+  const std::atomic<std::size_t>* shared_bytes_;
+  // The sums of the shards' `spans` and `bytes` are the totals of the chunks
+  // in the shards' `incoming` and in `buffered_`.  A chunk is counted in the
+  // shard to which it was pushed, but might be released from another, and so
+  // only the sums are meaningful.  Unsigned arithmetic wraps around, which
+  // keeps the sums exact.
+  struct alignas(64) Shard {
+    std::atomic<std::size_t> spans{0};
+    std::atomic<std::size_t> bytes{0};
+    MPSCQueue<Chunk> incoming;
+  };
+  std::size_t num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+  // `mutex_` serializes consumers of the shards' `incoming`, and protects
+  // `buffered_`.
+  std::mutex mutex_;
+  // `buffered_` contains chunks moved out of the shards' `incoming` by a
+  // `push` that had to choose chunks to drop.
+  std::deque<Chunk> buffered_;
+
+  template <typename Member>
+  std::size_t sum(Member member) const {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < num_shards_; ++i) {
+      total += (shards_[i].*member).load(std::memory_order_relaxed);
+    }
+    // The shards are read at slightly different times, and so a release might
+    // be seen without the push that preceded it, making the sum "negative."
+    return total > std::size_t(-1) / 2 ? 0 : total;
+  }
+
+  bool exceeds_limits() const {
+    const auto spans = sum(&Shard::spans);
+    auto bytes = sum(&Shard::bytes);
+    if (shared_bytes_) {
+      bytes += shared_bytes_->load(std::memory_order_relaxed);
+    }
+    return (max_spans_ && spans > *max_spans_) ||
+           (max_bytes_ && bytes > *max_bytes_);
+  }
+
+  void release(const TraceChunkFootprint& footprint, Shard& shard) {
+    shard.spans.fetch_sub(footprint.spans, std::memory_order_relaxed);
+    shard.bytes.fetch_sub(footprint.bytes, std::memory_order_relaxed);
+  }
+
+  void drop(const Chunk& chunk, DroppedTraceChunks& dropped, Shard& shard) {
+    release(chunk.footprint, shard);
+    ++dropped.traces;
+    dropped.spans += chunk.footprint.spans;
+  }
+
+  // Remove the chunks from each shard's `incoming`, and invoke the specified
+  // `visit` with each.  The caller must hold `mutex_`.
+  template <typename Visit>
+  void drain(Visit&& visit) {
+    for (std::size_t i = 0; i < num_shards_; ++i) {
+      shards_[i].incoming.drain(visit);
+    }
+  }
+
+  // Drop chunks from `buffered_` until the buffer is within its limits.  The
+  // caller must hold `mutex_`.
+  DroppedTraceChunks drop_to_fit() {
+    DroppedTraceChunks dropped;
+    if (policy_ == BufferOverflowPolicy::DROP_BY_PRIORITY) {
+      // Drop chunks that sampling dropped, oldest first, keeping the relative
+      // order of the others.
+      auto kept = buffered_.begin();
+      for (auto iter = buffered_.begin(); iter != buffered_.end(); ++iter) {
+        if (iter->footprint.dropped_by_sampling && exceeds_limits()) {
+          drop(*iter, dropped, shards_[0]);
+          continue;
+        }
+        if (kept != iter) {
+          *kept = std::move(*iter);
+        }
+        ++kept;
+      }
+      buffered_.erase(kept, buffered_.end());
+    }
+
+    while (exceeds_limits() && !buffered_.empty()) {
+      drop(buffered_.front(), dropped, shards_[0]);
+      buffered_.pop_front();
+    }
+    return dropped;
+  }
+
+ public:
+  // Create a buffer having the specified limits, overflow `policy`, and
+  // optionally specified `shared_bytes` and number of `shards`, which must be
+  // positive.
+  TraceChunkBuffer(std::optional<std::size_t> max_spans,
+                   std::optional<std::size_t> max_bytes,
+                   BufferOverflowPolicy policy,
+                   const std::atomic<std::size_t>* shared_bytes = nullptr,
+                   std::size_t shards = 1)
+      : max_spans_(max_spans),
+        max_bytes_(max_bytes),
+        policy_(policy),
+        shared_bytes_(shared_bytes),
+        num_shards_(shards),
+        shards_(std::make_unique<Shard[]>(shards)) {}
+
+  // Return the number of shards in the buffer.
+  std::size_t shards() const { return num_shards_; }
+
+  // Return the number of spans in the buffer.
+  std::size_t spans() const { return sum(&Shard::spans); }
+
+  // Return the estimated number of encoded bytes in the buffer.
+  std::size_t bytes() const { return sum(&Shard::bytes); }
+
+  // Add the specified `chunk` to the optionally specified `shard` of the
+  // buffer, modulo the number of shards, dropping chunks as necessary to stay
+  // within the buffer's limits.  Return the number of chunks dropped, which
+  // might include `chunk`.
+  DroppedTraceChunks push(Chunk chunk, std::size_t shard = 0) {
+    Shard& target = shards_[shard % num_shards_];
+    const TraceChunkFootprint footprint = chunk.footprint;
+    target.spans.fetch_add(footprint.spans, std::memory_order_relaxed);
+    target.bytes.fetch_add(footprint.bytes, std::memory_order_relaxed);
+    if (!exceeds_limits()) {
+      target.incoming.push(std::move(chunk));
+      return DroppedTraceChunks{};
+    }
+
+    if (policy_ == BufferOverflowPolicy::DROP_NEWEST) {
+      DroppedTraceChunks dropped;
+      drop(chunk, dropped, target);
+      return dropped;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    drain([&](Chunk&& pushed) { buffered_.push_back(std::move(pushed)); });
+    buffered_.push_back(std::move(chunk));
+    return drop_to_fit();
+  }
+
+  // Remove all chunks from the buffer and return them, the chunks that
+  // sampling kept first.  Otherwise, the chunks of each shard are in the
+  // order in which they were pushed.
+  std::vector<Chunk> take() {
+    std::vector<Chunk> chunks;
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Chunks that `drop_to_fit` moved into `buffered_` were pushed before any
+    // chunks remaining in the shards' `incoming`.
+    chunks.reserve(buffered_.size());
+    for (auto& chunk : buffered_) {
+      chunks.push_back(std::move(chunk));
+    }
+    buffered_.clear();
+    drain([&](Chunk&& chunk) { chunks.push_back(std::move(chunk)); });
+    for (const auto& chunk : chunks) {
+      release(chunk.footprint, shards_[0]);
+    }
+    std::stable_partition(chunks.begin(), chunks.end(), [](const Chunk& chunk) {
+      return !chunk.footprint.dropped_by_sampling;
+    });
+    return chunks;
+  }
+};
+
+}  // namespace tracing
+}  // namespace datadog
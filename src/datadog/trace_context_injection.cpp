@@ -0,0 +1,131 @@
+#include "trace_context_injection.h"
+
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <system_error>
+
+#include "dict_writer.h"
+#include "propagation_styles.h"
+#include "w3c_propagation.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `IntegerBuffer` is large enough to hold the decimal or hexadecimal
+// representation of any 64-bit integer.
+using IntegerBuffer = char[std::numeric_limits<std::uint64_t>::digits10 + 2];
+
+// Format the specified `value` in the specified `base` into the specified
+// `buffer`, and return a view of the result.
+template <typename Integer>
+std::string_view format(IntegerBuffer& buffer, Integer value, int base = 10) {
+  auto result =
+      std::to_chars(std::begin(buffer), std::end(buffer), value, base);
+  assert(result.ec == std::errc());
+  return std::string_view(buffer, result.ptr - buffer);
+}
+
+}  // namespace
+
+void inject_trace_context(DictWriter& writer, const PropagationStyles& styles,
+                          const InjectedContext& context) {
+  // The headers are collected into `entries` and then written in one call.
+  DictWriter::Entry entries[12];
+  std::size_t count = 0;
+  IntegerBuffer trace_id_buffer;
+  IntegerBuffer span_id_buffer;
+  IntegerBuffer priority_buffer;
+  IntegerBuffer b3_trace_id_buffer;
+  TraceID::HexBuffer b3_trace_id_128_buffer;
+  IntegerBuffer b3_span_id_buffer;
+  char b3_buffer[32 + 1 + 16 + 2];
+  TraceParentBuffer traceparent_buffer;
+  TraceStateBuffer tracestate_buffer;
+
+  const TraceID& trace_id = context.trace_id;
+  const std::uint64_t span_id = context.span_id;
+  const auto& sampling_priority = context.sampling_priority;
+
+  // Origin and trace tag headers are always propagated.
+  // Other headers depend on the injection styles.
+  if (context.origin) {
+    entries[count++] = {"x-datadog-origin", *context.origin};
+  }
+  if (!context.trace_tags.empty() && !context.trace_tags_too_large) {
+    entries[count++] = {"x-datadog-tags", context.trace_tags};
+  }
+
+  // The request for the sampling decision doesn't depend on the injection
+  // styles either.
+  if (context.delegate_sampling) {
+    entries[count++] = {"x-datadog-delegate-trace-sampling", "delegate"};
+  }
+
+  if (styles.datadog) {
+    entries[count++] = {"x-datadog-trace-id",
+                        format(trace_id_buffer, trace_id.low)};
+    entries[count++] = {"x-datadog-parent-id",
+                        format(span_id_buffer, span_id)};
+    if (sampling_priority) {
+      entries[count++] = {"x-datadog-sampling-priority",
+                          format(priority_buffer, *sampling_priority)};
+    }
+  }
+
+  if (styles.b3) {
+    // A 128-bit trace ID is all 32 hexadecimal digits, while a 64-bit trace ID
+    // is as short as possible, as it always has been.
+    entries[count++] = {
+        "x-b3-traceid", trace_id.high
+                            ? trace_id.hex_padded(b3_trace_id_128_buffer)
+                            : format(b3_trace_id_buffer, trace_id.low, 16)};
+    entries[count++] = {"x-b3-spanid", format(b3_span_id_buffer, span_id, 16)};
+    if (sampling_priority) {
+      entries[count++] = {"x-b3-sampled", *sampling_priority > 0 ? "1" : "0"};
+    }
+  }
+
+  if (styles.b3_single) {
+    // "{trace ID}-{span ID}[-{sampled}]", where the trace ID is 16 or 32
+    // hexadecimal digits, as with "x-b3-traceid".
+    char* end = b3_buffer;
+    if (trace_id.high) {
+      write_hex16(end, trace_id.high);
+      end += 16;
+    }
+    write_hex16(end, trace_id.low);
+    end += 16;
+    *end++ = '-';
+    write_hex16(end, span_id);
+    end += 16;
+    if (sampling_priority) {
+      *end++ = '-';
+      *end++ = *sampling_priority > 0 ? '1' : '0';
+    }
+    entries[count++] = {"b3", std::string_view(b3_buffer, end - b3_buffer)};
+  }
+
+  if (styles.w3c) {
+    entries[count++] = {
+        "traceparent",
+        format_traceparent(traceparent_buffer, trace_id, span_id,
+                           sampling_priority && *sampling_priority > 0)};
+    const auto tracestate =
+        format_tracestate(tracestate_buffer, sampling_priority,
+                          context.origin, context.trace_tags,
+                          context.w3c_tracestate);
+    if (!tracestate.empty()) {
+      entries[count++] = {"tracestate", tracestate};
+    }
+  }
+
+  assert(count <= std::size(entries));
+  writer.set_all(entries, count);
+}
+
+}  // namespace tracing
+}  // namespace datadog
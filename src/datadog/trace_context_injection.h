@@ -0,0 +1,54 @@
+#pragma once
+
+// This component provides a function, `inject_trace_context`, that writes the
+// trace context headers of each of the injection styles to a `DictWriter`.
+//
+// `TraceSegment::inject` uses it to propagate a span, and `Tracer::propagate`
+// uses it to pass on the trace context of an inbound request without a span.
+// The headers' values are formatted into buffers on the stack, or are views of
+// the `InjectedContext`, and so writing them doesn't allocate.
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+class DictWriter;
+struct PropagationStyles;
+
+// `InjectedContext` is the trace context written by `inject_trace_context`.
+struct InjectedContext {
+  TraceID trace_id;
+  // `span_id` is the parent of the receiver's spans.
+  std::uint64_t span_id = 0;
+  // If `sampling_priority` is null, then the headers that carry it are
+  // omitted, and "traceparent" isn't "sampled", so that the receiver makes the
+  // sampling decision.
+  std::optional<int> sampling_priority;
+  std::optional<std::string_view> origin;
+  // `trace_tags` are in the format of the "x-datadog-tags" header.  If empty,
+  // then the header is omitted.  If `trace_tags_too_large`, then the header is
+  // omitted too, and only the tags that fit in "tracestate" are propagated.
+  std::string_view trace_tags;
+  bool trace_tags_too_large = false;
+  // `w3c_tracestate` is the inbound "tracestate" header of the trace, if any,
+  // whose members other than "dd" are passed on in "tracestate".
+  std::string_view w3c_tracestate;
+  // `delegate_sampling` is whether to ask the receiver for the sampling
+  // decision (see `TracerConfig::delegate_trace_sampling`).
+  bool delegate_sampling = false;
+};
+
+// Write the headers of the specified `context` in the specified `styles` to
+// the specified `writer`, in one call to `DictWriter::set_all`.  The origin,
+// trace tags, and sampling delegation headers are written whatever the
+// styles.
+void inject_trace_context(DictWriter& writer, const PropagationStyles& styles,
+                          const InjectedContext& context);
+
+}  // namespace tracing
+}  // namespace datadog
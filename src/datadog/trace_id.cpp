@@ -0,0 +1,183 @@
+#include "trace_id.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include "error.h"
+#include "parse_util.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+// `hex_values[c]` is the value of the hexadecimal digit `c`, or -1 if `c` is
+// not a hexadecimal digit.
+constexpr auto hex_values = []() {
+  std::array<signed char, 256> values{};
+  for (auto& value : values) {
+    value = -1;
+  }
+  for (int i = 0; i < 10; ++i) {
+    values['0' + i] = static_cast<signed char>(i);
+  }
+  for (int i = 0; i < 6; ++i) {
+    values['a' + i] = values['A' + i] = static_cast<signed char>(10 + i);
+  }
+  return values;
+}();
+
+constexpr std::uint64_t lanes_of(unsigned char byte) {
+  return 0x0101010101010101ULL * byte;
+}
+
+// Return the high bit of each of the specified `lanes` that is within
+// `[low, high]`.  Each lane must be less than 0x80.
+constexpr std::uint64_t lanes_within(std::uint64_t lanes, unsigned char low,
+                                     unsigned char high) {
+  return (lanes + lanes_of(0x80 - low)) & ~(lanes + lanes_of(0x7F - high)) &
+         lanes_of(0x80);
+}
+
+// Return the value of the eight hexadecimal digits beginning at the specified
+// `digits`.  If any of them is not a hexadecimal digit, then set bits in the
+// specified `invalid`.
+std::uint64_t read_hex8(const char* digits, int& invalid) {
+  const std::uint64_t lanes = load_lanes(digits);
+  // Setting bit 5 maps "A" through "F" onto "a" through "f".
+  const std::uint64_t valid = lanes_within(lanes, '0', '9') |
+                              lanes_within(lanes | lanes_of(0x20), 'a', 'f');
+  invalid |= int(((lanes & lanes_of(0x80)) | (valid ^ lanes_of(0x80))) != 0);
+
+  // A letter's low nibble is nine less than its value.  Only letters have
+  // bit 6 set.
+  std::uint64_t value =
+      (lanes & lanes_of(0x0F)) + ((lanes & lanes_of(0x40)) >> 6) * 9;
+  // Combine adjacent nibbles into bytes, bytes into 16-bit words, and then
+  // words into the result.  The first digit is the least significant lane.
+  value = ((value & 0x00FF00FF00FF00FFULL) << 4) |
+          ((value >> 8) & 0x00FF00FF00FF00FFULL);
+  value = ((value & 0x0000FFFF0000FFFFULL) << 8) |
+          ((value >> 16) & 0x0000FFFF0000FFFFULL);
+  return ((value & 0xFFFFFFFFULL) << 16) | (value >> 32);
+}
+
+// Write the eight lowercase hexadecimal digits of the specified `value`,
+// which is less than 2^32, padded with leading zeros, to the specified
+// `destination`.  This is the inverse of `read_hex8`.
+void write_hex8(char* destination, std::uint64_t value) {
+  value = ((value & 0xFFFFULL) << 32) | (value >> 16);
+  value = ((value & 0x000000FF000000FFULL) << 16) |
+          ((value >> 8) & 0x000000FF000000FFULL);
+  value = ((value & 0x000F000F000F000FULL) << 8) |
+          ((value >> 4) & 0x000F000F000F000FULL);
+  // Each lane is now a nibble.  Those of 10 or more become letters.
+  const std::uint64_t letters = ((value + lanes_of(0x06)) >> 4) & lanes_of(1);
+  store_lanes(destination,
+              value + lanes_of('0') + letters * ('a' - '0' - 10));
+}
+
+Error invalid_hex(std::string_view input, std::size_t max_digits) {
+  if (input.size() > max_digits) {
+    std::string message;
+    message += "Hexadecimal integer has more than ";
+    message += std::to_string(max_digits);
+    message += " digits: ";
+    message += input;
+    return Error{Error::OUT_OF_RANGE_INTEGER, std::move(message)};
+  }
+  std::string message;
+  message += "Is not a valid hexadecimal integer: \"";
+  message += input;
+  message += '\"';
+  return Error{Error::INVALID_INTEGER, std::move(message)};
+}
+
+}  // namespace
+
+void write_hex16(char* destination, std::uint64_t value) {
+  write_hex8(destination, value >> 32);
+  write_hex8(destination + 8, value & 0xFFFFFFFFULL);
+}
+
+std::uint64_t read_hex(std::string_view digits, int& invalid) {
+  std::uint64_t value = 0;
+  const char* next = digits.data();
+  const char* const end = next + digits.size();
+  for (; end - next >= 8; next += 8) {
+    value = (value << 32) | read_hex8(next, invalid);
+  }
+  for (; next != end; ++next) {
+    const int digit_value = hex_values[static_cast<unsigned char>(*next)];
+    // Only a negative `digit_value` has bits above the low four, and so
+    // poisons `invalid`.
+    invalid |= digit_value & ~0xF;
+    value = (value << 4) | std::uint64_t(digit_value & 0xF);
+  }
+  return value;
+}
+
+TraceID::TraceID(std::uint64_t low) : low(low) {}
+
+TraceID::TraceID(std::uint64_t low, std::uint64_t high)
+    : low(low), high(high) {}
+
+std::string_view TraceID::hex_padded(HexBuffer& buffer) const {
+  write_hex16(buffer, high);
+  write_hex16(buffer + 16, low);
+  return std::string_view(buffer, sizeof buffer);
+}
+
+std::string TraceID::hex_padded() const {
+  HexBuffer buffer;
+  return std::string(hex_padded(buffer));
+}
+
+Expected<TraceID> TraceID::parse_hex(std::string_view input) {
+  if (input.empty() || input.size() > 32) {
+    return invalid_hex(input, 32);
+  }
+  const std::size_t low_digits = std::min<std::size_t>(input.size(), 16);
+  const std::size_t high_digits = input.size() - low_digits;
+  int invalid = 0;
+  TraceID result;
+  result.high = read_hex(input.substr(0, high_digits), invalid);
+  result.low = read_hex(input.substr(high_digits), invalid);
+  if (invalid) {
+    return invalid_hex(input, 32);
+  }
+  return result;
+}
+
+bool operator==(TraceID left, TraceID right) {
+  return left.low == right.low && left.high == right.high;
+}
+
+bool operator!=(TraceID left, TraceID right) { return !(left == right); }
+
+bool operator==(TraceID left, std::uint64_t right) {
+  return left.high == 0 && left.low == right;
+}
+
+bool operator!=(TraceID left, std::uint64_t right) { return !(left == right); }
+
+std::string hex_padded(std::uint64_t value) {
+  char buffer[16];
+  write_hex16(buffer, value);
+  return std::string(buffer, sizeof buffer);
+}
+
+Expected<std::uint64_t> parse_hex_uint64(std::string_view input) {
+  if (input.empty() || input.size() > 16) {
+    return invalid_hex(input, 16);
+  }
+  int invalid = 0;
+  const std::uint64_t value = read_hex(input, invalid);
+  if (invalid) {
+    return invalid_hex(input, 16);
+  }
+  return value;
+}
+
+}  // namespace tracing
+}  // namespace datadog
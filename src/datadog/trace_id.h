@@ -0,0 +1,74 @@
+#pragma once
+
+// This component provides a `struct`, `TraceID`, that is a 128-bit trace ID.
+//
+// Datadog trace IDs were historically 64 bits.  The low 64 bits of a 128-bit
+// trace ID are what is sent to the Datadog Agent as the span's "trace_id",
+// what is propagated in the "x-datadog-trace-id" header, and what trace
+// sampling decisions are based on.  The high 64 bits, if not zero, are
+// propagated and reported as the "_dd.p.tid" trace tag, formatted as 16
+// hexadecimal digits.
+//
+// The hexadecimal formatting and parsing functions below are for the fixed
+// sizes used in propagation, and so they don't branch on the value of each
+// digit.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "expected.h"
+
+namespace datadog {
+namespace tracing {
+
+struct TraceID {
+  std::uint64_t low = 0;
+  std::uint64_t high = 0;
+
+  TraceID() = default;
+  explicit TraceID(std::uint64_t low);
+  TraceID(std::uint64_t low, std::uint64_t high);
+
+  // `HexBuffer` is large enough to hold all 32 hexadecimal digits of a
+  // `TraceID`.
+  using HexBuffer = char[32];
+
+  // Format this ID as 32 lowercase hexadecimal digits, padded with leading
+  // zeros, into the specified `buffer`, and return a view of the result.
+  std::string_view hex_padded(HexBuffer& buffer) const;
+  // Return this ID as 32 lowercase hexadecimal digits, padded with leading
+  // zeros.
+  std::string hex_padded() const;
+
+  // Return a `TraceID` parsed from the specified `input`, which is one to 32
+  // hexadecimal digits, or return an `Error` if `input` is not.
+  static Expected<TraceID> parse_hex(std::string_view input);
+};
+
+bool operator==(TraceID left, TraceID right);
+bool operator!=(TraceID left, TraceID right);
+// Return whether the specified `left` is the 64-bit trace ID `right`, i.e.
+// whether its high bits are zero and its low bits are `right`.
+bool operator==(TraceID left, std::uint64_t right);
+bool operator!=(TraceID left, std::uint64_t right);
+
+// Return the specified `value` as 16 lowercase hexadecimal digits, padded with
+// leading zeros.  This is the format of the "_dd.p.tid" trace tag.
+std::string hex_padded(std::uint64_t value);
+
+// Return the value of the specified `input`, which is one to 16 hexadecimal
+// digits, or return an `Error` if `input` is not.
+Expected<std::uint64_t> parse_hex_uint64(std::string_view input);
+
+// Write the 16 lowercase hexadecimal digits of the specified `value`, padded
+// with leading zeros, to the specified `destination`.
+void write_hex16(char* destination, std::uint64_t value);
+
+// Return the value of the specified `digits`, which are at most 16 in number.
+// If any of them is not a hexadecimal digit, then set bits in the specified
+// `invalid`, which the caller checks once after reading all of its digits.
+std::uint64_t read_hex(std::string_view digits, int& invalid);
+
+}  // namespace tracing
+}  // namespace datadog
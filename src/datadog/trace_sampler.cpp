@@ -1,9 +1,19 @@
 #include "trace_sampler.h"
 
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
 #include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <sstream>
+#include <utility>
 
 #include "collector_response.h"
 #include "json.hpp"
@@ -15,33 +25,89 @@
 namespace datadog {
 namespace tracing {
 
+TraceSampler::CollectorRates::Threshold::Threshold(Rate rate)
+    : rate(rate), max_id(max_id_from_rate(rate)) {}
+
+TraceSampler::CompiledRule::CompiledRule(
+    const FinalizedTraceSamplerConfig::Rule& rule)
+    : matcher(rule),
+      sample_rate(rule.sample_rate),
+      max_id(max_id_from_rate(rule.sample_rate)) {}
+
+std::size_t TraceSampler::CollectorRates::hash(std::string_view service,
+                                               std::string_view environment) {
+  const std::hash<std::string_view> hash;
+  const std::size_t result = hash(service);
+  return result ^ (hash(environment) + 0x9e3779b9 + (result << 6) +
+                   (result >> 2));
+}
+
+const TraceSampler::CollectorRates::Threshold*
+TraceSampler::CollectorRates::find(
+    std::string_view service, std::string_view environment) const {
+  const auto [begin, end] = rates.equal_range(hash(service, environment));
+  for (auto iter = begin; iter != end; ++iter) {
+    const Entry& entry = iter->second;
+    if (entry.service == service && entry.environment == environment) {
+      return &entry.threshold;
+    }
+  }
+  return nullptr;
+}
+
+TraceSampler::RuleSet::RuleSet(const FinalizedTraceSamplerConfig& config,
+                               const Clock& clock)
+    : rules(config.rules),
+      limiter(clock, config.max_per_second),
+      limiter_max_per_second(config.max_per_second) {
+  compiled_rules.reserve(rules.size());
+  for (const auto& rule : rules) {
+    compiled_rules.emplace_back(rule);
+  }
+}
+
 TraceSampler::TraceSampler(const FinalizedTraceSamplerConfig& config,
                            const Clock& clock)
-    : rules_(config.rules),
-      limiter_(clock, config.max_per_second),
-      limiter_max_per_second_(config.max_per_second) {}
+    : collector_rates_(std::make_shared<const CollectorRates>()),
+      collector_response_version_(0),
+      rates_file_(config.rates_file),
+      rates_file_max_age_(config.rates_file_max_age),
+      rule_set_(std::make_shared<RuleSet>(config, clock)),
+      clock_(clock),
+      adaptive_(config.target_spans_per_second
+                    ? std::make_unique<AdaptiveSampler>(
+                          clock, *config.target_spans_per_second)
+                    : nullptr) {
+  if (rates_file_) {
+    if (auto rates = load_rates()) {
+      collector_rates_ = std::move(rates);
+    }
+  }
+}
 
 SamplingDecision TraceSampler::decide(const SpanData& span) {
   SamplingDecision decision;
   decision.origin = SamplingDecision::Origin::LOCAL;
 
   // First check sampling rules.
-  auto found_rule =
-      std::find_if(rules_.begin(), rules_.end(),
-                   [&](const auto& rule) { return rule.match(span); });
-
-  // `mutex_` protects `limiter_`, `collector_sample_rates_`, and
-  // `collector_default_sample_rate_`, so let's lock it here.
-  std::lock_guard lock(mutex_);
+  const auto rule_set =
+      std::atomic_load_explicit(&rule_set_, std::memory_order_acquire);
+  const auto& compiled_rules = rule_set->compiled_rules;
+  const auto found_rule =
+      compiled_rules.begin() +
+      rule_set->match_cache.find(
+          span, compiled_rules.size(),
+          [&](std::size_t i) -> const CompiledSpanMatcher& {
+            return compiled_rules[i].matcher;
+          });
 
-  if (found_rule != rules_.end()) {
+  if (found_rule != compiled_rules.end()) {
     const auto& rule = *found_rule;
     decision.mechanism = int(SamplingMechanism::RULE);
-    decision.limiter_max_per_second = limiter_max_per_second_;
+    decision.limiter_max_per_second = rule_set->limiter_max_per_second;
     decision.configured_rate = rule.sample_rate;
-    const std::uint64_t threshold = max_id_from_rate(rule.sample_rate);
-    if (knuth_hash(span.trace_id) < threshold) {
-      const auto result = limiter_.allow();
+    if (knuth_hash(span.trace_id.low) < rule.max_id) {
+      const auto result = rule_set->limiter.allow();
       if (result.allowed) {
         decision.priority = int(SamplingPriority::USER_KEEP);
       } else {
@@ -55,27 +121,45 @@ SamplingDecision TraceSampler::decide(const SpanData& span) {
     return decision;
   }
 
-  // No sampling rule matched.  Find the appropriate collector-controlled
-  // sample rate.
-  auto found_rate = collector_sample_rates_.find(
-      CollectorResponse::key(span.service, span.environment().value_or("")));
-  if (found_rate != collector_sample_rates_.end()) {
-    decision.configured_rate = found_rate->second;
+  // No sampling rule matched.  Adaptive sampling, if configured, takes the
+  // place of the collector-controlled rates.  Like the default rate, it's a
+  // rate chosen by the tracer itself.
+  if (adaptive_) {
+    const auto adaptive_decision = adaptive_->decide(span);
+    decision.configured_rate = adaptive_decision.rate;
+    decision.mechanism = int(SamplingMechanism::DEFAULT);
+    if (knuth_hash(span.trace_id.low) < adaptive_decision.max_id) {
+      decision.priority = int(SamplingPriority::AUTO_KEEP);
+    } else {
+      decision.priority = int(SamplingPriority::AUTO_DROP);
+    }
+    return decision;
+  }
+
+  // Find the appropriate collector-controlled sample rate.
+  const auto collector_rates = std::atomic_load_explicit(
+      &collector_rates_, std::memory_order_acquire);
+  std::uint64_t max_id;
+  if (const auto* found = collector_rates->find(
+          span.service, span.environment().value_or(""))) {
+    decision.configured_rate = found->rate;
+    max_id = found->max_id;
     decision.mechanism = int(SamplingMechanism::AGENT_RATE);
   } else {
-    if (collector_default_sample_rate_) {
-      decision.configured_rate = *collector_default_sample_rate_;
+    if (collector_rates->default_rate) {
+      decision.configured_rate = collector_rates->default_rate->rate;
+      max_id = collector_rates->default_rate->max_id;
       decision.mechanism = int(SamplingMechanism::AGENT_RATE);
     } else {
       // We have yet to receive a default rate from the collector.  This
       // corresponds to the `DEFAULT` sampling mechanism.
       decision.configured_rate = Rate::one();
+      max_id = max_id_from_rate(Rate::one());
       decision.mechanism = int(SamplingMechanism::DEFAULT);
     }
   }
 
-  const std::uint64_t threshold = max_id_from_rate(*decision.configured_rate);
-  if (knuth_hash(span.trace_id) < threshold) {
+  if (knuth_hash(span.trace_id.low) < max_id) {
     decision.priority = int(SamplingPriority::AUTO_KEEP);
   } else {
     decision.priority = int(SamplingPriority::AUTO_DROP);
@@ -84,29 +168,209 @@ SamplingDecision TraceSampler::decide(const SpanData& span) {
   return decision;
 }
 
+void TraceSampler::update(const FinalizedTraceSamplerConfig& config) {
+  std::atomic_store_explicit(&rule_set_,
+                             std::make_shared<RuleSet>(config, clock_),
+                             std::memory_order_release);
+}
+
 void TraceSampler::handle_collector_response(
     const CollectorResponse& response) {
+  if (response.version != 0) {
+    std::lock_guard<std::mutex> lock(collector_rates_mutex_);
+    if (response.version == collector_response_version_) {
+      // These are the rates that we already have.
+      return;
+    }
+  }
+
+  // Get the new snapshot before taking the lock.
+  std::shared_ptr<const CollectorRates> snapshot =
+      response.version != 0 ? shared_rates(response) : make_rates(response);
+
+  std::lock_guard<std::mutex> lock(collector_rates_mutex_);
+  if (!snapshot->default_rate) {
+    // Keep the previous default rate.  The snapshot might be shared, so
+    // modify a copy.
+    const auto previous =
+        std::atomic_load_explicit(&collector_rates_, std::memory_order_relaxed);
+    if (previous->default_rate) {
+      auto rates = std::make_shared<CollectorRates>(*snapshot);
+      rates->default_rate = previous->default_rate;
+      snapshot = std::move(rates);
+    }
+  }
+  if (rates_file_) {
+    save_rates(*snapshot);
+  }
+  std::atomic_store_explicit(&collector_rates_, std::move(snapshot),
+                             std::memory_order_release);
+  collector_response_version_ = response.version;
+}
+
+std::shared_ptr<const TraceSampler::CollectorRates> TraceSampler::make_rates(
+    const CollectorResponse& response) {
+  auto rates = std::make_shared<CollectorRates>();
+  rates->rates.reserve(response.sample_rate_by_key.size());
+  for (const auto& [key, rate] : response.sample_rate_by_key) {
+    const auto parsed = CollectorResponse::parse_key(key);
+    if (!parsed) {
+      // No span could have this key.
+      continue;
+    }
+    const auto& [service, environment] = *parsed;
+    rates->rates.emplace(
+        CollectorRates::hash(service, environment),
+        CollectorRates::Entry{std::string(service), std::string(environment),
+                              CollectorRates::Threshold(rate)});
+  }
   const auto found =
       response.sample_rate_by_key.find(response.key_of_default_rate);
-  std::lock_guard<std::mutex> lock(mutex_);
-
   if (found != response.sample_rate_by_key.end()) {
-    collector_default_sample_rate_ = found->second;
+    rates->default_rate.emplace(found->second);
+  }
+  return rates;
+}
+
+std::shared_ptr<const TraceSampler::CollectorRates> TraceSampler::shared_rates(
+    const CollectorResponse& response) {
+  assert(response.version != 0);
+  // Versions are unique within the process, so the most recently converted
+  // response is identified by its version alone.  The rates are built while
+  // the lock is held, so that samplers handling the same response
+  // concurrently don't each build them.
+  static std::mutex mutex;
+  static std::uint64_t version = 0;
+  static std::weak_ptr<const CollectorRates> latest;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (version == response.version) {
+    if (auto rates = latest.lock()) {
+      return rates;
+    }
+  }
+  auto rates = make_rates(response);
+  version = response.version;
+  latest = rates;
+  return rates;
+}
+
+std::shared_ptr<const TraceSampler::CollectorRates> TraceSampler::load_rates()
+    const {
+  std::ifstream file(*rates_file_);
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  if (!file) {
+    return nullptr;
+  }
+  const auto json = nlohmann::json::parse(contents.str(), nullptr, false);
+  if (!json.is_object()) {
+    // This includes the "discarded" value of a parse error.
+    return nullptr;
   }
 
-  collector_sample_rates_ = response.sample_rate_by_key;
+  const auto time = json.find("time");
+  if (time == json.end() || !time->is_number_integer()) {
+    return nullptr;
+  }
+  const std::chrono::system_clock::time_point written{
+      std::chrono::seconds(time->get<std::int64_t>())};
+  const auto now = clock_().wall;
+  if (written > now || now - written > rates_file_max_age_) {
+    return nullptr;
+  }
+
+  const auto rates = json.find("rate_by_service");
+  if (rates == json.end() || !rates->is_object()) {
+    return nullptr;
+  }
+  CollectorResponse response;
+  for (const auto& [key, value] : rates->items()) {
+    if (!value.is_number()) {
+      return nullptr;
+    }
+    auto rate = Rate::from(value.get<double>());
+    if (!rate) {
+      return nullptr;
+    }
+    response.sample_rate_by_key.emplace(key, *rate);
+  }
+  return make_rates(response);
+}
+
+void TraceSampler::save_rates(const CollectorRates& rates) const {
+  auto by_key = nlohmann::json::object();
+  for (const auto& item : rates.rates) {
+    const CollectorRates::Entry& entry = item.second;
+    by_key[CollectorResponse::key(entry.service, entry.environment)] =
+        double(entry.threshold.rate);
+  }
+  if (rates.default_rate) {
+    by_key[CollectorResponse::key_of_default_rate] =
+        double(rates.default_rate->rate);
+  }
+  const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+      clock_().wall.time_since_epoch());
+  const auto json = nlohmann::json::object({
+      {"time", std::int64_t(seconds.count())},
+      {"rate_by_service", std::move(by_key)},
+  });
+
+  // Write a temporary file next to the rates file and then rename it over
+  // the rates file, so that readers see either the old rates or the new.
+  std::string temporary = *rates_file_;
+  temporary += ".tmp";
+#ifndef _MSC_VER
+  temporary += '.';
+  temporary += std::to_string(::getpid());
+#endif
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    file << json.dump();
+    if (!file.flush()) {
+      std::remove(temporary.c_str());
+      return;
+    }
+  }
+  if (std::rename(temporary.c_str(), rates_file_->c_str()) != 0) {
+    std::remove(temporary.c_str());
+  }
+}
+
+bool TraceSampler::adaptive() const { return bool(adaptive_); }
+
+void TraceSampler::count_spans(std::size_t count) {
+  if (adaptive_) {
+    adaptive_->count_spans(count);
+  }
+}
+
+void TraceSampler::adapt() {
+  if (adaptive_) {
+    adaptive_->adapt();
+  }
 }
 
 nlohmann::json TraceSampler::config_json() const {
+  const auto rule_set =
+      std::atomic_load_explicit(&rule_set_, std::memory_order_acquire);
   std::vector<nlohmann::json> rules;
-  for (const auto& rule : rules_) {
+  for (const auto& rule : rule_set->rules) {
     rules.push_back(to_json(rule));
   }
 
-  return nlohmann::json::object({
+  auto config = nlohmann::json::object({
       {"rules", rules},
-      {"max_per_second", limiter_max_per_second_},
+      {"max_per_second", rule_set->limiter_max_per_second},
   });
+  if (adaptive_) {
+    config["target_spans_per_second"] = adaptive_->target_spans_per_second();
+  }
+  if (rates_file_) {
+    config["rates_file"] = *rates_file_;
+    config["rates_file_max_age_seconds"] = rates_file_max_age_.count();
+  }
+  return config;
 }
 
 }  // namespace tracing
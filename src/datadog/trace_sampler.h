@@ -82,16 +82,61 @@
 // rate) is limited by a configurable number of traces-per-second.  The limit is
 // configured via `TraceSamplerConfig::max_per_second` or the
 // `DD_TRACE_RATE_LIMIT` environment variable.
+//
+// 4. Adaptive Sampling
+// --------------------
+// If `TraceSamplerConfig::target_spans_per_second` is given a value, or if the
+// `DD_TRACE_TARGET_SPANS_PER_SECOND` environment variable has a value, then
+// root spans that match no sampling rule are sampled at rates that the tracer
+// adjusts every second, instead of at the Datadog Agent's rates.  The rates
+// are chosen per service, resource, and error status so that the kept traces
+// add up to the target number of spans per second, favoring rare traces over
+// common ones.  See `adaptive_sampler.h`.
+//
+// Persisted Agent Rates
+// ---------------------
+// Until the Datadog Agent first responds, which takes at least one flush
+// interval, a sampler has no Agent rates, and so keeps every trace that no
+// rule or adaptive rate covers.  When many processes start at once, e.g.
+// during a rolling deployment, those traces add up.
+//
+// If `TraceSamplerConfig::rates_file` or the `DD_TRACE_SAMPLER_RATES_FILE`
+// environment variable names a file, then the sampler writes the Agent's
+// rates to that file whenever they change, and a sampler created later
+// starts with the rates in the file, unless the file was written more than
+// `TraceSamplerConfig::rates_file_max_age_seconds` ago.  The file is JSON
+// having the Agent's "rate_by_service" property and the "time", in seconds
+// since the Unix epoch, at which it was written.  It is replaced atomically,
+// so processes that share it don't read partial updates.  A file that is
+// missing, stale, or malformed is ignored, as are failures to write it.  A
+// path on a memory file system, such as "/dev/shm", avoids the disk.
+//
+// Updating Rules
+// --------------
+// `update` replaces the sampling rules, the global sample rate, and the rate
+// limit while the sampler is in use, e.g. via `Tracer::update_sampling`.
+// Decisions already made stand, and decisions made afterward, including for
+// traces that were already open, use the new rules.  The sample rates
+// received from the collector and the adaptive sampling configuration are
+// unaffected.
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
+#include "adaptive_sampler.h"
 #include "clock.h"
 #include "json_fwd.hpp"
 #include "limiter.h"
 #include "rate.h"
+#include "rule_match_cache.h"
+#include "span_matcher.h"
 #include "trace_sampler_config.h"
 
 namespace datadog {
@@ -102,14 +147,91 @@ struct SamplingDecision;
 struct SpanData;
 
 class TraceSampler {
-  std::mutex mutex_;
+  // `CollectorRates` is an immutable snapshot of the sample rates most
+  // recently received from the collector.  `rates` is keyed by a hash of the
+  // service and environment (see `hash`), so that looking up a span's rate
+  // doesn't build a key string.  Each rate is stored with its sampling
+  // threshold (see `max_id_from_rate`), computed once per collector response
+  // rather than once per decision.
+  struct CollectorRates {
+    struct Threshold {
+      Rate rate;
+      std::uint64_t max_id;
+
+      explicit Threshold(Rate);
+    };
+    struct Entry {
+      std::string service;
+      std::string environment;
+      Threshold threshold;
+    };
+    std::optional<Threshold> default_rate;
+    std::unordered_multimap<std::size_t, Entry> rates;
 
-  std::optional<Rate> collector_default_sample_rate_;
-  std::unordered_map<std::string, Rate> collector_sample_rates_;
+    static std::size_t hash(std::string_view service,
+                            std::string_view environment);
+    // Return the rate for the specified `service` and `environment`, or return
+    // null if there is none.
+    const Threshold* find(std::string_view service,
+                          std::string_view environment) const;
+  };
+  // `CompiledRule` is what `decide` needs of a sampling rule: its compiled
+  // matcher, its rate, and the threshold derived from the rate.  There is one
+  // `Limiter`, `limiter_`, shared by all rules.
+  struct CompiledRule {
+    CompiledSpanMatcher matcher;
+    Rate sample_rate;
+    std::uint64_t max_id;
 
-  std::vector<FinalizedTraceSamplerConfig::Rule> rules_;
-  Limiter limiter_;
-  double limiter_max_per_second_;
+    explicit CompiledRule(const FinalizedTraceSamplerConfig::Rule&);
+  };
+  // `collector_rates_` is read and replaced using the atomic `shared_ptr`
+  // functions, so that `decide` doesn't block on a collector response.
+  // `collector_rates_mutex_` serializes only the replacements, and protects
+  // `collector_response_version_`, the nonzero `CollectorResponse::version`
+  // of the rates, if any.
+  std::shared_ptr<const CollectorRates> collector_rates_;
+  std::mutex collector_rates_mutex_;
+  std::uint64_t collector_response_version_;
+
+  // `rates_file_` names the file in which the collector's rates are kept, if
+  // any.  It's written while `collector_rates_mutex_` is held.
+  std::optional<std::string> rates_file_;
+  std::chrono::seconds rates_file_max_age_;
+
+  // Return the rates of the specified `response`.
+  static std::shared_ptr<const CollectorRates> make_rates(
+      const CollectorResponse& response);
+  // Return the rates of the specified `response`, which has a nonzero
+  // `version`.  Such a response is converted once per process: every
+  // `TraceSampler` that handles it shares the same immutable rates.
+  static std::shared_ptr<const CollectorRates> shared_rates(
+      const CollectorResponse& response);
+  // Return the rates in `rates_file_`, or return null if it is missing,
+  // stale, or malformed.
+  std::shared_ptr<const CollectorRates> load_rates() const;
+  // Write the specified `rates` to `rates_file_`.
+  void save_rates(const CollectorRates& rates) const;
+
+  // `RuleSet` is the part of the configuration that `update` replaces.
+  // `rules` is kept only for `config_json`.  `compiled_rules[i]` is compiled
+  // from `rules[i]`.
+  struct RuleSet {
+    std::vector<FinalizedTraceSamplerConfig::Rule> rules;
+    std::vector<CompiledRule> compiled_rules;
+    RuleMatchCache match_cache;
+    Limiter limiter;
+    double limiter_max_per_second;
+
+    RuleSet(const FinalizedTraceSamplerConfig&, const Clock&);
+  };
+  // `rule_set_` is read and replaced using the atomic `shared_ptr` functions,
+  // as is `collector_rates_`.  A decision in progress keeps the rules that it
+  // started with.
+  std::shared_ptr<RuleSet> rule_set_;
+  Clock clock_;
+  // `adaptive_` is null unless adaptive sampling is configured.
+  std::unique_ptr<AdaptiveSampler> adaptive_;
 
  public:
   TraceSampler(const FinalizedTraceSamplerConfig& config, const Clock& clock);
@@ -117,10 +239,28 @@ class TraceSampler {
   // Return a sampling decision for the specified root span.
   SamplingDecision decide(const SpanData&);
 
+  // Replace this sampler's rules, global sample rate, and rate limit with
+  // those of the specified `config`.  The adaptive sampling configuration is
+  // not changed.
+  void update(const FinalizedTraceSamplerConfig& config);
+
   // Update this sampler's Agent-provided sample rates using the specified
-  // collector response.
+  // collector response.  Do nothing if the response has the same nonzero
+  // `version` as the response that provided the current rates.  Samplers
+  // that handle the same response having a nonzero `version`, e.g. those of
+  // tracers that share a `DatadogAgent`, share one copy of its rates.
   void handle_collector_response(const CollectorResponse&);
 
+  // Return whether adaptive sampling is configured.  If so, then `Tracer`
+  // calls `adapt` every second, and `TraceSegment` reports the spans of its
+  // chunks to `count_spans`.
+  bool adaptive() const;
+  // Count the specified number of finished spans for adaptive sampling.  Do
+  // nothing if adaptive sampling is not configured.
+  void count_spans(std::size_t count);
+  // Recompute the adaptive sample rates.  See `AdaptiveSampler::adapt`.
+  void adapt();
+
   nlohmann::json config_json() const;
 };
 
@@ -1,111 +1,144 @@
 #include "trace_sampler_config.h"
 
 #include <cmath>
+#include <string_view>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "environment.h"
 #include "json.hpp"
 #include "parse_util.h"
+#include "sampling_rule_parser.h"
 
 namespace datadog {
 namespace tracing {
+namespace {
 
-TraceSamplerConfig::Rule::Rule(const SpanMatcher &base) : SpanMatcher(base) {}
+// Return the trace sampling rules in the specified `rules_raw`, which is the
+// value of `DD_TRACE_SAMPLING_RULES`, or return an error.
+Expected<std::vector<TraceSamplerConfig::Rule>> parse_rules(
+    std::string_view rules_raw) {
+  std::vector<TraceSamplerConfig::Rule> rules;
+  if (auto parsed = parse_sampling_rules(rules_raw, false)) {
+    rules.reserve(parsed->size());
+    for (ParsedSamplingRule &parsed_rule : *parsed) {
+      TraceSamplerConfig::Rule &rule = rules.emplace_back();
+      static_cast<SpanMatcher &>(rule) = std::move(parsed_rule.matcher);
+      if (parsed_rule.sample_rate) {
+        rule.sample_rate = *parsed_rule.sample_rate;
+      }
+    }
+    return rules;
+  }
 
-Expected<FinalizedTraceSamplerConfig> finalize_config(
-    const TraceSamplerConfig &config) {
-  FinalizedTraceSamplerConfig result;
+  // The rules are invalid, or at least unusual.  Parse them as a JSON
+  // document, so that any error can be described.
+  nlohmann::json json_rules;
+  try {
+    json_rules = nlohmann::json::parse(rules_raw);
+  } catch (const nlohmann::json::parse_error &error) {
+    std::string message;
+    message += "Unable to parse JSON from ";
+    message += name(environment::DD_TRACE_SAMPLING_RULES);
+    message += " value ";
+    message += rules_raw;
+    message += ": ";
+    message += error.what();
+    return Error{Error::TRACE_SAMPLING_RULES_INVALID_JSON, std::move(message)};
+  }
 
-  std::vector<TraceSamplerConfig::Rule> rules = config.rules;
+  std::string type = json_rules.type_name();
+  if (type != "array") {
+    std::string message;
+    message += "Trace sampling rules must be an array, but ";
+    message += name(environment::DD_TRACE_SAMPLING_RULES);
+    message += " has JSON type \"";
+    message += type;
+    message += "\": ";
+    message += rules_raw;
+    return Error{Error::TRACE_SAMPLING_RULES_WRONG_TYPE, std::move(message)};
+  }
 
-  if (auto rules_env = lookup(environment::DD_TRACE_SAMPLING_RULES)) {
-    rules.clear();
-    nlohmann::json json_rules;
-    try {
-      json_rules = nlohmann::json::parse(*rules_env);
-    } catch (const nlohmann::json::parse_error &error) {
+  const std::unordered_set<std::string_view> allowed_properties{
+      "service", "name", "resource", "tags", "sample_rate"};
+
+  for (const auto &json_rule : json_rules) {
+    auto matcher = SpanMatcher::from_json(json_rule);
+    if (auto *error = matcher.if_error()) {
+      std::string prefix;
+      prefix += "Unable to create a rule from ";
+      prefix += name(environment::DD_TRACE_SAMPLING_RULES);
+      prefix += " value ";
+      prefix += rules_raw;
+      prefix += ": ";
+      return error->with_prefix(prefix);
+    }
+
+    TraceSamplerConfig::Rule rule{*matcher};
+
+    auto sample_rate = json_rule.find("sample_rate");
+    if (sample_rate != json_rule.end()) {
+      type = sample_rate->type_name();
+      if (type != "number") {
+        std::string message;
+        message += "Unable to parse a rule from ";
+        message += name(environment::DD_TRACE_SAMPLING_RULES);
+        message += " value ";
+        message += rules_raw;
+        message += ".  The \"sample_rate\" property of the rule ";
+        message += json_rule.dump();
+        message += " is not a number, but instead has type \"";
+        message += type;
+        message += "\".";
+        return Error{Error::TRACE_SAMPLING_RULES_SAMPLE_RATE_WRONG_TYPE,
+                     std::move(message)};
+      }
+      rule.sample_rate = *sample_rate;
+    }
+
+    // Look for unexpected properties.
+    for (const auto &[key, value] : json_rule.items()) {
+      if (allowed_properties.count(key)) {
+        continue;
+      }
       std::string message;
-      message += "Unable to parse JSON from ";
+      message += "Unexpected property \"";
+      message += key;
+      message += "\" having value ";
+      message += value.dump();
+      message += " in trace sampling rule ";
+      message += json_rule.dump();
+      message += ".  Error occurred while parsing ";
       message += name(environment::DD_TRACE_SAMPLING_RULES);
-      message += " value ";
-      message += *rules_env;
       message += ": ";
-      message += error.what();
-      return Error{Error::TRACE_SAMPLING_RULES_INVALID_JSON,
+      message += rules_raw;
+      return Error{Error::TRACE_SAMPLING_RULES_UNKNOWN_PROPERTY,
                    std::move(message)};
     }
 
-    std::string type = json_rules.type_name();
-    if (type != "array") {
-      std::string message;
-      message += "Trace sampling rules must be an array, but ";
-      message += name(environment::DD_TRACE_SAMPLING_RULES);
-      message += " has JSON type \"";
-      message += type;
-      message += "\": ";
-      message += *rules_env;
-      return Error{Error::TRACE_SAMPLING_RULES_WRONG_TYPE, std::move(message)};
-    }
+    rules.emplace_back(std::move(rule));
+  }
 
-    const std::unordered_set<std::string_view> allowed_properties{
-        "service", "name", "resource", "tags", "sample_rate"};
-
-    for (const auto &json_rule : json_rules) {
-      auto matcher = SpanMatcher::from_json(json_rule);
-      if (auto *error = matcher.if_error()) {
-        std::string prefix;
-        prefix += "Unable to create a rule from ";
-        prefix += name(environment::DD_TRACE_SAMPLING_RULES);
-        prefix += " value ";
-        prefix += *rules_env;
-        prefix += ": ";
-        return error->with_prefix(prefix);
-      }
+  return rules;
+}
 
-      TraceSamplerConfig::Rule rule{*matcher};
-
-      auto sample_rate = json_rule.find("sample_rate");
-      if (sample_rate != json_rule.end()) {
-        type = sample_rate->type_name();
-        if (type != "number") {
-          std::string message;
-          message += "Unable to parse a rule from ";
-          message += name(environment::DD_TRACE_SAMPLING_RULES);
-          message += " value ";
-          message += *rules_env;
-          message += ".  The \"sample_rate\" property of the rule ";
-          message += json_rule.dump();
-          message += " is not a number, but instead has type \"";
-          message += type;
-          message += "\".";
-          return Error{Error::TRACE_SAMPLING_RULES_SAMPLE_RATE_WRONG_TYPE,
-                       std::move(message)};
-        }
-        rule.sample_rate = *sample_rate;
-      }
+}  // namespace
 
-      // Look for unexpected properties.
-      for (const auto &[key, value] : json_rule.items()) {
-        if (allowed_properties.count(key)) {
-          continue;
-        }
-        std::string message;
-        message += "Unexpected property \"";
-        message += key;
-        message += "\" having value ";
-        message += value.dump();
-        message += " in trace sampling rule ";
-        message += json_rule.dump();
-        message += ".  Error occurred while parsing ";
-        message += name(environment::DD_TRACE_SAMPLING_RULES);
-        message += ": ";
-        message += *rules_env;
-        return Error{Error::TRACE_SAMPLING_RULES_UNKNOWN_PROPERTY,
-                     std::move(message)};
-      }
+TraceSamplerConfig::Rule::Rule(const SpanMatcher &base) : SpanMatcher(base) {}
 
-      rules.emplace_back(std::move(rule));
+Expected<FinalizedTraceSamplerConfig> finalize_config(
+    const TraceSamplerConfig &config) {
+  FinalizedTraceSamplerConfig result;
+
+  std::vector<TraceSamplerConfig::Rule> rules = config.rules;
+
+  if (auto rules_env = lookup(environment::DD_TRACE_SAMPLING_RULES)) {
+    auto maybe_rules = parse_rules(*rules_env);
+    if (auto *error = maybe_rules.if_error()) {
+      return std::move(*error);
     }
+    rules = std::move(*maybe_rules);
   }
 
   for (const auto &rule : rules) {
@@ -180,6 +213,52 @@ Expected<FinalizedTraceSamplerConfig> finalize_config(
   }
   result.max_per_second = max_per_second;
 
+  auto target = config.target_spans_per_second;
+  if (auto target_env =
+          lookup(environment::DD_TRACE_TARGET_SPANS_PER_SECOND)) {
+    auto maybe_target = parse_double(*target_env);
+    if (auto *error = maybe_target.if_error()) {
+      std::string prefix;
+      prefix += "While parsing ";
+      prefix += name(environment::DD_TRACE_TARGET_SPANS_PER_SECOND);
+      prefix += ": ";
+      return error->with_prefix(prefix);
+    }
+    target = *maybe_target;
+  }
+  if (target) {
+    if (!(*target > 0) ||
+        std::find(std::begin(allowed_types), std::end(allowed_types),
+                  std::fpclassify(*target)) == std::end(allowed_types)) {
+      std::string message;
+      message +=
+          "Trace sampling target_spans_per_second must be greater than zero, "
+          "but the following value was given: ";
+      message += std::to_string(*target);
+      return Error{Error::TARGET_SPANS_PER_SECOND_OUT_OF_RANGE,
+                   std::move(message)};
+    }
+  }
+  result.target_spans_per_second = target;
+
+  result.rates_file = config.rates_file;
+  if (auto rates_file_env = lookup(environment::DD_TRACE_SAMPLER_RATES_FILE)) {
+    result.rates_file = std::string(*rates_file_env);
+  }
+  if (result.rates_file && result.rates_file->empty()) {
+    result.rates_file = std::nullopt;
+  }
+  if (config.rates_file_max_age_seconds <= 0) {
+    std::string message;
+    message +=
+        "Trace sampling rates_file_max_age_seconds must be positive, but the "
+        "following value was given: ";
+    message += std::to_string(config.rates_file_max_age_seconds);
+    return Error{Error::INVALID_SAMPLER_RATES_FILE_MAX_AGE, std::move(message)};
+  }
+  result.rates_file_max_age =
+      std::chrono::seconds(config.rates_file_max_age_seconds);
+
   return result;
 }
 
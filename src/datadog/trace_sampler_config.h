@@ -7,7 +7,9 @@
 // `TraceSamplerConfig` is specified as the `trace_sampler` property of
 // `TracerConfig`.
 
+#include <chrono>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include "expected.h"
@@ -29,6 +31,17 @@ struct TraceSamplerConfig {
   std::optional<double> sample_rate;
   std::vector<Rule> rules;
   double max_per_second = 200;
+  // If `target_spans_per_second` has a value, then traces that match no rule
+  // are sampled adaptively, so that the kept traces add up to about that many
+  // spans per second.  See `trace_sampler.h`.
+  std::optional<double> target_spans_per_second;
+  // If `rates_file` has a value, then the sampler keeps the sample rates most
+  // recently received from the Datadog Agent in the file that it names, and
+  // a sampler created within `rates_file_max_age_seconds` of the file's last
+  // update starts with those rates.  See `trace_sampler.h`.  `rates_file` is
+  // overridden by the `DD_TRACE_SAMPLER_RATES_FILE` environment variable.
+  std::optional<std::string> rates_file;
+  int rates_file_max_age_seconds = 600;
 };
 
 class FinalizedTraceSamplerConfig {
@@ -45,6 +58,9 @@ class FinalizedTraceSamplerConfig {
 
   std::vector<Rule> rules;
   double max_per_second;
+  std::optional<double> target_spans_per_second;
+  std::optional<std::string> rates_file;
+  std::chrono::seconds rates_file_max_age;
 };
 
 Expected<FinalizedTraceSamplerConfig> finalize_config(
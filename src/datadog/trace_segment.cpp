@@ -1,78 +1,117 @@
 #include "trace_segment.h"
 
+#include <algorithm>
 #include <cassert>
-#include <charconv>
-#include <limits>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
 #include <optional>
 #include <string>
-#include <system_error>
-#include <unordered_map>
+#include <string_view>
+#include <tuple>
+#include <unordered_set>
 #include <utility>
 
 #include "collector.h"
 #include "collector_response.h"
+#include "dict_reader.h"
 #include "dict_writer.h"
 #include "error.h"
+#include "json.hpp"
 #include "logger.h"
+#include "metrics.h"
 #include "span_data.h"
+#include "span_prototype.h"
+#include "span_quota.h"
 #include "span_sampler.h"
 #include "tag_propagation.h"
 #include "tags.h"
+#include "trace_context_injection.h"
+#include "trace_id.h"
 #include "trace_sampler.h"
 
 namespace datadog {
 namespace tracing {
-namespace {
-
-template <typename Integer>
-std::string hex(Integer value) {
-  // 4 bits per hex digit char, and then +1 char for possible minus sign
-  char buffer[std::numeric_limits<Integer>::digits / 4 + 1];
-
-  const int base = 16;
-  auto result =
-      std::to_chars(std::begin(buffer), std::end(buffer), value, base);
-  assert(result.ec == std::errc());
-
-  return std::string{std::begin(buffer), result.ptr};
-}
-
-}  // namespace
 
 TraceSegment::TraceSegment(
     const std::shared_ptr<Logger>& logger,
     const std::shared_ptr<Collector>& collector,
+    const std::shared_ptr<Metrics>& metrics, bool overhead_profiling,
     const std::shared_ptr<TraceSampler>& trace_sampler,
     const std::shared_ptr<SpanSampler>& span_sampler,
-    const std::shared_ptr<const SpanDefaults>& defaults,
+    const std::shared_ptr<const SpanPrototype>& prototype,
+    const std::shared_ptr<const IDGenerator>& generator,
+    const std::shared_ptr<const Clock>& clock,
     const PropagationStyles& injection_styles,
     const std::optional<std::string>& hostname,
     std::optional<std::string> origin, std::size_t tags_header_max_size,
-    std::unordered_map<std::string, std::string> trace_tags,
-    std::optional<SamplingDecision> sampling_decision,
+    std::optional<std::size_t> partial_flush_min_spans,
+    std::optional<std::size_t> max_memory_bytes,
+    FlatMap<std::string> trace_tags,
+    std::optional<SamplingDecision> sampling_decision, SpanArena arena,
     std::unique_ptr<SpanData> local_root)
     : logger_(logger),
       collector_(collector),
+      metrics_(metrics),
+      overhead_metrics_(overhead_profiling ? metrics.get() : nullptr),
       trace_sampler_(trace_sampler),
       span_sampler_(span_sampler),
-      defaults_(defaults),
+      prototype_(prototype),
+      generator_(generator),
+      clock_(clock),
       injection_styles_(injection_styles),
       hostname_(hostname),
       origin_(std::move(origin)),
       tags_header_max_size_(tags_header_max_size),
+      local_root_id_(local_root->span_id),
+      partial_flush_min_spans_(partial_flush_min_spans),
+      max_memory_bytes_(max_memory_bytes),
       trace_tags_(std::move(trace_tags)),
+      trace_tags_size_(encoded_tags_size(trace_tags_)),
+      arena_(std::move(arena)),
+      registrations_(nullptr),
+      num_registered_spans_(0),
       num_finished_spans_(0),
+      num_taken_spans_(0),
+      local_root_(local_root.get()),
+      chunks_sent_(false),
       sampling_decision_(std::move(sampling_decision)) {
   assert(logger_);
   assert(collector_);
+  assert(metrics_);
   assert(trace_sampler_);
   assert(span_sampler_);
-  assert(defaults_);
+  assert(prototype_);
+  assert(generator_ && *generator_);
+  assert(clock_ && *clock_);
 
   register_span(std::move(local_root));
 }
 
-const SpanDefaults& TraceSegment::defaults() const { return *defaults_; }
+TraceSegment::~TraceSegment() {
+  // The last span to finish takes all of `registrations_`, so this is only in
+  // case the segment is destroyed otherwise.
+  SpanData* node = registrations_.load(std::memory_order_acquire);
+  while (node) {
+    SpanData* const next = node->next_registration;
+    delete node;
+    node = next;
+  }
+  delete overflow_span_.load(std::memory_order_relaxed);
+}
+
+const SpanDefaults& TraceSegment::defaults() const {
+  return prototype_->defaults;
+}
+
+const SpanPrototype& TraceSegment::prototype() const {
+  return *prototype_;
+}
+
+const IDGenerator& TraceSegment::generator() const { return *generator_; }
+
+const Clock& TraceSegment::clock() const { return *clock_; }
 
 const std::optional<std::string>& TraceSegment::hostname() const {
   return hostname_;
@@ -82,97 +121,581 @@ const std::optional<std::string>& TraceSegment::origin() const {
   return origin_;
 }
 
+std::uint64_t TraceSegment::local_root_id() const { return local_root_id_; }
+
 std::optional<SamplingDecision> TraceSegment::sampling_decision() const {
   // `sampling_decision_` can change, so we need a lock.
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
   return sampling_decision_;
 }
 
 Logger& TraceSegment::logger() const { return *logger_; }
 
+std::unique_ptr<SpanData> TraceSegment::allocate_span_data() {
+  std::lock_guard<Mutex> lock(arena_mutex_);
+  return std::unique_ptr<SpanData>(new (arena_) SpanData);
+}
+
+void TraceSegment::allocate_span_data(
+    std::size_t count, std::vector<std::unique_ptr<SpanData>>& spans) {
+  spans.reserve(spans.size() + count);
+  std::lock_guard<Mutex> lock(arena_mutex_);
+  for (std::size_t i = 0; i < count; ++i) {
+    spans.emplace_back(new (arena_) SpanData);
+  }
+}
+
 void TraceSegment::register_span(std::unique_ptr<SpanData> span) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  assert(spans_.empty() || num_finished_spans_ < spans_.size());
-  spans_.emplace_back(std::move(span));
+  // A span is registered only while another span of this segment is still
+  // open (its parent), or during construction.
+  assert(num_finished_spans_.load(std::memory_order_relaxed) <
+             num_registered_spans_.load(std::memory_order_relaxed) ||
+         num_registered_spans_.load(std::memory_order_relaxed) == 0);
+  num_registered_spans_.fetch_add(1, std::memory_order_relaxed);
+  metrics_->add(Metrics::SPANS_CREATED);
+  SpanData* const node = span.release();
+  node->next_registration = registrations_.load(std::memory_order_relaxed);
+  while (!registrations_.compare_exchange_weak(node->next_registration, node,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+  }
 }
 
-void TraceSegment::span_finished() {
+void TraceSegment::register_spans(
+    std::vector<std::unique_ptr<SpanData>>& spans) {
+  // As in `register_span`, the parent of the spans is still open.
+  assert(num_finished_spans_.load(std::memory_order_relaxed) <
+         num_registered_spans_.load(std::memory_order_relaxed));
+  num_registered_spans_.fetch_add(spans.size(), std::memory_order_relaxed);
+  metrics_->add(Metrics::SPANS_CREATED, spans.size());
+  std::lock_guard<Mutex> lock(mutex_);
+  // Spans registered earlier come first.
+  take_registrations();
+  spans_.reserve(spans_.size() + spans.size());
+  for (auto& span : spans) {
+    spans_.push_back(std::move(span));
+  }
+  num_taken_spans_ += spans.size();
+  spans.clear();
+}
+
+void TraceSegment::span_finished(const SpanData& span) {
+  const OverheadTimer timer{overhead_metrics_, Metrics::FINISH_SPAN_DURATION};
+  metrics_->add(Metrics::SPANS_FINISHED);
+  if (max_memory_bytes_) {
+    metrics_->increase(Metrics::TRACE_SEGMENT_BYTES, approximate_size(span));
+  }
+  std::vector<std::unique_ptr<SpanData>> chunk;
+  std::size_t chunk_bytes = 0;
+  int priority;
+  std::optional<int> mechanism;
+  bool span_sampling_deferred;
   {
-    std::lock_guard<std::mutex> lock(mutex_);
-    ++num_finished_spans_;
-    assert(num_finished_spans_ <= spans_.size());
-    if (num_finished_spans_ < spans_.size()) {
+    // Partial flushing, the memory budget, and compaction keep track of which
+    // spans are finished, which requires the lock.  Otherwise, the lock is
+    // needed only once all spans are finished.
+    const bool track_finished = partial_flush_min_spans_ ||
+                                max_memory_bytes_ || compact_finished_spans_;
+    std::unique_lock<Mutex> lock(mutex_, std::defer_lock);
+    if (track_finished) {
+      lock.lock();
+    }
+    // A span's registration happens before it finishes, and so the last span
+    // to finish sees all of the registrations.
+    const std::size_t num_finished =
+        num_finished_spans_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    const bool all_finished =
+        num_finished == num_registered_spans_.load(std::memory_order_acquire);
+    assert(num_finished <= num_registered_spans_.load());
+    if (!all_finished && !track_finished) {
       return;
     }
+    if (!lock.owns_lock()) {
+      lock.lock();
+    }
+
+    take_registrations();
+    const SpanData* const first = spans_.front().get();
+    if (all_finished) {
+      chunk = std::move(spans_);
+      spans_.clear();
+      finished_spans_.clear();
+    } else {
+      finished_spans_.push_back(&span);
+      if (!partial_flush_min_spans_ ||
+          finished_spans_.size() < *partial_flush_min_spans_) {
+        if (!over_memory_budget()) {
+          if (compact_finished_spans_ &&
+              finished_spans_.size() >= *compact_finished_spans_) {
+            compact_spans();
+          }
+          return;
+        }
+        metrics_->add(Metrics::MEMORY_BUDGET_PARTIAL_FLUSHES);
+      }
+      take_finished_spans(chunk);
+    }
+    if (!compact_spans_.empty()) {
+      restore_compacted_spans(chunk, chunk.front().get() == first);
+    }
+    // Measure the chunk before finalizing it changes its spans, so that it
+    // matches what its spans added as they finished.
+    if (max_memory_bytes_) {
+      for (const auto& span_ptr : chunk) {
+        chunk_bytes += approximate_size(*span_ptr);
+      }
+    }
+
+    filter_short_spans(chunk);
+    collapse_repeated_spans(chunk);
+
+    // The chunk's spans are finished, but `trace_tags_` and the sampling
+    // decision are shared with spans that might still be open, so finalize
+    // while holding the lock.
+    make_sampling_decision_if_null();
+    assert(sampling_decision_);
+    priority = sampling_decision_->priority;
+    mechanism = sampling_decision_->mechanism;
+    span_sampling_deferred =
+        defer_span_sampling_ && priority <= 0 && span_sampler_->has_rules();
+    finalize_chunk(chunk, !span_sampling_deferred);
+    chunks_sent_ = true;
   }
-  // We don't need the lock anymore.  There's nobody left to call our methods.
-  // On the other hand, there's nobody left to contend for the mutex, so it
-  // doesn't make any difference.
-  make_sampling_decision_if_null();
-  assert(sampling_decision_);
 
-  // All of our spans are finished.  Run the span sampler, finalize the spans,
-  // and then send the spans to the collector.
-  if (sampling_decision_->priority <= 0) {
-    // Span sampling happens when the trace is dropped.
-    for (const auto& span_ptr : spans_) {
-      SpanData& span = *span_ptr;
-      auto* rule = span_sampler_->match(span);
-      if (!rule) {
-        continue;
+  metrics_->add(Metrics::TRACE_CHUNKS_FINISHED);
+  trace_sampler_->count_spans(chunk.size());
+  if (max_memory_bytes_) {
+    const bool discard = shed_memory(chunk, priority, span_sampling_deferred);
+    metrics_->decrease(Metrics::TRACE_SEGMENT_BYTES, chunk_bytes);
+    if (discard) {
+      return;
+    }
+  }
+  if (span_quotas_ && !chunk.empty() &&
+      !span_quotas_->allow(*chunk.front(), chunk.size())) {
+    metrics_->add(Metrics::QUOTA_TRACE_CHUNKS_DROPPED);
+    metrics_->add(Metrics::QUOTA_SPANS_DROPPED, chunk.size());
+    return;
+  }
+  // The origin is repeated on all spans, but it's left to the collector to
+  // add it.
+  Expected<void> result;
+  if (priority <= 0) {
+    result = collector_->send_unsampled(
+        std::move(chunk), trace_sampler_, origin_,
+        span_sampling_deferred ? span_sampler_ : nullptr, mechanism);
+  } else if (origin_) {
+    result = collector_->send_with_origin(std::move(chunk), trace_sampler_,
+                                          *origin_);
+  } else {
+    result = collector_->send(std::move(chunk), trace_sampler_);
+  }
+  if (auto* error = result.if_error()) {
+    logger_->log_error(
+        error->with_prefix("Error sending spans to collector: "));
+  }
+}
+
+void TraceSegment::take_registrations() {
+  // `mutex_` must already be locked.
+  // Every registered span not yet taken is in `registrations_`, or is about to
+  // be, and so `spans_` grows at most once.
+  const std::size_t num_registered =
+      num_registered_spans_.load(std::memory_order_acquire);
+  spans_.reserve(spans_.size() + (num_registered - num_taken_spans_));
+  // The stack is newest-first.  Reverse it.
+  SpanData* node = registrations_.exchange(nullptr, std::memory_order_acquire);
+  SpanData* reversed = nullptr;
+  while (node) {
+    SpanData* const next = node->next_registration;
+    node->next_registration = reversed;
+    reversed = node;
+    node = next;
+  }
+  while (reversed) {
+    SpanData* const next = reversed->next_registration;
+    reversed->next_registration = nullptr;
+    spans_.emplace_back(reversed);
+    ++num_taken_spans_;
+    reversed = next;
+  }
+}
+
+void TraceSegment::take_finished_spans(
+    std::vector<std::unique_ptr<SpanData>>& chunk) {
+  // `mutex_` must already be locked.
+  std::sort(finished_spans_.begin(), finished_spans_.end());
+  const auto is_finished = [&](const std::unique_ptr<SpanData>& span_ptr) {
+    return std::binary_search(finished_spans_.begin(), finished_spans_.end(),
+                              span_ptr.get());
+  };
+
+  // Keep the relative order of both the finished and the open spans.
+  std::vector<std::unique_ptr<SpanData>> open;
+  open.reserve(spans_.size() - finished_spans_.size());
+  chunk.reserve(finished_spans_.size());
+  for (auto& span_ptr : spans_) {
+    if (is_finished(span_ptr)) {
+      chunk.push_back(std::move(span_ptr));
+    } else {
+      open.push_back(std::move(span_ptr));
+    }
+  }
+  spans_ = std::move(open);
+  finished_spans_.clear();
+}
+
+void TraceSegment::compact_spans() {
+  // `mutex_` must already be locked.
+  SpanData* const first = spans_.front().get();
+  std::vector<std::unique_ptr<SpanData>> compacted;
+  take_finished_spans(compacted);
+  // The first span stays, so that it's still first when the spans are sent.
+  if (!compacted.empty() && compacted.front().get() == first) {
+    spans_.insert(spans_.begin(), std::move(compacted.front()));
+    compacted.erase(compacted.begin());
+    finished_spans_.push_back(first);
+  }
+  if (compacted.empty()) {
+    return;
+  }
+
+  const std::size_t bytes_before = compact_spans_.bytes();
+  compact_spans_.add(compacted, compress_compacted_spans_);
+  if (max_memory_bytes_) {
+    std::size_t compacted_bytes = 0;
+    for (const auto& span_ptr : compacted) {
+      compacted_bytes += approximate_size(*span_ptr);
+    }
+    metrics_->decrease(Metrics::TRACE_SEGMENT_BYTES, compacted_bytes);
+    metrics_->increase(Metrics::TRACE_SEGMENT_BYTES,
+                       compact_spans_.bytes() - bytes_before);
+  }
+  metrics_->add(Metrics::SPANS_COMPACTED, compacted.size());
+}
+
+void TraceSegment::restore_compacted_spans(
+    std::vector<std::unique_ptr<SpanData>>& chunk, bool after_first) {
+  // `mutex_` must already be locked.
+  std::vector<std::unique_ptr<SpanData>> restored;
+  const std::size_t compacted_bytes = compact_spans_.bytes();
+  const auto result = compact_spans_.take(restored);
+  if (auto* error = result.if_error()) {
+    logger_->log_error(
+        error->with_prefix("Unable to restore compacted spans: "));
+  }
+  if (max_memory_bytes_) {
+    std::size_t restored_bytes = 0;
+    for (const auto& span_ptr : restored) {
+      restored_bytes += approximate_size(*span_ptr);
+    }
+    metrics_->decrease(Metrics::TRACE_SEGMENT_BYTES, compacted_bytes);
+    metrics_->increase(Metrics::TRACE_SEGMENT_BYTES, restored_bytes);
+  }
+  chunk.insert(chunk.begin() + (after_first ? 1 : 0),
+               std::make_move_iterator(restored.begin()),
+               std::make_move_iterator(restored.end()));
+}
+
+void TraceSegment::filter_short_spans(
+    std::vector<std::unique_ptr<SpanData>>& chunk) {
+  // `mutex_` must already be locked.
+  if (!min_span_duration_ || chunks_sent_) {
+    return;
+  }
+  // The first span of the chunk carries the trace-level tags, and so is never
+  // filtered.  Most chunks have no short spans, so check before indexing.
+  const auto is_short = [&](const std::unique_ptr<SpanData>& span_ptr) {
+    return span_ptr->duration < *min_span_duration_ && !span_ptr->error;
+  };
+  if (chunk.size() < 2 ||
+      std::none_of(chunk.begin() + 1, chunk.end(), is_short)) {
+    return;
+  }
+
+  std::unordered_map<std::uint64_t, SpanData*> spans_by_id;
+  std::unordered_set<std::uint64_t> parent_ids;
+  spans_by_id.reserve(chunk.size());
+  for (const auto& span_ptr : chunk) {
+    spans_by_id.emplace(span_ptr->span_id, span_ptr.get());
+    parent_ids.insert(span_ptr->parent_id);
+  }
+  for (const auto& span_ptr : spans_) {
+    parent_ids.insert(span_ptr->parent_id);
+  }
+
+  std::uint64_t filtered = 0;
+  auto kept = chunk.begin() + 1;
+  for (auto iter = chunk.begin() + 1; iter != chunk.end(); ++iter) {
+    const SpanData& span = **iter;
+    const auto parent = spans_by_id.find(span.parent_id);
+    if (is_short(*iter) && !parent_ids.count(span.span_id) &&
+        parent != spans_by_id.end() &&
+        parent->second->service == span.service &&
+        !span.numeric_tags.contains(tags::internal::measured)) {
+      SpanData& parent_span = *parent->second;
+      parent_span.numeric_tags[tags::filtered_span_count] += 1;
+      parent_span.numeric_tags[tags::filtered_span_duration] += double(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(span.duration)
+              .count());
+      ++filtered;
+      continue;
+    }
+    if (kept != iter) {
+      *kept = std::move(*iter);
+    }
+    ++kept;
+  }
+  chunk.erase(kept, chunk.end());
+  metrics_->add(Metrics::SPANS_FILTERED, filtered);
+}
+
+void TraceSegment::collapse_repeated_spans(
+    std::vector<std::unique_ptr<SpanData>>& chunk) {
+  // `mutex_` must already be locked.
+  if (!collapse_repeated_spans_threshold_ || chunks_sent_ ||
+      chunk.size() <= *collapse_repeated_spans_threshold_) {
+    return;
+  }
+
+  std::unordered_set<std::uint64_t> parent_ids;
+  for (const auto& span_ptr : chunk) {
+    parent_ids.insert(span_ptr->parent_id);
+  }
+  for (const auto& span_ptr : spans_) {
+    parent_ids.insert(span_ptr->parent_id);
+  }
+
+  // Group the childless spans other than the first, which carries the
+  // trace-level tags, by parent, service, name, and resource.  A group's
+  // elements are indices into `chunk`, in order.
+  using Key = std::tuple<std::uint64_t, std::string_view, std::string_view,
+                         std::string_view>;
+  std::map<Key, std::vector<std::size_t>> groups;
+  for (std::size_t i = 1; i < chunk.size(); ++i) {
+    const SpanData& span = *chunk[i];
+    if (parent_ids.count(span.span_id)) {
+      continue;
+    }
+    groups[Key{span.parent_id, span.service, span.name, span.resource}]
+        .push_back(i);
+  }
+
+  const auto nanoseconds = [](Duration duration) {
+    return double(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  };
+  std::vector<bool> collapsed(chunk.size(), false);
+  std::uint64_t collapsed_count = 0;
+  for (const auto& entry : groups) {
+    const std::vector<std::size_t>& indices = entry.second;
+    if (indices.size() < *collapse_repeated_spans_threshold_) {
+      continue;
+    }
+    SpanData& aggregate = *chunk[indices.front()];
+    TimePoint start = aggregate.start;
+    auto end = aggregate.start.tick + aggregate.duration;
+    Duration min_duration = aggregate.duration;
+    Duration max_duration = aggregate.duration;
+    Duration total_duration = Duration::zero();
+    std::size_t error_count = 0;
+    const SpanData* first_error = nullptr;
+    for (const std::size_t i : indices) {
+      const SpanData& span = *chunk[i];
+      if (span.start.tick < start.tick) {
+        start = span.start;
       }
-      const SamplingDecision decision = rule->decide(span);
-      if (decision.priority <= 0) {
-        continue;
+      end = std::max(end, span.start.tick + span.duration);
+      min_duration = std::min(min_duration, span.duration);
+      max_duration = std::max(max_duration, span.duration);
+      total_duration += span.duration;
+      if (span.error) {
+        ++error_count;
+        if (!first_error) {
+          first_error = &span;
+        }
       }
-      span.numeric_tags[tags::internal::span_sampling_mechanism] =
-          *decision.mechanism;
-      span.numeric_tags[tags::internal::span_sampling_rule_rate] =
-          *decision.configured_rate;
-      if (decision.limiter_max_per_second) {
-        span.numeric_tags[tags::internal::span_sampling_limit] =
-            *decision.limiter_max_per_second;
+    }
+
+    if (first_error && first_error != &aggregate) {
+      aggregate.error = true;
+      for (const auto* tag :
+           {&tags::error_message, &tags::error_type, &tags::error_stack}) {
+        const auto found = first_error->tags.find(*tag);
+        if (found != first_error->tags.end()) {
+          aggregate.tags.insert_or_assign(*tag, found->second);
+        }
       }
+      aggregate.error_stack_addresses = first_error->error_stack_addresses;
+    }
+    aggregate.start = start;
+    aggregate.duration = end - start.tick;
+    aggregate.numeric_tags[tags::collapsed_span_count] = double(indices.size());
+    aggregate.numeric_tags[tags::collapsed_span_error_count] =
+        double(error_count);
+    aggregate.numeric_tags[tags::collapsed_span_min_duration] =
+        nanoseconds(min_duration);
+    aggregate.numeric_tags[tags::collapsed_span_max_duration] =
+        nanoseconds(max_duration);
+    aggregate.numeric_tags[tags::collapsed_span_total_duration] =
+        nanoseconds(total_duration);
+    for (auto iter = indices.begin() + 1; iter != indices.end(); ++iter) {
+      collapsed[*iter] = true;
+    }
+    collapsed_count += indices.size() - 1;
+  }
+  if (collapsed_count == 0) {
+    return;
+  }
+
+  auto kept = chunk.begin();
+  for (std::size_t i = 0; i < chunk.size(); ++i) {
+    if (collapsed[i]) {
+      continue;
+    }
+    if (kept != chunk.begin() + i) {
+      *kept = std::move(chunk[i]);
+    }
+    ++kept;
+  }
+  chunk.erase(kept, chunk.end());
+  metrics_->add(Metrics::SPANS_COLLAPSED, collapsed_count);
+}
+
+void TraceSegment::mark_top_level(
+    std::vector<std::unique_ptr<SpanData>>& chunk) {
+  // `mutex_` must already be locked.
+  std::unordered_map<std::uint64_t, const std::string*> chunk_services;
+  for (const auto& span_ptr : chunk) {
+    chunk_services.emplace(span_ptr->span_id, &span_ptr->service);
+  }
+  std::unordered_map<std::uint64_t, const std::string*> open_services;
+  for (const auto& span_ptr : spans_) {
+    open_services.emplace(span_ptr->span_id, &span_ptr->service);
+  }
+
+  // A span whose parent is in neither the chunk, the open spans, nor the
+  // previously sent spans has a parent outside of this segment, and so is top
+  // level.
+  for (const auto& span_ptr : chunk) {
+    SpanData& span = *span_ptr;
+    if (span.parent_id == 0 || chunk_services.count(span.parent_id)) {
+      continue;
+    }
+    bool top_level = true;
+    if (const auto found = open_services.find(span.parent_id);
+        found != open_services.end()) {
+      top_level = *found->second != span.service;
+    } else if (const auto found = sent_parent_services_.find(span.parent_id);
+               found != sent_parent_services_.end()) {
+      top_level = found->second != span.service;
     }
+    span.numeric_tags[tags::internal::top_level] = top_level;
   }
 
+  // Remember the services of sent spans whose children are still open.
+  std::unordered_map<std::uint64_t, std::string> parent_services;
+  for (const auto& span_ptr : spans_) {
+    const auto parent_id = span_ptr->parent_id;
+    if (const auto found = chunk_services.find(parent_id);
+        found != chunk_services.end()) {
+      parent_services.emplace(parent_id, *found->second);
+    } else if (const auto found = sent_parent_services_.find(parent_id);
+               found != sent_parent_services_.end()) {
+      parent_services.emplace(parent_id, found->second);
+    }
+  }
+  sent_parent_services_ = std::move(parent_services);
+}
+
+void TraceSegment::finalize_chunk(
+    std::vector<std::unique_ptr<SpanData>>& chunk, bool sample_spans) {
+  // `mutex_` must already be locked.
+  assert(!chunk.empty());
   const SamplingDecision& decision = *sampling_decision_;
 
-  auto& local_root = *spans_.front();
-  local_root.tags.insert(trace_tags_.begin(), trace_tags_.end());
-  local_root.numeric_tags[tags::internal::sampling_priority] =
+  // Span sampling happens when the trace is dropped.
+  if (sample_spans && decision.priority <= 0) {
+    span_sampler_->sample(chunk);
+  }
+
+  if (chunks_sent_ || !spans_.empty()) {
+    mark_top_level(chunk);
+  }
+
+  // The trace-level tags go on the first span of each chunk.  That's the
+  // local root, if it's in the chunk, since the local root is first among the
+  // segment's spans.
+  SpanData& chunk_root = *chunk.front();
+  chunk_root.tags.insert(trace_tags_.begin(), trace_tags_.end());
+  chunk_root.numeric_tags[tags::internal::sampling_priority] =
       decision.priority;
   if (hostname_) {
-    local_root.tags[tags::internal::hostname] = *hostname_;
-  }
-  if (decision.origin == SamplingDecision::Origin::LOCAL) {
-    if (decision.mechanism == int(SamplingMechanism::AGENT_RATE) ||
-        decision.mechanism == int(SamplingMechanism::DEFAULT)) {
-      local_root.numeric_tags[tags::internal::agent_sample_rate] =
-          *decision.configured_rate;
-    } else if (decision.mechanism == int(SamplingMechanism::RULE)) {
-      local_root.numeric_tags[tags::internal::rule_sample_rate] =
-          *decision.configured_rate;
-      if (decision.limiter_effective_rate) {
-        local_root.numeric_tags[tags::internal::rule_limiter_sample_rate] =
-            *decision.limiter_effective_rate;
+    chunk_root.tags[tags::internal::hostname] = *hostname_;
+  }
+  if (&chunk_root == local_root_) {
+    local_root_ = nullptr;
+    SpanData& local_root = chunk_root;
+    if (const std::size_t overflow =
+            num_overflow_spans_.load(std::memory_order_relaxed)) {
+      local_root.numeric_tags[tags::overflow_span_count] = double(overflow);
+    }
+    if (decision.origin == SamplingDecision::Origin::LOCAL) {
+      if (decision.mechanism == int(SamplingMechanism::AGENT_RATE) ||
+          decision.mechanism == int(SamplingMechanism::DEFAULT)) {
+        local_root.numeric_tags[tags::internal::agent_sample_rate] =
+            *decision.configured_rate;
+      } else if (decision.mechanism == int(SamplingMechanism::RULE)) {
+        local_root.numeric_tags[tags::internal::rule_sample_rate] =
+            *decision.configured_rate;
+        if (decision.limiter_effective_rate) {
+          local_root.numeric_tags[tags::internal::rule_limiter_sample_rate] =
+              *decision.limiter_effective_rate;
+        }
       }
     }
   }
+}
 
-  // Origin is repeated on all spans.
-  if (origin_) {
-    for (const auto& span_ptr : spans_) {
-      SpanData& span = *span_ptr;
-      span.tags[tags::internal::origin] = *origin_;
-    }
+bool TraceSegment::over_memory_budget() const {
+  return max_memory_bytes_ && metrics_->memory_bytes() > *max_memory_bytes_;
+}
+
+bool TraceSegment::shed_memory(std::vector<std::unique_ptr<SpanData>>& chunk,
+                               int priority, bool span_sampling_deferred) {
+  if (!over_memory_budget()) {
+    return false;
   }
 
-  const auto result = collector_->send(std::move(spans_), trace_sampler_);
-  if (auto* error = result.if_error()) {
-    logger_->log_error(
-        error->with_prefix("Error sending spans to collector: "));
+  const auto kept_by_span_sampling = [](const auto& span_ptr) {
+    return span_ptr->numeric_tags.contains(
+        tags::internal::span_sampling_mechanism);
+  };
+  // If span sampling is deferred, then it's not yet known whether any span is
+  // kept, and so the chunk is only stripped.
+  if (priority <= 0 && !span_sampling_deferred &&
+      std::none_of(chunk.begin(), chunk.end(), kept_by_span_sampling)) {
+    metrics_->add(Metrics::MEMORY_BUDGET_TRACE_CHUNKS_DROPPED);
+    return true;
   }
+
+  std::uint64_t stripped = 0;
+  for (const auto& span_ptr : chunk) {
+    auto& span_tags = span_ptr->tags;
+    for (auto iter = span_tags.begin(); iter != span_tags.end();) {
+      if (iter->second.size() > large_tag_size &&
+          !tags::is_internal(iter->first)) {
+        iter = span_tags.erase(iter);
+        ++stripped;
+      } else {
+        ++iter;
+      }
+    }
+  }
+  if (stripped != 0) {
+    metrics_->add(Metrics::MEMORY_BUDGET_TAGS_STRIPPED, stripped);
+  }
+  return false;
 }
 
 void TraceSegment::override_sampling_priority(int priority) {
@@ -181,9 +704,173 @@ void TraceSegment::override_sampling_priority(int priority) {
   decision.mechanism = int(SamplingMechanism::MANUAL);
   decision.origin = SamplingDecision::Origin::LOCAL;
 
-  std::lock_guard<std::mutex> lock(mutex_);
+  std::lock_guard<Mutex> lock(mutex_);
+  if (chunks_sent_) {
+    return;
+  }
+  sampling_decision_ = decision;
+  update_decision_maker_trace_tag();
+  if (priority > 0) {
+    lightweight_.store(false, std::memory_order_relaxed);
+  }
+}
+
+void TraceSegment::defer_span_sampling() { defer_span_sampling_ = true; }
+
+void TraceSegment::filter_spans_shorter_than(Duration min_duration) {
+  min_span_duration_ = min_duration;
+}
+
+void TraceSegment::collapse_repeated_spans(std::size_t threshold) {
+  collapse_repeated_spans_threshold_ = threshold;
+}
+
+void TraceSegment::compact_finished_spans(std::size_t min_spans,
+                                          bool compress) {
+  compact_finished_spans_ = min_spans;
+  compress_compacted_spans_ = compress;
+}
+
+void TraceSegment::limit_spans(std::size_t max_spans) {
+  max_spans_ = max_spans;
+}
+
+void TraceSegment::enforce_span_quotas(std::shared_ptr<SpanQuotas> quotas) {
+  span_quotas_ = std::move(quotas);
+}
+
+void TraceSegment::delegate_sampling() { delegate_sampling_ = true; }
+
+void TraceSegment::sampling_delegation_requested() {
+  sampling_delegation_requested_ = true;
+}
+
+void TraceSegment::pass_on_tracestate(std::string tracestate) {
+  w3c_tracestate_ = std::move(tracestate);
+}
+
+Expected<void> TraceSegment::read_sampling_delegation_response(
+    const DictReader& reader) {
+  const auto header = reader.lookup("x-datadog-trace-sampling-decision");
+  if (!header) {
+    return std::nullopt;
+  }
+
+  const auto invalid = [&](std::string_view reason) {
+    std::string message;
+    message += "Invalid sampling delegation response header ";
+    message += "\"x-datadog-trace-sampling-decision: ";
+    message += *header;
+    message += "\": ";
+    message += reason;
+    return Error{Error::INVALID_SAMPLING_DELEGATION_RESPONSE,
+                 std::move(message)};
+  };
+
+  nlohmann::json json;
+  try {
+    json = nlohmann::json::parse(*header);
+  } catch (const nlohmann::json::parse_error& error) {
+    return invalid(error.what());
+  }
+  if (!json.is_object()) {
+    return invalid("expected an object.");
+  }
+  const auto priority = json.find("priority");
+  if (priority == json.end() || !priority->is_number_integer()) {
+    return invalid("expected an integer \"priority\".");
+  }
+  SamplingDecision decision;
+  decision.priority = priority->get<int>();
+  decision.origin = SamplingDecision::Origin::DELEGATED;
+  const auto mechanism = json.find("mechanism");
+  if (mechanism != json.end()) {
+    if (!mechanism->is_number_integer()) {
+      return invalid("expected an integer \"mechanism\".");
+    }
+    decision.mechanism = mechanism->get<int>();
+  }
+
+  std::lock_guard<Mutex> lock(mutex_);
+  // A response to a request that didn't ask for the decision, or that
+  // arrives after the provisional decision was sent with a trace chunk, is
+  // ignored.
+  if (!awaiting_delegated_sampling_decision_ || chunks_sent_) {
+    return std::nullopt;
+  }
+  awaiting_delegated_sampling_decision_ = false;
   sampling_decision_ = decision;
   update_decision_maker_trace_tag();
+  if (decision.priority > 0) {
+    lightweight_.store(false, std::memory_order_relaxed);
+  }
+  return std::nullopt;
+}
+
+void TraceSegment::write_sampling_delegation_response(DictWriter& writer) {
+  if (!sampling_delegation_requested_) {
+    return;
+  }
+  std::string value;
+  {
+    std::lock_guard<Mutex> lock(mutex_);
+    make_sampling_decision_if_null();
+    assert(sampling_decision_);
+    auto json = nlohmann::json::object(
+        {{"priority", sampling_decision_->priority}});
+    if (sampling_decision_->mechanism) {
+      json["mechanism"] = *sampling_decision_->mechanism;
+    }
+    value = json.dump();
+  }
+  writer.set("x-datadog-trace-sampling-decision", value);
+}
+
+std::size_t TraceSegment::admit_spans(std::size_t count) {
+  if (!max_spans_) {
+    return count;
+  }
+  // Spans registered concurrently might exceed the limit by a few.
+  const std::size_t registered =
+      num_registered_spans_.load(std::memory_order_relaxed);
+  const std::size_t admitted =
+      registered >= *max_spans_ ? 0 : std::min(count, *max_spans_ - registered);
+  if (admitted != count) {
+    num_overflow_spans_.fetch_add(count - admitted, std::memory_order_relaxed);
+  }
+  return admitted;
+}
+
+SpanData* TraceSegment::overflow_span(const SpanData& parent) {
+  SpanData* span = overflow_span_.load(std::memory_order_acquire);
+  if (span) {
+    return span;
+  }
+  std::lock_guard<Mutex> lock(mutex_);
+  span = overflow_span_.load(std::memory_order_relaxed);
+  if (!span) {
+    // The overflow span is allocated from the global heap, rather than from
+    // the arena, so that it's freed with the segment rather than with a
+    // chunk.
+    span = new SpanData;
+    span->trace_id = parent.trace_id;
+    span->span_id = local_root_id_;
+    overflow_span_.store(span, std::memory_order_release);
+  }
+  return span;
+}
+
+void TraceSegment::single_threaded() {
+  mutex_.disable();
+  arena_mutex_.disable();
+}
+
+void TraceSegment::make_sampling_decision_at_root() {
+  std::lock_guard<Mutex> lock(mutex_);
+  make_sampling_decision_if_null();
+  if (sampling_decision_->priority <= 0 && !span_sampler_->has_rules()) {
+    lightweight_.store(true, std::memory_order_relaxed);
+  }
 }
 
 void TraceSegment::make_sampling_decision_if_null() {
@@ -193,8 +880,10 @@ void TraceSegment::make_sampling_decision_if_null() {
     return;
   }
 
-  const SpanData& local_root = *spans_.front();
-  sampling_decision_ = trace_sampler_->decide(local_root);
+  // The decision is made before any chunk is sent, and so before the local
+  // root is sent.
+  assert(local_root_);
+  sampling_decision_ = trace_sampler_->decide(*local_root_);
 
   update_decision_maker_trace_tag();
 }
@@ -204,58 +893,90 @@ void TraceSegment::update_decision_maker_trace_tag() {
 
   assert(sampling_decision_);
 
+  // Keep `trace_tags_size_` up to date, as if the tags were a sequence whose
+  // encoding begins with a comma.
+  std::size_t size = trace_tags_size_ + !trace_tags_.empty();
+  const auto found = trace_tags_.find(tags::internal::decision_maker);
+  if (found != trace_tags_.end()) {
+    size -= encoded_tag_size(found->first, found->second);
+  }
   if (sampling_decision_->priority <= 0) {
     trace_tags_.erase(tags::internal::decision_maker);
   } else {
-    trace_tags_[tags::internal::decision_maker] =
-        "-" + std::to_string(*sampling_decision_->mechanism);
+    std::string& value = trace_tags_[tags::internal::decision_maker];
+    value = "-" + std::to_string(*sampling_decision_->mechanism);
+    size += encoded_tag_size(tags::internal::decision_maker, value);
   }
+  trace_tags_size_ = trace_tags_.empty() ? 0 : size - 1;
+  assert(trace_tags_size_ == encoded_tags_size(trace_tags_));
+  encoded_trace_tags_.reset();
 }
 
 void TraceSegment::inject(DictWriter& writer, const SpanData& span) {
+  const OverheadTimer timer{overhead_metrics_, Metrics::INJECT_DURATION};
   int sampling_priority;
-  std::string encoded_trace_tags;
+  bool delegate;
+  std::shared_ptr<const EncodedTraceTags> encoded_trace_tags;
   {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<Mutex> lock(mutex_);
     make_sampling_decision_if_null();
     assert(sampling_decision_);
     sampling_priority = sampling_decision_->priority;
-    encoded_trace_tags = encode_tags(trace_tags_);
+    // Only a decision that this segment made automatically is delegated.
+    // Extracted, manual, and already delegated decisions are final.
+    delegate = delegate_sampling_ && !chunks_sent_ &&
+               sampling_decision_->origin == SamplingDecision::Origin::LOCAL &&
+               sampling_decision_->mechanism !=
+                   int(SamplingMechanism::MANUAL);
+    if (delegate) {
+      awaiting_delegated_sampling_decision_ = true;
+    }
+    // Trace tags rarely change once the sampling decision is made, so a
+    // segment that injects many times encodes them only once.
+    // If they're too large for "x-datadog-tags", then they're encoded only
+    // if "tracestate" needs them.
+    if (!encoded_trace_tags_) {
+      const bool too_large = trace_tags_size_ > tags_header_max_size_;
+      std::string encoded;
+      if (!too_large || injection_styles_.w3c) {
+        encoded = encode_tags(trace_tags_);
+      }
+      encoded_trace_tags_ = std::make_shared<const EncodedTraceTags>(
+          EncodedTraceTags{std::move(encoded), trace_tags_size_, too_large});
+    }
+    encoded_trace_tags = encoded_trace_tags_;
   }
 
-  // Origin and trace tag headers are always propagated.
-  // Other headers depend on the injection styles.
+  // The headers' values are views of `origin_`, `encoded_trace_tags`, and
+  // `w3c_tracestate_`, so formatting them doesn't allocate.
+  InjectedContext context;
+  context.trace_id = span.trace_id;
+  context.span_id = span.span_id;
+  context.sampling_priority = sampling_priority;
   if (origin_) {
-    writer.set("x-datadog-origin", *origin_);
+    context.origin = *origin_;
   }
-  if (encoded_trace_tags.size() > tags_header_max_size_) {
+  context.trace_tags = encoded_trace_tags->value;
+  context.trace_tags_too_large = encoded_trace_tags->too_large;
+  context.w3c_tracestate = w3c_tracestate_;
+  context.delegate_sampling = delegate;
+  if (encoded_trace_tags->too_large) {
     std::string message;
     message +=
         "Serialized x-datadog-tags header value is too large.  The configured "
         "maximum size is ";
     message += std::to_string(tags_header_max_size_);
     message += " bytes, but the encoded value is ";
-    message += std::to_string(encoded_trace_tags.size());
+    message += std::to_string(encoded_trace_tags->size);
     message += " bytes.";
     logger_->log_error(message);
-    SpanData& local_root = *spans_.front();
-    local_root.tags[tags::internal::propagation_error] = "inject_max_size";
-  } else if (!encoded_trace_tags.empty()) {
-    writer.set("x-datadog-tags", encoded_trace_tags);
-  }
-
-  if (injection_styles_.datadog) {
-    writer.set("x-datadog-trace-id", std::to_string(span.trace_id));
-    writer.set("x-datadog-parent-id", std::to_string(span.span_id));
-    writer.set("x-datadog-sampling-priority",
-               std::to_string(sampling_priority));
+    std::lock_guard<Mutex> lock(mutex_);
+    if (local_root_) {
+      local_root_->tags[tags::internal::propagation_error] = "inject_max_size";
+    }
   }
 
-  if (injection_styles_.b3) {
-    writer.set("x-b3-traceid", hex(span.trace_id));
-    writer.set("x-b3-spanid", hex(span.span_id));
-    writer.set("x-b3-sampled", std::to_string(int(sampling_priority > 0)));
-  }
+  inject_trace_context(writer, injection_styles_, context);
 }
 
 }  // namespace tracing
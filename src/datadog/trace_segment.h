@@ -25,17 +25,113 @@
 //
 // When all of the `Span`s associated with `TraceSegment` have been destroyed,
 // the `TraceSegment` submits their them in a payload to a `Collector`.
+//
+// If partial flushing is configured, then a long-lived segment does not retain
+// all of its spans until the last of them finishes.  Instead, once enough of
+// its spans are finished, the `TraceSegment` submits the finished spans as a
+// trace chunk, and retains only the spans that are still open.  The sampling
+// decision is made before the first chunk is submitted, and thereafter cannot
+// be overridden, so that every chunk of the segment has the same sampling
+// priority.
+//
+// If the sampling decision is made when the segment is created (see
+// `TracerConfig::sampling_decision_at_root`), and the trace is dropped, and
+// no span sampling rule is configured, then the segment is "lightweight":
+// its spans keep only what's needed for trace context propagation and for
+// trace metrics (IDs, timing, service, name, resource, type, error, and the
+// environment, version, and HTTP status code tags).  Other tags, metrics, and
+// error messages, types, and stacks, are discarded as they're set.
+//
+// If a memory budget is configured (see `TracerConfig::max_memory_bytes`),
+// then the segment counts the approximate size of each of its finished spans
+// in the tracer's metrics until the spans are sent.  While the tracer's
+// buffered trace data exceeds the budget, the segment sends finished spans
+// right away, removes large tags from the chunks that it sends, and discards
+// the chunks that sampling drops instead of sending them.
+//
+// The chunks of a dropped trace are sent to the collector by
+// `Collector::send_unsampled`, along with the trace's sampling mechanism.  If
+// span sampling is deferred (see `TracerConfig::defer_span_sampling`), then
+// they are sent before span sampling is applied to them, and the collector
+// applies it as it flushes.  Then the thread that finishes a dropped trace
+// doesn't match each of its spans against the span sampling rules.
+//
+// If a minimum span duration is configured (see
+// `TracerConfig::min_span_duration_microseconds`), then the segment leaves
+// unremarkable short spans out of its first trace chunk, before the chunk is
+// sampled or sent, and counts them on their parents instead.  Later chunks of
+// a partially flushed segment are not filtered, because their spans might be
+// the parents of spans already sent.
+//
+// Similarly, if a threshold for repeated spans is configured (see
+// `TracerConfig::collapse_repeated_spans_threshold`), then the segment
+// collapses each run of at least that many childless siblings having the same
+// service, name, and resource into one span that covers them all, and that
+// summarizes them in its metrics.  This also applies only to the first chunk.
+//
+// If compaction of finished spans is configured (see
+// `TracerConfig::compact_finished_spans`), then once enough of a segment's
+// spans are finished while others are still open, the segment moves the
+// finished spans, other than its first span, into a compact encoding (see
+// `compact_spans.h`).  They're decoded back into the trace chunk that's sent
+// next, in their original order, before the chunk is filtered, sampled, or
+// finalized.  The first span is kept, because it carries the trace-level tags
+// and the sampling decision depends on it.
+//
+// If a maximum number of spans per trace is configured (see
+// `TracerConfig::max_spans_per_trace`), then once that many spans have been
+// created in the segment, `Span::create_child` returns "overflow" spans
+// instead of creating more.  An overflow span records nothing, and its IDs
+// are those of the local root span, so that injecting it still propagates the
+// trace.  Overflow spans share one `SpanData` owned by the segment, which is
+// allocated only if the limit is reached.  The local root span has a metric
+// for the number of overflow spans (`overflow_spans.count`), if it's sent
+// after they're created.
+//
+// If span quotas are configured (see `TracerConfig::span_quotas`), then each
+// trace chunk is counted against the quotas of its first span's service just
+// before it's sent, and is dropped if it exceeds them.
+//
+// If sampling delegation is configured (see
+// `TracerConfig::delegate_trace_sampling`), then injecting a trace whose
+// sampling decision was made here automatically, rather than extracted or
+// overridden, also asks the receiving service to make the decision instead.
+// The segment still injects its provisional decision, and keeps it unless the
+// response carries the receiving service's decision (see
+// `read_sampling_delegation_response`), which then replaces it, provided that
+// no trace chunk has been sent yet.  Conversely, a segment extracted from a
+// request that asks for the decision ignores any extracted sampling priority,
+// and returns its own decision in the response (see
+// `write_sampling_delegation_response`).
+//
+// Spans are registered and finished without locking the segment.  Only the
+// finish of the last open span, partial flushing, and the paths that read or
+// make the sampling decision (such as `inject`) lock the segment's mutex.
+//
+// A segment whose spans are all used on one thread, such as an event loop's,
+// can be made "single-threaded" when it's created (see
+// `SpanConfig::single_threaded`).  Then its mutexes do nothing, and locking
+// costs only a branch.  Using the spans of a single-threaded segment from
+// more than one thread is undefined.
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "clock.h"
+#include "compact_spans.h"
 #include "expected.h"
+#include "flat_map.h"
+#include "id_generator.h"
 #include "propagation_styles.h"
 #include "sampling_decision.h"
+#include "span_arena.h"
 
 namespace datadog {
 namespace tracing {
@@ -44,48 +140,192 @@ class Collector;
 class DictReader;
 class DictWriter;
 class Logger;
+class Metrics;
 struct SpanData;
 struct SpanDefaults;
+struct SpanPrototype;
+class SpanQuotas;
 class SpanSampler;
 class TraceSampler;
 
 class TraceSegment {
-  mutable std::mutex mutex_;
+  // `Mutex` is a `std::mutex` that can be disabled, after which locking and
+  // unlocking it do nothing.  It's disabled only before it's first locked.
+  class Mutex {
+    std::mutex mutex_;
+    bool enabled_ = true;
+
+   public:
+    void disable() { enabled_ = false; }
+    void lock() {
+      if (enabled_) {
+        mutex_.lock();
+      }
+    }
+    void unlock() {
+      if (enabled_) {
+        mutex_.unlock();
+      }
+    }
+  };
+
+  // `mutex_` protects the sampling decision, `trace_tags_`, and the members
+  // that track sent and unsent spans (`spans_` and below).
+  mutable Mutex mutex_;
 
   std::shared_ptr<Logger> logger_;
   std::shared_ptr<Collector> collector_;
+  std::shared_ptr<Metrics> metrics_;
+  // `overhead_metrics_` is `metrics_` if overhead profiling is enabled, and
+  // otherwise is null.  See `OverheadTimer`.
+  Metrics* const overhead_metrics_;
   std::shared_ptr<TraceSampler> trace_sampler_;
   std::shared_ptr<SpanSampler> span_sampler_;
 
-  std::shared_ptr<const SpanDefaults> defaults_;
+  std::shared_ptr<const SpanPrototype> prototype_;
+  std::shared_ptr<const IDGenerator> generator_;
+  std::shared_ptr<const Clock> clock_;
   const PropagationStyles injection_styles_;
   const std::optional<std::string> hostname_;
   const std::optional<std::string> origin_;
   const std::size_t tags_header_max_size_;
-  std::unordered_map<std::string, std::string> trace_tags_;
+  // `local_root_id_` is the span ID of the segment's first span, which
+  // outlives `local_root_`.
+  const std::uint64_t local_root_id_;
+  // If `partial_flush_min_spans_` is not null, then finished spans are sent
+  // once there are at least that many.
+  const std::optional<std::size_t> partial_flush_min_spans_;
+  // If `max_memory_bytes_` is not null, then finished spans are counted in
+  // `metrics_`, and the segment degrades while the memory counted there
+  // exceeds `*max_memory_bytes_`.
+  const std::optional<std::size_t> max_memory_bytes_;
+  FlatMap<std::string> trace_tags_;
+  // `trace_tags_size_` is the length of the encoding of `trace_tags_` (see
+  // `encoded_tags_size`).  It's updated as `trace_tags_` changes, so that an
+  // encoding too large to propagate needn't be built to find that out.
+  std::size_t trace_tags_size_;
+  // `EncodedTraceTags` is `trace_tags_` encoded for the "x-datadog-tags"
+  // header, and whether the encoding exceeds `tags_header_max_size_`.  If it
+  // does, and the encoding isn't needed for the "tracestate" header either,
+  // then `value` is empty.
+  struct EncodedTraceTags {
+    std::string value;
+    std::size_t size;
+    bool too_large;
+  };
+  // `encoded_trace_tags_` is computed by `inject` and reset whenever
+  // `trace_tags_` changes.  It's shared so that `inject` can use it without
+  // copying it or holding the lock.
+  std::shared_ptr<const EncodedTraceTags> encoded_trace_tags_;
 
+  // `arena_mutex_` protects `arena_`, so that allocating a span doesn't
+  // contend with `mutex_`.
+  Mutex arena_mutex_;
+  SpanArena arena_;
+
+  // `registrations_` are the spans that have been registered but not yet
+  // moved into `spans_`, newest first, linked by their `next_registration`.
+  // It is a lock-free stack, like `MPSCQueue`, but the spans are its nodes,
+  // so that registering a span allocates nothing.  It is drained only while
+  // `mutex_` is locked.  The spans in it are owned by this segment.
+  std::atomic<SpanData*> registrations_;
+  // The number of spans ever registered with this segment, and the number of
+  // them that are finished.  When the two are equal, the segment is done.
+  std::atomic<std::size_t> num_registered_spans_;
+  std::atomic<std::size_t> num_finished_spans_;
+
+  // `num_taken_spans_` is the number of spans ever moved into `spans_`.
+  std::size_t num_taken_spans_;
+  // `spans_` are the spans that have not yet been sent to the collector,
+  // excluding those still in `registrations_`.  `local_root_` is the first of
+  // them until it is sent, and then is null.
   std::vector<std::unique_ptr<SpanData>> spans_;
-  std::size_t num_finished_spans_;
+  SpanData* local_root_;
+  // `finished_spans_` are the finished elements of `spans_`.  They're tracked
+  // only if `partial_flush_min_spans_`, `max_memory_bytes_`, or
+  // `compact_finished_spans_` is not null.
+  std::vector<const SpanData*> finished_spans_;
+  // `chunks_sent_` is whether any of this segment's spans have been sent to
+  // the collector.
+  bool chunks_sent_;
+  // `sent_parent_services_` maps the IDs of sent spans that are parents of
+  // spans in `spans_` to their services.  See `mark_top_level`.
+  std::unordered_map<std::uint64_t, std::string> sent_parent_services_;
   std::optional<SamplingDecision> sampling_decision_;
+  // `delegate_sampling_` is whether `inject` asks for the sampling decision.
+  // `awaiting_delegated_sampling_decision_` is whether it has, and the
+  // decision has not yet been read from a response.
+  bool delegate_sampling_ = false;
   bool awaiting_delegated_sampling_decision_ = false;
+  // `sampling_delegation_requested_` is whether the segment was extracted
+  // from a request that asks for its sampling decision.
+  bool sampling_delegation_requested_ = false;
+  // `w3c_tracestate_` is the inbound "tracestate" header of the trace, whose
+  // members other than "dd" are passed on by `inject`, or is empty.
+  std::string w3c_tracestate_;
+  // `defer_span_sampling_` is whether span sampling is left to the collector.
+  bool defer_span_sampling_ = false;
+  // If `min_span_duration_` is not null, then shorter spans are filtered.
+  std::optional<Duration> min_span_duration_;
+  // If `collapse_repeated_spans_threshold_` is not null, then repeated
+  // siblings are collapsed.
+  std::optional<std::size_t> collapse_repeated_spans_threshold_;
+  // If `compact_finished_spans_` is not null, then once that many spans are
+  // finished, they're moved from `spans_` into `compact_spans_`, and are
+  // compressed if `compress_compacted_spans_`.  `compact_spans_` are spans
+  // that were registered after the first of `spans_`.
+  std::optional<std::size_t> compact_finished_spans_;
+  bool compress_compacted_spans_ = false;
+  CompactSpans compact_spans_;
+  // If `max_spans_` is not null, then spans beyond that number are overflow
+  // spans, whose data is `overflow_span_`, and which are counted in
+  // `num_overflow_spans_`.  `overflow_span_` is set once, while `mutex_` is
+  // locked.
+  std::optional<std::size_t> max_spans_;
+  std::atomic<SpanData*> overflow_span_{nullptr};
+  std::atomic<std::size_t> num_overflow_spans_{0};
+  // If `span_quotas_` is not null, then chunks that exceed them are dropped.
+  std::shared_ptr<SpanQuotas> span_quotas_;
+  // `lightweight_` is read without locking by the segment's spans.
+  std::atomic<bool> lightweight_{false};
 
  public:
+  // While the memory budget is exceeded, tags whose values are longer than
+  // `large_tag_size` bytes are removed from the trace chunks that are sent.
+  static constexpr std::size_t large_tag_size = 1024;
+
   TraceSegment(const std::shared_ptr<Logger>& logger,
                const std::shared_ptr<Collector>& collector,
+               const std::shared_ptr<Metrics>& metrics,
+               bool overhead_profiling,
                const std::shared_ptr<TraceSampler>& trace_sampler,
                const std::shared_ptr<SpanSampler>& span_sampler,
-               const std::shared_ptr<const SpanDefaults>& defaults,
+               const std::shared_ptr<const SpanPrototype>& prototype,
+               const std::shared_ptr<const IDGenerator>& generator,
+               const std::shared_ptr<const Clock>& clock,
                const PropagationStyles& injection_styles,
                const std::optional<std::string>& hostname,
                std::optional<std::string> origin,
                std::size_t tags_header_max_size,
-               std::unordered_map<std::string, std::string> trace_tags,
+               std::optional<std::size_t> partial_flush_min_spans,
+               std::optional<std::size_t> max_memory_bytes,
+               FlatMap<std::string> trace_tags,
                std::optional<SamplingDecision> sampling_decision,
-               std::unique_ptr<SpanData> local_root);
+               SpanArena arena, std::unique_ptr<SpanData> local_root);
+  ~TraceSegment();
 
   const SpanDefaults& defaults() const;
+  // Return the defaults, and the default tags, of this segment's spans.
+  const SpanPrototype& prototype() const;
+  // Return the generator of span IDs and the clock used by this segment's
+  // spans.
+  const IDGenerator& generator() const;
+  const Clock& clock() const;
   const std::optional<std::string>& hostname() const;
   const std::optional<std::string>& origin() const;
+  // Return the span ID of this segment's local root span, i.e. of the first
+  // span in the segment.
+  std::uint64_t local_root_id() const;
   std::optional<SamplingDecision> sampling_decision() const;
 
   Logger& logger() const;
@@ -94,29 +334,157 @@ class TraceSegment {
   // This function is the implementation of `Span::inject`.
   void inject(DictWriter& writer, const SpanData& span);
 
-  // These are for sampling delegation, not for trace propagation.
-  // TODO: Sampling delegation is not yet implemented.
-  Expected<void> extract(const DictReader& reader);
-  void inject(DictWriter& writer) const;
+  // Adopt the sampling decision that the specified `reader`, the headers of
+  // a response to a request into which this segment injected trace context,
+  // might contain, as described above.  Return an error if the decision is
+  // malformed.  A response without a decision is not an error, and the
+  // provisional decision is kept.  This function is the implementation of
+  // `Span::read_sampling_delegation_response`.
+  Expected<void> read_sampling_delegation_response(const DictReader& reader);
+  // If this segment was asked for its sampling decision, make the decision
+  // if it hasn't been made, and write it into the specified `writer`, the
+  // headers of the response to the request from which this segment was
+  // extracted.  Otherwise, do nothing.  This function is the implementation
+  // of `Span::write_sampling_delegation_response`.
+  void write_sampling_delegation_response(DictWriter& writer);
 
-  // Take ownership of the specified `span`.
+  // Return a default-constructed `SpanData` allocated from this segment's
+  // arena.  The returned object is not yet registered with this segment (see
+  // `register_span`).
+  std::unique_ptr<SpanData> allocate_span_data();
+  // Append the specified `count` default-constructed `SpanData`s, allocated
+  // from this segment's arena under one lock, to the specified `spans`.
+  void allocate_span_data(std::size_t count,
+                          std::vector<std::unique_ptr<SpanData>>& spans);
+  // Take ownership of the specified `span`.  This function does not block.
   void register_span(std::unique_ptr<SpanData> span);
-  // Increment the number of finished spans.  If that number is equal to the
-  // number of registered spans, send all of the spans to the `Collector`.
-  void span_finished();
+  // Take ownership of the specified `spans`, leaving `spans` empty.  Unlike
+  // `register_span`, this function locks the segment, once for all of the
+  // spans.
+  void register_spans(std::vector<std::unique_ptr<SpanData>>& spans);
+  // Note that the specified `span` is finished.  If all of the registered
+  // spans are finished, send them to the `Collector`.  Otherwise, if partial
+  // flushing is configured and enough spans are finished, or if the memory
+  // budget is exceeded, send the finished spans to the `Collector`.
+  void span_finished(const SpanData& span);
 
   // Set the sampling decision to be a local, manual decision with the specified
-  // sampling `priority`.  Overwrite any previous sampling decision.
+  // sampling `priority`.  Overwrite any previous sampling decision, unless
+  // some of this segment's spans have already been sent to the `Collector`,
+  // in which case do nothing.  A priority that keeps the trace makes the
+  // segment no longer lightweight, though what its spans already discarded
+  // is lost.
   void override_sampling_priority(int priority);
 
+  // Make the sampling decision, if it hasn't been made, from the local root
+  // span as it is now.  If the trace is dropped and the span sampler has no
+  // rules, then make the segment lightweight.  `Tracer` calls this when the
+  // segment is created, if so configured.
+  void make_sampling_decision_at_root();
+  // Leave the span sampling of dropped chunks to the collector.  `Tracer`
+  // calls this when the segment is created, if so configured.
+  void defer_span_sampling();
+  // Leave finished spans shorter than the specified `min_duration` out of
+  // this segment's trace chunk, as described above.  `Tracer` calls this when
+  // the segment is created, if so configured.
+  void filter_spans_shorter_than(Duration min_duration);
+  // Collapse at least the specified `threshold` number of repeated sibling
+  // spans in this segment's trace chunk into one, as described above.
+  // `Tracer` calls this when the segment is created, if so configured.
+  void collapse_repeated_spans(std::size_t threshold);
+  // Compact this segment's finished spans once there are at least the
+  // specified `min_spans` of them, compressing them if the specified
+  // `compress` is true, as described above.  `Tracer` calls this when the
+  // segment is created, if so configured.
+  void compact_finished_spans(std::size_t min_spans, bool compress);
+  // Limit this segment to the specified `max_spans` spans, as described
+  // above.  `Tracer` calls this when the segment is created, if so
+  // configured.
+  void limit_spans(std::size_t max_spans);
+  // Drop this segment's trace chunks that exceed the specified `quotas`, as
+  // described above.  `Tracer` calls this when the segment is created, if so
+  // configured.
+  void enforce_span_quotas(std::shared_ptr<SpanQuotas> quotas);
+  // Ask the services into whose requests this segment injects trace context
+  // to make its sampling decision, as described above.  `Tracer` calls this
+  // when the segment is created, if so configured.
+  void delegate_sampling();
+  // Note that this segment was extracted from a request that asks for its
+  // sampling decision.  `Tracer` calls this when it extracts the segment.
+  void sampling_delegation_requested();
+  // Pass on the members other than "dd" of the specified inbound
+  // "tracestate" header when injecting.  `Tracer` calls this when it extracts
+  // the segment, before the segment is used.
+  void pass_on_tracestate(std::string tracestate);
+  // Return how many of the specified `count` new spans this segment admits,
+  // given its maximum number of spans, and count the others as overflow
+  // spans.
+  std::size_t admit_spans(std::size_t count);
+  // Return the data of this segment's overflow spans, whose trace ID is that
+  // of the specified `parent`, a span of this segment.
+  SpanData* overflow_span(const SpanData& parent);
+  // Return whether the specified `span` is the data of this segment's
+  // overflow spans.
+  bool is_overflow_span(const SpanData* span) const {
+    return span == overflow_span_.load(std::memory_order_relaxed);
+  }
+  // Disable this segment's locking, as described above.  `Tracer` calls this
+  // when the segment is created, if so configured, before the segment is
+  // used.
+  void single_threaded();
+  // Return whether the segment's spans discard what isn't needed for trace
+  // context propagation or trace metrics.
+  bool lightweight() const {
+    return lightweight_.load(std::memory_order_relaxed);
+  }
+
  private:
   // If `sampling_decision_` is not null, use `trace_sampler_` to make a
   // sampling decision and assign it to `sampling_decision_`.
   void make_sampling_decision_if_null();
   // Set or remove the `tags::internal::decision_maker` trace tag in
   // `trace_tags_` according to either information extracted from trace context
-  // or from a local sampling decision.
+  // or from a local sampling decision.  Reset `encoded_trace_tags_`.
   void update_decision_maker_trace_tag();
+  // Append the spans in `registrations_` to `spans_`, in the order in which
+  // they were registered.
+  void take_registrations();
+  // Move the finished spans from `spans_` into the specified `chunk`.
+  void take_finished_spans(std::vector<std::unique_ptr<SpanData>>& chunk);
+  // Move the finished spans other than the first of `spans_` into
+  // `compact_spans_`.
+  void compact_spans();
+  // Decode the spans in `compact_spans_` into the specified `chunk`, after
+  // its first span if the specified `after_first` is true, and otherwise
+  // before it.
+  void restore_compacted_spans(std::vector<std::unique_ptr<SpanData>>& chunk,
+                               bool after_first);
+  // Remove from the specified `chunk` the spans that are shorter than
+  // `min_span_duration_` and otherwise unremarkable, and count them in the
+  // metrics of their parents.
+  void filter_short_spans(std::vector<std::unique_ptr<SpanData>>& chunk);
+  // Replace each group of at least `collapse_repeated_spans_threshold_`
+  // childless spans in the specified `chunk` that have the same parent,
+  // service, name, and resource with the first of them, amended to summarize
+  // the group.
+  void collapse_repeated_spans(std::vector<std::unique_ptr<SpanData>>& chunk);
+  // Tag the spans of the specified `chunk` whose parents are not in `chunk`
+  // with whether they are top level, since the collector can't tell.  This is
+  // necessary only once the segment has been partially flushed.
+  void mark_top_level(std::vector<std::unique_ptr<SpanData>>& chunk);
+  // Apply the sampling decision and trace-level tags, and span sampling if
+  // the specified `sample_spans` is true, to the specified `chunk`, before it
+  // is sent to the collector.
+  void finalize_chunk(std::vector<std::unique_ptr<SpanData>>& chunk,
+                      bool sample_spans);
+  // Return whether the memory budget is configured and exceeded.
+  bool over_memory_budget() const;
+  // Remove the large tags from the specified finalized `chunk`, and return
+  // whether to discard the chunk instead of sending it, given its sampling
+  // `priority` and whether its `span_sampling_deferred`.  This is done only
+  // while the memory budget is exceeded.
+  bool shed_memory(std::vector<std::unique_ptr<SpanData>>& chunk,
+                   int priority, bool span_sampling_deferred);
 };
 
 }  // namespace tracing
@@ -1,42 +1,69 @@
 #include "tracer.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <variant>
 
+#include "active_span.h"
+#include "cycle_counter.h"
 #include "datadog_agent.h"
 #include "dict_reader.h"
 #include "environment.h"
+#include "indexed_dict_reader.h"
 #include "json.hpp"
 #include "logger.h"
 #include "net_util.h"
+#include "null_collector.h"
 #include "parse_util.h"
+#include "remote_config.h"
+#include "sampling_priority.h"
 #include "span.h"
+#include "span_arena.h"
 #include "span_config.h"
 #include "span_data.h"
+#include "span_limits.h"
+#include "span_prototype.h"
+#include "span_quota.h"
 #include "span_sampler.h"
 #include "tag_propagation.h"
 #include "tags.h"
+#include "threaded_event_scheduler.h"
+#include "trace_context_injection.h"
+#include "trace_id.h"
 #include "trace_sampler.h"
 #include "trace_segment.h"
 #include "version.h"
+#include "w3c_propagation.h"
 
 namespace datadog {
 namespace tracing {
 namespace {
 
-class ExtractionPolicy {
- public:
-  virtual Expected<std::optional<std::uint64_t>> trace_id(
-      const DictReader& headers) = 0;
-  virtual Expected<std::optional<std::uint64_t>> parent_id(
-      const DictReader& headers) = 0;
-  virtual Expected<std::optional<int>> sampling_priority(
-      const DictReader& headers) = 0;
-  virtual std::optional<std::string> origin(const DictReader& headers) = 0;
-  virtual std::optional<std::string> trace_tags(const DictReader&) = 0;
-};
+// Each extraction policy provides the members `trace_id`, `parent_id`,
+// `sampling_priority`, `origin`, `trace_tags`, and `ignored_error`, which are
+// called by `Tracer::ExtractedData::extract` and by `extract_context`.  The
+// policies are not polymorphic: each extraction style is compiled into the
+// instantiations of `Tracer::extract_styles` that include it.  `origin` and
+// `trace_tags` return views of the headers, or of the policy, so that
+// `Tracer::propagate` can pass them on without copying them.
+// `ignored_error` returns the error, if any, in headers that the policy
+// ignored instead of failing the extraction.
 
-class DatadogExtractionPolicy : public ExtractionPolicy {
+class DatadogExtractionPolicy {
   Expected<std::optional<std::uint64_t>> id(const DictReader& headers,
                                             std::string_view header,
                                             std::string_view kind) {
@@ -46,32 +73,33 @@ class DatadogExtractionPolicy : public ExtractionPolicy {
     }
     auto result = parse_uint64(*found, 10);
     if (auto* error = result.if_error()) {
-      std::string prefix;
-      prefix += "Could not extract Datadog-style ";
-      prefix += kind;
-      prefix += "ID from ";
-      prefix += header;
-      prefix += ": ";
-      prefix += *found;
-      prefix += ' ';
-      return error->with_prefix(prefix);
+      return error
+          ->with_context({"Could not extract Datadog-style ", kind, "ID from ",
+                          header, ": ", *found, " "})
+          .to_error();
     }
     return *result;
   }
 
  public:
-  Expected<std::optional<std::uint64_t>> trace_id(
-      const DictReader& headers) override {
-    return id(headers, "x-datadog-trace-id", "trace");
+  Expected<std::optional<TraceID>> trace_id(const DictReader& headers) {
+    // The high 64 bits, if any, are in the "_dd.p.tid" trace tag.  See
+    // `extract_data`.
+    auto result = id(headers, "x-datadog-trace-id", "trace");
+    if (auto* error = result.if_error()) {
+      return std::move(*error);
+    }
+    if (!*result) {
+      return std::nullopt;
+    }
+    return TraceID{**result};
   }
 
-  Expected<std::optional<std::uint64_t>> parent_id(
-      const DictReader& headers) override {
+  Expected<std::optional<std::uint64_t>> parent_id(const DictReader& headers) {
     return id(headers, "x-datadog-parent-id", "parent span");
   }
 
-  Expected<std::optional<int>> sampling_priority(
-      const DictReader& headers) override {
+  Expected<std::optional<int>> sampling_priority(const DictReader& headers) {
     const std::string_view header = "x-datadog-sampling-priority";
     auto found = headers.lookup(header);
     if (!found) {
@@ -79,32 +107,24 @@ class DatadogExtractionPolicy : public ExtractionPolicy {
     }
     auto result = parse_int(*found, 10);
     if (auto* error = result.if_error()) {
-      std::string prefix;
-      prefix += "Could not extract Datadog-style sampling priority from ";
-      prefix += header;
-      prefix += ": ";
-      prefix += *found;
-      prefix += ' ';
-      return error->with_prefix(prefix);
+      return error
+          ->with_context({"Could not extract Datadog-style sampling priority "
+                          "from ",
+                          header, ": ", *found, " "})
+          .to_error();
     }
     return *result;
   }
 
-  std::optional<std::string> origin(const DictReader& headers) override {
-    auto found = headers.lookup("x-datadog-origin");
-    if (found) {
-      return std::string(*found);
-    }
-    return std::nullopt;
+  std::optional<std::string_view> origin(const DictReader& headers) {
+    return headers.lookup("x-datadog-origin");
   }
 
-  std::optional<std::string> trace_tags(const DictReader& headers) override {
-    auto found = headers.lookup("x-datadog-tags");
-    if (found) {
-      return std::string(*found);
-    }
-    return std::nullopt;
+  std::optional<std::string_view> trace_tags(const DictReader& headers) {
+    return headers.lookup("x-datadog-tags");
   }
+
+  std::optional<Error> ignored_error() const { return std::nullopt; }
 };
 
 class B3ExtractionPolicy : public DatadogExtractionPolicy {
@@ -116,11 +136,27 @@ class B3ExtractionPolicy : public DatadogExtractionPolicy {
       return std::nullopt;
     }
     auto result = parse_uint64(*found, 16);
+    if (auto* error = result.if_error()) {
+      return error
+          ->with_context({"Could not extract B3-style ", kind, "ID from ",
+                          header, ": ", *found, " "})
+          .to_error();
+    }
+    return *result;
+  }
+
+ public:
+  Expected<std::optional<TraceID>> trace_id(const DictReader& headers) {
+    // B3 trace IDs are either 16 or 32 hexadecimal digits.
+    const std::string_view header = "x-b3-traceid";
+    auto found = headers.lookup(header);
+    if (!found) {
+      return std::nullopt;
+    }
+    auto result = TraceID::parse_hex(strip(*found));
     if (auto* error = result.if_error()) {
       std::string prefix;
-      prefix += "Could not extract B3-style ";
-      prefix += kind;
-      prefix += "ID from ";
+      prefix += "Could not extract B3-style trace ID from ";
       prefix += header;
       prefix += ": ";
       prefix += *found;
@@ -130,19 +166,11 @@ class B3ExtractionPolicy : public DatadogExtractionPolicy {
     return *result;
   }
 
- public:
-  Expected<std::optional<std::uint64_t>> trace_id(
-      const DictReader& headers) override {
-    return id(headers, "x-b3-traceid", "trace");
-  }
-
-  Expected<std::optional<std::uint64_t>> parent_id(
-      const DictReader& headers) override {
+  Expected<std::optional<std::uint64_t>> parent_id(const DictReader& headers) {
     return id(headers, "x-b3-spanid", "parent span");
   }
 
-  Expected<std::optional<int>> sampling_priority(
-      const DictReader& headers) override {
+  Expected<std::optional<int>> sampling_priority(const DictReader& headers) {
     const std::string_view header = "x-b3-sampled";
     auto found = headers.lookup(header);
     if (!found) {
@@ -150,83 +178,354 @@ class B3ExtractionPolicy : public DatadogExtractionPolicy {
     }
     auto result = parse_int(*found, 10);
     if (auto* error = result.if_error()) {
-      std::string prefix;
-      prefix += "Could not extract B3-style sampling priority from ";
-      prefix += header;
-      prefix += ": ";
-      prefix += *found;
-      prefix += ' ';
-      return error->with_prefix(prefix);
+      return error
+          ->with_context({"Could not extract B3-style sampling priority from ",
+                          header, ": ", *found, " "})
+          .to_error();
     }
     return *result;
   }
 };
 
-struct ExtractedData {
-  std::optional<std::uint64_t> trace_id;
-  std::optional<std::uint64_t> parent_id;
-  std::optional<std::string> origin;
-  std::optional<std::string> trace_tags;
-  std::optional<int> sampling_priority;
+// `B3SingleExtractionPolicy` extracts the trace context from the single "b3"
+// header, which is "{trace ID}-{span ID}[-{sampled}[-{parent span ID}]]", or
+// only "{sampled}".  The header is parsed in one pass, when the trace ID is
+// requested.  "sampled" is "1", "0", or "d" (debug), which is `USER_KEEP`.
+// The parent span ID is validated, as 16 or 32 hexadecimal digits, but is
+// otherwise ignored.
+class B3SingleExtractionPolicy {
+  std::optional<std::uint64_t> span_id_;
+  std::optional<int> sampling_priority_;
+
+  static Error malformed(std::string_view value, std::string_view problem) {
+    std::string message;
+    message += "Could not extract B3-style trace context from b3: ";
+    message += value;
+    message += ' ';
+    message += problem;
+    return Error{Error::MALFORMED_B3_HEADER, std::move(message)};
+  }
+
+  Expected<void> parse_sampled(std::string_view value,
+                               std::string_view sampled) {
+    if (sampled == "1") {
+      sampling_priority_ = 1;
+    } else if (sampled == "0") {
+      sampling_priority_ = 0;
+    } else if (sampled == "d") {
+      sampling_priority_ = 2;
+    } else {
+      return malformed(value, "(sampling state must be 1, 0, or d)");
+    }
+    return std::nullopt;
+  }
+
+ public:
+  Expected<std::optional<TraceID>> trace_id(const DictReader& headers) {
+    const auto found = headers.lookup("b3");
+    if (!found) {
+      return std::nullopt;
+    }
+    const auto value = strip(*found);
+    auto dash = value.find('-');
+    if (dash == std::string_view::npos) {
+      // Only a sampling decision.
+      auto result = parse_sampled(value, value);
+      if (auto* error = result.if_error()) {
+        return std::move(*error);
+      }
+      return std::nullopt;
+    }
+
+    auto trace_id = TraceID::parse_hex(value.substr(0, dash));
+    if (auto* error = trace_id.if_error()) {
+      return error->with_prefix(
+          "Could not extract B3-style trace ID from b3: ");
+    }
+    const auto span_begin = dash + 1;
+    dash = value.find('-', span_begin);
+    auto span_id =
+        parse_hex_uint64(value.substr(span_begin, dash - span_begin));
+    if (auto* error = span_id.if_error()) {
+      return error->with_prefix(
+          "Could not extract B3-style parent span ID from b3: ");
+    }
+    span_id_ = *span_id;
+    if (dash != std::string_view::npos) {
+      const auto sampled_begin = dash + 1;
+      dash = value.find('-', sampled_begin);
+      const auto sampled = value.substr(sampled_begin, dash - sampled_begin);
+      auto result = parse_sampled(value, sampled);
+      if (auto* error = result.if_error()) {
+        return std::move(*error);
+      }
+    }
+    if (dash != std::string_view::npos) {
+      // The parent span ID is the parent of the span that sent the header,
+      // and so is of no use here.
+      const auto parent = value.substr(dash + 1);
+      if ((parent.size() != 16 && parent.size() != 32) ||
+          !std::all_of(parent.begin(), parent.end(), [](char ch) {
+            return std::isxdigit(static_cast<unsigned char>(ch));
+          })) {
+        return malformed(value,
+                         "(parent span ID must be 16 or 32 hexadecimal "
+                         "digits)");
+      }
+    }
+    return *trace_id;
+  }
+
+  Expected<std::optional<std::uint64_t>> parent_id(const DictReader&) {
+    return span_id_;
+  }
+
+  Expected<std::optional<int>> sampling_priority(const DictReader&) {
+    return sampling_priority_;
+  }
+
+  std::optional<std::string_view> origin(const DictReader&) {
+    return std::nullopt;
+  }
+
+  std::optional<std::string_view> trace_tags(const DictReader&) {
+    return std::nullopt;
+  }
+
+  std::optional<Error> ignored_error() const { return std::nullopt; }
 };
 
-bool operator!=(const ExtractedData& left, const ExtractedData& right) {
-  return left.trace_id != right.trace_id || left.parent_id != right.parent_id ||
-         left.origin != right.origin || left.trace_tags != right.trace_tags ||
-         left.sampling_priority != right.sampling_priority;
-}
+// `W3CExtractionPolicy` extracts the trace context from the "traceparent"
+// header, and the sampling priority, origin, and trace tags from the "dd"
+// member of the "tracestate" header.  "tracestate" is examined only once
+// "traceparent" has been parsed, and only when one of those is requested.
+// The member is decoded into `buffer_`, to which the origin and trace tags
+// refer.  As the W3C specification requires, a malformed "traceparent" is
+// ignored, as though there were no trace context, and is reported by
+// `ignored_error`.
+class W3CExtractionPolicy {
+  std::optional<TraceParent> traceparent_;
+  std::optional<Error> ignored_error_;
+  std::optional<DatadogTraceState> tracestate_;
+  DatadogTraceStateBuffer buffer_;
 
-Expected<ExtractedData> extract_data(ExtractionPolicy& extract,
-                                     const DictReader& reader) {
-  ExtractedData extracted_data;
+  // Return the "dd" member of the "tracestate" header in the specified
+  // `headers`, decoding it if this is the first call.
+  const DatadogTraceState& tracestate(const DictReader& headers) {
+    if (!tracestate_) {
+      tracestate_.emplace();
+      if (const auto found = headers.lookup("tracestate")) {
+        if (const auto member = find_datadog_member(*found)) {
+          *tracestate_ = parse_datadog_member(buffer_, *member);
+        }
+      }
+    }
+    return *tracestate_;
+  }
 
-  auto& [trace_id, parent_id, origin, trace_tags, sampling_priority] =
-      extracted_data;
+ public:
+  Expected<std::optional<TraceID>> trace_id(const DictReader& headers) {
+    auto found = headers.lookup("traceparent");
+    if (!found) {
+      return std::nullopt;
+    }
+    auto result = parse_traceparent(strip(*found));
+    if (auto* error = result.if_error()) {
+      ignored_error_ = error->with_prefix(
+          "Ignoring W3C-style trace context that could not be extracted: ");
+      return std::nullopt;
+    }
+    traceparent_ = *result;
+    return traceparent_->trace_id;
+  }
 
-  auto maybe_trace_id = extract.trace_id(reader);
-  if (auto* error = maybe_trace_id.if_error()) {
-    return std::move(*error);
+  Expected<std::optional<std::uint64_t>> parent_id(const DictReader&) {
+    if (!traceparent_) {
+      return std::nullopt;
+    }
+    return traceparent_->parent_id;
   }
-  trace_id = *maybe_trace_id;
 
-  origin = extract.origin(reader);
+  Expected<std::optional<int>> sampling_priority(const DictReader& headers) {
+    if (!traceparent_) {
+      return std::nullopt;
+    }
+    // The priority in "tracestate" is used only if it agrees with the
+    // "sampled" flag, which might have been changed by another vendor.
+    const bool sampled = traceparent_->sampled;
+    const auto& priority = tracestate(headers).sampling_priority;
+    if (priority && (*priority > 0) == sampled) {
+      return *priority;
+    }
+    return int(sampled);
+  }
 
-  auto maybe_parent_id = extract.parent_id(reader);
-  if (auto* error = maybe_parent_id.if_error()) {
+  std::optional<std::string_view> origin(const DictReader& headers) {
+    if (!traceparent_) {
+      return std::nullopt;
+    }
+    return tracestate(headers).origin;
+  }
+
+  std::optional<std::string_view> trace_tags(const DictReader& headers) {
+    if (!traceparent_) {
+      return std::nullopt;
+    }
+    return tracestate(headers).trace_tags;
+  }
+
+  std::optional<Error> ignored_error() const { return ignored_error_; }
+};
+
+// Return the "tracestate" header in the specified `headers`, if "traceparent"
+// belongs to the trace having the specified `trace_id`, or return null.  This
+// way, the other vendors' members of "tracestate" are passed on even if the
+// trace context was extracted from another style's headers.  A 64-bit
+// `trace_id` matches the low 64 bits of the trace ID in "traceparent".
+std::optional<std::string_view> w3c_tracestate(const DictReader& headers,
+                                               const TraceID& trace_id) {
+  const auto tracestate = headers.lookup("tracestate");
+  if (!tracestate) {
+    return std::nullopt;
+  }
+  const auto traceparent = headers.lookup("traceparent");
+  if (!traceparent) {
+    return std::nullopt;
+  }
+  const auto parsed = parse_traceparent(strip(*traceparent));
+  if (!parsed || parsed->trace_id.low != trace_id.low ||
+      (trace_id.high != 0 && parsed->trace_id.high != trace_id.high)) {
+    return std::nullopt;
+  }
+  return *tracestate;
+}
+
+// Return the high 64 bits of the trace ID in the "_dd.p.tid" tag of the
+// specified encoded `trace_tags`, or return null if there isn't such a tag or
+// if its value is not 16 hexadecimal digits.  This looks for only the one tag,
+// rather than decoding all of them.
+std::optional<std::uint64_t> trace_id_high(std::string_view trace_tags) {
+  const std::string_view key = "_dd.p.tid=";
+  std::size_t begin = 0;
+  for (;;) {
+    begin = trace_tags.find(key, begin);
+    if (begin == std::string_view::npos) {
+      return std::nullopt;
+    }
+    if (begin == 0 || trace_tags[begin - 1] == ',') {
+      break;
+    }
+    begin += key.size();
+  }
+  begin += key.size();
+  const auto end = std::min(trace_tags.find(',', begin), trace_tags.size());
+  const auto value = trace_tags.substr(begin, end - begin);
+  if (value.size() != 16) {
+    return std::nullopt;
+  }
+  auto parsed = parse_hex_uint64(value);
+  if (!parsed) {
+    return std::nullopt;
+  }
+  return *parsed;
+}
+
+// Extract the trace context in the specified `headers` by the specified
+// `policy` into the specified `context`, for `Tracer::propagate`.  Return
+// whether there is a trace ID, or return an error if the context is malformed
+// or incomplete, as for `Tracer::extract_span`.  The views in `context` refer
+// to `headers` or to `policy`.
+template <typename Policy>
+Expected<bool> extract_context(Policy& policy, const DictReader& headers,
+                               InjectedContext& context) {
+  auto trace_id = policy.trace_id(headers);
+  if (auto* error = trace_id.if_error()) {
     return std::move(*error);
   }
-  parent_id = *maybe_parent_id;
+  if (!*trace_id) {
+    return false;
+  }
+  context.trace_id = **trace_id;
+  context.origin = policy.origin(headers);
 
-  auto maybe_sampling_priority = extract.sampling_priority(reader);
-  if (auto* error = maybe_sampling_priority.if_error()) {
+  auto parent_id = policy.parent_id(headers);
+  if (auto* error = parent_id.if_error()) {
     return std::move(*error);
   }
-  sampling_priority = *maybe_sampling_priority;
+  if (!*parent_id && !context.origin) {
+    std::string message;
+    message +=
+        "There's no parent span ID to extract, but there is a trace ID: ";
+    message += context.trace_id.hex_padded();
+    return Error{Error::MISSING_PARENT_SPAN_ID, std::move(message)};
+  }
+  context.span_id = parent_id->value_or(0);
 
-  trace_tags = extract.trace_tags(reader);
+  auto sampling_priority = policy.sampling_priority(headers);
+  if (auto* error = sampling_priority.if_error()) {
+    return std::move(*error);
+  }
+  context.sampling_priority = *sampling_priority;
 
-  return extracted_data;
+  if (const auto trace_tags = policy.trace_tags(headers)) {
+    context.trace_tags = *trace_tags;
+    if (context.trace_id.high == 0) {
+      if (const auto high = trace_id_high(*trace_tags)) {
+        context.trace_id.high = *high;
+      }
+    }
+  }
+  return true;
 }
 
+// These are the bits of the `Styles` argument of `Tracer::extract_styles`.
+constexpr unsigned extract_datadog = 1;
+constexpr unsigned extract_b3 = 2;
+constexpr unsigned extract_b3_single = 4;
+constexpr unsigned extract_w3c = 8;
+
 void log_startup_message(Logger& logger, std::string_view tracer_version_string,
                          const Collector& collector,
                          const SpanDefaults& defaults,
+                         const SpanLimits& limits,
                          const TraceSampler& trace_sampler,
                          const SpanSampler& span_sampler,
                          const PropagationStyles& injection_styles,
                          const PropagationStyles& extraction_styles,
                          const std::optional<std::string>& hostname,
-                         std::size_t tags_header_max_size) {
+                         std::size_t tags_header_max_size,
+                         std::optional<std::size_t> partial_flush_min_spans,
+                         std::optional<std::size_t> max_memory_bytes,
+                         std::optional<std::chrono::steady_clock::duration>
+                             min_span_duration,
+                         std::optional<std::size_t>
+                             collapse_repeated_spans_threshold,
+                         std::optional<std::size_t> compact_finished_spans,
+                         bool compress_compacted_spans,
+                         std::optional<std::size_t> max_spans_per_trace,
+                         const SpanQuotas* span_quotas,
+                         bool trace_id_128_bit, bool sampling_decision_at_root,
+                         bool defer_span_sampling,
+                         bool delegate_trace_sampling,
+                         bool active_span_as_parent,
+                         bool overhead_profiling) {
   // clang-format off
   auto config = nlohmann::json::object({
     {"version", tracer_version_string},
     {"defaults", to_json(defaults)},
+    {"span_limits", to_json(limits)},
     {"collector", collector.config_json()},
     {"trace_sampler", trace_sampler.config_json()},
     {"span_sampler", span_sampler.config_json()},
     {"injection_styles", to_json(injection_styles)},
     {"extraction_styles", to_json(extraction_styles)},
     {"tags_header_size", tags_header_max_size},
+    {"trace_id_128_bit", trace_id_128_bit},
+    {"sampling_decision_at_root", sampling_decision_at_root},
+    {"defer_span_sampling", defer_span_sampling},
+    {"delegate_trace_sampling", delegate_trace_sampling},
+    {"active_span_as_parent", active_span_as_parent},
+    {"overhead_profiling_enabled", overhead_profiling},
     {"environment_variables", environment::to_json()},
   });
   // clang-format on
@@ -234,66 +533,570 @@ void log_startup_message(Logger& logger, std::string_view tracer_version_string,
   if (hostname) {
     config["hostname"] = *hostname;
   }
+  if (partial_flush_min_spans) {
+    config["partial_flush_min_spans"] = *partial_flush_min_spans;
+  }
+  if (max_memory_bytes) {
+    config["max_memory_bytes"] = *max_memory_bytes;
+  }
+  if (min_span_duration) {
+    config["min_span_duration_microseconds"] =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            *min_span_duration)
+            .count();
+  }
+  if (collapse_repeated_spans_threshold) {
+    config["collapse_repeated_spans_threshold"] =
+        *collapse_repeated_spans_threshold;
+  }
+  if (compact_finished_spans) {
+    config["compact_finished_spans"] = *compact_finished_spans;
+    config["compress_compacted_spans"] = compress_compacted_spans;
+  }
+  if (max_spans_per_trace) {
+    config["max_spans_per_trace"] = *max_spans_per_trace;
+  }
+  if (span_quotas) {
+    config["span_quotas"] = span_quotas->config_json();
+  }
 
   logger.log_startup([&config](std::ostream& log) {
     log << "DATADOG TRACER CONFIGURATION - " << config;
   });
 }
 
+// Log a summary of the tracer's overhead from the specified `metrics`.
+void log_overhead(Logger& logger, const MetricsSnapshot& metrics) {
+  const auto summary = [](const MetricsSnapshot::Histogram& histogram) {
+    // clang-format off
+    return nlohmann::json::object({
+      {"count", histogram.count},
+      {"mean_ns", histogram.mean().count()},
+      {"p50_ns", histogram.percentile(0.5).count()},
+      {"p99_ns", histogram.percentile(0.99).count()},
+    });
+    // clang-format on
+  };
+  // clang-format off
+  const auto overhead = nlohmann::json::object({
+    {"create_span", summary(metrics.create_span_duration)},
+    {"extract_span", summary(metrics.extract_span_duration)},
+    {"inject", summary(metrics.inject_duration)},
+    {"finish_span", summary(metrics.finish_span_duration)},
+    {"flush", summary(metrics.flush_duration)},
+  });
+  // clang-format on
+  logger.log_startup([&overhead](std::ostream& log) {
+    log << "DATADOG TRACER OVERHEAD - " << overhead;
+  });
+}
+
+// Return the trace segment shared by all no-op spans.  It's created the first
+// time this function is called, from the specified components of the calling
+// tracer, and it's never destroyed, since no-op spans don't own it.
+TraceSegment& noop_trace_segment(
+    const std::shared_ptr<Logger>& logger,
+    const std::shared_ptr<TraceSampler>& trace_sampler,
+    const std::shared_ptr<SpanSampler>& span_sampler,
+    const std::shared_ptr<const SpanPrototype>& prototype,
+    const std::shared_ptr<const IDGenerator>& generator,
+    const std::shared_ptr<const Clock>& clock) {
+  static TraceSegment* const segment = [&]() {
+    SamplingDecision decision;
+    decision.priority = int(SamplingPriority::USER_DROP);
+    decision.origin = SamplingDecision::Origin::LOCAL;
+    return new TraceSegment(
+        logger, std::make_shared<NullCollector>(), std::make_shared<Metrics>(),
+        false, trace_sampler, span_sampler, prototype, generator, clock,
+        PropagationStyles{}, std::nullopt /* hostname */,
+        std::nullopt /* origin */, 0 /* tags_header_max_size */,
+        std::nullopt /* partial_flush_min_spans */,
+        std::nullopt /* max_memory_bytes */, FlatMap<std::string>{},
+        decision, SpanArena{}, std::make_unique<SpanData>());
+  }();
+  return *segment;
+}
+
+// Return a recurring event callback that, whenever the modification time of
+// the specified span sampling rules `file` changes, replaces the rules of the
+// specified `span_sampler` with those in the file.  Log errors using the
+// specified `logger`.
+std::function<void()> watch_span_sampling_rules_file(
+    std::shared_ptr<SpanSampler> span_sampler, std::shared_ptr<Logger> logger,
+    std::string file) {
+  std::error_code ignored;
+  auto last_write = std::filesystem::last_write_time(file, ignored);
+  return [span_sampler = std::move(span_sampler), logger = std::move(logger),
+          file = std::move(file), last_write]() mutable {
+    std::error_code error;
+    const auto write = std::filesystem::last_write_time(file, error);
+    if (error || write == last_write) {
+      // An unreadable file keeps the current rules.
+      return;
+    }
+    last_write = write;
+    auto config = finalize_config(SpanSamplerConfig{}, *logger);
+    if (auto* config_error = config.if_error()) {
+      logger->log_error(config_error->with_prefix(
+          "Unable to reload the span sampling rules file: "));
+      return;
+    }
+    span_sampler->update(*config);
+  };
+}
+
+// Return a `TraceSegment` constructed from the specified `args`, allocated
+// from the specified `resource`, or from the global heap if it's null.
+template <typename... Args>
+std::shared_ptr<TraceSegment> make_segment(std::pmr::memory_resource* resource,
+                                           Args&&... args) {
+  if (resource) {
+    return std::allocate_shared<TraceSegment>(
+        std::pmr::polymorphic_allocator<TraceSegment>(resource),
+        std::forward<Args>(args)...);
+  }
+  return std::make_shared<TraceSegment>(std::forward<Args>(args)...);
+}
+
+// Return whether a tracer configured by the specified `config` defers its
+// startup.  A disabled tracer has nothing to defer.
+bool defers_startup(const FinalizedTracerConfig& config) {
+  return config.lazy_startup && config.report_traces;
+}
+
 }  // namespace
 
+struct Tracer::ExtractedData {
+  std::optional<TraceID> trace_id;
+  std::optional<std::uint64_t> parent_id;
+  std::optional<std::string> origin;
+  std::optional<std::string> trace_tags;
+  std::optional<int> sampling_priority;
+  // `w3c_tracestate` is the "tracestate" header of the extracted trace, whose
+  // members other than "dd" are passed on, if W3C extraction is enabled.
+  std::optional<std::string> w3c_tracestate;
+  // `ignored_error` is the error, if any, in headers that were ignored, which
+  // is logged instead of failing the extraction.
+  std::optional<Error> ignored_error;
+
+  // Return the data extracted from the specified `headers` by a `Policy`.
+  template <typename Policy>
+  static Expected<ExtractedData> extract(const DictReader& headers);
+
+  bool operator!=(const ExtractedData& other) const {
+    return trace_id != other.trace_id || parent_id != other.parent_id ||
+           origin != other.origin || trace_tags != other.trace_tags ||
+           sampling_priority != other.sampling_priority;
+  }
+};
+
+template <typename Policy>
+Expected<Tracer::ExtractedData> Tracer::ExtractedData::extract(
+    const DictReader& reader) {
+  Policy extract;
+  ExtractedData extracted_data;
+
+  auto& [trace_id, parent_id, origin, trace_tags, sampling_priority,
+         w3c_tracestate, ignored_error] = extracted_data;
+
+  auto maybe_trace_id = extract.trace_id(reader);
+  if (auto* error = maybe_trace_id.if_error()) {
+    return std::move(*error);
+  }
+  trace_id = *maybe_trace_id;
+  ignored_error = extract.ignored_error();
+
+  if (const auto found = extract.origin(reader)) {
+    origin.emplace(*found);
+  }
+
+  auto maybe_parent_id = extract.parent_id(reader);
+  if (auto* error = maybe_parent_id.if_error()) {
+    return std::move(*error);
+  }
+  parent_id = *maybe_parent_id;
+
+  auto maybe_sampling_priority = extract.sampling_priority(reader);
+  if (auto* error = maybe_sampling_priority.if_error()) {
+    return std::move(*error);
+  }
+  sampling_priority = *maybe_sampling_priority;
+
+  if (const auto found = extract.trace_tags(reader)) {
+    trace_tags.emplace(*found);
+  }
+
+  // A 128-bit trace ID whose high bits weren't in its header might have them
+  // in the "_dd.p.tid" trace tag.
+  if (trace_id && trace_id->high == 0 && trace_tags) {
+    if (const auto high = trace_id_high(*trace_tags)) {
+      trace_id->high = *high;
+    }
+  }
+
+  return extracted_data;
+}
+
+template <unsigned Styles>
+Expected<Tracer::ExtractedData> Tracer::extract_styles(
+    const DictReader& headers) {
+  ExtractedData extracted_data;
+
+  if constexpr ((Styles & extract_datadog) != 0) {
+    auto data = ExtractedData::extract<DatadogExtractionPolicy>(headers);
+    if (auto* error = data.if_error()) {
+      return std::move(*error);
+    }
+    extracted_data = std::move(*data);
+  }
+
+  if constexpr ((Styles & extract_b3) != 0) {
+    auto data = ExtractedData::extract<B3ExtractionPolicy>(headers);
+    if (auto* error = data.if_error()) {
+      return std::move(*error);
+    }
+    if constexpr ((Styles & extract_datadog) != 0) {
+      if (*data != extracted_data) {
+        // TODO: diagnose difference
+        return Error{Error::INCONSISTENT_EXTRACTION_STYLES,
+                     "B3 extracted different data than did Datadog"};
+      }
+    }
+    extracted_data = std::move(*data);
+  }
+
+  // The B3 single header and W3C styles are consulted, in that order, only if
+  // the styles before them found no trace.  Data without a trace is kept from
+  // the first style that was consulted.
+  const auto extract_fallback =
+      [&](auto policy, bool first) -> Expected<void> {
+    if (extracted_data.trace_id) {
+      return std::nullopt;
+    }
+    auto data = ExtractedData::extract<decltype(policy)>(headers);
+    if (auto* error = data.if_error()) {
+      return std::move(*error);
+    }
+    if (first || data->trace_id) {
+      extracted_data = std::move(*data);
+    } else if (data->ignored_error) {
+      extracted_data.ignored_error = std::move(data->ignored_error);
+    }
+    return std::nullopt;
+  };
+
+  if constexpr ((Styles & extract_b3_single) != 0) {
+    const bool first = (Styles & (extract_datadog | extract_b3)) == 0;
+    auto result = extract_fallback(B3SingleExtractionPolicy{}, first);
+    if (auto* error = result.if_error()) {
+      return std::move(*error);
+    }
+  }
+
+  if constexpr ((Styles & extract_w3c) != 0) {
+    const bool first = (Styles & (extract_datadog | extract_b3 |
+                                  extract_b3_single)) == 0;
+    auto result = extract_fallback(W3CExtractionPolicy{}, first);
+    if (auto* error = result.if_error()) {
+      return std::move(*error);
+    }
+    if (extracted_data.trace_id) {
+      if (const auto tracestate =
+              w3c_tracestate(headers, *extracted_data.trace_id)) {
+        extracted_data.w3c_tracestate.emplace(*tracestate);
+      }
+    }
+  }
+
+  return extracted_data;
+}
+
+Tracer::Extract Tracer::extract_function(const PropagationStyles& styles) {
+  static constexpr Extract extract_by_styles[] = {
+      &extract_styles<0>,  &extract_styles<1>,  &extract_styles<2>,
+      &extract_styles<3>,  &extract_styles<4>,  &extract_styles<5>,
+      &extract_styles<6>,  &extract_styles<7>,  &extract_styles<8>,
+      &extract_styles<9>,  &extract_styles<10>, &extract_styles<11>,
+      &extract_styles<12>, &extract_styles<13>, &extract_styles<14>,
+      &extract_styles<15>};
+  return extract_by_styles[(styles.datadog ? extract_datadog : 0) |
+                           (styles.b3 ? extract_b3 : 0) |
+                           (styles.b3_single ? extract_b3_single : 0) |
+                           (styles.w3c ? extract_w3c : 0)];
+}
+
+struct Tracer::LazyStartup {
+  FinalizedTracerConfig config;
+  IDGenerator generator;
+  Clock clock;
+  std::mutex mutex;
+  std::optional<Tracer> tracer;
+  // `started` is `&*tracer` once `tracer` has been constructed, so that the
+  // tracer can be used without locking `mutex`.
+  std::atomic<Tracer*> started{nullptr};
+
+  LazyStartup(const FinalizedTracerConfig& config, const IDGenerator& generator,
+              const Clock& clock)
+      : config(config), generator(generator), clock(clock) {}
+};
+
 Tracer::Tracer(const FinalizedTracerConfig& config)
-    : Tracer(config, default_id_generator, default_clock) {}
+    : Tracer(config, default_id_generator, config.clock) {}
 
 Tracer::Tracer(const FinalizedTracerConfig& config,
                const IDGenerator& generator, const Clock& clock)
     : logger_(config.logger),
       collector_(/* see constructor body */),
+      metrics_(/* see constructor body */),
+      overhead_metrics_(/* see constructor body */),
       trace_sampler_(
           std::make_shared<TraceSampler>(config.trace_sampler, clock)),
       span_sampler_(std::make_shared<SpanSampler>(config.span_sampler, clock)),
-      generator_(generator),
-      clock_(clock),
-      defaults_(std::make_shared<SpanDefaults>(config.defaults)),
+      generator_(std::make_shared<const IDGenerator>(generator)),
+      clock_(std::make_shared<const Clock>(clock)),
+      prototype_(std::make_shared<SpanPrototype>(config.defaults,
+                                                 config.span_limits)),
+      log_correlation_(std::make_shared<LogCorrelation>(config.defaults)),
       injection_styles_(config.injection_styles),
       extraction_styles_(config.extraction_styles),
-      hostname_(config.report_hostname ? get_hostname() : std::nullopt),
-      tags_header_max_size_(config.tags_header_size) {
+      extract_(extract_function(config.extraction_styles)),
+      hostname_(config.report_hostname && !defers_startup(config)
+                    ? get_hostname()
+                    : std::nullopt),
+      tags_header_max_size_(config.tags_header_size),
+      partial_flush_min_spans_(config.partial_flush_min_spans),
+      max_memory_bytes_(config.max_memory_bytes),
+      trace_id_128_bit_(config.trace_id_128_bit),
+      sampling_decision_at_root_(config.sampling_decision_at_root),
+      defer_span_sampling_(config.defer_span_sampling),
+      delegate_trace_sampling_(config.delegate_trace_sampling),
+      active_span_as_parent_(config.active_span_as_parent),
+      min_span_duration_(config.min_span_duration),
+      collapse_repeated_spans_threshold_(
+          config.collapse_repeated_spans_threshold),
+      compact_finished_spans_(config.compact_finished_spans),
+      compress_compacted_spans_(config.compress_compacted_spans),
+      max_spans_per_trace_(config.max_spans_per_trace),
+      span_quotas_(config.span_quotas.empty()
+                       ? nullptr
+                       : std::make_shared<SpanQuotas>(config.span_quotas,
+                                                      config.clock)),
+      memory_resource_(config.memory_resource),
+      noop_segment_(config.report_traces
+                        ? nullptr
+                        : &noop_trace_segment(logger_, trace_sampler_,
+                                              span_sampler_, prototype_,
+                                              generator_, clock_)) {
+  if (defers_startup(config)) {
+    lazy_startup_ = std::make_shared<LazyStartup>(config, generator, clock);
+    return;
+  }
   if (auto* collector =
           std::get_if<std::shared_ptr<Collector>>(&config.collector)) {
     collector_ = *collector;
+    if (const auto agent =
+            std::dynamic_pointer_cast<DatadogAgent>(*collector)) {
+      metrics_ = agent->metrics();
+    } else {
+      metrics_ = std::make_shared<Metrics>();
+    }
   } else {
     auto& agent_config =
         std::get<FinalizedDatadogAgentConfig>(config.collector);
-    collector_ =
-        std::make_shared<DatadogAgent>(agent_config, clock, config.logger);
+    metrics_ = std::make_shared<Metrics>();
+    collector_ = std::make_shared<DatadogAgent>(
+        agent_config, clock, config.logger, prototype_->defaults, metrics_);
+    if (config.overhead_profiling_enabled &&
+        config.overhead_log_interval != config.overhead_log_interval.zero()) {
+      auto cancel = agent_config.event_scheduler->schedule_recurring_event(
+          config.overhead_log_interval,
+          [logger = logger_, metrics = metrics_]() {
+            log_overhead(*logger, metrics->snapshot());
+          });
+      // The deleter is invoked even though the pointer is null.
+      overhead_log_ =
+          std::shared_ptr<void>(nullptr, [cancel = std::move(cancel)](void*) {
+            cancel();
+          });
+    }
+    if (agent_config.remote_configuration_enabled) {
+      const auto& defaults = prototype_->defaults;
+      remote_config_ = std::make_shared<RemoteConfigClient>(
+          logger_, agent_config.http_client, agent_config.url, trace_sampler_,
+          config.trace_sampler, defaults.service, defaults.environment,
+          defaults.version);
+      remote_config_->start(*agent_config.event_scheduler,
+                            agent_config.remote_configuration_poll_interval);
+    }
+  }
+  // A custom collector comes without an event scheduler, so the tracer
+  // brings its own if it needs one.
+  std::shared_ptr<EventScheduler> scheduler;
+  const auto event_scheduler = [&]() {
+    if (!scheduler) {
+      if (const auto* agent_config =
+              std::get_if<FinalizedDatadogAgentConfig>(&config.collector)) {
+        scheduler = agent_config->event_scheduler;
+      } else {
+        scheduler = std::make_shared<ThreadedEventScheduler>();
+      }
+    }
+    return scheduler;
+  };
+  if (trace_sampler_->adaptive()) {
+    auto cancel = event_scheduler()->schedule_recurring_event(
+        std::chrono::seconds(1),
+        [sampler = trace_sampler_]() { sampler->adapt(); });
+    // The deleter is invoked even though the pointer is null.
+    adaptive_sampling_ = std::shared_ptr<void>(
+        nullptr, [cancel = std::move(cancel), scheduler](void*) { cancel(); });
+  }
+  if (config.span_sampling_rules_file) {
+    auto cancel = event_scheduler()->schedule_recurring_event(
+        config.span_sampling_rules_file_poll_interval,
+        watch_span_sampling_rules_file(span_sampler_, logger_,
+                                       *config.span_sampling_rules_file));
+    rules_file_watch_ = std::shared_ptr<void>(
+        nullptr, [cancel = std::move(cancel), scheduler](void*) { cancel(); });
+  }
+  overhead_metrics_ =
+      config.overhead_profiling_enabled ? metrics_.get() : nullptr;
+  if (overhead_metrics_) {
+    calibrate_cycle_counter();
   }
 
   if (config.log_on_startup) {
     log_startup_message(*logger_, tracer_version_string, *collector_,
-                        *defaults_, *trace_sampler_, *span_sampler_,
-                        injection_styles_, extraction_styles_, hostname_,
-                        tags_header_max_size_);
+                        prototype_->defaults, prototype_->limits,
+                        *trace_sampler_, *span_sampler_, injection_styles_,
+                        extraction_styles_, hostname_, tags_header_max_size_,
+                        partial_flush_min_spans_, max_memory_bytes_,
+                        min_span_duration_,
+                        collapse_repeated_spans_threshold_,
+                        compact_finished_spans_, compress_compacted_spans_,
+                        max_spans_per_trace_, span_quotas_.get(),
+                        trace_id_128_bit_, sampling_decision_at_root_,
+                        defer_span_sampling_, delegate_trace_sampling_,
+                        active_span_as_parent_,
+                        bool(overhead_metrics_));
   }
 }
 
-Span Tracer::create_span() { return create_span(SpanConfig{}); }
+Tracer& Tracer::started() {
+  LazyStartup& startup = *lazy_startup_;
+  if (Tracer* tracer = startup.started.load(std::memory_order_acquire)) {
+    return *tracer;
+  }
+
+  std::lock_guard<std::mutex> lock(startup.mutex);
+  if (!startup.tracer) {
+    FinalizedTracerConfig& config = startup.config;
+    config.lazy_startup = false;
+    if (auto* agent_config =
+            std::get_if<FinalizedDatadogAgentConfig>(&config.collector)) {
+      auto created = create_deferred_components(*agent_config, config.logger);
+      if (auto* error = created.if_error()) {
+        config.logger->log_error(
+            error->with_prefix("Unable to start the tracer: "));
+        config.collector = std::make_shared<NullCollector>();
+      }
+    }
+    startup.tracer.emplace(config, startup.generator, startup.clock);
+    startup.started.store(&*startup.tracer, std::memory_order_release);
+  }
+  return *startup.tracer;
+}
+
+Span Tracer::create_span() {
+  if (noop_segment_) {
+    // Skip constructing a `SpanConfig`.
+    return Span::noop(*noop_segment_);
+  }
+  return create_span(SpanConfig{});
+}
 
 Span Tracer::create_span(const SpanConfig& config) {
-  auto span_data = std::make_unique<SpanData>();
-  span_data->apply_config(*defaults_, config, clock_);
-  span_data->span_id = generator_();
-  span_data->trace_id = span_data->span_id;
+  return create_span_from(config);
+}
+
+Span Tracer::create_span(const SpanConfigView& config) {
+  return create_span_from(config);
+}
+
+template <typename Config>
+Span Tracer::create_span_from(const Config& config) {
+  if (noop_segment_) {
+    return Span::noop(*noop_segment_);
+  }
+  if (lazy_startup_) {
+    return started().create_span_from(config);
+  }
+  if (remote_config_ && !remote_config_->tracing_enabled()) {
+    return Span::noop(noop_trace_segment(logger_, trace_sampler_,
+                                         span_sampler_, prototype_,
+                                         generator_, clock_));
+  }
+  if (active_span_as_parent_) {
+    if (const Span* parent = active_span()) {
+      return parent->create_child(config);
+    }
+  }
+  const OverheadTimer timer{overhead_metrics_, Metrics::CREATE_SPAN_DURATION};
+  SpanArena arena{memory_resource_};
+  std::unique_ptr<SpanData> span_data{new (arena) SpanData};
+  span_data->apply_config(*prototype_, config, *clock_);
+  span_data->span_id = (*generator_)();
+  span_data->trace_id = TraceID{span_data->span_id};
   span_data->parent_id = 0;
 
+  FlatMap<std::string> trace_tags;
+  if (trace_id_128_bit_) {
+    // The high bits are the 32-bit Unix time in seconds, followed by zeros.
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(
+                             span_data->start.wall.time_since_epoch())
+                             .count();
+    span_data->trace_id.high = std::uint64_t(std::uint32_t(seconds)) << 32;
+    trace_tags.insert_or_assign(tags::internal::trace_id_high,
+                                hex_padded(span_data->trace_id.high));
+  }
+
   const auto span_data_ptr = span_data.get();
-  const auto segment = std::make_shared<TraceSegment>(
-      logger_, collector_, trace_sampler_, span_sampler_, defaults_,
+  const auto segment = make_segment(
+      memory_resource_, logger_, collector_, metrics_, bool(overhead_metrics_),
+      trace_sampler_, span_sampler_, prototype_, generator_, clock_,
       injection_styles_, hostname_, std::nullopt /* origin */,
-      tags_header_max_size_,
-      std::unordered_map<std::string, std::string>{} /* trace_tags */,
-      std::nullopt /* sampling_decision */, std::move(span_data));
-  Span span{span_data_ptr, segment, generator_, clock_};
+      tags_header_max_size_, partial_flush_min_spans_, max_memory_bytes_,
+      std::move(trace_tags), std::nullopt /* sampling_decision */,
+      std::move(arena), std::move(span_data));
+  if (config.single_threaded) {
+    segment->single_threaded();
+  }
+  if (defer_span_sampling_) {
+    segment->defer_span_sampling();
+  }
+  if (min_span_duration_) {
+    segment->filter_spans_shorter_than(*min_span_duration_);
+  }
+  if (collapse_repeated_spans_threshold_) {
+    segment->collapse_repeated_spans(*collapse_repeated_spans_threshold_);
+  }
+  if (compact_finished_spans_) {
+    segment->compact_finished_spans(*compact_finished_spans_,
+                                    compress_compacted_spans_);
+  }
+  if (max_spans_per_trace_) {
+    segment->limit_spans(*max_spans_per_trace_);
+  }
+  if (span_quotas_) {
+    segment->enforce_span_quotas(span_quotas_);
+  }
+  if (delegate_trace_sampling_) {
+    segment->delegate_sampling();
+  }
+  if (sampling_decision_at_root_) {
+    segment->make_sampling_decision_at_root();
+  }
+  Span span{span_data_ptr, segment};
   return span;
 }
 
@@ -303,41 +1106,49 @@ Expected<Span> Tracer::extract_span(const DictReader& reader) {
 
 Expected<Span> Tracer::extract_span(const DictReader& reader,
                                     const SpanConfig& config) {
-  assert(extraction_styles_.datadog || extraction_styles_.b3);
+  return extract_span_from(reader, config);
+}
 
-  std::optional<ExtractedData> extracted_data;
-  const char* extracted_by;
+Expected<Span> Tracer::extract_span(const DictReader& reader,
+                                    const SpanConfigView& config) {
+  return extract_span_from(reader, config);
+}
 
-  if (extraction_styles_.datadog) {
-    DatadogExtractionPolicy extract;
-    auto data = extract_data(extract, reader);
-    if (auto* error = data.if_error()) {
-      return std::move(*error);
-    }
-    extracted_data = *data;
-    extracted_by = "Datadog";
+template <typename Config>
+Expected<Span> Tracer::extract_span_from(const DictReader& reader,
+                                         const Config& config) {
+  if (noop_segment_) {
+    return Span::noop(*noop_segment_);
   }
+  if (lazy_startup_) {
+    return started().extract_span_from(reader, config);
+  }
+  if (remote_config_ && !remote_config_->tracing_enabled()) {
+    return Span::noop(noop_trace_segment(logger_, trace_sampler_,
+                                         span_sampler_, prototype_,
+                                         generator_, clock_));
+  }
+  const OverheadTimer timer{overhead_metrics_, Metrics::EXTRACT_SPAN_DURATION};
+  assert(extraction_styles_.datadog || extraction_styles_.b3 ||
+         extraction_styles_.b3_single || extraction_styles_.w3c);
 
-  if (extraction_styles_.b3) {
-    B3ExtractionPolicy extract;
-    auto data = extract_data(extract, reader);
-    if (auto* error = data.if_error()) {
-      return std::move(*error);
-    }
-    if (extracted_data && *data != *extracted_data) {
-      std::string message;
-      message += "B3 extracted different data than did ";
-      message += extracted_by;
-      // TODO: diagnose difference
-      return Error{Error::INCONSISTENT_EXTRACTION_STYLES, std::move(message)};
-    }
-    extracted_data = *data;
-    extracted_by = "B3";
+  // If the reader prefers it, read all of the relevant headers in one pass,
+  // and then extract from those.
+  std::optional<IndexedDictReader> visited;
+  if (reader.prefer_visit()) {
+    visited.emplace(reader);
   }
+  const DictReader& headers = visited ? *visited : reader;
 
-  assert(extracted_data);
-  auto& [trace_id, parent_id, origin, trace_tags, sampling_priority] =
-      *extracted_data;
+  auto extracted_data = extract_(headers);
+  if (auto* error = extracted_data.if_error()) {
+    return std::move(*error);
+  }
+  auto& [trace_id, parent_id, origin, trace_tags, sampling_priority,
+         w3c_tracestate, ignored_error] = *extracted_data;
+  if (ignored_error) {
+    logger_->log_error(*ignored_error);
+  }
 
   // Some information might be missing.
   // Here are the combinations considered:
@@ -369,7 +1180,7 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
     std::string message;
     message +=
         "There's no parent span ID to extract, but there is a trace ID: ";
-    message += std::to_string(*trace_id);
+    message += trace_id->hex_padded();
     return Error{Error::MISSING_PARENT_SPAN_ID, std::move(message)};
   }
 
@@ -385,14 +1196,21 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
   assert(parent_id);
   assert(trace_id);
 
-  auto span_data = std::make_unique<SpanData>();
-  span_data->apply_config(*defaults_, config, clock_);
-  span_data->span_id = generator_();
+  SpanArena arena{memory_resource_};
+  std::unique_ptr<SpanData> span_data{new (arena) SpanData};
+  span_data->apply_config(*prototype_, config, *clock_);
+  span_data->span_id = (*generator_)();
   span_data->trace_id = *trace_id;
   span_data->parent_id = *parent_id;
 
+  // A service that delegates the sampling decision still propagates a
+  // provisional sampling priority, which is then ignored here, so that the
+  // decision is made by this segment and returned in the response (see
+  // `TraceSegment::write_sampling_delegation_response`).
+  const bool delegation_requested =
+      bool(headers.lookup("x-datadog-delegate-trace-sampling"));
   std::optional<SamplingDecision> sampling_decision;
-  if (sampling_priority) {
+  if (sampling_priority && !delegation_requested) {
     SamplingDecision decision;
     decision.priority = *sampling_priority;
     // `decision.mechanism` is null.  We might be able to infer it once we
@@ -402,31 +1220,138 @@ Expected<Span> Tracer::extract_span(const DictReader& reader,
     sampling_decision = decision;
   }
 
-  std::unordered_map<std::string, std::string> decoded_trace_tags;
+  FlatMap<std::string> decoded_trace_tags;
   if (trace_tags) {
-    auto maybe_trace_tags = decode_tags(*trace_tags);
-    if (auto* error = maybe_trace_tags.if_error()) {
-      logger_->log_error(*error);
+    // Only the "_dd.p.*" tags are kept, so decode into views and copy only
+    // those.  The error, if any, is formatted only if the logger writes it.
+    auto result = decode_tags(
+        *trace_tags, [&](std::string_view key, std::string_view value) {
+          if (starts_with(key, "_dd.p.")) {
+            decoded_trace_tags.insert_or_assign(key, std::string(value));
+          }
+        });
+    if (auto* error = result.if_error()) {
+      logger_->log_error([&](std::ostream& log) { log << *error; });
       span_data->tags[tags::internal::propagation_error] = "decoding_error";
-    } else {
-      for (const auto& [key, value] : *maybe_trace_tags) {
-        if (starts_with(key, "_dd.p.")) {
-          decoded_trace_tags.insert_or_assign(key, value);
-        }
-      }
     }
   }
+  // "_dd.p.tid" is propagated only as the high bits of the trace ID, so that
+  // a malformed tag, or one that disagrees with a 128-bit B3 trace ID, isn't
+  // passed on.
+  if (trace_id->high) {
+    decoded_trace_tags.insert_or_assign(tags::internal::trace_id_high,
+                                        hex_padded(trace_id->high));
+  } else {
+    decoded_trace_tags.erase(tags::internal::trace_id_high);
+  }
 
   const auto span_data_ptr = span_data.get();
-  const auto segment = std::make_shared<TraceSegment>(
-      logger_, collector_, trace_sampler_, span_sampler_, defaults_,
+  const auto segment = make_segment(
+      memory_resource_, logger_, collector_, metrics_, bool(overhead_metrics_),
+      trace_sampler_, span_sampler_, prototype_, generator_, clock_,
       injection_styles_, hostname_, std::move(origin), tags_header_max_size_,
+      partial_flush_min_spans_, max_memory_bytes_,
       std::move(decoded_trace_tags), std::move(sampling_decision),
-      std::move(span_data));
-  Span span{span_data_ptr, segment, generator_, clock_};
+      std::move(arena), std::move(span_data));
+  if (config.single_threaded) {
+    segment->single_threaded();
+  }
+  if (defer_span_sampling_) {
+    segment->defer_span_sampling();
+  }
+  if (min_span_duration_) {
+    segment->filter_spans_shorter_than(*min_span_duration_);
+  }
+  if (collapse_repeated_spans_threshold_) {
+    segment->collapse_repeated_spans(*collapse_repeated_spans_threshold_);
+  }
+  if (compact_finished_spans_) {
+    segment->compact_finished_spans(*compact_finished_spans_,
+                                    compress_compacted_spans_);
+  }
+  if (max_spans_per_trace_) {
+    segment->limit_spans(*max_spans_per_trace_);
+  }
+  if (span_quotas_) {
+    segment->enforce_span_quotas(span_quotas_);
+  }
+  if (delegate_trace_sampling_) {
+    segment->delegate_sampling();
+  }
+  if (delegation_requested) {
+    segment->sampling_delegation_requested();
+  }
+  if (w3c_tracestate && injection_styles_.w3c) {
+    segment->pass_on_tracestate(std::move(*w3c_tracestate));
+  }
+  if (sampling_decision_at_root_) {
+    segment->make_sampling_decision_at_root();
+  }
+  Span span{span_data_ptr, segment};
   return span;
 }
 
+Expected<bool> Tracer::propagate(const DictReader& reader, DictWriter& writer,
+                                 bool new_span_id) {
+  if (noop_segment_) {
+    return false;
+  }
+  if (lazy_startup_) {
+    return started().propagate(reader, writer, new_span_id);
+  }
+  if (remote_config_ && !remote_config_->tracing_enabled()) {
+    return false;
+  }
+
+  std::optional<IndexedDictReader> visited;
+  if (reader.prefer_visit()) {
+    visited.emplace(reader);
+  }
+  const DictReader& headers = visited ? *visited : reader;
+
+  // The first style that has a trace ID is passed on.  The policies are kept
+  // here, since `context` might refer to them.
+  InjectedContext context;
+  DatadogExtractionPolicy datadog;
+  B3ExtractionPolicy b3;
+  B3SingleExtractionPolicy b3_single;
+  W3CExtractionPolicy w3c;
+  Expected<bool> found = false;
+  const auto consult = [&](bool enabled, auto& policy) {
+    if (enabled && found && !*found) {
+      found = extract_context(policy, headers, context);
+    }
+  };
+  consult(extraction_styles_.datadog, datadog);
+  consult(extraction_styles_.b3, b3);
+  consult(extraction_styles_.b3_single, b3_single);
+  consult(extraction_styles_.w3c, w3c);
+  if (const auto ignored_error = w3c.ignored_error()) {
+    logger_->log_error(*ignored_error);
+  }
+  if (auto* error = found.if_error()) {
+    return std::move(*error);
+  }
+  if (!*found) {
+    return false;
+  }
+  if (extraction_styles_.w3c) {
+    if (const auto tracestate = w3c_tracestate(headers, context.trace_id)) {
+      context.w3c_tracestate = *tracestate;
+    }
+  }
+
+  if (new_span_id) {
+    context.span_id = (*generator_)();
+  }
+  context.trace_tags_too_large =
+      context.trace_tags.size() > tags_header_max_size_;
+  context.delegate_sampling =
+      bool(headers.lookup("x-datadog-delegate-trace-sampling"));
+  inject_trace_context(writer, injection_styles_, context);
+  return true;
+}
+
 Expected<Span> Tracer::extract_or_create_span(const DictReader& reader) {
   return extract_or_create_span(reader, SpanConfig{});
 }
@@ -440,5 +1365,72 @@ Expected<Span> Tracer::extract_or_create_span(const DictReader& reader,
   return maybe_span;
 }
 
+Expected<Span> Tracer::extract_or_create_span(const DictReader& reader,
+                                              const SpanConfigView& config) {
+  auto maybe_span = extract_span(reader, config);
+  if (!maybe_span && maybe_span.error().code == Error::NO_SPAN_TO_EXTRACT) {
+    return create_span(config);
+  }
+  return maybe_span;
+}
+
+Expected<void> Tracer::update_sampling(const TraceSamplerConfig& trace_sampler,
+                                       const SpanSamplerConfig& span_sampler) {
+  auto trace_config = finalize_config(trace_sampler);
+  if (auto* error = trace_config.if_error()) {
+    return std::move(*error);
+  }
+  auto span_config = finalize_config(span_sampler, *logger_);
+  if (auto* error = span_config.if_error()) {
+    return std::move(*error);
+  }
+
+  Tracer* tracer = this;
+  if (lazy_startup_) {
+    LazyStartup& startup = *lazy_startup_;
+    std::lock_guard<std::mutex> lock(startup.mutex);
+    if (!startup.tracer) {
+      // The tracer will start with the new configuration.
+      startup.config.trace_sampler = std::move(*trace_config);
+      startup.config.span_sampler = std::move(*span_config);
+      return std::nullopt;
+    }
+    tracer = &*startup.tracer;
+  }
+  if (tracer->remote_config_) {
+    // Remote configuration overrides the new configuration.
+    tracer->remote_config_->update_base(*trace_config);
+  } else {
+    tracer->trace_sampler_->update(*trace_config);
+  }
+  tracer->span_sampler_->update(*span_config);
+  return std::nullopt;
+}
+
+Expected<void> Tracer::flush(std::chrono::steady_clock::time_point deadline) {
+  if (lazy_startup_) {
+    // A tracer that hasn't started has no traces to flush.
+    Tracer* tracer = lazy_startup_->started.load(std::memory_order_acquire);
+    if (!tracer) {
+      return std::nullopt;
+    }
+    return tracer->flush(deadline);
+  }
+  return collector_->flush(deadline);
+}
+
+MetricsSnapshot Tracer::metrics() const {
+  if (lazy_startup_) {
+    const Tracer* tracer =
+        lazy_startup_->started.load(std::memory_order_acquire);
+    return tracer ? tracer->metrics() : MetricsSnapshot{};
+  }
+  return metrics_->snapshot();
+}
+
+const LogCorrelation& Tracer::log_correlation() const {
+  return *log_correlation_;
+}
+
 }  // namespace tracing
 }  // namespace datadog
@@ -9,13 +9,47 @@
 // `Tracer` is instantiated with a `FinalizedTracerConfig`, which can be
 // obtained from a `TracerConfig` via the `finalize_config` function.  See
 // `tracer_config.h`.
+//
+// If `TracerConfig::report_traces` is `false`, then the tracer is disabled,
+// and `create_span` and `extract_span` return no-op spans (see `span.h`)
+// without consulting the configuration, the samplers, or the extracted
+// context.
+//
+// `Tracer` counts the spans that it creates, and other events in its
+// operation, in a `Metrics` (see `metrics.h`).  `metrics` returns a snapshot
+// of the counts.  If overhead profiling is enabled, then the counts include
+// the time spent in the tracer's operations.  See
+// `TracerConfig::overhead_profiling_enabled`.
+//
+// If `TracerConfig::lazy_startup` is `true`, then constructing a `Tracer` only
+// keeps a copy of its configuration.  The first `create_span`, `extract_span`,
+// or `extract_or_create_span` starts the tracer, and all copies of the tracer
+// then share it.  Until then, `flush` has nothing to do and `metrics` counts
+// nothing.
+//
+// A proxy that forwards requests without tracing them can instead pass on their
+// trace context with `propagate`, which extracts the context and injects it
+// again without creating a span or a trace segment, and so without the
+// samplers or the collector.
+//
+// `update_sampling` replaces the tracer's trace sampling and span sampling
+// rules while it's running, without a new `Tracer`, so without new threads
+// and without losing buffered traces.  Traces that are open at the time
+// remain valid, and are sampled by the new rules if they have yet to be
+// sampled.  The span sampling rules file can also be watched for changes.  See
+// `TracerConfig::span_sampling_rules_file_poll_interval_milliseconds`.
 
+#include <chrono>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 
 #include "clock.h"
 #include "error.h"
 #include "expected.h"
 #include "id_generator.h"
+#include "log_correlation.h"
+#include "metrics.h"
 #include "span.h"
 #include "tracer_config.h"
 
@@ -23,22 +57,96 @@ namespace datadog {
 namespace tracing {
 
 class DictReader;
+class DictWriter;
 struct SpanConfig;
+struct SpanConfigView;
+struct SpanPrototype;
+class RemoteConfigClient;
 class TraceSampler;
+class TraceSegment;
+class SpanQuotas;
 class SpanSampler;
 
 class Tracer {
   std::shared_ptr<Logger> logger_;
   std::shared_ptr<Collector> collector_;
+  // `metrics_` is shared with the `TraceSegment`s and with the collector, if
+  // it's a `DatadogAgent`.
+  std::shared_ptr<Metrics> metrics_;
+  // `overhead_metrics_` is `metrics_` if overhead profiling is enabled, and
+  // otherwise is null.  `overhead_log_` cancels the periodic overhead log
+  // when the last copy of this tracer is destroyed.
+  Metrics* overhead_metrics_;
+  std::shared_ptr<void> overhead_log_;
+  // `adaptive_sampling_` cancels the periodic adjustment of adaptive sample
+  // rates, if configured, when the last copy of this tracer is destroyed.
+  std::shared_ptr<void> adaptive_sampling_;
+  // `rules_file_watch_` likewise cancels the watching of the span sampling
+  // rules file, if configured.
+  std::shared_ptr<void> rules_file_watch_;
+  // `remote_config_` polls the Datadog Agent for remote configuration, if
+  // enabled, until the last copy of this tracer is destroyed.
+  std::shared_ptr<RemoteConfigClient> remote_config_;
   std::shared_ptr<TraceSampler> trace_sampler_;
   std::shared_ptr<SpanSampler> span_sampler_;
-  IDGenerator generator_;
-  Clock clock_;
-  std::shared_ptr<const SpanDefaults> defaults_;
+  // `generator_` and `clock_` are shared with the `TraceSegment`s, so that
+  // spans refer to them instead of copying them.
+  std::shared_ptr<const IDGenerator> generator_;
+  std::shared_ptr<const Clock> clock_;
+  std::shared_ptr<const SpanPrototype> prototype_;
+  std::shared_ptr<const LogCorrelation> log_correlation_;
   PropagationStyles injection_styles_;
   PropagationStyles extraction_styles_;
+  // `extract_` reads the trace context of `extract_span` using the styles of
+  // `extraction_styles_`.  It's the instantiation of `extract_styles` for
+  // those styles, chosen once at construction, so that extraction doesn't
+  // check which styles are enabled.
+  struct ExtractedData;
+  using Extract = Expected<ExtractedData> (*)(const DictReader&);
+  Extract extract_;
   std::optional<std::string> hostname_;
   std::size_t tags_header_max_size_;
+  std::optional<std::size_t> partial_flush_min_spans_;
+  std::optional<std::size_t> max_memory_bytes_;
+  bool trace_id_128_bit_;
+  bool sampling_decision_at_root_;
+  bool defer_span_sampling_;
+  bool delegate_trace_sampling_;
+  bool active_span_as_parent_;
+  std::optional<std::chrono::steady_clock::duration> min_span_duration_;
+  std::optional<std::size_t> collapse_repeated_spans_threshold_;
+  std::optional<std::size_t> compact_finished_spans_;
+  bool compress_compacted_spans_;
+  std::optional<std::size_t> max_spans_per_trace_;
+  // `span_quotas_` is null if no span quotas are configured.
+  std::shared_ptr<SpanQuotas> span_quotas_;
+  // `memory_resource_` is where trace segments and their spans are allocated,
+  // or null for the global heap.
+  std::pmr::memory_resource* memory_resource_;
+  // `noop_segment_` is the trace segment of the no-op spans created if the
+  // tracer is disabled, and otherwise is null.  See `span.h`.
+  TraceSegment* noop_segment_;
+  // `lazy_startup_` is not null if the tracer defers its startup.  Then the
+  // members above are unused, and the tracer forwards to the `Tracer` that
+  // `lazy_startup_` creates once.
+  struct LazyStartup;
+  std::shared_ptr<LazyStartup> lazy_startup_;
+
+  // Return the started tracer that this tracer forwards to, starting it if
+  // necessary.
+  Tracer& started();
+
+  // `Config` is either `SpanConfig` or `SpanConfigView`.
+  template <typename Config>
+  Span create_span_from(const Config& config);
+  template <typename Config>
+  Expected<Span> extract_span_from(const DictReader& reader,
+                                   const Config& config);
+
+  // `Styles` is a set of bits, one per extraction style.  See `tracer.cpp`.
+  template <unsigned Styles>
+  static Expected<ExtractedData> extract_styles(const DictReader& headers);
+  static Extract extract_function(const PropagationStyles& styles);
 
  public:
   // Create a tracer configured using the specified `config`, and optionally:
@@ -49,18 +157,28 @@ class Tracer {
          const Clock& clock);
 
   // Create a new trace and return the root span of the trace.  Optionally
-  // specify a `config` indicating the attributes of the root span.
+  // specify a `config` indicating the attributes of the root span.  A
+  // `SpanConfigView` need only outlive the call (see `span_config.h`).  If
+  // `TracerConfig::active_span_as_parent` is `true` and the calling thread
+  // has an active span (see `active_span.h`), then instead return a child of
+  // the active span.
   Span create_span();
   Span create_span(const SpanConfig& config);
+  Span create_span(const SpanConfigView& config);
 
   // Return a span whose parent and other context is parsed from the specified
   // `reader`, and whose attributes are determined by the optionally specified
   // `config`.  If there is no tracing information in `reader`, then return an
   // error with code `Error::NO_SPAN_TO_EXTRACT`.  If a failure occurs, then
-  // return an error with some other code.
+  // return an error with some other code.  A malformed "traceparent" header
+  // is logged and otherwise ignored, as the W3C specification requires.  The
+  // members of the "tracestate" header other than "dd" are passed on when
+  // the span's trace context is injected.
   Expected<Span> extract_span(const DictReader& reader);
   Expected<Span> extract_span(const DictReader& reader,
                               const SpanConfig& config);
+  Expected<Span> extract_span(const DictReader& reader,
+                              const SpanConfigView& config);
 
   // Return a span extracted from the specified `reader` (see `extract_span`).
   // If there is no span to extract, then return a span that is the root of a
@@ -70,6 +188,52 @@ class Tracer {
   Expected<Span> extract_or_create_span(const DictReader& reader);
   Expected<Span> extract_or_create_span(const DictReader& reader,
                                         const SpanConfig& config);
+  Expected<Span> extract_or_create_span(const DictReader& reader,
+                                        const SpanConfigView& config);
+
+  // Extract the trace context from the specified `reader` using the
+  // extraction styles, and inject it into the specified `writer` using the
+  // injection styles, without creating a span.  If the optionally specified
+  // `new_span_id` is `true`, then the injected parent span ID is a new ID,
+  // as though this service had a span, rather than the extracted one.  Return
+  // whether there was trace context to propagate, or return an error if it is
+  // malformed.  Of the extraction styles, the first that has a trace ID (in
+  // the order of `PropagationStyles`) is propagated, and the styles aren't
+  // checked for agreement.  The sampling priority, origin, and trace tags are
+  // passed on as received, including an absent sampling priority, which
+  // leaves the decision to the receiver, as are the members of "tracestate"
+  // other than "dd".  As in `extract_span`, a malformed "traceparent" is
+  // logged and otherwise ignored.  `propagate` doesn't allocate,
+  // except to report an error, or as `writer` does.  If the tracer is
+  // disabled, then it injects nothing and returns `false`.
+  Expected<bool> propagate(const DictReader& reader, DictWriter& writer,
+                           bool new_span_id = false);
+
+  // Send the trace segments that have finished but that are still buffered
+  // by the collector, and wait until they have been delivered or until the
+  // specified `deadline`, whichever is first.  Return an error with code
+  // `Error::FLUSH_TIMEOUT` if the deadline passed first.  Spans that have not
+  // yet finished are not flushed.  `flush` doesn't create any threads, so
+  // it's suitable for sending traces at the end of each invocation of a
+  // short-lived job, without destroying the tracer.
+  Expected<void> flush(std::chrono::steady_clock::time_point deadline);
+
+  // Replace this tracer's sampling rules with those of the specified
+  // `trace_sampler` and `span_sampler` configurations, to which environment
+  // variables apply as in `finalize_config`.  The adaptive sampling
+  // configuration is not changed.  If either configuration is invalid, then
+  // return an error and change neither.
+  Expected<void> update_sampling(const TraceSamplerConfig& trace_sampler,
+                                 const SpanSamplerConfig& span_sampler);
+
+  // Return a snapshot of this tracer's health metrics.  If the collector is a
+  // `DatadogAgent`, then the snapshot includes the `DatadogAgent`'s metrics,
+  // and also the spans of the other tracers that share it, if any.
+  MetricsSnapshot metrics() const;
+
+  // Return the formatter of the fields that correlate log records with this
+  // tracer's spans.  See `log_correlation.h`.
+  const LogCorrelation& log_correlation() const;
 };
 
 }  // namespace tracing
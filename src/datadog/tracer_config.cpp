@@ -5,12 +5,12 @@
 #include <cstddef>
 #include <string>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
 #include "cerr_logger.h"
 #include "datadog_agent.h"
 #include "environment.h"
+#include "gzip.h"
 #include "null_collector.h"
 #include "parse_util.h"
 
@@ -23,12 +23,6 @@ void to_lower(std::string &text) {
                  [](unsigned char ch) { return std::tolower(ch); });
 }
 
-bool falsy(std::string_view text) {
-  auto lower = std::string{text};
-  to_lower(lower);
-  return lower == "0" || lower == "false" || lower == "no";
-}
-
 // List items are separated by an optional comma (",") and any amount of
 // whitespace.
 // Leading and trailing whitespace is ignored.
@@ -78,13 +72,19 @@ Expected<PropagationStyles> parse_propagation_styles(std::string_view input) {
       styles.datadog = true;
     } else if (token == "b3") {
       styles.b3 = true;
+    } else if (token == "b3single") {
+      styles.b3_single = true;
+    } else if (token == "tracecontext") {
+      styles.w3c = true;
     } else {
       std::string message;
       message += "Unsupported propagation style \"";
       message += token;
       message += "\" in list \"";
       message += input;
-      message += "\".  The following styles are supported: Datadog, B3.";
+      message +=
+          "\".  The following styles are supported: Datadog, B3, "
+          "b3single, tracecontext.";
       return Error{Error::UNKNOWN_PROPAGATION_STYLE, std::move(message)};
     }
   }
@@ -92,9 +92,8 @@ Expected<PropagationStyles> parse_propagation_styles(std::string_view input) {
   return styles;
 }
 
-Expected<std::unordered_map<std::string, std::string>> parse_tags(
-    std::string_view input) {
-  std::unordered_map<std::string, std::string> tags;
+Expected<FlatMap<std::string>> parse_tags(std::string_view input) {
+  FlatMap<std::string> tags;
 
   // Within a tag, the key and value are separated by a colon (":").
   for (const std::string_view &token : parse_list(input)) {
@@ -152,6 +151,16 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &config) {
     result.defaults.tags = std::move(*tags);
   }
 
+  const SpanLimits &limits = config.span_limits;
+  if (limits.max_resource_bytes == std::size_t(0) ||
+      limits.max_tag_name_bytes == std::size_t(0) ||
+      limits.max_tag_value_bytes == std::size_t(0)) {
+    return Error{Error::INVALID_SPAN_LIMITS,
+                 "The maximum sizes of resource names, tag names, and tag "
+                 "values must be positive."};
+  }
+  result.span_limits = limits;
+
   if (config.logger) {
     result.logger = config.logger;
   } else {
@@ -163,15 +172,22 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &config) {
     result.log_on_startup = !falsy(*startup_env);
   }
 
+  result.lazy_startup = config.lazy_startup;
+  if (auto lazy_env = lookup(environment::DD_TRACE_LAZY_STARTUP)) {
+    result.lazy_startup = !falsy(*lazy_env);
+  }
+
   bool report_traces = config.report_traces;
   if (auto enabled_env = lookup(environment::DD_TRACE_ENABLED)) {
     report_traces = !falsy(*enabled_env);
   }
 
+  result.report_traces = report_traces;
   if (!report_traces) {
     result.collector = std::make_shared<NullCollector>();
   } else if (!config.collector) {
-    auto finalized = finalize_config(config.agent, result.logger);
+    auto finalized =
+        finalize_config(config.agent, result.logger, result.lazy_startup);
     if (auto *error = finalized.if_error()) {
       return std::move(*error);
     }
@@ -219,10 +235,14 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &config) {
     result.injection_styles = *styles;
   }
 
-  if (!result.extraction_styles.datadog && !result.extraction_styles.b3) {
+  if (!result.extraction_styles.datadog && !result.extraction_styles.b3 &&
+      !result.extraction_styles.b3_single && !result.extraction_styles.w3c) {
     return Error{Error::MISSING_SPAN_EXTRACTION_STYLE,
                  "At least one extraction style must be specified."};
-  } else if (!result.injection_styles.datadog && !result.injection_styles.b3) {
+  } else if (!result.injection_styles.datadog &&
+             !result.injection_styles.b3 &&
+             !result.injection_styles.b3_single &&
+             !result.injection_styles.w3c) {
     return Error{Error::MISSING_SPAN_INJECTION_STYLE,
                  "At least one injection style must be specified."};
   }
@@ -230,6 +250,222 @@ Expected<FinalizedTracerConfig> finalize_config(const TracerConfig &config) {
   result.report_hostname = config.report_hostname;
   result.tags_header_size = config.tags_header_size;
 
+  bool partial_flush_enabled = config.partial_flush_enabled;
+  if (auto enabled_env = lookup(environment::DD_TRACE_PARTIAL_FLUSH_ENABLED)) {
+    partial_flush_enabled = !falsy(*enabled_env);
+  }
+  std::size_t partial_flush_min_spans = config.partial_flush_min_spans;
+  if (auto min_spans_env =
+          lookup(environment::DD_TRACE_PARTIAL_FLUSH_MIN_SPANS)) {
+    auto min_spans = parse_uint64(*min_spans_env, 10);
+    if (auto *error = min_spans.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_PARTIAL_FLUSH_MIN_SPANS);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    partial_flush_min_spans = std::size_t(*min_spans);
+  }
+  if (partial_flush_enabled) {
+    if (partial_flush_min_spans == 0) {
+      return Error{Error::INVALID_PARTIAL_FLUSH_MIN_SPANS,
+                   "The minimum number of spans for a partial flush must be "
+                   "positive."};
+    }
+    result.partial_flush_min_spans = partial_flush_min_spans;
+  }
+
+  result.max_memory_bytes = config.max_memory_bytes;
+  if (auto max_bytes_env = lookup(environment::DD_TRACE_MAX_MEMORY_BYTES)) {
+    auto max_bytes = parse_uint64(*max_bytes_env, 10);
+    if (auto *error = max_bytes.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_MAX_MEMORY_BYTES);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    result.max_memory_bytes = std::size_t(*max_bytes);
+  }
+  if (result.max_memory_bytes == std::size_t(0)) {
+    return Error{Error::INVALID_MAX_MEMORY_BYTES,
+                 "The maximum memory of buffered trace data must be positive."};
+  }
+
+  result.trace_id_128_bit = config.trace_id_128_bit;
+  if (auto enabled_env =
+          lookup(environment::DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED)) {
+    result.trace_id_128_bit = !falsy(*enabled_env);
+  }
+
+  result.sampling_decision_at_root = config.sampling_decision_at_root;
+  if (auto at_root_env =
+          lookup(environment::DD_TRACE_SAMPLING_DECISION_AT_ROOT)) {
+    result.sampling_decision_at_root = !falsy(*at_root_env);
+  }
+
+  result.defer_span_sampling = config.defer_span_sampling;
+  if (auto defer_env = lookup(environment::DD_TRACE_DEFER_SPAN_SAMPLING)) {
+    result.defer_span_sampling = !falsy(*defer_env);
+  }
+
+  result.delegate_trace_sampling = config.delegate_trace_sampling;
+  if (auto delegate_env = lookup(environment::DD_TRACE_DELEGATE_SAMPLING)) {
+    result.delegate_trace_sampling = !falsy(*delegate_env);
+  }
+
+  result.active_span_as_parent = config.active_span_as_parent;
+  if (auto active_env = lookup(environment::DD_TRACE_ACTIVE_SPAN_AS_PARENT)) {
+    result.active_span_as_parent = !falsy(*active_env);
+  }
+
+  std::optional<std::uint64_t> min_span_duration_microseconds =
+      config.min_span_duration_microseconds;
+  if (auto min_duration_env =
+          lookup(environment::DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS)) {
+    auto microseconds = parse_uint64(*min_duration_env, 10);
+    if (auto *error = microseconds.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    min_span_duration_microseconds = *microseconds;
+  }
+  if (min_span_duration_microseconds && *min_span_duration_microseconds) {
+    result.min_span_duration =
+        std::chrono::microseconds(*min_span_duration_microseconds);
+  }
+
+  result.collapse_repeated_spans_threshold =
+      config.collapse_repeated_spans_threshold;
+  if (auto threshold_env =
+          lookup(environment::DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD)) {
+    auto threshold = parse_uint64(*threshold_env, 10);
+    if (auto *error = threshold.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    result.collapse_repeated_spans_threshold = std::size_t(*threshold);
+  }
+  if (result.collapse_repeated_spans_threshold &&
+      *result.collapse_repeated_spans_threshold < 2) {
+    return Error{Error::INVALID_COLLAPSE_REPEATED_SPANS_THRESHOLD,
+                 "The number of repeated spans at which they're collapsed "
+                 "must be at least two."};
+  }
+
+  result.compact_finished_spans = config.compact_finished_spans;
+  if (auto compact_env = lookup(environment::DD_TRACE_COMPACT_FINISHED_SPANS)) {
+    auto compact = parse_uint64(*compact_env, 10);
+    if (auto *error = compact.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_COMPACT_FINISHED_SPANS);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    result.compact_finished_spans = std::size_t(*compact);
+  }
+  if (result.compact_finished_spans && *result.compact_finished_spans < 1) {
+    return Error{Error::INVALID_COMPACT_FINISHED_SPANS,
+                 "The number of finished spans at which they're compacted "
+                 "must be at least one."};
+  }
+
+  result.compress_compacted_spans = config.compress_compacted_spans;
+  if (auto compress_env =
+          lookup(environment::DD_TRACE_COMPRESS_COMPACTED_SPANS)) {
+    result.compress_compacted_spans = !falsy(*compress_env);
+  }
+  if (result.compact_finished_spans && result.compress_compacted_spans &&
+      !gzip_supported()) {
+    return Error{Error::GZIP_UNSUPPORTED,
+                 "Compression of compacted spans was configured, but this "
+                 "library was built without zlib."};
+  }
+
+  result.max_spans_per_trace = config.max_spans_per_trace;
+  if (auto max_spans_env = lookup(environment::DD_TRACE_MAX_SPANS_PER_TRACE)) {
+    auto max_spans = parse_uint64(*max_spans_env, 10);
+    if (auto *error = max_spans.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_MAX_SPANS_PER_TRACE);
+      prefix += " environment variable: ";
+      return error->to_error().with_prefix(prefix);
+    }
+    result.max_spans_per_trace = std::size_t(*max_spans);
+  }
+  if (result.max_spans_per_trace && *result.max_spans_per_trace < 1) {
+    return Error{Error::INVALID_MAX_SPANS_PER_TRACE,
+                 "The maximum number of spans per trace must be at least one."};
+  }
+
+  result.span_quotas = config.span_quotas;
+  if (auto quotas_env = lookup(environment::DD_TRACE_SPAN_QUOTAS)) {
+    auto quotas = parse_span_quotas(*quotas_env);
+    if (auto *error = quotas.if_error()) {
+      std::string prefix;
+      prefix += "Unable to parse ";
+      prefix += name(environment::DD_TRACE_SPAN_QUOTAS);
+      prefix += " environment variable: ";
+      return error->with_prefix(prefix);
+    }
+    result.span_quotas = std::move(*quotas);
+  }
+  for (const SpanQuotaConfig &quota : result.span_quotas) {
+    if (quota.service.empty()) {
+      return Error{Error::INVALID_SPAN_QUOTAS,
+                   "Each span quota must name a service."};
+    }
+    if (!(quota.max_spans_per_second > 0)) {
+      std::string message;
+      message += "The span quota of service \"";
+      message += quota.service;
+      message += "\" must have a positive max_spans_per_second, but it has ";
+      message += std::to_string(quota.max_spans_per_second);
+      message += '.';
+      return Error{Error::INVALID_SPAN_QUOTAS, std::move(message)};
+    }
+  }
+
+  result.clock = make_clock(config.clock_source);
+  result.memory_resource = config.memory_resource;
+
+  result.overhead_profiling_enabled = config.overhead_profiling_enabled;
+  if (auto profiling_env =
+          lookup(environment::DD_TRACE_OVERHEAD_PROFILING_ENABLED)) {
+    result.overhead_profiling_enabled = !falsy(*profiling_env);
+  }
+  if (config.overhead_log_interval_milliseconds < 0) {
+    return Error{Error::INVALID_OVERHEAD_LOG_INTERVAL,
+                 "The overhead log interval must not be a negative number of "
+                 "milliseconds."};
+  }
+  result.overhead_log_interval =
+      std::chrono::milliseconds(config.overhead_log_interval_milliseconds);
+
+  if (config.span_sampling_rules_file_poll_interval_milliseconds < 0) {
+    return Error{Error::INVALID_SPAN_SAMPLING_RULES_FILE_POLL_INTERVAL,
+                 "The span sampling rules file poll interval must not be a "
+                 "negative number of milliseconds."};
+  }
+  result.span_sampling_rules_file_poll_interval = std::chrono::milliseconds(
+      config.span_sampling_rules_file_poll_interval_milliseconds);
+  if (result.span_sampling_rules_file_poll_interval !=
+          result.span_sampling_rules_file_poll_interval.zero() &&
+      !lookup(environment::DD_SPAN_SAMPLING_RULES)) {
+    if (auto file_env = lookup(environment::DD_SPAN_SAMPLING_RULES_FILE)) {
+      result.span_sampling_rules_file = std::string(*file_env);
+    }
+  }
+
   return result;
 }
 
@@ -4,15 +4,24 @@
 // `Tracer`.  `Tracer` is instantiated with a `FinalizedTracerConfig`, which
 // must be obtained from the result of a call to `finalize_config`.
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
 #include <variant>
+#include <vector>
 
+#include "clock.h"
 #include "datadog_agent_config.h"
 #include "error.h"
 #include "expected.h"
 #include "propagation_styles.h"
 #include "span_defaults.h"
+#include "span_limits.h"
+#include "span_quota.h"
 #include "span_sampler_config.h"
 #include "trace_sampler_config.h"
 
@@ -30,6 +39,13 @@ struct TracerConfig {
   // that `defaults.service` is required to have a nonempty value.
   SpanDefaults defaults;
 
+  // `span_limits` bounds the sizes of spans' resource names and tags, and
+  // their number of tags.  The limits are applied as spans' properties are
+  // set, so that excess bytes are never copied.  By default, resource names
+  // and tags are limited as the Datadog Agent would truncate them anyway, and
+  // the number of tags is unlimited.  See `span_limits.h`.
+  SpanLimits span_limits;
+
   // `agent` configures a `DatadogAgent` collector instance.  See
   // `datadog_agent_config.h`.  Note that `agent` is ignored if `collector` is
   // set or if `report_traces` is `false`.
@@ -37,13 +53,16 @@ struct TracerConfig {
 
   // `collector` is a `Collector` instance that the tracer will use to report
   // traces to Datadog.  If `collector` is null, then a `DatadogAgent` instance
-  // will be created using the `agent` configuration.  Note that `collector` is
-  // ignored if `report_traces` is `false`.
+  // will be created using the `agent` configuration.  A `collector` may be
+  // shared by several tracers, e.g. one made by `make_shared_datadog_agent`.
+  // See `datadog_agent.h`.  Note that `collector` is ignored if
+  // `report_traces` is `false`.
   std::shared_ptr<Collector> collector = nullptr;
 
-  // `report_traces` indicates whether traces generated by the tracer will be
-  // sent to a collector (`true`) or discarded on completion (`false`).  If
-  // `report_traces` is `false`, then both `agent` and `collector` are ignored.
+  // `report_traces` indicates whether the tracer is enabled.  If
+  // `report_traces` is `false`, then both `agent` and `collector` are ignored,
+  // and the tracer creates and extracts only no-op spans, which record
+  // nothing, propagate nothing, and cost next to nothing (see `span.h`).
   // `report_traces` is overridden by the `DD_TRACE_ENABLED` environment
   // variable.
   bool report_traces = true;
@@ -57,6 +76,17 @@ struct TracerConfig {
   // the trace sampler.  See `span_sampler_config.h`.
   SpanSamplerConfig span_sampler;
 
+  // `span_sampling_rules_file_poll_interval_milliseconds`, if positive, is how
+  // often the tracer checks whether the file named by the
+  // `DD_SPAN_SAMPLING_RULES_FILE` environment variable has been modified.  If
+  // it has, then the tracer replaces its span sampling rules with those in the
+  // file, as `Tracer::update_sampling` would.  If zero, then the file is read
+  // only by `finalize_config`.  The file is not watched if the
+  // `DD_SPAN_SAMPLING_RULES` environment variable, which overrides it, is set.
+  // `span_sampling_rules_file_poll_interval_milliseconds` must not be
+  // negative.
+  int span_sampling_rules_file_poll_interval_milliseconds = 0;
+
   // `injection_styles` indicates with which tracing systems trace propagation
   // will be compatible when injecting (sending) trace context.
   // `injection_styles` is overridden by the `DD_PROPAGATION_STYLE_INJECT`
@@ -79,6 +109,175 @@ struct TracerConfig {
   // `tags_header_size`, the header will be omitted instead.
   std::size_t tags_header_size = 512;
 
+  // `partial_flush_enabled` indicates whether a trace segment sends its
+  // finished spans to the collector before all of its spans are finished, once
+  // at least `partial_flush_min_spans` of them are finished.  This bounds the
+  // memory used by long-lived traces having many spans.  Once a trace
+  // segment's spans have been partially sent, its sampling priority can no
+  // longer be overridden.  `partial_flush_enabled` is overridden by the
+  // `DD_TRACE_PARTIAL_FLUSH_ENABLED` environment variable, and
+  // `partial_flush_min_spans` is overridden by the
+  // `DD_TRACE_PARTIAL_FLUSH_MIN_SPANS` environment variable.
+  bool partial_flush_enabled = false;
+  std::size_t partial_flush_min_spans = 1000;
+
+  // `max_memory_bytes` is the approximate amount of memory that the tracer's
+  // buffered trace data may occupy: the finished spans of open trace
+  // segments, the trace chunks buffered by the `DatadogAgent`, and the
+  // payloads that it has yet to send (see `MetricsSnapshot::memory_bytes`).
+  // The limit is soft.  While it is exceeded, trace segments degrade
+  // gracefully instead of refusing spans:
+  //
+  // - A segment sends its finished spans as soon as each finishes, as if
+  //   partial flushing were enabled with a minimum of one span.
+  // - Before a trace chunk is sent, tags whose values are longer than
+  //   `TraceSegment::large_tag_size` bytes are removed from its spans,
+  //   except the tags that the tracer itself sets.
+  // - A trace chunk that sampling drops, and none of whose spans is kept by
+  //   span sampling, is discarded instead of being sent.  It is thus
+  //   missing from any statistics that the tracer computes.
+  //
+  // The memory used and the degradations are reported in `Tracer::metrics`.
+  // The collector's memory counts only if the collector is a `DatadogAgent`,
+  // with which the tracer then shares its metrics.  By default, there is no
+  // limit.  `max_memory_bytes` is overridden by the
+  // `DD_TRACE_MAX_MEMORY_BYTES` environment variable.
+  std::optional<std::size_t> max_memory_bytes;
+
+  // `trace_id_128_bit` indicates whether the tracer generates 128-bit trace
+  // IDs for the traces that it starts, instead of 64-bit trace IDs.  The high
+  // 64 bits of a generated trace ID begin with the 32-bit Unix time at which
+  // the trace started.  Extracted 128-bit trace IDs are preserved either way.
+  // `trace_id_128_bit` is overridden by the
+  // `DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED` environment variable.
+  bool trace_id_128_bit = false;
+
+  // `sampling_decision_at_root` indicates whether the tracer makes the
+  // sampling decision for a trace as soon as it creates or extracts the
+  // trace's local root span, instead of when the trace is first injected or
+  // finished.  Sampling rules then see only the local root's properties at
+  // its creation, e.g. not a resource name set afterward.  In exchange, if
+  // the trace is dropped and no span sampling rules are configured, then the
+  // trace's spans discard the tags and error details that neither trace
+  // context propagation nor trace metrics need (see `trace_segment.h`), which
+  // saves most of the memory and serialization cost of dropped traces.
+  // `sampling_decision_at_root` is overridden by the
+  // `DD_TRACE_SAMPLING_DECISION_AT_ROOT` environment variable.
+  bool sampling_decision_at_root = false;
+
+  // `defer_span_sampling` indicates whether span sampling rules are applied to
+  // the spans of a dropped trace by the collector as it flushes, instead of
+  // by the thread that finishes the trace.  Finishing a large dropped trace
+  // then doesn't cost time proportional to its number of spans.  Span
+  // sampling is still done before flushing if the collector computes trace
+  // metrics or encodes spans as they arrive (see `datadog_agent_config.h`).
+  // `defer_span_sampling` is overridden by the `DD_TRACE_DEFER_SPAN_SAMPLING`
+  // environment variable.
+  bool defer_span_sampling = false;
+
+  // `delegate_trace_sampling` indicates whether the tracer, when it injects
+  // trace context into a request, asks the service that handles the request
+  // to make the trace's sampling decision instead, unless the decision was
+  // extracted or made manually.  The tracer still injects a provisional
+  // sampling priority, for services that don't delegate.  A service that
+  // delegates, such as a proxy, then adopts the decision returned in the
+  // response's headers (see `Span::read_sampling_delegation_response`), so
+  // that each trace is decided once.  A tracer always honors a request to
+  // make the decision, whatever this option (see
+  // `Span::write_sampling_delegation_response`).
+  // `delegate_trace_sampling` is overridden by the
+  // `DD_TRACE_DELEGATE_SAMPLING` environment variable.
+  bool delegate_trace_sampling = false;
+
+  // `min_span_duration_microseconds`, if set and not zero, is the duration
+  // below which a finished span is left out of its trace chunk, and is
+  // instead counted on its parent, in the `filtered_spans.count` metric and
+  // in the `filtered_spans.duration` metric (in nanoseconds).  Only spans
+  // that are unremarkable are filtered: those that aren't the first span of
+  // their trace chunk, that have a parent in the same chunk and of the same
+  // service, and that have no error, no children, and no "_dd.measured" tag.
+  // Filtered spans are not seen by span sampling or trace metrics.
+  // `min_span_duration_microseconds` is overridden by the
+  // `DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS` environment variable.
+  std::optional<std::uint64_t> min_span_duration_microseconds;
+
+  // `collapse_repeated_spans_threshold`, if set, is the number of sibling
+  // spans having the same service, name, and resource, at or above which a
+  // trace segment collapses them into one span before sending them.  The
+  // collapsed span is the first of the siblings, extended to cover all of
+  // them, and has metrics for the siblings' number (`collapsed_spans.count`),
+  // errors (`collapsed_spans.error_count`), and minimum, maximum, and total
+  // durations (`collapsed_spans.min_duration` and so on, in nanoseconds).
+  // Only siblings without children are collapsed, and only in a segment's
+  // first trace chunk.  `collapse_repeated_spans_threshold` must be at least
+  // two.  It is overridden by the `DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD`
+  // environment variable.
+  std::optional<std::size_t> collapse_repeated_spans_threshold;
+
+  // `compact_finished_spans`, if set, is the number of finished spans at
+  // which a trace segment whose other spans are still open moves its
+  // finished spans, other than its first, into a compact encoding, until
+  // they're sent.  This saves most of the memory of long-lived traces, such
+  // as those of websocket sessions or of batch jobs, where partial flushing
+  // (see `partial_flush_min_spans`) is not acceptable.  The spans are decoded
+  // just before they're sent, which costs about as much as encoding them did.
+  // See `compact_spans.h`.  If `partial_flush_min_spans` is also set, then
+  // whichever of the two is smaller applies, and the other doesn't.
+  // `compact_finished_spans` must be at least one.  It is overridden by the
+  // `DD_TRACE_COMPACT_FINISHED_SPANS` environment variable.
+  std::optional<std::size_t> compact_finished_spans;
+
+  // `compress_compacted_spans` indicates whether finished spans compacted
+  // per `compact_finished_spans` are also gzip compressed, which further
+  // reduces their memory at some cost in time.  It requires zlib.
+  // `compress_compacted_spans` is overridden by the
+  // `DD_TRACE_COMPRESS_COMPACTED_SPANS` environment variable.
+  bool compress_compacted_spans = false;
+
+  // `max_spans_per_trace`, if set, is the maximum number of spans that a trace
+  // segment records.  Spans created beyond the maximum are overflow spans: they
+  // are no-ops except that they propagate the trace as the segment's local
+  // root span, and they're not sent.  The local root span of each of the
+  // segment's trace chunks has a metric, `overflow_spans.count`, of the number
+  // of overflow spans created.  `max_spans_per_trace` must be at least one.
+  // It is overridden by the `DD_TRACE_MAX_SPANS_PER_TRACE` environment
+  // variable.
+  std::optional<std::size_t> max_spans_per_trace;
+
+  // `span_quotas` limit the rate at which the spans of particular services,
+  // and optionally of particular resources of those services, are sent,
+  // whatever their sampling priority.  A trace chunk that would exceed a quota
+  // is dropped as a whole.  See `span_quota.h`.  Each quota must name a
+  // service and have a positive `max_spans_per_second`.  `span_quotas` is
+  // overridden by the `DD_TRACE_SPAN_QUOTAS` environment variable, whose value
+  // is a JSON array of objects such as
+  // `{"service": "billing", "max_spans_per_second": 500}`.
+  std::vector<SpanQuotaConfig> span_quotas;
+
+  // `active_span_as_parent` indicates whether `Tracer::create_span` creates a
+  // child of the calling thread's active span, if there is one, instead of
+  // the root of a new trace.  See `active_span.h`.
+  // `active_span_as_parent` is overridden by the
+  // `DD_TRACE_ACTIVE_SPAN_AS_PARENT` environment variable.
+  bool active_span_as_parent = false;
+
+  // `clock_source` indicates how the tracer measures span start times and
+  // durations, if a `Clock` is not given to the `Tracer` directly.  The
+  // default reads both the system clock and the steady clock.  The
+  // alternatives are cheaper and less exact.  See `clock.h`.
+  ClockSource clock_source = ClockSource::DEFAULT;
+
+  // `memory_resource`, if not null, is where the tracer allocates the memory
+  // of its trace segments and of their spans' `SpanData` objects, which are
+  // allocated from arena blocks (see `span_arena.h`) taken from the resource.
+  // This isolates that memory from the global heap, e.g. in an arena of a
+  // custom allocator, where it can be accounted for separately.  The strings
+  // and tags within spans, and the collector's buffers and payloads, are
+  // still allocated from the global heap.  The resource must be thread-safe,
+  // and it must outlive the tracer and every span and trace chunk that the
+  // tracer creates, including those that the collector has yet to send.
+  std::pmr::memory_resource* memory_resource = nullptr;
+
   // `logger` specifies how the tracer will issue diagnostic messages.  If
   // `logger` is null, then it defaults to a logger that inserts into
   // `std::cerr`.
@@ -89,6 +288,27 @@ struct TracerConfig {
   // `log_on_startup` is overridden by the `DD_TRACE_STARTUP_LOGS` environment
   // variable.
   bool log_on_startup = true;
+
+  // `lazy_startup` indicates whether the tracer defers its startup until it
+  // first creates or extracts a span.  Startup includes creating the
+  // `DatadogAgent` collector and its default HTTP client and event scheduler,
+  // whose threads then start, looking up the hostname, and logging the
+  // startup banner.  A process that never traces then pays none of that.
+  // Note that if this library was built without a default HTTP client, the
+  // lack of one is logged at startup instead of failing `finalize_config`.
+  // `lazy_startup` is overridden by the `DD_TRACE_LAZY_STARTUP` environment
+  // variable.
+  bool lazy_startup = false;
+
+  // `overhead_profiling_enabled` indicates whether the tracer times its own
+  // operations, so that their overhead is included in `Tracer::metrics` (see
+  // `metrics.h`).  Timing an operation costs a few tens of nanoseconds.  If
+  // the tracer sends traces to a Datadog Agent, then it also logs a summary of
+  // its overhead every `overhead_log_interval_milliseconds`, unless that is
+  // zero.  `overhead_profiling_enabled` is overridden by the
+  // `DD_TRACE_OVERHEAD_PROFILING_ENABLED` environment variable.
+  bool overhead_profiling_enabled = false;
+  int overhead_log_interval_milliseconds = 60000;
 };
 
 // `FinalizedTracerConfig` contains `Tracer` implementation details derived from
@@ -101,21 +321,45 @@ class FinalizedTracerConfig {
 
  public:
   SpanDefaults defaults;
+  SpanLimits span_limits;
 
   std::variant<std::monostate, FinalizedDatadogAgentConfig,
                std::shared_ptr<Collector>>
       collector;
+  bool report_traces;
 
   FinalizedTraceSamplerConfig trace_sampler;
   FinalizedSpanSamplerConfig span_sampler;
+  // `span_sampling_rules_file` is the span sampling rules file to watch, if
+  // any.
+  std::optional<std::string> span_sampling_rules_file;
+  std::chrono::steady_clock::duration span_sampling_rules_file_poll_interval;
 
   PropagationStyles injection_styles;
   PropagationStyles extraction_styles;
 
   bool report_hostname;
   std::size_t tags_header_size;
+  std::optional<std::size_t> partial_flush_min_spans;
+  std::optional<std::size_t> max_memory_bytes;
+  bool trace_id_128_bit;
+  bool sampling_decision_at_root;
+  bool defer_span_sampling;
+  bool delegate_trace_sampling;
+  bool active_span_as_parent;
+  std::optional<std::chrono::steady_clock::duration> min_span_duration;
+  std::optional<std::size_t> collapse_repeated_spans_threshold;
+  std::optional<std::size_t> compact_finished_spans;
+  bool compress_compacted_spans;
+  std::optional<std::size_t> max_spans_per_trace;
+  std::vector<SpanQuotaConfig> span_quotas;
+  Clock clock;
+  std::pmr::memory_resource* memory_resource;
   std::shared_ptr<Logger> logger;
   bool log_on_startup;
+  bool lazy_startup;
+  bool overhead_profiling_enabled;
+  std::chrono::steady_clock::duration overhead_log_interval;
 };
 
 // Return a `FinalizedTracerConfig` from the specified `config` and from any
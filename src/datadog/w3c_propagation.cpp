@@ -0,0 +1,286 @@
+#include "w3c_propagation.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#include "error.h"
+#include "parse_util.h"
+#include "tags.h"
+
+namespace datadog {
+namespace tracing {
+namespace {
+
+constexpr char hex_digits[] = "0123456789abcdef";
+
+// "tracestate" has at most this many members.
+constexpr std::size_t max_tracestate_members = 32;
+
+// The "dd" member of "tracestate" is at most this long, including its key.
+constexpr std::size_t max_datadog_member_size = 3 + 256;
+
+// `MemberWriter` appends to a fixed-size buffer, and refuses what doesn't fit.
+class MemberWriter {
+  char* begin_;
+  std::size_t size_;
+  std::size_t capacity_;
+
+ public:
+  template <std::size_t capacity>
+  explicit MemberWriter(char (&buffer)[capacity])
+      : MemberWriter(buffer, capacity) {}
+  MemberWriter(char* buffer, std::size_t capacity)
+      : begin_(buffer), size_(0), capacity_(capacity) {}
+
+  bool fits(std::size_t size) const { return size_ + size <= capacity_; }
+  std::string_view view() const { return std::string_view(begin_, size_); }
+
+  // Append the specified `text`, which must fit.
+  void append(std::string_view text) {
+    std::memcpy(begin_ + size_, text.data(), text.size());
+    size_ += text.size();
+  }
+
+  // Append the specified `text`, which must fit, with "=" replaced by "~" and
+  // the characters not allowed in a field of the "dd" member replaced by "_".
+  void append_value(std::string_view text) {
+    for (const char ch : text) {
+      char replacement = ch;
+      if (ch == '=') {
+        replacement = '~';
+      } else if (ch < 0x20 || ch > 0x7E || ch == ',' || ch == ';' ||
+                 ch == '~') {
+        replacement = '_';
+      }
+      begin_[size_++] = replacement;
+    }
+  }
+
+  // Append the specified `text`, which must fit, with its "~" characters
+  // replaced by "=", i.e. with the replacement made by `append_value` undone.
+  void append_decoded(std::string_view text) {
+    for (const char ch : text) {
+      begin_[size_++] = ch == '~' ? '=' : ch;
+    }
+  }
+};
+
+Error malformed(std::string_view value) {
+  std::string message;
+  message += "Malformed W3C traceparent: \"";
+  message += value;
+  message += '\"';
+  return Error{Error::MALFORMED_TRACEPARENT, std::move(message)};
+}
+
+// Return whether the specified `text` contains an uppercase hexadecimal digit.
+// `read_hex` accepts them, but W3C Trace Context allows only lowercase.
+bool has_uppercase_hex(std::string_view text) {
+  return std::any_of(text.begin(), text.end(),
+                     [](char ch) { return ch >= 'A' && ch <= 'F'; });
+}
+
+}  // namespace
+
+Expected<TraceParent> parse_traceparent(std::string_view value) {
+  // version "-" trace-id "-" parent-id "-" trace-flags
+  //  0..1   2   3..34    35   36..51   52    53..54
+  if (value.size() < 55) {
+    return malformed(value);
+  }
+  int invalid = 0;
+  const std::uint64_t version = read_hex(value.substr(0, 2), invalid);
+  TraceParent result;
+  result.trace_id.high = read_hex(value.substr(3, 16), invalid);
+  result.trace_id.low = read_hex(value.substr(19, 16), invalid);
+  result.parent_id = read_hex(value.substr(36, 16), invalid);
+  const std::uint64_t flags = read_hex(value.substr(53, 2), invalid);
+  result.sampled = flags & 1;
+
+  // Later versions may append fields, but version 00 may not.  Version ff is
+  // forbidden, as are IDs that are all zeros.
+  const bool delimited = (value[2] == '-') & (value[35] == '-') &
+                         (value[52] == '-') &
+                         (value.size() == 55 ||
+                          (version != 0 && value[55] == '-'));
+  const bool nonzero =
+      (result.trace_id.high | result.trace_id.low) != 0 && result.parent_id;
+  if (invalid || !delimited || !nonzero || version == 0xFF ||
+      has_uppercase_hex(value.substr(0, 55))) {
+    return malformed(value);
+  }
+  return result;
+}
+
+std::string_view format_traceparent(TraceParentBuffer& buffer, TraceID trace_id,
+                                    std::uint64_t parent_id, bool sampled) {
+  buffer[0] = '0';
+  buffer[1] = '0';
+  buffer[2] = '-';
+  write_hex16(buffer + 3, trace_id.high);
+  write_hex16(buffer + 19, trace_id.low);
+  buffer[35] = '-';
+  write_hex16(buffer + 36, parent_id);
+  buffer[52] = '-';
+  buffer[53] = '0';
+  buffer[54] = hex_digits[sampled];
+  return std::string_view(buffer, sizeof buffer);
+}
+
+std::optional<std::string_view> find_datadog_member(std::string_view value) {
+  const std::string_view key = "dd=";
+  std::size_t begin = 0;
+  while (begin < value.size()) {
+    auto end = value.find(',', begin);
+    end = end == std::string_view::npos ? value.size() : end;
+    const auto member = strip(value.substr(begin, end - begin));
+    if (starts_with(member, key)) {
+      return member.substr(key.size());
+    }
+    begin = end + 1;
+  }
+  return std::nullopt;
+}
+
+DatadogTraceState parse_datadog_member(DatadogTraceStateBuffer& buffer,
+                                       std::string_view member) {
+  // The origin is decoded into the first third of `buffer`, and the trace
+  // tags, which are longer than their encoding, into the rest.
+  constexpr std::size_t origin_capacity = sizeof buffer / 3;
+  MemberWriter origin{buffer, origin_capacity};
+  MemberWriter tags{buffer + origin_capacity, sizeof buffer - origin_capacity};
+  DatadogTraceState result;
+  std::size_t begin = 0;
+  while (begin < member.size()) {
+    auto end = member.find(';', begin);
+    end = end == std::string_view::npos ? member.size() : end;
+    const auto field = member.substr(begin, end - begin);
+    begin = end + 1;
+
+    const auto colon = field.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    const auto key = field.substr(0, colon);
+    const auto value = field.substr(colon + 1);
+    if (key == "s") {
+      if (auto priority = parse_int(value, 10)) {
+        result.sampling_priority = *priority;
+      }
+    } else if (key == "o") {
+      origin = MemberWriter{buffer, origin_capacity};
+      if (origin.fits(value.size())) {
+        origin.append_decoded(value);
+        result.origin = origin.view();
+      }
+    } else if (starts_with(key, "t.")) {
+      // "t.dm:-4" is the trace tag "_dd.p.dm=-4".
+      const std::size_t separator = tags.view().empty() ? 0 : 1;
+      const auto name = key.substr(2);
+      if (!tags.fits(separator + 6 + name.size() + 1 + value.size())) {
+        continue;
+      }
+      if (separator) {
+        tags.append(",");
+      }
+      tags.append("_dd.p.");
+      tags.append(name);
+      tags.append("=");
+      tags.append_decoded(value);
+      result.trace_tags = tags.view();
+    }
+  }
+  return result;
+}
+
+std::string_view format_tracestate(TraceStateBuffer& buffer,
+                                   std::optional<int> sampling_priority,
+                                   std::optional<std::string_view> origin,
+                                   std::string_view trace_tags,
+                                   std::string_view other_tracestate) {
+  MemberWriter writer{buffer, max_datadog_member_size};
+  writer.append("dd=");
+  const std::size_t empty_size = writer.view().size();
+  // Each field but the first is preceded by ";".
+  const auto separator = [&]() {
+    return std::string_view(";", writer.view().size() != empty_size);
+  };
+
+  if (sampling_priority) {
+    char priority[16];
+    const auto formatted =
+        std::to_chars(std::begin(priority), std::end(priority),
+                      *sampling_priority);
+    writer.append("s:");
+    writer.append(std::string_view(priority, formatted.ptr - priority));
+  }
+
+  if (origin && writer.fits(separator().size() + 2 + origin->size())) {
+    writer.append(separator());
+    writer.append("o:");
+    writer.append_value(*origin);
+  }
+
+  const std::string_view prefix = "_dd.p.";
+  std::size_t begin = 0;
+  while (begin < trace_tags.size()) {
+    auto end = trace_tags.find(',', begin);
+    end = end == std::string_view::npos ? trace_tags.size() : end;
+    const auto tag = trace_tags.substr(begin, end - begin);
+    begin = end + 1;
+
+    const auto equals = tag.find('=');
+    if (equals == std::string_view::npos) {
+      continue;
+    }
+    const auto key = tag.substr(0, equals);
+    const auto value = tag.substr(equals + 1);
+    if (!starts_with(key, prefix) || key == tags::internal::trace_id_high) {
+      continue;
+    }
+    // ";t." key ":" value
+    const auto name = key.substr(prefix.size());
+    if (!writer.fits(separator().size() + 2 + name.size() + 1 +
+                     value.size())) {
+      continue;
+    }
+    writer.append(separator());
+    writer.append("t.");
+    writer.append_value(name);
+    writer.append(":");
+    writer.append_value(value);
+  }
+
+  // The other vendors' members follow the "dd" member, if there is one.
+  const bool has_datadog_member = writer.view().size() != empty_size;
+  const std::size_t size = has_datadog_member ? writer.view().size() : 0;
+  MemberWriter others{buffer + size, sizeof buffer - size};
+  std::size_t members = has_datadog_member;
+  begin = 0;
+  while (begin < other_tracestate.size() &&
+         members < max_tracestate_members) {
+    auto end = other_tracestate.find(',', begin);
+    end = end == std::string_view::npos ? other_tracestate.size() : end;
+    const auto member = strip(other_tracestate.substr(begin, end - begin));
+    begin = end + 1;
+
+    const bool separated = members != 0;
+    if (member.empty() || starts_with(member, "dd=") ||
+        !others.fits(separated + member.size())) {
+      continue;
+    }
+    if (separated) {
+      others.append(",");
+    }
+    others.append(member);
+    ++members;
+  }
+  return std::string_view(buffer, size + others.view().size());
+}
+
+}  // namespace tracing
+}  // namespace datadog
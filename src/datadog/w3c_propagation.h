@@ -0,0 +1,107 @@
+#pragma once
+
+// This component provides functions for the W3C Trace Context propagation
+// style, which uses the "traceparent" and "tracestate" headers.  See
+// https://www.w3.org/TR/trace-context/.
+//
+// "traceparent" has a fixed format, e.g.
+//
+//     00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01
+//
+// which is the version, the 128-bit trace ID, the parent span ID, and the
+// trace flags, whose lowest bit means "sampled".  Since the header is on every
+// inbound request, `parse_traceparent` reads it at fixed offsets, and checks
+// all of its digits at once, rather than tokenizing it.  Likewise,
+// `format_traceparent` writes into a caller's buffer, and so doesn't allocate.
+//
+// "tracestate" is a list of vendor-specific members.  Datadog's member, "dd",
+// contains the sampling priority, origin, and propagated trace tags, e.g.
+//
+//     dd=s:2;o:rum;t.dm:-4,othervendor=value
+//
+// `find_datadog_member` finds the "dd" member without decoding the others, and
+// `parse_datadog_member` decodes it, so that "tracestate" is examined only if
+// what it contains is needed.  `parse_datadog_member` decodes into a caller's
+// buffer, so it doesn't allocate either.
+//
+// The other vendors' members are passed on as they were received, after the
+// "dd" member, as the W3C specification requires.  `format_tracestate` copies
+// them from the inbound "tracestate" header into the caller's buffer.
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "expected.h"
+#include "trace_id.h"
+
+namespace datadog {
+namespace tracing {
+
+struct TraceParent {
+  TraceID trace_id;
+  std::uint64_t parent_id = 0;
+  bool sampled = false;
+};
+
+// Return the trace context in the specified "traceparent" header `value`, or
+// return an `Error` if `value` is not a valid "traceparent".
+Expected<TraceParent> parse_traceparent(std::string_view value);
+
+// `TraceParentBuffer` is large enough to hold a "traceparent" header value.
+using TraceParentBuffer = char[55];
+
+// Format a version 00 "traceparent" header value having the specified
+// `trace_id`, `parent_id`, and `sampled` flag into the specified `buffer`, and
+// return a view of the result.
+std::string_view format_traceparent(TraceParentBuffer& buffer, TraceID trace_id,
+                                    std::uint64_t parent_id, bool sampled);
+
+// `DatadogTraceState` is the information in the "dd" member of "tracestate".
+// `origin` and `trace_tags` are views of the buffer that the member was
+// decoded into.  `trace_tags` are in the format of the "x-datadog-tags"
+// header.
+struct DatadogTraceState {
+  std::optional<int> sampling_priority;
+  std::optional<std::string_view> origin;
+  std::optional<std::string_view> trace_tags;
+};
+
+// `DatadogTraceStateBuffer` is large enough to hold the decoded origin and
+// trace tags of a "dd" member whose value is at most 256 characters.
+using DatadogTraceStateBuffer = char[3 * 256];
+
+// Return the value of the "dd" member of the specified "tracestate" header
+// `value`, or return null if there isn't one.
+std::optional<std::string_view> find_datadog_member(std::string_view value);
+
+// Return the information in the specified value of the "dd" member of
+// "tracestate", decoded into the specified `buffer`.  Unrecognized and
+// malformed fields are ignored, as are the origin and trace tags that don't
+// fit in `buffer`.
+DatadogTraceState parse_datadog_member(DatadogTraceStateBuffer& buffer,
+                                       std::string_view member);
+
+// `TraceStateBuffer` is large enough to hold a "tracestate" header value whose
+// "dd" member's value is at most 256 characters, followed by at most 512
+// characters of other vendors' members.
+using TraceStateBuffer = char[3 + 256 + 512];
+
+// Format a "tracestate" header value containing a "dd" member having the
+// specified optional `sampling_priority`, the specified optional `origin`, and
+// the "_dd.p.*" tags from the specified `trace_tags` (in the format of the
+// "x-datadog-tags" header) into the specified `buffer`, and return a view of
+// the result.  Trace tags that don't fit in the member are omitted.  The
+// "_dd.p.tid" tag is omitted, since it is part of "traceparent".  The "dd"
+// member is omitted if it would be empty.  It's followed by the members other
+// than "dd" of the optionally specified inbound "tracestate" header value
+// `other_tracestate`, in order, up to the W3C limit of 32 members.  Members
+// that don't fit in `buffer` are omitted.
+std::string_view format_tracestate(TraceStateBuffer& buffer,
+                                   std::optional<int> sampling_priority,
+                                   std::optional<std::string_view> origin,
+                                   std::string_view trace_tags,
+                                   std::string_view other_tracestate = "");
+
+}  // namespace tracing
+}  // namespace datadog
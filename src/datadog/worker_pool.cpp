@@ -0,0 +1,106 @@
+#include "worker_pool.h"
+
+#include <utility>
+
+namespace datadog {
+namespace tracing {
+
+WorkerPool::WorkerPool(std::size_t threads)
+    : num_threads_(threads),
+      stopping_(false),
+      generation_(0),
+      job_(nullptr),
+      job_tasks_(0),
+      active_(0),
+      next_task_(0) {
+  start();
+  ForkHandlers handlers;
+  handlers.before_fork = [this]() { stop(); };
+  handlers.after_fork_in_parent = [this]() { start(); };
+  handlers.after_fork_in_child = [this]() { start(); };
+  unregister_fork_handlers_ = register_fork_handlers(std::move(handlers));
+}
+
+WorkerPool::~WorkerPool() {
+  unregister_fork_handlers_();
+  stop();
+}
+
+void WorkerPool::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  for (std::size_t i = 0; i < num_threads_; ++i) {
+    threads_.emplace_back([this]() { work(); });
+  }
+}
+
+void WorkerPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    job_or_stop_.notify_all();
+  }
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  threads_.clear();
+}
+
+void WorkerPool::run_tasks(const std::function<void(std::size_t)>& task,
+                           std::size_t tasks) {
+  for (;;) {
+    const std::size_t index =
+        next_task_.fetch_add(1, std::memory_order_relaxed);
+    if (index >= tasks) {
+      return;
+    }
+    task(index);
+  }
+}
+
+void WorkerPool::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::uint64_t seen = generation_;
+  for (;;) {
+    job_or_stop_.wait(lock,
+                      [&]() { return stopping_ || generation_ != seen; });
+    if (stopping_) {
+      return;
+    }
+    seen = generation_;
+    if (!job_) {
+      // The job finished before this thread woke.
+      continue;
+    }
+    const auto& job = *job_;
+    const std::size_t tasks = job_tasks_;
+    ++active_;
+    lock.unlock();
+    run_tasks(job, tasks);
+    lock.lock();
+    if (--active_ == 0) {
+      job_done_.notify_one();
+    }
+  }
+}
+
+void WorkerPool::run(std::size_t tasks,
+                     const std::function<void(std::size_t)>& task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &task;
+    job_tasks_ = tasks;
+    next_task_.store(0, std::memory_order_relaxed);
+    ++generation_;
+    job_or_stop_.notify_all();
+  }
+  run_tasks(task, tasks);
+  std::unique_lock<std::mutex> lock(mutex_);
+  job_done_.wait(lock, [&]() { return active_ == 0; });
+  job_ = nullptr;
+}
+
+std::size_t WorkerPool::size() const { return num_threads_; }
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,75 @@
+#pragma once
+
+// This component provides a class, `WorkerPool`, that runs the tasks of a job
+// on a fixed set of threads, and on the thread that submits the job.
+//
+// `run` numbers a job's tasks from zero.  Each participating thread claims the
+// next unclaimed task until none remain, so that threads that finish their
+// tasks early take over the remaining ones, rather than each thread being
+// assigned a fixed share.  Tasks should therefore be small enough that there
+// are several per thread.
+//
+// `DatadogAgent` uses a `WorkerPool` to encode large flushes in parallel.  See
+// `DatadogAgentConfig::encoder_threads`.
+//
+// Like `ThreadedEventScheduler`, the pool's threads are stopped before `fork`
+// and started again after it, in both the parent and the child.  A job that's
+// running during `fork` is completed by the thread that submitted it.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "fork_handlers.h"
+
+namespace datadog {
+namespace tracing {
+
+class WorkerPool {
+  std::size_t num_threads_;
+  std::vector<std::thread> threads_;
+  // `mutex_` protects the members below it, except for `next_task_`.
+  std::mutex mutex_;
+  std::condition_variable job_or_stop_;
+  std::condition_variable job_done_;
+  bool stopping_;
+  // `generation_` is incremented with each job.  `job_` is the current job,
+  // or null if there is none, and `active_` is the number of pool threads
+  // working on it.
+  std::uint64_t generation_;
+  const std::function<void(std::size_t)>* job_;
+  std::size_t job_tasks_;
+  std::size_t active_;
+  std::atomic<std::size_t> next_task_;
+  UnregisterForkHandlers unregister_fork_handlers_;
+
+  void start();
+  void stop();
+  void work();
+  // Run tasks of the current job until none remain unclaimed.
+  void run_tasks(const std::function<void(std::size_t)>& task,
+                 std::size_t tasks);
+
+ public:
+  // Create a pool having the specified number of `threads`.
+  explicit WorkerPool(std::size_t threads);
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  ~WorkerPool();
+
+  // Invoke the specified `task` with each index less than the specified
+  // `tasks`, on the pool's threads and on the calling thread, and return once
+  // every invocation has returned.  `run` must not be called concurrently
+  // with itself.
+  void run(std::size_t tasks, const std::function<void(std::size_t)>& task);
+
+  std::size_t size() const;
+};
+
+}  // namespace tracing
+}  // namespace datadog
@@ -0,0 +1,193 @@
+// These are tests for `ActiveSpan`, `active_span`, and `active_span_ids`, and
+// for how `Tracer::create_span` uses the active span when so configured.
+
+#include <datadog/active_span.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <csignal>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("active span") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  config.active_span_as_parent = true;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SECTION("is none by default") { REQUIRE(active_span() == nullptr); }
+
+  SECTION("is a stack") {
+    auto outer = tracer.create_span();
+    {
+      ActiveSpan outer_scope{outer};
+      REQUIRE(active_span() == &outer);
+      auto inner = outer.create_child();
+      {
+        ActiveSpan inner_scope{inner};
+        REQUIRE(active_span() == &inner);
+      }
+      REQUIRE(active_span() == &outer);
+    }
+    REQUIRE(active_span() == nullptr);
+  }
+
+  SECTION("is per thread") {
+    auto span = tracer.create_span();
+    ActiveSpan scope{span};
+    Span* other_thread_active = &span;
+    std::thread([&]() { other_thread_active = active_span(); }).join();
+    REQUIRE(other_thread_active == nullptr);
+  }
+
+  SECTION("is the parent of created spans") {
+    auto root = tracer.create_span();
+    ActiveSpan scope{root};
+    auto child = tracer.create_span();
+    REQUIRE(child.trace_id() == root.trace_id());
+    REQUIRE(child.parent_id() == root.id());
+
+    SpanConfig span_config;
+    span_config.name = "child.op";
+    auto configured = tracer.create_span(span_config);
+    REQUIRE(configured.parent_id() == root.id());
+  }
+
+  SECTION("is not the parent of created spans unless configured") {
+    config.active_span_as_parent = false;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer unconfigured{*finalized};
+    auto root = unconfigured.create_span();
+    ActiveSpan scope{root};
+    auto other = unconfigured.create_span();
+    REQUIRE(other.trace_id() != root.trace_id());
+    REQUIRE(!other.parent_id());
+  }
+}
+
+TEST_CASE("bind_active_span") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  auto span = tracer.create_span();
+
+  SECTION("activates the span that was active when bound") {
+    auto handler = [&]() {
+      ActiveSpan scope{span};
+      return bind_active_span([](int value) {
+        return std::make_pair(active_span(), value + 1);
+      });
+    }();
+    REQUIRE(active_span() == nullptr);
+
+    // The handler runs on another thread, as if resumed by an executor.
+    std::pair<Span*, int> result;
+    Span* active_after_call = &span;
+    std::thread([&]() {
+      result = handler(1);
+      active_after_call = active_span();
+    }).join();
+    REQUIRE(result.first == &span);
+    REQUIRE(result.second == 2);
+    REQUIRE(active_after_call == nullptr);
+  }
+
+  SECTION("deactivates the caller's span if none was active when bound") {
+    auto handler = bind_active_span([]() { return active_span(); });
+    ActiveSpan scope{span};
+    REQUIRE(handler() == nullptr);
+    REQUIRE(active_span() == &span);
+  }
+}
+
+namespace {
+
+std::optional<ActiveSpanIDs> ids_in_handler;
+
+void read_ids(int) { ids_in_handler = active_span_ids(); }
+
+}  // namespace
+
+TEST_CASE("active_span_ids") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SECTION("are none by default") { REQUIRE(!active_span_ids()); }
+
+  SECTION("follow the active span") {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+    {
+      ActiveSpan root_scope{root};
+      auto ids = active_span_ids();
+      REQUIRE(ids);
+      REQUIRE(ids->trace_id == root.trace_id());
+      REQUIRE(ids->span_id == root.id());
+      REQUIRE(ids->local_root_span_id == root.id());
+      {
+        ActiveSpan child_scope{child};
+        ids = active_span_ids();
+        REQUIRE(ids);
+        REQUIRE(ids->trace_id == root.trace_id());
+        REQUIRE(ids->span_id == child.id());
+        REQUIRE(ids->local_root_span_id == root.id());
+        {
+          ActiveSpan none_scope{nullptr};
+          REQUIRE(!active_span_ids());
+        }
+        ids = active_span_ids();
+        REQUIRE(ids);
+        REQUIRE(ids->span_id == child.id());
+      }
+      ids = active_span_ids();
+      REQUIRE(ids);
+      REQUIRE(ids->span_id == root.id());
+    }
+    REQUIRE(!active_span_ids());
+  }
+
+  SECTION("are per thread") {
+    auto span = tracer.create_span();
+    ActiveSpan scope{span};
+    bool other_thread_has_ids = true;
+    std::thread([&]() { other_thread_has_ids = bool(active_span_ids()); })
+        .join();
+    REQUIRE(!other_thread_has_ids);
+  }
+
+  SECTION("can be read by a signal handler") {
+    auto span = tracer.create_span();
+    ActiveSpan scope{span};
+    const auto previous = std::signal(SIGUSR1, read_ids);
+    REQUIRE(previous != SIG_ERR);
+    ids_in_handler.reset();
+    std::raise(SIGUSR1);
+    std::signal(SIGUSR1, previous);
+    REQUIRE(ids_in_handler);
+    REQUIRE(ids_in_handler->span_id == span.id());
+    REQUIRE(ids_in_handler->trace_id == span.trace_id());
+  }
+}
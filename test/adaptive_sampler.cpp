@@ -0,0 +1,89 @@
+#include <datadog/adaptive_sampler.h>
+#include <datadog/clock.h>
+#include <datadog/span_data.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+SpanData root(std::string resource, bool error = false) {
+  SpanData span;
+  span.service = "testsvc";
+  span.resource = std::move(resource);
+  span.error = error;
+  return span;
+}
+
+}  // namespace
+
+TEST_CASE("adaptive sampler") {
+  TimePoint current_time = default_clock();
+  auto clock = [&current_time]() { return current_time; };
+  // The target is 100 spans per second, and each trace has two spans, so the
+  // budget is 50 traces per second.
+  AdaptiveSampler sampler{clock, 100};
+
+  // Count the specified number of traces of the specified `span` over one
+  // second, and then adapt.
+  const auto second = [&](const SpanData& span, std::size_t traces) {
+    for (std::size_t i = 0; i < traces; ++i) {
+      sampler.decide(span);
+    }
+    sampler.count_spans(2 * traces);
+  };
+  const auto adapt = [&]() {
+    current_time += std::chrono::seconds(1);
+    sampler.adapt();
+  };
+
+  SECTION("keeps new groups entirely") {
+    REQUIRE(sampler.decide(root("/new")).rate == 1.0);
+  }
+
+  SECTION("keeps everything under the target") {
+    second(root("/a"), 10);
+    second(root("/b"), 10);
+    adapt();
+    REQUIRE(sampler.decide(root("/a")).rate == 1.0);
+    REQUIRE(sampler.decide(root("/b")).rate == 1.0);
+  }
+
+  SECTION("favors rare groups over busy ones") {
+    second(root("/busy"), 1000);
+    second(root("/rare"), 10);
+    second(root("/busy", true), 5);
+    adapt();
+    // The rare groups are kept entirely, and the busy group gets what's left
+    // of the budget.  Spans per trace is measured as two.
+    REQUIRE(sampler.decide(root("/rare")).rate == 1.0);
+    REQUIRE(sampler.decide(root("/busy", true)).rate == 1.0);
+    const double busy_rate = sampler.decide(root("/busy")).rate;
+    REQUIRE(busy_rate == Approx((50.0 - 10 - 5) / 1000));
+  }
+
+  SECTION("splits the budget among busy groups") {
+    second(root("/a"), 1000);
+    second(root("/b"), 500);
+    adapt();
+    REQUIRE(sampler.decide(root("/a")).rate == Approx(25.0 / 1000));
+    REQUIRE(sampler.decide(root("/b")).rate == Approx(25.0 / 500));
+  }
+
+  SECTION("forgets groups that go quiet") {
+    second(root("/a"), 1000);
+    adapt();
+    REQUIRE(sampler.decide(root("/a")).rate < 1.0);
+    // The decision above counted one trace.  Traffic then stops, and so
+    // smoothed traffic eventually falls below the threshold.
+    for (int i = 0; i < 20; ++i) {
+      adapt();
+    }
+    REQUIRE(sampler.decide(root("/a")).rate == 1.0);
+  }
+}
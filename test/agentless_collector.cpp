@@ -0,0 +1,401 @@
+// These are tests for `AgentlessCollector`, which sends traces directly to the
+// Datadog intake, and for its configuration.  The request bodies are decoded
+// by a minimal protobuf decoder.
+
+#include <datadog/agentless_collector.h>
+#include <datadog/agentless_collector_config.h>
+#include <datadog/span.h>
+#include <datadog/span_data.h>
+#include <datadog/tags.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// For the lifetime of this object, set a specified environment variable.
+// Restore any previous value (or unset the value if it was unset) afterward.
+class EnvGuard {
+  std::string name_;
+  std::optional<std::string> former_value_;
+
+ public:
+  EnvGuard(std::string name, std::string value) : name_(std::move(name)) {
+    if (const char* current = std::getenv(name_.c_str())) {
+      former_value_ = current;
+    }
+    ::setenv(name_.c_str(), value.c_str(), 1);
+  }
+
+  ~EnvGuard() {
+    if (former_value_) {
+      ::setenv(name_.c_str(), former_value_->c_str(), 1);
+    } else {
+      ::unsetenv(name_.c_str());
+    }
+  }
+};
+
+// `Message` is a decoded protobuf message: each field's number mapped to its
+// values.  A varint or double is kept in `number`, and a string or embedded
+// message in `bytes`.
+struct Value {
+  std::uint64_t number = 0;
+  double real = 0;
+  std::string bytes;
+};
+using Message = std::multimap<std::uint32_t, Value>;
+
+std::uint64_t decode_varint(std::string_view& input) {
+  std::uint64_t result = 0;
+  int shift = 0;
+  while (true) {
+    REQUIRE(!input.empty());
+    const auto byte = static_cast<unsigned char>(input.front());
+    input.remove_prefix(1);
+    result |= std::uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return result;
+    }
+    shift += 7;
+  }
+}
+
+Message decode(std::string_view input) {
+  Message result;
+  while (!input.empty()) {
+    const auto tag = decode_varint(input);
+    Value value;
+    switch (tag & 7) {
+      case 0:
+        value.number = decode_varint(input);
+        break;
+      case 1: {
+        REQUIRE(input.size() >= 8);
+        std::uint64_t bits = 0;
+        for (int i = 7; i >= 0; --i) {
+          bits = (bits << 8) | static_cast<unsigned char>(input[i]);
+        }
+        std::memcpy(&value.real, &bits, sizeof bits);
+        input.remove_prefix(8);
+        break;
+      }
+      case 2: {
+        const auto length = decode_varint(input);
+        REQUIRE(input.size() >= length);
+        value.bytes = std::string(input.substr(0, length));
+        input.remove_prefix(length);
+        break;
+      }
+      default:
+        FAIL("unexpected wire type " << (tag & 7));
+    }
+    result.emplace(std::uint32_t(tag >> 3), std::move(value));
+  }
+  return result;
+}
+
+// Return the embedded messages of the specified `field` of `message`.
+std::vector<Message> messages(const Message& message, std::uint32_t field) {
+  std::vector<Message> result;
+  const auto [begin, end] = message.equal_range(field);
+  for (auto entry = begin; entry != end; ++entry) {
+    result.push_back(decode(entry->second.bytes));
+  }
+  return result;
+}
+
+// Return the single value of the specified `field` of `message`.
+const Value& only(const Message& message, std::uint32_t field) {
+  REQUIRE(message.count(field) == 1);
+  return message.find(field)->second;
+}
+
+// Return the entries of the map in the specified `field` of `message`, whose
+// values are strings.
+std::map<std::string, std::string> string_map(const Message& message,
+                                              std::uint32_t field) {
+  std::map<std::string, std::string> result;
+  for (const auto& entry : messages(message, field)) {
+    result[only(entry, 1).bytes] = only(entry, 2).bytes;
+  }
+  return result;
+}
+
+// Return the spans of all of the trace chunks in the specified
+// "AgentPayload" `body`.
+std::vector<Message> spans(const std::string& body) {
+  std::vector<Message> result;
+  for (const auto& tracer_payload : messages(decode(body), 5)) {
+    for (const auto& chunk : messages(tracer_payload, 6)) {
+      for (auto& span : messages(chunk, 3)) {
+        result.push_back(std::move(span));
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("AgentlessCollectorConfig") {
+  AgentlessCollectorConfig config;
+  config.http_client = std::make_shared<MockHTTPClient>();
+  config.event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto logger = std::make_shared<NullLogger>();
+
+  SECTION("requires an API key") {
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::AGENTLESS_MISSING_API_KEY);
+  }
+
+  SECTION("sends to the intake of the site") {
+    config.api_key = "key";
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    REQUIRE(finalized->url.scheme == "https");
+    REQUIRE(finalized->url.authority == "trace.agent.datadoghq.com");
+    REQUIRE(finalized->url.path == "/api/v0.2/traces");
+
+    config.site = "datadoghq.eu";
+    finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    REQUIRE(finalized->url.authority == "trace.agent.datadoghq.eu");
+  }
+
+  SECTION("environment variables override") {
+    EnvGuard api_key{"DD_API_KEY", "env-key"};
+    EnvGuard site{"DD_SITE", "us3.datadoghq.com"};
+    config.api_key = "key";
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    REQUIRE(finalized->api_key == "env-key");
+    REQUIRE(finalized->url.authority == "trace.agent.us3.datadoghq.com");
+  }
+
+  SECTION("a URL replaces the site") {
+    config.api_key = "key";
+    config.url = "http://proxy:8080/intake/";
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    REQUIRE(finalized->url.scheme == "http");
+    REQUIRE(finalized->url.authority == "proxy:8080");
+    REQUIRE(finalized->url.path == "/intake/api/v0.2/traces");
+
+    config.url = "proxy";
+    REQUIRE(!finalize_config(config, logger));
+  }
+
+  SECTION("rejects invalid values") {
+    config.api_key = "key";
+    Error::Code expected{};
+    SECTION("flush interval") {
+      config.flush_interval_milliseconds = 0;
+      expected = Error::AGENTLESS_INVALID_FLUSH_INTERVAL;
+    }
+    SECTION("payload size") {
+      config.max_payload_bytes = 0;
+      expected = Error::AGENTLESS_INVALID_MAX_PAYLOAD_BYTES;
+    }
+    SECTION("compression level") {
+      config.compression_level = 10;
+      expected = Error::AGENTLESS_INVALID_COMPRESSION_LEVEL;
+    }
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == expected);
+  }
+}
+
+TEST_CASE("AgentlessCollector") {
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  const auto scheduler = std::make_shared<MockEventScheduler>();
+  const auto logger = std::make_shared<MockLogger>();
+  AgentlessCollectorConfig config;
+  config.http_client = http_client;
+  config.event_scheduler = scheduler;
+  config.api_key = "secret";
+  config.compression = PayloadCompression::NONE;
+  http_client->response_status = 202;
+
+  SECTION("sends traces to the intake") {
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    const auto collector =
+        std::make_shared<AgentlessCollector>(*finalized, logger);
+    REQUIRE(scheduler->recurrence_interval == std::chrono::seconds(2));
+    REQUIRE(collector->config_json()["config"].dump().find("secret") ==
+            std::string::npos);
+
+    TracerConfig tracer_config;
+    tracer_config.defaults.service = "testsvc";
+    tracer_config.defaults.environment = "prod";
+    tracer_config.defaults.version = "1.2.3";
+    tracer_config.collector = collector;
+    tracer_config.logger = logger;
+    auto finalized_tracer = finalize_config(tracer_config);
+    REQUIRE(finalized_tracer);
+    Tracer tracer{*finalized_tracer};
+    {
+      auto root = tracer.create_span();
+      root.set_name("parent");
+      auto child = root.create_child();
+      child.set_name("child");
+    }
+    REQUIRE(http_client->requests.empty());
+    scheduler->event_callback();
+    REQUIRE(http_client->requests.size() == 1);
+
+    const auto& request = http_client->requests.front();
+    REQUIRE(request.url.path == "/api/v0.2/traces");
+    REQUIRE(request.headers.at("DD-Api-Key") == "secret");
+    REQUIRE(request.headers.at("Content-Type") == "application/x-protobuf");
+    REQUIRE(request.headers.count("Content-Encoding") == 0);
+
+    const auto payload = decode(request.body);
+    REQUIRE(only(payload, 2).bytes == "prod");
+    const auto tracer_payloads = messages(payload, 5);
+    REQUIRE(tracer_payloads.size() == 1);
+    const auto& tracer_payload = tracer_payloads.front();
+    REQUIRE(only(tracer_payload, 2).bytes == "cpp");
+    REQUIRE(only(tracer_payload, 8).bytes == "prod");
+    REQUIRE(only(tracer_payload, 10).bytes == "1.2.3");
+    const auto chunks = messages(tracer_payload, 6);
+    REQUIRE(chunks.size() == 1);
+    REQUIRE(only(chunks.front(), 1).number == 1);  // priority: auto keep
+
+    const auto decoded = spans(request.body);
+    REQUIRE(decoded.size() == 2);
+    std::map<std::string, const Message*> by_name;
+    for (const auto& span : decoded) {
+      by_name[only(span, 2).bytes] = &span;
+      REQUIRE(only(span, 1).bytes == "testsvc");
+    }
+    const Message& parent = *by_name.at("parent");
+    const Message& child = *by_name.at("child");
+    REQUIRE(only(child, 4).number == only(parent, 4).number);
+    REQUIRE(only(child, 6).number == only(parent, 5).number);
+    REQUIRE(string_map(parent, 10).at("env") == "prod");
+    REQUIRE(logger->error_count() == 0);
+  }
+
+  SECTION("sends the origin") {
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    AgentlessCollector collector{*finalized, logger};
+    std::vector<std::unique_ptr<SpanData>> trace;
+    trace.push_back(std::make_unique<SpanData>());
+    trace.back()->numeric_tags.insert_or_assign(
+        tags::internal::sampling_priority, 2);
+    REQUIRE(
+        collector.send_with_origin(std::move(trace), nullptr, "synthetics"));
+    REQUIRE(collector.flush(std::chrono::steady_clock::time_point::max()));
+    const auto& body = http_client->requests.front().body;
+    const auto chunk = messages(messages(decode(body), 5).front(), 6).front();
+    REQUIRE(only(chunk, 1).number == 2);
+    REQUIRE(only(chunk, 2).bytes == "synthetics");
+    REQUIRE(string_map(spans(body).front(), 10).at("_dd.origin") ==
+            "synthetics");
+  }
+
+  SECTION("sends only the spans of dropped traces kept by span sampling") {
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    AgentlessCollector collector{*finalized, logger};
+    const auto dropped_trace = [](bool span_sampled) {
+      std::vector<std::unique_ptr<SpanData>> trace;
+      trace.push_back(std::make_unique<SpanData>());
+      trace.back()->numeric_tags.insert_or_assign(
+          tags::internal::sampling_priority, -1);
+      trace.push_back(std::make_unique<SpanData>());
+      trace.back()->name = "kept";
+      if (span_sampled) {
+        trace.back()->numeric_tags.insert_or_assign(
+            tags::internal::span_sampling_mechanism, 8);
+      }
+      return trace;
+    };
+    REQUIRE(collector.send(dropped_trace(false), nullptr));
+    REQUIRE(collector.flush(std::chrono::steady_clock::time_point::max()));
+    REQUIRE(http_client->requests.empty());
+
+    REQUIRE(collector.send(dropped_trace(true), nullptr));
+    REQUIRE(collector.flush(std::chrono::steady_clock::time_point::max()));
+    REQUIRE(http_client->requests.size() == 1);
+    const auto& body = http_client->requests.front().body;
+    const auto chunk = messages(messages(decode(body), 5).front(), 6).front();
+    REQUIRE(only(chunk, 5).number == 1);  // droppedTrace
+    const auto decoded = spans(body);
+    REQUIRE(decoded.size() == 1);
+    REQUIRE(only(decoded.front(), 2).bytes == "kept");
+  }
+
+  SECTION("splits batches at the maximum payload size") {
+    config.max_payload_bytes = 400;
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    AgentlessCollector collector{*finalized, logger};
+    const auto trace = []() {
+      std::vector<std::unique_ptr<SpanData>> spans;
+      spans.push_back(std::make_unique<SpanData>());
+      spans.back()->resource = std::string(100, 'x');
+      return spans;
+    };
+    // Each chunk takes over a third of a payload, and so the third doesn't fit
+    // with the first two, which are sent without waiting for the flush.
+    REQUIRE(collector.send(trace(), nullptr));
+    REQUIRE(collector.send(trace(), nullptr));
+    REQUIRE(http_client->requests.empty());
+    REQUIRE(collector.send(trace(), nullptr));
+    REQUIRE(http_client->requests.size() == 1);
+    REQUIRE(spans(http_client->requests.front().body).size() == 2);
+    REQUIRE(http_client->requests.front().body.size() <= 400);
+
+    scheduler->event_callback();
+    REQUIRE(http_client->requests.size() == 2);
+    REQUIRE(spans(http_client->requests.back().body).size() == 1);
+  }
+
+  SECTION("compresses payloads") {
+    config.compression = PayloadCompression::GZIP;
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    AgentlessCollector collector{*finalized, logger};
+    std::vector<std::unique_ptr<SpanData>> trace;
+    trace.push_back(std::make_unique<SpanData>());
+    REQUIRE(collector.send(std::move(trace), nullptr));
+    scheduler->event_callback();
+    const auto& request = http_client->requests.front();
+    REQUIRE(request.headers.at("Content-Encoding") == "gzip");
+    REQUIRE(request.body.substr(0, 2) == "\x1f\x8b");
+  }
+
+  SECTION("logs unexpected responses") {
+    auto finalized = finalize_config(config, logger);
+    REQUIRE(finalized);
+    AgentlessCollector collector{*finalized, logger};
+    std::vector<std::unique_ptr<SpanData>> trace;
+    trace.push_back(std::make_unique<SpanData>());
+    REQUIRE(collector.send(std::move(trace), nullptr));
+    http_client->response_status = 403;
+    REQUIRE(collector.flush(std::chrono::steady_clock::time_point::max()));
+    REQUIRE(logger->error_count() == 1);
+  }
+}
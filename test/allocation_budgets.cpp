@@ -0,0 +1,201 @@
+// These tests check the number of heap allocations made by common tracer
+// operations against a budget for each.  The allocations are counted by
+// `AllocationCounter`, defined in `allocation_counter.h`.
+//
+// The budgets are those of the current implementation (using libstdc++).  A
+// change that makes an operation allocate more fails here; a change that makes
+// it allocate less should lower the operation's budget.
+//
+// Each operation is performed once before it's counted, so that allocations
+// made only the first time (e.g. growing a buffer that's then reused) aren't
+// counted.
+
+#include <datadog/dict_writer.h>
+#include <datadog/indexed_dict_reader.h>
+#include <datadog/null_collector.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "allocation_counter.h"
+#include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+FinalizedTracerConfig make_config() {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.environment = "dev";
+  config.defaults.version = "1.0";
+  config.collector = std::make_shared<NullCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  return *finalized;
+}
+
+// Return the number of allocations made by the specified `operation` when
+// it's invoked the second time.
+template <typename Operation>
+std::uint64_t allocations_of(Operation&& operation) {
+  operation();
+  const AllocationCounter allocations;
+  operation();
+  return allocations.count();
+}
+
+}  // namespace
+
+TEST_CASE("AllocationCounter counts the current thread's allocations") {
+  const AllocationCounter allocations;
+  REQUIRE(allocations.count() == 0);
+  auto one = std::make_unique<int>(1);
+  auto many = std::make_unique<int[]>(1000);
+  REQUIRE(allocations.count() == 2);
+}
+
+TEST_CASE("allocation budgets") {
+  Tracer tracer{make_config()};
+
+  SECTION("create a root span and finish it") {
+    REQUIRE(allocations_of([&]() { tracer.create_span(); }) <= 2);
+  }
+
+  SECTION("create a child span, set five tags, and finish it") {
+    std::optional<Span> root{tracer.create_span()};
+    const auto count = allocations_of([&]() {
+      auto child = root->create_child();
+      child.set_tag("http.method", "GET");
+      child.set_tag("http.route", "/users/:id");
+      child.set_tag("http.status_code", "200");
+      child.set_tag("component", "http");
+      child.set_tag("span.kind", "server");
+    });
+    REQUIRE(count <= 1);
+  }
+
+  SECTION("overwrite a tag") {
+    auto span = tracer.create_span();
+    REQUIRE(allocations_of([&]() { span.set_tag("foo", "bar"); }) == 0);
+  }
+
+  SECTION("create a child span with a configuration and finish it") {
+    std::optional<Span> root{tracer.create_span()};
+    SpanConfig config;
+    config.name = "sha256.file";
+    config.resource = "/srv/data/file.txt";
+    REQUIRE(allocations_of([&]() { root->create_child(config); }) <= 1);
+  }
+
+  SECTION("create a child span with a configuration view and finish it") {
+    std::optional<Span> root{tracer.create_span()};
+    // Unlike the `SpanConfig` above, the view is built within the budget.
+    const std::string resource = "/srv/data/file.txt";
+    REQUIRE(allocations_of([&]() {
+              SpanConfigView config;
+              config.name = "sha256.file";
+              config.resource = resource;
+              config.tags.emplace("component", "crypto");
+              root->create_child(config);
+            }) <= 1);
+  }
+
+  SECTION("extract a span and finish it") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "4942614562549416309"},
+        {"x-datadog-parent-id", "6756151711809114196"},
+        {"x-datadog-sampling-priority", "1"},
+        {"x-datadog-tags", "_dd.p.dm=-4"},
+    };
+    const MockDictReader reader{headers};
+    bool extracted = false;
+    // Most of these are `MockDictReader` copying each header name that's
+    // looked up, including "x-datadog-delegate-trace-sampling".
+    REQUIRE(allocations_of([&]() {
+              extracted = bool(tracer.extract_span(reader));
+            }) <= 7);
+    REQUIRE(extracted);
+  }
+
+  SECTION("inject a span") {
+    auto span = tracer.create_span();
+    MockDictWriter writer;
+    REQUIRE(allocations_of([&]() { span.inject(writer); }) <= 5);
+  }
+
+  SECTION("propagate trace context without a span") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "4942614562549416309"},
+        {"x-datadog-parent-id", "6756151711809114196"},
+        {"x-datadog-sampling-priority", "1"},
+        {"x-datadog-origin", "synthetics-browser"},
+        {"x-datadog-tags", "_dd.p.dm=-4,_dd.p.tid=66d2f1a800000000"},
+    };
+    // Unlike `MockDictReader`, an `IndexedDictReader` looks up headers
+    // without allocating, and so does `CountingDictWriter`.
+    const IndexedDictReader reader{MockDictReader{headers}};
+    struct CountingDictWriter : public DictWriter {
+      std::size_t count = 0;
+      void set(std::string_view, std::string_view) override { ++count; }
+    } writer;
+    bool propagated = false;
+    REQUIRE(allocations_of([&]() {
+              propagated = bool(tracer.propagate(reader, writer, true));
+            }) == 0);
+    REQUIRE(propagated);
+    REQUIRE(writer.count != 0);
+  }
+
+  SECTION("encode a span") {
+    SpanData span;
+    span.service = "testsvc";
+    span.name = "sha256.request";
+    span.resource = "/srv/data";
+    span.tags.emplace("http.method", "GET");
+    span.numeric_tags.emplace("_sampling_priority_v1", 1);
+    std::string buffer;
+    bool encoded = false;
+    REQUIRE(allocations_of([&]() {
+              buffer.clear();
+              encoded = bool(msgpack_encode(buffer, span));
+            }) == 0);
+    REQUIRE(encoded);
+  }
+}
+
+TEST_CASE("a disabled tracer allocates nothing") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  config.report_traces = false;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const std::unordered_map<std::string, std::string> headers{
+      {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+  MockDictReader reader{headers};
+  MockDictWriter writer;
+  REQUIRE(allocations_of([&]() {
+            auto root = tracer.create_span();
+            auto child = root.create_child();
+            child.set_tag("http.method", "GET");
+            child.set_error_message("oops");
+            child.inject(writer);
+            auto extracted = tracer.extract_span(reader);
+          }) == 0);
+}
@@ -0,0 +1,107 @@
+#include "allocation_counter.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace {
+
+// The counters have constant initialization, and so they're safe to use from
+// `operator new` in any thread, at any time.
+thread_local std::uint64_t allocations = 0;
+thread_local std::int64_t live_count = 0;
+thread_local std::int64_t live_size = 0;
+
+std::int64_t granted_size(void* memory) {
+#ifdef __GLIBC__
+  return std::int64_t(malloc_usable_size(memory));
+#else
+  (void)memory;
+  return 0;
+#endif
+}
+
+void* allocated(void* memory) {
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  ++live_count;
+  live_size += granted_size(memory);
+  return memory;
+}
+
+void deallocate(void* memory) {
+  if (memory) {
+    --live_count;
+    live_size -= granted_size(memory);
+  }
+  std::free(memory);
+}
+
+void* allocate(std::size_t size) {
+  ++allocations;
+  return allocated(std::malloc(size ? size : 1));
+}
+
+void* allocate(std::size_t size, std::align_val_t alignment) {
+  ++allocations;
+  const auto align = static_cast<std::size_t>(alignment);
+  // `std::aligned_alloc` requires that the size be a multiple of the
+  // alignment.
+  const std::size_t rounded = (size + align - 1) / align * align;
+  return allocated(std::aligned_alloc(align, rounded ? rounded : align));
+}
+
+}  // namespace
+
+std::uint64_t thread_allocation_count() { return allocations; }
+
+bool allocation_bytes_supported() {
+#ifdef __GLIBC__
+  return true;
+#else
+  return false;
+#endif
+}
+
+AllocationCounter::AllocationCounter()
+    : start_(allocations),
+      start_live_(live_count),
+      start_live_bytes_(live_size) {}
+
+std::uint64_t AllocationCounter::count() const { return allocations - start_; }
+
+std::int64_t AllocationCounter::live_allocations() const {
+  return live_count - start_live_;
+}
+
+std::int64_t AllocationCounter::live_bytes() const {
+  return live_size - start_live_bytes_;
+}
+
+// The remaining replaceable forms of `operator new` and `operator delete`
+// (arrays and `std::nothrow_t`) are by default implemented in terms of these.
+
+void* operator new(std::size_t size) { return allocate(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return allocate(size, alignment);
+}
+
+void operator delete(void* memory) noexcept { deallocate(memory); }
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+  deallocate(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+  deallocate(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+  deallocate(memory);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// This component provides a class, `AllocationCounter`, that counts the heap
+// allocations made by the current thread while it exists.
+//
+// `allocation_counter.cpp` replaces the global `operator new` and
+// `operator delete` with versions that count each allocation in a thread-local
+// variable.  Linking `allocation_counter.cpp` into a program is what enables
+// the counting; the program's other code needn't change.  The library
+// allocates via `operator new`, so its allocations are all counted, as are any
+// made by the standard library on its behalf.
+//
+// The current thread's live allocations, and the bytes that the allocator
+// granted them, are counted as well, so that the memory retained by objects
+// can be measured (see `benchmark/memory_footprint.cpp`).  Memory freed by
+// another thread than the one that allocated it is subtracted from the
+// freeing thread's counts.  The granted size of an allocation is known only
+// with glibc (see `malloc_usable_size`); elsewhere, bytes aren't counted.
+
+#include <cstddef>
+#include <cstdint>
+
+// Return the number of allocations made by the current thread so far.
+std::uint64_t thread_allocation_count();
+
+// Return whether the bytes of allocations are counted.
+bool allocation_bytes_supported();
+
+// The allocator's bookkeeping for each allocation, in addition to the bytes
+// granted, e.g. glibc's chunk header.
+constexpr std::size_t allocation_header_bytes = sizeof(std::size_t);
+
+class AllocationCounter {
+  std::uint64_t start_;
+  std::int64_t start_live_;
+  std::int64_t start_live_bytes_;
+
+ public:
+  AllocationCounter();
+
+  // Return the number of allocations made by the current thread since this
+  // object was created.
+  std::uint64_t count() const;
+  // Return the net change in the number of the current thread's live
+  // allocations, and in the bytes granted to them, since this object was
+  // created.
+  std::int64_t live_allocations() const;
+  std::int64_t live_bytes() const;
+};
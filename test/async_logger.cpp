@@ -0,0 +1,188 @@
+// These are tests for `AsyncLogger`, which rate limits messages per site and
+// passes them to another `Logger` from a dedicated thread.
+
+#include <datadog/async_logger.h>
+#include <datadog/clock.h>
+#include <datadog/error.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `BlockingLogger` is a `MockLogger` whose `log_error` waits until `release`
+// is called, so that messages accumulate in an `AsyncLogger`'s buffer.
+class BlockingLogger : public MockLogger {
+  std::mutex mutex_;
+  std::condition_variable released_or_entered_;
+  bool released_ = false;
+  bool entered_ = false;
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    entered_ = true;
+    released_or_entered_.notify_all();
+    released_or_entered_.wait(lock, [this]() { return released_; });
+  }
+
+ public:
+  void log_error(const LogFunc& write) override {
+    wait();
+    MockLogger::log_error(write);
+  }
+
+  void log_error(const Error& error) override {
+    wait();
+    MockLogger::log_error(error);
+  }
+
+  // Wait until `log_error` has been called.
+  void wait_until_entered() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_or_entered_.wait(lock, [this]() { return entered_; });
+  }
+
+  void release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    released_ = true;
+    released_or_entered_.notify_all();
+  }
+};
+
+const std::string& text(const MockLogger::Entry& entry) {
+  return std::get<std::string>(entry.payload);
+}
+
+}  // namespace
+
+TEST_CASE("AsyncLogger") {
+  auto logger = std::make_shared<MockLogger>();
+  TimePoint now;
+  const Clock clock = [&now]() { return now; };
+
+  SECTION("passes messages to the decorated logger") {
+    {
+      AsyncLogger async(logger, 10, 1.0, 16, clock);
+      async.log_startup([](std::ostream& log) { log << "starting"; });
+      async.log_error([](std::ostream& log) { log << "oops " << 42; });
+      async.log_error(Error{Error::OTHER, "an error"});
+      async.log_error("a string");
+    }
+    REQUIRE(logger->entries.size() == 4);
+    REQUIRE(logger->entries[0].kind == MockLogger::Entry::STARTUP);
+    REQUIRE(text(logger->entries[0]) == "starting");
+    REQUIRE(text(logger->entries[1]) == "oops 42");
+    const auto& error = std::get<Error>(logger->entries[2].payload);
+    REQUIRE(error.code == Error::OTHER);
+    REQUIRE(error.message == "an error");
+    REQUIRE(text(logger->entries[3]) == "a string");
+  }
+
+  SECTION("rate limits each message site") {
+    int formatted = 0;
+    {
+      AsyncLogger async(logger, 3, 1.0, 16, clock);
+      for (int i = 0; i < 10; ++i) {
+        async.log_error([&](std::ostream& log) {
+          ++formatted;
+          log << "first site";
+        });
+        async.log_error([](std::ostream& log) { log << "second site"; });
+      }
+      // Suppressed messages are not formatted.
+      REQUIRE(formatted == 3);
+
+      now.tick += std::chrono::seconds(1);
+      async.log_error([&](std::ostream& log) {
+        ++formatted;
+        log << "first site";
+      });
+    }
+    // A second later, the first site is allowed one more message.
+    REQUIRE(formatted == 4);
+    REQUIRE(logger->error_count() == 3 + 3 + 1);
+
+    // The lambda expressions, though alike, are distinct sites.
+    int first = 0;
+    int second = 0;
+    for (const auto& entry : logger->entries) {
+      first += text(entry).rfind("first site", 0) == 0;
+      second += text(entry) == "second site";
+    }
+    REQUIRE(first == 4);
+    REQUIRE(second == 3);
+  }
+
+  SECTION("notes how many messages were suppressed") {
+    {
+      AsyncLogger async(logger, 1, 1.0, 16, clock);
+      for (int i = 0; i < 5; ++i) {
+        async.log_error(Error{Error::OTHER, "flood"});
+      }
+      now.tick += std::chrono::seconds(1);
+      async.log_error(Error{Error::OTHER, "flood"});
+    }
+    REQUIRE(logger->error_count() == 2);
+    REQUIRE(std::get<Error>(logger->entries[0].payload).message == "flood");
+    REQUIRE(std::get<Error>(logger->entries[1].payload).message ==
+            "flood [4 similar messages were suppressed]");
+  }
+
+  SECTION("does not rate limit startup messages") {
+    {
+      AsyncLogger async(logger, 1, 1.0, 16, clock);
+      for (int i = 0; i < 5; ++i) {
+        async.log_startup([](std::ostream& log) { log << "hello"; });
+      }
+    }
+    REQUIRE(logger->startup_count() == 5);
+  }
+
+  SECTION("discards messages when its buffer is full") {
+    auto blocking = std::make_shared<BlockingLogger>();
+    {
+      AsyncLogger async(blocking, 100, 1.0, 4, clock);
+      async.log_error("first");
+      // The writing thread is now blocked while logging the first message,
+      // whose slot is still occupied, and so the buffer fills up after three
+      // more.
+      blocking->wait_until_entered();
+      for (int i = 0; i < 10; ++i) {
+        async.log_error([i](std::ostream& log) { log << "message " << i; });
+      }
+      blocking->release();
+    }
+    REQUIRE(blocking->error_count() == 1 + 3 + 1);
+    REQUIRE(text(blocking->entries.back()) ==
+            "AsyncLogger discarded 7 messages because its buffer was full.");
+  }
+
+  SECTION("logs from many threads") {
+    {
+      AsyncLogger async(logger, 1000, 1.0, 1024, clock);
+      std::vector<std::thread> threads;
+      for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&async]() {
+          for (int j = 0; j < 100; ++j) {
+            async.log_startup([j](std::ostream& log) { log << j; });
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+    REQUIRE(logger->startup_count() == 400);
+  }
+}
@@ -0,0 +1,44 @@
+// This test covers the `Clock`s defined in `clock.h`.
+
+#include <datadog/clock.h>
+
+#include <chrono>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("coarse_clock is close to default_clock") {
+  const auto precise = default_clock();
+  const auto coarse = coarse_clock();
+  // The coarse clocks lag by at most a scheduler tick, which is allowed
+  // plenty of slack here.
+  const auto slack = std::chrono::milliseconds(100);
+  REQUIRE(coarse.wall <= precise.wall + slack);
+  REQUIRE(coarse.wall >= precise.wall - slack);
+  REQUIRE(coarse.tick <= precise.tick + slack);
+  REQUIRE(coarse.tick >= precise.tick - slack);
+  REQUIRE(coarse_clock().tick >= coarse.tick);
+}
+
+TEST_CASE("anchored clock derives wall time from steady time") {
+  const auto before = default_clock();
+  const Clock clock = make_anchored_clock();
+  const auto first = clock();
+  const auto second = clock();
+  REQUIRE(first.wall >= before.wall);
+  REQUIRE(second.tick >= first.tick);
+  REQUIRE(second.wall - first.wall ==
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              second.tick - first.tick));
+}
+
+TEST_CASE("make_clock") {
+  const auto source = GENERATE(ClockSource::DEFAULT, ClockSource::COARSE,
+                               ClockSource::ANCHORED);
+  const Clock clock = make_clock(source);
+  REQUIRE(clock);
+  const auto now = clock();
+  const auto precise = default_clock();
+  REQUIRE(now.tick <= precise.tick + std::chrono::milliseconds(100));
+}
@@ -0,0 +1,157 @@
+// These are tests for `CompactSpans`, which encodes finished spans compactly
+// until they're sent.
+
+#include <datadog/compact_spans.h>
+#include <datadog/gzip.h>
+#include <datadog/span_data.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Return spans of a trace having the specified `count` spans, having every
+// kind of property.
+std::vector<std::unique_ptr<SpanData>> make_spans(int count) {
+  static const int return_address = 0;
+  std::vector<std::unique_ptr<SpanData>> spans;
+  for (int i = 0; i < count; ++i) {
+    auto& span = *spans.emplace_back(std::make_unique<SpanData>());
+    span.service = "testsvc";
+    span.service_type = "db";
+    span.name = "query";
+    span.resource = "SELECT " + std::to_string(i);
+    span.trace_id = TraceID{0xCAFEBABE, 0xDEADBEEF};
+    span.span_id = 1000 + i;
+    span.parent_id = i == 0 ? 0 : 1000;
+    span.start = default_clock();
+    span.duration = std::chrono::microseconds(i);
+    span.error = i % 2 == 1;
+    span.tags.insert_or_assign("component", "database");
+    span.tags.insert_or_assign("db.row_count", std::to_string(i * 7));
+    span.tags.insert_or_assign(
+        "a.tag.name.longer.than.an.inline.tag.key", std::string(100, 'x'));
+    span.numeric_tags.insert_or_assign("_dd.measured", 1);
+    span.numeric_tags.insert_or_assign("rows", -0.5 * i);
+    span.marks[0] = SpanMark{"connected", std::chrono::nanoseconds(i)};
+    span.marks[1] = SpanMark{"queried", std::chrono::nanoseconds(-i)};
+    span.mark_count = 2;
+    span.error_stack_addresses = {&return_address, &spans};
+  }
+  return spans;
+}
+
+void require_equal(const SpanData& actual, const SpanData& expected) {
+  REQUIRE(actual.service == expected.service);
+  REQUIRE(actual.service_type == expected.service_type);
+  REQUIRE(actual.name == expected.name);
+  REQUIRE(actual.resource == expected.resource);
+  REQUIRE(actual.trace_id == expected.trace_id);
+  REQUIRE(actual.span_id == expected.span_id);
+  REQUIRE(actual.parent_id == expected.parent_id);
+  REQUIRE(actual.start.wall == expected.start.wall);
+  REQUIRE(actual.start.tick == expected.start.tick);
+  REQUIRE(actual.duration == expected.duration);
+  REQUIRE(actual.error == expected.error);
+  REQUIRE(actual.tags == expected.tags);
+  REQUIRE(actual.numeric_tags == expected.numeric_tags);
+  REQUIRE(actual.mark_count == expected.mark_count);
+  for (std::size_t i = 0; i < expected.mark_count; ++i) {
+    // The names are the same strings, not just equal strings.
+    REQUIRE(actual.marks[i].name.data() == expected.marks[i].name.data());
+    REQUIRE(actual.marks[i].name.size() == expected.marks[i].name.size());
+    REQUIRE(actual.marks[i].offset == expected.marks[i].offset);
+  }
+  REQUIRE(actual.error_stack_addresses == expected.error_stack_addresses);
+}
+
+}  // namespace
+
+TEST_CASE("CompactSpans") {
+  CompactSpans compact;
+  REQUIRE(compact.empty());
+  REQUIRE(compact.bytes() == 0);
+
+  const auto first = make_spans(3);
+  const auto second = make_spans(50);
+  const bool compress = GENERATE(false, true);
+  CAPTURE(compress);
+  compact.add(first, compress);
+  compact.add(second, compress);
+  REQUIRE(compact.size() == 53);
+  REQUIRE(compact.bytes() > 0);
+
+  SECTION("round trips spans in order, appending them") {
+    std::vector<std::unique_ptr<SpanData>> spans;
+    spans.push_back(std::make_unique<SpanData>());
+    REQUIRE(compact.take(spans));
+    REQUIRE(compact.empty());
+    REQUIRE(compact.size() == 0);
+    REQUIRE(compact.bytes() == 0);
+
+    REQUIRE(spans.size() == 54);
+    for (std::size_t i = 0; i < first.size(); ++i) {
+      require_equal(*spans[1 + i], *first[i]);
+    }
+    for (std::size_t i = 0; i < second.size(); ++i) {
+      require_equal(*spans[1 + first.size() + i], *second[i]);
+    }
+  }
+
+  SECTION("is smaller than the spans") {
+    std::size_t span_bytes = 0;
+    for (const auto* spans : {&first, &second}) {
+      for (const auto& span : *spans) {
+        span_bytes += approximate_size(*span);
+      }
+    }
+    REQUIRE(compact.bytes() < span_bytes / 2);
+  }
+}
+
+TEST_CASE("CompactSpans compression") {
+  REQUIRE(gzip_supported());
+  CompactSpans uncompressed;
+  CompactSpans compressed;
+  uncompressed.add(make_spans(100), false);
+  compressed.add(make_spans(100), true);
+  REQUIRE(compressed.bytes() < uncompressed.bytes() / 2);
+}
+
+TEST_CASE("CompactSpans ignores an empty batch") {
+  CompactSpans compact;
+  compact.add({}, true);
+  REQUIRE(compact.empty());
+  REQUIRE(compact.bytes() == 0);
+}
+
+TEST_CASE("CompactSpans pools short strings across blocks") {
+  CompactSpans compact;
+  const auto first = make_spans(5);
+  const auto second = make_spans(5);
+  compact.add(first, false);
+  const std::size_t first_block_bytes = compact.bytes();
+  compact.add(second, false);
+  // The second block refers to the strings that the first block pooled, and
+  // so it, with no additions to the pool, is smaller.
+  REQUIRE(compact.bytes() - first_block_bytes < first_block_bytes * 3 / 4);
+
+  std::vector<std::unique_ptr<SpanData>> spans;
+  REQUIRE(compact.take(spans));
+  REQUIRE(spans.size() == 10);
+  for (std::size_t i = 0; i < 5; ++i) {
+    require_equal(*spans[i], *first[i]);
+    require_equal(*spans[5 + i], *second[i]);
+  }
+
+  // Taking the spans releases the pool, and the spans compacted next start a
+  // new one.
+  compact.add(first, false);
+  REQUIRE(compact.bytes() == first_block_bytes);
+}
@@ -0,0 +1,78 @@
+// These are tests for `ContainerDictReader`, the `DictReader` adapter for
+// containers of HTTP header fields.
+
+#include <datadog/container_dict_reader.h>
+#include <datadog/indexed_dict_reader.h>
+
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+template <typename Container>
+std::vector<std::pair<std::string, std::string>> visited(
+    const ContainerDictReader<Container>& reader) {
+  std::vector<std::pair<std::string, std::string>> result;
+  reader.visit([&](std::string_view key, std::string_view value) {
+    result.emplace_back(key, value);
+  });
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("ContainerDictReader") {
+  SECTION("maps of strings") {
+    const std::map<std::string, std::string> headers{
+        {"Content-Type", "text/plain"}, {"X-Datadog-Trace-ID", "123"}};
+    const ContainerDictReader reader{headers};
+
+    REQUIRE(reader.lookup("x-datadog-trace-id") == "123");
+    REQUIRE(reader.lookup("CONTENT-TYPE") == "text/plain");
+    REQUIRE(!reader.lookup("x-datadog-parent-id"));
+    REQUIRE(reader.prefer_visit());
+    REQUIRE(visited(reader) ==
+            std::vector<std::pair<std::string, std::string>>{
+                {"Content-Type", "text/plain"}, {"X-Datadog-Trace-ID", "123"}});
+  }
+
+  SECTION("sequences of pairs, where the first occurrence wins") {
+    const std::vector<std::pair<std::string_view, std::string_view>> headers{
+        {"b3", "first"}, {"B3", "second"}};
+    const ContainerDictReader reader{headers};
+
+    REQUIRE(reader.lookup("b3") == "first");
+    REQUIRE(visited(reader).size() == 2);
+  }
+
+  SECTION("maps of lists of values use the first value") {
+    const std::unordered_map<std::string, std::vector<std::string>> headers{
+        {"traceparent", {"first", "second"}}, {"tracestate", {}}};
+    const ContainerDictReader reader{headers};
+
+    REQUIRE(reader.lookup("TraceParent") == "first");
+    REQUIRE(!reader.lookup("tracestate"));
+    REQUIRE(visited(reader) ==
+            std::vector<std::pair<std::string, std::string>>{
+                {"traceparent", "first"}});
+  }
+
+  SECTION("can be indexed") {
+    const std::multimap<std::string, std::string> headers{
+        {"X-B3-TraceId", "abc"}, {"X-B3-Sampled", "1"}, {"Accept", "*/*"}};
+    const ContainerDictReader reader{headers};
+    const IndexedDictReader indexed{reader};
+
+    REQUIRE(indexed.lookup("x-b3-traceid") == "abc");
+    REQUIRE(indexed.lookup("x-b3-sampled") == "1");
+    REQUIRE(!indexed.lookup("accept"));
+  }
+}
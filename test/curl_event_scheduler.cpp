@@ -0,0 +1,233 @@
+// These are tests for `curl_event_scheduler`, defined in `curl.h`, which
+// returns an `EventScheduler` whose events are invoked on the thread of a
+// `Curl` HTTP client.
+
+#include <datadog/curl.h>
+#include <datadog/datadog_agent_config.h>
+#include <datadog/event_loop.h>
+#include <datadog/event_scheduler.h>
+#include <datadog/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `Invocations` records which events were invoked, in order, and lets a test
+// wait for them.
+class Invocations {
+  std::mutex mutex_;
+  std::condition_variable invoked_;
+  std::vector<std::string> names_;
+
+ public:
+  // Return a callback that records an invocation of the specified `name`.
+  std::function<void()> callback(std::string name) {
+    return [this, name]() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      names_.push_back(name);
+      invoked_.notify_all();
+    };
+  }
+
+  // Wait until there have been at least the specified `count` invocations,
+  // and return whether there were before the wait timed out.
+  bool wait_for(std::size_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return invoked_.wait_for(lock, std::chrono::seconds(10),
+                             [&]() { return names_.size() >= count; });
+  }
+
+  std::vector<std::string> names() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return names_;
+  }
+
+  std::size_t count(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::count(names_.begin(), names_.end(), name);
+  }
+};
+
+}  // namespace
+
+TEST_CASE("curl_event_scheduler") {
+  // `invocations` outlives the events that refer to it.
+  Invocations invocations;
+  const auto curl = std::make_shared<Curl>(std::make_shared<NullLogger>());
+  const auto scheduler = curl_event_scheduler(curl);
+  REQUIRE(scheduler);
+
+  SECTION("invokes recurring events on the curl thread") {
+    std::thread::id thread;
+    auto cancel = scheduler->schedule_recurring_event(
+        std::chrono::milliseconds(1),
+        [&, record = invocations.callback("a")]() {
+          thread = std::this_thread::get_id();
+          record();
+        });
+    REQUIRE(invocations.wait_for(3));
+    cancel();
+    REQUIRE(thread != std::this_thread::get_id());
+  }
+
+  SECTION("cancel stops an event") {
+    auto cancel = scheduler->schedule_recurring_event(
+        std::chrono::milliseconds(1), invocations.callback("a"));
+    REQUIRE(invocations.wait_for(1));
+    // Cancelling waits for a callback that's running, and so the event isn't
+    // invoked afterward.
+    cancel();
+    const auto count = invocations.names().size();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(invocations.names().size() == count);
+  }
+
+  SECTION("an event can cancel itself") {
+    EventScheduler::Cancel cancel;
+    std::mutex mutex;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancel = scheduler->schedule_recurring_event(
+          std::chrono::milliseconds(1),
+          [&, record = invocations.callback("a")]() {
+            record();
+            std::lock_guard<std::mutex> lock(mutex);
+            cancel();
+          });
+    }
+    REQUIRE(invocations.wait_for(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(invocations.names().size() == 1);
+  }
+
+  SECTION("wake invokes an event now") {
+    // The interval is long enough that only waking invokes the callback.
+    auto event = scheduler->schedule_wakeable_recurring_event(
+        std::chrono::hours(1), invocations.callback("a"));
+    event.wake();
+    REQUIRE(invocations.wait_for(1));
+    event.wake();
+    REQUIRE(invocations.wait_for(2));
+
+    // Waking a cancelled event does nothing.
+    event.cancel();
+    event.wake();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    REQUIRE(invocations.names().size() == 2);
+  }
+
+  SECTION("events are invoked in the order of their first delays") {
+    auto later = scheduler->schedule_jittered_recurring_event(
+        std::chrono::milliseconds(50), std::chrono::hours(1),
+        std::chrono::milliseconds(0), invocations.callback("later"));
+    auto sooner = scheduler->schedule_jittered_recurring_event(
+        std::chrono::milliseconds(1), std::chrono::hours(1),
+        std::chrono::milliseconds(0), invocations.callback("sooner"));
+    REQUIRE(invocations.wait_for(2));
+    later.cancel();
+    sooner.cancel();
+    REQUIRE(invocations.names() ==
+            std::vector<std::string>{"sooner", "later"});
+  }
+
+  SECTION("jitter shortens the interval by at most the jitter") {
+    std::mutex mutex;
+    std::vector<std::chrono::steady_clock::time_point> times;
+    const auto start = std::chrono::steady_clock::now();
+    auto event = scheduler->schedule_jittered_recurring_event(
+        std::chrono::milliseconds(1), std::chrono::milliseconds(100),
+        std::chrono::milliseconds(50),
+        [&, record = invocations.callback("a")]() {
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            times.push_back(std::chrono::steady_clock::now());
+          }
+          record();
+        });
+    REQUIRE(invocations.wait_for(3));
+    event.cancel();
+    std::lock_guard<std::mutex> lock(mutex);
+    REQUIRE(times[0] - start < std::chrono::milliseconds(100));
+    REQUIRE(times[2] - times[0] >= std::chrono::milliseconds(100));
+  }
+
+  SECTION("a stalled event isn't invoked once for each missed interval") {
+    auto cancel_frequent = scheduler->schedule_recurring_event(
+        std::chrono::milliseconds(10), invocations.callback("frequent"));
+    // The stalling event blocks the curl thread for twenty of the frequent
+    // event's intervals.
+    std::size_t before_stall_ends = 0;
+    auto stall = scheduler->schedule_jittered_recurring_event(
+        std::chrono::milliseconds(5), std::chrono::hours(1),
+        std::chrono::milliseconds(0),
+        [&, record = invocations.callback("stall")]() {
+          std::this_thread::sleep_for(std::chrono::milliseconds(200));
+          before_stall_ends = invocations.count("frequent");
+          record();
+        });
+    while (invocations.count("stall") == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    cancel_frequent();
+    stall.cancel();
+    // About three intervals elapsed after the stall.
+    REQUIRE(invocations.count("frequent") - before_stall_ends < 10);
+  }
+
+  SECTION("destroying the scheduler cancels its events") {
+    auto other = curl_event_scheduler(curl);
+    REQUIRE(other);
+    auto cancel = other->schedule_recurring_event(
+        std::chrono::milliseconds(1), invocations.callback("a"));
+    REQUIRE(invocations.wait_for(1));
+    other.reset();
+    const auto count = invocations.names().size();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(invocations.names().size() == count);
+    // Cancelling an event of a destroyed scheduler does nothing.
+    cancel();
+  }
+}
+
+TEST_CASE("curl_event_scheduler without a thread") {
+  // A `Curl` driven by an `EventLoop` has no thread on which to invoke
+  // events.
+  struct NullEventLoop : public EventLoop {
+    void watch_socket(Socket, int, SocketCallback) override {}
+    TimerID start_timer(std::chrono::steady_clock::duration,
+                        std::function<void()>) override {
+      return 1;
+    }
+    void cancel_timer(TimerID) override {}
+    void post(std::function<void()>) override {}
+  };
+
+  const auto curl = std::make_shared<Curl>(std::make_shared<NullLogger>(),
+                                           std::make_shared<NullEventLoop>());
+  REQUIRE(!curl_event_scheduler(curl));
+}
+
+TEST_CASE("single_background_thread uses the curl thread") {
+  // The default HTTP client is a `Curl` that has a thread.
+  DatadogAgentConfig config;
+  config.single_background_thread = true;
+  auto finalized = finalize_config(config, std::make_shared<NullLogger>());
+  REQUIRE(finalized);
+  REQUIRE(finalized->event_scheduler->config_json()["type"] ==
+          "datadog::tracing::CurlEventScheduler");
+}
@@ -1,10 +1,27 @@
+#include <datadog/clock.h>
 #include <datadog/collector_response.h>
+#include <datadog/datadog_agent.h>
 #include <datadog/datadog_agent_config.h>
+#include <datadog/id_generator.h>
+#include <datadog/span_data.h>
+#include <datadog/span_processor.h>
+#include <datadog/span_sampler_config.h>
+#include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
+#include <stdlib.h>
+#include <unistd.h>
 
+#include <chrono>
+#include <cstddef>
+#include <datadog/json.hpp>
+#include <future>
 #include <iostream>
+#include <string>
+#include <unordered_map>
 
+#include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
 #include "mocks/event_schedulers.h"
 #include "mocks/http_clients.h"
 #include "mocks/loggers.h"
@@ -66,6 +83,21 @@ TEST_CASE("CollectorResponse") {
     REQUIRE(logger->error_count() == 0);
   }
 
+  SECTION("other properties are ignored") {
+    {
+      http_client->response_status = 200;
+      http_client->response_body
+          << "{\"version\": [1, {\"rate_by_service\": 7}], "
+             "\"rate_by_service\": {\"service:testsvc,env:\": 0.5}, "
+             "\"extra\": {\"nested\": [null, true, \"x\"]}}";
+      Tracer tracer{*finalized};
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    REQUIRE(event_scheduler->cancelled);
+    REQUIRE(logger->error_count() == 0);
+  }
+
   SECTION("invalid responses") {
     // Don't echo error messages.
     logger->echo = nullptr;
@@ -77,10 +109,14 @@ TEST_CASE("CollectorResponse") {
 
     auto test_case = GENERATE(values<TestCase>({
         {"not JSON", "well that's not right at all!"},
+        {"trailing garbage", "{} {}"},
+        {"truncated", "{\"rate_by_service\": {\"service:foo,env:bar\": 0"},
         {"not an object", "[\"wrong\", \"type\", 123]"},
         {"rate_by_service not an object", "{\"rate_by_service\": null}"},
         {"sample rate not a number",
          "{\"rate_by_service\": {\"service:foo,env:bar\": []}}"},
+        {"sample rate is a string",
+         "{\"rate_by_service\": {\"service:foo,env:bar\": \"0.5\"}}"},
         {"invalid sample rate",
          "{\"rate_by_service\": {\"service:foo,env:bar\": -1.337}}"},
     }));
@@ -144,3 +180,1659 @@ TEST_CASE("CollectorResponse") {
     REQUIRE(logger->first_error().code == error.code);
   }
 }
+
+TEST_CASE("DatadogAgent API version") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  // Encoding when traces are flushed and encoding when traces are sent to the
+  // collector produce equivalent payloads.
+  config.agent.encode_on_send = GENERATE(false, true);
+  CAPTURE(config.agent.encode_on_send);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  // Return the number of times that the specified `needle` occurs in the
+  // specified `haystack`.
+  const auto count = [](const std::string& haystack, std::string_view needle) {
+    std::size_t result = 0;
+    for (auto pos = haystack.find(needle); pos != std::string::npos;
+         pos = haystack.find(needle, pos + 1)) {
+      ++result;
+    }
+    return result;
+  };
+
+  const auto send_trace = [&]() {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    auto root = tracer.create_span();
+    root.set_tag("color", "chartreuse");
+    auto child1 = root.create_child();
+    child1.set_tag("color", "chartreuse");
+    auto child2 = root.create_child();
+    child2.set_tag("color", "chartreuse");
+  };
+
+  SECTION("v0.4 repeats strings") {
+    send_trace();
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(http_client->request_url.path == "/v0.4/traces");
+    // one trace containing three spans
+    const std::string prefix{"\x91\x93", 2};
+    REQUIRE(http_client->request_body.substr(0, 2) == prefix);
+    REQUIRE(count(http_client->request_body, "testsvc") == 3);
+    REQUIRE(count(http_client->request_body, "chartreuse") == 3);
+  }
+
+  SECTION("v0.5 uses a string table") {
+    config.agent.api_version = TraceAPIVersion::V0_5;
+    send_trace();
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(http_client->request_url.path == "/v0.5/traces");
+    // an array of the string table and the traces, where the string table is
+    // a small array that begins with the empty string
+    const auto& body = http_client->request_body;
+    REQUIRE(body.size() > 3);
+    REQUIRE(static_cast<unsigned char>(body[0]) == 0x92);
+    REQUIRE((static_cast<unsigned char>(body[1]) & 0xF0) == 0x90);
+    REQUIRE(static_cast<unsigned char>(body[2]) == 0xA0);
+    REQUIRE(count(body, "testsvc") == 1);
+    REQUIRE(count(body, "chartreuse") == 1);
+    REQUIRE(count(body, "color") == 1);
+  }
+}
+
+TEST_CASE("DatadogAgent encodes the trace origin in each span") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.encode_on_send = GENERATE(false, true);
+  CAPTURE(config.agent.encode_on_send);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  const auto send_trace = [&]() {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-origin", "synthetics-browser"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    span->set_tag("color", "chartreuse");
+    auto child = span->create_child();
+    // The origin isn't among the span's tags.
+    REQUIRE(!child.lookup_tag("_dd.origin"));
+  };
+
+  SECTION("v0.4") {
+    send_trace();
+    REQUIRE(logger->error_count() == 0);
+    const auto payload =
+        nlohmann::json::from_msgpack(http_client->request_body);
+    REQUIRE(payload.size() == 1);
+    REQUIRE(payload[0].size() == 2);
+    for (const auto& span : payload[0]) {
+      REQUIRE(span["meta"]["_dd.origin"] == "synthetics-browser");
+    }
+    REQUIRE(payload[0][0]["meta"]["color"] == "chartreuse");
+  }
+
+  SECTION("v0.5") {
+    config.agent.api_version = TraceAPIVersion::V0_5;
+    send_trace();
+    REQUIRE(logger->error_count() == 0);
+    const auto& body = http_client->request_body;
+    // The string table contains the origin once, and each span's meta map
+    // refers to it.
+    std::size_t count = 0;
+    for (auto pos = body.find("synthetics-browser"); pos != std::string::npos;
+         pos = body.find("synthetics-browser", pos + 1)) {
+      ++count;
+    }
+    REQUIRE(count == 1);
+    REQUIRE(body.find("_dd.origin") != std::string::npos);
+  }
+}
+
+TEST_CASE("DatadogAgent encode on send") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.encode_on_send = true;
+  config.agent.api_version = GENERATE(TraceAPIVersion::V0_4,
+                                      TraceAPIVersion::V0_5);
+  config.agent.shard_buffer_by_numa_node = GENERATE(false, true);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  {
+    Tracer tracer{*finalized};
+    for (int i = 0; i < 3; ++i) {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    // Nothing is sent until the flush.
+    REQUIRE(http_client->request_body.empty());
+    event_scheduler->event_callback();
+    REQUIRE(!http_client->request_body.empty());
+    REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+            "3");
+    // No trace chunks remain, so the next flush sends nothing.
+    http_client->request_body.clear();
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_body.empty());
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent normalizes resource names") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.normalize_resources = true;
+  config.agent.encode_on_send = GENERATE(false, true);
+  config.agent.stats_computation_enabled = GENERATE(false, true);
+  CAPTURE(config.agent.encode_on_send);
+  CAPTURE(config.agent.stats_computation_enabled);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  TimePoint current_time = default_clock();
+  auto clock = [&current_time]() { return current_time; };
+
+  const auto& requests = http_client->requests;
+  {
+    Tracer tracer{*finalized, default_id_generator, clock};
+    for (const char* id : {"42", "43"}) {
+      auto span = tracer.create_span();
+      span.set_service_type("sql");
+      span.set_resource_name(std::string("SELECT * FROM t WHERE id = ") + id);
+    }
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 1);
+    const auto& body = requests[0].body;
+    REQUIRE(body.find("SELECT * FROM t WHERE id = ?") != std::string::npos);
+    REQUIRE(body.find("id = 42") == std::string::npos);
+    REQUIRE(body.find("id = 43") == std::string::npos);
+
+    if (config.agent.stats_computation_enabled) {
+      // The statistics aggregate the spans by their normalized resource.
+      current_time += std::chrono::seconds(10);
+      event_scheduler->event_callback();
+      REQUIRE(requests.size() == 2);
+      const auto payload = nlohmann::json::from_msgpack(requests[1].body);
+      const auto& stats = payload["Stats"][0]["Stats"];
+      REQUIRE(stats.size() == 1);
+      REQUIRE(stats[0]["Resource"] == "SELECT * FROM t WHERE id = ?");
+      REQUIRE(stats[0]["Hits"] == 2);
+    }
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent normalizes spans") {
+  TracerConfig config;
+  config.defaults.service = "Test Service";
+  config.agent.normalize_spans = true;
+  config.agent.encode_on_send = GENERATE(false, true);
+  CAPTURE(config.agent.encode_on_send);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto& requests = http_client->requests;
+  {
+    Tracer tracer{*finalized};
+    auto span = tracer.create_span();
+    span.set_name("My Operation!!");
+    span.set_resource_name("");
+    span.set_tag("binary", "\xFF\xFEvalue");
+    span.set_tag("key\xC0", "value");
+  }
+  event_scheduler->event_callback();
+  REQUIRE(requests.size() == 1);
+  // The body is valid UTF-8, or else it could not be parsed.
+  const auto body = nlohmann::json::from_msgpack(requests[0].body);
+  const auto& span = body[0][0];
+  REQUIRE(span["service"] == "test_service");
+  REQUIRE(span["name"] == "My_Operation");
+  REQUIRE(span["resource"] == "My_Operation");
+  REQUIRE(span["meta"]["binary"] == "\xEF\xBF\xBDvalue");
+  REQUIRE(span["meta"]["key\xEF\xBF\xBD"] == "value");
+  REQUIRE(logger->error_count() == 0);
+}
+
+namespace {
+
+// `TestSpanProcessor` records the chunks that it's given, and then removes
+// the tag `removed_tag`, adds the tag `added_tag`, and resets the spans named
+// `dropped_name`, whichever are not empty.
+struct TestSpanProcessor : public SpanProcessor {
+  std::vector<std::string> tags;
+  std::string removed_tag;
+  std::pair<std::string, std::string> added_tag;
+  std::string dropped_name;
+  std::vector<std::size_t> chunk_sizes;
+  std::vector<std::string> origins;
+
+  void process(const std::vector<Chunk>& chunks) override {
+    for (const Chunk& chunk : chunks) {
+      chunk_sizes.push_back(chunk.spans.size());
+      origins.emplace_back(chunk.origin);
+      for (auto& span : chunk.spans) {
+        if (!removed_tag.empty()) {
+          span->tags.erase(removed_tag);
+        }
+        if (!added_tag.first.empty()) {
+          span->tags.insert_or_assign(added_tag.first, added_tag.second);
+        }
+        if (!dropped_name.empty() && span->name == dropped_name) {
+          span.reset();
+        }
+      }
+    }
+  }
+
+  std::vector<std::string> tags_read() const override { return tags; }
+
+  nlohmann::json config_json() const override {
+    return nlohmann::json::object({{"type", "TestSpanProcessor"}});
+  }
+};
+
+}  // namespace
+
+TEST_CASE("DatadogAgent span processors") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  const auto scrubber = std::make_shared<TestSpanProcessor>();
+  scrubber->tags = {"user.email"};
+  scrubber->removed_tag = "user.email";
+  const auto enricher = std::make_shared<TestSpanProcessor>();
+  enricher->added_tag = {"pod", "pod-1"};
+  enricher->dropped_name = "dropped";
+  config.agent.span_processors = {scrubber, enricher};
+
+  SECTION("modify and drop spans when flushing") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    const auto& requests = http_client->requests;
+    {
+      Tracer tracer{*finalized};
+      {
+        auto span = tracer.create_span();
+        span.set_tag("user.email", "someone@example.com");
+      }
+      {
+        auto span = tracer.create_span();
+        auto child = span.create_child();
+        child.set_name("dropped");
+      }
+      {
+        auto span = tracer.create_span();
+        span.set_name("dropped");
+      }
+      // The spans are processed when they're flushed, not when they finish.
+      REQUIRE(scrubber->chunk_sizes.empty());
+      REQUIRE(enricher->chunk_sizes.empty());
+      event_scheduler->event_callback();
+    }
+    // The scrubber is given only the chunk having the tag that it reads.
+    REQUIRE(scrubber->chunk_sizes == std::vector<std::size_t>{1});
+    REQUIRE(enricher->chunk_sizes == std::vector<std::size_t>{1, 2, 1});
+    REQUIRE(enricher->origins == std::vector<std::string>{"", "", ""});
+
+    // The chunk whose only span was dropped is not sent.
+    REQUIRE(requests.size() == 1);
+    const auto body = nlohmann::json::from_msgpack(requests[0].body);
+    REQUIRE(body.size() == 2);
+    for (const auto& chunk : body) {
+      REQUIRE(chunk.size() == 1);
+      REQUIRE(chunk[0]["meta"]["pod"] == "pod-1");
+      REQUIRE(!chunk[0]["meta"].contains("user.email"));
+    }
+    REQUIRE(logger->error_count() == 0);
+  }
+
+  SECTION("appear in the configuration") {
+    auto agent =
+        make_shared_datadog_agent(config.agent, logger, config.defaults);
+    REQUIRE(agent);
+    const auto processors =
+        (*agent)->config_json()["config"]["span_processors"];
+    REQUIRE(processors.size() == 2);
+    REQUIRE(processors[0]["type"] == "TestSpanProcessor");
+  }
+
+  SECTION("are incompatible with encode_on_send") {
+    config.agent.encode_on_send = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_SPAN_PROCESSORS);
+  }
+
+  SECTION("must not be null") {
+    config.agent.span_processors.push_back(nullptr);
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_SPAN_PROCESSORS);
+  }
+}
+
+TEST_CASE("DatadogAgent buffer limits") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.max_buffered_spans = 2;
+  config.agent.buffer_overflow_policy =
+      GENERATE(BufferOverflowPolicy::DROP_NEWEST,
+               BufferOverflowPolicy::DROP_OLDEST,
+               BufferOverflowPolicy::DROP_BY_PRIORITY);
+  config.agent.encode_on_send = GENERATE(false, true);
+  config.agent.api_version = GENERATE(TraceAPIVersion::V0_4,
+                                      TraceAPIVersion::V0_5);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  {
+    Tracer tracer{*finalized};
+    for (int i = 0; i < 3; ++i) {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    const auto& headers = http_client->request_headers.items;
+    REQUIRE(headers.at("X-Datadog-Trace-Count") == "2");
+    REQUIRE(headers.at("Datadog-Client-Dropped-P0-Traces") == "1");
+    REQUIRE(headers.at("Datadog-Client-Dropped-P0-Spans") == "1");
+
+    // The dropped counts are reported only once.
+    http_client->request_headers.items.clear();
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    REQUIRE(headers.at("X-Datadog-Trace-Count") == "1");
+    REQUIRE(headers.count("Datadog-Client-Dropped-P0-Traces") == 0);
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent flush threshold") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.flush_threshold_spans = 3;
+  config.agent.encode_on_send = GENERATE(false, true);
+  config.agent.api_version = GENERATE(TraceAPIVersion::V0_4,
+                                      TraceAPIVersion::V0_5);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  {
+    Tracer tracer{*finalized};
+    const auto send_trace = [&]() {
+      auto span = tracer.create_span();
+      (void)span;
+    };
+
+    send_trace();
+    send_trace();
+    REQUIRE(event_scheduler->wake_count == 0);
+    send_trace();
+    REQUIRE(event_scheduler->wake_count == 1);
+    // The flush is woken only once, until it happens.
+    send_trace();
+    REQUIRE(event_scheduler->wake_count == 1);
+    // Nothing is flushed on the sending thread.
+    REQUIRE(http_client->request_body.empty());
+
+    event_scheduler->event_callback();
+    REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+            "4");
+    for (int i = 0; i < 3; ++i) {
+      send_trace();
+    }
+    REQUIRE(event_scheduler->wake_count == 2);
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent early first flush") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.early_first_flush = true;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  Tracer tracer{*finalized};
+  const auto send_trace = [&]() {
+    auto span = tracer.create_span();
+    (void)span;
+  };
+
+  REQUIRE(event_scheduler->wake_count == 0);
+  send_trace();
+  REQUIRE(event_scheduler->wake_count == 1);
+  event_scheduler->event_callback();
+  REQUIRE(http_client->request_headers.items.at("X-Datadog-Trace-Count") ==
+          "1");
+  // Only the first flush is early.
+  send_trace();
+  send_trace();
+  REQUIRE(event_scheduler->wake_count == 1);
+}
+
+TEST_CASE("DatadogAgent flush phase and jitter") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  config.agent.flush_interval_milliseconds = 1000;
+
+  SECTION("by default, flushes are a whole interval apart") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    REQUIRE(event_scheduler->first_delay == std::chrono::seconds(1));
+    REQUIRE(event_scheduler->jitter == std::chrono::seconds(0));
+  }
+
+  SECTION("the first flush is after a random part of the interval") {
+    config.agent.randomize_flush_phase = true;
+    config.agent.flush_jitter_milliseconds = 100;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    REQUIRE(event_scheduler->first_delay);
+    REQUIRE(*event_scheduler->first_delay > std::chrono::seconds(0));
+    REQUIRE(*event_scheduler->first_delay <= std::chrono::seconds(1));
+    REQUIRE(event_scheduler->jitter == std::chrono::milliseconds(100));
+  }
+
+  SECTION("jitter must be less than the interval") {
+    config.agent.flush_jitter_milliseconds = GENERATE(-1, 1000);
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+  }
+}
+
+TEST_CASE("DatadogAgent adaptive flush interval") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  // Don't echo error messages.
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.max_retry_attempts = 0;
+  config.agent.flush_interval_milliseconds = 1000;
+  config.agent.adaptive_flush_interval = true;
+  config.agent.max_flush_interval_milliseconds = 4000;
+
+  SECTION("the interval lengthens under distress and then recovers") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    const auto& requests = http_client->requests;
+    Tracer tracer{*finalized};
+    const auto send_trace = [&]() {
+      auto span = tracer.create_span();
+      (void)span;
+    };
+    const auto tick = [&]() {
+      event_scheduler->event_callback();
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    };
+
+    http_client->response_status = 429;
+    send_trace();
+    tick();
+    REQUIRE(requests.size() == 1);
+    // The interval is now two ticks.
+    send_trace();
+    tick();
+    REQUIRE(requests.size() == 1);
+    tick();
+    REQUIRE(requests.size() == 2);
+
+    // The interval is now four ticks, the maximum.
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    send_trace();
+    for (int i = 0; i < 3; ++i) {
+      tick();
+      REQUIRE(requests.size() == 2);
+    }
+    tick();
+    REQUIRE(requests.size() == 3);
+
+    // After a success, the interval is two ticks again.
+    send_trace();
+    tick();
+    REQUIRE(requests.size() == 3);
+    tick();
+    REQUIRE(requests.size() == 4);
+  }
+
+  SECTION("the maximum interval can't be less than the interval") {
+    config.agent.max_flush_interval_milliseconds = 999;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+  }
+}
+
+TEST_CASE("DatadogAgent splits large payloads") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  // Every trace chunk exceeds the limit, and so is sent in its own request.
+  config.agent.max_payload_bytes = 1;
+  config.agent.encode_on_send = GENERATE(false, true);
+  config.agent.api_version = GENERATE(TraceAPIVersion::V0_4,
+                                      TraceAPIVersion::V0_5);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  {
+    Tracer tracer{*finalized};
+    for (int i = 0; i < 3; ++i) {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+  }
+
+  const auto& requests = http_client->requests;
+  if (config.agent.encode_on_send &&
+      config.agent.api_version == TraceAPIVersion::V0_5) {
+    // The trace chunks share a string table, and so can't be split.
+    REQUIRE(requests.size() == 1);
+    REQUIRE(requests[0].headers.at("X-Datadog-Trace-Count") == "3");
+  } else {
+    REQUIRE(requests.size() == 3);
+    for (const auto& request : requests) {
+      REQUIRE(request.headers.at("X-Datadog-Trace-Count") == "1");
+      // A "v0.4" payload is an array of one trace, and a "v0.5" payload is an
+      // array of a string table and an array of one trace.
+      const auto expected_prefix =
+          config.agent.api_version == TraceAPIVersion::V0_4 ? "\x91" : "\x92";
+      REQUIRE(request.body.substr(0, 1) == expected_prefix);
+    }
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent encodes large flushes in parallel") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.encoder_threads = 3;
+  // Without a limit, all of the trace chunks are sent in one request.  With
+  // a small limit, the payloads of different encoder threads are sent in
+  // separate requests.
+  config.agent.max_payload_bytes = GENERATE(10 * 1024 * 1024, 4096);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const int trace_count = 500;
+  {
+    Tracer tracer{*finalized};
+    for (int i = 0; i < trace_count; ++i) {
+      auto span = tracer.create_span();
+      span.set_tag("index", std::to_string(i));
+    }
+    event_scheduler->event_callback();
+  }
+
+  // The trace chunks are sent in their original order.
+  const auto& requests = http_client->requests;
+  REQUIRE(!requests.empty());
+  int next_index = 0;
+  for (const auto& request : requests) {
+    const auto traces = nlohmann::json::from_msgpack(request.body);
+    REQUIRE(request.headers.at("X-Datadog-Trace-Count") ==
+            std::to_string(traces.size()));
+    for (const auto& trace : traces) {
+      REQUIRE(trace.size() == 1);
+      REQUIRE(trace[0]["meta"]["index"] == std::to_string(next_index));
+      ++next_index;
+    }
+  }
+  REQUIRE(next_index == trace_count);
+  if (config.agent.max_payload_bytes > 4096) {
+    REQUIRE(requests.size() == 1);
+  } else {
+    REQUIRE(requests.size() > 4);
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent compression") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  SECTION("is off by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      Tracer tracer{*finalized};
+      {
+        auto span = tracer.create_span();
+        (void)span;
+      }
+      event_scheduler->event_callback();
+    }
+    REQUIRE(http_client->request_headers.items.count("Content-Encoding") == 0);
+    REQUIRE(http_client->request_body.substr(0, 1) == "\x91");
+  }
+
+  SECTION("gzip") {
+    config.agent.compression = PayloadCompression::GZIP;
+    config.agent.compression_level = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    {
+      Tracer tracer{*finalized};
+      {
+        auto span = tracer.create_span();
+        (void)span;
+      }
+      event_scheduler->event_callback();
+    }
+    REQUIRE(http_client->request_headers.items.at("Content-Encoding") ==
+            "gzip");
+    REQUIRE(http_client->request_body.substr(0, 2) == "\x1F\x8B");
+  }
+
+  SECTION("level must be between 1 and 9") {
+    config.agent.compression = PayloadCompression::GZIP;
+    config.agent.compression_level = GENERATE(0, 10, -1);
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_COMPRESSION_LEVEL);
+  }
+
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent retries failed requests") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.max_retry_attempts = 2;
+  config.agent.retry_backoff_milliseconds = 1000;
+  config.agent.max_retry_backoff_milliseconds = 4000;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  // Don't echo error messages.
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+
+  struct TestCase {
+    std::string name;
+    int response_status;
+    std::optional<Error> response_error;
+    bool expect_retries;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"service unavailable", 503, std::nullopt, true},
+      {"too many requests", 429, std::nullopt, true},
+      {"bad request", 400, std::nullopt, false},
+      {"HTTP client failure", -1, Error{Error::OTHER, "oh no!"}, true},
+  }));
+
+  CAPTURE(test_case.name);
+  http_client->response_status = test_case.response_status;
+  http_client->response_error = test_case.response_error;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  TimePoint current_time = default_clock();
+  // Modify `current_time` to advance the clock.
+  auto clock = [&current_time]() { return current_time; };
+
+  const auto& requests = http_client->requests;
+  {
+    Tracer tracer{*finalized, default_id_generator, clock};
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    const auto flush = [&]() {
+      event_scheduler->event_callback();
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    };
+
+    flush();
+    REQUIRE(requests.size() == 1);
+    // The first backoff is at least half of a second.
+    current_time += std::chrono::milliseconds(400);
+    flush();
+    REQUIRE(requests.size() == 1);
+
+    // The first backoff is at most one second, and the second backoff is at
+    // most two seconds.
+    current_time += std::chrono::milliseconds(600);
+    flush();
+    current_time += std::chrono::seconds(2);
+    flush();
+    // No more retries are attempted.
+    current_time += std::chrono::seconds(10);
+    flush();
+    current_time += std::chrono::seconds(10);
+    flush();
+  }
+
+  if (test_case.expect_retries) {
+    REQUIRE(requests.size() == 3);
+    REQUIRE(requests[1].body == requests[0].body);
+    REQUIRE(requests[2].body == requests[0].body);
+    REQUIRE(requests[2].headers.at("X-Datadog-Trace-Count") == "1");
+  } else {
+    REQUIRE(requests.size() == 1);
+  }
+}
+
+TEST_CASE("DatadogAgent spools requests that it would drop") {
+  char directory[] = "/tmp/datadog-agent-spool-XXXXXX";
+  REQUIRE(::mkdtemp(directory));
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.max_retry_attempts = 0;
+  config.agent.spool_directory = directory;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 503;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto& requests = http_client->requests;
+  {
+    Tracer tracer{*finalized};
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    const auto flush = [&]() {
+      event_scheduler->event_callback();
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    };
+
+    // The failed request is spooled by the next flush, which doesn't replay
+    // it, since a request failed.
+    flush();
+    flush();
+    REQUIRE(requests.size() == 1);
+    REQUIRE(tracer.metrics().requests_spooled == 1);
+    REQUIRE(tracer.metrics().trace_chunks_dropped == 0);
+
+    // The next flush replays it, and it fails again.
+    flush();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[1].body == requests[0].body);
+    flush();
+    REQUIRE(tracer.metrics().requests_spooled == 2);
+
+    // Once the Agent recovers, the request is sent for the last time.
+    http_client->response_status = 200;
+    flush();
+    REQUIRE(requests.size() == 3);
+    REQUIRE(requests[2].body == requests[0].body);
+    REQUIRE(requests[2].headers.at("X-Datadog-Trace-Count") == "1");
+    flush();
+    flush();
+    REQUIRE(requests.size() == 3);
+    REQUIRE(tracer.metrics().requests_replayed == 2);
+  }
+  REQUIRE(::rmdir(directory) == 0);
+}
+
+TEST_CASE("DatadogAgent spool configuration") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  config.agent.spool_directory = "";
+  auto finalized = finalize_config(config);
+  REQUIRE(!finalized);
+  REQUIRE(finalized.error().code == Error::DATADOG_AGENT_INVALID_SPOOL);
+
+  config.agent.spool_directory = "/tmp";
+  config.agent.spool_max_bytes = 1024;
+  finalized = finalize_config(config);
+  REQUIRE(!finalized);
+  REQUIRE(finalized.error().code == Error::DATADOG_AGENT_INVALID_SPOOL);
+}
+
+namespace {
+
+// `MirroringHTTPClient` responds to every pending request in `drain`, with
+// the status in `statuses` of the request's authority, and with the body in
+// `bodies` of the request's authority, or "{}" if there is none.
+struct MirroringHTTPClient : public HTTPClient {
+  struct Request {
+    URL url;
+    BodyChain body;
+  };
+
+  std::unordered_map<std::string, int> statuses;
+  std::unordered_map<std::string, std::string> bodies;
+  std::vector<Request> requests;
+  std::vector<std::pair<std::string, ResponseHandler>> pending;
+
+  Expected<void> post(const URL& url, HeadersSetter, std::string body,
+                      ResponseHandler on_response, ErrorHandler) override {
+    BodyChain chain;
+    chain.push_back(std::make_shared<const std::string>(std::move(body)));
+    requests.push_back(Request{url, std::move(chain)});
+    pending.emplace_back(url.authority, std::move(on_response));
+    return std::nullopt;
+  }
+
+  Expected<void> post(const URL& url, HeadersSetter, BodyChain body,
+                      ResponseHandler on_response, ErrorHandler) override {
+    requests.push_back(Request{url, std::move(body)});
+    pending.emplace_back(url.authority, std::move(on_response));
+    return std::nullopt;
+  }
+
+  void drain(std::chrono::steady_clock::time_point) override {
+    auto responding = std::move(pending);
+    pending.clear();
+    for (auto& [authority, on_response] : responding) {
+      const std::unordered_map<std::string, std::string> headers;
+      MockDictReader reader{headers};
+      const auto body = bodies.find(authority);
+      on_response(statuses.at(authority), reader,
+                  body == bodies.end() ? "{}" : body->second);
+    }
+  }
+
+  nlohmann::json config_json() const override {
+    return nlohmann::json::object({{"type", "MirroringHTTPClient"}});
+  }
+};
+
+}  // namespace
+
+TEST_CASE("DatadogAgent mirrors requests") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.url = "http://primary:8126";
+  config.agent.mirror_urls = {"http://mirror:8126"};
+  config.agent.max_retry_attempts = 1;
+  config.agent.retry_backoff_milliseconds = 1000;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MirroringHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->statuses["primary:8126"] = 200;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  TimePoint current_time = default_clock();
+  auto clock = [&current_time]() { return current_time; };
+  Tracer tracer{*finalized, default_id_generator, clock};
+  const auto flush = [&]() {
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  };
+  {
+    auto span = tracer.create_span();
+    (void)span;
+  }
+  const auto& requests = http_client->requests;
+
+  SECTION("the destinations share the encoded body") {
+    http_client->statuses["mirror:8126"] = 200;
+    flush();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[0].url.authority == "mirror:8126");
+    REQUIRE(requests[1].url.authority == "primary:8126");
+    REQUIRE(requests[0].url.path == requests[1].url.path);
+    REQUIRE(requests[0].body.size() == requests[1].body.size());
+    for (std::size_t i = 0; i < requests[0].body.size(); ++i) {
+      REQUIRE(requests[0].body[i] == requests[1].body[i]);
+    }
+    auto agent = make_shared_datadog_agent(config.agent, logger,
+                                           config.defaults, clock);
+    REQUIRE(agent);
+    REQUIRE((*agent)->config_json()["config"]["mirror_urls"] ==
+            nlohmann::json::array({"http://mirror:8126/v0.4/traces"}));
+  }
+
+  SECTION("a mirror retries its own failures") {
+    http_client->statuses["mirror:8126"] = 503;
+    flush();
+    REQUIRE(requests.size() == 2);
+    // The next flush schedules the retry, and the primary isn't retried.
+    flush();
+    REQUIRE(requests.size() == 2);
+    http_client->statuses["mirror:8126"] = 200;
+    current_time += std::chrono::seconds(1);
+    flush();
+    REQUIRE(requests.size() == 3);
+    REQUIRE(requests[2].url.authority == "mirror:8126");
+    REQUIRE(requests[2].body == requests[0].body);
+    current_time += std::chrono::seconds(10);
+    flush();
+    REQUIRE(requests.size() == 3);
+    REQUIRE(tracer.metrics().mirror_requests_dropped == 0);
+  }
+
+  SECTION("a mirror drops requests that exhaust their retries") {
+    http_client->statuses["mirror:8126"] = 503;
+    flush();
+    flush();
+    current_time += std::chrono::seconds(1);
+    flush();
+    REQUIRE(requests.size() == 3);
+    current_time += std::chrono::seconds(10);
+    flush();
+    REQUIRE(requests.size() == 3);
+    REQUIRE(tracer.metrics().mirror_requests_dropped == 1);
+  }
+}
+
+TEST_CASE("DatadogAgent distributes requests among replicas") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.url = "http://primary:8126";
+  config.agent.replica_urls = {"http://replica:8126"};
+  config.agent.max_retry_attempts = 1;
+  config.agent.retry_backoff_milliseconds = 1000;
+  config.agent.max_retry_backoff_milliseconds = 1500;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  logger->echo = nullptr;
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MirroringHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->statuses["primary:8126"] = 200;
+  http_client->statuses["replica:8126"] = 200;
+
+  TimePoint current_time = default_clock();
+  auto clock = [&current_time]() { return current_time; };
+  const auto& requests = http_client->requests;
+  // Send a trace, and return the authority to which it was sent.
+  const auto send_trace = [&](Tracer& tracer, bool respond = true) {
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    const auto before = requests.size();
+    event_scheduler->event_callback();
+    if (respond) {
+      http_client->drain(std::chrono::steady_clock::time_point::max());
+    }
+    REQUIRE(requests.size() == before + 1);
+    return requests.back().url.authority;
+  };
+
+  SECTION("round robin") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized, default_id_generator, clock};
+    REQUIRE(send_trace(tracer) == "primary:8126");
+    REQUIRE(send_trace(tracer) == "replica:8126");
+    REQUIRE(send_trace(tracer) == "primary:8126");
+    auto agent = make_shared_datadog_agent(config.agent, logger,
+                                           config.defaults, clock);
+    REQUIRE(agent);
+    const auto agent_config = (*agent)->config_json()["config"];
+    REQUIRE(agent_config["replica_urls"] ==
+            nlohmann::json::array({"http://replica:8126/v0.4/traces"}));
+    REQUIRE(agent_config["load_balancing"] == "round_robin");
+  }
+
+  SECTION("least outstanding requests") {
+    config.agent.load_balancing =
+        AgentLoadBalancing::LEAST_OUTSTANDING_REQUESTS;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized, default_id_generator, clock};
+    REQUIRE(send_trace(tracer, false) == "primary:8126");
+    REQUIRE(send_trace(tracer, false) == "replica:8126");
+    REQUIRE(send_trace(tracer, false) == "primary:8126");
+    // The primary has two requests outstanding, and the replica one.
+    REQUIRE(send_trace(tracer, false) == "replica:8126");
+    REQUIRE(send_trace(tracer, false) == "primary:8126");
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  }
+
+  SECTION("failover") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized, default_id_generator, clock};
+    REQUIRE(send_trace(tracer) == "primary:8126");
+    http_client->statuses["replica:8126"] = 503;
+    REQUIRE(send_trace(tracer) == "replica:8126");
+    http_client->statuses["replica:8126"] = 200;
+    // The replica is skipped for the retry backoff.
+    REQUIRE(send_trace(tracer) == "primary:8126");
+    REQUIRE(send_trace(tracer) == "primary:8126");
+    // Then the failed request is retried, and the Agents take turns again.
+    current_time += std::chrono::seconds(1);
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+    REQUIRE(requests.size() == 6);
+    REQUIRE(requests[4].url.authority != requests[5].url.authority);
+    REQUIRE((requests[4].body == requests[1].body ||
+             requests[5].body == requests[1].body));
+  }
+
+  SECTION("sampling rates are averaged") {
+    http_client->bodies["primary:8126"] =
+        R"({"rate_by_service": {"service:testsvc,env:": 0.2}})";
+    http_client->bodies["replica:8126"] =
+        R"({"rate_by_service": {"service:testsvc,env:": 0.6}})";
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized, default_id_generator, clock};
+    REQUIRE(send_trace(tracer) == "primary:8126");
+    REQUIRE(send_trace(tracer) == "replica:8126");
+    for (int i = 0; i < 2; ++i) {
+      send_trace(tracer);
+      std::string body;
+      for (const auto& buffer : requests.back().body) {
+        body += *buffer;
+      }
+      const auto traces = nlohmann::json::from_msgpack(body);
+      const auto& span = traces[0][0];
+      REQUIRE(span["metrics"]["_dd.agent_psr"].get<double>() ==
+              Approx(0.4));
+    }
+  }
+}
+
+TEST_CASE("DatadogAgent computes stats") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.stats_computation_enabled = true;
+  config.trace_sampler.sample_rate = 0;  // drop the trace
+  SpanSamplerConfig::Rule rule;
+  rule.name = "kept";
+  config.span_sampler.rules.push_back(rule);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  TimePoint current_time = default_clock();
+  // Modify `current_time` to advance the clock.
+  auto clock = [&current_time]() { return current_time; };
+
+  const auto& requests = http_client->requests;
+  {
+    Tracer tracer{*finalized, default_id_generator, clock};
+    {
+      auto span = tracer.create_span();
+      span.set_name("dropped");
+    }
+    {
+      auto parent = tracer.create_span();
+      parent.set_name("parent");
+      auto child = parent.create_child();
+      child.set_name("kept");
+    }
+    event_scheduler->event_callback();
+
+    // The trace chunk that was entirely dropped isn't sent, and only the span
+    // kept by span sampling is sent from the other.  The stats bucket
+    // containing the spans hasn't elapsed.
+    REQUIRE(requests.size() == 1);
+    REQUIRE(requests[0].url.path == "/v0.4/traces");
+    const auto& headers = requests[0].headers;
+    REQUIRE(headers.at("Datadog-Client-Computed-Stats") == "yes");
+    REQUIRE(headers.at("X-Datadog-Trace-Count") == "1");
+    REQUIRE(headers.at("Datadog-Client-Dropped-P0-Traces") == "1");
+    REQUIRE(headers.at("Datadog-Client-Dropped-P0-Spans") == "2");
+
+    current_time += std::chrono::seconds(10);
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[1].url.path == "/v0.6/stats");
+    const auto payload = nlohmann::json::from_msgpack(requests[1].body);
+    REQUIRE(payload["Service"] == "testsvc");
+    // The stats include the dropped spans.  "kept" isn't top level.
+    REQUIRE(payload["Stats"][0]["Stats"].size() == 2);
+  }
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent tail sampling") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.tail_sampling_enabled = true;
+  // Sampling rules drop every trace at its start.
+  config.trace_sampler.sample_rate = 0;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  TimePoint current_time = default_clock();
+  auto clock = [&current_time]() { return current_time; };
+  // Return the sampling priority of each trace in the specified `request`.
+  const auto priorities = [](const MockHTTPClient::Request& request) {
+    std::vector<double> result;
+    for (const auto& trace : nlohmann::json::from_msgpack(request.body)) {
+      result.push_back(trace[0]["metrics"]["_sampling_priority_v1"]);
+    }
+    return result;
+  };
+
+  const auto& requests = http_client->requests;
+  {
+    Tracer tracer{*finalized, default_id_generator, clock};
+    {
+      auto span = tracer.create_span();
+      span.set_name("boring");
+    }
+    {
+      auto span = tracer.create_span();
+      span.set_name("failed");
+      span.set_error(true);
+    }
+    {
+      // The user's decision to drop a trace is final.
+      auto span = tracer.create_span();
+      span.set_name("dropped by the user");
+      span.set_error(true);
+      span.trace_segment().override_sampling_priority(-1);
+    }
+    // Only the traces having an error are sent by the next flush.
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 1);
+    // The sampling rule's decision becomes the user's decision to keep it,
+    // and the rule is the decision maker.
+    REQUIRE(priorities(requests[0]) == std::vector<double>{2, -1});
+    const auto traces = nlohmann::json::from_msgpack(requests[0].body);
+    REQUIRE(traces[0][0]["meta"]["_dd.p.dm"] == "-3");
+    REQUIRE(!traces[1][0]["meta"].contains("_dd.p.dm"));
+    REQUIRE(tracer.metrics().tail_sampling_traces_kept == 1);
+    REQUIRE(tracer.metrics().tail_sampling_bytes > 0);
+
+    // The other is sent, still dropped, once its window has elapsed.
+    current_time += std::chrono::milliseconds(
+        config.agent.tail_sampling_window_milliseconds);
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(priorities(requests[1]) == std::vector<double>{-1});
+    REQUIRE(tracer.metrics().tail_sampling_bytes == 0);
+
+    // Held trace chunks are sent by an explicit flush.
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    // `MockHTTPClient` completes only the most recent request, and so the
+    // flush times out waiting for the others.
+    (void)tracer.flush(current_time.tick);
+    REQUIRE(requests.size() == 3);
+    REQUIRE(priorities(requests[2]) == std::vector<double>{-1});
+  }
+  auto agent =
+      make_shared_datadog_agent(config.agent, logger, config.defaults, clock);
+  REQUIRE(agent);
+  const auto tail_sampling =
+      (*agent)->config_json()["config"]["tail_sampling"];
+  REQUIRE(tail_sampling["window_milliseconds"] == 10000);
+  REQUIRE(tail_sampling["min_duration_milliseconds"] == 1000);
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent discovers the Agent's features") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.agent_discovery_enabled = true;
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto& requests = http_client->requests;
+  Tracer tracer{*finalized};
+  REQUIRE(requests.size() == 1);
+  REQUIRE(requests[0].method == "GET");
+  REQUIRE(requests[0].url.path == "/info");
+
+  const auto answer = [&](int status, std::string body) {
+    http_client->response_status = status;
+    http_client->response_body.str(std::move(body));
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+    http_client->response_status = 200;
+    http_client->response_body.str("{}");
+  };
+  const auto send_trace = [&]() {
+    auto span = tracer.create_span();
+    (void)span;
+  };
+  const std::string supported = R"({
+    "endpoints": ["/v0.4/traces", "/v0.5/traces", "/v0.6/stats"],
+    "client_drop_p0s": true
+  })";
+
+  SECTION("uses the features that the Agent supports") {
+    answer(200, supported);
+    // The features apply as of the next flush.
+    event_scheduler->event_callback();
+    send_trace();
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[1].url.path == "/v0.5/traces");
+    REQUIRE(requests[1].headers.at("Datadog-Client-Computed-Stats") == "yes");
+  }
+
+  SECTION("doesn't compute statistics unless the Agent can drop") {
+    answer(200, R"({"endpoints": ["/v0.4/traces", "/v0.6/stats"]})");
+    send_trace();
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[1].url.path == "/v0.4/traces");
+    REQUIRE(requests[1].headers.count("Datadog-Client-Computed-Stats") == 0);
+  }
+
+  SECTION("doesn't compute statistics of trace chunks sent before") {
+    send_trace();
+    answer(200, supported);
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[1].url.path == "/v0.5/traces");
+    REQUIRE(requests[1].headers.count("Datadog-Client-Computed-Stats") == 0);
+  }
+
+  SECTION("falls back to the configured features") {
+    answer(404, "");
+    send_trace();
+    event_scheduler->event_callback();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[1].url.path == "/v0.4/traces");
+    REQUIRE(requests[1].headers.count("Datadog-Client-Computed-Stats") == 0);
+  }
+
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent shared by tracers") {
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  DatadogAgentConfig agent_config;
+  agent_config.event_scheduler = event_scheduler;
+  agent_config.http_client = http_client;
+  SpanDefaults defaults;
+  defaults.service = "alpha";
+  auto agent = make_shared_datadog_agent(agent_config, logger, defaults);
+  REQUIRE(agent);
+
+  const auto make_tracer = [&](const std::string& service) {
+    TracerConfig config;
+    config.defaults.service = service;
+    config.logger = logger;
+    config.collector = *agent;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    return Tracer{*finalized};
+  };
+  Tracer alpha = make_tracer("alpha");
+  Tracer beta = make_tracer("beta");
+  // Both tracers' traces are sent in one request.
+  {
+    auto span = alpha.create_span();
+    auto other = beta.create_span();
+  }
+  event_scheduler->event_callback();
+  const auto& requests = http_client->requests;
+  REQUIRE(requests.size() == 1);
+  REQUIRE(requests[0].headers.at("X-Datadog-Trace-Count") == "2");
+  const auto payload = nlohmann::json::from_msgpack(requests[0].body);
+  REQUIRE(payload.size() == 2);
+  REQUIRE(payload[0][0]["service"] != payload[1][0]["service"]);
+
+  // The response is given to both tracers' samplers.
+  http_client->response_status = 200;
+  http_client->response_body << "{\"rate_by_service\": {\""
+                             << CollectorResponse::key("alpha", "")
+                             << "\": 0.0, \""
+                             << CollectorResponse::key("beta", "")
+                             << "\": 1.0}}";
+  http_client->drain(std::chrono::steady_clock::now());
+  const auto priority = [](Tracer& tracer) {
+    auto span = tracer.create_span();
+    MockDictWriter writer;
+    span.inject(writer);
+    return writer.items.at("x-datadog-sampling-priority");
+  };
+  REQUIRE(priority(alpha) == "0");
+  REQUIRE(priority(beta) == "1");
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent repeated responses") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  // Send a trace, and respond with the specified sample `rate` for the
+  // service.  Return the sampling priority of the next trace.
+  const auto respond = [&](const char* rate) {
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    http_client->response_body.str("");
+    http_client->response_body << "{\"rate_by_service\": {\""
+                               << CollectorResponse::key("testsvc", "")
+                               << "\": " << rate << "}}";
+    http_client->drain(std::chrono::steady_clock::now());
+    auto span = tracer.create_span();
+    MockDictWriter writer;
+    span.inject(writer);
+    return writer.items.at("x-datadog-sampling-priority");
+  };
+
+  // The second and third responses are the same as the first, and the fourth
+  // differs.
+  REQUIRE(respond("0.0") == "0");
+  REQUIRE(respond("0.0") == "0");
+  REQUIRE(respond("0.0") == "0");
+  REQUIRE(respond("1.0") == "1");
+  REQUIRE(respond("0.0") == "0");
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent shutdown") {
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  DatadogAgentConfig agent_config;
+  agent_config.event_scheduler = event_scheduler;
+  agent_config.http_client = http_client;
+  agent_config.encode_on_send = GENERATE(false, true);
+  SpanDefaults defaults;
+  defaults.service = "testsvc";
+  auto agent = make_shared_datadog_agent(agent_config, logger, defaults);
+  REQUIRE(agent);
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.logger = logger;
+  config.collector = *agent;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(10);
+  const auto ready = [](const std::shared_future<void>& future) {
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  };
+
+  SECTION("sends kept trace chunks first") {
+    for (const int priority : {-1, 2, 0, 1}) {
+      auto span = tracer.create_span();
+      span.set_tag("priority", std::to_string(priority));
+      span.trace_segment().override_sampling_priority(priority);
+    }
+    const auto future = (*agent)->shutdown(deadline);
+    REQUIRE(!ready(future));
+    const auto& requests = http_client->requests;
+    REQUIRE(requests.size() == 1);
+    const auto payload = nlohmann::json::from_msgpack(requests[0].body);
+    REQUIRE(payload.size() == 4);
+    const auto priority_of = [&](std::size_t i) {
+      return payload[i][0]["meta"]["priority"].get<std::string>();
+    };
+    REQUIRE(priority_of(0) == "2");
+    REQUIRE(priority_of(1) == "1");
+    REQUIRE(priority_of(2) == "-1");
+    REQUIRE(priority_of(3) == "0");
+
+    // The future is fulfilled once the request completes.
+    http_client->drain(deadline);
+    REQUIRE(ready(future));
+    // Later calls return the same future.
+    REQUIRE(ready((*agent)->shutdown(deadline)));
+  }
+
+  SECTION("is fulfilled at the deadline") {
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    const auto future = (*agent)->shutdown(deadline);
+    REQUIRE(http_client->requests.size() == 1);
+    REQUIRE(!ready(future));
+    REQUIRE(event_scheduler->recurrence_interval <= std::chrono::seconds(10));
+    event_scheduler->event_callback();
+    REQUIRE(ready(future));
+  }
+
+  SECTION("is fulfilled immediately when nothing is in flight") {
+    const auto future = (*agent)->shutdown(deadline);
+    REQUIRE(http_client->requests.empty());
+    REQUIRE(ready(future));
+  }
+
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent flush on demand") {
+  // `UnresponsiveHTTPClient` never completes a request, so that flushes time
+  // out.
+  struct UnresponsiveHTTPClient : public MockHTTPClient {
+    void drain(std::chrono::steady_clock::time_point) override {}
+  };
+
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.encode_on_send = GENERATE(false, true);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const bool responsive = GENERATE(true, false);
+  const std::shared_ptr<MockHTTPClient> http_client =
+      responsive ? std::make_shared<MockHTTPClient>()
+                 : std::make_shared<UnresponsiveHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  Tracer tracer{*finalized};
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  // There is nothing to flush.
+  REQUIRE(tracer.flush(deadline));
+  REQUIRE(http_client->requests.empty());
+
+  {
+    auto span = tracer.create_span();
+    (void)span;
+  }
+  const auto result = tracer.flush(deadline);
+  // The trace chunk is sent without waiting for the scheduled flush.
+  REQUIRE(http_client->requests.size() == 1);
+  REQUIRE(http_client->requests[0].headers.at("X-Datadog-Trace-Count") ==
+          "1");
+  if (responsive) {
+    REQUIRE(result);
+  } else {
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::FLUSH_TIMEOUT);
+  }
+  REQUIRE(logger->error_count() == 0);
+}
@@ -0,0 +1,157 @@
+// This test covers `DDSketch`, defined in `ddsketch.h`.  The expected
+// encodings are protobuf, as described in `ddsketch.cpp`.
+
+#include <datadog/ddsketch.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Return a string containing the specified `bytes`.
+std::string bytes(std::initializer_list<unsigned char> bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+// Return the little endian encoding of the specified `value`.
+std::string fixed64(double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  std::string result;
+  for (int i = 0; i < 8; ++i) {
+    result.push_back(char((bits >> (8 * i)) & 0xFF));
+  }
+  return result;
+}
+
+// Return the encoded index mapping of a sketch having the default relative
+// accuracy.  The bins are narrowed to make up for the cubic interpolation,
+// which is encoded as 3.
+std::string mapping() {
+  const double gamma = std::pow(1.01 / 0.99, 10.0 / 7.0 * std::log(2.0));
+  return bytes({0x0A, 0x0B, 0x09}) + fixed64(gamma) + bytes({0x18, 0x03});
+}
+
+// Return whether the specified `actual` value is within the default relative
+// accuracy of the specified `expected` value.
+bool accurate(double actual, double expected) {
+  return std::abs(actual - expected) <= 0.01 * expected;
+}
+
+}  // namespace
+
+TEST_CASE("DDSketch empty") {
+  DDSketch sketch;
+  REQUIRE(sketch.empty());
+  std::string encoded;
+  sketch.protobuf_encode(encoded);
+  REQUIRE(encoded == mapping());
+}
+
+TEST_CASE("DDSketch counts zero separately") {
+  DDSketch sketch;
+  sketch.add(0);
+  sketch.add(-5);
+  REQUIRE(!sketch.empty());
+  std::string encoded;
+  sketch.protobuf_encode(encoded);
+  REQUIRE(encoded == mapping() + bytes({0x21}) + fixed64(2));
+}
+
+TEST_CASE("DDSketch bins are contiguous") {
+  DDSketch sketch;
+  // One is at index zero, which is the default offset.
+  sketch.add(1);
+  sketch.add(1);
+  std::string encoded;
+  sketch.protobuf_encode(encoded);
+  REQUIRE(encoded ==
+          mapping() + bytes({0x12, 0x0A, 0x12, 0x08}) + fixed64(2));
+
+  // Slightly less than one is at index -1, which is zigzag encoded as 1.
+  // 1.05 is at index 2, and so the bin at index 1 is empty.
+  sketch.add(0.99);
+  sketch.add(1.05);
+  encoded.clear();
+  sketch.protobuf_encode(encoded);
+  REQUIRE(encoded == mapping() + bytes({0x12, 0x24, 0x12, 0x20}) +
+                         fixed64(1) + fixed64(2) + fixed64(0) + fixed64(1) +
+                         bytes({0x18, 0x01}));
+}
+
+TEST_CASE("DDSketch ignores non-finite values") {
+  DDSketch sketch;
+  sketch.add(std::numeric_limits<double>::infinity());
+  sketch.add(std::numeric_limits<double>::quiet_NaN());
+  REQUIRE(sketch.empty());
+}
+
+TEST_CASE("DDSketch quantiles are within the relative accuracy") {
+  DDSketch sketch;
+  const int n = 100000;
+  for (int i = 1; i <= n; ++i) {
+    sketch.add(i);
+  }
+  REQUIRE(sketch.count() == n);
+  for (const double quantile : {0.0, 0.1, 0.5, 0.9, 0.99, 0.999, 1.0}) {
+    CAPTURE(quantile);
+    const double expected = std::floor(quantile * (n - 1)) + 1;
+    REQUIRE(accurate(sketch.quantile(quantile), expected));
+  }
+  // Durations in nanoseconds span many orders of magnitude.
+  for (const double value : {1e-3, 0.7, 3.0, 1234.5, 1e6, 7.5e9, 1e15}) {
+    CAPTURE(value);
+    DDSketch single;
+    single.add(value);
+    REQUIRE(accurate(single.quantile(0.5), value));
+  }
+}
+
+TEST_CASE("DDSketch collapses its lowest bins") {
+  DDSketch sketch{0.01, 10};
+  sketch.add(1);
+  sketch.add(1e6);
+  sketch.add(1e6);
+  REQUIRE(sketch.count() == 3);
+  // The smallest value is counted in the lowest remaining bin, whose value is
+  // close to the largest.
+  REQUIRE(sketch.quantile(0) > 1e5);
+  REQUIRE(accurate(sketch.quantile(1), 1e6));
+  std::string encoded;
+  sketch.protobuf_encode(encoded);
+  // The mapping, the store's key and size, the 10 bins' key and size and
+  // counts, and the offset's key and varint.
+  REQUIRE(encoded.size() <= mapping().size() + 2 + 2 + 10 * 8 + 1 + 3);
+}
+
+TEST_CASE("DDSketch merge") {
+  DDSketch low;
+  DDSketch high;
+  for (int i = 1; i <= 1000; ++i) {
+    low.add(i);
+    high.add(1000 + i);
+  }
+  low.add(0);
+  high.merge(low);
+  REQUIRE(high.count() == 2001);
+  REQUIRE(high.quantile(0) == 0);
+  REQUIRE(accurate(high.quantile(0.5), 1000));
+  REQUIRE(accurate(high.quantile(1), 2000));
+
+  // Merging into an empty sketch copies the other.
+  DDSketch empty;
+  empty.merge(low);
+  std::string merged;
+  empty.protobuf_encode(merged);
+  std::string original;
+  low.protobuf_encode(original);
+  REQUIRE(merged == original);
+}
@@ -0,0 +1,175 @@
+// These are tests for `DiskSpool`, whose segment files are created in a new
+// temporary directory.
+
+#include <datadog/disk_spool.h>
+#include <datadog/error.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+class SpoolDirectory {
+  std::string path_;
+
+ public:
+  SpoolDirectory() {
+    char directory[] = "/tmp/disk-spool-test-XXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    path_ = directory;
+  }
+
+  ~SpoolDirectory() { ::rmdir(path_.c_str()); }
+
+  const std::string& path() const { return path_; }
+
+  // Return the number of files in the directory.
+  std::size_t files() const {
+    std::size_t count = 0;
+    DIR* dir = ::opendir(path_.c_str());
+    REQUIRE(dir);
+    while (const dirent* entry = ::readdir(dir)) {
+      const std::string name = entry->d_name;
+      count += name != "." && name != "..";
+    }
+    ::closedir(dir);
+    return count;
+  }
+};
+
+HTTPClient::BodyChain body_of(std::string first, std::string second = "") {
+  HTTPClient::BodyChain body;
+  body.push_back(std::make_shared<const std::string>(std::move(first)));
+  body.push_back(std::make_shared<const std::string>(std::move(second)));
+  return body;
+}
+
+// Append a request whose body is the specified `body` and that contains one
+// trace chunk of the specified number of `spans` to the specified `spool`.
+// Return whether it was appended.
+bool append(DiskSpool& spool, const std::string& body, std::size_t spans,
+            DroppedTraceChunks& dropped) {
+  return spool.append(body_of(body), body.size(), false,
+                      TraceAPIVersion::V0_4, false, 1, spans, dropped);
+}
+
+}  // namespace
+
+TEST_CASE("DiskSpool") {
+  SpoolDirectory directory;
+  const auto page_size = std::size_t(::sysconf(_SC_PAGESIZE));
+  // Each segment is one page.
+  auto opened =
+      open_disk_spool(directory.path(), DiskSpool::num_segments * page_size);
+  REQUIRE(opened);
+  auto& spool = **opened;
+
+  SECTION("removes its segment files from the directory") {
+    REQUIRE(directory.files() == 0);
+  }
+
+  SECTION("takes requests in the order that they were appended") {
+    DroppedTraceChunks dropped;
+    REQUIRE(spool.append(body_of("[[", "]]"), 4, true, TraceAPIVersion::V0_5,
+                         true, 2, 3, dropped));
+    REQUIRE(append(spool, "second", 1, dropped));
+    REQUIRE(spool.size() == 2);
+    REQUIRE(spool.bytes() == 4 + 6);
+
+    auto first = spool.take();
+    REQUIRE(first);
+    REQUIRE(first->body == "[[]]");
+    REQUIRE(first->compressed);
+    REQUIRE(first->api_version == TraceAPIVersion::V0_5);
+    REQUIRE(first->computed_stats);
+    REQUIRE(first->trace_count == 2);
+    REQUIRE(first->span_count == 3);
+    auto second = spool.take();
+    REQUIRE(second);
+    REQUIRE(second->body == "second");
+    REQUIRE(!second->compressed);
+    REQUIRE(second->api_version == TraceAPIVersion::V0_4);
+    REQUIRE(!second->computed_stats);
+    REQUIRE(!spool.take());
+    REQUIRE(spool.size() == 0);
+    REQUIRE(spool.bytes() == 0);
+    REQUIRE(dropped.traces == 0);
+  }
+
+  SECTION("moves to the next segment when one is full") {
+    // Three of these fit in a segment.
+    const std::string body(page_size / 4, 'x');
+    DroppedTraceChunks dropped;
+    for (std::size_t i = 0; i < 3 * DiskSpool::num_segments; ++i) {
+      REQUIRE(append(spool, body + std::to_string(i), 1, dropped));
+    }
+    REQUIRE(spool.size() == 3 * DiskSpool::num_segments);
+    REQUIRE(dropped.traces == 0);
+    for (std::size_t i = 0; i < 3 * DiskSpool::num_segments; ++i) {
+      auto request = spool.take();
+      REQUIRE(request);
+      REQUIRE(request->body == body + std::to_string(i));
+    }
+    REQUIRE(!spool.take());
+  }
+
+  SECTION("drops the oldest segment when the ring is full") {
+    const std::string body(page_size / 4, 'x');
+    DroppedTraceChunks dropped;
+    for (std::size_t i = 0; i < 3 * DiskSpool::num_segments + 1; ++i) {
+      REQUIRE(append(spool, body + std::to_string(i), 2, dropped));
+    }
+    // The first segment's three requests were dropped.
+    REQUIRE(dropped.traces == 3);
+    REQUIRE(dropped.spans == 6);
+    REQUIRE(spool.size() == 3 * DiskSpool::num_segments - 2);
+    auto oldest = spool.take();
+    REQUIRE(oldest);
+    REQUIRE(oldest->body == body + "3");
+  }
+
+  SECTION("reuses segments once their requests are taken") {
+    const std::string body(page_size / 4, 'x');
+    DroppedTraceChunks dropped;
+    for (int round = 0; round < 10; ++round) {
+      for (int i = 0; i < 5; ++i) {
+        REQUIRE(append(spool, body, 1, dropped));
+      }
+      for (int i = 0; i < 5; ++i) {
+        REQUIRE(spool.take());
+      }
+    }
+    REQUIRE(dropped.traces == 0);
+    REQUIRE(spool.size() == 0);
+  }
+
+  SECTION("refuses requests larger than a segment") {
+    DroppedTraceChunks dropped;
+    REQUIRE(!append(spool, std::string(page_size, 'x'), 1, dropped));
+    REQUIRE(spool.size() == 0);
+    REQUIRE(dropped.traces == 0);
+  }
+}
+
+TEST_CASE("open_disk_spool errors") {
+  SECTION("the directory doesn't exist") {
+    auto result = open_disk_spool("/nonexistent/disk-spool", 1 << 20);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::DISK_SPOOL_ERROR);
+  }
+
+  SECTION("the spool is smaller than its segments") {
+    SpoolDirectory directory;
+    auto result = open_disk_spool(directory.path(), 100);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::DISK_SPOOL_ERROR);
+  }
+}
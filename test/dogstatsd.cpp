@@ -0,0 +1,135 @@
+// These are tests for `DogStatsD`, which is given a Unix domain datagram
+// socket to send to.
+
+#include <datadog/dogstatsd.h>
+#include <datadog/error.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `DogStatsDSocket` is a Unix domain datagram socket bound in a new temporary
+// directory.
+class DogStatsDSocket {
+  std::string directory_;
+  std::string path_;
+  int socket_;
+
+ public:
+  DogStatsDSocket() {
+    char directory[] = "/tmp/dogstatsd-test-XXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    directory_ = directory;
+    path_ = directory_ + "/dsd.socket";
+    socket_ = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    REQUIRE(socket_ >= 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path_.copy(address.sun_path, path_.size());
+    REQUIRE(::bind(socket_, reinterpret_cast<const sockaddr*>(&address),
+                   sizeof address) == 0);
+  }
+
+  ~DogStatsDSocket() {
+    ::close(socket_);
+    ::unlink(path_.c_str());
+    ::rmdir(directory_.c_str());
+  }
+
+  HTTPClient::URL url() const { return HTTPClient::URL{"unix", path_, ""}; }
+
+  // Return the datagrams received so far.
+  std::vector<std::string> receive() {
+    std::vector<std::string> datagrams;
+    char buffer[65536];
+    for (;;) {
+      const auto received =
+          ::recv(socket_, buffer, sizeof buffer, MSG_DONTWAIT);
+      if (received < 0) {
+        return datagrams;
+      }
+      datagrams.emplace_back(buffer, received);
+    }
+  }
+};
+
+}  // namespace
+
+TEST_CASE("DogStatsD") {
+  DogStatsDSocket server;
+  auto client = connect_dogstatsd(server.url());
+  REQUIRE(client);
+  DogStatsD& dogstatsd = **client;
+
+  SECTION("sends nothing until flushed") {
+    dogstatsd.count("requests", 1, "");
+    REQUIRE(server.receive().empty());
+    dogstatsd.flush();
+    REQUIRE(server.receive() == std::vector<std::string>{"requests:1|c"});
+    // The metrics are forgotten once sent.
+    dogstatsd.flush();
+    REQUIRE(server.receive().empty());
+  }
+
+  SECTION("aggregates metrics having the same name and tags") {
+    dogstatsd.count("requests", 1, "env:prod");
+    dogstatsd.count("requests", 2, "env:prod");
+    dogstatsd.count("requests", 5, "env:dev");
+    dogstatsd.gauge("queue", 10, "env:prod");
+    dogstatsd.gauge("queue", 3, "env:prod");
+    // A count and a gauge are distinct even if they have the same name.
+    dogstatsd.gauge("requests", 7, "env:prod");
+    dogstatsd.flush();
+    REQUIRE(server.receive() ==
+            std::vector<std::string>{"queue:3|g|#env:prod\n"
+                                     "requests:5|c|#env:dev\n"
+                                     "requests:3|c|#env:prod\n"
+                                     "requests:7|g|#env:prod"});
+  }
+
+  SECTION("packs lines into datagrams of limited size") {
+    const int num_metrics = 200;
+    for (int i = 0; i < num_metrics; ++i) {
+      dogstatsd.count("metric." + std::to_string(i), 1, "service:testsvc");
+    }
+    dogstatsd.flush();
+    const auto datagrams = server.receive();
+    REQUIRE(datagrams.size() > 1);
+    std::size_t lines = 0;
+    for (const auto& datagram : datagrams) {
+      REQUIRE(datagram.size() <= DogStatsD::max_datagram_size);
+      REQUIRE(datagram.back() != '\n');
+      for (const char ch : datagram) {
+        lines += ch == '\n';
+      }
+      ++lines;
+    }
+    REQUIRE(lines == num_metrics);
+    REQUIRE(dogstatsd.dropped_datagrams() == 0);
+  }
+}
+
+TEST_CASE("connect_dogstatsd") {
+  SECTION("fails if nothing is listening on the socket") {
+    auto client = connect_dogstatsd(
+        HTTPClient::URL{"unix", "/nonexistent/dsd.socket", ""});
+    REQUIRE(!client);
+    REQUIRE(client.error().code == Error::DOGSTATSD_SOCKET_ERROR);
+  }
+
+  SECTION("connects to a UDP port") {
+    auto client =
+        connect_dogstatsd(HTTPClient::URL{"udp", "127.0.0.1:8125", ""});
+    REQUIRE(client);
+  }
+}
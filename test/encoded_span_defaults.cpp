@@ -0,0 +1,68 @@
+// This test covers `EncodedSpanDefaults`, defined in
+// `encoded_span_defaults.h`, and its use by `msgpack_encode(SpanData)`.
+
+#include <datadog/encoded_span_defaults.h>
+#include <datadog/span_data.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tags.h>
+
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("EncodedSpanDefaults") {
+  SpanDefaults defaults;
+  defaults.service = "testsvc";
+  defaults.service_type = "web";
+  defaults.environment = "dev";
+  defaults.version = "1.2.3";
+  const EncodedSpanDefaults encoded{defaults};
+
+  SpanData span;
+  span.name = "do.thing";
+  span.resource = "thing";
+  span.trace_id = TraceID{123};
+  span.span_id = 456;
+  span.tags.insert_or_assign("foo", "bar");
+  span.numeric_tags.insert_or_assign("answer", 42);
+
+  SECTION("encodes the same bytes whether or not values match the defaults") {
+    struct TestCase {
+      std::string name;
+      std::string service;
+      std::string service_type;
+      std::string environment;
+      std::string version;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {"all defaults", "testsvc", "web", "dev", "1.2.3"},
+        {"different service", "othersvc", "web", "dev", "1.2.3"},
+        {"different type", "testsvc", "db", "dev", "1.2.3"},
+        {"different env and version", "testsvc", "web", "prod", "2.0"},
+        {"empty fields", "", "", "", ""},
+    }));
+
+    CAPTURE(test_case.name);
+    span.service = test_case.service;
+    span.service_type = test_case.service_type;
+    span.tags.insert_or_assign(tags::environment, test_case.environment);
+    span.tags.insert_or_assign(tags::version, test_case.version);
+
+    std::string expected;
+    REQUIRE(msgpack_encode(expected, span));
+    std::string actual;
+    REQUIRE(msgpack_encode(actual, span, encoded));
+    REQUIRE(actual == expected);
+  }
+
+  SECTION("fragments contain the default values") {
+    REQUIRE(encoded.service().value == defaults.service);
+    REQUIRE(encoded.service_type().value == defaults.service_type);
+    REQUIRE(encoded.environment().value == defaults.environment);
+    REQUIRE(encoded.version().value == defaults.version);
+    REQUIRE(!encoded.service().encoded.empty());
+  }
+}
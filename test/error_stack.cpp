@@ -0,0 +1,113 @@
+// These are tests for `capture_stack`, `symbolize_stack`, and
+// `Span::capture_error_stack`, whose captured stacks are symbolized by
+// `symbolize_error_stacks`.
+
+#include <datadog/error_stack.h>
+#include <datadog/span.h>
+#include <datadog/span_data.h>
+#include <datadog/tracer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+#if __has_include(<execinfo.h>) && __has_include(<dlfcn.h>)
+constexpr bool captures_stacks = true;
+#else
+constexpr bool captures_stacks = false;
+#endif
+
+std::size_t count_lines(const std::string& text) {
+  if (text.empty()) {
+    return 0;
+  }
+  return std::count(text.begin(), text.end(), '\n') + 1;
+}
+
+}  // namespace
+
+TEST_CASE("capture_stack and symbolize_stack") {
+  SECTION("one line per frame, and the same lines each time") {
+    const auto addresses = capture_stack();
+    REQUIRE(addresses.size() <= max_captured_frames);
+    if (captures_stacks) {
+      REQUIRE(!addresses.empty());
+    }
+    const std::string symbolized = symbolize_stack(addresses);
+    REQUIRE(count_lines(symbolized) == addresses.size());
+    REQUIRE(symbolize_stack(addresses) == symbolized);
+  }
+
+  SECTION("skipped frames are omitted") {
+    const auto all = capture_stack();
+    const auto skipped = capture_stack(1);
+    if (captures_stacks && all.size() < max_captured_frames) {
+      REQUIRE(skipped.size() + 1 == all.size());
+    }
+  }
+
+  SECTION("an unknown address is described by its value") {
+    const auto* const address = reinterpret_cast<const void*>(0x10);
+    REQUIRE(symbolize_stack({address}) == "0x10");
+  }
+}
+
+TEST_CASE("Span::capture_error_stack") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  SECTION("captures addresses that are symbolized later") {
+    {
+      auto span = tracer.create_span();
+      span.capture_error_stack();
+      REQUIRE(span.error());
+    }
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& spans = collector->chunks.front();
+    REQUIRE(spans.size() == 1);
+    const SpanData& span = *spans.front();
+    REQUIRE(span.error);
+    REQUIRE(!span.tags.contains("error.stack"));
+    const std::size_t frames = span.error_stack_addresses.size();
+    if (captures_stacks) {
+      REQUIRE(frames != 0);
+    }
+
+    symbolize_error_stacks(spans);
+    REQUIRE(span.error_stack_addresses.empty());
+    if (captures_stacks) {
+      const auto found = span.tags.find("error.stack");
+      REQUIRE(found != span.tags.end());
+      REQUIRE(count_lines(found->second) == frames);
+    }
+  }
+
+  SECTION("an error stack set explicitly replaces the captured one") {
+    {
+      auto span = tracer.create_span();
+      span.capture_error_stack();
+      span.set_error_stack("this is C++, fool");
+    }
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& spans = collector->chunks.front();
+    REQUIRE(spans.size() == 1);
+    const SpanData& span = *spans.front();
+    REQUIRE(span.error_stack_addresses.empty());
+    symbolize_error_stacks(spans);
+    REQUIRE(span.tags.find("error.stack")->second == "this is C++, fool");
+  }
+}
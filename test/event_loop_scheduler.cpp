@@ -0,0 +1,147 @@
+// This test covers `EventLoopScheduler`, defined in `event_loop_scheduler.h`.
+// The event loop is simulated by `ManualEventLoop`, whose time advances only
+// when the test says so.
+
+#include <datadog/event_loop.h>
+#include <datadog/event_loop_scheduler.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+class ManualEventLoop : public EventLoop {
+  using Duration = std::chrono::steady_clock::duration;
+
+  Duration now_ = Duration::zero();
+  TimerID next_id_ = 1;
+  // `timers_` maps each timer to its due time and callback.
+  std::map<TimerID, std::pair<Duration, std::function<void()>>> timers_;
+  std::vector<std::function<void()>> posted_;
+
+ public:
+  void watch_socket(Socket, int, SocketCallback) override {}
+
+  TimerID start_timer(Duration delay, std::function<void()> callback) override {
+    const TimerID id = next_id_++;
+    timers_.emplace(id, std::make_pair(now_ + delay, std::move(callback)));
+    return id;
+  }
+
+  void cancel_timer(TimerID id) override { timers_.erase(id); }
+
+  void post(std::function<void()> callback) override {
+    posted_.push_back(std::move(callback));
+  }
+
+  // Invoke the posted callbacks, and then the callbacks of the timers that
+  // are due after advancing time by the specified `elapsed`.
+  void run(Duration elapsed = Duration::zero()) {
+    auto posted = std::move(posted_);
+    posted_.clear();
+    for (auto& callback : posted) {
+      callback();
+    }
+    now_ += elapsed;
+    for (;;) {
+      auto due = timers_.end();
+      for (auto iter = timers_.begin(); iter != timers_.end(); ++iter) {
+        if (iter->second.first <= now_ &&
+            (due == timers_.end() || iter->second.first < due->second.first)) {
+          due = iter;
+        }
+      }
+      if (due == timers_.end()) {
+        return;
+      }
+      auto callback = std::move(due->second.second);
+      timers_.erase(due);
+      callback();
+    }
+  }
+
+  std::size_t num_timers() const { return timers_.size(); }
+};
+
+}  // namespace
+
+TEST_CASE("EventLoopScheduler") {
+  const auto loop = std::make_shared<ManualEventLoop>();
+  const auto interval = std::chrono::seconds(2);
+  int invocations = 0;
+
+  SECTION("invokes the callback at each interval") {
+    EventLoopScheduler scheduler{loop};
+    auto cancel = scheduler.schedule_recurring_event(
+        interval, [&]() { ++invocations; });
+    loop->run(std::chrono::seconds(1));
+    REQUIRE(invocations == 0);
+    loop->run(std::chrono::seconds(1));
+    REQUIRE(invocations == 1);
+    loop->run(interval);
+    REQUIRE(invocations == 2);
+
+    cancel();
+    REQUIRE(loop->num_timers() == 0);
+    loop->run(interval);
+    REQUIRE(invocations == 2);
+  }
+
+  SECTION("wake posts an invocation to the loop") {
+    EventLoopScheduler scheduler{loop};
+    auto event = scheduler.schedule_wakeable_recurring_event(
+        interval, [&]() { ++invocations; });
+    REQUIRE(event.wake);
+
+    loop->run(std::chrono::seconds(1));
+    event.wake();
+    REQUIRE(invocations == 0);
+    loop->run();
+    REQUIRE(invocations == 1);
+    // The next invocation is an interval after the woken one.
+    loop->run(std::chrono::seconds(1));
+    REQUIRE(invocations == 1);
+    loop->run(std::chrono::seconds(1));
+    REQUIRE(invocations == 2);
+
+    // Waking a cancelled event does nothing.
+    event.cancel();
+    event.wake();
+    loop->run(interval);
+    REQUIRE(invocations == 2);
+  }
+
+  SECTION("the callback may cancel its event") {
+    EventLoopScheduler scheduler{loop};
+    EventScheduler::Cancel cancel;
+    cancel = scheduler.schedule_recurring_event(interval, [&]() {
+      ++invocations;
+      cancel();
+    });
+    loop->run(interval);
+    loop->run(interval);
+    REQUIRE(invocations == 1);
+    REQUIRE(loop->num_timers() == 0);
+  }
+
+  SECTION("destruction cancels the scheduled events") {
+    EventScheduler::RecurringEvent event;
+    {
+      EventLoopScheduler scheduler{loop};
+      event = scheduler.schedule_wakeable_recurring_event(
+          interval, [&]() { ++invocations; });
+    }
+    REQUIRE(loop->num_timers() == 0);
+    event.wake();
+    loop->run(interval);
+    REQUIRE(invocations == 0);
+  }
+}
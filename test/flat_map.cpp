@@ -0,0 +1,187 @@
+// This test covers the associative container `FlatMap`, defined in
+// `flat_map.h`.
+
+#include <datadog/flat_map.h>
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Fill the specified `map` with `count` elements, where the key of each is
+// "key<i>" and the value is `i`.
+template <typename Map>
+void fill(Map& map, int count) {
+  for (int i = 0; i < count; ++i) {
+    map.insert_or_assign("key" + std::to_string(i), i);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("FlatMap") {
+  SECTION("starts empty") {
+    FlatMap<std::string> map;
+    REQUIRE(map.empty());
+    REQUIRE(map.size() == 0);
+    REQUIRE(map.begin() == map.end());
+    REQUIRE(map.find("anything") == map.end());
+  }
+
+  SECTION("keeps the last of duplicate initializers") {
+    const FlatMap<std::string> map{{"foo", "one"}, {"bar", "two"},
+                                   {"foo", "three"}};
+    REQUIRE(map.size() == 2);
+    REQUIRE(map.at("foo") == "three");
+    REQUIRE(map.at("bar") == "two");
+  }
+
+  SECTION("insert_or_assign inserts or assigns") {
+    FlatMap<std::string> map;
+    auto [iter, inserted] = map.insert_or_assign("foo", "bar");
+    REQUIRE(inserted);
+    REQUIRE(iter->second == "bar");
+    std::tie(iter, inserted) = map.insert_or_assign("foo", "baz");
+    REQUIRE(!inserted);
+    REQUIRE(iter->second == "baz");
+    REQUIRE(map.size() == 1);
+  }
+
+  SECTION("emplace does not overwrite") {
+    FlatMap<std::string> map{{"foo", "bar"}};
+    const auto [iter, inserted] = map.emplace("foo", "baz");
+    REQUIRE(!inserted);
+    REQUIRE(iter->second == "bar");
+  }
+
+  SECTION("operator[] value-initializes missing elements") {
+    FlatMap<double> map;
+    REQUIRE(map["foo"] == 0.0);
+    map["foo"] = 4.5;
+    REQUIRE(map.at("foo") == 4.5);
+    REQUIRE(map.size() == 1);
+  }
+
+  SECTION("at throws for missing elements") {
+    const FlatMap<std::string> map{{"foo", "bar"}};
+    REQUIRE_THROWS_AS(map.at("bar"), std::out_of_range);
+  }
+
+  SECTION("insert does not overwrite") {
+    FlatMap<std::string> map{{"foo", "bar"}};
+    const std::unordered_map<std::string, std::string> other{{"foo", "baz"},
+                                                             {"x", "y"}};
+    map.insert(other.begin(), other.end());
+    REQUIRE(map.size() == 2);
+    REQUIRE(map.at("foo") == "bar");
+    REQUIRE(map.at("x") == "y");
+  }
+
+  SECTION("inserts a value referring to its own element when full") {
+    // The inline storage is full at eight elements, and the first allocated
+    // storage at sixteen.
+    const int count = GENERATE(8, 16);
+    const bool emplace = GENERATE(true, false);
+    CAPTURE(count);
+    CAPTURE(emplace);
+    // The value is too long to be stored within a `std::string`.
+    const std::string value(100, 'x');
+    FlatMap<std::string> map;
+    for (int i = 0; i < count; ++i) {
+      map.insert_or_assign("key" + std::to_string(i), value);
+    }
+
+    if (emplace) {
+      map.emplace("new", map.at("key0"));
+    } else {
+      map.insert_or_assign("new", map.begin()->second);
+    }
+    REQUIRE(map.size() == std::size_t(count + 1));
+    REQUIRE(map.at("new") == value);
+    for (int i = 0; i < count; ++i) {
+      REQUIRE(map.at("key" + std::to_string(i)) == value);
+    }
+  }
+
+  SECTION("comparison ignores order") {
+    const FlatMap<std::string> left{{"a", "1"}, {"b", "2"}};
+    const FlatMap<std::string> right{{"b", "2"}, {"a", "1"}};
+    REQUIRE(left == right);
+    const FlatMap<std::string> different{{"b", "2"}, {"a", "different"}};
+    REQUIRE(left != different);
+    const FlatMap<std::string> bigger{{"b", "2"}, {"a", "1"}, {"c", "3"}};
+    REQUIRE(left != bigger);
+  }
+
+  SECTION("works at any size") {
+    // Cover inline storage, heap storage, and the hashed index.
+    const int count = GENERATE(1, 8, 9, 16, 17, 100);
+    CAPTURE(count);
+    FlatMap<int> map;
+    fill(map, count);
+    REQUIRE(map.size() == std::size_t(count));
+    for (int i = 0; i < count; ++i) {
+      REQUIRE(map.at("key" + std::to_string(i)) == i);
+    }
+    REQUIRE(map.count("missing") == 0);
+
+    SECTION("copy") {
+      FlatMap<int> copy{map};
+      REQUIRE(copy == map);
+      FlatMap<int> assigned;
+      assigned = map;
+      REQUIRE(assigned == map);
+
+      // A copy's index stays consistent as the copy is modified.
+      copy.insert_or_assign("extra", -1);
+      REQUIRE(copy.erase("key0") == 1);
+      REQUIRE(copy.at("extra") == -1);
+      REQUIRE(copy.count("key0") == 0);
+      for (int i = 1; i < count; ++i) {
+        REQUIRE(copy.at("key" + std::to_string(i)) == i);
+      }
+    }
+
+    SECTION("move") {
+      const FlatMap<int> copy{map};
+      FlatMap<int> moved{std::move(map)};
+      REQUIRE(moved == copy);
+      REQUIRE(map.empty());
+      // The moved-from map is still usable.
+      fill(map, count);
+      REQUIRE(map == copy);
+    }
+
+    SECTION("erase") {
+      // Erase the even elements.
+      for (int i = 0; i < count; i += 2) {
+        REQUIRE(map.erase("key" + std::to_string(i)) == 1);
+      }
+      REQUIRE(map.erase("key0") == 0);
+      REQUIRE(map.size() == std::size_t(count / 2));
+      for (int i = 0; i < count; ++i) {
+        const auto found = map.find("key" + std::to_string(i));
+        if (i % 2 == 0) {
+          REQUIRE(found == map.end());
+        } else {
+          REQUIRE(found != map.end());
+          REQUIRE(found->second == i);
+        }
+      }
+    }
+
+    SECTION("clear") {
+      map.clear();
+      REQUIRE(map.empty());
+      REQUIRE(map.find("key0") == map.end());
+      fill(map, count);
+      REQUIRE(map.size() == std::size_t(count));
+    }
+  }
+}
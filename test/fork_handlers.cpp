@@ -0,0 +1,164 @@
+// This test covers `register_fork_handlers`, defined in `fork_handlers.h`, and
+// the handling of `fork` by the components that use it.
+//
+// Each test case forks.  The child process checks its expectations without
+// Catch2, and reports the result in its exit status.
+
+#include <datadog/datadog_agent_config.h>
+#include <datadog/fork_handlers.h>
+#include <datadog/threaded_event_scheduler.h>
+#include <datadog/timer_wheel_event_scheduler.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Fork, and in the child return the exit status of the specified
+// `in_child`.  In the parent, return the exit status of the child.
+template <typename Function>
+int fork_and_wait(Function&& in_child) {
+  const pid_t pid = ::fork();
+  if (pid == 0) {
+    std::_Exit(in_child() ? 0 : 1);
+  }
+  REQUIRE(pid > 0);
+  int status = 0;
+  REQUIRE(::waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  return WEXITSTATUS(status);
+}
+
+}  // namespace
+
+TEST_CASE("fork handlers") {
+  std::vector<std::string> calls;
+  const auto make_handlers = [&](const std::string& name) {
+    ForkHandlers handlers;
+    handlers.before_fork = [&calls, name]() {
+      calls.push_back("before " + name);
+    };
+    handlers.after_fork_in_parent = [&calls, name]() {
+      calls.push_back("parent " + name);
+    };
+    handlers.after_fork_in_child = [&calls, name]() {
+      calls.push_back("child " + name);
+    };
+    return handlers;
+  };
+
+  auto unregister_first = register_fork_handlers(make_handlers("first"));
+  auto unregister_second = register_fork_handlers(make_handlers("second"));
+
+  const int status = fork_and_wait([&]() {
+    return calls == std::vector<std::string>{"before second", "before first",
+                                             "child first", "child second"};
+  });
+  REQUIRE(status == 0);
+  REQUIRE(calls == std::vector<std::string>{"before second", "before first",
+                                            "parent first", "parent second"});
+
+  // Unregistered handlers aren't invoked.
+  unregister_first();
+  unregister_second();
+  calls.clear();
+  REQUIRE(fork_and_wait([&]() { return calls.empty(); }) == 0);
+  REQUIRE(calls.empty());
+}
+
+TEST_CASE("event schedulers keep running after fork") {
+  std::unique_ptr<EventScheduler> scheduler;
+  SECTION("ThreadedEventScheduler") {
+    scheduler = std::make_unique<ThreadedEventScheduler>();
+  }
+  SECTION("TimerWheelEventScheduler") {
+    scheduler = std::make_unique<TimerWheelEventScheduler>(
+        std::chrono::milliseconds(1));
+  }
+
+  std::atomic<int> invocations{0};
+  auto cancel = scheduler->schedule_recurring_event(
+      std::chrono::milliseconds(1), [&]() { ++invocations; });
+
+  const auto invoked_again = [&]() {
+    const int before = invocations;
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (invocations == before) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  };
+
+  REQUIRE(fork_and_wait(invoked_again) == 0);
+  REQUIRE(invoked_again());
+  cancel();
+}
+
+TEST_CASE("DatadogAgent discards inherited trace chunks after fork") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.agent.encode_on_send = GENERATE(false, true);
+  config.agent.api_version =
+      GENERATE(TraceAPIVersion::V0_4, TraceAPIVersion::V0_5);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  Tracer tracer{*finalized};
+  {
+    auto span = tracer.create_span();
+    (void)span;
+  }
+
+  // The child sends only its own trace chunks.
+  const int status = fork_and_wait([&]() {
+    event_scheduler->event_callback();
+    if (!http_client->requests.empty()) {
+      return false;
+    }
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+    event_scheduler->event_callback();
+    return http_client->requests.size() == 1 &&
+           http_client->requests[0].headers.at("X-Datadog-Trace-Count") ==
+               "1";
+  });
+  REQUIRE(status == 0);
+
+  // The parent sends the trace chunks buffered before `fork`.
+  event_scheduler->event_callback();
+  REQUIRE(http_client->requests.size() == 1);
+  REQUIRE(http_client->requests[0].headers.at("X-Datadog-Trace-Count") == "1");
+  REQUIRE(logger->error_count() == 0);
+}
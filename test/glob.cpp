@@ -1,5 +1,6 @@
 // This test covers the glob-style string pattern matching function,
-// `glob_match`, defined in `glob.h`.
+// `glob_match`, and the compiled pattern class, `GlobPattern`, both defined in
+// `glob.h`.
 
 #include <datadog/glob.h>
 
@@ -43,7 +44,27 @@ TEST_CASE("glob") {
     {"", "", true},
     {"", "a", false},
     {"*", "", true},
-    {"?", "", false}
+    {"?", "", false},
+
+    // forms that `GlobPattern` specializes
+    {"**", "anything", true},
+    {"foo", "fo", false},
+    {"foo", "food", false},
+    {"foo**", "foo", true},
+    {"*foo", "xfoo", true},
+    {"*foo", "foox", false},
+    {"*foo*", "xfoox", true},
+    {"*foo*", "fo", false},
+    {"**foo**", "foo", true},
+    {"a*b*c", "abc", true},
+    {"a*b*c", "aXbXc", true},
+    {"a*b*c", "acb", false},
+    {"a*b*c", "ab", false},
+    {"ab*ba", "aba", false},
+    {"ab*ba", "abba", true},
+    {"*ab*ab*", "abab", true},
+    {"*ab*ab*", "aba", false},
+    {"a*", "b", false},
   }));
   // clang-format on
 
@@ -52,4 +73,6 @@ TEST_CASE("glob") {
   CAPTURE(test_case.expected);
   REQUIRE(glob_match(test_case.pattern, test_case.subject) ==
           test_case.expected);
+  REQUIRE(GlobPattern(test_case.pattern).match(test_case.subject) ==
+          test_case.expected);
 }
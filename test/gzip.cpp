@@ -0,0 +1,106 @@
+// This test covers `gzip_compress` and `gzip_decompress`, defined in
+// `gzip.h`.  It decompresses the result of `gzip_compress` using zlib
+// directly.
+
+#include <datadog/gzip.h>
+#include <zlib.h>
+
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+std::string gunzip(const std::string& compressed) {
+  z_stream stream{};
+  REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = uInt(compressed.size());
+
+  std::string result;
+  char buffer[4096];
+  int status;
+  do {
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof buffer;
+    status = inflate(&stream, Z_NO_FLUSH);
+    REQUIRE((status == Z_OK || status == Z_STREAM_END));
+    result.append(buffer, sizeof buffer - stream.avail_out);
+  } while (status != Z_STREAM_END);
+  inflateEnd(&stream);
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("gzip") {
+  REQUIRE(gzip_supported());
+
+  std::string input;
+  for (int i = 0; i < 1000; ++i) {
+    input += "service:testsvc resource:GET /hello ";
+    input += std::to_string(i);
+  }
+  auto level = GENERATE(1, 6, 9);
+  CAPTURE(level);
+
+  SECTION("round trips") {
+    std::string compressed;
+    REQUIRE(gzip_compress(compressed, input, level));
+    // A gzip stream begins with the bytes 1F 8B.
+    REQUIRE(compressed.substr(0, 2) == "\x1F\x8B");
+    REQUIRE(compressed.size() < input.size());
+    REQUIRE(gunzip(compressed) == input);
+  }
+
+  SECTION("appends to the destination") {
+    std::string compressed = "prefix";
+    REQUIRE(gzip_compress(compressed, input, level));
+    REQUIRE(compressed.substr(0, 6) == "prefix");
+    REQUIRE(gunzip(compressed.substr(6)) == input);
+  }
+
+  SECTION("empty input") {
+    std::string compressed;
+    REQUIRE(gzip_compress(compressed, "", level));
+    REQUIRE(gunzip(compressed).empty());
+  }
+}
+
+TEST_CASE("gzip_decompress") {
+  std::string input;
+  for (int i = 0; i < 1000; ++i) {
+    input += "service:testsvc resource:GET /hello ";
+    input += std::to_string(i);
+  }
+  std::string compressed;
+  REQUIRE(gzip_compress(compressed, input, 6));
+
+  SECTION("round trips, appending to the destination") {
+    std::string decompressed = "prefix";
+    REQUIRE(gzip_decompress(decompressed, compressed, input.size()));
+    REQUIRE(decompressed == "prefix" + input);
+  }
+
+  SECTION("fails if the size is not as expected") {
+    auto size = GENERATE_COPY(values<std::size_t>(
+        {0, input.size() - 1, input.size() + 1}));
+    CAPTURE(size);
+    std::string decompressed = "prefix";
+    const auto result = gzip_decompress(decompressed, compressed, size);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::GZIP_FAILURE);
+    REQUIRE(decompressed == "prefix");
+  }
+
+  SECTION("fails if the input is not gzip") {
+    std::string decompressed;
+    const auto result = gzip_decompress(decompressed, input, input.size());
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::GZIP_FAILURE);
+    REQUIRE(decompressed.empty());
+  }
+}
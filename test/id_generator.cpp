@@ -0,0 +1,30 @@
+// This test covers `default_id_generator`, defined in `id_generator.h`.
+
+#include <datadog/id_generator.h>
+
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <thread>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("default_id_generator produces distinct 63-bit IDs") {
+  std::set<std::uint64_t> ids;
+  for (int i = 0; i < 10'000; ++i) {
+    const std::uint64_t id = default_id_generator();
+    REQUIRE(id <= std::uint64_t(std::numeric_limits<std::int64_t>::max()));
+    ids.insert(id);
+  }
+  REQUIRE(ids.size() == 10'000);
+}
+
+TEST_CASE("default_id_generator is seeded separately in each thread") {
+  std::uint64_t first = 0;
+  std::uint64_t second = 0;
+  std::thread([&]() { first = default_id_generator(); }).join();
+  std::thread([&]() { second = default_id_generator(); }).join();
+  REQUIRE(first != second);
+}
@@ -0,0 +1,65 @@
+// These are tests for `IndexedDictReader`, which indexes the trace context
+// headers of another `DictReader`.
+
+#include <datadog/indexed_dict_reader.h>
+
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "mocks/dict_readers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("IndexedDictReader classifies header names") {
+  for (int i = 0; i < IndexedDictReader::NUM_HEADERS; ++i) {
+    const auto header = IndexedDictReader::Header(i);
+    const std::string_view name = IndexedDictReader::names[i];
+    CAPTURE(name);
+    REQUIRE(IndexedDictReader::classify(name) == header);
+
+    std::string upper{name};
+    for (char& ch : upper) {
+      ch = char(std::toupper(static_cast<unsigned char>(ch)));
+    }
+    REQUIRE(IndexedDictReader::classify(upper) == header);
+  }
+
+  // Names of the same length as a trace context header, but different.
+  auto name = GENERATE(values<std::string>(
+      {"", "b4", "tracestat3", "traceparenT-", "x-b3-spanix", "tXaceparent",
+       "x-b3-traceie", "x-b3-sampleX", "x-datadog-tagz", "x-datadog-origix",
+       "x-datadog-trace-ix", "x-datadog-parent-ix",
+       "x-datadog-sampling-priorit_", "x-datadog-delegate-trace-samplinx"}));
+  CAPTURE(name);
+  REQUIRE(IndexedDictReader::classify(name) == IndexedDictReader::NUM_HEADERS);
+}
+
+TEST_CASE("IndexedDictReader reads the trace context headers once") {
+  const std::unordered_map<std::string, std::string> headers{
+      {"X-Datadog-Trace-Id", "123"},
+      {"x-datadog-parent-id", "456"},
+      {"tracestate", "dd=s:1"},
+      {"user-agent", "test"}};
+  const MockDictReader reader{headers};
+  const IndexedDictReader indexed{reader};
+
+  REQUIRE(indexed.lookup("x-datadog-trace-id") == "123");
+  REQUIRE(indexed.lookup("X-DATADOG-PARENT-ID") == "456");
+  REQUIRE(indexed.lookup("tracestate") == "dd=s:1");
+  REQUIRE(!indexed.lookup("traceparent"));
+  // Only the trace context headers are indexed.
+  REQUIRE(!indexed.lookup("user-agent"));
+  REQUIRE(!indexed.prefer_visit());
+
+  std::unordered_map<std::string, std::string> visited;
+  indexed.visit([&](std::string_view key, std::string_view value) {
+    visited.emplace(key, value);
+  });
+  REQUIRE(visited == std::unordered_map<std::string, std::string>{
+                         {"x-datadog-trace-id", "123"},
+                         {"x-datadog-parent-id", "456"},
+                         {"tracestate", "dd=s:1"}});
+}
@@ -0,0 +1,85 @@
+// These are tests for the instrumentation macros of `instrumentation.h`, as
+// they are when tracing is compiled in.  See
+// `instrumentation_compiled_out.cpp` for the other case.
+
+#undef DD_TRACE_COMPILE_OUT
+
+#include <datadog/instrumentation.h>
+#include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/tracer.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mocks/collectors.h"
+#include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("instrumentation macros") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  SECTION("create spans and set tags") {
+    {
+      DD_TRACE_SPAN(root, tracer);
+      REQUIRE(root.get());
+      DD_TRACE_SET_TAG(root, "color", "purple");
+      SpanConfig child_config;
+      child_config.name = "child";
+      DD_TRACE_CHILD_SPAN(child, root, child_config);
+      REQUIRE(child.get());
+      DD_TRACE_SET_TAG(child, "count", std::to_string(3));
+    }
+
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& chunk = collector->chunks.front();
+    REQUIRE(chunk.size() == 2);
+    REQUIRE(chunk[0]->tags.at("color") == "purple");
+    REQUIRE(chunk[1]->name == "child");
+    REQUIRE(chunk[1]->tags.at("count") == "3");
+  }
+
+  SECTION("extract and inject") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    MockDictWriter writer;
+    {
+      DD_TRACE_EXTRACT_SPAN(span, tracer, reader);
+      REQUIRE(span.get());
+      REQUIRE(span.get()->trace_id().low == 123);
+      DD_TRACE_INJECT(span, writer);
+    }
+    REQUIRE(writer.items.at("x-datadog-trace-id") == "123");
+  }
+
+  SECTION("a span that can't be extracted is empty") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "not a number"},
+        {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    MockDictWriter writer;
+    {
+      DD_TRACE_EXTRACT_SPAN(span, tracer, reader);
+      REQUIRE(!span.get());
+      DD_TRACE_SET_TAG(span, "ignored", "yes");
+      DD_TRACE_CHILD_SPAN(child, span);
+      REQUIRE(!child.get());
+      DD_TRACE_INJECT(span, writer);
+    }
+    REQUIRE(writer.items.empty());
+    REQUIRE(collector->chunks.empty());
+  }
+}
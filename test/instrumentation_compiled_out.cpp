@@ -0,0 +1,47 @@
+// These are tests for the instrumentation macros of `instrumentation.h`, as
+// they are when tracing is compiled out.  See `instrumentation.cpp` for the
+// other case.
+
+#ifndef DD_TRACE_COMPILE_OUT
+#define DD_TRACE_COMPILE_OUT
+#endif
+
+#include <datadog/instrumentation.h>
+
+#include <string>
+#include <type_traits>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Instrumented code refers to the tracer, the reader, and the writer only in
+// the arguments of the macros, and so they need not be what they would be
+// when tracing is compiled in.
+struct Unused {};
+
+std::string evaluated(int& count) {
+  ++count;
+  return "evaluated";
+}
+
+}  // namespace
+
+TEST_CASE("compiled out instrumentation macros") {
+  static_assert(std::is_empty_v<InstrumentedSpan>);
+
+  Unused tracer;
+  Unused reader;
+  Unused writer;
+  int count = 0;
+  {
+    DD_TRACE_SPAN(root, tracer, evaluated(count));
+    DD_TRACE_SET_TAG(root, "tag", evaluated(count));
+    DD_TRACE_CHILD_SPAN(child, root, evaluated(count));
+    DD_TRACE_EXTRACT_SPAN(span, tracer, reader, evaluated(count));
+    DD_TRACE_INJECT(span, writer);
+  }
+  REQUIRE(count == 0);
+}
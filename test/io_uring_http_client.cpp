@@ -0,0 +1,437 @@
+// These are tests for `IoUringHTTPClient`, which sends requests over io_uring
+// to a server on the loopback interface or on a Unix domain socket.  If the
+// kernel doesn't allow io_uring, e.g. within a container whose seccomp policy
+// forbids it, then the tests do nothing.
+
+#include <datadog/dict_reader.h>
+#include <datadog/dict_writer.h>
+#include <datadog/io_uring_http_client.h>
+#include <datadog/json.hpp>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Return whether `IoUringHTTPClient` can create its ring.
+bool io_uring_available() {
+#ifdef IORING_CQE_F_NOTIF
+  io_uring_params params{};
+  const long fd = ::syscall(__NR_io_uring_setup, 1, &params);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(int(fd));
+  return true;
+#else
+  return false;
+#endif
+}
+
+// `LoopbackServer` is an HTTP server that answers each request with the
+// response returned by a function of the request.  It listens on an ephemeral
+// port of the loopback interface, or on a Unix domain socket in a new
+// temporary directory.  It records the requests that it receives, and counts
+// its connections.
+class LoopbackServer {
+  int listener_;
+  std::string directory_;
+  HTTPClient::URL url_;
+  std::function<std::string(const std::string& request)> respond_;
+  std::atomic<bool> stopping_;
+  std::mutex mutex_;
+  std::vector<std::string> requests_;
+  int num_connections_;
+  std::thread thread_;
+
+  void run() {
+    struct Client {
+      int socket;
+      std::string received;
+    };
+    std::vector<Client> clients;
+    while (!stopping_) {
+      std::vector<pollfd> descriptors{pollfd{listener_, POLLIN, 0}};
+      for (const Client& client : clients) {
+        descriptors.push_back(pollfd{client.socket, POLLIN, 0});
+      }
+      if (::poll(descriptors.data(), descriptors.size(), 10) <= 0) {
+        continue;
+      }
+      if (descriptors[0].revents & POLLIN) {
+        clients.push_back(Client{::accept(listener_, nullptr, nullptr), ""});
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++num_connections_;
+      }
+      for (std::size_t i = 1; i < descriptors.size(); ++i) {
+        if (!descriptors[i].revents) {
+          continue;
+        }
+        Client& client = clients[i - 1];
+        char buffer[4096];
+        const auto received = ::recv(client.socket, buffer, sizeof buffer, 0);
+        if (received <= 0) {
+          ::close(client.socket);
+          client.socket = -1;
+          continue;
+        }
+        client.received.append(buffer, std::size_t(received));
+        handle(client.socket, client.received);
+      }
+      clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                   [](const Client& client) {
+                                     return client.socket == -1;
+                                   }),
+                    clients.end());
+    }
+    for (const Client& client : clients) {
+      ::close(client.socket);
+    }
+  }
+
+  // Answer the request at the beginning of the specified `received` data, if
+  // all of it has been received, on the specified `socket`.
+  void handle(int& socket, std::string& received) {
+    const auto header_end = received.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+      return;
+    }
+    std::size_t length = 0;
+    const auto field = received.find("Content-Length: ");
+    if (field != std::string::npos && field < header_end) {
+      length = std::stoul(received.substr(field + 16));
+    }
+    if (received.size() < header_end + 4 + length) {
+      return;
+    }
+    const std::string request = received.substr(0, header_end + 4 + length);
+    received.erase(0, request.size());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      requests_.push_back(request);
+    }
+    const std::string response = respond_(request);
+    if (response.empty()) {
+      // Never respond.
+      return;
+    }
+    // Catch's assertions aren't thread-safe.  A short send fails the test
+    // that's waiting for the response.
+    (void)::send(socket, response.data(), response.size(), MSG_NOSIGNAL);
+    if (response.find("Connection: close") != std::string::npos) {
+      ::close(socket);
+      socket = -1;
+    }
+  }
+
+ public:
+  LoopbackServer(bool unix_socket,
+                 std::function<std::string(const std::string&)> respond)
+      : respond_(std::move(respond)), stopping_(false), num_connections_(0) {
+    if (unix_socket) {
+      char directory[] = "/tmp/io-uring-test-XXXXXX";
+      REQUIRE(::mkdtemp(directory));
+      directory_ = directory;
+      const std::string path = directory_ + "/http.socket";
+      listener_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      path.copy(address.sun_path, path.size());
+      REQUIRE(::bind(listener_, reinterpret_cast<const sockaddr*>(&address),
+                     sizeof address) == 0);
+      url_ = HTTPClient::URL{"unix", path, "/v0.4/traces"};
+    } else {
+      listener_ = ::socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      REQUIRE(::bind(listener_, reinterpret_cast<const sockaddr*>(&address),
+                     sizeof address) == 0);
+      socklen_t size = sizeof address;
+      ::getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &size);
+      url_ = HTTPClient::URL{
+          "http", "127.0.0.1:" + std::to_string(ntohs(address.sin_port)),
+          "/v0.4/traces"};
+    }
+    REQUIRE(::listen(listener_, 16) == 0);
+    thread_ = std::thread([this]() { run(); });
+  }
+
+  ~LoopbackServer() {
+    stopping_ = true;
+    thread_.join();
+    ::close(listener_);
+    if (!directory_.empty()) {
+      ::unlink(url_.authority.c_str());
+      ::rmdir(directory_.c_str());
+    }
+  }
+
+  const HTTPClient::URL& url() const { return url_; }
+
+  std::vector<std::string> requests() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requests_;
+  }
+
+  int num_connections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_connections_;
+  }
+};
+
+std::string respond_ok(const std::string&) {
+  return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+         "Content-Length: 2\r\n\r\n{}";
+}
+
+// `Outcome` is what a request's handlers were called with.
+struct Outcome {
+  std::mutex mutex;
+  std::optional<int> status;
+  std::optional<std::string> content_type;
+  std::string body;
+  std::optional<Error> error;
+};
+
+// Send a POST request having the specified `body` buffers to the specified
+// `url` using the specified `client`, and wait for it to finish.
+std::shared_ptr<Outcome> post(HTTPClient& client, const HTTPClient::URL& url,
+                              HTTPClient::BodyChain body) {
+  auto outcome = std::make_shared<Outcome>();
+  const auto result = client.post(
+      url,
+      [](DictWriter& headers) {
+        headers.set("Datadog-Meta-Lang", "cpp");
+      },
+      std::move(body),
+      [outcome](int status, const DictReader& headers, std::string body) {
+        std::lock_guard<std::mutex> lock(outcome->mutex);
+        outcome->status = status;
+        if (auto value = headers.lookup("content-type")) {
+          outcome->content_type = std::string(*value);
+        }
+        outcome->body = std::move(body);
+      },
+      [outcome](Error error) {
+        std::lock_guard<std::mutex> lock(outcome->mutex);
+        outcome->error = std::move(error);
+      });
+  REQUIRE(result);
+  client.drain(std::chrono::steady_clock::now() + std::chrono::seconds(5));
+  return outcome;
+}
+
+HTTPClient::BodyChain chain(std::vector<std::string> buffers) {
+  HTTPClient::BodyChain result;
+  for (auto& buffer : buffers) {
+    result.push_back(std::make_shared<const std::string>(std::move(buffer)));
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("IoUringHTTPClient") {
+  if (!io_uring_available()) {
+    WARN("io_uring is not available, so IoUringHTTPClient isn't tested.");
+    return;
+  }
+  const auto logger = std::make_shared<NullLogger>();
+
+  SECTION("sends a body chain and receives the response") {
+    const bool unix_socket = GENERATE(false, true);
+    CAPTURE(unix_socket);
+    LoopbackServer server{unix_socket, respond_ok};
+    IoUringHTTPClient client{logger};
+    const auto outcome =
+        post(client, server.url(), chain({"hello, ", "", "world"}));
+    REQUIRE(!outcome->error);
+    REQUIRE(outcome->status == 200);
+    REQUIRE(outcome->content_type == "application/json");
+    REQUIRE(outcome->body == "{}");
+
+    const auto requests = server.requests();
+    REQUIRE(requests.size() == 1);
+    const std::string& request = requests[0];
+    REQUIRE(request.find("POST /v0.4/traces HTTP/1.1\r\n") == 0);
+    REQUIRE(request.find("\r\nContent-Length: 12\r\n") != std::string::npos);
+    REQUIRE(request.find("\r\nDatadog-Meta-Lang: cpp\r\n") !=
+            std::string::npos);
+    REQUIRE(request.substr(request.size() - 16) == "\r\n\r\nhello, world");
+  }
+
+  SECTION("reuses connections") {
+    LoopbackServer server{false, respond_ok};
+    IoUringHTTPClient client{logger};
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(post(client, server.url(), chain({"{}"}))->status == 200);
+    }
+    REQUIRE(server.num_connections() == 1);
+    const auto stats = client.config_json()["stats"];
+    REQUIRE(stats["requests"] == 3);
+    REQUIRE(stats["connections"] == 1);
+    REQUIRE(stats["reused_connections"] == 2);
+  }
+
+  SECTION("opens a new connection after Connection: close") {
+    LoopbackServer server{false, [](const std::string&) {
+                            return std::string(
+                                "HTTP/1.1 202 Accepted\r\nConnection: close"
+                                "\r\nContent-Length: 0\r\n\r\n");
+                          }};
+    IoUringHTTPClient client{logger};
+    REQUIRE(post(client, server.url(), chain({"{}"}))->status == 202);
+    REQUIRE(post(client, server.url(), chain({"{}"}))->status == 202);
+    REQUIRE(server.num_connections() == 2);
+  }
+
+  SECTION("decodes chunked responses") {
+    LoopbackServer server{false, [](const std::string&) {
+                            return std::string(
+                                "HTTP/1.1 200 OK\r\n"
+                                "Transfer-Encoding: chunked\r\n\r\n"
+                                "5\r\nhello\r\n7;ext=1\r\n, world\r\n"
+                                "0\r\n\r\n");
+                          }};
+    IoUringHTTPClient client{logger};
+    const auto outcome = post(client, server.url(), chain({"{}"}));
+    REQUIRE(outcome->status == 200);
+    REQUIRE(outcome->body == "hello, world");
+    // The connection is still usable.
+    REQUIRE(post(client, server.url(), chain({"{}"}))->body ==
+            "hello, world");
+    REQUIRE(server.num_connections() == 1);
+  }
+
+  SECTION("receives responses larger than the receive buffer") {
+    const std::string large(100000, 'x');
+    LoopbackServer server{false, [&](const std::string&) {
+                            return "HTTP/1.1 200 OK\r\nContent-Length: " +
+                                   std::to_string(large.size()) + "\r\n\r\n" +
+                                   large;
+                          }};
+    IoUringHTTPClientConfig config;
+    config.receive_buffer_size = 1024;
+    IoUringHTTPClient client{logger, config};
+    REQUIRE(post(client, server.url(), chain({"{}"}))->body == large);
+  }
+
+  SECTION("sends large bodies with zero copies") {
+    LoopbackServer server{false, respond_ok};
+    IoUringHTTPClientConfig config;
+    config.zero_copy_min_bytes = 1024;
+    IoUringHTTPClient client{logger, config};
+    const std::string body(200000, 'y');
+    REQUIRE(post(client, server.url(), chain({body, body}))->status == 200);
+    REQUIRE(post(client, server.url(), chain({"{}"}))->status == 200);
+    const auto requests = server.requests();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[0].substr(requests[0].size() - body.size() * 2) ==
+            body + body);
+    // Zero-copy sends are counted only if the kernel supports them.
+    REQUIRE(client.config_json()["stats"]["zero_copy_sends"] <= 1);
+  }
+
+  SECTION("sends many concurrent requests") {
+    LoopbackServer server{false, respond_ok};
+    IoUringHTTPClientConfig config;
+    config.max_connections = 2;
+    IoUringHTTPClient client{logger, config};
+    std::atomic<int> num_responses{0};
+    for (int i = 0; i < 50; ++i) {
+      REQUIRE(client.post(
+          server.url(), [](DictWriter&) {}, chain({std::to_string(i)}),
+          [&](int, const DictReader&, std::string) { ++num_responses; },
+          [](Error) {}));
+    }
+    client.drain(std::chrono::steady_clock::now() + std::chrono::seconds(5));
+    REQUIRE(num_responses == 50);
+    REQUIRE(server.num_connections() <= 2);
+  }
+
+  SECTION("keeps working in both processes after fork") {
+    LoopbackServer server{false, respond_ok};
+    IoUringHTTPClient client{logger};
+    REQUIRE(post(client, server.url(), chain({"{}"}))->status == 200);
+    const pid_t child = ::fork();
+    REQUIRE(child != -1);
+    if (child == 0) {
+      // The child uses a new ring and a new connection.  Catch's assertions
+      // aren't for the child, which reports by its exit status instead.
+      std::atomic<int> status{0};
+      const auto result = client.post(
+          server.url(), [](DictWriter&) {}, chain({"{}"}),
+          [&](int code, const DictReader&, std::string) { status = code; },
+          [](Error) {});
+      client.drain(std::chrono::steady_clock::now() + std::chrono::seconds(5));
+      ::_exit(result && status == 200 ? 0 : 1);
+    }
+    int child_status;
+    REQUIRE(::waitpid(child, &child_status, 0) == child);
+    REQUIRE(WIFEXITED(child_status));
+    REQUIRE(WEXITSTATUS(child_status) == 0);
+    REQUIRE(post(client, server.url(), chain({"{}"}))->status == 200);
+    REQUIRE(server.num_connections() == 2);
+  }
+
+  SECTION("reports connection failures") {
+    // Find a port that nothing listens on.
+    HTTPClient::URL url;
+    {
+      LoopbackServer server{false, respond_ok};
+      url = server.url();
+    }
+    IoUringHTTPClient client{logger};
+    const auto outcome = post(client, url, chain({"{}"}));
+    REQUIRE(!outcome->status);
+    REQUIRE(outcome->error);
+    REQUIRE(outcome->error->code == Error::IO_URING_REQUEST_FAILURE);
+  }
+
+  SECTION("times out requests") {
+    LoopbackServer server{false,
+                          [](const std::string&) { return std::string(); }};
+    IoUringHTTPClientConfig config;
+    config.request_timeout = std::chrono::milliseconds(50);
+    IoUringHTTPClient client{logger, config};
+    const auto outcome = post(client, server.url(), chain({"{}"}));
+    REQUIRE(outcome->error);
+    REQUIRE(outcome->error->message.find("timed out") != std::string::npos);
+  }
+
+  SECTION("doesn't support HTTPS") {
+    IoUringHTTPClient client{logger};
+    const auto result = client.post(
+        HTTPClient::URL{"https", "localhost:8126", "/"}, [](DictWriter&) {},
+        std::string("{}"), [](int, const DictReader&, std::string) {},
+        [](Error) {});
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::IO_URING_REQUEST_SETUP_FAILED);
+  }
+}
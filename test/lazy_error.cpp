@@ -0,0 +1,74 @@
+// These are tests for `LazyError`, and for the functions that return it
+// instead of an `Error`.
+
+#include <datadog/error.h>
+#include <datadog/lazy_error.h>
+#include <datadog/parse_util.h>
+#include <datadog/tag_propagation.h>
+
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("LazyError") {
+  SECTION("formats its parts") {
+    const std::string input = "bogus";
+    const LazyError error{Error::INVALID_INTEGER,
+                          {"Is not a valid integer: \"", input, "\""}};
+    REQUIRE(error.code == Error::INVALID_INTEGER);
+    const Error formatted = error.to_error();
+    REQUIRE(formatted.code == Error::INVALID_INTEGER);
+    REQUIRE(formatted.message == "Is not a valid integer: \"bogus\"");
+
+    std::ostringstream stream;
+    stream << error;
+    REQUIRE(stream.str() == "[error code " +
+                                std::to_string(int(Error::INVALID_INTEGER)) +
+                                "] Is not a valid integer: \"bogus\"");
+  }
+
+  SECTION("with_context precedes its parts") {
+    const LazyError error{Error::INVALID_INTEGER, {"b", "c"}};
+    REQUIRE(error.with_context({"a", " "}).to_error().message == "a bc");
+  }
+
+  SECTION("parts beyond max_parts are ignored") {
+    LazyError error{Error::INVALID_INTEGER, {"x"}};
+    for (std::size_t i = 0; i < LazyError::max_parts; ++i) {
+      error = error.with_context({"y"});
+    }
+    REQUIRE(error.to_error().message ==
+            std::string(LazyError::max_parts, 'y'));
+  }
+
+  SECTION("long parts are truncated") {
+    const std::string input(10 * LazyError::max_part_size, 'z');
+    const LazyError error{Error::INVALID_INTEGER, {"<", input, ">"}};
+    REQUIRE(error.to_error().message ==
+            "<" + std::string(LazyError::max_part_size, 'z') + "...>");
+  }
+}
+
+TEST_CASE("parse errors refer to their input") {
+  SECTION("parse_uint64") {
+    const std::string input = "12ab";
+    const auto result = parse_uint64(input, 10);
+    REQUIRE(!result);
+    REQUIRE(result.error().to_error().message ==
+            "Integer has trailing characters in: \"12ab\"");
+  }
+
+  SECTION("decode_tags") {
+    const std::string header = "foo=bar,baz";
+    const auto result = decode_tags(header);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::MALFORMED_TRACE_TAGS);
+    REQUIRE(result.error().to_error().message ==
+            "Error decoding trace tags \"foo=bar,baz\": invalid key=value pair "
+            "for encoded tag: missing \"=\" in: baz");
+  }
+}
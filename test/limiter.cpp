@@ -1,8 +1,13 @@
 #include <datadog/clock.h>
 #include <datadog/limiter.h>
 
+#include <atomic>
 #include <chrono>
+#include <cmath>
 #include <ctime>
+#include <limits>
+#include <thread>
+#include <vector>
 
 #include "test.h"
 
@@ -19,7 +24,7 @@ TEST_CASE("limiter") {
   auto clock = [&current_time]() { return current_time; };
 
   SECTION("limits requests") {
-    Limiter lim(clock, 1, 1.0, 1);
+    Limiter lim(clock, 1, 1.0);
     auto first = lim.allow();
     auto second = lim.allow();
     REQUIRE(first.allowed);
@@ -27,7 +32,7 @@ TEST_CASE("limiter") {
   }
 
   SECTION("refreshes over time") {
-    Limiter lim(clock, 1, 1.0, 1);
+    Limiter lim(clock, 1, 1.0);
     auto first = lim.allow();
     auto second = lim.allow();
     current_time += std::chrono::seconds(1);
@@ -38,7 +43,7 @@ TEST_CASE("limiter") {
   }
 
   SECTION("handles long intervals correctly") {
-    Limiter lim(clock, 1, 1.0, 1);
+    Limiter lim(clock, 1, 1.0);
     auto first = lim.allow();
     current_time += std::chrono::seconds(2);
     auto second = lim.allow();
@@ -50,7 +55,7 @@ TEST_CASE("limiter") {
 
   SECTION("calculates effective rate") {
     // starts off at 1.0, and decreases if nothing happens
-    Limiter lim(clock, 1, 1.0, 1);
+    Limiter lim(clock, 1, 1.0);
     auto first = lim.allow();
     REQUIRE(first.allowed);
     REQUIRE(first.effective_rate == 1.0);
@@ -66,8 +71,8 @@ TEST_CASE("limiter") {
   }
 
   SECTION("updates tokens at sub-second intervals") {
-    Limiter lim(clock, 5, 5.0,
-                1);  // replace tokens @ 5.0 per second (i.e. every 0.2 seconds)
+    // replace tokens @ 5.0 per second (i.e. every 0.2 seconds)
+    Limiter lim(clock, 5, 5.0);
     // consume all the tokens first
     for (auto i = 0; i < 5; i++) {
       auto result = lim.allow();
@@ -93,8 +98,8 @@ TEST_CASE("limiter") {
   }
 
   SECTION("updates tokens at multi-second intervals") {
-    Limiter lim(clock, 1, 0.25,
-                1);  // replace tokens @ 0.25 per second (i.e. every 4 seconds)
+    // replace tokens @ 0.25 per second (i.e. every 4 seconds)
+    Limiter lim(clock, 1, 0.25);
 
     // 0 seconds (0s)
     auto result = lim.allow();
@@ -135,4 +140,51 @@ TEST_CASE("limiter") {
     result = lim.allow();
     REQUIRE(!result.allowed);
   }
+
+  SECTION("a rate that is tiny, zero, or not a number doesn't refill") {
+    const double rate =
+        GENERATE(1e-300, 5e-324, 0.0, -1.0, std::nan(""),
+                 -std::numeric_limits<double>::infinity());
+    CAPTURE(rate);
+    Limiter lim(clock, 2, rate);
+    REQUIRE(lim.allow().allowed);
+    REQUIRE(lim.allow().allowed);
+    REQUIRE(!lim.allow().allowed);
+    current_time += std::chrono::hours(24 * 365 * 10);
+    REQUIRE(!lim.allow().allowed);
+    REQUIRE(!lim.allow(1000000).allowed);
+
+    // Through the dedicated constructor, there are no initial tokens unless
+    // the rate is positive.
+    Limiter dedicated(clock, rate);
+    REQUIRE(dedicated.allow().allowed == (rate > 0));
+    REQUIRE(!dedicated.allow().allowed);
+  }
+
+  SECTION("more tokens than the bucket holds are never allowed") {
+    Limiter lim(clock, 10, 1.0);
+    REQUIRE(!lim.allow(11).allowed);
+    REQUIRE(!lim.allow(std::numeric_limits<int>::max()).allowed);
+    REQUIRE(lim.allow(10).allowed);
+  }
+
+  SECTION("allows exactly the available tokens under contention") {
+    // The clock doesn't advance, so no tokens are refilled.
+    Limiter lim(clock, 100, 1.0);
+    std::atomic<int> allowed{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+      threads.emplace_back([&]() {
+        for (int j = 0; j < 1000; ++j) {
+          if (lim.allow().allowed) {
+            ++allowed;
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(allowed == 100);
+  }
 }
@@ -0,0 +1,94 @@
+#include <datadog/active_span.h>
+#include <datadog/log_correlation.h>
+#include <datadog/span.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+std::string format(const LogCorrelation& correlation, TraceID trace_id,
+                   std::uint64_t span_id) {
+  char buffer[256];
+  const std::size_t size =
+      correlation.format(buffer, sizeof buffer, trace_id, span_id);
+  return std::string(buffer, size);
+}
+
+}  // namespace
+
+TEST_CASE("LogCorrelation") {
+  SpanDefaults defaults;
+  defaults.service = "testsvc";
+
+  SECTION("service only") {
+    const LogCorrelation correlation{defaults};
+    REQUIRE(format(correlation, TraceID(123), 456) ==
+            "dd.trace_id=123 dd.span_id=456 dd.service=testsvc");
+  }
+
+  SECTION("environment and version") {
+    defaults.environment = "prod";
+    defaults.version = "1.2.3";
+    const LogCorrelation correlation{defaults};
+    REQUIRE(format(correlation, TraceID(123), 456) ==
+            "dd.trace_id=123 dd.span_id=456 dd.service=testsvc dd.env=prod "
+            "dd.version=1.2.3");
+  }
+
+  SECTION("128-bit trace IDs are hexadecimal") {
+    const LogCorrelation correlation{defaults};
+    const std::uint64_t span_id = 18446744073709551615u;
+    REQUIRE(format(correlation, TraceID(0xcafe, 0xbeef), span_id) ==
+            "dd.trace_id=000000000000beef000000000000cafe "
+            "dd.span_id=18446744073709551615 dd.service=testsvc");
+  }
+
+  SECTION("buffer size") {
+    const LogCorrelation correlation{defaults};
+    const std::string expected =
+        "dd.trace_id=1 dd.span_id=2 dd.service=testsvc";
+    REQUIRE(expected.size() < correlation.max_size());
+    char buffer[256];
+    // An exact fit.
+    REQUIRE(correlation.format(buffer, expected.size(), TraceID(1), 2) ==
+            expected.size());
+    REQUIRE(std::string_view(buffer, expected.size()) == expected);
+    // One short.
+    REQUIRE(correlation.format(buffer, expected.size() - 1, TraceID(1), 2) ==
+            0);
+  }
+
+  SECTION("active span") {
+    TracerConfig config;
+    config.defaults.service = "testsvc";
+    config.defaults.environment = "dev";
+    config.collector = std::make_shared<MockCollector>();
+    config.logger = std::make_shared<MockLogger>();
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    const LogCorrelation& correlation = tracer.log_correlation();
+
+    char buffer[256];
+    std::size_t size = correlation.format_active(buffer, sizeof buffer);
+    REQUIRE(std::string_view(buffer, size) == "dd.service=testsvc dd.env=dev");
+
+    auto span = tracer.create_span();
+    const ActiveSpan scope{span};
+    size = correlation.format_active(buffer, sizeof buffer);
+    REQUIRE(size <= correlation.max_size());
+    REQUIRE(std::string(buffer, size) ==
+            format(correlation, span.trace_id(), span.id()));
+  }
+}
@@ -0,0 +1,553 @@
+// These are tests for `Metrics`, and for the health metrics that `Tracer` and
+// `DatadogAgent` record in it, including sending them to DogStatsD, along with
+// the runtime metrics of `RuntimeMetrics`.
+
+#include <datadog/datadog_agent.h>
+#include <datadog/metrics.h>
+#include <datadog/null_collector.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <datadog/json.hpp>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `RecordingEventScheduler` retains every scheduled event, unlike
+// `MockEventScheduler`, which retains only the most recent.  Events are
+// invoked only by `fire`.
+struct RecordingEventScheduler : public EventScheduler {
+  struct Event {
+    std::chrono::steady_clock::duration interval;
+    std::function<void()> callback;
+    bool cancelled = false;
+  };
+  std::vector<Event> events;
+
+  Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
+                                  std::function<void()> callback) override {
+    const std::size_t index = events.size();
+    events.push_back(Event{interval, std::move(callback)});
+    return [this, index]() { events[index].cancelled = true; };
+  }
+
+  // Invoke the events that have the specified `interval`.
+  void fire(std::chrono::steady_clock::duration interval) {
+    for (const auto& event : events) {
+      if (event.interval == interval && !event.cancelled) {
+        event.callback();
+      }
+    }
+  }
+
+  nlohmann::json config_json() const override {
+    return nlohmann::json::object({{"type", "RecordingEventScheduler"}});
+  }
+};
+
+// `DogStatsDServer` is a UDP socket bound to a loopback port.
+class DogStatsDServer {
+  int socket_;
+  int port_;
+
+ public:
+  DogStatsDServer() {
+    socket_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    REQUIRE(socket_ >= 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    REQUIRE(::bind(socket_, reinterpret_cast<const sockaddr*>(&address),
+                   sizeof address) == 0);
+    socklen_t length = sizeof address;
+    REQUIRE(::getsockname(socket_, reinterpret_cast<sockaddr*>(&address),
+                          &length) == 0);
+    port_ = ntohs(address.sin_port);
+    // Don't wait forever for a datagram that never arrives.
+    timeval timeout{5, 0};
+    ::setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+  }
+
+  ~DogStatsDServer() { ::close(socket_); }
+
+  std::string url() const {
+    return "udp://127.0.0.1:" + std::to_string(port_);
+  }
+
+  // Return the next datagram received, or an empty string on timeout.
+  std::string receive() {
+    char buffer[65536];
+    const auto received = ::recv(socket_, buffer, sizeof buffer, 0);
+    return received > 0 ? std::string(buffer, received) : std::string();
+  }
+};
+
+}  // namespace
+
+TEST_CASE("Metrics") {
+  Metrics metrics;
+
+  SECTION("starts at zero") {
+    const auto snapshot = metrics.snapshot();
+    REQUIRE(snapshot.spans_created == 0);
+    REQUIRE(snapshot.http_errors == 0);
+    REQUIRE(snapshot.buffered_bytes == 0);
+    REQUIRE(snapshot.flush_duration.count == 0);
+  }
+
+  SECTION("counters sum the shards of all threads") {
+    const int num_threads = 2 * int(Metrics::num_shards) + 1;
+    const int increments = 1000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (int j = 0; j < increments; ++j) {
+          metrics.add(Metrics::SPANS_CREATED);
+          metrics.add(Metrics::BYTES_ENCODED, 10);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto snapshot = metrics.snapshot();
+    REQUIRE(snapshot.spans_created == std::uint64_t(num_threads) * increments);
+    REQUIRE(snapshot.bytes_encoded ==
+            std::uint64_t(num_threads) * increments * 10);
+    REQUIRE(snapshot.spans_finished == 0);
+  }
+
+  SECTION("gauges are the most recent value") {
+    metrics.set(Metrics::BUFFERED_SPANS, 10);
+    metrics.set(Metrics::BUFFERED_SPANS, 3);
+    REQUIRE(metrics.snapshot().buffered_spans == 3);
+  }
+
+  SECTION("memory gauges are increased and decreased") {
+    metrics.increase(Metrics::TRACE_SEGMENT_BYTES, 100);
+    metrics.increase(Metrics::TRACE_SEGMENT_BYTES, 20);
+    metrics.decrease(Metrics::TRACE_SEGMENT_BYTES, 100);
+    metrics.set(Metrics::BUFFERED_BYTES, 3);
+    metrics.increase(Metrics::PAYLOAD_BYTES, 400);
+    REQUIRE(metrics.memory_bytes() == 20 + 3 + 400);
+    const auto snapshot = metrics.snapshot();
+    REQUIRE(snapshot.trace_segment_bytes == 20);
+    REQUIRE(snapshot.payload_bytes == 400);
+    REQUIRE(snapshot.memory_bytes() == 20 + 3 + 400);
+  }
+
+  SECTION("histogram buckets are powers of two nanoseconds") {
+    using std::chrono::nanoseconds;
+    metrics.record(Metrics::FLUSH_DURATION, nanoseconds(0));
+    metrics.record(Metrics::FLUSH_DURATION, nanoseconds(1));
+    metrics.record(Metrics::FLUSH_DURATION, nanoseconds(3));
+    metrics.record(Metrics::FLUSH_DURATION, nanoseconds(4));
+    metrics.record(Metrics::FLUSH_DURATION, std::chrono::hours(24 * 365));
+    metrics.record(Metrics::FLUSH_DURATION, nanoseconds(-1));
+
+    const auto histogram = metrics.snapshot().flush_duration;
+    REQUIRE(histogram.count == 6);
+    REQUIRE(histogram.buckets[0] == 2);
+    REQUIRE(histogram.buckets[1] == 1);
+    REQUIRE(histogram.buckets[2] == 1);
+    REQUIRE(histogram.buckets[3] == 1);
+    REQUIRE(histogram.buckets.back() == 1);
+    REQUIRE(histogram.sum > std::chrono::hours(24 * 365));
+  }
+
+  SECTION("histogram mean and percentiles") {
+    using std::chrono::nanoseconds;
+    const auto histogram = [&]() {
+      return metrics.snapshot().create_span_duration;
+    };
+    REQUIRE(histogram().mean() == nanoseconds(0));
+    REQUIRE(histogram().percentile(0.5) == nanoseconds(0));
+
+    // 90 durations of 100ns, and 10 of 5000ns.
+    for (int i = 0; i < 90; ++i) {
+      metrics.record(Metrics::CREATE_SPAN_DURATION, nanoseconds(100));
+    }
+    for (int i = 0; i < 10; ++i) {
+      metrics.record(Metrics::CREATE_SPAN_DURATION, nanoseconds(5000));
+    }
+    REQUIRE(histogram().mean() == nanoseconds(590));
+    // 100ns is in the bucket [64ns, 128ns), and 5000ns in [4096ns, 8192ns).
+    REQUIRE(histogram().percentile(0.5) == nanoseconds(128));
+    REQUIRE(histogram().percentile(0.9) == nanoseconds(128));
+    REQUIRE(histogram().percentile(0.99) == nanoseconds(8192));
+    REQUIRE(histogram().percentile(1) == nanoseconds(8192));
+  }
+
+  SECTION("distribution buckets, mean, and percentiles") {
+    const auto distribution = [&]() {
+      return metrics.snapshot().request_bytes;
+    };
+    REQUIRE(distribution().mean() == 0);
+    REQUIRE(distribution().percentile(0.5) == 0);
+
+    // 90 sizes of 1000, and 10 of 100000.
+    for (int i = 0; i < 90; ++i) {
+      metrics.record(Metrics::REQUEST_BYTES, 1000);
+    }
+    for (int i = 0; i < 10; ++i) {
+      metrics.record(Metrics::REQUEST_BYTES, 100000);
+    }
+    metrics.record(Metrics::REQUEST_TRACE_CHUNKS, 0);
+    REQUIRE(distribution().count == 100);
+    REQUIRE(distribution().mean() == 10900);
+    // 1000 is in the bucket [512, 1024), and 100000 in [65536, 131072).
+    REQUIRE(distribution().buckets[10] == 90);
+    REQUIRE(distribution().percentile(0.9) == 1024);
+    REQUIRE(distribution().percentile(0.99) == 131072);
+    REQUIRE(metrics.snapshot().request_trace_chunks.buckets[0] == 1);
+  }
+
+  SECTION("OverheadTimer") {
+    {
+      const OverheadTimer timer{&metrics, Metrics::INJECT_DURATION};
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+      // A timer without metrics does nothing.
+      const OverheadTimer timer{nullptr, Metrics::INJECT_DURATION};
+    }
+    const auto histogram = metrics.snapshot().inject_duration;
+    REQUIRE(histogram.count == 1);
+    REQUIRE(histogram.sum >= std::chrono::microseconds(900));
+    REQUIRE(histogram.sum < std::chrono::seconds(10));
+  }
+}
+
+TEST_CASE("Tracer::metrics") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  config.logger = logger;
+
+  SECTION("counts spans and trace chunks") {
+    config.collector = std::make_shared<NullCollector>();
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+      REQUIRE(tracer.metrics().spans_created == 2);
+      REQUIRE(tracer.metrics().spans_finished == 0);
+    }
+    const auto snapshot = tracer.metrics();
+    REQUIRE(snapshot.spans_created == 2);
+    REQUIRE(snapshot.spans_finished == 2);
+    REQUIRE(snapshot.trace_chunks_finished == 1);
+    REQUIRE(snapshot.http_requests == 0);
+  }
+
+  SECTION("includes the DatadogAgent's metrics") {
+    const auto event_scheduler = std::make_shared<MockEventScheduler>();
+    const auto http_client = std::make_shared<MockHTTPClient>();
+    config.agent.event_scheduler = event_scheduler;
+    config.agent.http_client = http_client;
+    config.agent.max_buffered_spans = 2;
+    http_client->response_status = 200;
+    http_client->response_body << "{}";
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+
+    {
+      auto root = tracer.create_span();
+      auto child = root.create_child();
+    }
+    // The third span exceeds the buffer limit.
+    tracer.create_span();
+    auto snapshot = tracer.metrics();
+    REQUIRE(snapshot.trace_chunks_finished == 2);
+    REQUIRE(snapshot.trace_chunks_enqueued == 2);
+    REQUIRE(snapshot.trace_chunks_dropped == 1);
+    REQUIRE(snapshot.spans_dropped == 1);
+    REQUIRE(snapshot.buffered_spans == 2);
+
+    event_scheduler->event_callback();
+    // The payload counts as memory until the request completes.
+    REQUIRE(tracer.metrics().payload_bytes ==
+            http_client->request_body.size());
+    http_client->drain(std::chrono::steady_clock::now());
+    snapshot = tracer.metrics();
+    REQUIRE(snapshot.payload_bytes == 0);
+    REQUIRE(snapshot.http_requests == 1);
+    REQUIRE(snapshot.http_errors == 0);
+    REQUIRE(snapshot.bytes_encoded == http_client->request_body.size());
+    REQUIRE(snapshot.buffered_spans == 0);
+    REQUIRE(snapshot.buffered_bytes == 0);
+    REQUIRE(snapshot.flush_duration.count == 1);
+    // Each stage of the flush, and of its request, is timed.
+    REQUIRE(snapshot.flush_swap_duration.count == 1);
+    REQUIRE(snapshot.flush_encode_duration.count == 1);
+    REQUIRE(snapshot.request_build_duration.count == 1);
+    REQUIRE(snapshot.request_round_trip_duration.count == 1);
+    REQUIRE(snapshot.response_parse_duration.count == 1);
+    REQUIRE(snapshot.request_bytes.count == 1);
+    REQUIRE(snapshot.request_bytes.sum == http_client->request_body.size());
+    REQUIRE(snapshot.request_trace_chunks.sum == 1);
+
+    // Failed requests are counted as errors.
+    http_client->response_status = 500;
+    tracer.create_span();
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::now());
+    snapshot = tracer.metrics();
+    REQUIRE(snapshot.http_requests == 2);
+    REQUIRE(snapshot.http_errors == 1);
+    REQUIRE(logger->error_count() == 1);
+  }
+
+  SECTION("is shared by tracers that share a DatadogAgent") {
+    config.agent.event_scheduler = std::make_shared<MockEventScheduler>();
+    config.agent.http_client = std::make_shared<MockHTTPClient>();
+    config.agent.shutdown_timeout_milliseconds = 0;
+    SpanDefaults defaults;
+    defaults.service = "testsvc";
+    auto agent = make_shared_datadog_agent(config.agent, logger, defaults);
+    REQUIRE(agent);
+    config.collector = *agent;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer first{*finalized};
+    Tracer second{*finalized};
+    first.create_span();
+    second.create_span();
+    REQUIRE(first.metrics().spans_created == 2);
+    REQUIRE(second.metrics().trace_chunks_enqueued == 2);
+    REQUIRE((*agent)->metrics()->snapshot().spans_finished == 2);
+  }
+}
+
+TEST_CASE("overhead profiling") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<RecordingEventScheduler>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  config.agent.shutdown_timeout_milliseconds = 0;
+  config.overhead_profiling_enabled = GENERATE(false, true);
+  config.overhead_log_interval_milliseconds = 30000;
+  CAPTURE(config.overhead_profiling_enabled);
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  Tracer tracer{*finalized};
+  // The startup log reports whether overhead profiling is enabled.
+  REQUIRE(logger->startup_count() == 1);
+  REQUIRE_THAT(std::get<std::string>(logger->entries[0].payload),
+               Catch::Contains(std::string("\"overhead_profiling_enabled\":") +
+                               (config.overhead_profiling_enabled ? "true"
+                                                                  : "false")));
+  {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+    MockDictWriter writer;
+    child.inject(writer);
+    const MockDictReader reader{writer.items};
+    auto extracted = tracer.extract_span(reader);
+    REQUIRE(extracted);
+  }
+
+  const auto snapshot = tracer.metrics();
+  const std::uint64_t expected = config.overhead_profiling_enabled ? 1 : 0;
+  REQUIRE(snapshot.create_span_duration.count == expected);
+  REQUIRE(snapshot.extract_span_duration.count == expected);
+  REQUIRE(snapshot.inject_duration.count == expected);
+  REQUIRE(snapshot.finish_span_duration.count == 3 * expected);
+
+  // The overhead is logged periodically.
+  const auto log_interval = std::chrono::milliseconds(30000);
+  event_scheduler->fire(log_interval);
+  if (!config.overhead_profiling_enabled) {
+    REQUIRE(logger->startup_count() == 1);
+    return;
+  }
+  REQUIRE(logger->startup_count() == 2);
+  const auto& message = std::get<std::string>(logger->entries[1].payload);
+  const std::string prefix = "DATADOG TRACER OVERHEAD - ";
+  REQUIRE(message.substr(0, prefix.size()) == prefix);
+  const auto overhead = nlohmann::json::parse(message.substr(prefix.size()));
+  REQUIRE(overhead["create_span"]["count"] == 1);
+  REQUIRE(overhead["finish_span"]["count"] == 3);
+  REQUIRE(overhead["inject"]["p99_ns"] > 0);
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("flush summary") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  const auto event_scheduler = std::make_shared<RecordingEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.log_on_startup = false;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.flush_interval_milliseconds = 1000;
+  config.agent.flush_summary_enabled = true;
+  config.agent.flush_summary_interval_milliseconds = 30000;
+  config.agent.shutdown_timeout_milliseconds = 0;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto flush_interval = std::chrono::milliseconds(1000);
+  const auto summary_interval = std::chrono::milliseconds(30000);
+  Tracer tracer{*finalized};
+  REQUIRE(logger->startup_count() == 0);
+
+  // Nothing is logged if there were no flushes.
+  event_scheduler->fire(summary_interval);
+  REQUIRE(logger->startup_count() == 0);
+
+  tracer.create_span();
+  event_scheduler->fire(flush_interval);
+  http_client->drain(std::chrono::steady_clock::now());
+  event_scheduler->fire(summary_interval);
+  REQUIRE(logger->startup_count() == 1);
+  const auto& message = std::get<std::string>(logger->entries[0].payload);
+  const std::string prefix = "DATADOG TRACER FLUSHES - 1 flush(es):";
+  REQUIRE(message.substr(0, prefix.size()) == prefix);
+  REQUIRE_THAT(message, Catch::Contains(" 1 request(s):"));
+  REQUIRE_THAT(message, Catch::Contains(" round trip mean "));
+  REQUIRE_THAT(message, Catch::Contains("; trace chunks mean 1 p99 2"));
+
+  // The next summary covers only the flushes since the previous one.
+  event_scheduler->fire(flush_interval);
+  event_scheduler->fire(summary_interval);
+  REQUIRE(logger->startup_count() == 2);
+  REQUIRE_THAT(std::get<std::string>(logger->entries[1].payload),
+               Catch::Contains(" 0 request(s):"));
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent sends health metrics to DogStatsD") {
+  DogStatsDServer server;
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.environment = "test";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<RecordingEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.flush_interval_milliseconds = 1000;
+  config.agent.health_metrics_enabled = true;
+  config.agent.health_metrics_interval_milliseconds = 5000;
+  config.agent.dogstatsd_url = server.url();
+  config.agent.shutdown_timeout_milliseconds = 0;
+  http_client->response_status = 200;
+  http_client->response_body << "{}";
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto flush_interval = std::chrono::milliseconds(1000);
+  const auto metrics_interval = std::chrono::milliseconds(5000);
+  Tracer tracer{*finalized};
+  REQUIRE(event_scheduler->events.size() == 2);
+  {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+  }
+  event_scheduler->fire(flush_interval);
+
+  event_scheduler->fire(metrics_interval);
+  std::string datagram = server.receive();
+  const std::string tags = "|#service:testsvc,env:test,lang:cpp";
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.spans.created:2|c" +
+                                         tags));
+  REQUIRE_THAT(datagram,
+               Catch::Contains("datadog.tracer.trace_chunks.enqueued:1|c"));
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.http.requests:1|c"));
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.buffer.spans:0|g"));
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.flushes:1|c"));
+  // The request hasn't completed, and so its payload counts as memory.
+  const auto payload_size = std::to_string(http_client->request_body.size());
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.memory.bytes:" +
+                                         payload_size + "|g"));
+  REQUIRE_THAT(datagram, !Catch::Contains("http.errors"));
+
+  // Counters are sent as the increase since the previous report.
+  tracer.create_span();
+  event_scheduler->fire(metrics_interval);
+  datagram = server.receive();
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.spans.created:1|c"));
+  REQUIRE_THAT(datagram, !Catch::Contains("http.requests"));
+  REQUIRE_THAT(datagram, Catch::Contains("datadog.tracer.buffer.spans:1|g"));
+  REQUIRE(logger->error_count() == 0);
+}
+
+TEST_CASE("DatadogAgent sends runtime metrics to DogStatsD") {
+  DogStatsDServer server;
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.environment = "test";
+  config.defaults.version = "1.2";
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<RecordingEventScheduler>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  config.agent.flush_interval_milliseconds = 1000;
+  config.agent.runtime_metrics_enabled = true;
+  config.agent.runtime_metrics_interval_milliseconds = 5000;
+  config.agent.dogstatsd_url = server.url();
+  config.agent.shutdown_timeout_milliseconds = 0;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  const auto metrics_interval = std::chrono::milliseconds(5000);
+  Tracer tracer{*finalized};
+  // Health metrics are not enabled, and so only flushes and runtime metrics
+  // are scheduled.
+  REQUIRE(event_scheduler->events.size() == 2);
+#ifdef __linux__
+  event_scheduler->fire(metrics_interval);
+  std::string datagram = server.receive();
+  const std::string tags = "|#service:testsvc,env:test,version:1.2,lang:cpp";
+  REQUIRE_THAT(datagram, Catch::Contains("runtime.cpp.mem.rss:"));
+  REQUIRE_THAT(datagram, Catch::Contains("runtime.cpp.thread_count:"));
+  REQUIRE_THAT(datagram, Catch::Contains("|g" + tags));
+  REQUIRE_THAT(datagram, !Catch::Contains("runtime.cpp.cpu"));
+  REQUIRE_THAT(datagram, !Catch::Contains("datadog.tracer"));
+
+  // CPU time is sent as the increase since the previous sample.
+  event_scheduler->fire(metrics_interval);
+  datagram = server.receive();
+  REQUIRE_THAT(datagram, Catch::Contains("runtime.cpp.cpu.time.user_us:"));
+  REQUIRE_THAT(datagram, Catch::Contains("runtime.cpp.cpu.time.sys_us:"));
+#endif
+  REQUIRE(logger->error_count() == 0);
+}
@@ -9,11 +9,13 @@ using namespace datadog::tracing;
 
 class MockDictReader : public DictReader {
   const std::unordered_map<std::string, std::string>* map_;
+  bool prefer_visit_;
 
  public:
   explicit MockDictReader(
-      const std::unordered_map<std::string, std::string>& map)
-      : map_(&map) {}
+      const std::unordered_map<std::string, std::string>& map,
+      bool prefer_visit = false)
+      : map_(&map), prefer_visit_(prefer_visit) {}
 
   std::optional<std::string_view> lookup(std::string_view key) const override {
     auto found = map_->find(std::string(key));
@@ -30,4 +32,6 @@ class MockDictReader : public DictReader {
       visitor(key, value);
     }
   }
+
+  bool prefer_visit() const override { return prefer_visit_; }
 };
@@ -2,9 +2,12 @@
 
 #include <datadog/dict_writer.h>
 
+#include <cstddef>
 #include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 using namespace datadog::tracing;
 
@@ -15,3 +18,19 @@ struct MockDictWriter : public DictWriter {
     items.insert_or_assign(std::string(key), std::string(value));
   }
 };
+
+// `MockBulkDictWriter` records each call to `set_all` separately.
+struct MockBulkDictWriter : public DictWriter {
+  std::vector<std::vector<std::pair<std::string, std::string>>> batches;
+
+  void set(std::string_view key, std::string_view value) override {
+    batches.push_back({{std::string(key), std::string(value)}});
+  }
+
+  void set_all(const Entry* entries, std::size_t count) override {
+    auto& batch = batches.emplace_back();
+    for (std::size_t i = 0; i < count; ++i) {
+      batch.emplace_back(entries[i].key, entries[i].value);
+    }
+  }
+};
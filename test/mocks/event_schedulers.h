@@ -12,7 +12,12 @@ using namespace datadog::tracing;
 struct MockEventScheduler : public EventScheduler {
   std::function<void()> event_callback;
   std::optional<std::chrono::steady_clock::duration> recurrence_interval;
+  // `first_delay` and `jitter` are those of the last
+  // `schedule_jittered_recurring_event`.
+  std::optional<std::chrono::steady_clock::duration> first_delay;
+  std::optional<std::chrono::steady_clock::duration> jitter;
   bool cancelled = false;
+  int wake_count = 0;
 
   Cancel schedule_recurring_event(std::chrono::steady_clock::duration interval,
                                   std::function<void()> callback) override {
@@ -21,6 +26,23 @@ struct MockEventScheduler : public EventScheduler {
     return [this]() { cancelled = true; };
   }
 
+  RecurringEvent schedule_wakeable_recurring_event(
+      std::chrono::steady_clock::duration interval,
+      std::function<void()> callback) override {
+    return RecurringEvent{schedule_recurring_event(interval, callback),
+                          [this]() { ++wake_count; }};
+  }
+
+  RecurringEvent schedule_jittered_recurring_event(
+      std::chrono::steady_clock::duration first_delay,
+      std::chrono::steady_clock::duration interval,
+      std::chrono::steady_clock::duration jitter,
+      std::function<void()> callback) override {
+    this->first_delay = first_delay;
+    this->jitter = jitter;
+    return schedule_wakeable_recurring_event(interval, callback);
+  }
+
   nlohmann::json config_json() const override {
     return nlohmann::json::object({{"type", "MockEventScheduler"}});
   }
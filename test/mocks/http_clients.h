@@ -9,6 +9,7 @@
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "dict_readers.h"
 #include "dict_writers.h"
@@ -16,7 +17,7 @@
 using namespace datadog::tracing;
 
 // `MockHTTPClient` handles at most one request (the most recent call to
-// `post`), doing so in the `drain` member function.
+// `post`), doing so in the next call to the `drain` member function.
 //
 // Customize the behavior of `MockHTTPClient` by setting any combination of the
 // following data members:
@@ -28,29 +29,62 @@ using namespace datadog::tracing;
 //
 // If `response_error` is not null, then it will be delivered instead of the
 // `response_body`.
+//
+// The URL and body of the most recent request are stored in `request_url` and
+// `request_body`.  Every request is also appended to `requests`.  GET requests
+// are handled the same way, with an empty body.
 struct MockHTTPClient : public HTTPClient {
+  struct Request {
+    URL url;
+    std::unordered_map<std::string, std::string> headers;
+    std::string body;
+    std::string method = "POST";
+  };
+
   std::optional<Error> post_error;
   std::ostringstream response_body;
   int response_status = -1;
   std::unordered_map<std::string, std::string> response_headers;
   std::optional<Error> response_error;
   MockDictWriter request_headers;
+  URL request_url;
+  std::string request_body;
+  std::vector<Request> requests;
   std::mutex mutex_;
   ResponseHandler on_response_;
   ErrorHandler on_error_;
 
-  Expected<void> post(const URL&, HeadersSetter set_headers,
-                      std::string /*body*/, ResponseHandler on_response,
+  using HTTPClient::post;
+
+  Expected<void> post(const URL& url, HeadersSetter set_headers,
+                      std::string body, ResponseHandler on_response,
                       ErrorHandler on_error) override {
     std::lock_guard<std::mutex> lock{mutex_};
     if (!post_error) {
       on_response_ = on_response;
       on_error_ = on_error;
       set_headers(request_headers);
+      MockDictWriter headers;
+      set_headers(headers);
+      requests.push_back(Request{url, std::move(headers.items), body});
+      request_url = url;
+      request_body = std::move(body);
     }
     return post_error;
   }
 
+  Expected<void> get(const URL& url, HeadersSetter set_headers,
+                     ResponseHandler on_response,
+                     ErrorHandler on_error) override {
+    auto result = post(url, std::move(set_headers), std::string(),
+                       std::move(on_response), std::move(on_error));
+    if (result) {
+      std::lock_guard<std::mutex> lock{mutex_};
+      requests.back().method = "GET";
+    }
+    return result;
+  }
+
   void drain(std::chrono::steady_clock::time_point /*deadline*/) override {
     std::lock_guard<std::mutex> lock{mutex_};
     if (response_error && on_error_) {
@@ -59,6 +93,9 @@ struct MockHTTPClient : public HTTPClient {
       MockDictReader reader{response_headers};
       on_response_(response_status, reader, response_body.str());
     }
+    // Each request is handled only once.
+    on_response_ = nullptr;
+    on_error_ = nullptr;
   }
 
   nlohmann::json config_json() const override {
@@ -0,0 +1,75 @@
+// This test covers `MPSCQueue`, defined in `mpsc_queue.h`.
+
+#include <datadog/mpsc_queue.h>
+
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("MPSCQueue drains in push order") {
+  MPSCQueue<int> queue;
+  REQUIRE(queue.drain([](int) { REQUIRE(false); }) == 0);
+
+  for (int i = 0; i < 5; ++i) {
+    queue.push(i);
+  }
+
+  std::vector<int> drained;
+  REQUIRE(queue.drain([&](int value) { drained.push_back(value); }) == 5);
+  REQUIRE(drained == std::vector<int>{0, 1, 2, 3, 4});
+
+  // The queue is empty after a drain.
+  REQUIRE(queue.drain([](int) { REQUIRE(false); }) == 0);
+}
+
+TEST_CASE("MPSCQueue moves values") {
+  MPSCQueue<std::unique_ptr<int>> queue;
+  queue.push(std::make_unique<int>(42));
+
+  std::unique_ptr<int> drained;
+  queue.drain(
+      [&](std::unique_ptr<int>&& value) { drained = std::move(value); });
+  REQUIRE(drained);
+  REQUIRE(*drained == 42);
+
+  // Values that are never drained are destroyed with the queue.
+  queue.push(std::make_unique<int>(1));
+}
+
+TEST_CASE("MPSCQueue with concurrent producers") {
+  const int producer_count = 4;
+  const int values_per_producer = 10000;
+  MPSCQueue<std::pair<int, int>> queue;
+
+  std::vector<std::thread> producers;
+  for (int producer = 0; producer < producer_count; ++producer) {
+    producers.emplace_back([&queue, producer]() {
+      for (int i = 0; i < values_per_producer; ++i) {
+        queue.push({producer, i});
+      }
+    });
+  }
+
+  // Drain concurrently with the producers.  Each producer's values must be
+  // seen in the order in which that producer pushed them.
+  std::vector<int> next(producer_count, 0);
+  int total = 0;
+  auto visit = [&](std::pair<int, int>&& value) {
+    REQUIRE(value.second == next[value.first]);
+    ++next[value.first];
+  };
+  while (total < producer_count * values_per_producer) {
+    total += int(queue.drain(visit));
+  }
+
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  REQUIRE(queue.drain(visit) == 0);
+  REQUIRE(next == std::vector<int>(producer_count, values_per_producer));
+}
@@ -0,0 +1,238 @@
+// This test covers the MessagePack encoding routines defined in `msgpack.h`.
+// Each value is expected to be encoded using its smallest form.
+
+#include <datadog/error.h>
+#include <datadog/msgpack.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Return a string containing the specified `bytes`.
+std::string bytes(std::initializer_list<unsigned char> bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+}  // namespace
+
+TEST_CASE("msgpack integers") {
+  struct TestCase {
+    std::int64_t value;
+    std::string expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {0, bytes({0x00})},
+      {127, bytes({0x7F})},
+      {128, bytes({0xCC, 0x80})},
+      {255, bytes({0xCC, 0xFF})},
+      {256, bytes({0xCD, 0x01, 0x00})},
+      {65535, bytes({0xCD, 0xFF, 0xFF})},
+      {65536, bytes({0xCE, 0x00, 0x01, 0x00, 0x00})},
+      {4294967296,
+       bytes({0xCF, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00})},
+      {-1, bytes({0xFF})},
+      {-32, bytes({0xE0})},
+      {-33, bytes({0xD0, 0xDF})},
+      {-128, bytes({0xD0, 0x80})},
+      {-129, bytes({0xD1, 0xFF, 0x7F})},
+      {-32768, bytes({0xD1, 0x80, 0x00})},
+      {-32769, bytes({0xD2, 0xFF, 0xFF, 0x7F, 0xFF})},
+      {std::numeric_limits<std::int64_t>::min(),
+       bytes({0xD3, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00})},
+  }));
+
+  CAPTURE(test_case.value);
+  std::string buffer;
+  msgpack::pack_integer(buffer, test_case.value);
+  REQUIRE(buffer == test_case.expected);
+}
+
+TEST_CASE("msgpack unsigned integers") {
+  std::string buffer;
+  msgpack::pack_integer(buffer, std::numeric_limits<std::uint64_t>::max());
+  REQUIRE(buffer ==
+          bytes({0xCF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}));
+}
+
+TEST_CASE("msgpack strings") {
+  struct TestCase {
+    std::size_t size;
+    std::string expected_header;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {0, bytes({0xA0})},
+      {5, bytes({0xA5})},
+      {31, bytes({0xBF})},
+      {32, bytes({0xD9, 0x20})},
+      {255, bytes({0xD9, 0xFF})},
+      {256, bytes({0xDA, 0x01, 0x00})},
+      {65535, bytes({0xDA, 0xFF, 0xFF})},
+      {65536, bytes({0xDB, 0x00, 0x01, 0x00, 0x00})},
+  }));
+
+  CAPTURE(test_case.size);
+  const std::string value(test_case.size, 'x');
+  std::string buffer;
+  REQUIRE(msgpack::pack_string(buffer, value));
+  REQUIRE(buffer == test_case.expected_header + value);
+}
+
+TEST_CASE("msgpack arrays and maps") {
+  struct TestCase {
+    std::size_t size;
+    std::string expected_array;
+    std::string expected_map;
+  };
+
+  // Arrays and maps have no 8-bit form.
+  auto test_case = GENERATE(values<TestCase>({
+      {0, bytes({0x90}), bytes({0x80})},
+      {15, bytes({0x9F}), bytes({0x8F})},
+      {16, bytes({0xDC, 0x00, 0x10}), bytes({0xDE, 0x00, 0x10})},
+      {65535, bytes({0xDC, 0xFF, 0xFF}), bytes({0xDE, 0xFF, 0xFF})},
+      {65536, bytes({0xDD, 0x00, 0x01, 0x00, 0x00}),
+       bytes({0xDF, 0x00, 0x01, 0x00, 0x00})},
+  }));
+
+  CAPTURE(test_case.size);
+  std::string buffer;
+  REQUIRE(msgpack::pack_array(buffer, test_case.size));
+  REQUIRE(buffer == test_case.expected_array);
+  buffer.clear();
+  REQUIRE(msgpack::pack_map(buffer, test_case.size));
+  REQUIRE(buffer == test_case.expected_map);
+}
+
+TEST_CASE("msgpack booleans") {
+  std::string buffer;
+  msgpack::pack_bool(buffer, false);
+  msgpack::pack_bool(buffer, true);
+  REQUIRE(buffer == bytes({0xC2, 0xC3}));
+}
+
+TEST_CASE("msgpack binary") {
+  struct TestCase {
+    std::size_t size;
+    std::string expected_header;
+  };
+
+  // Binary has no "fix" form.
+  auto test_case = GENERATE(values<TestCase>({
+      {0, bytes({0xC4, 0x00})},
+      {255, bytes({0xC4, 0xFF})},
+      {256, bytes({0xC5, 0x01, 0x00})},
+      {65536, bytes({0xC6, 0x00, 0x01, 0x00, 0x00})},
+  }));
+
+  CAPTURE(test_case.size);
+  const std::string value(test_case.size, 'x');
+  std::string buffer;
+  REQUIRE(msgpack::pack_binary(buffer, value));
+  REQUIRE(buffer == test_case.expected_header + value);
+}
+
+TEST_CASE("msgpack unchecked writers encode the same bytes") {
+  // Write with `unchecked_pack` into a buffer having the specified room, and
+  // return what was written.
+  const auto unchecked = [](std::size_t room, auto&& unchecked_pack) {
+    std::string buffer(room, '\0');
+    char* const end = unchecked_pack(buffer.data());
+    REQUIRE(end <= buffer.data() + room);
+    buffer.resize(end - buffer.data());
+    return buffer;
+  };
+
+  SECTION("integers") {
+    const std::int64_t value = GENERATE(
+        as<std::int64_t>{}, 0, 127, 128, 65536, -1, -33, -32769, 4294967296,
+        std::numeric_limits<std::int64_t>::min());
+    CAPTURE(value);
+    std::string expected;
+    msgpack::pack_integer(expected, value);
+    REQUIRE(unchecked(msgpack::unchecked::max_integer_size, [&](char* out) {
+              return msgpack::unchecked::pack_integer(out, value);
+            }) == expected);
+  }
+
+  SECTION("big endian integers of each width") {
+    REQUIRE(unchecked(1, [](char* out) {
+              return msgpack::unchecked::pack_big_endian(out,
+                                                         std::int8_t(-2));
+            }) == bytes({0xFE}));
+    REQUIRE(unchecked(2, [](char* out) {
+              return msgpack::unchecked::pack_big_endian(out,
+                                                         std::uint16_t(0x0102));
+            }) == bytes({0x01, 0x02}));
+    REQUIRE(unchecked(4, [](char* out) {
+              return msgpack::unchecked::pack_big_endian(
+                  out, std::int32_t(-0x01020304));
+            }) == bytes({0xFE, 0xFD, 0xFC, 0xFC}));
+    REQUIRE(unchecked(8, [](char* out) {
+              return msgpack::unchecked::pack_big_endian(
+                  out, std::uint64_t(0x0102030405060708));
+            }) == bytes({0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08}));
+  }
+
+  SECTION("doubles") {
+    const double value = GENERATE(0.0, -1.5, 1e300);
+    CAPTURE(value);
+    std::string expected;
+    msgpack::pack_double(expected, value);
+    REQUIRE(unchecked(msgpack::unchecked::max_double_size, [&](char* out) {
+              return msgpack::unchecked::pack_double(out, value);
+            }) == expected);
+  }
+
+  SECTION("strings, arrays, and maps") {
+    const std::size_t size =
+        GENERATE(as<std::size_t>{}, 0, 15, 16, 31, 32, 256, 65536);
+    CAPTURE(size);
+    const std::string value(size, 'x');
+    std::string expected;
+    REQUIRE(msgpack::pack_string(expected, value));
+    REQUIRE(unchecked(msgpack::unchecked::max_header_size + size,
+                      [&](char* out) {
+                        return msgpack::unchecked::pack_string(out, value);
+                      }) == expected);
+
+    expected.clear();
+    REQUIRE(msgpack::pack_array(expected, size));
+    REQUIRE(unchecked(msgpack::unchecked::max_header_size, [&](char* out) {
+              return msgpack::unchecked::pack_array(out, size);
+            }) == expected);
+
+    expected.clear();
+    REQUIRE(msgpack::pack_map(expected, size));
+    REQUIRE(unchecked(msgpack::unchecked::max_header_size, [&](char* out) {
+              return msgpack::unchecked::pack_map(out, size);
+            }) == expected);
+  }
+
+  SECTION("string literals") {
+    constexpr msgpack::unchecked::FixStr key("service");
+    static_assert(key.size() == 8);
+    std::string expected;
+    REQUIRE(msgpack::pack_string(expected, "service"));
+    REQUIRE(std::string(key.bytes, key.size()) == expected);
+  }
+}
+
+TEST_CASE("msgpack check_size") {
+  REQUIRE(msgpack::check_size("string", 0));
+  const std::size_t max = std::numeric_limits<std::uint32_t>::max();
+  REQUIRE(msgpack::check_size("map", max));
+  const std::size_t too_large = max + 1;
+  auto result = msgpack::check_size("array", too_large);
+  REQUIRE(!result);
+  REQUIRE(result.error().code == Error::MESSAGEPACK_ENCODE_FAILURE);
+}
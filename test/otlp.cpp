@@ -0,0 +1,321 @@
+// These are tests for the OpenTelemetry protocol (OTLP) encoding defined in
+// `otlp.h`, and for `DatadogAgent` sending traces in that format.  The
+// encodings are checked by a minimal protobuf decoder.
+
+#include <datadog/datadog_agent_config.h>
+#include <datadog/otlp.h>
+#include <datadog/span_data.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tags.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <datadog/version.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `Message` is a decoded protobuf message: each field's number mapped to its
+// values.  A varint or fixed64 is kept in `number`, and a string or embedded
+// message in `bytes`.
+struct Value {
+  std::uint64_t number = 0;
+  std::string bytes;
+};
+using Message = std::multimap<std::uint32_t, Value>;
+
+std::uint64_t decode_varint(std::string_view& input) {
+  std::uint64_t result = 0;
+  int shift = 0;
+  while (true) {
+    REQUIRE(!input.empty());
+    const auto byte = static_cast<unsigned char>(input.front());
+    input.remove_prefix(1);
+    result |= std::uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return result;
+    }
+    shift += 7;
+  }
+}
+
+Message decode(std::string_view input) {
+  Message result;
+  while (!input.empty()) {
+    const auto tag = decode_varint(input);
+    Value value;
+    switch (tag & 7) {
+      case 0:
+        value.number = decode_varint(input);
+        break;
+      case 1:
+        REQUIRE(input.size() >= 8);
+        for (int i = 7; i >= 0; --i) {
+          value.number =
+              (value.number << 8) | static_cast<unsigned char>(input[i]);
+        }
+        input.remove_prefix(8);
+        break;
+      case 2: {
+        const auto length = decode_varint(input);
+        REQUIRE(input.size() >= length);
+        value.bytes = std::string(input.substr(0, length));
+        input.remove_prefix(length);
+        break;
+      }
+      default:
+        FAIL("unexpected wire type " << (tag & 7));
+    }
+    result.emplace(std::uint32_t(tag >> 3), std::move(value));
+  }
+  return result;
+}
+
+// Return the embedded messages of the specified `field` of `message`.
+std::vector<Message> messages(const Message& message, std::uint32_t field) {
+  std::vector<Message> result;
+  const auto [begin, end] = message.equal_range(field);
+  for (auto entry = begin; entry != end; ++entry) {
+    result.push_back(decode(entry->second.bytes));
+  }
+  return result;
+}
+
+// Return the single value of the specified `field` of `message`.
+const Value& only(const Message& message, std::uint32_t field) {
+  REQUIRE(message.count(field) == 1);
+  return message.find(field)->second;
+}
+
+// Return the attributes in the specified `field` of `message`, i.e. its
+// "KeyValue" messages, as strings.  A double value is formatted by
+// `std::to_string`.
+std::map<std::string, std::string> attributes(const Message& message,
+                                              std::uint32_t field) {
+  std::map<std::string, std::string> result;
+  for (const auto& key_value : messages(message, field)) {
+    const auto value = decode(only(key_value, 2).bytes);
+    if (value.count(1)) {
+      result[only(key_value, 1).bytes] = only(value, 1).bytes;
+    } else {
+      double real;
+      const auto bits = only(value, 4).number;
+      std::memcpy(&real, &bits, sizeof real);
+      result[only(key_value, 1).bytes] = std::to_string(real);
+    }
+  }
+  return result;
+}
+
+// `Request` is a decoded "ExportTraceServiceRequest" having one resource and
+// one instrumentation scope.
+struct Request {
+  Message resource;
+  Message scope;
+  std::vector<Message> spans;
+};
+
+// Return the decoded "ExportTraceServiceRequest" `body`, which must have one
+// resource and one instrumentation scope.
+Request decode_request(const std::string& body) {
+  const auto resource_spans = messages(decode(body), 1);
+  REQUIRE(resource_spans.size() == 1);
+  const auto scope_spans = messages(resource_spans.front(), 2);
+  REQUIRE(scope_spans.size() == 1);
+  return Request{decode(only(resource_spans.front(), 1).bytes),
+                 decode(only(scope_spans.front(), 1).bytes),
+                 messages(scope_spans.front(), 2)};
+}
+
+// Return the specified `high` and `low` bits as a big-endian ID of the
+// specified `size` in bytes.
+std::string big_endian(std::uint64_t high, std::uint64_t low,
+                       std::size_t size) {
+  std::string result;
+  for (int i = 7; i >= 0; --i) {
+    result += char((high >> (8 * i)) & 0xFF);
+  }
+  for (int i = 7; i >= 0; --i) {
+    result += char((low >> (8 * i)) & 0xFF);
+  }
+  return result.substr(16 - size);
+}
+
+}  // namespace
+
+TEST_CASE("otlp encoding") {
+  SpanDefaults defaults;
+  defaults.service = "testsvc";
+  defaults.environment = "prod";
+  defaults.version = "1.2.3";
+  const OtlpResource resource{defaults};
+
+  SpanData span;
+  span.service = "testsvc";
+  span.service_type = "web";
+  span.name = "http.request";
+  span.resource = "GET /users";
+  span.trace_id = TraceID{0x1122334455667788ULL, 0x0102030405060708ULL};
+  span.span_id = 0xAABBCCDDEEFF0011ULL;
+  span.parent_id = 42;
+  span.start.wall = std::chrono::system_clock::time_point(
+      std::chrono::seconds(1700000000));
+  span.duration = std::chrono::milliseconds(5);
+  span.tags.emplace("env", "prod");
+  span.tags.emplace("version", "1.2.3");
+  span.tags.emplace("span.kind", "client");
+  span.tags.emplace("http.method", "GET");
+  span.numeric_tags.emplace("_sampling_priority_v1", 1);
+
+  std::string spans;
+  otlp_encode(spans, span, resource);
+  std::string body;
+  otlp_encode_header(body, resource, spans.size());
+  body += spans;
+  const auto request = decode_request(body);
+
+  SECTION("the resource has the defaults") {
+    const auto resource_attributes = attributes(request.resource, 1);
+    REQUIRE(resource_attributes.at("service.name") == "testsvc");
+    REQUIRE(resource_attributes.at("deployment.environment") == "prod");
+    REQUIRE(resource_attributes.at("service.version") == "1.2.3");
+    REQUIRE(resource_attributes.at("telemetry.sdk.language") == "cpp");
+    REQUIRE(resource_attributes.at("telemetry.sdk.version") == tracer_version);
+    REQUIRE(only(request.scope, 1).bytes == "datadog");
+  }
+
+  SECTION("the span's fields") {
+    REQUIRE(request.spans.size() == 1);
+    const auto& decoded = request.spans.front();
+    REQUIRE(only(decoded, 1).bytes ==
+            big_endian(0x0102030405060708ULL, 0x1122334455667788ULL, 16));
+    REQUIRE(only(decoded, 2).bytes ==
+            big_endian(0, 0xAABBCCDDEEFF0011ULL, 8));
+    REQUIRE(only(decoded, 4).bytes == big_endian(0, 42, 8));
+    REQUIRE(only(decoded, 5).bytes == "http.request");
+    REQUIRE(only(decoded, 6).number == 3);  // client
+    REQUIRE(only(decoded, 7).number == 1700000000000000000ULL);
+    REQUIRE(only(decoded, 8).number == 1700000000005000000ULL);
+    REQUIRE(decoded.count(15) == 0);  // no status
+  }
+
+  SECTION("the span's attributes") {
+    const auto span_attributes = attributes(request.spans.front(), 9);
+    REQUIRE(span_attributes.at("operation.name") == "http.request");
+    REQUIRE(span_attributes.at("resource.name") == "GET /users");
+    REQUIRE(span_attributes.at("span.type") == "web");
+    REQUIRE(span_attributes.at("http.method") == "GET");
+    REQUIRE(span_attributes.at("_sampling_priority_v1") ==
+            std::to_string(1.0));
+    // The values of the resource aren't repeated.
+    REQUIRE(span_attributes.count("service.name") == 0);
+    REQUIRE(span_attributes.count("env") == 0);
+    REQUIRE(span_attributes.count("version") == 0);
+  }
+
+  SECTION("values that differ from the resource") {
+    span.service = "othersvc";
+    span.tags.insert_or_assign("env", "staging");
+    spans.clear();
+    otlp_encode(spans, span, resource, "synthetics");
+    const auto span_attributes =
+        attributes(decode(only(decode(spans), 2).bytes), 9);
+    REQUIRE(span_attributes.at("service.name") == "othersvc");
+    REQUIRE(span_attributes.at("env") == "staging");
+    REQUIRE(span_attributes.at("_dd.origin") == "synthetics");
+  }
+
+  SECTION("errors have a status") {
+    span.error = true;
+    span.tags.emplace(tags::error_message, "oops");
+    spans.clear();
+    otlp_encode(spans, span, resource);
+    const auto decoded = decode(only(decode(spans), 2).bytes);
+    const auto status = decode(only(decoded, 15).bytes);
+    REQUIRE(only(status, 2).bytes == "oops");
+    REQUIRE(only(status, 3).number == 2);  // error
+  }
+
+  SECTION("spans are concatenated") {
+    otlp_encode(spans, span, resource);
+    body.clear();
+    otlp_encode_header(body, resource, spans.size());
+    body += spans;
+    REQUIRE(decode_request(body).spans.size() == 2);
+  }
+}
+
+TEST_CASE("DatadogAgent sends OTLP") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.environment = "prod";
+  config.agent.api_version = TraceAPIVersion::OTLP;
+  config.agent.encode_on_send = GENERATE(false, true);
+  CAPTURE(config.agent.encode_on_send);
+  const auto logger =
+      std::make_shared<MockLogger>(std::cerr, MockLogger::ERRORS_ONLY);
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.logger = logger;
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  // An OTLP response is an empty "ExportTraceServiceResponse".
+  http_client->response_status = 200;
+
+  SECTION("to \"/v1/traces\" in protobuf") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    for (int i = 0; i < 2; ++i) {
+      auto root = tracer.create_span();
+      root.set_name("parent");
+      auto child = root.create_child();
+      child.set_name("child");
+    }
+    event_scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+    REQUIRE(http_client->requests.size() == 1);
+    const auto& request = http_client->requests.front();
+    REQUIRE(request.url.path == "/v1/traces");
+    REQUIRE(request.headers.at("Content-Type") == "application/x-protobuf");
+    REQUIRE(request.headers.count("X-Datadog-Trace-Count") == 0);
+
+    const auto decoded = decode_request(request.body);
+    REQUIRE(attributes(decoded.resource, 1).at("service.name") == "testsvc");
+    REQUIRE(decoded.spans.size() == 4);
+    std::map<std::string, std::vector<const Message*>> by_name;
+    for (const auto& span : decoded.spans) {
+      by_name[only(span, 5).bytes].push_back(&span);
+    }
+    REQUIRE(by_name.at("parent").size() == 2);
+    REQUIRE(by_name.at("child").size() == 2);
+    REQUIRE(only(*by_name.at("child").front(), 4).bytes ==
+            only(*by_name.at("parent").front(), 2).bytes);
+    REQUIRE(logger->error_count() == 0);
+  }
+
+  SECTION("incompatible with features of the Datadog Agent") {
+    SECTION("stats computation") {
+      config.agent.stats_computation_enabled = true;
+    }
+    SECTION("agent discovery") { config.agent.agent_discovery_enabled = true; }
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::DATADOG_AGENT_INVALID_API_VERSION);
+  }
+}
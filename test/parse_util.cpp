@@ -0,0 +1,106 @@
+// This test covers the integer parsing of `parse_util.h`, whose common cases
+// take a fast path that examines eight characters at a time.
+
+#include <datadog/error.h>
+#include <datadog/parse_util.h>
+
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("parse_uint64 decimal") {
+  SECTION("valid") {
+    struct TestCase {
+      std::string input;
+      std::uint64_t expected;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {"0", 0},
+        {"7", 7},
+        {"12345678", 12345678},
+        {"123456789", 123456789},
+        {"1234567890123456", 1234567890123456},
+        {"9999999999999999999", 9999999999999999999ULL},
+        {"18446744073709551615", std::numeric_limits<std::uint64_t>::max()},
+        {"000000000000000000000042", 42},
+        {" 42 ", 42},
+    }));
+
+    CAPTURE(test_case.input);
+    const auto result = parse_uint64(test_case.input, 10);
+    REQUIRE(result);
+    REQUIRE(*result == test_case.expected);
+  }
+
+  SECTION("every digit in every position") {
+    for (char digit = '0'; digit <= '9'; ++digit) {
+      for (std::size_t position = 0; position < 16; ++position) {
+        std::string input(16, '1');
+        input[position] = digit;
+        CAPTURE(input);
+        const auto result = parse_uint64(input, 10);
+        REQUIRE(result);
+        REQUIRE(*result == std::stoull(input));
+      }
+    }
+  }
+
+  SECTION("invalid") {
+    const auto input = GENERATE(as<std::string>{}, "", "-1", "1234567x",
+                                "12345678:", "123/5678", "0x10");
+    CAPTURE(input);
+    const auto result = parse_uint64(input, 10);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::INVALID_INTEGER);
+  }
+
+  SECTION("out of range") {
+    const auto input =
+        GENERATE(as<std::string>{}, "18446744073709551616",
+                 "99999999999999999999", "100000000000000000000");
+    CAPTURE(input);
+    const auto result = parse_uint64(input, 10);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::OUT_OF_RANGE_INTEGER);
+  }
+}
+
+TEST_CASE("parse_uint64 hexadecimal") {
+  SECTION("valid") {
+    struct TestCase {
+      std::string input;
+      std::uint64_t expected;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {"0", 0},
+        {"abcdef", 0xabcdef},
+        {"ABCDEF09", 0xabcdef09},
+        {"0123456789abcdef", 0x0123456789abcdef},
+        {"ffffffffffffffff", std::numeric_limits<std::uint64_t>::max()},
+    }));
+
+    CAPTURE(test_case.input);
+    const auto result = parse_uint64(test_case.input, 16);
+    REQUIRE(result);
+    REQUIRE(*result == test_case.expected);
+  }
+
+  SECTION("invalid") {
+    const auto input = GENERATE(as<std::string>{}, "", "0123456g", "@@@@@@@@",
+                                "`abcdefg", "0x12");
+    CAPTURE(input);
+    REQUIRE(!parse_uint64(input, 16));
+  }
+
+  SECTION("out of range") {
+    const auto result = parse_uint64(std::string(17, 'f'), 16);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::OUT_OF_RANGE_INTEGER);
+  }
+}
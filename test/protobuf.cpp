@@ -0,0 +1,106 @@
+// This test covers the Protocol Buffers encoding routines defined in
+// `protobuf.h`.
+
+#include <datadog/protobuf.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// Return a string containing the specified `bytes`.
+std::string bytes(std::initializer_list<unsigned char> bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+}  // namespace
+
+TEST_CASE("protobuf varints") {
+  struct TestCase {
+    std::uint64_t value;
+    std::string expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {0, bytes({0x00})},
+      {1, bytes({0x01})},
+      {127, bytes({0x7F})},
+      {128, bytes({0x80, 0x01})},
+      {300, bytes({0xAC, 0x02})},
+      {std::uint64_t(-1), bytes({0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                 0xFF, 0xFF, 0x01})},
+  }));
+
+  CAPTURE(test_case.value);
+  std::string destination;
+  protobuf::pack_varint(destination, test_case.value);
+  REQUIRE(destination == test_case.expected);
+}
+
+TEST_CASE("protobuf fields") {
+  std::string destination;
+
+  SECTION("integers") {
+    protobuf::pack_uint64(destination, 1, 150);
+    REQUIRE(destination == bytes({0x08, 0x96, 0x01}));
+  }
+
+  SECTION("negative integers are ten bytes") {
+    protobuf::pack_int32(destination, 2, -2);
+    REQUIRE(destination == bytes({0x10, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                  0xFF, 0xFF, 0xFF, 0x01}));
+  }
+
+  SECTION("doubles are little-endian") {
+    protobuf::pack_double(destination, 1, 1.0);
+    REQUIRE(destination ==
+            bytes({0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF0, 0x3F}));
+  }
+
+  SECTION("fixed64 values are little-endian") {
+    protobuf::pack_fixed64(destination, 7, 0x0102030405060708ULL);
+    REQUIRE(destination ==
+            bytes({0x39, 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01}));
+  }
+
+  SECTION("strings") {
+    protobuf::pack_string(destination, 2, "testing");
+    REQUIRE(destination == bytes({0x12, 0x07}) + "testing");
+  }
+
+  SECTION("embedded messages") {
+    const auto begin = protobuf::begin_message(destination, 3);
+    protobuf::pack_uint64(destination, 1, 150);
+    protobuf::end_message(destination, begin);
+    REQUIRE(destination == bytes({0x1A, 0x03, 0x08, 0x96, 0x01}));
+  }
+
+  SECTION("embedded messages longer than one length byte") {
+    const auto begin = protobuf::begin_message(destination, 1);
+    protobuf::pack_string(destination, 1, std::string(200, 'x'));
+    protobuf::end_message(destination, begin);
+    REQUIRE(destination.substr(0, 6) ==
+            bytes({0x0A, 0xCB, 0x01, 0x0A, 0xC8, 0x01}));
+    REQUIRE(destination.size() == 3 + 203);
+  }
+
+  SECTION("embedded messages of known size") {
+    protobuf::pack_message_header(destination, 3, 3);
+    protobuf::pack_uint64(destination, 1, 150);
+    REQUIRE(destination == bytes({0x1A, 0x03, 0x08, 0x96, 0x01}));
+    REQUIRE(protobuf::message_size(3, 3) == destination.size());
+    REQUIRE(protobuf::message_size(1, 200) == 3 + 200);
+    REQUIRE(protobuf::message_size(16, 1) == 2 + 1 + 1);
+  }
+
+  SECTION("map entries") {
+    protobuf::pack_map_entry(destination, 10, "k", "v");
+    REQUIRE(destination == bytes({0x52, 0x06, 0x0A, 0x01, 'k', 0x12, 0x01,
+                                  'v'}));
+  }
+}
@@ -0,0 +1,178 @@
+// These are tests for `RecordingCollector` and `read_trace_recording`, whose
+// recordings are written to a new temporary directory.
+
+#include <datadog/error.h>
+#include <datadog/recording_collector.h>
+#include <datadog/span_data.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mocks/collectors.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+class RecordingFile {
+  std::string directory_;
+  std::string path_;
+
+ public:
+  RecordingFile() {
+    char directory[] = "/tmp/recording-collector-test-XXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    directory_ = directory;
+    path_ = directory_ + "/recording";
+  }
+
+  ~RecordingFile() {
+    std::remove(path_.c_str());
+    ::rmdir(directory_.c_str());
+  }
+
+  const std::string& path() const { return path_; }
+};
+
+std::unique_ptr<SpanData> make_span(std::uint64_t span_id,
+                                    std::string resource) {
+  auto span = std::make_unique<SpanData>();
+  span->service = "testsvc";
+  span->service_type = "web";
+  span->name = "http.request";
+  span->resource = std::move(resource);
+  span->trace_id = TraceID{42, 7};
+  span->span_id = span_id;
+  span->parent_id = span_id == 1 ? 0 : 1;
+  span->start.wall = std::chrono::system_clock::time_point(
+      std::chrono::seconds(1700000000) + std::chrono::nanoseconds(123));
+  span->duration = std::chrono::microseconds(1500);
+  span->error = span_id == 2;
+  span->tags.emplace("http.method", "GET");
+  span->tags.emplace("_dd.p.dm", "-1");
+  span->numeric_tags.emplace("_dd.measured", 1.0);
+  return span;
+}
+
+std::vector<std::unique_ptr<SpanData>> make_chunk() {
+  std::vector<std::unique_ptr<SpanData>> spans;
+  spans.push_back(make_span(1, "GET /users"));
+  spans.push_back(make_span(2, "GET /users"));
+  spans.back()->marks[0] = SpanMark{"db.ready", std::chrono::nanoseconds(250)};
+  spans.back()->mark_count = 1;
+  return spans;
+}
+
+}  // namespace
+
+TEST_CASE("RecordingCollector") {
+  const RecordingFile file;
+  const auto inner = std::make_shared<MockCollector>();
+
+  SECTION("records what it passes on") {
+    auto collector = RecordingCollector::open(inner, file.path());
+    REQUIRE(collector);
+    REQUIRE((*collector)->send(make_chunk(), nullptr));
+    REQUIRE(
+        (*collector)->send_with_origin(make_chunk(), nullptr, "synthetics"));
+    REQUIRE((*collector)->flush(std::chrono::steady_clock::now()));
+    REQUIRE(inner->chunks.size() == 2);
+
+    auto chunks = read_trace_recording(file.path());
+    REQUIRE(chunks);
+    REQUIRE(chunks->size() == 2);
+    REQUIRE((*chunks)[0].origin.empty());
+    REQUIRE((*chunks)[1].origin == "synthetics");
+
+    const auto& spans = (*chunks)[1].spans;
+    REQUIRE(spans.size() == 2);
+    const SpanData& expected = *inner->chunks[1][1];
+    const SpanData& actual = *spans[1];
+    REQUIRE(actual.service == expected.service);
+    REQUIRE(actual.service_type == expected.service_type);
+    REQUIRE(actual.name == expected.name);
+    REQUIRE(actual.resource == expected.resource);
+    REQUIRE(actual.trace_id == expected.trace_id);
+    REQUIRE(actual.span_id == expected.span_id);
+    REQUIRE(actual.parent_id == expected.parent_id);
+    REQUIRE(actual.start.wall == expected.start.wall);
+    REQUIRE(actual.duration == expected.duration);
+    REQUIRE(actual.error == expected.error);
+    REQUIRE(actual.tags.size() == 2);
+    REQUIRE(actual.tags.at("http.method") == "GET");
+    REQUIRE(actual.tags.at("_dd.p.dm") == "-1");
+    // The mark is recorded as a numeric tag.
+    REQUIRE(actual.numeric_tags.size() == 2);
+    REQUIRE(actual.numeric_tags.at("_dd.measured") == 1.0);
+    REQUIRE(actual.numeric_tags.at("db.ready") == 250.0);
+  }
+
+  SECTION("anonymizes resources and tag values") {
+    auto collector =
+        RecordingCollector::open(inner, file.path(), /*anonymize=*/true);
+    REQUIRE(collector);
+    REQUIRE((*collector)->send(make_chunk(), nullptr));
+    REQUIRE((*collector)->flush(std::chrono::steady_clock::now()));
+
+    auto chunks = read_trace_recording(file.path());
+    REQUIRE(chunks);
+    REQUIRE(chunks->size() == 1);
+    const auto& spans = (*chunks)[0].spans;
+    REQUIRE(spans.size() == 2);
+    for (const auto& span : spans) {
+      REQUIRE(span->service == "testsvc");
+      REQUIRE(span->resource.size() == std::string("GET /users").size());
+      REQUIRE(span->resource != "GET /users");
+      REQUIRE(span->tags.at("http.method").size() == 3);
+      REQUIRE(span->tags.at("http.method") != "GET");
+      REQUIRE(span->tags.at("_dd.p.dm") == "-1");
+    }
+    // Equal strings remain equal.
+    REQUIRE(spans[0]->resource == spans[1]->resource);
+  }
+
+  SECTION("an incomplete chunk at the end is ignored") {
+    {
+      auto collector = RecordingCollector::open(inner, file.path());
+      REQUIRE(collector);
+      REQUIRE((*collector)->send(make_chunk(), nullptr));
+      REQUIRE((*collector)->send(make_chunk(), nullptr));
+    }
+    std::FILE* recording = std::fopen(file.path().c_str(), "rb+");
+    REQUIRE(recording);
+    REQUIRE(std::fseek(recording, 0, SEEK_END) == 0);
+    const long size = std::ftell(recording);
+    std::fclose(recording);
+    REQUIRE(::truncate(file.path().c_str(), size - 5) == 0);
+
+    auto chunks = read_trace_recording(file.path());
+    REQUIRE(chunks);
+    REQUIRE(chunks->size() == 1);
+    REQUIRE((*chunks)[0].spans.size() == 2);
+  }
+
+  SECTION("a file that isn't a recording is an error") {
+    std::FILE* other = std::fopen(file.path().c_str(), "wb");
+    REQUIRE(other);
+    std::fputs("not a recording", other);
+    std::fclose(other);
+
+    auto chunks = read_trace_recording(file.path());
+    REQUIRE(!chunks);
+    REQUIRE(chunks.error().code == Error::TRACE_RECORDING_ERROR);
+  }
+
+  SECTION("a file that can't be created is an error") {
+    auto collector =
+        RecordingCollector::open(inner, file.path() + "/nonexistent/file");
+    REQUIRE(!collector);
+    REQUIRE(collector.error().code == Error::TRACE_RECORDING_ERROR);
+  }
+}
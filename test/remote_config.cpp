@@ -0,0 +1,269 @@
+// These are tests for `RemoteConfigClient`, which applies the configuration
+// delivered by the Datadog Agent's remote configuration endpoint, and for how
+// `Tracer` uses it.
+
+#include <datadog/clock.h>
+#include <datadog/remote_config.h>
+#include <datadog/span.h>
+#include <datadog/trace_sampler.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <datadog/json.hpp>
+#include <memory>
+#include <string>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+std::string encode_base64(std::string_view input) {
+  const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string result;
+  std::uint32_t bits = 0;
+  int bit_count = 0;
+  for (const char ch : input) {
+    bits = (bits << 8) | static_cast<unsigned char>(ch);
+    bit_count += 8;
+    while (bit_count >= 6) {
+      bit_count -= 6;
+      result += alphabet[(bits >> bit_count) & 0x3F];
+    }
+  }
+  if (bit_count > 0) {
+    result += alphabet[(bits << (6 - bit_count)) & 0x3F];
+  }
+  while (result.size() % 4) {
+    result += '=';
+  }
+  return result;
+}
+
+// Return the path of the remote configuration file having the specified `id`.
+std::string config_path(std::string_view id) {
+  return "datadog/2/APM_TRACING/" + std::string(id) + "/config";
+}
+
+// `Target` is a configuration file in a response from the Datadog Agent.
+struct Target {
+  std::string id;
+  nlohmann::json config;
+  std::string hash;
+  // Whether the file's content is delivered, rather than already held.
+  bool delivered = true;
+};
+
+// Return a response from the Datadog Agent that lists the specified `targets`
+// as the client's configuration, at the specified `version`.
+std::string response(const std::vector<Target>& targets, int version) {
+  auto metadata = nlohmann::json::object();
+  auto client_configs = nlohmann::json::array();
+  auto target_files = nlohmann::json::array();
+  for (const auto& target : targets) {
+    const auto path = config_path(target.id);
+    const auto raw = target.config.dump();
+    metadata[path] = nlohmann::json::object({
+        {"length", raw.size()},
+        {"hashes", nlohmann::json::object({{"sha256", target.hash}})},
+        {"custom", nlohmann::json::object({{"v", version}})},
+    });
+    client_configs.push_back(path);
+    if (target.delivered) {
+      target_files.push_back(nlohmann::json::object(
+          {{"path", path}, {"raw", encode_base64(raw)}}));
+    }
+  }
+  const auto signed_targets = nlohmann::json::object({
+      {"signed",
+       nlohmann::json::object({
+           {"version", version},
+           {"custom", nlohmann::json::object(
+                          {{"opaque_backend_state", "backend-state"}})},
+           {"targets", metadata},
+       })},
+  });
+  return nlohmann::json::object({
+                                    {"targets",
+                                     encode_base64(signed_targets.dump())},
+                                    {"client_configs", client_configs},
+                                    {"target_files", target_files},
+                                })
+      .dump();
+}
+
+nlohmann::json lib_config(nlohmann::json properties) {
+  return nlohmann::json::object({{"lib_config", std::move(properties)}});
+}
+
+}  // namespace
+
+TEST_CASE("RemoteConfigClient") {
+  TraceSamplerConfig trace_config;
+  trace_config.max_per_second = 100;
+  trace_config.rules.emplace_back();
+  trace_config.rules.back().service = "checkout";
+  trace_config.rules.back().sample_rate = 0.5;
+  auto finalized = finalize_config(trace_config);
+  REQUIRE(finalized);
+  const auto sampler =
+      std::make_shared<TraceSampler>(*finalized, default_clock);
+  const auto logger = std::make_shared<MockLogger>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  // The scheduler outlives the client, which cancels its polling when it's
+  // destroyed.
+  MockEventScheduler scheduler;
+  const auto client = std::make_shared<RemoteConfigClient>(
+      logger, http_client,
+      HTTPClient::URL{"http", "localhost:8126", ""}, sampler, *finalized,
+      "testsvc", "prod", "1.2.3");
+
+  SECTION("reports itself and its state") {
+    const auto request = nlohmann::json::parse(client->request_body());
+    const auto& state = request["client"]["state"];
+    REQUIRE(request["client"]["products"] ==
+            nlohmann::json::array({"APM_TRACING"}));
+    REQUIRE(request["client"]["client_tracer"]["service"] == "testsvc");
+    REQUIRE(request["client"]["client_tracer"]["env"] == "prod");
+    REQUIRE(state["targets_version"] == 0);
+    REQUIRE(state["config_states"].empty());
+    REQUIRE(request["cached_target_files"].empty());
+  }
+
+  SECTION("polls the Agent's endpoint") {
+    client->start(scheduler, std::chrono::seconds(5));
+    REQUIRE(scheduler.recurrence_interval == std::chrono::seconds(5));
+    http_client->response_status = 200;
+    http_client->response_body
+        << response({{"a", lib_config({{"tracing_rate_limit", 7}}), "aa"}}, 3);
+    scheduler.event_callback();
+    REQUIRE(http_client->request_url.path == "/v0.7/config");
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+    REQUIRE(logger->error_count() == 0);
+    REQUIRE(sampler->config_json()["max_per_second"] == 7);
+  }
+
+  SECTION("applies the sample rate and rate limit") {
+    REQUIRE(client->handle_response(response(
+        {{"a",
+          lib_config({{"tracing_sampling_rate", 0.25},
+                      {"tracing_rate_limit", 10}}),
+          "aa"}},
+        3)));
+    auto config = sampler->config_json();
+    REQUIRE(config["max_per_second"] == 10);
+    REQUIRE(config["rules"].size() == 2);
+    REQUIRE(config["rules"][0]["service"] == "checkout");
+    REQUIRE(config["rules"][1]["service"] == "*");
+    REQUIRE(config["rules"][1]["sample_rate"] == 0.25);
+
+    // The client reports what it holds, so that the Agent can respond with
+    // nothing while nothing changes.
+    const auto request = nlohmann::json::parse(client->request_body());
+    const auto& state = request["client"]["state"];
+    REQUIRE(state["targets_version"] == 3);
+    REQUIRE(state["backend_client_state"] == "backend-state");
+    REQUIRE(state["config_states"].size() == 1);
+    REQUIRE(state["config_states"][0]["id"] == "a");
+    REQUIRE(state["config_states"][0]["apply_state"] == 2);
+    REQUIRE(request["cached_target_files"][0]["path"] == config_path("a"));
+    REQUIRE(request["cached_target_files"][0]["hashes"][0]["hash"] == "aa");
+
+    SECTION("keeps them while nothing changes") {
+      REQUIRE(client->handle_response("{}"));
+      REQUIRE(sampler->config_json() == config);
+    }
+
+    SECTION("keeps a file that isn't delivered again") {
+      REQUIRE(client->handle_response(response(
+          {{"a", nlohmann::json::object(), "aa", false},
+           {"b", lib_config({{"tracing_rate_limit", 20}}), "bb"}},
+          4)));
+      config = sampler->config_json();
+      REQUIRE(config["max_per_second"] == 10);
+      REQUIRE(config["rules"][1]["sample_rate"] == 0.25);
+    }
+
+    SECTION("reverts them when the file is removed") {
+      REQUIRE(client->handle_response(response({}, 4)));
+      config = sampler->config_json();
+      REQUIRE(config["max_per_second"] == 100);
+      REQUIRE(config["rules"].size() == 1);
+    }
+
+    SECTION("applies them to a new base configuration") {
+      trace_config.rules.clear();
+      auto replacement = finalize_config(trace_config);
+      REQUIRE(replacement);
+      client->update_base(*replacement);
+      config = sampler->config_json();
+      REQUIRE(config["rules"].size() == 1);
+      REQUIRE(config["rules"][0]["sample_rate"] == 0.25);
+    }
+  }
+
+  SECTION("ignores configuration targeting another service") {
+    auto config = lib_config({{"tracing_rate_limit", 10}});
+    config["service_target"] = {{"service", "other"}, {"env", "prod"}};
+    REQUIRE(client->handle_response(response({{"a", config, "aa"}}, 3)));
+    REQUIRE(sampler->config_json()["max_per_second"] == 100);
+  }
+
+  SECTION("rejects invalid values") {
+    REQUIRE(!client->handle_response(response(
+        {{"a", lib_config({{"tracing_sampling_rate", 2.0}}), "aa"}}, 3)));
+    REQUIRE(sampler->config_json()["rules"].size() == 1);
+    const auto request = nlohmann::json::parse(client->request_body());
+    REQUIRE(request["client"]["state"]["config_states"][0]["apply_state"] == 3);
+  }
+
+  SECTION("rejects invalid responses") {
+    auto result = client->handle_response("not json");
+    REQUIRE(!result);
+    REQUIRE(result.error().code ==
+            Error::REMOTE_CONFIGURATION_INVALID_RESPONSE);
+    result = client->handle_response(R"({"targets": "!!!"})");
+    REQUIRE(!result);
+    // A file that is neither delivered nor held.
+    result = client->handle_response(response(
+        {{"a", lib_config({{"tracing_rate_limit", 10}}), "aa", false}}, 3));
+    REQUIRE(!result);
+  }
+}
+
+TEST_CASE("remote configuration kill switch") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  const auto scheduler = std::make_shared<MockEventScheduler>();
+  config.agent.http_client = http_client;
+  config.agent.event_scheduler = scheduler;
+  config.agent.remote_configuration_enabled = true;
+  config.logger = std::make_shared<NullLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const auto poll = [&](std::string body) {
+    http_client->response_status = 200;
+    http_client->response_body.str(std::move(body));
+    scheduler->event_callback();
+    http_client->drain(std::chrono::steady_clock::time_point::max());
+  };
+
+  REQUIRE(tracer.create_span().id() != 0);
+  poll(response({{"a", lib_config({{"tracing_enabled", false}}), "aa"}}, 1));
+  {
+    auto span = tracer.create_span();
+    REQUIRE(span.id() == 0);
+  }
+  poll("{}");
+  REQUIRE(tracer.create_span().id() == 0);
+  poll(response({}, 2));
+  REQUIRE(tracer.create_span().id() != 0);
+}
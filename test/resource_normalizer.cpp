@@ -0,0 +1,141 @@
+// This test covers `ResourceNormalizer`, `obfuscate_sql`, and
+// `template_url_path`, defined in `resource_normalizer.h`.
+
+#include <datadog/resource_normalizer.h>
+#include <datadog/span_data.h>
+
+#include <string>
+#include <utility>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+SpanData make_span(std::string type, std::string resource) {
+  SpanData span;
+  span.service_type = std::move(type);
+  span.resource = std::move(resource);
+  return span;
+}
+
+}  // namespace
+
+TEST_CASE("obfuscate_sql") {
+  struct TestCase {
+    std::string query;
+    std::string expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"SELECT * FROM users WHERE id = 42", "SELECT * FROM users WHERE id = ?"},
+      {"SELECT * FROM t WHERE name = 'O''Brien' AND x = 'a\\'b'",
+       "SELECT * FROM t WHERE name = ? AND x = ?"},
+      {"SELECT a FROM t WHERE b = 1.5 OR c = 0xFF OR d = -3",
+       "SELECT a FROM t WHERE b = ? OR c = ? OR d = -?"},
+      {"SELECT * FROM t WHERE id IN (1, 2, 3)",
+       "SELECT * FROM t WHERE id IN (?)"},
+      {"INSERT INTO t (a, b) VALUES ('x', 2)",
+       "INSERT INTO t (a, b) VALUES (?)"},
+      {"SELECT  a,\n\tb  FROM t -- comment\nWHERE /* hint */ c = 1  ",
+       "SELECT a, b FROM t WHERE c = ?"},
+      {"SELECT \"col1\", `col2`, table2.col3 FROM table2 WHERE $1 = x1",
+       "SELECT \"col1\", `col2`, table2.col3 FROM table2 WHERE $1 = x1"},
+      {"SELECT ? FROM t", "SELECT ? FROM t"},
+      {"SELECT 'unterminated", "SELECT ?"},
+  }));
+
+  CAPTURE(test_case.query);
+  REQUIRE(obfuscate_sql(test_case.query) == test_case.expected);
+}
+
+TEST_CASE("template_url_path") {
+  struct TestCase {
+    std::string resource;
+    std::string expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"GET /users/42", "GET /users/?"},
+      {"GET /users/42/orders/7?page=2#top", "GET /users/?/orders/?"},
+      {"/v2/items/123e4567-e89b-12d3-a456-426614174000",
+       "/v2/items/?"},
+      {"POST /api/v1/upload", "POST /api/v1/upload"},
+      {"/sessions/abc123def456ghi789jkl/", "/sessions/?/"},
+      {"/users/user42/profile", "/users/user42/profile"},
+      {"handle_request", "handle_request"},
+  }));
+
+  CAPTURE(test_case.resource);
+  REQUIRE(template_url_path(test_case.resource) == test_case.expected);
+}
+
+TEST_CASE("ResourceNormalizer") {
+  SECTION("normalizes according to the span type") {
+    ResourceNormalizer normalizer;
+    auto sql = make_span("sql", "SELECT 1");
+    auto web = make_span("web", "GET /users/42");
+    auto other = make_span("cache", "GET /users/42");
+    normalizer.normalize(sql);
+    normalizer.normalize(web);
+    normalizer.normalize(other);
+    REQUIRE(sql.resource == "SELECT ?");
+    REQUIRE(web.resource == "GET /users/?");
+    REQUIRE(other.resource == "GET /users/42");
+    REQUIRE(normalizer.size() == 2);
+  }
+
+  SECTION("does not cache web resources without a path") {
+    ResourceNormalizer normalizer;
+    auto span = make_span("web", "handle_request");
+    normalizer.normalize(span);
+    REQUIRE(span.resource == "handle_request");
+    REQUIRE(normalizer.size() == 0);
+  }
+
+  SECTION("keys the cache by span type and resource") {
+    ResourceNormalizer normalizer;
+    auto sql = make_span("db", "/42");
+    auto web = make_span("http", "/42");
+    normalizer.normalize(sql);
+    normalizer.normalize(web);
+    REQUIRE(sql.resource == "/?");
+    REQUIRE(web.resource == "/?");
+    REQUIRE(normalizer.size() == 2);
+
+    auto again = make_span("db", "/42");
+    normalizer.normalize(again);
+    REQUIRE(again.resource == "/?");
+    REQUIRE(normalizer.size() == 2);
+  }
+
+  SECTION("evicts the least recently used entry") {
+    ResourceNormalizer normalizer(2);
+    auto first = make_span("sql", "SELECT 1");
+    auto second = make_span("sql", "SELECT 'two'");
+    normalizer.normalize(first);
+    normalizer.normalize(second);
+    // Using the first again makes the second the least recently used.
+    auto first_again = make_span("sql", "SELECT 1");
+    normalizer.normalize(first_again);
+    auto third = make_span("sql", "SELECT x FROM t WHERE y = 3");
+    normalizer.normalize(third);
+    REQUIRE(third.resource == "SELECT x FROM t WHERE y = ?");
+    REQUIRE(normalizer.size() == 2);
+
+    // The evicted entry is normalized again.
+    auto second_again = make_span("sql", "SELECT 'two'");
+    normalizer.normalize(second_again);
+    REQUIRE(second_again.resource == "SELECT ?");
+    REQUIRE(normalizer.size() == 2);
+  }
+
+  SECTION("can be used without a cache") {
+    ResourceNormalizer normalizer(0);
+    auto span = make_span("sql", "SELECT 1");
+    normalizer.normalize(span);
+    REQUIRE(span.resource == "SELECT ?");
+    REQUIRE(normalizer.size() == 0);
+  }
+}
@@ -0,0 +1,115 @@
+// This test covers `RuleMatchCache`, defined in `rule_match_cache.h`.
+
+#include <datadog/rule_match_cache.h>
+#include <datadog/span_data.h>
+#include <datadog/span_matcher.h>
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+SpanData make_span(std::string service, std::string name = "op",
+                   std::string resource = "res") {
+  SpanData span;
+  span.service = std::move(service);
+  span.name = std::move(name);
+  span.resource = std::move(resource);
+  return span;
+}
+
+SpanMatcher make_matcher(std::string service) {
+  SpanMatcher matcher;
+  matcher.service = std::move(service);
+  return matcher;
+}
+
+// `Matchers` counts how many times its matchers are accessed.
+struct Matchers {
+  std::vector<CompiledSpanMatcher> matchers;
+  int accesses = 0;
+
+  std::size_t find(RuleMatchCache& cache, const SpanData& span) {
+    return cache.find(span, matchers.size(),
+                      [&](std::size_t i) -> const CompiledSpanMatcher& {
+                        ++accesses;
+                        return matchers[i];
+                      });
+  }
+};
+
+}  // namespace
+
+TEST_CASE("RuleMatchCache remembers the first matching rule") {
+  Matchers rules;
+  rules.matchers.emplace_back(make_matcher("alpha"));
+  rules.matchers.emplace_back(make_matcher("b*"));
+  rules.matchers.emplace_back(make_matcher("*"));
+  RuleMatchCache cache;
+
+  const auto beta = make_span("beta");
+  REQUIRE(rules.find(cache, beta) == 1);
+  REQUIRE(cache.size() == 1);
+  REQUIRE(cache.lookup(beta) == 1);
+
+  // The second time, only the cached rule's tags are checked.
+  rules.accesses = 0;
+  REQUIRE(rules.find(cache, beta) == 1);
+  REQUIRE(rules.accesses == 1);
+
+  // A different resource is a different entry.
+  REQUIRE(rules.find(cache, make_span("beta", "op", "other")) == 1);
+  REQUIRE(cache.size() == 2);
+
+  // "No match" is cached too.
+  rules.matchers.pop_back();
+  RuleMatchCache other_cache;
+  const auto gamma = make_span("gamma");
+  REQUIRE(rules.find(other_cache, gamma) == 2);
+  REQUIRE(other_cache.lookup(gamma) == 2);
+}
+
+TEST_CASE("RuleMatchCache checks the tags of the cached rule") {
+  auto with_tags = make_matcher("svc");
+  with_tags.tags.emplace("env", "prod*");
+  Matchers rules;
+  rules.matchers.emplace_back(with_tags);
+  rules.matchers.emplace_back(make_matcher("*"));
+  RuleMatchCache cache;
+
+  auto span = make_span("svc");
+  span.tags.emplace("env", "production");
+  REQUIRE(rules.find(cache, span) == 0);
+
+  // Same service, name, and resource, but the tags don't match, so the scan
+  // continues after the cached rule.
+  span.tags["env"] = "staging";
+  REQUIRE(rules.find(cache, span) == 1);
+  REQUIRE(cache.lookup(span) == 0);
+
+  span.tags.erase("env");
+  REQUIRE(rules.find(cache, span) == 1);
+}
+
+TEST_CASE("RuleMatchCache is bounded") {
+  Matchers rules;
+  rules.matchers.emplace_back(make_matcher("*"));
+  RuleMatchCache cache{2};
+
+  REQUIRE(rules.find(cache, make_span("a")) == 0);
+  REQUIRE(rules.find(cache, make_span("b")) == 0);
+  REQUIRE(cache.size() == 2);
+  // Inserting into a full cache clears it first.
+  REQUIRE(rules.find(cache, make_span("c")) == 0);
+  REQUIRE(cache.size() == 1);
+  REQUIRE(!cache.lookup(make_span("a")));
+
+  cache.clear();
+  REQUIRE(cache.size() == 0);
+}
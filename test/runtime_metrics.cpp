@@ -0,0 +1,56 @@
+// These are tests for `RuntimeMetrics`, which samples the resource usage of
+// the test process itself.
+
+#include <datadog/runtime_metrics.h>
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("RuntimeMetrics") {
+  RuntimeMetrics metrics;
+  const auto first = metrics.sample();
+#ifdef __linux__
+  REQUIRE(first);
+  REQUIRE(first->resident_bytes > 0);
+  REQUIRE(first->threads >= 1);
+
+  SECTION("counts threads") {
+    std::thread thread([&]() {
+      const auto second = metrics.sample();
+      REQUIRE(second);
+      REQUIRE(second->threads >= 2);
+    });
+    thread.join();
+  }
+
+  SECTION("CPU time advances") {
+    // Spin until the CPU time advances by at least one clock tick.
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    volatile std::uint64_t spin = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+      ++spin;
+    }
+    const auto second = metrics.sample();
+    REQUIRE(second);
+    REQUIRE(second->cpu_user_microseconds + second->cpu_system_microseconds >
+            first->cpu_user_microseconds + first->cpu_system_microseconds);
+  }
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  SECTION("reports heap usage") {
+    REQUIRE(first->heap_allocated_bytes);
+    REQUIRE(first->heap_reserved_bytes);
+    REQUIRE(*first->heap_allocated_bytes > 0);
+  }
+#endif
+#else
+  REQUIRE(!first);
+#endif
+}
@@ -0,0 +1,86 @@
+// This test covers `parse_sampling_rules`, defined in
+// `sampling_rule_parser.h`.
+
+#include <datadog/sampling_rule_parser.h>
+
+#include <string>
+#include <string_view>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("parse_sampling_rules") {
+  SECTION("parses each property") {
+    auto rules = parse_sampling_rules(R"json([
+        {"service": "svc", "name": "op", "resource": "GET /*",
+         "tags": {"env": "prod", "version": "1.*"},
+         "sample_rate": 0.5, "max_per_second": 10},
+        {},
+        {"sample_rate": 1}
+    ])json",
+                                      true);
+    REQUIRE(rules);
+    REQUIRE(rules->size() == 3);
+
+    const auto& first = (*rules)[0];
+    REQUIRE(first.matcher.service == "svc");
+    REQUIRE(first.matcher.name == "op");
+    REQUIRE(first.matcher.resource == "GET /*");
+    REQUIRE(first.matcher.tags.size() == 2);
+    REQUIRE(first.matcher.tags.at("env") == "prod");
+    REQUIRE(first.matcher.tags.at("version") == "1.*");
+    REQUIRE(first.sample_rate == 0.5);
+    REQUIRE(first.max_per_second == 10);
+
+    const auto& second = (*rules)[1];
+    REQUIRE(second.matcher.service == "*");
+    REQUIRE(second.matcher.name == "*");
+    REQUIRE(second.matcher.resource == "*");
+    REQUIRE(second.matcher.tags.empty());
+    REQUIRE(!second.sample_rate);
+    REQUIRE(!second.max_per_second);
+
+    REQUIRE((*rules)[2].sample_rate == 1.0);
+  }
+
+  SECTION("accepts an empty array") {
+    auto rules = parse_sampling_rules("[]", false);
+    REQUIRE(rules);
+    REQUIRE(rules->empty());
+  }
+
+  SECTION("a repeated property replaces the earlier value") {
+    auto rules = parse_sampling_rules(
+        R"json([{"service": "a", "service": "b",
+                 "tags": {"x": "1"}, "tags": {"y": "2"}}])json",
+        false);
+    REQUIRE(rules);
+    REQUIRE(rules->size() == 1);
+    const auto& matcher = (*rules)[0].matcher;
+    REQUIRE(matcher.service == "b");
+    REQUIRE(matcher.tags.size() == 1);
+    REQUIRE(matcher.tags.at("y") == "2");
+  }
+
+  SECTION("rejects what the JSON document parser would reject") {
+    auto text = GENERATE(as<std::string_view>{}, "", "[", "{}", "[1]",
+                         "[[]]", R"([{"service": 1}])",
+                         R"([{"service": null}])", R"([{"tags": []}])",
+                         R"([{"tags": {"x": 1}}])", R"([{"tags": {"x": {}}}])",
+                         R"([{"sample_rate": "1"}])",
+                         R"([{"sample_rate": true}])",
+                         R"([{"max_per_second": 1}])", R"([{"bogus": 1}])",
+                         "[] []");
+    CAPTURE(text);
+    REQUIRE(!parse_sampling_rules(text, false));
+  }
+
+  SECTION("max_per_second is allowed only in span sampling rules") {
+    const std::string_view text = R"json([{"max_per_second": 2.5}])json";
+    REQUIRE(!parse_sampling_rules(text, false));
+    auto rules = parse_sampling_rules(text, true);
+    REQUIRE(rules);
+    REQUIRE((*rules)[0].max_per_second == 2.5);
+  }
+}
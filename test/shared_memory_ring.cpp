@@ -0,0 +1,193 @@
+// These are tests for `SharedMemoryRing` and `SharedMemoryCollector`, and for
+// the draining of a ring by `DatadogAgent`.  Some test cases fork, and the
+// child process writes to the ring and then exits.
+
+#include <datadog/error.h>
+#include <datadog/shared_memory_collector.h>
+#include <datadog/shared_memory_ring.h>
+#include <datadog/span_defaults.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+struct Chunk {
+  std::string encoded;
+  std::size_t span_count;
+};
+
+std::vector<Chunk> drain(SharedMemoryRing& ring,
+                         DroppedTraceChunks* dropped = nullptr) {
+  std::vector<Chunk> chunks;
+  const auto result =
+      ring.drain([&](std::string_view chunk, std::size_t span_count) {
+        chunks.push_back(Chunk{std::string(chunk), span_count});
+      });
+  if (dropped) {
+    *dropped = result;
+  }
+  return chunks;
+}
+
+// Fork a child that invokes the specified `in_child` and then exits, and wait
+// for it.
+template <typename Function>
+void fork_and_wait(Function&& in_child) {
+  const pid_t pid = ::fork();
+  if (pid == 0) {
+    in_child();
+    std::_Exit(0);
+  }
+  REQUIRE(pid > 0);
+  int status = 0;
+  REQUIRE(::waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+}
+
+}  // namespace
+
+TEST_CASE("SharedMemoryRing") {
+  auto made = make_shared_memory_ring(4, 4096);
+  REQUIRE(made);
+  auto& ring = **made;
+
+  SECTION("drains what was written, in order") {
+    REQUIRE(ring.write("first", 1));
+    REQUIRE(ring.write("second chunk", 2));
+    const auto chunks = drain(ring);
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[0].encoded == "first");
+    REQUIRE(chunks[0].span_count == 1);
+    REQUIRE(chunks[1].encoded == "second chunk");
+    REQUIRE(chunks[1].span_count == 2);
+    REQUIRE(drain(ring).empty());
+  }
+
+  SECTION("wraps around the end of a buffer") {
+    const std::string chunk(1000, 'x');
+    for (int i = 0; i < 20; ++i) {
+      REQUIRE(ring.write(chunk + std::to_string(i), 1));
+      REQUIRE(ring.write(chunk, 1));
+      const auto chunks = drain(ring);
+      REQUIRE(chunks.size() == 2);
+      REQUIRE(chunks[0].encoded == chunk + std::to_string(i));
+    }
+  }
+
+  SECTION("drops and counts what doesn't fit") {
+    const std::string chunk(1000, 'x');
+    int written = 0;
+    while (ring.write(chunk, 3)) {
+      ++written;
+    }
+    REQUIRE(written == 4);
+    REQUIRE(!ring.write(std::string(5000, 'x'), 2));
+    DroppedTraceChunks dropped;
+    REQUIRE(drain(ring, &dropped).size() == 4);
+    REQUIRE(dropped.traces == 2);
+    REQUIRE(dropped.spans == 5);
+    // There's room again.
+    REQUIRE(ring.write(chunk, 3));
+  }
+
+  SECTION("gives each process its own buffer") {
+    REQUIRE(ring.write("parent", 1));
+    fork_and_wait([&]() { ring.write("child", 1); });
+    const auto chunks = drain(ring);
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[0].encoded == "parent");
+    REQUIRE(chunks[1].encoded == "child");
+  }
+}
+
+TEST_CASE("SharedMemoryRing reclaims the buffers of exited processes") {
+  auto made = make_shared_memory_ring(1, 4096);
+  REQUIRE(made);
+  auto& ring = **made;
+
+  fork_and_wait([&]() { ring.write("child", 1); });
+  // The child holds the only buffer.
+  REQUIRE(!ring.write("parent", 1));
+  const auto chunks = drain(ring);
+  REQUIRE(chunks.size() == 1);
+  REQUIRE(chunks[0].encoded == "child");
+  REQUIRE(ring.write("parent", 1));
+  REQUIRE(drain(ring).size() == 1);
+}
+
+TEST_CASE("make_shared_memory_ring errors") {
+  auto no_processes = make_shared_memory_ring(0, 4096);
+  REQUIRE(!no_processes);
+  REQUIRE(no_processes.error().code == Error::SHARED_MEMORY_RING_ERROR);
+  auto too_small = make_shared_memory_ring(1, 100);
+  REQUIRE(!too_small);
+  REQUIRE(too_small.error().code == Error::SHARED_MEMORY_RING_ERROR);
+}
+
+TEST_CASE("DatadogAgent drains a shared memory ring") {
+  auto made = make_shared_memory_ring(4, 64 * 1024);
+  REQUIRE(made);
+  const auto ring = *made;
+
+  // A worker process traces into the ring.
+  fork_and_wait([&]() {
+    TracerConfig config;
+    config.defaults.service = "worker";
+    config.logger = std::make_shared<NullLogger>();
+    SpanDefaults defaults;
+    defaults.service = "worker";
+    config.collector = std::make_shared<SharedMemoryCollector>(ring, defaults);
+    auto finalized = finalize_config(config);
+    if (!finalized) {
+      std::_Exit(1);
+    }
+    Tracer tracer{*finalized};
+    auto span = tracer.create_span();
+    span.set_name("worker.request");
+  });
+
+  TracerConfig config;
+  config.defaults.service = "master";
+  config.logger = std::make_shared<NullLogger>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  const auto http_client = std::make_shared<MockHTTPClient>();
+  config.agent.event_scheduler = event_scheduler;
+  config.agent.http_client = http_client;
+  config.agent.shared_memory_ring = ring;
+
+  SECTION("sends the workers' trace chunks") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    event_scheduler->event_callback();
+    REQUIRE(http_client->requests.size() == 1);
+    const auto& request = http_client->requests.front();
+    REQUIRE(request.headers.at("X-Datadog-Trace-Count") == "1");
+    REQUIRE(request.body.find("worker.request") != std::string::npos);
+  }
+
+  SECTION("requires API version v0.4") {
+    config.agent.api_version = TraceAPIVersion::V0_5;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_SHARED_MEMORY_RING);
+  }
+}
@@ -3,8 +3,10 @@
 // for propagation.
 
 #include <datadog/clock.h>
+#include <datadog/json.hpp>
 #include <datadog/span.h>
 #include <datadog/span_config.h>
+#include <datadog/span_data.h>
 #include <datadog/tag_propagation.h>
 #include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
@@ -15,7 +17,10 @@
 #include <functional>
 #include <limits>
 #include <optional>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "matchers.h"
 #include "mocks/collectors.h"
@@ -101,6 +106,64 @@ TEST_CASE("set_tag") {
     REQUIRE(span.tags.at("_dd_not_internal") == "");
     REQUIRE(span.tags.count("_dd.chipmunk") == 0);
   }
+
+  SECTION("values can be moved in") {
+    std::string url(100, 'x');
+    const char* const url_data = url.data();
+    {
+      auto span = tracer.create_span();
+      span.set_tag("http.url", std::move(url));
+      span.set_tag("_dd.moved", std::string("nope"));
+    }
+
+    const auto& span = collector->first_span();
+    REQUIRE(span.tags.at("http.url") == std::string(100, 'x'));
+    REQUIRE(span.tags.at("http.url").data() == url_data);
+    REQUIRE(span.tags.count("_dd.moved") == 0);
+  }
+
+  SECTION("many tags can be set at once") {
+    {
+      auto span = tracer.create_span();
+      span.set_tag("color", "purple");
+      span.set_tags({
+          {"color", "green"},
+          {"flavor", "lemon"},
+          {"_dd.secret.sauce", "thousand islands"},
+      });
+    }
+
+    const auto& span = collector->first_span();
+    REQUIRE(span.tags.at("color") == "green");
+    REQUIRE(span.tags.at("flavor") == "lemon");
+    REQUIRE(span.tags.count("_dd.secret.sauce") == 0);
+  }
+}
+
+TEST_CASE("set_metric") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  {
+    auto span = tracer.create_span();
+    span.set_metric("bytes", 2048);
+    span.set_metric("ratio", 0.5);
+    span.set_metric("ratio", 0.25);
+    span.set_metric("_dd.secret.metric", 1);
+  }
+
+  const auto& span = collector->first_span();
+  REQUIRE(span.numeric_tags.at("bytes") == 2048);
+  REQUIRE(span.numeric_tags.at("ratio") == 0.25);
+  REQUIRE(span.numeric_tags.count("_dd.secret.metric") == 0);
+  REQUIRE(span.tags.count("bytes") == 0);
 }
 
 TEST_CASE("lookup_tag") {
@@ -223,6 +286,99 @@ TEST_CASE("span duration") {
   }
 }
 
+TEST_CASE("create_children") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  // Partial flushing exercises registration of the children alongside the
+  // finished spans.
+  config.partial_flush_enabled = GENERATE(false, true);
+  config.partial_flush_min_spans = 2;
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  std::uint64_t root_id;
+  {
+    auto root = tracer.create_span();
+    root_id = root.id();
+    auto before = root.create_child();
+    SpanConfig child_config;
+    child_config.name = "shard.query";
+    child_config.tags = {{"shard.group", "a"}};
+    auto children = root.create_children(5, child_config);
+    REQUIRE(children.size() == 5);
+    std::set<std::uint64_t> ids;
+    for (const auto& child : children) {
+      REQUIRE(child.trace_id() == root.trace_id());
+      REQUIRE(child.parent_id() == root.id());
+      REQUIRE(child.start_time().tick == children.front().start_time().tick);
+      REQUIRE(child.lookup_tag("shard.group") == "a");
+      ids.insert(child.id());
+    }
+    REQUIRE(ids.size() == children.size());
+    children.back().set_tag("shard", "last");
+    REQUIRE(!children.front().lookup_tag("shard"));
+    REQUIRE(root.create_children(0).empty());
+  }
+
+  std::vector<const SpanData*> spans;
+  for (const auto& chunk : collector->chunks) {
+    for (const auto& span : chunk) {
+      spans.push_back(span.get());
+    }
+  }
+  REQUIRE(spans.size() == 7);
+  std::size_t shard_queries = 0;
+  for (const auto* span : spans) {
+    if (span->name == "shard.query") {
+      ++shard_queries;
+      REQUIRE(span->parent_id == root_id);
+    }
+  }
+  REQUIRE(shard_queries == 5);
+}
+
+TEST_CASE("span marks") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  {
+    auto span = tracer.create_span();
+    const auto start = span.start_time().tick;
+    span.mark("parse", start + std::chrono::microseconds(5));
+    span.mark("_dd.internal", start);
+    for (std::size_t i = 0; i < SpanData::max_marks; ++i) {
+      span.mark("serialize");
+    }
+  }
+
+  REQUIRE(collector->chunks.size() == 1);
+  const auto& span = *collector->chunks.front().front();
+  // Internal names are ignored, and so are marks beyond the maximum.
+  REQUIRE(span.mark_count == SpanData::max_marks);
+  REQUIRE(span.marks[0].name == "parse");
+  REQUIRE(span.marks[0].offset == std::chrono::microseconds(5));
+  REQUIRE(span.marks[1].name == "serialize");
+
+  // Marks are encoded as metrics, in nanoseconds.
+  std::string encoded;
+  REQUIRE(msgpack_encode(encoded, span));
+  const auto decoded = nlohmann::json::from_msgpack(encoded);
+  REQUIRE(decoded["metrics"]["parse"] == 5000.0);
+  REQUIRE(decoded["metrics"].contains("serialize"));
+}
+
 TEST_CASE(".error() and .set_error*()") {
   struct TestCase {
     std::string name;
@@ -393,15 +549,32 @@ TEST_CASE("injection") {
 
     const auto& headers = writer.items;
     REQUIRE(headers.at("x-datadog-trace-id") ==
-            std::to_string(span.trace_id()));
+            std::to_string(span.trace_id().low));
     REQUIRE(headers.at("x-datadog-parent-id") == std::to_string(span.id()));
     REQUIRE(headers.at("x-datadog-sampling-priority") ==
             std::to_string(priority));
-    REQUIRE(headers.at("x-b3-traceid") == hex(span.trace_id()));
+    REQUIRE(headers.at("x-b3-traceid") == hex(span.trace_id().low));
     REQUIRE(headers.at("x-b3-spanid") == hex(span.id()));
     REQUIRE(headers.at("x-b3-sampled") == std::to_string(int(priority > 0)));
   }
 
+  SECTION("headers are written in one batch") {
+    auto span = tracer.create_span();
+    span.trace_segment().override_sampling_priority(-1);
+    MockBulkDictWriter writer;
+    span.inject(writer);
+
+    REQUIRE(writer.batches.size() == 1);
+    const std::vector<std::pair<std::string, std::string>> expected{
+        {"x-datadog-trace-id", "42"},
+        {"x-datadog-parent-id", "42"},
+        {"x-datadog-sampling-priority", "-1"},
+        {"x-b3-traceid", "2a"},
+        {"x-b3-spanid", "2a"},
+        {"x-b3-sampled", "0"}};
+    REQUIRE(writer.batches.front() == expected);
+  }
+
   SECTION("origin and trace tags") {
     SECTION("empty trace tags") {
       const std::unordered_map<std::string, std::string> headers{
@@ -446,5 +619,24 @@ TEST_CASE("injection") {
       // trace tags, so check only that the output is a subset of the input.
       REQUIRE_THAT(*input, ContainsSubset(*output));
     }
+
+    SECTION("repeated injection follows changes to the sampling decision") {
+      auto span = tracer.create_span();
+      span.trace_segment().override_sampling_priority(2);
+      MockDictWriter first;
+      span.inject(first);
+      MockDictWriter second;
+      span.inject(second);
+      REQUIRE(first.items.at("x-datadog-tags") ==
+              second.items.at("x-datadog-tags"));
+      REQUIRE(decode_tags(first.items.at("x-datadog-tags"))
+                  ->at("_dd.p.dm") == "-4");
+
+      // Dropping the trace removes the decision maker trace tag.
+      span.trace_segment().override_sampling_priority(-1);
+      MockDictWriter third;
+      span.inject(third);
+      REQUIRE(third.items.count("x-datadog-tags") == 0);
+    }
   }
 }
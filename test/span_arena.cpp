@@ -0,0 +1,281 @@
+// These are tests for `SpanArena`, the allocator of a trace segment's spans.
+// Blocks allocated from a memory resource are observed through the resource.
+// Blocks allocated from the global heap are observed by counting the heap
+// allocations of the thread that allocates (see `allocation_counter.h`).
+
+#include <datadog/span_arena.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `CountingResource` allocates from the global heap, and records the size of
+// each allocation and how many are outstanding.  It may be used from multiple
+// threads.
+class CountingResource : public std::pmr::memory_resource {
+  std::mutex mutex_;
+  std::vector<std::size_t> sizes_;
+  std::size_t outstanding_ = 0;
+
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sizes_.push_back(bytes);
+    ++outstanding_;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* pointer, std::size_t bytes,
+                     std::size_t alignment) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --outstanding_;
+    std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+  }
+
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+ public:
+  std::vector<std::size_t> sizes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sizes_;
+  }
+
+  std::size_t outstanding() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return outstanding_;
+  }
+};
+
+bool is_aligned(const void* pointer) {
+  return reinterpret_cast<std::uintptr_t>(pointer) %
+             alignof(std::max_align_t) ==
+         0;
+}
+
+// Fill the specified `size` bytes at the specified `pointer` with the
+// specified `value`, and return whether they all then have that value.
+bool fill(void* pointer, std::size_t size, unsigned char value) {
+  std::memset(pointer, value, size);
+  const auto* bytes = static_cast<const unsigned char*>(pointer);
+  for (std::size_t i = 0; i < size; ++i) {
+    if (bytes[i] != value) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// An allocation of this size needs a block of the largest capacity, 64 KiB,
+// to itself.  Such blocks are kept for reuse only four at a time, and a
+// thread takes only one at a time.
+constexpr std::size_t large_allocation = 40 * 1024;
+
+// On a new thread, allocate the specified `count` large allocations, each
+// from an arena of its own, and then free them.  Return the number of heap
+// allocations that the thread made.
+std::uint64_t allocate_large_blocks(std::size_t count) {
+  std::uint64_t result = 0;
+  std::thread thread([&]() {
+    std::vector<void*> allocations;
+    allocations.reserve(count);
+    AllocationCounter counter;
+    for (std::size_t i = 0; i < count; ++i) {
+      SpanArena arena;
+      allocations.push_back(arena.allocate(large_allocation));
+    }
+    result = counter.count();
+    for (void* allocation : allocations) {
+      SpanArena::deallocate(allocation);
+    }
+  });
+  thread.join();
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("SpanArena blocks") {
+  CountingResource resource;
+
+  SECTION("grow by doubling up to a maximum") {
+    std::vector<void*> allocations;
+    {
+      SpanArena arena{&resource};
+      while (resource.sizes().size() < 8) {
+        void* allocation = arena.allocate(100);
+        REQUIRE(is_aligned(allocation));
+        REQUIRE(fill(allocation, 100, 0xAB));
+        allocations.push_back(allocation);
+      }
+    }
+
+    // Each block is the block's header followed by its capacity, which
+    // doubles from 2 KiB to 64 KiB.
+    const auto sizes = resource.sizes();
+    for (std::size_t i = 1; i < 6; ++i) {
+      CAPTURE(i);
+      REQUIRE(sizes[i] - sizes[i - 1] == (std::size_t(1) << i) * 1024);
+    }
+    REQUIRE(sizes[6] == sizes[5]);
+    REQUIRE(sizes[7] == sizes[5]);
+
+    // A block is released once the arena and all of its allocations are gone.
+    REQUIRE(resource.outstanding() == 8);
+    for (void* allocation : allocations) {
+      SpanArena::deallocate(allocation);
+    }
+    REQUIRE(resource.outstanding() == 0);
+  }
+
+  SECTION("allocations larger than a block get a block of their own") {
+    SpanArena arena{&resource};
+    void* small = arena.allocate(100);
+    const std::size_t size = 100 * 1024;
+    void* large = arena.allocate(size);
+    REQUIRE(is_aligned(large));
+    REQUIRE(fill(large, size, 0xCD));
+    REQUIRE(resource.sizes().size() == 2);
+    REQUIRE(resource.sizes()[1] > size);
+
+    // The arena keeps allocating from its current block.
+    void* other = arena.allocate(100);
+    REQUIRE(resource.sizes().size() == 2);
+
+    SpanArena::deallocate(large);
+    REQUIRE(resource.outstanding() == 1);
+    SpanArena::deallocate(small);
+    SpanArena::deallocate(other);
+  }
+
+  SECTION("allocations may be freed by another thread") {
+    std::vector<void*> allocations;
+    {
+      SpanArena arena{&resource};
+      for (int i = 0; i < 100; ++i) {
+        allocations.push_back(arena.allocate(100));
+      }
+    }
+    REQUIRE(resource.outstanding() > 0);
+    std::thread thread([&]() {
+      for (void* allocation : allocations) {
+        SpanArena::deallocate(allocation);
+      }
+    });
+    thread.join();
+    REQUIRE(resource.outstanding() == 0);
+  }
+
+  SECTION("a moved-from arena releases nothing") {
+    SpanArena arena{&resource};
+    void* allocation = arena.allocate(100);
+    SpanArena moved{std::move(arena)};
+    SpanArena assigned;
+    assigned = std::move(moved);
+    void* other = assigned.allocate(100);
+    REQUIRE(resource.sizes().size() == 1);
+    SpanArena::deallocate(allocation);
+    SpanArena::deallocate(other);
+    REQUIRE(resource.outstanding() == 1);
+  }
+}
+
+TEST_CASE("SpanArena without a memory resource") {
+  SECTION("allocations larger than a block come from the global heap") {
+    AllocationCounter counter;
+    SpanArena arena;
+    const std::size_t size = 100 * 1024;
+    void* large = arena.allocate(size);
+    REQUIRE(is_aligned(large));
+    REQUIRE(fill(large, size, 0xEF));
+    REQUIRE(counter.count() == 1);
+    SpanArena::deallocate(large);
+    REQUIRE(counter.live_allocations() == 0);
+  }
+
+  SECTION("unpooled allocations come from the global heap") {
+    AllocationCounter counter;
+    void* allocation = SpanArena::allocate_unpooled(100);
+    REQUIRE(is_aligned(allocation));
+    REQUIRE(counter.live_allocations() == 1);
+    SpanArena::deallocate(allocation);
+    SpanArena::deallocate(nullptr);
+    REQUIRE(counter.live_allocations() == 0);
+  }
+
+  SECTION("released blocks are reused, up to a limit") {
+    // The first round takes any blocks kept from other tests.  Of its blocks,
+    // at most four are kept, and so the second round allocates most of its
+    // blocks, but reuses some.
+    allocate_large_blocks(20);
+    const auto allocations = allocate_large_blocks(20);
+    REQUIRE(allocations >= 16);
+    REQUIRE(allocations < 20);
+  }
+
+  SECTION("a thread takes only some of the released blocks") {
+    allocate_large_blocks(20);
+    // Four blocks are now kept.  One thread holds one of them, and so leaves
+    // the other three for another thread.
+    std::uint64_t allocations = 0;
+    void* held = nullptr;
+    std::thread holder([&]() {
+      SpanArena arena;
+      held = arena.allocate(large_allocation);
+      std::thread other([&]() {
+        std::vector<void*> others;
+        others.reserve(3);
+        AllocationCounter counter;
+        for (int i = 0; i < 3; ++i) {
+          SpanArena other_arena;
+          others.push_back(other_arena.allocate(large_allocation));
+        }
+        allocations = counter.count();
+        for (void* allocation : others) {
+          SpanArena::deallocate(allocation);
+        }
+      });
+      other.join();
+    });
+    holder.join();
+    SpanArena::deallocate(held);
+    REQUIRE(allocations == 0);
+  }
+
+  SECTION("reused blocks are fully usable") {
+    // Blocks released by one thread are reused by another, whose allocations
+    // may use all of the memory.  With AddressSanitizer, this also checks
+    // that no allocation overlaps a block's bookkeeping.
+    for (int round = 0; round < 3; ++round) {
+      std::vector<void*> allocations;
+      bool filled = true;
+      std::thread thread([&]() {
+        SpanArena arena;
+        for (int i = 0; i < 200; ++i) {
+          void* allocation = arena.allocate(300);
+          filled = fill(allocation, 300, static_cast<unsigned char>(i)) &&
+                   filled;
+          allocations.push_back(allocation);
+        }
+      });
+      thread.join();
+      REQUIRE(filled);
+      for (void* allocation : allocations) {
+        SpanArena::deallocate(allocation);
+      }
+    }
+  }
+}
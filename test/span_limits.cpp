@@ -0,0 +1,167 @@
+// These are tests for `SpanLimits`, which bound the sizes of a span's resource
+// name and tags, and its number of tags, as they're set.
+
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/span_limits.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <datadog/json.hpp>
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("truncate_utf8") {
+  REQUIRE(truncate_utf8("hello", 10) == "hello");
+  REQUIRE(truncate_utf8("hello", 5) == "hello");
+  REQUIRE(truncate_utf8("hello", 3) == "hel");
+  REQUIRE(truncate_utf8("hello", 0) == "");
+  // "é" is two bytes, and "€" is three.
+  REQUIRE(truncate_utf8("caf\xC3\xA9", 4) == "caf");
+  REQUIRE(truncate_utf8("caf\xC3\xA9", 5) == "caf\xC3\xA9");
+  REQUIRE(truncate_utf8("\xE2\x82\xAC\xE2\x82\xAC", 5) == "\xE2\x82\xAC");
+}
+
+TEST_CASE("span limits") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.tags = {{"default", "tag"}};
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.span_limits.max_resource_bytes = 4;
+  config.span_limits.max_tag_name_bytes = 11;
+  config.span_limits.max_tag_value_bytes = 5;
+  config.span_limits.max_tags = 3;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  SECTION("truncate the resource name and tags as they're set") {
+    {
+      auto span = tracer.create_span();
+      span.set_resource_name("select * from users");
+      span.set_tag("http.request.body", "0123456789");
+      span.set_tag("moved", std::string("0123456789"));
+    }
+    const auto& span = collector->first_span();
+    REQUIRE(span.resource == "sele");
+    REQUIRE(span.tags.at("http.reques") == "01234");
+    REQUIRE(span.tags.at("moved") == "01234");
+    REQUIRE(span.tags.count("http.request.body") == 0);
+  }
+
+  SECTION("discard new tags beyond the maximum, but overwrite existing ones") {
+    {
+      auto span = tracer.create_span();
+      span.set_tag("one", "1");
+      span.set_metric("two", 2);
+      span.set_tag("three", "3");
+      span.set_metric("four", 4);
+      span.set_tag("one", "uno");
+      span.set_metric("two", 22);
+    }
+    const auto& span = collector->first_span();
+    // The default tag counts toward the maximum.
+    REQUIRE(span.tags.at("default") == "tag");
+    REQUIRE(span.tags.at("one") == "uno");
+    REQUIRE(span.numeric_tags.at("two") == 22);
+    REQUIRE(span.tags.count("three") == 0);
+    REQUIRE(span.numeric_tags.count("four") == 0);
+  }
+
+  SECTION("apply to error details") {
+    {
+      auto span = tracer.create_span();
+      span.set_error_stack("a very long stack trace");
+    }
+    const auto& span = collector->first_span();
+    REQUIRE(span.error);
+    REQUIRE(span.tags.at("error.stack") == "a ver");
+  }
+
+  SECTION("apply to a span's configuration") {
+    {
+      SpanConfig span_config;
+      span_config.resource = "GET /users/:id";
+      span_config.tags = {{"http.method", "GET /users"}};
+      auto span = tracer.create_span(span_config);
+    }
+    const auto& span = collector->first_span();
+    REQUIRE(span.resource == "GET ");
+    REQUIRE(span.tags.at("http.method") == "GET /");
+  }
+}
+
+TEST_CASE("default span limits are the Datadog Agent's") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+  {
+    auto span = tracer.create_span();
+    span.set_resource_name(std::string(6000, 'r'));
+    span.set_tag(std::string(300, 'k'), std::string(30000, 'v'));
+  }
+  const auto& span = collector->first_span();
+  REQUIRE(span.resource.size() == 5000);
+  REQUIRE(span.tags.at(std::string(200, 'k')).size() == 25000);
+}
+
+TEST_CASE("span tag projection") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.tags = {{"default", "tag"}};
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.span_limits.allowed_tags = {"http.*", "db.*", "default"};
+  config.span_limits.denied_tags = {"http.request.headers.*", "db.statement"};
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+  {
+    SpanConfig span_config;
+    span_config.tags = {{"http.method", "GET"}, {"component", "nginx"}};
+    auto span = tracer.create_span(span_config);
+    span.set_tag("http.url", "/users");
+    span.set_tag("http.request.headers.cookie", std::string("secret"));
+    span.set_tags({{"db.statement", "select"}, {"db.type", "postgres"}});
+    span.set_tag("query", "debug=1");
+    span.set_metric("db.row_count", 3);
+    span.set_metric("debug.count", 1);
+    span.set_error_message("oops");
+  }
+  const auto& span = collector->first_span();
+  REQUIRE(span.tags.at("http.method") == "GET");
+  REQUIRE(span.tags.at("http.url") == "/users");
+  REQUIRE(span.tags.at("db.type") == "postgres");
+  REQUIRE(span.numeric_tags.at("db.row_count") == 3);
+  REQUIRE(span.tags.count("component") == 0);
+  REQUIRE(span.tags.count("http.request.headers.cookie") == 0);
+  REQUIRE(span.tags.count("db.statement") == 0);
+  REQUIRE(span.tags.count("query") == 0);
+  REQUIRE(span.numeric_tags.count("debug.count") == 0);
+  // Default tags and the tracer's own tags aren't projected.
+  REQUIRE(span.tags.at("default") == "tag");
+  REQUIRE(span.tags.at("error.msg") == "oops");
+
+  const auto json = to_json(config.span_limits);
+  REQUIRE(json["allowed_tags"] ==
+          nlohmann::json(config.span_limits.allowed_tags));
+  REQUIRE(json["denied_tags"] ==
+          nlohmann::json(config.span_limits.denied_tags));
+}
@@ -0,0 +1,121 @@
+// This test covers `SpanNormalizer`, `is_valid_utf8`, `to_valid_utf8`,
+// `normalize_service`, and `normalize_operation_name`, defined in
+// `span_normalizer.h`.
+
+#include <datadog/span_data.h>
+#include <datadog/span_normalizer.h>
+
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("UTF-8 validation") {
+  struct TestCase {
+    std::string text;
+    bool valid;
+    std::string repaired;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"", true, ""},
+      {"plain ASCII that is longer than eight bytes", true,
+       "plain ASCII that is longer than eight bytes"},
+      {"caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 and more ASCII", true,
+       "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 and more ASCII"},
+      {"\xFF", false, "\xEF\xBF\xBD"},
+      {"ab\xFF\xFE\xFD" "cd", false, "ab\xEF\xBF\xBD" "cd"},
+      // overlong encoding of "/"
+      {"\xC0\xAF", false, "\xEF\xBF\xBD"},
+      // overlong three byte encoding
+      {"\xE0\x80\xAF", false, "\xEF\xBF\xBD"},
+      // surrogate
+      {"\xED\xA0\x80", false, "\xEF\xBF\xBD"},
+      // beyond U+10FFFF
+      {"\xF4\x90\x80\x80", false, "\xEF\xBF\xBD"},
+      // truncated sequence at the end, after eight bytes of ASCII
+      {"12345678\xE2\x82", false, "12345678\xEF\xBF\xBD"},
+      // a lone continuation byte between valid sequences
+      {"\xC3\xA9\x80\xC3\xA9", false, "\xC3\xA9\xEF\xBF\xBD\xC3\xA9"},
+  }));
+
+  CAPTURE(test_case.text);
+  REQUIRE(is_valid_utf8(test_case.text) == test_case.valid);
+  REQUIRE(to_valid_utf8(test_case.text) == test_case.repaired);
+  REQUIRE(is_valid_utf8(to_valid_utf8(test_case.text)));
+}
+
+TEST_CASE("normalize_service") {
+  struct TestCase {
+    std::string name;
+    std::string expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"my-service", "my-service"},
+      {"My Service", "my_service"},
+      {"__123service", "service"},
+      {"svc!!@@name", "svc_name"},
+      {"svc:v1.2/x", "svc:v1.2/x"},
+      {"trailing__", "trailing"},
+      {"caf\xC3\xA9", "caf\xC3\xA9"},
+      {"", "unnamed-service"},
+      {"123", "unnamed-service"},
+      {std::string(150, 'a'), std::string(100, 'a')},
+  }));
+
+  CAPTURE(test_case.name);
+  REQUIRE(normalize_service(test_case.name) == test_case.expected);
+}
+
+TEST_CASE("normalize_operation_name") {
+  struct TestCase {
+    std::string name;
+    std::string expected;
+  };
+
+  auto test_case = GENERATE(values<TestCase>({
+      {"http.request", "http.request"},
+      {"My Operation!!", "My_Operation"},
+      {"..a__b", "a_b"},
+      {"a_.b", "a.b"},
+      {"caf\xC3\xA9", "caf"},
+      {"", "unnamed_operation"},
+      {"!!!", "unnamed_operation"},
+      {std::string(150, 'x'), std::string(100, 'x')},
+  }));
+
+  CAPTURE(test_case.name);
+  REQUIRE(normalize_operation_name(test_case.name) == test_case.expected);
+}
+
+TEST_CASE("SpanNormalizer") {
+  const std::size_t max_entries = GENERATE(0, 1, 1024);
+  CAPTURE(max_entries);
+  SpanNormalizer normalizer{max_entries};
+
+  for (int i = 0; i < 3; ++i) {
+    SpanData span;
+    span.service = "Web Frontend";
+    span.name = "handle request";
+    span.service_type = "web\xFF";
+    span.tags.insert_or_assign("valid", "value");
+    span.tags.insert_or_assign("invalid", "\xC0value");
+    span.tags.insert_or_assign("key\xFF", "value");
+    span.numeric_tags.insert_or_assign("metric\xFF", 1.0);
+    normalizer.normalize(span);
+
+    REQUIRE(span.service == "web_frontend");
+    REQUIRE(span.name == "handle_request");
+    // An empty resource becomes the operation name.
+    REQUIRE(span.resource == "handle_request");
+    REQUIRE(span.service_type == "web\xEF\xBF\xBD");
+    REQUIRE(span.tags.find("valid")->second == "value");
+    REQUIRE(span.tags.find("invalid")->second == "\xEF\xBF\xBDvalue");
+    REQUIRE(span.tags.find("key\xEF\xBF\xBD")->second == "value");
+    REQUIRE(span.tags.size() == 3);
+    REQUIRE(span.numeric_tags.find("metric\xEF\xBF\xBD")->second == 1.0);
+    REQUIRE(span.numeric_tags.size() == 1);
+  }
+}
@@ -0,0 +1,133 @@
+#include <datadog/clock.h>
+#include <datadog/error.h>
+#include <datadog/span.h>
+#include <datadog/span_config.h>
+#include <datadog/span_data.h>
+#include <datadog/span_quota.h>
+#include <datadog/tracer.h>
+#include <datadog/tracer_config.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+
+#include "mocks/collectors.h"
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("parse_span_quotas") {
+  SECTION("valid quotas") {
+    auto quotas = parse_span_quotas(
+        R"([{"service": "billing", "max_spans_per_second": 100},)"
+        R"( {"service": "search", "resource": "GET /",)"
+        R"(  "max_spans_per_second": 2.5}])");
+    REQUIRE(quotas);
+    REQUIRE(quotas->size() == 2);
+    REQUIRE((*quotas)[0].service == "billing");
+    REQUIRE(!(*quotas)[0].resource);
+    REQUIRE((*quotas)[0].max_spans_per_second == 100);
+    REQUIRE((*quotas)[1].service == "search");
+    REQUIRE((*quotas)[1].resource == "GET /");
+    REQUIRE((*quotas)[1].max_spans_per_second == 2.5);
+  }
+
+  SECTION("invalid quotas") {
+    auto input = GENERATE(values<std::string>({
+        "",
+        "not json",
+        R"({"service": "billing", "max_spans_per_second": 100})",
+        R"(["billing"])",
+        R"([{"service": 42, "max_spans_per_second": 100}])",
+        R"([{"service": "billing", "max_spans_per_second": "100"}])",
+        R"([{"service": "billing", "max_spans_per_second": 100, "x": 1}])",
+    }));
+    CAPTURE(input);
+    auto quotas = parse_span_quotas(input);
+    REQUIRE(!quotas);
+    REQUIRE(quotas.error().code == Error::INVALID_SPAN_QUOTAS);
+  }
+}
+
+TEST_CASE("SpanQuotas") {
+  TimePoint current_time = default_clock();
+  const Clock clock = [&current_time]() { return current_time; };
+
+  SpanData billing;
+  billing.service = "billing";
+  billing.resource = "charge";
+  SpanData refund = billing;
+  refund.resource = "refund";
+  SpanData search;
+  search.service = "search";
+
+  SECTION("services without quotas are not limited") {
+    SpanQuotas quotas{{{"billing", std::nullopt, 10}}, clock};
+    for (int i = 0; i < 100; ++i) {
+      REQUIRE(quotas.allow(search, 10));
+    }
+  }
+
+  SECTION("each span counts against the quota") {
+    SpanQuotas quotas{{{"billing", std::nullopt, 10}}, clock};
+    REQUIRE(quotas.allow(billing, 6));
+    REQUIRE(quotas.allow(refund, 4));
+    REQUIRE(!quotas.allow(billing, 1));
+    current_time += std::chrono::milliseconds(100);
+    REQUIRE(quotas.allow(billing, 1));
+    REQUIRE(!quotas.allow(billing, 1));
+  }
+
+  SECTION("a chunk larger than the bucket needs a full bucket") {
+    SpanQuotas quotas{{{"billing", std::nullopt, 10}}, clock};
+    REQUIRE(quotas.allow(billing, 50));
+    REQUIRE(!quotas.allow(billing, 50));
+    current_time += std::chrono::seconds(1);
+    REQUIRE(quotas.allow(billing, 50));
+  }
+
+  SECTION("resource quotas apply before the service's") {
+    SpanQuotas quotas{{{"billing", std::nullopt, 10}, {"billing", "refund", 2}},
+                      clock};
+    REQUIRE(quotas.allow(refund, 2));
+    // The refund quota is exhausted, and denying a refund doesn't consume the
+    // service's quota.
+    REQUIRE(!quotas.allow(refund, 1));
+    REQUIRE(!quotas.allow(refund, 1));
+    REQUIRE(quotas.allow(billing, 8));
+    REQUIRE(!quotas.allow(billing, 1));
+  }
+}
+
+TEST_CASE("span quotas drop trace chunks") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  // Two traces of three spans fit in a second's bucket, but not three.
+  config.span_quotas.push_back(SpanQuotaConfig{"testsvc", std::nullopt, 6});
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const auto create_trace = [&](const std::string& service) {
+    SpanConfig root_config;
+    root_config.service = service;
+    auto root = tracer.create_span(root_config);
+    auto child1 = root.create_child();
+    auto child2 = root.create_child();
+  };
+
+  for (int i = 0; i < 3; ++i) {
+    create_trace("testsvc");
+  }
+  create_trace("othersvc");
+
+  REQUIRE(collector->chunks.size() == 3);
+  REQUIRE(collector->span_count() == 9);
+  const auto metrics = tracer.metrics();
+  REQUIRE(metrics.quota_trace_chunks_dropped == 1);
+  REQUIRE(metrics.quota_spans_dropped == 3);
+}
@@ -1,3 +1,4 @@
+#include <datadog/flat_map.h>
 #include <datadog/span_data.h>
 #include <datadog/span_sampler.h>
 #include <datadog/tags.h>
@@ -7,8 +8,10 @@
 #include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "mocks/collectors.h"
 #include "mocks/loggers.h"
@@ -25,9 +28,13 @@ std::ostream& operator<<(std::ostream& stream, std::optional<double> value) {
   return stream << "null";
 }
 
-std::ostream& operator<<(
-    std::ostream& stream,
-    const std::unordered_map<std::string, double>& numeric_tags) {
+}  // namespace std
+
+namespace datadog {
+namespace tracing {
+
+std::ostream& operator<<(std::ostream& stream,
+                         const FlatMap<double>& numeric_tags) {
   stream << "{";
   auto iter = numeric_tags.begin();
   const auto end = numeric_tags.end();
@@ -41,7 +48,8 @@ std::ostream& operator<<(
   return stream << "}";
 }
 
-}  // namespace std
+}  // namespace tracing
+}  // namespace datadog
 
 namespace {
 
@@ -242,6 +250,64 @@ TEST_CASE("span rules only on trace drop") {
   REQUIRE(test_case.expected_tags.max_per_second == tags.max_per_second);
 }
 
+TEST_CASE("deferred span sampling") {
+  // `DeferringCollector` keeps the span sampler that it's given instead of
+  // applying it, as a buffering collector would until it flushes.
+  struct DeferringCollector : public MockCollector {
+    std::shared_ptr<SpanSampler> span_sampler;
+
+    Expected<void> send_unsampled(
+        std::vector<std::unique_ptr<SpanData>>&& spans,
+        const std::shared_ptr<TraceSampler>& response_handler,
+        std::optional<std::string_view>,
+        const std::shared_ptr<SpanSampler>& sampler,
+        std::optional<int>) override {
+      span_sampler = sampler;
+      return send(std::move(spans), response_handler);
+    }
+  };
+
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<DeferringCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.span_sampler.rules.push_back(by_service("testsvc"));
+  config.defer_span_sampling = true;
+
+  SECTION("dropped trace is sampled by the collector") {
+    config.trace_sampler.sample_rate = 0.0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+
+    REQUIRE(collector->span_sampler);
+    REQUIRE(!span_sampling_tags(collector->first_span()).mechanism);
+    collector->span_sampler->sample(collector->chunks.front());
+    const auto tags = span_sampling_tags(collector->first_span());
+    REQUIRE(tags.mechanism == 8);
+    REQUIRE(tags.rule_rate == 1.0);
+  }
+
+  SECTION("kept trace is sent as usual") {
+    config.trace_sampler.sample_rate = 1.0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto span = tracer.create_span();
+      (void)span;
+    }
+
+    REQUIRE(!collector->span_sampler);
+    REQUIRE(!span_sampling_tags(collector->first_span()).mechanism);
+  }
+}
+
 TEST_CASE("span rule sample rate") {
   TracerConfig config;
   config.defaults.service = "testsvc";
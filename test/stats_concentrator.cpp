@@ -0,0 +1,220 @@
+// This test covers `StatsConcentrator`, defined in `stats_concentrator.h`.
+// The encoded payloads are decoded using `nlohmann::json::from_msgpack`.
+
+#include <datadog/span_data.h>
+#include <datadog/span_defaults.h>
+#include <datadog/stats_concentrator.h>
+#include <datadog/tags.h>
+
+#include <chrono>
+#include <cstdint>
+#include <datadog/json.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+using Spans = std::vector<std::unique_ptr<SpanData>>;
+
+// The start of the bucket that the tests' spans end in.
+const auto epoch = std::chrono::system_clock::time_point(std::chrono::hours(1));
+
+std::unique_ptr<SpanData> make_span(std::uint64_t span_id,
+                                    std::uint64_t parent_id,
+                                    std::string service = "testsvc") {
+  auto span = std::make_unique<SpanData>();
+  span->service = std::move(service);
+  span->service_type = "web";
+  span->name = "op";
+  span->resource = "res";
+  span->trace_id = TraceID{1};
+  span->span_id = span_id;
+  span->parent_id = parent_id;
+  span->start.wall = epoch;
+  span->duration = std::chrono::milliseconds(10);
+  return span;
+}
+
+SpanDefaults defaults() {
+  SpanDefaults result;
+  result.service = "testsvc";
+  result.environment = "test";
+  result.version = "1.2.3";
+  return result;
+}
+
+// Return the aggregate in the specified `bucket` having the specified
+// `service` and `name`, or return null if there isn't one.
+const nlohmann::json* find(const nlohmann::json& bucket,
+                           const std::string& service,
+                           const std::string& name) {
+  for (const auto& stats : bucket["Stats"]) {
+    if (stats["Service"] == service && stats["Name"] == name) {
+      return &stats;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+TEST_CASE("StatsConcentrator aggregates top level and measured spans") {
+  StatsConcentrator concentrator{defaults()};
+
+  Spans spans;
+  spans.push_back(make_span(1, 0));
+  // A child having the same service is not top level.
+  spans.push_back(make_span(2, 1));
+  spans.back()->name = "child";
+  // ...unless it's measured.
+  spans.push_back(make_span(3, 1));
+  spans.back()->name = "measured";
+  spans.back()->numeric_tags[tags::internal::measured] = 1;
+  // A child having a different service is top level.
+  spans.push_back(make_span(4, 1, "othersvc"));
+  spans.back()->error = true;
+  spans.back()->tags[tags::http_status_code] = "500";
+  concentrator.add(spans);
+  // Another of the root span, with the same key.
+  spans.clear();
+  spans.push_back(make_span(5, 0));
+  spans.back()->duration = std::chrono::milliseconds(30);
+  concentrator.add(spans);
+
+  std::string encoded;
+  auto flushed = concentrator.flush(encoded, epoch + std::chrono::seconds(10));
+  REQUIRE(flushed);
+  REQUIRE(*flushed == 1);
+  const auto payload = nlohmann::json::from_msgpack(encoded);
+  REQUIRE(payload["Service"] == "testsvc");
+  REQUIRE(payload["Env"] == "test");
+  REQUIRE(payload["Version"] == "1.2.3");
+  REQUIRE(payload["Lang"] == "cpp");
+  REQUIRE(payload["Sequence"] == 1);
+  REQUIRE(payload["Stats"].size() == 1);
+
+  const auto& bucket = payload["Stats"][0];
+  const auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         epoch.time_since_epoch())
+                         .count();
+  REQUIRE(bucket["Start"] == start);
+  REQUIRE(bucket["Duration"] == 10'000'000'000);
+  REQUIRE(bucket["Stats"].size() == 3);
+  REQUIRE(find(bucket, "testsvc", "child") == nullptr);
+
+  const auto* root = find(bucket, "testsvc", "op");
+  REQUIRE(root);
+  REQUIRE((*root)["Resource"] == "res");
+  REQUIRE((*root)["Type"] == "web");
+  REQUIRE((*root)["Hits"] == 2);
+  REQUIRE((*root)["TopLevelHits"] == 2);
+  REQUIRE((*root)["Errors"] == 0);
+  REQUIRE((*root)["Duration"] == 40'000'000);
+  REQUIRE((*root)["Synthetics"] == false);
+
+  const auto* measured = find(bucket, "testsvc", "measured");
+  REQUIRE(measured);
+  REQUIRE((*measured)["Hits"] == 1);
+  REQUIRE((*measured)["TopLevelHits"] == 0);
+
+  const auto* other = find(bucket, "othersvc", "op");
+  REQUIRE(other);
+  REQUIRE((*other)["Hits"] == 1);
+  REQUIRE((*other)["TopLevelHits"] == 1);
+  REQUIRE((*other)["Errors"] == 1);
+  REQUIRE((*other)["HTTPStatusCode"] == 500);
+  // The durations of errors are in the error summary, which is binary.
+  REQUIRE((*other)["ErrorSummary"].is_binary());
+  REQUIRE((*other)["ErrorSummary"].get_binary().size() >
+          (*other)["OkSummary"].get_binary().size());
+}
+
+TEST_CASE("StatsConcentrator flushes elapsed buckets") {
+  StatsConcentrator concentrator{defaults()};
+  const auto bucket = std::chrono::seconds(10);
+
+  Spans spans;
+  spans.push_back(make_span(1, 0));
+  concentrator.add(spans);
+  spans.clear();
+  spans.push_back(make_span(2, 0));
+  spans.back()->start.wall += bucket;
+  concentrator.add(spans);
+
+  // Nothing has elapsed.
+  std::string encoded;
+  auto flushed = concentrator.flush(encoded, epoch + std::chrono::seconds(5));
+  REQUIRE(flushed);
+  REQUIRE(*flushed == 0);
+  REQUIRE(encoded.empty());
+
+  // Only the first bucket has elapsed.
+  flushed = concentrator.flush(encoded, epoch + bucket);
+  REQUIRE(flushed);
+  REQUIRE(*flushed == 1);
+  auto payload = nlohmann::json::from_msgpack(encoded);
+  REQUIRE(payload["Sequence"] == 1);
+  REQUIRE(payload["Stats"].size() == 1);
+
+  // A span ending in the flushed bucket is counted in the oldest bucket that
+  // hasn't been flushed.
+  spans.clear();
+  spans.push_back(make_span(3, 0));
+  concentrator.add(spans);
+
+  // Flushing all includes the bucket that hasn't elapsed.
+  encoded.clear();
+  flushed = concentrator.flush(encoded, epoch + bucket, true);
+  REQUIRE(flushed);
+  REQUIRE(*flushed == 1);
+  payload = nlohmann::json::from_msgpack(encoded);
+  REQUIRE(payload["Sequence"] == 2);
+  REQUIRE(payload["Stats"].size() == 1);
+  const auto start = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         (epoch + bucket).time_since_epoch())
+                         .count();
+  REQUIRE(payload["Stats"][0]["Start"] == start);
+  REQUIRE(payload["Stats"][0]["Stats"][0]["Hits"] == 2);
+}
+
+TEST_CASE("StatsConcentrator aggregates synthetics separately") {
+  StatsConcentrator concentrator{defaults()};
+
+  Spans spans;
+  spans.push_back(make_span(1, 0));
+  spans.push_back(make_span(2, 0));
+  spans.back()->tags[tags::internal::origin] = "synthetics-browser";
+  concentrator.add(spans);
+
+  std::string encoded;
+  auto flushed = concentrator.flush(encoded, epoch, true);
+  REQUIRE(flushed);
+  const auto payload = nlohmann::json::from_msgpack(encoded);
+  const auto& stats = payload["Stats"][0]["Stats"];
+  REQUIRE(stats.size() == 2);
+  REQUIRE(stats[0]["Synthetics"] != stats[1]["Synthetics"]);
+}
+
+TEST_CASE("StatsConcentrator honors the origin of a trace chunk") {
+  StatsConcentrator concentrator{defaults()};
+
+  Spans spans;
+  spans.push_back(make_span(1, 0));
+  concentrator.add(spans, "synthetics");
+  // A span's own origin tag takes precedence.
+  spans.back()->tags[tags::internal::origin] = "lambda";
+  concentrator.add(spans, "synthetics");
+
+  std::string encoded;
+  auto flushed = concentrator.flush(encoded, epoch, true);
+  REQUIRE(flushed);
+  const auto payload = nlohmann::json::from_msgpack(encoded);
+  const auto& stats = payload["Stats"][0]["Stats"];
+  REQUIRE(stats.size() == 2);
+  REQUIRE(stats[0]["Synthetics"] != stats[1]["Synthetics"]);
+}
@@ -0,0 +1,86 @@
+// This test covers `TagKey`, the key type of `FlatMap`, defined in `tag_key.h`.
+
+#include <datadog/tag_key.h>
+#include <datadog/tags.h>
+
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("TagKey") {
+  SECTION("every tag name in tags.h is interned") {
+    auto name = GENERATE(
+        tags::environment, tags::service_name, tags::span_type,
+        tags::operation_name, tags::resource_name, tags::manual_keep,
+        tags::manual_drop, tags::version, tags::error_message, tags::error_type,
+        tags::error_stack, tags::internal::propagation_error,
+        tags::internal::decision_maker, tags::internal::origin,
+        tags::internal::hostname, tags::internal::sampling_priority,
+        tags::internal::rule_sample_rate,
+        tags::internal::rule_limiter_sample_rate,
+        tags::internal::agent_sample_rate,
+        tags::internal::span_sampling_mechanism,
+        tags::internal::span_sampling_rule_rate,
+        tags::internal::span_sampling_limit);
+    CAPTURE(name);
+    const TagKey key{name};
+    REQUIRE(key.interned());
+    REQUIRE(key == name);
+    // Interned keys refer to the table, not to the argument.
+    REQUIRE(key.data() == TagKey::find_interned(name).data());
+  }
+
+  SECTION("other names are copied") {
+    auto name = GENERATE(std::string(""), std::string("short"),
+                         std::string(TagKey::inline_capacity, 'x'),
+                         std::string(TagKey::inline_capacity + 1, 'x'),
+                         std::string("a rather long tag name, for a tag"));
+    CAPTURE(name);
+    const TagKey key{name};
+    REQUIRE(!key.interned());
+    REQUIRE(TagKey::find_interned(name).data() == nullptr);
+    REQUIRE(key == name);
+    REQUIRE(key.size() == name.size());
+    REQUIRE(key.data() != name.data());
+
+    SECTION("copy") {
+      TagKey copy{key};
+      REQUIRE(copy == key);
+      TagKey assigned{"something else"};
+      assigned = key;
+      REQUIRE(assigned == key);
+      assigned = assigned;
+      REQUIRE(assigned == key);
+    }
+
+    SECTION("move") {
+      TagKey source{key};
+      TagKey moved{std::move(source)};
+      REQUIRE(moved == key);
+      TagKey assigned{"something else that is fairly long"};
+      assigned = std::move(moved);
+      REQUIRE(assigned == key);
+    }
+  }
+
+  SECTION("comparison") {
+    const TagKey key{"foo"};
+    REQUIRE(key == "foo");
+    REQUIRE("foo" == key);
+    REQUIRE(key == std::string("foo"));
+    REQUIRE(key != "bar");
+    REQUIRE(key != "fo");
+    REQUIRE(key == TagKey{"foo"});
+    REQUIRE(key != TagKey{"food"});
+  }
+
+  SECTION("printing") {
+    std::ostringstream stream;
+    stream << TagKey{"http.status_code"} << ' ' << TagKey{"custom"};
+    REQUIRE(stream.str() == "http.status_code custom");
+  }
+}
@@ -0,0 +1,50 @@
+// These are tests for `TagProjection`, which decides which tags spans may
+// have.
+
+#include <datadog/tag_projection.h>
+
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("TagProjection") {
+  SECTION("accepts every tag by default") {
+    const TagProjection projection{{}, {}};
+    REQUIRE(projection.accepts_all());
+    REQUIRE(projection.accepts("anything"));
+  }
+
+  SECTION("accepts allowed tags that aren't denied") {
+    const TagProjection projection{{"http.*", "peer.service"},
+                                   {"http.request.headers.*"}};
+    REQUIRE(!projection.accepts_all());
+    // Each name is looked up twice, the second time in the cache.
+    for (int i = 0; i < 2; ++i) {
+      REQUIRE(projection.accepts("http.method"));
+      REQUIRE(projection.accepts("peer.service"));
+      REQUIRE(!projection.accepts("peer.service.remapped"));
+      REQUIRE(!projection.accepts("http.request.headers.cookie"));
+      REQUIRE(!projection.accepts("query"));
+    }
+  }
+
+  SECTION("denies tags without an allowlist") {
+    const TagProjection projection{{}, {"debug.*", "?"}};
+    REQUIRE(projection.accepts("http.method"));
+    REQUIRE(!projection.accepts("debug.query"));
+    REQUIRE(!projection.accepts("x"));
+    REQUIRE(projection.accepts("xy"));
+  }
+
+  SECTION("still decides when its cache is full") {
+    const TagProjection projection{{"kept.*"}, {}, 2};
+    for (int i = 0; i < 10; ++i) {
+      const std::string suffix = std::to_string(i);
+      REQUIRE(projection.accepts("kept." + suffix));
+      REQUIRE(!projection.accepts("dropped." + suffix));
+    }
+  }
+}
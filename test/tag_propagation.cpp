@@ -0,0 +1,78 @@
+// This test covers `decode_tags`, `encode_tags`, and `encoded_tags_size`,
+// defined in `tag_propagation.h`.
+
+#include <datadog/error.h>
+#include <datadog/tag_propagation.h>
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+using Tags = std::vector<std::pair<std::string_view, std::string_view>>;
+
+}  // namespace
+
+TEST_CASE("decode_tags visits views in order") {
+  const std::string header = "_dd.p.dm=-4,foo=bar,_dd.p.dm=-3,empty=,=x";
+  Tags visited;
+  auto result = decode_tags(header, [&](auto key, auto value) {
+    visited.emplace_back(key, value);
+  });
+  REQUIRE(result);
+  const Tags expected{{"_dd.p.dm", "-4"},
+                      {"foo", "bar"},
+                      {"_dd.p.dm", "-3"},
+                      {"empty", ""},
+                      {"", "x"}};
+  REQUIRE(visited == expected);
+
+  // The views refer to the header.
+  for (const auto& [key, value] : visited) {
+    REQUIRE(key.data() >= header.data());
+    REQUIRE(value.data() + value.size() <= header.data() + header.size());
+  }
+
+  // The map-returning overload keeps the last of duplicate keys.
+  auto decoded = decode_tags(header);
+  REQUIRE(decoded);
+  REQUIRE(decoded->size() == 4);
+  REQUIRE(decoded->at("_dd.p.dm") == "-3");
+}
+
+TEST_CASE("decode_tags of an empty header visits nothing") {
+  auto result = decode_tags("", [](auto, auto) { REQUIRE(false); });
+  REQUIRE(result);
+}
+
+TEST_CASE("decode_tags visits nothing if any entry is malformed") {
+  auto header = GENERATE(as<std::string>{}, "a=b,c", "c,a=b", "a=b,,c=d",
+                         "a=b,");
+  CAPTURE(header);
+  auto result = decode_tags(header, [](auto, auto) { REQUIRE(false); });
+  REQUIRE(!result);
+  REQUIRE(result.error().code == Error::MALFORMED_TRACE_TAGS);
+  REQUIRE(!decode_tags(header));
+}
+
+TEST_CASE("encode_tags round trip") {
+  const std::string header = "_dd.p.dm=-4,_dd.p.upstream_services=abc";
+  auto decoded = decode_tags(header);
+  REQUIRE(decoded);
+  REQUIRE(encode_tags(*decoded) == header);
+}
+
+TEST_CASE("encoded_tags_size is the length of encode_tags") {
+  auto header = GENERATE(as<std::string>{}, "", "a=b", "_dd.p.dm=-4,x=",
+                         "_dd.p.dm=-4,_dd.p.upstream_services=abc");
+  CAPTURE(header);
+  auto decoded = decode_tags(header);
+  REQUIRE(decoded);
+  REQUIRE(encoded_tags_size(*decoded) == encode_tags(*decoded).size());
+}
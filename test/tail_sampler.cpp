@@ -0,0 +1,211 @@
+// These are tests for `TailSampler`, which decides whether to keep the traces
+// that the trace sampler dropped once they have finished.
+
+#include <datadog/metrics.h>
+#include <datadog/sampling_mechanism.h>
+#include <datadog/span_data.h>
+#include <datadog/tail_sampler.h>
+#include <datadog/tags.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+const auto window = std::chrono::seconds(10);
+
+// Return a trace chunk of the trace having the specified `trace_id`, having
+// the specified `spans` spans that last the specified `duration`, the first
+// of which has the specified sampling `priority` and, if the specified
+// `error` is true, an error.  The trace was sampled by a sampling rule.
+TailSampler::Chunk chunk(std::uint64_t trace_id, int priority,
+                         std::size_t spans = 1, bool error = false,
+                         Duration duration = std::chrono::milliseconds(1)) {
+  TailSampler::Chunk result;
+  result.sampling_mechanism = int(SamplingMechanism::RULE);
+  const auto start = default_clock();
+  for (std::size_t i = 0; i < spans; ++i) {
+    auto& span = *result.spans.emplace_back(std::make_unique<SpanData>());
+    span.trace_id = TraceID{trace_id};
+    span.span_id = trace_id * 100 + i;
+    span.start = start;
+    span.duration = duration;
+  }
+  result.spans.front()->error = error;
+  result.spans.front()->numeric_tags[tags::internal::sampling_priority] =
+      priority;
+  return result;
+}
+
+double priority(const TailSampler::Chunk& chunk) {
+  return chunk.spans.front()->numeric_tags.find(
+      tags::internal::sampling_priority)->second;
+}
+
+// Return the decision-maker trace tag of the specified `chunk`, if it has one.
+std::optional<std::string> decision_maker(const TailSampler::Chunk& chunk) {
+  const auto& tags = chunk.spans.front()->tags;
+  const auto found = tags.find(tags::internal::decision_maker);
+  if (found == tags.end()) {
+    return std::nullopt;
+  }
+  return found->second;
+}
+
+}  // namespace
+
+TEST_CASE("TailSampler") {
+  const auto metrics = std::make_shared<Metrics>();
+  TailSampler sampler{window, 1024 * 1024, std::chrono::seconds(1), 5,
+                      metrics};
+  const auto now = std::chrono::steady_clock::time_point{} + window;
+  std::vector<TailSampler::Chunk> released;
+
+  SECTION("releases chunks that sampling kept") {
+    sampler.add(chunk(1, 1), now, released);
+    sampler.add(chunk(2, 2), now, released);
+    REQUIRE(released.size() == 2);
+    REQUIRE(sampler.bytes() == 0);
+  }
+
+  SECTION("holds dropped traces for the window") {
+    sampler.add(chunk(1, 0), now, released);
+    REQUIRE(released.empty());
+    REQUIRE(sampler.bytes() > 0);
+    REQUIRE(metrics->snapshot().tail_sampling_bytes == sampler.bytes());
+
+    sampler.release(now + window / 2, false, released);
+    REQUIRE(released.empty());
+    sampler.release(now + window, false, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == 0);
+    REQUIRE(sampler.bytes() == 0);
+    REQUIRE(metrics->snapshot().tail_sampling_bytes == 0);
+    REQUIRE(metrics->snapshot().tail_sampling_traces_kept == 0);
+  }
+
+  SECTION("keeps interesting traces") {
+    struct TestCase {
+      std::string name;
+      std::size_t spans;
+      bool error;
+      Duration duration;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {"error", 1, true, std::chrono::milliseconds(1)},
+        {"duration", 1, false, std::chrono::seconds(2)},
+        {"span count", 4, false, std::chrono::milliseconds(1)},
+    }));
+
+    CAPTURE(test_case.name);
+    // A trace that sampling rules dropped is kept by the user, too.
+    const int dropped = GENERATE(0, -1);
+    const int kept = dropped == 0 ? 1 : 2;
+    CAPTURE(dropped);
+    // The trace's first chunk isn't interesting by itself, and so it's held
+    // until the second arrives.
+    sampler.add(chunk(1, dropped), now, released);
+    sampler.add(chunk(2, 0), now, released);
+    REQUIRE(released.empty());
+
+    sampler.add(chunk(1, dropped, test_case.spans, test_case.error,
+                      test_case.duration),
+                now + window / 2, released);
+    REQUIRE(released.size() == 2);
+    REQUIRE(priority(released[0]) == kept);
+    REQUIRE(priority(released[1]) == kept);
+    REQUIRE(decision_maker(released[0]) == "-3");
+    REQUIRE(decision_maker(released[1]) == "-3");
+    REQUIRE(released[0].spans.front()->span_id == 100);
+    REQUIRE(metrics->snapshot().tail_sampling_traces_kept == 1);
+
+    // Later chunks of the trace are kept too, while the other trace is still
+    // held.
+    released.clear();
+    sampler.add(chunk(1, dropped), now + window / 2, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == kept);
+
+    released.clear();
+    sampler.release(now, true, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == 0);
+    REQUIRE(!decision_maker(released[0]));
+    REQUIRE(sampler.bytes() == 0);
+  }
+
+  SECTION("doesn't reconsider the user's decisions") {
+    auto dropped = chunk(1, -1, 1, true);
+    dropped.sampling_mechanism = int(SamplingMechanism::MANUAL);
+    sampler.add(std::move(dropped), now, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == -1);
+    REQUIRE(!decision_maker(released[0]));
+    REQUIRE(sampler.bytes() == 0);
+    REQUIRE(metrics->snapshot().tail_sampling_traces_kept == 0);
+  }
+
+  SECTION("forgets held chunks when cleared") {
+    sampler.add(chunk(1, 0), now, released);
+    sampler.clear();
+    sampler.release(now, true, released);
+    REQUIRE(released.empty());
+    REQUIRE(metrics->snapshot().tail_sampling_bytes == 0);
+  }
+}
+
+TEST_CASE("TailSampler memory limit") {
+  const auto metrics = std::make_shared<Metrics>();
+  const auto now = std::chrono::steady_clock::time_point{};
+  std::vector<TailSampler::Chunk> released;
+
+  // The limit fits the first trace, but not the second.
+  std::size_t limit = 0;
+  {
+    TailSampler sizer{window, 1024 * 1024, std::nullopt, std::nullopt,
+                      metrics};
+    sizer.add(chunk(1, 0, 3), now, released);
+    limit = sizer.bytes() + 1;
+  }
+  TailSampler sampler{window, limit, std::nullopt, std::nullopt, metrics};
+  sampler.add(chunk(1, 0, 3), now, released);
+  REQUIRE(released.empty());
+
+  SECTION("falls back to the head-based decision") {
+    sampler.add(chunk(2, 0), now, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == 0);
+    REQUIRE(metrics->snapshot().tail_sampling_overflows == 1);
+
+    // Another chunk of the held trace doesn't fit either, and so the trace's
+    // held chunk is released with it, and so are the trace's later chunks.
+    released.clear();
+    sampler.add(chunk(1, 0), now, released);
+    REQUIRE(released.size() == 2);
+    REQUIRE(sampler.bytes() < limit / 2);
+    released.clear();
+    sampler.add(chunk(1, 0, 1, true), now, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == 0);
+    REQUIRE(metrics->snapshot().tail_sampling_overflows == 2);
+    REQUIRE(metrics->snapshot().tail_sampling_traces_kept == 0);
+  }
+
+  SECTION("still keeps interesting chunks") {
+    sampler.add(chunk(2, 0, 1, true), now, released);
+    REQUIRE(released.size() == 1);
+    REQUIRE(priority(released[0]) == 1);
+    REQUIRE(metrics->snapshot().tail_sampling_overflows == 0);
+    REQUIRE(metrics->snapshot().tail_sampling_traces_kept == 1);
+  }
+}
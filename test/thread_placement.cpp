@@ -0,0 +1,83 @@
+// These are tests for `place_current_thread`, `parse_cpu_list`, and the NUMA
+// node functions, defined in `thread_placement.h`.
+
+#include <datadog/thread_placement.h>
+
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("parse_cpu_list") {
+  SECTION("indices and ranges") {
+    auto cpus = parse_cpu_list("0, 2,8-10,3");
+    REQUIRE(cpus);
+    REQUIRE(*cpus == std::vector<int>{0, 2, 8, 9, 10, 3});
+  }
+
+  SECTION("invalid lists") {
+    const auto input = GENERATE("", "1,", ",1", "a", "3-1", "-1", "1-",
+                                "0-1024");
+    CAPTURE(input);
+    auto cpus = parse_cpu_list(input);
+    REQUIRE(!cpus);
+    REQUIRE(cpus.error().code == Error::INVALID_THREAD_PLACEMENT);
+  }
+}
+
+#ifdef __linux__
+TEST_CASE("place_current_thread") {
+  // The thread is kept to the first CPU on which this thread may run.
+  cpu_set_t allowed;
+  REQUIRE(sched_getaffinity(0, sizeof allowed, &allowed) == 0);
+  int first_cpu = 0;
+  while (!CPU_ISSET(first_cpu, &allowed)) {
+    ++first_cpu;
+  }
+
+  ThreadPlacement placement;
+  placement.cpus = {first_cpu};
+  placement.nice = 19;
+
+  Expected<void> placed;
+  char name[16] = {};
+  int cpu_count = 0;
+  bool on_first_cpu = false;
+  int nice = 0;
+  std::thread thread([&]() {
+    placed = place_current_thread(placement, "dd-test-placement-long-name");
+    pthread_getname_np(pthread_self(), name, sizeof name);
+    cpu_set_t cpus;
+    sched_getaffinity(0, sizeof cpus, &cpus);
+    cpu_count = CPU_COUNT(&cpus);
+    on_first_cpu = CPU_ISSET(first_cpu, &cpus);
+    nice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+  });
+  thread.join();
+
+  REQUIRE(placed);
+  // The name is truncated to 15 characters.
+  REQUIRE(std::string(name) == "dd-test-placeme");
+  REQUIRE(cpu_count == 1);
+  REQUIRE(on_first_cpu);
+  REQUIRE(nice == 19);
+}
+#endif
+
+TEST_CASE("NUMA nodes") {
+  const std::size_t count = numa_node_count();
+  REQUIRE(count >= 1);
+  REQUIRE(current_numa_node() < count);
+}
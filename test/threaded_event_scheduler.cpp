@@ -0,0 +1,124 @@
+// This test covers `ThreadedEventScheduler`, defined in
+// `threaded_event_scheduler.h`.
+
+#include <datadog/threaded_event_scheduler.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "mocks/loggers.h"
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("ThreadedEventScheduler wake") {
+  std::mutex mutex;
+  std::condition_variable invoked;
+  int invocations = 0;
+
+  ThreadedEventScheduler scheduler;
+  // The interval is long enough that only waking invokes the callback.
+  auto event = scheduler.schedule_wakeable_recurring_event(
+      std::chrono::hours(1), [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++invocations;
+        invoked.notify_one();
+      });
+  REQUIRE(event.cancel);
+  REQUIRE(event.wake);
+
+  const auto wait_for_invocations = [&](int count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return invoked.wait_for(lock, std::chrono::seconds(10),
+                            [&]() { return invocations >= count; });
+  };
+
+  event.wake();
+  REQUIRE(wait_for_invocations(1));
+  event.wake();
+  REQUIRE(wait_for_invocations(2));
+
+  // Waking a cancelled event does nothing.
+  event.cancel();
+  event.wake();
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  std::lock_guard<std::mutex> lock(mutex);
+  REQUIRE(invocations == 2);
+}
+
+TEST_CASE("ThreadedEventScheduler first delay and jitter") {
+  std::mutex mutex;
+  std::condition_variable invoked;
+  std::vector<std::chrono::steady_clock::time_point> invocations;
+
+  ThreadedEventScheduler scheduler;
+  const auto start = std::chrono::steady_clock::now();
+  auto event = scheduler.schedule_jittered_recurring_event(
+      std::chrono::milliseconds(1), std::chrono::milliseconds(200),
+      std::chrono::milliseconds(50), [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        invocations.push_back(std::chrono::steady_clock::now());
+        invoked.notify_one();
+      });
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    REQUIRE(invoked.wait_for(lock, std::chrono::seconds(10),
+                             [&]() { return invocations.size() >= 3; }));
+  }
+  event.cancel();
+
+  // The first invocation is well before the end of the first interval, and
+  // each interval thereafter is at least the interval less the jitter.
+  REQUIRE(invocations[0] - start < std::chrono::milliseconds(200));
+  REQUIRE(invocations[2] - start >= std::chrono::milliseconds(301));
+}
+
+#ifdef __linux__
+TEST_CASE("ThreadedEventScheduler thread placement") {
+  std::mutex mutex;
+  std::condition_variable invoked;
+  bool done = false;
+  std::string name;
+  int nice = 0;
+
+  ThreadPlacement placement;
+  placement.nice = 19;
+  auto logger = std::make_shared<MockLogger>();
+  ThreadedEventScheduler scheduler{placement, logger};
+  auto event = scheduler.schedule_wakeable_recurring_event(
+      std::chrono::hours(1), [&]() {
+        char buffer[16] = {};
+        pthread_getname_np(pthread_self(), buffer, sizeof buffer);
+        std::lock_guard<std::mutex> lock(mutex);
+        name = buffer;
+        nice =
+            getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+        done = true;
+        invoked.notify_one();
+      });
+  event.wake();
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    REQUIRE(invoked.wait_for(lock, std::chrono::seconds(10),
+                             [&]() { return done; }));
+  }
+  event.cancel();
+
+  REQUIRE(name == "dd-trace-sched");
+  REQUIRE(nice == 19);
+  REQUIRE(logger->error_count() == 0);
+}
+#endif
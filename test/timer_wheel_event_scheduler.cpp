@@ -0,0 +1,145 @@
+// This test covers `TimerWheelEventScheduler`, defined in
+// `timer_wheel_event_scheduler.h`.
+
+#include <datadog/timer_wheel_event_scheduler.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+// `Counter` counts the invocations of an event's callback, and records when
+// the first one happened.
+struct Counter {
+  std::mutex mutex;
+  std::condition_variable invoked;
+  int invocations = 0;
+  std::chrono::steady_clock::time_point first;
+
+  void operator()() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (invocations++ == 0) {
+      first = std::chrono::steady_clock::now();
+    }
+    invoked.notify_all();
+  }
+
+  bool wait_for(int count) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return invoked.wait_for(lock, std::chrono::seconds(10),
+                            [&]() { return invocations >= count; });
+  }
+
+  int count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return invocations;
+  }
+};
+
+}  // namespace
+
+TEST_CASE("TimerWheelEventScheduler invokes events at their intervals") {
+  TimerWheelEventScheduler scheduler{std::chrono::milliseconds(1)};
+  const auto start = std::chrono::steady_clock::now();
+
+  // The intervals are placed at different levels of the wheel.
+  Counter fast;
+  Counter medium;
+  Counter slow;
+  Counter distant;
+  const auto fast_interval = std::chrono::milliseconds(5);
+  const auto medium_interval = std::chrono::milliseconds(70);
+  const auto slow_interval = std::chrono::milliseconds(300);
+  auto cancel_fast =
+      scheduler.schedule_recurring_event(fast_interval, std::ref(fast));
+  auto cancel_medium =
+      scheduler.schedule_recurring_event(medium_interval, std::ref(medium));
+  auto cancel_slow =
+      scheduler.schedule_recurring_event(slow_interval, std::ref(slow));
+  auto cancel_distant =
+      scheduler.schedule_recurring_event(std::chrono::hours(1),
+                                         std::ref(distant));
+
+  REQUIRE(slow.wait_for(2));
+  REQUIRE(medium.wait_for(4));
+  REQUIRE(fast.wait_for(20));
+  REQUIRE(distant.count() == 0);
+
+  // No event is invoked before its interval has elapsed.
+  REQUIRE(fast.first - start >= fast_interval);
+  REQUIRE(medium.first - start >= medium_interval);
+  REQUIRE(slow.first - start >= slow_interval);
+
+  cancel_fast();
+  cancel_medium();
+  cancel_slow();
+  cancel_distant();
+  const int fast_count = fast.count();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(fast.count() == fast_count);
+}
+
+TEST_CASE("TimerWheelEventScheduler wake") {
+  TimerWheelEventScheduler scheduler;
+  Counter counter;
+  // The interval is long enough that only waking invokes the callback.
+  auto event = scheduler.schedule_wakeable_recurring_event(
+      std::chrono::hours(1), std::ref(counter));
+  REQUIRE(event.cancel);
+  REQUIRE(event.wake);
+
+  event.wake();
+  REQUIRE(counter.wait_for(1));
+  event.wake();
+  REQUIRE(counter.wait_for(2));
+
+  // Waking a cancelled event does nothing.
+  event.cancel();
+  event.wake();
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  REQUIRE(counter.count() == 2);
+}
+
+TEST_CASE("TimerWheelEventScheduler cancel") {
+  TimerWheelEventScheduler scheduler{std::chrono::milliseconds(1)};
+
+  SECTION("waits for the callback to return") {
+    std::atomic<bool> entered{false};
+    std::atomic<bool> returned{false};
+    auto cancel =
+        scheduler.schedule_recurring_event(std::chrono::milliseconds(1), [&]() {
+          entered = true;
+          std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          returned = true;
+        });
+    while (!entered) {
+      std::this_thread::yield();
+    }
+    cancel();
+    REQUIRE(returned);
+  }
+
+  SECTION("may be called by the event's own callback") {
+    Counter counter;
+    EventScheduler::Cancel cancel;
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    cancel = scheduler.schedule_recurring_event(
+        std::chrono::milliseconds(1), [&]() {
+          std::lock_guard<std::mutex> guard(mutex);
+          counter();
+          cancel();
+        });
+    lock.unlock();
+    REQUIRE(counter.wait_for(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(counter.count() == 1);
+  }
+}
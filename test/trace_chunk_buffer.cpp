@@ -0,0 +1,154 @@
+// This test covers `TraceChunkBuffer`, defined in `trace_chunk_buffer.h`.
+
+#include <datadog/trace_chunk_buffer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+namespace {
+
+struct Chunk {
+  int id;
+  TraceChunkFootprint footprint;
+};
+
+Chunk chunk(int id, std::size_t spans, bool dropped_by_sampling = false) {
+  TraceChunkFootprint footprint;
+  footprint.spans = spans;
+  footprint.bytes = spans * 100;
+  footprint.dropped_by_sampling = dropped_by_sampling;
+  return Chunk{id, footprint};
+}
+
+std::vector<int> ids(const std::vector<Chunk>& chunks) {
+  std::vector<int> result;
+  for (const auto& chunk : chunks) {
+    result.push_back(chunk.id);
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST_CASE("TraceChunkBuffer without limits keeps everything") {
+  TraceChunkBuffer<Chunk> buffer{std::nullopt, std::nullopt,
+                                 BufferOverflowPolicy::DROP_NEWEST};
+  for (int i = 0; i < 100; ++i) {
+    REQUIRE(buffer.push(chunk(i, 10)).traces == 0);
+  }
+  const auto taken = buffer.take();
+  REQUIRE(taken.size() == 100);
+  REQUIRE(taken.front().id == 0);
+  REQUIRE(taken.back().id == 99);
+  REQUIRE(buffer.take().empty());
+}
+
+TEST_CASE("TraceChunkBuffer takes kept chunks first") {
+  struct TestCase {
+    std::string name;
+    BufferOverflowPolicy policy;
+    std::vector<int> expected_ids;
+  };
+
+  // Chunks 1, 3, and 5 were dropped by sampling.  Pushing chunk 5 exceeds the
+  // limit, and so, except when dropping the newest, moves the chunks pushed
+  // earlier out of the lock-free queue.
+  auto test_case = GENERATE(values<TestCase>({
+      {"drop newest", BufferOverflowPolicy::DROP_NEWEST, {0, 2, 4, 1, 3}},
+      {"drop oldest", BufferOverflowPolicy::DROP_OLDEST, {2, 4, 1, 3, 5}},
+      {"drop by priority", BufferOverflowPolicy::DROP_BY_PRIORITY,
+       {0, 2, 4, 3, 5}},
+  }));
+
+  CAPTURE(test_case.name);
+  TraceChunkBuffer<Chunk> buffer{5, std::nullopt, test_case.policy};
+  for (int i = 0; i < 5; ++i) {
+    REQUIRE(buffer.push(chunk(i, 1, i % 2 == 1)).traces == 0);
+  }
+  REQUIRE(buffer.push(chunk(5, 1, true)).traces == 1);
+  REQUIRE(ids(buffer.take()) == test_case.expected_ids);
+}
+
+TEST_CASE("TraceChunkBuffer overflow policies") {
+  struct TestCase {
+    std::string name;
+    BufferOverflowPolicy policy;
+    std::vector<int> expected_ids;
+  };
+
+  // Chunks 0 through 3 each have two spans, and chunk 1 was dropped by
+  // sampling.  The buffer holds at most six spans, and so pushing chunk 3
+  // requires dropping a chunk.  `take` returns chunk 1, if it's still there,
+  // last.
+  auto test_case = GENERATE(values<TestCase>({
+      {"drop newest", BufferOverflowPolicy::DROP_NEWEST, {0, 2, 1}},
+      {"drop oldest", BufferOverflowPolicy::DROP_OLDEST, {2, 3, 1}},
+      {"drop by priority", BufferOverflowPolicy::DROP_BY_PRIORITY, {0, 2, 3}},
+  }));
+
+  CAPTURE(test_case.name);
+  const std::optional<std::size_t> max_spans = GENERATE(
+      std::optional<std::size_t>(6), std::optional<std::size_t>(std::nullopt));
+  // The byte limit is equivalent to the span limit, if the span limit isn't
+  // used.
+  const std::optional<std::size_t> max_bytes =
+      max_spans ? std::nullopt : std::optional<std::size_t>(600);
+  TraceChunkBuffer<Chunk> buffer{max_spans, max_bytes, test_case.policy};
+
+  REQUIRE(buffer.push(chunk(0, 2)).traces == 0);
+  REQUIRE(buffer.push(chunk(1, 2, true)).traces == 0);
+  REQUIRE(buffer.push(chunk(2, 2)).traces == 0);
+  const auto dropped = buffer.push(chunk(3, 2));
+  REQUIRE(dropped.traces == 1);
+  REQUIRE(dropped.spans == 2);
+  REQUIRE(ids(buffer.take()) == test_case.expected_ids);
+
+  // Taking the chunks frees their room in the buffer.
+  REQUIRE(buffer.push(chunk(4, 6)).traces == 0);
+  REQUIRE(ids(buffer.take()) == std::vector<int>{4});
+}
+
+TEST_CASE("TraceChunkBuffer drops a chunk that exceeds the limits alone") {
+  auto policy = GENERATE(BufferOverflowPolicy::DROP_NEWEST,
+                         BufferOverflowPolicy::DROP_OLDEST,
+                         BufferOverflowPolicy::DROP_BY_PRIORITY);
+  TraceChunkBuffer<Chunk> buffer{4, std::nullopt, policy};
+  const auto dropped = buffer.push(chunk(0, 5));
+  REQUIRE(dropped.traces == 1);
+  REQUIRE(dropped.spans == 5);
+  REQUIRE(buffer.take().empty());
+}
+
+TEST_CASE("TraceChunkBuffer shards") {
+  TraceChunkBuffer<Chunk> buffer{6, std::nullopt,
+                                 BufferOverflowPolicy::DROP_NEWEST, nullptr,
+                                 3};
+  REQUIRE(buffer.shards() == 3);
+  // Shards are chosen modulo their number, and the limit applies to all of
+  // them together.
+  REQUIRE(buffer.push(chunk(0, 2), 0).traces == 0);
+  REQUIRE(buffer.push(chunk(1, 2), 1).traces == 0);
+  REQUIRE(buffer.push(chunk(2, 1), 4).traces == 0);
+  REQUIRE(buffer.spans() == 5);
+  REQUIRE(buffer.push(chunk(3, 2), 2).traces == 1);
+  REQUIRE(buffer.push(chunk(4, 1), 2).traces == 0);
+  REQUIRE(buffer.spans() == 6);
+  REQUIRE(buffer.bytes() == 600);
+
+  auto taken = ids(buffer.take());
+  std::sort(taken.begin(), taken.end());
+  REQUIRE(taken == std::vector<int>{0, 1, 2, 4});
+  REQUIRE(buffer.spans() == 0);
+  REQUIRE(buffer.bytes() == 0);
+
+  // Chunks taken from any shard free their room in the buffer.
+  REQUIRE(buffer.push(chunk(5, 6), 1).traces == 0);
+  REQUIRE(ids(buffer.take()) == std::vector<int>{5});
+}
@@ -0,0 +1,109 @@
+// This test covers `TraceID`, defined in `trace_id.h`.
+
+#include <datadog/error.h>
+#include <datadog/trace_id.h>
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("TraceID::hex_padded") {
+  REQUIRE(TraceID{}.hex_padded() == std::string(32, '0'));
+  REQUIRE(TraceID(0xabc).hex_padded() == "00000000000000000000000000000abc");
+  REQUIRE(TraceID(0x0123456789abcdef, 0xfedcba9876543210).hex_padded() ==
+          "fedcba98765432100123456789abcdef");
+  REQUIRE(hex_padded(0x64d2f1a800000000) == "64d2f1a800000000");
+  REQUIRE(hex_padded(1) == "0000000000000001");
+  REQUIRE(hex_padded(0xfedcba9876543210) == "fedcba9876543210");
+}
+
+TEST_CASE("TraceID::parse_hex") {
+  SECTION("64 bits or fewer") {
+    const auto result = TraceID::parse_hex("ABCdef");
+    REQUIRE(result);
+    REQUIRE(*result == TraceID(0xabcdef));
+    REQUIRE(*result == 0xabcdef);
+  }
+
+  SECTION("128 bits") {
+    const auto result =
+        TraceID::parse_hex("fedcba98765432100123456789abcdef");
+    REQUIRE(result);
+    REQUIRE(result->high == 0xfedcba9876543210);
+    REQUIRE(result->low == 0x0123456789abcdef);
+    REQUIRE(*result != 0x0123456789abcdef);
+  }
+
+  SECTION("between 64 and 128 bits") {
+    const auto result = TraceID::parse_hex("1ffffffffffffffff");
+    REQUIRE(result);
+    REQUIRE(result->high == 1);
+    REQUIRE(result->low == 0xffffffffffffffff);
+  }
+
+  SECTION("round trip") {
+    const TraceID id{0x0123456789abcdef, 0x64d2f1a800000000};
+    const auto result = TraceID::parse_hex(id.hex_padded());
+    REQUIRE(result);
+    REQUIRE(*result == id);
+  }
+
+  SECTION("invalid") {
+    const auto input = GENERATE(as<std::string>{}, "", "0x1", "12g4", " 1");
+    CAPTURE(input);
+    const auto result = TraceID::parse_hex(input);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::INVALID_INTEGER);
+  }
+
+  SECTION("too many digits") {
+    const auto result = TraceID::parse_hex(std::string(33, '1'));
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::OUT_OF_RANGE_INTEGER);
+  }
+}
+
+TEST_CASE("parse_hex_uint64") {
+  const auto result = parse_hex_uint64("64d2f1a800000000");
+  REQUIRE(result);
+  REQUIRE(*result == 0x64d2f1a800000000);
+  REQUIRE(!parse_hex_uint64(std::string(17, '1')));
+  REQUIRE(!parse_hex_uint64("xyz"));
+}
+
+TEST_CASE("read_hex") {
+  SECTION("every digit in every position") {
+    const std::string digits = "0123456789abcdefABCDEF";
+    for (const char digit : digits) {
+      for (std::size_t position = 0; position < 16; ++position) {
+        std::string input(16, '0');
+        input[position] = digit;
+        CAPTURE(input);
+        int invalid = 0;
+        REQUIRE(read_hex(input, invalid) == std::stoull(input, nullptr, 16));
+        REQUIRE(invalid == 0);
+      }
+    }
+  }
+
+  SECTION("every invalid character in every position") {
+    for (int character = 0; character < 256; ++character) {
+      if (std::isxdigit(character)) {
+        continue;
+      }
+      for (std::size_t position = 0; position < 16; ++position) {
+        std::string input(16, 'a');
+        input[position] = char(character);
+        CAPTURE(character, position);
+        int invalid = 0;
+        read_hex(input, invalid);
+        REQUIRE(invalid != 0);
+      }
+    }
+  }
+}
@@ -1,14 +1,22 @@
 #include <datadog/clock.h>
+#include <datadog/collector_response.h>
 #include <datadog/id_generator.h>
 #include <datadog/rate.h>
+#include <datadog/sampling_decision.h>
+#include <datadog/sampling_mechanism.h>
 #include <datadog/sampling_priority.h>
+#include <datadog/span_data.h>
+#include <datadog/trace_sampler.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
 
 #include <chrono>
+#include <filesystem>
+#include <fstream>
 #include <limits>
 #include <map>
 #include <ostream>
+#include <thread>
 
 #include "mocks/collectors.h"
 #include "mocks/loggers.h"
@@ -269,3 +277,263 @@ TEST_CASE("sampling rules") {
     REQUIRE(collector->count_of(SamplingPriority::USER_DROP) == 1);
   }
 }
+
+TEST_CASE("collector sample rates") {
+  TraceSamplerConfig config;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  TraceSampler sampler{*finalized, default_clock};
+
+  SpanData span;
+  span.service = "testsvc";
+  span.trace_id = TraceID{1};
+
+  // Before any response, the rate is 100% by default.
+  auto decision = sampler.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::DEFAULT));
+  REQUIRE(decision.configured_rate == Rate::one());
+
+  CollectorResponse response;
+  response.sample_rate_by_key[CollectorResponse::key_of_default_rate] =
+      assert_rate(0.5);
+  response.sample_rate_by_key[CollectorResponse::key("testsvc", "")] =
+      assert_rate(0.25);
+  sampler.handle_collector_response(response);
+  decision = sampler.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::AGENT_RATE));
+  REQUIRE(*decision.configured_rate == 0.25);
+
+  // A response without the default rate replaces the other rates, but keeps
+  // the previous default rate.
+  response.sample_rate_by_key.clear();
+  response.sample_rate_by_key[CollectorResponse::key("othersvc", "")] =
+      assert_rate(0.75);
+  sampler.handle_collector_response(response);
+  decision = sampler.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::AGENT_RATE));
+  REQUIRE(*decision.configured_rate == 0.5);
+
+  // Decisions may be made concurrently with collector responses.
+  std::thread responder([&]() {
+    for (int i = 0; i < 1000; ++i) {
+      sampler.handle_collector_response(response);
+    }
+  });
+  for (int i = 0; i < 1000; ++i) {
+    REQUIRE(*sampler.decide(span).configured_rate == 0.5);
+  }
+  responder.join();
+}
+
+TEST_CASE("trace samplers share a versioned collector response") {
+  auto finalized = finalize_config(TraceSamplerConfig{});
+  REQUIRE(finalized);
+  TraceSampler with_default{*finalized, default_clock};
+  TraceSampler without_default{*finalized, default_clock};
+
+  SpanData span;
+  span.service = "testsvc";
+  span.trace_id = TraceID{1};
+
+  CollectorResponse first;
+  first.sample_rate_by_key[CollectorResponse::key_of_default_rate] =
+      assert_rate(0.5);
+  first.version = 1000001;
+  with_default.handle_collector_response(first);
+
+  CollectorResponse second;
+  second.sample_rate_by_key[CollectorResponse::key("testsvc", "")] =
+      assert_rate(0.25);
+  second.version = 1000002;
+  with_default.handle_collector_response(second);
+  without_default.handle_collector_response(second);
+
+  // Both samplers use the rates of the shared response.
+  REQUIRE(*with_default.decide(span).configured_rate == 0.25);
+  REQUIRE(*without_default.decide(span).configured_rate == 0.25);
+
+  // Each keeps its own previous default rate, if any.
+  span.service = "othersvc";
+  auto decision = with_default.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::AGENT_RATE));
+  REQUIRE(*decision.configured_rate == 0.5);
+  decision = without_default.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::DEFAULT));
+  REQUIRE(decision.configured_rate == Rate::one());
+}
+
+TEST_CASE("adaptive sampling") {
+  TraceSamplerConfig config;
+  config.target_spans_per_second = 100;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  TimePoint current_time = default_clock();
+  TraceSampler sampler{*finalized, [&]() { return current_time; }};
+  REQUIRE(sampler.adaptive());
+
+  SpanData span;
+  span.service = "testsvc";
+  span.resource = "/busy";
+  span.trace_id = TraceID{1};
+
+  // Adaptive rates take the place of the collector's rates.
+  CollectorResponse response;
+  response.sample_rate_by_key[CollectorResponse::key_of_default_rate] =
+      assert_rate(0.5);
+  sampler.handle_collector_response(response);
+  auto decision = sampler.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::DEFAULT));
+  REQUIRE(decision.configured_rate == Rate::one());
+
+  // One span per trace, at ten times the target.
+  for (int i = 0; i < 999; ++i) {
+    sampler.decide(span);
+  }
+  sampler.count_spans(1000);
+  current_time += std::chrono::seconds(1);
+  sampler.adapt();
+  decision = sampler.decide(span);
+  REQUIRE(decision.mechanism == int(SamplingMechanism::DEFAULT));
+  REQUIRE(*decision.configured_rate == Approx(0.1));
+}
+
+TEST_CASE("collector sample rates by service and environment") {
+  TraceSamplerConfig config;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  TraceSampler sampler{*finalized, default_clock};
+
+  CollectorResponse response;
+  response.sample_rate_by_key[CollectorResponse::key("svc", "prod")] =
+      assert_rate(0.25);
+  response.sample_rate_by_key[CollectorResponse::key("svc", "")] =
+      assert_rate(0.75);
+  // Keys that no span could have are ignored.
+  response.sample_rate_by_key["nonsense"] = assert_rate(0.5);
+  sampler.handle_collector_response(response);
+
+  SpanData span;
+  span.service = "svc";
+  span.tags.emplace("env", "prod");
+  REQUIRE(*sampler.decide(span).configured_rate == 0.25);
+
+  span.tags.erase("env");
+  REQUIRE(*sampler.decide(span).configured_rate == 0.75);
+
+  span.service = "other";
+  REQUIRE(sampler.decide(span).mechanism == int(SamplingMechanism::DEFAULT));
+}
+
+TEST_CASE("collector responses with the same version") {
+  TraceSamplerConfig config;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  TraceSampler sampler{*finalized, default_clock};
+
+  SpanData span;
+  span.service = "svc";
+
+  CollectorResponse response;
+  response.version = 7;
+  response.sample_rate_by_key[CollectorResponse::key("svc", "")] =
+      assert_rate(0.25);
+  sampler.handle_collector_response(response);
+  REQUIRE(*sampler.decide(span).configured_rate == 0.25);
+
+  // A response with the same version is assumed to have the same rates.
+  response.sample_rate_by_key[CollectorResponse::key("svc", "")] =
+      assert_rate(0.75);
+  sampler.handle_collector_response(response);
+  REQUIRE(*sampler.decide(span).configured_rate == 0.25);
+
+  // A response with another version, or without a version, is handled.
+  response.version = 8;
+  sampler.handle_collector_response(response);
+  REQUIRE(*sampler.decide(span).configured_rate == 0.75);
+  response.version = 0;
+  response.sample_rate_by_key[CollectorResponse::key("svc", "")] =
+      assert_rate(0.5);
+  sampler.handle_collector_response(response);
+  REQUIRE(*sampler.decide(span).configured_rate == 0.5);
+}
+
+TEST_CASE("collector sample rates persisted in a file") {
+  namespace fs = std::filesystem;
+  const fs::path path =
+      fs::temp_directory_path() /
+      ("dd-trace-cpp-rates-" + std::to_string(default_id_generator()));
+  TimePoint now;
+  now.wall = std::chrono::system_clock::time_point(std::chrono::hours(500000));
+  const Clock clock = [&]() { return now; };
+
+  TraceSamplerConfig config;
+  config.rates_file = path.string();
+  config.rates_file_max_age_seconds = 60;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+
+  SpanData span;
+  span.service = "svc";
+
+  SECTION("a missing file is ignored") {
+    TraceSampler sampler{*finalized, clock};
+    REQUIRE(sampler.decide(span).mechanism == int(SamplingMechanism::DEFAULT));
+  }
+
+  SECTION("the rates of a response are used by a new sampler") {
+    {
+      TraceSampler sampler{*finalized, clock};
+      CollectorResponse response;
+      response.sample_rate_by_key[CollectorResponse::key("svc", "")] =
+          assert_rate(0.25);
+      response.sample_rate_by_key[CollectorResponse::key_of_default_rate] =
+          assert_rate(0.5);
+      sampler.handle_collector_response(response);
+    }
+
+    SECTION("while the file is fresh") {
+      now.wall += std::chrono::seconds(60);
+      TraceSampler sampler{*finalized, clock};
+      const auto decision = sampler.decide(span);
+      REQUIRE(decision.mechanism == int(SamplingMechanism::AGENT_RATE));
+      REQUIRE(*decision.configured_rate == 0.25);
+      span.service = "other";
+      REQUIRE(*sampler.decide(span).configured_rate == 0.5);
+    }
+
+    SECTION("but not once it is stale") {
+      now.wall += std::chrono::seconds(61);
+      TraceSampler sampler{*finalized, clock};
+      REQUIRE(sampler.decide(span).mechanism ==
+              int(SamplingMechanism::DEFAULT));
+    }
+  }
+
+  SECTION("a malformed file is ignored") {
+    std::ofstream{path} << "{\"time\": \"yesterday\"}";
+    TraceSampler sampler{*finalized, clock};
+    REQUIRE(sampler.decide(span).mechanism == int(SamplingMechanism::DEFAULT));
+  }
+
+  SECTION("the maximum age must be positive") {
+    config.rates_file_max_age_seconds = 0;
+    auto result = finalize_config(config);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::INVALID_SAMPLER_RATES_FILE_MAX_AGE);
+  }
+
+  std::error_code ignored;
+  fs::remove(path, ignored);
+}
+
+TEST_CASE("CollectorResponse::parse_key") {
+  const auto key = CollectorResponse::key("a,b", "c:d");
+  const auto parsed = CollectorResponse::parse_key(key);
+  REQUIRE(parsed);
+  REQUIRE(parsed->first == "a,b");
+  REQUIRE(parsed->second == "c:d");
+
+  REQUIRE(CollectorResponse::parse_key(CollectorResponse::key_of_default_rate));
+  REQUIRE(!CollectorResponse::parse_key("service:foo"));
+  REQUIRE(!CollectorResponse::parse_key("env:foo,service:bar"));
+}
@@ -1,10 +1,22 @@
 #include <datadog/net_util.h>
 #include <datadog/rate.h>
+#include <datadog/span_config.h>
+#include <datadog/span_prototype.h>
 #include <datadog/tags.h>
 #include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "matchers.h"
 #include "mocks/collectors.h"
 #include "mocks/dict_readers.h"
@@ -59,6 +71,14 @@ TEST_CASE("TraceSegment accessors") {
     auto span = tracer.create_span();
 
     REQUIRE(span.trace_segment().defaults() == config.defaults);
+    // The prototype's tags are the default tags, plus the environment and
+    // version.
+    const auto& tags = span.trace_segment().prototype().tags;
+    REQUIRE(tags.size() == 4);
+    REQUIRE(tags.at("hello") == "world");
+    REQUIRE(tags.at("foo") == "bar");
+    REQUIRE(tags.at("env") == "test");
+    REQUIRE(tags.at("version") == "v0");
   }
 
   SECTION("origin") {
@@ -284,7 +304,7 @@ TEST_CASE("TraceSegment finalization of spans") {
         (void)span;
       }
 
-      const std::unordered_map<std::string, std::string> filtered{
+      const FlatMap<std::string> filtered{
           {"_dd.p.one", "1"}, {"_dd.p.two", "2"}};
 
       REQUIRE(collector->span_count() == 1);
@@ -378,3 +398,771 @@ TEST_CASE("TraceSegment finalization of spans") {
     }
   }  // root span
 }  // span finalizers
+
+TEST_CASE("TraceSegment partial flush") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.partial_flush_enabled = true;
+
+  const auto& chunks = collector->chunks;
+  const auto top_level = [](const SpanData& span) -> std::optional<double> {
+    const auto found = span.numeric_tags.find(tags::internal::top_level);
+    if (found == span.numeric_tags.end()) {
+      return std::nullopt;
+    }
+    return found->second;
+  };
+
+  SECTION("sends finished spans once there are enough of them") {
+    config.partial_flush_min_spans = 2;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+
+    auto root = std::make_optional(tracer.create_span());
+    auto first = std::make_optional(root->create_child());
+    auto second = std::make_optional(root->create_child());
+    auto other = std::make_optional(root->create_child());
+    other->set_service_name("othersvc");
+    auto grandchild = std::make_optional(other->create_child());
+
+    first.reset();
+    REQUIRE(chunks.empty());
+    second.reset();
+    REQUIRE(chunks.size() == 1);
+    REQUIRE(chunks[0].size() == 2);
+    // The first span of each chunk has the sampling priority and trace tags.
+    const SpanData& chunk_root = *chunks[0].front();
+    const auto priority =
+        chunk_root.numeric_tags.at(tags::internal::sampling_priority);
+    REQUIRE(chunk_root.tags.count(tags::internal::decision_maker) == 1);
+    REQUIRE(chunks[0][1]->numeric_tags.count(
+                tags::internal::sampling_priority) == 0);
+    // The local root, which is open, has the same service.
+    REQUIRE(top_level(*chunks[0][0]) == 0.0);
+    REQUIRE(top_level(*chunks[0][1]) == 0.0);
+
+    // The sampling decision can't change once spans have been sent.
+    root->trace_segment().override_sampling_priority(-1);
+
+    grandchild.reset();
+    REQUIRE(chunks.size() == 1);
+    other.reset();
+    REQUIRE(chunks.size() == 2);
+    REQUIRE(chunks[1].size() == 2);
+    REQUIRE(chunks[1][0]->service == "othersvc");
+    REQUIRE(chunks[1][0]->numeric_tags.at(tags::internal::sampling_priority) ==
+            priority);
+    REQUIRE(top_level(*chunks[1][0]) == 1.0);
+    // The grandchild's parent is in the same chunk.
+    REQUIRE(!top_level(*chunks[1][1]));
+
+    root.reset();
+    REQUIRE(chunks.size() == 3);
+    REQUIRE(chunks[2].size() == 1);
+    const SpanData& local_root = *chunks[2].front();
+    REQUIRE(local_root.parent_id == 0);
+    REQUIRE(local_root.numeric_tags.at(tags::internal::sampling_priority) ==
+            priority);
+    REQUIRE(local_root.numeric_tags.count(tags::internal::agent_sample_rate) ==
+            1);
+    REQUIRE(!top_level(local_root));
+  }
+
+  SECTION("the local root can finish first") {
+    config.partial_flush_min_spans = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+
+    auto root = std::make_optional(tracer.create_span());
+    auto child = root->create_child();
+    root.reset();
+    REQUIRE(chunks.size() == 1);
+    REQUIRE(chunks[0].front()->parent_id == 0);
+    const auto priority =
+        chunks[0].front()->numeric_tags.at(tags::internal::sampling_priority);
+
+    // The child is in a chunk of its own.  Its parent was sent already, and
+    // has the same service.
+    {
+      const auto finishing = std::move(child);
+    }
+    REQUIRE(chunks.size() == 2);
+    const SpanData& span = *chunks[1].front();
+    REQUIRE(span.numeric_tags.at(tags::internal::sampling_priority) ==
+            priority);
+    REQUIRE(top_level(span) == 0.0);
+  }
+
+  SECTION("is off by default") {
+    config.partial_flush_enabled = false;
+    config.partial_flush_min_spans = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      { auto child = root.create_child(); }
+      REQUIRE(chunks.empty());
+    }
+    REQUIRE(chunks.size() == 1);
+    REQUIRE(chunks[0].size() == 2);
+    REQUIRE(!top_level(*chunks[0][1]));
+  }
+}
+
+TEST_CASE("TraceSegment memory budget") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  const auto& chunks = collector->chunks;
+
+  SECTION("counts finished spans until they're sent") {
+    config.max_memory_bytes = 1024 * 1024;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      { auto child = root.create_child(); }
+      REQUIRE(chunks.empty());
+      REQUIRE(tracer.metrics().trace_segment_bytes >= sizeof(SpanData));
+    }
+    REQUIRE(chunks.size() == 1);
+    REQUIRE(chunks[0].size() == 2);
+    const auto metrics = tracer.metrics();
+    REQUIRE(metrics.trace_segment_bytes == 0);
+    REQUIRE(metrics.memory_budget_partial_flushes == 0);
+  }
+
+  SECTION("when exceeded, sends finished spans right away") {
+    config.max_memory_bytes = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      { auto child = root.create_child(); }
+      REQUIRE(chunks.size() == 1);
+      REQUIRE(chunks[0].size() == 1);
+    }
+    REQUIRE(chunks.size() == 2);
+    const auto metrics = tracer.metrics();
+    REQUIRE(metrics.trace_segment_bytes == 0);
+    REQUIRE(metrics.memory_budget_partial_flushes == 1);
+  }
+
+  SECTION("when exceeded, removes large tags") {
+    config.max_memory_bytes = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      root.set_tag("large", std::string(TraceSegment::large_tag_size + 1, 'x'));
+      root.set_tag("small", "x");
+    }
+    REQUIRE(chunks.size() == 1);
+    const SpanData& span = *chunks[0].front();
+    REQUIRE(span.tags.count("large") == 0);
+    REQUIRE(span.tags.count("small") == 1);
+    REQUIRE(span.tags.count(tags::internal::decision_maker) == 1);
+    REQUIRE(tracer.metrics().memory_budget_tags_stripped == 1);
+  }
+
+  SECTION("when exceeded, discards trace chunks dropped by sampling") {
+    config.max_memory_bytes = 1;
+    config.trace_sampler.sample_rate = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    { auto root = tracer.create_span(); }
+    REQUIRE(chunks.empty());
+    const auto metrics = tracer.metrics();
+    REQUIRE(metrics.trace_chunks_finished == 1);
+    REQUIRE(metrics.memory_budget_trace_chunks_dropped == 1);
+    REQUIRE(metrics.trace_segment_bytes == 0);
+  }
+
+  SECTION("is off by default") {
+    config.partial_flush_min_spans = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      { auto child = root.create_child(); }
+      REQUIRE(tracer.metrics().trace_segment_bytes == 0);
+    }
+    REQUIRE(chunks.size() == 1);
+  }
+}
+
+TEST_CASE("TraceSegment minimum span duration") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.min_span_duration_microseconds = 1000;
+  const auto& chunks = collector->chunks;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  // Finish a child of the specified `parent` having the specified `duration`,
+  // after the optionally specified `modify` is applied to it.
+  const auto finish_child = [](const Span& parent, Duration duration,
+                               const std::function<void(Span&)>& modify =
+                                   nullptr) {
+    auto child = parent.create_child();
+    if (modify) {
+      modify(child);
+    }
+    child.set_end_time(child.start_time().tick + duration);
+  };
+  const auto short_duration = std::chrono::microseconds(10);
+  const auto long_duration = std::chrono::milliseconds(10);
+
+  std::uint64_t parent_id;
+  {
+    auto root = tracer.create_span();
+    auto parent = root.create_child();
+    parent_id = parent.id();
+    finish_child(parent, short_duration);
+    finish_child(parent, short_duration);
+    finish_child(parent, long_duration);
+    finish_child(parent, short_duration, [](Span& span) {
+      span.set_error(true);
+    });
+    finish_child(parent, short_duration, [](Span& span) {
+      span.set_service_name("othersvc");
+    });
+    parent.set_end_time(parent.start_time().tick + long_duration);
+    // `root` is short, but it's the first span of the chunk.
+    root.set_end_time(root.start_time().tick);
+  }
+
+  REQUIRE(chunks.size() == 1);
+  const auto& chunk = chunks.front();
+  // The root, the parent, and the long, error, and other service children.
+  REQUIRE(chunk.size() == 5);
+  const auto found = std::find_if(
+      chunk.begin(), chunk.end(),
+      [&](const auto& span_ptr) { return span_ptr->span_id == parent_id; });
+  REQUIRE(found != chunk.end());
+  const SpanData& parent = **found;
+  REQUIRE(parent.numeric_tags.at(tags::filtered_span_count) == 2);
+  REQUIRE(parent.numeric_tags.at(tags::filtered_span_duration) == 20000);
+  REQUIRE(tracer.metrics().spans_filtered == 2);
+}
+
+TEST_CASE("TraceSegment collapse repeated spans") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.collapse_repeated_spans_threshold = 3;
+  const auto& chunks = collector->chunks;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  // Finish a "query" child of the specified `parent` having the specified
+  // `resource` and `duration`.
+  const auto finish_query = [](const Span& parent, std::string_view resource,
+                               Duration duration, bool error = false) {
+    auto child = parent.create_child();
+    child.set_name("query");
+    child.set_resource_name(resource);
+    if (error) {
+      child.set_error_message("timeout");
+    }
+    child.set_end_time(child.start_time().tick + duration);
+  };
+  const auto ms = [](int count) { return std::chrono::milliseconds(count); };
+
+  std::uint64_t parent_id;
+  {
+    auto root = tracer.create_span();
+    auto parent = root.create_child();
+    parent_id = parent.id();
+    finish_query(parent, "SELECT 1", ms(1));
+    finish_query(parent, "SELECT 1", ms(4), true);
+    finish_query(parent, "SELECT 1", ms(2));
+    // Too few to collapse.
+    finish_query(parent, "SELECT 2", ms(1));
+    finish_query(parent, "SELECT 2", ms(1));
+  }
+
+  REQUIRE(chunks.size() == 1);
+  const auto& chunk = chunks.front();
+  // The root, the parent, one "SELECT 1", and two "SELECT 2".
+  REQUIRE(chunk.size() == 5);
+  const auto found = std::find_if(
+      chunk.begin(), chunk.end(), [&](const auto& span_ptr) {
+        return span_ptr->parent_id == parent_id &&
+               span_ptr->resource == "SELECT 1";
+      });
+  REQUIRE(found != chunk.end());
+  const SpanData& aggregate = **found;
+  REQUIRE(aggregate.numeric_tags.at(tags::collapsed_span_count) == 3);
+  REQUIRE(aggregate.numeric_tags.at(tags::collapsed_span_error_count) == 1);
+  REQUIRE(aggregate.numeric_tags.at(tags::collapsed_span_min_duration) ==
+          1000000);
+  REQUIRE(aggregate.numeric_tags.at(tags::collapsed_span_max_duration) ==
+          4000000);
+  REQUIRE(aggregate.numeric_tags.at(tags::collapsed_span_total_duration) ==
+          7000000);
+  // The aggregate spans from the first query's start to the last query's end.
+  REQUIRE(aggregate.duration >= ms(4));
+  REQUIRE(aggregate.error);
+  REQUIRE(aggregate.tags.at(tags::error_message) == "timeout");
+  REQUIRE(tracer.metrics().spans_collapsed == 2);
+}
+
+TEST_CASE("TraceSegment compact finished spans") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.compact_finished_spans = 2;
+  config.max_memory_bytes = 1024 * 1024;
+  config.compress_compacted_spans = GENERATE(false, true);
+  CAPTURE(config.compress_compacted_spans);
+  const auto& chunks = collector->chunks;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  std::uint64_t root_id;
+  {
+    auto root = tracer.create_span();
+    root_id = root.id();
+    for (int i = 0; i < 5; ++i) {
+      auto child = root.create_child();
+      child.set_resource_name("child " + std::to_string(i));
+      child.set_tag("index", std::to_string(i));
+    }
+    REQUIRE(chunks.empty());
+    // Two batches of two children.  The fifth child is still pending.
+    REQUIRE(tracer.metrics().spans_compacted == 4);
+    REQUIRE(tracer.metrics().trace_segment_bytes > 0);
+  }
+
+  REQUIRE(chunks.size() == 1);
+  const auto& chunk = chunks.front();
+  REQUIRE(chunk.size() == 6);
+  REQUIRE(chunk.front()->span_id == root_id);
+  REQUIRE(chunk.front()->tags.count(tags::internal::decision_maker) == 1);
+  for (int i = 0; i < 5; ++i) {
+    const auto found = std::find_if(
+        chunk.begin(), chunk.end(), [&](const auto& span_ptr) {
+          return span_ptr->resource == "child " + std::to_string(i);
+        });
+    REQUIRE(found != chunk.end());
+    REQUIRE((*found)->parent_id == root_id);
+    REQUIRE((*found)->tags.at("index") == std::to_string(i));
+    REQUIRE((*found)->service == "testsvc");
+  }
+  REQUIRE(tracer.metrics().trace_segment_bytes == 0);
+}
+
+TEST_CASE("TraceSegment maximum spans per trace") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  config.max_spans_per_trace = 4;
+  const auto& chunks = collector->chunks;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  std::uint64_t root_id;
+  {
+    auto root = tracer.create_span();
+    root_id = root.id();
+    auto child = root.create_child();
+    REQUIRE(child.id() != root_id);
+    // Two of the three are admitted, and the third is an overflow span, which
+    // has the local root's ID.
+    auto children = child.create_children(3);
+    REQUIRE(children[0].id() != root_id);
+    REQUIRE(children[1].id() != root_id);
+    REQUIRE(children[2].id() == root_id);
+
+    auto overflow = root.create_child();
+    REQUIRE(overflow.id() == root_id);
+    overflow.set_tag("foo", "bar");
+    REQUIRE(!overflow.lookup_tag("foo"));
+    // Overflow spans propagate the trace as the local root.
+    MockDictWriter writer;
+    overflow.inject(writer);
+    REQUIRE(writer.items.at("x-datadog-parent-id") == std::to_string(root_id));
+    auto grandchild = overflow.create_child();
+    REQUIRE(grandchild.id() == root_id);
+  }
+
+  REQUIRE(chunks.size() == 1);
+  const auto& chunk = chunks.front();
+  REQUIRE(chunk.size() == 4);
+  const auto found = std::find_if(
+      chunk.begin(), chunk.end(),
+      [&](const auto& span_ptr) { return span_ptr->span_id == root_id; });
+  REQUIRE(found != chunk.end());
+  REQUIRE((*found)->numeric_tags.at(tags::overflow_span_count) == 3);
+}
+
+TEST_CASE("TraceSegment spans created and finished concurrently") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+
+  const auto partial_flush = GENERATE(false, true);
+  CAPTURE(partial_flush);
+  config.partial_flush_enabled = partial_flush;
+  config.partial_flush_min_spans = 10;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const int num_threads = 8;
+  const int spans_per_thread = 100;
+  {
+    const auto root = tracer.create_span();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+      threads.emplace_back([&]() {
+        for (int j = 0; j < spans_per_thread; ++j) {
+          auto child = root.create_child();
+          { auto grandchild = child.create_child(); }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    if (!partial_flush) {
+      REQUIRE(collector->chunks.empty());
+    }
+  }
+
+  // Every span is sent exactly once, and the local root is sent last.
+  REQUIRE(collector->span_count() == 1 + 2 * num_threads * spans_per_thread);
+  const auto& last_chunk = collector->chunks.back();
+  REQUIRE(last_chunk.front()->parent_id == 0);
+  if (!partial_flush) {
+    REQUIRE(collector->chunks.size() == 1);
+  }
+}
+
+TEST_CASE("TraceSegment single-threaded") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<MockLogger>();
+  const auto partial_flush = GENERATE(false, true);
+  CAPTURE(partial_flush);
+  config.partial_flush_enabled = partial_flush;
+  config.partial_flush_min_spans = 2;
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  Tracer tracer{*finalized};
+
+  const std::unordered_map<std::string, std::string> headers{
+      {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+  MockDictReader reader{headers};
+  SpanConfig span_config;
+  span_config.single_threaded = true;
+  const bool extract = GENERATE(false, true);
+  CAPTURE(extract);
+  {
+    auto root = extract ? *tracer.extract_span(reader, span_config)
+                        : tracer.create_span(span_config);
+    for (int i = 0; i < 3; ++i) {
+      auto child = root.create_child();
+      { auto grandchild = child.create_child(); }
+      MockDictWriter writer;
+      child.inject(writer);
+      REQUIRE(writer.items.at("x-datadog-parent-id") ==
+              std::to_string(child.id()));
+    }
+    REQUIRE(root.trace_segment().sampling_decision());
+  }
+
+  // The segment behaves as any other, without locking.
+  REQUIRE(collector->span_count() == 7);
+  REQUIRE(collector->chunks.back().front()->parent_id ==
+          (extract ? 456 : 0));
+  if (!partial_flush) {
+    REQUIRE(collector->chunks.size() == 1);
+  }
+}
+
+TEST_CASE("TraceSegment sampling decision at root") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.defaults.environment = "dev";
+  config.defaults.tags = {{"team", "tracing"}};
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.sampling_decision_at_root = true;
+
+  SECTION("a kept trace keeps everything") {
+    config.trace_sampler.sample_rate = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      REQUIRE(root.trace_segment().sampling_decision());
+      REQUIRE(!root.trace_segment().lightweight());
+      auto child = root.create_child();
+      child.set_tag("foo", "bar");
+    }
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& child = *collector->chunks.front().back();
+    REQUIRE(child.tags.at("foo") == "bar");
+    REQUIRE(child.tags.at("team") == "tracing");
+  }
+
+  SECTION("a dropped trace's spans are lightweight") {
+    config.trace_sampler.sample_rate = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      REQUIRE(root.trace_segment().lightweight());
+      auto child = root.create_child();
+      child.set_name("child.op");
+      child.set_resource_name("SELECT 1");
+      child.set_tag("foo", "bar");
+      child.set_tag(tags::http_status_code, "200");
+      child.set_error_message("oops");
+
+      // Context propagation works as usual.
+      MockDictWriter writer;
+      child.inject(writer);
+      REQUIRE(writer.items.at("x-datadog-parent-id") ==
+              std::to_string(child.id()));
+      REQUIRE(writer.items.at("x-datadog-sampling-priority") == "-1");
+    }
+    REQUIRE(collector->chunks.size() == 1);
+    const auto& child = *collector->chunks.front().back();
+    REQUIRE(child.name == "child.op");
+    REQUIRE(child.resource == "SELECT 1");
+    REQUIRE(child.error);
+    REQUIRE(child.tags.at(tags::http_status_code) == "200");
+    REQUIRE(child.tags.at(tags::environment) == "dev");
+    REQUIRE(child.tags.count("foo") == 0);
+    REQUIRE(child.tags.count("team") == 0);
+    REQUIRE(child.tags.count(tags::error_message) == 0);
+  }
+
+  SECTION("not if span sampling rules are configured") {
+    config.trace_sampler.sample_rate = 0;
+    SpanSamplerConfig::Rule rule;
+    rule.service = "othersvc";
+    config.span_sampler.rules.push_back(rule);
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    auto root = tracer.create_span();
+    REQUIRE(root.trace_segment().sampling_decision());
+    REQUIRE(!root.trace_segment().lightweight());
+  }
+
+  SECTION("overriding the priority to keep ends lightweight mode") {
+    config.trace_sampler.sample_rate = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    {
+      auto root = tracer.create_span();
+      REQUIRE(root.trace_segment().lightweight());
+      root.trace_segment().override_sampling_priority(2);
+      REQUIRE(!root.trace_segment().lightweight());
+      root.set_tag("foo", "bar");
+    }
+    REQUIRE(collector->first_span().tags.at("foo") == "bar");
+  }
+
+  SECTION("an extracted decision is honored") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-sampling-priority", "0"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    const auto decision = span->trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->origin == SamplingDecision::Origin::EXTRACTED);
+    REQUIRE(span->trace_segment().lightweight());
+  }
+
+  SECTION("is off by default") {
+    config.sampling_decision_at_root = false;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    Tracer tracer{*finalized};
+    auto root = tracer.create_span();
+    REQUIRE(!root.trace_segment().sampling_decision());
+  }
+}
+
+TEST_CASE("TraceSegment sampling delegation") {
+  // The proxy drops every trace, and the upstream service keeps every trace,
+  // so it's clear whose decision is used.
+  TracerConfig proxy_config;
+  proxy_config.defaults.service = "proxy";
+  const auto proxy_collector = std::make_shared<MockCollector>();
+  proxy_config.collector = proxy_collector;
+  proxy_config.logger = std::make_shared<NullLogger>();
+  proxy_config.trace_sampler.sample_rate = 0;
+  proxy_config.delegate_trace_sampling = true;
+
+  TracerConfig upstream_config;
+  upstream_config.defaults.service = "upstream";
+  const auto upstream_collector = std::make_shared<MockCollector>();
+  upstream_config.collector = upstream_collector;
+  upstream_config.logger = std::make_shared<NullLogger>();
+  upstream_config.trace_sampler.sample_rate = 1;
+
+  auto finalized_upstream = finalize_config(upstream_config);
+  REQUIRE(finalized_upstream);
+  Tracer upstream{*finalized_upstream};
+
+  SECTION("the proxy adopts the upstream service's decision") {
+    auto finalized_proxy = finalize_config(proxy_config);
+    REQUIRE(finalized_proxy);
+    Tracer proxy{*finalized_proxy};
+    {
+      auto proxy_span = proxy.create_span();
+      MockDictWriter request;
+      proxy_span.inject(request);
+      REQUIRE(request.items.at("x-datadog-delegate-trace-sampling") ==
+              "delegate");
+      // A service that doesn't delegate sees the provisional decision.
+      REQUIRE(request.items.at("x-datadog-sampling-priority") == "-1");
+
+      MockDictWriter response;
+      {
+        MockDictReader reader{request.items};
+        auto upstream_span = upstream.extract_span(reader);
+        REQUIRE(upstream_span);
+        upstream_span->write_sampling_delegation_response(response);
+        const auto decision =
+            upstream_span->trace_segment().sampling_decision();
+        REQUIRE(decision);
+        REQUIRE(decision->origin == SamplingDecision::Origin::LOCAL);
+        REQUIRE(decision->priority == 2);
+      }
+      REQUIRE(response.items.at("x-datadog-trace-sampling-decision") ==
+              R"({"mechanism":3,"priority":2})");
+
+      MockDictReader reader{response.items};
+      REQUIRE(proxy_span.read_sampling_delegation_response(reader));
+      const auto decision = proxy_span.trace_segment().sampling_decision();
+      REQUIRE(decision);
+      REQUIRE(decision->origin == SamplingDecision::Origin::DELEGATED);
+      REQUIRE(decision->priority == 2);
+      REQUIRE(decision->mechanism == 3);
+    }
+    const auto& proxy_root = proxy_collector->first_span();
+    REQUIRE(proxy_root.numeric_tags.at(tags::internal::sampling_priority) ==
+            2);
+    REQUIRE(proxy_root.tags.at(tags::internal::decision_maker) == "-3");
+    REQUIRE(upstream_collector->first_span().numeric_tags.at(
+                tags::internal::sampling_priority) == 2);
+  }
+
+  SECTION("a request that doesn't delegate gets no decision") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-sampling-priority", "0"}};
+    MockDictReader reader{headers};
+    auto span = upstream.extract_span(reader);
+    REQUIRE(span);
+    MockDictWriter response;
+    span->write_sampling_delegation_response(response);
+    REQUIRE(response.items.empty());
+    const auto decision = span->trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->origin == SamplingDecision::Origin::EXTRACTED);
+  }
+
+  SECTION("final decisions aren't delegated") {
+    auto finalized_proxy = finalize_config(proxy_config);
+    REQUIRE(finalized_proxy);
+    Tracer proxy{*finalized_proxy};
+
+    SECTION("extracted") {
+      const std::unordered_map<std::string, std::string> headers{
+          {"x-datadog-trace-id", "123"},
+          {"x-datadog-parent-id", "456"},
+          {"x-datadog-sampling-priority", "1"}};
+      MockDictReader reader{headers};
+      auto span = proxy.extract_span(reader);
+      REQUIRE(span);
+      MockDictWriter request;
+      span->inject(request);
+      REQUIRE(request.items.count("x-datadog-delegate-trace-sampling") == 0);
+    }
+
+    SECTION("manual") {
+      auto span = proxy.create_span();
+      span.trace_segment().override_sampling_priority(2);
+      MockDictWriter request;
+      span.inject(request);
+      REQUIRE(request.items.count("x-datadog-delegate-trace-sampling") == 0);
+    }
+  }
+
+  SECTION("the provisional decision is kept without a valid response") {
+    auto finalized_proxy = finalize_config(proxy_config);
+    REQUIRE(finalized_proxy);
+    Tracer proxy{*finalized_proxy};
+    auto span = proxy.create_span();
+    MockDictWriter request;
+    span.inject(request);
+
+    std::unordered_map<std::string, std::string> headers;
+    MockDictReader reader{headers};
+    REQUIRE(span.read_sampling_delegation_response(reader));
+
+    auto value = GENERATE(values<std::string>(
+        {"", "2", R"({"mechanism": 3})", R"({"priority": "2"})",
+         R"({"priority": 2, "mechanism": "rule"})"}));
+    CAPTURE(value);
+    headers["x-datadog-trace-sampling-decision"] = value;
+    const auto result = span.read_sampling_delegation_response(reader);
+    REQUIRE(!result);
+    REQUIRE(result.error().code ==
+            Error::INVALID_SAMPLING_DELEGATION_RESPONSE);
+
+    const auto decision = span.trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->origin == SamplingDecision::Origin::LOCAL);
+    REQUIRE(decision->priority == -1);
+  }
+}
@@ -9,16 +9,21 @@
 #include <datadog/span_data.h>
 #include <datadog/span_defaults.h>
 #include <datadog/tag_propagation.h>
+#include <datadog/tags.h>
+#include <datadog/trace_id.h>
 #include <datadog/trace_segment.h>
 #include <datadog/tracer.h>
 #include <datadog/tracer_config.h>
 
+#include <chrono>
 #include <iosfwd>
+#include <memory_resource>
 #include <optional>
 
 #include "matchers.h"
 #include "mocks/collectors.h"
 #include "mocks/dict_readers.h"
+#include "mocks/dict_writers.h"
 #include "mocks/loggers.h"
 #include "test.h"
 
@@ -234,6 +239,46 @@ TEST_CASE("tracer span defaults") {
     REQUIRE(child.name == overrides.name);
     REQUIRE_THAT(child.tags, ContainsSubset(overrides.tags));
   }
+
+  SECTION("can be overridden by a view") {
+    SpanConfigView view;
+    view.service = *overrides.service;
+    view.service_type = *overrides.service_type;
+    view.environment = *overrides.environment;
+    view.version = *overrides.version;
+    view.name = *overrides.name;
+    for (const auto& [key, value] : overrides.tags) {
+      view.tags.emplace(key, value);
+    }
+    view.tags.emplace("_dd.secret.sauce", "thousand islands");
+    {
+      auto root = tracer.create_span(view);
+      auto extracted = tracer.extract_span(reader, view);
+      REQUIRE(extracted);
+      auto child = root.create_child(view);
+    }
+    REQUIRE(logger->error_count() == 0);
+
+    // The extracted span's segment finished first, and then the root's: the
+    // root and its child.
+    REQUIRE(collector->chunks.size() == 2);
+    REQUIRE(collector->chunks[0].size() == 1);
+    REQUIRE(collector->chunks[1].size() == 2);
+    for (const auto& chunk : collector->chunks) {
+      for (const auto& span_ptr : chunk) {
+        REQUIRE(span_ptr);
+        const auto& span = *span_ptr;
+        REQUIRE(span.service == overrides.service);
+        REQUIRE(span.service_type == overrides.service_type);
+        REQUIRE(span.environment() == overrides.environment);
+        REQUIRE(span.version() == overrides.version);
+        REQUIRE(span.name == overrides.name);
+        REQUIRE(span.resource == overrides.name);
+        REQUIRE_THAT(span.tags, ContainsSubset(overrides.tags));
+        REQUIRE(span.tags.count("_dd.secret.sauce") == 0);
+      }
+    }
+  }
 }
 
 TEST_CASE("span extraction") {
@@ -384,7 +429,7 @@ TEST_CASE("span extraction") {
         {"bad x-b3-traceid (2)",
          false,
          true,
-         {{"x-b3-traceid", "ffffffffffffffffffffffffffffff"},
+         {{"x-b3-traceid", "fffffffffffffffffffffffffffffffff"},
           {"x-b3-spanid", "def"}},
          Error::OUT_OF_RANGE_INTEGER},
         {"bad x-b3-spanid",
@@ -422,7 +467,11 @@ TEST_CASE("span extraction") {
     REQUIRE(finalized_config);
     Tracer tracer{*finalized_config};
 
-    MockDictReader reader{test_case.headers};
+    // Extraction behaves the same whether the reader is scanned once or
+    // looked up repeatedly.
+    const bool prefer_visit = GENERATE(false, true);
+    CAPTURE(prefer_visit);
+    MockDictReader reader{test_case.headers, prefer_visit};
 
     auto result = tracer.extract_span(reader);
     if (test_case.expected_error) {
@@ -528,7 +577,9 @@ TEST_CASE("span extraction") {
     auto finalized_config = finalize_config(config);
     REQUIRE(finalized_config);
     Tracer tracer{*finalized_config};
-    MockDictReader reader{test_case.headers};
+    const bool prefer_visit = GENERATE(false, true);
+    CAPTURE(prefer_visit);
+    MockDictReader reader{test_case.headers, prefer_visit};
 
     const auto checks = [](const TestCase& test_case, const Span& span) {
       REQUIRE(span.trace_id() == test_case.expected_trace_id);
@@ -552,6 +603,29 @@ TEST_CASE("span extraction") {
     checks(test_case, *span);
   }
 
+  SECTION("a single pass matches header names without regard to case") {
+    config.extraction_styles.b3 = true;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+
+    const std::unordered_map<std::string, std::string> headers{
+        {"X-Datadog-Trace-Id", "255"},
+        {"X-DATADOG-PARENT-ID", "14"},
+        {"x-datadog-origin", "synthetics"},
+        {"X-B3-TraceId", "ff"},
+        {"X-B3-SpanId", "e"},
+        {"X-B3-Sampled", "1"},
+        {"X-Datadog-Sampling-Priority", "1"},
+        {"x-datadog-trace-identity", "irrelevant"}};
+    MockDictReader reader{headers, true};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() == 255);
+    REQUIRE(span->parent_id() == 14);
+    REQUIRE(span->trace_segment().origin() == "synthetics");
+  }
+
   SECTION("x-datadog-tags") {
     auto finalized_config = finalize_config(config);
     REQUIRE(finalized_config);
@@ -584,6 +658,468 @@ TEST_CASE("span extraction") {
   }
 }
 
+TEST_CASE("128-bit trace IDs") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<NullCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  config.injection_styles.datadog = true;
+  config.injection_styles.b3 = true;
+  config.extraction_styles.datadog = true;
+  config.extraction_styles.b3 = false;
+
+  // Return the "_dd.p.tid" trace tag injected by the specified `span`, or
+  // return null if there isn't one.
+  const auto injected_tid = [](const Span& span) {
+    MockDictWriter writer;
+    span.inject(writer);
+    std::optional<std::string> result;
+    const auto found = writer.items.find("x-datadog-tags");
+    if (found != writer.items.end()) {
+      REQUIRE(decode_tags(found->second, [&](auto key, auto value) {
+        if (key == tags::internal::trace_id_high) {
+          result = std::string(value);
+        }
+      }));
+    }
+    return result;
+  };
+
+  SECTION("are not generated by default") {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const auto span = tracer.create_span();
+    REQUIRE(span.trace_id().high == 0);
+    REQUIRE(!injected_tid(span));
+  }
+
+  SECTION("are generated when enabled") {
+    config.trace_id_128_bit = true;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const auto span = tracer.create_span();
+    const auto id = span.trace_id();
+    // The high bits are the Unix time in seconds, followed by 32 zeros.
+    REQUIRE(id.high >> 32 != 0);
+    REQUIRE((id.high & 0xffffffff) == 0);
+    REQUIRE(id.low == span.id());
+    REQUIRE(injected_tid(span) == hex_padded(id.high));
+
+    MockDictWriter writer;
+    span.inject(writer);
+    REQUIRE(writer.items.at("x-datadog-trace-id") == std::to_string(id.low));
+    REQUIRE(writer.items.at("x-b3-traceid") == id.hex_padded());
+  }
+
+  SECTION("are extracted from x-datadog-tags") {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-tags", "_dd.p.dm=-4,_dd.p.tid=64d2f1a800000000"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id().low == 123);
+    REQUIRE(span->trace_id().high == 0x64d2f1a800000000);
+    REQUIRE(injected_tid(*span) == "64d2f1a800000000");
+  }
+
+  SECTION("a malformed _dd.p.tid is not propagated") {
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-tags", "_dd.p.tid=nothex"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() == 123);
+    REQUIRE(!injected_tid(*span));
+  }
+
+  SECTION("are extracted from x-b3-traceid") {
+    config.extraction_styles.datadog = false;
+    config.extraction_styles.b3 = true;
+    auto finalized_config = finalize_config(config);
+    REQUIRE(finalized_config);
+    Tracer tracer{*finalized_config};
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-b3-traceid", "64d2f1a8000000000000000000000abc"},
+        {"x-b3-spanid", "def"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() == TraceID(0xabc, 0x64d2f1a800000000));
+    REQUIRE(injected_tid(*span) == "64d2f1a800000000");
+  }
+}
+
+TEST_CASE("B3 single header") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<NullCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  config.injection_styles.datadog = false;
+  config.injection_styles.b3_single = true;
+  config.extraction_styles.datadog = GENERATE(false, true);
+  config.extraction_styles.b3_single = true;
+  CAPTURE(config.extraction_styles.datadog);
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  const bool prefer_visit = GENERATE(false, true);
+  CAPTURE(prefer_visit);
+
+  SECTION("is extracted and injected") {
+    struct TestCase {
+      std::string header;
+      TraceID expected_trace_id;
+      std::optional<int> expected_sampling_priority;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {"0000000000000abc-0000000000000def", TraceID(0xabc), std::nullopt},
+        {"0000000000000abc-0000000000000def-1", TraceID(0xabc), 1},
+        {"0000000000000abc-0000000000000def-0-0000000000000123",
+         TraceID(0xabc), 0},
+        {"64d2f1a8000000000000000000000abc-0000000000000def-d",
+         TraceID(0xabc, 0x64d2f1a800000000), 2},
+        {"0000000000000abc-0000000000000def-1-"
+         "00000000000000000000000000000123",
+         TraceID(0xabc), 1},
+    }));
+    CAPTURE(test_case.header);
+
+    const std::unordered_map<std::string, std::string> headers{
+        {"b3", test_case.header}};
+    MockDictReader reader{headers, prefer_visit};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() == test_case.expected_trace_id);
+    REQUIRE(span->parent_id() == 0xdef);
+    const auto decision = span->trace_segment().sampling_decision();
+    if (test_case.expected_sampling_priority) {
+      REQUIRE(decision);
+      REQUIRE(decision->priority == *test_case.expected_sampling_priority);
+    } else {
+      REQUIRE(!decision);
+    }
+
+    MockDictWriter writer;
+    span->inject(writer);
+    const auto& injected = writer.items.at("b3");
+    const auto trace_id_digits = test_case.expected_trace_id.high ? 32 : 16;
+    REQUIRE(injected.substr(0, trace_id_digits + 1) ==
+            test_case.header.substr(0, trace_id_digits + 1));
+    REQUIRE(injected.size() == std::size_t(trace_id_digits + 1 + 16 + 2));
+    REQUIRE(writer.items.count("x-b3-traceid") == 0);
+  }
+
+  SECTION("malformed headers are errors") {
+    auto header = GENERATE(as<std::string>{}, "x", "abc-xyz", "xyz-abc",
+                           "abc-def-2", "abc-def-", "abc-def-1-",
+                           "abc-def-1-zz", "abc-def-1-123",
+                           "abc-def-1-000000000000012z",
+                           "abc-def-1-0000000000000123-",
+                           "abc-def-1-0000000000000123-0000000000000456");
+    CAPTURE(header);
+    const std::unordered_map<std::string, std::string> headers{
+        {"b3", header}};
+    MockDictReader reader{headers, prefer_visit};
+    REQUIRE(!tracer.extract_span(reader));
+  }
+
+  SECTION("a sampling decision alone is no trace") {
+    const std::unordered_map<std::string, std::string> headers{{"b3", "0"}};
+    MockDictReader reader{headers, prefer_visit};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(!span);
+    REQUIRE(span.error().code == Error::NO_SPAN_TO_EXTRACT);
+  }
+}
+
+TEST_CASE("W3C trace context") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<NullCollector>();
+  config.logger = std::make_shared<NullLogger>();
+  config.injection_styles.datadog = false;
+  config.injection_styles.w3c = true;
+  config.extraction_styles.datadog = GENERATE(false, true);
+  config.extraction_styles.w3c = true;
+  CAPTURE(config.extraction_styles.datadog);
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  const bool prefer_visit = GENERATE(false, true);
+  CAPTURE(prefer_visit);
+
+  SECTION("is extracted from traceparent and tracestate") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"traceparent",
+         "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"},
+        {"tracestate", "othervendor=x,dd=s:2;o:rum;t.dm:-4"}};
+    MockDictReader reader{headers, prefer_visit};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() ==
+            TraceID(0xa3ce929d0e0e4736, 0x4bf92f3577b34da6));
+    REQUIRE(span->parent_id() == 0x00f067aa0ba902b7);
+    REQUIRE(span->trace_segment().origin() == "rum");
+    const auto decision = span->trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->priority == 2);
+
+    MockDictWriter writer;
+    span->inject(writer);
+    const auto& traceparent = writer.items.at("traceparent");
+    REQUIRE(traceparent.substr(0, 36) ==
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-");
+    REQUIRE(traceparent.substr(52) == "-01");
+    REQUIRE(writer.items.at("tracestate") ==
+            "dd=s:2;o:rum;t.dm:-4,othervendor=x");
+    REQUIRE(writer.items.count("x-datadog-trace-id") == 0);
+  }
+
+  SECTION("uses the sampled flag when tracestate disagrees") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"traceparent",
+         "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00"},
+        {"tracestate", "dd=s:2"}};
+    MockDictReader reader{headers, prefer_visit};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    const auto decision = span->trace_segment().sampling_decision();
+    REQUIRE(decision);
+    REQUIRE(decision->priority == 0);
+  }
+
+  SECTION("a malformed traceparent is ignored") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"traceparent",
+         "00-00000000000000000000000000000000-00f067aa0ba902b7-01"},
+        {"tracestate", "othervendor=x"}};
+    MockDictReader reader{headers, prefer_visit};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(!span);
+    REQUIRE(span.error().code == Error::NO_SPAN_TO_EXTRACT);
+
+    auto created = tracer.extract_or_create_span(reader);
+    REQUIRE(created);
+    REQUIRE(created->parent_id() == std::nullopt);
+    MockDictWriter writer;
+    created->inject(writer);
+    REQUIRE(writer.items.at("tracestate").find("othervendor") ==
+            std::string::npos);
+  }
+
+  if (config.extraction_styles.datadog) {
+    SECTION("passes on tracestate with the Datadog style's trace") {
+      const std::unordered_map<std::string, std::string> headers{
+          {"x-datadog-trace-id", "123"},
+          {"x-datadog-parent-id", "456"},
+          {"x-datadog-sampling-priority", "1"},
+          {"traceparent",
+           "00-0000000000000000000000000000007b-00000000000001c8-01"},
+          {"tracestate", "dd=s:1,foo=bar"}};
+      MockDictReader reader{headers, prefer_visit};
+      auto span = tracer.extract_span(reader);
+      REQUIRE(span);
+      MockDictWriter writer;
+      span->inject(writer);
+      REQUIRE(writer.items.at("tracestate") == "dd=s:1,foo=bar");
+    }
+
+    SECTION("doesn't pass on another trace's tracestate") {
+      const std::unordered_map<std::string, std::string> headers{
+          {"x-datadog-trace-id", "123"},
+          {"x-datadog-parent-id", "456"},
+          {"x-datadog-sampling-priority", "1"},
+          {"traceparent",
+           "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"},
+          {"tracestate", "dd=s:1,foo=bar"}};
+      MockDictReader reader{headers, prefer_visit};
+      auto span = tracer.extract_span(reader);
+      REQUIRE(span);
+      REQUIRE(span->trace_id() == 123);
+      MockDictWriter writer;
+      span->inject(writer);
+      REQUIRE(writer.items.at("tracestate") == "dd=s:1");
+    }
+
+    SECTION("doesn't pass on tracestate with an uppercase traceparent") {
+      const std::unordered_map<std::string, std::string> headers{
+          {"x-datadog-trace-id", "123"},
+          {"x-datadog-parent-id", "456"},
+          {"x-datadog-sampling-priority", "1"},
+          {"traceparent",
+           "00-0000000000000000000000000000007B-00000000000001C8-01"},
+          {"tracestate", "dd=s:1,foo=bar"}};
+      MockDictReader reader{headers, prefer_visit};
+      auto span = tracer.extract_span(reader);
+      REQUIRE(span);
+      MockDictWriter writer;
+      span->inject(writer);
+      REQUIRE(writer.items.at("tracestate") == "dd=s:1");
+    }
+
+    SECTION("is not consulted when the Datadog style finds a trace") {
+      const std::unordered_map<std::string, std::string> headers{
+          {"x-datadog-trace-id", "123"},
+          {"x-datadog-parent-id", "456"},
+          {"traceparent", "malformed"}};
+      MockDictReader reader{headers, prefer_visit};
+      auto span = tracer.extract_span(reader);
+      REQUIRE(span);
+      REQUIRE(span->trace_id() == 123);
+      REQUIRE(span->parent_id() == 456);
+    }
+  }
+}
+
+TEST_CASE("propagate trace context without a span") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.extraction_styles.w3c = true;
+  config.injection_styles.w3c = true;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+  const bool prefer_visit = GENERATE(false, true);
+  CAPTURE(prefer_visit);
+
+  SECTION("passes on the Datadog headers as received") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-sampling-priority", "2"},
+        {"x-datadog-origin", "rum"},
+        {"x-datadog-tags", "_dd.p.dm=-4"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    auto result = tracer.propagate(reader, writer);
+    REQUIRE(result);
+    REQUIRE(*result);
+    REQUIRE(writer.items.at("x-datadog-trace-id") == "123");
+    REQUIRE(writer.items.at("x-datadog-parent-id") == "456");
+    REQUIRE(writer.items.at("x-datadog-sampling-priority") == "2");
+    REQUIRE(writer.items.at("x-datadog-origin") == "rum");
+    REQUIRE(writer.items.at("x-datadog-tags") == "_dd.p.dm=-4");
+    REQUIRE(writer.items.at("traceparent") ==
+            "00-0000000000000000000000000000007b-00000000000001c8-01");
+    REQUIRE(writer.items.at("tracestate") == "dd=s:2;o:rum;t.dm:-4");
+    REQUIRE(collector->chunks.empty());
+  }
+
+  SECTION("assigns a new span ID when asked") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    REQUIRE(tracer.propagate(reader, writer, true));
+    REQUIRE(writer.items.at("x-datadog-trace-id") == "123");
+    REQUIRE(writer.items.at("x-datadog-parent-id") != "456");
+  }
+
+  SECTION("leaves an absent sampling decision to the receiver") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    REQUIRE(tracer.propagate(reader, writer));
+    REQUIRE(writer.items.count("x-datadog-sampling-priority") == 0);
+    REQUIRE(writer.items.at("traceparent").substr(52) == "-00");
+    REQUIRE(writer.items.count("tracestate") == 0);
+  }
+
+  SECTION("converts W3C context to the Datadog style") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"traceparent",
+         "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"},
+        {"tracestate", "othervendor=x,dd=s:2;o:rum;t.dm:-4"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    REQUIRE(tracer.propagate(reader, writer));
+    REQUIRE(writer.items.at("x-datadog-trace-id") ==
+            std::to_string(0xa3ce929d0e0e4736));
+    REQUIRE(writer.items.at("x-datadog-parent-id") ==
+            std::to_string(0x00f067aa0ba902b7));
+    REQUIRE(writer.items.at("x-datadog-sampling-priority") == "2");
+    REQUIRE(writer.items.at("x-datadog-origin") == "rum");
+    REQUIRE(writer.items.at("x-datadog-tags") == "_dd.p.dm=-4");
+    REQUIRE(writer.items.at("traceparent") ==
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+    REQUIRE(writer.items.at("tracestate") ==
+            "dd=s:2;o:rum;t.dm:-4,othervendor=x");
+  }
+
+  SECTION("passes on other vendors' tracestate members") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"traceparent",
+         "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"},
+        {"tracestate", "dd=s:2;o:rum,foo=bar"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    REQUIRE(tracer.propagate(reader, writer));
+    REQUIRE(writer.items.at("tracestate") == "dd=s:2;o:rum,foo=bar");
+  }
+
+  SECTION("ignores a malformed traceparent") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"traceparent", "malformed"}, {"tracestate", "foo=bar"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    auto result = tracer.propagate(reader, writer);
+    REQUIRE(result);
+    REQUIRE(!*result);
+    REQUIRE(writer.items.empty());
+  }
+
+  SECTION("passes on a request to delegate the sampling decision") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"},
+        {"x-datadog-parent-id", "456"},
+        {"x-datadog-delegate-trace-sampling", "delegate"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    REQUIRE(tracer.propagate(reader, writer));
+    REQUIRE(writer.items.at("x-datadog-delegate-trace-sampling") ==
+            "delegate");
+  }
+
+  SECTION("writes nothing when there's no context") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"unrelated", "header"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    auto result = tracer.propagate(reader, writer);
+    REQUIRE(result);
+    REQUIRE(!*result);
+    REQUIRE(writer.items.empty());
+  }
+
+  SECTION("malformed context is an error") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "nope"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers, prefer_visit};
+    MockDictWriter writer;
+    auto result = tracer.propagate(reader, writer);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::INVALID_INTEGER);
+    REQUIRE(writer.items.empty());
+  }
+}
+
 TEST_CASE("report hostname") {
   TracerConfig config;
   config.defaults.service = "testsvc";
@@ -605,3 +1141,210 @@ TEST_CASE("report hostname") {
     REQUIRE(tracer.create_span().trace_segment().hostname() == get_hostname());
   }
 }
+
+TEST_CASE("disabled tracer") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.report_traces = false;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  SECTION("creates no-op spans") {
+    {
+      auto span = tracer.create_span();
+      REQUIRE(span.id() == 0);
+      REQUIRE(span.trace_id() == TraceID(0));
+      REQUIRE(!span.parent_id());
+
+      span.set_tag("foo", "bar");
+      span.set_name("do.thing");
+      span.set_error_message("oops");
+      REQUIRE(!span.lookup_tag("foo"));
+      REQUIRE(!span.error());
+
+      auto child = span.create_child();
+      REQUIRE(child.id() == 0);
+      child.set_tag("baz", "qux");
+      REQUIRE(!child.lookup_tag("baz"));
+
+      MockDictWriter writer;
+      child.inject(writer);
+      REQUIRE(writer.items.empty());
+    }
+    REQUIRE(collector->chunks.empty());
+  }
+
+  SECTION("extracts no-op spans, ignoring the context") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    auto span = tracer.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() == TraceID(0));
+
+    const std::unordered_map<std::string, std::string> no_headers;
+    MockDictReader empty_reader{no_headers};
+    REQUIRE(tracer.extract_span(empty_reader));
+    REQUIRE(tracer.extract_or_create_span(empty_reader));
+  }
+
+  SECTION("propagates nothing") {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    MockDictWriter writer;
+    auto result = tracer.propagate(reader, writer);
+    REQUIRE(result);
+    REQUIRE(!*result);
+    REQUIRE(writer.items.empty());
+  }
+
+  SECTION("spans share one sentinel trace segment") {
+    auto span = tracer.create_span();
+    auto other = tracer.create_span();
+    REQUIRE(&span.trace_segment() == &other.trace_segment());
+  }
+}
+
+TEST_CASE("lazy startup") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  const auto logger = std::make_shared<MockLogger>();
+  config.logger = logger;
+  config.lazy_startup = true;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  // Nothing has started yet.
+  REQUIRE(logger->startup_count() == 0);
+  REQUIRE(tracer.metrics().spans_created == 0);
+  REQUIRE(tracer.flush(std::chrono::steady_clock::now()));
+
+  // Copies of the tracer share the tracer that starts.
+  Tracer copy = tracer;
+  { auto span = tracer.create_span(); }
+  REQUIRE(logger->startup_count() == 1);
+  {
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    auto span = copy.extract_span(reader);
+    REQUIRE(span);
+    REQUIRE(span->trace_id() == TraceID(123));
+  }
+  REQUIRE(logger->startup_count() == 1);
+  REQUIRE(collector->chunks.size() == 2);
+  REQUIRE(tracer.metrics().spans_created == 2);
+  REQUIRE(copy.metrics().spans_created == 2);
+}
+
+TEST_CASE("memory resource") {
+  // `CountingResource` allocates from the global heap, counting the bytes of
+  // its outstanding allocations.
+  struct CountingResource : public std::pmr::memory_resource {
+    std::size_t allocations = 0;
+    std::size_t outstanding_bytes = 0;
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+      ++allocations;
+      outstanding_bytes += bytes;
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* pointer, std::size_t bytes,
+                       std::size_t alignment) override {
+      outstanding_bytes -= bytes;
+      std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+      return this == &other;
+    }
+  };
+
+  CountingResource resource;
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.memory_resource = &resource;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  {
+    auto root = tracer.create_span();
+    auto child = root.create_child();
+    // The trace segment and its arena's blocks.
+    const std::size_t allocations = resource.allocations;
+    REQUIRE(allocations >= 2);
+    REQUIRE(resource.outstanding_bytes > 0);
+
+    const std::unordered_map<std::string, std::string> headers{
+        {"x-datadog-trace-id", "123"}, {"x-datadog-parent-id", "456"}};
+    MockDictReader reader{headers};
+    auto extracted = tracer.extract_span(reader);
+    REQUIRE(extracted);
+    REQUIRE(resource.allocations >= allocations + 2);
+  }
+  REQUIRE(collector->span_count() == 3);
+  // The spans' memory is held until the collector destroys them.
+  REQUIRE(resource.outstanding_bytes > 0);
+  collector->chunks.clear();
+  REQUIRE(resource.outstanding_bytes == 0);
+}
+
+TEST_CASE("update sampling") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto collector = std::make_shared<MockCollector>();
+  config.collector = collector;
+  config.logger = std::make_shared<NullLogger>();
+  config.trace_sampler.sample_rate = 1;
+  auto finalized_config = finalize_config(config);
+  REQUIRE(finalized_config);
+  Tracer tracer{*finalized_config};
+
+  const auto sampling_priority = [](const SpanData& span) {
+    return span.numeric_tags.at(tags::internal::sampling_priority);
+  };
+
+  SECTION("invalid configuration changes nothing") {
+    TraceSamplerConfig trace_sampler;
+    trace_sampler.sample_rate = 2;
+    const auto result = tracer.update_sampling(trace_sampler, {});
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::RATE_OUT_OF_RANGE);
+    { auto span = tracer.create_span(); }
+    REQUIRE(collector->chunks.size() == 1);
+    REQUIRE(sampling_priority(collector->first_span()) > 0);
+  }
+
+  SECTION("applies to open traces and new traces") {
+    auto open = std::make_optional(tracer.create_span());
+    TraceSamplerConfig trace_sampler;
+    trace_sampler.sample_rate = 0;
+    SpanSamplerConfig span_sampler;
+    span_sampler.rules.emplace_back();
+    REQUIRE(tracer.update_sampling(trace_sampler, span_sampler));
+    { auto span = tracer.create_span(); }
+    open.reset();
+
+    REQUIRE(collector->chunks.size() == 2);
+    for (const auto& chunk : collector->chunks) {
+      const SpanData& span = *chunk.front();
+      REQUIRE(sampling_priority(span) < 0);
+      REQUIRE(span.numeric_tags.contains(
+          tags::internal::span_sampling_mechanism));
+    }
+  }
+}
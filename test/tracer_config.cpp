@@ -15,15 +15,20 @@
 #include <stdexcept>
 #include <string>
 #include <system_error>
+#include <vector>
 
 #include "mocks/collectors.h"
 #include "mocks/event_schedulers.h"
+#include "mocks/http_clients.h"
 #include "mocks/loggers.h"
 #include "test.h"
 #ifdef _MSC_VER
 #include <winbase.h>  // SetEnvironmentVariable
 #else
 #include <stdlib.h>  // setenv, unsetenv
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 #endif
 
 namespace datadog {
@@ -41,6 +46,14 @@ std::ostream& operator<<(std::ostream& stream,
     stream << separator << "B3";
     separator = ", ";
   }
+  if (styles.b3_single) {
+    stream << separator << "b3single";
+    separator = ", ";
+  }
+  if (styles.w3c) {
+    stream << separator << "tracecontext";
+    separator = ", ";
+  }
   return stream << '}';
 }
 
@@ -193,7 +206,7 @@ TEST_CASE("TracerConfig::defaults") {
     struct TestCase {
       std::string name;
       std::string dd_tags;
-      std::unordered_map<std::string, std::string> expected_tags;
+      FlatMap<std::string> expected_tags;
       std::optional<Error::Code> expected_error;
     };
 
@@ -298,6 +311,478 @@ TEST_CASE("TracerConfig::log_on_startup") {
   }
 }
 
+TEST_CASE("TracerConfig::partial_flush") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default is disabled") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->partial_flush_min_spans);
+  }
+
+  SECTION("enabled uses the minimum number of spans") {
+    config.partial_flush_enabled = true;
+    config.partial_flush_min_spans = 10;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->partial_flush_min_spans == 10);
+  }
+
+  SECTION("the minimum number of spans must be positive") {
+    config.partial_flush_enabled = true;
+    config.partial_flush_min_spans = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_PARTIAL_FLUSH_MIN_SPANS);
+  }
+
+  SECTION("overridden by DD_TRACE_PARTIAL_FLUSH_ENABLED") {
+    const EnvGuard guard{"DD_TRACE_PARTIAL_FLUSH_ENABLED", "true"};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->partial_flush_min_spans == 1000);
+  }
+
+  SECTION("DD_TRACE_PARTIAL_FLUSH_MIN_SPANS") {
+    config.partial_flush_enabled = true;
+
+    SECTION("overrides partial_flush_min_spans") {
+      const EnvGuard guard{"DD_TRACE_PARTIAL_FLUSH_MIN_SPANS", "3"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->partial_flush_min_spans == 3);
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_PARTIAL_FLUSH_MIN_SPANS", "lots"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig::span_limits") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default to the Datadog Agent's limits") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->span_limits.max_resource_bytes == 5000);
+    REQUIRE(finalized->span_limits.max_tag_name_bytes == 200);
+    REQUIRE(finalized->span_limits.max_tag_value_bytes == 25000);
+    REQUIRE(!finalized->span_limits.max_tags);
+  }
+
+  SECTION("byte limits must be positive") {
+    const auto limit = GENERATE(&SpanLimits::max_resource_bytes,
+                                &SpanLimits::max_tag_name_bytes,
+                                &SpanLimits::max_tag_value_bytes);
+    config.span_limits.*limit = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_SPAN_LIMITS);
+  }
+
+  SECTION("may be unset, and the maximum number of tags may be zero") {
+    config.span_limits.max_resource_bytes.reset();
+    config.span_limits.max_tags = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->span_limits.max_resource_bytes);
+  }
+}
+
+TEST_CASE("TracerConfig::max_memory_bytes") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default is unlimited") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->max_memory_bytes);
+  }
+
+  SECTION("must be positive") {
+    config.max_memory_bytes = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_MAX_MEMORY_BYTES);
+  }
+
+  SECTION("DD_TRACE_MAX_MEMORY_BYTES") {
+    config.max_memory_bytes = 1000;
+
+    SECTION("overrides max_memory_bytes") {
+      const EnvGuard guard{"DD_TRACE_MAX_MEMORY_BYTES", "3000"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->max_memory_bytes == 3000);
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_MAX_MEMORY_BYTES", "lots"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+
+    SECTION("zero is invalid") {
+      const EnvGuard guard{"DD_TRACE_MAX_MEMORY_BYTES", "0"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_MAX_MEMORY_BYTES);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig::min_span_duration_microseconds") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default is no filtering") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->min_span_duration);
+  }
+
+  SECTION("zero is no filtering") {
+    config.min_span_duration_microseconds = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->min_span_duration);
+  }
+
+  SECTION("DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS") {
+    config.min_span_duration_microseconds = 100;
+
+    SECTION("overrides min_span_duration_microseconds") {
+      const EnvGuard guard{"DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS", "250"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->min_span_duration == std::chrono::microseconds(250));
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_MIN_SPAN_DURATION_MICROSECONDS", "short"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig::collapse_repeated_spans_threshold") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default is no collapsing") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->collapse_repeated_spans_threshold);
+  }
+
+  SECTION("must be at least two") {
+    config.collapse_repeated_spans_threshold = 1;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::INVALID_COLLAPSE_REPEATED_SPANS_THRESHOLD);
+  }
+
+  SECTION("DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD") {
+    config.collapse_repeated_spans_threshold = 10;
+
+    SECTION("overrides collapse_repeated_spans_threshold") {
+      const EnvGuard guard{"DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD", "5"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->collapse_repeated_spans_threshold == 5);
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_COLLAPSE_REPEATED_SPANS_THRESHOLD",
+                           "many"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig::compact_finished_spans") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+
+  SECTION("default is no compaction") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->compact_finished_spans);
+    REQUIRE(!finalized->compress_compacted_spans);
+  }
+
+  SECTION("must be at least one") {
+    config.compact_finished_spans = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_COMPACT_FINISHED_SPANS);
+  }
+
+  SECTION("DD_TRACE_COMPACT_FINISHED_SPANS") {
+    config.compact_finished_spans = 100;
+
+    SECTION("overrides compact_finished_spans") {
+      const EnvGuard guard{"DD_TRACE_COMPACT_FINISHED_SPANS", "50"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->compact_finished_spans == 50);
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_COMPACT_FINISHED_SPANS", "lots"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
+
+  SECTION("DD_TRACE_COMPRESS_COMPACTED_SPANS") {
+    config.compact_finished_spans = 100;
+    config.compress_compacted_spans = false;
+    const EnvGuard guard{"DD_TRACE_COMPRESS_COMPACTED_SPANS", "true"};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->compress_compacted_spans);
+  }
+}
+
+TEST_CASE("TracerConfig::max_spans_per_trace") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default is no maximum") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->max_spans_per_trace);
+  }
+
+  SECTION("must be at least one") {
+    config.max_spans_per_trace = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_MAX_SPANS_PER_TRACE);
+  }
+
+  SECTION("DD_TRACE_MAX_SPANS_PER_TRACE") {
+    config.max_spans_per_trace = 1000;
+
+    SECTION("overrides max_spans_per_trace") {
+      const EnvGuard guard{"DD_TRACE_MAX_SPANS_PER_TRACE", "100"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->max_spans_per_trace == 100);
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_MAX_SPANS_PER_TRACE", "lots"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig::span_quotas") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+
+  SECTION("default is no quotas") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->span_quotas.empty());
+  }
+
+  SECTION("a quota must name a service") {
+    config.span_quotas.push_back(SpanQuotaConfig{"", std::nullopt, 10});
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_SPAN_QUOTAS);
+  }
+
+  SECTION("a quota's rate must be positive") {
+    config.span_quotas.push_back(SpanQuotaConfig{"billing", std::nullopt, 0});
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_SPAN_QUOTAS);
+  }
+
+  SECTION("DD_TRACE_SPAN_QUOTAS") {
+    config.span_quotas.push_back(SpanQuotaConfig{"billing", std::nullopt, 10});
+
+    SECTION("overrides span_quotas") {
+      const EnvGuard guard{
+          "DD_TRACE_SPAN_QUOTAS",
+          R"([{"service": "search", "resource": "GET /", )"
+          R"("max_spans_per_second": 50}])"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->span_quotas.size() == 1);
+      const auto& quota = finalized->span_quotas.front();
+      REQUIRE(quota.service == "search");
+      REQUIRE(quota.resource == "GET /");
+      REQUIRE(quota.max_spans_per_second == 50);
+    }
+
+    SECTION("parsing failure") {
+      const EnvGuard guard{"DD_TRACE_SPAN_QUOTAS", "{"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_SPAN_QUOTAS);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig::lazy_startup") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.logger = std::make_shared<NullLogger>();
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+
+  SECTION("default is to start with the tracer") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->lazy_startup);
+    const auto& agent =
+        std::get<FinalizedDatadogAgentConfig>(finalized->collector);
+    REQUIRE(agent.event_scheduler);
+  }
+
+  SECTION("defers creating the agent's event scheduler") {
+    config.lazy_startup = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->lazy_startup);
+    const auto& agent =
+        std::get<FinalizedDatadogAgentConfig>(finalized->collector);
+    REQUIRE(!agent.event_scheduler);
+    REQUIRE(agent.http_client == config.agent.http_client);
+  }
+
+  SECTION("overridden by DD_TRACE_LAZY_STARTUP") {
+    const EnvGuard guard{"DD_TRACE_LAZY_STARTUP", "true"};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->lazy_startup);
+  }
+}
+
+TEST_CASE("TracerConfig::span_sampling_rules_file_poll_interval_milliseconds") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  const auto logger = std::make_shared<MockLogger>();
+  config.logger = logger;
+  config.agent.http_client = std::make_shared<MockHTTPClient>();
+  const auto event_scheduler = std::make_shared<MockEventScheduler>();
+  config.agent.event_scheduler = event_scheduler;
+
+  SomewhatSecureTemporaryFile file;
+  REQUIRE(file.is_open());
+  file << R"json([{"service": "testsvc"}])json";
+  file.close();
+  const EnvGuard guard{"DD_SPAN_SAMPLING_RULES_FILE", file.path().string()};
+
+  SECTION("default is not to watch the file") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->span_sampling_rules_file);
+  }
+
+  SECTION("must not be negative") {
+    config.span_sampling_rules_file_poll_interval_milliseconds = -1;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::INVALID_SPAN_SAMPLING_RULES_FILE_POLL_INTERVAL);
+  }
+
+  SECTION("reloads the file when it changes") {
+    config.span_sampling_rules_file_poll_interval_milliseconds = 1000;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->span_sampling_rules_file == file.path().string());
+    Tracer tracer{*finalized};
+    // The tracer's recurring event is scheduled after the `DatadogAgent`'s.
+    REQUIRE(event_scheduler->recurrence_interval ==
+            std::chrono::seconds(1));
+    const int errors = logger->error_count();
+    const auto written = std::filesystem::last_write_time(file.path());
+
+    // A missing file keeps the current rules.
+    std::filesystem::remove(file.path());
+    event_scheduler->event_callback();
+    REQUIRE(logger->error_count() == errors);
+
+    // A changed file is read, and invalid rules are reported.
+    {
+      std::ofstream rewritten{file.path()};
+      rewritten << "not JSON";
+    }
+    std::filesystem::last_write_time(file.path(),
+                                     written + std::chrono::seconds(10));
+    event_scheduler->event_callback();
+    REQUIRE(logger->error_count() == errors + 1);
+    const auto& error = std::get<Error>(logger->entries.back().payload);
+    REQUIRE(error.code == Error::SPAN_SAMPLING_RULES_INVALID_JSON);
+
+    // An unchanged file isn't read again.
+    event_scheduler->event_callback();
+    REQUIRE(logger->error_count() == errors + 1);
+  }
+}
+
+TEST_CASE("TracerConfig::trace_id_128_bit") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("default is disabled") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->trace_id_128_bit);
+  }
+
+  SECTION("can be enabled") {
+    config.trace_id_128_bit = true;
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->trace_id_128_bit);
+  }
+
+  SECTION("overridden by DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED") {
+    config.trace_id_128_bit = true;
+    const EnvGuard guard{"DD_TRACE_128_BIT_TRACEID_GENERATION_ENABLED",
+                         "false"};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->trace_id_128_bit);
+  }
+}
+
+TEST_CASE("TracerConfig::clock_source") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.clock_source = GENERATE(ClockSource::DEFAULT, ClockSource::COARSE,
+                                 ClockSource::ANCHORED);
+  auto finalized = finalize_config(config);
+  REQUIRE(finalized);
+  REQUIRE(finalized->clock);
+  const auto start = finalized->clock();
+  REQUIRE(finalized->clock().tick >= start.tick);
+}
+
 TEST_CASE("TracerConfig::report_traces") {
   TracerConfig config;
   config.defaults.service = "testsvc";
@@ -392,21 +877,69 @@ TEST_CASE("TracerConfig::agent") {
       REQUIRE(agent);
       REQUIRE(agent->event_scheduler == scheduler);
     }
-  }
 
-  SECTION("flush interval") {
-    SECTION("cannot be zero") {
-      config.agent.flush_interval_milliseconds = 0;
-      auto finalized = finalize_config(config);
-      REQUIRE(!finalized);
-      REQUIRE(finalized.error().code ==
-              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
-    }
+    SECTION("single background thread") {
+      config.agent.http_client = std::make_shared<MockHTTPClient>();
 
-    SECTION("cannot be negative") {
-      config.agent.flush_interval_milliseconds = -1337;
-      auto finalized = finalize_config(config);
-      REQUIRE(!finalized);
+      SECTION("is off by default") {
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(!agent->single_background_thread);
+      }
+
+      SECTION("environment variable overrides") {
+        config.agent.single_background_thread = false;
+        const EnvGuard guard{"DD_TRACE_SINGLE_BACKGROUND_THREAD", "true"};
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->single_background_thread);
+      }
+
+      SECTION("uses a thread of its own without the default HTTP client") {
+        config.agent.single_background_thread = true;
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->single_background_thread);
+        REQUIRE(dynamic_cast<ThreadedEventScheduler*>(
+            agent->event_scheduler.get()));
+      }
+
+      SECTION("doesn't replace a custom event scheduler") {
+        config.agent.single_background_thread = true;
+        auto scheduler = std::make_shared<MockEventScheduler>();
+        config.agent.event_scheduler = scheduler;
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->event_scheduler == scheduler);
+      }
+    }
+  }
+
+  SECTION("flush interval") {
+    SECTION("cannot be zero") {
+      config.agent.flush_interval_milliseconds = 0;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
+    }
+
+    SECTION("cannot be negative") {
+      config.agent.flush_interval_milliseconds = -1337;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
       REQUIRE(finalized.error().code ==
               Error::DATADOG_AGENT_INVALID_FLUSH_INTERVAL);
     }
@@ -511,6 +1044,828 @@ TEST_CASE("TracerConfig::agent") {
       REQUIRE(agent->url.scheme == test_case.expected_scheme);
       REQUIRE(agent->url.authority == test_case.expected_authority);
     }
+
+#ifndef _MSC_VER
+    SECTION("Unix domain socket is used if it exists") {
+      SomewhatSecureTemporaryFile file;
+      REQUIRE(file.is_open());
+      const auto socket_path = file.path().parent_path() / "apm.socket";
+      config.agent.unix_socket_path = socket_path.string();
+
+      const auto finalized_url = [&]() {
+        auto finalized = finalize_config(config);
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        return agent->url;
+      };
+
+      // There's no socket yet.
+      auto url = finalized_url();
+      REQUIRE(url.scheme == "http");
+      REQUIRE(url.authority == "localhost:8126");
+
+      const int descriptor = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      REQUIRE(descriptor >= 0);
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      const std::string path = socket_path.string();
+      REQUIRE(path.size() < sizeof address.sun_path);
+      path.copy(address.sun_path, path.size());
+      REQUIRE(::bind(descriptor, reinterpret_cast<const sockaddr*>(&address),
+                     sizeof address) == 0);
+
+      url = finalized_url();
+      REQUIRE(url.scheme == "unix");
+      REQUIRE(url.authority == path);
+
+      // An explicit URL is preferred, as are the environment variables.
+      SECTION("explicit URL") {
+        config.agent.url = "http://dd-agent:8126";
+        REQUIRE(finalized_url().authority == "dd-agent:8126");
+      }
+      SECTION("environment") {
+        EnvGuard guard{"DD_AGENT_HOST", "dd-agent"};
+        REQUIRE(finalized_url().authority == "dd-agent:8126");
+      }
+      SECTION("detection disabled") {
+        config.agent.unix_socket_path.clear();
+        REQUIRE(finalized_url().authority == "localhost:8126");
+      }
+
+      ::close(descriptor);
+    }
+#endif
+  }
+
+  SECTION("api version") {
+    SECTION("default is v0.4") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->api_version == TraceAPIVersion::V0_4);
+    }
+
+    SECTION("can be configured") {
+      config.agent.api_version = TraceAPIVersion::V0_5;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->api_version == TraceAPIVersion::V0_5);
+    }
+
+    SECTION("environment variable overrides") {
+      struct TestCase {
+        std::string env_value;
+        std::optional<TraceAPIVersion> expected_version;
+      };
+
+      auto test_case = GENERATE(values<TestCase>({
+          {"v0.4", TraceAPIVersion::V0_4},
+          {"v0.5", TraceAPIVersion::V0_5},
+          {"v0.3", std::nullopt},
+          {"0.5", std::nullopt},
+          {"", std::nullopt},
+      }));
+
+      CAPTURE(test_case.env_value);
+      config.agent.api_version = TraceAPIVersion::V0_5;
+      const EnvGuard guard{"DD_TRACE_API_VERSION", test_case.env_value};
+      auto finalized = finalize_config(config);
+      if (!test_case.expected_version) {
+        REQUIRE(!finalized);
+        REQUIRE(finalized.error().code ==
+                Error::DATADOG_AGENT_INVALID_API_VERSION);
+      } else {
+        REQUIRE(finalized);
+        const auto* const agent =
+            std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+        REQUIRE(agent);
+        REQUIRE(agent->api_version == *test_case.expected_version);
+      }
+    }
+  }
+
+  SECTION("buffer limits") {
+    SECTION("are unbounded by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->max_buffered_spans);
+      REQUIRE(!agent->max_buffered_bytes);
+      REQUIRE(agent->buffer_overflow_policy ==
+              BufferOverflowPolicy::DROP_NEWEST);
+    }
+
+    SECTION("can be configured") {
+      config.agent.max_buffered_spans = 1000;
+      config.agent.max_buffered_bytes = 1 << 20;
+      config.agent.buffer_overflow_policy =
+          BufferOverflowPolicy::DROP_BY_PRIORITY;
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->max_buffered_spans == std::size_t(1000));
+      REQUIRE(agent->max_buffered_bytes == std::size_t(1 << 20));
+      REQUIRE(agent->buffer_overflow_policy ==
+              BufferOverflowPolicy::DROP_BY_PRIORITY);
+    }
+
+    SECTION("must be positive") {
+      if (GENERATE(true, false)) {
+        config.agent.max_buffered_spans = 0;
+      } else {
+        config.agent.max_buffered_bytes = 0;
+      }
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_BUFFER_LIMIT);
+    }
+  }
+
+  SECTION("max payload size must be positive") {
+    config.agent.max_payload_bytes = 0;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_MAX_PAYLOAD_BYTES);
+  }
+
+  SECTION("retry settings must be valid") {
+    struct TestCase {
+      int max_retry_attempts;
+      int retry_backoff_milliseconds;
+      int max_retry_backoff_milliseconds;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {-1, 1000, 30000},
+        {3, 0, 30000},
+        {3, -1000, 30000},
+        {3, 1000, 999},
+    }));
+
+    config.agent.max_retry_attempts = test_case.max_retry_attempts;
+    config.agent.retry_backoff_milliseconds =
+        test_case.retry_backoff_milliseconds;
+    config.agent.max_retry_backoff_milliseconds =
+        test_case.max_retry_backoff_milliseconds;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::DATADOG_AGENT_INVALID_RETRY);
+  }
+
+  SECTION("flush thresholds must be positive") {
+    if (GENERATE(true, false)) {
+      config.agent.flush_threshold_spans = 0;
+    } else {
+      config.agent.flush_threshold_bytes = 0;
+    }
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_FLUSH_THRESHOLD);
+  }
+
+  SECTION("shutdown timeout must not be negative") {
+    config.agent.shutdown_timeout_milliseconds = -1;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code ==
+            Error::DATADOG_AGENT_INVALID_SHUTDOWN_TIMEOUT);
+  }
+
+  SECTION("stats computation") {
+    struct TestCase {
+      bool configured;
+      std::optional<std::string> env_value;
+      bool expected;
+    };
+
+    auto test_case = GENERATE(values<TestCase>({
+        {false, std::nullopt, false},
+        {true, std::nullopt, true},
+        {false, "true", true},
+        {false, "1", true},
+        {true, "false", false},
+        {true, "0", false},
+    }));
+
+    CAPTURE(test_case.configured);
+    CAPTURE(test_case.env_value);
+    config.agent.stats_computation_enabled = test_case.configured;
+    std::optional<EnvGuard> guard;
+    if (test_case.env_value) {
+      guard.emplace("DD_TRACE_STATS_COMPUTATION_ENABLED", *test_case.env_value);
+    }
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    const auto* const agent =
+        std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+    REQUIRE(agent);
+    REQUIRE(agent->stats_computation_enabled == test_case.expected);
+  }
+
+  SECTION("health metrics") {
+    // Don't depend on whether the host has a DogStatsD socket.
+    config.agent.dogstatsd_socket_path.clear();
+    const auto finalized_agent = [&]() {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      return *agent;
+    };
+
+    SECTION("are disabled by default") {
+      REQUIRE(!finalized_agent().health_metrics_enabled);
+    }
+
+    SECTION("can be enabled by the environment") {
+      EnvGuard guard{"DD_TRACE_HEALTH_METRICS_ENABLED", "true"};
+      const auto agent = finalized_agent();
+      REQUIRE(agent.health_metrics_enabled);
+      REQUIRE(agent.dogstatsd_url.scheme == "udp");
+      REQUIRE(agent.dogstatsd_url.authority == "localhost:8125");
+      REQUIRE(agent.health_metrics_interval == std::chrono::seconds(10));
+    }
+
+    SECTION("DogStatsD URL") {
+      config.agent.health_metrics_enabled = true;
+      struct TestCase {
+        std::string url;
+        std::string expected_scheme;
+        std::string expected_authority;
+      };
+      auto test_case = GENERATE(values<TestCase>({
+          {"udp://localhost:8125", "udp", "localhost:8125"},
+          {"udp://dogstatsd", "udp", "dogstatsd:8125"},
+          {"udp://[::1]:9000", "udp", "::1:9000"},
+          {"udp://[::1]", "udp", "::1:8125"},
+          {"unix:///var/run/datadog/dsd.socket", "unix",
+           "/var/run/datadog/dsd.socket"},
+      }));
+      CAPTURE(test_case.url);
+
+      SECTION("in the configuration") {
+        config.agent.dogstatsd_url = test_case.url;
+      }
+      std::optional<EnvGuard> guard;
+      SECTION("in the environment") {
+        config.agent.dogstatsd_url = "udp://ignored:1";
+        guard.emplace("DD_DOGSTATSD_URL", test_case.url);
+      }
+      const auto agent = finalized_agent();
+      REQUIRE(agent.dogstatsd_url.scheme == test_case.expected_scheme);
+      REQUIRE(agent.dogstatsd_url.authority == test_case.expected_authority);
+    }
+
+    SECTION("DogStatsD host and port") {
+      config.agent.health_metrics_enabled = true;
+      struct TestCase {
+        std::optional<std::string> env_agent_host;
+        std::optional<std::string> env_host;
+        std::optional<std::string> env_port;
+        std::optional<std::string> env_url;
+        std::string expected_authority;
+      };
+      auto test_case = GENERATE(values<TestCase>({
+          {std::nullopt, std::nullopt, std::nullopt, std::nullopt,
+           "configured:1"},
+          {"agent", std::nullopt, std::nullopt, std::nullopt, "configured:1"},
+          {std::nullopt, "dsd", std::nullopt, std::nullopt, "dsd:8125"},
+          {std::nullopt, std::nullopt, "9125", std::nullopt, "localhost:9125"},
+          {"agent", std::nullopt, "9125", std::nullopt, "agent:9125"},
+          {"agent", "dsd", "9125", std::nullopt, "dsd:9125"},
+          {"agent", "dsd", "9125", "udp://url:2", "url:2"},
+      }));
+      config.agent.dogstatsd_url = "udp://configured:1";
+      SECTION("without a configured URL") {
+        // Only then is `DD_AGENT_HOST` the default host.
+        if (!test_case.env_host && !test_case.env_port && !test_case.env_url) {
+          config.agent.dogstatsd_url.reset();
+          test_case.expected_authority =
+              test_case.env_agent_host.value_or("localhost") + ":8125";
+        }
+      }
+      SECTION("with a configured URL") {}
+
+      std::optional<EnvGuard> agent_host_guard;
+      std::optional<EnvGuard> host_guard;
+      std::optional<EnvGuard> port_guard;
+      std::optional<EnvGuard> url_guard;
+      if (test_case.env_agent_host) {
+        agent_host_guard.emplace("DD_AGENT_HOST", *test_case.env_agent_host);
+      }
+      if (test_case.env_host) {
+        host_guard.emplace("DD_DOGSTATSD_HOST", *test_case.env_host);
+      }
+      if (test_case.env_port) {
+        port_guard.emplace("DD_DOGSTATSD_PORT", *test_case.env_port);
+      }
+      if (test_case.env_url) {
+        url_guard.emplace("DD_DOGSTATSD_URL", *test_case.env_url);
+      }
+      CAPTURE(config.agent.dogstatsd_url);
+      REQUIRE(finalized_agent().dogstatsd_url.authority ==
+              test_case.expected_authority);
+    }
+
+#ifndef _MSC_VER
+    SECTION("DogStatsD socket is used if it exists") {
+      config.agent.health_metrics_enabled = true;
+      SomewhatSecureTemporaryFile file;
+      REQUIRE(file.is_open());
+      const std::string path =
+          (file.path().parent_path() / "dsd.socket").string();
+      config.agent.dogstatsd_socket_path = path;
+      REQUIRE(finalized_agent().dogstatsd_url.scheme == "udp");
+
+      const int descriptor = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+      REQUIRE(descriptor >= 0);
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      REQUIRE(path.size() < sizeof address.sun_path);
+      path.copy(address.sun_path, path.size());
+      REQUIRE(::bind(descriptor, reinterpret_cast<const sockaddr*>(&address),
+                     sizeof address) == 0);
+      auto url = finalized_agent().dogstatsd_url;
+      REQUIRE(url.scheme == "unix");
+      REQUIRE(url.authority == path);
+
+      // An explicit URL is preferred.
+      config.agent.dogstatsd_url = "udp://dsd:8125";
+      REQUIRE(finalized_agent().dogstatsd_url.authority == "dsd:8125");
+      ::close(descriptor);
+    }
+#endif
+
+    SECTION("invalid DogStatsD URL") {
+      config.agent.health_metrics_enabled = true;
+      config.agent.dogstatsd_url =
+          GENERATE(as<std::string>{}, "localhost:8125", "http://localhost",
+                   "udp://:8125", "udp://localhost:0",
+                   "udp://localhost:99999", "udp://localhost:port",
+                   "unix://relative/path");
+      CAPTURE(config.agent.dogstatsd_url);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_DOGSTATSD_URL);
+    }
+
+    SECTION("invalid DogStatsD URL is ignored if health metrics are "
+            "disabled") {
+      config.agent.dogstatsd_url = "bogus";
+      REQUIRE(!finalized_agent().health_metrics_enabled);
+    }
+
+    SECTION("interval must be positive") {
+      config.agent.health_metrics_enabled = true;
+      config.agent.health_metrics_interval_milliseconds = GENERATE(0, -1);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_HEALTH_METRICS_INTERVAL);
+    }
+  }
+
+  SECTION("runtime metrics") {
+    // Don't depend on whether the host has a DogStatsD socket.
+    config.agent.dogstatsd_socket_path.clear();
+    const auto finalized_agent = [&]() {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      return *agent;
+    };
+
+    SECTION("are disabled by default") {
+      REQUIRE(!finalized_agent().runtime_metrics_enabled);
+    }
+
+    SECTION("can be enabled by the environment") {
+      EnvGuard guard{"DD_RUNTIME_METRICS_ENABLED", "true"};
+      const auto agent = finalized_agent();
+      REQUIRE(agent.runtime_metrics_enabled);
+      REQUIRE(!agent.health_metrics_enabled);
+      REQUIRE(agent.dogstatsd_url.scheme == "udp");
+      REQUIRE(agent.dogstatsd_url.authority == "localhost:8125");
+      REQUIRE(agent.runtime_metrics_interval == std::chrono::seconds(10));
+    }
+
+    SECTION("use the DogStatsD URL") {
+      config.agent.runtime_metrics_enabled = true;
+      config.agent.dogstatsd_url = "bogus";
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_DOGSTATSD_URL);
+    }
+
+    SECTION("interval must be positive") {
+      config.agent.runtime_metrics_enabled = true;
+      config.agent.runtime_metrics_interval_milliseconds = GENERATE(0, -1);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_RUNTIME_METRICS_INTERVAL);
+    }
+  }
+
+  SECTION("flush summary") {
+    const auto finalized_agent = [&]() {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      return *agent;
+    };
+
+    SECTION("is disabled by default") {
+      REQUIRE(!finalized_agent().flush_summary_enabled);
+    }
+
+    SECTION("is enabled by DD_TRACE_DEBUG") {
+      EnvGuard guard{"DD_TRACE_DEBUG", "true"};
+      const auto agent = finalized_agent();
+      REQUIRE(agent.flush_summary_enabled);
+      REQUIRE(agent.flush_summary_interval == std::chrono::seconds(60));
+    }
+
+    SECTION("interval must be positive") {
+      config.agent.flush_summary_enabled = true;
+      config.agent.flush_summary_interval_milliseconds = GENERATE(0, -1);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_FLUSH_SUMMARY_INTERVAL);
+    }
+  }
+
+  SECTION("agent discovery") {
+    SECTION("is disabled by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->agent_discovery_enabled);
+    }
+
+    SECTION("interval must be positive") {
+      EnvGuard guard{"DD_TRACE_AGENT_DISCOVERY_ENABLED", "true"};
+      config.agent.agent_discovery_interval_milliseconds = GENERATE(0, -1);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_DISCOVERY_INTERVAL);
+    }
+  }
+
+  SECTION("remote configuration") {
+    const auto finalized_agent = [&]() {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      return *agent;
+    };
+
+    SECTION("is disabled by default") {
+      REQUIRE(!finalized_agent().remote_configuration_enabled);
+    }
+
+    SECTION("can be enabled by the environment") {
+      EnvGuard guard{"DD_REMOTE_CONFIGURATION_ENABLED", "true"};
+      const auto agent = finalized_agent();
+      REQUIRE(agent.remote_configuration_enabled);
+      REQUIRE(agent.remote_configuration_poll_interval ==
+              std::chrono::seconds(5));
+    }
+
+    SECTION("can be disabled by the environment") {
+      EnvGuard guard{"DD_REMOTE_CONFIGURATION_ENABLED", "false"};
+      config.agent.remote_configuration_enabled = true;
+      REQUIRE(!finalized_agent().remote_configuration_enabled);
+    }
+
+    SECTION("poll interval must be positive") {
+      config.agent.remote_configuration_enabled = true;
+      config.agent.remote_configuration_poll_interval_milliseconds =
+          GENERATE(0, -1);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_REMOTE_CONFIGURATION_POLL_INTERVAL);
+    }
+  }
+
+  SECTION("background threads") {
+    SECTION("default is no placement") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->background_threads.cpus.empty());
+      REQUIRE(!agent->background_threads.nice);
+    }
+
+    SECTION("environment variables override") {
+      config.agent.background_thread_cpus = {0};
+      config.agent.background_thread_nice = 5;
+      const EnvGuard cpus_guard{"DD_TRACE_BACKGROUND_THREAD_CPUS", "2,4-6"};
+      const EnvGuard nice_guard{"DD_TRACE_BACKGROUND_THREAD_NICE", "10"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->background_threads.cpus == std::vector<int>{2, 4, 5, 6});
+      REQUIRE(agent->background_threads.nice == 10);
+    }
+
+    SECTION("invalid CPU list") {
+      const EnvGuard guard{"DD_TRACE_BACKGROUND_THREAD_CPUS", "4-2"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_THREAD_PLACEMENT);
+    }
+
+    SECTION("negative CPU index") {
+      config.agent.background_thread_cpus = {-1};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_THREAD_PLACEMENT);
+    }
+
+    SECTION("nice value out of range") {
+      config.agent.background_thread_nice = GENERATE(-21, 20);
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_THREAD_PLACEMENT);
+    }
+
+    SECTION("nice value parsing failure") {
+      const EnvGuard guard{"DD_TRACE_BACKGROUND_THREAD_NICE", "low"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::INVALID_INTEGER);
+    }
+  }
+
+  SECTION("mirror URLs") {
+    config.agent.http_client = std::make_shared<MockHTTPClient>();
+
+    SECTION("default is no mirrors") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->mirror_urls.empty());
+    }
+
+    SECTION("environment variable overrides") {
+      config.agent.mirror_urls = {"http://ignored:8126"};
+      const EnvGuard guard{"DD_TRACE_AGENT_MIRROR_URLS",
+                           " http://new-agent:8126 ,unix:///var/run/apm.sock"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->mirror_urls.size() == 2);
+      REQUIRE(agent->mirror_urls[0].scheme == "http");
+      REQUIRE(agent->mirror_urls[0].authority == "new-agent:8126");
+      REQUIRE(agent->mirror_urls[1].scheme == "unix");
+      REQUIRE(agent->mirror_urls[1].authority == "/var/run/apm.sock");
+    }
+
+    SECTION("invalid URL") {
+      config.agent.mirror_urls = {"ftp://new-agent"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::URL_UNSUPPORTED_SCHEME);
+    }
+  }
+
+  SECTION("replica URLs") {
+    config.agent.http_client = std::make_shared<MockHTTPClient>();
+
+    SECTION("default is no replicas, balanced round robin") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->replica_urls.empty());
+      REQUIRE(agent->load_balancing == AgentLoadBalancing::ROUND_ROBIN);
+    }
+
+    SECTION("environment variables override") {
+      config.agent.replica_urls = {"http://ignored:8126"};
+      const EnvGuard urls_guard{"DD_TRACE_AGENT_REPLICA_URLS",
+                                "http://replica-1:8126, http://replica-2:8126"};
+      const EnvGuard balancing_guard{"DD_TRACE_AGENT_LOAD_BALANCING",
+                                     "least_outstanding_requests"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->replica_urls.size() == 2);
+      REQUIRE(agent->replica_urls[0].authority == "replica-1:8126");
+      REQUIRE(agent->replica_urls[1].authority == "replica-2:8126");
+      REQUIRE(agent->load_balancing ==
+              AgentLoadBalancing::LEAST_OUTSTANDING_REQUESTS);
+    }
+
+    SECTION("invalid URL") {
+      config.agent.replica_urls = {"ftp://replica"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code == Error::URL_UNSUPPORTED_SCHEME);
+    }
+
+    SECTION("invalid load balancing") {
+      const EnvGuard guard{"DD_TRACE_AGENT_LOAD_BALANCING", "random"};
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_LOAD_BALANCING);
+    }
+  }
+
+  SECTION("tail sampling") {
+    config.agent.http_client = std::make_shared<MockHTTPClient>();
+
+    SECTION("default is disabled") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(!agent->tail_sampling_enabled);
+      REQUIRE(agent->tail_sampling_min_duration == std::chrono::seconds(1));
+      REQUIRE(!agent->tail_sampling_min_spans);
+    }
+
+    SECTION("environment variable overrides") {
+      const EnvGuard guard{"DD_TRACE_TAIL_SAMPLING_ENABLED", "true"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      const auto* const agent =
+          std::get_if<FinalizedDatadogAgentConfig>(&finalized->collector);
+      REQUIRE(agent);
+      REQUIRE(agent->tail_sampling_enabled);
+    }
+
+    SECTION("invalid") {
+      auto& agent = config.agent;
+      switch (GENERATE(0, 1, 2, 3)) {
+        case 0:
+          agent.tail_sampling_window_milliseconds = 0;
+          break;
+        case 1:
+          agent.tail_sampling_max_bytes = 0;
+          break;
+        case 2:
+          agent.tail_sampling_min_duration_milliseconds = -1;
+          break;
+        default:
+          agent.tail_sampling_min_spans = 0;
+      }
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::DATADOG_AGENT_INVALID_TAIL_SAMPLING);
+    }
+  }
+}
+
+TEST_CASE("TracerConfig overhead profiling") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("is disabled by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->overhead_profiling_enabled);
+    REQUIRE(finalized->overhead_log_interval == std::chrono::minutes(1));
+  }
+
+  SECTION("is overridden by the environment") {
+    config.overhead_profiling_enabled = GENERATE(false, true);
+    const std::string env_value = GENERATE("true", "false");
+    EnvGuard guard{"DD_TRACE_OVERHEAD_PROFILING_ENABLED", env_value};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->overhead_profiling_enabled == (env_value == "true"));
+  }
+
+  SECTION("log interval must not be negative") {
+    config.overhead_log_interval_milliseconds = -1;
+    auto finalized = finalize_config(config);
+    REQUIRE(!finalized);
+    REQUIRE(finalized.error().code == Error::INVALID_OVERHEAD_LOG_INTERVAL);
+  }
+}
+
+TEST_CASE("TracerConfig sampling decision at root") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("is disabled by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->sampling_decision_at_root);
+  }
+
+  SECTION("is overridden by the environment") {
+    config.sampling_decision_at_root = GENERATE(false, true);
+    const std::string env_value = GENERATE("true", "false");
+    EnvGuard guard{"DD_TRACE_SAMPLING_DECISION_AT_ROOT", env_value};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->sampling_decision_at_root == (env_value == "true"));
+  }
+}
+
+TEST_CASE("TracerConfig defer span sampling") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("is disabled by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->defer_span_sampling);
+  }
+
+  SECTION("is overridden by the environment") {
+    config.defer_span_sampling = GENERATE(false, true);
+    const std::string env_value = GENERATE("true", "false");
+    EnvGuard guard{"DD_TRACE_DEFER_SPAN_SAMPLING", env_value};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->defer_span_sampling == (env_value == "true"));
+  }
+}
+
+TEST_CASE("TracerConfig delegate trace sampling") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+  config.collector = std::make_shared<MockCollector>();
+
+  SECTION("is disabled by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->delegate_trace_sampling);
+  }
+
+  SECTION("is overridden by the environment") {
+    config.delegate_trace_sampling = GENERATE(false, true);
+    const std::string env_value = GENERATE("true", "false");
+    EnvGuard guard{"DD_TRACE_DELEGATE_SAMPLING", env_value};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->delegate_trace_sampling == (env_value == "true"));
+  }
+}
+
+TEST_CASE("TracerConfig active span as parent") {
+  TracerConfig config;
+  config.defaults.service = "testsvc";
+
+  SECTION("is disabled by default") {
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(!finalized->active_span_as_parent);
+  }
+
+  SECTION("is overridden by the environment") {
+    config.active_span_as_parent = GENERATE(false, true);
+    const std::string env_value = GENERATE("true", "false");
+    EnvGuard guard{"DD_TRACE_ACTIVE_SPAN_AS_PARENT", env_value};
+    auto finalized = finalize_config(config);
+    REQUIRE(finalized);
+    REQUIRE(finalized->active_span_as_parent == (env_value == "true"));
   }
 }
 
@@ -679,6 +2034,33 @@ TEST_CASE("TracerConfig::trace_sampler") {
     }
   }
 
+  SECTION("target_spans_per_second") {
+    SECTION("is unset by default") {
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(!finalized->trace_sampler.target_spans_per_second);
+    }
+
+    SECTION("is overridden by DD_TRACE_TARGET_SPANS_PER_SECOND") {
+      config.trace_sampler.target_spans_per_second = 1000;
+      const EnvGuard guard{"DD_TRACE_TARGET_SPANS_PER_SECOND", "250"};
+      auto finalized = finalize_config(config);
+      REQUIRE(finalized);
+      REQUIRE(finalized->trace_sampler.target_spans_per_second == 250);
+    }
+
+    SECTION("must be >0 and a finite number") {
+      auto target = GENERATE(0.0, -1.0, std::nan(""),
+                             std::numeric_limits<double>::infinity());
+      CAPTURE(target);
+      config.trace_sampler.target_spans_per_second = target;
+      auto finalized = finalize_config(config);
+      REQUIRE(!finalized);
+      REQUIRE(finalized.error().code ==
+              Error::TARGET_SPANS_PER_SECOND_OUT_OF_RANGE);
+    }
+  }
+
   SECTION("DD_TRACE_SAMPLING_RULES") {
     SECTION("sets sampling rules and overrides TraceSampler::rules") {
       TraceSamplerConfig::Rule config_rule;
@@ -1037,6 +2419,10 @@ TEST_CASE("TracerConfig propagation styles") {
           {__LINE__, "b3,,datadog", Error::UNKNOWN_PROPAGATION_STYLE},
           {__LINE__, "b3,datadog,w3c", Error::UNKNOWN_PROPAGATION_STYLE},
           {__LINE__, "b3,datadog,datadog", x, {true, true}},
+          {__LINE__, "b3single", x, {false, false, true}},
+          {__LINE__, "B3 B3Single", x, {false, true, true}},
+          {__LINE__, "tracecontext", x, {false, false, false, true}},
+          {__LINE__, "Datadog TraceContext", x, {true, false, false, true}},
           {__LINE__, "  b3 b3 b3, b3 , b3, b3, b3   , b3 b3 b3  ", x, {false, true}},
         }));
         // clang-format on
@@ -1056,6 +2442,10 @@ TEST_CASE("TracerConfig propagation styles") {
                   test_case.expected_styles.datadog);
           REQUIRE(finalized->injection_styles.b3 ==
                   test_case.expected_styles.b3);
+          REQUIRE(finalized->injection_styles.b3_single ==
+                  test_case.expected_styles.b3_single);
+          REQUIRE(finalized->injection_styles.w3c ==
+                  test_case.expected_styles.w3c);
         }
       }
     }
@@ -0,0 +1,168 @@
+// These are tests for the W3C Trace Context functions defined in
+// `w3c_propagation.h`.
+
+#include <datadog/error.h>
+#include <datadog/trace_id.h>
+#include <datadog/w3c_propagation.h>
+
+#include <optional>
+#include <string>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("parse_traceparent") {
+  SECTION("parses a valid traceparent") {
+    const auto result = parse_traceparent(
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+    REQUIRE(result);
+    REQUIRE(result->trace_id ==
+            TraceID(0xa3ce929d0e0e4736, 0x4bf92f3577b34da6));
+    REQUIRE(result->parent_id == 0x00f067aa0ba902b7);
+    REQUIRE(result->sampled);
+  }
+
+  SECTION("reads only the sampled flag") {
+    const auto result = parse_traceparent(
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-fe");
+    REQUIRE(result);
+    REQUIRE(!result->sampled);
+  }
+
+  SECTION("allows later versions to append fields") {
+    REQUIRE(parse_traceparent(
+        "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-extra"));
+  }
+
+  SECTION("rejects malformed values") {
+    auto value = GENERATE(
+        as<std::string>{}, "",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-extra",
+        "ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+        "00-00000000000000000000000000000000-00f067aa0ba902b7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e473g-00f067aa0ba902b7-01",
+        "00-4BF92F3577B34DA6A3CE929D0E0E4736-00F067AA0BA902B7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-0B",
+        "0A-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+        "00_4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01",
+        "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7_01",
+        "01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01x");
+    CAPTURE(value);
+    const auto result = parse_traceparent(value);
+    REQUIRE(!result);
+    REQUIRE(result.error().code == Error::MALFORMED_TRACEPARENT);
+  }
+}
+
+TEST_CASE("format_traceparent") {
+  TraceParentBuffer buffer;
+  REQUIRE(format_traceparent(buffer, TraceID(0xabc, 0x64d2f1a800000000),
+                             0xdef, true) ==
+          "00-64d2f1a8000000000000000000000abc-0000000000000def-01");
+  REQUIRE(format_traceparent(buffer, TraceID(1), 2, false) ==
+          "00-00000000000000000000000000000001-0000000000000002-00");
+
+  // What's formatted parses back into the same values.
+  const auto parsed = parse_traceparent(
+      format_traceparent(buffer, TraceID(0xabc, 0x123), 0xdef, true));
+  REQUIRE(parsed);
+  REQUIRE(parsed->trace_id == TraceID(0xabc, 0x123));
+  REQUIRE(parsed->parent_id == 0xdef);
+  REQUIRE(parsed->sampled);
+}
+
+TEST_CASE("tracestate") {
+  SECTION("finds the dd member among others") {
+    REQUIRE(find_datadog_member("a=1, dd=s:1 ,b=2") == "s:1");
+    REQUIRE(find_datadog_member("dd=s:1") == "s:1");
+    REQUIRE(!find_datadog_member("a=1,xdd=s:1"));
+    REQUIRE(!find_datadog_member(""));
+  }
+
+  SECTION("decodes the dd member") {
+    DatadogTraceStateBuffer buffer;
+    const auto state = parse_datadog_member(
+        buffer, "s:-1;o:synthetics~rum;t.dm:-4;t.usr.id:a~b;x");
+    REQUIRE(state.sampling_priority == -1);
+    REQUIRE(state.origin == "synthetics=rum");
+    REQUIRE(state.trace_tags == "_dd.p.dm=-4,_dd.p.usr.id=a=b");
+  }
+
+  SECTION("ignores a malformed sampling priority") {
+    DatadogTraceStateBuffer buffer;
+    const auto state = parse_datadog_member(buffer, "s:keep");
+    REQUIRE(!state.sampling_priority);
+    REQUIRE(!state.origin);
+    REQUIRE(!state.trace_tags);
+  }
+
+  SECTION("formats the dd member") {
+    TraceStateBuffer buffer;
+    REQUIRE(format_tracestate(buffer, 1, std::nullopt, "") == "dd=s:1");
+    REQUIRE(format_tracestate(
+                buffer, 2, std::string("syn;th=etics"),
+                "_dd.p.dm=-4,_dd.p.tid=64d2f1a800000000,other=x") ==
+            "dd=s:2;o:syn_th~etics;t.dm:-4");
+  }
+
+  SECTION("ignores trace tags that don't fit in the buffer") {
+    DatadogTraceStateBuffer buffer;
+    const std::string member =
+        "t.long:" + std::string(sizeof buffer, 'x') + ";t.dm:-4";
+    const auto state = parse_datadog_member(buffer, member);
+    REQUIRE(state.trace_tags == "_dd.p.dm=-4");
+  }
+
+  SECTION("formats a dd member without a sampling priority") {
+    TraceStateBuffer buffer;
+    REQUIRE(format_tracestate(buffer, std::nullopt, "rum", "_dd.p.dm=-4") ==
+            "dd=o:rum;t.dm:-4");
+    REQUIRE(format_tracestate(buffer, std::nullopt, std::nullopt, "").empty());
+  }
+
+  SECTION("omits trace tags that don't fit") {
+    TraceStateBuffer buffer;
+    const std::string long_value(250, 'x');
+    const auto formatted = format_tracestate(
+        buffer, 1, std::nullopt, "_dd.p.long=" + long_value + ",_dd.p.dm=-4");
+    REQUIRE(formatted == "dd=s:1;t.dm:-4");
+    REQUIRE(formatted.size() <= sizeof buffer);
+  }
+
+  SECTION("passes on the other vendors' members after the dd member") {
+    TraceStateBuffer buffer;
+    REQUIRE(format_tracestate(buffer, 1, std::nullopt, "",
+                              "foo=bar, dd=s:2;o:rum ,,baz=qux") ==
+            "dd=s:1,foo=bar,baz=qux");
+    REQUIRE(format_tracestate(buffer, std::nullopt, std::nullopt, "",
+                              "dd=s:2,foo=bar") == "foo=bar");
+    REQUIRE(format_tracestate(buffer, std::nullopt, std::nullopt, "",
+                              "dd=s:2") == "");
+  }
+
+  SECTION("passes on at most 32 members") {
+    TraceStateBuffer buffer;
+    std::string inbound;
+    for (int i = 0; i < 40; ++i) {
+      inbound += "v" + std::to_string(i) + "=x,";
+    }
+    std::string expected = "dd=s:1";
+    for (int i = 0; i < 31; ++i) {
+      expected += ",v" + std::to_string(i) + "=x";
+    }
+    REQUIRE(format_tracestate(buffer, 1, std::nullopt, "", inbound) ==
+            expected);
+  }
+
+  SECTION("omits other vendors' members that don't fit") {
+    TraceStateBuffer buffer;
+    const std::string inbound =
+        "long=" + std::string(sizeof buffer, 'x') + ",foo=bar";
+    const auto formatted =
+        format_tracestate(buffer, 1, std::nullopt, "", inbound);
+    REQUIRE(formatted == "dd=s:1,foo=bar");
+  }
+}
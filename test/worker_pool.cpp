@@ -0,0 +1,53 @@
+// These are tests for `WorkerPool`.  One test case forks, and the child
+// process runs a job and then exits.
+
+#include <datadog/worker_pool.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+#include "test.h"
+
+using namespace datadog::tracing;
+
+TEST_CASE("WorkerPool") {
+  const std::size_t threads = GENERATE(0, 1, 4);
+  WorkerPool pool{threads};
+  REQUIRE(pool.size() == threads);
+
+  SECTION("invokes each task exactly once") {
+    const std::size_t tasks = GENERATE(0, 1, 7, 1000);
+    std::vector<std::atomic<int>> invocations(tasks);
+    pool.run(tasks, [&](std::size_t task) { ++invocations[task]; });
+    for (const auto& count : invocations) {
+      REQUIRE(count == 1);
+    }
+  }
+
+  SECTION("runs one job after another") {
+    std::atomic<std::size_t> total{0};
+    for (int job = 0; job < 100; ++job) {
+      pool.run(10, [&](std::size_t task) { total += task; });
+    }
+    REQUIRE(total == 100 * 45);
+  }
+
+  SECTION("works in both processes after fork") {
+    const pid_t pid = ::fork();
+    std::atomic<std::size_t> total{0};
+    pool.run(100, [&](std::size_t task) { total += task; });
+    if (pid == 0) {
+      std::_Exit(total == 4950 ? 0 : 1);
+    }
+    REQUIRE(pid > 0);
+    REQUIRE(total == 4950);
+    int status = 0;
+    REQUIRE(::waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+  }
+}